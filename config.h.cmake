@@ -8,8 +8,15 @@
 #cmakedefine HAVE_LIBEXECINFO
 #cmakedefine HAVE_CXXABI_H
 #cmakedefine HAVE_NICE
+#cmakedefine HAVE_EPOLL
+#cmakedefine HAVE_INOTIFY
+#cmakedefine HAVE_MEMFD_CREATE
 #cmakedefine HAVE_EDITLINE
 #cmakedefine HAVE_SYSTEMD
+#cmakedefine HAVE_ZLIB
+#cmakedefine HAVE_JEMALLOC
+#cmakedefine HAVE_MIMALLOC
+#cmakedefine HAVE_MALLINFO2
 
 #cmakedefine ICINGA2_UNITY_BUILD
 
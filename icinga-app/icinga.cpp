@@ -278,6 +278,50 @@ static int Main()
 			}
 		}
 #endif /* RLIMIT_STACK */
+
+		String coroutineStackSize = Utility::GetFromEnvironment("ICINGA2_COROUTINE_STACK_SIZE");
+		if (!coroutineStackSize.IsEmpty()) {
+			try {
+				Configuration::CoroutineStackSize = Convert::ToLong(coroutineStackSize);
+			} catch (const std::invalid_argument& ex) {
+				std::cout
+					<< "Error setting \"ICINGA2_COROUTINE_STACK_SIZE\": " << ex.what() << '\n';
+				return EXIT_FAILURE;
+			}
+		}
+
+		String allocatorArenas = Utility::GetFromEnvironment("ICINGA2_ALLOCATOR_ARENAS");
+		if (!allocatorArenas.IsEmpty()) {
+			try {
+				Configuration::AllocatorArenas = Convert::ToLong(allocatorArenas);
+			} catch (const std::invalid_argument& ex) {
+				std::cout
+					<< "Error setting \"ICINGA2_ALLOCATOR_ARENAS\": " << ex.what() << '\n';
+				return EXIT_FAILURE;
+			}
+		}
+
+		String ioNumaAware = Utility::GetFromEnvironment("ICINGA2_IO_NUMA_AWARE");
+		if (!ioNumaAware.IsEmpty()) {
+			try {
+				Configuration::IoNumaAware = Convert::ToLong(ioNumaAware);
+			} catch (const std::invalid_argument& ex) {
+				std::cout
+					<< "Error setting \"ICINGA2_IO_NUMA_AWARE\": " << ex.what() << '\n';
+				return EXIT_FAILURE;
+			}
+		}
+
+		String tlsBufferSize = Utility::GetFromEnvironment("ICINGA2_TLS_BUFFER_SIZE");
+		if (!tlsBufferSize.IsEmpty()) {
+			try {
+				Configuration::TlsBufferSize = Convert::ToLong(tlsBufferSize);
+			} catch (const std::invalid_argument& ex) {
+				std::cout
+					<< "Error setting \"ICINGA2_TLS_BUFFER_SIZE\": " << ex.what() << '\n';
+				return EXIT_FAILURE;
+			}
+		}
 	}
 
 	/* Calculate additional global constants. */
@@ -448,6 +492,12 @@ static int Main()
 	/* Ensure that all defined constants work in the way we expect them. */
 	HandleLegacyDefines();
 
+	if (Configuration::TimerBackend == "wheel")
+		Timer::SetBackend(TimerBackendWheel);
+	else if (!Configuration::TimerBackend.IsEmpty() && Configuration::TimerBackend != "ordered")
+		Log(LogWarning, "icinga-app")
+			<< "Ignoring unknown timer backend '" << Configuration::TimerBackend << "', valid values are 'ordered' and 'wheel'.";
+
 	if (vm.count("script-debugger"))
 		Application::SetScriptDebuggerEnabled(true);
 
@@ -0,0 +1,136 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/allocator.hpp"
+#include "base/configuration.hpp"
+#include "base/logger.hpp"
+#include "base/metrics.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/statsfunction.hpp"
+#include <cstring>
+#include <mutex>
+
+#if defined(HAVE_JEMALLOC)
+#	include <jemalloc/jemalloc.h>
+#elif defined(HAVE_MIMALLOC)
+#	include <mimalloc.h>
+#elif defined(HAVE_MALLINFO2)
+#	include <malloc.h>
+#endif /* HAVE_JEMALLOC */
+
+using namespace icinga;
+
+REGISTER_STATSFUNCTION(Allocator, &Allocator::StatsFunc);
+
+static Gauge l_AllocatedBytes ("icinga_allocator_allocated_bytes", "Memory handed out by the allocator", "bytes", []() {
+	return Allocator::GetStats().Allocated;
+});
+
+static Gauge l_ResidentBytes ("icinga_allocator_resident_bytes", "Physical memory held by the allocator", "bytes", []() {
+	return Allocator::GetStats().Resident;
+});
+
+const char *Allocator::GetName()
+{
+#if defined(HAVE_JEMALLOC)
+	return "jemalloc";
+#elif defined(HAVE_MIMALLOC)
+	return "mimalloc";
+#else /* HAVE_JEMALLOC */
+	return "system";
+#endif /* HAVE_JEMALLOC */
+}
+
+/**
+ * Makes the current thread allocate from the arena shared by all threads of the given kind,
+ * if Configuration::AllocatorArenas is set.
+ *
+ * Only jemalloc needs this. mimalloc gives each thread its own heap anyway
+ * and glibc's arenas are tuned via the environment (MALLOC_ARENA_MAX).
+ */
+void Allocator::UseArena(AllocatorArena arena)
+{
+	if (!Configuration::AllocatorArenas)
+		return;
+
+#ifdef HAVE_JEMALLOC
+	static std::mutex mutex;
+	static unsigned arenas[AllocatorArenaCount];
+	static bool created[AllocatorArenaCount];
+
+	unsigned index;
+
+	{
+		std::unique_lock<std::mutex> lock (mutex);
+
+		if (!created[arena]) {
+			size_t size = sizeof(arenas[arena]);
+			int err = mallctl("arenas.create", &arenas[arena], &size, nullptr, 0);
+
+			if (err) {
+				Log(LogWarning, "Allocator")
+					<< "Cannot create jemalloc arena: " << strerror(err);
+				return;
+			}
+
+			created[arena] = true;
+		}
+
+		index = arenas[arena];
+	}
+
+	int err = mallctl("thread.arena", nullptr, nullptr, &index, sizeof(index));
+
+	if (err) {
+		Log(LogWarning, "Allocator")
+			<< "Cannot switch to jemalloc arena " << index << ": " << strerror(err);
+	}
+#else /* HAVE_JEMALLOC */
+	(void)arena;
+#endif /* HAVE_JEMALLOC */
+}
+
+/**
+ * Returns what the allocator currently holds. Both values are 0 if the
+ * system allocator can't tell.
+ */
+AllocatorStats Allocator::GetStats()
+{
+	AllocatorStats stats = { 0, 0 };
+
+#if defined(HAVE_JEMALLOC)
+	/* The statistics are only refreshed when the epoch advances. */
+	uint64_t epoch = 1;
+	size_t size = sizeof(epoch);
+	(void)mallctl("epoch", &epoch, &size, &epoch, size);
+
+	size = sizeof(size_t);
+	(void)mallctl("stats.allocated", &stats.Allocated, &size, nullptr, 0);
+	(void)mallctl("stats.resident", &stats.Resident, &size, nullptr, 0);
+#elif defined(HAVE_MIMALLOC)
+	size_t elapsed, user, system, peakRss, peakCommit, pageFaults;
+
+	/* mimalloc doesn't count the bytes in use cheaply, the committed ones are an upper bound. */
+	mi_process_info(&elapsed, &user, &system, &stats.Resident, &peakRss, &stats.Allocated, &peakCommit, &pageFaults);
+#elif defined(HAVE_MALLINFO2)
+	struct mallinfo2 info = mallinfo2();
+
+	stats.Allocated = info.uordblks + info.hblkhd;
+	stats.Resident = info.arena + info.hblkhd;
+#endif /* HAVE_JEMALLOC */
+
+	return stats;
+}
+
+void Allocator::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
+{
+	AllocatorStats stats = GetStats();
+
+	status->Set("allocator", new Dictionary({
+		{ "name", GetName() },
+		{ "allocated", stats.Allocated },
+		{ "resident", stats.Resident }
+	}));
+
+	perfdata->Add(new PerfdataValue("allocator_allocated", stats.Allocated, false, "B"));
+	perfdata->Add(new PerfdataValue("allocator_resident", stats.Resident, false, "B"));
+}
@@ -0,0 +1,61 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include "base/i2-base.hpp"
+#include "base/array.hpp"
+#include "base/dictionary.hpp"
+#include <cstddef>
+
+namespace icinga
+{
+
+/**
+ * The threads which get their own arena, so that their allocations don't
+ * interleave with (and fragment) those of all other threads.
+ *
+ * @ingroup base
+ */
+enum AllocatorArena
+{
+	AllocatorArenaIo,
+	AllocatorArenaWorkQueue,
+	AllocatorArenaCount
+};
+
+/**
+ * What the allocator holds, in bytes.
+ *
+ * @ingroup base
+ */
+struct AllocatorStats
+{
+	/* Handed out to the application. */
+	size_t Allocated;
+
+	/* Held in physical memory, i.e. Allocated plus fragmentation and caches. */
+	size_t Resident;
+};
+
+/**
+ * The malloc implementation Icinga 2 has been built with: jemalloc, mimalloc
+ * or the system's one.
+ *
+ * @ingroup base
+ */
+class Allocator
+{
+public:
+	static const char *GetName();
+
+	static void UseArena(AllocatorArena arena);
+
+	static AllocatorStats GetStats();
+
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+};
+
+}
+
+#endif /* ALLOCATOR_H */
@@ -14,6 +14,7 @@
 #include "base/convert.hpp"
 #include "base/scriptglobal.hpp"
 #include "base/process.hpp"
+#include "base/processhandoff.hpp"
 #include "base/tlsutility.hpp"
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/exception/errinfo_api_function.hpp>
@@ -339,6 +340,9 @@ void Application::RunEventLoop()
 
 	Log(LogInformation, "Application", "Shutting down...");
 
+	/* Lets the next worker process accept connections while we're still shutting down. */
+	ProcessHandoff::SendListeners();
+
 	ConfigObject::StopObjects();
 	Application::GetInstance()->OnShutdown();
 
@@ -6,6 +6,11 @@
 #include "base/scriptframe.hpp"
 #include "base/objectlock.hpp"
 #include "base/exception.hpp"
+#include "base/parallel.hpp"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
 
 using namespace icinga;
 
@@ -218,6 +223,164 @@ static bool ArrayAll(const Function::Ptr& function)
 
 	return true;
 }
+
+/* Parallel variants process at least that many items per thread */
+static const size_t l_ParallelGrain = 64;
+
+/**
+ * Copies the items so that the threads don't need the array's lock.
+ */
+static ArrayData GetArrayItems(const Array::Ptr& self)
+{
+	ObjectLock olock(self);
+	return ArrayData(self->Begin(), self->End());
+}
+
+/**
+ * Calls func for chunks of count items on the thread pool. Each chunk runs in
+ * a script frame which is sandboxed and nested as deep as the calling one.
+ */
+static void ParallelForFrames(const ScriptFrame *vframe, size_t count, const std::function<void (size_t, size_t)>& func)
+{
+	bool sandboxed = vframe->Sandboxed;
+	int depth = vframe->Depth;
+
+	ParallelForRanges(count, l_ParallelGrain, [sandboxed, depth, &func](size_t begin, size_t end) {
+		ScriptFrame frame (false);
+		frame.Sandboxed = sandboxed;
+		frame.Depth = depth;
+
+		func(begin, end);
+	});
+}
+
+static Array::Ptr ArrayParallelMap(const Function::Ptr& function)
+{
+	ScriptFrame *vframe = ScriptFrame::GetCurrentFrame();
+	Array::Ptr self = static_cast<Array::Ptr>(vframe->Self);
+	REQUIRE_NOT_NULL(self);
+	REQUIRE_NOT_NULL(function);
+
+	if (vframe->Sandboxed && !function->IsSideEffectFree())
+		BOOST_THROW_EXCEPTION(ScriptError("Map function must be side-effect free."));
+
+	ArrayData items = GetArrayItems(self);
+	ArrayData result (items.size());
+
+	ParallelForFrames(vframe, items.size(), [&function, &items, &result](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			result[i] = function->Invoke({ items[i] });
+	});
+
+	return new Array(std::move(result));
+}
+
+/**
+ * Reduces chunks of the array concurrently and then the chunks' results,
+ * so the function has to be associative.
+ */
+static Value ArrayParallelReduce(const Function::Ptr& function)
+{
+	ScriptFrame *vframe = ScriptFrame::GetCurrentFrame();
+	Array::Ptr self = static_cast<Array::Ptr>(vframe->Self);
+	REQUIRE_NOT_NULL(self);
+	REQUIRE_NOT_NULL(function);
+
+	if (vframe->Sandboxed && !function->IsSideEffectFree())
+		BOOST_THROW_EXCEPTION(ScriptError("Reduce function must be side-effect free."));
+
+	ArrayData items = GetArrayItems(self);
+
+	if (items.empty())
+		return Empty;
+
+	std::mutex mutex;
+	std::map<size_t, Value> partials;
+
+	ParallelForFrames(vframe, items.size(), [&function, &items, &mutex, &partials](size_t begin, size_t end) {
+		Value result = items[begin];
+
+		for (size_t i = begin + 1; i < end; i++)
+			result = function->Invoke({ result, items[i] });
+
+		std::unique_lock<std::mutex> lock (mutex);
+		partials.emplace(begin, std::move(result));
+	});
+
+	auto it (partials.begin());
+	Value result = it->second;
+
+	for (++it; it != partials.end(); ++it)
+		result = function->Invoke({ result, it->second });
+
+	return result;
+}
+
+static Array::Ptr ArrayParallelFilter(const Function::Ptr& function)
+{
+	ScriptFrame *vframe = ScriptFrame::GetCurrentFrame();
+	Array::Ptr self = static_cast<Array::Ptr>(vframe->Self);
+	REQUIRE_NOT_NULL(self);
+	REQUIRE_NOT_NULL(function);
+
+	if (vframe->Sandboxed && !function->IsSideEffectFree())
+		BOOST_THROW_EXCEPTION(ScriptError("Filter function must be side-effect free."));
+
+	ArrayData items = GetArrayItems(self);
+	std::vector<char> matches (items.size());
+
+	ParallelForFrames(vframe, items.size(), [&function, &items, &matches](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			matches[i] = function->Invoke({ items[i] }).ToBool();
+	});
+
+	ArrayData result;
+
+	for (size_t i = 0; i < items.size(); i++) {
+		if (matches[i])
+			result.push_back(std::move(items[i]));
+	}
+
+	return new Array(std::move(result));
+}
+
+/**
+ * Returns whether the function returns expected for any item. The other
+ * threads stop as soon as one item has been found.
+ */
+static bool ArrayParallelMatch(const Function::Ptr& function, bool expected)
+{
+	ScriptFrame *vframe = ScriptFrame::GetCurrentFrame();
+	Array::Ptr self = static_cast<Array::Ptr>(vframe->Self);
+	REQUIRE_NOT_NULL(self);
+	REQUIRE_NOT_NULL(function);
+
+	if (vframe->Sandboxed && !function->IsSideEffectFree())
+		BOOST_THROW_EXCEPTION(ScriptError("Filter function must be side-effect free."));
+
+	ArrayData items = GetArrayItems(self);
+	std::atomic<bool> found (false);
+
+	ParallelForFrames(vframe, items.size(), [&function, &items, &found, expected](size_t begin, size_t end) {
+		for (size_t i = begin; i < end && !found.load(std::memory_order_relaxed); i++) {
+			if (function->Invoke({ items[i] }).ToBool() == expected)
+				found.store(true);
+		}
+	});
+
+	return found.load();
+}
+
+static bool ArrayParallelAny(const Function::Ptr& function)
+{
+	return ArrayParallelMatch(function, true);
+}
+
+static bool ArrayParallelAll(const Function::Ptr& function)
+{
+	return !ArrayParallelMatch(function, false);
+}
+
 static Array::Ptr ArrayUnique()
 {
 	ScriptFrame *vframe = ScriptFrame::GetCurrentFrame();
@@ -252,6 +415,11 @@ Object::Ptr Array::GetPrototype()
 		{ "filter", new Function("Array#filter", ArrayFilter, { "func" }, true) },
 		{ "any", new Function("Array#any", ArrayAny, { "func" }, true) },
 		{ "all", new Function("Array#all", ArrayAll, { "func" }, true) },
+		{ "parallel_map", new Function("Array#parallel_map", ArrayParallelMap, { "func" }, true) },
+		{ "parallel_reduce", new Function("Array#parallel_reduce", ArrayParallelReduce, { "reduce" }, true) },
+		{ "parallel_filter", new Function("Array#parallel_filter", ArrayParallelFilter, { "func" }, true) },
+		{ "parallel_any", new Function("Array#parallel_any", ArrayParallelAny, { "func" }, true) },
+		{ "parallel_all", new Function("Array#parallel_all", ArrayParallelAll, { "func" }, true) },
 		{ "unique", new Function("Array#unique", ArrayUnique, {}, true) },
 		{ "freeze", new Function("Array#freeze", ArrayFreeze, {}) }
 	});
@@ -5,6 +5,7 @@
 
 #include "base/i2-base.hpp"
 #include "base/objectlock.hpp"
+#include "base/objectpool.hpp"
 #include "base/value.hpp"
 #include <boost/range/iterator.hpp>
 #include <vector>
@@ -24,6 +25,7 @@ class Array final : public Object
 {
 public:
 	DECLARE_OBJECT(Array);
+	IMPL_OBJECT_POOL(Array);
 
 	/**
 	 * An iterator that can be used to iterate over array elements.
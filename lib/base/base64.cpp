@@ -1,53 +1,122 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "base/base64.hpp"
-#include <openssl/bio.h>
-#include <openssl/evp.h>
-#include <openssl/buffer.h>
-#include <sstream>
+#include <cstdint>
+#include <stdexcept>
 
 using namespace icinga;
 
+static const char l_Base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* The value of every character in l_Base64Alphabet, -1 for all others. */
+static const signed char l_Base64Values[256] = {
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+	-1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+	-1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
 String Base64::Encode(const String& input)
 {
-	BIO *biomem = BIO_new(BIO_s_mem());
-	BIO *bio64 = BIO_new(BIO_f_base64());
-	BIO_push(bio64, biomem);
-	BIO_set_flags(bio64, BIO_FLAGS_BASE64_NO_NL);
-	BIO_write(bio64, input.CStr(), input.GetLength());
-	(void) BIO_flush(bio64);
+	auto in (reinterpret_cast<const unsigned char *>(input.CStr()));
+	size_t length = input.GetLength();
+
+	String result;
+	result.Append((length + 2) / 3 * 4, '=');
+
+	char *out = &result[0];
+	size_t i = 0;
+
+	for (; i + 3 <= length; i += 3) {
+		uint_fast32_t bits = uint_fast32_t(in[i]) << 16u | uint_fast32_t(in[i + 1]) << 8u | in[i + 2];
 
-	char *outbuf;
-	long len = BIO_get_mem_data(biomem, &outbuf);
+		*out++ = l_Base64Alphabet[bits >> 18u];
+		*out++ = l_Base64Alphabet[bits >> 12u & 63u];
+		*out++ = l_Base64Alphabet[bits >> 6u & 63u];
+		*out++ = l_Base64Alphabet[bits & 63u];
+	}
 
-	String ret = String(outbuf, outbuf + len);
-	BIO_free_all(bio64);
+	/* The remaining one or two bytes, padded with the '=' from above. */
+	if (i < length) {
+		uint_fast32_t bits = uint_fast32_t(in[i]) << 16u;
 
-	return ret;
+		if (i + 1 < length)
+			bits |= uint_fast32_t(in[i + 1]) << 8u;
+
+		*out++ = l_Base64Alphabet[bits >> 18u];
+		*out++ = l_Base64Alphabet[bits >> 12u & 63u];
+
+		if (i + 1 < length)
+			*out = l_Base64Alphabet[bits >> 6u & 63u];
+	}
+
+	return result;
 }
 
+/**
+ * Decodes base64 with or without padding.
+ *
+ * @throws std::invalid_argument if the input contains any other characters
+ */
 String Base64::Decode(const String& input)
 {
-	BIO *biomem = BIO_new_mem_buf(
-		const_cast<char*>(input.CStr()), input.GetLength());
-	BIO *bio64 = BIO_new(BIO_f_base64());
-	BIO_push(bio64, biomem);
-	BIO_set_flags(bio64, BIO_FLAGS_BASE64_NO_NL);
+	auto in (reinterpret_cast<const unsigned char *>(input.CStr()));
+	size_t length = input.GetLength();
+	size_t padding = 0;
 
-	auto *outbuf = new char[input.GetLength()];
+	while (length && padding < 2 && in[length - 1] == '=') {
+		length--;
+		padding++;
+	}
 
-	size_t len = 0;
-	int rc;
+	if (length % 4 == 1 || (padding && (length + padding) % 4))
+		throw std::invalid_argument("Not a valid base64 string");
 
-	while ((rc = BIO_read(bio64, outbuf + len, input.GetLength() - len)) > 0)
-		len += rc;
+	String result;
+	result.Append(length / 4 * 3 + (length % 4 ? length % 4 - 1 : 0), '\0');
 
-	String ret = String(outbuf, outbuf + len);
-	BIO_free_all(bio64);
-	delete [] outbuf;
+	char *out = &result[0];
+	size_t i = 0;
+	auto value ([in](size_t index) -> uint_fast32_t {
+		signed char value = l_Base64Values[in[index]];
 
-	if (ret.IsEmpty() && !input.IsEmpty())
-		throw std::invalid_argument("Not a valid base64 string");
+		if (value < 0)
+			throw std::invalid_argument("Not a valid base64 string");
+
+		return value;
+	});
+
+	for (; i + 4 <= length; i += 4) {
+		uint_fast32_t bits = value(i) << 18u | value(i + 1) << 12u | value(i + 2) << 6u | value(i + 3);
+
+		*out++ = bits >> 16u;
+		*out++ = bits >> 8u & 0xffu;
+		*out++ = bits & 0xffu;
+	}
+
+	if (i < length) {
+		uint_fast32_t bits = value(i) << 18u | value(i + 1) << 12u;
+
+		if (i + 2 < length)
+			bits |= value(i + 2) << 6u;
+
+		*out++ = bits >> 16u;
+
+		if (i + 2 < length)
+			*out = bits >> 8u & 0xffu;
+	}
 
-	return ret;
+	return result;
 }
@@ -0,0 +1,276 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef CONCURRENTINDEX_H
+#define CONCURRENTINDEX_H
+
+#include "base/i2-base.hpp"
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * A hash index whose lookups neither take a lock nor write to shared
+ * memory except for a reader counter.
+ *
+ * Changes are published RCU style: a new entry is linked into its bucket
+ * once it's complete and a removed entry (or the bucket array after it has
+ * been grown) is only freed once all lookups which may still see it have
+ * finished. Lookups register themselves in one of two counters for the
+ * current epoch, spread over several cache lines to keep the threads from
+ * fighting over them, and a writer which frees memory advances the epoch
+ * and waits for the counters of the previous one to drain.
+ *
+ * Lookups may run on any number of threads. Changes must be serialized
+ * by the caller, e.g. by the lock which also protects the list of all
+ * entries.
+ *
+ * @ingroup base
+ */
+template<class K, class V, class H = std::hash<K> >
+class ConcurrentIndex final
+{
+public:
+	ConcurrentIndex()
+		: m_Table(new Table(16))
+	{ }
+
+	ConcurrentIndex(const ConcurrentIndex&) = delete;
+	ConcurrentIndex& operator=(const ConcurrentIndex&) = delete;
+
+	~ConcurrentIndex()
+	{
+		Table *table = m_Table.load(std::memory_order_relaxed);
+		table->DeleteNodes();
+		delete table;
+	}
+
+	/**
+	 * Looks up a key. May be called by any number of threads at once and
+	 * while an entry is being added or removed.
+	 *
+	 * @param key The key
+	 * @param value Set to a copy of the key's value if there's one
+	 * @return Whether the key has been found
+	 */
+	bool Get(const K& key, V& value) const
+	{
+		ReadSection section (*this);
+		const Node *node = Find(m_Table.load(std::memory_order_acquire), key, H()(key));
+
+		if (!node)
+			return false;
+
+		value = node->Value;
+		return true;
+	}
+
+	/**
+	 * Adds an entry unless the key is already there. Must not run
+	 * concurrently with other changes.
+	 *
+	 * @return Whether the entry has been added
+	 */
+	bool Insert(const K& key, V value)
+	{
+		size_t hash = H()(key);
+		Table *table = m_Table.load(std::memory_order_relaxed);
+
+		if (Find(table, key, hash))
+			return false;
+
+		if (m_Size.load(std::memory_order_relaxed) >= table->Buckets.size())
+			table = Grow(table);
+
+		auto& bucket (table->Buckets[hash & table->Mask]);
+		Node *node = new Node(key, std::move(value), hash);
+
+		node->Next.store(bucket.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		bucket.store(node, std::memory_order_release);
+		m_Size.fetch_add(1, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	/**
+	 * Removes an entry and waits until no lookup can see it anymore.
+	 * Must not run concurrently with other changes.
+	 *
+	 * @return Whether the key has been found
+	 */
+	bool Erase(const K& key)
+	{
+		size_t hash = H()(key);
+		Table *table = m_Table.load(std::memory_order_relaxed);
+		std::atomic<Node *> *link = &table->Buckets[hash & table->Mask];
+
+		for (Node *node = link->load(std::memory_order_relaxed); node; node = link->load(std::memory_order_relaxed)) {
+			if (node->Hash == hash && node->Key == key) {
+				link->store(node->Next.load(std::memory_order_relaxed), std::memory_order_release);
+				m_Size.fetch_sub(1, std::memory_order_relaxed);
+
+				Synchronize();
+				delete node;
+				return true;
+			}
+
+			link = &node->Next;
+		}
+
+		return false;
+	}
+
+	size_t GetSize() const
+	{
+		return m_Size.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Node
+	{
+		K Key;
+		V Value;
+		size_t Hash;
+		std::atomic<Node *> Next{nullptr};
+
+		Node(K key, V value, size_t hash)
+			: Key(std::move(key)), Value(std::move(value)), Hash(hash)
+		{ }
+	};
+
+	struct Table
+	{
+		std::vector<std::atomic<Node *> > Buckets;
+		size_t Mask;
+
+		explicit Table(size_t size)
+			: Buckets(size), Mask(size - 1u)
+		{ }
+
+		void DeleteNodes()
+		{
+			for (auto& bucket : Buckets) {
+				Node *node = bucket.load(std::memory_order_relaxed);
+
+				while (node) {
+					Node *next = node->Next.load(std::memory_order_relaxed);
+					delete node;
+					node = next;
+				}
+			}
+		}
+	};
+
+	/* Padded to a cache line, alignas() would need an aligned new for the types embedding an index. */
+	struct ReaderCounter
+	{
+		std::atomic<size_t> Count{0};
+		char Padding[64 - sizeof(std::atomic<size_t>)];
+	};
+
+	static const size_t Stripes = 16;
+
+	std::atomic<Table *> m_Table;
+	std::atomic<size_t> m_Size{0};
+	std::atomic<size_t> m_Epoch{0};
+	mutable ReaderCounter m_Readers[2][Stripes];
+
+	/**
+	 * Keeps the nodes and the buckets a lookup may see alive.
+	 */
+	class ReadSection
+	{
+	public:
+		explicit ReadSection(const ConcurrentIndex& index)
+		{
+			static thread_local size_t stripe = std::hash<std::thread::id>()(std::this_thread::get_id()) % Stripes;
+
+			for (;;) {
+				size_t epoch = index.m_Epoch.load();
+
+				m_Counter = &index.m_Readers[epoch & 1u][stripe].Count;
+				m_Counter->fetch_add(1);
+
+				/* Otherwise the writer may not have seen us before it started to wait. */
+				if (index.m_Epoch.load() == epoch)
+					break;
+
+				m_Counter->fetch_sub(1, std::memory_order_release);
+			}
+		}
+
+		ReadSection(const ReadSection&) = delete;
+		ReadSection& operator=(const ReadSection&) = delete;
+
+		~ReadSection()
+		{
+			m_Counter->fetch_sub(1, std::memory_order_release);
+		}
+
+	private:
+		std::atomic<size_t> *m_Counter;
+	};
+
+	static const Node *Find(const Table *table, const K& key, size_t hash)
+	{
+		for (const Node *node = table->Buckets[hash & table->Mask].load(std::memory_order_acquire);
+			node; node = node->Next.load(std::memory_order_acquire)) {
+			if (node->Hash == hash && node->Key == key)
+				return node;
+		}
+
+		return nullptr;
+	}
+
+	/**
+	 * Replaces the bucket array with one of twice the size. Lookups which
+	 * still use the old one see all entries in it, they're copied rather
+	 * than relinked.
+	 */
+	Table *Grow(Table *table)
+	{
+		Table *grown = new Table(table->Buckets.size() * 2u);
+
+		for (auto& bucket : table->Buckets) {
+			for (Node *node = bucket.load(std::memory_order_relaxed); node; node = node->Next.load(std::memory_order_relaxed)) {
+				auto& target (grown->Buckets[node->Hash & grown->Mask]);
+				Node *copy = new Node(node->Key, node->Value, node->Hash);
+
+				copy->Next.store(target.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				target.store(copy, std::memory_order_relaxed);
+			}
+		}
+
+		m_Table.store(grown, std::memory_order_release);
+
+		Synchronize();
+		table->DeleteNodes();
+		delete table;
+
+		return grown;
+	}
+
+	/**
+	 * Waits for all lookups which started before the latest change.
+	 */
+	void Synchronize()
+	{
+		size_t epoch = m_Epoch.load(std::memory_order_relaxed);
+
+		m_Epoch.store(epoch + 1u);
+
+		for (auto& counter : m_Readers[epoch & 1u]) {
+			while (counter.Count.load(std::memory_order_acquire))
+				std::this_thread::yield();
+		}
+	}
+};
+
+}
+
+#endif /* CONCURRENTINDEX_H */
@@ -4,6 +4,7 @@
 #include "base/configobject-ti.cpp"
 #include "base/configtype.hpp"
 #include "base/serializer.hpp"
+#include "base/statefile.hpp"
 #include "base/netstring.hpp"
 #include "base/json.hpp"
 #include "base/stdiostream.hpp"
@@ -193,6 +194,8 @@ void ConfigObject::ModifyAttribute(const String& attr, const Value& value, bool
 	ValidateField(fid, Lazy<Value>{newValue}, utils);
 
 	SetField(fid, newValue);
+	m_ModifiedAttributesGeneration.fetch_add(1);
+	UpdateRevision();
 
 	if (updateVersion && (field.Attributes & FAConfig))
 		SetVersion(Utility::GetTime());
@@ -309,6 +312,8 @@ void ConfigObject::RestoreAttribute(const String& attr, bool updateVersion)
 
 	original_attributes->Remove(attr);
 	SetField(fid, newValue);
+	m_ModifiedAttributesGeneration.fetch_add(1);
+	UpdateRevision();
 
 	if (updateVersion)
 		SetVersion(Utility::GetTime());
@@ -324,6 +329,131 @@ bool ConfigObject::IsAttributeModified(const String& attr) const
 	return original_attributes->Contains(attr);
 }
 
+/**
+ * Get a counter which ModifyAttribute() and RestoreAttribute() increment
+ *
+ * Unlike the version it also changes if the version isn't updated, e.g. for state attributes.
+ *
+ * @return The number of attribute modifications so far
+ */
+uint_fast64_t ConfigObject::GetModifiedAttributesGeneration() const
+{
+	return m_ModifiedAttributesGeneration.load();
+}
+
+/**
+ * Get the revision of the object's last registration or attribute modification
+ *
+ * Revisions are comparable with ConfigType::GetRevision() of the object's type.
+ *
+ * @return The revision
+ */
+uint_fast64_t ConfigObject::GetRevision() const
+{
+	return m_Revision.load();
+}
+
+/**
+ * Returns an attribute serialized like Serialize(value, FAConfig | FAState)
+ * does. Object values, e.g. the custom variables or the last check result,
+ * of active objects are only serialized once until the attribute changes.
+ * The result is shared by all callers and must not be modified.
+ *
+ * @param fid The ID of the field
+ * @return The serialized value
+ */
+Value ConfigObject::GetSerializedField(int fid)
+{
+	static std::once_flag tracking;
+	std::call_once(tracking, &ConfigObject::TrackSerializedFields);
+
+	uint_fast64_t generation;
+
+	{
+		std::unique_lock<std::mutex> lock(m_SerializedFieldsMutex);
+
+		auto it (m_SerializedFields.find(fid));
+
+		if (it != m_SerializedFields.end())
+			return it->second;
+
+		generation = m_SerializedFieldsGeneration;
+	}
+
+	Value value = GetField(fid);
+	Value result = Serialize(value, FAConfig | FAState);
+	int attributes = GetReflectionType()->GetFieldInfo(fid).Attributes;
+
+	/* Only these are tracked, attributes without storage are computed. Scalars aren't worth it. */
+	if (!IsActive() || !value.IsObject() || (attributes & (FAConfig | FAState)) == 0 || (attributes & FANoStorage))
+		return result;
+
+	std::unique_lock<std::mutex> lock(m_SerializedFieldsMutex);
+
+	/* The attribute may have changed while it was serialized. */
+	if (generation == m_SerializedFieldsGeneration)
+		m_SerializedFields.emplace(fid, result);
+
+	return result;
+}
+
+/**
+ * Drops serialized attributes which have changed.
+ *
+ * @param fid The ID of the field, -1 for all
+ */
+void ConfigObject::InvalidateSerializedFields(int fid)
+{
+	std::unique_lock<std::mutex> lock(m_SerializedFieldsMutex);
+
+	m_SerializedFieldsGeneration++;
+
+	if (fid == -1)
+		m_SerializedFields.clear();
+	else
+		m_SerializedFields.erase(fid);
+}
+
+/**
+ * Registers handlers for the attributes of all config object types which
+ * drop the serialized attributes once they change.
+ */
+void ConfigObject::TrackSerializedFields()
+{
+	for (const Type::Ptr& type : Type::GetAllTypes()) {
+		if (!ConfigObject::TypeInstance->IsAssignableFrom(type))
+			continue;
+
+		/* Inherited fields are tracked by the base type already. */
+		Type::Ptr baseType = type->GetBaseType();
+		int start = baseType ? baseType->GetFieldCount() : 0;
+
+		for (int i = start; i < type->GetFieldCount(); i++) {
+			Field field = type->GetFieldInfo(i);
+
+			if ((field.Attributes & (FAConfig | FAState)) == 0 || (field.Attributes & FANoStorage))
+				continue;
+
+			type->RegisterAttributeHandler(i, [i](const Object::Ptr& object, const Value&) {
+				static_cast<ConfigObject *>(object.get())->InvalidateSerializedFields(i);
+			});
+		}
+	}
+}
+
+/**
+ * Assigns a new revision to the object after it has been changed.
+ */
+void ConfigObject::UpdateRevision()
+{
+	uint_fast64_t revision = ConfigType::NextRevision();
+
+	m_Revision.store(revision);
+
+	TypeImpl<ConfigObject>::Ptr type = static_pointer_cast<TypeImpl<ConfigObject> >(GetReflectionType());
+	type->UpdateRevision(revision);
+}
+
 void ConfigObject::Register()
 {
 	ASSERT(!OwnsLock());
@@ -355,6 +485,9 @@ void ConfigObject::PreActivate()
 
 	ASSERT(!IsActive());
 	SetActive(true, true);
+
+	/* The attribute handlers haven't been called while inactive. */
+	InvalidateSerializedFields();
 }
 
 void ConfigObject::Activate(bool runtimeCreated, const Value& cookie)
@@ -395,6 +528,7 @@ void ConfigObject::Deactivate(bool runtimeRemoved, const Value& cookie)
 			return;
 
 		SetActive(false, true);
+		InvalidateSerializedFields();
 
 		SetAuthority(false);
 
@@ -465,53 +599,7 @@ void ConfigObject::SetAuthority(bool authority)
 
 void ConfigObject::DumpObjects(const String& filename, int attributeTypes)
 {
-	Log(LogInformation, "ConfigObject")
-		<< "Dumping program state to file '" << filename << "'";
-
-	try {
-		Utility::Glob(filename + ".tmp.*", &Utility::Remove, GlobFile);
-	} catch (const std::exception& ex) {
-		Log(LogWarning, "ConfigObject") << DiagnosticInformation(ex);
-	}
-
-	std::fstream fp;
-	String tempFilename = Utility::CreateTempFile(filename + ".tmp.XXXXXX", 0600, fp);
-	fp.exceptions(std::ofstream::failbit | std::ofstream::badbit);
-
-	if (!fp)
-		BOOST_THROW_EXCEPTION(std::runtime_error("Could not open '" + tempFilename + "' file"));
-
-	StdioStream::Ptr sfp = new StdioStream(&fp, false);
-
-	for (const Type::Ptr& type : Type::GetAllTypes()) {
-		auto *dtype = dynamic_cast<ConfigType *>(type.get());
-
-		if (!dtype)
-			continue;
-
-		for (const ConfigObject::Ptr& object : dtype->GetObjects()) {
-			Dictionary::Ptr update = Serialize(object, attributeTypes);
-
-			if (!update)
-				continue;
-
-			Dictionary::Ptr persistentObject = new Dictionary({
-				{ "type", type->GetName() },
-				{ "name", object->GetName() },
-				{ "update", update }
-			});
-
-			String json = JsonEncode(persistentObject);
-
-			NetString::WriteStringToStream(sfp, json);
-		}
-	}
-
-	sfp->Close();
-
-	fp.close();
-
-	Utility::RenameFile(tempFilename, filename);
+	StateFile::Dump(filename, attributeTypes);
 }
 
 void ConfigObject::RestoreObject(const String& message, int attributeTypes)
@@ -544,34 +632,39 @@ void ConfigObject::RestoreObjects(const String& filename, int attributeTypes)
 	Log(LogInformation, "ConfigObject")
 		<< "Restoring program state from file '" << filename << "'";
 
-	std::fstream fp;
-	fp.open(filename.CStr(), std::ios_base::in);
+	unsigned long restored = 0;
 
-	StdioStream::Ptr sfp = new StdioStream (&fp, false);
+	if (StateFile::IsStateFile(filename)) {
+		restored = StateFile::Restore(filename, attributeTypes);
+	} else {
+		/* Written by an older version */
+		std::fstream fp;
+		fp.open(filename.CStr(), std::ios_base::in);
 
-	unsigned long restored = 0;
+		StdioStream::Ptr sfp = new StdioStream (&fp, false);
 
-	WorkQueue upq(25000, Configuration::Concurrency);
-	upq.SetName("ConfigObject::RestoreObjects");
+		WorkQueue upq(25000, Configuration::Concurrency);
+		upq.SetName("ConfigObject::RestoreObjects");
 
-	String message;
-	StreamReadContext src;
-	for (;;) {
-		StreamReadStatus srs = NetString::ReadStringFromStream(sfp, &message, src);
+		String message;
+		StreamReadContext src;
+		for (;;) {
+			StreamReadStatus srs = NetString::ReadStringFromStream(sfp, &message, src);
 
-		if (srs == StatusEof)
-			break;
+			if (srs == StatusEof)
+				break;
 
-		if (srs != StatusNewItem)
-			continue;
+			if (srs != StatusNewItem)
+				continue;
 
-		upq.Enqueue([message, attributeTypes]() { RestoreObject(message, attributeTypes); });
-		restored++;
-	}
+			upq.Enqueue([message, attributeTypes]() { RestoreObject(message, attributeTypes); });
+			restored++;
+		}
 
-	sfp->Close();
+		sfp->Close();
 
-	upq.Join();
+		upq.Join();
+	}
 
 	unsigned long no_state = 0;
 
@@ -711,5 +804,14 @@ Dictionary::Ptr ConfigObject::GetSourceLocation() const
 	});
 }
 
+/**
+ * Returns how many CPU seconds per second this object is expected to cost
+ * the endpoint which has its authority, see ApiListener::UpdateAuthorityLoad().
+ */
+double ConfigObject::GetAuthorityLoad() const
+{
+	return 0;
+}
+
 NameComposer::~NameComposer()
 { }
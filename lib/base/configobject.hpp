@@ -4,11 +4,15 @@
 #define CONFIGOBJECT_H
 
 #include "base/i2-base.hpp"
+#include "base/atomic.hpp"
 #include "base/configobject-ti.hpp"
 #include "base/object.hpp"
 #include "base/type.hpp"
 #include "base/dictionary.hpp"
 #include <boost/signals2.hpp>
+#include <cstdint>
+#include <map>
+#include <mutex>
 
 namespace icinga
 {
@@ -39,6 +43,12 @@ public:
 	void ModifyAttribute(const String& attr, const Value& value, bool updateVersion = true);
 	void RestoreAttribute(const String& attr, bool updateVersion = true);
 	bool IsAttributeModified(const String& attr) const;
+	uint_fast64_t GetModifiedAttributesGeneration() const;
+
+	uint_fast64_t GetRevision() const;
+	void UpdateRevision();
+
+	Value GetSerializedField(int fid);
 
 	void Register();
 	void Unregister();
@@ -61,6 +71,8 @@ public:
 
 	Dictionary::Ptr GetSourceLocation() const override;
 
+	virtual double GetAuthorityLoad() const;
+
 	template<typename T>
 	static intrusive_ptr<T> GetObject(const String& name)
 	{
@@ -80,7 +92,20 @@ public:
 	static Object::Ptr GetPrototype();
 
 private:
+	friend class StateFile;
+
 	ConfigObject::Ptr m_Zone;
+	Atomic<uint_fast64_t> m_ModifiedAttributesGeneration {0};
+	Atomic<uint_fast64_t> m_Revision {0};
+
+	std::mutex m_SerializedFieldsMutex;
+	std::map<int, Value> m_SerializedFields; /**< Protected by m_SerializedFieldsMutex. */
+	uint_fast64_t m_SerializedFieldsGeneration{0}; /**< Protected by m_SerializedFieldsMutex. */
+
+	void InvalidateSerializedFields(int fid = -1);
+	static void TrackSerializedFields();
+	String m_StateHash; /**< Hash of the state which was last written to the state file. */
+	Atomic<bool> m_StateDirty {false};
 
 	static void RestoreObject(const String& message, int attributeTypes);
 };
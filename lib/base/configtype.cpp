@@ -3,22 +3,23 @@
 #include "base/configobject.hpp"
 #include "base/convert.hpp"
 #include "base/exception.hpp"
+#include "base/utility.hpp"
 
 using namespace icinga;
 
+/* Starts with the current time in microseconds, so that revisions keep increasing across restarts. */
+static std::atomic<uint_fast64_t> l_NextRevision (Utility::GetTime() * 1000000);
+
 ConfigType::~ConfigType()
 { }
 
 ConfigObject::Ptr ConfigType::GetObject(const String& name) const
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	ConfigObject::Ptr object;
 
-	auto nt = m_ObjectMap.find(name);
+	m_ObjectIndex.Get(name, object);
 
-	if (nt == m_ObjectMap.end())
-		return nullptr;
-
-	return nt->second;
+	return object;
 }
 
 void ConfigType::RegisterObject(const ConfigObject::Ptr& object)
@@ -28,22 +29,26 @@ void ConfigType::RegisterObject(const ConfigObject::Ptr& object)
 	{
 		std::unique_lock<std::mutex> lock(m_Mutex);
 
-		auto it = m_ObjectMap.find(name);
+		ConfigObject::Ptr existing;
 
-		if (it != m_ObjectMap.end()) {
-			if (it->second == object)
+		if (m_ObjectIndex.Get(name, existing)) {
+			if (existing == object)
 				return;
 
 			auto *type = dynamic_cast<Type *>(this);
 
 			BOOST_THROW_EXCEPTION(ScriptError("An object with type '" + type->GetName() + "' and name '" + name + "' already exists (" +
-				Convert::ToString(it->second->GetDebugInfo()) + "), new declaration: " + Convert::ToString(object->GetDebugInfo()),
+				Convert::ToString(existing->GetDebugInfo()) + "), new declaration: " + Convert::ToString(object->GetDebugInfo()),
 				object->GetDebugInfo()));
 		}
 
-		m_ObjectMap[name] = object;
+		m_ObjectIndex.Insert(name, object);
 		m_ObjectVector.push_back(object);
+		m_Epoch++;
+		std::atomic_store(&m_Snapshot, ConfigTypeSnapshot::ConstPtr());
 	}
+
+	object->UpdateRevision();
 }
 
 void ConfigType::UnregisterObject(const ConfigObject::Ptr& object)
@@ -53,9 +58,13 @@ void ConfigType::UnregisterObject(const ConfigObject::Ptr& object)
 	{
 		std::unique_lock<std::mutex> lock(m_Mutex);
 
-		m_ObjectMap.erase(name);
+		m_ObjectIndex.Erase(name);
 		m_ObjectVector.erase(std::remove(m_ObjectVector.begin(), m_ObjectVector.end(), object), m_ObjectVector.end());
+		m_Epoch++;
+		std::atomic_store(&m_Snapshot, ConfigTypeSnapshot::ConstPtr());
 	}
+
+	UpdateRevision(NextRevision());
 }
 
 std::vector<ConfigObject::Ptr> ConfigType::GetObjects() const
@@ -64,13 +73,76 @@ std::vector<ConfigObject::Ptr> ConfigType::GetObjects() const
 	return m_ObjectVector;
 }
 
+/**
+ * Returns the objects registered so far without copying them for every
+ * caller. The snapshot is built by the first reader after a change and
+ * shared with all readers until the next one, so config loading doesn't pay
+ * a copy per registered object.
+ */
+ConfigTypeSnapshot::ConstPtr ConfigType::GetSnapshot() const
+{
+	auto snapshot (std::atomic_load(&m_Snapshot));
+
+	if (snapshot)
+		return snapshot;
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	snapshot = std::atomic_load(&m_Snapshot);
+
+	if (!snapshot) {
+		auto fresh (std::make_shared<ConfigTypeSnapshot>());
+		fresh->Epoch = m_Epoch;
+		fresh->Objects = m_ObjectVector;
+
+		snapshot = fresh;
+		std::atomic_store(&m_Snapshot, snapshot);
+	}
+
+	return snapshot;
+}
+
 std::vector<ConfigObject::Ptr> ConfigType::GetObjectsHelper(Type *type)
 {
 	return static_cast<TypeImpl<ConfigObject> *>(type)->GetObjects();
 }
 
+ConfigTypeSnapshot::ConstPtr ConfigType::GetSnapshotHelper(Type *type)
+{
+	return static_cast<TypeImpl<ConfigObject> *>(type)->GetSnapshot();
+}
+
 int ConfigType::GetObjectCount() const
 {
 	std::unique_lock<std::mutex> lock(m_Mutex);
 	return m_ObjectVector.size();
 }
+
+/**
+ * Returns the revision of the latest change to this type's objects, i.e.
+ * an object being registered, unregistered or having its attributes
+ * modified. It doesn't change with the objects' state.
+ */
+uint_fast64_t ConfigType::GetRevision() const
+{
+	return m_Revision.load();
+}
+
+/**
+ * Raises the revision returned by GetRevision(), it never decreases.
+ */
+void ConfigType::UpdateRevision(uint_fast64_t revision)
+{
+	uint_fast64_t current = m_Revision.load();
+
+	while (current < revision && !m_Revision.compare_exchange_weak(current, revision))
+		;
+}
+
+/**
+ * Returns a new revision which is greater than all revisions returned so far.
+ */
+uint_fast64_t ConfigType::NextRevision()
+{
+	return l_NextRevision.fetch_add(1) + 1;
+}
@@ -4,16 +4,98 @@
 #define CONFIGTYPE_H
 
 #include "base/i2-base.hpp"
+#include "base/concurrentindex.hpp"
 #include "base/object.hpp"
 #include "base/type.hpp"
 #include "base/dictionary.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <mutex>
+#include <vector>
 
 namespace icinga
 {
 
 class ConfigObject;
 
+/**
+ * An immutable list of a type's objects as of a given epoch. Holding one
+ * doesn't block registering or unregistering objects.
+ *
+ * @ingroup base
+ */
+struct ConfigTypeSnapshot
+{
+	typedef std::shared_ptr<const ConfigTypeSnapshot> ConstPtr;
+
+	uint64_t Epoch;
+	std::vector<intrusive_ptr<ConfigObject> > Objects;
+};
+
+/**
+ * Iterates over a snapshot's objects as raw pointers to T, i.e. without
+ * copying the list or touching the objects' reference counts. The view
+ * keeps the snapshot and thereby all of its objects alive.
+ *
+ * @ingroup base
+ */
+template<typename T>
+class ConfigObjectsView
+{
+public:
+	class Iterator
+	{
+	public:
+		typedef std::vector<intrusive_ptr<ConfigObject> >::const_iterator BaseIterator;
+
+		explicit Iterator(BaseIterator it)
+			: m_It(it)
+		{ }
+
+		T *operator*() const
+		{
+			return static_cast<T *>(m_It->get());
+		}
+
+		Iterator& operator++()
+		{
+			++m_It;
+			return *this;
+		}
+
+		bool operator!=(const Iterator& other) const
+		{
+			return m_It != other.m_It;
+		}
+
+	private:
+		BaseIterator m_It;
+	};
+
+	explicit ConfigObjectsView(ConfigTypeSnapshot::ConstPtr snapshot)
+		: m_Snapshot(std::move(snapshot))
+	{ }
+
+	Iterator begin() const
+	{
+		return Iterator(m_Snapshot->Objects.begin());
+	}
+
+	Iterator end() const
+	{
+		return Iterator(m_Snapshot->Objects.end());
+	}
+
+	size_t size() const
+	{
+		return m_Snapshot->Objects.size();
+	}
+
+private:
+	ConfigTypeSnapshot::ConstPtr m_Snapshot;
+};
+
 class ConfigType
 {
 public:
@@ -36,26 +118,53 @@ public:
 	template<typename T>
 	static std::vector<intrusive_ptr<T> > GetObjectsByType()
 	{
-		std::vector<intrusive_ptr<ConfigObject> > objects = GetObjectsHelper(T::TypeInstance.get());
+		ConfigTypeSnapshot::ConstPtr snapshot = GetSnapshotHelper(T::TypeInstance.get());
 		std::vector<intrusive_ptr<T> > result;
-		result.reserve(objects.size());
-for (const auto& object : objects) {
+		result.reserve(snapshot->Objects.size());
+		for (const auto& object : snapshot->Objects) {
 			result.push_back(static_pointer_cast<T>(object));
 		}
 		return result;
 	}
 
+	ConfigTypeSnapshot::ConstPtr GetSnapshot() const;
+
+	template<typename T>
+	static ConfigTypeSnapshot::ConstPtr GetSnapshotByType()
+	{
+		return GetSnapshotHelper(T::TypeInstance.get());
+	}
+
+	/**
+	 * Prefer this over GetObjectsByType() for sweeps over all objects of
+	 * a type which don't need the objects' Ptr.
+	 */
+	template<typename T>
+	static ConfigObjectsView<T> GetObjectsViewByType()
+	{
+		return ConfigObjectsView<T>(GetSnapshotHelper(T::TypeInstance.get()));
+	}
+
 	int GetObjectCount() const;
 
+	uint_fast64_t GetRevision() const;
+	void UpdateRevision(uint_fast64_t revision);
+
+	static uint_fast64_t NextRevision();
+
 private:
-	typedef std::map<String, intrusive_ptr<ConfigObject> > ObjectMap;
+	typedef ConcurrentIndex<String, intrusive_ptr<ConfigObject> > ObjectIndex;
 	typedef std::vector<intrusive_ptr<ConfigObject> > ObjectVector;
 
 	mutable std::mutex m_Mutex;
-	ObjectMap m_ObjectMap;
+	ObjectIndex m_ObjectIndex; /**< Changed while holding m_Mutex, looked up without it. */
 	ObjectVector m_ObjectVector;
+	uint64_t m_Epoch{0};
+	mutable ConfigTypeSnapshot::ConstPtr m_Snapshot;
+	std::atomic<uint_fast64_t> m_Revision{0}; /**< The latest revision of any of the objects, see NextRevision(). */
 
 	static std::vector<intrusive_ptr<ConfigObject> > GetObjectsHelper(Type *type);
+	static ConfigTypeSnapshot::ConstPtr GetSnapshotHelper(Type *type);
 };
 
 }
@@ -8,16 +8,19 @@ using namespace icinga;
 
 REGISTER_TYPE(Configuration);
 
+bool Configuration::AllocatorArenas{true};
 String Configuration::ApiBindHost{"::"};
 String Configuration::ApiBindPort{"5665"};
 bool Configuration::AttachDebugger{false};
 String Configuration::CacheDir;
 int Configuration::Concurrency{static_cast<int>(std::thread::hardware_concurrency())};
 String Configuration::ConfigDir;
+int Configuration::CoroutineStackSize;
 String Configuration::DataDir;
 String Configuration::EventEngine;
 String Configuration::IncludeConfDir;
 String Configuration::InitRunDir;
+bool Configuration::IoNumaAware{false};
 String Configuration::LogDir;
 String Configuration::ModAttrPath;
 String Configuration::ObjectsPath;
@@ -32,6 +35,8 @@ String Configuration::RunAsGroup;
 String Configuration::RunAsUser;
 String Configuration::SpoolDir;
 String Configuration::StatePath;
+String Configuration::TimerBackend;
+int Configuration::TlsBufferSize{0};
 double Configuration::TlsHandshakeTimeout{10};
 String Configuration::VarsPath;
 String Configuration::ZonesDir;
@@ -53,6 +58,16 @@ void HandleUserWrite(const String& name, T *target, const T& value, bool readOnl
 	*target = value;
 }
 
+bool Configuration::GetAllocatorArenas() const
+{
+	return Configuration::AllocatorArenas;
+}
+
+void Configuration::SetAllocatorArenas(bool val, bool suppress_events, const Value& cookie)
+{
+	HandleUserWrite("AllocatorArenas", &Configuration::AllocatorArenas, val, m_ReadOnly);
+}
+
 String Configuration::GetApiBindHost() const
 {
 	return Configuration::ApiBindHost;
@@ -113,6 +128,16 @@ void Configuration::SetConfigDir(const String& val, bool suppress_events, const
 	HandleUserWrite("ConfigDir", &Configuration::ConfigDir, val, m_ReadOnly);
 }
 
+int Configuration::GetCoroutineStackSize() const
+{
+	return Configuration::CoroutineStackSize;
+}
+
+void Configuration::SetCoroutineStackSize(int val, bool suppress_events, const Value& cookie)
+{
+	HandleUserWrite("CoroutineStackSize", &Configuration::CoroutineStackSize, val, m_ReadOnly);
+}
+
 String Configuration::GetDataDir() const
 {
 	return Configuration::DataDir;
@@ -153,6 +178,16 @@ void Configuration::SetInitRunDir(const String& val, bool suppress_events, const
 	HandleUserWrite("InitRunDir", &Configuration::InitRunDir, val, m_ReadOnly);
 }
 
+bool Configuration::GetIoNumaAware() const
+{
+	return Configuration::IoNumaAware;
+}
+
+void Configuration::SetIoNumaAware(bool val, bool suppress_events, const Value& cookie)
+{
+	HandleUserWrite("IoNumaAware", &Configuration::IoNumaAware, val, m_ReadOnly);
+}
+
 String Configuration::GetLogDir() const
 {
 	return Configuration::LogDir;
@@ -293,6 +328,26 @@ void Configuration::SetStatePath(const String& val, bool suppress_events, const
 	HandleUserWrite("StatePath", &Configuration::StatePath, val, m_ReadOnly);
 }
 
+String Configuration::GetTimerBackend() const
+{
+	return Configuration::TimerBackend;
+}
+
+void Configuration::SetTimerBackend(const String& val, bool suppress_events, const Value& cookie)
+{
+	HandleUserWrite("TimerBackend", &Configuration::TimerBackend, val, m_ReadOnly);
+}
+
+int Configuration::GetTlsBufferSize() const
+{
+	return Configuration::TlsBufferSize;
+}
+
+void Configuration::SetTlsBufferSize(int val, bool suppress_events, const Value& cookie)
+{
+	HandleUserWrite("TlsBufferSize", &Configuration::TlsBufferSize, val, m_ReadOnly);
+}
+
 double Configuration::GetTlsHandshakeTimeout() const
 {
 	return Configuration::TlsHandshakeTimeout;
@@ -19,6 +19,9 @@ class Configuration : public ObjectImpl<Configuration>
 public:
 	DECLARE_OBJECT(Configuration);
 
+	bool GetAllocatorArenas() const override;
+	void SetAllocatorArenas(bool value, bool suppress_events = false, const Value& cookie = Empty) override;
+
 	String GetApiBindHost() const override;
 	void SetApiBindHost(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
@@ -37,6 +40,9 @@ public:
 	String GetConfigDir() const override;
 	void SetConfigDir(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
+	int GetCoroutineStackSize() const override;
+	void SetCoroutineStackSize(int value, bool suppress_events = false, const Value& cookie = Empty) override;
+
 	String GetDataDir() const override;
 	void SetDataDir(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
@@ -49,6 +55,9 @@ public:
 	String GetInitRunDir() const override;
 	void SetInitRunDir(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
+	bool GetIoNumaAware() const override;
+	void SetIoNumaAware(bool value, bool suppress_events = false, const Value& cookie = Empty) override;
+
 	String GetLogDir() const override;
 	void SetLogDir(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
@@ -91,6 +100,12 @@ public:
 	String GetStatePath() const override;
 	void SetStatePath(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
 
+	String GetTimerBackend() const override;
+	void SetTimerBackend(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
+
+	int GetTlsBufferSize() const override;
+	void SetTlsBufferSize(int value, bool suppress_events = false, const Value& cookie = Empty) override;
+
 	double GetTlsHandshakeTimeout() const override;
 	void SetTlsHandshakeTimeout(double value, bool suppress_events = false, const Value& cookie = Empty) override;
 
@@ -113,16 +128,19 @@ public:
 	static bool GetReadOnly();
 	static void SetReadOnly(bool readOnly);
 
+	static bool AllocatorArenas;
 	static String ApiBindHost;
 	static String ApiBindPort;
 	static bool AttachDebugger;
 	static String CacheDir;
 	static int Concurrency;
 	static String ConfigDir;
+	static int CoroutineStackSize;
 	static String DataDir;
 	static String EventEngine;
 	static String IncludeConfDir;
 	static String InitRunDir;
+	static bool IoNumaAware;
 	static String LogDir;
 	static String ModAttrPath;
 	static String ObjectsPath;
@@ -137,6 +155,8 @@ public:
 	static String RunAsUser;
 	static String SpoolDir;
 	static String StatePath;
+	static String TimerBackend;
+	static int TlsBufferSize;
 	static double TlsHandshakeTimeout;
 	static String VarsPath;
 	static String ZonesDir;
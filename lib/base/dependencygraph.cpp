@@ -1,45 +1,75 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "base/dependencygraph.hpp"
+#include "base/profiler.hpp"
+#include <array>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <unordered_map>
 
 using namespace icinga;
 
-std::mutex DependencyGraph::m_Mutex;
-std::map<Object *, std::map<Object *, int> > DependencyGraph::m_Dependencies;
+/**
+ * The parents of some of the children.
+ */
+struct DependencyGraphShard
+{
+	std::mutex Mutex;
+	std::unordered_map<Object *, std::map<Object *, int> > Dependencies;
+};
+
+static std::array<DependencyGraphShard, 64> l_DependencyGraphShards;
+
+static inline DependencyGraphShard& GetShard(Object *child)
+{
+	/* The lowest bits are the same for all objects due to alignment. */
+	return l_DependencyGraphShards[(reinterpret_cast<uintptr_t>(child) >> 4u) % l_DependencyGraphShards.size()];
+}
 
 void DependencyGraph::AddDependency(Object *parent, Object *child)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
-	m_Dependencies[child][parent]++;
+	auto& shard (GetShard(child));
+
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(shard.Mutex));
+	shard.Dependencies[child][parent]++;
 }
 
 void DependencyGraph::RemoveDependency(Object *parent, Object *child)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	auto& shard (GetShard(child));
 
-	auto& refs = m_Dependencies[child];
-	auto it = refs.find(parent);
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(shard.Mutex));
 
-	if (it == refs.end())
+	auto refs (shard.Dependencies.find(child));
+
+	if (refs == shard.Dependencies.end())
+		return;
+
+	auto it = refs->second.find(parent);
+
+	if (it == refs->second.end())
 		return;
 
 	it->second--;
 
 	if (it->second == 0)
-		refs.erase(it);
+		refs->second.erase(it);
 
-	if (refs.empty())
-		m_Dependencies.erase(child);
+	if (refs->second.empty())
+		shard.Dependencies.erase(refs);
 }
 
 std::vector<Object::Ptr> DependencyGraph::GetParents(const Object::Ptr& child)
 {
 	std::vector<Object::Ptr> objects;
 
-	std::unique_lock<std::mutex> lock(m_Mutex);
-	auto it = m_Dependencies.find(child.get());
+	auto& shard (GetShard(child.get()));
+
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(shard.Mutex));
+	auto it = shard.Dependencies.find(child.get());
 
-	if (it != m_Dependencies.end()) {
+	if (it != shard.Dependencies.end()) {
 		typedef std::pair<Object *, int> kv_pair;
 		for (const kv_pair& kv : it->second) {
 			objects.emplace_back(kv.first);
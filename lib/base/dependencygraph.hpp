@@ -5,14 +5,16 @@
 
 #include "base/i2-base.hpp"
 #include "base/object.hpp"
-#include <map>
-#include <mutex>
+#include <vector>
 
 namespace icinga {
 
 /**
  * A graph that tracks dependencies between objects.
  *
+ * The children are spread over shards with a lock each, so that e.g. config
+ * commit threads setting references don't all serialize on one lock.
+ *
  * @ingroup base
  */
 class DependencyGraph
@@ -24,9 +26,6 @@ public:
 
 private:
 	DependencyGraph();
-
-	static std::mutex m_Mutex;
-	static std::map<Object *, std::map<Object *, int> > m_Dependencies;
 };
 
 }
@@ -5,29 +5,128 @@
 #include "base/debug.hpp"
 #include "base/primitivetype.hpp"
 #include "base/configwriter.hpp"
+#include <algorithm>
 #include <sstream>
 
 using namespace icinga;
 
-template class std::map<String, Value>;
+template class std::vector<Dictionary::Pair>;
 
 REGISTER_PRIMITIVE_TYPE(Dictionary, Object, Dictionary::GetPrototype());
 
+const Dictionary::SizeType Dictionary::IndexThreshold = 32;
+
+static bool DictionaryKeyLess(const Dictionary::Pair& lhs, const Dictionary::Pair& rhs)
+{
+	return lhs.first < rhs.first;
+}
+
+static boost::string_view DictionaryIndexKey(const String& key)
+{
+	return boost::string_view(key.CStr(), key.GetLength());
+}
+
 Dictionary::Dictionary(const DictionaryData& other)
 {
+	std::vector<Pair> data;
+	data.reserve(other.size());
+
 	for (const auto& kv : other)
-		m_Data.insert(kv);
+		data.emplace_back(kv.first, kv.second);
+
+	Assign(std::move(data));
 }
 
 Dictionary::Dictionary(DictionaryData&& other)
 {
+	std::vector<Pair> data;
+	data.reserve(other.size());
+
 	for (auto& kv : other)
-		m_Data.insert(std::move(kv));
+		data.emplace_back(kv.first, std::move(kv.second));
+
+	Assign(std::move(data));
 }
 
 Dictionary::Dictionary(std::initializer_list<Dictionary::Pair> init)
-	: m_Data(init)
-{ }
+{
+	Assign(std::vector<Pair>(init));
+}
+
+/**
+ * Replaces the pairs of a new dictionary. Of duplicate keys the first one
+ * is kept.
+ *
+ * @param data The pairs.
+ */
+void Dictionary::Assign(std::vector<Pair>&& data)
+{
+	m_Data = std::move(data);
+
+	std::stable_sort(m_Data.begin(), m_Data.end(), &DictionaryKeyLess);
+
+	m_Data.erase(std::unique(m_Data.begin(), m_Data.end(), [](const Pair& lhs, const Pair& rhs) {
+		return lhs.first == rhs.first;
+	}), m_Data.end());
+
+	if (m_Data.size() > IndexThreshold)
+		BuildIndex();
+}
+
+/**
+ * Looks up the position of a key.
+ *
+ * Note: Caller must hold the object lock.
+ *
+ * @param key The key.
+ * @returns The position or the length of the dictionary if the key was not found.
+ */
+Dictionary::SizeType Dictionary::Find(const String& key) const
+{
+	if (m_Index) {
+		auto it (m_Index->find(DictionaryIndexKey(key)));
+
+		return it == m_Index->end() ? m_Data.size() : it->second;
+	}
+
+	auto it (std::lower_bound(m_Data.begin(), m_Data.end(), key, [](const Pair& kv, const String& key) {
+		return kv.first < key;
+	}));
+
+	if (it == m_Data.end() || it->first != key)
+		return m_Data.size();
+
+	return it - m_Data.begin();
+}
+
+/**
+ * Sorts the pairs after keys have been appended to a large dictionary.
+ *
+ * Note: Caller must hold the object lock.
+ */
+void Dictionary::Sort() const
+{
+	if (m_Sorted)
+		return;
+
+	std::sort(m_Data.begin(), m_Data.end(), &DictionaryKeyLess);
+	m_Sorted = true;
+
+	BuildIndex();
+}
+
+void Dictionary::BuildIndex() const
+{
+	if (!m_Index)
+		m_Index.reset(new Index());
+	else
+		m_Index->clear();
+
+	m_Index->reserve(m_Data.size());
+
+	for (SizeType i = 0; i < m_Data.size(); i++)
+		m_Index->emplace(DictionaryIndexKey(m_Data[i].first), i);
+}
 
 /**
  * Retrieves a value from a dictionary.
@@ -39,12 +138,12 @@ Value Dictionary::Get(const String& key) const
 {
 	ObjectLock olock(this);
 
-	auto it = m_Data.find(key);
+	SizeType pos = Find(key);
 
-	if (it == m_Data.end())
+	if (pos == m_Data.size())
 		return Empty;
 
-	return it->second;
+	return m_Data[pos].second;
 }
 
 /**
@@ -58,12 +157,12 @@ bool Dictionary::Get(const String& key, Value *result) const
 {
 	ObjectLock olock(this);
 
-	auto it = m_Data.find(key);
+	SizeType pos = Find(key);
 
-	if (it == m_Data.end())
+	if (pos == m_Data.size())
 		return false;
 
-	*result = it->second;
+	*result = m_Data[pos].second;
 	return true;
 }
 
@@ -81,7 +180,35 @@ void Dictionary::Set(const String& key, Value value, bool overrideFrozen)
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Value in dictionary must not be modified."));
 
-	m_Data[key] = std::move(value);
+	if (m_Index) {
+		SizeType pos = Find(key);
+
+		if (pos != m_Data.size()) {
+			m_Data[pos].second = std::move(value);
+			return;
+		}
+
+		if (m_Sorted && !m_Data.empty() && !(m_Data.back().first < key))
+			m_Sorted = false;
+
+		m_Data.emplace_back(key, std::move(value));
+		m_Index->emplace(DictionaryIndexKey(m_Data.back().first), m_Data.size() - 1);
+		return;
+	}
+
+	auto it (std::lower_bound(m_Data.begin(), m_Data.end(), key, [](const Pair& kv, const String& key) {
+		return kv.first < key;
+	}));
+
+	if (it != m_Data.end() && it->first == key) {
+		it->second = std::move(value);
+		return;
+	}
+
+	m_Data.emplace(it, key, std::move(value));
+
+	if (m_Data.size() > IndexThreshold)
+		BuildIndex();
 }
 
 /**
@@ -106,7 +233,7 @@ bool Dictionary::Contains(const String& key) const
 {
 	ObjectLock olock(this);
 
-	return (m_Data.find(key) != m_Data.end());
+	return Find(key) != m_Data.size();
 }
 
 /**
@@ -120,6 +247,8 @@ Dictionary::Iterator Dictionary::Begin()
 {
 	ASSERT(OwnsLock());
 
+	Sort();
+
 	return m_Data.begin();
 }
 
@@ -134,6 +263,8 @@ Dictionary::Iterator Dictionary::End()
 {
 	ASSERT(OwnsLock());
 
+	Sort();
+
 	return m_Data.end();
 }
 
@@ -142,15 +273,23 @@ Dictionary::Iterator Dictionary::End()
  *
  * @param it The iterator.
  * @param overrideFrozen Whether to allow modifying frozen dictionaries.
+ * @returns An iterator to the item following the removed one.
  */
-void Dictionary::Remove(Dictionary::Iterator it, bool overrideFrozen)
+Dictionary::Iterator Dictionary::Remove(Dictionary::Iterator it, bool overrideFrozen)
 {
 	ASSERT(OwnsLock());
 
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Dictionary must not be modified."));
 
+	SizeType pos = it - m_Data.begin();
+
 	m_Data.erase(it);
+
+	if (m_Index)
+		BuildIndex();
+
+	return m_Data.begin() + pos;
 }
 
 /**
@@ -166,13 +305,15 @@ void Dictionary::Remove(const String& key, bool overrideFrozen)
 	if (m_Frozen && !overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Dictionary must not be modified."));
 
-	Dictionary::Iterator it;
-	it = m_Data.find(key);
+	SizeType pos = Find(key);
 
-	if (it == m_Data.end())
+	if (pos == m_Data.size())
 		return;
 
-	m_Data.erase(it);
+	m_Data.erase(m_Data.begin() + pos);
+
+	if (m_Index)
+		BuildIndex();
 }
 
 /**
@@ -188,12 +329,16 @@ void Dictionary::Clear(bool overrideFrozen)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Dictionary must not be modified."));
 
 	m_Data.clear();
+	m_Index.reset();
+	m_Sorted = true;
 }
 
 void Dictionary::CopyTo(const Dictionary::Ptr& dest) const
 {
 	ObjectLock olock(this);
 
+	Sort();
+
 	for (const Dictionary::Pair& kv : m_Data) {
 		dest->Set(kv.first, kv.second);
 	}
@@ -224,6 +369,8 @@ Object::Ptr Dictionary::Clone() const
 	{
 		ObjectLock olock(this);
 
+		Sort();
+
 		dict.reserve(GetLength());
 
 		for (const Dictionary::Pair& kv : m_Data) {
@@ -244,7 +391,10 @@ std::vector<String> Dictionary::GetKeys() const
 {
 	ObjectLock olock(this);
 
+	Sort();
+
 	std::vector<String> keys;
+	keys.reserve(m_Data.size());
 
 	for (const Dictionary::Pair& kv : m_Data) {
 		keys.push_back(kv.first);
@@ -4,10 +4,15 @@
 #define DICTIONARY_H
 
 #include "base/i2-base.hpp"
+#include "base/internedstring.hpp"
 #include "base/object.hpp"
+#include "base/objectpool.hpp"
 #include "base/value.hpp"
+#include <boost/functional/hash.hpp>
 #include <boost/range/iterator.hpp>
-#include <map>
+#include <boost/utility/string_view.hpp>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
 namespace icinga
@@ -18,21 +23,32 @@ typedef std::vector<std::pair<String, Value> > DictionaryData;
 /**
  * A container that holds key-value pairs.
  *
+ * The pairs are kept in a vector sorted by their key, so small dictionaries
+ * are looked up with a binary search and need a single allocation. Above
+ * IndexThreshold keys a hash index is used for lookups and new keys are
+ * appended; the vector is sorted again before it's iterated. Keys are
+ * interned as the same attribute names are used by countless dictionaries.
+ *
+ * Iterators are invalidated when keys are added or removed.
+ *
  * @ingroup base
  */
 class Dictionary final : public Object
 {
 public:
 	DECLARE_OBJECT(Dictionary);
+	IMPL_OBJECT_POOL(Dictionary);
 
 	/**
 	 * An iterator that can be used to iterate over dictionary elements.
 	 */
-	typedef std::map<String, Value>::iterator Iterator;
+	typedef std::pair<InternedString, Value> Pair;
+
+	typedef std::vector<Pair>::iterator Iterator;
 
-	typedef std::map<String, Value>::size_type SizeType;
+	typedef std::vector<Pair>::size_type SizeType;
 
-	typedef std::map<String, Value>::value_type Pair;
+	static const SizeType IndexThreshold;
 
 	Dictionary() = default;
 	Dictionary(const DictionaryData& other);
@@ -51,7 +67,7 @@ public:
 
 	void Remove(const String& key, bool overrideFrozen = false);
 
-	void Remove(Iterator it, bool overrideFrozen = false);
+	Iterator Remove(Iterator it, bool overrideFrozen = false);
 
 	void Clear(bool overrideFrozen = false);
 
@@ -74,8 +90,17 @@ public:
 	bool GetOwnField(const String& field, Value *result) const override;
 
 private:
-	std::map<String, Value> m_Data; /**< The data for the dictionary. */
+	typedef std::unordered_map<boost::string_view, SizeType, boost::hash<boost::string_view> > Index;
+
+	mutable std::vector<Pair> m_Data; /**< The data for the dictionary. */
+	mutable std::unique_ptr<Index> m_Index; /**< Positions of the keys in m_Data, only used for large dictionaries. */
+	mutable bool m_Sorted{true};
 	bool m_Frozen{false};
+
+	void Assign(std::vector<Pair>&& data);
+	SizeType Find(const String& key) const;
+	void Sort() const;
+	void BuildIndex() const;
 };
 
 Dictionary::Iterator begin(const Dictionary::Ptr& x);
@@ -83,6 +108,6 @@ Dictionary::Iterator end(const Dictionary::Ptr& x);
 
 }
 
-extern template class std::map<icinga::String, icinga::Value>;
+extern template class std::vector<icinga::Dictionary::Pair>;
 
 #endif /* DICTIONARY_H */
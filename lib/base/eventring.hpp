@@ -0,0 +1,158 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef EVENTRING_H
+#define EVENTRING_H
+
+#include "base/i2-base.hpp"
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * A bounded lock-free ring of fixed-size event records with
+ * multiple producers and a single consumer.
+ *
+ * All slots are allocated up front, so pushing an event neither
+ * allocates nor takes a lock. Each slot carries a sequence number
+ * which tells whether it is free for the producers or filled for
+ * the consumer.
+ *
+ * @ingroup base
+ */
+template<class T>
+class EventRing final
+{
+public:
+	/**
+	 * @param capacity Minimum number of slots, rounded up to a power of two
+	 */
+	explicit EventRing(size_t capacity)
+		: m_Slots(RoundUpToPowerOfTwo(capacity)), m_Mask(m_Slots.size() - 1u)
+	{
+		for (size_t i = 0; i < m_Slots.size(); i++)
+			m_Slots[i].Sequence.store(i, std::memory_order_relaxed);
+	}
+
+	EventRing(const EventRing&) = delete;
+	EventRing& operator=(const EventRing&) = delete;
+
+	/**
+	 * Adds an event. May be called by any number of threads.
+	 *
+	 * @param event The event, left untouched if the ring is full
+	 * @return Whether the event has been added
+	 */
+	bool TryPush(T&& event)
+	{
+		size_t pos = m_Tail.load(std::memory_order_relaxed);
+
+		for (;;) {
+			Slot& slot = m_Slots[pos & m_Mask];
+			size_t sequence = slot.Sequence.load(std::memory_order_acquire);
+			auto diff = static_cast<std::ptrdiff_t>(sequence - pos);
+
+			if (diff == 0) {
+				if (m_Tail.compare_exchange_weak(pos, pos + 1u, std::memory_order_relaxed)) {
+					slot.Event = std::move(event);
+					slot.Sequence.store(pos + 1u, std::memory_order_release);
+					return true;
+				}
+			} else if (diff < 0) {
+				/* The consumer hasn't freed this slot since the previous round. */
+				return false;
+			} else {
+				pos = m_Tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/**
+	 * Removes events in the order they were added and passes them to a function.
+	 * Must only be called by one thread at a time.
+	 *
+	 * @param max Maximum number of events
+	 * @param handler Called for each event
+	 * @return The number of events
+	 */
+	template<class F>
+	size_t Drain(size_t max, const F& handler)
+	{
+		size_t count = 0;
+		size_t head = m_Head.load(std::memory_order_relaxed);
+
+		while (count < max) {
+			Slot& slot = m_Slots[head & m_Mask];
+
+			if (slot.Sequence.load(std::memory_order_acquire) != head + 1u)
+				break;
+
+			T event (std::move(slot.Event));
+			slot.Event = T();
+			slot.Sequence.store(head + m_Mask + 1u, std::memory_order_release);
+			m_Head.store(++head, std::memory_order_relaxed);
+			count++;
+
+			handler(event);
+		}
+
+		return count;
+	}
+
+	/**
+	 * Tells whether there is no event to drain. Must only be called by the consumer.
+	 */
+	bool IsEmpty() const
+	{
+		size_t head = m_Head.load(std::memory_order_relaxed);
+
+		return m_Slots[head & m_Mask].Sequence.load(std::memory_order_acquire) != head + 1u;
+	}
+
+	size_t GetCapacity() const
+	{
+		return m_Mask + 1u;
+	}
+
+	/**
+	 * The number of events at some point in time, for statistics.
+	 */
+	size_t GetLength() const
+	{
+		size_t head = m_Head.load(std::memory_order_relaxed);
+		size_t tail = m_Tail.load(std::memory_order_relaxed);
+
+		return tail > head ? tail - head : 0;
+	}
+
+private:
+	struct Slot
+	{
+		std::atomic<size_t> Sequence{0};
+		T Event;
+	};
+
+	std::vector<Slot> m_Slots;
+	size_t m_Mask;
+
+	/* Keep the producers' and the consumer's position on different cache lines. */
+	alignas(64) std::atomic<size_t> m_Tail{0};
+	alignas(64) std::atomic<size_t> m_Head{0};
+
+	static size_t RoundUpToPowerOfTwo(size_t value)
+	{
+		size_t result = 1;
+
+		while (result < value)
+			result <<= 1u;
+
+		return result;
+	}
+};
+
+}
+
+#endif /* EVENTRING_H */
@@ -3,6 +3,7 @@
 #include "base/filelogger.hpp"
 #include "base/filelogger-ti.cpp"
 #include "base/configtype.hpp"
+#include "base/perfdatavalue.hpp"
 #include "base/statsfunction.hpp"
 #include "base/application.hpp"
 #include <fstream>
@@ -13,12 +14,21 @@ REGISTER_TYPE(FileLogger);
 
 REGISTER_STATSFUNCTION(FileLogger, &FileLogger::StatsFunc);
 
-void FileLogger::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+void FileLogger::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
 	DictionaryData nodes;
 
 	for (const FileLogger::Ptr& filelogger : ConfigType::GetObjectsByType<FileLogger>()) {
-		nodes.emplace_back(filelogger->GetName(), 1); //add more stats
+		size_t queueLength = filelogger->GetAsyncQueueLength();
+		uint_fast64_t dropped = filelogger->GetDroppedEntries();
+
+		nodes.emplace_back(filelogger->GetName(), new Dictionary({
+			{ "async_queue_length", queueLength },
+			{ "dropped_messages", dropped }
+		}));
+
+		perfdata->Add(new PerfdataValue("filelogger_" + filelogger->GetName() + "_async_queue_length", queueLength));
+		perfdata->Add(new PerfdataValue("filelogger_" + filelogger->GetName() + "_dropped_messages", dropped));
 	}
 
 	status->Set("filelogger", new Dictionary(std::move(nodes)));
@@ -0,0 +1,33 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/hex.hpp"
+
+using namespace icinga;
+
+static const char l_HexDigits[] = "0123456789abcdef";
+
+String Hex::Encode(const String& data)
+{
+	return Encode(reinterpret_cast<const unsigned char *>(data.CStr()), data.GetLength());
+}
+
+String Hex::Encode(const unsigned char *data, size_t length)
+{
+	String result;
+	result.Append(length * 2, '\0');
+
+	Encode(data, length, &result[0]);
+
+	return result;
+}
+
+/**
+ * Writes exactly 2 * length characters to output, without a terminating NUL.
+ */
+void Hex::Encode(const unsigned char *data, size_t length, char *output)
+{
+	for (size_t i = 0; i < length; i++) {
+		output[2 * i] = l_HexDigits[data[i] >> 4];
+		output[2 * i + 1] = l_HexDigits[data[i] & 0xf];
+	}
+}
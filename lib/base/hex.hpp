@@ -0,0 +1,27 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef HEX_H
+#define HEX_H
+
+#include "base/i2-base.hpp"
+#include "base/string.hpp"
+#include <cstddef>
+
+namespace icinga
+{
+
+/**
+ * Lowercase hexadecimal encoding, e.g. of digests.
+ *
+ * @ingroup base
+ */
+struct Hex
+{
+	static String Encode(const String& data);
+	static String Encode(const unsigned char *data, size_t length);
+	static void Encode(const unsigned char *data, size_t length, char *output);
+};
+
+}
+
+#endif /* HEX_H */
@@ -0,0 +1,311 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/internedstring.hpp"
+#include <boost/functional/hash.hpp>
+#include <boost/utility/string_view.hpp>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+using namespace icinga;
+
+struct InternedString::Entry
+{
+	String Data;
+	size_t Shard;
+	std::atomic<uint_fast32_t> References{1};
+};
+
+namespace
+{
+
+/* The pool is split into shards so threads interning different strings rarely contend. */
+static const size_t l_InternShardCount = 64;
+
+struct InternShard
+{
+	std::mutex Mutex;
+
+	/* The keys point to the text of their entry. */
+	std::unordered_map<boost::string_view, void *, boost::hash<boost::string_view>> Entries;
+};
+
+}
+
+/* Never destroyed, as interned strings may be used by static objects of other translation units. */
+static InternShard *GetInternShards()
+{
+	static auto *shards (new InternShard[l_InternShardCount]);
+	return shards;
+}
+
+InternedString::InternedString(const String& str)
+{
+	if (str.IsEmpty())
+		return;
+
+	boost::string_view key (str.CStr(), str.GetLength());
+	size_t shard = boost::hash<boost::string_view>()(key) % l_InternShardCount;
+	auto& pool (GetInternShards()[shard]);
+
+	std::unique_lock<std::mutex> lock (pool.Mutex);
+
+	auto it (pool.Entries.find(key));
+
+	if (it != pool.Entries.end()) {
+		m_Entry = static_cast<Entry *>(it->second);
+		m_Entry->References.fetch_add(1);
+		return;
+	}
+
+	m_Entry = new Entry();
+	m_Entry->Data = str;
+	m_Entry->Shard = shard;
+
+	pool.Entries.emplace(boost::string_view(m_Entry->Data.CStr(), m_Entry->Data.GetLength()), m_Entry);
+}
+
+InternedString::InternedString(const char *str)
+	: InternedString(String(str))
+{ }
+
+InternedString::InternedString(const InternedString& other)
+	: m_Entry(other.m_Entry)
+{
+	if (m_Entry)
+		m_Entry->References.fetch_add(1);
+}
+
+InternedString::InternedString(InternedString&& other)
+	: m_Entry(other.m_Entry)
+{
+	other.m_Entry = nullptr;
+}
+
+InternedString::~InternedString()
+{
+	Release();
+}
+
+InternedString& InternedString::operator=(const InternedString& rhs)
+{
+	if (rhs.m_Entry)
+		rhs.m_Entry->References.fetch_add(1);
+
+	Release();
+	m_Entry = rhs.m_Entry;
+
+	return *this;
+}
+
+InternedString& InternedString::operator=(InternedString&& rhs)
+{
+	if (this != &rhs) {
+		Release();
+		m_Entry = rhs.m_Entry;
+		rhs.m_Entry = nullptr;
+	}
+
+	return *this;
+}
+
+void InternedString::Release()
+{
+	if (!m_Entry)
+		return;
+
+	Entry *entry = m_Entry;
+	m_Entry = nullptr;
+
+	/* Dropping a reference other than the last one doesn't need the lock. */
+	auto refs (entry->References.load());
+
+	while (refs > 1) {
+		if (entry->References.compare_exchange_weak(refs, refs - 1))
+			return;
+	}
+
+	/* The last reference is dropped under the lock, so the entry can't be found and revived concurrently. */
+	auto& pool (GetInternShards()[entry->Shard]);
+
+	{
+		std::unique_lock<std::mutex> lock (pool.Mutex);
+
+		if (entry->References.fetch_sub(1) != 1)
+			return;
+
+		pool.Entries.erase(boost::string_view(entry->Data.CStr(), entry->Data.GetLength()));
+	}
+
+	delete entry;
+}
+
+const String& InternedString::GetString() const
+{
+	static const auto *emptyString (new String());
+
+	return m_Entry ? m_Entry->Data : *emptyString;
+}
+
+InternedString::operator const String&() const
+{
+	return GetString();
+}
+
+const char *InternedString::CStr() const
+{
+	return GetString().CStr();
+}
+
+String::SizeType InternedString::GetLength() const
+{
+	return GetString().GetLength();
+}
+
+bool InternedString::IsEmpty() const
+{
+	return !m_Entry;
+}
+
+String::SizeType InternedString::Find(const String& str, String::SizeType pos) const
+{
+	return GetString().Find(str, pos);
+}
+
+String::SizeType InternedString::FindFirstOf(const char *s, String::SizeType pos) const
+{
+	return GetString().FindFirstOf(s, pos);
+}
+
+String InternedString::SubStr(String::SizeType first, String::SizeType len) const
+{
+	return GetString().SubStr(first, len);
+}
+
+std::vector<String> InternedString::Split(const char *separators) const
+{
+	return GetString().Split(separators);
+}
+
+bool InternedString::Contains(const String& str) const
+{
+	return GetString().Contains(str);
+}
+
+String::ConstIterator InternedString::Begin() const
+{
+	return GetString().Begin();
+}
+
+String::ConstIterator InternedString::End() const
+{
+	return GetString().End();
+}
+
+bool InternedString::operator==(const InternedString& rhs) const
+{
+	return m_Entry == rhs.m_Entry;
+}
+
+bool InternedString::operator!=(const InternedString& rhs) const
+{
+	return m_Entry != rhs.m_Entry;
+}
+
+bool InternedString::operator<(const InternedString& rhs) const
+{
+	return m_Entry != rhs.m_Entry && GetString() < rhs.GetString();
+}
+
+/**
+ * Returns the number of distinct strings which are currently interned.
+ *
+ * @returns The number of strings.
+ */
+size_t InternedString::GetPoolSize()
+{
+	size_t size = 0;
+
+	for (size_t i = 0; i < l_InternShardCount; i++) {
+		auto& pool (GetInternShards()[i]);
+		std::unique_lock<std::mutex> lock (pool.Mutex);
+		size += pool.Entries.size();
+	}
+
+	return size;
+}
+
+bool icinga::operator<(const InternedString& lhs, const String& rhs)
+{
+	return lhs.GetString() < rhs;
+}
+
+bool icinga::operator<(const String& lhs, const InternedString& rhs)
+{
+	return lhs < rhs.GetString();
+}
+
+bool icinga::operator==(const InternedString& lhs, const String& rhs)
+{
+	return lhs.GetString() == rhs;
+}
+
+bool icinga::operator==(const String& lhs, const InternedString& rhs)
+{
+	return lhs == rhs.GetString();
+}
+
+bool icinga::operator==(const InternedString& lhs, const char *rhs)
+{
+	return lhs.GetString() == rhs;
+}
+
+bool icinga::operator==(const char *lhs, const InternedString& rhs)
+{
+	return lhs == rhs.GetString();
+}
+
+bool icinga::operator!=(const InternedString& lhs, const String& rhs)
+{
+	return lhs.GetString() != rhs;
+}
+
+bool icinga::operator!=(const String& lhs, const InternedString& rhs)
+{
+	return lhs != rhs.GetString();
+}
+
+bool icinga::operator!=(const InternedString& lhs, const char *rhs)
+{
+	return lhs.GetString() != rhs;
+}
+
+bool icinga::operator!=(const char *lhs, const InternedString& rhs)
+{
+	return lhs != rhs.GetString();
+}
+
+String icinga::operator+(const InternedString& lhs, const char *rhs)
+{
+	return lhs.GetString() + rhs;
+}
+
+String icinga::operator+(const char *lhs, const InternedString& rhs)
+{
+	return lhs + rhs.GetString();
+}
+
+std::ostream& icinga::operator<<(std::ostream& stream, const InternedString& str)
+{
+	return stream << str.GetString();
+}
+
+String::ConstIterator icinga::begin(const InternedString& x)
+{
+	return x.Begin();
+}
+
+String::ConstIterator icinga::end(const InternedString& x)
+{
+	return x.End();
+}
@@ -0,0 +1,96 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef INTERNEDSTRING_H
+#define INTERNEDSTRING_H
+
+#include "base/i2-base.hpp"
+#include "base/string.hpp"
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+
+namespace icinga
+{
+
+/**
+ * An immutable string whose text is shared with all other interned strings
+ * of the same content.
+ *
+ * Meant for identifiers which are repeated many times, e.g. dictionary keys
+ * such as attribute names. Copies only increment a reference count and
+ * interned strings compare equal if and only if they point to the same
+ * text. The text is freed once the last interned string referring to it is
+ * destroyed.
+ *
+ * Ordering compares the content, so containers keyed by interned strings
+ * iterate in the same order as with String keys.
+ *
+ * @ingroup base
+ */
+class InternedString
+{
+public:
+	InternedString() = default;
+	InternedString(const String& str);
+	InternedString(const char *str);
+	InternedString(const InternedString& other);
+	InternedString(InternedString&& other);
+	~InternedString();
+
+	InternedString& operator=(const InternedString& rhs);
+	InternedString& operator=(InternedString&& rhs);
+
+	const String& GetString() const;
+	operator const String&() const;
+
+	const char *CStr() const;
+	String::SizeType GetLength() const;
+	bool IsEmpty() const;
+
+	String::SizeType Find(const String& str, String::SizeType pos = 0) const;
+	String::SizeType FindFirstOf(const char *s, String::SizeType pos = 0) const;
+	String SubStr(String::SizeType first, String::SizeType len = String::NPos) const;
+	std::vector<String> Split(const char *separators) const;
+	bool Contains(const String& str) const;
+
+	String::ConstIterator Begin() const;
+	String::ConstIterator End() const;
+
+	bool operator==(const InternedString& rhs) const;
+	bool operator!=(const InternedString& rhs) const;
+	bool operator<(const InternedString& rhs) const;
+
+	static size_t GetPoolSize();
+
+private:
+	struct Entry;
+
+	Entry *m_Entry{nullptr};
+
+	void Release();
+};
+
+bool operator<(const InternedString& lhs, const String& rhs);
+bool operator<(const String& lhs, const InternedString& rhs);
+
+bool operator==(const InternedString& lhs, const String& rhs);
+bool operator==(const String& lhs, const InternedString& rhs);
+bool operator==(const InternedString& lhs, const char *rhs);
+bool operator==(const char *lhs, const InternedString& rhs);
+
+bool operator!=(const InternedString& lhs, const String& rhs);
+bool operator!=(const String& lhs, const InternedString& rhs);
+bool operator!=(const InternedString& lhs, const char *rhs);
+bool operator!=(const char *lhs, const InternedString& rhs);
+
+String operator+(const InternedString& lhs, const char *rhs);
+String operator+(const char *lhs, const InternedString& rhs);
+
+std::ostream& operator<<(std::ostream& stream, const InternedString& str);
+
+String::ConstIterator begin(const InternedString& x);
+String::ConstIterator end(const InternedString& x);
+
+}
+
+#endif /* INTERNEDSTRING_H */
@@ -1,11 +1,19 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
+#include "base/allocator.hpp"
+#include "base/configuration.hpp"
 #include "base/exception.hpp"
 #include "base/io-engine.hpp"
 #include "base/lazy-init.hpp"
 #include "base/logger.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <exception>
+#include <fstream>
 #include <memory>
+#include <sstream>
+#include <string>
 #include <thread>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/spawn.hpp>
@@ -13,63 +21,48 @@
 #include <boost/date_time/posix_time/ptime.hpp>
 #include <boost/system/error_code.hpp>
 
+#ifdef __linux__
+#	include <pthread.h>
+#	include <sched.h>
+#endif /* __linux__ */
+
 using namespace icinga;
 
-CpuBoundWork::CpuBoundWork(boost::asio::yield_context yc)
+/* The share of contended slots each class gets, relative to the others. */
+static const uint_fast64_t l_CpuBoundWeights[CpuBoundWorkPriorityCount] = { 8, 4, 2, 1 };
+static const uint_fast64_t l_CpuBoundStride = 8 * 4 * 2;
+
+CpuBoundWork::CpuBoundWork(boost::asio::yield_context yc, CpuBoundWorkPriority priority)
 	: m_Done(false)
 {
-	auto& ioEngine (IoEngine::Get());
-
-	for (;;) {
-		auto availableSlots (ioEngine.m_CpuBoundSemaphore.fetch_sub(1));
-
-		if (availableSlots < 1) {
-			ioEngine.m_CpuBoundSemaphore.fetch_add(1);
-			ioEngine.m_AlreadyExpiredTimer.async_wait(yc);
-			continue;
-		}
-
-		break;
-	}
+	IoEngine::Get().AcquireCpuBoundSlot(yc, priority);
 }
 
 CpuBoundWork::~CpuBoundWork()
 {
 	if (!m_Done) {
-		IoEngine::Get().m_CpuBoundSemaphore.fetch_add(1);
+		IoEngine::Get().ReleaseCpuBoundSlot();
 	}
 }
 
 void CpuBoundWork::Done()
 {
 	if (!m_Done) {
-		IoEngine::Get().m_CpuBoundSemaphore.fetch_add(1);
+		IoEngine::Get().ReleaseCpuBoundSlot();
 
 		m_Done = true;
 	}
 }
 
-IoBoundWorkSlot::IoBoundWorkSlot(boost::asio::yield_context yc)
-	: yc(yc)
+IoBoundWorkSlot::IoBoundWorkSlot(boost::asio::yield_context yc, CpuBoundWorkPriority priority)
+	: yc(yc), m_Priority(priority)
 {
-	IoEngine::Get().m_CpuBoundSemaphore.fetch_add(1);
+	IoEngine::Get().ReleaseCpuBoundSlot();
 }
 
 IoBoundWorkSlot::~IoBoundWorkSlot()
 {
-	auto& ioEngine (IoEngine::Get());
-
-	for (;;) {
-		auto availableSlots (ioEngine.m_CpuBoundSemaphore.fetch_sub(1));
-
-		if (availableSlots < 1) {
-			ioEngine.m_CpuBoundSemaphore.fetch_add(1);
-			ioEngine.m_AlreadyExpiredTimer.async_wait(yc);
-			continue;
-		}
-
-		break;
-	}
+	IoEngine::Get().AcquireCpuBoundSlot(yc, m_Priority);
 }
 
 LazyInit<std::unique_ptr<IoEngine>> IoEngine::m_Instance ([]() { return std::unique_ptr<IoEngine>(new IoEngine()); });
@@ -84,20 +77,179 @@ boost::asio::io_context& IoEngine::GetIoContext()
 	return m_IoContext;
 }
 
+/**
+ * Returns the I/O context for a new network connection. With Configuration::IoNumaAware
+ * these are distributed round-robin across the NUMA nodes, otherwise it's GetIoContext().
+ */
+boost::asio::io_context& IoEngine::GetNextIoContext()
+{
+	if (m_NodeIoContexts.empty()) {
+		return m_IoContext;
+	}
+
+	size_t next = m_NextIoContext.fetch_add(1) % (m_NodeIoContexts.size() + 1u);
+
+	return next ? *m_NodeIoContexts[next - 1u] : m_IoContext;
+}
+
+CpuBoundWorkStats IoEngine::GetCpuBoundWorkStats(CpuBoundWorkPriority priority)
+{
+	std::unique_lock<std::mutex> lock (m_CpuBoundMutex);
+	return m_CpuBoundClasses[priority].Stats;
+}
+
+/**
+ * Waits for a free CPU-bound work slot. While slots are contended, waiting
+ * classes get them in proportion to their weights, so e.g. a heavy API export
+ * can't starve cluster message processing.
+ */
+void IoEngine::AcquireCpuBoundSlot(boost::asio::yield_context yc, CpuBoundWorkPriority priority)
+{
+	auto& cls (m_CpuBoundClasses[priority]);
+
+	{
+		std::unique_lock<std::mutex> lock (m_CpuBoundMutex);
+
+		if (m_CpuBoundSlots > 0 && !m_CpuBoundWaiting) {
+			m_CpuBoundSlots--;
+			cls.Stats.Acquired++;
+			return;
+		}
+
+		/* Don't let a class which didn't wait for a while make up for that time. */
+		if (!cls.Waiting && cls.Pass < m_CpuBoundPass)
+			cls.Pass = m_CpuBoundPass;
+
+		cls.Waiting++;
+		m_CpuBoundWaiting++;
+	}
+
+	auto start (std::chrono::steady_clock::now());
+
+	for (;;) {
+		m_AlreadyExpiredTimer.async_wait(yc);
+
+		std::unique_lock<std::mutex> lock (m_CpuBoundMutex);
+
+		if (m_CpuBoundSlots > 0 && GetNextCpuBoundPriority() == priority) {
+			m_CpuBoundSlots--;
+			m_CpuBoundWaiting--;
+			m_CpuBoundPass = cls.Pass;
+
+			cls.Waiting--;
+			cls.Pass += l_CpuBoundStride / l_CpuBoundWeights[priority];
+			cls.Stats.Acquired++;
+			cls.Stats.WaitTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+			return;
+		}
+	}
+}
+
+void IoEngine::ReleaseCpuBoundSlot()
+{
+	std::unique_lock<std::mutex> lock (m_CpuBoundMutex);
+	m_CpuBoundSlots++;
+}
+
+/**
+ * @return The waiting class which is due for the next slot. The caller must hold m_CpuBoundMutex.
+ */
+CpuBoundWorkPriority IoEngine::GetNextCpuBoundPriority() const
+{
+	int next = -1;
+
+	for (int i = 0; i < CpuBoundWorkPriorityCount; i++) {
+		if (m_CpuBoundClasses[i].Waiting && (next < 0 || m_CpuBoundClasses[i].Pass < m_CpuBoundClasses[next].Pass))
+			next = i;
+	}
+
+	return static_cast<CpuBoundWorkPriority>(next);
+}
+
+/**
+ * Returns the CPUs of each NUMA node, nothing if that's unknown.
+ */
+static std::vector<std::vector<int>> GetNumaNodes()
+{
+	std::vector<std::vector<int>> nodes;
+
+#ifdef __linux__
+	for (;;) {
+		std::ifstream fp ("/sys/devices/system/node/node" + std::to_string(nodes.size()) + "/cpulist");
+		std::string cpuList;
+
+		if (!fp || !std::getline(fp, cpuList)) {
+			break;
+		}
+
+		std::vector<int> cpus;
+		std::istringstream ranges (cpuList);
+		std::string range;
+
+		/* E.g. "0-31,64-95" */
+		while (std::getline(ranges, range, ',')) {
+			int first, last;
+			char dash;
+			std::istringstream rangeStream (range);
+
+			if (!(rangeStream >> first)) {
+				continue;
+			}
+
+			if (!(rangeStream >> dash >> last)) {
+				last = first;
+			}
+
+			for (int cpu = first; cpu <= last; cpu++) {
+				cpus.emplace_back(cpu);
+			}
+		}
+
+		nodes.emplace_back(std::move(cpus));
+	}
+#endif /* __linux__ */
+
+	return nodes;
+}
+
 IoEngine::IoEngine() : m_IoContext(), m_KeepAlive(boost::asio::make_work_guard(m_IoContext)), m_Threads(decltype(m_Threads)::size_type(std::thread::hardware_concurrency() * 2u)), m_AlreadyExpiredTimer(m_IoContext)
 {
 	m_AlreadyExpiredTimer.expires_at(boost::posix_time::neg_infin);
-	m_CpuBoundSemaphore.store(std::thread::hardware_concurrency() * 3u / 2u);
+	m_CpuBoundSlots = std::thread::hardware_concurrency() * 3u / 2u;
 
-	for (auto& thread : m_Threads) {
-		thread = std::thread(&IoEngine::RunEventLoop, this);
+	std::vector<std::vector<int>> nodes;
+
+	if (Configuration::IoNumaAware) {
+		nodes = GetNumaNodes();
+
+		if (nodes.size() < 2u) {
+			Log(LogWarning, "IoEngine", "NUMA-aware I/O is enabled, but there's only one NUMA node.");
+			nodes.clear();
+		} else {
+			Log(LogInformation, "IoEngine")
+				<< "Running one I/O event loop on each of " << nodes.size() << " NUMA nodes.";
+		}
+	}
+
+	for (size_t i = 1; i < nodes.size(); i++) {
+		m_NodeIoContexts.emplace_back(new boost::asio::io_context());
+		m_NodeKeepAlives.emplace_back(boost::asio::make_work_guard(*m_NodeIoContexts.back()));
+	}
+
+	for (size_t i = 0; i < m_Threads.size(); i++) {
+		size_t node = nodes.empty() ? 0 : i % nodes.size();
+		auto& io (node ? *m_NodeIoContexts[node - 1u] : m_IoContext);
+
+		m_ThreadIoContexts.emplace_back(&io);
+		m_Threads[i] = std::thread(&IoEngine::RunEventLoop, this, std::ref(io), nodes.empty() ? std::vector<int>() : nodes[node]);
 	}
 }
 
 IoEngine::~IoEngine()
 {
-	for (auto& thread : m_Threads) {
-		boost::asio::post(m_IoContext, []() {
+	for (auto io : m_ThreadIoContexts) {
+		boost::asio::post(*io, []() {
 			throw TerminateIoThread();
 		});
 	}
@@ -107,11 +259,38 @@ IoEngine::~IoEngine()
 	}
 }
 
-void IoEngine::RunEventLoop()
+/**
+ * Runs an I/O context until the thread is terminated.
+ *
+ * @param io The I/O context
+ * @param cpus The CPUs to pin the thread to, all if empty
+ */
+void IoEngine::RunEventLoop(boost::asio::io_context& io, std::vector<int> cpus)
 {
+	Allocator::UseArena(AllocatorArenaIo);
+
+#ifdef __linux__
+	if (!cpus.empty()) {
+		cpu_set_t cpuSet;
+
+		CPU_ZERO(&cpuSet);
+
+		for (int cpu : cpus) {
+			CPU_SET(cpu, &cpuSet);
+		}
+
+		int err = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+
+		if (err) {
+			Log(LogWarning, "IoEngine")
+				<< "Cannot pin I/O thread to its NUMA node's CPUs: " << strerror(err);
+		}
+	}
+#endif /* __linux__ */
+
 	for (;;) {
 		try {
-			m_IoContext.run();
+			io.run();
 
 			break;
 		} catch (const TerminateIoThread&) {
@@ -152,3 +331,35 @@ void Timeout::Cancel()
 	boost::system::error_code ec;
 	m_Timer.cancel(ec);
 }
+
+/**
+ * Returns the stack size for new coroutines, ICINGA2_COROUTINE_STACK_SIZE if set.
+ *
+ * @param stack What the coroutine does
+ */
+size_t IoEngine::GetCoroutineStackSize(CoroutineStack stack)
+{
+#ifdef _WIN32
+	// Increase the stack size for Windows coroutines to prevent exception corruption.
+	// Rationale: Low cost Windows agent only & https://github.com/Icinga/icinga2/issues/7431
+	size_t size = 8 * 1024 * 1024;
+#else /* _WIN32 */
+	// Increase the stack size for Linux/Unix coroutines for many JSON objects on the stack.
+	// This may help mitigate possible stack overflows. https://github.com/Icinga/icinga2/issues/7532
+	size_t size = 256 * 1024;
+	//return boost::coroutines::stack_allocator::traits_type::default_size(); // Default 64 KB
+#endif /* _WIN32 */
+
+	if (Configuration::CoroutineStackSize > 0) {
+		size = Configuration::CoroutineStackSize;
+	}
+
+#ifndef _WIN32
+	/* Windows needs the large stacks for exceptions, so only shrink them elsewhere. */
+	if (stack == CoroutineStackSmall) {
+		size = std::min(size, std::max<size_t>(size / 4u, 64 * 1024));
+	}
+#endif /* _WIN32 */
+
+	return size;
+}
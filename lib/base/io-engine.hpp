@@ -9,7 +9,9 @@
 #include "base/shared-object.hpp"
 #include <atomic>
 #include <exception>
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -22,6 +24,31 @@
 namespace icinga
 {
 
+/**
+ * Priority classes of CPU-bound work, from the most to the least important
+ *
+ * @ingroup base
+ */
+enum CpuBoundWorkPriority
+{
+	CpuBoundWorkCluster,
+	CpuBoundWorkCheckResult,
+	CpuBoundWorkApiRead,
+	CpuBoundWorkApiWrite,
+	CpuBoundWorkPriorityCount
+};
+
+/**
+ * Stack sizes of coroutines
+ *
+ * @ingroup base
+ */
+enum CoroutineStack
+{
+	CoroutineStackDefault, /* Anything which may process messages */
+	CoroutineStackSmall /* Only waits and writes data */
+};
+
 /**
  * Scope lock for CPU-bound work done in an I/O thread
  *
@@ -30,7 +57,7 @@ namespace icinga
 class CpuBoundWork
 {
 public:
-	CpuBoundWork(boost::asio::yield_context yc);
+	CpuBoundWork(boost::asio::yield_context yc, CpuBoundWorkPriority priority);
 	CpuBoundWork(const CpuBoundWork&) = delete;
 	CpuBoundWork(CpuBoundWork&&) = delete;
 	CpuBoundWork& operator=(const CpuBoundWork&) = delete;
@@ -51,7 +78,7 @@ private:
 class IoBoundWorkSlot
 {
 public:
-	IoBoundWorkSlot(boost::asio::yield_context yc);
+	IoBoundWorkSlot(boost::asio::yield_context yc, CpuBoundWorkPriority priority);
 	IoBoundWorkSlot(const IoBoundWorkSlot&) = delete;
 	IoBoundWorkSlot(IoBoundWorkSlot&&) = delete;
 	IoBoundWorkSlot& operator=(const IoBoundWorkSlot&) = delete;
@@ -60,6 +87,18 @@ public:
 
 private:
 	boost::asio::yield_context yc;
+	CpuBoundWorkPriority m_Priority;
+};
+
+/**
+ * How often and how long a priority class waited for CPU-bound work slots
+ *
+ * @ingroup base
+ */
+struct CpuBoundWorkStats
+{
+	uint_fast64_t Acquired;
+	double WaitTime;
 };
 
 /**
@@ -82,22 +121,14 @@ public:
 	static IoEngine& Get();
 
 	boost::asio::io_context& GetIoContext();
+	boost::asio::io_context& GetNextIoContext();
 
-	static inline size_t GetCoroutineStackSize() {
-#ifdef _WIN32
-		// Increase the stack size for Windows coroutines to prevent exception corruption.
-		// Rationale: Low cost Windows agent only & https://github.com/Icinga/icinga2/issues/7431
-		return 8 * 1024 * 1024;
-#else /* _WIN32 */
-		// Increase the stack size for Linux/Unix coroutines for many JSON objects on the stack.
-		// This may help mitigate possible stack overflows. https://github.com/Icinga/icinga2/issues/7532
-		return 256 * 1024;
-		//return boost::coroutines::stack_allocator::traits_type::default_size(); // Default 64 KB
-#endif /* _WIN32 */
-	}
+	CpuBoundWorkStats GetCpuBoundWorkStats(CpuBoundWorkPriority priority);
+
+	static size_t GetCoroutineStackSize(CoroutineStack stack = CoroutineStackDefault);
 
 	template <typename Handler, typename Function>
-	static void SpawnCoroutine(Handler& h, Function f) {
+	static void SpawnCoroutine(Handler& h, Function f, CoroutineStack stack = CoroutineStackDefault) {
 
 		boost::asio::spawn(h,
 			[f](boost::asio::yield_context yc) {
@@ -115,22 +146,46 @@ public:
 					Log(LogCritical, "IoEngine", "Exception in coroutine!");
 				}
 			},
-			boost::coroutines::attributes(GetCoroutineStackSize()) // Set a pre-defined stack size.
+			boost::coroutines::attributes(GetCoroutineStackSize(stack)) // Set a pre-defined stack size.
 		);
 	}
 
 private:
 	IoEngine();
 
-	void RunEventLoop();
+	void RunEventLoop(boost::asio::io_context& io, std::vector<int> cpus);
+
+	void AcquireCpuBoundSlot(boost::asio::yield_context yc, CpuBoundWorkPriority priority);
+	void ReleaseCpuBoundSlot();
+	CpuBoundWorkPriority GetNextCpuBoundPriority() const;
 
 	static LazyInit<std::unique_ptr<IoEngine>> m_Instance;
 
 	boost::asio::io_context m_IoContext;
 	boost::asio::executor_work_guard<boost::asio::io_context::executor_type> m_KeepAlive;
+
+	/* The ones of the further NUMA nodes, see Configuration::IoNumaAware. m_IoContext serves the first one. */
+	std::vector<std::unique_ptr<boost::asio::io_context>> m_NodeIoContexts;
+	std::vector<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> m_NodeKeepAlives;
+	std::atomic<size_t> m_NextIoContext{0};
+
 	std::vector<std::thread> m_Threads;
+	std::vector<boost::asio::io_context*> m_ThreadIoContexts;
 	boost::asio::deadline_timer m_AlreadyExpiredTimer;
-	std::atomic_int_fast32_t m_CpuBoundSemaphore;
+
+	/* Free slots are granted to the waiting classes by stride scheduling, i.e. in proportion to their weights. */
+	struct CpuBoundClass
+	{
+		size_t Waiting{0};
+		uint_fast64_t Pass{0};
+		CpuBoundWorkStats Stats{0, 0};
+	};
+
+	std::mutex m_CpuBoundMutex;
+	int_fast32_t m_CpuBoundSlots;
+	size_t m_CpuBoundWaiting{0};
+	uint_fast64_t m_CpuBoundPass{0};
+	CpuBoundClass m_CpuBoundClasses[CpuBoundWorkPriorityCount];
 };
 
 class TerminateIoThread : public std::exception
@@ -10,8 +10,12 @@
 #include "base/utility.hpp"
 #include <bitset>
 #include <boost/exception_ptr.hpp>
+#include <cmath>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <json.hpp>
+#include <utf8.h>
 #include <stack>
 #include <utility>
 #include <vector>
@@ -44,6 +48,41 @@ private:
 	void FillCurrentTarget(Value value);
 };
 
+/**
+ * Decodes JSON directly into Value trees without a sanitized copy of the
+ * input. Strings are scanned eight bytes at a time and only the ones which
+ * contain non-ASCII bytes are checked for invalid UTF-8.
+ *
+ * Decode() only tells whether the input is valid, JsonDecode() leaves it to
+ * JsonSax to report the details of invalid input.
+ */
+class JsonDecoder
+{
+public:
+	JsonDecoder(const char *begin, const char *end);
+
+	bool Decode(Value& result);
+
+private:
+	struct Frame
+	{
+		Dictionary *Dict;
+		Array *Arr;
+		String Key;
+	};
+
+	const char *m_Pos;
+	const char *m_End;
+
+	void SkipWhitespace();
+	bool ParseKey(String& key);
+	bool ParseString(String& result);
+	bool ParseEscape(std::string& out);
+	bool ParseHex4(unsigned int& codepoint);
+	bool ParseNumber(double& result);
+	bool ParseLiteral(const char *literal, size_t length);
+};
+
 const char l_Null[] = "null";
 const char l_False[] = "false";
 const char l_True[] = "true";
@@ -57,7 +96,7 @@ public:
 	void Null();
 	void Boolean(bool value);
 	void NumberFloat(double value);
-	void Strng(String value);
+	void Strng(const String& value);
 	void StartObject();
 	void Key(String value);
 	void EndObject();
@@ -65,6 +104,9 @@ public:
 	void EndArray();
 
 	String GetResult();
+	size_t GetLength() const;
+	String TakeResult();
+	void Reset();
 
 private:
 	std::vector<char> m_Result;
@@ -76,7 +118,8 @@ private:
 	template<class Iterator>
 	void AppendChars(Iterator begin, Iterator end);
 
-	void AppendJson(nlohmann::json json);
+	void AppendInteger(unsigned long long value);
+	void AppendString(const String& value);
 
 	void BeforeItem();
 
@@ -94,7 +137,7 @@ void EncodeNamespace(JsonEncoder<prettyPrint>& stateMachine, const Namespace::Pt
 
 	ObjectLock olock(ns);
 	for (const Namespace::Pair& kv : ns) {
-		stateMachine.Key(Utility::ValidateUTF8(kv.first));
+		stateMachine.Key(kv.first);
 		Encode(stateMachine, kv.second->Get());
 	}
 
@@ -109,7 +152,7 @@ void EncodeDictionary(JsonEncoder<prettyPrint>& stateMachine, const Dictionary::
 
 	ObjectLock olock(dict);
 	for (const Dictionary::Pair& kv : dict) {
-		stateMachine.Key(Utility::ValidateUTF8(kv.first));
+		stateMachine.Key(kv.first);
 		Encode(stateMachine, kv.second);
 	}
 
@@ -143,7 +186,7 @@ void Encode(JsonEncoder<prettyPrint>& stateMachine, const Value& value)
 			break;
 
 		case ValueString:
-			stateMachine.Strng(Utility::ValidateUTF8(value.Get<String>()));
+			stateMachine.Strng(value.Get<String>());
 			break;
 
 		case ValueObject:
@@ -188,24 +231,126 @@ void Encode(JsonEncoder<prettyPrint>& stateMachine, const Value& value)
 
 String icinga::JsonEncode(const Value& value, bool pretty_print)
 {
-	if (pretty_print) {
-		JsonEncoder<true> stateMachine;
+	/* Each thread keeps its buffers, so encoding a message only allocates its result. */
+	static thread_local JsonEncoder<true> pretty;
+	static thread_local JsonEncoder<false> plain;
 
-		Encode(stateMachine, value);
+	if (pretty_print) {
+		pretty.Reset();
+		Encode(pretty, value);
 
-		return stateMachine.GetResult() + "\n";
+		return pretty.GetResult() + "\n";
 	} else {
-		JsonEncoder<false> stateMachine;
-
-		Encode(stateMachine, value);
+		plain.Reset();
+		Encode(plain, value);
 
-		return stateMachine.GetResult();
+		return plain.GetResult();
 	}
 }
 
+class JsonStreamEncoder::Impl
+{
+public:
+	bool PrettyPrint;
+	JsonEncoder<true> Pretty;
+	JsonEncoder<false> Plain;
+};
+
+JsonStreamEncoder::JsonStreamEncoder(bool prettyPrint)
+	: m_Impl(new Impl())
+{
+	m_Impl->PrettyPrint = prettyPrint;
+}
+
+JsonStreamEncoder::~JsonStreamEncoder() = default;
+
+void JsonStreamEncoder::StartObject()
+{
+	if (m_Impl->PrettyPrint)
+		m_Impl->Pretty.StartObject();
+	else
+		m_Impl->Plain.StartObject();
+}
+
+void JsonStreamEncoder::Key(const String& key)
+{
+	if (m_Impl->PrettyPrint)
+		m_Impl->Pretty.Key(key);
+	else
+		m_Impl->Plain.Key(key);
+}
+
+void JsonStreamEncoder::EndObject()
+{
+	if (m_Impl->PrettyPrint)
+		m_Impl->Pretty.EndObject();
+	else
+		m_Impl->Plain.EndObject();
+}
+
+void JsonStreamEncoder::StartArray()
+{
+	if (m_Impl->PrettyPrint)
+		m_Impl->Pretty.StartArray();
+	else
+		m_Impl->Plain.StartArray();
+}
+
+void JsonStreamEncoder::EndArray()
+{
+	if (m_Impl->PrettyPrint)
+		m_Impl->Pretty.EndArray();
+	else
+		m_Impl->Plain.EndArray();
+}
+
+void JsonStreamEncoder::Encode(const Value& value)
+{
+	if (m_Impl->PrettyPrint)
+		::Encode(m_Impl->Pretty, value);
+	else
+		::Encode(m_Impl->Plain, value);
+}
+
+/**
+ * Returns how many bytes have been encoded since the last TakeResult().
+ */
+size_t JsonStreamEncoder::GetLength() const
+{
+	return m_Impl->PrettyPrint ? m_Impl->Pretty.GetLength() : m_Impl->Plain.GetLength();
+}
+
+/**
+ * Returns what has been encoded since the last call.
+ */
+String JsonStreamEncoder::TakeResult()
+{
+	return m_Impl->PrettyPrint ? m_Impl->Pretty.TakeResult() : m_Impl->Plain.TakeResult();
+}
+
 Value icinga::JsonDecode(const String& data)
 {
-	String sanitized (Utility::ValidateUTF8(data));
+	return JsonDecodeRange(data.CStr(), data.CStr() + data.GetLength());
+}
+
+/**
+ * Decodes a JSON document which doesn't have to be in a String, e.g. a message in a network buffer.
+ *
+ * @param begin The document's first character
+ * @param end Just past the document's last character
+ * @return The decoded value
+ */
+Value icinga::JsonDecodeRange(const char *begin, const char *end)
+{
+	{
+		Value result;
+
+		if (JsonDecoder(begin, end).Decode(result))
+			return result;
+	}
+
+	/* Only invalid UTF-8 or documents the fast decoder doesn't handle end up here. */
+	String sanitized (Utility::ValidateUTF8(String(begin, end)));
 
 	JsonSax stateMachine;
 
@@ -339,6 +484,436 @@ void JsonSax::FillCurrentTarget(Value value)
 	}
 }
 
+inline
+JsonDecoder::JsonDecoder(const char *begin, const char *end)
+	: m_Pos(begin), m_End(end)
+{
+	/* Like nlohmann::json, skip a UTF-8 BOM. */
+	if (m_End - m_Pos >= 3 && memcmp(m_Pos, "\xEF\xBB\xBF", 3) == 0)
+		m_Pos += 3;
+}
+
+bool JsonDecoder::Decode(Value& result)
+{
+	std::vector<Frame> stack;
+
+	for (;;) {
+		Value value;
+		Dictionary::Ptr dict;
+		Array::Ptr arr;
+
+		SkipWhitespace();
+
+		if (m_Pos == m_End)
+			return false;
+
+		switch (*m_Pos) {
+			case '{':
+				++m_Pos;
+				dict = new Dictionary();
+				value = dict;
+				break;
+			case '[':
+				++m_Pos;
+				arr = new Array();
+				value = arr;
+				break;
+			case '"': {
+				String str;
+
+				if (!ParseString(str))
+					return false;
+
+				value = std::move(str);
+				break;
+			}
+			case 't':
+				if (!ParseLiteral(l_True, 4))
+					return false;
+
+				value = true;
+				break;
+			case 'f':
+				if (!ParseLiteral(l_False, 5))
+					return false;
+
+				value = false;
+				break;
+			case 'n':
+				if (!ParseLiteral(l_Null, 4))
+					return false;
+
+				break;
+			default: {
+				double number;
+
+				if (!ParseNumber(number))
+					return false;
+
+				value = number;
+			}
+		}
+
+		if (stack.empty()) {
+			result = value;
+		} else if (stack.back().Dict) {
+			stack.back().Dict->Set(std::move(stack.back().Key), std::move(value));
+		} else {
+			stack.back().Arr->Add(std::move(value));
+		}
+
+		if (dict || arr) {
+			stack.push_back({ dict.get(), arr.get(), String() });
+
+			SkipWhitespace();
+
+			if (m_Pos == m_End)
+				return false;
+
+			if (*m_Pos == (dict ? '}' : ']')) {
+				++m_Pos;
+				stack.pop_back();
+			} else {
+				if (dict && !ParseKey(stack.back().Key))
+					return false;
+
+				continue;
+			}
+		}
+
+		/* A value is complete, close as many containers as the input does. */
+		for (;;) {
+			SkipWhitespace();
+
+			if (stack.empty())
+				return m_Pos == m_End;
+
+			if (m_Pos == m_End)
+				return false;
+
+			auto& top (stack.back());
+
+			if (*m_Pos == ',') {
+				++m_Pos;
+
+				if (top.Dict && !ParseKey(top.Key))
+					return false;
+
+				break;
+			}
+
+			if (*m_Pos != (top.Dict ? '}' : ']'))
+				return false;
+
+			++m_Pos;
+			stack.pop_back();
+		}
+	}
+}
+
+inline
+void JsonDecoder::SkipWhitespace()
+{
+	while (m_Pos != m_End && (*m_Pos == ' ' || *m_Pos == '\n' || *m_Pos == '\r' || *m_Pos == '\t'))
+		++m_Pos;
+}
+
+inline
+bool JsonDecoder::ParseKey(String& key)
+{
+	SkipWhitespace();
+
+	if (m_Pos == m_End || *m_Pos != '"' || !ParseString(key))
+		return false;
+
+	SkipWhitespace();
+
+	if (m_Pos == m_End || *m_Pos != ':')
+		return false;
+
+	++m_Pos;
+
+	return true;
+}
+
+/**
+ * Whether any of the eight bytes is a quote, a backslash, a control
+ * character or not ASCII, i.e. anything but a plain string character.
+ */
+static inline
+bool JsonHasSpecialByte(uint64_t word)
+{
+	const uint64_t ones = 0x0101010101010101u;
+	const uint64_t highs = 0x8080808080808080u;
+
+	auto hasZero ([ones, highs](uint64_t x) { return (x - ones) & ~x & highs; });
+
+	return hasZero(word ^ (ones * '"')) | hasZero(word ^ (ones * '\\')) | ((word - ones * 0x20u) & ~word & highs) | (word & highs);
+}
+
+bool JsonDecoder::ParseString(String& result)
+{
+	/* Skip the opening quote. */
+	++m_Pos;
+
+	const char *chunk = m_Pos;
+	std::string unescaped;
+	bool escaped = false;
+	bool nonAscii = false;
+
+	for (;;) {
+		while (m_End - m_Pos >= 8) {
+			uint64_t word;
+			memcpy(&word, m_Pos, 8);
+
+			if (JsonHasSpecialByte(word))
+				break;
+
+			m_Pos += 8;
+		}
+
+		if (m_Pos == m_End)
+			return false;
+
+		auto c (static_cast<unsigned char>(*m_Pos));
+
+		if (c == '"') {
+			if (escaped) {
+				unescaped.append(chunk, m_Pos);
+				result = String(std::move(unescaped));
+			} else {
+				result = String(chunk, m_Pos);
+			}
+
+			++m_Pos;
+			break;
+		}
+
+		if (c == '\\') {
+			unescaped.append(chunk, m_Pos);
+			escaped = true;
+
+			if (!ParseEscape(unescaped))
+				return false;
+
+			chunk = m_Pos;
+		} else if (c < 0x20) {
+			return false;
+		} else {
+			if (c >= 0x80)
+				nonAscii = true;
+
+			++m_Pos;
+		}
+	}
+
+	/* Escapes always yield valid UTF-8, only raw bytes may need replacing. */
+	if (nonAscii)
+		result = Utility::ValidateUTF8(result);
+
+	return true;
+}
+
+bool JsonDecoder::ParseEscape(std::string& out)
+{
+	/* Skip the backslash. */
+	++m_Pos;
+
+	if (m_Pos == m_End)
+		return false;
+
+	switch (*m_Pos++) {
+		case '"':
+			out += '"';
+			return true;
+		case '\\':
+			out += '\\';
+			return true;
+		case '/':
+			out += '/';
+			return true;
+		case 'b':
+			out += '\b';
+			return true;
+		case 'f':
+			out += '\f';
+			return true;
+		case 'n':
+			out += '\n';
+			return true;
+		case 'r':
+			out += '\r';
+			return true;
+		case 't':
+			out += '\t';
+			return true;
+		case 'u':
+			break;
+		default:
+			return false;
+	}
+
+	unsigned int codepoint;
+
+	if (!ParseHex4(codepoint))
+		return false;
+
+	if (codepoint >= 0xDC00 && codepoint <= 0xDFFF)
+		return false;
+
+	if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+		unsigned int low;
+
+		if (m_End - m_Pos < 2 || m_Pos[0] != '\\' || m_Pos[1] != 'u')
+			return false;
+
+		m_Pos += 2;
+
+		if (!ParseHex4(low) || low < 0xDC00 || low > 0xDFFF)
+			return false;
+
+		codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+	}
+
+	if (codepoint < 0x80) {
+		out += static_cast<char>(codepoint);
+	} else if (codepoint < 0x800) {
+		out += static_cast<char>(0xC0 | (codepoint >> 6));
+		out += static_cast<char>(0x80 | (codepoint & 0x3F));
+	} else if (codepoint < 0x10000) {
+		out += static_cast<char>(0xE0 | (codepoint >> 12));
+		out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+		out += static_cast<char>(0x80 | (codepoint & 0x3F));
+	} else {
+		out += static_cast<char>(0xF0 | (codepoint >> 18));
+		out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+		out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+		out += static_cast<char>(0x80 | (codepoint & 0x3F));
+	}
+
+	return true;
+}
+
+inline
+bool JsonDecoder::ParseHex4(unsigned int& codepoint)
+{
+	if (m_End - m_Pos < 4)
+		return false;
+
+	codepoint = 0;
+
+	for (int i = 0; i < 4; i++) {
+		char c = *m_Pos++;
+
+		codepoint <<= 4;
+
+		if (c >= '0' && c <= '9')
+			codepoint |= c - '0';
+		else if (c >= 'a' && c <= 'f')
+			codepoint |= c - 'a' + 10;
+		else if (c >= 'A' && c <= 'F')
+			codepoint |= c - 'A' + 10;
+		else
+			return false;
+	}
+
+	return true;
+}
+
+bool JsonDecoder::ParseNumber(double& result)
+{
+	auto isDigit ([this]() { return m_Pos != m_End && *m_Pos >= '0' && *m_Pos <= '9'; });
+
+	const char *start = m_Pos;
+	bool negative = false;
+	bool integer = true;
+
+	if (*m_Pos == '-') {
+		negative = true;
+		++m_Pos;
+	}
+
+	const char *digits = m_Pos;
+
+	if (!isDigit())
+		return false;
+
+	if (*m_Pos++ != '0') {
+		while (isDigit())
+			++m_Pos;
+	}
+
+	const char *digitsEnd = m_Pos;
+
+	if (m_Pos != m_End && *m_Pos == '.') {
+		++m_Pos;
+		integer = false;
+
+		if (!isDigit())
+			return false;
+
+		while (isDigit())
+			++m_Pos;
+	}
+
+	if (m_Pos != m_End && (*m_Pos == 'e' || *m_Pos == 'E')) {
+		++m_Pos;
+		integer = false;
+
+		if (m_Pos != m_End && (*m_Pos == '+' || *m_Pos == '-'))
+			++m_Pos;
+
+		if (!isDigit())
+			return false;
+
+		while (isDigit())
+			++m_Pos;
+	}
+
+	/* Like nlohmann::json, convert integers which fit into 64 bits exactly
+	 * (-0 becomes 0) and leave everything else to strtod(). */
+	if (integer) {
+		uint64_t magnitude = 0;
+		bool overflow = false;
+
+		for (auto p (digits); p != digitsEnd; ++p) {
+			unsigned int digit = *p - '0';
+
+			if (magnitude > (UINT64_MAX - digit) / 10) {
+				overflow = true;
+				break;
+			}
+
+			magnitude = magnitude * 10 + digit;
+		}
+
+		if (!overflow && (!negative || magnitude <= 9223372036854775808u)) {
+			result = negative && magnitude ? -static_cast<double>(magnitude) : static_cast<double>(magnitude);
+			return true;
+		}
+	}
+
+	std::string token (start, m_Pos);
+	char *end;
+
+	result = strtod(token.c_str(), &end);
+
+	/* JsonSax rejects numbers out of range and copes with e.g. a locale's
+	 * decimal point strtod() doesn't accept. */
+	return end == token.c_str() + token.size() && std::isfinite(result);
+}
+
+inline
+bool JsonDecoder::ParseLiteral(const char *literal, size_t length)
+{
+	if (static_cast<size_t>(m_End - m_Pos) < length || memcmp(m_Pos, literal, length) != 0)
+		return false;
+
+	m_Pos += length;
+
+	return true;
+}
+
 template<bool prettyPrint>
 inline
 void JsonEncoder<prettyPrint>::Null()
@@ -366,32 +941,44 @@ void JsonEncoder<prettyPrint>::NumberFloat(double value)
 {
 	BeforeItem();
 
+	if (!std::isfinite(value)) {
+		AppendChars((const char*)l_Null, (const char*)l_Null + 4);
+		return;
+	}
+
 	// Make sure 0.0 is serialized as 0, so e.g. Icinga DB can parse it as int.
 	if (value < 0) {
-		long long i = value;
+		if (value >= -9223372036854775808.0) {
+			long long i = value;
 
-		if (i == value) {
-			AppendJson(i);
-		} else {
-			AppendJson(value);
+			if (i == value) {
+				AppendChar('-');
+				AppendInteger(0ull - static_cast<unsigned long long>(i));
+				return;
+			}
 		}
-	} else {
+	} else if (value < 18446744073709551616.0) {
 		unsigned long long i = value;
 
 		if (i == value) {
-			AppendJson(i);
-		} else {
-			AppendJson(value);
+			AppendInteger(i);
+			return;
 		}
 	}
+
+	/* The shortest representation which round-trips, like nlohmann::json. */
+	char buffer[64];
+	char *end = nlohmann::detail::to_chars(buffer, buffer + sizeof(buffer), value);
+
+	AppendChars((const char*)buffer, (const char*)end);
 }
 
 template<bool prettyPrint>
 inline
-void JsonEncoder<prettyPrint>::Strng(String value)
+void JsonEncoder<prettyPrint>::Strng(const String& value)
 {
 	BeforeItem();
-	AppendJson(std::move(value));
+	AppendString(value);
 }
 
 template<bool prettyPrint>
@@ -442,6 +1029,47 @@ String JsonEncoder<prettyPrint>::GetResult()
 	return String(m_Result.begin(), m_Result.end());
 }
 
+template<bool prettyPrint>
+inline
+size_t JsonEncoder<prettyPrint>::GetLength() const
+{
+	return m_Result.size();
+}
+
+/**
+ * Returns what has been encoded since the last call.
+ */
+template<bool prettyPrint>
+inline
+String JsonEncoder<prettyPrint>::TakeResult()
+{
+	String result (m_Result.begin(), m_Result.end());
+
+	m_Result.clear();
+
+	return result;
+}
+
+/**
+ * Prepares the encoder for another document, keeping its buffer unless
+ * a huge document has made it excessively large.
+ */
+template<bool prettyPrint>
+inline
+void JsonEncoder<prettyPrint>::Reset()
+{
+	if (m_Result.capacity() > 1024 * 1024) {
+		std::vector<char>().swap(m_Result);
+	} else {
+		m_Result.clear();
+	}
+
+	m_CurrentKey = String();
+
+	while (!m_CurrentSubtree.empty())
+		m_CurrentSubtree.pop();
+}
+
 template<bool prettyPrint>
 inline
 void JsonEncoder<prettyPrint>::AppendChar(char c)
@@ -459,9 +1087,152 @@ void JsonEncoder<prettyPrint>::AppendChars(Iterator begin, Iterator end)
 
 template<bool prettyPrint>
 inline
-void JsonEncoder<prettyPrint>::AppendJson(nlohmann::json json)
+void JsonEncoder<prettyPrint>::AppendInteger(unsigned long long value)
+{
+	char buffer[20];
+	char *begin = buffer + sizeof(buffer);
+
+	do {
+		*--begin = '0' + value % 10u;
+		value /= 10u;
+	} while (value);
+
+	AppendChars((const char*)begin, (const char*)buffer + sizeof(buffer));
+}
+
+/**
+ * Whether any of the eight bytes has to be escaped, i.e. is a quote,
+ * a backslash, a control character, DEL or not ASCII.
+ */
+static inline
+bool JsonNeedsEscape(uint64_t word)
+{
+	const uint64_t ones = 0x0101010101010101u;
+	const uint64_t highs = 0x8080808080808080u;
+
+	auto hasZero ([ones, highs](uint64_t x) { return (x - ones) & ~x & highs; });
+
+	return hasZero(word ^ (ones * '"')) | hasZero(word ^ (ones * '\\')) | hasZero(word ^ (ones * 0x7Fu))
+		| ((word - ones * 0x20u) & ~word & highs) | (word & highs);
+}
+
+/**
+ * Appends a quoted string, escaped like nlohmann::json does with
+ * ensure_ascii. Invalid UTF-8 is replaced like Utility::ValidateUTF8() does.
+ */
+template<bool prettyPrint>
+void JsonEncoder<prettyPrint>::AppendString(const String& value)
 {
-	nlohmann::detail::serializer<nlohmann::json>(nlohmann::detail::output_adapter<char>(m_Result), ' ').dump(std::move(json), prettyPrint, true, 0);
+	static const char hexDigits[] = "0123456789abcdef";
+
+	const char *pos = value.CStr();
+	const char *end = pos + value.GetLength();
+	String replaced;
+	bool validated = false;
+
+	AppendChar('"');
+
+	for (;;) {
+		const char *chunk = pos;
+
+		while (end - pos >= 8) {
+			uint64_t word;
+			memcpy(&word, pos, 8);
+
+			if (JsonNeedsEscape(word))
+				break;
+
+			pos += 8;
+		}
+
+		while (pos != end) {
+			auto c (static_cast<unsigned char>(*pos));
+
+			if (c < 0x20 || c >= 0x7F || c == '"' || c == '\\')
+				break;
+
+			++pos;
+		}
+
+		AppendChars(chunk, pos);
+
+		if (pos == end)
+			break;
+
+		auto c (static_cast<unsigned char>(*pos));
+
+		if (c >= 0x80) {
+			/* Everything before is ASCII, so validating the rest suffices. */
+			if (!validated) {
+				validated = true;
+
+				if (!utf8::is_valid(pos, end)) {
+					replaced = Utility::ValidateUTF8(String(pos, end));
+					pos = replaced.CStr();
+					end = pos + replaced.GetLength();
+					continue;
+				}
+			}
+
+			uint32_t codepoint = utf8::unchecked::next(pos);
+			char escaped[12] = { '\\', 'u' };
+			size_t length = 6;
+
+			if (codepoint >= 0x10000) {
+				uint32_t high = 0xD800 + ((codepoint - 0x10000) >> 10);
+				uint32_t low = 0xDC00 + ((codepoint - 0x10000) & 0x3FF);
+
+				codepoint = high;
+
+				escaped[6] = '\\';
+				escaped[7] = 'u';
+
+				for (int i = 0; i < 4; i++)
+					escaped[11 - i] = hexDigits[(low >> (i * 4)) & 0xF];
+
+				length = 12;
+			}
+
+			for (int i = 0; i < 4; i++)
+				escaped[5 - i] = hexDigits[(codepoint >> (i * 4)) & 0xF];
+
+			AppendChars((const char*)escaped, (const char*)escaped + length);
+			continue;
+		}
+
+		++pos;
+		AppendChar('\\');
+
+		switch (c) {
+			case '"':
+				AppendChar('"');
+				break;
+			case '\\':
+				AppendChar('\\');
+				break;
+			case '\b':
+				AppendChar('b');
+				break;
+			case '\f':
+				AppendChar('f');
+				break;
+			case '\n':
+				AppendChar('n');
+				break;
+			case '\r':
+				AppendChar('r');
+				break;
+			case '\t':
+				AppendChar('t');
+				break;
+			default: {
+				char escaped[] = { 'u', '0', '0', hexDigits[c >> 4], hexDigits[c & 0xF] };
+				AppendChars((const char*)escaped, (const char*)escaped + 5);
+			}
+		}
+	}
+
+	AppendChar('"');
 }
 
 template<bool prettyPrint>
@@ -486,7 +1257,7 @@ void JsonEncoder<prettyPrint>::BeforeItem()
 		}
 
 		if (node[1]) {
-			AppendJson(std::move(m_CurrentKey));
+			AppendString(m_CurrentKey);
 			AppendChar(':');
 
 			if (prettyPrint) {
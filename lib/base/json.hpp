@@ -4,6 +4,7 @@
 #define JSON_H
 
 #include "base/i2-base.hpp"
+#include <memory>
 
 namespace icinga
 {
@@ -13,6 +14,35 @@ class Value;
 
 String JsonEncode(const Value& value, bool pretty_print = false);
 Value JsonDecode(const String& data);
+Value JsonDecodeRange(const char *begin, const char *end);
+
+/**
+ * Encodes a JSON document piece by piece, so huge documents (e.g. an array
+ * of all objects) don't have to be built and encoded as a whole.
+ *
+ * @ingroup base
+ */
+class JsonStreamEncoder
+{
+public:
+	JsonStreamEncoder(bool prettyPrint = false);
+	~JsonStreamEncoder();
+
+	void StartObject();
+	void Key(const String& key);
+	void EndObject();
+	void StartArray();
+	void EndArray();
+	void Encode(const Value& value);
+
+	size_t GetLength() const;
+	String TakeResult();
+
+private:
+	class Impl;
+
+	std::unique_ptr<Impl> m_Impl;
+};
 
 }
 
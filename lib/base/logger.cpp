@@ -5,10 +5,12 @@
 #include "base/application.hpp"
 #include "base/streamlogger.hpp"
 #include "base/configtype.hpp"
+#include "base/convert.hpp"
 #include "base/utility.hpp"
 #include "base/objectlock.hpp"
 #include "base/context.hpp"
 #include "base/scriptglobal.hpp"
+#include <algorithm>
 #include <iostream>
 #include <utility>
 
@@ -31,6 +33,7 @@ std::mutex Logger::m_Mutex;
 bool Logger::m_ConsoleLogEnabled = true;
 bool Logger::m_TimestampEnabled = true;
 LogSeverity Logger::m_ConsoleLogSeverity = LogInformation;
+std::atomic<int> Logger::m_MinLogSeverity (LogInformation);
 
 INITIALIZE_ONCE([]() {
 	ScriptGlobal::Set("System.LogDebug", LogDebug, true);
@@ -38,6 +41,8 @@ INITIALIZE_ONCE([]() {
 	ScriptGlobal::Set("System.LogInformation", LogInformation, true);
 	ScriptGlobal::Set("System.LogWarning", LogWarning, true);
 	ScriptGlobal::Set("System.LogCritical", LogCritical, true);
+
+	Logger::OnSeverityChanged.connect([](const Logger::Ptr&, const Value&) { Logger::UpdateMinLogSeverity(); });
 });
 
 /**
@@ -47,8 +52,21 @@ void Logger::Start(bool runtimeCreated)
 {
 	ObjectImpl<Logger>::Start(runtimeCreated);
 
-	std::unique_lock<std::mutex> lock(m_Mutex);
-	m_Loggers.insert(this);
+	if (GetAsync()) {
+		{
+			std::unique_lock<std::mutex> lock(m_AsyncMutex);
+			m_AsyncStopped = false;
+		}
+
+		m_AsyncThread = std::thread([this]() { AsyncWriterThreadProc(); });
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_Loggers.insert(this);
+	}
+
+	UpdateMinLogSeverity();
 }
 
 void Logger::Stop(bool runtimeRemoved)
@@ -58,9 +76,123 @@ void Logger::Stop(bool runtimeRemoved)
 		m_Loggers.erase(this);
 	}
 
+	UpdateMinLogSeverity();
+
+	/* Write what's still queued, entries submitted from now on are written synchronously. */
+	if (m_AsyncThread.joinable()) {
+		{
+			std::unique_lock<std::mutex> lock(m_AsyncMutex);
+			m_AsyncStopped = true;
+		}
+
+		m_AsyncCV.notify_all();
+		m_AsyncFullCV.notify_all();
+		m_AsyncThread.join();
+	}
+
 	ObjectImpl<Logger>::Stop(runtimeRemoved);
 }
 
+/**
+ * Passes a log entry to ProcessLogEntry(), right away or, if the logger is
+ * asynchronous, through its writer thread.
+ *
+ * @param entry The log entry.
+ */
+void Logger::SubmitLogEntry(const LogEntry& entry)
+{
+	if (GetAsync()) {
+		std::unique_lock<std::mutex> lock(m_AsyncMutex);
+
+		while (!m_AsyncStopped && m_AsyncQueue.size() >= static_cast<size_t>(GetAsyncQueueSize())) {
+			if (GetAsyncOverflowPolicy() == "DROP") {
+				m_DroppedEntries.fetch_add(1);
+				return;
+			}
+
+			m_AsyncFullCV.wait(lock);
+		}
+
+		if (!m_AsyncStopped) {
+			m_AsyncQueue.push_back(entry);
+
+			if (m_AsyncQueue.size() == 1u)
+				m_AsyncCV.notify_one();
+
+			return;
+		}
+	}
+
+	ObjectLock llock(this);
+	ProcessLogEntry(entry);
+}
+
+/**
+ * Formats and writes the queued entries of an asynchronous logger in batches.
+ */
+void Logger::AsyncWriterThreadProc()
+{
+	Utility::SetThreadName("Log Writer");
+
+	std::vector<LogEntry> entries;
+	uint_fast64_t reportedDrops = 0;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_AsyncMutex);
+
+			while (m_AsyncQueue.empty() && !m_AsyncStopped)
+				m_AsyncCV.wait(lock);
+
+			if (m_AsyncQueue.empty())
+				break;
+
+			std::swap(entries, m_AsyncQueue);
+		}
+
+		m_AsyncFullCV.notify_all();
+
+		ObjectLock llock(this);
+
+		for (const LogEntry& entry : entries)
+			ProcessLogEntry(entry);
+
+		entries.clear();
+
+		uint_fast64_t drops = m_DroppedEntries.load();
+
+		if (drops != reportedDrops) {
+			LogEntry notice;
+			notice.Timestamp = Utility::GetTime();
+			notice.Severity = LogWarning;
+			notice.Facility = "Logger";
+			notice.Message = "Dropped " + Convert::ToString(drops - reportedDrops)
+				+ " log messages because the queue of logger '" + GetName() + "' was full.";
+
+			ProcessLogEntry(notice);
+
+			reportedDrops = drops;
+		}
+	}
+}
+
+/**
+ * Returns how many entries an asynchronous logger has dropped so far.
+ */
+uint_fast64_t Logger::GetDroppedEntries() const
+{
+	return m_DroppedEntries.load();
+}
+
+/**
+ * Returns how many entries wait for an asynchronous logger's writer thread.
+ */
+size_t Logger::GetAsyncQueueLength()
+{
+	std::unique_lock<std::mutex> lock(m_AsyncMutex);
+	return m_AsyncQueue.size();
+}
+
 std::set<Logger::Ptr> Logger::GetLoggers()
 {
 	std::unique_lock<std::mutex> lock(m_Mutex);
@@ -135,11 +267,13 @@ LogSeverity Logger::StringToSeverity(const String& severity)
 void Logger::DisableConsoleLog()
 {
 	m_ConsoleLogEnabled = false;
+	UpdateMinLogSeverity();
 }
 
 void Logger::EnableConsoleLog()
 {
 	m_ConsoleLogEnabled = true;
+	UpdateMinLogSeverity();
 }
 
 bool Logger::IsConsoleLogEnabled()
@@ -150,6 +284,7 @@ bool Logger::IsConsoleLogEnabled()
 void Logger::SetConsoleLogSeverity(LogSeverity logSeverity)
 {
 	m_ConsoleLogSeverity = logSeverity;
+	UpdateMinLogSeverity();
 }
 
 LogSeverity Logger::GetConsoleLogSeverity()
@@ -157,6 +292,31 @@ LogSeverity Logger::GetConsoleLogSeverity()
 	return m_ConsoleLogSeverity;
 }
 
+/**
+ * Returns the lowest severity any logger or the console is interested in.
+ * Messages below it aren't even formatted.
+ */
+LogSeverity Logger::GetMinLogSeverity()
+{
+	return static_cast<LogSeverity>(m_MinLogSeverity.load(std::memory_order_relaxed));
+}
+
+void Logger::UpdateMinLogSeverity()
+{
+	/* Above LogCritical if nobody logs at all. */
+	int minSeverity = LogCritical + 1;
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	for (const Logger::Ptr& logger : m_Loggers)
+		minSeverity = std::min(minSeverity, static_cast<int>(logger->GetMinSeverity()));
+
+	if (m_ConsoleLogEnabled)
+		minSeverity = std::min(minSeverity, static_cast<int>(m_ConsoleLogSeverity));
+
+	m_MinLogSeverity.store(minSeverity);
+}
+
 void Logger::DisableTimestamp()
 {
 	m_TimestampEnabled = false;
@@ -183,14 +343,31 @@ void Logger::ValidateSeverity(const Lazy<String>& lvalue, const ValidationUtils&
 	}
 }
 
+void Logger::ValidateAsyncQueueSize(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<Logger>::ValidateAsyncQueueSize(lvalue, utils);
+
+	if (lvalue() < 1)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "async_queue_size" }, "Async queue size must be positive."));
+}
+
+void Logger::ValidateAsyncOverflowPolicy(const Lazy<String>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<Logger>::ValidateAsyncOverflowPolicy(lvalue, utils);
+
+	if (lvalue() != "BLOCK" && lvalue() != "DROP")
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "async_overflow_policy" }, "Async overflow policy '" + lvalue() + "' is invalid."));
+}
+
 Log::Log(LogSeverity severity, String facility, const String& message)
-	: m_Severity(severity), m_Facility(std::move(facility))
+	: m_Severity(severity), m_Facility(std::move(facility)), m_IsNoOp(severity < Logger::GetMinLogSeverity())
 {
-	m_Buffer << message;
+	if (!m_IsNoOp)
+		m_Buffer << message;
 }
 
 Log::Log(LogSeverity severity, String facility)
-	: m_Severity(severity), m_Facility(std::move(facility))
+	: m_Severity(severity), m_Facility(std::move(facility)), m_IsNoOp(severity < Logger::GetMinLogSeverity())
 { }
 
 /**
@@ -198,6 +375,9 @@ Log::Log(LogSeverity severity, String facility)
  */
 Log::~Log()
 {
+	if (m_IsNoOp)
+		return;
+
 	LogEntry entry;
 	entry.Timestamp = Utility::GetTime();
 	entry.Severity = m_Severity;
@@ -221,13 +401,11 @@ Log::~Log()
 	}
 
 	for (const Logger::Ptr& logger : Logger::GetLoggers()) {
-		ObjectLock llock(logger);
-
 		if (!logger->IsActive())
 			continue;
 
 		if (entry.Severity >= logger->GetMinSeverity())
-			logger->ProcessLogEntry(entry);
+			logger->SubmitLogEntry(entry);
 
 #ifdef I2_DEBUG /* I2_DEBUG */
 		/* Always flush, don't depend on the timer. Enable this for development sprints on Linux/macOS only. Windows crashes. */
@@ -246,6 +424,8 @@ Log::~Log()
 
 Log& Log::operator<<(const char *val)
 {
-	m_Buffer << val;
+	if (!m_IsNoOp)
+		m_Buffer << val;
+
 	return *this;
 }
@@ -5,8 +5,13 @@
 
 #include "base/i2-base.hpp"
 #include "base/logger-ti.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <set>
 #include <sstream>
+#include <thread>
+#include <vector>
 
 namespace icinga
 {
@@ -62,6 +67,11 @@ public:
 
 	virtual void Flush() = 0;
 
+	void SubmitLogEntry(const LogEntry& entry);
+
+	uint_fast64_t GetDroppedEntries() const;
+	size_t GetAsyncQueueLength();
+
 	static std::set<Logger::Ptr> GetLoggers();
 
 	static void DisableConsoleLog();
@@ -74,7 +84,12 @@ public:
 	static void SetConsoleLogSeverity(LogSeverity logSeverity);
 	static LogSeverity GetConsoleLogSeverity();
 
+	static LogSeverity GetMinLogSeverity();
+	static void UpdateMinLogSeverity();
+
 	void ValidateSeverity(const Lazy<String>& lvalue, const ValidationUtils& utils) final;
+	void ValidateAsyncQueueSize(const Lazy<int>& lvalue, const ValidationUtils& utils) final;
+	void ValidateAsyncOverflowPolicy(const Lazy<String>& lvalue, const ValidationUtils& utils) final;
 
 protected:
 	void Start(bool runtimeCreated) override;
@@ -86,6 +101,17 @@ private:
 	static bool m_ConsoleLogEnabled;
 	static bool m_TimestampEnabled;
 	static LogSeverity m_ConsoleLogSeverity;
+	static std::atomic<int> m_MinLogSeverity;
+
+	std::mutex m_AsyncMutex;
+	std::condition_variable m_AsyncCV;
+	std::condition_variable m_AsyncFullCV;
+	std::vector<LogEntry> m_AsyncQueue;
+	std::thread m_AsyncThread;
+	bool m_AsyncStopped{false};
+	std::atomic<uint_fast64_t> m_DroppedEntries{0};
+
+	void AsyncWriterThreadProc();
 };
 
 class Log
@@ -103,7 +129,9 @@ public:
 	template<typename T>
 	Log& operator<<(const T& val)
 	{
-		m_Buffer << val;
+		if (!m_IsNoOp)
+			m_Buffer << val;
+
 		return *this;
 	}
 
@@ -113,6 +141,7 @@ private:
 	LogSeverity m_Severity;
 	String m_Facility;
 	std::ostringstream m_Buffer;
+	bool m_IsNoOp;
 };
 
 extern template Log& Log::operator<<(const Value&);
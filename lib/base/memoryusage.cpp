@@ -0,0 +1,67 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/memoryusage.hpp"
+#include "base/array.hpp"
+#include "base/utility.hpp"
+#include <algorithm>
+
+using namespace icinga;
+
+std::map<String, MemoryUsage::Provider>& MemoryUsage::GetProviders()
+{
+	static std::map<String, Provider> providers;
+	return providers;
+}
+
+/**
+ * Adds a section to the report. Must be called during initialization.
+ *
+ * @param name The key of the section
+ * @param provider Returns the section, e.g. queue lengths by queue name
+ */
+void MemoryUsage::Register(const String& name, Provider provider)
+{
+	GetProviders()[name] = std::move(provider);
+}
+
+/**
+ * Returns the object counters, the largest types first, and all registered sections.
+ */
+Dictionary::Ptr MemoryUsage::GetReport()
+{
+	std::vector<ObjectTypeStatistics> types = GetObjectTypeStatistics();
+
+	std::sort(types.begin(), types.end(), [](const ObjectTypeStatistics& a, const ObjectTypeStatistics& b) {
+		return a.Bytes > b.Bytes;
+	});
+
+	ArrayData objects;
+	uint_fast64_t totalCount = 0, totalBytes = 0;
+
+	for (auto& type : types) {
+		if (!type.Count)
+			continue;
+
+		objects.emplace_back(new Dictionary({
+			{ "type", Utility::GetTypeName(*type.Type) },
+			{ "count", type.Count },
+			{ "bytes", type.Bytes }
+		}));
+
+		totalCount += type.Count;
+		totalBytes += type.Bytes;
+	}
+
+	Dictionary::Ptr report = new Dictionary({
+		{ "objects", new Array(std::move(objects)) },
+		{ "objects_total", new Dictionary({
+			{ "count", totalCount },
+			{ "bytes", totalBytes }
+		}) }
+	});
+
+	for (auto& provider : GetProviders())
+		report->Set(provider.first, provider.second());
+
+	return report;
+}
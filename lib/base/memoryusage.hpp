@@ -0,0 +1,37 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H
+
+#include "base/i2-base.hpp"
+#include "base/dictionary.hpp"
+#include "base/value.hpp"
+#include <functional>
+#include <map>
+
+namespace icinga
+{
+
+/**
+ * What holds memory: the live instances and their size per class (see
+ * GetObjectTypeStatistics()) and the backlogs of queues, which features
+ * add via Register().
+ *
+ * @ingroup base
+ */
+class MemoryUsage
+{
+public:
+	typedef std::function<Value ()> Provider;
+
+	static void Register(const String& name, Provider provider);
+
+	static Dictionary::Ptr GetReport();
+
+private:
+	static std::map<String, Provider>& GetProviders();
+};
+
+}
+
+#endif /* MEMORYUSAGE_H */
@@ -0,0 +1,301 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/metrics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+using namespace icinga;
+
+constexpr int Histogram::l_SubBuckets;
+constexpr int Histogram::l_Powers;
+constexpr int Histogram::l_Buckets;
+constexpr int Histogram::l_Shards;
+
+/* All of them are initialized before any static Histogram or Gauge is constructed. */
+static std::mutex l_HistogramsMutex;
+static Histogram *l_Histograms = nullptr;
+static Gauge *l_Gauges = nullptr;
+
+static std::atomic<int> l_NextShard (0);
+static thread_local int l_Shard = -1;
+
+Histogram::Histogram(const char *name, const char *help, const char *labelName)
+	: m_Name(name), m_Help(help), m_LabelName(labelName)
+{
+	for (auto& shard : m_Shards) {
+		for (auto& bucket : shard.Buckets)
+			bucket.store(0, std::memory_order_relaxed);
+
+		shard.SumNanoseconds.store(0, std::memory_order_relaxed);
+	}
+
+	std::unique_lock<std::mutex> lock (l_HistogramsMutex);
+
+	m_Next = l_Histograms;
+	l_Histograms = this;
+}
+
+Histogram::~Histogram()
+{
+	std::unique_lock<std::mutex> lock (l_HistogramsMutex);
+
+	for (Histogram **histogram = &l_Histograms; *histogram; histogram = &(*histogram)->m_Next) {
+		if (*histogram == this) {
+			*histogram = m_Next;
+			break;
+		}
+	}
+}
+
+/**
+ * Sets the value of the label given to the constructor.
+ * Histograms with a label are only exposed once the label has a value.
+ *
+ * @param value The value
+ */
+void Histogram::SetLabelValue(const String& value)
+{
+	std::unique_lock<std::mutex> lock (l_HistogramsMutex);
+
+	m_LabelValue = value;
+}
+
+/**
+ * Records one duration.
+ *
+ * @param seconds The duration
+ */
+void Histogram::Observe(double seconds)
+{
+	if (l_Shard < 0)
+		l_Shard = l_NextShard.fetch_add(1, std::memory_order_relaxed) % l_Shards;
+
+	Shard& shard = m_Shards[l_Shard];
+
+	shard.Buckets[GetBucket(seconds)].fetch_add(1, std::memory_order_relaxed);
+
+	if (seconds > 0)
+		shard.SumNanoseconds.fetch_add(static_cast<uint_fast64_t>(seconds * 1e9), std::memory_order_relaxed);
+}
+
+int Histogram::GetBucket(double seconds)
+{
+	double microseconds = seconds * 1e6;
+
+	/* Also catches NaN. */
+	if (!(microseconds >= 1))
+		return 0;
+
+	int exponent;
+	double mantissa = std::frexp(microseconds, &exponent);
+	int power = exponent - 1;
+
+	if (power >= l_Powers)
+		return l_Buckets - 1;
+
+	/* microseconds == mantissa * 2 * 2^power with mantissa * 2 in [1, 2). */
+	int sub = static_cast<int>((mantissa * 2 - 1) * l_SubBuckets);
+
+	return 1 + power * l_SubBuckets + sub;
+}
+
+double Histogram::GetUpperBound(int bucket)
+{
+	if (bucket == 0)
+		return 1e-6;
+
+	bucket--;
+
+	return std::ldexp(1.0 + (bucket % l_SubBuckets + 1.0) / l_SubBuckets, bucket / l_SubBuckets) / 1e6;
+}
+
+uint_fast64_t Histogram::GetCount() const
+{
+	uint_fast64_t count = 0;
+
+	for (auto& shard : m_Shards) {
+		for (auto& bucket : shard.Buckets)
+			count += bucket.load(std::memory_order_relaxed);
+	}
+
+	return count;
+}
+
+/**
+ * Returns the sum of all durations in seconds.
+ */
+double Histogram::GetSum() const
+{
+	uint_fast64_t sumNanoseconds = 0;
+
+	for (auto& shard : m_Shards)
+		sumNanoseconds += shard.SumNanoseconds.load(std::memory_order_relaxed);
+
+	return sumNanoseconds / 1e9;
+}
+
+/**
+ * Writes all histograms and gauges in the OpenMetrics text format.
+ *
+ * @param fp The stream
+ */
+void Histogram::WriteOpenMetrics(std::ostream& fp)
+{
+	{
+		std::unique_lock<std::mutex> lock (l_HistogramsMutex);
+		std::vector<const Histogram *> histograms;
+
+		for (Histogram *histogram = l_Histograms; histogram; histogram = histogram->m_Next) {
+			if (!histogram->m_LabelName || !histogram->m_LabelValue.IsEmpty())
+				histograms.push_back(histogram);
+		}
+
+		/* The series of a family have to be written one after another, below one header.
+		 * Histograms with the same name and label value (e.g. two work queues with the same
+		 * name) are merged into one series.
+		 */
+		std::sort(histograms.begin(), histograms.end(), [](const Histogram *a, const Histogram *b) {
+			int cmp = strcmp(a->m_Name, b->m_Name);
+			return cmp < 0 || (cmp == 0 && a->m_LabelValue < b->m_LabelValue);
+		});
+
+		for (auto begin = histograms.begin(); begin != histograms.end();) {
+			auto end = begin + 1;
+
+			while (end != histograms.end() && !strcmp((*end)->m_Name, (*begin)->m_Name) && (*end)->m_LabelValue == (*begin)->m_LabelValue)
+				end++;
+
+			bool header = begin == histograms.begin() || strcmp((*(begin - 1))->m_Name, (*begin)->m_Name);
+
+			WriteSeries(fp, &*begin, &*begin + (end - begin), header);
+			begin = end;
+		}
+	}
+
+	Gauge::WriteOpenMetrics(fp);
+
+	fp << "# EOF\n";
+}
+
+static String EscapeLabelValue(const String& value)
+{
+	String result;
+
+	for (char ch : value) {
+		switch (ch) {
+			case '\\':
+				result += "\\\\";
+				break;
+			case '"':
+				result += "\\\"";
+				break;
+			case '\n':
+				result += "\\n";
+				break;
+			default:
+				result += ch;
+		}
+	}
+
+	return result;
+}
+
+void Histogram::WriteSeries(std::ostream& fp, const Histogram * const *begin, const Histogram * const *end, bool header)
+{
+	const Histogram& first = **begin;
+	uint_fast64_t buckets[l_Buckets] = {};
+	uint_fast64_t sumNanoseconds = 0;
+
+	for (auto histogram = begin; histogram != end; histogram++) {
+		for (auto& shard : (*histogram)->m_Shards) {
+			for (int i = 0; i < l_Buckets; i++)
+				buckets[i] += shard.Buckets[i].load(std::memory_order_relaxed);
+
+			sumNanoseconds += shard.SumNanoseconds.load(std::memory_order_relaxed);
+		}
+	}
+
+	if (header) {
+		fp << "# TYPE " << first.m_Name << " histogram\n"
+			<< "# HELP " << first.m_Name << " " << first.m_Help << "\n"
+			<< "# UNIT " << first.m_Name << " seconds\n";
+	}
+
+	String label;
+
+	if (first.m_LabelName)
+		label = String(first.m_LabelName) + "=\"" + EscapeLabelValue(first.m_LabelValue) + "\"";
+
+	String bucketLabels = label.IsEmpty() ? "{le=\"" : "{" + label + ",le=\"";
+	String labels = label.IsEmpty() ? "" : "{" + label + "}";
+
+	uint_fast64_t count = 0;
+
+	/* Buckets are cumulative, so empty ones don't tell anything. */
+	for (int i = 0; i < l_Buckets - 1; i++) {
+		if (!buckets[i])
+			continue;
+
+		count += buckets[i];
+
+		fp << first.m_Name << "_bucket" << bucketLabels << GetUpperBound(i) << "\"} " << count << "\n";
+	}
+
+	count += buckets[l_Buckets - 1];
+
+	fp << first.m_Name << "_bucket" << bucketLabels << "+Inf\"} " << count << "\n"
+		<< first.m_Name << "_count" << labels << " " << count << "\n"
+		<< first.m_Name << "_sum" << labels << " " << sumNanoseconds / 1e9 << "\n";
+}
+
+Gauge::Gauge(const char *name, const char *help, const char *unit, std::function<double()> value)
+	: m_Name(name), m_Help(help), m_Unit(unit), m_Value(std::move(value))
+{
+	std::unique_lock<std::mutex> lock (l_HistogramsMutex);
+
+	m_Next = l_Gauges;
+	l_Gauges = this;
+}
+
+Gauge::~Gauge()
+{
+	std::unique_lock<std::mutex> lock (l_HistogramsMutex);
+
+	for (Gauge **gauge = &l_Gauges; *gauge; gauge = &(*gauge)->m_Next) {
+		if (*gauge == this) {
+			*gauge = m_Next;
+			break;
+		}
+	}
+}
+
+/**
+ * Writes all gauges in the OpenMetrics text format, without the final "# EOF".
+ *
+ * @param fp The stream
+ */
+void Gauge::WriteOpenMetrics(std::ostream& fp)
+{
+	std::unique_lock<std::mutex> lock (l_HistogramsMutex);
+	std::vector<const Gauge *> gauges;
+
+	for (Gauge *gauge = l_Gauges; gauge; gauge = gauge->m_Next)
+		gauges.push_back(gauge);
+
+	std::sort(gauges.begin(), gauges.end(), [](const Gauge *a, const Gauge *b) {
+		return strcmp(a->m_Name, b->m_Name) < 0;
+	});
+
+	for (auto *gauge : gauges) {
+		fp << "# TYPE " << gauge->m_Name << " gauge\n"
+			<< "# HELP " << gauge->m_Name << " " << gauge->m_Help << "\n";
+
+		if (gauge->m_Unit)
+			fp << "# UNIT " << gauge->m_Name << " " << gauge->m_Unit << "\n";
+
+		fp << gauge->m_Name << " " << gauge->m_Value() << "\n";
+	}
+}
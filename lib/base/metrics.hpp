@@ -0,0 +1,110 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "base/i2-base.hpp"
+#include "base/string.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+
+namespace icinga
+{
+
+/**
+ * A distribution of durations, exposed via /v1/metrics.
+ *
+ * Durations are counted in log-linear buckets: four linear buckets per
+ * power of two microseconds, from 1 µs up to about 18 minutes, so any
+ * quantile is off by 25% at most. Each thread counts into one of a few
+ * shards, so recording a duration is a handful of uncontended relaxed
+ * atomic increments, no lock and no allocation.
+ *
+ * Histograms register themselves. Most are static objects, others carry a
+ * label to tell the instances of a family apart, e.g. one per work queue.
+ *
+ * @ingroup base
+ */
+class Histogram final
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	Histogram(const char *name, const char *help, const char *labelName = nullptr);
+
+	Histogram(const Histogram&) = delete;
+	Histogram& operator=(const Histogram&) = delete;
+
+	~Histogram();
+
+	void SetLabelValue(const String& value);
+
+	void Observe(double seconds);
+
+	void ObserveSince(Clock::time_point start)
+	{
+		Observe(std::chrono::duration<double>(Clock::now() - start).count());
+	}
+
+	uint_fast64_t GetCount() const;
+	double GetSum() const;
+
+	static void WriteOpenMetrics(std::ostream& fp);
+
+private:
+	static constexpr int l_SubBuckets = 4;
+	static constexpr int l_Powers = 30;
+	static constexpr int l_Buckets = 1 + l_Powers * l_SubBuckets + 1;
+	static constexpr int l_Shards = 8;
+
+	struct Shard
+	{
+		std::atomic<uint_fast64_t> Buckets[l_Buckets];
+		std::atomic<uint_fast64_t> SumNanoseconds;
+	};
+
+	const char *m_Name;
+	const char *m_Help;
+	const char *m_LabelName;
+	String m_LabelValue;
+	Shard m_Shards[l_Shards];
+	Histogram *m_Next;
+
+	static int GetBucket(double seconds);
+	static double GetUpperBound(int bucket);
+
+	static void WriteSeries(std::ostream& fp, const Histogram * const *begin, const Histogram * const *end, bool header);
+};
+
+/**
+ * A value which is only sampled when the metrics are exposed, e.g. the memory held by the allocator.
+ * Gauges register themselves like histograms and are written after them.
+ *
+ * @ingroup base
+ */
+class Gauge final
+{
+public:
+	Gauge(const char *name, const char *help, const char *unit, std::function<double()> value);
+
+	Gauge(const Gauge&) = delete;
+	Gauge& operator=(const Gauge&) = delete;
+
+	~Gauge();
+
+	static void WriteOpenMetrics(std::ostream& fp);
+
+private:
+	const char *m_Name;
+	const char *m_Help;
+	const char *m_Unit;
+	std::function<double()> m_Value;
+	Gauge *m_Next;
+};
+
+}
+
+#endif /* METRICS_H */
@@ -14,6 +14,8 @@ template class std::map<icinga::String, std::shared_ptr<icinga::NamespaceValue>
 
 REGISTER_PRIMITIVE_TYPE(Namespace, Object, Namespace::GetPrototype());
 
+std::atomic<uint64_t> Namespace::m_Version (0);
+
 Namespace::Namespace(NamespaceBehavior *behavior)
 	: m_Behavior(std::unique_ptr<NamespaceBehavior>(behavior))
 { }
@@ -73,6 +75,7 @@ void Namespace::RemoveAttribute(const String& field)
 		return;
 
 	m_Data.erase(it);
+	m_Version.fetch_add(1, std::memory_order_release);
 }
 
 NamespaceValue::Ptr Namespace::GetAttribute(const String& key) const
@@ -92,6 +95,7 @@ void Namespace::SetAttribute(const String& key, const NamespaceValue::Ptr& nsVal
 	ObjectLock olock(this);
 
 	m_Data[key] = nsVal;
+	m_Version.fetch_add(1, std::memory_order_release);
 }
 
 Value Namespace::GetFieldByName(const String& field, bool, const DebugInfo& debugInfo) const
@@ -112,10 +116,15 @@ void Namespace::SetFieldByName(const String& field, const Value& value, bool ove
 
 	auto nsVal = GetAttribute(field);
 
-	if (!nsVal)
+	if (!nsVal) {
 		m_Behavior->Register(this, field, value, overrideFrozen, debugInfo);
-	else
+	} else {
 		nsVal->Set(value, overrideFrozen, debugInfo);
+
+		/* Lookups may have cached the constant's value. */
+		if (dynamic_cast<ConstEmbeddedNamespaceValue *>(nsVal.get()))
+			m_Version.fetch_add(1, std::memory_order_release);
+	}
 }
 
 bool Namespace::HasOwnField(const String& field) const
@@ -8,6 +8,8 @@
 #include "base/shared-object.hpp"
 #include "base/value.hpp"
 #include "base/debuginfo.hpp"
+#include <atomic>
+#include <cstdint>
 #include <map>
 #include <vector>
 #include <memory>
@@ -88,6 +90,16 @@ public:
 	Iterator Begin();
 	Iterator End();
 
+	/**
+	 * Returns a number which changes whenever a field of any namespace is
+	 * added, replaced or removed or a constant is overridden, so lookups
+	 * can be cached.
+	 */
+	static uint64_t GetVersion()
+	{
+		return m_Version.load(std::memory_order_acquire);
+	}
+
 	Value GetFieldByName(const String& field, bool sandboxed, const DebugInfo& debugInfo) const override;
 	void SetFieldByName(const String& field, const Value& value, bool overrideFrozen, const DebugInfo& debugInfo) override;
 	bool HasOwnField(const String& field) const override;
@@ -98,6 +110,7 @@ public:
 private:
 	std::map<String, NamespaceValue::Ptr> m_Data;
 	std::unique_ptr<NamespaceBehavior> m_Behavior;
+	static std::atomic<uint64_t> m_Version;
 };
 
 Namespace::Iterator begin(const Namespace::Ptr& x);
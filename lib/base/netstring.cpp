@@ -3,9 +3,12 @@
 #include "base/netstring.hpp"
 #include "base/debug.hpp"
 #include "base/tlsstream.hpp"
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <memory>
 #include <sstream>
+#include <string>
 #include <utility>
 #include <boost/asio/buffer.hpp>
 #include <boost/asio/read.hpp>
@@ -276,6 +279,98 @@ String NetString::ReadStringFromStream(const Shared<AsioTlsStream>::Ptr& stream,
 	return std::move(payload);
 }
 
+/* Large enough for most cluster messages, the buffer grows for larger ones. */
+static constexpr size_t l_NetStringReaderBufferSize = 64 * 1024;
+
+/**
+ * Reads the next message.
+ *
+ * @param stream The stream to read from.
+ * @param yc Yield Context for ASIO
+ * @param maxMessageLength maximum size of bytes read.
+ * @returns The message, valid until the next call.
+ * @exception invalid_argument The input stream is invalid.
+ */
+boost::string_view NetStringReader::ReadString(const Shared<AsioTlsStream>::Ptr& stream,
+	boost::asio::yield_context yc, ssize_t maxMessageLength)
+{
+	namespace asio = boost::asio;
+
+	for (;;) {
+		const char *begin = m_Buffer.data() + m_Begin;
+		size_t available = m_End - m_Begin;
+		size_t headerLength = 0;
+		size_t len = 0;
+
+		for (size_t i = 0; i < available; i++) {
+			char ch = begin[i];
+
+			if (isdigit(ch)) {
+				if (i == 9) {
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Length specifier must not exceed 9 characters"));
+				}
+
+				if (i == 1 && begin[0] == '0') {
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (leading zero)"));
+				}
+
+				len = len * 10u + size_t(ch - '0');
+			} else if (ch == ':') {
+				if (!i) {
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (no length specifier)"));
+				}
+
+				headerLength = i + 1u;
+				break;
+			} else {
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (missing :)"));
+			}
+		}
+
+		size_t required;
+
+		if (headerLength) {
+			if (maxMessageLength >= 0 && len > (size_t)maxMessageLength) {
+				std::stringstream errorMessage;
+				errorMessage << "Max data length exceeded: " << (maxMessageLength / 1024) << " KB";
+
+				BOOST_THROW_EXCEPTION(std::invalid_argument(errorMessage.str()));
+			}
+
+			required = headerLength + len + 1u;
+
+			if (available >= required) {
+				if (begin[headerLength + len] != ',') {
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (missing ,)"));
+				}
+
+				m_Begin += required;
+
+				return boost::string_view(begin + headerLength, len);
+			}
+		} else {
+			required = available + 1u;
+		}
+
+		/* Move the incomplete message to the front to make room for its rest. */
+		if (m_Begin) {
+			memmove(m_Buffer.data(), begin, available);
+			m_Begin = 0;
+			m_End = available;
+		}
+
+		if (m_Buffer.size() < required) {
+			m_Buffer.resize(std::max(required, l_NetStringReaderBufferSize));
+		} else if (!available && m_Buffer.size() > l_NetStringReaderBufferSize) {
+			/* Don't keep a buffer grown for one large message. */
+			m_Buffer.resize(l_NetStringReaderBufferSize);
+			m_Buffer.shrink_to_fit();
+		}
+
+		m_End += stream->async_read_some(asio::mutable_buffer(m_Buffer.data() + m_End, m_Buffer.size() - m_End), yc);
+	}
+}
+
 /**
  * Writes data into a stream using the netstring format and returns bytes written.
  *
@@ -332,3 +427,24 @@ void NetString::WriteStringToStream(std::ostream& stream, const String& str)
 {
 	stream << str.GetLength() << ":" << str << ",";
 }
+
+/**
+ * Appends data in the netstring format to a buffer and returns bytes appended.
+ *
+ * @param buffer The buffer.
+ * @param str The String that is to be appended.
+ *
+ * @return The amount of bytes appended.
+ */
+size_t NetString::AppendStringToBuffer(std::string& buffer, const String& str)
+{
+	auto oldSize (buffer.size());
+	auto length (std::to_string(str.GetLength()));
+
+	buffer += length;
+	buffer += ':';
+	buffer.append(str.CStr(), str.GetLength());
+	buffer += ',';
+
+	return buffer.size() - oldSize;
+}
@@ -7,7 +7,9 @@
 #include "base/stream.hpp"
 #include "base/tlsstream.hpp"
 #include <memory>
+#include <vector>
 #include <boost/asio/spawn.hpp>
+#include <boost/utility/string_view.hpp>
 
 namespace icinga
 {
@@ -33,11 +35,34 @@ public:
 	static size_t WriteStringToStream(const Shared<AsioTlsStream>::Ptr& stream, const String& message);
 	static size_t WriteStringToStream(const Shared<AsioTlsStream>::Ptr& stream, const String& message, boost::asio::yield_context yc);
 	static void WriteStringToStream(std::ostream& stream, const String& message);
+	static size_t AppendStringToBuffer(std::string& buffer, const String& message);
 
 private:
 	NetString();
 };
 
+/**
+ * Reads messages in the netstring format from an Asio stream.
+ *
+ * Unlike NetString::ReadStringFromStream() it reads whatever the stream has
+ * available into a buffer which is reused for all messages, so a single read
+ * may frame many messages and the messages aren't copied. Each returned view
+ * is valid until the next call.
+ *
+ * @ingroup base
+ */
+class NetStringReader
+{
+public:
+	boost::string_view ReadString(const Shared<AsioTlsStream>::Ptr& stream,
+		boost::asio::yield_context yc, ssize_t maxMessageLength = -1);
+
+private:
+	std::vector<char> m_Buffer;
+	size_t m_Begin = 0;
+	size_t m_End = 0;
+};
+
 }
 
 #endif /* NETSTRING_H */
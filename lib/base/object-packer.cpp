@@ -5,11 +5,19 @@
 #include "base/dictionary.hpp"
 #include "base/array.hpp"
 #include "base/objectlock.hpp"
+#include "base/utility.hpp"
+#include "base/exception.hpp"
+#include "base/tlsutility.hpp"
+#include <openssl/err.h>
+#include <openssl/sha.h>
 #include <algorithm>
 #include <climits>
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <utility>
+#include <stdexcept>
+#include <vector>
 
 using namespace icinga;
 
@@ -29,7 +37,8 @@ static const EndiannessDetector l_EndiannessDetector;
 // Assumption: The compiler will optimize (away) if/else statements using this.
 #define MACHINE_LITTLE_ENDIAN (l_EndiannessDetector.buf[0])
 
-static void PackAny(const Value& value, std::string& builder);
+template<class Builder>
+static void PackAny(const Value& value, Builder& builder);
 
 /**
  * std::swap() seems not to work
@@ -72,7 +81,8 @@ static inline char UIntToByte(unsigned i)
 /**
  * Append the given int as big-endian 64-bit unsigned int
  */
-static inline void PackUInt64BE(uint_least64_t i, std::string& builder)
+template<class Builder>
+static inline void PackUInt64BE(uint_least64_t i, Builder& builder)
 {
 	char buf[8] = {
 		UIntToByte(i >> 56u),
@@ -109,7 +119,8 @@ union Double2BytesConverter
 /**
  * Append the given double as big-endian IEEE 754 binary64
  */
-static inline void PackFloat64BE(double f, std::string& builder)
+template<class Builder>
+static inline void PackFloat64BE(double f, Builder& builder)
 {
 	Double2BytesConverter converter;
 
@@ -128,20 +139,22 @@ static inline void PackFloat64BE(double f, std::string& builder)
 /**
  * Append the given string's length (BE uint64) and the string itself
  */
-static inline void PackString(const String& string, std::string& builder)
+template<class Builder>
+static inline void PackString(const String& string, Builder& builder)
 {
 	PackUInt64BE(string.GetLength(), builder);
-	builder += string.GetData();
+	builder.append(string.CStr(), string.GetLength());
 }
 
 /**
  * Append the given array
  */
-static inline void PackArray(const Array::Ptr& arr, std::string& builder)
+template<class Builder>
+static inline void PackArray(const Array::Ptr& arr, Builder& builder)
 {
 	ObjectLock olock(arr);
 
-	builder += '\5';
+	builder.push_back('\5');
 	PackUInt64BE(arr->GetLength(), builder);
 
 	for (const Value& value : arr) {
@@ -152,11 +165,12 @@ static inline void PackArray(const Array::Ptr& arr, std::string& builder)
 /**
  * Append the given dictionary
  */
-static inline void PackDictionary(const Dictionary::Ptr& dict, std::string& builder)
+template<class Builder>
+static inline void PackDictionary(const Dictionary::Ptr& dict, Builder& builder)
 {
 	ObjectLock olock(dict);
 
-	builder += '\6';
+	builder.push_back('\6');
 	PackUInt64BE(dict->GetLength(), builder);
 
 	for (const Dictionary::Pair& kv : dict) {
@@ -168,25 +182,26 @@ static inline void PackDictionary(const Dictionary::Ptr& dict, std::string& buil
 /**
  * Append any JSON-encodable value
  */
-static void PackAny(const Value& value, std::string& builder)
+template<class Builder>
+static void PackAny(const Value& value, Builder& builder)
 {
 	switch (value.GetType()) {
 		case ValueString:
-			builder += '\4';
+			builder.push_back('\4');
 			PackString(value.Get<String>(), builder);
 			break;
 
 		case ValueNumber:
-			builder += '\3';
+			builder.push_back('\3');
 			PackFloat64BE(value.Get<double>(), builder);
 			break;
 
 		case ValueBoolean:
-			builder += (value.ToBool() ? '\2' : '\1');
+			builder.push_back(value.ToBool() ? '\2' : '\1');
 			break;
 
 		case ValueEmpty:
-			builder += '\0';
+			builder.push_back('\0');
 			break;
 
 		case ValueObject:
@@ -206,7 +221,7 @@ static void PackAny(const Value& value, std::string& builder)
 				}
 			}
 
-			builder += '\0';
+			builder.push_back('\0');
 			break;
 
 		default:
@@ -244,3 +259,390 @@ String icinga::PackObject(const Value& value)
 
 	return std::move(builder);
 }
+
+/**
+ * Collects PackAny()'s output for a PackSink, so that the sink isn't called for every single byte
+ */
+class SinkBuilder
+{
+public:
+	SinkBuilder(PackSink& sink) : m_Sink(sink), m_Length(0)
+	{
+	}
+
+	inline void push_back(char c)
+	{
+		if (m_Length == sizeof(m_Buffer)) {
+			Flush();
+		}
+
+		m_Buffer[m_Length++] = c;
+	}
+
+	void append(const char *data, size_t length)
+	{
+		if (m_Length + length > sizeof(m_Buffer)) {
+			Flush();
+
+			if (length > sizeof(m_Buffer)) {
+				// Not worth buffering, pass it through as is
+				m_Sink.Write(data, length);
+				return;
+			}
+		}
+
+		memcpy(m_Buffer + m_Length, data, length);
+		m_Length += length;
+	}
+
+	void Flush()
+	{
+		if (m_Length) {
+			m_Sink.Write(m_Buffer, m_Length);
+			m_Length = 0;
+		}
+	}
+
+private:
+	PackSink& m_Sink;
+	char m_Buffer[4096];
+	size_t m_Length;
+};
+
+/**
+ * Pack any JSON-encodable value as PackObject() does, but write the result to sink piece by piece
+ *
+ * @param value The value to pack
+ * @param sink Receives the packed value
+ */
+void icinga::PackObject(const Value& value, PackSink& sink)
+{
+	SinkBuilder builder (sink);
+	PackAny(value, builder);
+	builder.Flush();
+}
+
+/**
+ * Calculate the length of PackObject(value) without packing value
+ *
+ * @return The length in bytes
+ */
+size_t icinga::GetPackedSize(const Value& value)
+{
+	switch (value.GetType()) {
+		case ValueString:
+			return 9u + value.Get<String>().GetLength();
+
+		case ValueNumber:
+			return 9u;
+
+		case ValueObject:
+			{
+				const Object::Ptr& obj = value.Get<Object::Ptr>();
+
+				Dictionary::Ptr dict = dynamic_pointer_cast<Dictionary>(obj);
+				if (dict) {
+					ObjectLock olock(dict);
+					size_t size = 9;
+
+					for (const Dictionary::Pair& kv : dict) {
+						size += 8u + kv.first.GetLength() + GetPackedSize(kv.second);
+					}
+
+					return size;
+				}
+
+				Array::Ptr arr = dynamic_pointer_cast<Array>(obj);
+				if (arr) {
+					ObjectLock olock(arr);
+					size_t size = 9;
+
+					for (const Value& item : arr) {
+						size += GetPackedSize(item);
+					}
+
+					return size;
+				}
+			}
+
+			// Packed as null, just like all other types
+		default:
+			return 1u;
+	}
+}
+
+/**
+ * Digests a packed value
+ */
+class SHA1PackSink : public PackSink
+{
+public:
+	SHA1PackSink()
+	{
+		if (!SHA1_Init(&m_Context)) {
+			BOOST_THROW_EXCEPTION(openssl_error()
+				<< boost::errinfo_api_function("SHA1_Init")
+				<< errinfo_openssl_error(ERR_peek_error()));
+		}
+	}
+
+	void Write(const char *data, size_t length) override
+	{
+		if (!SHA1_Update(&m_Context, data, length)) {
+			BOOST_THROW_EXCEPTION(openssl_error()
+				<< boost::errinfo_api_function("SHA1_Update")
+				<< errinfo_openssl_error(ERR_peek_error()));
+		}
+	}
+
+	String Final()
+	{
+		unsigned char digest[SHA_DIGEST_LENGTH];
+
+		if (!SHA1_Final(digest, &m_Context)) {
+			BOOST_THROW_EXCEPTION(openssl_error()
+				<< boost::errinfo_api_function("SHA1_Final")
+				<< errinfo_openssl_error(ERR_peek_error()));
+		}
+
+		static const char hexdigits[] = "0123456789abcdef";
+		char output[SHA_DIGEST_LENGTH*2+1];
+
+		for (int i = 0; i < SHA_DIGEST_LENGTH; i++) {
+			output[2*i] = hexdigits[digest[i] >> 4];
+			output[2*i + 1] = hexdigits[digest[i] & 0xf];
+		}
+
+		output[2*SHA_DIGEST_LENGTH] = 0;
+
+		return output;
+	}
+
+private:
+	SHA_CTX m_Context;
+};
+
+/**
+ * Hash the given value as SHA1(PackObject(value)) does, but without building the packed string
+ *
+ * @return The hex-encoded SHA1 digest
+ */
+String icinga::PackObjectSHA1(const Value& value)
+{
+	SHA1PackSink sink;
+	PackObject(value, sink);
+
+	return sink.Final();
+}
+
+#if CHAR_MIN != 0
+union CharS2UConverter
+{
+	CharS2UConverter()
+	{
+		u = 0;
+	}
+
+	unsigned char u;
+	signed char s;
+};
+#endif
+
+/**
+ * Avoid implementation-defined underflows during signed to unsigned casts
+ */
+static inline unsigned ByteToUInt(char c)
+{
+#if CHAR_MIN == 0
+	return c;
+#else
+	CharS2UConverter converter;
+
+	converter.s = c;
+	return converter.u;
+#endif
+}
+
+/**
+ * Make sure the given amount of bytes is available at the current position
+ */
+static inline void RequireBytes(boost::string_view packed, size_t pos, uint_least64_t amount)
+{
+	if (amount > packed.size() - pos) {
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Packed object is truncated."));
+	}
+}
+
+/**
+ * Read a big-endian 64-bit unsigned int
+ */
+static inline uint_least64_t UnpackUInt64BE(boost::string_view packed, size_t& pos)
+{
+	RequireBytes(packed, pos, 8);
+
+	uint_least64_t i = 0;
+
+	for (size_t end = pos + 8; pos < end; ++pos) {
+		i = (i << 8u) | ByteToUInt(packed[pos]);
+	}
+
+	return i;
+}
+
+/**
+ * Read a big-endian IEEE 754 binary64
+ */
+static inline double UnpackFloat64BE(boost::string_view packed, size_t& pos)
+{
+	RequireBytes(packed, pos, 8);
+
+	Double2BytesConverter converter;
+
+	std::copy(packed.begin() + pos, packed.begin() + pos + 8, converter.buf);
+	pos += 8;
+
+	if (MACHINE_LITTLE_ENDIAN) {
+		SwapBytes(converter.buf[0], converter.buf[7]);
+		SwapBytes(converter.buf[1], converter.buf[6]);
+		SwapBytes(converter.buf[2], converter.buf[5]);
+		SwapBytes(converter.buf[3], converter.buf[4]);
+	}
+
+	return converter.f;
+}
+
+/**
+ * Read a string's length (BE uint64) and the string itself
+ */
+static inline String UnpackString(boost::string_view packed, size_t& pos)
+{
+	uint_least64_t length = UnpackUInt64BE(packed, pos);
+
+	RequireBytes(packed, pos, length);
+
+	String string (packed.begin() + pos, packed.begin() + pos + length);
+	pos += length;
+
+	/* JsonEncode() would have done this on the sender's side. */
+	return Utility::ValidateUTF8(string);
+}
+
+/**
+ * A not yet completely unpacked array or dictionary
+ */
+struct UnpackFrame
+{
+	Array::Ptr Arr;
+	Dictionary::Ptr Dict;
+	uint_least64_t Remaining;
+};
+
+/**
+ * Unpack a value produced by PackObject()
+ *
+ * Nested arrays and dictionaries are tracked on the heap instead of
+ * recursing, so malicious input can't exhaust the (coroutine) stack.
+ *
+ * @param packed The packed value
+ *
+ * @return The unpacked value
+ */
+Value icinga::UnpackObject(boost::string_view packed)
+{
+	std::vector<UnpackFrame> stack;
+	size_t pos = 0;
+	Value result;
+
+	for (;;) {
+		String key;
+
+		if (!stack.empty() && stack.back().Dict) {
+			key = UnpackString(packed, pos);
+		}
+
+		RequireBytes(packed, pos, 1);
+
+		Value value;
+		UnpackFrame frame;
+		frame.Remaining = 0;
+
+		switch (packed[pos++]) {
+			case '\0':
+				break;
+
+			case '\1':
+				value = false;
+				break;
+
+			case '\2':
+				value = true;
+				break;
+
+			case '\3':
+				value = UnpackFloat64BE(packed, pos);
+				break;
+
+			case '\4':
+				value = UnpackString(packed, pos);
+				break;
+
+			case '\5':
+				frame.Arr = new Array();
+				frame.Remaining = UnpackUInt64BE(packed, pos);
+
+				/* Each element takes at least one byte. */
+				RequireBytes(packed, pos, frame.Remaining);
+
+				frame.Arr->Reserve(frame.Remaining);
+				value = frame.Arr;
+				break;
+
+			case '\6':
+				frame.Dict = new Dictionary();
+				frame.Remaining = UnpackUInt64BE(packed, pos);
+
+				/* Each key/value pair takes at least nine bytes. */
+				if (frame.Remaining > (packed.size() - pos) / 9u) {
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Packed object is truncated."));
+				}
+
+				value = frame.Dict;
+				break;
+
+			default:
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Packed object contains an invalid type."));
+		}
+
+		if (stack.empty()) {
+			result = std::move(value);
+		} else {
+			UnpackFrame& parent (stack.back());
+
+			if (parent.Arr) {
+				parent.Arr->Add(std::move(value));
+			} else {
+				parent.Dict->Set(key, std::move(value));
+			}
+
+			--parent.Remaining;
+		}
+
+		if (frame.Remaining) {
+			stack.emplace_back(std::move(frame));
+		}
+
+		while (!stack.empty() && !stack.back().Remaining) {
+			stack.pop_back();
+		}
+
+		if (stack.empty()) {
+			break;
+		}
+	}
+
+	if (pos != packed.size()) {
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Packed object is followed by garbage."));
+	}
+
+	return std::move(result);
+}
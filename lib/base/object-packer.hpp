@@ -4,6 +4,8 @@
 #define OBJECT_PACKER
 
 #include "base/i2-base.hpp"
+#include <cstddef>
+#include <boost/utility/string_view.hpp>
 
 namespace icinga
 {
@@ -11,7 +13,24 @@ namespace icinga
 class String;
 class Value;
 
+/**
+ * Receives a packed value piece by piece, e.g. to hash or to send it.
+ *
+ * @ingroup base
+ */
+class PackSink
+{
+public:
+	virtual ~PackSink() = default;
+
+	virtual void Write(const char *data, size_t length) = 0;
+};
+
 String PackObject(const Value& value);
+void PackObject(const Value& value, PackSink& sink);
+size_t GetPackedSize(const Value& value);
+String PackObjectSHA1(const Value& value);
+Value UnpackObject(boost::string_view packed);
 
 }
 
@@ -1,6 +1,7 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "base/object.hpp"
+#include "base/objectlock.hpp"
 #include "base/value.hpp"
 #include "base/dictionary.hpp"
 #include "base/primitivetype.hpp"
@@ -11,14 +12,44 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/thread/recursive_mutex.hpp>
 #include <thread>
+#include <typeindex>
+#include <unordered_map>
 
 using namespace icinga;
 
 DEFINE_TYPE_INSTANCE(Object);
 
+namespace
+{
+
+struct ObjectTypeCounter
+{
+	const std::type_info *Type;
+	std::atomic<uint_fast64_t> Count{0};
+	std::atomic<uint_fast64_t> Bytes{0};
+};
+
+struct ObjectTypeCounters
+{
+	std::mutex Mutex;
+	std::unordered_map<std::type_index, ObjectTypeCounter *> Counters;
+};
+
+/* Trivially destructible, so objects may be released until the very end of a thread. */
+struct ObjectTypeCacheEntry
+{
+	const std::type_info *Type;
+	ObjectTypeCounter *Counter;
+};
+
+}
+
+static constexpr size_t l_ObjectTypeCacheSize = 64;
+
+/* Remembers the counters of the types the current thread has seen recently. */
+static thread_local ObjectTypeCacheEntry l_ObjectTypeCache[l_ObjectTypeCacheSize];
+
 #ifdef I2_LEAK_DEBUG
-static std::mutex l_ObjectCountLock;
-static std::map<String, int> l_ObjectCounts;
 static Timer::Ptr l_ObjectCountTimer;
 #endif /* I2_LEAK_DEBUG */
 
@@ -28,10 +59,7 @@ static Timer::Ptr l_ObjectCountTimer;
 Object::Object()
 {
 	m_References.store(0);
-
-#ifdef I2_DEBUG
-	m_LockOwner.store(decltype(m_LockOwner.load())());
-#endif /* I2_DEBUG */
+	m_LockWord.store(0);
 }
 
 /**
@@ -57,7 +85,7 @@ String Object::ToString() const
  */
 bool Object::OwnsLock() const
 {
-	return m_LockOwner.load() == std::this_thread::get_id();
+	return ObjectLock::IsOwner(this);
 }
 #endif /* I2_DEBUG */
 
@@ -180,6 +208,11 @@ Type::Ptr Object::GetReflectionType() const
 	return Object::TypeInstance;
 }
 
+size_t Object::GetObjectSize() const
+{
+	return sizeof(*this);
+}
+
 Value icinga::GetPrototypeField(const Value& context, const String& field, bool not_found_error, const DebugInfo& debugInfo)
 {
 	Type::Ptr ctype = context.GetReflectionType();
@@ -200,34 +233,89 @@ Value icinga::GetPrototypeField(const Value& context, const String& field, bool
 		return Empty;
 }
 
-#ifdef I2_LEAK_DEBUG
+static ObjectTypeCounters& GetObjectTypeCounters()
+{
+	/* Never destroyed, objects may be released during static destruction. */
+	static auto *counters (new ObjectTypeCounters());
+	return *counters;
+}
+
+static ObjectTypeCounter& GetObjectTypeCounter(const std::type_info& type)
+{
+	auto& entry (l_ObjectTypeCache[(reinterpret_cast<uintptr_t>(&type) >> 4u) % l_ObjectTypeCacheSize]);
+
+	if (entry.Type == &type)
+		return *entry.Counter;
+
+	auto& counters (GetObjectTypeCounters());
+	std::unique_lock<std::mutex> lock (counters.Mutex);
+
+	auto& counter (counters.Counters[std::type_index(type)]);
+
+	if (!counter) {
+		counter = new ObjectTypeCounter();
+		counter->Type = &type;
+	}
+
+	entry.Type = &type;
+	entry.Counter = counter;
+
+	return *counter;
+}
+
+/**
+ * Counts a new object, called once it's referenced for the first time.
+ */
 void icinga::TypeAddObject(Object *object)
 {
-	std::unique_lock<std::mutex> lock(l_ObjectCountLock);
-	String typeName = Utility::GetTypeName(typeid(*object));
-	l_ObjectCounts[typeName]++;
+	auto& counter (GetObjectTypeCounter(typeid(*object)));
+
+	counter.Count.fetch_add(1, std::memory_order_relaxed);
+	counter.Bytes.fetch_add(object->GetObjectSize(), std::memory_order_relaxed);
 }
 
+/**
+ * Stops counting an object, called right before it's destroyed.
+ */
 void icinga::TypeRemoveObject(Object *object)
 {
-	std::unique_lock<std::mutex> lock(l_ObjectCountLock);
-	String typeName = Utility::GetTypeName(typeid(*object));
-	l_ObjectCounts[typeName]--;
+	auto& counter (GetObjectTypeCounter(typeid(*object)));
+
+	counter.Count.fetch_sub(1, std::memory_order_relaxed);
+	counter.Bytes.fetch_sub(object->GetObjectSize(), std::memory_order_relaxed);
 }
 
-static void TypeInfoTimerHandler()
+/**
+ * Returns the live instances of all types which have had any so far.
+ */
+std::vector<ObjectTypeStatistics> icinga::GetObjectTypeStatistics()
 {
-	std::unique_lock<std::mutex> lock(l_ObjectCountLock);
+	std::vector<ObjectTypeStatistics> result;
+	auto& counters (GetObjectTypeCounters());
+	std::unique_lock<std::mutex> lock (counters.Mutex);
+
+	result.reserve(counters.Counters.size());
+
+	for (auto& kv : counters.Counters) {
+		result.push_back({
+			kv.second->Type,
+			kv.second->Count.load(std::memory_order_relaxed),
+			kv.second->Bytes.load(std::memory_order_relaxed)
+		});
+	}
 
-	typedef std::map<String, int>::value_type kv_pair;
-	for (kv_pair& kv : l_ObjectCounts) {
-		if (kv.second == 0)
+	return result;
+}
+
+#ifdef I2_LEAK_DEBUG
+static void TypeInfoTimerHandler()
+{
+	for (auto& type : GetObjectTypeStatistics()) {
+		if (type.Count == 0)
 			continue;
 
 		Log(LogInformation, "TypeInfo")
-			<< kv.second << " " << kv.first << " objects";
-
-		kv.second = 0;
+			<< type.Count << " " << Utility::GetTypeName(*type.Type) << " objects";
 	}
 }
 
@@ -241,12 +329,8 @@ INITIALIZE_ONCE([]() {
 
 void icinga::intrusive_ptr_add_ref(Object *object)
 {
-#ifdef I2_LEAK_DEBUG
 	if (object->m_References.fetch_add(1) == 0u)
 		TypeAddObject(object);
-#else /* I2_LEAK_DEBUG */
-	object->m_References.fetch_add(1);
-#endif /* I2_LEAK_DEBUG */
 }
 
 void icinga::intrusive_ptr_release(Object *object)
@@ -254,9 +338,7 @@ void icinga::intrusive_ptr_release(Object *object)
 	auto previous (object->m_References.fetch_sub(1));
 
 	if (previous == 1u) {
-#ifdef I2_LEAK_DEBUG
 		TypeRemoveObject(object);
-#endif /* I2_LEAK_DEBUG */
 
 		delete object;
 	}
@@ -11,6 +11,7 @@
 #include <cstdint>
 #include <mutex>
 #include <thread>
+#include <typeinfo>
 #include <vector>
 
 using boost::intrusive_ptr;
@@ -41,9 +42,16 @@ extern Value Empty;
 		return TypeInstance;						\
 	}
 
+#define IMPL_OBJECT_SIZE() \
+	virtual size_t GetObjectSize() const override \
+	{ \
+		return sizeof(*this); \
+	}
+
 #define DECLARE_OBJECT(klass) \
 	DECLARE_PTR_TYPEDEFS(klass); \
-	IMPL_TYPE_LOOKUP();
+	IMPL_TYPE_LOOKUP(); \
+	IMPL_OBJECT_SIZE()
 
 #define REQUIRE_NOT_NULL(ptr) RequireNotNullInternal(ptr, #ptr)
 
@@ -165,6 +173,9 @@ public:
 
 	virtual intrusive_ptr<Type> GetReflectionType() const;
 
+	/* The size of the most derived class which used DECLARE_OBJECT(), for memory accounting. */
+	virtual size_t GetObjectSize() const;
+
 	virtual void Validate(int types, const ValidationUtils& utils);
 
 	virtual void SetField(int id, const Value& value, bool suppress_events = false, const Value& cookie = Empty);
@@ -192,12 +203,9 @@ private:
 	Object& operator=(const Object& rhs) = delete;
 
 	std::atomic<uint_fast64_t> m_References;
-	mutable std::recursive_mutex m_Mutex;
 
-#ifdef I2_DEBUG
-	mutable std::atomic<std::thread::id> m_LockOwner;
-	mutable size_t m_LockCount = 0;
-#endif /* I2_DEBUG */
+	/* The ID of the thread holding the ObjectLock (0 if unlocked) and whether other threads wait for it. */
+	mutable std::atomic<uint32_t> m_LockWord;
 
 	friend struct ObjectLock;
 
@@ -207,8 +215,23 @@ private:
 
 Value GetPrototypeField(const Value& context, const String& field, bool not_found_error, const DebugInfo& debugInfo);
 
+/**
+ * The live instances of a C++ class derived from Object.
+ *
+ * @ingroup base
+ */
+struct ObjectTypeStatistics
+{
+	const std::type_info *Type;
+	uint_fast64_t Count;
+
+	/* Only the instances themselves, not what they point to. */
+	uint_fast64_t Bytes;
+};
+
 void TypeAddObject(Object *object);
 void TypeRemoveObject(Object *object);
+std::vector<ObjectTypeStatistics> GetObjectTypeStatistics();
 
 void intrusive_ptr_add_ref(Object *object);
 void intrusive_ptr_release(Object *object);
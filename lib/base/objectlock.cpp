@@ -1,12 +1,50 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "base/objectlock.hpp"
+#include "base/profiler.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
+#include <utility>
+#include <vector>
 
 using namespace icinga;
 
 #define I2MUTEX_UNLOCKED 0
-#define I2MUTEX_LOCKED 1
+#define I2MUTEX_WAITERS 0x80000000u
+
+/* How often a contended lock is polled before the thread is parked. */
+#define I2MUTEX_SPIN_COUNT 100
+
+/**
+ * Threads waiting for an object's lock are parked on one of these, chosen
+ * by the object's address, so objects only need a 4-byte lock word.
+ */
+struct ObjectLockParkingLot
+{
+	std::mutex Mutex;
+	std::condition_variable CV;
+};
+
+static const size_t l_ParkingLotCount = 256;
+
+static ObjectLockParkingLot& GetParkingLot(const Object *object)
+{
+	/* Never destroyed, as objects may be unlocked during static destruction. */
+	static auto *lots (new ObjectLockParkingLot[l_ParkingLotCount]);
+
+	return lots[(reinterpret_cast<uintptr_t>(object) / alignof(std::max_align_t)) % l_ParkingLotCount];
+}
+
+/**
+ * The recursive locks held by this thread, i.e. how often each object has
+ * been locked in addition to the first time.
+ */
+static thread_local std::vector<std::pair<const Object *, uint32_t> > t_RecursiveLocks;
+
+/* Whether t_RecursiveLocks is non-empty, cheaper to check than the vector itself. */
+static thread_local bool t_HasRecursiveLocks = false;
 
 ObjectLock::~ObjectLock()
 {
@@ -25,31 +63,130 @@ ObjectLock::ObjectLock(const Object *object)
 		Lock();
 }
 
+/**
+ * Returns the ID the current thread stores in the lock words of the objects it locks.
+ *
+ * @returns The ID.
+ */
+uint32_t ObjectLock::GetThreadId()
+{
+	static std::atomic<uint32_t> nextId (1);
+	static thread_local uint32_t id (0);
+
+	while (id == I2MUTEX_UNLOCKED)
+		id = nextId.fetch_add(1) & ~I2MUTEX_WAITERS;
+
+	return id;
+}
+
+/**
+ * Checks whether the current thread holds the lock of an object.
+ *
+ * @param object The object.
+ * @returns true if the current thread holds the lock.
+ */
+bool ObjectLock::IsOwner(const Object *object)
+{
+	return (object->m_LockWord.load() & ~I2MUTEX_WAITERS) == GetThreadId();
+}
+
 void ObjectLock::Lock()
 {
 	ASSERT(!m_Locked && m_Object);
 
-	m_Object->m_Mutex.lock();
+	auto& word (m_Object->m_LockWord);
+	uint32_t self = GetThreadId();
+	uint32_t expected = I2MUTEX_UNLOCKED;
+
+	if (!word.compare_exchange_strong(expected, self)) {
+		if ((expected & ~I2MUTEX_WAITERS) == self) {
+			for (auto& lock : t_RecursiveLocks) {
+				if (lock.first == m_Object) {
+					lock.second++;
+					m_Locked = true;
+					return;
+				}
+			}
+
+			t_RecursiveLocks.emplace_back(m_Object, 1);
+			t_HasRecursiveLocks = true;
+			m_Locked = true;
+			return;
+		}
+
+		if (Profiler::IsRecordingLocks()) {
+			auto start (std::chrono::steady_clock::now());
+			LockSlowPath(self);
+			Profiler::RecordObjectLockWait(typeid(*m_Object), std::chrono::steady_clock::now() - start);
+		} else {
+			LockSlowPath(self);
+		}
+	}
 
 	m_Locked = true;
+}
+
+void ObjectLock::LockSlowPath(uint32_t self)
+{
+	auto& word (m_Object->m_LockWord);
 
-#ifdef I2_DEBUG
-	if (++m_Object->m_LockCount == 1u) {
-		m_Object->m_LockOwner.store(std::this_thread::get_id());
+	for (int i = 0; i < I2MUTEX_SPIN_COUNT; i++) {
+		uint32_t expected = I2MUTEX_UNLOCKED;
+
+		if (word.load(std::memory_order_relaxed) == I2MUTEX_UNLOCKED && word.compare_exchange_weak(expected, self))
+			return;
+
+		std::this_thread::yield();
+	}
+
+	auto& lot (GetParkingLot(m_Object));
+	std::unique_lock<std::mutex> lock (lot.Mutex);
+
+	for (;;) {
+		uint32_t current = word.load();
+
+		if (current == I2MUTEX_UNLOCKED) {
+			/* Other threads may still be parked, keep them in the waiters flag. */
+			if (word.compare_exchange_weak(current, self | I2MUTEX_WAITERS))
+				return;
+
+			continue;
+		}
+
+		if (!(current & I2MUTEX_WAITERS) && !word.compare_exchange_weak(current, current | I2MUTEX_WAITERS))
+			continue;
+
+		lot.CV.wait(lock);
 	}
-#endif /* I2_DEBUG */
 }
 
 void ObjectLock::Unlock()
 {
-#ifdef I2_DEBUG
-	if (m_Locked && !--m_Object->m_LockCount) {
-		m_Object->m_LockOwner.store(decltype(m_Object->m_LockOwner.load())());
+	if (!m_Locked)
+		return;
+
+	m_Locked = false;
+
+	if (t_HasRecursiveLocks) {
+		for (auto it (t_RecursiveLocks.rbegin()); it != t_RecursiveLocks.rend(); ++it) {
+			if (it->first == m_Object) {
+				if (!--it->second) {
+					t_RecursiveLocks.erase(std::next(it).base());
+					t_HasRecursiveLocks = !t_RecursiveLocks.empty();
+				}
+
+				return;
+			}
+		}
 	}
-#endif /* I2_DEBUG */
 
-	if (m_Locked) {
-		m_Object->m_Mutex.unlock();
-		m_Locked = false;
+	if (m_Object->m_LockWord.exchange(I2MUTEX_UNLOCKED) & I2MUTEX_WAITERS) {
+		auto& lot (GetParkingLot(m_Object));
+
+		{
+			std::unique_lock<std::mutex> lock (lot.Mutex);
+		}
+
+		lot.CV.notify_all();
 	}
 }
@@ -4,12 +4,17 @@
 #define OBJECTLOCK_H
 
 #include "base/object.hpp"
+#include <cstdint>
 
 namespace icinga
 {
 
 /**
  * A scoped lock for Objects.
+ *
+ * The lock is recursive. Uncontended locks are a single atomic operation on
+ * the object's lock word; threads which can't get the lock spin for a while
+ * and are then parked in a table shared by all objects.
  */
 struct ObjectLock
 {
@@ -22,9 +27,15 @@ public:
 	void Lock();
 	void Unlock();
 
+	static bool IsOwner(const Object *object);
+
 private:
 	const Object *m_Object{nullptr};
 	bool m_Locked{false};
+
+	void LockSlowPath(uint32_t self);
+
+	static uint32_t GetThreadId();
 };
 
 }
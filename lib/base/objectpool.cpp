@@ -0,0 +1,7 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/objectpool.hpp"
+
+using namespace icinga;
+
+thread_local uint_fast64_t ObjectPoolStats::m_Allocations = 0;
@@ -0,0 +1,154 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include "base/i2-base.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace icinga
+{
+
+/**
+ * Counts the allocations of all object pools on the current thread.
+ *
+ * @ingroup base
+ */
+class ObjectPoolStats final
+{
+public:
+	/**
+	 * Counts the pooled allocations made on the current thread while this
+	 * counter exists. Must not outlive a coroutine's yield.
+	 */
+	class Scope final
+	{
+	public:
+		Scope() : m_Start(m_Allocations)
+		{ }
+
+		uint_fast64_t GetAllocations() const
+		{
+			return m_Allocations - m_Start;
+		}
+
+	private:
+		uint_fast64_t m_Start;
+	};
+
+	static void CountAllocation()
+	{
+		m_Allocations++;
+	}
+
+private:
+	static thread_local uint_fast64_t m_Allocations;
+};
+
+/**
+ * Recycles the memory of a class' short-lived instances.
+ *
+ * Check results, API requests and cluster messages build lots of temporary
+ * dictionaries, arrays and strings which die right after. Freed blocks are
+ * kept in a small cache per thread and handed out again by the next
+ * allocation on that thread, so most of them don't hit malloc(). Blocks may
+ * be freed on any thread, they end up in that thread's cache.
+ *
+ * Use it by giving the class an operator new and delete which call
+ * Allocate() and Free(), see IMPL_OBJECT_POOL().
+ *
+ * @ingroup base
+ */
+template<class T>
+class ObjectPool final
+{
+public:
+	static void *Allocate(size_t size)
+	{
+		ObjectPoolStats::CountAllocation();
+
+		if (size == sizeof(T) && m_Cache) {
+			Block *block = m_Cache;
+
+			m_Cache = block->Next;
+			m_CacheLength--;
+
+			return block;
+		}
+
+		return ::operator new(size);
+	}
+
+	static void Free(void *ptr, size_t size)
+	{
+		if (ptr && size == sizeof(T) && m_CacheLength < l_MaxCacheLength) {
+			/* Frees the cache on thread exit, from then on blocks go straight back to the heap. */
+			static thread_local Reaper reaper;
+			(void)reaper;
+
+			auto *block = static_cast<Block *>(ptr);
+
+			block->Next = m_Cache;
+			m_Cache = block;
+			m_CacheLength++;
+
+			return;
+		}
+
+		::operator delete(ptr);
+	}
+
+private:
+	struct Block
+	{
+		Block *Next;
+	};
+
+	struct Reaper
+	{
+		~Reaper()
+		{
+			while (m_Cache) {
+				Block *block = m_Cache;
+				m_Cache = block->Next;
+				::operator delete(block);
+			}
+
+			m_CacheLength = l_MaxCacheLength;
+		}
+	};
+
+	static_assert(sizeof(T) >= sizeof(Block), "T must be large enough to hold a pointer");
+
+	static constexpr size_t l_MaxCacheLength = 1024;
+
+	/* Trivially destructible, so they may be used until the very end of a thread. */
+	static thread_local Block *m_Cache;
+	static thread_local size_t m_CacheLength;
+};
+
+template<class T>
+thread_local typename ObjectPool<T>::Block *ObjectPool<T>::m_Cache = nullptr;
+
+template<class T>
+thread_local size_t ObjectPool<T>::m_CacheLength = 0;
+
+template<class T>
+constexpr size_t ObjectPool<T>::l_MaxCacheLength;
+
+#define IMPL_OBJECT_POOL(klass) \
+	static void *operator new(size_t size) \
+	{ \
+		return ObjectPool<klass>::Allocate(size); \
+	} \
+	\
+	static void operator delete(void *ptr, size_t size) \
+	{ \
+		ObjectPool<klass>::Free(ptr, size); \
+	}
+
+}
+
+#endif /* OBJECTPOOL_H */
@@ -0,0 +1,96 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef OBSERVERLIST_H
+#define OBSERVERLIST_H
+
+#include "base/i2-base.hpp"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <utility>
+
+namespace icinga
+{
+
+/**
+ * A minimal replacement for boost::signals2::signal for hot paths.
+ *
+ * Slots are kept in an append-only singly linked list. Connecting takes a
+ * mutex, emitting doesn't take any lock and doesn't copy anything, it just
+ * walks the list. Emitting without any slots costs one atomic load.
+ *
+ * Slots can't be disconnected. connect() and operator() are named like
+ * their boost::signals2 counterparts, so existing callers don't change.
+ *
+ * @ingroup base
+ */
+template<class... Args>
+class ObserverList final
+{
+public:
+	typedef std::function<void(Args...)> Slot;
+
+	ObserverList() = default;
+	ObserverList(const ObserverList&) = delete;
+	ObserverList& operator=(const ObserverList&) = delete;
+
+	~ObserverList()
+	{
+		Node *node = m_Head.load(std::memory_order_relaxed);
+
+		while (node) {
+			Node *next = node->Next.load(std::memory_order_relaxed);
+			delete node;
+			node = next;
+		}
+	}
+
+	/**
+	 * Appends a slot, it's called after all previously connected ones.
+	 *
+	 * @param slot The callable
+	 */
+	void connect(Slot slot)
+	{
+		Node *node = new Node(std::move(slot));
+
+		std::unique_lock<std::mutex> lock (m_ConnectMutex);
+
+		/* Release, so that emitters which find the node also see its slot. */
+		if (m_Tail)
+			m_Tail->Next.store(node, std::memory_order_release);
+		else
+			m_Head.store(node, std::memory_order_release);
+
+		m_Tail = node;
+	}
+
+	bool empty() const
+	{
+		return !m_Head.load(std::memory_order_acquire);
+	}
+
+	void operator()(Args... args) const
+	{
+		for (Node *node = m_Head.load(std::memory_order_acquire); node; node = node->Next.load(std::memory_order_acquire))
+			node->Func(args...);
+	}
+
+private:
+	struct Node
+	{
+		Slot Func;
+		std::atomic<Node*> Next;
+
+		explicit Node(Slot func) : Func(std::move(func)), Next(nullptr)
+		{ }
+	};
+
+	std::atomic<Node*> m_Head{nullptr};
+	Node *m_Tail{nullptr};
+	std::mutex m_ConnectMutex;
+};
+
+}
+
+#endif /* OBSERVERLIST_H */
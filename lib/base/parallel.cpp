@@ -0,0 +1,132 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/parallel.hpp"
+#include "base/application.hpp"
+#include "base/threadpool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+using namespace icinga;
+
+namespace
+{
+
+/**
+ * The chunks of one ParallelForRanges() call, shared with its helpers.
+ */
+struct ParallelRanges
+{
+	std::atomic<size_t> Next{0};
+	size_t Count;
+	size_t Grain;
+	const std::function<void (size_t, size_t)> *Func;
+
+	std::mutex Mutex;
+	std::condition_variable CV;
+	size_t Running{0};
+	bool Done{false};
+	std::exception_ptr Error;
+
+	/**
+	 * Processes chunks until there are none left.
+	 */
+	void Run()
+	{
+		for (;;) {
+			size_t begin = Next.fetch_add(Grain);
+
+			if (begin >= Count)
+				return;
+
+			try {
+				(*Func)(begin, std::min(begin + Grain, Count));
+			} catch (...) {
+				std::unique_lock<std::mutex> lock (Mutex);
+
+				if (!Error)
+					Error = std::current_exception();
+
+				/* Don't start any further chunks. */
+				Next.store(Count);
+				return;
+			}
+		}
+	}
+};
+
+}
+
+/**
+ * Splits [0, count) into chunks and calls func(begin, end) for each of them,
+ * partly on the global thread pool, and waits for all of them.
+ *
+ * The calling thread processes chunks as well and only waits for helpers
+ * which have already started, so this doesn't deadlock even if called from
+ * within the thread pool. If func throws, no further chunks are started
+ * and the first exception is re-thrown here.
+ *
+ * @param count The number of items
+ * @param minGrain Process at least that many items per chunk
+ * @param func Called for each chunk, possibly concurrently
+ */
+void icinga::ParallelForRanges(size_t count, size_t minGrain, const std::function<void (size_t, size_t)>& func)
+{
+	if (count == 0)
+		return;
+
+	size_t threads = std::max(1u, std::thread::hardware_concurrency());
+	size_t grain = GetParallelGrain(count, threads, std::max<size_t>(minGrain, 1));
+
+	if (grain >= count) {
+		func(0, count);
+		return;
+	}
+
+	auto ranges (std::make_shared<ParallelRanges>());
+	ranges->Count = count;
+	ranges->Grain = grain;
+	ranges->Func = &func;
+
+	size_t helpers = std::min(threads, (count + grain - 1) / grain - 1);
+
+	for (size_t i = 0; i < helpers; i++) {
+		bool posted = Application::GetTP().Post([ranges]() {
+			{
+				std::unique_lock<std::mutex> lock (ranges->Mutex);
+
+				if (ranges->Done)
+					return;
+
+				ranges->Running++;
+			}
+
+			ranges->Run();
+
+			std::unique_lock<std::mutex> lock (ranges->Mutex);
+
+			if (!--ranges->Running)
+				ranges->CV.notify_all();
+		}, DefaultScheduler);
+
+		if (!posted)
+			break;
+	}
+
+	ranges->Run();
+
+	/* Only wait for the helpers which have already started, the others may
+	 * be stuck in the queue behind threads waiting just like us.
+	 */
+	std::unique_lock<std::mutex> lock (ranges->Mutex);
+
+	ranges->Done = true;
+	ranges->CV.wait(lock, [&ranges]() { return ranges->Running == 0; });
+
+	if (ranges->Error)
+		std::rethrow_exception(ranges->Error);
+}
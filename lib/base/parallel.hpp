@@ -0,0 +1,47 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "base/i2-base.hpp"
+#include <cstddef>
+#include <functional>
+
+namespace icinga
+{
+
+/**
+ * Returns how many items to process per chunk when splitting count items
+ * among threads. There are a few more chunks than threads so that idle
+ * threads can pick up the remainder of a slow chunk.
+ *
+ * @param count The number of items
+ * @param threads The number of threads
+ * @param minGrain Process at least that many items per chunk
+ */
+template<typename SizeType>
+SizeType GetParallelGrain(SizeType count, size_t threads, SizeType minGrain = 1)
+{
+	SizeType grain = count / (static_cast<SizeType>(threads) * 8);
+
+	return grain < minGrain ? minGrain : grain;
+}
+
+void ParallelForRanges(size_t count, size_t minGrain, const std::function<void (size_t, size_t)>& func);
+
+/**
+ * Calls func for every item on the global thread pool and waits for all of
+ * them, see ParallelForRanges().
+ */
+template<typename VectorType, typename FuncType>
+void ParallelFor(const VectorType& items, const FuncType& func, size_t minGrain = 1)
+{
+	ParallelForRanges(items.size(), minGrain, [&items, &func](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; i++)
+			func(items[i]);
+	});
+}
+
+}
+
+#endif /* PARALLEL_H */
@@ -0,0 +1,209 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/parsedperfdata.hpp"
+#include "base/convert.hpp"
+#include "base/objectlock.hpp"
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+using namespace icinga;
+
+/* Labels repeat across the check results of the same checkable, so they are
+ * shared. Interned strings are never released, hence the upper bound.
+ */
+static const size_t l_InternedStringsLimit = 65536;
+
+static std::mutex l_InternedStringsMutex;
+static std::unordered_map<std::string, String> l_InternedStrings;
+
+ParsedPerfdata::ParsedPerfdata(const Array::Ptr& perfdata)
+{
+	if (!perfdata)
+		return;
+
+	ObjectLock olock(perfdata);
+
+	size_t length = perfdata->GetLength();
+
+	m_Labels.reserve(length);
+	m_Units.reserve(length);
+	m_Values.reserve(length);
+	m_Warns.reserve(length);
+	m_Crits.reserve(length);
+	m_Mins.reserve(length);
+	m_Maxs.reserve(length);
+	m_Flags.reserve(length);
+
+	for (const Value& val : perfdata) {
+		PerfdataFields fields;
+
+		if (val.IsObjectType<PerfdataValue>()) {
+			PerfdataValue::Ptr pdv = val;
+
+			static const struct {
+				Value (PerfdataValue::*Getter)() const;
+				double PerfdataFields::*Field;
+				unsigned char Flag;
+			} thresholds[] = {
+				{ &PerfdataValue::GetWarn, &PerfdataFields::Warn, PerfdataFields::HasWarn },
+				{ &PerfdataValue::GetCrit, &PerfdataFields::Crit, PerfdataFields::HasCrit },
+				{ &PerfdataValue::GetMin, &PerfdataFields::Min, PerfdataFields::HasMin },
+				{ &PerfdataValue::GetMax, &PerfdataFields::Max, PerfdataFields::HasMax }
+			};
+
+			fields.Value = pdv->GetValue();
+			fields.Flags = pdv->GetCounter() ? PerfdataFields::Counter : 0;
+
+			for (auto& threshold : thresholds) {
+				Value limit (((*pdv).*threshold.Getter)());
+
+				if (limit.IsEmpty()) {
+					fields.*threshold.Field = 0;
+				} else {
+					fields.*threshold.Field = Convert::ToDouble(limit);
+					fields.Flags |= threshold.Flag;
+				}
+			}
+
+			String label (pdv->GetLabel());
+			String unit (pdv->GetUnit());
+
+			Add(Intern(label.CStr(), label.GetLength()), Intern(unit.CStr(), unit.GetLength()), fields);
+			continue;
+		}
+
+		String perfdataString (val);
+		size_t labelBegin, labelLength;
+
+		try {
+			PerfdataValue::ParseFields(perfdataString, labelBegin, labelLength, fields);
+		} catch (const std::exception&) {
+			m_Invalid.push_back(val);
+			continue;
+		}
+
+		Add(Intern(perfdataString.CStr() + labelBegin, labelLength), Intern(fields.Unit, strlen(fields.Unit)), fields);
+	}
+}
+
+void ParsedPerfdata::Add(const String *label, const String *unit, const PerfdataFields& fields)
+{
+	m_Labels.push_back(label);
+	m_Units.push_back(unit);
+	m_Values.push_back(fields.Value);
+	m_Warns.push_back(fields.Warn);
+	m_Crits.push_back(fields.Crit);
+	m_Mins.push_back(fields.Min);
+	m_Maxs.push_back(fields.Max);
+	m_Flags.push_back(fields.Flags);
+}
+
+const String *ParsedPerfdata::Intern(const char *data, size_t length)
+{
+	std::string key (data, length);
+
+	{
+		std::unique_lock<std::mutex> lock (l_InternedStringsMutex);
+
+		auto interned (l_InternedStrings.find(key));
+
+		if (interned != l_InternedStrings.end())
+			return &interned->second;
+
+		if (l_InternedStrings.size() < l_InternedStringsLimit) {
+			String value (key);
+			return &l_InternedStrings.emplace(std::move(key), std::move(value)).first->second;
+		}
+	}
+
+	m_OwnLabels.emplace_back(std::move(key));
+	return &m_OwnLabels.back();
+}
+
+size_t ParsedPerfdata::GetLength() const
+{
+	return m_Values.size();
+}
+
+const String& ParsedPerfdata::GetLabel(size_t index) const
+{
+	return *m_Labels[index];
+}
+
+double ParsedPerfdata::GetValue(size_t index) const
+{
+	return m_Values[index];
+}
+
+const String& ParsedPerfdata::GetUnit(size_t index) const
+{
+	return *m_Units[index];
+}
+
+bool ParsedPerfdata::IsCounter(size_t index) const
+{
+	return m_Flags[index] & PerfdataFields::Counter;
+}
+
+bool ParsedPerfdata::HasWarn(size_t index) const
+{
+	return m_Flags[index] & PerfdataFields::HasWarn;
+}
+
+bool ParsedPerfdata::HasCrit(size_t index) const
+{
+	return m_Flags[index] & PerfdataFields::HasCrit;
+}
+
+bool ParsedPerfdata::HasMin(size_t index) const
+{
+	return m_Flags[index] & PerfdataFields::HasMin;
+}
+
+bool ParsedPerfdata::HasMax(size_t index) const
+{
+	return m_Flags[index] & PerfdataFields::HasMax;
+}
+
+double ParsedPerfdata::GetWarn(size_t index) const
+{
+	return m_Warns[index];
+}
+
+double ParsedPerfdata::GetCrit(size_t index) const
+{
+	return m_Crits[index];
+}
+
+double ParsedPerfdata::GetMin(size_t index) const
+{
+	return m_Mins[index];
+}
+
+double ParsedPerfdata::GetMax(size_t index) const
+{
+	return m_Maxs[index];
+}
+
+/**
+ * Materializes one metric as a PerfdataValue, for consumers which need an object.
+ */
+PerfdataValue::Ptr ParsedPerfdata::GetPerfdataValue(size_t index) const
+{
+	return new PerfdataValue(GetLabel(index), GetValue(index), IsCounter(index), GetUnit(index),
+		HasWarn(index) ? Value(GetWarn(index)) : Empty,
+		HasCrit(index) ? Value(GetCrit(index)) : Empty,
+		HasMin(index) ? Value(GetMin(index)) : Empty,
+		HasMax(index) ? Value(GetMax(index)) : Empty);
+}
+
+/**
+ * The entries which could not be parsed, in their original form.
+ */
+const std::vector<Value>& ParsedPerfdata::GetInvalid() const
+{
+	return m_Invalid;
+}
@@ -0,0 +1,69 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef PARSEDPERFDATA_H
+#define PARSEDPERFDATA_H
+
+#include "base/i2-base.hpp"
+#include "base/array.hpp"
+#include "base/perfdatavalue.hpp"
+#include <deque>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * The performance data of a check result, parsed once and stored column-wise.
+ *
+ * Labels and units are interned, so iterating over the metrics
+ * doesn't allocate anything per metric.
+ *
+ * @ingroup base
+ */
+class ParsedPerfdata final : public Object
+{
+public:
+	DECLARE_PTR_TYPEDEFS(ParsedPerfdata);
+
+	explicit ParsedPerfdata(const Array::Ptr& perfdata);
+
+	size_t GetLength() const;
+
+	const String& GetLabel(size_t index) const;
+	double GetValue(size_t index) const;
+	const String& GetUnit(size_t index) const;
+	bool IsCounter(size_t index) const;
+
+	bool HasWarn(size_t index) const;
+	bool HasCrit(size_t index) const;
+	bool HasMin(size_t index) const;
+	bool HasMax(size_t index) const;
+
+	double GetWarn(size_t index) const;
+	double GetCrit(size_t index) const;
+	double GetMin(size_t index) const;
+	double GetMax(size_t index) const;
+
+	PerfdataValue::Ptr GetPerfdataValue(size_t index) const;
+
+	const std::vector<Value>& GetInvalid() const;
+
+private:
+	std::vector<const String*> m_Labels;
+	std::vector<const String*> m_Units;
+	std::vector<double> m_Values;
+	std::vector<double> m_Warns;
+	std::vector<double> m_Crits;
+	std::vector<double> m_Mins;
+	std::vector<double> m_Maxs;
+	std::vector<unsigned char> m_Flags;
+	std::deque<String> m_OwnLabels;
+	std::vector<Value> m_Invalid;
+
+	void Add(const String *label, const String *unit, const PerfdataFields& fields);
+	const String *Intern(const char *data, size_t length);
+};
+
+}
+
+#endif /* PARSEDPERFDATA_H */
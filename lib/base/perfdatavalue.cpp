@@ -7,7 +7,10 @@
 #include "base/logger.hpp"
 #include "base/function.hpp"
 #include <boost/algorithm/string.hpp>
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
@@ -225,91 +228,250 @@ PerfdataValue::PerfdataValue(const String& label, double value, bool counter,
 	SetMax(max, true);
 }
 
-PerfdataValue::Ptr PerfdataValue::Parse(const String& perfdata)
+/**
+ * Whether c may be part of a number in performance data
+ */
+static inline bool IsNumberChar(char c)
 {
-	size_t eqp = perfdata.FindLastOf('=');
+	return (c >= '0' && c <= '9') || c == '+' || c == '-' || c == '.' || c == 'e';
+}
 
-	if (eqp == String::NPos)
-		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid performance data value: " + perfdata));
+static const double l_PowersOf10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * Parse [begin, end) as a floating point number, if that's possible exactly without big number arithmetic
+ *
+ * That's the case if both the mantissa and the power of 10 are exactly representable as doubles,
+ * so that a single multiplication or division rounds correctly.
+ *
+ * @return Whether [begin, end) has been parsed
+ */
+static bool ParseNumberFast(const char *begin, const char *end, double& result)
+{
+	const char *pos = begin;
+	bool negative = false;
+
+	if (pos != end && (*pos == '+' || *pos == '-')) {
+		negative = *pos == '-';
+		++pos;
+	}
+
+	uint_fast64_t mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+
+	for (; pos != end && *pos >= '0' && *pos <= '9'; ++pos, ++digits) {
+		mantissa = mantissa * 10u + (*pos - '0');
+	}
+
+	if (pos != end && *pos == '.') {
+		for (++pos; pos != end && *pos >= '0' && *pos <= '9'; ++pos, ++digits, --exponent) {
+			mantissa = mantissa * 10u + (*pos - '0');
+		}
+	}
+
+	if (!digits || digits > 19) {
+		return false;
+	}
+
+	if (pos != end && *pos == 'e') {
+		bool negativeExponent = false;
+		int explicitExponent = 0;
+		int exponentDigits = 0;
+
+		++pos;
+
+		if (pos != end && (*pos == '+' || *pos == '-')) {
+			negativeExponent = *pos == '-';
+			++pos;
+		}
+
+		for (; pos != end && *pos >= '0' && *pos <= '9'; ++pos, ++exponentDigits) {
+			if (explicitExponent < 1000) {
+				explicitExponent = explicitExponent * 10 + (*pos - '0');
+			}
+		}
+
+		if (!exponentDigits) {
+			return false;
+		}
+
+		exponent += negativeExponent ? -explicitExponent : explicitExponent;
+	}
+
+	if (pos != end || mantissa > (uint_fast64_t(1) << 53u) || exponent < -22 || exponent > 22) {
+		return false;
+	}
+
+	result = exponent < 0 ? mantissa / l_PowersOf10[-exponent] : mantissa * l_PowersOf10[exponent];
+
+	if (negative) {
+		result = -result;
+	}
 
-	String label = perfdata.SubStr(0, eqp);
+	return true;
+}
 
-	if (label.GetLength() > 2 && label[0] == '\'' && label[label.GetLength() - 1] == '\'')
-		label = label.SubStr(1, label.GetLength() - 2);
+/**
+ * Parse [begin, end) as Convert::ToDouble() does, but without copying it in the common case
+ */
+static inline double ParseNumber(const char *begin, const char *end)
+{
+	double result;
 
-	size_t spq = perfdata.FindFirstOf(' ', eqp);
+	if (ParseNumberFast(begin, end, result)) {
+		return result;
+	}
 
-	if (spq == String::NPos)
-		spq = perfdata.GetLength();
+	return Convert::ToDouble(String(begin, end));
+}
 
-	String valueStr = perfdata.SubStr(eqp + 1, spq - eqp - 1);
+/**
+ * Parse a warning/critical/minimum/maximum perfdata value
+ *
+ * @param begin Start of the ;-separated token
+ * @param end End of the token
+ * @param description What the token is for (for the debug log)
+ * @param result Set to the parsed value
+ *
+ * @return Whether the token specifies a supported value
+ */
+static bool ParseWarnCritMinMax(const char *begin, const char *end, const char *description, double& result)
+{
+	if (begin == end) {
+		return false;
+	}
+
+	if (!(end - begin == 1 && *begin == 'U') && std::all_of(begin, end, IsNumberChar)) {
+		result = ParseNumber(begin, end);
+		return true;
+	}
 
-	size_t pos = valueStr.FindFirstNotOf("+-0123456789.e");
+	Log(LogDebug, "PerfdataValue")
+		<< "Ignoring unsupported perfdata " << description << " range, value: '" << String(begin, end) << "'.";
 
-	if (pos != String::NPos && valueStr[pos] == ',') {
+	return false;
+}
+
+/**
+ * Parse a single performance data value in one pass and without creating any objects
+ *
+ * @param perfdata E.g. "'my label'=42.5ms;100;200;0"
+ * @param labelBegin Set to the label's offset in perfdata, quotes excluded
+ * @param labelLength Set to the label's length
+ * @param fields Set to everything else
+ */
+void PerfdataValue::ParseFields(const String& perfdata, size_t& labelBegin, size_t& labelLength, PerfdataFields& fields)
+{
+	size_t eqp = perfdata.FindLastOf('=');
+
+	if (eqp == String::NPos)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid performance data value: " + perfdata));
+
+	const char *data = perfdata.CStr();
+
+	labelBegin = 0;
+	labelLength = eqp;
+
+	if (labelLength > 2 && data[0] == '\'' && data[labelLength - 1] == '\'') {
+		labelBegin = 1;
+		labelLength -= 2;
 	}
 
-	double value = Convert::ToDouble(valueStr.SubStr(0, pos));
+	const char *valueBegin = data + eqp + 1;
+	const char *valueEnd = (const char*)memchr(valueBegin, ' ', perfdata.GetLength() - eqp - 1);
 
-	std::vector<String> tokens = valueStr.Split(";");
+	if (!valueEnd)
+		valueEnd = data + perfdata.GetLength();
 
-	bool counter = false;
-	String unit;
-	Value warn, crit, min, max;
+	const char *numberEnd = std::find_if_not(valueBegin, valueEnd, IsNumberChar);
 
-	if (pos != String::NPos)
-		unit = valueStr.SubStr(pos, tokens[0].GetLength() - pos);
+	if (numberEnd != valueEnd && *numberEnd == ',') {
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid performance data value: " + perfdata));
+	}
 
+	fields.Value = ParseNumber(valueBegin, numberEnd);
+	fields.Flags = 0;
+
+	const char *tokenEnd = std::find(numberEnd, valueEnd, ';');
+	std::string unit (numberEnd, tokenEnd);
 	double base;
 
 	{
-		auto uom (l_CsUoMs.find(unit.GetData()));
+		auto uom (l_CsUoMs.find(unit));
 
 		if (uom == l_CsUoMs.end()) {
-			auto ciUnit (unit.ToLower());
-			auto uom (l_CiUoMs.find(ciUnit.GetData()));
+			auto ciUnit (unit);
+			boost::algorithm::to_lower(ciUnit);
+
+			auto uom (l_CiUoMs.find(ciUnit));
 
 			if (uom == l_CiUoMs.end()) {
 				Log(LogDebug, "PerfdataValue")
 					<< "Invalid performance data unit: " << unit;
 
-				unit = "";
+				fields.Unit = "";
 				base = 1.0;
 			} else {
-				unit = uom->second.Out;
+				fields.Unit = uom->second.Out;
 				base = uom->second.Factor;
 			}
 		} else {
-			unit = uom->second.Out;
+			fields.Unit = uom->second.Out;
 			base = uom->second.Factor;
 		}
 	}
 
-	if (unit == "c") {
-		counter = true;
+	if (!strcmp(fields.Unit, "c")) {
+		fields.Flags |= PerfdataFields::Counter;
 	}
 
-	warn = ParseWarnCritMinMaxToken(tokens, 1, "warning");
-	crit = ParseWarnCritMinMaxToken(tokens, 2, "critical");
-	min = ParseWarnCritMinMaxToken(tokens, 3, "minimum");
-	max = ParseWarnCritMinMaxToken(tokens, 4, "maximum");
-
-	value = value * base;
-
-	if (!warn.IsEmpty())
-		warn = warn * base;
+	static const struct {
+		double PerfdataFields::*Field;
+		unsigned char Flag;
+		const char *Description;
+	} thresholds[] = {
+		{ &PerfdataFields::Warn, PerfdataFields::HasWarn, "warning" },
+		{ &PerfdataFields::Crit, PerfdataFields::HasCrit, "critical" },
+		{ &PerfdataFields::Min, PerfdataFields::HasMin, "minimum" },
+		{ &PerfdataFields::Max, PerfdataFields::HasMax, "maximum" }
+	};
+
+	for (auto& threshold : thresholds) {
+		auto& field (fields.*threshold.Field);
+
+		field = 0;
+
+		if (tokenEnd != valueEnd) {
+			const char *tokenBegin = tokenEnd + 1;
+			tokenEnd = std::find(tokenBegin, valueEnd, ';');
+
+			if (ParseWarnCritMinMax(tokenBegin, tokenEnd, threshold.Description, field)) {
+				field *= base;
+				fields.Flags |= threshold.Flag;
+			}
+		}
+	}
 
-	if (!crit.IsEmpty())
-		crit = crit * base;
+	fields.Value *= base;
+}
 
-	if (!min.IsEmpty())
-		min = min * base;
+PerfdataValue::Ptr PerfdataValue::Parse(const String& perfdata)
+{
+	size_t labelBegin, labelLength;
+	PerfdataFields fields;
 
-	if (!max.IsEmpty())
-		max = max * base;
+	ParseFields(perfdata, labelBegin, labelLength, fields);
 
-	return new PerfdataValue(label, value, counter, unit, warn, crit, min, max);
+	return new PerfdataValue(perfdata.SubStr(labelBegin, labelLength), fields.Value,
+		fields.Flags & PerfdataFields::Counter, fields.Unit,
+		fields.Flags & PerfdataFields::HasWarn ? Value(fields.Warn) : Empty,
+		fields.Flags & PerfdataFields::HasCrit ? Value(fields.Crit) : Empty,
+		fields.Flags & PerfdataFields::HasMin ? Value(fields.Min) : Empty,
+		fields.Flags & PerfdataFields::HasMax ? Value(fields.Max) : Empty);
 }
 
 static const std::unordered_map<std::string, const char*> l_FormatUoMs ({
@@ -376,15 +538,3 @@ String PerfdataValue::Format() const
 
 	return result.str();
 }
-
-Value PerfdataValue::ParseWarnCritMinMaxToken(const std::vector<String>& tokens, std::vector<String>::size_type index, const String& description)
-{
-	if (tokens.size() > index && tokens[index] != "U" && tokens[index] != "" && tokens[index].FindFirstNotOf("+-0123456789.e") == String::NPos)
-		return Convert::ToDouble(tokens[index]);
-	else {
-		if (tokens.size() > index && tokens[index] != "")
-			Log(LogDebug, "PerfdataValue")
-				<< "Ignoring unsupported perfdata " << description << " range, value: '" << tokens[index] << "'.";
-		return Empty;
-	}
-}
@@ -9,6 +9,32 @@
 namespace icinga
 {
 
+/**
+ * A performance data value's numbers and unit as plain data.
+ *
+ * @ingroup base
+ */
+struct PerfdataFields
+{
+	enum : unsigned char
+	{
+		HasWarn = 1u,
+		HasCrit = 1u << 1u,
+		HasMin = 1u << 2u,
+		HasMax = 1u << 3u,
+		Counter = 1u << 4u
+	};
+
+	double Value;
+	double Warn;
+	double Crit;
+	double Min;
+	double Max;
+	// Normalized, e.g. "bytes", static storage
+	const char *Unit;
+	unsigned char Flags;
+};
+
 /**
  * A performance data value.
  *
@@ -26,11 +52,8 @@ public:
 		const Value& min = Empty, const Value& max = Empty);
 
 	static PerfdataValue::Ptr Parse(const String& perfdata);
+	static void ParseFields(const String& perfdata, size_t& labelBegin, size_t& labelLength, PerfdataFields& fields);
 	String Format() const;
-
-private:
-	static Value ParseWarnCritMinMaxToken(const std::vector<String>& tokens,
-		std::vector<String>::size_type index, const String& description);
 };
 
 }
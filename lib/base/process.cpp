@@ -10,9 +10,15 @@
 #include "base/logger.hpp"
 #include "base/utility.hpp"
 #include "base/scriptglobal.hpp"
-#include "base/json.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/statsfunction.hpp"
+#include "base/tracing.hpp"
 #include <boost/algorithm/string/join.hpp>
 #include <boost/thread/once.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <set>
 #include <thread>
 #include <iostream>
 
@@ -21,6 +27,10 @@
 #	include <poll.h>
 #	include <string.h>
 
+#	ifdef HAVE_EPOLL
+#		include <sys/epoll.h>
+#	endif /* HAVE_EPOLL */
+
 #	ifndef __APPLE__
 extern char **environ;
 #	else /* __APPLE__ */
@@ -31,32 +41,79 @@ extern char **environ;
 
 using namespace icinga;
 
-#define IOTHREADS 4
+/* The maximum number of I/O threads. They are started on demand as the number of running processes grows. */
+#define IOTHREADS 32
 
 static std::mutex l_ProcessMutex[IOTHREADS];
 static std::map<Process::ProcessHandle, Process::Ptr> l_Processes[IOTHREADS];
+static std::atomic<size_t> l_ProcessCount[IOTHREADS];
+static std::mutex l_IOThreadMutex;
+static std::atomic<int> l_IOThreadCount (0);
 #ifdef _WIN32
 static HANDLE l_Events[IOTHREADS];
 #else /* _WIN32 */
 static int l_EventFDs[IOTHREADS][2];
 static std::map<Process::ConsoleHandle, Process::ProcessHandle> l_FDs[IOTHREADS];
 
-static std::mutex l_ProcessControlMutex;
+#	ifdef HAVE_EPOLL
+static int l_EpollFDs[IOTHREADS];
+
+/* The timeouts of the processes, so the I/O threads don't have to scan all of them. */
+static std::set<std::pair<double, Process::ProcessHandle>> l_Deadlines[IOTHREADS];
+#	endif /* HAVE_EPOLL */
+
+#define SPAWNHELPERS 4
+
+/* Three FDs per spawn, so a batch stays below the kernel's limit of FDs per message. */
+#define SPAWNBATCHSIZE 64
+
+struct SpawnRequest
+{
+	String Payload;
+	int FDs[3];
+	pid_t PID{-1};
+	int Error{0};
+	bool Done{false};
+};
+
+struct SpawnHelper
+{
+	/* Serializes the use of the control socket. */
+	std::mutex Mutex;
+	int FD{-1};
+	pid_t PID{-1};
+
+	std::mutex QueueMutex;
+	std::vector<SpawnRequest *> Queue;
+};
+
+static SpawnHelper l_SpawnHelpers[SPAWNHELPERS];
+static std::atomic<unsigned int> l_NextSpawnHelper (0);
+
+/* The control socket of the spawn helper, only used in the helper process itself. */
 static int l_ProcessControlFD = -1;
-static pid_t l_ProcessControlPID;
 #endif /* _WIN32 */
+
+#define SPAWNLATENCYSAMPLES 1024
+
+static std::mutex l_SpawnLatencyMutex;
+static std::vector<double> l_SpawnLatencies;
+static size_t l_SpawnLatencyIndex = 0;
+static std::atomic<double> l_SpawnLatencyAverage (0);
 static boost::once_flag l_ProcessOnceFlag = BOOST_ONCE_INIT;
 static boost::once_flag l_SpawnHelperOnceFlag = BOOST_ONCE_INIT;
 
+REGISTER_STATSFUNCTION(Process, &Process::StatsFunc);
+
 Process::Process(Process::Arguments arguments, Dictionary::Ptr extraEnvironment)
 	: m_Arguments(std::move(arguments)), m_ExtraEnvironment(std::move(extraEnvironment)),
 	  m_Timeout(600)
 #ifdef _WIN32
 	, m_ReadPending(false), m_ReadFailed(false), m_Overlapped()
 #else /* _WIN32 */
-	, m_SentSigterm(false)
+	, m_SentSigterm(false), m_SpawnHelper(0), m_Stdin(STDIN_FILENO), m_Stdout(-1)
 #endif /* _WIN32 */
-	, m_AdjustPriority(false), m_ResultAvailable(false)
+	, m_AdjustPriority(false), m_MaxOutputSize(0), m_DiscardedOutput(0), m_ResultAvailable(false)
 {
 #ifdef _WIN32
 	m_Overlapped.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
@@ -70,73 +127,179 @@ Process::~Process()
 #endif /* _WIN32 */
 }
 
+static void AddSpawnLatency(double latency)
+{
+	std::unique_lock<std::mutex> lock(l_SpawnLatencyMutex);
+
+	if (l_SpawnLatencies.size() < SPAWNLATENCYSAMPLES)
+		l_SpawnLatencies.push_back(latency);
+	else
+		l_SpawnLatencies[l_SpawnLatencyIndex] = latency;
+
+	l_SpawnLatencyIndex = (l_SpawnLatencyIndex + 1) % SPAWNLATENCYSAMPLES;
+
+	auto average (l_SpawnLatencyAverage.load());
+	l_SpawnLatencyAverage.store(average > 0 ? average * 0.9 + latency * 0.1 : latency);
+}
+
 #ifndef _WIN32
-static Value ProcessSpawnImpl(struct msghdr *msgh, const Dictionary::Ptr& request)
+/* Spawn helper wire format
+ *
+ * Each request starts with a SpawnHelperHeader, followed by Length bytes of
+ * payload. A spawn request carries Count spawns with three FDs each as
+ * ancillary data. Each spawn is encoded as its flags, the arguments and the
+ * extra environment variables (already formatted as "key=value"). Integers
+ * are in host byte order as both ends run on the same machine, and strings
+ * are NUL-terminated so the helper can point argv and envp into the buffer.
+ */
+enum SpawnHelperCommand : uint32_t
 {
-	struct cmsghdr *cmsg = CMSG_FIRSTHDR(msgh);
+	SpawnHelperSpawn = 1,
+	SpawnHelperWaitPID = 2,
+	SpawnHelperKill = 3
+};
 
-	if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * 3)) {
-		std::cerr << "Invalid 'spawn' request: FDs missing" << std::endl;
-		return Empty;
+enum SpawnHelperFlags : uint32_t
+{
+	SpawnAdjustPriority = 1
+};
+
+struct SpawnHelperHeader
+{
+	uint32_t Command;
+	uint32_t Count;
+	uint32_t Length;
+};
+
+static bool SendAll(int fd, const char *buf, size_t length)
+{
+	while (length > 0) {
+		ssize_t rc = send(fd, buf, length, 0);
+
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return false;
+		}
+
+		buf += rc;
+		length -= rc;
 	}
 
-	auto *fds = (int *)CMSG_DATA(cmsg);
+	return true;
+}
 
-	Array::Ptr arguments = request->Get("arguments");
-	Dictionary::Ptr extraEnvironment = request->Get("extraEnvironment");
-	bool adjustPriority = request->Get("adjustPriority");
+static bool RecvAll(int fd, char *buf, size_t length)
+{
+	while (length > 0) {
+		ssize_t rc = recv(fd, buf, length, 0);
 
-	// build argv
-	auto **argv = new char *[arguments->GetLength() + 1];
+		if (rc <= 0) {
+			if (rc < 0 && (errno == EINTR || errno == EAGAIN))
+				continue;
+
+			return false;
+		}
 
-	for (unsigned int i = 0; i < arguments->GetLength(); i++) {
-		String arg = arguments->Get(i);
-		argv[i] = strdup(arg.CStr());
+		buf += rc;
+		length -= rc;
 	}
 
-	argv[arguments->GetLength()] = nullptr;
+	return true;
+}
 
-	// build envp
-	int envc = 0;
+static void EncodeUInt32(String& buf, uint32_t value)
+{
+	buf.GetData().append((const char *)&value, sizeof(value));
+}
 
-	/* count existing environment variables */
-	while (environ[envc])
-		envc++;
+static void EncodeString(String& buf, const String& str)
+{
+	EncodeUInt32(buf, str.GetLength() + 1);
+	buf.GetData().append(str.CStr(), str.GetLength() + 1);
+}
 
-	auto **envp = new char *[envc + (extraEnvironment ? extraEnvironment->GetLength() : 0) + 2];
-	const char* lcnumeric = "LC_NUMERIC=";
-	int j = 0;
+static bool DecodeUInt32(const char*& pos, const char *end, uint32_t& value)
+{
+	if (end - pos < (ptrdiff_t)sizeof(value))
+		return false;
 
-	for (int i = 0; i < envc; i++) {
-		if (strncmp(environ[i], lcnumeric, strlen(lcnumeric)) == 0) {
-			continue;
-		}
+	memcpy(&value, pos, sizeof(value));
+	pos += sizeof(value);
+	return true;
+}
+
+static bool DecodeString(const char*& pos, const char *end, char*& str)
+{
+	uint32_t length;
+
+	if (!DecodeUInt32(pos, end, length) || length == 0 || end - pos < (ptrdiff_t)length || pos[length - 1] != '\0')
+		return false;
+
+	str = const_cast<char *>(pos);
+	pos += length;
+	return true;
+}
+
+/* The helper's environment without LC_NUMERIC, computed once per helper process. */
+static std::vector<char *> l_SpawnHelperEnvironment;
+
+static pid_t ProcessSpawnImpl(const char*& pos, const char *end, const int fds[3], int *errorCode)
+{
+	uint32_t flags, argc, envc;
+
+	std::vector<char *> argv;
 
-		envp[j] = strdup(environ[i]);
-		++j;
+	if (!DecodeUInt32(pos, end, flags) || !DecodeUInt32(pos, end, argc) || argc == 0) {
+		*errorCode = EINVAL;
+		return -1;
 	}
 
-	if (extraEnvironment) {
-		ObjectLock olock(extraEnvironment);
+	argv.resize(argc + 1);
 
-		for (const Dictionary::Pair& kv : extraEnvironment) {
-			String skv = kv.first + "=" + Convert::ToString(kv.second);
-			envp[j] = strdup(skv.CStr());
-			j++;
+	for (uint32_t i = 0; i < argc; i++) {
+		if (!DecodeString(pos, end, argv[i])) {
+			*errorCode = EINVAL;
+			return -1;
 		}
 	}
 
-	envp[j] = strdup("LC_NUMERIC=C");
-	envp[j + 1] = nullptr;
+	argv[argc] = nullptr;
+
+	if (!DecodeUInt32(pos, end, envc)) {
+		*errorCode = EINVAL;
+		return -1;
+	}
 
-	extraEnvironment.reset();
+	std::vector<char *> envp (l_SpawnHelperEnvironment);
+	envp.reserve(envp.size() + envc + 2);
 
-	pid_t pid = fork();
+	for (uint32_t i = 0; i < envc; i++) {
+		char *env;
 
-	int errorCode = 0;
+		if (!DecodeString(pos, end, env)) {
+			*errorCode = EINVAL;
+			return -1;
+		}
+
+		envp.push_back(env);
+	}
+
+	envp.push_back(const_cast<char *>("LC_NUMERIC=C"));
+	envp.push_back(nullptr);
+
+	/* The helper is single-threaded and only execs or exits in the child,
+	 * so it doesn't need to copy its address space.
+	 */
+#ifdef HAVE_VFORK
+	pid_t pid = vfork();
+#else /* HAVE_VFORK */
+	pid_t pid = fork();
+#endif /* HAVE_VFORK */
 
 	if (pid < 0)
-		errorCode = errno;
+		*errorCode = errno;
 
 	if (pid == 0) {
 		// child process
@@ -158,7 +321,7 @@ static Value ProcessSpawnImpl(struct msghdr *msgh, const Dictionary::Ptr& reques
 		(void)close(fds[2]);
 
 #ifdef HAVE_NICE
-		if (adjustPriority) {
+		if (flags & SpawnAdjustPriority) {
 			// Cheating the compiler on "warning: ignoring return value of 'int nice(int)', declared with attribute warn_unused_result [-Wunused-result]".
 			auto x (nice(5));
 			(void)x;
@@ -169,7 +332,7 @@ static Value ProcessSpawnImpl(struct msghdr *msgh, const Dictionary::Ptr& reques
 		sigemptyset(&mask);
 		sigprocmask(SIG_SETMASK, &mask, nullptr);
 
-		if (icinga2_execvpe(argv[0], argv, envp) < 0) {
+		if (icinga2_execvpe(argv[0], argv.data(), envp.data()) < 0) {
 			char errmsg[512];
 			strcpy(errmsg, "execvpe(");
 			strncat(errmsg, argv[0], sizeof(errmsg) - strlen(errmsg) - 1);
@@ -182,59 +345,72 @@ static Value ProcessSpawnImpl(struct msghdr *msgh, const Dictionary::Ptr& reques
 		_exit(128);
 	}
 
-	(void)close(fds[0]);
-	(void)close(fds[1]);
-	(void)close(fds[2]);
+	return pid;
+}
 
-	// free arguments
-	for (int i = 0; argv[i]; i++)
-		free(argv[i]);
+static void ProcessSpawnBatchImpl(struct msghdr *msgh, const SpawnHelperHeader& header, const char *payload)
+{
+	std::vector<int32_t> response (header.Count * 2, -1);
 
-	delete[] argv;
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(msgh);
+	int *fds = nullptr;
 
-	// free environment
-	for (int i = 0; envp[i]; i++)
-		free(envp[i]);
+	if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * 3 * header.Count))
+		std::cerr << "Invalid 'spawn' request: FDs missing" << std::endl;
+	else
+		fds = (int *)CMSG_DATA(cmsg);
 
-	delete[] envp;
+	const char *pos = payload;
+	const char *end = payload + header.Length;
 
-	Dictionary::Ptr response = new Dictionary({
-		{ "rc", pid },
-		{ "errno", errorCode }
-	});
+	for (uint32_t i = 0; fds && i < header.Count; i++) {
+		int errorCode = 0;
 
-	return response;
-}
-
-static Value ProcessKillImpl(struct msghdr *msgh, const Dictionary::Ptr& request)
-{
-	pid_t pid = request->Get("pid");
-	int signum = request->Get("signum");
+		response[i * 2] = ProcessSpawnImpl(pos, end, fds + i * 3, &errorCode);
+		response[i * 2 + 1] = errorCode;
 
-	errno = 0;
-	kill(pid, signum);
-	int error = errno;
+		if (response[i * 2] == -1 && errorCode == EINVAL)
+			std::cerr << "Invalid 'spawn' request: malformed payload" << std::endl;
+	}
 
-	Dictionary::Ptr response = new Dictionary({
-		{ "errno", error }
-	});
+	if (fds) {
+		for (uint32_t i = 0; i < header.Count * 3; i++)
+			(void)close(fds[i]);
+	}
 
-	return response;
+	(void)SendAll(l_ProcessControlFD, (const char *)response.data(), response.size() * sizeof(int32_t));
 }
 
-static Value ProcessWaitPIDImpl(struct msghdr *msgh, const Dictionary::Ptr& request)
+static void ProcessKillImpl(const SpawnHelperHeader& header, const char *payload)
 {
-	pid_t pid = request->Get("pid");
+	const char *pos = payload;
+	const char *end = payload + header.Length;
+	uint32_t pid, signum;
+	int32_t error = EINVAL;
+
+	if (DecodeUInt32(pos, end, pid) && DecodeUInt32(pos, end, signum)) {
+		errno = 0;
+		kill((pid_t)(int32_t)pid, signum);
+		error = errno;
+	}
 
-	int status;
-	int rc = waitpid(pid, &status, 0);
+	(void)SendAll(l_ProcessControlFD, (const char *)&error, sizeof(error));
+}
 
-	Dictionary::Ptr response = new Dictionary({
-		{ "status", status },
-		{ "rc", rc }
-	});
+static void ProcessWaitPIDImpl(const SpawnHelperHeader& header, const char *payload)
+{
+	const char *pos = payload;
+	const char *end = payload + header.Length;
+	uint32_t pid;
+	int32_t response[2] = { -1, 0 };
+
+	if (DecodeUInt32(pos, end, pid)) {
+		int status = 0;
+		response[0] = waitpid((pid_t)(int32_t)pid, &status, 0);
+		response[1] = status;
+	}
 
-	return response;
+	(void)SendAll(l_ProcessControlFD, (const char *)response, sizeof(response));
 }
 
 static void ProcessHandler()
@@ -245,24 +421,33 @@ static void ProcessHandler()
 
 	Utility::CloseAllFDs({0, 1, 2, l_ProcessControlFD});
 
+	const char* lcnumeric = "LC_NUMERIC=";
+
+	for (int i = 0; environ[i]; i++) {
+		if (strncmp(environ[i], lcnumeric, strlen(lcnumeric)) != 0)
+			l_SpawnHelperEnvironment.push_back(environ[i]);
+	}
+
+	std::vector<char> payload;
+
 	for (;;) {
-		size_t length;
+		SpawnHelperHeader header;
 
 		struct msghdr msg;
 		memset(&msg, 0, sizeof(msg));
 
 		struct iovec io;
-		io.iov_base = &length;
-		io.iov_len = sizeof(length);
+		io.iov_base = &header;
+		io.iov_len = sizeof(header);
 
 		msg.msg_iov = &io;
 		msg.msg_iovlen = 1;
 
-		char cbuf[4096];
+		char cbuf[CMSG_SPACE(sizeof(int) * 3 * SPAWNBATCHSIZE)];
 		msg.msg_control = cbuf;
 		msg.msg_controllen = sizeof(cbuf);
 
-		int rc = recvmsg(l_ProcessControlFD, &msg, 0);
+		ssize_t rc = recvmsg(l_ProcessControlFD, &msg, 0);
 
 		if (rc <= 0) {
 			if (rc < 0 && (errno == EINTR || errno == EAGAIN))
@@ -271,65 +456,40 @@ static void ProcessHandler()
 			break;
 		}
 
-		auto *mbuf = new char[length];
-
-		size_t count = 0;
-		while (count < length) {
-			rc = recv(l_ProcessControlFD, mbuf + count, length - count, 0);
-
-			if (rc <= 0) {
-				if (rc < 0 && (errno == EINTR || errno == EAGAIN))
-					continue;
-
-				delete [] mbuf;
+		if ((size_t)rc < sizeof(header) && !RecvAll(l_ProcessControlFD, (char *)&header + rc, sizeof(header) - rc))
+			break;
 
-				_exit(0);
-			}
+		payload.resize(header.Length);
 
-			count += rc;
+		if (!RecvAll(l_ProcessControlFD, payload.data(), payload.size()))
+			break;
 
-			if (rc == 0)
+		switch (header.Command) {
+			case SpawnHelperSpawn:
+				ProcessSpawnBatchImpl(&msg, header, payload.data());
 				break;
-		}
-
-		String jrequest = String(mbuf, mbuf + count);
-
-		delete [] mbuf;
-
-		Dictionary::Ptr request = JsonDecode(jrequest);
-
-		String command = request->Get("command");
-
-		Value response;
-
-		if (command == "spawn")
-			response = ProcessSpawnImpl(&msg, request);
-		else if (command == "waitpid")
-			response = ProcessWaitPIDImpl(&msg, request);
-		else if (command == "kill")
-			response = ProcessKillImpl(&msg, request);
-		else
-			response = Empty;
-
-		String jresponse = JsonEncode(response);
-
-		if (send(l_ProcessControlFD, jresponse.CStr(), jresponse.GetLength(), 0) < 0) {
-			BOOST_THROW_EXCEPTION(posix_error()
-				<< boost::errinfo_api_function("send")
-				<< boost::errinfo_errno(errno));
+			case SpawnHelperWaitPID:
+				ProcessWaitPIDImpl(header, payload.data());
+				break;
+			case SpawnHelperKill:
+				ProcessKillImpl(header, payload.data());
+				break;
+			default:
+				std::cerr << "Invalid spawn helper command: " << header.Command << std::endl;
+				_exit(1);
 		}
 	}
 
 	_exit(0);
 }
 
-static void StartSpawnProcessHelper()
+static void StartSpawnProcessHelper(SpawnHelper& helper)
 {
-	if (l_ProcessControlFD != -1) {
-		(void)close(l_ProcessControlFD);
+	if (helper.FD != -1) {
+		(void)close(helper.FD);
 
 		int status;
-		(void)waitpid(l_ProcessControlPID, &status, 0);
+		(void)waitpid(helper.PID, &status, 0);
 	}
 
 	int controlFDs[2];
@@ -359,182 +519,306 @@ static void StartSpawnProcessHelper()
 
 	(void)close(controlFDs[0]);
 
-	l_ProcessControlFD = controlFDs[1];
-	l_ProcessControlPID = pid;
+	helper.FD = controlFDs[1];
+	helper.PID = pid;
 }
 
-static pid_t ProcessSpawn(const std::vector<String>& arguments, const Dictionary::Ptr& extraEnvironment, bool adjustPriority, int fds[3])
+/**
+ * Sends a request to the spawn helper, restarting it if it has gone away.
+ * The caller must hold the helper's mutex.
+ */
+static void SendSpawnHelperRequest(SpawnHelper& helper, SpawnHelperCommand command, uint32_t count, const String& payload, const std::vector<int>& fds = std::vector<int>())
 {
-	Dictionary::Ptr request = new Dictionary({
-		{ "command", "spawn" },
-		{ "arguments", Array::FromVector(arguments) },
-		{ "extraEnvironment", extraEnvironment },
-		{ "adjustPriority", adjustPriority }
-	});
-
-	String jrequest = JsonEncode(request);
-	size_t length = jrequest.GetLength();
-
-	std::unique_lock<std::mutex> lock(l_ProcessControlMutex);
+	SpawnHelperHeader header;
+	header.Command = command;
+	header.Count = count;
+	header.Length = payload.GetLength();
 
 	struct msghdr msg;
 	memset(&msg, 0, sizeof(msg));
 
 	struct iovec io;
-	io.iov_base = &length;
-	io.iov_len = sizeof(length);
+	io.iov_base = &header;
+	io.iov_len = sizeof(header);
 
 	msg.msg_iov = &io;
 	msg.msg_iovlen = 1;
 
-	char cbuf[CMSG_SPACE(sizeof(int) * 3)];
-	msg.msg_control = cbuf;
-	msg.msg_controllen = sizeof(cbuf);
+	char cbuf[CMSG_SPACE(sizeof(int) * 3 * SPAWNBATCHSIZE)];
 
-	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
-	cmsg->cmsg_level = SOL_SOCKET;
-	cmsg->cmsg_type = SCM_RIGHTS;
-	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 3);
+	if (!fds.empty()) {
+		msg.msg_control = cbuf;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
 
-	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * 3);
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
 
-	msg.msg_controllen = cmsg->cmsg_len;
+		memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+		msg.msg_controllen = cmsg->cmsg_len;
+	}
 
 	do {
-		while (sendmsg(l_ProcessControlFD, &msg, 0) < 0) {
-			StartSpawnProcessHelper();
+		while (sendmsg(helper.FD, &msg, 0) != sizeof(header)) {
+			StartSpawnProcessHelper(helper);
 		}
-	} while (send(l_ProcessControlFD, jrequest.CStr(), jrequest.GetLength(), 0) < 0);
+	} while (!SendAll(helper.FD, payload.CStr(), payload.GetLength()));
+}
 
-	char buf[4096];
+/**
+ * Sends all queued spawn requests of the helper as one batch and stores the
+ * results in the requests. The caller must hold the helper's mutex.
+ */
+static void ProcessSpawnBatch(SpawnHelper& helper)
+{
+	std::vector<SpawnRequest *> batch;
 
-	ssize_t rc = recv(l_ProcessControlFD, buf, sizeof(buf), 0);
+	{
+		std::unique_lock<std::mutex> lock(helper.QueueMutex);
 
-	if (rc <= 0)
-		return -1;
+		auto count (std::min<size_t>(helper.Queue.size(), SPAWNBATCHSIZE));
 
-	String jresponse = String(buf, buf + rc);
+		batch.assign(helper.Queue.begin(), helper.Queue.begin() + count);
+		helper.Queue.erase(helper.Queue.begin(), helper.Queue.begin() + count);
+	}
 
-	Dictionary::Ptr response = JsonDecode(jresponse);
+	if (batch.empty())
+		return;
 
-	if (response->Get("rc") == -1)
-		errno = response->Get("errno");
+	String payload;
+	std::vector<int> fds;
 
-	return response->Get("rc");
+	for (auto request : batch) {
+		payload += request->Payload;
+		fds.insert(fds.end(), request->FDs, request->FDs + 3);
+	}
+
+	SendSpawnHelperRequest(helper, SpawnHelperSpawn, batch.size(), payload, fds);
+
+	std::vector<int32_t> response (batch.size() * 2);
+	bool ok = RecvAll(helper.FD, (char *)response.data(), response.size() * sizeof(int32_t));
+
+	for (size_t i = 0; i < batch.size(); i++) {
+		if (ok) {
+			batch[i]->PID = response[i * 2];
+			batch[i]->Error = response[i * 2 + 1];
+		} else {
+			batch[i]->Error = ECONNRESET;
+		}
+
+		batch[i]->Done = true;
+	}
 }
 
-static int ProcessKill(pid_t pid, int signum)
+static pid_t ProcessSpawn(const std::vector<String>& arguments, const Dictionary::Ptr& extraEnvironment, bool adjustPriority, int fds[3], int *helperIndex)
 {
-	Dictionary::Ptr request = new Dictionary({
-		{ "command", "kill" },
-		{ "pid", pid },
-		{ "signum", signum }
-	});
+	SpawnRequest request;
 
-	String jrequest = JsonEncode(request);
-	size_t length = jrequest.GetLength();
+	EncodeUInt32(request.Payload, adjustPriority ? SpawnAdjustPriority : 0);
+	EncodeUInt32(request.Payload, arguments.size());
 
-	std::unique_lock<std::mutex> lock(l_ProcessControlMutex);
+	for (const String& arg : arguments)
+		EncodeString(request.Payload, arg);
 
-	do {
-		while (send(l_ProcessControlFD, &length, sizeof(length), 0) < 0) {
-			StartSpawnProcessHelper();
-		}
-	} while (send(l_ProcessControlFD, jrequest.CStr(), jrequest.GetLength(), 0) < 0);
+	if (extraEnvironment) {
+		ObjectLock olock(extraEnvironment);
 
-	char buf[4096];
+		EncodeUInt32(request.Payload, extraEnvironment->GetLength());
 
-	ssize_t rc = recv(l_ProcessControlFD, buf, sizeof(buf), 0);
+		for (const Dictionary::Pair& kv : extraEnvironment)
+			EncodeString(request.Payload, kv.first + "=" + Convert::ToString(kv.second));
+	} else {
+		EncodeUInt32(request.Payload, 0);
+	}
 
-	if (rc <= 0)
-		return -1;
+	memcpy(request.FDs, fds, sizeof(request.FDs));
+
+	*helperIndex = l_NextSpawnHelper.fetch_add(1) % SPAWNHELPERS;
+	auto& helper (l_SpawnHelpers[*helperIndex]);
+
+	{
+		std::unique_lock<std::mutex> lock(helper.QueueMutex);
+		helper.Queue.push_back(&request);
+	}
 
-	String jresponse = String(buf, buf + rc);
+	/* Whoever gets the helper sends all requests which have queued up in the
+	 * meantime, so most callers find their request done once they get it.
+	 */
+	for (;;) {
+		std::unique_lock<std::mutex> lock(helper.Mutex);
+
+		if (request.Done)
+			break;
 
-	Dictionary::Ptr response = JsonDecode(jresponse);
-	return response->Get("errno");
+		ProcessSpawnBatch(helper);
+	}
+
+	if (request.PID == -1)
+		errno = request.Error;
+
+	return request.PID;
 }
 
-static int ProcessWaitPID(pid_t pid, int *status)
+static int ProcessKill(int helperIndex, pid_t pid, int signum)
 {
-	Dictionary::Ptr request = new Dictionary({
-		{ "command", "waitpid" },
-		{ "pid", pid }
-	});
+	String payload;
+	EncodeUInt32(payload, (uint32_t)(int32_t)pid);
+	EncodeUInt32(payload, signum);
 
-	String jrequest = JsonEncode(request);
-	size_t length = jrequest.GetLength();
+	auto& helper (l_SpawnHelpers[helperIndex]);
+	std::unique_lock<std::mutex> lock(helper.Mutex);
 
-	std::unique_lock<std::mutex> lock(l_ProcessControlMutex);
+	SendSpawnHelperRequest(helper, SpawnHelperKill, 1, payload);
 
-	do {
-		while (send(l_ProcessControlFD, &length, sizeof(length), 0) < 0) {
-			StartSpawnProcessHelper();
-		}
-	} while (send(l_ProcessControlFD, jrequest.CStr(), jrequest.GetLength(), 0) < 0);
+	int32_t error;
 
-	char buf[4096];
+	if (!RecvAll(helper.FD, (char *)&error, sizeof(error)))
+		return -1;
 
-	ssize_t rc = recv(l_ProcessControlFD, buf, sizeof(buf), 0);
+	return error;
+}
 
-	if (rc <= 0)
-		return -1;
+static int ProcessWaitPID(int helperIndex, pid_t pid, int *status)
+{
+	String payload;
+	EncodeUInt32(payload, (uint32_t)(int32_t)pid);
+
+	auto& helper (l_SpawnHelpers[helperIndex]);
+	std::unique_lock<std::mutex> lock(helper.Mutex);
+
+	SendSpawnHelperRequest(helper, SpawnHelperWaitPID, 1, payload);
 
-	String jresponse = String(buf, buf + rc);
+	int32_t response[2];
+
+	if (!RecvAll(helper.FD, (char *)response, sizeof(response)))
+		return -1;
 
-	Dictionary::Ptr response = JsonDecode(jresponse);
-	*status = response->Get("status");
-	return response->Get("rc");
+	*status = response[1];
+	return response[0];
 }
 
 void Process::InitializeSpawnHelper()
 {
-	if (l_ProcessControlFD == -1)
-		StartSpawnProcessHelper();
+	for (auto& helper : l_SpawnHelpers) {
+		std::unique_lock<std::mutex> lock(helper.Mutex);
+
+		if (helper.FD == -1)
+			StartSpawnProcessHelper(helper);
+	}
 }
 #endif /* _WIN32 */
 
-static void InitializeProcess()
+/**
+ * Starts another I/O thread. The caller must hold l_IOThreadMutex.
+ */
+void Process::StartIOThread()
 {
+	int tid = l_IOThreadCount.load();
+
 #ifdef _WIN32
-	for (auto& event : l_Events) {
-		event = CreateEvent(nullptr, TRUE, FALSE, nullptr);
-	}
+	l_Events[tid] = CreateEvent(nullptr, TRUE, FALSE, nullptr);
 #else /* _WIN32 */
-	for (auto& eventFD : l_EventFDs) {
-#	ifdef HAVE_PIPE2
-		if (pipe2(eventFD, O_CLOEXEC) < 0) {
-			if (errno == ENOSYS) {
-#	endif /* HAVE_PIPE2 */
-				if (pipe(eventFD) < 0) {
-					BOOST_THROW_EXCEPTION(posix_error()
-						<< boost::errinfo_api_function("pipe")
-						<< boost::errinfo_errno(errno));
-				}
+	auto& eventFD (l_EventFDs[tid]);
 
-				Utility::SetCloExec(eventFD[0]);
-				Utility::SetCloExec(eventFD[1]);
 #	ifdef HAVE_PIPE2
-			} else {
+	if (pipe2(eventFD, O_CLOEXEC) < 0) {
+		if (errno == ENOSYS) {
+#	endif /* HAVE_PIPE2 */
+			if (pipe(eventFD) < 0) {
 				BOOST_THROW_EXCEPTION(posix_error()
-					<< boost::errinfo_api_function("pipe2")
+					<< boost::errinfo_api_function("pipe")
 					<< boost::errinfo_errno(errno));
 			}
+
+			Utility::SetCloExec(eventFD[0]);
+			Utility::SetCloExec(eventFD[1]);
+#	ifdef HAVE_PIPE2
+		} else {
+			BOOST_THROW_EXCEPTION(posix_error()
+				<< boost::errinfo_api_function("pipe2")
+				<< boost::errinfo_errno(errno));
 		}
+	}
 #	endif /* HAVE_PIPE2 */
+
+#	ifdef HAVE_EPOLL
+	l_EpollFDs[tid] = epoll_create1(EPOLL_CLOEXEC);
+
+	if (l_EpollFDs[tid] < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("epoll_create1")
+			<< boost::errinfo_errno(errno));
 	}
+
+	Utility::SetNonBlocking(eventFD[0]);
+
+	epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.fd = eventFD[0];
+
+	if (epoll_ctl(l_EpollFDs[tid], EPOLL_CTL_ADD, eventFD[0], &event) < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("epoll_ctl")
+			<< boost::errinfo_errno(errno));
+	}
+#	endif /* HAVE_EPOLL */
 #endif /* _WIN32 */
+
+#ifdef HAVE_EPOLL
+	std::thread t([tid]() { EpollIOThreadProc(tid); });
+#else /* HAVE_EPOLL */
+	std::thread t([tid]() { IOThreadProc(tid); });
+#endif /* HAVE_EPOLL */
+	t.detach();
+
+	l_IOThreadCount.store(tid + 1);
 }
 
-INITIALIZE_ONCE(InitializeProcess);
+/**
+ * Picks the I/O thread with the fewest processes and starts another one if
+ * all of them are busy.
+ *
+ * @returns The thread's index.
+ */
+int Process::PickIOThread()
+{
+	int count = l_IOThreadCount.load();
+	int tid = 0;
+
+	for (int i = 1; i < count; i++) {
+		if (l_ProcessCount[i].load() < l_ProcessCount[tid].load())
+			tid = i;
+	}
+
+	if (l_ProcessCount[tid].load() >= MaxTasksPerThread && count < IOTHREADS) {
+		std::unique_lock<std::mutex> lock(l_IOThreadMutex);
+
+		/* Another thread might have started one in the meantime. */
+		if (l_IOThreadCount.load() == count) {
+			Log(LogNotice, "Process")
+				<< "Starting I/O thread #" << (count + 1) << " for " << l_ProcessCount[tid].load() << " processes per thread";
+
+			StartIOThread();
+		}
+
+		tid = l_IOThreadCount.load() - 1;
+	}
+
+	l_ProcessCount[tid].fetch_add(1);
+
+	return tid;
+}
 
 void Process::ThreadInitialize()
 {
 	/* Note to self: Make sure this runs _after_ we've daemonized. */
-	for (int tid = 0; tid < IOTHREADS; tid++) {
-		std::thread t([tid]() { IOThreadProc(tid); });
-		t.detach();
-	}
+	std::unique_lock<std::mutex> lock(l_IOThreadMutex);
+
+	if (l_IOThreadCount.load() == 0)
+		StartIOThread();
 }
 
 Process::Arguments Process::PrepareCommand(const Value& command)
@@ -590,6 +874,128 @@ bool Process::GetAdjustPriority() const
 	return m_AdjustPriority;
 }
 
+/**
+ * Limits the output kept from the process. Anything beyond that is read
+ * and discarded, so the process doesn't block on a full pipe.
+ *
+ * @param size The limit in bytes, 0 for none
+ */
+void Process::SetMaxOutputSize(size_t size)
+{
+	m_MaxOutputSize = size;
+}
+
+size_t Process::GetMaxOutputSize() const
+{
+	return m_MaxOutputSize;
+}
+
+#ifndef _WIN32
+/**
+ * Connects the process' stdin and stdout to the given FDs instead of
+ * /dev/null and the output which is passed to the callback. The latter only
+ * receives stderr then. The caller keeps ownership of the FDs.
+ *
+ * @param input The FD for stdin
+ * @param output The FD for stdout
+ */
+void Process::SetStdio(ConsoleHandle input, ConsoleHandle output)
+{
+	m_Stdin = input;
+	m_Stdout = output;
+}
+#endif /* _WIN32 */
+
+#ifdef HAVE_EPOLL
+/**
+ * Like IOThreadProc() but waits with epoll: the pipes are registered once in
+ * Run() and read edge-triggered, which is fine as DoEvents() reads until
+ * EAGAIN. The timeouts are kept sorted so a wakeup only touches the
+ * processes which are ready or due.
+ */
+void Process::EpollIOThreadProc(int tid)
+{
+	epoll_event events[128];
+	int epollFD = l_EpollFDs[tid];
+	int eventFD = l_EventFDs[tid][0];
+
+	Utility::SetThreadName("ProcessIO");
+
+	for (;;) {
+		int timeout = -1;
+
+		{
+			std::unique_lock<std::mutex> lock(l_ProcessMutex[tid]);
+
+			if (!l_Deadlines[tid].empty()) {
+				double delta = l_Deadlines[tid].begin()->first - Utility::GetTime();
+				timeout = delta > 0 ? static_cast<int>(delta * 1000) + 1 : 0;
+			}
+		}
+
+		int rc = epoll_wait(epollFD, events, sizeof(events) / sizeof(events[0]), timeout);
+
+		if (rc < 0)
+			continue;
+
+		std::unique_lock<std::mutex> lock(l_ProcessMutex[tid]);
+
+		auto handle ([tid](std::map<ProcessHandle, Process::Ptr>::iterator it) {
+			const Process::Ptr& process = it->second;
+
+			if (process->m_Timeout != 0)
+				l_Deadlines[tid].erase({ process->m_Result.ExecutionStart + process->GetNextTimeout(), process->m_Process });
+
+			if (!process->DoEvents()) {
+				l_FDs[tid].erase(process->m_FD);
+				(void)close(process->m_FD);
+				l_Processes[tid].erase(it);
+				l_ProcessCount[tid].fetch_sub(1);
+			} else if (process->m_Timeout != 0) {
+				l_Deadlines[tid].insert({ process->m_Result.ExecutionStart + process->GetNextTimeout(), process->m_Process });
+			}
+		});
+
+		for (int i = 0; i < rc; i++) {
+			int fd = events[i].data.fd;
+
+			if (fd == eventFD) {
+				char buffer[512];
+				while (read(eventFD, buffer, sizeof(buffer)) > 0)
+					; /* Drain the pipe. */
+
+				continue;
+			}
+
+			auto it2 = l_FDs[tid].find(fd);
+
+			if (it2 == l_FDs[tid].end())
+				continue; /* This should never happen. */
+
+			auto it = l_Processes[tid].find(it2->second);
+
+			if (it == l_Processes[tid].end())
+				continue; /* This should never happen. */
+
+			handle(it);
+		}
+
+		double now = Utility::GetTime();
+
+		while (!l_Deadlines[tid].empty() && l_Deadlines[tid].begin()->first < now) {
+			auto it = l_Processes[tid].find(l_Deadlines[tid].begin()->second);
+
+			if (it == l_Processes[tid].end()) {
+				l_Deadlines[tid].erase(l_Deadlines[tid].begin()); /* This should never happen. */
+				continue;
+			}
+
+			handle(it);
+		}
+	}
+}
+#endif /* HAVE_EPOLL */
+
 void Process::IOThreadProc(int tid)
 {
 #ifdef _WIN32
@@ -729,6 +1135,7 @@ void Process::IOThreadProc(int tid)
 						(void)close(it->second->m_FD);
 #endif /* _WIN32 */
 						l_Processes[tid].erase(it);
+						l_ProcessCount[tid].fetch_sub(1);
 					}
 				}
 			}
@@ -780,11 +1187,15 @@ static BOOL CreatePipeOverlapped(HANDLE *outReadPipe, HANDLE *outWritePipe,
 
 void Process::Run(const std::function<void(const ProcessResult&)>& callback)
 {
+	Span span ("Process::Run");
+
 #ifndef _WIN32
 	boost::call_once(l_SpawnHelperOnceFlag, &Process::InitializeSpawnHelper);
 #endif /* _WIN32 */
 	boost::call_once(l_ProcessOnceFlag, &Process::ThreadInitialize);
 
+	auto spawnStart (std::chrono::steady_clock::now());
+
 	m_Result.ExecutionStart = Utility::GetTime();
 
 #ifdef _WIN32
@@ -972,16 +1383,18 @@ void Process::Run(const std::function<void(const ProcessResult&)>& callback)
 #endif /* HAVE_PIPE2 */
 
 	int fds[3];
-	fds[0] = STDIN_FILENO;
-	fds[1] = outfds[1];
+	fds[0] = m_Stdin;
+	fds[1] = m_Stdout != -1 ? m_Stdout : outfds[1];
 	fds[2] = outfds[1];
 
-	m_Process = ProcessSpawn(m_Arguments, m_ExtraEnvironment, m_AdjustPriority, fds);
+	m_Process = ProcessSpawn(m_Arguments, m_ExtraEnvironment, m_AdjustPriority, fds, &m_SpawnHelper);
 	m_PID = m_Process;
 
 	if (m_PID == -1) {
-		m_OutputStream << "Fork failed with error code " << errno << " (" << Utility::FormatErrorNumber(errno) << ")";
-		Log(LogCritical, "Process", m_OutputStream.str());
+		int error = errno;
+
+		m_Output = "Fork failed with error code " + Convert::ToString(error) + " (" + Utility::FormatErrorNumber(error) + ")";
+		Log(LogCritical, "Process", m_Output);
 	}
 
 	Log(LogNotice, "Process")
@@ -994,15 +1407,30 @@ void Process::Run(const std::function<void(const ProcessResult&)>& callback)
 	m_FD = outfds[0];
 #endif /* _WIN32 */
 
+	AddSpawnLatency(std::chrono::duration<double>(std::chrono::steady_clock::now() - spawnStart).count());
+
 	m_Callback = callback;
 
-	int tid = GetTID();
+	int tid = PickIOThread();
 
 	{
 		std::unique_lock<std::mutex> lock(l_ProcessMutex[tid]);
 		l_Processes[tid][m_Process] = this;
 #ifndef _WIN32
 		l_FDs[tid][m_FD] = m_Process;
+
+#	ifdef HAVE_EPOLL
+		if (m_Timeout != 0)
+			l_Deadlines[tid].insert({ m_Result.ExecutionStart + GetNextTimeout(), m_Process });
+
+		epoll_event event;
+		memset(&event, 0, sizeof(event));
+		event.events = EPOLLIN | EPOLLET;
+		event.data.fd = m_FD;
+
+		if (epoll_ctl(l_EpollFDs[tid], EPOLL_CTL_ADD, m_FD, &event) < 0)
+			Log(LogCritical, "Process", "Adding the process' output pipe to epoll failed.");
+#	endif /* HAVE_EPOLL */
 #endif /* _WIN32 */
 	}
 
@@ -1014,6 +1442,26 @@ void Process::Run(const std::function<void(const ProcessResult&)>& callback)
 #endif /* _WIN32 */
 }
 
+/**
+ * Keeps the output of the process up to the configured limit.
+ */
+void Process::AppendOutput(const char *data, size_t length)
+{
+	if (m_MaxOutputSize > 0 && m_Output.GetLength() + length > m_MaxOutputSize) {
+		size_t room = m_Output.GetLength() < m_MaxOutputSize ? m_MaxOutputSize - m_Output.GetLength() : 0;
+
+		m_Output.GetData().append(data, room);
+		m_DiscardedOutput += length - room;
+		return;
+	}
+
+	/* Most plugins print less than 4 KiB, so the buffer rarely has to grow. */
+	if (m_Output.IsEmpty())
+		m_Output.GetData().reserve(m_MaxOutputSize > 0 ? std::min<size_t>(m_MaxOutputSize, 4096) : 4096);
+
+	m_Output.GetData().append(data, length);
+}
+
 const ProcessResult& Process::WaitForResult() {
 	std::unique_lock<std::mutex> lock(m_ResultMutex);
 	m_ResultCondition.wait(lock, [this]{ return m_ResultAvailable; });
@@ -1040,9 +1488,9 @@ bool Process::DoEvents()
 					<< "Terminating process " << m_PID << " (" << PrettyPrintArguments(m_Arguments)
 					<< ") after timeout of " << timeout << " seconds";
 
-				m_OutputStream << "<Timeout exceeded.>";
+				m_Output += "<Timeout exceeded.>";
 
-				int error = ProcessKill(m_Process, SIGTERM);
+				int error = ProcessKill(m_SpawnHelper, m_Process, SIGTERM);
 				if (error) {
 					Log(LogWarning, "Process")
 						<< "Couldn't terminate the process " << m_PID << " (" << PrettyPrintArguments(m_Arguments)
@@ -1063,10 +1511,10 @@ bool Process::DoEvents()
 				<< ") after timeout of " << timeout << " seconds";
 
 #ifdef _WIN32
-			m_OutputStream << "<Timeout exceeded.>";
+			m_Output += "<Timeout exceeded.>";
 			TerminateProcess(m_Process, 3);
 #else /* _WIN32 */
-			int error = ProcessKill(-m_Process, SIGKILL);
+			int error = ProcessKill(m_SpawnHelper, -m_Process, SIGKILL);
 			if (error) {
 				Log(LogWarning, "Process")
 					<< "Couldn't kill the process group " << m_PID << " (" << PrettyPrintArguments(m_Arguments)
@@ -1085,11 +1533,11 @@ bool Process::DoEvents()
 
 		DWORD rc;
 		if (!m_ReadFailed && GetOverlappedResult(m_FD, &m_Overlapped, &rc, TRUE) && rc > 0) {
-			m_OutputStream.write(m_ReadBuffer, rc);
+			AppendOutput(m_ReadBuffer, rc);
 			return true;
 		}
 #else /* _WIN32 */
-		char buffer[512];
+		char buffer[4096];
 		for (;;) {
 			int rc = read(m_FD, buffer, sizeof(buffer));
 
@@ -1097,7 +1545,7 @@ bool Process::DoEvents()
 				return true;
 
 			if (rc > 0) {
-				m_OutputStream.write(buffer, rc);
+				AppendOutput(buffer, rc);
 				continue;
 			}
 
@@ -1106,7 +1554,15 @@ bool Process::DoEvents()
 #endif /* _WIN32 */
 	}
 
-	String output = m_OutputStream.str();
+	if (m_DiscardedOutput > 0) {
+		Log(LogWarning, "Process")
+			<< "Discarded " << m_DiscardedOutput << " bytes of output of PID " << m_PID << " (" << PrettyPrintArguments(m_Arguments)
+			<< ") exceeding the limit of " << m_MaxOutputSize << " bytes";
+
+		m_Output += "\n<Output truncated, " + Convert::ToString(m_DiscardedOutput) + " bytes discarded.>";
+	}
+
+	String output = std::move(m_Output);
 
 #ifdef _WIN32
 	WaitForSingleObject(m_Process, INFINITE);
@@ -1120,7 +1576,7 @@ bool Process::DoEvents()
 	int status, exitcode;
 	if (could_not_kill || m_PID == -1) {
 		exitcode = 128;
-	} else if (ProcessWaitPID(m_Process, &status) != m_Process) {
+	} else if (ProcessWaitPID(m_SpawnHelper, m_Process, &status) != m_Process) {
 		exitcode = 128;
 
 		Log(LogWarning, "Process")
@@ -1159,7 +1615,7 @@ bool Process::DoEvents()
 		m_Result.PID = m_PID;
 		m_Result.ExecutionEnd = Utility::GetTime();
 		m_Result.ExitStatus = exitcode;
-		m_Result.Output = output;
+		m_Result.Output = std::move(output);
 		m_ResultAvailable = true;
 	}
 	m_ResultCondition.notify_all();
@@ -1176,17 +1632,69 @@ bool Process::DoEvents()
 	return false;
 }
 
-pid_t Process::GetPID() const
+/**
+ * Reports percentiles of the time it took to spawn the recent processes,
+ * including the time spent waiting for a spawn helper.
+ */
+void Process::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
-	return m_PID;
+	std::vector<double> latencies;
+
+	{
+		std::unique_lock<std::mutex> lock(l_SpawnLatencyMutex);
+		latencies = l_SpawnLatencies;
+	}
+
+	if (latencies.empty())
+		return;
+
+	std::sort(latencies.begin(), latencies.end());
+
+	auto percentile ([&latencies](double p) {
+		return latencies[std::min<size_t>(latencies.size() - 1, p * latencies.size())];
+	});
+
+	Dictionary::Ptr stats = new Dictionary({
+		{ "p50", percentile(0.5) },
+		{ "p90", percentile(0.9) },
+		{ "p99", percentile(0.99) },
+		{ "max", latencies.back() }
+	});
+
+	ObjectLock olock(stats);
+	for (const Dictionary::Pair& kv : stats)
+		perfdata->Add(new PerfdataValue("process_spawn_latency_" + kv.first, kv.second, false, "s"));
+
+	status->Set("process_spawn_latency", stats);
+}
+
+/**
+ * Returns how many processes have been started, but not reaped yet.
+ */
+size_t Process::GetRunningCount()
+{
+	size_t count = 0;
+
+	for (auto& threadCount : l_ProcessCount)
+		count += threadCount.load();
+
+	return count;
 }
 
+/**
+ * Returns the moving average of the time it took to start a process, in seconds.
+ */
+double Process::GetSpawnLatency()
+{
+	return l_SpawnLatencyAverage.load();
+}
 
-int Process::GetTID() const
+pid_t Process::GetPID() const
 {
-	return (reinterpret_cast<uintptr_t>(this) / sizeof(void *)) % IOTHREADS;
+	return m_PID;
 }
 
+
 double Process::GetNextTimeout() const
 {
 #ifdef _WIN32
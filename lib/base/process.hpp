@@ -5,6 +5,7 @@
 
 #include "base/i2-base.hpp"
 #include "base/dictionary.hpp"
+#include "base/array.hpp"
 #include <iosfwd>
 #include <deque>
 #include <vector>
@@ -61,6 +62,13 @@ public:
 	void SetAdjustPriority(bool adjust);
 	bool GetAdjustPriority() const;
 
+	void SetMaxOutputSize(size_t size);
+	size_t GetMaxOutputSize() const;
+
+#ifndef _WIN32
+	void SetStdio(ConsoleHandle input, ConsoleHandle output);
+#endif /* _WIN32 */
+
 	void Run(const std::function<void (const ProcessResult&)>& callback = std::function<void (const ProcessResult&)>());
 
 	const ProcessResult& WaitForResult();
@@ -73,6 +81,11 @@ public:
 
 	static String PrettyPrintArguments(const Arguments& arguments);
 
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+
+	static size_t GetRunningCount();
+	static double GetSpawnLatency();
+
 #ifndef _WIN32
 	static void InitializeSpawnHelper();
 #endif /* _WIN32 */
@@ -84,6 +97,9 @@ private:
 	double m_Timeout;
 #ifndef _WIN32
 	bool m_SentSigterm;
+	int m_SpawnHelper;
+	ConsoleHandle m_Stdin;
+	ConsoleHandle m_Stdout;
 #endif /* _WIN32 */
 
 	bool m_AdjustPriority;
@@ -99,16 +115,23 @@ private:
 	char m_ReadBuffer[1024];
 #endif /* _WIN32 */
 
-	std::ostringstream m_OutputStream;
+	String m_Output;
+	size_t m_MaxOutputSize;
+	size_t m_DiscardedOutput;
 	std::function<void (const ProcessResult&)> m_Callback;
 	ProcessResult m_Result;
 	bool m_ResultAvailable;
 	std::mutex m_ResultMutex;
 	std::condition_variable m_ResultCondition;
 
+	static void StartIOThread();
+	static int PickIOThread();
 	static void IOThreadProc(int tid);
+#ifdef HAVE_EPOLL
+	static void EpollIOThreadProc(int tid);
+#endif /* HAVE_EPOLL */
+	void AppendOutput(const char *data, size_t length);
 	bool DoEvents();
-	int GetTID() const;
 	double GetNextTimeout() const;
 };
 
@@ -0,0 +1,382 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/processhandoff.hpp"
+#include "base/logger.hpp"
+#include "base/utility.hpp"
+#include <cstring>
+#include <vector>
+
+#ifndef _WIN32
+#	include <sys/socket.h>
+#	include <sys/types.h>
+#	include <unistd.h>
+#endif /* _WIN32 */
+
+using namespace icinga;
+
+/* Precedes the keys of the listeners sent over the handoff socket. */
+static const char l_ListenersMagic[] = "I2LISTENERS\n";
+
+/* The kernel refuses to pass more file descriptors in one message. */
+#define MAXLISTENERS 250
+
+std::mutex ProcessHandoff::m_Mutex;
+int ProcessHandoff::m_ControlChannel = -1;
+bool ProcessHandoff::m_Received = false;
+std::map<String, ProcessHandoff::Listener> ProcessHandoff::m_Listeners;
+std::map<String, int> ProcessHandoff::m_ReceivedListeners;
+
+/**
+ * Creates a pair of connected sockets suitable for passing file descriptors.
+ *
+ * @param fds Receives the sockets
+ * @return 0 on success, -1 otherwise
+ */
+int ProcessHandoff::CreateChannel(int fds[2])
+{
+#ifndef _WIN32
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) < 0)
+		return -1;
+
+	Utility::SetCloExec(fds[0]);
+	Utility::SetCloExec(fds[1]);
+
+	return 0;
+#else /* _WIN32 */
+	return -1;
+#endif /* _WIN32 */
+}
+
+/**
+ * Sets the socket over which the umbrella process passes the handoff
+ * socket to this worker process.
+ */
+void ProcessHandoff::SetControlChannel(int fd)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_ControlChannel = fd;
+}
+
+/**
+ * Passes a file descriptor to the process at the other end of a channel.
+ */
+bool ProcessHandoff::SendSocket(int channel, int fd)
+{
+#ifndef _WIN32
+	char data = 0;
+
+	struct iovec io;
+	io.iov_base = &data;
+	io.iov_len = sizeof(data);
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+
+	msg.msg_iov = &io;
+	msg.msg_iovlen = 1;
+
+	char cbuf[CMSG_SPACE(sizeof(int))];
+	memset(cbuf, 0, sizeof(cbuf));
+
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+	for (;;) {
+		ssize_t rc = sendmsg(channel, &msg, 0);
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+
+		return rc == sizeof(data);
+	}
+#else /* _WIN32 */
+	(void)channel;
+	(void)fd;
+	return false;
+#endif /* _WIN32 */
+}
+
+#ifndef _WIN32
+/**
+ * Receives a message without waiting for it.
+ *
+ * @param fds Receives the file descriptors passed along with the message
+ * @return The size of the message, -1 if there's none
+ */
+static ssize_t ReceiveMessage(int channel, char *buf, size_t length, std::vector<int>& fds)
+{
+	struct iovec io;
+	io.iov_base = buf;
+	io.iov_len = length;
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+
+	msg.msg_iov = &io;
+	msg.msg_iovlen = 1;
+
+	char cbuf[CMSG_SPACE(sizeof(int) * MAXLISTENERS)];
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+
+	int flags = MSG_DONTWAIT;
+
+#ifdef MSG_CMSG_CLOEXEC
+	flags |= MSG_CMSG_CLOEXEC;
+#endif /* MSG_CMSG_CLOEXEC */
+
+	ssize_t rc;
+
+	do {
+		rc = recvmsg(channel, &msg, flags);
+	} while (rc < 0 && errno == EINTR);
+
+	if (rc < 0)
+		return -1;
+
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		size_t offset = fds.size();
+
+		fds.resize(offset + count);
+		memcpy(&fds[offset], CMSG_DATA(cmsg), sizeof(int) * count);
+	}
+
+	for (int fd : fds)
+		Utility::SetCloExec(fd);
+
+	/* The message didn't fit, don't make sense of the rest. */
+	if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+		for (int fd : fds)
+			(void)close(fd);
+
+		fds.clear();
+		return -1;
+	}
+
+	return rc;
+}
+#endif /* _WIN32 */
+
+/**
+ * Takes the handoff socket passed by the umbrella process if there's one.
+ * The caller must hold m_Mutex.
+ *
+ * @return The socket, -1 if there's none
+ */
+int ProcessHandoff::ReceiveSocket(int channel)
+{
+#ifndef _WIN32
+	if (channel == -1)
+		return -1;
+
+	char data;
+	std::vector<int> fds;
+
+	if (ReceiveMessage(channel, &data, sizeof(data), fds) < 0)
+		return -1;
+
+	for (size_t i = 1; i < fds.size(); i++)
+		(void)close(fds[i]);
+
+	return fds.empty() ? -1 : fds[0];
+#else /* _WIN32 */
+	(void)channel;
+	return -1;
+#endif /* _WIN32 */
+}
+
+/**
+ * Takes the listeners passed by the previous worker process once.
+ * The caller must hold m_Mutex.
+ */
+void ProcessHandoff::ReceiveListeners()
+{
+#ifndef _WIN32
+	if (m_Received)
+		return;
+
+	m_Received = true;
+
+	int handoff = ReceiveSocket(m_ControlChannel);
+
+	if (handoff == -1)
+		return;
+
+	/* The previous worker process has exited before we're allowed to work, so the message is there if it's been sent. */
+	std::vector<char> buf (65536);
+	std::vector<int> fds;
+	ssize_t rc = ReceiveMessage(handoff, buf.data(), buf.size(), fds);
+
+	(void)close(handoff);
+
+	if (rc < 0) {
+		Log(LogNotice, "ProcessHandoff", "The previous worker process didn't pass any listeners.");
+		return;
+	}
+
+	String payload (buf.data(), buf.data() + rc);
+	size_t magicLength = sizeof(l_ListenersMagic) - 1;
+
+	if (payload.SubStr(0, magicLength) != l_ListenersMagic) {
+		for (int fd : fds)
+			(void)close(fd);
+
+		return;
+	}
+
+	std::vector<String> keys = payload.SubStr(magicLength).Split("\n");
+
+	for (size_t i = 0; i < fds.size(); i++) {
+		if (i < keys.size() && !keys[i].IsEmpty() && m_ReceivedListeners.emplace(keys[i], fds[i]).second)
+			continue;
+
+		(void)close(fds[i]);
+	}
+
+	Log(LogInformation, "ProcessHandoff")
+		<< "Took over " << m_ReceivedListeners.size() << " listener(s) from the previous worker process.";
+#endif /* _WIN32 */
+}
+
+/**
+ * Registers a listening socket to pass to the next worker process.
+ *
+ * @param key Identifies the listener, e.g. its bind address and port
+ * @param fd The socket
+ * @param stop Stops accepting connections once the socket has been passed
+ */
+void ProcessHandoff::AddListener(const String& key, int fd, std::function<void()> stop)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_Listeners[key] = Listener{fd, std::move(stop)};
+}
+
+/**
+ * Takes a listening socket passed by the previous worker process.
+ *
+ * @param key Identifies the listener
+ * @return The socket, -1 if there's none
+ */
+int ProcessHandoff::TakeListener(const String& key)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	ReceiveListeners();
+
+	auto it (m_ReceivedListeners.find(key));
+
+	if (it == m_ReceivedListeners.end())
+		return -1;
+
+	int fd = it->second;
+	m_ReceivedListeners.erase(it);
+
+	return fd;
+}
+
+/**
+ * Closes the listening sockets passed by the previous worker process which
+ * haven't been taken, e.g. because the bind address has been changed.
+ */
+void ProcessHandoff::CloseUnclaimedListeners()
+{
+#ifndef _WIN32
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	ReceiveListeners();
+
+	for (const auto& kv : m_ReceivedListeners) {
+		Log(LogNotice, "ProcessHandoff")
+			<< "Closing listener '" << kv.first << "' which isn't used anymore.";
+
+		(void)close(kv.second);
+	}
+
+	m_ReceivedListeners.clear();
+#endif /* _WIN32 */
+}
+
+/**
+ * Passes the registered listening sockets to the next worker process if
+ * this one is being replaced by it and stops accepting connections.
+ */
+void ProcessHandoff::SendListeners()
+{
+#ifndef _WIN32
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	if (m_Listeners.empty())
+		return;
+
+	int handoff = ReceiveSocket(m_ControlChannel);
+
+	if (handoff == -1)
+		return;
+
+	String payload = l_ListenersMagic;
+	std::vector<int> fds;
+
+	for (const auto& kv : m_Listeners) {
+		if (fds.size() >= MAXLISTENERS)
+			break;
+
+		payload += kv.first + "\n";
+		fds.push_back(kv.second.FD);
+	}
+
+	struct iovec io;
+	io.iov_base = const_cast<char *>(payload.CStr());
+	io.iov_len = payload.GetLength();
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+
+	msg.msg_iov = &io;
+	msg.msg_iovlen = 1;
+
+	std::vector<char> cbuf (CMSG_SPACE(sizeof(int) * fds.size()));
+	msg.msg_control = cbuf.data();
+	msg.msg_controllen = cbuf.size();
+
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+
+	memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+	ssize_t rc;
+
+	do {
+		rc = sendmsg(handoff, &msg, 0);
+	} while (rc < 0 && errno == EINTR);
+
+	(void)close(handoff);
+
+	if (rc != (ssize_t)payload.GetLength()) {
+		Log(LogWarning, "ProcessHandoff")
+			<< "Failed to pass the listeners to the next worker process: " << Utility::FormatErrorNumber(errno);
+		return;
+	}
+
+	Log(LogInformation, "ProcessHandoff")
+		<< "Passed " << fds.size() << " listener(s) to the next worker process.";
+
+	/* The next worker process accepts the connections from now on. */
+	for (const auto& kv : m_Listeners)
+		kv.second.Stop();
+
+	m_Listeners.clear();
+#endif /* _WIN32 */
+}
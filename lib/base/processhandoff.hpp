@@ -0,0 +1,63 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef PROCESSHANDOFF_H
+#define PROCESSHANDOFF_H
+
+#include "base/i2-base.hpp"
+#include "base/string.hpp"
+#include <functional>
+#include <map>
+#include <mutex>
+
+namespace icinga
+{
+
+/**
+ * Passes the listening sockets of a worker process which shuts down due to a
+ * reload to the worker replacing it. Connections are queued in the sockets'
+ * backlog until the new worker accepts them rather than being refused while
+ * neither worker listens.
+ *
+ * The umbrella process gives each worker one end of a control channel. On a
+ * reload it creates a socket pair and sends one end to each of the two
+ * workers. The old worker sends its listening sockets over it right before
+ * it stops its objects and the new worker's listeners take them over
+ * instead of binding new sockets.
+ *
+ * @ingroup base
+ */
+class ProcessHandoff
+{
+public:
+	static int CreateChannel(int fds[2]);
+	static void SetControlChannel(int fd);
+	static bool SendSocket(int channel, int fd);
+
+	static void AddListener(const String& key, int fd, std::function<void()> stop);
+	static int TakeListener(const String& key);
+	static void CloseUnclaimedListeners();
+	static void SendListeners();
+
+private:
+	ProcessHandoff();
+
+	static std::mutex m_Mutex;
+	static int m_ControlChannel;
+	static bool m_Received;
+
+	struct Listener
+	{
+		int FD;
+		std::function<void()> Stop;
+	};
+
+	static std::map<String, Listener> m_Listeners;
+	static std::map<String, int> m_ReceivedListeners;
+
+	static int ReceiveSocket(int channel);
+	static void ReceiveListeners();
+};
+
+}
+
+#endif /* PROCESSHANDOFF_H */
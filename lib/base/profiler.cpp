@@ -0,0 +1,384 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/profiler.hpp"
+#include "base/utility.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <set>
+#include <typeindex>
+#include <unordered_map>
+
+#ifndef _WIN32
+#	include <signal.h>
+#	include <sys/time.h>
+#endif /* _WIN32 */
+
+#ifdef HAVE_BACKTRACE_SYMBOLS
+#	include <execinfo.h>
+#endif /* HAVE_BACKTRACE_SYMBOLS */
+
+using namespace icinga;
+
+std::atomic<bool> Profiler::m_RecordingLocks (false);
+
+static constexpr int l_MaxSampleFrames = 48;
+static constexpr size_t l_MaxSamples = 1u << 16;
+
+/* The signal handler and the signal trampoline. */
+static constexpr int l_SkipSampleFrames = 2;
+
+namespace
+{
+
+struct ProfilerSample
+{
+	/* Written last by the signal handler, 0 until then. */
+	std::atomic<int> Depth;
+	void *Frames[l_MaxSampleFrames];
+};
+
+struct LockSites
+{
+	std::mutex Mutex;
+	std::vector<LockSite *> Sites;
+	std::unordered_map<std::type_index, LockSite *> ObjectLockSites;
+};
+
+}
+
+static std::mutex l_ProfilerMutex;
+static bool l_ProfilerRunning = false;
+static std::unique_ptr<ProfilerSample[]> l_Samples;
+
+/* What the signal handler writes to, nullptr while not profiling. */
+static std::atomic<ProfilerSample *> l_SampleBuffer (nullptr);
+static std::atomic<size_t> l_NextSample (0);
+
+static LockSites& GetLockSites()
+{
+	/* Never destroyed, lock sites are function-local statics themselves. */
+	static auto *sites (new LockSites());
+	return *sites;
+}
+
+LockSite::LockSite(const char *file, int line)
+	: File(file), Line(line), Type(nullptr)
+{
+	Profiler::RegisterLockSite(this);
+}
+
+LockSite::LockSite(const std::type_info *type)
+	: File(nullptr), Line(0), Type(type)
+{
+	Profiler::RegisterLockSite(this);
+}
+
+String LockSite::GetName() const
+{
+	if (Type)
+		return "ObjectLock<" + Utility::GetTypeName(*Type) + ">";
+
+	const char *file = std::strrchr(File, '/');
+
+	return String(file ? file + 1 : File) + ":" + std::to_string(Line);
+}
+
+void LockSite::RecordWait(std::chrono::steady_clock::duration wait)
+{
+	uint_fast64_t nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count();
+
+	Waits.fetch_add(1, std::memory_order_relaxed);
+	WaitNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+
+	uint_fast64_t max = MaxWaitNanoseconds.load(std::memory_order_relaxed);
+
+	while (nanoseconds > max && !MaxWaitNanoseconds.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed))
+		;
+}
+
+void LockSite::Reset()
+{
+	Waits.store(0, std::memory_order_relaxed);
+	WaitNanoseconds.store(0, std::memory_order_relaxed);
+	MaxWaitNanoseconds.store(0, std::memory_order_relaxed);
+}
+
+void Profiler::RegisterLockSite(LockSite *site)
+{
+	auto& sites (GetLockSites());
+	std::unique_lock<std::mutex> lock (sites.Mutex);
+
+	sites.Sites.push_back(site);
+}
+
+/**
+ * Records that a thread had to wait for the lock of an object of the given type.
+ */
+void Profiler::RecordObjectLockWait(const std::type_info& type, std::chrono::steady_clock::duration wait)
+{
+	LockSite *site;
+
+	{
+		auto& sites (GetLockSites());
+		std::unique_lock<std::mutex> lock (sites.Mutex);
+
+		auto& objectLockSite (sites.ObjectLockSites[std::type_index(type)]);
+
+		if (!objectLockSite) {
+			lock.unlock();
+
+			/* Registers itself. */
+			site = new LockSite(&type);
+
+			lock.lock();
+
+			auto& again (sites.ObjectLockSites[std::type_index(type)]);
+
+			if (!again)
+				again = site;
+
+			site = again;
+		} else {
+			site = objectLockSite;
+		}
+	}
+
+	site->RecordWait(wait);
+}
+
+#if defined(HAVE_BACKTRACE_SYMBOLS) && !defined(_WIN32)
+static void ProfilerSignalHandler(int)
+{
+	int savedErrno = errno;
+	ProfilerSample *samples = l_SampleBuffer.load(std::memory_order_acquire);
+
+	if (samples) {
+		size_t index = l_NextSample.fetch_add(1, std::memory_order_relaxed);
+
+		if (index < l_MaxSamples) {
+			auto& sample (samples[index]);
+			int depth = backtrace(sample.Frames, l_MaxSampleFrames);
+
+			sample.Depth.store(depth > 0 ? depth : -1, std::memory_order_release);
+		}
+	}
+
+	errno = savedErrno;
+}
+#endif /* defined(HAVE_BACKTRACE_SYMBOLS) && !defined(_WIN32) */
+
+bool Profiler::IsSupported()
+{
+#if defined(HAVE_BACKTRACE_SYMBOLS) && !defined(_WIN32)
+	return true;
+#else /* defined(HAVE_BACKTRACE_SYMBOLS) && !defined(_WIN32) */
+	return false;
+#endif /* defined(HAVE_BACKTRACE_SYMBOLS) && !defined(_WIN32) */
+}
+
+/**
+ * Starts a profile, discarding the results of the previous one.
+ *
+ * @param frequency Stack samples per CPU second, 0 not to sample stacks
+ * @param locks Whether to record lock contention
+ *
+ * @returns false if a profile is already running
+ */
+bool Profiler::Start(int frequency, bool locks)
+{
+	std::unique_lock<std::mutex> lock (l_ProfilerMutex);
+
+	if (l_ProfilerRunning)
+		return false;
+
+	{
+		auto& sites (GetLockSites());
+		std::unique_lock<std::mutex> sitesLock (sites.Mutex);
+
+		for (auto *site : sites.Sites)
+			site->Reset();
+	}
+
+	l_Samples.reset();
+	l_NextSample.store(0);
+
+#if defined(HAVE_BACKTRACE_SYMBOLS) && !defined(_WIN32)
+	if (frequency > 0) {
+		l_Samples.reset(new ProfilerSample[l_MaxSamples]());
+
+		/* The first call may load libgcc, which must not happen in the signal handler. */
+		void *frames[1];
+		(void)backtrace(frames, 1);
+
+		l_SampleBuffer.store(l_Samples.get(), std::memory_order_release);
+
+		/* Stays installed, a signal may still be pending after Stop(). */
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = &ProfilerSignalHandler;
+		sa.sa_flags = SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+		(void)sigaction(SIGPROF, &sa, nullptr);
+
+		long interval = 1000000 / std::min(std::max(frequency, 1), 1000);
+
+		struct itimerval timer;
+		timer.it_interval.tv_sec = 0;
+		timer.it_interval.tv_usec = interval;
+		timer.it_value = timer.it_interval;
+		(void)setitimer(ITIMER_PROF, &timer, nullptr);
+	}
+#endif /* defined(HAVE_BACKTRACE_SYMBOLS) && !defined(_WIN32) */
+
+	m_RecordingLocks.store(locks);
+	l_ProfilerRunning = true;
+
+	return true;
+}
+
+/**
+ * Stops the current profile, its results stay available until the next one starts.
+ */
+void Profiler::Stop()
+{
+	std::unique_lock<std::mutex> lock (l_ProfilerMutex);
+
+	if (!l_ProfilerRunning)
+		return;
+
+#if defined(HAVE_BACKTRACE_SYMBOLS) && !defined(_WIN32)
+	struct itimerval timer;
+	memset(&timer, 0, sizeof(timer));
+	(void)setitimer(ITIMER_PROF, &timer, nullptr);
+#endif /* defined(HAVE_BACKTRACE_SYMBOLS) && !defined(_WIN32) */
+
+	l_SampleBuffer.store(nullptr, std::memory_order_release);
+	m_RecordingLocks.store(false);
+	l_ProfilerRunning = false;
+}
+
+/**
+ * Writes the stack samples of the last profile, one line per distinct stack:
+ * its frames from the outermost one, separated by semicolons, and how often it's been seen.
+ *
+ * @returns The number of samples
+ */
+size_t Profiler::WriteFoldedStacks(std::ostream& fp)
+{
+	std::unique_lock<std::mutex> lock (l_ProfilerMutex);
+
+	if (!l_Samples)
+		return 0;
+
+	std::map<std::vector<void *>, size_t> stacks;
+	std::set<void *> addresses;
+	size_t samples = std::min(l_NextSample.load(), l_MaxSamples);
+	size_t total = 0;
+
+	for (size_t i = 0; i < samples; i++) {
+		auto& sample (l_Samples[i]);
+		int depth = sample.Depth.load(std::memory_order_acquire);
+
+		if (depth <= l_SkipSampleFrames)
+			continue;
+
+		std::vector<void *> frames (sample.Frames + l_SkipSampleFrames, sample.Frames + depth);
+		std::reverse(frames.begin(), frames.end());
+
+		addresses.insert(frames.begin(), frames.end());
+		stacks[std::move(frames)]++;
+		total++;
+	}
+
+	std::unordered_map<void *, String> names;
+
+#ifdef HAVE_BACKTRACE_SYMBOLS
+	std::vector<void *> unique (addresses.begin(), addresses.end());
+	char **symbols = unique.empty() ? nullptr : backtrace_symbols(unique.data(), unique.size());
+
+	for (size_t i = 0; i < unique.size() && symbols; i++) {
+		/* e.g. /usr/lib64/icinga2/sbin/icinga2(_ZN6icinga9WorkQueue10RunTaskFunEv+0x3a) [0x7f...] */
+		String name = symbols[i];
+		char *symBegin = strchr(symbols[i], '(');
+		char *symEnd = symBegin ? strchr(symBegin, '+') : nullptr;
+
+		if (symBegin && symEnd && symEnd > symBegin + 1) {
+			String demangled = Utility::DemangleSymbolName(String(symBegin + 1, symEnd));
+
+			if (!demangled.IsEmpty())
+				name = demangled;
+		}
+
+		std::replace(name.Begin(), name.End(), ';', ':');
+		names[unique[i]] = std::move(name);
+	}
+
+	std::free(symbols);
+#endif /* HAVE_BACKTRACE_SYMBOLS */
+
+	for (auto& stack : stacks) {
+		bool first = true;
+
+		for (void *frame : stack.first) {
+			if (!first)
+				fp << ';';
+
+			first = false;
+
+			auto name (names.find(frame));
+
+			if (name != names.end())
+				fp << name->second;
+			else
+				fp << frame;
+		}
+
+		fp << ' ' << stack.second << '\n';
+	}
+
+	return total;
+}
+
+/**
+ * Returns how many stack samples of the last profile didn't fit into the buffer.
+ */
+size_t Profiler::GetDroppedSamples()
+{
+	size_t samples = l_NextSample.load();
+
+	return samples > l_MaxSamples ? samples - l_MaxSamples : 0;
+}
+
+/**
+ * Returns the lock sites threads had to wait for since the last profile started, the longest waits first.
+ */
+std::vector<LockContention> Profiler::GetLockContention()
+{
+	std::vector<LockContention> result;
+	auto& sites (GetLockSites());
+	std::unique_lock<std::mutex> lock (sites.Mutex);
+
+	for (auto *site : sites.Sites) {
+		uint_fast64_t waits = site->Waits.load(std::memory_order_relaxed);
+
+		if (!waits)
+			continue;
+
+		result.push_back({
+			site->GetName(),
+			waits,
+			site->WaitNanoseconds.load(std::memory_order_relaxed) / 1e9,
+			site->MaxWaitNanoseconds.load(std::memory_order_relaxed) / 1e9
+		});
+	}
+
+	std::sort(result.begin(), result.end(), [](const LockContention& a, const LockContention& b) {
+		return a.WaitTime > b.WaitTime;
+	});
+
+	return result;
+}
@@ -0,0 +1,124 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "base/i2-base.hpp"
+#include "base/string.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <typeinfo>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * Where a lock is taken, with how often and how long threads had to wait for it.
+ *
+ * @ingroup base
+ */
+class LockSite final
+{
+public:
+	LockSite(const char *file, int line);
+	explicit LockSite(const std::type_info *type);
+
+	LockSite(const LockSite&) = delete;
+	LockSite& operator=(const LockSite&) = delete;
+
+	String GetName() const;
+
+	void RecordWait(std::chrono::steady_clock::duration wait);
+	void Reset();
+
+	const char *File;
+	int Line;
+	const std::type_info *Type;
+
+	std::atomic<uint_fast64_t> Waits{0};
+	std::atomic<uint_fast64_t> WaitNanoseconds{0};
+	std::atomic<uint_fast64_t> MaxWaitNanoseconds{0};
+};
+
+/**
+ * How long threads waited for a lock site during a profile.
+ *
+ * @ingroup base
+ */
+struct LockContention
+{
+	String Site;
+	uint_fast64_t Waits;
+	double WaitTime;
+	double MaxWaitTime;
+};
+
+/**
+ * An on-demand sampling CPU profiler and lock contention recorder.
+ *
+ * While running, the threads using CPU are interrupted about Frequency times
+ * per CPU second (SIGPROF) to record their stack. Stop() aggregates the stacks
+ * in the folded format of flame graph tools. Lock contention is only recorded
+ * for the lock sites using PROFILED_LOCK() and for ObjectLock, by object type.
+ *
+ * @ingroup base
+ */
+class Profiler final
+{
+public:
+	static bool Start(int frequency, bool locks);
+	static void Stop();
+
+	static bool IsSupported();
+
+	static size_t WriteFoldedStacks(std::ostream& fp);
+	static size_t GetDroppedSamples();
+	static std::vector<LockContention> GetLockContention();
+
+	static bool IsRecordingLocks()
+	{
+		return m_RecordingLocks.load(std::memory_order_relaxed);
+	}
+
+	static void RecordObjectLockWait(const std::type_info& type, std::chrono::steady_clock::duration wait);
+
+	static void RegisterLockSite(LockSite *site);
+
+private:
+	static std::atomic<bool> m_RecordingLocks;
+};
+
+/**
+ * Locks a mutex like std::unique_lock does, but records the wait at site if it's contended
+ * and lock contention is being recorded. See PROFILED_LOCK().
+ */
+inline std::unique_lock<std::mutex> LockProfiled(std::mutex& mutex, LockSite& site)
+{
+	std::unique_lock<std::mutex> lock (mutex, std::try_to_lock);
+
+	if (!lock) {
+		if (Profiler::IsRecordingLocks()) {
+			auto start (std::chrono::steady_clock::now());
+			lock.lock();
+			site.RecordWait(std::chrono::steady_clock::now() - start);
+		} else {
+			lock.lock();
+		}
+	}
+
+	return lock;
+}
+
+#define PROFILED_LOCK(mutex) \
+	icinga::LockProfiled(mutex, []() -> icinga::LockSite& { \
+		static icinga::LockSite site (__FILE__, __LINE__); \
+		return site; \
+	}())
+
+}
+
+#endif /* PROFILER_H */
@@ -18,6 +18,7 @@
 #include <boost/regex.hpp>
 #include <algorithm>
 #include <set>
+#include <unordered_map>
 #ifdef _WIN32
 #include <msi.h>
 #endif /* _WIN32 */
@@ -93,6 +94,30 @@ bool ScriptUtils::CastBool(const Value& value)
 	return value.ToBool();
 }
 
+/* Usually there are only a few distinct patterns, e.g. those in apply rules. */
+static const size_t l_MaxCachedRegexes = 1024;
+
+/**
+ * Compiles a regular expression unless the thread has compiled it before.
+ * Each thread has its own cache, so looking up patterns doesn't need a lock.
+ */
+static const boost::regex& GetCachedRegex(const String& pattern)
+{
+	static thread_local std::unordered_map<String, boost::regex> cache;
+
+	auto it (cache.find(pattern));
+
+	if (it != cache.end())
+		return it->second;
+
+	boost::regex expr (pattern.GetData());
+
+	if (cache.size() >= l_MaxCachedRegexes)
+		cache.clear();
+
+	return cache.emplace(pattern, std::move(expr)).first->second;
+}
+
 bool ScriptUtils::Regex(const std::vector<Value>& args)
 {
 	if (args.size() < 2)
@@ -111,7 +136,7 @@ bool ScriptUtils::Regex(const std::vector<Value>& args)
 	else
 		mode = MatchAll;
 
-	boost::regex expr(pattern.GetData());
+	const boost::regex& expr = GetCachedRegex(pattern);
 
 	Array::Ptr texts;
 
@@ -394,7 +419,7 @@ Array::Ptr ScriptUtils::Keys(const Object::Ptr& obj)
 	if (dict) {
 		ObjectLock olock(dict);
 		for (const Dictionary::Pair& kv : dict) {
-			result.push_back(kv.first);
+			result.push_back(kv.first.GetString());
 		}
 	}
 
@@ -1,6 +1,7 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "base/serializer.hpp"
+#include "base/configobject.hpp"
 #include "base/type.hpp"
 #include "base/application.hpp"
 #include "base/objectlock.hpp"
@@ -129,6 +130,12 @@ static Object::Ptr SerializeObject(const Object::Ptr& input, int attributeTypes,
 	DictionaryData fields;
 	fields.reserve(type->GetFieldCount() + 1);
 
+	/* Only at the top level, the attributes of nested objects have to be checked for cycles. */
+	ConfigObject *configObject = nullptr;
+
+	if (stack.Entries.empty() && attributeTypes == (FAConfig | FAState))
+		configObject = dynamic_cast<ConfigObject *>(input.get());
+
 	ObjectLock olock(input);
 
 	for (int i = 0; i < type->GetFieldCount(); i++) {
@@ -140,6 +147,11 @@ static Object::Ptr SerializeObject(const Object::Ptr& input, int attributeTypes,
 		if (strcmp(field.Name, "type") == 0)
 			continue;
 
+		if (configObject) {
+			fields.emplace_back(field.Name, configObject->GetSerializedField(i));
+			continue;
+		}
+
 		Value value = input->GetField(i);
 		stack.Push(field.Name, value);
 		fields.emplace_back(field.Name, SerializeInternal(value, attributeTypes, stack));
@@ -0,0 +1,302 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/shmring.hpp"
+#include "base/configuration.hpp"
+#include "base/exception.hpp"
+#include "base/utility.hpp"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#ifndef _WIN32
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif /* _WIN32 */
+
+using namespace icinga;
+
+/* Tells an initialized ring from garbage, e.g. another version's layout. */
+static const uint64_t l_RingMagic = 0x49324d5352494e47; /* "I2MSRING" */
+
+#ifndef _WIN32
+/**
+ * Creates anonymous shared memory.
+ *
+ * @param size The size in bytes
+ */
+SharedMemory::SharedMemory(size_t size)
+	: m_FD(-1), m_Address(nullptr), m_Size(size)
+{
+#ifdef HAVE_MEMFD_CREATE
+	m_FD = memfd_create("icinga2-shm", MFD_CLOEXEC);
+
+	if (m_FD < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("memfd_create")
+			<< boost::errinfo_errno(errno));
+	}
+#else /* HAVE_MEMFD_CREATE */
+	String path = Configuration::RunDir + "/icinga2-shm.XXXXXX";
+	std::vector<char> targetPath (path.Begin(), path.End());
+	targetPath.push_back('\0');
+
+	m_FD = mkstemp(&targetPath[0]);
+
+	if (m_FD < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("mkstemp")
+			<< boost::errinfo_errno(errno)
+			<< boost::errinfo_file_name(path));
+	}
+
+	/* Only the FD is passed on, nobody else shall find it. */
+	(void)unlink(&targetPath[0]);
+
+	Utility::SetCloExec(m_FD);
+#endif /* HAVE_MEMFD_CREATE */
+
+	if (ftruncate(m_FD, size) < 0) {
+		int error = errno;
+
+		(void)close(m_FD);
+
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("ftruncate")
+			<< boost::errinfo_errno(error));
+	}
+
+	Map();
+}
+
+/**
+ * Maps shared memory created by another process.
+ *
+ * @param fd The FD passed by the other process, owned by us from now on
+ */
+SharedMemory::SharedMemory(int fd)
+	: m_FD(fd), m_Address(nullptr), m_Size(0)
+{
+	struct stat st;
+
+	if (fstat(m_FD, &st) < 0) {
+		int error = errno;
+
+		(void)close(m_FD);
+
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("fstat")
+			<< boost::errinfo_errno(error));
+	}
+
+	m_Size = st.st_size;
+
+	Map();
+}
+
+SharedMemory::~SharedMemory()
+{
+	(void)munmap(m_Address, m_Size);
+	(void)close(m_FD);
+}
+
+void SharedMemory::Map()
+{
+	m_Address = mmap(nullptr, m_Size, PROT_READ | PROT_WRITE, MAP_SHARED, m_FD, 0);
+
+	if (m_Address == MAP_FAILED) {
+		int error = errno;
+
+		(void)close(m_FD);
+
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("mmap")
+			<< boost::errinfo_errno(error));
+	}
+}
+
+int SharedMemory::GetFD() const
+{
+	return m_FD;
+}
+
+void *SharedMemory::GetAddress() const
+{
+	return m_Address;
+}
+
+size_t SharedMemory::GetSize() const
+{
+	return m_Size;
+}
+#endif /* _WIN32 */
+
+/**
+ * The size of the memory a ring of the given capacity needs.
+ *
+ * @param capacity The capacity in bytes, a power of two
+ */
+size_t SharedMemoryRing::GetSize(size_t capacity)
+{
+	return sizeof(Header) + capacity;
+}
+
+/**
+ * Tells whether the rings' positions can be shared between processes, i.e.
+ * the atomics don't need a lock which would be private to each process.
+ */
+bool SharedMemoryRing::IsSupported()
+{
+	std::atomic<uint64_t> position (0);
+	std::atomic<uint32_t> flag (0);
+
+	return position.is_lock_free() && flag.is_lock_free();
+}
+
+/**
+ * Initializes a new ring.
+ *
+ * @param memory At least GetSize(capacity) bytes, aligned to a page
+ * @param capacity The capacity in bytes, a power of two
+ */
+SharedMemoryRing::SharedMemoryRing(void *memory, size_t capacity)
+	: m_Header(new (memory) Header()), m_Data(static_cast<char *>(memory) + sizeof(Header)), m_Mask(capacity - 1u)
+{
+	VERIFY(capacity > 0 && (capacity & (capacity - 1u)) == 0);
+
+	m_Header->Capacity = capacity;
+	m_Header->Head.store(0);
+	m_Header->Waiting.store(0);
+	m_Header->Tail.store(0);
+	m_Header->Magic = l_RingMagic;
+}
+
+/**
+ * Attaches to a ring initialized by another process.
+ *
+ * @param memory The memory the other process has initialized the ring in
+ */
+SharedMemoryRing::SharedMemoryRing(void *memory)
+	: m_Header(static_cast<Header *>(memory)), m_Data(static_cast<char *>(memory) + sizeof(Header))
+{
+	if (m_Header->Magic != l_RingMagic)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Shared memory doesn't contain a ring"));
+
+	m_Mask = m_Header->Capacity - 1u;
+}
+
+void SharedMemoryRing::Copy(uint64_t position, const char *data, size_t length)
+{
+	size_t offset = position & m_Mask;
+	size_t first = std::min<size_t>(length, m_Mask + 1u - offset);
+
+	memcpy(m_Data + offset, data, first);
+	memcpy(m_Data, data + first, length - first);
+}
+
+void SharedMemoryRing::CopyOut(uint64_t position, char *data, size_t length) const
+{
+	size_t offset = position & m_Mask;
+	size_t first = std::min<size_t>(length, m_Mask + 1u - offset);
+
+	memcpy(data, m_Data + offset, first);
+	memcpy(data + first, m_Data, length - first);
+}
+
+/**
+ * Adds a message. Must only be called by the producer.
+ *
+ * @param message The message
+ * @return false if the ring is too full
+ */
+bool SharedMemoryRing::TryWrite(const String& message)
+{
+	uint32_t length = message.GetLength();
+	uint64_t tail = m_Header->Tail.load(std::memory_order_relaxed);
+	uint64_t head = m_Header->Head.load(std::memory_order_acquire);
+
+	if (message.GetLength() > UINT32_MAX || m_Mask + 1u - (tail - head) < sizeof(length) + length)
+		return false;
+
+	Copy(tail, reinterpret_cast<const char *>(&length), sizeof(length));
+	Copy(tail + sizeof(length), message.CStr(), length);
+
+	/* Pairs with the load in PrepareWait(), see Notify(). */
+	m_Header->Tail.store(tail + sizeof(length) + length, std::memory_order_seq_cst);
+
+	return true;
+}
+
+/**
+ * Tells the producer whether it has to wake up the consumer after writing.
+ *
+ * @return true once after the consumer has called PrepareWait()
+ */
+bool SharedMemoryRing::Notify()
+{
+	if (!m_Header->Waiting.load(std::memory_order_seq_cst))
+		return false;
+
+	return m_Header->Waiting.exchange(0, std::memory_order_seq_cst);
+}
+
+/**
+ * Removes the oldest message. Must only be called by the consumer.
+ *
+ * @param message Receives the message
+ * @return false if the ring is empty
+ */
+bool SharedMemoryRing::TryRead(String& message)
+{
+	uint64_t head = m_Header->Head.load(std::memory_order_relaxed);
+	uint64_t tail = m_Header->Tail.load(std::memory_order_acquire);
+
+	if (head == tail)
+		return false;
+
+	uint32_t length;
+	CopyOut(head, reinterpret_cast<char *>(&length), sizeof(length));
+
+	/* Don't let a corrupted header make us allocate more than the ring could hold. */
+	if (length > GetCapacity() || tail - head < sizeof(length) + length)
+		BOOST_THROW_EXCEPTION(std::runtime_error("Shared memory ring is corrupted"));
+
+	std::string buf (length, '\0');
+	CopyOut(head + sizeof(length), &buf[0], length);
+
+	m_Header->Head.store(head + sizeof(length) + length, std::memory_order_release);
+
+	message = String(std::move(buf));
+	return true;
+}
+
+/**
+ * Announces that the consumer is going to wait for the producer to wake it up.
+ * Must only be called by the consumer.
+ *
+ * @return false if there are messages already, i.e. the consumer must not wait
+ */
+bool SharedMemoryRing::PrepareWait()
+{
+	m_Header->Waiting.store(1, std::memory_order_seq_cst);
+
+	if (m_Header->Tail.load(std::memory_order_seq_cst) == m_Header->Head.load(std::memory_order_relaxed))
+		return true;
+
+	m_Header->Waiting.store(0, std::memory_order_relaxed);
+	return false;
+}
+
+size_t SharedMemoryRing::GetCapacity() const
+{
+	return m_Mask + 1u;
+}
+
+/**
+ * The number of bytes used at some point in time, for statistics.
+ */
+size_t SharedMemoryRing::GetLength() const
+{
+	return m_Header->Tail.load(std::memory_order_relaxed) - m_Header->Head.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,103 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include "base/i2-base.hpp"
+#include "base/string.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace icinga
+{
+
+#ifndef _WIN32
+
+/**
+ * Memory shared with a child process. It's created anonymously and passed to
+ * the child as a file descriptor.
+ *
+ * @ingroup base
+ */
+class SharedMemory final
+{
+public:
+	explicit SharedMemory(size_t size);
+	explicit SharedMemory(int fd);
+	~SharedMemory();
+
+	SharedMemory(const SharedMemory&) = delete;
+	SharedMemory& operator=(const SharedMemory&) = delete;
+
+	int GetFD() const;
+	void *GetAddress() const;
+	size_t GetSize() const;
+
+private:
+	int m_FD;
+	void *m_Address;
+	size_t m_Size;
+
+	void Map();
+};
+
+#endif /* _WIN32 */
+
+/**
+ * A bounded ring of variable-size messages with a single producer and a
+ * single consumer, which may be different processes. The ring lives in the
+ * memory passed to it, neither reading nor writing a message takes a lock or
+ * a system call.
+ *
+ * The consumer announces with PrepareWait() that it's going to sleep and the
+ * producer learns with Notify() after writing whether it has to wake it up,
+ * e.g. by writing to a pipe. That way no wakeup gets lost while neither side
+ * wakes up the other one for each message.
+ *
+ * @ingroup base
+ */
+class SharedMemoryRing final
+{
+public:
+	static size_t GetSize(size_t capacity);
+	static bool IsSupported();
+
+	SharedMemoryRing(void *memory, size_t capacity);
+	explicit SharedMemoryRing(void *memory);
+
+	SharedMemoryRing(const SharedMemoryRing&) = delete;
+	SharedMemoryRing& operator=(const SharedMemoryRing&) = delete;
+
+	bool TryWrite(const String& message);
+	bool Notify();
+
+	bool TryRead(String& message);
+	bool PrepareWait();
+
+	size_t GetCapacity() const;
+	size_t GetLength() const;
+
+private:
+	struct Header
+	{
+		uint64_t Magic;
+		uint64_t Capacity;
+
+		/* Keep the producer's and the consumer's position on different cache lines. */
+		alignas(64) std::atomic<uint64_t> Head;
+		std::atomic<uint32_t> Waiting;
+		alignas(64) std::atomic<uint64_t> Tail;
+	};
+
+	Header *m_Header;
+	char *m_Data;
+	uint64_t m_Mask;
+
+	void Copy(uint64_t position, const char *data, size_t length);
+	void CopyOut(uint64_t position, char *data, size_t length) const;
+};
+
+}
+
+#endif /* SHMRING_H */
@@ -0,0 +1,203 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/startupprofiler.hpp"
+#include "base/application.hpp"
+#include "base/array.hpp"
+#include "base/exception.hpp"
+#include "base/logger.hpp"
+#include "base/utility.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#ifndef _WIN32
+#	include <sys/resource.h>
+#endif /* _WIN32 */
+
+using namespace icinga;
+
+struct StartupProfileEntry
+{
+	const char *Category;
+	String Name;
+	double Wall;
+	double Cpu;
+	size_t Count;
+};
+
+static std::mutex l_EntriesMutex;
+static std::vector<StartupProfileEntry> l_Entries;
+
+StartupProfiler::Scope::Scope(const char *category, String name, size_t count)
+	: m_Category(category), m_Name(std::move(name)), m_Count(count), m_WallStart(Utility::GetTime()), m_CpuStart(GetCpuTime())
+{ }
+
+StartupProfiler::Scope::~Scope()
+{
+	Record(m_Category, m_Name, Utility::GetTime() - m_WallStart, GetCpuTime() - m_CpuStart, m_Count);
+}
+
+/**
+ * Adds a time to the profile.
+ *
+ * @param category "phase", "commit", "validate", "activate" or "feature"
+ * @param name The phase, type or feature object
+ * @param wall Wall clock seconds
+ * @param cpu CPU seconds, negative if not known
+ * @param count How many objects have been processed, if applicable
+ */
+void StartupProfiler::Record(const char *category, const String& name, double wall, double cpu, size_t count)
+{
+	std::unique_lock<std::mutex> lock (l_EntriesMutex);
+
+	for (auto& entry : l_Entries) {
+		if (!strcmp(entry.Category, category) && entry.Name == name) {
+			entry.Wall += wall;
+
+			if (cpu >= 0)
+				entry.Cpu = entry.Cpu < 0 ? cpu : entry.Cpu + cpu;
+
+			entry.Count += count;
+			return;
+		}
+	}
+
+	l_Entries.push_back({ category, name, wall, cpu, count });
+}
+
+/**
+ * Returns the entries grouped by category, phases in the order they ran,
+ * everything else sorted by wall clock time, the slowest first.
+ */
+static std::vector<StartupProfileEntry> GetSortedEntries()
+{
+	std::vector<StartupProfileEntry> entries;
+
+	{
+		std::unique_lock<std::mutex> lock (l_EntriesMutex);
+		entries = l_Entries;
+	}
+
+	auto rank ([](const char *category) {
+		return strcmp(category, "phase") ? 1 : 0;
+	});
+
+	std::stable_sort(entries.begin(), entries.end(), [&rank](const StartupProfileEntry& a, const StartupProfileEntry& b) {
+		int rankA = rank(a.Category);
+		int rankB = rank(b.Category);
+
+		if (rankA != rankB)
+			return rankA < rankB;
+
+		if (!rankA)
+			return false;
+
+		int cmp = strcmp(a.Category, b.Category);
+
+		if (cmp)
+			return cmp < 0;
+
+		return a.Wall > b.Wall;
+	});
+
+	return entries;
+}
+
+Dictionary::Ptr StartupProfiler::ToJson()
+{
+	Dictionary::Ptr result = new Dictionary({
+		{ "version", Application::GetAppVersion() },
+		{ "timestamp", Utility::GetTime() }
+	});
+
+	for (auto& entry : GetSortedEntries()) {
+		String key = String(entry.Category) + "s";
+		Array::Ptr entries = result->Get(key);
+
+		if (!entries) {
+			entries = new Array();
+			result->Set(key, entries);
+		}
+
+		entries->Add(new Dictionary({
+			{ "name", entry.Name },
+			{ "wall_time", entry.Wall },
+			{ "cpu_time", entry.Cpu < 0 ? Value() : Value(entry.Cpu) },
+			{ "count", entry.Count }
+		}));
+	}
+
+	return result;
+}
+
+/**
+ * Logs the profile as a table and writes it as JSON.
+ *
+ * The phases are always logged, the config types and features only if verbose
+ * (otherwise they end up in the debug log).
+ *
+ * @param verbose Whether to log the whole table with severity information
+ * @param jsonPath Where to write the JSON file to, empty for nowhere
+ */
+void StartupProfiler::Report(bool verbose, const String& jsonPath)
+{
+	char line[160];
+
+	snprintf(line, sizeof(line), "%-8s  %-50s  %10s  %10s  %8s", "Category", "Name", "Wall (s)", "CPU (s)", "Count");
+
+	Log(LogInformation, "StartupProfiler", line);
+
+	for (auto& entry : GetSortedEntries()) {
+		char cpu[16] = "-";
+
+		if (entry.Cpu >= 0)
+			snprintf(cpu, sizeof(cpu), "%.3f", entry.Cpu);
+
+		String name = entry.Name;
+
+		if (name.GetLength() > 50)
+			name = name.SubStr(0, 47) + "...";
+
+		snprintf(line, sizeof(line), "%-8s  %-50s  %10.3f  %10s  %8lu", entry.Category, name.CStr(), entry.Wall, cpu, static_cast<unsigned long>(entry.Count));
+
+		Log(verbose || !strcmp(entry.Category, "phase") ? LogInformation : LogNotice, "StartupProfiler", line);
+	}
+
+	if (jsonPath.IsEmpty())
+		return;
+
+	try {
+		Utility::SaveJsonFile(jsonPath, 0644, ToJson());
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "StartupProfiler")
+			<< "Cannot write startup profile to '" << jsonPath << "': " << DiagnosticInformation(ex, false);
+	}
+}
+
+/**
+ * Returns the CPU time used by the whole process so far in seconds.
+ */
+double StartupProfiler::GetCpuTime()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+		return 0;
+
+	auto toSeconds ([](const FILETIME& ft) {
+		return (static_cast<uint64_t>(ft.dwHighDateTime) << 32u | ft.dwLowDateTime) / 1e7;
+	});
+
+	return toSeconds(kernel) + toSeconds(user);
+#else /* _WIN32 */
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage) < 0)
+		return 0;
+
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif /* _WIN32 */
+}
@@ -0,0 +1,58 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef STARTUPPROFILER_H
+#define STARTUPPROFILER_H
+
+#include "base/i2-base.hpp"
+#include "base/dictionary.hpp"
+#include "base/string.hpp"
+
+namespace icinga
+{
+
+/**
+ * Records the wall clock and CPU time the daemon spends in each phase of
+ * its startup, per config type and per feature.
+ *
+ * Times recorded twice under the same name add up. The CPU time is the
+ * whole process' one, i.e. it includes all threads working meanwhile.
+ *
+ * @ingroup base
+ */
+class StartupProfiler final
+{
+public:
+	/**
+	 * Records the time between its construction and destruction.
+	 *
+	 * @ingroup base
+	 */
+	class Scope final
+	{
+	public:
+		Scope(const char *category, String name, size_t count = 0);
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+		~Scope();
+
+	private:
+		const char *m_Category;
+		String m_Name;
+		size_t m_Count;
+		double m_WallStart;
+		double m_CpuStart;
+	};
+
+	static void Record(const char *category, const String& name, double wall, double cpu = -1, size_t count = 0);
+
+	static Dictionary::Ptr ToJson();
+	static void Report(bool verbose, const String& jsonPath);
+
+	static double GetCpuTime();
+};
+
+}
+
+#endif /* STARTUPPROFILER_H */
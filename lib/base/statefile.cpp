@@ -0,0 +1,635 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/statefile.hpp"
+#include "base/configobject.hpp"
+#include "base/configtype.hpp"
+#include "base/configuration.hpp"
+#include "base/convert.hpp"
+#include "base/exception.hpp"
+#include "base/logger.hpp"
+#include "base/object-packer.hpp"
+#include "base/objectlock.hpp"
+#include "base/serializer.hpp"
+#include "base/utility.hpp"
+#include "base/workqueue.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif /* _WIN32 */
+
+using namespace icinga;
+
+std::mutex StateFile::m_Mutex;
+std::condition_variable StateFile::m_CV;
+bool StateFile::m_Compacting = false;
+bool StateFile::m_Tracking = false;
+String StateFile::m_Path;
+int StateFile::m_AttributeTypes = 0;
+std::map<String, uint_least64_t> StateFile::m_TypeIndexes;
+uint_least64_t StateFile::m_SnapshotSize = 0;
+uint_least64_t StateFile::m_DeltaSize = 0;
+std::mutex StateFile::m_DirtyMutex;
+std::set<ConfigObject::Ptr> StateFile::m_DirtyObjects;
+
+static const char l_StateFileMagic[8] = { 'I', '2', 'S', 'T', 'A', 'T', 'E', '\0' };
+static const uint_least64_t l_StateFileVersion = 1;
+
+/* Objects per chunk, i.e. the unit of work when restoring the state. */
+static const size_t l_StateChunkSize = 1000;
+
+enum StateFileSection : char
+{
+	SectionSchema = 'S',
+	SectionGeneration = 'G',
+	SectionChunk = 'C'
+};
+
+/**
+ * A state file mapped into memory.
+ */
+class MappedStateFile
+{
+public:
+	MappedStateFile(const String& path)
+	{
+#ifndef _WIN32
+		int fd = open(path.CStr(), O_RDONLY);
+
+		if (fd < 0)
+			return;
+
+		struct stat statbuf;
+
+		if (fstat(fd, &statbuf) == 0 && statbuf.st_size > 0) {
+			void *data = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+			if (data != MAP_FAILED) {
+				m_Data = static_cast<const char *>(data);
+				m_Size = statbuf.st_size;
+			}
+		}
+
+		(void)close(fd);
+#else /* _WIN32 */
+		std::ifstream fp (path.CStr(), std::ifstream::in | std::ifstream::binary);
+
+		m_Buffer.assign(std::istreambuf_iterator<char>(fp), std::istreambuf_iterator<char>());
+		m_Data = m_Buffer.data();
+		m_Size = m_Buffer.size();
+#endif /* _WIN32 */
+	}
+
+	MappedStateFile(const MappedStateFile&) = delete;
+	MappedStateFile& operator=(const MappedStateFile&) = delete;
+
+	~MappedStateFile()
+	{
+#ifndef _WIN32
+		if (m_Data)
+			(void)munmap(const_cast<char *>(m_Data), m_Size);
+#endif /* _WIN32 */
+	}
+
+	const char *m_Data{nullptr};
+	size_t m_Size{0};
+
+#ifdef _WIN32
+private:
+	std::vector<char> m_Buffer;
+#endif /* _WIN32 */
+};
+
+static void WriteUInt64BE(std::ostream& fp, uint_least64_t value)
+{
+	char buf[8];
+
+	for (int i = 7; i >= 0; i--) {
+		buf[i] = static_cast<char>(value & 0xffu);
+		value >>= 8u;
+	}
+
+	fp.write(buf, sizeof(buf));
+}
+
+static uint_least64_t ReadUInt64BE(const char *data)
+{
+	uint_least64_t value = 0;
+
+	for (int i = 0; i < 8; i++)
+		value = (value << 8u) | static_cast<unsigned char>(data[i]);
+
+	return value;
+}
+
+static void WriteSection(std::ostream& fp, StateFileSection kind, const String& payload)
+{
+	fp.put(kind);
+	WriteUInt64BE(fp, payload.GetLength());
+	fp.write(payload.CStr(), payload.GetLength());
+}
+
+/**
+ * The state attributes of a type in the order they're stored in.
+ */
+struct StateType
+{
+	ConfigType *Type;
+	Type::Ptr ReflectionType;
+	std::vector<int> FieldIds;
+};
+
+static std::vector<StateType> GetStateTypes(int attributeTypes)
+{
+	std::vector<StateType> types;
+
+	for (const Type::Ptr& type : Type::GetAllTypes()) {
+		auto *ctype = dynamic_cast<ConfigType *>(type.get());
+
+		if (!ctype)
+			continue;
+
+		StateType stype { ctype, type, {} };
+
+		for (int i = 0; i < type->GetFieldCount(); i++) {
+			Field field = type->GetFieldInfo(i);
+
+			if (attributeTypes != 0 && (field.Attributes & attributeTypes) == 0)
+				continue;
+
+			if (strcmp(field.Name, "type") == 0)
+				continue;
+
+			stype.FieldIds.push_back(i);
+		}
+
+		types.emplace_back(std::move(stype));
+	}
+
+	return types;
+}
+
+static Array::Ptr SerializeState(const ConfigObject::Ptr& object, const std::vector<int>& fieldIds, int attributeTypes)
+{
+	ArrayData values;
+	values.reserve(fieldIds.size());
+
+	ObjectLock olock(object);
+
+	for (int fid : fieldIds)
+		values.emplace_back(Serialize(object->GetField(fid), attributeTypes));
+
+	return new Array(std::move(values));
+}
+
+/**
+ * Checks whether a file is in the binary state file format rather than the
+ * JSON format of older versions.
+ *
+ * @param filename The path of the file.
+ */
+bool StateFile::IsStateFile(const String& filename)
+{
+	std::ifstream fp (filename.CStr(), std::ifstream::in | std::ifstream::binary);
+	char magic[sizeof(l_StateFileMagic)];
+
+	return fp.read(magic, sizeof(magic)) && memcmp(magic, l_StateFileMagic, sizeof(magic)) == 0;
+}
+
+/**
+ * Writes the state of the objects which changed since the last dump to the
+ * journal at the end of the state file. A full snapshot is only written by
+ * the first dump; once the journal has grown to half of the snapshot's size
+ * it is compacted into a new snapshot in the background.
+ *
+ * @param filename The path of the state file.
+ * @param attributeTypes The attributes to write.
+ */
+void StateFile::Dump(const String& filename, int attributeTypes)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	/* Changes made while compacting are appended to the new snapshot. */
+	m_CV.wait(lock, []() { return !m_Compacting; });
+
+	TrackChanges(attributeTypes);
+
+	try {
+		if (m_SnapshotSize == 0 || m_Path != filename || m_AttributeTypes != attributeTypes || !DumpDelta(filename, attributeTypes)) {
+			m_SnapshotSize = 0;
+			m_SnapshotSize = DumpSnapshot(filename, attributeTypes, &m_TypeIndexes);
+			m_Path = filename;
+			m_AttributeTypes = attributeTypes;
+			m_DeltaSize = 0;
+			return;
+		}
+	} catch (const std::exception&) {
+		/* The journal may not match the snapshot anymore. */
+		m_SnapshotSize = 0;
+		throw;
+	}
+
+	if (m_DeltaSize > m_SnapshotSize / 2) {
+		m_Compacting = true;
+
+		/* Not using the thread pool: a shutdown waits for the compaction to finish. */
+		std::thread([filename, attributeTypes]() { Compact(filename, attributeTypes); }).detach();
+	}
+}
+
+void StateFile::Compact(const String& filename, int attributeTypes)
+{
+	std::map<String, uint_least64_t> typeIndexes;
+	uint_least64_t size = 0;
+
+	try {
+		size = DumpSnapshot(filename, attributeTypes, &typeIndexes);
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "ConfigObject")
+			<< "Failed to compact state file '" << filename << "': " << DiagnosticInformation(ex, false);
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+
+		m_TypeIndexes = std::move(typeIndexes);
+		m_SnapshotSize = size;
+		m_DeltaSize = 0;
+		m_Compacting = false;
+	}
+
+	m_CV.notify_all();
+}
+
+/**
+ * Registers handlers for the state attributes of all config object types
+ * which mark the objects as dirty.
+ */
+void StateFile::TrackChanges(int attributeTypes)
+{
+	if (m_Tracking)
+		return;
+
+	for (const Type::Ptr& type : Type::GetAllTypes()) {
+		if (!ConfigObject::TypeInstance->IsAssignableFrom(type))
+			continue;
+
+		/* Inherited fields are tracked by the base type already. */
+		Type::Ptr baseType = type->GetBaseType();
+		int start = baseType ? baseType->GetFieldCount() : 0;
+
+		for (int i = start; i < type->GetFieldCount(); i++) {
+			Field field = type->GetFieldInfo(i);
+
+			if (attributeTypes != 0 && (field.Attributes & attributeTypes) == 0)
+				continue;
+
+			type->RegisterAttributeHandler(i, [](const Object::Ptr& object, const Value&) {
+				MarkDirty(static_pointer_cast<ConfigObject>(object));
+			});
+		}
+	}
+
+	m_Tracking = true;
+}
+
+void StateFile::MarkDirty(const ConfigObject::Ptr& object)
+{
+	if (object->m_StateDirty.exchange(true))
+		return;
+
+	std::unique_lock<std::mutex> lock(m_DirtyMutex);
+	m_DirtyObjects.insert(object);
+}
+
+std::set<ConfigObject::Ptr> StateFile::TakeDirtyObjects()
+{
+	std::set<ConfigObject::Ptr> objects;
+
+	{
+		std::unique_lock<std::mutex> lock(m_DirtyMutex);
+		std::swap(objects, m_DirtyObjects);
+	}
+
+	for (const ConfigObject::Ptr& object : objects)
+		object->m_StateDirty.store(false);
+
+	return objects;
+}
+
+/**
+ * Writes a full snapshot of the state of all objects.
+ *
+ * @returns The size of the snapshot.
+ */
+uint_least64_t StateFile::DumpSnapshot(const String& filename, int attributeTypes, std::map<String, uint_least64_t> *typeIndexes)
+{
+	Log(LogInformation, "ConfigObject")
+		<< "Dumping program state to file '" << filename << "'";
+
+	/* Everything which changes from now on is part of the next journal entry. */
+	(void)TakeDirtyObjects();
+
+	try {
+		Utility::Glob(filename + ".tmp.*", &Utility::Remove, GlobFile);
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "ConfigObject") << DiagnosticInformation(ex);
+	}
+
+	std::fstream fp;
+	String tempFilename = Utility::CreateTempFile(filename + ".tmp.XXXXXX", 0600, fp);
+	fp.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
+	if (!fp)
+		BOOST_THROW_EXCEPTION(std::runtime_error("Could not open '" + tempFilename + "' file"));
+
+	fp.write(l_StateFileMagic, sizeof(l_StateFileMagic));
+	WriteUInt64BE(fp, l_StateFileVersion);
+
+	std::vector<StateType> types = GetStateTypes(attributeTypes);
+
+	typeIndexes->clear();
+
+	{
+		ArrayData schema;
+
+		for (const StateType& stype : types) {
+			ArrayData fields;
+
+			for (int fid : stype.FieldIds)
+				fields.emplace_back(stype.ReflectionType->GetFieldInfo(fid).Name);
+
+			(*typeIndexes)[stype.ReflectionType->GetName()] = schema.size();
+			schema.emplace_back(new Array({ stype.ReflectionType->GetName(), new Array(std::move(fields)) }));
+		}
+
+		WriteSection(fp, SectionSchema, PackObject(new Array(std::move(schema))));
+	}
+
+	ArrayData records;
+
+	for (const StateType& stype : types) {
+		double index = (*typeIndexes)[stype.ReflectionType->GetName()];
+
+		for (const ConfigObject::Ptr& object : stype.Type->GetObjects()) {
+			Array::Ptr values = SerializeState(object, stype.FieldIds, attributeTypes);
+
+			object->m_StateHash = PackObjectSHA1(values);
+			records.emplace_back(new Array({ index, object->GetName(), values }));
+
+			if (records.size() >= l_StateChunkSize) {
+				WriteSection(fp, SectionChunk, PackObject(new Array(std::move(records))));
+				records.clear();
+			}
+		}
+	}
+
+	if (!records.empty())
+		WriteSection(fp, SectionChunk, PackObject(new Array(std::move(records))));
+
+	uint_least64_t size = fp.tellp();
+
+	fp.close();
+
+	Utility::RenameFile(tempFilename, filename);
+
+	return size;
+}
+
+/**
+ * Appends the state of the objects which were marked as dirty since the
+ * last dump.
+ *
+ * @returns false if a full snapshot has to be written instead.
+ */
+bool StateFile::DumpDelta(const String& filename, int attributeTypes)
+{
+	std::map<Type *, StateType> types;
+
+	for (StateType& stype : GetStateTypes(attributeTypes)) {
+		if (m_TypeIndexes.find(stype.ReflectionType->GetName()) == m_TypeIndexes.end())
+			return false;
+
+		types.emplace(stype.ReflectionType.get(), std::move(stype));
+	}
+
+	std::ofstream fp;
+	fp.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
+	ArrayData records;
+	size_t changed = 0;
+
+	auto writeChunk = [&fp, &filename, &records]() {
+		if (!fp.is_open()) {
+			fp.open(filename.CStr(), std::ofstream::out | std::ofstream::app | std::ofstream::binary);
+			WriteSection(fp, SectionGeneration, String());
+		}
+
+		WriteSection(fp, SectionChunk, PackObject(new Array(std::move(records))));
+		records.clear();
+	};
+
+	for (const ConfigObject::Ptr& object : TakeDirtyObjects()) {
+		auto it = types.find(object->GetReflectionType().get());
+
+		/* Skip objects which were deleted in the meantime. */
+		if (it == types.end() || it->second.Type->GetObject(object->GetName()) != object)
+			continue;
+
+		const StateType& stype = it->second;
+		Array::Ptr values = SerializeState(object, stype.FieldIds, attributeTypes);
+		String hash = PackObjectSHA1(values);
+
+		if (hash == object->m_StateHash)
+			continue;
+
+		object->m_StateHash = std::move(hash);
+		records.emplace_back(new Array({ static_cast<double>(m_TypeIndexes[stype.ReflectionType->GetName()]), object->GetName(), values }));
+		changed++;
+
+		if (records.size() >= l_StateChunkSize)
+			writeChunk();
+	}
+
+	if (!records.empty())
+		writeChunk();
+
+	if (fp.is_open()) {
+		m_DeltaSize += static_cast<uint_least64_t>(fp.tellp());
+		fp.close();
+	}
+
+	Log(LogNotice, "ConfigObject")
+		<< "Appended the state of " << changed << " changed objects to file '" << filename << "'";
+
+	return true;
+}
+
+/**
+ * Restores the state of all objects. Chunks of the same generation are
+ * restored in parallel.
+ *
+ * @param filename The path of the state file.
+ * @param attributeTypes The attributes to restore.
+ * @returns The number of objects which were restored.
+ */
+size_t StateFile::Restore(const String& filename, int attributeTypes)
+{
+	MappedStateFile file (filename);
+
+	const char *data = file.m_Data;
+	size_t size = file.m_Size;
+	size_t headerSize = sizeof(l_StateFileMagic) + 8;
+
+	if (size < headerSize || memcmp(data, l_StateFileMagic, sizeof(l_StateFileMagic)) != 0)
+		BOOST_THROW_EXCEPTION(std::runtime_error("'" + filename + "' is not a state file."));
+
+	uint_least64_t version = ReadUInt64BE(data + sizeof(l_StateFileMagic));
+
+	if (version != l_StateFileVersion)
+		BOOST_THROW_EXCEPTION(std::runtime_error("State file '" + filename + "' has the unsupported version " + Convert::ToString(version) + "."));
+
+	std::vector<StateType> types;
+	std::vector<std::vector<std::pair<size_t, size_t> > > generations (1);
+
+	for (size_t pos = headerSize; pos < size;) {
+		if (size - pos < 9 || size - pos - 9 < ReadUInt64BE(data + pos + 1)) {
+			/* The last dump was interrupted. */
+			Log(LogWarning, "ConfigObject")
+				<< "State file '" << filename << "' is truncated, ignoring the last " << (size - pos) << " bytes.";
+			break;
+		}
+
+		char kind = data[pos];
+		size_t length = ReadUInt64BE(data + pos + 1);
+		size_t offset = pos + 9;
+
+		pos = offset + length;
+
+		switch (kind) {
+			case SectionSchema: {
+				Array::Ptr schema = UnpackObject(boost::string_view(data + offset, length));
+
+				ObjectLock olock(schema);
+				for (const Value& ventry : schema) {
+					Array::Ptr entry = ventry;
+					Type::Ptr type = Type::GetByName(entry->Get(0));
+					auto *ctype = dynamic_cast<ConfigType *>(type.get());
+					StateType stype { ctype, type, {} };
+					Array::Ptr fields = entry->Get(1);
+
+					ObjectLock flock(fields);
+					for (const Value& name : fields) {
+						int fid = ctype ? type->GetFieldId(name) : -1;
+
+						if (fid >= 0 && (type->GetFieldInfo(fid).Attributes & attributeTypes) == 0)
+							fid = -1;
+
+						stype.FieldIds.push_back(fid);
+					}
+
+					types.emplace_back(std::move(stype));
+				}
+
+				break;
+			}
+
+			case SectionGeneration:
+				generations.emplace_back();
+				break;
+
+			case SectionChunk:
+				generations.back().emplace_back(offset, length);
+				break;
+
+			default:
+				BOOST_THROW_EXCEPTION(std::runtime_error("State file '" + filename + "' contains an invalid section."));
+		}
+	}
+
+	std::mutex mutex;
+	std::vector<ConfigObject::Ptr> restored;
+	size_t records = 0;
+
+	WorkQueue upq(25000, Configuration::Concurrency);
+	upq.SetName("ConfigObject::RestoreObjects");
+
+	for (auto& chunks : generations) {
+		for (auto& chunk : chunks) {
+			upq.Enqueue([data, chunk, attributeTypes, &types, &mutex, &restored, &records]() {
+				std::vector<ConfigObject::Ptr> objects;
+				Array::Ptr chunkRecords = UnpackObject(boost::string_view(data + chunk.first, chunk.second));
+
+				ObjectLock olock(chunkRecords);
+				for (const Value& vrecord : chunkRecords) {
+					Array::Ptr record = vrecord;
+					size_t index = record->Get(0);
+
+					if (index >= types.size() || !types[index].Type)
+						continue;
+
+					const StateType& stype = types[index];
+					ConfigObject::Ptr object = stype.Type->GetObject(record->Get(1));
+
+					if (!object)
+						continue;
+
+					Array::Ptr values = record->Get(2);
+					ObjectLock vlock(values);
+					size_t i = 0;
+
+					for (const Value& value : values) {
+						if (i >= stype.FieldIds.size())
+							break;
+
+						int fid = stype.FieldIds[i++];
+
+						if (fid < 0)
+							continue;
+
+						try {
+							object->SetField(fid, Deserialize(value, false, attributeTypes), true);
+						} catch (const std::exception&) {
+							object->SetField(fid, Empty);
+						}
+					}
+
+					objects.emplace_back(std::move(object));
+				}
+
+				std::unique_lock<std::mutex> lock(mutex);
+				records += objects.size();
+				restored.insert(restored.end(), objects.begin(), objects.end());
+			});
+		}
+
+		/* Later generations override the state of earlier ones. */
+		upq.Join();
+	}
+
+	std::sort(restored.begin(), restored.end());
+	restored.erase(std::unique(restored.begin(), restored.end()), restored.end());
+
+	upq.ParallelFor(restored, [](const ConfigObject::Ptr& object) {
+		object->OnStateLoaded();
+		object->SetStateLoaded(true);
+	});
+
+	upq.Join();
+
+	if (upq.HasExceptions())
+		upq.ReportExceptions("ConfigObject");
+
+	Log(LogNotice, "ConfigObject")
+		<< "Read " << records << " state records in " << generations.size() << " generations from file '" << filename << "'";
+
+	return restored.size();
+}
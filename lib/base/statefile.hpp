@@ -0,0 +1,67 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef STATEFILE_H
+#define STATEFILE_H
+
+#include "base/i2-base.hpp"
+#include "base/configobject.hpp"
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+
+namespace icinga
+{
+
+/**
+ * Reads and writes the binary state file.
+ *
+ * The file starts with a schema table which lists the state attributes of
+ * each type, so objects only store their values in the PackObject()
+ * encoding. Objects are written in chunks which are restored in parallel.
+ *
+ * Objects are marked as dirty by attribute handlers on their state
+ * attributes. Between full snapshots only the dirty objects are appended to
+ * the file as a new generation of chunks, i.e. the file is a snapshot
+ * followed by a journal. Generations are restored in order, so later ones
+ * override earlier ones. Long journals are compacted into a new snapshot in
+ * the background.
+ *
+ * @ingroup base
+ */
+class StateFile
+{
+public:
+	static bool IsStateFile(const String& filename);
+
+	static void Dump(const String& filename, int attributeTypes);
+	static size_t Restore(const String& filename, int attributeTypes);
+
+private:
+	StateFile();
+
+	static std::mutex m_Mutex;
+	static std::condition_variable m_CV;
+	static bool m_Compacting;
+	static bool m_Tracking;
+	static String m_Path;
+	static int m_AttributeTypes;
+	static std::map<String, uint_least64_t> m_TypeIndexes;
+	static uint_least64_t m_SnapshotSize;
+	static uint_least64_t m_DeltaSize;
+
+	static std::mutex m_DirtyMutex;
+	static std::set<ConfigObject::Ptr> m_DirtyObjects;
+
+	static void TrackChanges(int attributeTypes);
+	static void MarkDirty(const ConfigObject::Ptr& object);
+	static std::set<ConfigObject::Ptr> TakeDirtyObjects();
+
+	static uint_least64_t DumpSnapshot(const String& filename, int attributeTypes, std::map<String, uint_least64_t> *typeIndexes);
+	static bool DumpDelta(const String& filename, int attributeTypes);
+	static void Compact(const String& filename, int attributeTypes);
+};
+
+}
+
+#endif /* STATEFILE_H */
@@ -0,0 +1,117 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/statsfunction.hpp"
+#include "base/namespace.hpp"
+#include "base/objectlock.hpp"
+#include "base/serializer.hpp"
+#include "base/utility.hpp"
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+using namespace icinga;
+
+namespace
+{
+
+struct StatsFunctionCacheEntry
+{
+	std::mutex Mutex;
+	double Ttl{1};
+	double Updated{0};
+	StatsFunctionResult Result;
+};
+
+}
+
+static std::mutex l_StatsFunctionCacheMutex;
+static std::unordered_map<String, std::shared_ptr<StatsFunctionCacheEntry>> l_StatsFunctionCache;
+
+static std::shared_ptr<StatsFunctionCacheEntry> GetStatsFunctionCacheEntry(const String& name)
+{
+	std::unique_lock<std::mutex> lock (l_StatsFunctionCacheMutex);
+
+	auto& entry (l_StatsFunctionCache[name]);
+
+	if (!entry)
+		entry = std::make_shared<StatsFunctionCacheEntry>();
+
+	return entry;
+}
+
+void StatsFunctionCache::SetTtl(const String& name, double ttl)
+{
+	auto entry (GetStatsFunctionCacheEntry(name));
+	std::unique_lock<std::mutex> lock (entry->Mutex);
+
+	entry->Ttl = ttl;
+}
+
+/**
+ * Returns the result of a stats function, evaluating it if the cached one has expired.
+ *
+ * @param name The name of the stats function
+ */
+StatsFunctionResult StatsFunctionCache::Get(const String& name)
+{
+	Namespace::Ptr statsFunctions = ScriptGlobal::Get("StatsFunctions", &Empty);
+
+	if (!statsFunctions)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("No status functions are available."));
+
+	Value vfunc;
+
+	if (!statsFunctions->Get(name, &vfunc))
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid status function name."));
+
+	Function::Ptr func = vfunc;
+
+	if (!func)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid status function name."));
+
+	auto entry (GetStatsFunctionCacheEntry(name));
+
+	/* Concurrent callers wait for the first one instead of evaluating it again. */
+	std::unique_lock<std::mutex> lock (entry->Mutex);
+
+	double now = Utility::GetTime();
+
+	if (entry->Result.Status && now >= entry->Updated && now < entry->Updated + entry->Ttl)
+		return entry->Result;
+
+	Dictionary::Ptr status = new Dictionary();
+	Array::Ptr perfdata = new Array();
+	func->Invoke({ status, perfdata });
+
+	entry->Result.Status = status;
+	entry->Result.Perfdata = perfdata;
+	entry->Result.SerializedPerfdata = Serialize(perfdata, FAState);
+	entry->Updated = now;
+
+	return entry->Result;
+}
+
+/**
+ * Calls func with the result of every stats function.
+ */
+void StatsFunctionCache::ForEach(const std::function<void (const String& name, const StatsFunctionResult& result)>& func)
+{
+	Namespace::Ptr statsFunctions = ScriptGlobal::Get("StatsFunctions", &Empty);
+
+	if (!statsFunctions)
+		return;
+
+	std::vector<String> names;
+
+	{
+		ObjectLock olock(statsFunctions);
+
+		for (const Namespace::Pair& kv : statsFunctions)
+			names.push_back(kv.first);
+	}
+
+	for (auto& name : names)
+		func(name, Get(name));
+}
@@ -4,7 +4,11 @@
 #define STATSFUNCTION_H
 
 #include "base/i2-base.hpp"
+#include "base/array.hpp"
+#include "base/dictionary.hpp"
 #include "base/function.hpp"
+#include "base/initialize.hpp"
+#include <functional>
 
 namespace icinga
 {
@@ -12,6 +16,39 @@ namespace icinga
 #define REGISTER_STATSFUNCTION(name, callback) \
 	REGISTER_FUNCTION(StatsFunctions, name, callback, "status:perfdata")
 
+/* For stats functions which are expensive to evaluate, their results are re-used for ttl seconds. */
+#define REGISTER_STATSFUNCTION_TTL(name, callback, ttl) \
+	REGISTER_STATSFUNCTION(name, callback); \
+	INITIALIZE_ONCE([]() { StatsFunctionCache::SetTtl(#name, ttl); })
+
+/**
+ * What a stats function returned. Shared between callers, don't modify it.
+ *
+ * @ingroup base
+ */
+struct StatsFunctionResult
+{
+	Dictionary::Ptr Status;
+	Array::Ptr Perfdata;
+	Array::Ptr SerializedPerfdata;
+};
+
+/**
+ * Evaluates stats functions at most once per TTL (one second unless registered
+ * with REGISTER_STATSFUNCTION_TTL()), no matter how many of /v1/status,
+ * the icinga check and Icinga DB ask for them.
+ *
+ * @ingroup base
+ */
+class StatsFunctionCache
+{
+public:
+	static void SetTtl(const String& name, double ttl);
+
+	static StatsFunctionResult Get(const String& name);
+	static void ForEach(const std::function<void (const String& name, const StatsFunctionResult& result)>& func);
+};
+
 }
 
 #endif /* STATSFUNCTION_H */
@@ -7,6 +7,7 @@
 #include "base/object.hpp"
 #include <boost/range/iterator.hpp>
 #include <boost/utility/string_view.hpp>
+#include <functional>
 #include <string>
 #include <iosfwd>
 
@@ -197,4 +198,18 @@ struct range_const_iterator<icinga::String>
 
 }
 
+namespace std
+{
+
+template<>
+struct hash<icinga::String>
+{
+	size_t operator()(const icinga::String& s) const noexcept
+	{
+		return hash<std::string>()(s.GetData());
+	}
+};
+
+}
+
 #endif /* STRING_H */
@@ -4,6 +4,7 @@
 #include "base/sysloglogger.hpp"
 #include "base/sysloglogger-ti.cpp"
 #include "base/configtype.hpp"
+#include "base/perfdatavalue.hpp"
 #include "base/statsfunction.hpp"
 
 using namespace icinga;
@@ -61,12 +62,21 @@ void SyslogLogger::StaticInitialize()
 	m_FacilityMap["LOG_UUCP"] = LOG_UUCP;
 }
 
-void SyslogLogger::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+void SyslogLogger::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
 	DictionaryData nodes;
 
 	for (const SyslogLogger::Ptr& sysloglogger : ConfigType::GetObjectsByType<SyslogLogger>()) {
-		nodes.emplace_back(sysloglogger->GetName(), 1); //add more stats
+		size_t queueLength = sysloglogger->GetAsyncQueueLength();
+		uint_fast64_t dropped = sysloglogger->GetDroppedEntries();
+
+		nodes.emplace_back(sysloglogger->GetName(), new Dictionary({
+			{ "async_queue_length", queueLength },
+			{ "dropped_messages", dropped }
+		}));
+
+		perfdata->Add(new PerfdataValue("sysloglogger_" + sysloglogger->GetName() + "_async_queue_length", queueLength));
+		perfdata->Add(new PerfdataValue("sysloglogger_" + sysloglogger->GetName() + "_dropped_messages", dropped));
 	}
 
 	status->Set("sysloglogger", new Dictionary(std::move(nodes)));
@@ -2,11 +2,28 @@
 
 #include "base/threadpool.hpp"
 #include <boost/thread/locks.hpp>
+#include <algorithm>
 
 using namespace icinga;
 
+ThreadPool::Lane::Lane(size_t threads, const char *name)
+	: Threads(threads), Pending(0), WaitTime("icinga_threadpool_wait_seconds", "Time tasks spent queued in a thread pool lane", "lane")
+{
+	WaitTime.SetLabelValue(name);
+}
+
+/**
+ * Constructor for the ThreadPool class.
+ *
+ * @param threads The number of threads of the default lane. The low latency
+ * lane gets a quarter of them and the background one an eighth.
+ */
 ThreadPool::ThreadPool(size_t threads)
-	: m_Threads(threads), m_Pending(0)
+	: m_Lanes{
+		{ threads, "default" },
+		{ std::max<size_t>(2, threads / 4u), "low_latency" },
+		{ std::max<size_t>(1, threads / 8u), "background" }
+	}
 {
 	Start();
 }
@@ -20,8 +37,10 @@ void ThreadPool::Start()
 {
 	boost::unique_lock<decltype(m_Mutex)> lock (m_Mutex);
 
-	if (!m_Pool) {
-		m_Pool = decltype(m_Pool)(new boost::asio::thread_pool(m_Threads));
+	for (auto& lane : m_Lanes) {
+		if (!lane.Pool) {
+			lane.Pool = decltype(lane.Pool)(new boost::asio::thread_pool(lane.Threads));
+		}
 	}
 }
 
@@ -29,8 +48,10 @@ void ThreadPool::Stop()
 {
 	boost::unique_lock<decltype(m_Mutex)> lock (m_Mutex);
 
-	if (m_Pool) {
-		m_Pool->join();
-		m_Pool = nullptr;
+	for (auto& lane : m_Lanes) {
+		if (lane.Pool) {
+			lane.Pool->join();
+			lane.Pool = nullptr;
+		}
 	}
 }
@@ -6,6 +6,7 @@
 #include "base/atomic.hpp"
 #include "base/exception.hpp"
 #include "base/logger.hpp"
+#include "base/metrics.hpp"
 #include <cstddef>
 #include <exception>
 #include <functional>
@@ -20,15 +21,25 @@
 namespace icinga
 {
 
+/**
+ * The lane of the thread pool a work item is executed in.
+ *
+ * @ingroup base
+ */
 enum SchedulerPolicy
 {
 	DefaultScheduler,
-	LowLatencyScheduler
+	LowLatencyScheduler, /**< Short tasks which shouldn't wait behind long ones, e.g. timers. */
+	BackgroundScheduler /**< Bulk sweeps, e.g. writing status files or cleaning up. */
 };
 
 /**
  * A thread pool.
  *
+ * Each scheduler policy has a lane with its own threads, so that e.g. timers
+ * don't wait for check results to be processed and a status file being
+ * written doesn't hold up either.
+ *
  * @ingroup base
  */
 class ThreadPool
@@ -43,21 +54,27 @@ public:
 	void Stop();
 
 	/**
-	 * Appends a work item to the work queue. Work items will be processed in FIFO order.
+	 * Appends a work item to the work queue of a lane. Work items will be processed in FIFO order.
 	 *
 	 * @param callback The callback function for the work item.
+	 * @param policy The lane to execute the work item in.
 	 * @returns true if the item was queued, false otherwise.
 	 */
 	template<class T>
-	bool Post(T callback, SchedulerPolicy)
+	bool Post(T callback, SchedulerPolicy policy)
 	{
+		Lane& lane (GetLane(policy));
+
 		boost::shared_lock<decltype(m_Mutex)> lock (m_Mutex);
 
-		if (m_Pool) {
-			m_Pending.fetch_add(1);
+		if (lane.Pool) {
+			lane.Pending.fetch_add(1);
+
+			auto queued (Histogram::Clock::now());
 
-			boost::asio::post(*m_Pool, [this, callback]() {
-				m_Pending.fetch_sub(1);
+			boost::asio::post(*lane.Pool, [&lane, callback, queued]() {
+				lane.Pending.fetch_sub(1);
+				lane.WaitTime.ObserveSince(queued);
 
 				try {
 					callback();
@@ -83,14 +100,37 @@ public:
 	 */
 	inline uint_fast64_t GetPending()
 	{
-		return m_Pending.load();
+		uint_fast64_t pending = 0;
+
+		for (auto& lane : m_Lanes)
+			pending += lane.Pending.load();
+
+		return pending;
+	}
+
+	inline uint_fast64_t GetPending(SchedulerPolicy policy)
+	{
+		return GetLane(policy).Pending.load();
 	}
 
 private:
+	struct Lane
+	{
+		std::unique_ptr<boost::asio::thread_pool> Pool;
+		size_t Threads;
+		Atomic<uint_fast64_t> Pending;
+		Histogram WaitTime;
+
+		Lane(size_t threads, const char *name);
+	};
+
 	boost::shared_mutex m_Mutex;
-	std::unique_ptr<boost::asio::thread_pool> m_Pool;
-	size_t m_Threads;
-	Atomic<uint_fast64_t> m_Pending;
+	Lane m_Lanes[3];
+
+	inline Lane& GetLane(SchedulerPolicy policy)
+	{
+		return m_Lanes[policy < 3 ? policy : DefaultScheduler];
+	}
 };
 
 }
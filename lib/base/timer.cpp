@@ -4,14 +4,20 @@
 #include "base/timer.hpp"
 #include "base/debug.hpp"
 #include "base/logger.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/ringbuffer.hpp"
+#include "base/statsfunction.hpp"
 #include "base/utility.hpp"
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/key_extractors.hpp>
 #include <chrono>
+#include <cmath>
 #include <condition_variable>
+#include <cstdint>
 #include <mutex>
 #include <thread>
+#include <vector>
 
 using namespace icinga;
 
@@ -42,6 +48,66 @@ private:
 	Timer *m_Timer;
 };
 
+/**
+ * A hierarchical timing wheel.
+ *
+ * Timers are linked into intrusive per-slot lists, so scheduling and
+ * unscheduling a timer costs O(1) no matter how many timers exist. The first
+ * level has one slot per tick, every upper level covers the whole range of
+ * the level below it with each of its slots. Timers are moved ("cascaded")
+ * to the lower levels as their due time comes closer.
+ *
+ * All methods must be called with l_TimerMutex held.
+ */
+class TimerWheel
+{
+public:
+	void Insert(Timer *timer);
+	void Erase(Timer *timer);
+	Timer *PopDue(double now, double& wakeup);
+	void GetTimers(std::vector<Timer *>& timers) const;
+	void Rebuild(double now);
+
+	inline bool IsEmpty() const
+	{
+		return m_Count == 0;
+	}
+
+private:
+	static constexpr double Resolution = 0.01;
+	static constexpr int RootBits = 8;
+	static constexpr int LevelBits = 6;
+	static constexpr int Levels = 3;
+	static constexpr int64_t RootSize = 1 << RootBits;
+	static constexpr int64_t LevelSize = 1 << LevelBits;
+
+	Timer *m_Root[RootSize]{};
+	Timer *m_Levels[Levels][LevelSize]{};
+	Timer *m_Overflow{nullptr};
+	Timer *m_Ready{nullptr};
+
+	int64_t m_CurrentTick{-1}; /**< The next tick which has to be processed. */
+	size_t m_Count{0};
+
+	static inline int64_t TickOf(double ts)
+	{
+		return static_cast<int64_t>(std::floor(ts / Resolution));
+	}
+
+	static inline int LevelShift(int level)
+	{
+		return RootBits + level * LevelBits;
+	}
+
+	static void Link(Timer *& head, Timer *timer);
+	static void Unlink(Timer *timer);
+	static void CollectList(Timer *head, std::vector<Timer *>& timers);
+
+	void Place(Timer *timer);
+	void Cascade(Timer *& head);
+	void Tick();
+};
+
 }
 
 typedef boost::multi_index_container<
@@ -57,10 +123,229 @@ static std::condition_variable l_TimerCV;
 static std::thread l_TimerThread;
 static bool l_StopTimerThread;
 static TimerSet l_Timers;
+static TimerWheel l_TimerWheel;
+static TimerBackend l_TimerBackend = TimerBackendOrdered;
 static int l_AliveTimers = 0;
 
+REGISTER_STATSFUNCTION(Timer, &Timer::StatsFunc);
+
+/* How often the timer thread woke up to fire timers, must outlive it. */
+static RingBuffer l_TimerWakeups (15 * 60);
+
 static Defer l_ShutdownTimersCleanlyOnExit (&Timer::Uninitialize);
 
+void TimerWheel::Link(Timer *& head, Timer *timer)
+{
+	timer->m_WheelSlot = &head;
+	timer->m_WheelPrev = nullptr;
+	timer->m_WheelNext = head;
+
+	if (head)
+		head->m_WheelPrev = timer;
+
+	head = timer;
+}
+
+void TimerWheel::Unlink(Timer *timer)
+{
+	if (timer->m_WheelPrev)
+		timer->m_WheelPrev->m_WheelNext = timer->m_WheelNext;
+	else
+		*timer->m_WheelSlot = timer->m_WheelNext;
+
+	if (timer->m_WheelNext)
+		timer->m_WheelNext->m_WheelPrev = timer->m_WheelPrev;
+
+	timer->m_WheelPrev = nullptr;
+	timer->m_WheelNext = nullptr;
+	timer->m_WheelSlot = nullptr;
+}
+
+void TimerWheel::CollectList(Timer *head, std::vector<Timer *>& timers)
+{
+	for (Timer *timer = head; timer; timer = timer->m_WheelNext)
+		timers.push_back(timer);
+}
+
+void TimerWheel::Insert(Timer *timer)
+{
+	/* Nothing has been processed while the wheel was empty, start over at the current time. */
+	if (m_Count == 0)
+		m_CurrentTick = TickOf(Utility::GetTime());
+
+	Place(timer);
+	m_Count++;
+}
+
+void TimerWheel::Erase(Timer *timer)
+{
+	if (!timer->m_WheelSlot)
+		return;
+
+	Unlink(timer);
+	m_Count--;
+}
+
+/**
+ * Links the timer into the slot matching its due time.
+ * Overdue timers are put into the slot for the current tick.
+ */
+void TimerWheel::Place(Timer *timer)
+{
+	int64_t tick = std::max(TickOf(timer->m_Next), m_CurrentTick);
+	int64_t delta = tick - m_CurrentTick;
+
+	if (delta < RootSize) {
+		Link(m_Root[tick & (RootSize - 1)], timer);
+		return;
+	}
+
+	for (int level = 0; level < Levels; level++) {
+		if (delta < (int64_t(1) << (LevelShift(level) + LevelBits))) {
+			Link(m_Levels[level][(tick >> LevelShift(level)) & (LevelSize - 1)], timer);
+			return;
+		}
+	}
+
+	Link(m_Overflow, timer);
+}
+
+void TimerWheel::Cascade(Timer *& head)
+{
+	Timer *timer = head;
+
+	while (timer) {
+		Timer *next = timer->m_WheelNext;
+		Unlink(timer);
+		Place(timer);
+		timer = next;
+	}
+}
+
+/**
+ * Processes the current tick: cascades the upper levels if the lower one
+ * wrapped around and moves all timers due in this tick to the ready list.
+ */
+void TimerWheel::Tick()
+{
+	for (int level = Levels; level >= 0; level--) {
+		int shift = LevelShift(level);
+
+		if (m_CurrentTick & ((int64_t(1) << shift) - 1))
+			continue;
+
+		if (level == Levels)
+			Cascade(m_Overflow);
+		else
+			Cascade(m_Levels[level][(m_CurrentTick >> shift) & (LevelSize - 1)]);
+	}
+
+	Timer *& slot = m_Root[m_CurrentTick & (RootSize - 1)];
+
+	while (slot) {
+		Timer *timer = slot;
+		Unlink(timer);
+		Link(m_Ready, timer);
+	}
+
+	m_CurrentTick++;
+}
+
+/**
+ * Removes and returns the next timer which is due at the specified time.
+ *
+ * @param now The current time.
+ * @param wakeup Set to the time when this should be called again if there's no due timer.
+ * @returns The timer or nullptr.
+ */
+Timer *TimerWheel::PopDue(double now, double& wakeup)
+{
+	/* Timers are due up to one tick (10ms) early, just like with the ordered backend. */
+	int64_t target = TickOf(now);
+
+	/* Don't crawl through every single tick after the clock has jumped. */
+	if (target - m_CurrentTick > (int64_t(1) << LevelShift(1)) || m_CurrentTick - target > RootSize)
+		Rebuild(now);
+
+	while (!m_Ready && m_CurrentTick <= target)
+		Tick();
+
+	if (m_Ready) {
+		Timer *timer = m_Ready;
+		Erase(timer);
+		return timer;
+	}
+
+	/* Wake up for the next occupied slot or when the next cascade is due, whichever comes first. */
+	int64_t boundary = (m_CurrentTick | (RootSize - 1)) + 1;
+	int64_t tick = m_CurrentTick;
+
+	while (tick < boundary && !m_Root[tick & (RootSize - 1)])
+		tick++;
+
+	wakeup = tick * Resolution;
+
+	return nullptr;
+}
+
+void TimerWheel::GetTimers(std::vector<Timer *>& timers) const
+{
+	CollectList(m_Ready, timers);
+
+	for (Timer *head : m_Root)
+		CollectList(head, timers);
+
+	for (auto& level : m_Levels)
+		for (Timer *head : level)
+			CollectList(head, timers);
+
+	CollectList(m_Overflow, timers);
+}
+
+/**
+ * Re-links all timers relative to the specified time, e.g. after the
+ * timers' due times have changed or the clock has jumped.
+ *
+ * @param now The current time.
+ */
+void TimerWheel::Rebuild(double now)
+{
+	std::vector<Timer *> timers;
+	GetTimers(timers);
+
+	for (Timer *timer : timers)
+		Unlink(timer);
+
+	m_CurrentTick = TickOf(now);
+
+	for (Timer *timer : timers)
+		Place(timer);
+}
+
+static inline bool IsTimerQueueEmpty()
+{
+	if (l_TimerBackend == TimerBackendWheel)
+		return l_TimerWheel.IsEmpty();
+	else
+		return l_Timers.empty();
+}
+
+static inline void InsertTimer(Timer *timer)
+{
+	if (l_TimerBackend == TimerBackendWheel)
+		l_TimerWheel.Insert(timer);
+	else
+		l_Timers.insert(timer);
+}
+
+static inline void EraseTimer(Timer *timer)
+{
+	if (l_TimerBackend == TimerBackendWheel)
+		l_TimerWheel.Erase(timer);
+	else
+		l_Timers.erase(timer);
+}
+
 /**
  * Destructor for the Timer class.
  */
@@ -146,6 +431,76 @@ double Timer::GetInterval() const
 	return m_Interval;
 }
 
+/**
+ * Sets how much later than scheduled the timer may fire, 0 by default.
+ *
+ * Due times are rounded up to multiples of a granularity no larger than
+ * the slack (0.1, 0.5, 1, 5, 10, 30 or 60 seconds), so timers with a slack
+ * tend to fire together and the timer thread wakes up less often.
+ *
+ * @param slack The slack in seconds.
+ */
+void Timer::SetSlack(double slack)
+{
+	std::unique_lock<std::mutex> lock(l_TimerMutex);
+	m_Slack = slack;
+}
+
+/**
+ * Retrieves how much later than scheduled the timer may fire.
+ *
+ * @returns The slack in seconds.
+ */
+double Timer::GetSlack() const
+{
+	std::unique_lock<std::mutex> lock(l_TimerMutex);
+	return m_Slack;
+}
+
+/**
+ * Sets the thread pool lane the timer is called in. Timers default to the
+ * low latency lane, those doing bulk work should use the background lane.
+ *
+ * @param policy The lane.
+ */
+void Timer::SetSchedulerPolicy(SchedulerPolicy policy)
+{
+	std::unique_lock<std::mutex> lock(l_TimerMutex);
+	m_SchedulerPolicy = policy;
+}
+
+/**
+ * Retrieves the thread pool lane the timer is called in.
+ *
+ * @returns The lane.
+ */
+SchedulerPolicy Timer::GetSchedulerPolicy() const
+{
+	std::unique_lock<std::mutex> lock(l_TimerMutex);
+	return m_SchedulerPolicy;
+}
+
+/**
+ * Rounds a due time up to the coarsest granularity the slack allows.
+ * The granularities are multiples of each other, so timers with different
+ * slacks still share their due times at the coarser multiples.
+ *
+ * @param next The due time.
+ * @param slack The slack in seconds.
+ * @returns The new due time.
+ */
+double Timer::ApplySlack(double next, double slack)
+{
+	static const double granularities[] = { 60, 30, 10, 5, 1, 0.5, 0.1 };
+
+	for (double granularity : granularities) {
+		if (granularity <= slack)
+			return std::ceil(next / granularity) * granularity;
+	}
+
+	return next;
+}
+
 /**
  * Registers the timer and starts processing events for it.
  */
@@ -178,7 +533,7 @@ void Timer::Stop(bool wait)
 	}
 
 	m_Started = false;
-	l_Timers.erase(this);
+	EraseTimer(this);
 
 	/* Notify the worker thread that we've disabled a timer. */
 	l_TimerCV.notify_all();
@@ -214,12 +569,15 @@ void Timer::InternalReschedule(bool completed, double next)
 		next = Utility::GetTime() + m_Interval;
 	}
 
+	if (m_Slack > 0)
+		next = ApplySlack(next, m_Slack);
+
 	m_Next = next;
 
 	if (m_Started && !m_Running) {
 		/* Remove and re-add the timer to update the index. */
-		l_Timers.erase(this);
-		l_Timers.insert(this);
+		EraseTimer(this);
+		InsertTimer(this);
 
 		/* Notify the worker that we've rescheduled a timer. */
 		l_TimerCV.notify_all();
@@ -249,28 +607,81 @@ void Timer::AdjustTimers(double adjustment)
 
 	double now = Utility::GetTime();
 
-	typedef boost::multi_index::nth_index<TimerSet, 1>::type TimerView;
-	TimerView& idx = boost::get<1>(l_Timers);
-
 	std::vector<Timer *> timers;
 
-	for (Timer *timer : idx) {
+	if (l_TimerBackend == TimerBackendWheel) {
+		l_TimerWheel.GetTimers(timers);
+	} else {
+		typedef boost::multi_index::nth_index<TimerSet, 1>::type TimerView;
+		TimerView& idx = boost::get<1>(l_Timers);
+
+		timers.assign(idx.begin(), idx.end());
+	}
+
+	for (Timer *timer : timers) {
 		if (std::fabs(now - (timer->m_Next + adjustment)) <
 			std::fabs(now - timer->m_Next)) {
 			timer->m_Next += adjustment;
-			timers.push_back(timer);
+
+			if (l_TimerBackend == TimerBackendOrdered) {
+				l_Timers.erase(timer);
+				l_Timers.insert(timer);
+			}
 		}
 	}
 
-	for (Timer *timer : timers) {
-		l_Timers.erase(timer);
-		l_Timers.insert(timer);
-	}
+	if (l_TimerBackend == TimerBackendWheel)
+		l_TimerWheel.Rebuild(now);
 
 	/* Notify the worker that we've rescheduled some timers. */
 	l_TimerCV.notify_all();
 }
 
+/**
+ * Switches the data structure used for keeping track of scheduled timers.
+ * Timers which are already scheduled are moved over to the new backend.
+ *
+ * @param backend The backend.
+ */
+void Timer::SetBackend(TimerBackend backend)
+{
+	std::unique_lock<std::mutex> lock(l_TimerMutex);
+
+	if (backend == l_TimerBackend)
+		return;
+
+	std::vector<Timer *> timers;
+
+	if (l_TimerBackend == TimerBackendWheel) {
+		l_TimerWheel.GetTimers(timers);
+
+		for (Timer *timer : timers)
+			l_TimerWheel.Erase(timer);
+	} else {
+		timers.assign(l_Timers.begin(), l_Timers.end());
+		l_Timers.clear();
+	}
+
+	l_TimerBackend = backend;
+
+	for (Timer *timer : timers)
+		InsertTimer(timer);
+
+	/* Notify the worker that the timers have moved. */
+	l_TimerCV.notify_all();
+}
+
+/**
+ * Retrieves the data structure used for keeping track of scheduled timers.
+ *
+ * @returns The backend.
+ */
+TimerBackend Timer::GetBackend()
+{
+	std::unique_lock<std::mutex> lock(l_TimerMutex);
+	return l_TimerBackend;
+}
+
 /**
  * Worker thread proc for Timer objects.
  */
@@ -282,40 +693,89 @@ void Timer::TimerThreadProc()
 
 	Utility::SetThreadName("Timer Thread");
 
+	/* Whether the thread has been waiting since it fired the last timer. */
+	bool waited = true;
+
 	for (;;) {
 		std::unique_lock<std::mutex> lock(l_TimerMutex);
 
-		typedef boost::multi_index::nth_index<TimerSet, 1>::type NextTimerView;
-		NextTimerView& idx = boost::get<1>(l_Timers);
-
 		/* Wait until there is at least one timer. */
-		while (idx.empty() && !l_StopTimerThread)
+		while (IsTimerQueueEmpty() && !l_StopTimerThread)
 			l_TimerCV.wait(lock);
 
 		if (l_StopTimerThread)
 			break;
 
-		auto it = idx.begin();
-		Timer *timer = *it;
-
-		ch::time_point<ch::system_clock, ch::duration<double>> next (ch::duration<double>(timer->m_Next));
+		Timer *timer;
+		double wakeup;
+
+		if (l_TimerBackend == TimerBackendWheel) {
+			timer = l_TimerWheel.PopDue(Utility::GetTime(), wakeup);
+		} else {
+			typedef boost::multi_index::nth_index<TimerSet, 1>::type NextTimerView;
+			NextTimerView& idx = boost::get<1>(l_Timers);
+
+			timer = *idx.begin();
+			wakeup = timer->m_Next;
+
+			if (wakeup - Utility::GetTime() > 0.01) {
+				timer = nullptr;
+			} else {
+				/* Remove the timer from the list so it doesn't get called again
+				 * until the current call is completed. */
+				l_Timers.erase(timer);
+			}
+		}
 
-		if (next - ch::system_clock::now() > ch::duration<double>(0.01)) {
+		if (!timer) {
 			/* Wait for the next timer. */
-			l_TimerCV.wait_until(lock, next);
+			l_TimerCV.wait_until(lock, ch::time_point<ch::system_clock, ch::duration<double>>(ch::duration<double>(wakeup)));
 
+			waited = true;
 			continue;
 		}
 
-		/* Remove the timer from the list so it doesn't get called again
-		 * until the current call is completed. */
-		l_Timers.erase(timer);
-
 		timer->m_Running = true;
 
+		if (waited) {
+			l_TimerWakeups.InsertValue(Utility::GetTime(), 1);
+			waited = false;
+		}
+
+		SchedulerPolicy policy = timer->m_SchedulerPolicy;
+
 		lock.unlock();
 
 		/* Asynchronously call the timer. */
-		Utility::QueueAsyncCallback([timer]() { timer->Call(); });
+		Utility::QueueAsyncCallback([timer]() { timer->Call(); }, policy);
+	}
+}
+
+/**
+ * Retrieves how often per second the timer thread woke up to fire timers during the last minute.
+ *
+ * @returns The rate.
+ */
+double Timer::GetWakeupRate()
+{
+	return l_TimerWakeups.UpdateAndGetValues(Utility::GetTime(), 60) / 60.0;
+}
+
+void Timer::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
+{
+	int timers;
+
+	{
+		std::unique_lock<std::mutex> lock(l_TimerMutex);
+		timers = l_AliveTimers;
 	}
+
+	double rate = GetWakeupRate();
+
+	status->Set("timer", new Dictionary({
+		{ "timers", timers },
+		{ "wakeup_rate", rate }
+	}));
+
+	perfdata->Add(new PerfdataValue("timer_wakeup_rate", rate));
 }
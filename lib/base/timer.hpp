@@ -5,11 +5,26 @@
 
 #include "base/i2-base.hpp"
 #include "base/object.hpp"
+#include "base/array.hpp"
+#include "base/dictionary.hpp"
+#include "base/threadpool.hpp"
 #include <boost/signals2.hpp>
 
 namespace icinga {
 
 class TimerHolder;
+class TimerWheel;
+
+/**
+ * The data structure the timer thread uses to keep track of scheduled timers.
+ *
+ * @ingroup base
+ */
+enum TimerBackend
+{
+	TimerBackendOrdered,
+	TimerBackendWheel
+};
 
 /**
  * A timer that periodically triggers an event.
@@ -31,8 +46,20 @@ public:
 	void SetInterval(double interval);
 	double GetInterval() const;
 
+	void SetSlack(double slack);
+	double GetSlack() const;
+
+	void SetSchedulerPolicy(SchedulerPolicy policy);
+	SchedulerPolicy GetSchedulerPolicy() const;
+
 	static void AdjustTimers(double adjustment);
 
+	static void SetBackend(TimerBackend backend);
+	static TimerBackend GetBackend();
+
+	static double GetWakeupRate();
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+
 	void Start();
 	void Stop(bool wait = false);
 
@@ -43,16 +70,24 @@ public:
 
 private:
 	double m_Interval{0}; /**< The interval of the timer. */
+	double m_Slack{0}; /**< How much later than scheduled the timer may fire. */
 	double m_Next{0}; /**< When the next event should happen. */
+	SchedulerPolicy m_SchedulerPolicy{LowLatencyScheduler}; /**< The thread pool lane the timer is called in. */
 	bool m_Started{false}; /**< Whether the timer is enabled. */
 	bool m_Running{false}; /**< Whether the timer proc is currently running. */
 
+	Timer *m_WheelPrev{nullptr}; /**< The previous timer in the same timing wheel slot. */
+	Timer *m_WheelNext{nullptr}; /**< The next timer in the same timing wheel slot. */
+	Timer **m_WheelSlot{nullptr}; /**< The timing wheel slot this timer is linked into. */
+
 	void Call();
 	void InternalReschedule(bool completed, double next = -1);
 
+	static double ApplySlack(double next, double slack);
 	static void TimerThreadProc();
 
 	friend class TimerHolder;
+	friend class TimerWheel;
 };
 
 }
@@ -20,19 +20,58 @@ using namespace icinga;
 
 bool UnbufferedAsioTlsStream::IsVerifyOK() const
 {
+	auto ssl (const_cast<UnbufferedAsioTlsStream*>(this)->native_handle());
+
+	/* Resumed sessions skip the verify callback, but remember the result of the original verification. */
+	if (SSL_session_reused(ssl))
+		return SSL_get_verify_result(ssl) == X509_V_OK;
+
 	return m_VerifyOK;
 }
 
 String UnbufferedAsioTlsStream::GetVerifyError() const
 {
+	auto ssl (const_cast<UnbufferedAsioTlsStream*>(this)->native_handle());
+
+	if (SSL_session_reused(ssl)) {
+		long err = SSL_get_verify_result(ssl);
+
+		std::ostringstream msgbuf;
+		msgbuf << "code " << err << ": " << X509_verify_cert_error_string(err);
+		return msgbuf.str();
+	}
+
 	return m_VerifyError;
 }
 
+bool UnbufferedAsioTlsStream::IsSessionReused()
+{
+	return SSL_session_reused(native_handle());
+}
+
 std::shared_ptr<X509> UnbufferedAsioTlsStream::GetPeerCertificate()
 {
 	return std::shared_ptr<X509>(SSL_get_peer_certificate(native_handle()), X509_free);
 }
 
+/**
+ * @return The protocol negotiated via ALPN or an empty string if none was
+ */
+String UnbufferedAsioTlsStream::GetAlpnProtocol()
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+	const unsigned char *protocol = nullptr;
+	unsigned int length = 0;
+
+	SSL_get0_alpn_selected(native_handle(), &protocol, &length);
+
+	if (protocol)
+		return String((const char *)protocol, (const char *)protocol + length);
+#endif /* OPENSSL_VERSION_NUMBER >= 0x10002000L */
+
+	return String();
+}
+
 void UnbufferedAsioTlsStream::BeforeHandshake(handshake_type type)
 {
 	namespace ssl = boost::asio::ssl;
@@ -62,6 +101,11 @@ void UnbufferedAsioTlsStream::BeforeHandshake(handshake_type type)
 			serverName += ":" + environmentName;
 
 		SSL_set_tlsext_host_name(native_handle(), serverName.CStr());
+
+		auto session (GetTlsClientSession(serverName));
+
+		if (session)
+			SSL_set_session(native_handle(), session.get());
 	}
 #endif /* SSL_CTRL_SET_TLSEXT_HOSTNAME */
 }
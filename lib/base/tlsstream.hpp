@@ -4,6 +4,7 @@
 #define TLSSTREAM_H
 
 #include "base/i2-base.hpp"
+#include "base/configuration.hpp"
 #include "base/shared.hpp"
 #include "base/socket.hpp"
 #include "base/stream.hpp"
@@ -77,6 +78,8 @@ public:
 	bool IsVerifyOK() const;
 	String GetVerifyError() const;
 	std::shared_ptr<X509> GetPeerCertificate();
+	String GetAlpnProtocol();
+	bool IsSessionReused();
 
 	template<class... Args>
 	inline
@@ -116,9 +119,18 @@ public:
 private:
 	inline
 	AsioTlsStream(UnbufferedAsioTlsStreamParams init)
-		: buffered_stream(init)
+		: buffered_stream(init, GetBufferSize(), GetBufferSize())
 	{
 	}
+
+	static inline
+	size_t GetBufferSize()
+	{
+		if (Configuration::TlsBufferSize > 0)
+			return Configuration::TlsBufferSize;
+
+		return boost::asio::buffered_write_stream<UnbufferedAsioTlsStream>::default_buffer_size;
+	}
 };
 
 typedef boost::asio::buffered_stream<boost::asio::ip::tcp::socket> AsioTcpStream;
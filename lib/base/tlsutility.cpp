@@ -8,10 +8,12 @@
 #include "base/utility.hpp"
 #include "base/application.hpp"
 #include "base/exception.hpp"
+#include "base/hex.hpp"
 #include <boost/asio/ssl/context.hpp>
 #include <openssl/opensslv.h>
 #include <openssl/crypto.h>
 #include <fstream>
+#include <map>
 
 namespace icinga
 {
@@ -19,6 +21,8 @@ namespace icinga
 static bool l_SSLInitialized = false;
 static std::mutex *l_Mutexes;
 static std::mutex l_RandomMutex;
+static std::mutex l_ClientSessionsMutex;
+static std::map<String, std::shared_ptr<SSL_SESSION>> l_ClientSessions;
 
 String GetOpenSSLVersion()
 {
@@ -70,6 +74,68 @@ void InitializeOpenSSL()
 	l_SSLInitialized = true;
 }
 
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+/**
+ * Selects "http/1.1" if the client offers it via ALPN. Clients preferring h2
+ * thereby learn up front that they have to reuse HTTP/1.1 keep-alive
+ * connections instead of multiplexing, and we can tell HTTP clients apart
+ * from JSON-RPC ones without peeking at the first byte.
+ */
+static int SelectAlpnProtocol(SSL *, const unsigned char **out, unsigned char *outlen,
+	const unsigned char *in, unsigned int inlen, void *)
+{
+	static const unsigned char http11[] = { 8, 'h', 't', 't', 'p', '/', '1', '.', '1' };
+
+	unsigned char *selected = nullptr;
+
+	if (SSL_select_next_proto(&selected, outlen, http11, sizeof(http11), in, inlen) != OPENSSL_NPN_NEGOTIATED)
+		return SSL_TLSEXT_ERR_NOACK;
+
+	*out = selected;
+	return SSL_TLSEXT_ERR_OK;
+}
+#endif /* OPENSSL_VERSION_NUMBER >= 0x10002000L */
+
+/**
+ * Remembers the latest session of every server we've connected to, so the
+ * next connection to the same server name can resume it.
+ */
+static int CacheClientSession(SSL *ssl, SSL_SESSION *session)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+	if (SSL_is_server(ssl))
+		return 0;
+#endif /* OPENSSL_VERSION_NUMBER >= 0x10002000L */
+
+	const char *serverName = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+
+	if (!serverName)
+		return 0;
+
+	std::unique_lock<std::mutex> lock (l_ClientSessionsMutex);
+	l_ClientSessions[serverName] = std::shared_ptr<SSL_SESSION>(session, SSL_SESSION_free);
+
+	/* We've taken over the reference. */
+	return 1;
+}
+
+/**
+ * @param serverName The SNI server name the session was negotiated with
+ *
+ * @return The session to resume or nullptr
+ */
+std::shared_ptr<SSL_SESSION> GetTlsClientSession(const String& serverName)
+{
+	std::unique_lock<std::mutex> lock (l_ClientSessionsMutex);
+
+	auto it (l_ClientSessions.find(serverName));
+
+	if (it == l_ClientSessions.end())
+		return nullptr;
+
+	return it->second;
+}
+
 static void SetupSslContext(const Shared<boost::asio::ssl::context>::Ptr& context, const String& pubkey, const String& privkey, const String& cakey)
 {
 	char errbuf[256];
@@ -93,8 +159,15 @@ static void SetupSslContext(const Shared<boost::asio::ssl::context>::Ptr& contex
 
 	SSL_CTX_set_options(sslContext, flags);
 
-	SSL_CTX_set_mode(sslContext, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+	/* Idle connections, e.g. thousands of agents connected to a satellite, don't need their ~34 KB of TLS record buffers. */
+	SSL_CTX_set_mode(sslContext, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
 	SSL_CTX_set_session_id_context(sslContext, (const unsigned char *)"Icinga 2", 8);
+	SSL_CTX_set_session_cache_mode(sslContext, SSL_SESS_CACHE_BOTH);
+	SSL_CTX_sess_set_new_cb(sslContext, &CacheClientSession);
+
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+	SSL_CTX_set_alpn_select_cb(sslContext, &SelectAlpnProtocol, nullptr);
+#endif /* OPENSSL_VERSION_NUMBER >= 0x10002000L */
 
 	// Explicitly load ECC ciphers, required on el7 - https://github.com/Icinga/icinga2/issues/7247
 	// SSL_CTX_set_ecdh_auto is deprecated and removed in OpenSSL 1.1.x - https://github.com/openssl/openssl/issues/1437
@@ -247,6 +320,69 @@ void SetTlsProtocolminToSSLContext(const Shared<boost::asio::ssl::context>::Ptr&
 	*/
 }
 
+/**
+ * Sets the keys which protect the TLS session tickets issued by the specified
+ * SSL context. The keys are kept in a file, so clients can resume their
+ * sessions after a restart or a renewal of the context instead of doing full
+ * handshakes.
+ *
+ * New keys are generated if the file doesn't exist yet, is older than maxAge
+ * or is older than any of the files in invalidatedBy. The latter ensures that
+ * e.g. sessions of just revoked certificates can't be resumed.
+ *
+ * @param context The SSL context.
+ * @param keyPath The path to the key file.
+ * @param maxAge The maximum age of the keys in seconds.
+ * @param invalidatedBy Files whose modification invalidates the keys.
+ */
+void SetTlsSessionTicketKeysToSSLContext(const Shared<boost::asio::ssl::context>::Ptr& context, const String& keyPath,
+	double maxAge, const std::vector<String>& invalidatedBy)
+{
+	SSL_CTX *sslContext = context->native_handle();
+	long keyLength = SSL_CTX_get_tlsext_ticket_keys(sslContext, nullptr, 0);
+
+	if (keyLength <= 0)
+		BOOST_THROW_EXCEPTION(std::runtime_error("TLS session tickets are not supported."));
+
+	bool renew = !Utility::PathExists(keyPath) || Utility::GetFileCreationTime(keyPath) < Utility::GetTime() - maxAge;
+
+	for (const String& path : invalidatedBy) {
+		if (!renew && !path.IsEmpty() && Utility::PathExists(path) && Utility::GetFileCreationTime(path) > Utility::GetFileCreationTime(keyPath))
+			renew = true;
+	}
+
+	String hexKeys;
+
+	if (!renew) {
+		std::ifstream fp (keyPath.CStr());
+		std::getline(fp, hexKeys.GetData());
+	}
+
+	if (hexKeys.GetLength() != static_cast<size_t>(keyLength) * 2) {
+		hexKeys = RandomString(keyLength);
+
+		std::fstream fp;
+		String tempPath = Utility::CreateTempFile(keyPath + ".XXXXXX", 0600, fp);
+
+		fp.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+		fp << hexKeys << "\n";
+		fp.close();
+
+		Utility::RenameFile(tempPath, keyPath);
+	}
+
+	std::vector<unsigned char> keys (keyLength);
+
+	for (long i = 0; i < keyLength; i++)
+		keys[i] = std::stoi(std::string(hexKeys.Begin() + i * 2, hexKeys.Begin() + i * 2 + 2), nullptr, 16);
+
+	if (SSL_CTX_set_tlsext_ticket_keys(sslContext, keys.data(), keyLength) != 1) {
+		BOOST_THROW_EXCEPTION(openssl_error()
+			<< boost::errinfo_api_function("SSL_CTX_set_tlsext_ticket_keys")
+			<< errinfo_openssl_error(ERR_peek_error()));
+	}
+}
+
 /**
  * Loads a CRL and appends its certificates to the specified Boost SSL context.
  *
@@ -624,15 +760,58 @@ String GetIcingaCADir()
 	return Configuration::DataDir + "/ca";
 }
 
-std::shared_ptr<X509> CreateCertIcingaCA(EVP_PKEY *pubkey, X509_NAME *subject)
+/**
+ * The key and certificate of the Icinga CA, loaded once for all signing requests.
+ */
+struct IcingaCA
+{
+	std::shared_ptr<EVP_PKEY> Key;
+	std::shared_ptr<X509> Cert;
+	time_t KeyMTime;
+	time_t CertMTime;
+};
+
+static std::mutex l_IcingaCAMutex;
+static std::shared_ptr<IcingaCA> l_IcingaCA;
+
+static time_t GetMTime(const String& path)
+{
+#ifndef _WIN32
+	struct stat statbuf;
+	if (stat(path.CStr(), &statbuf) < 0)
+		return -1;
+#else /* _WIN32 */
+	struct _stat statbuf;
+	if (_stat(path.CStr(), &statbuf) < 0)
+		return -1;
+#endif /* _WIN32 */
+
+	return statbuf.st_mtime;
+}
+
+/**
+ * Returns the Icinga CA, re-reading it only if its files have been modified
+ * (e.g. by "icinga2 pki new-ca") since.
+ *
+ * @returns nullptr if the CA key can't be read
+ */
+static std::shared_ptr<IcingaCA> GetIcingaCA()
 {
 	char errbuf[256];
 
 	String cadir = GetIcingaCADir();
-
 	String cakeyfile = cadir + "/ca.key";
+	String cacertfile = cadir + "/ca.crt";
+
+	time_t keyMTime = GetMTime(cakeyfile);
+	time_t certMTime = GetMTime(cacertfile);
+
+	{
+		std::unique_lock<std::mutex> lock (l_IcingaCAMutex);
 
-	RSA *rsa;
+		if (l_IcingaCA && l_IcingaCA->KeyMTime == keyMTime && l_IcingaCA->CertMTime == certMTime)
+			return l_IcingaCA;
+	}
 
 	BIO *cakeybio = BIO_new_file(const_cast<char *>(cakeyfile.CStr()), "r");
 
@@ -640,28 +819,43 @@ std::shared_ptr<X509> CreateCertIcingaCA(EVP_PKEY *pubkey, X509_NAME *subject)
 		ERR_error_string_n(ERR_peek_error(), errbuf, sizeof errbuf);
 		Log(LogCritical, "SSL")
 			<< "Could not open CA key file '" << cakeyfile << "': " << ERR_peek_error() << ", \"" << errbuf << "\"";
-		return std::shared_ptr<X509>();
+		return nullptr;
 	}
 
-	rsa = PEM_read_bio_RSAPrivateKey(cakeybio, nullptr, nullptr, nullptr);
+	RSA *rsa = PEM_read_bio_RSAPrivateKey(cakeybio, nullptr, nullptr, nullptr);
+
+	BIO_free(cakeybio);
 
 	if (!rsa) {
 		ERR_error_string_n(ERR_peek_error(), errbuf, sizeof errbuf);
 		Log(LogCritical, "SSL")
 			<< "Could not read RSA key from CA key file '" << cakeyfile << "': " << ERR_peek_error() << ", \"" << errbuf << "\"";
-		return std::shared_ptr<X509>();
+		return nullptr;
 	}
 
-	BIO_free(cakeybio);
+	auto ca (std::make_shared<IcingaCA>());
 
-	String cacertfile = cadir + "/ca.crt";
+	ca->Key = std::shared_ptr<EVP_PKEY>(EVP_PKEY_new(), EVP_PKEY_free);
+	EVP_PKEY_assign_RSA(ca->Key.get(), rsa);
 
-	std::shared_ptr<X509> cacert = GetX509Certificate(cacertfile);
+	ca->Cert = GetX509Certificate(cacertfile);
+	ca->KeyMTime = keyMTime;
+	ca->CertMTime = certMTime;
 
-	EVP_PKEY *privkey = EVP_PKEY_new();
-	EVP_PKEY_assign_RSA(privkey, rsa);
+	std::unique_lock<std::mutex> lock (l_IcingaCAMutex);
+	l_IcingaCA = ca;
 
-	return CreateCert(pubkey, subject, X509_get_subject_name(cacert.get()), privkey, false);
+	return ca;
+}
+
+std::shared_ptr<X509> CreateCertIcingaCA(EVP_PKEY *pubkey, X509_NAME *subject)
+{
+	auto ca (GetIcingaCA());
+
+	if (!ca)
+		return std::shared_ptr<X509>();
+
+	return CreateCert(pubkey, subject, X509_get_subject_name(ca->Cert.get()), ca->Key.get(), false);
 }
 
 std::shared_ptr<X509> CreateCertIcingaCA(const std::shared_ptr<X509>& cert)
@@ -706,11 +900,7 @@ String PBKDF2_SHA1(const String& password, const String& salt, int iterations)
 	PKCS5_PBKDF2_HMAC_SHA1(password.CStr(), password.GetLength(), reinterpret_cast<const unsigned char *>(salt.CStr()), salt.GetLength(),
 		iterations, sizeof(digest), digest);
 
-	char output[SHA_DIGEST_LENGTH*2+1];
-	for (int i = 0; i < SHA_DIGEST_LENGTH; i++)
-		sprintf(output + 2 * i, "%02x", digest[i]);
-
-	return output;
+	return Hex::Encode(digest, sizeof(digest));
 }
 
 String PBKDF2_SHA256(const String& password, const String& salt, int iterations)
@@ -719,11 +909,7 @@ String PBKDF2_SHA256(const String& password, const String& salt, int iterations)
 	PKCS5_PBKDF2_HMAC(password.CStr(), password.GetLength(), reinterpret_cast<const unsigned char *>(salt.CStr()),
 		salt.GetLength(), iterations, EVP_sha256(), SHA256_DIGEST_LENGTH, digest);
 
-	char output[SHA256_DIGEST_LENGTH*2+1];
-	for (int i = 0; i < SHA256_DIGEST_LENGTH; i++)
-		sprintf(output + 2 * i, "%02x", digest[i]);
-
-	return output;
+	return Hex::Encode(digest, sizeof(digest));
 }
 
 String SHA1(const String& s, bool binary)
@@ -762,15 +948,7 @@ String SHA1(const String& s, bool binary)
 	if (binary)
 		return String(reinterpret_cast<const char*>(digest), reinterpret_cast<const char *>(digest + SHA_DIGEST_LENGTH));
 
-	static const char hexdigits[] = "0123456789abcdef";
-	char output[SHA_DIGEST_LENGTH*2+1];
-	for (int i = 0; i < SHA_DIGEST_LENGTH; i++) {
-		output[2*i] = hexdigits[digest[i] >> 4];
-		output[2*i + 1] = hexdigits[digest[i] & 0xf];
-	}
-	output[2*SHA_DIGEST_LENGTH] = 0;
-
-	return output;
+	return Hex::Encode(digest, sizeof(digest));
 }
 
 String SHA256(const String& s)
@@ -806,11 +984,7 @@ String SHA256(const String& s)
 			<< errinfo_openssl_error(ERR_peek_error()));
 	}
 
-	char output[SHA256_DIGEST_LENGTH*2+1];
-	for (int i = 0; i < 32; i++)
-		sprintf(output + 2 * i, "%02x", digest[i]);
-
-	return output;
+	return Hex::Encode(digest, sizeof(digest));
 }
 
 String RandomString(int length)
@@ -837,13 +1011,8 @@ String RandomString(int length)
 
 	lock.unlock();
 
-	auto *output = new char[length * 2 + 1];
-	for (int i = 0; i < length; i++)
-		sprintf(output + 2 * i, "%02x", bytes[i]);
-
-	String result = output;
+	String result = Hex::Encode(bytes, length);
 	delete [] bytes;
-	delete [] output;
 
 	return result;
 }
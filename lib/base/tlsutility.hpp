@@ -20,6 +20,8 @@
 #include <openssl/rand.h>
 #include <boost/asio/ssl/context.hpp>
 #include <boost/exception/info.hpp>
+#include <memory>
+#include <vector>
 
 namespace icinga
 {
@@ -33,6 +35,9 @@ void AddCRLToSSLContext(const Shared<boost::asio::ssl::context>::Ptr& context, c
 void AddCRLToSSLContext(X509_STORE *x509_store, const String& crlPath);
 void SetCipherListToSSLContext(const Shared<boost::asio::ssl::context>::Ptr& context, const String& cipherList);
 void SetTlsProtocolminToSSLContext(const Shared<boost::asio::ssl::context>::Ptr& context, const String& tlsProtocolmin);
+void SetTlsSessionTicketKeysToSSLContext(const Shared<boost::asio::ssl::context>::Ptr& context, const String& keyPath,
+	double maxAge, const std::vector<String>& invalidatedBy);
+std::shared_ptr<SSL_SESSION> GetTlsClientSession(const String& serverName);
 
 String GetCertificateCN(const std::shared_ptr<X509>& certificate);
 std::shared_ptr<X509> GetX509Certificate(const String& pemfile);
@@ -0,0 +1,212 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/tracing.hpp"
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <thread>
+
+using namespace icinga;
+
+static std::atomic<bool> l_Enabled (false);
+static std::atomic<double> l_SampleRate (0);
+static std::mutex l_ExporterMutex;
+static std::shared_ptr<Span::Exporter> l_Exporter;
+
+static thread_local Span *l_CurrentSpan = nullptr;
+
+static std::mt19937_64& GetRandomGenerator()
+{
+	static thread_local std::mt19937_64 generator (std::random_device{}()
+		^ std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+	return generator;
+}
+
+static uint64_t GenerateId()
+{
+	uint64_t id;
+
+	do {
+		id = GetRandomGenerator()();
+	} while (!id);
+
+	return id;
+}
+
+static uint64_t GetUnixTimeNanoseconds()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static bool ParseHex(const char *hex, size_t length, uint64_t& result)
+{
+	result = 0;
+
+	for (size_t i = 0; i < length; i++) {
+		char ch = hex[i];
+		unsigned int digit;
+
+		if (ch >= '0' && ch <= '9')
+			digit = ch - '0';
+		else if (ch >= 'a' && ch <= 'f')
+			digit = ch - 'a' + 10;
+		else
+			return false;
+
+		result = result << 4u | digit;
+	}
+
+	return true;
+}
+
+/**
+ * Formats the context as W3C traceparent header value.
+ */
+String TraceContext::ToString() const
+{
+	char buf[56];
+
+	snprintf(buf, sizeof(buf), "00-%016" PRIx64 "%016" PRIx64 "-%016" PRIx64 "-01", TraceIdHigh, TraceIdLow, SpanId);
+
+	return buf;
+}
+
+/**
+ * Parses a W3C traceparent header value.
+ *
+ * @param traceparent E.g. "00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01"
+ * @return The context, empty if it's malformed or not sampled
+ */
+TraceContext TraceContext::Parse(const String& traceparent)
+{
+	TraceContext context;
+
+	if (traceparent.GetLength() != 55)
+		return context;
+
+	const char *str = traceparent.CStr();
+	uint64_t flags;
+
+	if (str[2] != '-' || str[35] != '-' || str[52] != '-'
+		|| !ParseHex(str + 3, 16, context.TraceIdHigh) || !ParseHex(str + 19, 16, context.TraceIdLow)
+		|| !ParseHex(str + 36, 16, context.SpanId) || !ParseHex(str + 53, 2, flags) || !(flags & 1u)) {
+		return TraceContext();
+	}
+
+	return context;
+}
+
+/**
+ * Decides whether to trace a new operation, according to the sample rate.
+ *
+ * @return A new trace's context to start the root span in, empty if not sampled
+ */
+TraceContext TraceContext::StartTrace()
+{
+	TraceContext context;
+	double rate = l_SampleRate.load(std::memory_order_relaxed);
+
+	if (rate <= 0 || (rate < 1 && std::uniform_real_distribution<double>(0, 1)(GetRandomGenerator()) >= rate))
+		return context;
+
+	context.TraceIdHigh = GenerateId();
+	context.TraceIdLow = GenerateId();
+
+	return context;
+}
+
+Span::Span(const char *name)
+	: Span(name, GetCurrentContext())
+{ }
+
+Span::Span(const char *name, const TraceContext& parent)
+	: m_Previous(l_CurrentSpan)
+{
+	l_CurrentSpan = this;
+
+	/* Traces sampled by other nodes are only recorded if there's an exporter. */
+	if (!parent.IsSampled() || !l_Enabled.load(std::memory_order_relaxed))
+		return;
+
+	m_Data.reset(new SpanData{ name, parent, parent.SpanId, GetUnixTimeNanoseconds(), 0, nullptr });
+	m_Data->Context.SpanId = GenerateId();
+}
+
+Span::~Span()
+{
+	l_CurrentSpan = m_Previous;
+
+	if (!m_Data)
+		return;
+
+	m_Data->EndTime = GetUnixTimeNanoseconds();
+
+	std::shared_ptr<Exporter> exporter;
+
+	{
+		std::unique_lock<std::mutex> lock (l_ExporterMutex);
+		exporter = l_Exporter;
+	}
+
+	if (exporter) {
+		try {
+			(*exporter)(*m_Data);
+		} catch (...) {
+			/* Losing a span is better than terminating. */
+		}
+	}
+}
+
+TraceContext Span::GetContext() const
+{
+	return m_Data ? m_Data->Context : TraceContext();
+}
+
+void Span::SetAttribute(const String& key, const Value& value)
+{
+	if (!m_Data)
+		return;
+
+	if (!m_Data->Attributes)
+		m_Data->Attributes = new Dictionary();
+
+	m_Data->Attributes->Set(key, value);
+}
+
+/**
+ * Returns the context of the innermost span on the current thread.
+ */
+TraceContext Span::GetCurrentContext()
+{
+	return l_CurrentSpan ? l_CurrentSpan->GetContext() : TraceContext();
+}
+
+/**
+ * Sets the function all finished spans go to and enables tracing.
+ *
+ * @param exporter Receives finished spans on any thread, nullptr disables tracing
+ * @param sampleRate The share of new traces to record, between 0 and 1
+ */
+void Span::SetExporter(Exporter exporter, double sampleRate)
+{
+	std::unique_lock<std::mutex> lock (l_ExporterMutex);
+
+	if (exporter) {
+		l_Exporter = std::make_shared<Exporter>(std::move(exporter));
+		l_SampleRate.store(sampleRate);
+		l_Enabled.store(true);
+	} else {
+		l_Exporter = nullptr;
+		l_SampleRate.store(0);
+		l_Enabled.store(false);
+	}
+}
+
+double Span::GetSampleRate()
+{
+	return l_SampleRate.load();
+}
@@ -0,0 +1,103 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef TRACING_H
+#define TRACING_H
+
+#include "base/i2-base.hpp"
+#include "base/dictionary.hpp"
+#include "base/string.hpp"
+#include "base/value.hpp"
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace icinga
+{
+
+/**
+ * Identifies a span across threads and nodes.
+ *
+ * Only sampled traces are ever propagated, so an empty context means
+ * "don't record anything".
+ *
+ * @ingroup base
+ */
+struct TraceContext
+{
+	uint64_t TraceIdHigh{0};
+	uint64_t TraceIdLow{0};
+
+	/* Zero if a new root span is to be started in this trace. */
+	uint64_t SpanId{0};
+
+	bool IsSampled() const
+	{
+		return TraceIdHigh || TraceIdLow;
+	}
+
+	String ToString() const;
+
+	static TraceContext Parse(const String& traceparent);
+	static TraceContext StartTrace();
+};
+
+/**
+ * A finished span, as passed to the exporter.
+ *
+ * @ingroup base
+ */
+struct SpanData
+{
+	const char *Name;
+	TraceContext Context;
+	uint64_t ParentSpanId;
+	uint64_t StartTime;
+	uint64_t EndTime;
+	Dictionary::Ptr Attributes;
+};
+
+/**
+ * Records the duration of a scope as part of a trace.
+ *
+ * Spans nest per thread: a span constructed without an explicit parent is
+ * a child of the innermost span alive on the current thread. If the parent
+ * isn't sampled, the span doesn't record anything and costs next to nothing.
+ * Must not be held across a coroutine's yield.
+ *
+ * @ingroup base
+ */
+class Span final
+{
+public:
+	typedef std::function<void (const SpanData&)> Exporter;
+
+	explicit Span(const char *name);
+	Span(const char *name, const TraceContext& parent);
+
+	Span(const Span&) = delete;
+	Span& operator=(const Span&) = delete;
+
+	~Span();
+
+	bool IsRecording() const
+	{
+		return (bool)m_Data;
+	}
+
+	TraceContext GetContext() const;
+
+	void SetAttribute(const String& key, const Value& value);
+
+	static TraceContext GetCurrentContext();
+
+	static void SetExporter(Exporter exporter, double sampleRate);
+	static double GetSampleRate();
+
+private:
+	std::unique_ptr<SpanData> m_Data;
+	Span *m_Previous;
+};
+
+}
+
+#endif /* TRACING_H */
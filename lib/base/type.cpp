@@ -4,6 +4,9 @@
 #include "base/scriptglobal.hpp"
 #include "base/namespace.hpp"
 #include "base/objectlock.hpp"
+#include <algorithm>
+#include <cstring>
+#include <set>
 
 using namespace icinga;
 
@@ -146,11 +149,173 @@ int Type::GetActivationPriority() const
 	return 0;
 }
 
+/**
+ * Returns the size of an instance without the memory it allocates
+ * dynamically, or 0 if it's unknown.
+ */
+size_t Type::GetInstanceSize() const
+{
+	return 0;
+}
+
 void Type::RegisterAttributeHandler(int fieldId, const AttributeHandler& callback)
 {
 	throw std::runtime_error("Invalid field ID.");
 }
 
+/**
+ * Looks up a field by its name in the fields of this type and its base
+ * types, for the implementations of GetFieldId().
+ *
+ * @return The ID of the field, -1 if there's none
+ */
+int Type::LookupFieldId(const String& name) const
+{
+	return m_FieldIndex.Get(this, name);
+}
+
+int FieldIndex::Get(const Type *type, const String& name) const
+{
+	std::call_once(m_Built, [this, type]() { Build(type); });
+
+	/* See Build(). */
+	if (m_Displacements.empty()) {
+		for (auto& field : m_Slots) {
+			if (name == field.first)
+				return field.second;
+		}
+
+		return -1;
+	}
+
+	uint64_t hash = Hash(name.CStr(), name.GetLength());
+	uint32_t displacement = m_Displacements[(hash >> 32) % m_Displacements.size()];
+	auto& slot (m_Slots[GetSlot(hash, displacement, m_Slots.size())]);
+
+	if (slot.first && name == slot.first)
+		return slot.second;
+
+	return -1;
+}
+
+void FieldIndex::Build(const Type *type) const
+{
+	std::vector<std::pair<const char *, int> > fields;
+	std::set<String> names;
+
+	/* A field of a derived type hides a field of its base types with the same name. */
+	for (int id = type->GetFieldCount() - 1; id >= 0; id--) {
+		Field field = type->GetFieldInfo(id);
+
+		if (names.insert(field.Name).second)
+			fields.emplace_back(field.Name, id);
+	}
+
+	if (fields.empty())
+		return;
+
+	size_t slots = 1;
+
+	while (slots < fields.size())
+		slots <<= 1;
+
+	/* More free slots make finding displacements easier. */
+	for (; slots <= fields.size() * 64; slots <<= 1) {
+		/* About two names per bucket, the buckets with the most names are placed first. */
+		std::vector<std::vector<std::pair<uint64_t, size_t> > > buckets (fields.size() / 2 + 1);
+
+		for (size_t i = 0; i < fields.size(); i++) {
+			uint64_t hash = Hash(fields[i].first, strlen(fields[i].first));
+			buckets[(hash >> 32) % buckets.size()].emplace_back(hash, i);
+		}
+
+		std::vector<size_t> order;
+
+		for (size_t i = 0; i < buckets.size(); i++)
+			order.push_back(i);
+
+		std::stable_sort(order.begin(), order.end(), [&buckets](size_t a, size_t b) {
+			return buckets[a].size() > buckets[b].size();
+		});
+
+		m_Displacements.assign(buckets.size(), 0);
+		m_Slots.assign(slots, std::pair<const char *, int>(nullptr, -1));
+
+		bool placed = true;
+
+		for (size_t bucket : order) {
+			if (buckets[bucket].empty())
+				break;
+
+			/* Finds a displacement which puts all names of the bucket into free slots. */
+			uint32_t displacement = 0;
+			std::vector<size_t> taken;
+
+			for (; displacement < 1u << 16; displacement++) {
+				taken.clear();
+
+				for (auto& entry : buckets[bucket]) {
+					size_t slot = GetSlot(entry.first, displacement, slots);
+
+					if (m_Slots[slot].first || std::find(taken.begin(), taken.end(), slot) != taken.end())
+						break;
+
+					taken.push_back(slot);
+				}
+
+				if (taken.size() == buckets[bucket].size())
+					break;
+			}
+
+			if (taken.size() != buckets[bucket].size()) {
+				placed = false;
+				break;
+			}
+
+			m_Displacements[bucket] = displacement;
+
+			for (size_t i = 0; i < taken.size(); i++)
+				m_Slots[taken[i]] = fields[buckets[bucket][i].second];
+		}
+
+		if (placed)
+			return;
+	}
+
+	/* Only if two names have the same hash, they're compared one by one then. */
+	m_Displacements.clear();
+	m_Slots = std::move(fields);
+}
+
+/**
+ * FNV-1a, the upper half selects the bucket, the lower one the slot.
+ */
+uint64_t FieldIndex::Hash(const char *name, size_t length)
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	for (size_t i = 0; i < length; i++) {
+		hash ^= static_cast<unsigned char>(name[i]);
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+size_t FieldIndex::GetSlot(uint64_t hash, uint32_t displacement, size_t slots)
+{
+	uint32_t value = static_cast<uint32_t>(hash) ^ (displacement * 0x9e3779b9u);
+
+	/* The finalizer of MurmurHash3, so that each displacement scatters the names anew. */
+	value ^= value >> 16;
+	value *= 0x85ebca6bu;
+	value ^= value >> 13;
+	value *= 0xc2b2ae35u;
+	value ^= value >> 16;
+
+	return value & (slots - 1);
+}
+
 String TypeType::GetName() const
 {
 	return "Type";
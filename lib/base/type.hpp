@@ -7,6 +7,9 @@
 #include "base/string.hpp"
 #include "base/object.hpp"
 #include "base/initialize.hpp"
+#include <cstdint>
+#include <mutex>
+#include <utility>
 #include <vector>
 
 namespace icinga
@@ -18,6 +21,7 @@ enum FieldAttribute
 	FAEphemeral = 1,
 	FAConfig = 2,
 	FAState = 4,
+	FANoStorage = 64,
 	FARequired = 256,
 	FANavigation = 512,
 	FANoUserModify = 1024,
@@ -47,6 +51,30 @@ enum TypeAttribute
 	TAAbstract = 1
 };
 
+/**
+ * Maps the names of a type's fields, including the inherited ones, to their
+ * IDs. It's a minimal perfect hash built on first use ("hash and
+ * displace"), so a lookup hashes the name once, probes one slot and
+ * compares one name.
+ *
+ * @ingroup base
+ */
+class FieldIndex
+{
+public:
+	int Get(const Type *type, const String& name) const;
+
+private:
+	mutable std::once_flag m_Built;
+	mutable std::vector<uint32_t> m_Displacements;
+	mutable std::vector<std::pair<const char *, int> > m_Slots;
+
+	void Build(const Type *type) const;
+
+	static uint64_t Hash(const char *name, size_t length);
+	static size_t GetSlot(uint64_t hash, uint32_t displacement, size_t slots);
+};
+
 class ValidationUtils
 {
 public:
@@ -87,6 +115,7 @@ public:
 
 	virtual std::vector<String> GetLoadDependencies() const;
 	virtual int GetActivationPriority() const;
+	virtual size_t GetInstanceSize() const;
 
 	typedef std::function<void (const Object::Ptr&, const Value&)> AttributeHandler;
 	virtual void RegisterAttributeHandler(int fieldId, const AttributeHandler& callback);
@@ -94,8 +123,11 @@ public:
 protected:
 	virtual ObjectFactory GetFactory() const = 0;
 
+	int LookupFieldId(const String& name) const;
+
 private:
 	Object::Ptr m_Prototype;
+	FieldIndex m_FieldIndex;
 };
 
 class TypeType final : public Type
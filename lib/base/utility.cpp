@@ -3,6 +3,7 @@
 #include "base/utility.hpp"
 #include "base/convert.hpp"
 #include "base/application.hpp"
+#include "base/configuration.hpp"
 #include "base/logger.hpp"
 #include "base/exception.hpp"
 #include "base/socket.hpp"
@@ -10,7 +11,9 @@
 #include "base/json.hpp"
 #include "base/objectlock.hpp"
 #include <algorithm>
+#include <condition_variable>
 #include <cstdint>
+#include <exception>
 #include <mmatch.h>
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
@@ -25,9 +28,11 @@
 #include <fstream>
 #include <iostream>
 #include <iterator>
+#include <mutex>
 #include <stdlib.h>
 #include <future>
 #include <set>
+#include <thread>
 #include <utf8.h>
 #include <vector>
 
@@ -139,6 +144,20 @@ String Utility::GetSymbolName(const void *addr)
 	return "(unknown function)";
 }
 
+/**
+ * Compares a part of a text with a part of a pattern which doesn't contain
+ * any wildcards, case-insensitively like match().
+ */
+static bool MatchLiteral(const std::string& text, size_t offset, const std::string& pattern, size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; i++) {
+		if (tolower(text[offset + i - begin]) != tolower(pattern[i]))
+			return false;
+	}
+
+	return true;
+}
+
 /**
  * Performs wildcard pattern matching.
  *
@@ -148,6 +167,34 @@ String Utility::GetSymbolName(const void *addr)
  */
 bool Utility::Match(const String& pattern, const String& text)
 {
+	const std::string& mask = pattern.GetData();
+	const std::string& str = text.GetData();
+
+	/* Most patterns are a literal with a '*' at one end or both, which doesn't need match()'s backtracking. */
+	if (mask.find_first_of("?\\") == std::string::npos) {
+		size_t length = mask.size();
+		size_t first = mask.find('*');
+
+		if (first == std::string::npos)
+			return str.size() == length && MatchLiteral(str, 0, mask, 0, length);
+
+		size_t last = mask.rfind('*');
+
+		if (first == length - 1u)
+			return str.size() >= length - 1u && MatchLiteral(str, 0, mask, 0, length - 1u);
+
+		if (first == 0 && last == 0)
+			return str.size() >= length - 1u && MatchLiteral(str, str.size() - (length - 1u), mask, 1, length);
+
+		if (first == 0 && last == length - 1u && mask.find('*', 1) == last) {
+			auto it (std::search(str.begin(), str.end(), mask.begin() + 1, mask.end() - 1, [](char a, char b) {
+				return tolower(a) == tolower(b);
+			}));
+
+			return it != str.end() || length == 2u;
+		}
+	}
+
 	return (match(pattern.CStr(), text.CStr()) == 0);
 }
 
@@ -539,19 +586,37 @@ bool Utility::Glob(const String& pathSpec, const std::function<void (const Strin
 	return true;
 }
 
+namespace
+{
+
 /**
- * Calls the specified callback for each file in the specified directory
- * or any of its child directories if the file name matches the specified
- * pattern.
+ * A directory visited by Utility::GlobRecursive().
+ */
+struct GlobNode
+{
+	String Path;
+	std::vector<String> Files;
+	std::vector<String> Dirs;
+	std::vector<std::unique_ptr<GlobNode> > Children;
+};
+
+}
+
+/* Directories are read by up to this many threads at the same time. */
+static const int l_GlobRecursiveMaxThreads = 16;
+
+/**
+ * Reads a directory for GlobRecursive(), i.e. the sorted matching files and
+ * directories and the sorted subdirectories to visit next.
  *
- * @param path The path.
- * @param pattern The pattern.
- * @param callback The callback which is invoked for each matching file.
- * @param type The file type (a combination of GlobFile and GlobDirectory)
+ * @return false if the directory doesn't exist (Windows only)
  */
-bool Utility::GlobRecursive(const String& path, const String& pattern, const std::function<void (const String&)>& callback, int type)
+static bool ReadGlobDirectory(GlobNode& directory, const String& pattern, int type)
 {
-	std::vector<String> files, dirs, alldirs;
+	const String& path = directory.Path;
+	std::vector<String>& files = directory.Files;
+	std::vector<String>& dirs = directory.Dirs;
+	std::vector<String> alldirs;
 
 #ifdef _WIN32
 	HANDLE handle;
@@ -629,22 +694,33 @@ bool Utility::GlobRecursive(const String& path, const String& pattern, const std
 			continue;
 
 		String cpath = path + "/" + pent->d_name;
+		bool isDir;
 
-		struct stat statbuf;
+#ifdef DT_DIR
+		/* Most file systems tell the type right away, only symlinks and the like have to be followed. */
+		if (pent->d_type == DT_DIR || pent->d_type == DT_REG) {
+			isDir = pent->d_type == DT_DIR;
+		} else
+#endif /* DT_DIR */
+		{
+			struct stat statbuf;
 
-		if (stat(cpath.CStr(), &statbuf) < 0)
-			continue;
+			if (fstatat(dirfd(dirp), pent->d_name, &statbuf, 0) < 0)
+				continue;
+
+			isDir = S_ISDIR(statbuf.st_mode);
+		}
 
-		if (S_ISDIR(statbuf.st_mode))
+		if (isDir)
 			alldirs.push_back(cpath);
 
 		if (!Utility::Match(pattern, pent->d_name))
 			continue;
 
-		if (S_ISDIR(statbuf.st_mode) && (type & GlobDirectory))
+		if (isDir && (type & GlobDirectory))
 			dirs.push_back(cpath);
 
-		if (!S_ISDIR(statbuf.st_mode) && (type & GlobFile))
+		if (!isDir && (type & GlobFile))
 			files.push_back(cpath);
 	}
 
@@ -653,20 +729,127 @@ bool Utility::GlobRecursive(const String& path, const String& pattern, const std
 #endif /* _WIN32 */
 
 	std::sort(files.begin(), files.end());
-	for (const String& cpath : files) {
-		callback(cpath);
+	std::sort(dirs.begin(), dirs.end());
+	std::sort(alldirs.begin(), alldirs.end());
+
+	for (String& cpath : alldirs) {
+		std::unique_ptr<GlobNode> child (new GlobNode());
+		child->Path = std::move(cpath);
+		directory.Children.emplace_back(std::move(child));
 	}
 
-	std::sort(dirs.begin(), dirs.end());
-	for (const String& cpath : dirs) {
+	return true;
+}
+
+/**
+ * Reads the directories and all of their subdirectories in parallel.
+ */
+static void ReadGlobDirectories(std::vector<GlobNode *> pending, const String& pattern, int type)
+{
+	std::mutex mutex;
+	std::condition_variable cv;
+	size_t busy = 0;
+	std::exception_ptr error;
+
+	auto worker ([&]() {
+		for (;;) {
+			GlobNode *directory;
+
+			{
+				std::unique_lock<std::mutex> lock (mutex);
+
+				cv.wait(lock, [&]() { return !pending.empty() || busy == 0 || error; });
+
+				if (pending.empty() || error)
+					return;
+
+				directory = pending.back();
+				pending.pop_back();
+				busy++;
+			}
+
+			try {
+				ReadGlobDirectory(*directory, pattern, type);
+			} catch (...) {
+				std::unique_lock<std::mutex> lock (mutex);
+
+				if (!error)
+					error = std::current_exception();
+			}
+
+			{
+				std::unique_lock<std::mutex> lock (mutex);
+
+				busy--;
+
+				for (auto& child : directory->Children)
+					pending.push_back(child.get());
+			}
+
+			cv.notify_all();
+		}
+	});
+
+	std::vector<std::thread> threads;
+	int count = std::max(1, std::min(Configuration::Concurrency, l_GlobRecursiveMaxThreads));
+
+	for (int i = 0; i < count; i++)
+		threads.emplace_back(worker);
+
+	for (auto& thread : threads)
+		thread.join();
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+static void CallGlobCallback(const GlobNode& directory, const std::function<void (const String&)>& callback)
+{
+	for (const String& cpath : directory.Files)
 		callback(cpath);
-	}
 
-	std::sort(alldirs.begin(), alldirs.end());
-	for (const String& cpath : alldirs) {
-		GlobRecursive(cpath, pattern, callback, type);
+	for (const String& cpath : directory.Dirs)
+		callback(cpath);
+
+	for (auto& child : directory.Children)
+		CallGlobCallback(*child, callback);
+}
+
+/**
+ * Calls the specified callback for each file in the specified directory
+ * or any of its child directories if the file name matches the specified
+ * pattern.
+ *
+ * The directories are read in parallel, the callback is called afterwards from
+ * the calling thread. For each directory it gets the matching files, then the
+ * matching directories, both sorted, then the same for each subdirectory in
+ * sorted order.
+ *
+ * @param path The path.
+ * @param pattern The pattern.
+ * @param callback The callback which is invoked for each matching file.
+ * @param type The file type (a combination of GlobFile and GlobDirectory)
+ */
+bool Utility::GlobRecursive(const String& path, const String& pattern, const std::function<void (const String&)>& callback, int type)
+{
+	GlobNode root;
+	root.Path = path;
+
+	/* Most trees consist of a single directory, which isn't worth any threads. */
+	if (!ReadGlobDirectory(root, pattern, type))
+		return false;
+
+	if (!root.Children.empty()) {
+		std::vector<GlobNode *> pending;
+
+		for (auto& child : root.Children)
+			pending.push_back(child.get());
+
+		ReadGlobDirectories(std::move(pending), pattern, type);
 	}
 
+	CallGlobCallback(root, callback);
+
 	return true;
 }
 
@@ -13,21 +13,20 @@ using namespace icinga;
 
 Value::operator double() const
 {
-	const double *value = boost::get<double>(&m_Value);
+	if (m_Type == ValueNumber)
+		return m_Number;
 
-	if (value)
-		return *value;
-
-	const bool *fvalue = boost::get<bool>(&m_Value);
-
-	if (fvalue)
-		return *fvalue;
+	if (m_Type == ValueBoolean)
+		return m_Boolean;
 
 	if (IsEmpty())
 		return 0;
 
 	try {
-		return boost::lexical_cast<double>(m_Value);
+		if (m_Type != ValueString)
+			BOOST_THROW_EXCEPTION(std::bad_cast());
+
+		return boost::lexical_cast<double>(m_String->Str.GetData());
 	} catch (const std::exception&) {
 		std::ostringstream msgbuf;
 		msgbuf << "Can't convert '" << *this << "' to a floating point number.";
@@ -43,16 +42,16 @@ Value::operator String() const
 		case ValueEmpty:
 			return String();
 		case ValueNumber:
-			return Convert::ToString(boost::get<double>(m_Value));
+			return Convert::ToString(m_Number);
 		case ValueBoolean:
-			if (boost::get<bool>(m_Value))
+			if (m_Boolean)
 				return "true";
 			else
 				return "false";
 		case ValueString:
-			return boost::get<String>(m_Value);
+			return m_String->Str;
 		case ValueObject:
-			object = boost::get<Object::Ptr>(m_Value).get();
+			object = m_Object.get();
 			return object->ToString();
 		default:
 			BOOST_THROW_EXCEPTION(std::runtime_error("Unknown value type."));
@@ -207,6 +206,12 @@ Value icinga::operator+(const String& lhs, const Value& rhs)
 
 Value icinga::operator+(const Value& lhs, const Value& rhs)
 {
+	if (lhs.IsNumber() && rhs.IsNumber())
+		return lhs.Get<double>() + rhs.Get<double>();
+
+	if (lhs.IsString() && rhs.IsString())
+		return lhs.Get<String>() + rhs.Get<String>();
+
 	if ((lhs.IsEmpty() || lhs.IsNumber()) && !lhs.IsString() && (rhs.IsEmpty() || rhs.IsNumber()) && !rhs.IsString() && !(lhs.IsEmpty() && rhs.IsEmpty()))
 		return static_cast<double>(lhs) + static_cast<double>(rhs);
 	if ((lhs.IsString() || lhs.IsEmpty() || lhs.IsNumber()) && (rhs.IsString() || rhs.IsEmpty() || rhs.IsNumber()) && (!(lhs.IsEmpty() && rhs.IsEmpty()) || lhs.IsString() || rhs.IsString()))
@@ -256,6 +261,9 @@ Value icinga::operator+(int lhs, const Value& rhs)
 
 Value icinga::operator-(const Value& lhs, const Value& rhs)
 {
+	if (lhs.IsNumber() && rhs.IsNumber())
+		return lhs.Get<double>() - rhs.Get<double>();
+
 	if ((lhs.IsNumber() || lhs.IsEmpty()) && !lhs.IsString() && (rhs.IsNumber() || rhs.IsEmpty()) && !rhs.IsString() && !(lhs.IsEmpty() && rhs.IsEmpty()))
 		return static_cast<double>(lhs) - static_cast<double>(rhs);
 	else if (lhs.IsObjectType<DateTime>() && rhs.IsNumber())
@@ -316,6 +324,9 @@ Value icinga::operator-(int lhs, const Value& rhs)
 
 Value icinga::operator*(const Value& lhs, const Value& rhs)
 {
+	if (lhs.IsNumber() && rhs.IsNumber())
+		return lhs.Get<double>() * rhs.Get<double>();
+
 	if ((lhs.IsNumber() || lhs.IsEmpty()) && (rhs.IsNumber() || rhs.IsEmpty()) && !(lhs.IsEmpty() && rhs.IsEmpty()))
 		return static_cast<double>(lhs) * static_cast<double>(rhs);
 	else
@@ -550,8 +561,10 @@ Value icinga::operator>>(int lhs, const Value& rhs)
 
 bool icinga::operator<(const Value& lhs, const Value& rhs)
 {
-	if (lhs.IsString() && rhs.IsString())
-		return static_cast<String>(lhs) < static_cast<String>(rhs);
+	if (lhs.IsNumber() && rhs.IsNumber())
+		return lhs.Get<double>() < rhs.Get<double>();
+	else if (lhs.IsString() && rhs.IsString())
+		return lhs.Get<String>() < rhs.Get<String>();
 	else if ((lhs.IsNumber() || lhs.IsEmpty()) && (rhs.IsNumber() || rhs.IsEmpty()) && !(lhs.IsEmpty() && rhs.IsEmpty()))
 		return static_cast<double>(lhs) < static_cast<double>(rhs);
 	else if ((lhs.IsObjectType<DateTime>() || lhs.IsEmpty()) && (rhs.IsObjectType<DateTime>() || rhs.IsEmpty()) && !(lhs.IsEmpty() && rhs.IsEmpty()) && !(lhs.IsEmpty() && rhs.IsEmpty()))
@@ -603,8 +616,10 @@ bool icinga::operator<(int lhs, const Value& rhs)
 
 bool icinga::operator>(const Value& lhs, const Value& rhs)
 {
-	if (lhs.IsString() && rhs.IsString())
-		return static_cast<String>(lhs) > static_cast<String>(rhs);
+	if (lhs.IsNumber() && rhs.IsNumber())
+		return lhs.Get<double>() > rhs.Get<double>();
+	else if (lhs.IsString() && rhs.IsString())
+		return lhs.Get<String>() > rhs.Get<String>();
 	else if ((lhs.IsNumber() || lhs.IsEmpty()) && (rhs.IsNumber() || rhs.IsEmpty()) && !(lhs.IsEmpty() && rhs.IsEmpty()))
 		return static_cast<double>(lhs) > static_cast<double>(rhs);
 	else if ((lhs.IsObjectType<DateTime>() || lhs.IsEmpty()) && (rhs.IsObjectType<DateTime>() || rhs.IsEmpty()) && !(lhs.IsEmpty() && rhs.IsEmpty()) && !(lhs.IsEmpty() && rhs.IsEmpty()))
@@ -656,8 +671,10 @@ bool icinga::operator>(int lhs, const Value& rhs)
 
 bool icinga::operator<=(const Value& lhs, const Value& rhs)
 {
-	if (lhs.IsString() && rhs.IsString())
-		return static_cast<String>(lhs) <= static_cast<String>(rhs);
+	if (lhs.IsNumber() && rhs.IsNumber())
+		return lhs.Get<double>() <= rhs.Get<double>();
+	else if (lhs.IsString() && rhs.IsString())
+		return lhs.Get<String>() <= rhs.Get<String>();
 	else if ((lhs.IsNumber() || lhs.IsEmpty()) && (rhs.IsNumber() || rhs.IsEmpty()) && !(lhs.IsEmpty() && rhs.IsEmpty()))
 		return static_cast<double>(lhs) <= static_cast<double>(rhs);
 	else if ((lhs.IsObjectType<DateTime>() || lhs.IsEmpty()) && (rhs.IsObjectType<DateTime>() || rhs.IsEmpty()) && !(lhs.IsEmpty() && rhs.IsEmpty()) && !(lhs.IsEmpty() && rhs.IsEmpty()))
@@ -688,8 +705,10 @@ bool icinga::operator<=(int lhs, const Value& rhs)
 
 bool icinga::operator>=(const Value& lhs, const Value& rhs)
 {
-	if (lhs.IsString() && rhs.IsString())
-		return static_cast<String>(lhs) >= static_cast<String>(rhs);
+	if (lhs.IsNumber() && rhs.IsNumber())
+		return lhs.Get<double>() >= rhs.Get<double>();
+	else if (lhs.IsString() && rhs.IsString())
+		return lhs.Get<String>() >= rhs.Get<String>();
 	else if ((lhs.IsNumber() || lhs.IsEmpty()) && (rhs.IsNumber() || rhs.IsEmpty()) && !(lhs.IsEmpty() && rhs.IsEmpty()))
 		return static_cast<double>(lhs) >= static_cast<double>(rhs);
 	else if ((lhs.IsObjectType<DateTime>() || lhs.IsEmpty()) && (rhs.IsObjectType<DateTime>() || rhs.IsEmpty()) && !(lhs.IsEmpty() && rhs.IsEmpty()) && !(lhs.IsEmpty() && rhs.IsEmpty()))
@@ -4,10 +4,13 @@
 #define VALUE_H
 
 #include "base/object.hpp"
+#include "base/objectpool.hpp"
 #include "base/string.hpp"
-#include <boost/variant/variant.hpp>
-#include <boost/variant/get.hpp>
 #include <boost/throw_exception.hpp>
+#include <boost/variant/get.hpp>
+#include <atomic>
+#include <cstdint>
+#include <new>
 
 namespace icinga
 {
@@ -31,12 +34,24 @@ enum ValueType
 /**
  * A type that can hold an arbitrary value.
  *
+ * Numbers, booleans and object pointers are stored inline. Strings are
+ * stored out of line and shared between copies of a value, they're never
+ * modified once stored. So a value is just 16 bytes and copying it doesn't
+ * copy any string.
+ *
  * @ingroup base
  */
 class Value
 {
 public:
-	Value() = default;
+	Value() : m_Type(ValueEmpty)
+	{ }
+
+	~Value()
+	{
+		Destroy();
+	}
+
 	Value(std::nullptr_t);
 	Value(int value);
 	Value(unsigned int value);
@@ -49,8 +64,17 @@ public:
 	Value(const String& value);
 	Value(String&& value);
 	Value(const char *value);
-	Value(const Value& other);
-	Value(Value&& other);
+
+	Value(const Value& other)
+	{
+		CopyFrom(other);
+	}
+
+	Value(Value&& other) noexcept
+	{
+		MoveFrom(other);
+	}
+
 	Value(Object *value);
 	Value(const intrusive_ptr<Object>& value);
 
@@ -66,8 +90,30 @@ public:
 	operator double() const;
 	operator String() const;
 
-	Value& operator=(const Value& other);
-	Value& operator=(Value&& other);
+	Value& operator=(const Value& other)
+	{
+		if (this != &other) {
+			/* other might be owned by what we hold right now. */
+			Value copy (other);
+
+			Destroy();
+			MoveFrom(copy);
+		}
+
+		return *this;
+	}
+
+	Value& operator=(Value&& other) noexcept
+	{
+		if (this != &other) {
+			Value moved (std::move(other));
+
+			Destroy();
+			MoveFrom(moved);
+		}
+
+		return *this;
+	}
 
 	bool operator==(bool rhs) const;
 	bool operator!=(bool rhs) const;
@@ -124,7 +170,10 @@ public:
 		return dynamic_cast<T *>(Get<Object::Ptr>().get());
 	}
 
-	ValueType GetType() const;
+	ValueType GetType() const
+	{
+		return static_cast<ValueType>(m_Type);
+	}
 
 	void Swap(Value& other);
 
@@ -134,20 +183,138 @@ public:
 
 	Value Clone() const;
 
+	/**
+	 * Returns the value as a double, bool, String or Object::Ptr.
+	 * Throws boost::bad_get if it's of another type.
+	 */
 	template<typename T>
-	const T& Get() const
+	const T& Get() const;
+
+private:
+	struct StringHolder
 	{
-		return boost::get<T>(m_Value);
+		std::atomic<uint_fast32_t> References;
+		String Str;
+
+		IMPL_OBJECT_POOL(StringHolder);
+
+		template<class S>
+		explicit StringHolder(S&& str) : References(1), Str(std::forward<S>(str))
+		{ }
+	};
+
+	typedef Object::Ptr ObjectPtr;
+
+	union {
+		double m_Number;
+		bool m_Boolean;
+		StringHolder *m_String;
+		ObjectPtr m_Object;
+	};
+
+	uint8_t m_Type;
+
+	template<class S>
+	void InitString(S&& str)
+	{
+		m_String = new StringHolder(std::forward<S>(str));
+		m_Type = ValueString;
 	}
 
-private:
-	boost::variant<boost::blank, double, bool, String, Object::Ptr> m_Value;
+	void CopyFrom(const Value& other) noexcept
+	{
+		m_Type = other.m_Type;
+
+		switch (m_Type) {
+			case ValueNumber:
+				m_Number = other.m_Number;
+				break;
+			case ValueBoolean:
+				m_Boolean = other.m_Boolean;
+				break;
+			case ValueString:
+				m_String = other.m_String;
+				m_String->References.fetch_add(1, std::memory_order_relaxed);
+				break;
+			case ValueObject:
+				new (&m_Object) ObjectPtr(other.m_Object);
+				break;
+		}
+	}
+
+	/* Leaves other empty. */
+	void MoveFrom(Value& other) noexcept
+	{
+		m_Type = other.m_Type;
+
+		switch (m_Type) {
+			case ValueNumber:
+				m_Number = other.m_Number;
+				break;
+			case ValueBoolean:
+				m_Boolean = other.m_Boolean;
+				break;
+			case ValueString:
+				m_String = other.m_String;
+				break;
+			case ValueObject:
+				new (&m_Object) ObjectPtr(std::move(other.m_Object));
+				other.m_Object.~ObjectPtr();
+				break;
+		}
+
+		other.m_Type = ValueEmpty;
+	}
+
+	void Destroy() noexcept
+	{
+		switch (m_Type) {
+			case ValueString:
+				if (m_String->References.fetch_sub(1, std::memory_order_acq_rel) == 1u)
+					delete m_String;
+				break;
+			case ValueObject:
+				m_Object.~ObjectPtr();
+				break;
+		}
+	}
 };
 
-extern template const double& Value::Get<double>() const;
-extern template const bool& Value::Get<bool>() const;
-extern template const String& Value::Get<String>() const;
-extern template const Object::Ptr& Value::Get<Object::Ptr>() const;
+template<>
+inline const double& Value::Get<double>() const
+{
+	if (m_Type != ValueNumber)
+		BOOST_THROW_EXCEPTION(boost::bad_get());
+
+	return m_Number;
+}
+
+template<>
+inline const bool& Value::Get<bool>() const
+{
+	if (m_Type != ValueBoolean)
+		BOOST_THROW_EXCEPTION(boost::bad_get());
+
+	return m_Boolean;
+}
+
+template<>
+inline const String& Value::Get<String>() const
+{
+	if (m_Type != ValueString)
+		BOOST_THROW_EXCEPTION(boost::bad_get());
+
+	return m_String->Str;
+}
+
+template<>
+inline const Object::Ptr& Value::Get<Object::Ptr>() const
+{
+	if (m_Type != ValueObject)
+		BOOST_THROW_EXCEPTION(boost::bad_get());
+
+	return m_Object;
+}
 
 extern Value Empty;
 
@@ -246,6 +413,4 @@ std::istream& operator>>(std::istream& stream, Value& value);
 
 }
 
-extern template class boost::variant<boost::blank, double, bool, icinga::String, icinga::Object::Ptr>;
-
 #endif /* VALUE_H */
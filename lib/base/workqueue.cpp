@@ -2,17 +2,49 @@
 
 #include "base/workqueue.hpp"
 #include "base/utility.hpp"
+#include "base/allocator.hpp"
 #include "base/logger.hpp"
 #include "base/convert.hpp"
 #include "base/application.hpp"
 #include "base/exception.hpp"
+#include "base/initialize.hpp"
+#include "base/memoryusage.hpp"
+#include "base/profiler.hpp"
+#include "base/statsfunction.hpp"
 #include <boost/thread/tss.hpp>
 #include <math.h>
+#include <set>
 
 using namespace icinga;
 
 std::atomic<int> WorkQueue::m_NextID(1);
 boost::thread_specific_ptr<WorkQueue *> l_ThreadWorkQueue;
+static thread_local size_t l_ThreadWorkerIndex;
+
+static std::mutex l_WorkQueuesMutex;
+static std::set<WorkQueue *> l_WorkQueues;
+
+REGISTER_STATSFUNCTION(WorkQueue, &WorkQueue::StatsFunc);
+
+INITIALIZE_ONCE([]() {
+	MemoryUsage::Register("work_queues", []() -> Value {
+		Dictionary::Ptr queues = new Dictionary();
+		std::unique_lock<std::mutex> lock (l_WorkQueuesMutex);
+
+		for (WorkQueue *queue : l_WorkQueues)
+			queues->Set(queue->GetName(), queue->GetLength());
+
+		return queues;
+	});
+});
+
+/**
+ * Maps a task priority to its lane in the work stealing queues.
+ */
+static inline int GetTaskLane(WorkQueuePriority priority)
+{
+	return priority == PriorityImmediate ? 3 : priority;
+}
 
 WorkQueue::WorkQueue(size_t maxItems, int threadCount, LogSeverity statsLogLevel)
 	: m_ID(m_NextID++), m_ThreadCount(threadCount), m_MaxItems(maxItems),
@@ -25,10 +57,18 @@ WorkQueue::WorkQueue(size_t maxItems, int threadCount, LogSeverity statsLogLevel
 	m_StatusTimer->SetInterval(10);
 	m_StatusTimer->OnTimerExpired.connect([this](const Timer * const&) { StatusTimerHandler(); });
 	m_StatusTimer->Start();
+
+	std::unique_lock<std::mutex> lock (l_WorkQueuesMutex);
+	l_WorkQueues.insert(this);
 }
 
 WorkQueue::~WorkQueue()
 {
+	{
+		std::unique_lock<std::mutex> lock (l_WorkQueuesMutex);
+		l_WorkQueues.erase(this);
+	}
+
 	m_StatusTimer->Stop(true);
 
 	Join(true);
@@ -37,6 +77,9 @@ WorkQueue::~WorkQueue()
 void WorkQueue::SetName(const String& name)
 {
 	m_Name = name;
+
+	m_WaitTime.SetLabelValue(name);
+	m_RunTime.SetLabelValue(name);
 }
 
 String WorkQueue::GetName() const
@@ -44,9 +87,34 @@ String WorkQueue::GetName() const
 	return m_Name;
 }
 
+/**
+ * Enables or disables work stealing. Each worker thread has its own task queue
+ * and tasks enqueued by worker threads are kept in their local queue, while tasks
+ * from other threads go to a shared injection queue. Idle workers steal tasks
+ * from the other workers. Tasks of a higher priority are still run first, however
+ * tasks are no longer guaranteed to be executed in the order they were enqueued in.
+ *
+ * This has to be called before the first task is enqueued.
+ *
+ * @param workStealing Whether to enable work stealing
+ */
+void WorkQueue::SetWorkStealing(bool workStealing)
+{
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(m_Mutex));
+
+	ASSERT(!m_Spawned);
+
+	m_WorkStealing = workStealing;
+}
+
+bool WorkQueue::GetWorkStealing() const
+{
+	return m_WorkStealing;
+}
+
 std::unique_lock<std::mutex> WorkQueue::AcquireLock()
 {
-	return std::unique_lock<std::mutex>(m_Mutex);
+	return PROFILED_LOCK(m_Mutex);
 }
 
 /**
@@ -59,8 +127,17 @@ void WorkQueue::EnqueueUnlocked(std::unique_lock<std::mutex>& lock, std::functio
 		Log(LogNotice, "WorkQueue")
 			<< "Spawning WorkQueue threads for '" << m_Name << "'";
 
-		for (int i = 0; i < m_ThreadCount; i++) {
-			m_Threads.create_thread([this]() { WorkerThreadProc(); });
+		if (m_WorkStealing) {
+			while (m_Workers.size() < static_cast<size_t>(m_ThreadCount))
+				m_Workers.emplace_back(new WorkerQueue());
+
+			for (int i = 0; i < m_ThreadCount; i++) {
+				m_Threads.create_thread([this, i]() { StealingWorkerThreadProc(i); });
+			}
+		} else {
+			for (int i = 0; i < m_ThreadCount; i++) {
+				m_Threads.create_thread([this]() { WorkerThreadProc(); });
+			}
 		}
 
 		m_Spawned = true;
@@ -68,16 +145,66 @@ void WorkQueue::EnqueueUnlocked(std::unique_lock<std::mutex>& lock, std::functio
 
 	bool wq_thread = IsWorkerThread();
 
+	if (m_WorkStealing) {
+		if (wq_thread) {
+			if (EnqueueLocal(std::move(function), priority))
+				m_CVEmpty.notify_one();
+
+			return;
+		}
+
+		while (m_InjectionQueueSize >= m_MaxItems && m_MaxItems != 0)
+			m_CVFull.wait(lock);
+
+		int lane = GetTaskLane(priority);
+
+		/* Count the task before it becomes visible so that the counters never underflow. */
+		m_QueuedLaneTasks[lane]++;
+		UpdateHighWaterMark(++m_QueuedTasks);
+
+		m_InjectionQueue[lane].emplace_back(std::move(function), priority, ++m_NextTaskID);
+		m_InjectionQueueSize++;
+
+		if (m_IdleWorkers > 0)
+			m_CVEmpty.notify_one();
+
+		return;
+	}
+
 	if (!wq_thread) {
 		while (m_Tasks.size() >= m_MaxItems && m_MaxItems != 0)
 			m_CVFull.wait(lock);
 	}
 
+	m_QueuedLaneTasks[GetTaskLane(priority)]++;
 	m_Tasks.emplace(std::move(function), priority, ++m_NextTaskID);
+	UpdateHighWaterMark(m_Tasks.size());
 
 	m_CVEmpty.notify_one();
 }
 
+/**
+ * Enqueues a task into the local queue of the calling worker thread
+ * without taking the shared lock.
+ *
+ * @returns true if an idle worker has to be woken up, false otherwise
+ */
+bool WorkQueue::EnqueueLocal(std::function<void ()>&& function, WorkQueuePriority priority)
+{
+	WorkerQueue& worker = *m_Workers[l_ThreadWorkerIndex];
+	int lane = GetTaskLane(priority);
+
+	m_QueuedLaneTasks[lane]++;
+	UpdateHighWaterMark(++m_QueuedTasks);
+
+	{
+		std::unique_lock<std::mutex> lock(worker.Mutex);
+		worker.Lanes[lane].emplace_back(std::move(function), priority, -1);
+	}
+
+	return m_IdleWorkers > 0;
+}
+
 /**
  * Enqueues a task. Tasks are guaranteed to be executed in the order
  * they were enqueued in except if there is more than one worker thread or when
@@ -95,6 +222,15 @@ void WorkQueue::Enqueue(std::function<void ()>&& function, WorkQueuePriority pri
 		return;
 	}
 
+	if (wq_thread && m_WorkStealing) {
+		if (EnqueueLocal(std::move(function), priority)) {
+			auto lock = AcquireLock();
+			m_CVEmpty.notify_one();
+		}
+
+		return;
+	}
+
 	auto lock = AcquireLock();
 	EnqueueUnlocked(lock, std::move(function), priority);
 }
@@ -107,10 +243,15 @@ void WorkQueue::Enqueue(std::function<void ()>&& function, WorkQueuePriority pri
  */
 void WorkQueue::Join(bool stop)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
-
-	while (m_Processing || !m_Tasks.empty())
-		m_CVStarved.wait(lock);
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(m_Mutex));
+
+	if (m_WorkStealing) {
+		while (m_BusyWorkers || m_QueuedTasks)
+			m_CVStarved.wait(lock);
+	} else {
+		while (m_Processing || !m_Tasks.empty())
+			m_CVStarved.wait(lock);
+	}
 
 	if (stop) {
 		m_Stopped = true;
@@ -153,7 +294,7 @@ void WorkQueue::SetExceptionCallback(const ExceptionCallback& callback)
  */
 bool WorkQueue::HasExceptions() const
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(m_Mutex));
 
 	return !m_Exceptions.empty();
 }
@@ -164,7 +305,7 @@ bool WorkQueue::HasExceptions() const
  */
 std::vector<boost::exception_ptr> WorkQueue::GetExceptions() const
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(m_Mutex));
 
 	return m_Exceptions;
 }
@@ -184,18 +325,58 @@ void WorkQueue::ReportExceptions(const String& facility, bool verbose) const
 
 size_t WorkQueue::GetLength() const
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(m_Mutex));
+
+	return GetLengthUnlocked();
+}
+
+size_t WorkQueue::GetLengthUnlocked() const
+{
+	if (m_WorkStealing)
+		return m_QueuedTasks;
 
 	return m_Tasks.size();
 }
 
+/**
+ * Reports the load of all work queues, per queue name.
+ */
+void WorkQueue::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+{
+	static const char * const priorities[] = { "low", "normal", "high", "immediate" };
+
+	Dictionary::Ptr queues = new Dictionary();
+	std::unique_lock<std::mutex> lock (l_WorkQueuesMutex);
+
+	for (WorkQueue *queue : l_WorkQueues) {
+		Dictionary::Ptr items = new Dictionary();
+
+		for (int lane = 0; lane < 4; lane++)
+			items->Set(priorities[lane], queue->m_QueuedLaneTasks[lane].load());
+
+		uint_fast64_t waited = queue->m_WaitTime.GetCount();
+		uint_fast64_t ran = queue->m_RunTime.GetCount();
+
+		queues->Set(queue->GetName(), new Dictionary({
+			{ "items", queue->GetLength() },
+			{ "items_by_priority", items },
+			{ "high_water_mark", queue->m_HighWaterMark.load() },
+			{ "task_rate", queue->GetTaskCount(60) / 60.0 },
+			{ "avg_wait_time", waited ? queue->m_WaitTime.GetSum() / waited : 0 },
+			{ "avg_run_time", ran ? queue->m_RunTime.GetSum() / ran : 0 }
+		}));
+	}
+
+	status->Set("workqueue", queues);
+}
+
 void WorkQueue::StatusTimerHandler()
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(m_Mutex));
 
 	ASSERT(!m_Name.IsEmpty());
 
-	size_t pending = m_Tasks.size();
+	size_t pending = GetLengthUnlocked();
 
 	double now = Utility::GetTime();
 	double gradient = (pending - m_PendingTasks) / (now - m_PendingTasksTimestamp);
@@ -238,7 +419,7 @@ void WorkQueue::RunTaskFunction(const TaskFunction& func)
 		boost::exception_ptr eptr = boost::current_exception();
 
 		{
-			std::unique_lock<std::mutex> mutex(m_Mutex);
+			std::unique_lock<std::mutex> mutex (PROFILED_LOCK(m_Mutex));
 
 			if (!m_ExceptionCallback)
 				m_Exceptions.push_back(eptr);
@@ -249,6 +430,27 @@ void WorkQueue::RunTaskFunction(const TaskFunction& func)
 	}
 }
 
+/**
+ * Runs a task taken from the queue and records how long it has waited and run.
+ */
+void WorkQueue::RunTask(Task& task)
+{
+	auto start = Histogram::Clock::now();
+	m_WaitTime.Observe(std::chrono::duration<double>(start - task.Enqueued).count());
+
+	RunTaskFunction(task.Function);
+
+	m_RunTime.ObserveSince(start);
+}
+
+void WorkQueue::UpdateHighWaterMark(size_t length)
+{
+	size_t highWaterMark = m_HighWaterMark.load(std::memory_order_relaxed);
+
+	while (length > highWaterMark && !m_HighWaterMark.compare_exchange_weak(highWaterMark, length, std::memory_order_relaxed))
+		;
+}
+
 void WorkQueue::WorkerThreadProc()
 {
 	std::ostringstream idbuf;
@@ -257,7 +459,9 @@ void WorkQueue::WorkerThreadProc()
 
 	l_ThreadWorkQueue.reset(new WorkQueue *(this));
 
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	Allocator::UseArena(AllocatorArenaWorkQueue);
+
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(m_Mutex));
 
 	for (;;) {
 		while (m_Tasks.empty() && !m_Stopped)
@@ -271,12 +475,13 @@ void WorkQueue::WorkerThreadProc()
 
 		Task task = m_Tasks.top();
 		m_Tasks.pop();
+		m_QueuedLaneTasks[GetTaskLane(task.Priority)]--;
 
 		m_Processing++;
 
 		lock.unlock();
 
-		RunTaskFunction(task.Function);
+		RunTask(task);
 
 		/* clear the task so whatever other resources it holds are released _before_ we re-acquire the mutex */
 		task = Task();
@@ -292,6 +497,114 @@ void WorkQueue::WorkerThreadProc()
 	}
 }
 
+/**
+ * Takes the next task for a worker thread when work stealing is enabled: For each
+ * priority, starting with the highest one, the worker tries its own queue (newest
+ * task first), then the injection queue and finally the other workers' queues
+ * (oldest task first).
+ *
+ * @param index The worker's index
+ * @param task Set to the task
+ * @returns true if a task was found, false otherwise
+ */
+bool WorkQueue::TakeTask(size_t index, Task& task)
+{
+	for (int lane = 3; lane >= 0; lane--) {
+		if (m_QueuedLaneTasks[lane] == 0)
+			continue;
+
+		bool found = false;
+
+		{
+			WorkerQueue& own = *m_Workers[index];
+			std::unique_lock<std::mutex> lock(own.Mutex);
+
+			if (!own.Lanes[lane].empty()) {
+				task = std::move(own.Lanes[lane].back());
+				own.Lanes[lane].pop_back();
+				found = true;
+			}
+		}
+
+		if (!found) {
+			std::unique_lock<std::mutex> lock (PROFILED_LOCK(m_Mutex));
+
+			if (!m_InjectionQueue[lane].empty()) {
+				task = std::move(m_InjectionQueue[lane].front());
+				m_InjectionQueue[lane].pop_front();
+				m_InjectionQueueSize--;
+				found = true;
+
+				if (m_MaxItems != 0 && m_InjectionQueueSize < m_MaxItems)
+					m_CVFull.notify_all();
+			}
+		}
+
+		for (size_t i = 1; !found && i < m_Workers.size(); i++) {
+			WorkerQueue& victim = *m_Workers[(index + i) % m_Workers.size()];
+			std::unique_lock<std::mutex> lock(victim.Mutex);
+
+			if (!victim.Lanes[lane].empty()) {
+				task = std::move(victim.Lanes[lane].front());
+				victim.Lanes[lane].pop_front();
+				found = true;
+			}
+		}
+
+		if (found) {
+			m_BusyWorkers++;
+			m_QueuedLaneTasks[lane]--;
+			m_QueuedTasks--;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void WorkQueue::StealingWorkerThreadProc(size_t index)
+{
+	std::ostringstream idbuf;
+	idbuf << "WQ #" << m_ID;
+	Utility::SetThreadName(idbuf.str());
+
+	l_ThreadWorkQueue.reset(new WorkQueue *(this));
+	l_ThreadWorkerIndex = index;
+
+	for (;;) {
+		Task task;
+
+		if (!TakeTask(index, task)) {
+			std::unique_lock<std::mutex> lock (PROFILED_LOCK(m_Mutex));
+
+			m_IdleWorkers++;
+
+			while (!m_QueuedTasks && !m_Stopped)
+				m_CVEmpty.wait(lock);
+
+			m_IdleWorkers--;
+
+			if (m_Stopped)
+				break;
+
+			continue;
+		}
+
+		RunTask(task);
+
+		/* clear the task so whatever other resources it holds are released _before_ we signal completion */
+		task = Task();
+
+		IncreaseTaskCount();
+
+		if (--m_BusyWorkers == 0 && !m_QueuedTasks) {
+			std::unique_lock<std::mutex> lock (PROFILED_LOCK(m_Mutex));
+			m_CVStarved.notify_all();
+		}
+	}
+}
+
 void WorkQueue::IncreaseTaskCount()
 {
 	m_TaskStats.InsertValue(Utility::GetTime(), 1);
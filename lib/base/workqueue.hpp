@@ -4,16 +4,22 @@
 #define WORKQUEUE_H
 
 #include "base/i2-base.hpp"
+#include "base/array.hpp"
+#include "base/dictionary.hpp"
 #include "base/timer.hpp"
 #include "base/ringbuffer.hpp"
 #include "base/logger.hpp"
+#include "base/metrics.hpp"
+#include "base/parallel.hpp"
 #include <boost/thread/thread.hpp>
 #include <boost/exception_ptr.hpp>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <deque>
 #include <atomic>
+#include <vector>
 
 namespace icinga
 {
@@ -33,12 +39,13 @@ struct Task
 	Task() = default;
 
 	Task(TaskFunction function, WorkQueuePriority priority, int id)
-		: Function(std::move(function)), Priority(priority), ID(id)
+		: Function(std::move(function)), Priority(priority), ID(id), Enqueued(Histogram::Clock::now())
 	{ }
 
 	TaskFunction Function;
 	WorkQueuePriority Priority{PriorityNormal};
 	int ID{-1};
+	Histogram::Clock::time_point Enqueued;
 };
 
 bool operator<(const Task& a, const Task& b);
@@ -59,6 +66,9 @@ public:
 	void SetName(const String& name);
 	String GetName() const;
 
+	void SetWorkStealing(bool workStealing);
+	bool GetWorkStealing() const;
+
 	std::unique_lock<std::mutex> AcquireLock();
 	void EnqueueUnlocked(std::unique_lock<std::mutex>& lock, TaskFunction&& function, WorkQueuePriority priority = PriorityNormal);
 	void Enqueue(TaskFunction&& function, WorkQueuePriority priority = PriorityNormal,
@@ -72,27 +82,14 @@ public:
 
 		SizeType totalCount = items.size();
 
-		auto lock = AcquireLock();
-
-		SizeType offset = 0;
-
-		for (int i = 0; i < m_ThreadCount; i++) {
-			SizeType count = totalCount / static_cast<SizeType>(m_ThreadCount);
-			if (static_cast<SizeType>(i) < totalCount % static_cast<SizeType>(m_ThreadCount))
-				count++;
+		if (totalCount == 0)
+			return;
 
-			EnqueueUnlocked(lock, [&items, func, offset, count, this]() {
-				for (SizeType j = offset; j < offset + count; j++) {
-					RunTaskFunction([&func, &items, j]() {
-						func(items[j]);
-					});
-				}
-			});
-
-			offset += count;
-		}
+		SizeType grain = GetParallelGrain(totalCount, m_ThreadCount);
 
-		ASSERT(offset == items.size());
+		Enqueue([this, &items, func, totalCount, grain]() {
+			ParallelForRange(items, func, static_cast<SizeType>(0), totalCount, grain);
+		});
 	}
 
 	bool IsWorkerThread() const;
@@ -102,6 +99,8 @@ public:
 
 	void SetExceptionCallback(const ExceptionCallback& callback);
 
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+
 	bool HasExceptions() const;
 	std::vector<boost::exception_ptr> GetExceptions() const;
 	void ReportExceptions(const String& facility, bool verbose = false) const;
@@ -110,6 +109,16 @@ protected:
 	void IncreaseTaskCount();
 
 private:
+	/**
+	 * The task lanes of a worker thread when work stealing is enabled,
+	 * one per priority.
+	 */
+	struct WorkerQueue
+	{
+		std::mutex Mutex;
+		std::deque<Task> Lanes[4];
+	};
+
 	int m_ID;
 	String m_Name;
 	static std::atomic<int> m_NextID;
@@ -136,10 +145,57 @@ private:
 	size_t m_PendingTasks{0};
 	double m_PendingTasksTimestamp{0};
 
+	bool m_WorkStealing{false};
+	std::vector<std::unique_ptr<WorkerQueue> > m_Workers;
+	std::deque<Task> m_InjectionQueue[4];
+	size_t m_InjectionQueueSize{0};
+	std::atomic<size_t> m_QueuedTasks{0};
+	/* Per priority, also maintained without work stealing */
+	std::atomic<size_t> m_QueuedLaneTasks[4]{};
+	std::atomic<int> m_IdleWorkers{0};
+	std::atomic<int> m_BusyWorkers{0};
+
+	/* Labelled with the queue's name, see SetName(). */
+	Histogram m_WaitTime{"icinga_workqueue_wait_seconds", "Time tasks spent queued in a work queue", "queue"};
+	Histogram m_RunTime{"icinga_workqueue_run_seconds", "Time work queue tasks took to run", "queue"};
+	std::atomic<size_t> m_HighWaterMark{0};
+
 	void WorkerThreadProc();
+	void StealingWorkerThreadProc(size_t index);
 	void StatusTimerHandler();
 
+	size_t GetLengthUnlocked() const;
+
+	bool EnqueueLocal(TaskFunction&& function, WorkQueuePriority priority);
+	bool TakeTask(size_t index, Task& task);
+
 	void RunTaskFunction(const TaskFunction& func);
+	void RunTask(Task& task);
+	void UpdateHighWaterMark(size_t length);
+
+	/**
+	 * Processes the items in [begin, end). Larger ranges are split in half and the
+	 * upper half is handed back to the queue for other workers to pick up.
+	 */
+	template<typename VectorType, typename FuncType, typename SizeType>
+	void ParallelForRange(const VectorType& items, const FuncType& func, SizeType begin, SizeType end, SizeType grain)
+	{
+		while (end - begin > grain) {
+			SizeType middle = begin + (end - begin) / 2;
+
+			Enqueue([this, &items, func, middle, end, grain]() {
+				ParallelForRange(items, func, middle, end, grain);
+			});
+
+			end = middle;
+		}
+
+		for (SizeType j = begin; j < end; j++) {
+			RunTaskFunction([&func, &items, j]() {
+				func(items[j]);
+			});
+		}
+	}
 };
 
 }
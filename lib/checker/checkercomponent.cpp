@@ -4,6 +4,7 @@
 #include "checker/checkercomponent-ti.cpp"
 #include "icinga/icingaapplication.hpp"
 #include "icinga/cib.hpp"
+#include "icinga/checkworker.hpp"
 #include "remote/apilistener.hpp"
 #include "base/configuration.hpp"
 #include "base/configtype.hpp"
@@ -13,8 +14,16 @@
 #include "base/logger.hpp"
 #include "base/exception.hpp"
 #include "base/convert.hpp"
+#include "base/metrics.hpp"
+#include "base/process.hpp"
+#include "base/profiler.hpp"
 #include "base/statsfunction.hpp"
+#include "base/tracing.hpp"
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iterator>
 
 using namespace icinga;
 
@@ -22,22 +31,83 @@ REGISTER_TYPE(CheckerComponent);
 
 REGISTER_STATSFUNCTION(CheckerComponent, &CheckerComponent::StatsFunc);
 
+/* Upper bounds (in seconds) of CheckerComponent::DurationHistogram's buckets, the last bucket takes everything above */
+static const struct {
+	double UpperBound;
+	const char *Name;
+} l_DurationBuckets[] = {
+	{ 0.01, "0.01" }, { 0.1, "0.1" }, { 0.5, "0.5" }, { 1, "1" }, { 5, "5" },
+	{ 10, "10" }, { 30, "30" }, { 60, "60" }, { 300, "300" }
+};
+
+static Histogram l_CheckLateness ("icinga_check_lateness_seconds", "How much later than scheduled active checks have been started");
+static Histogram l_CheckLatency ("icinga_check_dispatch_latency_seconds", "How long active checks have waited for a thread after being started");
+
+/* How many due checks to consider when picking the most urgent one */
+static const int l_PriorityScanLimit = 32;
+
+/* How many phase slots a check interval is divided into at most */
+static const size_t l_MaxPhaseSlots = 600;
+
+/* What a check weighs in its phase slot if its execution time isn't known yet */
+static const double l_DefaultPhaseWeight = 1;
+
 void CheckerComponent::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
 	DictionaryData nodes;
 
 	for (const CheckerComponent::Ptr& checker : ConfigType::GetObjectsByType<CheckerComponent>()) {
-		unsigned long idle = checker->GetIdleCheckables();
-		unsigned long pending = checker->GetPendingCheckables();
+		unsigned long idle = 0;
+		unsigned long pending = 0;
+		ArrayData shards;
+
+		String perfdata_prefix = "checkercomponent_" + checker->GetName() + "_";
+
+		for (size_t i = 0; i < checker->m_Shards.size(); i++) {
+			auto& shard (*checker->m_Shards[i]);
+			unsigned long shardIdle, shardPending;
+
+			{
+				std::unique_lock<std::mutex> lock (PROFILED_LOCK(shard.Mutex));
+				shardIdle = shard.IdleCheckables.size();
+				shardPending = shard.PendingCheckables.size();
+			}
+
+			idle += shardIdle;
+			pending += shardPending;
+
+			shards.emplace_back(new Dictionary({
+				{ "idle", shardIdle },
+				{ "pending", shardPending }
+			}));
+
+			if (checker->m_Shards.size() > 1) {
+				String shard_prefix = perfdata_prefix + "shard" + Convert::ToString(i) + "_";
+				perfdata->Add(new PerfdataValue(shard_prefix + "idle", Convert::ToDouble(shardIdle)));
+				perfdata->Add(new PerfdataValue(shard_prefix + "pending", Convert::ToDouble(shardPending)));
+			}
+		}
 
-		nodes.emplace_back(checker->GetName(), new Dictionary({
+		int limit = checker->GetConcurrencyLimit();
+
+		Dictionary::Ptr node = new Dictionary({
 			{ "idle", idle },
-			{ "pending", pending }
-		}));
+			{ "pending", pending },
+			{ "concurrency_limit", limit },
+			{ "lateness_histogram", checker->m_Lateness.ToDictionary() },
+			{ "latency_histogram", checker->m_Latency.ToDictionary() },
+			{ "shards", new Array(std::move(shards)) }
+		});
+
+#ifndef _WIN32
+		node->Set("workers", CheckWorker::GetStats());
+#endif /* _WIN32 */
+
+		nodes.emplace_back(checker->GetName(), node);
 
-		String perfdata_prefix = "checkercomponent_" + checker->GetName() + "_";
 		perfdata->Add(new PerfdataValue(perfdata_prefix + "idle", Convert::ToDouble(idle)));
 		perfdata->Add(new PerfdataValue(perfdata_prefix + "pending", Convert::ToDouble(pending)));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "concurrency_limit", limit));
 	}
 
 	status->Set("checkercomponent", new Dictionary(std::move(nodes)));
@@ -45,6 +115,10 @@ void CheckerComponent::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr
 
 void CheckerComponent::OnConfigLoaded()
 {
+	/* The shards have to exist before the first checkable is handed to us. */
+	for (int i = 0; i < GetShards(); i++)
+		m_Shards.emplace_back(new Shard());
+
 	ConfigObject::OnActiveChanged.connect([this](const ConfigObject::Ptr& object, const Value&) {
 		ObjectHandler(object);
 	});
@@ -65,24 +139,46 @@ void CheckerComponent::Start(bool runtimeCreated)
 		<< "'" << GetName() << "' started.";
 
 
-	m_Thread = std::thread([this]() { CheckThreadProc(); });
+#ifndef _WIN32
+	/* Before the first check is dispatched, so that all of them are spawned by the workers. */
+	if (GetWorkers() > 0)
+		CheckWorker::StartWorkers(GetWorkers());
+#endif /* _WIN32 */
+
+	for (size_t i = 0; i < m_Shards.size(); i++) {
+		auto& shard (*m_Shards[i]);
+		shard.Thread = std::thread([this, &shard, i]() { CheckThreadProc(shard, i); });
+	}
 
 	m_ResultTimer = new Timer();
 	m_ResultTimer->SetInterval(5);
 	m_ResultTimer->OnTimerExpired.connect([this](const Timer * const&) { ResultTimerHandler(); });
 	m_ResultTimer->Start();
+
+	m_AdmissionTimer = new Timer();
+	m_AdmissionTimer->SetInterval(1);
+	m_AdmissionTimer->OnTimerExpired.connect([this](const Timer * const&) { AdmissionTimerHandler(); });
+	m_AdmissionTimer->Start();
 }
 
 void CheckerComponent::Stop(bool runtimeRemoved)
 {
-	{
-		std::unique_lock<std::mutex> lock(m_Mutex);
-		m_Stopped = true;
-		m_CV.notify_all();
+	m_Stopped = true;
+
+	for (auto& shard : m_Shards) {
+		std::unique_lock<std::mutex> lock (PROFILED_LOCK(shard->Mutex));
+		shard->CV.notify_all();
 	}
 
 	m_ResultTimer->Stop();
-	m_Thread.join();
+	m_AdmissionTimer->Stop(true);
+
+	for (auto& shard : m_Shards)
+		shard->Thread.join();
+
+#ifndef _WIN32
+	CheckWorker::StopWorkers();
+#endif /* _WIN32 */
 
 	Log(LogInformation, "CheckerComponent")
 		<< "'" << GetName() << "' stopped.";
@@ -90,19 +186,44 @@ void CheckerComponent::Stop(bool runtimeRemoved)
 	ObjectImpl<CheckerComponent>::Stop(runtimeRemoved);
 }
 
-void CheckerComponent::CheckThreadProc()
+void CheckerComponent::ValidateShards(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<CheckerComponent>::ValidateShards(lvalue, utils);
+
+	if (lvalue() < 1)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "shards" }, "Value must be greater than 0."));
+}
+
+void CheckerComponent::ValidateWorkers(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<CheckerComponent>::ValidateWorkers(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "workers" }, "Value must not be negative."));
+}
+
+CheckerComponent::Shard& CheckerComponent::GetShard(const Checkable::Ptr& checkable)
 {
-	Utility::SetThreadName("Check Scheduler");
+	if (m_Shards.size() == 1)
+		return *m_Shards[0];
+
+	/* The name is stable across reloads, unlike the object's address. */
+	return *m_Shards[std::hash<std::string>()(checkable->GetName().GetData()) % m_Shards.size()];
+}
+
+void CheckerComponent::CheckThreadProc(Shard& shard, size_t index)
+{
+	Utility::SetThreadName(m_Shards.size() > 1 ? "Check Sched " + Convert::ToString(index) : "Check Scheduler");
 	IcingaApplication::Ptr icingaApp = IcingaApplication::GetInstance();
 
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(shard.Mutex));
 
 	for (;;) {
 		typedef boost::multi_index::nth_index<CheckableSet, 1>::type CheckTimeView;
-		CheckTimeView& idx = boost::get<1>(m_IdleCheckables);
+		CheckTimeView& idx = boost::get<1>(shard.IdleCheckables);
 
 		while (idx.begin() == idx.end() && !m_Stopped)
-			m_CV.wait(lock);
+			shard.CV.wait(lock);
 
 		if (m_Stopped)
 			break;
@@ -110,27 +231,36 @@ void CheckerComponent::CheckThreadProc()
 		auto it = idx.begin();
 		CheckableScheduleInfo csi = *it;
 
-		double wait = csi.NextCheck - Utility::GetTime();
-
-//#ifdef I2_DEBUG
-//		Log(LogDebug, "CheckerComponent")
-//			<< "Pending checks " << Checkable::GetPendingChecks()
-//			<< " vs. max concurrent checks " << icingaApp->GetMaxConcurrentChecks() << ".";
-//#endif /* I2_DEBUG */
+		double now = Utility::GetTime();
+		double wait = csi.NextCheck - now;
 
-		if (Checkable::GetPendingChecks() >= icingaApp->GetMaxConcurrentChecks())
+		if (Checkable::GetPendingChecks() >= GetConcurrencyLimit())
 			wait = 0.5;
 
 		if (wait > 0) {
 			/* Wait for the next check. */
-			m_CV.wait_for(lock, std::chrono::duration<double>(wait));
+			shard.CV.wait_for(lock, std::chrono::duration<double>(wait));
 
 			continue;
 		}
 
+		/* Run retries and hard problems first among the due checks. That only matters
+		 * during a backlog (e.g. after a network outage), otherwise few checks are due. */
+		int bestPriority = GetCheckPriority(it->Object);
+		int scanned = 0;
+
+		for (auto next (std::next(it)); bestPriority && next != idx.end() && next->NextCheck <= now && ++scanned < l_PriorityScanLimit; ++next) {
+			int priority = GetCheckPriority(next->Object);
+
+			if (priority < bestPriority) {
+				csi = *next;
+				bestPriority = priority;
+			}
+		}
+
 		Checkable::Ptr checkable = csi.Object;
 
-		m_IdleCheckables.erase(checkable);
+		shard.IdleCheckables.erase(checkable);
 
 		bool forced = checkable->GetForceNextCheck();
 		bool check = true;
@@ -169,7 +299,7 @@ void CheckerComponent::CheckThreadProc()
 
 		/* reschedule the checkable if checks are disabled */
 		if (!check) {
-			m_IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
+			shard.IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
 			lock.unlock();
 
 			Log(LogDebug, "CheckerComponent")
@@ -191,7 +321,7 @@ void CheckerComponent::CheckThreadProc()
 			<< csi.Object->GetName() << "', Next Check: "
 			<< Utility::FormatDateTime("%Y-%m-%d %H:%M:%S %z", csi.NextCheck) << "(" << csi.NextCheck << ").";
 
-		m_PendingCheckables.insert(csi);
+		shard.PendingCheckables.insert(csi);
 
 		lock.unlock();
 
@@ -205,20 +335,36 @@ void CheckerComponent::CheckThreadProc()
 
 		Checkable::IncreasePendingChecks();
 
+		double dispatched = Utility::GetTime();
+		double lateness = std::max(0.0, dispatched - csi.NextCheck);
+
+		m_Lateness.Observe(lateness);
+		l_CheckLateness.Observe(lateness);
+
 		/*
 		 * Explicitly use CheckerComponent::Ptr to keep the reference counted while the
 		 * callback is active and making it crash safe
 		 */
 		CheckerComponent::Ptr checkComponent(this);
 
-		Utility::QueueAsyncCallback([this, checkComponent, checkable]() { ExecuteCheckHelper(checkable); });
+		Utility::QueueAsyncCallback([this, checkComponent, checkable, dispatched]() { ExecuteCheckHelper(checkable, dispatched); });
 
 		lock.lock();
 	}
 }
 
-void CheckerComponent::ExecuteCheckHelper(const Checkable::Ptr& checkable)
+void CheckerComponent::ExecuteCheckHelper(const Checkable::Ptr& checkable, double dispatched)
 {
+	double latency = std::max(0.0, Utility::GetTime() - dispatched);
+
+	m_Latency.Observe(latency);
+	l_CheckLatency.Observe(latency);
+
+	Span span ("CheckerComponent::ExecuteCheck", TraceContext::StartTrace());
+
+	if (span.IsRecording())
+		span.SetAttribute("icinga.checkable", checkable->GetName());
+
 	try {
 		checkable->ExecuteCheck();
 	} catch (const std::exception& ex) {
@@ -242,20 +388,21 @@ void CheckerComponent::ExecuteCheckHelper(const Checkable::Ptr& checkable)
 	Checkable::DecreasePendingChecks();
 
 	{
-		std::unique_lock<std::mutex> lock(m_Mutex);
+		auto& shard (GetShard(checkable));
+		std::unique_lock<std::mutex> lock (PROFILED_LOCK(shard.Mutex));
 
 		/* remove the object from the list of pending objects; if it's not in the
 		 * list this was a manual (i.e. forced) check and we must not re-add the
 		 * object to the list because it's already there. */
-		auto it = m_PendingCheckables.find(checkable);
+		auto it = shard.PendingCheckables.find(checkable);
 
-		if (it != m_PendingCheckables.end()) {
-			m_PendingCheckables.erase(it);
+		if (it != shard.PendingCheckables.end()) {
+			shard.PendingCheckables.erase(it);
 
 			if (checkable->IsActive())
-				m_IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
+				shard.IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
 
-			m_CV.notify_all();
+			shard.CV.notify_all();
 		}
 	}
 
@@ -267,14 +414,102 @@ void CheckerComponent::ResultTimerHandler()
 {
 	std::ostringstream msgbuf;
 
-	{
-		std::unique_lock<std::mutex> lock(m_Mutex);
+	msgbuf << "Pending checkables: " << GetPendingCheckables() << "; Idle checkables: " << GetIdleCheckables() << "; Checks/s: "
+		<< (CIB::GetActiveHostChecksStatistics(60) + CIB::GetActiveServiceChecksStatistics(60)) / 60.0;
+
+	Log(LogNotice, "CheckerComponent", msgbuf.str());
+}
+
+/**
+ * Adapts the concurrency limit to how well the system keeps up.
+ *
+ * The limit shrinks by a quarter (down to one check per core) while the load average
+ * exceeds two per core, starting a process takes more than half a second on average
+ * or more than twice the limit of processes run (e.g. plugins ignoring timeouts).
+ * Otherwise it grows by a tenth back to MaxConcurrentChecks.
+ */
+void CheckerComponent::AdmissionTimerHandler()
+{
+	double max = IcingaApplication::GetInstance()->GetMaxConcurrentChecks();
+	double limit = m_ConcurrencyLimit.load();
 
-		msgbuf << "Pending checkables: " << m_PendingCheckables.size() << "; Idle checkables: " << m_IdleCheckables.size() << "; Checks/s: "
-			<< (CIB::GetActiveHostChecksStatistics(60) + CIB::GetActiveServiceChecksStatistics(60)) / 60.0;
+	if (limit <= 0 || limit > max)
+		limit = max;
+
+	double cores = std::max(1u, std::thread::hardware_concurrency());
+	double load = 0;
+
+#ifndef _WIN32
+	double loadavg;
+
+	if (getloadavg(&loadavg, 1) == 1)
+		load = loadavg;
+#endif /* _WIN32 */
+
+	double spawnLatency = Process::GetSpawnLatency();
+	size_t processes = Process::GetRunningCount();
+
+	if (load > cores * 2 || spawnLatency > 0.5 || processes > limit * 2) {
+		double lower = std::max(std::min(max, cores), limit * 0.75);
+
+		if (lower < limit) {
+			Log(LogNotice, "CheckerComponent")
+				<< "Lowering the concurrency limit to " << (int)lower << " checks (load average: " << load
+				<< ", spawn latency: " << spawnLatency << "s, processes: " << processes << ")";
+		}
+
+		limit = lower;
+	} else {
+		limit = std::min(max, limit + std::max(1.0, limit * 0.1));
 	}
 
-	Log(LogNotice, "CheckerComponent", msgbuf.str());
+	m_ConcurrencyLimit.store(limit);
+}
+
+/**
+ * Returns the number of checks allowed to run at the same time right now.
+ */
+int CheckerComponent::GetConcurrencyLimit() const
+{
+	int max = IcingaApplication::GetInstance()->GetMaxConcurrentChecks();
+	double limit = m_ConcurrencyLimit.load();
+
+	return limit > 0 && limit < max ? limit : max;
+}
+
+/**
+ * Returns how urgent a due check is, lower first:
+ * forced checks and retries of soft problems, then hard problems, then the rest.
+ */
+int CheckerComponent::GetCheckPriority(const Checkable::Ptr& checkable)
+{
+	if (checkable->GetForceNextCheck())
+		return 0;
+
+	if (checkable->GetStateRaw() != ServiceOK)
+		return checkable->GetStateType() == StateTypeSoft ? 0 : 1;
+
+	return 2;
+}
+
+void CheckerComponent::DurationHistogram::Observe(double seconds)
+{
+	size_t bucket = 0;
+
+	while (bucket < DurationBuckets - 1u && seconds > l_DurationBuckets[bucket].UpperBound)
+		++bucket;
+
+	Buckets[bucket].fetch_add(1);
+}
+
+Dictionary::Ptr CheckerComponent::DurationHistogram::ToDictionary() const
+{
+	Dictionary::Ptr result = new Dictionary();
+
+	for (size_t i = 0; i < DurationBuckets; i++)
+		result->Set(i < DurationBuckets - 1u ? l_DurationBuckets[i].Name : "+Inf", (double)Buckets[i].load());
+
+	return result;
 }
 
 void CheckerComponent::ObjectHandler(const ConfigObject::Ptr& object)
@@ -287,23 +522,92 @@ void CheckerComponent::ObjectHandler(const ConfigObject::Ptr& object)
 	Zone::Ptr zone = Zone::GetByName(checkable->GetZoneName());
 	bool same_zone = (!zone || Zone::GetLocalZone() == zone);
 
+	if (object->IsActive() && !object->IsPaused() && same_zone)
+		AssignSchedulingPhase(checkable);
+	else
+		ReleaseSchedulingPhase(checkable);
+
 	{
-		std::unique_lock<std::mutex> lock(m_Mutex);
+		auto& shard (GetShard(checkable));
+		std::unique_lock<std::mutex> lock (PROFILED_LOCK(shard.Mutex));
 
 		if (object->IsActive() && !object->IsPaused() && same_zone) {
-			if (m_PendingCheckables.find(checkable) != m_PendingCheckables.end())
+			if (shard.PendingCheckables.find(checkable) != shard.PendingCheckables.end())
 				return;
 
-			m_IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
+			shard.IdleCheckables.insert(GetCheckableScheduleInfo(checkable));
 		} else {
-			m_IdleCheckables.erase(checkable);
-			m_PendingCheckables.erase(checkable);
+			shard.IdleCheckables.erase(checkable);
+			shard.PendingCheckables.erase(checkable);
 		}
 
-		m_CV.notify_all();
+		shard.CV.notify_all();
 	}
 }
 
+/**
+ * Assigns the checkable a phase within its check interval, i.e. a point in time
+ * modulo the interval which Checkable::UpdateNextCheck() snaps its checks to.
+ *
+ * The interval is divided into slots and each slot sums up the execution times
+ * of the checks assigned to it. New checkables go to the least loaded slot, so
+ * that checks with the same interval don't run at once. A phase restored from
+ * the state file is kept.
+ */
+void CheckerComponent::AssignSchedulingPhase(const Checkable::Ptr& checkable)
+{
+	ReleaseSchedulingPhase(checkable);
+
+	double interval = checkable->GetCheckInterval();
+
+	if (interval <= 1)
+		return;
+
+	CheckResult::Ptr cr = checkable->GetLastCheckResult();
+	double weight = cr ? std::max(cr->CalculateExecutionTime(), 0.1) : l_DefaultPhaseWeight;
+	double phase = checkable->GetSchedulingPhase();
+	bool assign = !(phase >= 0 && phase < interval);
+
+	{
+		std::unique_lock<std::mutex> lock(m_PhaseMutex);
+		auto& slots (m_PhaseSlots[interval]);
+
+		if (slots.empty())
+			slots.resize(std::min(static_cast<size_t>(interval), l_MaxPhaseSlots));
+
+		double width = interval / slots.size();
+		size_t slot;
+
+		if (assign) {
+			slot = std::min_element(slots.begin(), slots.end()) - slots.begin();
+
+			/* spread the checks within the slot, too */
+			phase = (slot + static_cast<unsigned long>(checkable->GetSchedulingOffset()) % 1000 / 1000.0) * width;
+		} else {
+			slot = std::min(static_cast<size_t>(phase / width), slots.size() - 1);
+		}
+
+		slots[slot] += weight;
+		m_PhaseAssignments.emplace(checkable, PhaseAssignment{interval, slot, weight});
+	}
+
+	if (assign)
+		checkable->SetSchedulingPhase(phase);
+}
+
+void CheckerComponent::ReleaseSchedulingPhase(const Checkable::Ptr& checkable)
+{
+	std::unique_lock<std::mutex> lock(m_PhaseMutex);
+
+	auto it (m_PhaseAssignments.find(checkable));
+
+	if (it == m_PhaseAssignments.end())
+		return;
+
+	m_PhaseSlots[it->second.Interval][it->second.Slot] -= it->second.Weight;
+	m_PhaseAssignments.erase(it);
+}
+
 CheckableScheduleInfo CheckerComponent::GetCheckableScheduleInfo(const Checkable::Ptr& checkable)
 {
 	CheckableScheduleInfo csi;
@@ -314,11 +618,12 @@ CheckableScheduleInfo CheckerComponent::GetCheckableScheduleInfo(const Checkable
 
 void CheckerComponent::NextCheckChangedHandler(const Checkable::Ptr& checkable)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	auto& shard (GetShard(checkable));
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(shard.Mutex));
 
 	/* remove and re-insert the object from the set in order to force an index update */
 	typedef boost::multi_index::nth_index<CheckableSet, 0>::type CheckableView;
-	CheckableView& idx = boost::get<0>(m_IdleCheckables);
+	CheckableView& idx = boost::get<0>(shard.IdleCheckables);
 
 	auto it = idx.find(checkable);
 
@@ -330,19 +635,29 @@ void CheckerComponent::NextCheckChangedHandler(const Checkable::Ptr& checkable)
 	CheckableScheduleInfo csi = GetCheckableScheduleInfo(checkable);
 	idx.insert(csi);
 
-	m_CV.notify_all();
+	shard.CV.notify_all();
 }
 
 unsigned long CheckerComponent::GetIdleCheckables()
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	unsigned long count = 0;
 
-	return m_IdleCheckables.size();
+	for (auto& shard : m_Shards) {
+		std::unique_lock<std::mutex> lock (PROFILED_LOCK(shard->Mutex));
+		count += shard->IdleCheckables.size();
+	}
+
+	return count;
 }
 
 unsigned long CheckerComponent::GetPendingCheckables()
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	unsigned long count = 0;
+
+	for (auto& shard : m_Shards) {
+		std::unique_lock<std::mutex> lock (PROFILED_LOCK(shard->Mutex));
+		count += shard->PendingCheckables.size();
+	}
 
-	return m_PendingCheckables.size();
+	return count;
 }
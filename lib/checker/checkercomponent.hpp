@@ -11,9 +11,14 @@
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/key_extractors.hpp>
+#include <atomic>
 #include <condition_variable>
+#include <cstdint>
+#include <map>
 #include <mutex>
+#include <memory>
 #include <thread>
+#include <vector>
 
 namespace icinga
 {
@@ -60,38 +65,99 @@ public:
 		>
 	> CheckableSet;
 
+	/**
+	 * A scheduler shard. Each shard owns a disjoint subset of the checkables
+	 * and runs its own dispatch thread.
+	 *
+	 * @ingroup checker
+	 */
+	struct Shard
+	{
+		std::mutex Mutex;
+		std::condition_variable CV;
+		std::thread Thread;
+
+		CheckableSet IdleCheckables;
+		CheckableSet PendingCheckables;
+	};
+
 	void OnConfigLoaded() override;
 	void Start(bool runtimeCreated) override;
 	void Stop(bool runtimeRemoved) override;
 
+	void ValidateShards(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateWorkers(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+
 	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 	unsigned long GetIdleCheckables();
 	unsigned long GetPendingCheckables();
+	int GetConcurrencyLimit() const;
 
 private:
-	std::mutex m_Mutex;
-	std::condition_variable m_CV;
-	bool m_Stopped{false};
-	std::thread m_Thread;
+	static constexpr size_t DurationBuckets = 10;
+
+	/**
+	 * Counts of durations by upper bound, see l_DurationBuckets.
+	 *
+	 * @ingroup checker
+	 */
+	struct DurationHistogram
+	{
+		std::atomic<uint_fast64_t> Buckets[DurationBuckets];
 
-	CheckableSet m_IdleCheckables;
-	CheckableSet m_PendingCheckables;
+		void Observe(double seconds);
+		Dictionary::Ptr ToDictionary() const;
+	};
+
+	/**
+	 * Where a checkable's phase has been counted in m_PhaseSlots.
+	 *
+	 * @ingroup checker
+	 */
+	struct PhaseAssignment
+	{
+		double Interval;
+		size_t Slot;
+		double Weight;
+	};
+
+	std::atomic<bool> m_Stopped{false};
+	std::vector<std::unique_ptr<Shard>> m_Shards;
+
+	/* Adapted by AdmissionTimerHandler() between a few checks and MaxConcurrentChecks, 0 until then. */
+	std::atomic<double> m_ConcurrencyLimit{0};
+
+	/* How late the checks have been started and how long they've waited for a thread. */
+	DurationHistogram m_Lateness{};
+	DurationHistogram m_Latency{};
+
+	/* Summed up execution times of the checks per check interval and phase slot. */
+	std::mutex m_PhaseMutex;
+	std::map<double, std::vector<double>> m_PhaseSlots;
+	std::map<Checkable::Ptr, PhaseAssignment> m_PhaseAssignments;
 
 	Timer::Ptr m_ResultTimer;
+	Timer::Ptr m_AdmissionTimer;
+
+	Shard& GetShard(const Checkable::Ptr& checkable);
 
-	void CheckThreadProc();
+	void CheckThreadProc(Shard& shard, size_t index);
 	void ResultTimerHandler();
+	void AdmissionTimerHandler();
 
-	void ExecuteCheckHelper(const Checkable::Ptr& checkable);
+	void ExecuteCheckHelper(const Checkable::Ptr& checkable, double dispatched);
 
 	void AdjustCheckTimer();
 
 	void ObjectHandler(const ConfigObject::Ptr& object);
+	void AssignSchedulingPhase(const Checkable::Ptr& checkable);
+	void ReleaseSchedulingPhase(const Checkable::Ptr& checkable);
 	void NextCheckChangedHandler(const Checkable::Ptr& checkable);
 
 	void RescheduleCheckTimer();
 
 	static CheckableScheduleInfo GetCheckableScheduleInfo(const Checkable::Ptr& checkable);
+	static int GetCheckPriority(const Checkable::Ptr& checkable);
 };
 
 }
@@ -12,11 +12,14 @@
 #include "base/logger.hpp"
 #include "base/application.hpp"
 #include "base/process.hpp"
+#include "base/processhandoff.hpp"
 #include "base/timer.hpp"
 #include "base/utility.hpp"
 #include "base/exception.hpp"
+#include "base/configtype.hpp"
 #include "base/convert.hpp"
 #include "base/scriptglobal.hpp"
+#include "base/startupprofiler.hpp"
 #include "base/context.hpp"
 #include "config.h"
 #include <cstdint>
@@ -24,6 +27,7 @@
 #include <boost/program_options.hpp>
 #include <iostream>
 #include <fstream>
+#include <map>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -168,6 +172,8 @@ void DaemonCommand::InitParameters(boost::program_options::options_description&
 		("config,c", po::value<std::vector<std::string> >(), "parse a configuration file")
 		("no-config,z", "start without a configuration file")
 		("validate,C", "exit after validating the configuration")
+		("config-cache", "restore objects from a cache when the configuration is unchanged")
+		("profile-startup", "log the time spent per config type and feature during startup")
 		("errorlog,e", po::value<std::string>(), "log fatal errors to the specified log file (only works in combination with --daemonize or --close-stdio)")
 #ifndef _WIN32
 		("daemonize,d", "detach from the controlling terminal")
@@ -184,6 +190,12 @@ std::vector<String> DaemonCommand::GetArgumentSuggestions(const String& argument
 		return CLICommand::GetArgumentSuggestions(argument, word);
 }
 
+// The config cache file, if --config-cache was given
+static String l_ConfigCachePath;
+
+// Whether --profile-startup was given
+static bool l_ProfileStartup = false;
+
 #ifndef _WIN32
 // The PID of the Icinga umbrella process
 pid_t l_UmbrellaPid = 0;
@@ -210,6 +222,37 @@ static double GetDebugWorkerDelay()
 }
 #endif /* I2_DEBUG */
 
+/**
+ * Logs how much memory the config objects take per type. Only the objects
+ * themselves are counted, not what they allocate, e.g. their strings.
+ */
+static void ReportObjectMemory()
+{
+	size_t total = 0;
+
+	for (const Type::Ptr& type : Type::GetAllTypes()) {
+		auto *ctype = dynamic_cast<ConfigType *>(type.get());
+
+		if (!ctype)
+			continue;
+
+		size_t count = ctype->GetObjectCount();
+		size_t size = type->GetInstanceSize();
+
+		if (!count || !size)
+			continue;
+
+		total += count * size;
+
+		Log(LogInformation, "cli")
+			<< "Memory used by " << count << " " << (count != 1 ? type->GetPluralName() : type->GetName()) << ": "
+			<< (count * size / 1024) << " KiB (" << size << " bytes each).";
+	}
+
+	Log(LogInformation, "cli")
+		<< "Memory used by all config objects: " << (total / 1024) << " KiB.";
+}
+
 /**
  * Do the actual work (config loading, ...)
  *
@@ -239,7 +282,7 @@ int RunWorker(const std::vector<std::string>& configs, bool closeConsoleLog = fa
 	{
 		std::vector<ConfigItem::Ptr> newItems;
 
-		if (!DaemonUtility::LoadConfigFiles(configs, newItems, Configuration::ObjectsPath, Configuration::VarsPath)) {
+		if (!DaemonUtility::LoadConfigFiles(configs, newItems, Configuration::ObjectsPath, Configuration::VarsPath, l_ConfigCachePath)) {
 			Log(LogCritical, "cli", "Config validation failed. Re-run with 'icinga2 daemon -C' after fixing the config.");
 			return EXIT_FAILURE;
 		}
@@ -268,6 +311,7 @@ int RunWorker(const std::vector<std::string>& configs, bool closeConsoleLog = fa
 
 		/* restore the previous program state */
 		try {
+			StartupProfiler::Scope profile ("phase", "restore_state");
 			ConfigObject::RestoreObjects(Configuration::StatePath);
 		} catch (const std::exception& ex) {
 			Log(LogCritical, "cli")
@@ -276,10 +320,20 @@ int RunWorker(const std::vector<std::string>& configs, bool closeConsoleLog = fa
 		}
 
 		// activate config only after daemonization: it starts threads and that is not compatible with fork()
-		if (!ConfigItem::ActivateItems(newItems, false, false, true)) {
+		bool activated;
+
+		{
+			StartupProfiler::Scope profile ("phase", "activate", newItems.size());
+			activated = ConfigItem::ActivateItems(newItems, false, false, true);
+		}
+
+		if (!activated) {
 			Log(LogCritical, "cli", "Error activating configuration.");
 			return EXIT_FAILURE;
 		}
+
+		/* the listeners have taken over the sockets of the previous worker they still need */
+		ProcessHandoff::CloseUnclaimedListeners();
 	}
 
 	/* Create the internal API object storage. Do this here too with setups without API. */
@@ -296,10 +350,28 @@ int RunWorker(const std::vector<std::string>& configs, bool closeConsoleLog = fa
 
 	ApiListener::UpdateObjectAuthority();
 
+	StartupProfiler::Report(l_ProfileStartup, Configuration::CacheDir + "/startup-profile.json");
+
 	return Application::GetInstance()->Run();
 }
 
 #ifndef _WIN32
+// The umbrella process' ends of the seamless workers' control channels (see ProcessHandoff)
+static std::map<pid_t, int> l_WorkerControlChannels;
+
+/**
+ * Closes the umbrella process' end of an exited seamless worker's control channel.
+ */
+static void CloseWorkerControlChannel(pid_t worker)
+{
+	auto channel (l_WorkerControlChannels.find(worker));
+
+	if (channel != l_WorkerControlChannels.end()) {
+		(void)close(channel->second);
+		l_WorkerControlChannels.erase(channel);
+	}
+}
+
 /**
  * The possible states of a seamless worker being started by StartUnixWorker().
  */
@@ -463,8 +535,40 @@ static pid_t StartUnixWorker(const std::vector<std::string>& configs, bool close
 	 */
 	(void)sigprocmask(SIG_BLOCK, &l_UnixWorkerSignals, nullptr);
 
+	int controlChannel[2];
+
+	if (ProcessHandoff::CreateChannel(controlChannel) < 0) {
+		Log(LogWarning, "cli")
+			<< "socketpair() failed with error code " << errno << ", \"" << Utility::FormatErrorNumber(errno)
+			<< "\", the worker won't be able to take over the listeners on reload";
+
+		controlChannel[0] = -1;
+		controlChannel[1] = -1;
+	}
+
 	pid_t pid = fork();
 
+	if (controlChannel[0] != -1) {
+		if (pid == 0) {
+			(void)close(controlChannel[0]);
+
+			for (auto& kv : l_WorkerControlChannels) {
+				(void)close(kv.second);
+			}
+
+			l_WorkerControlChannels.clear();
+			ProcessHandoff::SetControlChannel(controlChannel[1]);
+		} else {
+			(void)close(controlChannel[1]);
+
+			if (pid == -1) {
+				(void)close(controlChannel[0]);
+			} else {
+				l_WorkerControlChannels[pid] = controlChannel[0];
+			}
+		}
+	}
+
 	switch (pid) {
 		case -1:
 			Log(LogCritical, "cli")
@@ -560,6 +664,7 @@ static pid_t StartUnixWorker(const std::vector<std::string>& configs, bool close
 							NotifyWatchdog();
 #endif /* HAVE_SYSTEMD */
 						}
+						CloseWorkerControlChannel(pid);
 						pid = -2;
 						break;
 					default:
@@ -586,6 +691,40 @@ static pid_t StartUnixWorker(const std::vector<std::string>& configs, bool close
 	return pid;
 }
 
+/**
+ * Lets the old seamless worker pass its listening sockets to the new one
+ * instead of the new one binding its own only after the old one has exited.
+ *
+ * @param oldWorker The worker about to be terminated
+ * @param newWorker The worker taking over
+ */
+static void HandOverListeners(pid_t oldWorker, pid_t newWorker)
+{
+	auto oldChannel (l_WorkerControlChannels.find(oldWorker));
+	auto newChannel (l_WorkerControlChannels.find(newWorker));
+
+	if (oldChannel == l_WorkerControlChannels.end() || newChannel == l_WorkerControlChannels.end()) {
+		return;
+	}
+
+	int handoff[2];
+
+	if (ProcessHandoff::CreateChannel(handoff) < 0) {
+		Log(LogWarning, "cli")
+			<< "socketpair() failed with error code " << errno << ", \"" << Utility::FormatErrorNumber(errno) << "\"";
+		return;
+	}
+
+	if (!ProcessHandoff::SendSocket(oldChannel->second, handoff[0]) || !ProcessHandoff::SendSocket(newChannel->second, handoff[1])) {
+		Log(LogWarning, "cli")
+			<< "Failed to connect the old worker (PID " << oldWorker << ") to the new one (PID " << newWorker << ") for passing the listeners";
+	}
+
+	// The workers hold their own copies
+	(void)close(handoff[0]);
+	(void)close(handoff[1]);
+}
+
 /**
  * Workaround to instantiate Application (which is abstract) in DaemonCommand#Run()
  */
@@ -628,17 +767,29 @@ int DaemonCommand::Run(const po::variables_map& vm, const std::vector<std::strin
 		configs.push_back(configDir + "/icinga2.conf");
 	}
 
+	if (vm.count("config-cache"))
+		l_ConfigCachePath = Configuration::CacheDir + "/icinga2.config-cache";
+
+	if (vm.count("profile-startup"))
+		l_ProfileStartup = true;
+
 	if (vm.count("validate")) {
 		Log(LogInformation, "cli", "Loading configuration file(s).");
 
 		std::vector<ConfigItem::Ptr> newItems;
 
-		if (!DaemonUtility::LoadConfigFiles(configs, newItems, Configuration::ObjectsPath, Configuration::VarsPath)) {
+		if (!DaemonUtility::LoadConfigFiles(configs, newItems, Configuration::ObjectsPath, Configuration::VarsPath, l_ConfigCachePath)) {
 			Log(LogCritical, "cli", "Config validation failed. Re-run with 'icinga2 daemon -C' after fixing the config.");
 			return EXIT_FAILURE;
 		}
 
 		Log(LogInformation, "cli", "Finished validating the configuration file(s).");
+
+		if (l_ProfileStartup)
+			StartupProfiler::Report(true, String());
+
+		ReportObjectMemory();
+
 		return EXIT_SUCCESS;
 	}
 
@@ -796,6 +947,8 @@ int DaemonCommand::Run(const po::variables_map& vm, const std::vector<std::strin
 					Log(LogInformation, "Application")
 						<< "Reload done, old process shutting down. Child process with PID '" << nextWorker << "' is taking over.";
 
+					HandOverListeners(currentWorker, nextWorker);
+
 					(void)kill(currentWorker, SIGTERM);
 
 					{
@@ -811,6 +964,8 @@ int DaemonCommand::Run(const po::variables_map& vm, const std::vector<std::strin
 							<< "Waited for " << Utility::FormatDuration(Utility::GetTime() - start) << " on old process to exit.";
 					}
 
+					CloseWorkerControlChannel(currentWorker);
+
 					// Old instance shut down, allow the new one to continue working beyond config validation
 					(void)kill(nextWorker, SIGUSR2);
 
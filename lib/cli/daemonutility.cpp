@@ -5,9 +5,12 @@
 #include "base/logger.hpp"
 #include "base/application.hpp"
 #include "base/scriptglobal.hpp"
+#include "base/startupprofiler.hpp"
 #include "config/configcompiler.hpp"
 #include "config/configcompilercontext.hpp"
+#include "config/configcache.hpp"
 #include "config/configitembuilder.hpp"
+#include "remote/configobjectjournal.hpp"
 #include <set>
 
 using namespace icinga;
@@ -42,11 +45,14 @@ static bool IncludeZoneDirRecursive(const String& path, const String& package, b
 	/* register this zone path for cluster config sync */
 	ConfigCompiler::RegisterZoneDir("_etc", path, zoneName);
 
-	std::vector<std::unique_ptr<Expression> > expressions;
-	Utility::GlobRecursive(path, "*.conf", [&expressions, zoneName, package](const String& file) {
-		ConfigCompiler::CollectIncludes(expressions, file, zoneName, package);
+	std::vector<String> files;
+	Utility::GlobRecursive(path, "*.conf", [&files](const String& file) {
+		files.push_back(file);
 	}, GlobFile);
 
+	std::vector<std::unique_ptr<Expression> > expressions;
+	ConfigCompiler::CollectIncludes(expressions, files, zoneName, package);
+
 	DictExpression expr(std::move(expressions));
 	if (!ExecuteExpression(&expr))
 		success = false;
@@ -77,11 +83,14 @@ static bool IncludeNonLocalZone(const String& zonePath, const String& package, b
 		return true;
 	}
 
-	std::vector<std::unique_ptr<Expression> > expressions;
-	Utility::GlobRecursive(zonePath, "*.conf", [&expressions, zoneName, package](const String& file) {
-		ConfigCompiler::CollectIncludes(expressions, file, zoneName, package);
+	std::vector<String> files;
+	Utility::GlobRecursive(zonePath, "*.conf", [&files](const String& file) {
+		files.push_back(file);
 	}, GlobFile);
 
+	std::vector<std::unique_ptr<Expression> > expressions;
+	ConfigCompiler::CollectIncludes(expressions, files, zoneName, package);
+
 	DictExpression expr(std::move(expressions));
 	if (!ExecuteExpression(&expr))
 		success = false;
@@ -170,6 +179,10 @@ bool DaemonUtility::ValidateConfigFiles(const std::vector<std::string>& configs,
 	if (Utility::PathExists(packagesVarDir))
 		Utility::Glob(packagesVarDir + "/*", [&success](const String& packagePath) { IncludePackage(packagePath, success); }, GlobDirectory);
 
+	/* Runtime objects which are kept in the journal rather than in the _api package. */
+	if (!ConfigObjectJournal::GetInstance()->Load())
+		success = false;
+
 	if (!success)
 		return false;
 
@@ -232,25 +245,61 @@ bool DaemonUtility::ValidateConfigFiles(const std::vector<std::string>& configs,
 
 bool DaemonUtility::LoadConfigFiles(const std::vector<std::string>& configs,
 	std::vector<ConfigItem::Ptr>& newItems,
-	const String& objectsFile, const String& varsfile)
+	const String& objectsFile, const String& varsfile, const String& cacheFile)
 {
 	ActivationScope ascope;
 
-	if (!DaemonUtility::ValidateConfigFiles(configs, objectsFile)) {
+	ConfigCache *cache = ConfigCache::GetInstance();
+
+	if (!cacheFile.IsEmpty()) {
+		Namespace::Ptr systemNS = ScriptGlobal::Get("System");
+		Value zonesStageVarDir;
+
+		/* Staged cluster config sync validations restore the objects of unchanged
+		 * zones from the daemon's cache, but must not replace it.
+		 */
+		if (systemNS->Get("ZonesStageVarDir", &zonesStageVarDir)) {
+			cache->Open(cacheFile, true);
+			cache->SetPathAlias(zonesStageVarDir, Configuration::DataDir + "/api/zones");
+		} else {
+			cache->Open(cacheFile);
+		}
+	}
+
+	bool validated;
+
+	{
+		StartupProfiler::Scope profile ("phase", "compile");
+		validated = DaemonUtility::ValidateConfigFiles(configs, objectsFile);
+	}
+
+	if (!validated) {
 		ConfigCompilerContext::GetInstance()->CancelObjectsFile();
+		cache->Cancel();
 		return false;
 	}
 
+	/* All config files have been compiled at this point. */
+	cache->Load();
+
 	WorkQueue upq(25000, Configuration::Concurrency);
 	upq.SetName("DaemonUtility::LoadConfigFiles");
-	bool result = ConfigItem::CommitItems(ascope.GetContext(), upq, newItems);
+	upq.SetWorkStealing(true);
+	bool result;
+
+	{
+		StartupProfiler::Scope profile ("phase", "commit");
+		result = ConfigItem::CommitItems(ascope.GetContext(), upq, newItems);
+	}
 
 	if (!result) {
 		ConfigCompilerContext::GetInstance()->CancelObjectsFile();
+		cache->Cancel();
 		return false;
 	}
 
 	ConfigCompilerContext::GetInstance()->FinishObjectsFile();
+	cache->Finish();
 
 	try {
 		ScriptGlobal::WriteToFile(varsfile);
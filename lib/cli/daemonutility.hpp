@@ -19,7 +19,7 @@ class DaemonUtility
 public:
 	static bool ValidateConfigFiles(const std::vector<std::string>& configs, const String& objectsFile = String());
 	static bool LoadConfigFiles(const std::vector<std::string>& configs, std::vector<ConfigItem::Ptr>& newItems,
-		const String& objectsFile = String(), const String& varsfile = String());
+		const String& objectsFile = String(), const String& varsfile = String(), const String& cacheFile = String());
 };
 
 }
@@ -0,0 +1,39 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "cli/internalcheckworkercommand.hpp"
+#include "icinga/checkworker.hpp"
+#include "base/logger.hpp"
+
+using namespace icinga;
+
+REGISTER_CLICOMMAND("internal/check-worker", InternalCheckWorkerCommand);
+
+String InternalCheckWorkerCommand::GetDescription() const
+{
+	return "Execute checks on behalf of the CheckerComponent";
+}
+
+String InternalCheckWorkerCommand::GetShortDescription() const
+{
+	return "Execute checks on behalf of the CheckerComponent";
+}
+
+bool InternalCheckWorkerCommand::IsHidden() const
+{
+	return true;
+}
+
+/**
+ * The entry point for the "internal check-worker" CLI command.
+ *
+ * @returns An exit status.
+ */
+int InternalCheckWorkerCommand::Run(const boost::program_options::variables_map& vm, const std::vector<std::string>& ap) const
+{
+#ifndef _WIN32
+	return CheckWorker::RunWorker();
+#else /* _WIN32 */
+	Log(LogCritical, "cli", "Unsupported action on Windows.");
+	return 1;
+#endif /* _WIN32 */
+}
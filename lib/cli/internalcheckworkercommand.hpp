@@ -0,0 +1,30 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef INTERNALCHECKWORKERCOMMAND_H
+#define INTERNALCHECKWORKERCOMMAND_H
+
+#include "cli/clicommand.hpp"
+
+namespace icinga
+{
+
+/**
+ * The "internal check-worker" command.
+ *
+ * @ingroup cli
+ */
+class InternalCheckWorkerCommand final : public CLICommand
+{
+public:
+	DECLARE_PTR_TYPEDEFS(InternalCheckWorkerCommand);
+
+	String GetDescription() const override;
+	String GetShortDescription() const override;
+	bool IsHidden() const override;
+	int Run(const boost::program_options::variables_map& vm, const std::vector<std::string>& ap) const override;
+
+};
+
+}
+
+#endif /* INTERNALCHECKWORKERCOMMAND_H */
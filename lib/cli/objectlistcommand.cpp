@@ -13,6 +13,8 @@
 #include "base/debug.hpp"
 #include "base/objectlock.hpp"
 #include "base/console.hpp"
+#include "base/exception.hpp"
+#include "config/configcompilercontext.hpp"
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <fstream>
@@ -76,18 +78,41 @@ int ObjectListCommand::Run(const boost::program_options::variables_map& vm, cons
 	bool first = true;
 
 	String message;
-	StreamReadContext src;
-	for (;;) {
-		StreamReadStatus srs = NetString::ReadStringFromStream(sfp, &message, src);
+	std::vector<std::streamoff> offsets;
+
+	if ((!name_filter.IsEmpty() || !type_filter.IsEmpty()) && GetIndexedOffsets(objectfile, name_filter, type_filter, offsets)) {
+		/* Only decode the objects the index says are matching. */
+		for (auto offset : offsets) {
+			fp.clear();
+			fp.seekg(offset);
+
+			StreamReadContext src;
+			StreamReadStatus srs;
+
+			do {
+				srs = NetString::ReadStringFromStream(sfp, &message, src);
+			} while (srs != StatusEof && srs != StatusNewItem);
+
+			if (srs != StatusNewItem)
+				break;
 
-		if (srs == StatusEof)
-			break;
+			ObjectListUtility::PrintObject(std::cout, first, message, type_count, name_filter, type_filter);
+			objects_count++;
+		}
+	} else {
+		StreamReadContext src;
+		for (;;) {
+			StreamReadStatus srs = NetString::ReadStringFromStream(sfp, &message, src);
 
-		if (srs != StatusNewItem)
-			continue;
+			if (srs == StatusEof)
+				break;
 
-		ObjectListUtility::PrintObject(std::cout, first, message, type_count, name_filter, type_filter);
-		objects_count++;
+			if (srs != StatusNewItem)
+				continue;
+
+			ObjectListUtility::PrintObject(std::cout, first, message, type_count, name_filter, type_filter);
+			objects_count++;
+		}
 	}
 
 	sfp->Close();
@@ -107,6 +132,73 @@ int ObjectListCommand::Run(const boost::program_options::variables_map& vm, cons
 	return 0;
 }
 
+/**
+ * Looks up the objects matching the filters in the index written next to the
+ * objects file by "icinga2 daemon -C".
+ *
+ * @returns false if there is no index or it doesn't belong to the objects file
+ */
+bool ObjectListCommand::GetIndexedOffsets(const String& objectfile, const String& name_filter, const String& type_filter,
+	std::vector<std::streamoff>& offsets)
+{
+	String indexfile = ConfigCompilerContext::GetObjectsIndexPath(objectfile);
+
+	std::fstream objectsfp (objectfile.CStr(), std::ios_base::in | std::ios_base::ate);
+	std::fstream fp (indexfile.CStr(), std::ios_base::in);
+
+	if (!objectsfp || !fp)
+		return false;
+
+	StdioStream::Ptr sfp = new StdioStream(&fp, false);
+	String message;
+	StreamReadContext src;
+	bool header = true;
+
+	try {
+		for (;;) {
+			StreamReadStatus srs = NetString::ReadStringFromStream(sfp, &message, src);
+
+			if (srs == StatusEof)
+				break;
+
+			if (srs != StatusNewItem)
+				continue;
+
+			if (header) {
+				Dictionary::Ptr info = JsonDecode(message);
+
+				if (static_cast<std::streamoff>(info->Get("objects_size")) != static_cast<std::streamoff>(objectsfp.tellg())) {
+					Log(LogNotice, "cli")
+						<< "Ignoring outdated objects index file '" << indexfile << "'.";
+					return false;
+				}
+
+				header = false;
+				continue;
+			}
+
+			Array::Ptr entry = JsonDecode(message);
+			String type = entry->Get(1);
+			String name = entry->Get(2);
+			String internal_name = entry->Get(3);
+
+			if (!name_filter.IsEmpty() && !Utility::Match(name_filter, name) && !Utility::Match(name_filter, internal_name))
+				continue;
+			if (!type_filter.IsEmpty() && !Utility::Match(type_filter, type))
+				continue;
+
+			offsets.push_back(static_cast<std::streamoff>(entry->Get(0)));
+		}
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "cli")
+			<< "Ignoring invalid objects index file '" << indexfile << "': " << DiagnosticInformation(ex, false);
+		offsets.clear();
+		return false;
+	}
+
+	return !header;
+}
+
 void ObjectListCommand::PrintTypeCounts(std::ostream& fp, const std::map<String, int>& type_count)
 {
 	typedef std::map<String, int>::value_type TypeCount;
@@ -29,6 +29,8 @@ public:
 
 private:
 	static void PrintTypeCounts(std::ostream& fp, const std::map<String, int>& type_count);
+	static bool GetIndexedOffsets(const String& objectfile, const String& name_filter, const String& type_filter,
+		std::vector<std::streamoff>& offsets);
 };
 
 }
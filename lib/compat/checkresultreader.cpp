@@ -15,7 +15,16 @@
 #include "base/exception.hpp"
 #include "base/context.hpp"
 #include "base/statsfunction.hpp"
+#include "base/perfdatavalue.hpp"
+#include <algorithm>
 #include <fstream>
+#include <map>
+#include <sys/stat.h>
+
+#ifdef HAVE_INOTIFY
+#	include <poll.h>
+#	include <sys/inotify.h>
+#endif /* HAVE_INOTIFY */
 
 using namespace icinga;
 
@@ -23,12 +32,22 @@ REGISTER_TYPE(CheckResultReader);
 
 REGISTER_STATSFUNCTION(CheckResultReader, &CheckResultReader::StatsFunc);
 
-void CheckResultReader::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+void CheckResultReader::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
 	DictionaryData nodes;
+	double now = Utility::GetTime();
 
 	for (const CheckResultReader::Ptr& checkresultreader : ConfigType::GetObjectsByType<CheckResultReader>()) {
-		nodes.emplace_back(checkresultreader->GetName(), 1); //add more stats
+		double fileRate = checkresultreader->m_ProcessedFiles.CalculateRate(now, 60);
+		double lag = checkresultreader->m_ProcessingLag.load();
+
+		nodes.emplace_back(checkresultreader->GetName(), new Dictionary({
+			{ "files_per_second", fileRate },
+			{ "processing_lag", lag }
+		}));
+
+		perfdata->Add(new PerfdataValue("checkresultreader_" + checkresultreader->GetName() + "_files_per_second", fileRate));
+		perfdata->Add(new PerfdataValue("checkresultreader_" + checkresultreader->GetName() + "_processing_lag", lag));
 	}
 
 	status->Set("checkresultreader", new Dictionary(std::move(nodes)));
@@ -48,9 +67,33 @@ void CheckResultReader::Start(bool runtimeCreated)
 		<< "This feature is DEPRECATED and will be removed in future releases. Check the roadmap at https://github.com/Icinga/icinga2/milestones";
 
 #ifndef _WIN32
+	/* Without inotify the spool directory is scanned every few seconds. With
+	 * it, the scan is only a safety net for files which were missed. */
+	double interval = 5;
+
+#	ifdef HAVE_INOTIFY
+	m_Stopped.store(false);
+	m_WatchFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (m_WatchFD >= 0 && inotify_add_watch(m_WatchFD, GetSpoolDir().CStr(), IN_CLOSE_WRITE | IN_MOVED_TO) >= 0) {
+		m_WatchThread = std::thread([this]() { WatchThreadProc(); });
+		interval = 60;
+	} else {
+		Log(LogWarning, "CheckResultReader")
+			<< "Cannot watch spool directory '" << GetSpoolDir() << "' for new check result files, scanning it every "
+			<< interval << " seconds instead: " << Utility::FormatErrorNumber(errno);
+
+		if (m_WatchFD >= 0) {
+			(void)close(m_WatchFD);
+			m_WatchFD = -1;
+		}
+	}
+#	endif /* HAVE_INOTIFY */
+
 	m_ReadTimer = new Timer();
 	m_ReadTimer->OnTimerExpired.connect([this](const Timer * const&) { ReadTimerHandler(); });
-	m_ReadTimer->SetInterval(5);
+	m_ReadTimer->SetInterval(interval);
+	m_ReadTimer->SetSlack(1);
 	m_ReadTimer->Start();
 #endif /* _WIN32 */
 }
@@ -63,23 +106,200 @@ void CheckResultReader::Stop(bool runtimeRemoved)
 	Log(LogInformation, "CheckResultReader")
 		<< "'" << GetName() << "' stopped.";
 
+#ifndef _WIN32
+	m_ReadTimer->Stop(true);
+
+#	ifdef HAVE_INOTIFY
+	m_Stopped.store(true);
+
+	if (m_WatchThread.joinable())
+		m_WatchThread.join();
+
+	if (m_WatchFD >= 0) {
+		(void)close(m_WatchFD);
+		m_WatchFD = -1;
+	}
+#	endif /* HAVE_INOTIFY */
+#endif /* _WIN32 */
+
 	ObjectImpl<CheckResultReader>::Stop(runtimeRemoved);
 }
 
 /**
  * @threadsafety Always.
  */
-void CheckResultReader::ReadTimerHandler() const
+void CheckResultReader::ReadTimerHandler()
 {
 	CONTEXT("Processing check result files in '" + GetSpoolDir() + "'");
 
-	Utility::Glob(GetSpoolDir() + "/c??????.ok", [this](const String& path) { ProcessCheckResultFile(path); }, GlobFile);
+	std::vector<String> paths;
+
+	Utility::Glob(GetSpoolDir() + "/c??????.ok", [&paths](const String& path) { paths.push_back(path); }, GlobFile);
+
+	ProcessCheckResultFiles(paths);
 }
 
-void CheckResultReader::ProcessCheckResultFile(const String& path) const
+#ifdef HAVE_INOTIFY
+/**
+ * Picks up check result files as soon as their ".ok" file shows up.
+ */
+void CheckResultReader::WatchThreadProc()
+{
+	Utility::SetThreadName("CR Watcher");
+
+	/* Large enough for any event, aligned like the events themselves. */
+	alignas(struct inotify_event) char buffer[64 * 1024];
+
+	while (!m_Stopped.load()) {
+		pollfd pfd;
+		pfd.fd = m_WatchFD;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		/* Wake up every now and then to notice Stop(). */
+		if (poll(&pfd, 1, 500) <= 0)
+			continue;
+
+		std::vector<String> paths;
+		bool overflow = false;
+		ssize_t length;
+
+		while ((length = read(m_WatchFD, buffer, sizeof(buffer))) > 0) {
+			for (char *p = buffer; p < buffer + length;) {
+				auto event (reinterpret_cast<const struct inotify_event *>(p));
+
+				if (event->mask & IN_Q_OVERFLOW)
+					overflow = true;
+
+				if (event->len > 0) {
+					String name = event->name;
+
+					if (name.GetLength() == 10 && name[0] == 'c' && name.SubStr(7) == ".ok")
+						paths.push_back(GetSpoolDir() + "/" + name);
+				}
+
+				p += sizeof(struct inotify_event) + event->len;
+			}
+		}
+
+		try {
+			if (overflow) {
+				ReadTimerHandler();
+			} else {
+				std::sort(paths.begin(), paths.end());
+				paths.erase(std::unique(paths.begin(), paths.end()), paths.end());
+
+				ProcessCheckResultFiles(paths);
+			}
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "CheckResultReader")
+				<< "Failed to process check result files: " << DiagnosticInformation(ex, false);
+		}
+	}
+}
+#endif /* HAVE_INOTIFY */
+
+/**
+ * Reads the check result files in parallel and processes their results.
+ * Results for different checkables are processed in parallel too, results
+ * for the same checkable in the order of their paths.
+ *
+ * @param paths The paths of the ".ok" files
+ */
+void CheckResultReader::ProcessCheckResultFiles(const std::vector<String>& paths)
+{
+	if (paths.empty())
+		return;
+
+	/* The watcher and the timer may both have seen the same files. */
+	std::unique_lock<std::mutex> lock (m_ProcessMutex);
+
+	std::mutex resultsMutex;
+	std::vector<CheckResultFile> results;
+	double lagSum = 0;
+
+	std::vector<size_t> indices (paths.size());
+
+	for (size_t i = 0; i < indices.size(); i++)
+		indices[i] = i;
+
+	m_WorkQueue.ParallelFor(indices, [this, &paths, &resultsMutex, &results, &lagSum](size_t index) {
+		CheckResultFile crf;
+		double lag;
+
+		crf.Index = index;
+
+		if (!ReadCheckResultFile(paths[index], crf, lag))
+			return;
+
+		std::unique_lock<std::mutex> lock (resultsMutex);
+		results.emplace_back(std::move(crf));
+		lagSum += lag;
+	});
+
+	m_WorkQueue.Join();
+	m_WorkQueue.ReportExceptions("CheckResultReader");
+
+	if (results.empty())
+		return;
+
+	std::sort(results.begin(), results.end(), [](const CheckResultFile& a, const CheckResultFile& b) {
+		return a.Index < b.Index;
+	});
+
+	std::map<Checkable *, std::vector<CheckResultFile *>> byCheckable;
+
+	for (auto& crf : results)
+		byCheckable[crf.Target.get()].push_back(&crf);
+
+	std::vector<std::vector<CheckResultFile *>> groups;
+	groups.reserve(byCheckable.size());
+
+	for (auto& kv : byCheckable)
+		groups.emplace_back(std::move(kv.second));
+
+	m_WorkQueue.ParallelFor(groups, [](const std::vector<CheckResultFile *>& group) {
+		for (auto crf : group) {
+			crf->Target->ProcessCheckResult(crf->Result);
+
+			Log(LogDebug, "CheckResultReader")
+				<< "Processed checkresult file for object '" << crf->Target->GetName() << "'";
+		}
+
+		/* Reschedule the next check. The side effect of this is that for as long
+		 * as we receive check result files for a host/service we won't execute any
+		 * active checks. */
+		auto& checkable (group.back()->Target);
+		checkable->SetNextCheck(Utility::GetTime() + checkable->GetCheckInterval());
+	});
+
+	m_WorkQueue.Join();
+	m_WorkQueue.ReportExceptions("CheckResultReader");
+
+	m_ProcessedFiles.InsertValue(Utility::GetTime(), results.size());
+	m_ProcessingLag.store(lagSum / results.size());
+}
+
+/**
+ * Parses and removes a check result file.
+ *
+ * @param path The path of the ".ok" file
+ * @param crf Receives the checkable and its check result
+ * @param lag Receives how long the file has waited to be picked up
+ * @returns Whether the file contained a result for an existing checkable
+ */
+bool CheckResultReader::ReadCheckResultFile(const String& path, CheckResultFile& crf, double& lag) const
 {
 	CONTEXT("Processing check result file '" + path + "'");
 
+	struct stat statbuf;
+
+	/* Already processed by a concurrent scan. */
+	if (stat(path.CStr(), &statbuf) < 0)
+		return false;
+
+	lag = std::max(0.0, Utility::GetTime() - statbuf.st_mtime);
+
 	String crfile = String(path.Begin(), path.End() - 3); /* Remove the ".ok" extension. */
 
 	std::ifstream fp;
@@ -111,15 +331,13 @@ void CheckResultReader::ProcessCheckResultFile(const String& path) const
 
 	Utility::Remove(crfile);
 
-	Checkable::Ptr checkable;
-
 	Host::Ptr host = Host::GetByName(attrs["host_name"]);
 
 	if (!host) {
 		Log(LogWarning, "CheckResultReader")
 			<< "Ignoring checkresult file for host '" << attrs["host_name"] << "': Host does not exist.";
 
-		return;
+		return false;
 	}
 
 	if (attrs.find("service_description") != attrs.end()) {
@@ -130,12 +348,12 @@ void CheckResultReader::ProcessCheckResultFile(const String& path) const
 				<< "Ignoring checkresult file for host '" << attrs["host_name"]
 				<< "', service '" << attrs["service_description"] << "': Service does not exist.";
 
-			return;
+			return false;
 		}
 
-		checkable = service;
+		crf.Target = service;
 	} else
-		checkable = host;
+		crf.Target = host;
 
 	CheckResult::Ptr result = new CheckResult();
 	String output = CompatUtility::UnEscapeString(attrs["output"]);
@@ -154,13 +372,7 @@ void CheckResultReader::ProcessCheckResultFile(const String& path) const
 	else
 		result->SetExecutionEnd(result->GetExecutionStart());
 
-	checkable->ProcessCheckResult(result);
-
-	Log(LogDebug, "CheckResultReader")
-		<< "Processed checkresult file for object '" << checkable->GetName() << "'";
+	crf.Result = result;
 
-	/* Reschedule the next check. The side effect of this is that for as long
-	 * as we receive check result files for a host/service we won't execute any
-	 * active checks. */
-	checkable->SetNextCheck(Utility::GetTime() + checkable->GetCheckInterval());
+	return true;
 }
@@ -4,8 +4,16 @@
 #define CHECKRESULTREADER_H
 
 #include "compat/checkresultreader-ti.hpp"
+#include "icinga/checkable.hpp"
+#include "base/configuration.hpp"
+#include "base/ringbuffer.hpp"
 #include "base/timer.hpp"
+#include "base/workqueue.hpp"
+#include <atomic>
 #include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace icinga
 {
@@ -28,9 +36,31 @@ protected:
 	void Stop(bool runtimeRemoved) override;
 
 private:
+	struct CheckResultFile
+	{
+		size_t Index;
+		Checkable::Ptr Target;
+		CheckResult::Ptr Result;
+	};
+
 	Timer::Ptr m_ReadTimer;
-	void ReadTimerHandler() const;
-	void ProcessCheckResultFile(const String& path) const;
+	WorkQueue m_WorkQueue{0, Configuration::Concurrency, LogNotice};
+	std::mutex m_ProcessMutex;
+
+	RingBuffer m_ProcessedFiles{15 * 60};
+	std::atomic<double> m_ProcessingLag{0};
+
+#ifdef HAVE_INOTIFY
+	int m_WatchFD{-1};
+	std::thread m_WatchThread;
+	std::atomic<bool> m_Stopped{false};
+
+	void WatchThreadProc();
+#endif /* HAVE_INOTIFY */
+
+	void ReadTimerHandler();
+	void ProcessCheckResultFiles(const std::vector<String>& paths);
+	bool ReadCheckResultFile(const String& path, CheckResultFile& crf, double& lag) const;
 };
 
 }
@@ -18,6 +18,12 @@
 #include "base/utility.hpp"
 #include "base/statsfunction.hpp"
 #include <boost/algorithm/string.hpp>
+#include <chrono>
+#ifdef _WIN32
+#include <io.h>
+#else /* _WIN32 */
+#include <unistd.h>
+#endif /* _WIN32 */
 
 using namespace icinga;
 
@@ -71,10 +77,13 @@ void CompatLogger::Start(bool runtimeCreated)
 
 	m_RotationTimer = new Timer();
 	m_RotationTimer->OnTimerExpired.connect([this](const Timer * const&) { RotationTimerHandler(); });
+	m_RotationTimer->SetSchedulerPolicy(BackgroundScheduler);
 	m_RotationTimer->Start();
 
 	ReopenFile(false);
 	ScheduleNextRotation();
+
+	m_WriterThread = std::thread([this]() { WriterThreadProc(); });
 }
 
 /**
@@ -82,6 +91,29 @@ void CompatLogger::Start(bool runtimeCreated)
  */
 void CompatLogger::Stop(bool runtimeRemoved)
 {
+	{
+		std::unique_lock<std::mutex> lock(m_QueueMutex);
+		m_Stopped = true;
+	}
+
+	m_QueueCV.notify_one();
+
+	/* The writer thread commits the remaining lines before it exits. */
+	if (m_WriterThread.joinable())
+		m_WriterThread.join();
+
+	{
+		std::unique_lock<std::mutex> fileLock(m_FileMutex);
+
+		if (m_OutputFile) {
+			if (m_SyncPending && GetFsyncPolicy() != "NEVER")
+				SyncFile();
+
+			fclose(m_OutputFile);
+			m_OutputFile = nullptr;
+		}
+	}
+
 	Log(LogInformation, "CompatLogger")
 		<< "'" << GetName() << "' stopped.";
 
@@ -145,11 +177,7 @@ void CompatLogger::CheckResultHandler(const Checkable::Ptr& checkable, const Che
 
 	}
 
-	{
-		ObjectLock olock(this);
-		WriteLine(msgbuf.str());
-		Flush();
-	}
+	WriteLine(msgbuf.str());
 }
 
 /**
@@ -181,11 +209,7 @@ void CompatLogger::TriggerDowntimeHandler(const Downtime::Ptr& downtime)
 			<< "";
 	}
 
-	{
-		ObjectLock oLock(this);
-		WriteLine(msgbuf.str());
-		Flush();
-	}
+	WriteLine(msgbuf.str());
 }
 
 /**
@@ -228,11 +252,7 @@ void CompatLogger::RemoveDowntimeHandler(const Downtime::Ptr& downtime)
 			<< "";
 	}
 
-	{
-		ObjectLock oLock(this);
-		WriteLine(msgbuf.str());
-		Flush();
-	}
+	WriteLine(msgbuf.str());
 }
 
 /**
@@ -292,11 +312,7 @@ void CompatLogger::NotificationSentHandler(const Notification::Ptr& notification
 			<< "";
 	}
 
-	{
-		ObjectLock oLock(this);
-		WriteLine(msgbuf.str());
-		Flush();
-	}
+	WriteLine(msgbuf.str());
 }
 
 /**
@@ -336,11 +352,7 @@ void CompatLogger::FlappingChangedHandler(const Checkable::Ptr& checkable)
 			<< "";
 	}
 
-	{
-		ObjectLock oLock(this);
-		WriteLine(msgbuf.str());
-		Flush();
-	}
+	WriteLine(msgbuf.str());
 }
 
 void CompatLogger::EnableFlappingChangedHandler(const Checkable::Ptr& checkable)
@@ -372,11 +384,7 @@ void CompatLogger::EnableFlappingChangedHandler(const Checkable::Ptr& checkable)
 			<< "";
 	}
 
-	{
-		ObjectLock oLock(this);
-		WriteLine(msgbuf.str());
-		Flush();
-	}
+	WriteLine(msgbuf.str());
 }
 
 void CompatLogger::ExternalCommandHandler(const String& command, const std::vector<String>& arguments)
@@ -387,11 +395,7 @@ void CompatLogger::ExternalCommandHandler(const String& command, const std::vect
 		<< boost::algorithm::join(arguments, ";")
 		<< "";
 
-	{
-		ObjectLock oLock(this);
-		WriteLine(msgbuf.str());
-		Flush();
-	}
+	WriteLine(msgbuf.str());
 }
 
 void CompatLogger::EventCommandHandler(const Checkable::Ptr& checkable)
@@ -423,11 +427,7 @@ void CompatLogger::EventCommandHandler(const Checkable::Ptr& checkable)
 			<< event_command_name;
 	}
 
-	{
-		ObjectLock oLock(this);
-		WriteLine(msgbuf.str());
-		Flush();
-	}
+	WriteLine(msgbuf.str());
 }
 
 String CompatLogger::GetHostStateString(const Host::Ptr& host)
@@ -438,24 +438,112 @@ String CompatLogger::GetHostStateString(const Host::Ptr& host)
 	return Host::StateToString(host->GetState());
 }
 
+/**
+ * Queues a line for the writer thread.
+ *
+ * @threadsafety Always.
+ */
 void CompatLogger::WriteLine(const String& line)
 {
-	ASSERT(OwnsLock());
+	String entry = "[" + Convert::ToString(static_cast<long>(Utility::GetTime())) + "] " + line + "\n";
 
-	if (!m_OutputFile.good())
-		return;
+	{
+		std::unique_lock<std::mutex> lock(m_QueueMutex);
+		m_Queue.emplace_back(std::move(entry));
+	}
 
-	m_OutputFile << "[" << (long)Utility::GetTime() << "] " << line << "\n";
+	m_QueueCV.notify_one();
 }
 
-void CompatLogger::Flush()
+/**
+ * Writes all queued lines with one write and flush per batch (group commit),
+ * so the event handlers never wait for the disk.
+ */
+void CompatLogger::WriterThreadProc()
 {
-	ASSERT(OwnsLock());
+	Utility::SetThreadName("CompatLogger");
+
+	std::unique_lock<std::mutex> lock(m_QueueMutex);
+
+	for (;;) {
+		if (m_Queue.empty() && !m_Stopped) {
+			/* A deferred periodic fsync is due after one second at the latest. */
+			if (m_SyncPending)
+				m_QueueCV.wait_for(lock, std::chrono::seconds(1));
+			else
+				m_QueueCV.wait(lock);
+		}
 
-	if (!m_OutputFile.good())
+		std::vector<String> lines;
+		std::swap(lines, m_Queue);
+
+		bool stopped = m_Stopped;
+
+		lock.unlock();
+
+		{
+			std::unique_lock<std::mutex> fileLock(m_FileMutex);
+			CommitLines(lines);
+		}
+
+		lock.lock();
+
+		if (stopped && m_Queue.empty())
+			break;
+	}
+}
+
+/**
+ * Writes lines to the log file and syncs it according to the fsync policy.
+ * The caller must hold m_FileMutex.
+ */
+void CompatLogger::CommitLines(const std::vector<String>& lines)
+{
+	if (!m_OutputFile)
 		return;
 
-	m_OutputFile << std::flush;
+	if (!lines.empty()) {
+		String buffer;
+
+		for (const String& line : lines)
+			buffer += line;
+
+		if (fwrite(buffer.CStr(), 1, buffer.GetLength(), m_OutputFile) != buffer.GetLength() || fflush(m_OutputFile) != 0) {
+			Log(LogWarning, "CompatLogger")
+				<< "Could not write to compat log file for '" << GetName() << "': " << Utility::FormatErrorNumber(errno);
+			return;
+		}
+
+		m_SyncPending = true;
+	}
+
+	String policy = GetFsyncPolicy();
+
+	if (m_SyncPending && (policy == "ALWAYS" || (policy == "PERIODIC" && Utility::GetTime() - m_LastSync >= 1)))
+		SyncFile();
+	else if (policy == "NEVER")
+		m_SyncPending = false;
+}
+
+/**
+ * Makes sure everything written to the log file has reached the disk.
+ * The caller must hold m_FileMutex.
+ */
+void CompatLogger::SyncFile()
+{
+#ifdef _WIN32
+	int rc = _commit(_fileno(m_OutputFile));
+#else /* _WIN32 */
+	int rc = fsync(fileno(m_OutputFile));
+#endif /* _WIN32 */
+
+	if (rc < 0) {
+		Log(LogWarning, "CompatLogger")
+			<< "Could not sync compat log file for '" << GetName() << "': " << Utility::FormatErrorNumber(errno);
+	}
+
+	m_LastSync = Utility::GetTime();
+	m_SyncPending = false;
 }
 
 /**
@@ -463,12 +551,26 @@ void CompatLogger::Flush()
  */
 void CompatLogger::ReopenFile(bool rotate)
 {
-	ObjectLock olock(this);
+	std::unique_lock<std::mutex> fileLock(m_FileMutex);
 
 	String tempFile = GetLogDir() + "/icinga.log";
 
 	if (m_OutputFile) {
-		m_OutputFile.close();
+		/* Lines queued before the rotation belong into the old file. */
+		std::vector<String> lines;
+
+		{
+			std::unique_lock<std::mutex> lock(m_QueueMutex);
+			std::swap(lines, m_Queue);
+		}
+
+		CommitLines(lines);
+
+		if (m_SyncPending && GetFsyncPolicy() != "NEVER")
+			SyncFile();
+
+		fclose(m_OutputFile);
+		m_OutputFile = nullptr;
 
 		if (rotate) {
 			String archiveFile = GetLogDir() + "/archives/icinga-" + Utility::FormatDateTime("%m-%d-%Y-%H", Utility::GetTime()) + ".log";
@@ -480,7 +582,7 @@ void CompatLogger::ReopenFile(bool rotate)
 		}
 	}
 
-	m_OutputFile.open(tempFile.CStr(), std::ofstream::app);
+	m_OutputFile = fopen(tempFile.CStr(), "a");
 
 	if (!m_OutputFile) {
 		Log(LogWarning, "CompatLogger")
@@ -489,8 +591,11 @@ void CompatLogger::ReopenFile(bool rotate)
 		return;
 	}
 
-	WriteLine("LOG ROTATION: " + GetRotationMethod());
-	WriteLine("LOG VERSION: 2.0");
+	std::vector<String> header;
+	String prefix = "[" + Convert::ToString(static_cast<long>(Utility::GetTime())) + "] ";
+
+	header.emplace_back(prefix + "LOG ROTATION: " + GetRotationMethod() + "\n");
+	header.emplace_back(prefix + "LOG VERSION: 2.0\n");
 
 	for (const Host::Ptr& host : ConfigType::GetObjectsByType<Host>()) {
 		String output;
@@ -500,14 +605,14 @@ void CompatLogger::ReopenFile(bool rotate)
 			output = CompatUtility::GetCheckResultOutput(cr);
 
 		std::ostringstream msgbuf;
-		msgbuf << "CURRENT HOST STATE: "
+		msgbuf << prefix << "CURRENT HOST STATE: "
 			<< host->GetName() << ";"
 			<< GetHostStateString(host) << ";"
 			<< Host::StateTypeToString(host->GetStateType()) << ";"
 			<< host->GetCheckAttempt() << ";"
-			<< output << "";
+			<< output << "" << "\n";
 
-		WriteLine(msgbuf.str());
+		header.emplace_back(msgbuf.str());
 	}
 
 	for (const Service::Ptr& service : ConfigType::GetObjectsByType<Service>()) {
@@ -520,18 +625,18 @@ void CompatLogger::ReopenFile(bool rotate)
 			output = CompatUtility::GetCheckResultOutput(cr);
 
 		std::ostringstream msgbuf;
-		msgbuf << "CURRENT SERVICE STATE: "
+		msgbuf << prefix << "CURRENT SERVICE STATE: "
 			<< host->GetName() << ";"
 			<< service->GetShortName() << ";"
 			<< Service::StateToString(service->GetState()) << ";"
 			<< Service::StateTypeToString(service->GetStateType()) << ";"
 			<< service->GetCheckAttempt() << ";"
-			<< output << "";
+			<< output << "" << "\n";
 
-		WriteLine(msgbuf.str());
+		header.emplace_back(msgbuf.str());
 	}
 
-	Flush();
+	CommitLines(header);
 }
 
 void CompatLogger::ScheduleNextRotation()
@@ -601,6 +706,15 @@ void CompatLogger::RotationTimerHandler()
 	ScheduleNextRotation();
 }
 
+void CompatLogger::ValidateFsyncPolicy(const Lazy<String>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<CompatLogger>::ValidateFsyncPolicy(lvalue, utils);
+
+	if (lvalue() != "NEVER" && lvalue() != "PERIODIC" && lvalue() != "ALWAYS") {
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "fsync_policy" }, "Fsync policy '" + lvalue() + "' is invalid."));
+	}
+}
+
 void CompatLogger::ValidateRotationMethod(const Lazy<String>& lvalue, const ValidationUtils& utils)
 {
 	ObjectImpl<CompatLogger>::ValidateRotationMethod(lvalue, utils);
@@ -6,7 +6,12 @@
 #include "compat/compatlogger-ti.hpp"
 #include "icinga/service.hpp"
 #include "base/timer.hpp"
-#include <fstream>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace icinga
 {
@@ -25,6 +30,7 @@ public:
 	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 
 	void ValidateRotationMethod(const Lazy<String>& lvalue, const ValidationUtils& utils) override;
+	void ValidateFsyncPolicy(const Lazy<String>& lvalue, const ValidationUtils& utils) override;
 
 protected:
 	void Start(bool runtimeCreated) override;
@@ -32,7 +38,6 @@ protected:
 
 private:
 	void WriteLine(const String& line);
-	void Flush();
 
 	void CheckResultHandler(const Checkable::Ptr& service, const CheckResult::Ptr& cr);
 	void NotificationSentHandler(const Notification::Ptr& notification, const Checkable::Ptr& service,
@@ -51,7 +56,20 @@ private:
 	void RotationTimerHandler();
 	void ScheduleNextRotation();
 
-	std::ofstream m_OutputFile;
+	/* Lines are queued by the event handlers and written by the writer thread in batches. */
+	std::mutex m_QueueMutex;
+	std::condition_variable m_QueueCV;
+	std::vector<String> m_Queue;
+	bool m_Stopped{false};
+	std::thread m_WriterThread;
+	void WriterThreadProc();
+
+	std::mutex m_FileMutex;
+	FILE *m_OutputFile{nullptr};
+	double m_LastSync{0};
+	std::atomic<bool> m_SyncPending{false};
+	void CommitLines(const std::vector<String>& lines);
+	void SyncFile();
 	void ReopenFile(bool rotate);
 };
 
@@ -8,6 +8,7 @@
 #include "base/exception.hpp"
 #include "base/application.hpp"
 #include "base/statsfunction.hpp"
+#include <cstring>
 
 using namespace icinga;
 
@@ -15,6 +16,11 @@ REGISTER_TYPE(ExternalCommandListener);
 
 REGISTER_STATSFUNCTION(ExternalCommandListener, &ExternalCommandListener::StatsFunc);
 
+#ifndef _WIN32
+/* Every read hands up to this many bytes worth of lines to ExecuteBatch(). */
+static const size_t l_CommandPipeReadSize = 64 * 1024;
+#endif /* _WIN32 */
+
 void ExternalCommandListener::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
 {
 	DictionaryData nodes;
@@ -97,18 +103,20 @@ void ExternalCommandListener::CommandPipeThread(const String& commandPath)
 			return;
 		}
 
-		FIFO::Ptr fifo = new FIFO();
 		Socket::Ptr sock = new Socket(fd);
-		StreamReadContext src;
+		std::vector<char> buffer;
+		size_t used = 0;
 
 		for (;;) {
 			sock->Poll(true, false);
 
-			char buffer[8192];
+			if (buffer.size() - used < l_CommandPipeReadSize)
+				buffer.resize(used + l_CommandPipeReadSize);
+
 			size_t rc;
 
 			try {
-				rc = sock->Read(buffer, sizeof(buffer));
+				rc = sock->Read(&buffer[used], l_CommandPipeReadSize);
 			} catch (const std::exception& ex) {
 				/* We have read all data. */
 				if (errno == EAGAIN)
@@ -123,27 +131,30 @@ void ExternalCommandListener::CommandPipeThread(const String& commandPath)
 			if (rc == 0)
 				continue;
 
-			fifo->Write(buffer, rc);
+			used += rc;
+
+			/* The lines are views into the buffer, the partial line at its end is kept for the next read. */
+			std::vector<boost::string_view> lines;
+			const char *begin = &buffer[0];
+			const char *end = begin + used;
 
 			for (;;) {
-				String command;
-				StreamReadStatus srs = fifo->ReadLine(&command, src);
+				auto eol (static_cast<const char *>(memchr(begin, '\n', end - begin)));
 
-				if (srs != StatusNewItem)
+				if (!eol)
 					break;
 
-				try {
-					Log(LogInformation, "ExternalCommandListener")
-						<< "Executing external command: " << command;
-
-					ExternalCommandProcessor::Execute(command);
-				} catch (const std::exception& ex) {
-					Log(LogWarning, "ExternalCommandListener")
-						<< "External command failed: " << DiagnosticInformation(ex, false);
-					Log(LogNotice, "ExternalCommandListener")
-						<< "External command failed: " << DiagnosticInformation(ex, true);
-				}
+				lines.emplace_back(begin, eol - begin);
+				begin = eol + 1;
 			}
+
+			if (lines.empty())
+				continue;
+
+			ExternalCommandProcessor::ExecuteBatch(lines, m_CommandQueue);
+
+			used = end - begin;
+			std::copy(begin, end, buffer.begin());
 		}
 	}
 }
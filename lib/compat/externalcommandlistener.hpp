@@ -4,9 +4,11 @@
 #define EXTERNALCOMMANDLISTENER_H
 
 #include "compat/externalcommandlistener-ti.hpp"
+#include "base/configuration.hpp"
 #include "base/objectlock.hpp"
 #include "base/timer.hpp"
 #include "base/utility.hpp"
+#include "base/workqueue.hpp"
 #include <thread>
 #include <iostream>
 
@@ -31,6 +33,7 @@ protected:
 private:
 #ifndef _WIN32
 	std::thread m_CommandThread;
+	WorkQueue m_CommandQueue{0, Configuration::Concurrency, LogNotice};
 
 	void CommandPipeThread(const String& commandPath);
 #endif /* _WIN32 */
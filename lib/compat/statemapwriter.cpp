@@ -0,0 +1,254 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "compat/statemapwriter.hpp"
+#include "compat/statemapwriter-ti.cpp"
+#include "icinga/host.hpp"
+#include "icinga/service.hpp"
+#include "icinga/downtime.hpp"
+#include "base/configtype.hpp"
+#include "base/exception.hpp"
+#include "base/logger.hpp"
+#include "base/statsfunction.hpp"
+#include <vector>
+
+using namespace icinga;
+
+REGISTER_TYPE(StateMapWriter);
+
+REGISTER_STATSFUNCTION(StateMapWriter, &StateMapWriter::StatsFunc);
+
+#ifndef _WIN32
+/* Hosts and services which have been added or removed are picked up after at most this many seconds. */
+static const double l_RebuildInterval = 5;
+#endif /* _WIN32 */
+
+void StateMapWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+{
+	DictionaryData nodes;
+
+	for (const StateMapWriter::Ptr& statemapwriter : ConfigType::GetObjectsByType<StateMapWriter>()) {
+#ifndef _WIN32
+		std::shared_ptr<StateMap> map;
+
+		{
+			std::unique_lock<std::mutex> lock (statemapwriter->m_Mutex);
+			map = statemapwriter->m_Map;
+		}
+
+		nodes.emplace_back(statemapwriter->GetName(), new Dictionary({
+			{ "records", map ? map->GetCount() : 0 },
+			{ "size", map ? map->GetSize() : 0 },
+			{ "updates", statemapwriter->m_Updates.load() },
+			{ "rebuilds", statemapwriter->m_Rebuilds.load() }
+		}));
+#else /* _WIN32 */
+		nodes.emplace_back(statemapwriter->GetName(), 1);
+#endif /* _WIN32 */
+	}
+
+	status->Set("statemapwriter", new Dictionary(std::move(nodes)));
+}
+
+void StateMapWriter::ValidateOutputSize(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<StateMapWriter>::ValidateOutputSize(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "output_size" }, "Value must not be negative."));
+}
+
+/**
+ * Starts the component.
+ */
+void StateMapWriter::Start(bool runtimeCreated)
+{
+	ObjectImpl<StateMapWriter>::Start(runtimeCreated);
+
+	Log(LogInformation, "StateMapWriter")
+		<< "'" << GetName() << "' started.";
+
+#ifndef _WIN32
+	Checkable::OnNewCheckResult.connect([this](const Checkable::Ptr& checkable, const CheckResult::Ptr&, const MessageOrigin::Ptr&) {
+		UpdateCheckable(checkable);
+	});
+	Checkable::OnAcknowledgementSet.connect([this](const Checkable::Ptr& checkable, const String&, const String&,
+		AcknowledgementType, bool, bool, double, double, const MessageOrigin::Ptr&) {
+		UpdateCheckable(checkable);
+	});
+	Checkable::OnAcknowledgementCleared.connect([this](const Checkable::Ptr& checkable, const String&, double, const MessageOrigin::Ptr&) {
+		UpdateCheckable(checkable);
+	});
+	Checkable::OnDowntimeDepthChanged.connect([this](const Checkable::Ptr& checkable, const Value&) {
+		UpdateCheckable(checkable);
+	});
+	Checkable::OnFlappingChange.connect([this](const Checkable::Ptr& checkable, double) { UpdateCheckable(checkable); });
+	Checkable::OnReachabilityChanged.connect([this](const Checkable::Ptr&, const CheckResult::Ptr&,
+		std::set<Checkable::Ptr> children, const MessageOrigin::Ptr&) {
+		for (const Checkable::Ptr& child : children)
+			UpdateCheckable(child);
+	});
+
+	/* The set of records is fixed, so added and removed objects require a new file. */
+	ConfigObject::OnActiveChanged.connect([this](const ConfigObject::Ptr& object, const Value&) {
+		if (dynamic_pointer_cast<Checkable>(object))
+			m_LayoutOutdated.store(true);
+	});
+
+	m_RebuildTimer = new Timer();
+	m_RebuildTimer->SetInterval(l_RebuildInterval);
+	m_RebuildTimer->OnTimerExpired.connect([this](const Timer * const&) { RebuildTimerHandler(); });
+	m_RebuildTimer->SetSchedulerPolicy(BackgroundScheduler);
+	m_RebuildTimer->Start();
+	m_RebuildTimer->Reschedule(0);
+#else /* _WIN32 */
+	Log(LogWarning, "StateMapWriter")
+		<< "Exporting the state into shared memory isn't supported on Windows.";
+#endif /* _WIN32 */
+}
+
+/**
+ * Stops the component. The file is left as is for readers.
+ */
+void StateMapWriter::Stop(bool runtimeRemoved)
+{
+	Log(LogInformation, "StateMapWriter")
+		<< "'" << GetName() << "' stopped.";
+
+#ifndef _WIN32
+	m_RebuildTimer->Stop(true);
+
+	{
+		std::unique_lock<std::mutex> lock (m_Mutex);
+		m_Map.reset();
+		m_Indexes.clear();
+	}
+#endif /* _WIN32 */
+
+	ObjectImpl<StateMapWriter>::Stop(runtimeRemoved);
+}
+
+#ifndef _WIN32
+void StateMapWriter::RebuildTimerHandler()
+{
+	if (!m_LayoutOutdated.exchange(false))
+		return;
+
+	try {
+		Rebuild();
+	} catch (const std::exception& ex) {
+		m_LayoutOutdated.store(true);
+
+		Log(LogCritical, "StateMapWriter")
+			<< "Cannot write state map '" << GetPath() << "': " << DiagnosticInformation(ex, false);
+	}
+}
+
+/**
+ * Replaces the file with one which contains a record for each active host and service.
+ */
+void StateMapWriter::Rebuild()
+{
+	std::vector<Checkable::Ptr> checkables;
+	std::vector<std::pair<StateMap::RecordType, String>> objects;
+
+	for (const Host::Ptr& host : ConfigType::GetObjectsByType<Host>()) {
+		if (host->IsActive()) {
+			checkables.emplace_back(host);
+			objects.emplace_back(StateMap::RecordHost, host->GetName());
+		}
+	}
+
+	for (const Service::Ptr& service : ConfigType::GetObjectsByType<Service>()) {
+		if (service->IsActive()) {
+			checkables.emplace_back(service);
+			objects.emplace_back(StateMap::RecordService, service->GetName());
+		}
+	}
+
+	std::shared_ptr<StateMap> map (new StateMap(GetPath(), objects, GetOutputSize()));
+	std::unordered_map<Checkable::Ptr, size_t> indexes;
+
+	indexes.reserve(checkables.size());
+
+	for (size_t i = 0; i < checkables.size(); i++)
+		indexes.emplace(checkables[i], i);
+
+	/* Updates go to the new file from now on, so none of them are lost while it's filled. */
+	{
+		std::unique_lock<std::mutex> lock (m_Mutex);
+		m_Map = map;
+		m_Indexes = std::move(indexes);
+	}
+
+	for (size_t i = 0; i < checkables.size(); i++)
+		map->Update(i, GetEntry(checkables[i]));
+
+	map->Publish();
+	m_Rebuilds++;
+
+	Log(LogNotice, "StateMapWriter")
+		<< "Wrote state map '" << GetPath() << "' with " << checkables.size() << " records.";
+}
+
+void StateMapWriter::UpdateCheckable(const Checkable::Ptr& checkable)
+{
+	std::shared_ptr<StateMap> map;
+	size_t index;
+
+	{
+		std::unique_lock<std::mutex> lock (m_Mutex);
+
+		auto it (m_Indexes.find(checkable));
+
+		if (it == m_Indexes.end())
+			return;
+
+		map = m_Map;
+		index = it->second;
+	}
+
+	map->Update(index, GetEntry(checkable));
+	m_Updates++;
+}
+
+StateMap::Entry StateMapWriter::GetEntry(const Checkable::Ptr& checkable)
+{
+	StateMap::Entry entry;
+	Host::Ptr host;
+	Service::Ptr service;
+	tie(host, service) = GetHostService(checkable);
+
+	if (service) {
+		entry.Type = StateMap::RecordService;
+		entry.State = service->GetState();
+	} else {
+		entry.Type = StateMap::RecordHost;
+		entry.State = host->GetState();
+	}
+
+	entry.StateType = checkable->GetStateType();
+	entry.CheckAttempt = checkable->GetCheckAttempt();
+	entry.LastCheck = checkable->GetLastCheck();
+	entry.LastStateChange = checkable->GetLastStateChange();
+
+	if (checkable->IsAcknowledged())
+		entry.Flags |= StateMap::FlagAcknowledged;
+
+	if (checkable->IsInDowntime())
+		entry.Flags |= StateMap::FlagInDowntime;
+
+	if (checkable->IsFlapping())
+		entry.Flags |= StateMap::FlagFlapping;
+
+	/* What the last check result saw, evaluating the dependencies again would be too expensive here. */
+	if (!checkable->GetLastReachable())
+		entry.Flags |= StateMap::FlagUnreachable;
+
+	CheckResult::Ptr cr = checkable->GetLastCheckResult();
+
+	if (cr)
+		entry.Output = cr->GetOutput();
+
+	return entry;
+}
+#endif /* _WIN32 */
@@ -0,0 +1,61 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef STATEMAPWRITER_H
+#define STATEMAPWRITER_H
+
+#include "compat/statemapwriter-ti.hpp"
+#include "icinga/checkable.hpp"
+#include "icinga/statemap.hpp"
+#include "base/timer.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace icinga
+{
+
+/**
+ * Exports the state of all hosts and services into a StateMap which local
+ * consumers map into their memory.
+ *
+ * @ingroup compat
+ */
+class StateMapWriter final : public ObjectImpl<StateMapWriter>
+{
+public:
+	DECLARE_OBJECT(StateMapWriter);
+	DECLARE_OBJECTNAME(StateMapWriter);
+
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+
+	void ValidateOutputSize(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+
+protected:
+	void Start(bool runtimeCreated) override;
+	void Stop(bool runtimeRemoved) override;
+
+private:
+#ifndef _WIN32
+	Timer::Ptr m_RebuildTimer;
+	std::atomic<bool> m_LayoutOutdated{true};
+
+	std::mutex m_Mutex;
+	std::shared_ptr<StateMap> m_Map;
+	std::unordered_map<Checkable::Ptr, size_t> m_Indexes;
+
+	std::atomic<uint_fast64_t> m_Updates{0};
+	std::atomic<uint_fast64_t> m_Rebuilds{0};
+
+	void RebuildTimerHandler();
+	void Rebuild();
+	void UpdateCheckable(const Checkable::Ptr& checkable);
+
+	static StateMap::Entry GetEntry(const Checkable::Ptr& checkable);
+#endif /* _WIN32 */
+};
+
+}
+
+#endif /* STATEMAPWRITER_H */
@@ -13,6 +13,9 @@
 #include "icinga/compatutility.hpp"
 #include "icinga/pluginutility.hpp"
 #include "icinga/dependency.hpp"
+#include "icinga/downtime.hpp"
+#include "icinga/comment.hpp"
+#include "icinga/notification.hpp"
 #include "base/configtype.hpp"
 #include "base/objectlock.hpp"
 #include "base/json.hpp"
@@ -32,6 +35,9 @@ REGISTER_TYPE(StatusDataWriter);
 
 REGISTER_STATSFUNCTION(StatusDataWriter, &StatusDataWriter::StatsFunc);
 
+/* Status blocks are rendered again after this many seconds even if no change was signalled. */
+static const double l_StatusBlockMaxAge = 300;
+
 void StatusDataWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
 {
 	DictionaryData nodes;
@@ -66,12 +72,78 @@ void StatusDataWriter::Start(bool runtimeCreated)
 
 	m_StatusTimer = new Timer();
 	m_StatusTimer->SetInterval(GetUpdateInterval());
+	m_StatusTimer->SetSlack(1);
 	m_StatusTimer->OnTimerExpired.connect([this](const Timer * const&){ StatusTimerHandler(); });
+	m_StatusTimer->SetSchedulerPolicy(BackgroundScheduler);
 	m_StatusTimer->Start();
 	m_StatusTimer->Reschedule(0);
 
-	ConfigObject::OnVersionChanged.connect([this](const ConfigObject::Ptr&, const Value&) { ObjectHandler(); });
+	ConfigObject::OnVersionChanged.connect([this](const ConfigObject::Ptr& object, const Value&) {
+		ObjectHandler();
+
+		auto checkable (dynamic_pointer_cast<Checkable>(object));
+
+		if (checkable)
+			MarkDirty(checkable);
+	});
+
 	ConfigObject::OnActiveChanged.connect([this](const ConfigObject::Ptr&, const Value&) { ObjectHandler(); });
+
+	/* Only the status of checkables which changed is rendered again, see StatusTimerHandler(). */
+	ConfigObject::OnStateChanged.connect([this](const ConfigObject::Ptr& object) {
+		auto checkable (dynamic_pointer_cast<Checkable>(object));
+
+		if (checkable)
+			MarkDirty(checkable);
+	});
+
+	auto markDirty ([this](const Checkable::Ptr& checkable, const Value&) { MarkDirty(checkable); });
+
+	Checkable::OnNextCheckChanged.connect(markDirty);
+	Checkable::OnDowntimeDepthChanged.connect(markDirty);
+	Checkable::OnLastReachableChanged.connect(markDirty);
+	Checkable::OnCheckIntervalChanged.connect(markDirty);
+	Checkable::OnRetryIntervalChanged.connect(markDirty);
+	Checkable::OnMaxCheckAttemptsChanged.connect(markDirty);
+	Checkable::OnEnableActiveChecksChanged.connect(markDirty);
+	Checkable::OnEnablePassiveChecksChanged.connect(markDirty);
+	Checkable::OnEnableNotificationsChanged.connect(markDirty);
+	Checkable::OnEnableFlappingChanged.connect(markDirty);
+	Checkable::OnEnableEventHandlerChanged.connect(markDirty);
+
+	Checkable::OnAcknowledgementSet.connect([this](const Checkable::Ptr& checkable, const String&, const String&,
+		AcknowledgementType, bool, bool, double, double, const MessageOrigin::Ptr&) {
+		MarkDirty(checkable);
+	});
+	Checkable::OnAcknowledgementCleared.connect([this](const Checkable::Ptr& checkable, const String&, double, const MessageOrigin::Ptr&) {
+		MarkDirty(checkable);
+	});
+	Checkable::OnFlappingChange.connect([this](const Checkable::Ptr& checkable, double) { MarkDirty(checkable); });
+	Checkable::OnReachabilityChanged.connect([this](const Checkable::Ptr&, const CheckResult::Ptr&,
+		std::set<Checkable::Ptr> children, const MessageOrigin::Ptr&) {
+		for (const Checkable::Ptr& child : children)
+			MarkDirty(child);
+	});
+	Checkable::OnNotificationSentToAllUsers.connect([this](const Notification::Ptr&, const Checkable::Ptr& checkable,
+		const std::set<User::Ptr>&, const NotificationType&, const CheckResult::Ptr&, const String&, const String&,
+		const MessageOrigin::Ptr&) {
+		MarkDirty(checkable);
+	});
+	Notification::OnNextNotificationChanged.connect([this](const Notification::Ptr& notification, const MessageOrigin::Ptr&) {
+		MarkDirty(notification->GetCheckable());
+	});
+
+	auto downtimeChanged ([this](const Downtime::Ptr& downtime) { MarkDirty(downtime->GetCheckable()); });
+
+	Downtime::OnDowntimeAdded.connect(downtimeChanged);
+	Downtime::OnDowntimeRemoved.connect(downtimeChanged);
+	Downtime::OnDowntimeStarted.connect(downtimeChanged);
+	Downtime::OnDowntimeTriggered.connect(downtimeChanged);
+
+	auto commentChanged ([this](const Comment::Ptr& comment) { MarkDirty(comment->GetCheckable()); });
+
+	Comment::OnCommentAdded.connect(commentChanged);
+	Comment::OnCommentRemoved.connect(commentChanged);
 }
 
 /**
@@ -187,24 +259,24 @@ void StatusDataWriter::DumpDowntimes(std::ostream& fp, const Checkable::Ptr& che
 	}
 }
 
-void StatusDataWriter::DumpHostStatus(std::ostream& fp, const Host::Ptr& host)
+/**
+ * Dumps a host's status. Everything after the value of last_update goes to the tail.
+ */
+void StatusDataWriter::DumpHostStatus(std::ostream& fp, std::ostream& tail, const Host::Ptr& host)
 {
 	fp << "hoststatus {" "\n" "\t" "host_name=" << host->GetName() << "\n";
 
-	{
-		ObjectLock olock(host);
-		DumpCheckableStatusAttrs(fp, host);
-	}
+	DumpCheckableStatusAttrs(fp, tail, host);
 
 	/* ugly but cgis parse only that */
-	fp << "\t" "last_time_up=" << host->GetLastStateUp() << "\n"
+	tail << "\t" "last_time_up=" << host->GetLastStateUp() << "\n"
 		"\t" "last_time_down=" << host->GetLastStateDown() << "\n"
 		"\t" "last_time_unreachable=" << host->GetLastStateUnreachable() << "\n";
 
-	fp << "\t" "}" "\n" "\n";
+	tail << "\t" "}" "\n" "\n";
 
-	DumpDowntimes(fp, host);
-	DumpComments(fp, host);
+	DumpDowntimes(tail, host);
+	DumpComments(tail, host);
 }
 
 void StatusDataWriter::DumpHostObject(std::ostream& fp, const Host::Ptr& host)
@@ -314,9 +386,15 @@ void StatusDataWriter::DumpHostObject(std::ostream& fp, const Host::Ptr& host)
 	fp << "\t" "}" "\n" "\n";
 }
 
-void StatusDataWriter::DumpCheckableStatusAttrs(std::ostream& fp, const Checkable::Ptr& checkable)
+/**
+ * Dumps the status attributes shared by hosts and services up to "last_update=",
+ * the attributes after its value go to the tail.
+ */
+void StatusDataWriter::DumpCheckableStatusAttrs(std::ostream& fp, std::ostream& tail, const Checkable::Ptr& checkable)
 {
-	CheckResult::Ptr cr = checkable->GetLastCheckResult();
+	/* Consistent with itself even while check results are being processed. */
+	CheckableStateRecord::ConstPtr state = checkable->GetStateRecord();
+	CheckResult::Ptr cr = state->LastCheckResult;
 
 	EventCommand::Ptr eventcommand = checkable->GetEventCommand();
 	CheckCommand::Ptr checkcommand = checkable->GetCheckCommand();
@@ -343,25 +421,25 @@ void StatusDataWriter::DumpCheckableStatusAttrs(std::ostream& fp, const Checkabl
 	tie(host, service) = GetHostService(checkable);
 
 	if (service) {
-		fp << "\t" "current_state=" << service->GetState() << "\n"
-			"\t" "last_hard_state=" << service->GetLastHardState() << "\n"
+		fp << "\t" "current_state=" << state->State << "\n"
+			"\t" "last_hard_state=" << state->LastHardState << "\n"
 			"\t" "last_time_ok=" << static_cast<int>(service->GetLastStateOK()) << "\n"
 			"\t" "last_time_warn=" << static_cast<int>(service->GetLastStateWarning()) << "\n"
 			"\t" "last_time_critical=" << static_cast<int>(service->GetLastStateCritical()) << "\n"
 			"\t" "last_time_unknown=" << static_cast<int>(service->GetLastStateUnknown()) << "\n";
 	} else {
-		int currentState = host->GetState();
+		int currentState = Host::CalculateState(state->State);
 
 		if (currentState != HostUp && !host->IsReachable())
 			currentState = 2; /* hardcoded compat state */
 
 		fp << "\t" "current_state=" << currentState << "\n"
-			"\t" "last_hard_state=" << host->GetLastHardState() << "\n"
+			"\t" "last_hard_state=" << Host::CalculateState(state->LastHardState) << "\n"
 			"\t" "last_time_up=" << static_cast<int>(host->GetLastStateUp()) << "\n"
 			"\t" "last_time_down=" << static_cast<int>(host->GetLastStateDown()) << "\n";
 	}
 
-	fp << "\t" "state_type=" << checkable->GetStateType() << "\n"
+	fp << "\t" "state_type=" << state->CurrentStateType << "\n"
 		"\t" "last_check=" << static_cast<long>(host->GetLastCheck()) << "\n";
 
 	if (cr) {
@@ -371,20 +449,22 @@ void StatusDataWriter::DumpCheckableStatusAttrs(std::ostream& fp, const Checkabl
 	}
 
 	fp << "\t" << "next_check=" << static_cast<long>(checkable->GetNextCheck()) << "\n"
-		"\t" "current_attempt=" << checkable->GetCheckAttempt() << "\n"
+		"\t" "current_attempt=" << state->CheckAttempt << "\n"
 		"\t" "max_attempts=" << checkable->GetMaxCheckAttempts() << "\n"
-		"\t" "last_state_change=" << static_cast<long>(checkable->GetLastStateChange()) << "\n"
-		"\t" "last_hard_state_change=" << static_cast<long>(checkable->GetLastHardStateChange()) << "\n"
-		"\t" "last_update=" << static_cast<long>(Utility::GetTime()) << "\n"
+		"\t" "last_state_change=" << static_cast<long>(state->LastStateChange) << "\n"
+		"\t" "last_hard_state_change=" << static_cast<long>(state->LastHardStateChange) << "\n"
+		"\t" "last_update=";
+
+	tail << "\n"
 		"\t" "notifications_enabled=" << Convert::ToLong(checkable->GetEnableNotifications()) << "\n"
 		"\t" "active_checks_enabled=" << Convert::ToLong(checkable->GetEnableActiveChecks()) << "\n"
 		"\t" "passive_checks_enabled=" << Convert::ToLong(checkable->GetEnablePassiveChecks()) << "\n"
 		"\t" "flap_detection_enabled=" << Convert::ToLong(checkable->GetEnableFlapping()) << "\n"
-		"\t" "is_flapping=" << Convert::ToLong(checkable->IsFlapping()) << "\n"
-		"\t" "percent_state_change=" << checkable->GetFlappingCurrent() << "\n"
-		"\t" "problem_has_been_acknowledged=" << (checkable->GetAcknowledgement() != AcknowledgementNone ? 1 : 0) << "\n"
-		"\t" "acknowledgement_type=" << checkable->GetAcknowledgement() << "\n"
-		"\t" "acknowledgement_end_time=" << checkable->GetAcknowledgementExpiry() << "\n"
+		"\t" "is_flapping=" << Convert::ToLong(state->Flapping) << "\n"
+		"\t" "percent_state_change=" << state->FlappingCurrent << "\n"
+		"\t" "problem_has_been_acknowledged=" << (state->GetAcknowledgement() != AcknowledgementNone ? 1 : 0) << "\n"
+		"\t" "acknowledgement_type=" << state->GetAcknowledgement() << "\n"
+		"\t" "acknowledgement_end_time=" << state->AcknowledgementExpiry << "\n"
 		"\t" "scheduled_downtime_depth=" << checkable->GetDowntimeDepth() << "\n"
 		"\t" "last_notification=" << CompatUtility::GetCheckableNotificationLastNotification(checkable) << "\n"
 		"\t" "next_notification=" << CompatUtility::GetCheckableNotificationNextNotification(checkable) << "\n"
@@ -392,7 +472,10 @@ void StatusDataWriter::DumpCheckableStatusAttrs(std::ostream& fp, const Checkabl
 		"\t" "is_reachable=" << Convert::ToLong(checkable->IsReachable()) << "\n";
 }
 
-void StatusDataWriter::DumpServiceStatus(std::ostream& fp, const Service::Ptr& service)
+/**
+ * Dumps a service's status. Everything after the value of last_update goes to the tail.
+ */
+void StatusDataWriter::DumpServiceStatus(std::ostream& fp, std::ostream& tail, const Service::Ptr& service)
 {
 	Host::Ptr host = service->GetHost();
 
@@ -400,15 +483,12 @@ void StatusDataWriter::DumpServiceStatus(std::ostream& fp, const Service::Ptr& s
 		"\t" "host_name=" << host->GetName() << "\n"
 		"\t" "service_description=" << service->GetShortName() << "\n";
 
-	{
-		ObjectLock olock(service);
-		DumpCheckableStatusAttrs(fp, service);
-	}
+	DumpCheckableStatusAttrs(fp, tail, service);
 
-	fp << "\t" "}" "\n" "\n";
+	tail << "\t" "}" "\n" "\n";
 
-	DumpDowntimes(fp, service);
-	DumpComments(fp, service);
+	DumpDowntimes(tail, service);
+	DumpComments(tail, service);
 }
 
 void StatusDataWriter::DumpServiceObject(std::ostream& fp, const Service::Ptr& service)
@@ -819,17 +899,27 @@ void StatusDataWriter::StatusTimerHandler()
 	statusfp << "\t" "}" "\n"
 			"\n";
 
-	for (const Host::Ptr& host : ConfigType::GetObjectsByType<Host>()) {
-		std::ostringstream tempstatusfp;
-		tempstatusfp << std::fixed;
-		DumpHostStatus(tempstatusfp, host);
-		statusfp << tempstatusfp.str();
+	std::set<Checkable::Ptr> dirty;
+
+	{
+		std::unique_lock<std::mutex> lock (m_DirtyCheckablesMutex);
+		std::swap(dirty, m_DirtyCheckables);
+	}
+
+	/* Blocks of deleted objects are dropped by not carrying them over. */
+	std::map<Checkable::Ptr, StatusBlock> blocks;
+	size_t rendered = 0;
+	String lastUpdate = Convert::ToString(static_cast<long>(start));
+
+	for (Host::Ptr host : ConfigType::GetObjectsViewByType<Host>()) {
+		const StatusBlock& hostBlock = GetStatusBlock(blocks, host, dirty, start, rendered);
+
+		statusfp << hostBlock.Head << lastUpdate << hostBlock.Tail;
 
 		for (const Service::Ptr& service : host->GetServices()) {
-			std::ostringstream tempstatusfp;
-			tempstatusfp << std::fixed;
-			DumpServiceStatus(tempstatusfp, service);
-			statusfp << tempstatusfp.str();
+			const StatusBlock& serviceBlock = GetStatusBlock(blocks, service, dirty, start, rendered);
+
+			statusfp << serviceBlock.Head << lastUpdate << serviceBlock.Tail;
 		}
 	}
 
@@ -838,7 +928,52 @@ void StatusDataWriter::StatusTimerHandler()
 	Utility::RenameFile(tempStatusPath, statusPath);
 
 	Log(LogNotice, "StatusDataWriter")
-		<< "Writing status.dat file took " << Utility::FormatDuration(Utility::GetTime() - start);
+		<< "Writing status.dat file took " << Utility::FormatDuration(Utility::GetTime() - start)
+		<< ", rendered the status of " << rendered << " out of " << blocks.size() << " objects";
+
+	m_StatusBlocks = std::move(blocks);
+}
+
+/**
+ * Returns the rendered status of a checkable, rendering it again if it changed since the last write.
+ *
+ * @param blocks The blocks of the current write, the returned one is added to them
+ * @param checkable The host or service
+ * @param dirty The checkables which changed since the last write
+ * @param now The time of the current write
+ * @param rendered Counts the blocks rendered again
+ */
+const StatusDataWriter::StatusBlock& StatusDataWriter::GetStatusBlock(std::map<Checkable::Ptr, StatusBlock>& blocks,
+	const Checkable::Ptr& checkable, const std::set<Checkable::Ptr>& dirty, double now, size_t& rendered)
+{
+	auto& block (blocks[checkable]);
+	auto cached (m_StatusBlocks.find(checkable));
+
+	if (cached != m_StatusBlocks.end() && dirty.find(checkable) == dirty.end()
+		&& now - cached->second.RenderedAt < l_StatusBlockMaxAge) {
+		block = std::move(cached->second);
+		return block;
+	}
+
+	std::ostringstream head, tail;
+	head << std::fixed;
+	tail << std::fixed;
+
+	Host::Ptr host;
+	Service::Ptr service;
+	tie(host, service) = GetHostService(checkable);
+
+	if (service)
+		DumpServiceStatus(head, tail, service);
+	else
+		DumpHostStatus(head, tail, host);
+
+	block.Head = head.str();
+	block.Tail = tail.str();
+	block.RenderedAt = now;
+	rendered++;
+
+	return block;
 }
 
 void StatusDataWriter::ObjectHandler()
@@ -846,6 +981,15 @@ void StatusDataWriter::ObjectHandler()
 	m_ObjectsCacheOutdated = true;
 }
 
+void StatusDataWriter::MarkDirty(const Checkable::Ptr& checkable)
+{
+	if (!checkable)
+		return;
+
+	std::unique_lock<std::mutex> lock (m_DirtyCheckablesMutex);
+	m_DirtyCheckables.insert(checkable);
+}
+
 String StatusDataWriter::GetNotificationOptions(const Checkable::Ptr& checkable)
 {
 	Host::Ptr host;
@@ -12,6 +12,9 @@
 #include "base/timer.hpp"
 #include "base/utility.hpp"
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
 
 namespace icinga
 {
@@ -32,17 +35,32 @@ protected:
 	void Stop(bool runtimeRemoved) override;
 
 private:
+	/**
+	 * The rendered status of a checkable including its downtimes and comments,
+	 * split around the value of last_update which is filled in on every write.
+	 */
+	struct StatusBlock
+	{
+		String Head;
+		String Tail;
+		double RenderedAt;
+	};
+
 	Timer::Ptr m_StatusTimer;
 	bool m_ObjectsCacheOutdated;
 
+	std::map<Checkable::Ptr, StatusBlock> m_StatusBlocks;
+	std::mutex m_DirtyCheckablesMutex;
+	std::set<Checkable::Ptr> m_DirtyCheckables;
+
 	void DumpCommand(std::ostream& fp, const Command::Ptr& command);
 	void DumpTimePeriod(std::ostream& fp, const TimePeriod::Ptr& tp);
 	void DumpDowntimes(std::ostream& fp, const Checkable::Ptr& owner);
 	void DumpComments(std::ostream& fp, const Checkable::Ptr& owner);
-	void DumpHostStatus(std::ostream& fp, const Host::Ptr& host);
+	void DumpHostStatus(std::ostream& fp, std::ostream& tail, const Host::Ptr& host);
 	void DumpHostObject(std::ostream& fp, const Host::Ptr& host);
 
-	void DumpCheckableStatusAttrs(std::ostream& fp, const Checkable::Ptr& checkable);
+	void DumpCheckableStatusAttrs(std::ostream& fp, std::ostream& tail, const Checkable::Ptr& checkable);
 
 	template<typename T>
 	void DumpNameList(std::ostream& fp, const T& list)
@@ -72,7 +90,7 @@ private:
 		}
 	}
 
-	void DumpServiceStatus(std::ostream& fp, const Service::Ptr& service);
+	void DumpServiceStatus(std::ostream& fp, std::ostream& tail, const Service::Ptr& service);
 	void DumpServiceObject(std::ostream& fp, const Service::Ptr& service);
 
 	void DumpCustomAttributes(std::ostream& fp, const CustomVarObject::Ptr& object);
@@ -81,6 +99,10 @@ private:
 	void StatusTimerHandler();
 	void ObjectHandler();
 
+	void MarkDirty(const Checkable::Ptr& checkable);
+	const StatusBlock& GetStatusBlock(std::map<Checkable::Ptr, StatusBlock>& blocks, const Checkable::Ptr& checkable,
+		const std::set<Checkable::Ptr>& dirty, double now, size_t& rendered);
+
 	static String GetNotificationOptions(const Checkable::Ptr& checkable);
 };
 
@@ -1,18 +1,24 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "config/applyrule.hpp"
+#include "config/applyruleindex.hpp"
+#include "config/bytecode.hpp"
 #include "base/logger.hpp"
+#include "base/objectlock.hpp"
 #include <set>
 
 using namespace icinga;
 
 ApplyRule::RuleMap ApplyRule::m_Rules;
 ApplyRule::TypeMap ApplyRule::m_Types;
+std::mutex ApplyRule::m_IndexMutex;
+std::map<std::pair<String, String>, std::shared_ptr<ApplyRuleIndex> > ApplyRule::m_Indexes;
 
 ApplyRule::ApplyRule(String targetType, String name, Expression::Ptr expression,
 	Expression::Ptr filter, String package, String fkvar, String fvvar, Expression::Ptr fterm,
 	bool ignoreOnError, DebugInfo di, Dictionary::Ptr scope)
-	: m_TargetType(std::move(targetType)), m_Name(std::move(name)), m_Expression(std::move(expression)), m_Filter(std::move(filter)), m_Package(std::move(package)), m_FKVar(std::move(fkvar)),
+	: m_TargetType(std::move(targetType)), m_Name(std::move(name)), m_Expression(std::move(expression)), m_Filter(std::move(filter)),
+	m_CompiledFilter(m_Filter ? new CompiledExpression(m_Filter) : nullptr), m_Package(std::move(package)), m_FKVar(std::move(fkvar)),
 	m_FVVar(std::move(fvvar)), m_FTerm(std::move(fterm)), m_IgnoreOnError(ignoreOnError), m_DebugInfo(std::move(di)), m_Scope(std::move(scope)), m_HasMatches(false)
 { }
 
@@ -75,12 +81,22 @@ void ApplyRule::AddRule(const String& sourceType, const String& targetType, cons
 	const Expression::Ptr& expression, const Expression::Ptr& filter, const String& package, const String& fkvar,
 	const String& fvvar, const Expression::Ptr& fterm, bool ignoreOnError, const DebugInfo& di, const Dictionary::Ptr& scope)
 {
-	m_Rules[sourceType].push_back(ApplyRule(targetType, name, expression, filter, package, fkvar, fvvar, fterm, ignoreOnError, di, scope));
+	String type = targetType;
+
+	/* Rules for types with only one target type may omit it. */
+	if (type.IsEmpty()) {
+		std::vector<String> targetTypes = GetTargetTypes(sourceType);
+
+		if (targetTypes.size() == 1u)
+			type = targetTypes[0];
+	}
+
+	m_Rules[sourceType].push_back(ApplyRule(std::move(type), name, expression, filter, package, fkvar, fvvar, fterm, ignoreOnError, di, scope));
 }
 
 bool ApplyRule::EvaluateFilter(ScriptFrame& frame) const
 {
-	return Convert::ToBool(m_Filter->Evaluate(frame));
+	return Convert::ToBool(m_CompiledFilter->Evaluate(frame));
 }
 
 void ApplyRule::RegisterType(const String& sourceType, const std::vector<String>& targetTypes)
@@ -141,6 +157,48 @@ std::vector<ApplyRule>& ApplyRule::GetRules(const String& type)
 	return it->second;
 }
 
+/**
+ * Returns the rules whose filters may match an object, skipping the ones
+ * which can't match according to an index of the rules.
+ *
+ * @param type The type of the objects the rules create
+ * @param targetType The type of the object
+ * @param locals The variables the filters are evaluated with, e.g. the host
+ * @return The rules, in the order of GetRules()
+ */
+std::vector<ApplyRule *> ApplyRule::GetCandidateRules(const String& type, const String& targetType, const Dictionary::Ptr& locals)
+{
+	std::vector<ApplyRule>& rules = GetRules(type);
+	std::shared_ptr<ApplyRuleIndex> index;
+
+	{
+		std::unique_lock<std::mutex> lock (m_IndexMutex);
+		auto& slot = m_Indexes[std::make_pair(type, targetType)];
+
+		/* Rules are only ever added, and not while objects are being committed. */
+		if (!slot || slot->GetRuleCount() != rules.size()) {
+			std::set<String> variables;
+
+			{
+				ObjectLock olock (locals);
+				for (const Dictionary::Pair& kv : locals)
+					variables.insert(kv.first);
+			}
+
+			slot = std::make_shared<ApplyRuleIndex>(rules, targetType, variables);
+		}
+
+		index = slot;
+	}
+
+	std::vector<ApplyRule *> result;
+
+	for (size_t i : index->GetCandidates(locals))
+		result.push_back(&rules[i]);
+
+	return result;
+}
+
 void ApplyRule::CheckMatches(bool silent)
 {
 	for (const RuleMap::value_type& kv : m_Rules) {
@@ -6,10 +6,14 @@
 #include "config/i2-config.hpp"
 #include "config/expression.hpp"
 #include "base/debuginfo.hpp"
+#include <memory>
+#include <mutex>
 
 namespace icinga
 {
 
+class ApplyRuleIndex;
+
 /**
  * @ingroup config
  */
@@ -39,6 +43,7 @@ public:
 		const Expression::Ptr& filter, const String& package, const String& fkvar, const String& fvvar, const Expression::Ptr& fterm,
 		bool ignoreOnError, const DebugInfo& di, const Dictionary::Ptr& scope);
 	static std::vector<ApplyRule>& GetRules(const String& type);
+	static std::vector<ApplyRule *> GetCandidateRules(const String& type, const String& targetType, const Dictionary::Ptr& locals);
 
 	static void RegisterType(const String& sourceType, const std::vector<String>& targetTypes);
 	static bool IsValidSourceType(const String& sourceType);
@@ -52,6 +57,7 @@ private:
 	String m_Name;
 	Expression::Ptr m_Expression;
 	Expression::Ptr m_Filter;
+	Expression::Ptr m_CompiledFilter;
 	String m_Package;
 	String m_FKVar;
 	String m_FVVar;
@@ -64,6 +70,9 @@ private:
 	static TypeMap m_Types;
 	static RuleMap m_Rules;
 
+	static std::mutex m_IndexMutex;
+	static std::map<std::pair<String, String>, std::shared_ptr<ApplyRuleIndex> > m_Indexes;
+
 	ApplyRule(String targetType, String name, Expression::Ptr expression,
 		Expression::Ptr filter, String package, String fkvar, String fvvar, Expression::Ptr fterm,
 		bool ignoreOnError, DebugInfo di, Dictionary::Ptr scope);
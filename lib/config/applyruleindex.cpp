@@ -0,0 +1,393 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "config/applyruleindex.hpp"
+#include "config/applyrule.hpp"
+#include "base/namespace.hpp"
+#include "base/objectlock.hpp"
+#include "base/scriptframe.hpp"
+#include "base/scriptglobal.hpp"
+#include <algorithm>
+
+using namespace icinga;
+
+/**
+ * @param rules The rules of a type
+ * @param targetType Only the rules for this type of objects are indexed
+ * @param variables The names of the objects the filters are evaluated for, e.g. host and service
+ */
+ApplyRuleIndex::ApplyRuleIndex(const std::vector<ApplyRule>& rules, const String& targetType, const std::set<String>& variables)
+	: m_RuleCount(rules.size()), m_Variables(variables)
+{
+	for (std::vector<ApplyRule>::size_type i = 0; i < rules.size(); i++) {
+		const ApplyRule& rule = rules[i];
+
+		if (rule.GetTargetType() != targetType)
+			continue;
+
+		std::vector<Key> keys;
+		std::vector<PathRef> guards;
+
+		/* The iterator of 'apply for' rules is evaluated before the filter and may fail as well. */
+		if (rule.GetFTerm() || !rule.GetFilter() || !ExtractKeys(rule.GetFilter().get(), rule.GetScope(), keys, guards)) {
+			m_UnindexedRules.push_back(i);
+			continue;
+		}
+
+		/* Keeps the expressions of the paths alive. */
+		m_Filters.push_back(rule.GetFilter());
+
+		for (const Key& key : keys) {
+			PathIndex& path = m_Paths[AddPath(key.Path)];
+
+			switch (key.Type) {
+				case KeyValue:
+					path.Values[key.Value].push_back(i);
+					break;
+				case KeyElement:
+					path.Elements[key.Value].push_back(i);
+					path.ElementRules.push_back(i);
+					break;
+				case KeyPrefix:
+					path.Prefixes[key.Value].push_back(i);
+					path.PrefixRules.push_back(i);
+					path.MaxPrefixLength = std::max(path.MaxPrefixLength, key.Value.GetLength());
+					break;
+			}
+
+			path.Rules.push_back(i);
+		}
+
+		for (const PathRef& guard : guards)
+			m_Paths[AddPath(guard)].Rules.push_back(i);
+	}
+}
+
+/**
+ * The number of rules the index has been built for.
+ */
+size_t ApplyRuleIndex::GetRuleCount() const
+{
+	return m_RuleCount;
+}
+
+/**
+ * Tells which rules may match an object.
+ *
+ * @param locals The variables the filters are evaluated with, e.g. the host
+ * @return The indexes of the rules, in the order of the rules
+ */
+std::vector<size_t> ApplyRuleIndex::GetCandidates(const Dictionary::Ptr& locals) const
+{
+	std::vector<char> candidates (m_RuleCount, 0);
+
+	auto mark ([&candidates](const std::vector<size_t>& rules) {
+		for (size_t rule : rules)
+			candidates[rule] = 1;
+	});
+
+	mark(m_UnindexedRules);
+
+	ScriptFrame frame (true);
+	locals->CopyTo(frame.Locals);
+
+	for (const PathIndex& path : m_Paths) {
+		Value value;
+
+		try {
+			value = path.Expr->Evaluate(frame).GetValue();
+		} catch (const std::exception&) {
+			/* The filters would fail the same way. */
+			mark(path.Rules);
+			continue;
+		}
+
+		if (value.IsObjectType<Array>()) {
+			Array::Ptr arr = value;
+
+			ObjectLock olock (arr);
+			for (const Value& element : arr) {
+				if (!element.IsString())
+					continue;
+
+				auto it = path.Elements.find(element);
+
+				if (it != path.Elements.end())
+					mark(it->second);
+			}
+
+			/* match() requires all elements to match. */
+			mark(path.PrefixRules);
+		} else if (value.IsString()) {
+			String str = value;
+
+			auto it = path.Values.find(str);
+
+			if (it != path.Values.end())
+				mark(it->second);
+
+			String lower = ToLowerAscii(str.SubStr(0, path.MaxPrefixLength));
+
+			for (String::SizeType length = 1; length <= lower.GetLength(); length++) {
+				auto prefix = path.Prefixes.find(lower.SubStr(0, length));
+
+				if (prefix != path.Prefixes.end())
+					mark(prefix->second);
+			}
+
+			/* The 'in' operator fails for strings which aren't empty. */
+			if (!str.IsEmpty())
+				mark(path.ElementRules);
+		} else if (!value.IsEmpty()) {
+			/* Other values are never equal to a string, but match() converts them and 'in' fails. */
+			mark(path.ElementRules);
+			mark(path.PrefixRules);
+		}
+	}
+
+	std::vector<size_t> result;
+
+	for (size_t i = 0; i < candidates.size(); i++) {
+		if (candidates[i])
+			result.push_back(i);
+	}
+
+	return result;
+}
+
+size_t ApplyRuleIndex::AddPath(const PathRef& ref)
+{
+	auto it = m_PathIds.find(ref.Names);
+
+	if (it != m_PathIds.end())
+		return it->second;
+
+	size_t id = m_Paths.size();
+
+	m_Paths.emplace_back();
+	m_Paths.back().Expr = ref.Expr;
+	m_PathIds[ref.Names] = id;
+
+	return id;
+}
+
+/**
+ * Tells whether an expression only reads an attribute of one of the objects,
+ * e.g. host.vars.os.
+ */
+bool ApplyRuleIndex::GetPath(const Expression *expr, PathRef *ref) const
+{
+	std::vector<String> names;
+	const Expression *current = expr;
+
+	while (auto indexer = dynamic_cast<const IndexerExpression *>(current)) {
+		auto binary = static_cast<const BinaryExpression *>(indexer);
+		auto index = dynamic_cast<const LiteralExpression *>(binary->m_Operand2.get());
+
+		if (!index || !index->GetValue().IsString())
+			return false;
+
+		names.push_back(index->GetValue());
+		current = binary->m_Operand1.get();
+	}
+
+	auto variable = dynamic_cast<const VariableExpression *>(current);
+
+	if (!variable || m_Variables.find(variable->GetVariable()) == m_Variables.end())
+		return false;
+
+	names.push_back(variable->GetVariable());
+	std::reverse(names.begin(), names.end());
+
+	ref->Names = std::move(names);
+	ref->Expr = expr;
+
+	return true;
+}
+
+/**
+ * Collects the predicates at least one of which is true if the expression is
+ * true or can fail. The paths of the guards have to be read without errors
+ * for this to hold.
+ *
+ * @return Whether the expression has such predicates
+ */
+bool ApplyRuleIndex::ExtractKeys(const Expression *expr, const Dictionary::Ptr& scope, std::vector<Key>& keys, std::vector<PathRef>& guards) const
+{
+	if (dynamic_cast<const LogicalAndExpression *>(expr)) {
+		auto binary = static_cast<const BinaryExpression *>(expr);
+		std::vector<Key> subKeys;
+		std::vector<PathRef> subGuards;
+
+		/* The right side is only used if the left side is evaluated without side effects or errors. */
+		if (!ExtractKeys(binary->m_Operand1.get(), scope, subKeys, subGuards)) {
+			subKeys.clear();
+			subGuards.clear();
+
+			if (!IsPure(binary->m_Operand1.get(), subGuards) || !ExtractKeys(binary->m_Operand2.get(), scope, subKeys, subGuards))
+				return false;
+		}
+
+		keys.insert(keys.end(), subKeys.begin(), subKeys.end());
+		guards.insert(guards.end(), subGuards.begin(), subGuards.end());
+		return true;
+	}
+
+	if (dynamic_cast<const LogicalOrExpression *>(expr)) {
+		auto binary = static_cast<const BinaryExpression *>(expr);
+		std::vector<Key> subKeys;
+		std::vector<PathRef> subGuards;
+
+		if (!ExtractKeys(binary->m_Operand1.get(), scope, subKeys, subGuards) ||
+			!ExtractKeys(binary->m_Operand2.get(), scope, subKeys, subGuards))
+			return false;
+
+		keys.insert(keys.end(), subKeys.begin(), subKeys.end());
+		guards.insert(guards.end(), subGuards.begin(), subGuards.end());
+		return true;
+	}
+
+	PathRef path;
+
+	if (dynamic_cast<const EqualExpression *>(expr)) {
+		auto binary = static_cast<const BinaryExpression *>(expr);
+		auto literal = dynamic_cast<const LiteralExpression *>(binary->m_Operand2.get());
+		const Expression *operand = binary->m_Operand1.get();
+
+		if (!literal) {
+			literal = dynamic_cast<const LiteralExpression *>(binary->m_Operand1.get());
+			operand = binary->m_Operand2.get();
+		}
+
+		/* Empty strings are equal to null. */
+		if (!literal || !literal->GetValue().IsString() || literal->GetValue().IsEmpty() || !GetPath(operand, &path))
+			return false;
+
+		keys.push_back({ std::move(path), KeyValue, literal->GetValue() });
+		return true;
+	}
+
+	if (dynamic_cast<const InExpression *>(expr)) {
+		auto binary = static_cast<const BinaryExpression *>(expr);
+		auto literal = dynamic_cast<const LiteralExpression *>(binary->m_Operand1.get());
+
+		if (!literal || !literal->GetValue().IsString() || literal->GetValue().IsEmpty() || !GetPath(binary->m_Operand2.get(), &path))
+			return false;
+
+		keys.push_back({ std::move(path), KeyElement, literal->GetValue() });
+		return true;
+	}
+
+	if (auto call = dynamic_cast<const FunctionCallExpression *>(expr)) {
+		/* The mode argument can make match() true if any element of an array matches. */
+		if (call->m_Args.size() != 2 || !IsMatchFunction(call->m_FName.get(), scope))
+			return false;
+
+		auto literal = dynamic_cast<const LiteralExpression *>(call->m_Args[0].get());
+		String prefix;
+
+		if (!literal || !literal->GetValue().IsString() || !GetMatchPrefix(literal->GetValue(), &prefix) ||
+			!GetPath(call->m_Args[1].get(), &path))
+			return false;
+
+		keys.push_back({ std::move(path), KeyPrefix, prefix });
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * Tells whether an expression can be evaluated without side effects and
+ * without errors, apart from reading the paths it adds to the guards.
+ */
+bool ApplyRuleIndex::IsPure(const Expression *expr, std::vector<PathRef>& guards) const
+{
+	if (dynamic_cast<const LiteralExpression *>(expr))
+		return true;
+
+	PathRef path;
+
+	if (GetPath(expr, &path)) {
+		guards.emplace_back(std::move(path));
+		return true;
+	}
+
+	if (dynamic_cast<const LogicalNegateExpression *>(expr))
+		return IsPure(static_cast<const UnaryExpression *>(expr)->m_Operand.get(), guards);
+
+	if (dynamic_cast<const LogicalAndExpression *>(expr) || dynamic_cast<const LogicalOrExpression *>(expr) ||
+		dynamic_cast<const EqualExpression *>(expr) || dynamic_cast<const NotEqualExpression *>(expr)) {
+		auto binary = static_cast<const BinaryExpression *>(expr);
+
+		return IsPure(binary->m_Operand1.get(), guards) && IsPure(binary->m_Operand2.get(), guards);
+	}
+
+	return false;
+}
+
+/**
+ * Tells whether a function name refers to the global match() function in a rule's scope.
+ */
+bool ApplyRuleIndex::IsMatchFunction(const Expression *fname, const Dictionary::Ptr& scope)
+{
+	if (!dynamic_cast<const VariableExpression *>(fname))
+		return false;
+
+	try {
+		Namespace::Ptr systemNS = ScriptGlobal::Get("System");
+
+		ScriptFrame frame (true);
+		if (scope)
+			scope->CopyTo(frame.Locals);
+
+		Value func = fname->Evaluate(frame).GetValue();
+
+		return func.IsObject() && func == systemNS->Get("match");
+	} catch (const std::exception&) {
+		return false;
+	}
+}
+
+/**
+ * Returns the lower case ASCII characters every text matching a pattern starts with.
+ * match() ignores the case.
+ *
+ * @return Whether there is such a prefix
+ */
+bool ApplyRuleIndex::GetMatchPrefix(const String& pattern, String *prefix)
+{
+	std::string result;
+
+	for (String::SizeType i = 0; i < pattern.GetLength(); i++) {
+		char ch = pattern[i];
+
+		if (ch == '*' || ch == '?')
+			break;
+
+		if (ch == '\\' && i + 1 < pattern.GetLength() && (pattern[i + 1] == '*' || pattern[i + 1] == '?'))
+			ch = pattern[++i];
+
+		if (static_cast<unsigned char>(ch) >= 0x80u)
+			break;
+
+		result += ch;
+	}
+
+	if (result.empty())
+		return false;
+
+	*prefix = ToLowerAscii(result);
+	return true;
+}
+
+String ApplyRuleIndex::ToLowerAscii(const String& str)
+{
+	std::string result = str.GetData();
+
+	for (char& ch : result) {
+		if (ch >= 'A' && ch <= 'Z')
+			ch = ch - 'A' + 'a';
+	}
+
+	return result;
+}
@@ -0,0 +1,95 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef APPLYRULEINDEX_H
+#define APPLYRULEINDEX_H
+
+#include "config/i2-config.hpp"
+#include "config/expression.hpp"
+#include "base/dictionary.hpp"
+#include <map>
+#include <set>
+#include <vector>
+
+namespace icinga
+{
+
+class ApplyRule;
+
+/**
+ * Tells which apply rules may match an object without evaluating their filters.
+ *
+ * The filters are searched for predicates such as host.vars.os == "Linux",
+ * "linux-servers" in host.groups and match("web*", host.name) which must be
+ * true for the whole filter to be true. Each rule is then filed under the
+ * values of the attributes it needs and only the rules which are filed under
+ * an object's values are candidates for that object. Rules without such
+ * predicates are always candidates.
+ *
+ * A rule is only skipped if its filter could neither be true nor fail,
+ * so the candidates' filters still have to be evaluated.
+ *
+ * @ingroup config
+ */
+class ApplyRuleIndex final
+{
+public:
+	ApplyRuleIndex(const std::vector<ApplyRule>& rules, const String& targetType, const std::set<String>& variables);
+
+	size_t GetRuleCount() const;
+	std::vector<size_t> GetCandidates(const Dictionary::Ptr& locals) const;
+
+private:
+	enum KeyType
+	{
+		KeyValue,
+		KeyElement,
+		KeyPrefix
+	};
+
+	struct PathRef
+	{
+		std::vector<String> Names;
+		const Expression *Expr{nullptr};
+	};
+
+	struct Key
+	{
+		PathRef Path;
+		KeyType Type;
+		String Value;
+	};
+
+	struct PathIndex
+	{
+		const Expression *Expr{nullptr};
+		std::map<String, std::vector<size_t> > Values;
+		std::map<String, std::vector<size_t> > Elements;
+		std::map<String, std::vector<size_t> > Prefixes;
+		String::SizeType MaxPrefixLength{0};
+
+		/* The rules which have to be evaluated if the value isn't of the expected type or can't be read. */
+		std::vector<size_t> ElementRules;
+		std::vector<size_t> PrefixRules;
+		std::vector<size_t> Rules;
+	};
+
+	size_t m_RuleCount;
+	std::set<String> m_Variables;
+	std::vector<Expression::Ptr> m_Filters;
+	std::vector<size_t> m_UnindexedRules;
+	std::vector<PathIndex> m_Paths;
+	std::map<std::vector<String>, size_t> m_PathIds;
+
+	size_t AddPath(const PathRef& ref);
+	bool GetPath(const Expression *expr, PathRef *ref) const;
+	bool ExtractKeys(const Expression *expr, const Dictionary::Ptr& scope, std::vector<Key>& keys, std::vector<PathRef>& guards) const;
+	bool IsPure(const Expression *expr, std::vector<PathRef>& guards) const;
+
+	static bool IsMatchFunction(const Expression *fname, const Dictionary::Ptr& scope);
+	static bool GetMatchPrefix(const String& pattern, String *prefix);
+	static String ToLowerAscii(const String& str);
+};
+
+}
+
+#endif /* APPLYRULEINDEX_H */
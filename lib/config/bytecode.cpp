@@ -0,0 +1,838 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "config/bytecode.hpp"
+#include "config/vmops.hpp"
+#include "base/configobject.hpp"
+#include "base/json.hpp"
+#include "base/scriptglobal.hpp"
+#include <boost/exception_ptr.hpp>
+#include <boost/exception/errinfo_nested_exception.hpp>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+
+using namespace icinga;
+
+/* Operands with this flag refer to a constant rather than to a register. */
+static const uint32_t l_ConstantFlag = 0x80000000u;
+
+/* Operands with this flag refer to a variable's slot until the program is linked. */
+static const uint32_t l_SlotFlag = 0x40000000u;
+
+static const uint32_t l_NoSlot = 0xffffffffu;
+static const uint32_t l_NoFieldCache = 0xffffffffu;
+
+/* The slots' state is kept in a bit mask. */
+static const uint32_t l_MaxSlots = 64;
+
+/* Registers of smaller programs are kept on the stack. */
+static const uint32_t l_StackRegisters = 16;
+
+/**
+ * Compiles an expression tree. The tree must outlive the program as the
+ * expressions which are evaluated by the tree walker are referenced.
+ */
+BytecodeProgram::Ptr BytecodeProgram::Compile(const Expression *expr)
+{
+	BytecodeProgram::Ptr program = new BytecodeProgram();
+	program->m_Result = program->CompileExpression(expr);
+	program->Link();
+
+	return program;
+}
+
+ExpressionResult BytecodeProgram::Run(ScriptFrame& frame) const
+{
+	uint32_t registerCount = m_RegisterCount + m_SlotCount;
+	Value stackRegisters[l_StackRegisters];
+	std::unique_ptr<Value[]> heapRegisters;
+	Value *regs = stackRegisters;
+
+	if (registerCount > l_StackRegisters) {
+		heapRegisters.reset(new Value[registerCount]);
+		regs = heapRegisters.get();
+	}
+
+	auto get ([this, regs](uint32_t operand) -> const Value& {
+		if (operand & l_ConstantFlag)
+			return m_Constants[operand & ~l_ConstantFlag];
+		else
+			return regs[operand];
+	});
+
+	uint64_t loadedSlots = 0;
+	size_t pc = 0;
+
+	try {
+		while (pc < m_Instructions.size()) {
+			const Instruction& ins = m_Instructions[pc++];
+
+			switch (ins.Op) {
+				case OpMove:
+					regs[ins.Dst] = get(ins.A);
+					break;
+
+				case OpLoadVariable:
+					if (ins.B != l_NoSlot) {
+						uint64_t mask = uint64_t(1) << ins.B;
+
+						if (loadedSlots & mask)
+							break;
+
+						loadedSlots |= mask;
+					}
+
+					if (ins.C) {
+						Value parent;
+						String index;
+
+						m_Variables[ins.A]->GetReference(frame, false, &parent, &index, nullptr);
+						regs[ins.Dst] = VMOps::GetField(parent, index, frame.Sandboxed, ins.Source->GetDebugInfo());
+					} else
+						regs[ins.Dst] = m_Variables[ins.A]->DoEvaluate(frame, nullptr).GetValue();
+
+					break;
+
+				case OpLoadScope:
+					if (ins.A == ScopeLocal)
+						regs[ins.Dst] = frame.Locals;
+					else if (ins.A == ScopeThis)
+						regs[ins.Dst] = frame.Self;
+					else
+						regs[ins.Dst] = ScriptGlobal::GetGlobals();
+
+					break;
+
+				case OpGetField:
+					regs[ins.Dst] = GetField(get(ins.A), get(ins.B), ins.C, frame.Sandboxed, ins.Source->GetDebugInfo());
+					break;
+
+				case OpNegate:
+				case OpLogicalNegate:
+					regs[ins.Dst] = ApplyUnary(ins.Op, get(ins.A));
+					break;
+
+				case OpCheckInOperand:
+					{
+						const Value& operand = get(ins.A);
+
+						if (operand.IsEmpty()) {
+							regs[ins.Dst] = ins.B != 0;
+							pc = ins.C;
+						} else if (!operand.IsObjectType<Array>())
+							BOOST_THROW_EXCEPTION(ScriptError("Invalid right side argument for 'in' operator: " + JsonEncode(operand), ins.Source->GetDebugInfo()));
+					}
+
+					break;
+
+				case OpIn:
+					{
+						Array::Ptr arr = get(ins.B);
+						bool contains = arr->Contains(get(ins.A));
+						regs[ins.Dst] = ins.C ? !contains : contains;
+					}
+
+					break;
+
+				case OpJump:
+					pc = ins.C;
+					break;
+
+				case OpJumpIfFalse:
+					if (!get(ins.A).ToBool())
+						pc = ins.C;
+
+					break;
+
+				case OpJumpIfTrue:
+					if (get(ins.A).ToBool())
+						pc = ins.C;
+
+					break;
+
+				case OpLoadCallee:
+					{
+						Value parent;
+						String index;
+
+						m_Variables[ins.A]->GetReference(frame, false, &parent, &index, nullptr);
+						regs[ins.Dst + 1] = VMOps::GetField(parent, index, frame.Sandboxed, ins.Source->GetDebugInfo());
+						regs[ins.Dst] = std::move(parent);
+					}
+
+					break;
+
+				case OpCheckCallee:
+					{
+						const Value& vfunc = regs[ins.A + 1];
+
+						if (vfunc.IsObjectType<Type>())
+							break;
+
+						if (!vfunc.IsObjectType<Function>())
+							BOOST_THROW_EXCEPTION(ScriptError("Argument is not a callable object.", ins.Source->GetDebugInfo()));
+
+						Function::Ptr func = vfunc;
+
+						if (!func->IsSideEffectFree() && frame.Sandboxed)
+							BOOST_THROW_EXCEPTION(ScriptError("Function is not marked as safe for sandbox mode.", ins.Source->GetDebugInfo()));
+					}
+
+					break;
+
+				case OpCall:
+					{
+						Value *args = regs + ins.A + 2;
+						std::vector<Value> arguments (std::make_move_iterator(args), std::make_move_iterator(args + ins.B));
+						const Value& vfunc = regs[ins.A + 1];
+						Value result;
+
+						if (vfunc.IsObjectType<Type>()) {
+							result = VMOps::ConstructorCall(vfunc, arguments, ins.Source->GetDebugInfo());
+							loadedSlots = 0;
+						} else {
+							Function::Ptr func = vfunc;
+
+							result = VMOps::FunctionCall(frame, regs[ins.A], func, arguments);
+
+							/* The function might have changed the variables. */
+							if (!func->IsSideEffectFree())
+								loadedSlots = 0;
+						}
+
+						regs[ins.Dst] = std::move(result);
+					}
+
+					break;
+
+				case OpEvaluate:
+					{
+						ExpressionResult result = ins.Source->Evaluate(frame);
+						loadedSlots = 0;
+
+						if (result.GetCode() != ResultOK)
+							return result;
+
+						regs[ins.Dst] = result.GetValue();
+					}
+
+					break;
+
+				case OpReturn:
+					return ExpressionResult(get(ins.A), ResultReturn);
+
+				default:
+					regs[ins.Dst] = ApplyBinary(ins.Op, get(ins.A), get(ins.B));
+					break;
+			}
+		}
+	} catch (const ScriptError&) {
+		throw;
+	} catch (const std::exception& ex) {
+		BOOST_THROW_EXCEPTION(ScriptError("Error while evaluating expression: " + String(ex.what()), m_Instructions[pc - 1].Source->GetDebugInfo())
+			<< boost::errinfo_nested_exception(boost::current_exception()));
+	}
+
+	return get(m_Result);
+}
+
+size_t BytecodeProgram::GetInstructionCount() const
+{
+	return m_Instructions.size();
+}
+
+/**
+ * The number of expressions which are evaluated by the tree walker.
+ */
+size_t BytecodeProgram::GetFallbackCount() const
+{
+	return m_FallbackCount;
+}
+
+static bool GetBinaryOpcode(const Expression *expr, BytecodeOpcode *op)
+{
+	if (dynamic_cast<const AddExpression *>(expr))
+		*op = OpAdd;
+	else if (dynamic_cast<const SubtractExpression *>(expr))
+		*op = OpSubtract;
+	else if (dynamic_cast<const MultiplyExpression *>(expr))
+		*op = OpMultiply;
+	else if (dynamic_cast<const DivideExpression *>(expr))
+		*op = OpDivide;
+	else if (dynamic_cast<const ModuloExpression *>(expr))
+		*op = OpModulo;
+	else if (dynamic_cast<const XorExpression *>(expr))
+		*op = OpXor;
+	else if (dynamic_cast<const BinaryAndExpression *>(expr))
+		*op = OpBinaryAnd;
+	else if (dynamic_cast<const BinaryOrExpression *>(expr))
+		*op = OpBinaryOr;
+	else if (dynamic_cast<const ShiftLeftExpression *>(expr))
+		*op = OpShiftLeft;
+	else if (dynamic_cast<const ShiftRightExpression *>(expr))
+		*op = OpShiftRight;
+	else if (dynamic_cast<const EqualExpression *>(expr))
+		*op = OpEqual;
+	else if (dynamic_cast<const NotEqualExpression *>(expr))
+		*op = OpNotEqual;
+	else if (dynamic_cast<const LessThanExpression *>(expr))
+		*op = OpLessThan;
+	else if (dynamic_cast<const GreaterThanExpression *>(expr))
+		*op = OpGreaterThan;
+	else if (dynamic_cast<const LessThanOrEqualExpression *>(expr))
+		*op = OpLessThanOrEqual;
+	else if (dynamic_cast<const GreaterThanOrEqualExpression *>(expr))
+		*op = OpGreaterThanOrEqual;
+	else
+		return false;
+
+	return true;
+}
+
+uint32_t BytecodeProgram::CompileExpression(const Expression *expr)
+{
+	if (auto *lexpr = dynamic_cast<const LiteralExpression *>(expr))
+		return AddConstant(lexpr->GetValue());
+
+	if (auto *vexpr = dynamic_cast<const VariableExpression *>(expr))
+		return CompileVariable(vexpr, false);
+
+	if (auto *sexpr = dynamic_cast<const GetScopeExpression *>(expr)) {
+		uint32_t dst = AllocRegister();
+		Emit(OpLoadScope, dst, sexpr->m_ScopeSpec, 0, 0, expr);
+		return dst;
+	}
+
+	if (auto *iexpr = dynamic_cast<const IndexerExpression *>(expr))
+		return CompileBinary(OpGetField, iexpr->m_Operand1.get(), iexpr->m_Operand2.get(), expr);
+
+	BytecodeOpcode op;
+
+	if (GetBinaryOpcode(expr, &op)) {
+		auto *bexpr = static_cast<const BinaryExpression *>(expr);
+		return CompileBinary(op, bexpr->m_Operand1.get(), bexpr->m_Operand2.get(), expr);
+	}
+
+	if (auto *iexpr = dynamic_cast<const InExpression *>(expr))
+		return CompileIn(false, iexpr->m_Operand1.get(), iexpr->m_Operand2.get(), expr);
+
+	if (auto *iexpr = dynamic_cast<const NotInExpression *>(expr))
+		return CompileIn(true, iexpr->m_Operand1.get(), iexpr->m_Operand2.get(), expr);
+
+	if (auto *aexpr = dynamic_cast<const LogicalAndExpression *>(expr))
+		return CompileLogical(true, aexpr->m_Operand1.get(), aexpr->m_Operand2.get());
+
+	if (auto *oexpr = dynamic_cast<const LogicalOrExpression *>(expr))
+		return CompileLogical(false, oexpr->m_Operand1.get(), oexpr->m_Operand2.get());
+
+	bool negate = dynamic_cast<const NegateExpression *>(expr);
+
+	if (negate || dynamic_cast<const LogicalNegateExpression *>(expr)) {
+		op = negate ? OpNegate : OpLogicalNegate;
+
+		uint32_t mark = m_NextRegister;
+		uint32_t operand = CompileExpression(static_cast<const UnaryExpression *>(expr)->m_Operand.get());
+
+		if (IsConstant(operand)) {
+			try {
+				return AddConstant(ApplyUnary(op, GetConstant(operand)));
+			} catch (const std::exception&) {
+				/* Let it fail when it's evaluated. */
+			}
+		}
+
+		m_NextRegister = mark;
+		uint32_t dst = AllocRegister();
+		Emit(op, dst, operand, 0, 0, expr);
+		return dst;
+	}
+
+	if (auto *cexpr = dynamic_cast<const ConditionalExpression *>(expr))
+		return CompileConditional(cexpr->m_Condition.get(), cexpr->m_TrueBranch.get(), cexpr->m_FalseBranch.get());
+
+	if (auto *dexpr = dynamic_cast<const DictExpression *>(expr)) {
+		if (!dexpr->m_Inline)
+			return CompileFallback(expr);
+
+		uint32_t dst = AllocRegister();
+		uint32_t result = AddConstant(Empty);
+
+		for (const auto& aexpr : dexpr->m_Expressions) {
+			uint32_t element = CompileExpression(aexpr.get());
+			m_NextRegister = dst + 1;
+
+			if (IsConstant(element))
+				result = element;
+			else {
+				Emit(OpMove, dst, element, 0, 0, aexpr.get());
+				result = dst;
+			}
+		}
+
+		return result;
+	}
+
+	if (auto *rexpr = dynamic_cast<const ReturnExpression *>(expr)) {
+		uint32_t mark = m_NextRegister;
+		Emit(OpReturn, 0, CompileExpression(rexpr->m_Operand.get()), 0, 0, expr);
+		m_NextRegister = mark;
+		return AddConstant(Empty);
+	}
+
+	if (dynamic_cast<const FunctionCallExpression *>(expr))
+		return CompileCall(expr);
+
+	return CompileFallback(expr);
+}
+
+uint32_t BytecodeProgram::CompileBinary(BytecodeOpcode op, const Expression *operand1, const Expression *operand2, const Expression *source)
+{
+	uint32_t mark = m_NextRegister;
+	uint32_t a = CompileExpression(operand1);
+	uint32_t reserved = IsSlot(a) ? AllocRegister() : 0;
+	size_t start = m_Instructions.size();
+	uint32_t b = CompileExpression(operand2);
+
+	if (op == OpGetField) {
+		m_NextRegister = mark;
+		uint32_t dst = AllocRegister();
+		uint32_t cache = IsConstant(b) && GetConstant(b).IsString() ? AddFieldCache(GetConstant(b).Get<String>()) : l_NoFieldCache;
+		Emit(OpGetField, dst, PinOperand(a, reserved, start), b, cache, source);
+		return dst;
+	}
+
+	if (IsConstant(a) && IsConstant(b) && !GetConstant(a).IsObject() && !GetConstant(b).IsObject()) {
+		try {
+			return AddConstant(ApplyBinary(op, GetConstant(a), GetConstant(b)));
+		} catch (const std::exception&) {
+			/* Let it fail when it's evaluated. */
+		}
+	}
+
+	m_NextRegister = mark;
+	uint32_t dst = AllocRegister();
+	Emit(op, dst, PinOperand(a, reserved, start), b, 0, source);
+	return dst;
+}
+
+/* The right operand is evaluated first and the left one only if the right one is an array. */
+uint32_t BytecodeProgram::CompileIn(bool negate, const Expression *operand1, const Expression *operand2, const Expression *source)
+{
+	uint32_t dst = AllocRegister();
+	uint32_t b = CompileExpression(operand2);
+	uint32_t reserved = IsSlot(b) ? AllocRegister() : 0;
+	size_t check = Emit(OpCheckInOperand, dst, b, negate, 0, source);
+	size_t start = m_Instructions.size();
+	uint32_t a = CompileExpression(operand1);
+
+	b = PinOperand(b, reserved, start);
+	Emit(OpIn, dst, a, b, negate, source);
+	PatchJump(check);
+
+	m_NextRegister = dst + 1;
+	return dst;
+}
+
+uint32_t BytecodeProgram::CompileLogical(bool isAnd, const Expression *operand1, const Expression *operand2)
+{
+	uint32_t mark = m_NextRegister;
+	uint32_t a = CompileExpression(operand1);
+
+	if (IsConstant(a)) {
+		if (GetConstant(a).ToBool() != isAnd)
+			return a;
+
+		m_NextRegister = mark;
+		return CompileExpression(operand2);
+	}
+
+	m_NextRegister = mark;
+	uint32_t dst = AllocRegister();
+
+	if (a != dst)
+		Emit(OpMove, dst, a, 0, 0, operand1);
+
+	size_t jump = Emit(isAnd ? OpJumpIfFalse : OpJumpIfTrue, 0, dst, 0, 0, operand1);
+	uint32_t b = CompileExpression(operand2);
+
+	if (b != dst)
+		Emit(OpMove, dst, b, 0, 0, operand2);
+
+	PatchJump(jump);
+
+	m_NextRegister = dst + 1;
+	return dst;
+}
+
+uint32_t BytecodeProgram::CompileConditional(const Expression *condition, const Expression *trueBranch, const Expression *falseBranch)
+{
+	uint32_t mark = m_NextRegister;
+	uint32_t cond = CompileExpression(condition);
+
+	if (IsConstant(cond)) {
+		m_NextRegister = mark;
+
+		if (GetConstant(cond).ToBool())
+			return CompileExpression(trueBranch);
+		else if (falseBranch)
+			return CompileExpression(falseBranch);
+		else
+			return AddConstant(Empty);
+	}
+
+	m_NextRegister = mark;
+	uint32_t dst = AllocRegister();
+	size_t jumpFalse = Emit(OpJumpIfFalse, 0, cond, 0, 0, condition);
+
+	uint32_t result = CompileExpression(trueBranch);
+	Emit(OpMove, dst, result, 0, 0, trueBranch);
+	size_t jumpEnd = Emit(OpJump, 0, 0, 0, 0, trueBranch);
+
+	PatchJump(jumpFalse);
+	m_NextRegister = dst + 1;
+
+	result = falseBranch ? CompileExpression(falseBranch) : AddConstant(Empty);
+	Emit(OpMove, dst, result, 0, 0, falseBranch ? falseBranch : trueBranch);
+
+	PatchJump(jumpEnd);
+	m_NextRegister = dst + 1;
+	return dst;
+}
+
+/**
+ * Calls the function with the object it was looked up in as 'this', which
+ * is what FunctionCallExpression does. The object, the function and the
+ * arguments are kept in consecutive registers.
+ */
+uint32_t BytecodeProgram::CompileCall(const Expression *expr)
+{
+	auto *cexpr = static_cast<const FunctionCallExpression *>(expr);
+	const Expression *fname = cexpr->m_FName.get();
+
+	for (const Expression *parent = fname; parent; ) {
+		/* Their references can't be compiled. */
+		if (dynamic_cast<const DerefExpression *>(parent) || dynamic_cast<const CompiledExpression *>(parent))
+			return CompileFallback(expr);
+
+		auto *iexpr = dynamic_cast<const IndexerExpression *>(parent);
+		parent = iexpr ? iexpr->m_Operand1.get() : nullptr;
+	}
+
+	uint32_t base = AllocRegister();
+	AllocRegister();
+
+	for (size_t i = 0; i < cexpr->m_Args.size(); i++)
+		AllocRegister();
+
+	if (auto *vexpr = dynamic_cast<const VariableExpression *>(fname)) {
+		m_Variables.push_back(vexpr);
+		Emit(OpLoadCallee, base, m_Variables.size() - 1, 0, 0, expr);
+	} else if (auto *iexpr = dynamic_cast<const IndexerExpression *>(fname)) {
+		Emit(OpMove, base, CompileReference(iexpr->m_Operand1.get()), 0, 0, expr);
+		uint32_t index = CompileExpression(iexpr->m_Operand2.get());
+		uint32_t cache = IsConstant(index) && GetConstant(index).IsString() ? AddFieldCache(GetConstant(index).Get<String>()) : l_NoFieldCache;
+		Emit(OpGetField, base + 1, base, index, cache, expr);
+	} else {
+		Emit(OpMove, base, AddConstant(Empty), 0, 0, expr);
+		Emit(OpMove, base + 1, CompileExpression(fname), 0, 0, expr);
+	}
+
+	Emit(OpCheckCallee, 0, base, 0, 0, expr);
+
+	for (size_t i = 0; i < cexpr->m_Args.size(); i++) {
+		const Expression *arg = cexpr->m_Args[i].get();
+
+		m_NextRegister = base + 2 + cexpr->m_Args.size();
+		Emit(OpMove, base + 2 + i, CompileExpression(arg), 0, 0, arg);
+	}
+
+	Emit(OpCall, base, base, cexpr->m_Args.size(), 0, expr);
+
+	m_NextRegister = base + 1;
+	return base;
+}
+
+/**
+ * Compiles the parent of an indexer the way IndexerExpression::GetReference()
+ * evaluates it, which only differs from the evaluation for variables which
+ * don't exist.
+ */
+uint32_t BytecodeProgram::CompileReference(const Expression *expr)
+{
+	if (auto *vexpr = dynamic_cast<const VariableExpression *>(expr))
+		return CompileVariable(vexpr, true);
+
+	if (auto *iexpr = dynamic_cast<const IndexerExpression *>(expr)) {
+		uint32_t mark = m_NextRegister;
+		uint32_t parent = CompileReference(iexpr->m_Operand1.get());
+		uint32_t reserved = IsSlot(parent) ? AllocRegister() : 0;
+		size_t start = m_Instructions.size();
+		uint32_t index = CompileExpression(iexpr->m_Operand2.get());
+		uint32_t cache = IsConstant(index) && GetConstant(index).IsString() ? AddFieldCache(GetConstant(index).Get<String>()) : l_NoFieldCache;
+
+		m_NextRegister = mark;
+		uint32_t dst = AllocRegister();
+		Emit(OpGetField, dst, PinOperand(parent, reserved, start), index, cache, expr);
+		return dst;
+	}
+
+	return CompileExpression(expr);
+}
+
+uint32_t BytecodeProgram::CompileVariable(const VariableExpression *expr, bool reference)
+{
+	m_Variables.push_back(expr);
+	uint32_t variable = m_Variables.size() - 1;
+
+	auto key (std::make_pair(expr->GetVariable(), reference));
+	auto it (m_SlotIds.find(key));
+	uint32_t slot;
+
+	if (it != m_SlotIds.end())
+		slot = it->second;
+	else if (m_SlotCount < l_MaxSlots) {
+		slot = m_SlotCount++;
+		m_SlotIds.emplace(key, slot);
+	} else {
+		uint32_t dst = AllocRegister();
+		Emit(OpLoadVariable, dst, variable, l_NoSlot, reference, expr);
+		return dst;
+	}
+
+	Emit(OpLoadVariable, l_SlotFlag | slot, variable, slot, reference, expr);
+	return l_SlotFlag | slot;
+}
+
+uint32_t BytecodeProgram::CompileFallback(const Expression *expr)
+{
+	m_FallbackCount++;
+
+	uint32_t dst = AllocRegister();
+	Emit(OpEvaluate, dst, 0, 0, 0, expr);
+	return dst;
+}
+
+uint32_t BytecodeProgram::AllocRegister()
+{
+	uint32_t reg = m_NextRegister++;
+	m_RegisterCount = std::max(m_RegisterCount, m_NextRegister);
+	return reg;
+}
+
+uint32_t BytecodeProgram::AddConstant(const Value& value)
+{
+	m_Constants.push_back(value);
+	return l_ConstantFlag | (m_Constants.size() - 1);
+}
+
+/**
+ * Looks up the field's ID for all config object types which have it.
+ */
+uint32_t BytecodeProgram::AddFieldCache(const String& name)
+{
+	auto it (m_FieldCacheIds.find(name));
+
+	if (it != m_FieldCacheIds.end())
+		return it->second;
+
+	FieldCache cache;
+
+	for (const Type::Ptr& type : Type::GetAllTypes()) {
+		if (!ConfigObject::TypeInstance->IsAssignableFrom(type))
+			continue;
+
+		int fid = type->GetFieldId(name);
+
+		if (fid == -1)
+			continue;
+
+		Field field = type->GetFieldInfo(fid);
+		cache.Types.push_back({ type.get(), fid, (field.Attributes & FANoUserView) != 0 });
+	}
+
+	std::sort(cache.Types.begin(), cache.Types.end());
+
+	m_FieldCaches.push_back(std::move(cache));
+	m_FieldCacheIds.emplace(name, m_FieldCaches.size() - 1);
+	return m_FieldCaches.size() - 1;
+}
+
+size_t BytecodeProgram::Emit(BytecodeOpcode op, uint32_t dst, uint32_t a, uint32_t b, uint32_t c, const Expression *source)
+{
+	m_Instructions.push_back({ op, dst, a, b, c, source });
+	return m_Instructions.size() - 1;
+}
+
+void BytecodeProgram::PatchJump(size_t jump)
+{
+	m_Instructions[jump].C = m_Instructions.size();
+}
+
+/**
+ * Copies a variable's value which is still needed after the instructions
+ * starting at 'start' if they might change the variable.
+ */
+uint32_t BytecodeProgram::PinOperand(uint32_t operand, uint32_t reserved, size_t start)
+{
+	if (!IsSlot(operand))
+		return operand;
+
+	auto mayChange ([](const Instruction& ins) { return ins.Op == OpCall || ins.Op == OpEvaluate; });
+
+	if (std::none_of(m_Instructions.begin() + start, m_Instructions.end(), mayChange))
+		return operand;
+
+	for (Instruction& ins : m_Instructions) {
+		if (IsJump(ins.Op) && ins.C > start)
+			ins.C++;
+	}
+
+	m_Instructions.insert(m_Instructions.begin() + start, { OpMove, reserved, operand, 0, 0, m_Instructions[start].Source });
+	return reserved;
+}
+
+/**
+ * Places the slots behind the registers.
+ */
+void BytecodeProgram::Link()
+{
+	auto link ([this](uint32_t& operand) {
+		if (IsSlot(operand))
+			operand = m_RegisterCount + (operand & ~l_SlotFlag);
+	});
+
+	for (Instruction& ins : m_Instructions) {
+		link(ins.Dst);
+		link(ins.A);
+		link(ins.B);
+	}
+
+	link(m_Result);
+
+	m_SlotIds.clear();
+	m_FieldCacheIds.clear();
+}
+
+const Value& BytecodeProgram::GetConstant(uint32_t operand) const
+{
+	return m_Constants[operand & ~l_ConstantFlag];
+}
+
+/**
+ * Reads a field like VMOps::GetField() does, but uses the field's ID for
+ * config objects if the field's name is known when compiling.
+ */
+Value BytecodeProgram::GetField(const Value& context, const Value& field, uint32_t cache, bool sandboxed, const DebugInfo& debugInfo) const
+{
+	if (cache != l_NoFieldCache && context.IsObject()) {
+		const Object::Ptr& object = context.Get<Object::Ptr>();
+		Type::Ptr type = object->GetReflectionType();
+		const std::vector<FieldRef>& types = m_FieldCaches[cache].Types;
+
+		auto it (std::lower_bound(types.begin(), types.end(), FieldRef{type.get(), -1, false}));
+
+		if (it != types.end() && it->ObjectType == type.get()) {
+			if (sandboxed && it->NoUserView)
+				BOOST_THROW_EXCEPTION(ScriptError("Accessing the field '" + field.Get<String>() + "' for type '" + type->GetName() + "' is not allowed in sandbox mode.", debugInfo));
+
+			return object->GetField(it->FieldId);
+		}
+	}
+
+	return VMOps::GetField(context, field, sandboxed, debugInfo);
+}
+
+bool BytecodeProgram::IsConstant(uint32_t operand)
+{
+	return operand & l_ConstantFlag;
+}
+
+bool BytecodeProgram::IsSlot(uint32_t operand)
+{
+	return (operand & (l_ConstantFlag | l_SlotFlag)) == l_SlotFlag;
+}
+
+bool BytecodeProgram::IsJump(BytecodeOpcode op)
+{
+	return op == OpJump || op == OpJumpIfFalse || op == OpJumpIfTrue || op == OpCheckInOperand;
+}
+
+Value BytecodeProgram::ApplyUnary(BytecodeOpcode op, const Value& operand)
+{
+	if (op == OpNegate)
+		return ~(long)operand;
+	else
+		return !operand.ToBool();
+}
+
+Value BytecodeProgram::ApplyBinary(BytecodeOpcode op, const Value& operand1, const Value& operand2)
+{
+	switch (op) {
+		case OpAdd:
+			return operand1 + operand2;
+		case OpSubtract:
+			return operand1 - operand2;
+		case OpMultiply:
+			return operand1 * operand2;
+		case OpDivide:
+			return operand1 / operand2;
+		case OpModulo:
+			return operand1 % operand2;
+		case OpXor:
+			return operand1 ^ operand2;
+		case OpBinaryAnd:
+			return operand1 & operand2;
+		case OpBinaryOr:
+			return operand1 | operand2;
+		case OpShiftLeft:
+			return operand1 << operand2;
+		case OpShiftRight:
+			return operand1 >> operand2;
+		case OpEqual:
+			return operand1 == operand2;
+		case OpNotEqual:
+			return operand1 != operand2;
+		case OpLessThan:
+			return operand1 < operand2;
+		case OpGreaterThan:
+			return operand1 > operand2;
+		case OpLessThanOrEqual:
+			return operand1 <= operand2;
+		case OpGreaterThanOrEqual:
+			return operand1 >= operand2;
+		default:
+			VERIFY(!"Invalid opcode.");
+	}
+}
+
+CompiledExpression::CompiledExpression(Expression::Ptr expression)
+	: m_Expression(std::move(expression)), m_Program(BytecodeProgram::Compile(m_Expression.get()))
+{ }
+
+const Expression::Ptr& CompiledExpression::GetExpression() const
+{
+	return m_Expression;
+}
+
+const BytecodeProgram::Ptr& CompiledExpression::GetProgram() const
+{
+	return m_Program;
+}
+
+ExpressionResult CompiledExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const
+{
+	if (dhint || !OnBreakpoint.empty())
+		return m_Expression->DoEvaluate(frame, dhint);
+
+	return m_Program->Run(frame);
+}
+
+bool CompiledExpression::GetReference(ScriptFrame& frame, bool init_dict, Value *parent, String *index, DebugHint **dhint) const
+{
+	return m_Expression->GetReference(frame, init_dict, parent, index, dhint);
+}
+
+const DebugInfo& CompiledExpression::GetDebugInfo() const
+{
+	return m_Expression->GetDebugInfo();
+}
@@ -0,0 +1,186 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "config/i2-config.hpp"
+#include "config/expression.hpp"
+#include "base/type.hpp"
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace icinga
+{
+
+class VariableExpression;
+
+/**
+ * @ingroup config
+ */
+enum BytecodeOpcode : uint8_t
+{
+	OpMove,
+	OpLoadVariable,
+	OpLoadScope,
+	OpGetField,
+	OpNegate,
+	OpLogicalNegate,
+	OpAdd,
+	OpSubtract,
+	OpMultiply,
+	OpDivide,
+	OpModulo,
+	OpXor,
+	OpBinaryAnd,
+	OpBinaryOr,
+	OpShiftLeft,
+	OpShiftRight,
+	OpEqual,
+	OpNotEqual,
+	OpLessThan,
+	OpGreaterThan,
+	OpLessThanOrEqual,
+	OpGreaterThanOrEqual,
+	OpCheckInOperand,
+	OpIn,
+	OpJump,
+	OpJumpIfFalse,
+	OpJumpIfTrue,
+	OpLoadCallee,
+	OpCheckCallee,
+	OpCall,
+	OpEvaluate,
+	OpReturn
+};
+
+/**
+ * An expression tree compiled into instructions for a register machine.
+ *
+ * Literals and operations on them are folded into constants, each variable
+ * is looked up once into its own slot until a function with side effects is
+ * called and the fields of config objects are read by their ID rather than
+ * by their name. Expressions the compiler doesn't know are evaluated by the
+ * tree walker, so every expression can be compiled.
+ *
+ * Programs are immutable and may be run by multiple threads at once.
+ *
+ * @ingroup config
+ */
+class BytecodeProgram final : public SharedObject
+{
+public:
+	DECLARE_PTR_TYPEDEFS(BytecodeProgram);
+
+	static BytecodeProgram::Ptr Compile(const Expression *expr);
+
+	ExpressionResult Run(ScriptFrame& frame) const;
+
+	size_t GetInstructionCount() const;
+	size_t GetFallbackCount() const;
+
+private:
+	struct Instruction
+	{
+		BytecodeOpcode Op;
+		uint32_t Dst;
+		uint32_t A;
+		uint32_t B;
+		uint32_t C;
+		const Expression *Source;
+	};
+
+	struct FieldRef
+	{
+		const Type *ObjectType;
+		int FieldId;
+		bool NoUserView;
+
+		bool operator<(const FieldRef& other) const
+		{
+			return ObjectType < other.ObjectType;
+		}
+	};
+
+	/* The config object types which have a field with this name, sorted by their address. */
+	struct FieldCache
+	{
+		std::vector<FieldRef> Types;
+	};
+
+	std::vector<Instruction> m_Instructions;
+	std::vector<Value> m_Constants;
+	std::vector<const VariableExpression *> m_Variables;
+	std::vector<FieldCache> m_FieldCaches;
+	uint32_t m_RegisterCount{0};
+	uint32_t m_SlotCount{0};
+	uint32_t m_Result{0};
+	size_t m_FallbackCount{0};
+
+	/* Compiler state */
+	uint32_t m_NextRegister{0};
+	std::map<std::pair<String, bool>, uint32_t> m_SlotIds;
+	std::map<String, uint32_t> m_FieldCacheIds;
+
+	BytecodeProgram() = default;
+
+	uint32_t CompileExpression(const Expression *expr);
+	uint32_t CompileBinary(BytecodeOpcode op, const Expression *operand1, const Expression *operand2, const Expression *source);
+	uint32_t CompileIn(bool negate, const Expression *operand1, const Expression *operand2, const Expression *source);
+	uint32_t CompileLogical(bool isAnd, const Expression *operand1, const Expression *operand2);
+	uint32_t CompileConditional(const Expression *condition, const Expression *trueBranch, const Expression *falseBranch);
+	uint32_t CompileCall(const Expression *expr);
+	uint32_t CompileReference(const Expression *expr);
+	uint32_t CompileVariable(const VariableExpression *expr, bool reference);
+	uint32_t CompileFallback(const Expression *expr);
+
+	uint32_t AllocRegister();
+	uint32_t AddConstant(const Value& value);
+	uint32_t AddFieldCache(const String& name);
+	size_t Emit(BytecodeOpcode op, uint32_t dst, uint32_t a, uint32_t b, uint32_t c, const Expression *source);
+	void PatchJump(size_t jump);
+	uint32_t PinOperand(uint32_t operand, uint32_t reserved, size_t start);
+	void Link();
+
+	const Value& GetConstant(uint32_t operand) const;
+
+	Value GetField(const Value& context, const Value& field, uint32_t cache, bool sandboxed, const DebugInfo& debugInfo) const;
+
+	static bool IsConstant(uint32_t operand);
+	static bool IsSlot(uint32_t operand);
+	static bool IsJump(BytecodeOpcode op);
+	static Value ApplyUnary(BytecodeOpcode op, const Value& operand);
+	static Value ApplyBinary(BytecodeOpcode op, const Value& operand1, const Value& operand2);
+};
+
+/**
+ * Evaluates an expression by running its bytecode.
+ *
+ * Falls back to the tree walker while a script debugger is attached to
+ * Expression::OnBreakpoint, so breakpoints and debug hints behave as before.
+ *
+ * @ingroup config
+ */
+class CompiledExpression final : public Expression
+{
+public:
+	DECLARE_PTR_TYPEDEFS(CompiledExpression);
+
+	CompiledExpression(Expression::Ptr expression);
+
+	const Expression::Ptr& GetExpression() const;
+	const BytecodeProgram::Ptr& GetProgram() const;
+
+protected:
+	ExpressionResult DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const override;
+	bool GetReference(ScriptFrame& frame, bool init_dict, Value *parent, String *index, DebugHint **dhint) const override;
+	const DebugInfo& GetDebugInfo() const override;
+
+private:
+	Expression::Ptr m_Expression;
+	BytecodeProgram::Ptr m_Program;
+};
+
+}
+
+#endif /* BYTECODE_H */
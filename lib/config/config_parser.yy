@@ -400,6 +400,8 @@ object:
 			std::move(filter), context->GetZone(), context->GetPackage(), std::move(*$5), $6, $7,
 			std::unique_ptr<Expression>($9), DebugInfoRange(@2, @7));
 		delete $5;
+
+		context->m_Definitions.push_back(DebugInfoRange(@2, @9));
 	}
 	;
 
@@ -1223,6 +1225,8 @@ apply:
 
 		$$ = new ApplyExpression(std::move(type), std::move(target), std::unique_ptr<Expression>($4), std::move(filter), context->GetPackage(), std::move(fkvar), std::move(fvvar), std::move(fterm), std::move(*$7), $8, std::unique_ptr<Expression>($10), DebugInfoRange(@2, @8));
 		delete $7;
+
+		context->m_Definitions.push_back(DebugInfoRange(@2, @10));
 	}
 	;
 
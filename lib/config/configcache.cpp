@@ -0,0 +1,586 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "config/configcache.hpp"
+#include "config/configitem.hpp"
+#include "base/application.hpp"
+#include "base/configobject.hpp"
+#include "base/exception.hpp"
+#include "base/json.hpp"
+#include "base/logger.hpp"
+#include "base/object-packer.hpp"
+#include "base/objectlock.hpp"
+#include "base/scriptglobal.hpp"
+#include "base/serializer.hpp"
+#include "base/singleton.hpp"
+#include "base/tlsutility.hpp"
+#include "base/utility.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+
+using namespace icinga;
+
+/* Bump this whenever the layout of the cached items changes. */
+static const int l_ConfigCacheVersion = 2;
+
+ConfigCache *ConfigCache::GetInstance()
+{
+	return Singleton<ConfigCache>::GetInstance();
+}
+
+/**
+ * Starts recording the config files which are compiled from now on.
+ *
+ * @param filename The path of the cache file.
+ * @param readOnly Whether to only restore objects from the cache, but not to update it.
+ */
+void ConfigCache::Open(const String& filename, bool readOnly)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	Clear();
+
+	m_Path = filename;
+	m_Open = true;
+	m_ReadOnly = readOnly;
+}
+
+/**
+ * Hashes the config files below a directory as if they were below another
+ * one, e.g. the staged cluster config sync files as if they were already
+ * in production. Must be called before Load().
+ *
+ * @param path The directory the files are actually compiled from.
+ * @param alias The directory the files are hashed in.
+ */
+void ConfigCache::SetPathAlias(const String& path, const String& alias)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	m_AliasedPath = path;
+	m_PathAlias = alias;
+}
+
+String ConfigCache::GetHashPath(const String& path) const
+{
+	if (m_AliasedPath.IsEmpty() || path.SubStr(0, m_AliasedPath.GetLength()) != m_AliasedPath)
+		return path;
+
+	/* The directories are joined with and without trailing slashes alike. */
+	String rest = path.SubStr(m_AliasedPath.GetLength());
+	size_t start = rest.FindFirstNotOf("/");
+
+	return m_PathAlias + "/" + (start == String::NPos ? String() : rest.SubStr(start));
+}
+
+bool ConfigCache::IsOpen() const
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	return m_Open;
+}
+
+void ConfigCache::Clear()
+{
+	m_Open = false;
+	m_ReadOnly = false;
+	m_AliasedPath = String();
+	m_PathAlias = String();
+	m_Loaded = false;
+	m_GlobalHash = String();
+	m_Files.clear();
+	m_DefinitionHashes.clear();
+	m_FileHashes.clear();
+	m_CachedItems.clear();
+	m_NewItems.clear();
+	m_AddedItems = 0;
+	m_Hits = 0;
+	m_Misses = 0;
+	m_ObjectHashes.clear();
+}
+
+/**
+ * Records a config file which was compiled. Called by the ConfigCompiler
+ * for every file, possibly from multiple threads.
+ *
+ * @param path The path of the file.
+ * @param text The contents of the file.
+ */
+void ConfigCache::AddFile(const String& path, const String& text)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	if (m_Open)
+		m_Files[path].Text = text;
+}
+
+/**
+ * Records the source ranges of the definitions in a config file.
+ *
+ * @param path The path of the file.
+ * @param definitions The ranges of the object, template and apply definitions.
+ */
+void ConfigCache::AddDefinitions(const String& path, const std::vector<DebugInfo>& definitions)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	auto it = m_Files.find(path);
+
+	if (m_Open && it != m_Files.end())
+		it->second.Definitions = definitions;
+}
+
+/**
+ * Finds a position reported by the lexer in the text of a file. The lexer
+ * counts columns from zero on the first line and from one afterwards, so
+ * both are tried and the expected text decides.
+ */
+static bool LocatePosition(const String& text, const std::vector<size_t>& lines, int line, int column,
+	const std::function<bool (size_t)>& check, size_t *offset)
+{
+	if (line < 1 || static_cast<size_t>(line) > lines.size())
+		return false;
+
+	for (int base = 0; base <= 1; base++) {
+		if (column < base)
+			continue;
+
+		size_t pos = lines[line - 1] + column - base;
+
+		if (pos < text.GetLength() && check(pos)) {
+			*offset = pos;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool LocateDefinition(const String& text, const std::vector<size_t>& lines, const DebugInfo& di,
+	size_t *begin, size_t *end)
+{
+	auto startsDefinition = [&text](size_t pos) {
+		for (const char *keyword : { "object", "template", "apply" }) {
+			if (text.SubStr(pos, strlen(keyword)) == keyword)
+				return true;
+		}
+
+		return false;
+	};
+
+	auto endsDefinition = [&text](size_t pos) { return text[pos] == '}'; };
+
+	return LocatePosition(text, lines, di.FirstLine, di.FirstColumn, startsDefinition, begin)
+		&& LocatePosition(text, lines, di.LastLine, di.LastColumn, endsDefinition, end)
+		&& *begin <= *end;
+}
+
+/**
+ * Reads the cache file once all config files have been compiled. The cached
+ * items are only used if the source outside of the definitions and the
+ * global constants haven't changed.
+ */
+void ConfigCache::Load()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	if (!m_Open)
+		return;
+
+	std::ostringstream globalSource;
+	globalSource << l_ConfigCacheVersion << "\n" << Application::GetAppVersion() << "\n";
+
+	/* Aliased files are hashed in the order they would have in their alias directory. */
+	std::map<String, const decltype(m_Files)::value_type *> files;
+
+	for (auto& kv : m_Files)
+		files.emplace(GetHashPath(kv.first), &kv);
+
+	for (auto& file : files) {
+		const String& hashPath = file.first;
+		const String& path = file.second->first;
+		const SourceFile& source = file.second->second;
+		const String& text = source.Text;
+
+		std::vector<size_t> lines { 0 };
+
+		for (size_t i = 0; i < text.GetLength(); i++) {
+			if (text[i] == '\n')
+				lines.push_back(i + 1);
+		}
+
+		std::vector<std::pair<size_t, size_t> > ranges;
+		bool located = true;
+
+		for (const DebugInfo& di : source.Definitions) {
+			size_t begin, end;
+
+			if (!LocateDefinition(text, lines, di, &begin, &end)) {
+				located = false;
+				break;
+			}
+
+			ranges.emplace_back(begin, end);
+
+			std::ostringstream msgbuf;
+			msgbuf << hashPath << "\n" << di.FirstLine << ":" << di.FirstColumn << "\n" << text.SubStr(begin, end - begin + 1);
+			m_DefinitionHashes[SourceLocation(path, di.FirstLine, di.FirstColumn)] = SHA256(msgbuf.str());
+		}
+
+		m_FileHashes[path] = SHA256(hashPath + "\n" + text);
+
+		globalSource << hashPath << "\n";
+
+		if (!located) {
+			/* Every object in this file depends on all of its contents. */
+			Log(LogNotice, "ConfigCache")
+				<< "Could not locate the definitions in config file '" << path << "'.";
+
+			for (const DebugInfo& di : source.Definitions)
+				m_DefinitionHashes.erase(SourceLocation(path, di.FirstLine, di.FirstColumn));
+
+			globalSource << text << "\n";
+			continue;
+		}
+
+		std::sort(ranges.begin(), ranges.end());
+
+		size_t pos = 0;
+
+		for (auto& range : ranges) {
+			if (range.first > pos)
+				globalSource << text.SubStr(pos, range.first - pos);
+
+			globalSource << "\n";
+			pos = std::max(pos, range.second + 1);
+		}
+
+		if (pos < text.GetLength())
+			globalSource << text.SubStr(pos);
+
+		globalSource << "\n";
+	}
+
+	/* Constants which were defined on the command line aren't part of any file. */
+	Namespace::Ptr globals = ScriptGlobal::GetGlobals();
+
+	{
+		ObjectLock olock(globals);
+		for (const Namespace::Pair& kv : globals) {
+			Value value = kv.second->Get();
+
+			if (!value.IsObject())
+				globalSource << kv.first << "=" << static_cast<int>(value.GetType()) << ":" << value << "\n";
+		}
+	}
+
+	/* Adding a default template changes what every object of its type imports. */
+	for (const Type::Ptr& type : Type::GetAllTypes()) {
+		if (!ConfigObject::TypeInstance->IsAssignableFrom(type))
+			continue;
+
+		for (const ConfigItem::Ptr& item : ConfigItem::GetDefaultTemplates(type))
+			globalSource << type->GetName() << " default " << item->GetName() << "\n";
+	}
+
+	m_GlobalHash = SHA256(globalSource.str());
+
+	if (!Utility::PathExists(m_Path))
+		return;
+
+	std::map<std::pair<String, String>, Dictionary::Ptr> items;
+
+	try {
+		std::ifstream fp(m_Path.CStr(), std::ifstream::in | std::ifstream::binary);
+		String packed((std::istreambuf_iterator<char>(fp)), std::istreambuf_iterator<char>());
+
+		if (fp.bad())
+			BOOST_THROW_EXCEPTION(std::runtime_error("Could not read config cache file '" + m_Path + "'."));
+
+		Dictionary::Ptr cache = UnpackObject(packed);
+
+		if (!cache || cache->Get("global_hash") != m_GlobalHash) {
+			Log(LogInformation, "ConfigCache")
+				<< "Global config has changed since the config cache '" << m_Path << "' was written, evaluating all objects.";
+			return;
+		}
+
+		Array::Ptr cachedItems = cache->Get("items");
+
+		ObjectLock olock(cachedItems);
+		for (const Value& vitem : cachedItems) {
+			Dictionary::Ptr entry = vitem;
+			Dictionary::Ptr item = entry->Get("item");
+			items[{ item->Get("type"), item->Get("name") }] = entry;
+		}
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "ConfigCache")
+			<< "Ignoring config cache '" << m_Path << "': " << DiagnosticInformation(ex, false);
+		return;
+	}
+
+	m_CachedItems = std::move(items);
+	m_Loaded = true;
+
+	Log(LogInformation, "ConfigCache")
+		<< "Loaded " << m_CachedItems.size() << " objects from the config cache.";
+}
+
+String ConfigCache::GetDefinitionHash(const DebugInfo& di) const
+{
+	auto it = m_DefinitionHashes.find(SourceLocation(di.Path, di.FirstLine, di.FirstColumn));
+
+	if (it != m_DefinitionHashes.end())
+		return it->second;
+
+	std::ostringstream msgbuf;
+	msgbuf << di.FirstLine << ":" << di.FirstColumn;
+
+	/* Not an object definition, e.g. an object created by the daemon itself. */
+	auto itFile = m_FileHashes.find(di.Path);
+
+	if (itFile != m_FileHashes.end())
+		msgbuf << ":" << itFile->second;
+
+	return msgbuf.str();
+}
+
+String ConfigCache::GetTemplatesHash(const ConfigItem *item, const Array::Ptr& templates) const
+{
+	std::ostringstream msgbuf;
+
+	if (templates) {
+		ObjectLock olock(templates);
+		for (const Value& name : templates) {
+			ConfigItem::Ptr tmpl = ConfigItem::GetByTypeAndName(item->GetType(), name);
+
+			msgbuf << name << "\n";
+
+			if (tmpl)
+				msgbuf << GetDefinitionHash(tmpl->GetDebugInfo()) << "\n";
+		}
+	}
+
+	return msgbuf.str();
+}
+
+/**
+ * Hashes a variable an object was created with. Config objects are hashed
+ * by their config attributes.
+ *
+ * @returns false if the value can't be hashed, e.g. because it's a function.
+ */
+bool ConfigCache::HashValue(std::ostream& fp, const Value& value)
+{
+	if (!value.IsObject()) {
+		fp << static_cast<int>(value.GetType()) << ":" << JsonEncode(value);
+		return true;
+	}
+
+	Object::Ptr object = value;
+
+	Array::Ptr array = dynamic_pointer_cast<Array>(object);
+
+	if (array) {
+		ObjectLock olock(array);
+
+		fp << "[";
+
+		for (const Value& item : array) {
+			if (!HashValue(fp, item))
+				return false;
+
+			fp << ",";
+		}
+
+		fp << "]";
+		return true;
+	}
+
+	Dictionary::Ptr dict = dynamic_pointer_cast<Dictionary>(object);
+
+	if (dict) {
+		ObjectLock olock(dict);
+
+		fp << "{";
+
+		for (const Dictionary::Pair& kv : dict) {
+			fp << JsonEncode(kv.first.GetString()) << ":";
+
+			if (!HashValue(fp, kv.second))
+				return false;
+
+			fp << ",";
+		}
+
+		fp << "}";
+		return true;
+	}
+
+	ConfigObject::Ptr configObject = dynamic_pointer_cast<ConfigObject>(object);
+
+	if (!configObject)
+		return false;
+
+	String hash;
+
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+
+		auto it = m_ObjectHashes.find(configObject.get());
+
+		if (it != m_ObjectHashes.end())
+			hash = it->second;
+	}
+
+	if (hash.IsEmpty()) {
+		hash = SHA256(JsonEncode(Serialize(configObject, FAConfig)));
+
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_ObjectHashes[configObject.get()] = hash;
+	}
+
+	fp << "object:" << configObject->GetReflectionType()->GetName() << ":" << JsonEncode(configObject->GetName()) << ":" << hash;
+	return true;
+}
+
+/**
+ * Hashes everything an item depends on except for its templates, which are
+ * only known after it has been evaluated.
+ *
+ * @returns false if the item can't be cached.
+ */
+bool ConfigCache::GetBaseHash(const ConfigItem *item, String *hash)
+{
+	std::ostringstream msgbuf;
+	msgbuf << item->GetType()->GetName() << "\n" << item->GetName() << "\n"
+		<< item->GetZone() << "\n" << item->GetPackage() << "\n"
+		<< GetDefinitionHash(item->GetDebugInfo()) << "\n";
+
+	Dictionary::Ptr scope = item->GetScope();
+
+	if (scope && !HashValue(msgbuf, scope))
+		return false;
+
+	*hash = msgbuf.str();
+	return true;
+}
+
+/**
+ * Looks up the cached attributes of a config item. Items which are found are
+ * added to the cache which is written by Finish().
+ *
+ * @param item The item.
+ * @returns The item as it was written to the objects file, or nullptr.
+ */
+Dictionary::Ptr ConfigCache::GetItem(const ConfigItem *item)
+{
+	/* m_CachedItems isn't modified while config items are being committed. */
+	if (!m_Loaded)
+		return nullptr;
+
+	auto it = m_CachedItems.find({ item->GetType()->GetName(), item->GetName() });
+	String baseHash;
+
+	if (it == m_CachedItems.end() || !GetBaseHash(item, &baseHash)) {
+		m_Misses++;
+		return nullptr;
+	}
+
+	const Dictionary::Ptr& entry = it->second;
+
+	if (SHA256(baseHash + GetTemplatesHash(item, entry->Get("templates"))) != entry->Get("hash")) {
+		m_Misses++;
+		return nullptr;
+	}
+
+	m_Hits++;
+
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_NewItems.emplace_back(entry);
+	}
+
+	return entry->Get("item");
+}
+
+/**
+ * Adds a committed config item to the cache which is written by Finish().
+ *
+ * @param item The item.
+ * @param persistentItem The item as it was written to the objects file.
+ */
+void ConfigCache::AddItem(const ConfigItem *item, const Dictionary::Ptr& persistentItem)
+{
+	String baseHash;
+
+	if (!GetBaseHash(item, &baseHash))
+		return;
+
+	Dictionary::Ptr properties = persistentItem->Get("properties");
+	Array::Ptr templates = properties->Get("templates");
+
+	Dictionary::Ptr entry = new Dictionary({
+		{ "item", persistentItem },
+		{ "templates", templates },
+		{ "hash", SHA256(baseHash + GetTemplatesHash(item, templates)) }
+	});
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	if (m_Open) {
+		m_NewItems.emplace_back(std::move(entry));
+		m_AddedItems++;
+	}
+}
+
+/**
+ * Stops recording after the config couldn't be loaded.
+ */
+void ConfigCache::Cancel()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	Clear();
+}
+
+/**
+ * Writes the cache file after the config was loaded successfully, unless
+ * all objects were restored from it anyway or it was opened read-only.
+ */
+void ConfigCache::Finish()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	if (!m_Open)
+		return;
+
+	if (m_Loaded) {
+		Log(LogInformation, "ConfigCache")
+			<< "Restored " << m_Hits << " objects from the config cache, evaluated " << m_Misses << " objects.";
+	}
+
+	if (!m_ReadOnly && (!m_Loaded || m_AddedItems > 0 || m_Hits != m_CachedItems.size())) {
+		try {
+			Dictionary::Ptr cache = new Dictionary({
+				{ "global_hash", m_GlobalHash },
+				{ "items", new Array(std::move(m_NewItems)) }
+			});
+
+			std::fstream fp;
+			String tempFilename = Utility::CreateTempFile(m_Path + ".XXXXXX", 0600, fp);
+
+			fp.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+			fp << PackObject(cache);
+			fp.close();
+
+			Utility::RenameFile(tempFilename, m_Path);
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "ConfigCache")
+				<< "Could not write config cache '" << m_Path << "': " << DiagnosticInformation(ex, false);
+		}
+	}
+
+	Clear();
+}
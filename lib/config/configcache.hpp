@@ -0,0 +1,98 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef CONFIGCACHE_H
+#define CONFIGCACHE_H
+
+#include "config/i2-config.hpp"
+#include "base/array.hpp"
+#include "base/debuginfo.hpp"
+#include "base/dictionary.hpp"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+namespace icinga
+{
+
+class ConfigItem;
+
+/**
+ * Keeps the evaluated config attributes of all objects from the last
+ * successful config load on disk.
+ *
+ * Each object is stored together with a hash of everything its evaluation
+ * depends on: the source of its own definition, the templates it imported
+ * and the variables it was created with (e.g. the host of an apply rule).
+ * Additionally the whole cache depends on the source outside of object,
+ * template and apply definitions and the global constants, as these may be
+ * used by any object.
+ *
+ * ConfigItem::Commit() restores objects whose hash is unchanged instead of
+ * evaluating and validating their expressions again, so only the objects
+ * affected by a config change are evaluated on a reload.
+ *
+ * @ingroup config
+ */
+class ConfigCache
+{
+public:
+	void Open(const String& filename, bool readOnly = false);
+	void SetPathAlias(const String& path, const String& alias);
+	void AddFile(const String& path, const String& text);
+	void AddDefinitions(const String& path, const std::vector<DebugInfo>& definitions);
+	void Load();
+	void Cancel();
+	void Finish();
+
+	bool IsOpen() const;
+
+	Dictionary::Ptr GetItem(const ConfigItem *item);
+	void AddItem(const ConfigItem *item, const Dictionary::Ptr& persistentItem);
+
+	static ConfigCache *GetInstance();
+
+private:
+	struct SourceFile
+	{
+		String Text;
+		std::vector<DebugInfo> Definitions;
+	};
+
+	typedef std::tuple<String, int, int> SourceLocation;
+
+	String m_Path;
+	bool m_Open{false};
+	bool m_ReadOnly{false};
+	String m_AliasedPath;
+	String m_PathAlias;
+	bool m_Loaded{false};
+	String m_GlobalHash;
+
+	std::map<String, SourceFile> m_Files;
+	std::map<SourceLocation, String> m_DefinitionHashes;
+	std::map<String, String> m_FileHashes;
+
+	std::map<std::pair<String, String>, Dictionary::Ptr> m_CachedItems;
+	ArrayData m_NewItems;
+	size_t m_AddedItems{0};
+	std::atomic<size_t> m_Hits{0};
+	std::atomic<size_t> m_Misses{0};
+
+	std::map<const Object *, String> m_ObjectHashes;
+
+	mutable std::mutex m_Mutex;
+
+	void Clear();
+
+	String GetHashPath(const String& path) const;
+
+	String GetDefinitionHash(const DebugInfo& di) const;
+	String GetTemplatesHash(const ConfigItem *item, const Array::Ptr& templates) const;
+	bool GetBaseHash(const ConfigItem *item, String *hash);
+	bool HashValue(std::ostream& fp, const Value& value);
+};
+
+}
+
+#endif /* CONFIGCACHE_H */
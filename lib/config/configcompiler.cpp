@@ -2,12 +2,18 @@
 
 #include "config/configcompiler.hpp"
 #include "config/configitem.hpp"
+#include "config/configcache.hpp"
+#include "config/expressionoptimizer.hpp"
 #include "base/logger.hpp"
 #include "base/utility.hpp"
 #include "base/loader.hpp"
 #include "base/context.hpp"
 #include "base/exception.hpp"
+#include "base/configuration.hpp"
+#include "base/workqueue.hpp"
+#include <algorithm>
 #include <fstream>
+#include <iterator>
 
 using namespace icinga;
 
@@ -104,6 +110,59 @@ void ConfigCompiler::CollectIncludes(std::vector<std::unique_ptr<Expression> >&
 	}
 }
 
+/**
+ * Compiles multiple files in parallel. The files don't depend on each other
+ * until they're evaluated, so only the resulting expressions need to be
+ * kept in the order of the files.
+ *
+ * @param expressions Where to append the expressions to.
+ * @param files The files in the order they should be evaluated in.
+ * @param zone The zone.
+ * @param package The package.
+ */
+void ConfigCompiler::CollectIncludes(std::vector<std::unique_ptr<Expression> >& expressions,
+	const std::vector<String>& files, const String& zone, const String& package)
+{
+	if (files.size() < 2) {
+		for (const String& file : files)
+			CollectIncludes(expressions, file, zone, package);
+
+		return;
+	}
+
+	std::vector<std::vector<std::unique_ptr<Expression> > > results(files.size());
+
+	double start = Utility::GetTime();
+	int threads = std::max(1, std::min(Configuration::Concurrency, static_cast<int>(files.size())));
+
+	{
+		WorkQueue upq(0, threads);
+		upq.SetName("ConfigCompiler");
+
+		for (decltype(files.size()) i = 0; i < files.size(); i++) {
+			upq.Enqueue([&files, &results, &zone, &package, i]() {
+				double fileStart = Utility::GetTime();
+
+				CollectIncludes(results[i], files[i], zone, package);
+
+				Log(LogDebug, "ConfigCompiler")
+					<< "Parsed config file '" << files[i] << "' in " << Utility::GetTime() - fileStart << " seconds.";
+			});
+		}
+
+		upq.Join();
+	}
+
+	for (auto& result : results) {
+		for (auto& expression : result)
+			expressions.emplace_back(std::move(expression));
+	}
+
+	Log(LogNotice, "ConfigCompiler")
+		<< "Parsed " << files.size() << " config files in " << Utility::GetTime() - start
+		<< " seconds using " << threads << " threads.";
+}
+
 /**
  * Handles an include directive.
  *
@@ -135,8 +194,8 @@ std::unique_ptr<Expression> ConfigCompiler::HandleInclude(const String& relative
 		}
 	}
 
-	std::vector<std::unique_ptr<Expression> > expressions;
-	auto funcCallback = [&expressions, zone, package](const String& file) { CollectIncludes(expressions, file, zone, package); };
+	std::vector<String> files;
+	auto funcCallback = [&files](const String& file) { files.push_back(file); };
 
 	if (!Utility::Glob(includePath, funcCallback, GlobFile) && includePath.FindFirstOf("*?") == String::NPos) {
 		std::ostringstream msgbuf;
@@ -144,6 +203,9 @@ std::unique_ptr<Expression> ConfigCompiler::HandleInclude(const String& relative
 		BOOST_THROW_EXCEPTION(ScriptError(msgbuf.str(), debuginfo));
 	}
 
+	std::vector<std::unique_ptr<Expression> > expressions;
+	CollectIncludes(expressions, files, zone, package);
+
 	std::unique_ptr<DictExpression> expr{new DictExpression(std::move(expressions))};
 	expr->MakeInline();
 	return std::move(expr);
@@ -167,11 +229,14 @@ std::unique_ptr<Expression> ConfigCompiler::HandleIncludeRecursive(const String&
 	else
 		ppath = relativeBase + "/" + path;
 
-	std::vector<std::unique_ptr<Expression> > expressions;
-	Utility::GlobRecursive(ppath, pattern, [&expressions, zone, package](const String& file) {
-		CollectIncludes(expressions, file, zone, package);
+	std::vector<String> files;
+	Utility::GlobRecursive(ppath, pattern, [&files](const String& file) {
+		files.push_back(file);
 	}, GlobFile);
 
+	std::vector<std::unique_ptr<Expression> > expressions;
+	CollectIncludes(expressions, files, zone, package);
+
 	std::unique_ptr<DictExpression> dict{new DictExpression(std::move(expressions))};
 	dict->MakeInline();
 	return std::move(dict);
@@ -190,9 +255,12 @@ void ConfigCompiler::HandleIncludeZone(const String& relativeBase, const String&
 
 	RegisterZoneDir(tag, ppath, zoneName);
 
-	Utility::GlobRecursive(ppath, pattern, [&expressions, zoneName, package](const String& file) {
-		CollectIncludes(expressions, file, zoneName, package);
+	std::vector<String> files;
+	Utility::GlobRecursive(ppath, pattern, [&files](const String& file) {
+		files.push_back(file);
 	}, GlobFile);
+
+	CollectIncludes(expressions, files, zoneName, package);
 }
 
 /**
@@ -242,7 +310,16 @@ std::unique_ptr<Expression> ConfigCompiler::CompileStream(const String& path,
 	ConfigCompiler ctx(path, stream, zone, package);
 
 	try {
-		return ctx.Compile();
+		std::unique_ptr<Expression> expr = ctx.Compile();
+
+		ExpressionOptimizer::Optimize(expr, path);
+
+		ConfigCache *cache = ConfigCache::GetInstance();
+
+		if (cache->IsOpen())
+			cache->AddDefinitions(path, ctx.m_Definitions);
+
+		return expr;
 	} catch (const ScriptError& ex) {
 		return std::unique_ptr<Expression>(new ThrowExpression(MakeLiteral(ex.what()), ex.IsIncompleteExpression(), ex.GetDebugInfo()));
 	} catch (const std::exception& ex) {
@@ -272,6 +349,14 @@ std::unique_ptr<Expression> ConfigCompiler::CompileFile(const String& path, cons
 	Log(LogNotice, "ConfigCompiler")
 		<< "Compiling config file: " << path;
 
+	ConfigCache *cache = ConfigCache::GetInstance();
+
+	if (cache->IsOpen()) {
+		String text((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+		cache->AddFile(path, text);
+		return CompileText(path, text, zone, package);
+	}
+
 	return CompileStream(path, &stream, zone, package);
 }
 
@@ -98,6 +98,8 @@ public:
 
 	static void CollectIncludes(std::vector<std::unique_ptr<Expression> >& expressions,
 		const String& file, const String& zone, const String& package);
+	static void CollectIncludes(std::vector<std::unique_ptr<Expression> >& expressions,
+		const std::vector<String>& files, const String& zone, const String& package);
 
 	static std::unique_ptr<Expression> HandleInclude(const String& relativeBase, const String& path, bool search,
 		const String& zone, const String& package, const DebugInfo& debuginfo = DebugInfo());
@@ -154,6 +156,8 @@ public:
 	std::stack<String> m_FVVar;
 	std::stack<Expression *> m_FTerm;
 	std::stack<int> m_FlowControlInfo;
+
+	std::vector<DebugInfo> m_Definitions; /**< Source ranges of the object, template and apply definitions. */
 };
 
 }
@@ -7,6 +7,8 @@
 #include "base/exception.hpp"
 #include "base/application.hpp"
 #include "base/utility.hpp"
+#include "base/logger.hpp"
+#include "base/array.hpp"
 
 using namespace icinga;
 
@@ -39,10 +41,21 @@ void ConfigCompilerContext::WriteObject(const Dictionary::Ptr& object)
 		return;
 
 	String json = JsonEncode(object);
+	Dictionary::Ptr properties = object->Get("properties");
+
+	ObjectsIndexEntry entry;
+	entry.Type = object->Get("type");
+	entry.Name = object->Get("name");
+
+	if (properties)
+		entry.InternalName = properties->Get("__name");
 
 	{
 		std::unique_lock<std::mutex> lock(m_Mutex);
+
+		entry.Offset = m_ObjectsFP->tellp();
 		NetString::WriteStringToStream(*m_ObjectsFP, json);
+		m_ObjectsIndex.emplace_back(std::move(entry));
 	}
 }
 
@@ -50,6 +63,7 @@ void ConfigCompilerContext::CancelObjectsFile()
 {
 	delete m_ObjectsFP;
 	m_ObjectsFP = nullptr;
+	m_ObjectsIndex.clear();
 
 #ifdef _WIN32
 	_unlink(m_ObjectsTempFile.CStr());
@@ -60,9 +74,59 @@ void ConfigCompilerContext::CancelObjectsFile()
 
 void ConfigCompilerContext::FinishObjectsFile()
 {
+	std::streamoff objectsSize = m_ObjectsFP->tellp();
+
 	delete m_ObjectsFP;
 	m_ObjectsFP = nullptr;
 
+	/* Don't leave an index behind which doesn't match the new objects file. */
+	Utility::Remove(GetObjectsIndexPath(m_ObjectsPath));
 	Utility::RenameFile(m_ObjectsTempFile, m_ObjectsPath);
+
+	try {
+		WriteObjectsIndex(objectsSize);
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "cli")
+			<< "Could not write objects index file: " << DiagnosticInformation(ex, false);
+	}
+
+	m_ObjectsIndex.clear();
+}
+
+/**
+ * Writes the type and names of all objects and their offsets in the objects
+ * file, so "icinga2 object list" can look up single objects without decoding
+ * all of them.
+ *
+ * The first netstring is a header with the size of the objects file, the
+ * others are [ offset, type, name, internal name ] arrays.
+ */
+void ConfigCompilerContext::WriteObjectsIndex(std::streamoff objectsSize)
+{
+	String indexPath = GetObjectsIndexPath(m_ObjectsPath);
+
+	std::fstream fp;
+	String tempIndexPath = Utility::CreateTempFile(indexPath + ".XXXXXX", 0600, fp);
+
+	fp.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
+	NetString::WriteStringToStream(fp, JsonEncode(new Dictionary({
+		{ "objects_size", static_cast<double>(objectsSize) }
+	})));
+
+	for (auto& entry : m_ObjectsIndex) {
+		NetString::WriteStringToStream(fp, JsonEncode(new Array({
+			static_cast<double>(entry.Offset), entry.Type, entry.Name, entry.InternalName
+		})));
+	}
+
+	fp.close();
+
+	Utility::RenameFile(tempIndexPath, indexPath);
+}
+
+String ConfigCompilerContext::GetObjectsIndexPath(const String& objectsPath)
+{
+	return objectsPath + ".index";
 }
 
@@ -7,6 +7,7 @@
 #include "base/dictionary.hpp"
 #include <fstream>
 #include <mutex>
+#include <vector>
 
 namespace icinga
 {
@@ -23,11 +24,24 @@ public:
 	void FinishObjectsFile();
 
 	static ConfigCompilerContext *GetInstance();
+	static String GetObjectsIndexPath(const String& objectsPath);
 
 private:
+	/* Where to find an object in the objects file, see WriteObjectsIndex(). */
+	struct ObjectsIndexEntry
+	{
+		std::streamoff Offset;
+		String Type;
+		String Name;
+		String InternalName;
+	};
+
 	String m_ObjectsPath;
 	String m_ObjectsTempFile;
 	std::fstream *m_ObjectsFP{nullptr};
+	std::vector<ObjectsIndexEntry> m_ObjectsIndex;
+
+	void WriteObjectsIndex(std::streamoff objectsSize);
 
 	mutable std::mutex m_Mutex;
 };
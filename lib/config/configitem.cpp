@@ -2,9 +2,11 @@
 
 #include "config/configitem.hpp"
 #include "config/configcompilercontext.hpp"
+#include "config/configcache.hpp"
 #include "config/applyrule.hpp"
 #include "config/objectrule.hpp"
 #include "config/configcompiler.hpp"
+#include "config/bytecode.hpp"
 #include "base/application.hpp"
 #include "base/configtype.hpp"
 #include "base/objectlock.hpp"
@@ -16,6 +18,8 @@
 #include "base/stdiostream.hpp"
 #include "base/netstring.hpp"
 #include "base/serializer.hpp"
+#include "base/startupprofiler.hpp"
+#include "base/profiler.hpp"
 #include "base/json.hpp"
 #include "base/exception.hpp"
 #include "base/function.hpp"
@@ -24,16 +28,20 @@
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <atomic>
 #include <random>
 
 using namespace icinga;
 
 std::mutex ConfigItem::m_Mutex;
 ConfigItem::TypeMap ConfigItem::m_Items;
+ConcurrentIndex<ConfigItem::ItemKey, ConfigItem::Ptr, ConfigItem::ItemKeyHash> ConfigItem::m_ItemIndex;
 ConfigItem::TypeMap ConfigItem::m_DefaultTemplates;
 ConfigItem::ItemList ConfigItem::m_UnnamedItems;
 ConfigItem::IgnoredItemList ConfigItem::m_IgnoredItems;
 
+boost::signals2::signal<void (const Type::Ptr&, const std::vector<ConfigObject::Ptr>&)> ConfigItem::OnObjectsLoaded;
+
 REGISTER_FUNCTION(Internal, run_with_activation_context, &ConfigItem::RunWithActivationContext, "func");
 
 /**
@@ -52,7 +60,8 @@ ConfigItem::ConfigItem(Type::Ptr type, String name,
 	DebugInfo debuginfo, Dictionary::Ptr scope,
 	String zone, String package)
 	: m_Type(std::move(type)), m_Name(std::move(name)), m_Abstract(abstract),
-	m_Expression(std::move(exprl)), m_Filter(std::move(filter)),
+	m_Expression(std::move(exprl)), m_Filter(filter ? new CompiledExpression(std::move(filter)) : nullptr),
+	m_TemplateProgram(abstract && m_Expression ? TemplateProgram::Compile(m_Expression) : nullptr),
 	m_DefaultTmpl(defaultTmpl), m_IgnoreOnError(ignoreOnError),
 	m_DebugInfo(std::move(debuginfo)), m_Scope(std::move(scope)), m_Zone(std::move(zone)),
 	m_Package(std::move(package))
@@ -114,6 +123,16 @@ Dictionary::Ptr ConfigItem::GetScope() const
 	return m_Scope;
 }
 
+String ConfigItem::GetZone() const
+{
+	return m_Zone;
+}
+
+String ConfigItem::GetPackage() const
+{
+	return m_Package;
+}
+
 ConfigObject::Ptr ConfigItem::GetObject() const
 {
 	return m_Object;
@@ -139,6 +158,17 @@ Expression::Ptr ConfigItem::GetFilter() const
 	return m_Filter;
 }
 
+/**
+ * Retrieves the expression list of a template, prepared for being imported
+ * by many objects.
+ *
+ * @returns The program, nullptr if this isn't a template.
+ */
+TemplateProgram::Ptr ConfigItem::GetTemplateProgram() const
+{
+	return m_TemplateProgram;
+}
+
 class DefaultValidationUtils final : public ValidationUtils
 {
 public:
@@ -159,7 +189,58 @@ public:
  *
  * @returns The ConfigObject that was created/updated.
  */
-ConfigObject::Ptr ConfigItem::Commit(bool discard)
+/**
+ * Checks whether a value survives being serialized and restored, i.e. that
+ * it doesn't contain functions or other objects.
+ */
+static bool IsCacheableValue(const Value& value)
+{
+	if (!value.IsObject())
+		return true;
+
+	Object::Ptr object = value;
+
+	Array::Ptr array = dynamic_pointer_cast<Array>(object);
+
+	if (array) {
+		ObjectLock olock(array);
+
+		return std::all_of(array->Begin(), array->End(), IsCacheableValue);
+	}
+
+	Dictionary::Ptr dict = dynamic_pointer_cast<Dictionary>(object);
+
+	if (dict) {
+		ObjectLock olock(dict);
+
+		return std::all_of(dict->Begin(), dict->End(), [](const Dictionary::Pair& kv) {
+			return IsCacheableValue(kv.second);
+		});
+	}
+
+	return false;
+}
+
+static bool IsCacheable(const ConfigObject::Ptr& object)
+{
+	Type::Ptr type = object->GetReflectionType();
+
+	for (int i = 0; i < type->GetFieldCount(); i++) {
+		Field field = type->GetFieldInfo(i);
+
+		if ((field.Attributes & FAConfig) && !IsCacheableValue(object->GetField(i)))
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * Evaluates the item into a new object, see Commit().
+ *
+ * @returns false if the item is ignored due to errors
+ */
+bool ConfigItem::Instantiate(bool discard)
 {
 	Type::Ptr type = GetType();
 
@@ -173,7 +254,7 @@ ConfigObject::Ptr ConfigItem::Commit(bool discard)
 		BOOST_THROW_EXCEPTION(ScriptError("Type '" + type->GetName() + "' does not exist.", m_DebugInfo));
 
 	if (IsAbstract())
-		return nullptr;
+		return false;
 
 	ConfigObject::Ptr dobj = static_pointer_cast<ConfigObject>(type->Instantiate(std::vector<Value>()));
 
@@ -182,27 +263,27 @@ ConfigObject::Ptr ConfigItem::Commit(bool discard)
 	dobj->SetPackage(m_Package);
 	dobj->SetName(m_Name);
 
+	ConfigCache *cache = ConfigCache::GetInstance();
+	Dictionary::Ptr cachedItem = cache->GetItem(this);
 	DebugHint debugHints;
 
-	ScriptFrame frame(true, dobj);
-	if (m_Scope)
-		m_Scope->CopyTo(frame.Locals);
-	try {
-		m_Expression->Evaluate(frame, &debugHints);
-	} catch (const std::exception& ex) {
-		if (m_IgnoreOnError) {
-			Log(LogNotice, "ConfigObject")
-				<< "Ignoring config object '" << m_Name << "' of type '" << type->GetName() << "' due to errors: " << DiagnosticInformation(ex);
-
-			{
-				std::unique_lock<std::mutex> lock(m_Mutex);
-				m_IgnoredItems.push_back(m_DebugInfo.Path);
+	if (cachedItem) {
+		/* Nothing this object depends on has changed since it was evaluated and validated. */
+		Deserialize(dobj, cachedItem->Get("properties"), true, FAConfig);
+	} else {
+		ScriptFrame frame(true, dobj);
+		if (m_Scope)
+			m_Scope->CopyTo(frame.Locals);
+		try {
+			m_Expression->Evaluate(frame, &debugHints);
+		} catch (const std::exception& ex) {
+			if (m_IgnoreOnError) {
+				Ignore(ex);
+				return false;
 			}
 
-			return nullptr;
+			throw;
 		}
-
-		throw;
 	}
 
 	if (discard)
@@ -236,71 +317,102 @@ ConfigObject::Ptr ConfigItem::Commit(bool discard)
 
 	dobj->SetName(name);
 
-	Dictionary::Ptr dhint = debugHints.ToDictionary();
+	Dictionary::Ptr dhint = cachedItem ? Dictionary::Ptr(cachedItem->Get("debug_hints")) : debugHints.ToDictionary();
+
+	m_Pending.reset(new PendingObject{ std::move(dobj), std::move(cachedItem), std::move(dhint) });
+
+	return true;
+}
+
+/**
+ * Validates the object which has been evaluated by Instantiate(), unless it
+ * has been restored from the config cache.
+ *
+ * Objects are validated in bulk while no objects are registered, see
+ * CommitNewItems(), so cross-object validators see the same objects
+ * no matter in which order the items are committed.
+ *
+ * @returns false if the item is ignored due to errors
+ */
+bool ConfigItem::ValidateObject()
+{
+	if (m_Pending->CachedItem)
+		return true;
 
 	try {
 		DefaultValidationUtils utils;
-		dobj->Validate(FAConfig, utils);
+		m_Pending->Object->Validate(FAConfig, utils);
 	} catch (ValidationError& ex) {
 		if (m_IgnoreOnError) {
-			Log(LogNotice, "ConfigObject")
-				<< "Ignoring config object '" << m_Name << "' of type '" << type->GetName() << "' due to errors: " << DiagnosticInformation(ex);
-
-			{
-				std::unique_lock<std::mutex> lock(m_Mutex);
-				m_IgnoredItems.push_back(m_DebugInfo.Path);
-			}
-
-			return nullptr;
+			Ignore(ex);
+			m_Pending.reset();
+			return false;
 		}
 
-		ex.SetDebugHint(dhint);
+		ex.SetDebugHint(m_Pending->DebugHints);
 		throw;
 	}
 
+	return true;
+}
+
+/**
+ * Registers the object which has been evaluated by Instantiate() and
+ * validated by ValidateObject().
+ */
+ConfigObject::Ptr ConfigItem::Commit()
+{
+	std::unique_ptr<PendingObject> pending (std::move(m_Pending));
+	ConfigObject::Ptr dobj = std::move(pending->Object);
+	Dictionary::Ptr cachedItem = std::move(pending->CachedItem);
+	Dictionary::Ptr dhint = std::move(pending->DebugHints);
+	Type::Ptr type = GetType();
+	ConfigCache *cache = ConfigCache::GetInstance();
+
 	try {
 		dobj->OnConfigLoaded();
 	} catch (const std::exception& ex) {
 		if (m_IgnoreOnError) {
-			Log(LogNotice, "ConfigObject")
-				<< "Ignoring config object '" << m_Name << "' of type '" << m_Type->GetName() << "' due to errors: " << DiagnosticInformation(ex);
-
-			{
-				std::unique_lock<std::mutex> lock(m_Mutex);
-				m_IgnoredItems.push_back(m_DebugInfo.Path);
-			}
-
+			Ignore(ex);
 			return nullptr;
 		}
 
 		throw;
 	}
 
-	Value serializedObject;
+	Dictionary::Ptr persistentItem = cachedItem;
 
-	try {
-		serializedObject = Serialize(dobj, FAConfig);
-	} catch (const CircularReferenceError& ex) {
-		BOOST_THROW_EXCEPTION(ValidationError(dobj, ex.GetPath(), "Circular references are not allowed"));
-	}
+	if (!persistentItem) {
+		Value serializedObject;
 
-	Dictionary::Ptr persistentItem = new Dictionary({
-		{ "type", type->GetName() },
-		{ "name", GetName() },
-		{ "properties", Serialize(dobj, FAConfig) },
-		{ "debug_hints", dhint },
-		{ "debug_info", new Array({
-			m_DebugInfo.Path,
-			m_DebugInfo.FirstLine,
-			m_DebugInfo.FirstColumn,
-			m_DebugInfo.LastLine,
-			m_DebugInfo.LastColumn,
-		}) }
-	});
+		try {
+			serializedObject = Serialize(dobj, FAConfig);
+		} catch (const CircularReferenceError& ex) {
+			BOOST_THROW_EXCEPTION(ValidationError(dobj, ex.GetPath(), "Circular references are not allowed"));
+		}
+
+		persistentItem = new Dictionary({
+			{ "type", type->GetName() },
+			{ "name", GetName() },
+			{ "properties", serializedObject },
+			{ "debug_hints", dhint },
+			{ "debug_info", new Array({
+				m_DebugInfo.Path,
+				m_DebugInfo.FirstLine,
+				m_DebugInfo.FirstColumn,
+				m_DebugInfo.LastLine,
+				m_DebugInfo.LastColumn,
+			}) }
+		});
+	}
 
 	dhint.reset();
 
 	ConfigCompilerContext::GetInstance()->WriteObject(persistentItem);
+
+	if (!cachedItem && cache->IsOpen() && IsCacheable(dobj))
+		cache->AddItem(this, persistentItem);
+
 	persistentItem.reset();
 
 	dobj->Register();
@@ -310,6 +422,15 @@ ConfigObject::Ptr ConfigItem::Commit(bool discard)
 	return dobj;
 }
 
+void ConfigItem::Ignore(const std::exception& ex)
+{
+	Log(LogNotice, "ConfigObject")
+		<< "Ignoring config object '" << m_Name << "' of type '" << m_Type->GetName() << "' due to errors: " << DiagnosticInformation(ex);
+
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(m_Mutex));
+	m_IgnoredItems.push_back(m_DebugInfo.Path);
+}
+
 /**
  * Registers the configuration item.
  */
@@ -317,7 +438,7 @@ void ConfigItem::Register()
 {
 	m_ActivationContext = ActivationContext::GetCurrentContext();
 
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(m_Mutex));
 
 	/* If this is a non-abstract object with a composite name
 	 * we register it in m_UnnamedItems instead of m_Items. */
@@ -337,6 +458,7 @@ void ConfigItem::Register()
 		}
 
 		m_Items[m_Type][m_Name] = this;
+		m_ItemIndex.Insert(ItemKey(m_Type.get(), m_Name), this);
 
 		if (m_DefaultTmpl)
 			m_DefaultTemplates[m_Type][m_Name] = this;
@@ -353,9 +475,10 @@ void ConfigItem::Unregister()
 		m_Object.reset();
 	}
 
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(m_Mutex));
 	m_UnnamedItems.erase(std::remove(m_UnnamedItems.begin(), m_UnnamedItems.end(), this), m_UnnamedItems.end());
 	m_Items[m_Type].erase(m_Name);
+	m_ItemIndex.Erase(ItemKey(m_Type.get(), m_Name));
 	m_DefaultTemplates[m_Type].erase(m_Name);
 }
 
@@ -368,28 +491,26 @@ void ConfigItem::Unregister()
  */
 ConfigItem::Ptr ConfigItem::GetByTypeAndName(const Type::Ptr& type, const String& name)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
-
-	auto it = m_Items.find(type);
+	ConfigItem::Ptr item;
 
-	if (it == m_Items.end())
-		return nullptr;
-
-	auto it2 = it->second.find(name);
+	m_ItemIndex.Get(ItemKey(type.get(), name), item);
 
-	if (it2 == it->second.end())
-		return nullptr;
+	return item;
+}
 
-	return it2->second;
+size_t ConfigItem::ItemKeyHash::operator()(const ItemKey& key) const
+{
+	return std::hash<Type *>()(key.first) * 31u + std::hash<String>()(key.second);
 }
 
-bool ConfigItem::CommitNewItems(const ActivationContext::Ptr& context, WorkQueue& upq, std::vector<ConfigItem::Ptr>& newItems)
+bool ConfigItem::CommitNewItems(const ActivationContext::Ptr& context, WorkQueue& upq, std::vector<ConfigItem::Ptr>& newItems,
+	std::map<Type::Ptr, double>& typeTimes, std::map<Type::Ptr, double>& validationTimes)
 {
 	typedef std::pair<ConfigItem::Ptr, bool> ItemPair;
 	std::vector<ItemPair> items;
 
 	{
-		std::unique_lock<std::mutex> lock(m_Mutex);
+		std::unique_lock<std::mutex> lock (PROFILED_LOCK(m_Mutex));
 
 		for (const TypeMap::value_type& kv : m_Items) {
 			for (const ItemMap::value_type& kv2 : kv.second) {
@@ -435,6 +556,21 @@ bool ConfigItem::CommitNewItems(const ActivationContext::Ptr& context, WorkQueue
 	for (const auto& ip : items)
 		newItems.push_back(ip.first);
 
+	/* The items of a type, so that each phase only visits the items of the type it's working on. */
+	struct TypeItems
+	{
+		std::vector<ItemPair> Items;
+		std::atomic<size_t> Pending{0};
+		double Instantiated{0};
+		double Validated{0};
+		double Finished{0};
+	};
+
+	std::map<Type::Ptr, TypeItems> itemsByType;
+
+	for (const auto& ip : items)
+		itemsByType[ip.first->m_Type].Items.push_back(ip);
+
 	std::set<Type::Ptr> types;
 	std::set<Type::Ptr> completed_types;
 
@@ -444,6 +580,8 @@ bool ConfigItem::CommitNewItems(const ActivationContext::Ptr& context, WorkQueue
 	}
 
 	while (types.size() != completed_types.size()) {
+		std::vector<Type::Ptr> ready_types;
+
 		for (const Type::Ptr& type : types) {
 			if (completed_types.find(type) != completed_types.end())
 				continue;
@@ -462,30 +600,101 @@ bool ConfigItem::CommitNewItems(const ActivationContext::Ptr& context, WorkQueue
 			if (unresolved_dep)
 				continue;
 
-			int committed_items = 0;
-			upq.ParallelFor(items, [&type, &committed_items](const ItemPair& ip) {
-				const ConfigItem::Ptr& item = ip.first;
+			ready_types.push_back(type);
+		}
+
+		/* None of these types depends on another one, so their items are committed at the same time. */
+		double start = Utility::GetTime();
+
+		for (const Type::Ptr& type : ready_types) {
+			auto it = itemsByType.find(type);
 
-				if (item->m_Type != type)
-					return;
+			if (it == itemsByType.end())
+				continue;
 
-				ip.first->Commit(ip.second);
-				committed_items++;
+			TypeItems& typeItems = it->second;
+			typeItems.Pending = typeItems.Items.size();
+
+			upq.ParallelFor(typeItems.Items, [&typeItems](const ItemPair& ip) {
+				ip.first->Instantiate(ip.second);
+
+				if (--typeItems.Pending == 0u)
+					typeItems.Instantiated = Utility::GetTime();
 			});
+		}
 
-			upq.Join();
+		upq.Join();
+
+		if (upq.HasExceptions())
+			return false;
+
+		/* Nothing is registered while the new objects are validated. */
+		double validationStart = Utility::GetTime();
+
+		for (const Type::Ptr& type : ready_types) {
+			auto it = itemsByType.find(type);
+
+			if (it == itemsByType.end())
+				continue;
+
+			TypeItems& typeItems = it->second;
+			typeItems.Pending = typeItems.Items.size();
+
+			upq.ParallelFor(typeItems.Items, [&typeItems](const ItemPair& ip) {
+				if (ip.first->m_Pending)
+					ip.first->ValidateObject();
+
+				if (--typeItems.Pending == 0u)
+					typeItems.Validated = Utility::GetTime();
+			});
+		}
+
+		upq.Join();
+
+		if (upq.HasExceptions())
+			return false;
+
+		double commitStart = Utility::GetTime();
+
+		for (const Type::Ptr& type : ready_types) {
+			auto it = itemsByType.find(type);
+
+			if (it == itemsByType.end())
+				continue;
+
+			TypeItems& typeItems = it->second;
+			typeItems.Pending = typeItems.Items.size();
+
+			upq.ParallelFor(typeItems.Items, [&typeItems](const ItemPair& ip) {
+				if (ip.first->m_Pending)
+					ip.first->Commit();
+
+				if (--typeItems.Pending == 0u)
+					typeItems.Finished = Utility::GetTime();
+			});
+		}
 
+		upq.Join();
+
+		for (const Type::Ptr& type : ready_types) {
 			completed_types.insert(type);
 
+			auto it = itemsByType.find(type);
+
+			if (it == itemsByType.end() || it->second.Pending != 0u)
+				continue;
+
+			typeTimes[type] += (it->second.Instantiated - start) + (it->second.Finished - commitStart);
+			validationTimes[type] += it->second.Validated - validationStart;
+
 #ifdef I2_DEBUG
-			if (committed_items > 0)
-				Log(LogDebug, "configitem")
-					<< "Committed " << committed_items << " items of type '" << type->GetName() << "'.";
+			Log(LogDebug, "configitem")
+				<< "Committed " << it->second.Items.size() << " items of type '" << type->GetName() << "'.";
 #endif /* I2_DEBUG */
-
-			if (upq.HasExceptions())
-				return false;
 		}
+
+		if (upq.HasExceptions())
+			return false;
 	}
 
 #ifdef I2_DEBUG
@@ -514,31 +723,36 @@ bool ConfigItem::CommitNewItems(const ActivationContext::Ptr& context, WorkQueue
 			if (unresolved_dep)
 				continue;
 
-			int notified_items = 0;
-			upq.ParallelFor(items, [&type, &notified_items](const ItemPair& ip) {
-				const ConfigItem::Ptr& item = ip.first;
+			double start = Utility::GetTime();
+			std::atomic<int> notified_items (0);
+			auto it = itemsByType.find(type);
 
-				if (!item->m_Object || item->m_Type != type)
-					return;
+			if (it != itemsByType.end()) {
+				upq.ParallelFor(it->second.Items, [&notified_items](const ItemPair& ip) {
+					const ConfigItem::Ptr& item = ip.first;
 
-				try {
-					item->m_Object->OnAllConfigLoaded();
-					notified_items++;
-				} catch (const std::exception& ex) {
-					if (!item->m_IgnoreOnError)
-						throw;
+					if (!item->m_Object)
+						return;
+
+					try {
+						item->m_Object->OnAllConfigLoaded();
+						notified_items++;
+					} catch (const std::exception& ex) {
+						if (!item->m_IgnoreOnError)
+							throw;
 
-					Log(LogNotice, "ConfigObject")
-						<< "Ignoring config object '" << item->m_Name << "' of type '" << item->m_Type->GetName() << "' due to errors: " << DiagnosticInformation(ex);
+						Log(LogNotice, "ConfigObject")
+							<< "Ignoring config object '" << item->m_Name << "' of type '" << item->m_Type->GetName() << "' due to errors: " << DiagnosticInformation(ex);
 
-					item->Unregister();
+						item->Unregister();
 
-					{
-						std::unique_lock<std::mutex> lock(item->m_Mutex);
-						item->m_IgnoredItems.push_back(item->m_DebugInfo.Path);
+						{
+							std::unique_lock<std::mutex> lock (PROFILED_LOCK(item->m_Mutex));
+							item->m_IgnoredItems.push_back(item->m_DebugInfo.Path);
+						}
 					}
-				}
-			});
+				});
+			}
 
 			completed_types.insert(type);
 
@@ -553,12 +767,28 @@ bool ConfigItem::CommitNewItems(const ActivationContext::Ptr& context, WorkQueue
 			if (upq.HasExceptions())
 				return false;
 
+			if (it != itemsByType.end()) {
+				std::vector<ConfigObject::Ptr> objects;
+
+				for (const ItemPair& ip : it->second.Items) {
+					if (ip.first->m_Object)
+						objects.push_back(ip.first->m_Object);
+				}
+
+				OnObjectsLoaded(type, objects);
+			}
+
 			notified_items = 0;
 			for (const String& loadDep : type->GetLoadDependencies()) {
-				upq.ParallelFor(items, [loadDep, &type, &notified_items](const ItemPair& ip) {
+				auto itDep = itemsByType.find(Type::GetByName(loadDep));
+
+				if (itDep == itemsByType.end())
+					continue;
+
+				upq.ParallelFor(itDep->second.Items, [&type, &notified_items](const ItemPair& ip) {
 					const ConfigItem::Ptr& item = ip.first;
 
-					if (!item->m_Object || item->m_Type->GetName() != loadDep)
+					if (!item->m_Object)
 						return;
 
 					ActivationScope ascope(item->m_ActivationContext);
@@ -578,8 +808,11 @@ bool ConfigItem::CommitNewItems(const ActivationContext::Ptr& context, WorkQueue
 			if (upq.HasExceptions())
 				return false;
 
+			if (it != itemsByType.end())
+				typeTimes[type] += Utility::GetTime() - start;
+
 			// Make sure to activate any additionally generated items
-			if (!CommitNewItems(context, upq, newItems))
+			if (!CommitNewItems(context, upq, newItems, typeTimes, validationTimes))
 				return false;
 		}
 	}
@@ -592,7 +825,10 @@ bool ConfigItem::CommitItems(const ActivationContext::Ptr& context, WorkQueue& u
 	if (!silent)
 		Log(LogInformation, "ConfigItem", "Committing config item(s).");
 
-	if (!CommitNewItems(context, upq, newItems)) {
+	std::map<Type::Ptr, double> typeTimes;
+	std::map<Type::Ptr, double> validationTimes;
+
+	if (!CommitNewItems(context, upq, newItems, typeTimes, validationTimes)) {
 		upq.ReportExceptions("config");
 
 		for (const ConfigItem::Ptr& item : newItems) {
@@ -619,6 +855,21 @@ bool ConfigItem::CommitItems(const ActivationContext::Ptr& context, WorkQueue& u
 			Log(LogInformation, "ConfigItem")
 				<< "Instantiated " << kv.second << " " << (kv.second != 1 ? kv.first->GetPluralName() : kv.first->GetName()) << ".";
 		}
+
+		for (const auto& kv : typeTimes) {
+			Log(LogInformation, "ConfigItem")
+				<< "Committed " << kv.first->GetPluralName() << " in " << kv.second << " seconds.";
+
+			/* Types are committed in parallel, so there's no CPU time per type. */
+			StartupProfiler::Record("commit", kv.first->GetName(), kv.second, -1, itemCounts[kv.first]);
+		}
+
+		for (const auto& kv : validationTimes) {
+			Log(LogInformation, "ConfigItem")
+				<< "Validated " << kv.first->GetPluralName() << " in " << kv.second << " seconds.";
+
+			StartupProfiler::Record("validate", kv.first->GetName(), kv.second, -1, itemCounts[kv.first]);
+		}
 	}
 
 	return true;
@@ -676,6 +927,13 @@ bool ConfigItem::ActivateItems(const std::vector<ConfigItem::Ptr>& newItems, boo
 	});
 
 	for (const Type::Ptr& type : types) {
+		double wallStart = Utility::GetTime();
+		double cpuStart = StartupProfiler::GetCpuTime();
+		size_t activated = 0;
+
+		/* The API listener and the features are activated after all core objects. */
+		bool isFeature = type->GetActivationPriority() >= 50;
+
 		for (const ConfigItem::Ptr& item : newItems) {
 			if (!item->m_Object)
 				continue;
@@ -693,8 +951,17 @@ bool ConfigItem::ActivateItems(const std::vector<ConfigItem::Ptr>& newItems, boo
 				<< objectType->GetActivationPriority();
 #endif /* I2_DEBUG */
 
+			std::unique_ptr<StartupProfiler::Scope> profile;
+
+			if (isFeature && !silent)
+				profile.reset(new StartupProfiler::Scope("feature", type->GetName() + " '" + object->GetName() + "'", 1));
+
 			object->Activate(runtimeCreated, cookie);
+			activated++;
 		}
+
+		if (activated && !silent)
+			StartupProfiler::Record("activate", type->GetName(), Utility::GetTime() - wallStart, StartupProfiler::GetCpuTime() - cpuStart, activated);
 	}
 
 	if (!silent)
@@ -714,6 +981,7 @@ bool ConfigItem::RunWithActivationContext(const Function::Ptr& function)
 
 	WorkQueue upq(25000, Configuration::Concurrency);
 	upq.SetName("ConfigItem::RunWithActivationContext");
+	upq.SetWorkStealing(true);
 
 	std::vector<ConfigItem::Ptr> newItems;
 
@@ -730,7 +998,7 @@ std::vector<ConfigItem::Ptr> ConfigItem::GetItems(const Type::Ptr& type)
 {
 	std::vector<ConfigItem::Ptr> items;
 
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(m_Mutex));
 
 	auto it = m_Items.find(type);
 
@@ -750,7 +1018,7 @@ std::vector<ConfigItem::Ptr> ConfigItem::GetDefaultTemplates(const Type::Ptr& ty
 {
 	std::vector<ConfigItem::Ptr> items;
 
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(m_Mutex));
 
 	auto it = m_DefaultTemplates.find(type);
 
@@ -768,7 +1036,7 @@ std::vector<ConfigItem::Ptr> ConfigItem::GetDefaultTemplates(const Type::Ptr& ty
 
 void ConfigItem::RemoveIgnoredItems(const String& allowedConfigPath)
 {
-	std::unique_lock<std::mutex> lock(m_Mutex);
+	std::unique_lock<std::mutex> lock (PROFILED_LOCK(m_Mutex));
 
 	for (const String& path : m_IgnoredItems) {
 		if (path.Find(allowedConfigPath) == String::NPos)
@@ -6,7 +6,9 @@
 #include "config/i2-config.hpp"
 #include "config/expression.hpp"
 #include "config/activationcontext.hpp"
+#include "config/templateprogram.hpp"
 #include "base/configobject.hpp"
+#include "base/concurrentindex.hpp"
 #include "base/workqueue.hpp"
 
 namespace icinga
@@ -40,12 +42,15 @@ public:
 
 	Expression::Ptr GetExpression() const;
 	Expression::Ptr GetFilter() const;
+	TemplateProgram::Ptr GetTemplateProgram() const;
 
 	void Register();
 	void Unregister();
 
 	DebugInfo GetDebugInfo() const;
 	Dictionary::Ptr GetScope() const;
+	String GetZone() const;
+	String GetPackage() const;
 
 	ConfigObject::Ptr GetObject() const;
 
@@ -53,6 +58,9 @@ public:
 		const String& name);
 
 	static bool CommitItems(const ActivationContext::Ptr& context, WorkQueue& upq, std::vector<ConfigItem::Ptr>& newItems, bool silent = false);
+
+	/* Emitted with the new objects of a type once they all got OnAllConfigLoaded(), for work which is cheaper in bulk. */
+	static boost::signals2::signal<void (const Type::Ptr&, const std::vector<ConfigObject::Ptr>&)> OnObjectsLoaded;
 	static bool ActivateItems(const std::vector<ConfigItem::Ptr>& newItems, bool runtimeCreated = false,
 		bool silent = false, bool withModAttrs = false, const Value& cookie = Empty);
 
@@ -70,6 +78,7 @@ private:
 
 	Expression::Ptr m_Expression;
 	Expression::Ptr m_Filter;
+	TemplateProgram::Ptr m_TemplateProgram; /**< The expression prepared for imports, templates only. */
 	bool m_DefaultTmpl;
 	bool m_IgnoreOnError;
 	DebugInfo m_DebugInfo; /**< Debug information. */
@@ -80,6 +89,16 @@ private:
 
 	ConfigObject::Ptr m_Object;
 
+	/* An object which has been evaluated, but not validated and registered yet. */
+	struct PendingObject
+	{
+		ConfigObject::Ptr Object;
+		Dictionary::Ptr CachedItem;
+		Dictionary::Ptr DebugHints;
+	};
+
+	std::unique_ptr<PendingObject> m_Pending;
+
 	static std::mutex m_Mutex;
 
 	typedef std::map<String, ConfigItem::Ptr> ItemMap;
@@ -87,6 +106,16 @@ private:
 	static TypeMap m_Items; /**< All registered configuration items. */
 	static TypeMap m_DefaultTemplates;
 
+	typedef std::pair<Type *, String> ItemKey;
+
+	struct ItemKeyHash
+	{
+		size_t operator()(const ItemKey& key) const;
+	};
+
+	/* The items in m_Items, for GetByTypeAndName() which doesn't take m_Mutex. */
+	static ConcurrentIndex<ItemKey, ConfigItem::Ptr, ItemKeyHash> m_ItemIndex;
+
 	typedef std::vector<ConfigItem::Ptr> ItemList;
 	static ItemList m_UnnamedItems;
 
@@ -96,9 +125,13 @@ private:
 	static ConfigItem::Ptr GetObjectUnlocked(const String& type,
 		const String& name);
 
-	ConfigObject::Ptr Commit(bool discard = true);
+	bool Instantiate(bool discard = true);
+	bool ValidateObject();
+	ConfigObject::Ptr Commit();
+	void Ignore(const std::exception& ex);
 
-	static bool CommitNewItems(const ActivationContext::Ptr& context, WorkQueue& upq, std::vector<ConfigItem::Ptr>& newItems);
+	static bool CommitNewItems(const ActivationContext::Ptr& context, WorkQueue& upq, std::vector<ConfigItem::Ptr>& newItems,
+		std::map<Type::Ptr, double>& typeTimes, std::map<Type::Ptr, double>& validationTimes);
 };
 
 }
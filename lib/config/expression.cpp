@@ -15,6 +15,7 @@
 #include "base/namespace.hpp"
 #include <boost/exception_ptr.hpp>
 #include <boost/exception/errinfo_nested_exception.hpp>
+#include <algorithm>
 
 using namespace icinga;
 
@@ -107,6 +108,103 @@ VariableExpression::VariableExpression(String variable, std::vector<Expression::
 	m_Imports.push_back(new IndexerExpression(MakeIndexer(ScopeGlobal, "System"), MakeLiteral("Configuration")));
 	m_Imports.push_back(MakeIndexer(ScopeGlobal, "Types").release());
 	m_Imports.push_back(MakeIndexer(ScopeGlobal, "Icinga").release());
+
+	m_Bindable = std::all_of(m_Imports.begin(), m_Imports.end(), [](const Expression::Ptr& import) {
+		return IsGlobalPath(import.get());
+	});
+}
+
+/**
+ * Returns whether the expression is a chain of literal indexers on the global
+ * scope, e.g. the default imports, i.e. its value only depends on namespaces.
+ */
+bool VariableExpression::IsGlobalPath(const Expression *expr)
+{
+	auto *iexpr = dynamic_cast<const IndexerExpression *>(expr);
+
+	if (!iexpr || !dynamic_cast<const LiteralExpression *>(iexpr->m_Operand2.get()))
+		return false;
+
+	auto *scope = dynamic_cast<const GetScopeExpression *>(iexpr->m_Operand1.get());
+
+	if (scope)
+		return scope->m_ScopeSpec == ScopeGlobal;
+
+	return IsGlobalPath(iexpr->m_Operand1.get());
+}
+
+/**
+ * Looks the variable up among the imports and the globals like
+ * VMOps::FindVarImport() and ScriptGlobal::Get() would, but remembers the
+ * namespace entry until any namespace changes. Constants are remembered
+ * by value.
+ *
+ * @returns Whether the variable has been found
+ */
+bool VariableExpression::GetBoundValue(ScriptFrame& frame, Value *result) const
+{
+	if (!m_Bindable)
+		return false;
+
+	auto binding (std::atomic_load(&m_Binding));
+	uint64_t version = Namespace::GetVersion();
+
+	if (!binding || binding->Version != version) {
+		binding = Bind(frame, version);
+
+		if (!binding)
+			return false;
+
+		std::atomic_store(&m_Binding, binding);
+	}
+
+	if (binding->Const) {
+		*result = binding->ConstValue;
+	} else {
+		ObjectLock olock(binding->Owner);
+		*result = binding->Slot->Get(m_DebugInfo);
+	}
+
+	return true;
+}
+
+std::shared_ptr<const VariableExpression::GlobalBinding> VariableExpression::Bind(ScriptFrame& frame, uint64_t version) const
+{
+	Namespace::Ptr owner;
+
+	for (const auto& import : m_Imports) {
+		ExpressionResult res = import->Evaluate(frame);
+		Object::Ptr obj = res.GetValue();
+		Namespace::Ptr ns = dynamic_pointer_cast<Namespace>(obj);
+
+		/* Other objects may have arbitrary fields. */
+		if (!ns)
+			return nullptr;
+
+		if (ns->HasOwnField(m_Variable)) {
+			owner = ns;
+			break;
+		}
+	}
+
+	if (!owner)
+		owner = ScriptGlobal::GetGlobals();
+
+	NamespaceValue::Ptr slot = owner->GetAttribute(m_Variable);
+
+	if (!slot)
+		return nullptr;
+
+	auto binding (std::make_shared<GlobalBinding>());
+	binding->Version = version;
+	binding->Owner = owner;
+	binding->Slot = slot;
+	binding->Const = dynamic_cast<ConstEmbeddedNamespaceValue *>(slot.get());
+
+	if (binding->Const)
+		binding->ConstValue = slot->Get(m_DebugInfo);
+
+	return binding;
 }
 
 ExpressionResult VariableExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const
@@ -117,6 +215,8 @@ ExpressionResult VariableExpression::DoEvaluate(ScriptFrame& frame, DebugHint *d
 		return value;
 	else if (frame.Self.IsObject() && frame.Locals != frame.Self.Get<Object::Ptr>() && frame.Self.Get<Object::Ptr>()->GetOwnField(m_Variable, &value))
 		return value;
+	else if (GetBoundValue(frame, &value))
+		return value;
 	else if (VMOps::FindVarImport(frame, m_Imports, m_Variable, &value, m_DebugInfo))
 		return value;
 	else
@@ -885,7 +985,8 @@ ExpressionResult ImportExpression::DoEvaluate(ScriptFrame& frame, DebugHint *dhi
 	if (scope)
 		scope->CopyTo(frame.Locals);
 
-	ExpressionResult result = item->GetExpression()->Evaluate(frame, dhint);
+	TemplateProgram::Ptr program = item->GetTemplateProgram();
+	ExpressionResult result = program ? program->Run(frame, dhint) : item->GetExpression()->Evaluate(frame, dhint);
 	CHECK_RESULT(result);
 
 	return Empty;
@@ -905,7 +1006,8 @@ ExpressionResult ImportDefaultTemplatesExpression::DoEvaluate(ScriptFrame& frame
 		if (scope)
 			scope->CopyTo(frame.Locals);
 
-		ExpressionResult result = item->GetExpression()->Evaluate(frame, dhint);
+		TemplateProgram::Ptr program = item->GetTemplateProgram();
+		ExpressionResult result = program ? program->Run(frame, dhint) : item->GetExpression()->Evaluate(frame, dhint);
 		CHECK_RESULT(result);
 	}
 
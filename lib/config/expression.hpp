@@ -8,11 +8,14 @@
 #include "base/array.hpp"
 #include "base/dictionary.hpp"
 #include "base/function.hpp"
+#include "base/namespace.hpp"
 #include "base/exception.hpp"
 #include "base/scriptframe.hpp"
 #include "base/shared-object.hpp"
 #include "base/convert.hpp"
+#include <cstdint>
 #include <map>
+#include <memory>
 
 namespace icinga
 {
@@ -223,6 +226,8 @@ protected:
 
 private:
 	Expression::Ptr m_Expression;
+
+	friend class TemplateProgram;
 };
 
 class LiteralExpression final : public Expression
@@ -274,6 +279,11 @@ public:
 
 protected:
 	std::unique_ptr<Expression> m_Operand;
+
+	friend class ApplyRuleIndex;
+	friend class BytecodeProgram;
+	friend class ExpressionOptimizer;
+	friend class FilterUtility;
 };
 
 class BinaryExpression : public DebuggableExpression
@@ -286,6 +296,13 @@ public:
 protected:
 	std::unique_ptr<Expression> m_Operand1;
 	std::unique_ptr<Expression> m_Operand2;
+
+	friend class ApplyRuleIndex;
+	friend class BytecodeProgram;
+	friend class ExpressionOptimizer;
+	friend class FilterUtility;
+	friend class TemplateProgram;
+	friend class VariableExpression;
 };
 
 class VariableExpression final : public DebuggableExpression
@@ -303,9 +320,30 @@ protected:
 	bool GetReference(ScriptFrame& frame, bool init_dict, Value *parent, String *index, DebugHint **dhint) const override;
 
 private:
+	/**
+	 * Where the variable has been found among the imports or the globals,
+	 * valid as long as Namespace::GetVersion() doesn't change.
+	 */
+	struct GlobalBinding
+	{
+		uint64_t Version;
+		Namespace::Ptr Owner;
+		NamespaceValue::Ptr Slot;
+		bool Const;
+		Value ConstValue;
+	};
+
 	String m_Variable;
 	std::vector<Expression::Ptr> m_Imports;
+	bool m_Bindable;
+	mutable std::shared_ptr<const GlobalBinding> m_Binding;
 
+	bool GetBoundValue(ScriptFrame& frame, Value *result) const;
+	std::shared_ptr<const GlobalBinding> Bind(ScriptFrame& frame, uint64_t version) const;
+
+	static bool IsGlobalPath(const Expression *expr);
+
+	friend class BytecodeProgram;
 	friend void BindToScope(std::unique_ptr<Expression>& expr, ScopeSpecifier scopeSpec);
 };
 
@@ -601,6 +639,8 @@ protected:
 
 private:
 	std::vector<std::unique_ptr<Expression> > m_Expressions;
+
+	friend class ExpressionOptimizer;
 };
 
 class DictExpression final : public DebuggableExpression
@@ -619,6 +659,10 @@ private:
 	std::vector<std::unique_ptr<Expression> > m_Expressions;
 	bool m_Inline{false};
 
+	friend class BytecodeProgram;
+	friend class ExpressionOptimizer;
+	friend class FilterUtility;
+	friend class TemplateProgram;
 	friend void BindToScope(std::unique_ptr<Expression>& expr, ScopeSpecifier scopeSpec);
 };
 
@@ -651,6 +695,7 @@ private:
 	CombinedSetOp m_Op;
 	bool m_OverrideFrozen{false};
 
+	friend class TemplateProgram;
 	friend void BindToScope(std::unique_ptr<Expression>& expr, ScopeSpecifier scopeSpec);
 };
 
@@ -668,6 +713,9 @@ private:
 	std::unique_ptr<Expression> m_Condition;
 	std::unique_ptr<Expression> m_TrueBranch;
 	std::unique_ptr<Expression> m_FalseBranch;
+
+	friend class BytecodeProgram;
+	friend class ExpressionOptimizer;
 };
 
 class WhileExpression final : public DebuggableExpression
@@ -683,6 +731,8 @@ protected:
 private:
 	std::unique_ptr<Expression> m_Condition;
 	std::unique_ptr<Expression> m_LoopBody;
+
+	friend class ExpressionOptimizer;
 };
 
 
@@ -731,6 +781,10 @@ protected:
 
 private:
 	ScopeSpecifier m_ScopeSpec;
+
+	friend class BytecodeProgram;
+	friend class TemplateProgram;
+	friend class VariableExpression;
 };
 
 class IndexerExpression final : public BinaryExpression
@@ -748,6 +802,7 @@ protected:
 	ExpressionResult DoEvaluate(ScriptFrame& frame, DebugHint *dhint) const override;
 	bool GetReference(ScriptFrame& frame, bool init_dict, Value *parent, String *index, DebugHint **dhint) const override;
 
+	friend class TemplateProgram;
 	friend void BindToScope(std::unique_ptr<Expression>& expr, ScopeSpecifier scopeSpec);
 };
 
@@ -766,6 +821,8 @@ protected:
 private:
 	std::unique_ptr<Expression> m_Message;
 	bool m_IncompleteExpr;
+
+	friend class ExpressionOptimizer;
 };
 
 class ImportExpression final : public DebuggableExpression
@@ -780,6 +837,8 @@ protected:
 
 private:
 	std::unique_ptr<Expression> m_Name;
+
+	friend class ExpressionOptimizer;
 };
 
 class ImportDefaultTemplatesExpression final : public DebuggableExpression
@@ -809,6 +868,8 @@ private:
 	std::vector<String> m_Args;
 	std::map<String, std::unique_ptr<Expression> > m_ClosedVars;
 	Expression::Ptr m_Expression;
+
+	friend class ExpressionOptimizer;
 };
 
 class ApplyExpression final : public DebuggableExpression
@@ -839,6 +900,8 @@ private:
 	bool m_IgnoreOnError;
 	std::map<String, std::unique_ptr<Expression> > m_ClosedVars;
 	Expression::Ptr m_Expression;
+
+	friend class ExpressionOptimizer;
 };
 
 class NamespaceExpression final : public DebuggableExpression
@@ -853,6 +916,8 @@ protected:
 
 private:
 	Expression::Ptr m_Expression;
+
+	friend class ExpressionOptimizer;
 };
 
 class ObjectExpression final : public DebuggableExpression
@@ -880,6 +945,8 @@ private:
 	bool m_IgnoreOnError;
 	std::map<String, std::unique_ptr<Expression> > m_ClosedVars;
 	Expression::Ptr m_Expression;
+
+	friend class ExpressionOptimizer;
 };
 
 class ForExpression final : public DebuggableExpression
@@ -897,6 +964,8 @@ private:
 	String m_FVVar;
 	std::unique_ptr<Expression> m_Value;
 	std::unique_ptr<Expression> m_Expression;
+
+	friend class ExpressionOptimizer;
 };
 
 class LibraryExpression final : public UnaryExpression
@@ -938,6 +1007,8 @@ private:
 	bool m_SearchIncludes;
 	String m_Zone;
 	String m_Package;
+
+	friend class ExpressionOptimizer;
 };
 
 class BreakpointExpression final : public DebuggableExpression
@@ -964,6 +1035,8 @@ protected:
 private:
 	std::unique_ptr<Expression> m_TryBody;
 	std::unique_ptr<Expression> m_ExceptBody;
+
+	friend class ExpressionOptimizer;
 };
 
 }
@@ -0,0 +1,236 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "config/expressionoptimizer.hpp"
+#include "base/json.hpp"
+#include "base/logger.hpp"
+
+using namespace icinga;
+
+/**
+ * Optimizes an expression tree in place.
+ *
+ * @param expr The expression, possibly replaced by a simpler one
+ * @param path The file it has been compiled from, for logging
+ */
+void ExpressionOptimizer::Optimize(std::unique_ptr<Expression>& expr, const String& path)
+{
+	if (!expr)
+		return;
+
+	ExpressionOptimizer optimizer;
+	optimizer.Visit(expr);
+
+	if (optimizer.m_Folded || optimizer.m_Branches) {
+		Log(LogDebug, "ConfigCompiler")
+			<< "Folded " << optimizer.m_Folded << " constant expressions and "
+			<< optimizer.m_Branches << " conditions in '" << path << "'.";
+	}
+}
+
+void ExpressionOptimizer::Visit(std::unique_ptr<Expression>& expr)
+{
+	if (!expr)
+		return;
+
+	VisitChildren(expr.get());
+
+	std::unique_ptr<Expression> simplified = Simplify(expr.get());
+
+	if (simplified)
+		expr = std::move(simplified);
+}
+
+void ExpressionOptimizer::Visit(Expression::Ptr& expr)
+{
+	if (!expr)
+		return;
+
+	VisitChildren(expr.get());
+
+	std::unique_ptr<Expression> simplified = Simplify(expr.get());
+
+	if (simplified)
+		expr = simplified.release();
+}
+
+void ExpressionOptimizer::VisitChildren(Expression *expr)
+{
+	if (auto *uexpr = dynamic_cast<UnaryExpression *>(expr)) {
+		Visit(uexpr->m_Operand);
+	} else if (auto *bexpr = dynamic_cast<BinaryExpression *>(expr)) {
+		Visit(bexpr->m_Operand1);
+		Visit(bexpr->m_Operand2);
+	} else if (auto *fexpr = dynamic_cast<FunctionCallExpression *>(expr)) {
+		Visit(fexpr->m_FName);
+
+		for (auto& arg : fexpr->m_Args)
+			Visit(arg);
+	} else if (auto *aexpr = dynamic_cast<ArrayExpression *>(expr)) {
+		for (auto& element : aexpr->m_Expressions)
+			Visit(element);
+	} else if (auto *dexpr = dynamic_cast<DictExpression *>(expr)) {
+		for (auto& element : dexpr->m_Expressions)
+			Visit(element);
+	} else if (auto *cexpr = dynamic_cast<ConditionalExpression *>(expr)) {
+		Visit(cexpr->m_Condition);
+		Visit(cexpr->m_TrueBranch);
+		Visit(cexpr->m_FalseBranch);
+	} else if (auto *wexpr = dynamic_cast<WhileExpression *>(expr)) {
+		Visit(wexpr->m_Condition);
+		Visit(wexpr->m_LoopBody);
+	} else if (auto *texpr = dynamic_cast<ThrowExpression *>(expr)) {
+		Visit(texpr->m_Message);
+	} else if (auto *iexpr = dynamic_cast<ImportExpression *>(expr)) {
+		Visit(iexpr->m_Name);
+	} else if (auto *fnexpr = dynamic_cast<FunctionExpression *>(expr)) {
+		for (auto& var : fnexpr->m_ClosedVars)
+			Visit(var.second);
+
+		Visit(fnexpr->m_Expression);
+	} else if (auto *apexpr = dynamic_cast<ApplyExpression *>(expr)) {
+		Visit(apexpr->m_Name);
+		Visit(apexpr->m_Filter);
+		Visit(apexpr->m_FTerm);
+
+		for (auto& var : apexpr->m_ClosedVars)
+			Visit(var.second);
+
+		Visit(apexpr->m_Expression);
+	} else if (auto *nexpr = dynamic_cast<NamespaceExpression *>(expr)) {
+		Visit(nexpr->m_Expression);
+	} else if (auto *oexpr = dynamic_cast<ObjectExpression *>(expr)) {
+		Visit(oexpr->m_Type);
+		Visit(oexpr->m_Name);
+		Visit(oexpr->m_Filter);
+
+		for (auto& var : oexpr->m_ClosedVars)
+			Visit(var.second);
+
+		Visit(oexpr->m_Expression);
+	} else if (auto *forexpr = dynamic_cast<ForExpression *>(expr)) {
+		Visit(forexpr->m_Value);
+		Visit(forexpr->m_Expression);
+	} else if (auto *inexpr = dynamic_cast<IncludeExpression *>(expr)) {
+		Visit(inexpr->m_Path);
+		Visit(inexpr->m_Pattern);
+		Visit(inexpr->m_Name);
+	} else if (auto *trexpr = dynamic_cast<TryExceptExpression *>(expr)) {
+		Visit(trexpr->m_TryBody);
+		Visit(trexpr->m_ExceptBody);
+	}
+}
+
+/**
+ * Returns a simpler expression which evaluates to the same, if any.
+ * Its children have been simplified already.
+ */
+std::unique_ptr<Expression> ExpressionOptimizer::Simplify(Expression *expr)
+{
+	if (IsFoldable(expr))
+		return Fold(expr);
+
+	Value condition;
+
+	/* Only the first operand decides, the second one would get no debug hints. */
+	auto *aexpr = dynamic_cast<LogicalAndExpression *>(expr);
+	auto *oexpr = dynamic_cast<LogicalOrExpression *>(expr);
+
+	if ((aexpr || oexpr) && GetScalar(static_cast<BinaryExpression *>(expr)->m_Operand1.get(), &condition)
+		&& condition.ToBool() == static_cast<bool>(oexpr)) {
+		m_Folded++;
+		return std::unique_ptr<Expression>(new LiteralExpression(condition));
+	}
+
+	auto *cexpr = dynamic_cast<ConditionalExpression *>(expr);
+
+	if (cexpr && GetScalar(cexpr->m_Condition.get(), &condition)) {
+		m_Branches++;
+
+		Log(LogDebug, "ConfigCompiler")
+			<< "Condition in " << cexpr->GetDebugInfo() << " is always " << (condition.ToBool() ? "true" : "false") << ".";
+
+		if (condition.ToBool())
+			return std::move(cexpr->m_TrueBranch);
+		else if (cexpr->m_FalseBranch)
+			return std::move(cexpr->m_FalseBranch);
+		else
+			return std::unique_ptr<Expression>(new LiteralExpression());
+	}
+
+	return nullptr;
+}
+
+/**
+ * Evaluates an operator whose operands are scalar literals.
+ *
+ * @returns nullptr if it fails, so it fails when it's evaluated
+ */
+std::unique_ptr<Expression> ExpressionOptimizer::Fold(Expression *expr)
+{
+	Value result;
+
+	try {
+		ScriptFrame frame(false);
+		frame.Sandboxed = true;
+
+		result = expr->DoEvaluate(frame, nullptr).GetValue();
+	} catch (const std::exception&) {
+		return nullptr;
+	}
+
+	if (result.IsObject())
+		return nullptr;
+
+	m_Folded++;
+
+	Log(LogDebug, "ConfigCompiler")
+		<< "Folded expression in " << expr->GetDebugInfo() << " into " << JsonEncode(result) << ".";
+
+	return std::unique_ptr<Expression>(new LiteralExpression(std::move(result)));
+}
+
+bool ExpressionOptimizer::GetScalar(const Expression *expr, Value *value)
+{
+	auto *lexpr = dynamic_cast<const LiteralExpression *>(expr);
+
+	if (!lexpr || lexpr->GetValue().IsObject())
+		return false;
+
+	*value = lexpr->GetValue();
+	return true;
+}
+
+/**
+ * Whether an expression is an operator whose operands are scalar literals.
+ */
+bool ExpressionOptimizer::IsFoldable(const Expression *expr)
+{
+	Value value;
+
+	if (dynamic_cast<const NegateExpression *>(expr) || dynamic_cast<const LogicalNegateExpression *>(expr))
+		return GetScalar(static_cast<const UnaryExpression *>(expr)->m_Operand.get(), &value);
+
+	if (!dynamic_cast<const AddExpression *>(expr)
+		&& !dynamic_cast<const SubtractExpression *>(expr)
+		&& !dynamic_cast<const MultiplyExpression *>(expr)
+		&& !dynamic_cast<const DivideExpression *>(expr)
+		&& !dynamic_cast<const ModuloExpression *>(expr)
+		&& !dynamic_cast<const XorExpression *>(expr)
+		&& !dynamic_cast<const BinaryAndExpression *>(expr)
+		&& !dynamic_cast<const BinaryOrExpression *>(expr)
+		&& !dynamic_cast<const ShiftLeftExpression *>(expr)
+		&& !dynamic_cast<const ShiftRightExpression *>(expr)
+		&& !dynamic_cast<const EqualExpression *>(expr)
+		&& !dynamic_cast<const NotEqualExpression *>(expr)
+		&& !dynamic_cast<const LessThanExpression *>(expr)
+		&& !dynamic_cast<const GreaterThanExpression *>(expr)
+		&& !dynamic_cast<const LessThanOrEqualExpression *>(expr)
+		&& !dynamic_cast<const GreaterThanOrEqualExpression *>(expr)
+		&& !dynamic_cast<const LogicalAndExpression *>(expr)
+		&& !dynamic_cast<const LogicalOrExpression *>(expr))
+		return false;
+
+	auto *bexpr = static_cast<const BinaryExpression *>(expr);
+
+	return GetScalar(bexpr->m_Operand1.get(), &value) && GetScalar(bexpr->m_Operand2.get(), &value);
+}
@@ -0,0 +1,47 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef EXPRESSIONOPTIMIZER_H
+#define EXPRESSIONOPTIMIZER_H
+
+#include "config/i2-config.hpp"
+#include "config/expression.hpp"
+#include <memory>
+
+namespace icinga
+{
+
+/**
+ * Simplifies expression trees once they have been parsed.
+ *
+ * Operators whose operands are scalar literals are folded into a literal,
+ * e.g. "check_" + "load" or 5 * 60, and if/else statements with such a
+ * condition are replaced by the branch which would be taken. Arrays and
+ * dictionaries are left alone, their values are mutable and mustn't be
+ * shared by all objects which evaluate them.
+ *
+ * @ingroup config
+ */
+class ExpressionOptimizer
+{
+public:
+	static void Optimize(std::unique_ptr<Expression>& expr, const String& path = String());
+
+private:
+	size_t m_Folded{0};
+	size_t m_Branches{0};
+
+	ExpressionOptimizer() = default;
+
+	void Visit(std::unique_ptr<Expression>& expr);
+	void Visit(Expression::Ptr& expr);
+	void VisitChildren(Expression *expr);
+	std::unique_ptr<Expression> Simplify(Expression *expr);
+	std::unique_ptr<Expression> Fold(Expression *expr);
+
+	static bool GetScalar(const Expression *expr, Value *value);
+	static bool IsFoldable(const Expression *expr);
+};
+
+}
+
+#endif /* EXPRESSIONOPTIMIZER_H */
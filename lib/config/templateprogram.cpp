@@ -0,0 +1,201 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "config/templateprogram.hpp"
+#include "config/vmops.hpp"
+#include <boost/exception_ptr.hpp>
+#include <boost/exception/errinfo_nested_exception.hpp>
+
+using namespace icinga;
+
+/**
+ * Splits the body of a template into its statements.
+ *
+ * @param expr The body, kept alive by the program
+ */
+TemplateProgram::Ptr TemplateProgram::Compile(Expression::Ptr expr)
+{
+	TemplateProgram::Ptr program (new TemplateProgram());
+
+	program->m_Expression = std::move(expr);
+	program->CompileStatement(program->m_Expression.get());
+
+	return program;
+}
+
+void TemplateProgram::CompileStatement(const Expression *expr)
+{
+	auto *oexpr = dynamic_cast<const OwnedExpression *>(expr);
+
+	if (oexpr) {
+		CompileStatement(oexpr->m_Expression.get());
+		return;
+	}
+
+	/* Inline dictionaries evaluate their statements in the frame of the object. */
+	auto *dexpr = dynamic_cast<const DictExpression *>(expr);
+
+	if (dexpr && dexpr->m_Inline) {
+		for (auto& aexpr : dexpr->m_Expressions)
+			CompileStatement(aexpr.get());
+
+		return;
+	}
+
+	Statement statement { expr, false, false, {}, Empty, false };
+	auto *sexpr = dynamic_cast<const SetExpression *>(expr);
+
+	if (sexpr && sexpr->m_Op == OpSetLiteral) {
+		auto *lexpr = dynamic_cast<const LiteralExpression *>(sexpr->m_Operand2.get());
+
+		if (lexpr && CompilePath(sexpr->m_Operand1.get(), statement)) {
+			statement.Constant = true;
+			statement.Literal = lexpr->GetValue();
+			statement.OverrideFrozen = sexpr->m_OverrideFrozen;
+			m_AssignmentCount++;
+		} else
+			statement.Path.clear();
+	}
+
+	m_Statements.emplace_back(std::move(statement));
+}
+
+/**
+ * Resolves the left side of an assignment into the names of the attribute
+ * and the dictionary keys it consists of, if they are constant.
+ */
+bool TemplateProgram::CompilePath(const Expression *expr, Statement& statement)
+{
+	auto *vexpr = dynamic_cast<const VariableExpression *>(expr);
+
+	if (vexpr) {
+		statement.Variable = true;
+		statement.Path.push_back({ vexpr->GetVariable(), false, nullptr, nullptr });
+		return true;
+	}
+
+	auto *iexpr = dynamic_cast<const IndexerExpression *>(expr);
+
+	if (!iexpr)
+		return false;
+
+	auto *lexpr = dynamic_cast<const LiteralExpression *>(iexpr->m_Operand2.get());
+
+	if (!lexpr || !lexpr->GetValue().IsString())
+		return false;
+
+	auto *scope = dynamic_cast<const GetScopeExpression *>(iexpr->m_Operand1.get());
+
+	if (scope) {
+		if (scope->m_ScopeSpec != ScopeThis)
+			return false;
+	} else {
+		if (!CompilePath(iexpr->m_Operand1.get(), statement))
+			return false;
+
+		/* See IndexerExpression::GetReference(), missing dictionaries are created. */
+		PathElement& parent = statement.Path.back();
+		parent.OverrideFrozen = iexpr->m_OverrideFrozen;
+		parent.InitInfo = &iexpr->m_Operand1->GetDebugInfo();
+		parent.GetInfo = &iexpr->GetDebugInfo();
+	}
+
+	statement.Path.push_back({ lexpr->GetValue(), false, nullptr, nullptr });
+	return true;
+}
+
+/**
+ * Evaluates the template for the object in frame.Self, just like its body.
+ */
+ExpressionResult TemplateProgram::Run(ScriptFrame& frame, DebugHint *dhint) const
+{
+	/* Let a debugger see each expression. */
+	if (!Expression::OnBreakpoint.empty())
+		return m_Expression->Evaluate(frame, dhint);
+
+	Value result;
+
+	for (auto& statement : m_Statements) {
+		if (statement.Constant && RunAssignment(frame, dhint, statement)) {
+			result = Empty;
+			continue;
+		}
+
+		ExpressionResult element = statement.Source->Evaluate(frame, dhint);
+		CHECK_RESULT(element);
+		result = element.GetValue();
+	}
+
+	return result;
+}
+
+/**
+ * Performs an assignment like SetExpression::DoEvaluate() would.
+ *
+ * @returns false if it has to be evaluated by the tree walker
+ */
+bool TemplateProgram::RunAssignment(ScriptFrame& frame, DebugHint *dhint, const Statement& statement) const
+{
+	if (!frame.Self.IsObject())
+		return false;
+
+	Object::Ptr self = frame.Self;
+
+	/* See VariableExpression::GetReference(). */
+	if (statement.Variable && ((frame.Locals && frame.Locals->Contains(statement.Path[0].Key))
+		|| frame.Locals == self || !self->HasOwnField(statement.Path[0].Key)))
+		return false;
+
+	const DebugInfo& debugInfo = statement.Source->GetDebugInfo();
+
+	try {
+		Value parent = self;
+
+		for (size_t i = 0; i < statement.Path.size() - 1; i++) {
+			const PathElement& element = statement.Path[i];
+
+			Value old_value;
+			bool has_field = true;
+
+			if (parent.IsObject()) {
+				Object::Ptr oparent = parent;
+				has_field = oparent->HasOwnField(element.Key);
+			}
+
+			if (has_field)
+				old_value = VMOps::GetField(parent, element.Key, false, *element.InitInfo);
+
+			if (old_value.IsEmpty() && !old_value.IsString())
+				VMOps::SetField(parent, element.Key, new Dictionary(), element.OverrideFrozen, *element.InitInfo);
+
+			parent = VMOps::GetField(parent, element.Key, false, *element.GetInfo);
+		}
+
+		VMOps::SetField(parent, statement.Path.back().Key, statement.Literal, statement.OverrideFrozen, debugInfo);
+	} catch (const ScriptError&) {
+		throw;
+	} catch (const std::exception& ex) {
+		BOOST_THROW_EXCEPTION(ScriptError("Error while evaluating expression: " + String(ex.what()), debugInfo)
+			<< boost::errinfo_nested_exception(boost::current_exception()));
+	}
+
+	if (dhint) {
+		DebugHint hint = dhint->GetChild(statement.Path[0].Key);
+
+		for (size_t i = 1; i < statement.Path.size(); i++)
+			hint = hint.GetChild(statement.Path[i].Key);
+
+		hint.AddMessage("=", debugInfo);
+	}
+
+	return true;
+}
+
+size_t TemplateProgram::GetStatementCount() const
+{
+	return m_Statements.size();
+}
+
+size_t TemplateProgram::GetAssignmentCount() const
+{
+	return m_AssignmentCount;
+}
@@ -0,0 +1,72 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef TEMPLATEPROGRAM_H
+#define TEMPLATEPROGRAM_H
+
+#include "config/i2-config.hpp"
+#include "config/expression.hpp"
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * The body of a template, prepared once for all objects which import it.
+ *
+ * Assignments of constants to attributes of the importing object, e.g.
+ * `check_command = "hostalive"` or `vars.os = "Linux"`, are applied directly
+ * rather than by walking their expression trees. Everything else, e.g. nested
+ * imports or computed values, is evaluated as usual. So are such assignments
+ * if their variable turns out to be a local one while importing.
+ *
+ * Programs are immutable and may be run by multiple threads at once.
+ *
+ * @ingroup config
+ */
+class TemplateProgram final : public SharedObject
+{
+public:
+	DECLARE_PTR_TYPEDEFS(TemplateProgram);
+
+	static TemplateProgram::Ptr Compile(Expression::Ptr expr);
+
+	ExpressionResult Run(ScriptFrame& frame, DebugHint *dhint) const;
+
+	size_t GetStatementCount() const;
+	size_t GetAssignmentCount() const;
+
+private:
+	/* An attribute or dictionary key on the way to the assigned one. */
+	struct PathElement
+	{
+		String Key;
+		bool OverrideFrozen;
+		const DebugInfo *InitInfo;
+		const DebugInfo *GetInfo;
+	};
+
+	struct Statement
+	{
+		const Expression *Source;
+		bool Constant;
+		bool Variable;
+		std::vector<PathElement> Path;
+		Value Literal;
+		bool OverrideFrozen;
+	};
+
+	Expression::Ptr m_Expression;
+	std::vector<Statement> m_Statements;
+	size_t m_AssignmentCount{0};
+
+	TemplateProgram() = default;
+
+	void CompileStatement(const Expression *expr);
+	static bool CompilePath(const Expression *expr, Statement& statement);
+
+	bool RunAssignment(ScriptFrame& frame, DebugHint *dhint, const Statement& statement) const;
+};
+
+}
+
+#endif /* TEMPLATEPROGRAM_H */
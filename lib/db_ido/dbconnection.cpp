@@ -7,11 +7,14 @@
 #include "icinga/host.hpp"
 #include "icinga/service.hpp"
 #include "base/configtype.hpp"
+#include "base/configuration.hpp"
 #include "base/convert.hpp"
 #include "base/objectlock.hpp"
+#include "base/perfdatavalue.hpp"
 #include "base/utility.hpp"
 #include "base/logger.hpp"
 #include "base/exception.hpp"
+#include <algorithm>
 
 using namespace icinga;
 
@@ -75,6 +78,7 @@ void DbConnection::Resume()
 	m_CleanUpTimer = new Timer();
 	m_CleanUpTimer->SetInterval(60);
 	m_CleanUpTimer->OnTimerExpired.connect([this](const Timer * const&) { CleanUpHandler(); });
+	m_CleanUpTimer->SetSchedulerPolicy(BackgroundScheduler);
 	m_CleanUpTimer->Start();
 
 	m_LogStatsTimeout = 0;
@@ -234,6 +238,13 @@ void DbConnection::CleanUpHandler()
 		if (max_age == 0)
 			continue;
 
+		/* A cleanup in chunks may take longer than the interval. */
+		if (!StartCleanUp(table.name)) {
+			Log(LogNotice, "DbConnection")
+				<< "Cleanup (" << table.name << ") is still running, skipping it.";
+			continue;
+		}
+
 		CleanUpExecuteQuery(table.name, table.time_column, now - max_age);
 		Log(LogNotice, "DbConnection")
 			<< "Cleanup (" << table.name << "): " << max_age
@@ -275,9 +286,96 @@ void DbConnection::LogStatsHandler()
 	}
 }
 
-void DbConnection::CleanUpExecuteQuery(const String&, const String&, double)
+void DbConnection::CleanUpExecuteQuery(const String& table, const String&, double)
 {
 	/* Default handler does nothing. */
+	FinishCleanUp(table, 0, true);
+}
+
+bool DbConnection::StartCleanUp(const String& table)
+{
+	std::unique_lock<std::mutex> lock (m_CleanUpMutex);
+	CleanUpStats& stats = m_CleanUpStats[table];
+
+	if (stats.Running)
+		return false;
+
+	stats.Running = true;
+	stats.StartTime = Utility::GetTime();
+	stats.RunRows = 0;
+
+	return true;
+}
+
+/**
+ * Accounts for a chunk of a table's cleanup.
+ *
+ * @param table The table
+ * @param rows The number of rows which have been removed
+ * @param done Whether there are no old rows left
+ */
+void DbConnection::FinishCleanUp(const String& table, uint_fast64_t rows, bool done)
+{
+	std::unique_lock<std::mutex> lock (m_CleanUpMutex);
+	CleanUpStats& stats = m_CleanUpStats[table];
+
+	if (!stats.Running)
+		return;
+
+	stats.Rows += rows;
+	stats.RunRows += rows;
+
+	if (!done)
+		return;
+
+	double duration = Utility::GetTime() - stats.StartTime;
+
+	stats.Duration += duration;
+	stats.Running = false;
+
+	if (stats.RunRows > 0) {
+		Log(LogNotice, "DbConnection")
+			<< "Cleanup (" << table << ") removed " << stats.RunRows << " rows in "
+			<< duration << " seconds.";
+	}
+}
+
+/**
+ * Forgets about running cleanups, e.g. because their chunks have been dropped with the connection.
+ */
+void DbConnection::ResetCleanUps()
+{
+	std::unique_lock<std::mutex> lock (m_CleanUpMutex);
+
+	for (auto& kv : m_CleanUpStats)
+		kv.second.Running = false;
+}
+
+/**
+ * Adds the number of removed rows and the time spent per history table to a connection's stats.
+ *
+ * @param status The connection's stats
+ * @param prefix The connection's perfdata label prefix
+ * @param perfdata Array of PerfdataValue objects
+ */
+void DbConnection::AddCleanUpStats(const Dictionary::Ptr& status, const String& prefix, const Array::Ptr& perfdata)
+{
+	Dictionary::Ptr tables = new Dictionary();
+
+	std::unique_lock<std::mutex> lock (m_CleanUpMutex);
+
+	for (auto& kv : m_CleanUpStats) {
+		tables->Set(kv.first, new Dictionary({
+			{ "rows", kv.second.Rows },
+			{ "duration", kv.second.Duration },
+			{ "running", kv.second.Running }
+		}));
+
+		perfdata->Add(new PerfdataValue(prefix + "_cleanup_" + kv.first + "_rows", kv.second.Rows, true));
+		perfdata->Add(new PerfdataValue(prefix + "_cleanup_" + kv.first + "_duration", kv.second.Duration, true, "seconds"));
+	}
+
+	status->Set("cleanup", tables);
 }
 
 void DbConnection::SetConfigHash(const DbObject::Ptr& dbobj, const String& hash)
@@ -290,10 +388,22 @@ void DbConnection::SetConfigHash(const DbType::Ptr& type, const DbReference& obj
 	if (!objid.IsValid())
 		return;
 
-	if (!hash.IsEmpty())
-		m_ConfigHashes[std::make_pair(type, objid)] = hash;
-	else
-		m_ConfigHashes.erase(std::make_pair(type, objid));
+	std::unique_lock<std::mutex> lock (m_CacheMutex);
+
+	if (!hash.IsEmpty()) {
+		m_RowCache[std::make_pair(type.get(), static_cast<long>(objid))].ConfigHash = hash;
+		return;
+	}
+
+	auto it = m_RowCache.find(std::make_pair(type.get(), static_cast<long>(objid)));
+
+	if (it == m_RowCache.end())
+		return;
+
+	it->second.ConfigHash = String();
+
+	if (!it->second.InsertID.IsValid())
+		m_RowCache.erase(it);
 }
 
 String DbConnection::GetConfigHash(const DbObject::Ptr& dbobj) const
@@ -306,30 +416,46 @@ String DbConnection::GetConfigHash(const DbType::Ptr& type, const DbReference& o
 	if (!objid.IsValid())
 		return String();
 
-	auto it = m_ConfigHashes.find(std::make_pair(type, objid));
+	std::unique_lock<std::mutex> lock (m_CacheMutex);
 
-	if (it == m_ConfigHashes.end())
+	auto it = m_RowCache.find(std::make_pair(type.get(), static_cast<long>(objid)));
+
+	if (it == m_RowCache.end())
 		return String();
 
-	return it->second;
+	return it->second.ConfigHash;
 }
 
 void DbConnection::SetObjectID(const DbObject::Ptr& dbobj, const DbReference& dbref)
 {
-	if (dbref.IsValid())
-		m_ObjectIDs[dbobj] = dbref;
-	else
-		m_ObjectIDs.erase(dbobj);
+	std::unique_lock<std::mutex> lock (m_CacheMutex);
+
+	if (dbref.IsValid()) {
+		m_ObjectCache[dbobj].ObjectID = dbref;
+		return;
+	}
+
+	auto it = m_ObjectCache.find(dbobj);
+
+	if (it == m_ObjectCache.end())
+		return;
+
+	it->second.ObjectID = DbReference();
+
+	if (it->second.IsEmpty())
+		m_ObjectCache.erase(it);
 }
 
 DbReference DbConnection::GetObjectID(const DbObject::Ptr& dbobj) const
 {
-	auto it = m_ObjectIDs.find(dbobj);
+	std::unique_lock<std::mutex> lock (m_CacheMutex);
+
+	auto it = m_ObjectCache.find(dbobj);
 
-	if (it == m_ObjectIDs.end())
+	if (it == m_ObjectCache.end())
 		return {};
 
-	return it->second;
+	return it->second.ObjectID;
 }
 
 void DbConnection::SetInsertID(const DbObject::Ptr& dbobj, const DbReference& dbref)
@@ -342,10 +468,22 @@ void DbConnection::SetInsertID(const DbType::Ptr& type, const DbReference& objid
 	if (!objid.IsValid())
 		return;
 
-	if (dbref.IsValid())
-		m_InsertIDs[std::make_pair(type, objid)] = dbref;
-	else
-		m_InsertIDs.erase(std::make_pair(type, objid));
+	std::unique_lock<std::mutex> lock (m_CacheMutex);
+
+	if (dbref.IsValid()) {
+		m_RowCache[std::make_pair(type.get(), static_cast<long>(objid))].InsertID = dbref;
+		return;
+	}
+
+	auto it = m_RowCache.find(std::make_pair(type.get(), static_cast<long>(objid)));
+
+	if (it == m_RowCache.end())
+		return;
+
+	it->second.InsertID = DbReference();
+
+	if (it->second.ConfigHash.IsEmpty())
+		m_RowCache.erase(it);
 }
 
 DbReference DbConnection::GetInsertID(const DbObject::Ptr& dbobj) const
@@ -358,66 +496,216 @@ DbReference DbConnection::GetInsertID(const DbType::Ptr& type, const DbReference
 	if (!objid.IsValid())
 		return {};
 
-	auto it = m_InsertIDs.find(std::make_pair(type, objid));
+	std::unique_lock<std::mutex> lock (m_CacheMutex);
 
-	if (it == m_InsertIDs.end())
+	auto it = m_RowCache.find(std::make_pair(type.get(), static_cast<long>(objid)));
+
+	if (it == m_RowCache.end())
 		return DbReference();
 
-	return it->second;
+	return it->second.InsertID;
+}
+
+void DbConnection::SetObjectCacheFlag(const DbObject::Ptr& dbobj, bool ObjectCacheEntry::*flag, bool value)
+{
+	std::unique_lock<std::mutex> lock (m_CacheMutex);
+
+	if (value) {
+		m_ObjectCache[dbobj].*flag = true;
+		return;
+	}
+
+	auto it = m_ObjectCache.find(dbobj);
+
+	if (it == m_ObjectCache.end())
+		return;
+
+	it->second.*flag = false;
+
+	if (it->second.IsEmpty())
+		m_ObjectCache.erase(it);
+}
+
+bool DbConnection::GetObjectCacheFlag(const DbObject::Ptr& dbobj, bool ObjectCacheEntry::*flag) const
+{
+	std::unique_lock<std::mutex> lock (m_CacheMutex);
+
+	auto it = m_ObjectCache.find(dbobj);
+
+	return it != m_ObjectCache.end() && it->second.*flag;
 }
 
 void DbConnection::SetObjectActive(const DbObject::Ptr& dbobj, bool active)
 {
-	if (active)
-		m_ActiveObjects.insert(dbobj);
-	else
-		m_ActiveObjects.erase(dbobj);
+	SetObjectCacheFlag(dbobj, &ObjectCacheEntry::Active, active);
 }
 
 bool DbConnection::GetObjectActive(const DbObject::Ptr& dbobj) const
 {
-	return (m_ActiveObjects.find(dbobj) != m_ActiveObjects.end());
+	return GetObjectCacheFlag(dbobj, &ObjectCacheEntry::Active);
 }
 
 void DbConnection::ClearIDCache()
 {
 	SetIDCacheValid(false);
 
-	m_ObjectIDs.clear();
-	m_InsertIDs.clear();
-	m_ActiveObjects.clear();
-	m_ConfigUpdates.clear();
-	m_StatusUpdates.clear();
-	m_ConfigHashes.clear();
+	std::unique_lock<std::mutex> lock (m_CacheMutex);
+
+	m_ObjectCache.clear();
+	m_RowCache.clear();
 }
 
 void DbConnection::SetConfigUpdate(const DbObject::Ptr& dbobj, bool hasupdate)
 {
-	if (hasupdate)
-		m_ConfigUpdates.insert(dbobj);
-	else
-		m_ConfigUpdates.erase(dbobj);
+	SetObjectCacheFlag(dbobj, &ObjectCacheEntry::ConfigUpdate, hasupdate);
 }
 
 bool DbConnection::GetConfigUpdate(const DbObject::Ptr& dbobj) const
 {
-	return (m_ConfigUpdates.find(dbobj) != m_ConfigUpdates.end());
+	return GetObjectCacheFlag(dbobj, &ObjectCacheEntry::ConfigUpdate);
 }
 
 void DbConnection::SetStatusUpdate(const DbObject::Ptr& dbobj, bool hasupdate)
 {
-	if (hasupdate)
-		m_StatusUpdates.insert(dbobj);
-	else
-		m_StatusUpdates.erase(dbobj);
+	if (!hasupdate) {
+		std::unique_lock<std::mutex> lock (m_CacheMutex);
+
+		auto it = m_ObjectCache.find(dbobj);
+
+		/* Without a status row there's nothing to compare the columns with. */
+		if (it != m_ObjectCache.end())
+			it->second.StatusFields = nullptr;
+	}
+
+	SetObjectCacheFlag(dbobj, &ObjectCacheEntry::StatusUpdate, hasupdate);
 }
 
 bool DbConnection::GetStatusUpdate(const DbObject::Ptr& dbobj) const
 {
-	return (m_StatusUpdates.find(dbobj) != m_StatusUpdates.end());
+	return GetObjectCacheFlag(dbobj, &ObjectCacheEntry::StatusUpdate);
 }
 
-void DbConnection::UpdateObject(const ConfigObject::Ptr& object)
+/**
+ * Tells whether writing a status column again would leave it as it is.
+ */
+static bool IsSameStatusValue(const Value& oldValue, const Value& newValue)
+{
+	if (DbValue::IsTimestamp(oldValue) != DbValue::IsTimestamp(newValue) ||
+		DbValue::IsObjectInsertID(oldValue) != DbValue::IsObjectInsertID(newValue))
+		return false;
+
+	Value oldRaw = DbValue::ExtractValue(oldValue);
+	Value newRaw = DbValue::ExtractValue(newValue);
+
+	if (oldRaw.GetType() != newRaw.GetType())
+		return false;
+
+	/* Timestamps are written with a resolution of one second. */
+	if (DbValue::IsTimestamp(newValue))
+		return static_cast<long>(oldRaw) == static_cast<long>(newRaw);
+
+	return oldRaw == newRaw;
+}
+
+/**
+ * Reduces a status update to the columns which have changed since the
+ * previous one of its object, once the object's status row exists.
+ * Updates of single status columns are remembered for the comparison.
+ *
+ * Must be called by the worker which executes the object's queries,
+ * in the order the queries are executed.
+ *
+ * @param query The query
+ * @param changedQuery Receives the UPDATE for the changed columns, without fields if there are none
+ * @return Whether changedQuery has to be executed instead of the query
+ */
+bool DbConnection::FilterStatusUpdate(const DbQuery& query, DbQuery& changedQuery)
+{
+	if (!query.StatusUpdate || !query.Object || !query.Fields || !(query.Type & DbQueryUpdate))
+		return false;
+
+	DbType::Ptr type = query.Object->GetType();
+
+	if (query.Table != type->GetTable() + "status")
+		return false;
+
+	std::unique_lock<std::mutex> lock (m_CacheMutex);
+
+	auto it = m_ObjectCache.find(query.Object);
+
+	if (query.Type != (DbQueryInsert | DbQueryUpdate)) {
+		if (it != m_ObjectCache.end() && it->second.StatusFields)
+			query.Fields->CopyTo(it->second.StatusFields);
+
+		return false;
+	}
+
+	if (it == m_ObjectCache.end() || !it->second.StatusUpdate || !it->second.StatusFields) {
+		m_ObjectCache[query.Object].StatusFields = query.Fields->ShallowClone();
+		return false;
+	}
+
+	const Dictionary::Ptr& statusFields = it->second.StatusFields;
+	String keyColumn = type->GetIDColumn();
+	Dictionary::Ptr fields = new Dictionary();
+	uint_fast64_t suppressed = 0;
+
+	{
+		ObjectLock olock(query.Fields);
+
+		for (const Dictionary::Pair& kv : query.Fields) {
+			if (kv.first != keyColumn && IsSameStatusValue(statusFields->Get(kv.first), kv.second)) {
+				suppressed++;
+				continue;
+			}
+
+			fields->Set(kv.first, kv.second);
+			statusFields->Set(kv.first, kv.second);
+		}
+	}
+
+	m_SuppressedStatusColumns.fetch_add(suppressed);
+
+	changedQuery = query;
+	changedQuery.Type = DbQueryUpdate;
+
+	if (fields->GetLength() > (fields->Contains(keyColumn) ? 1u : 0u))
+		changedQuery.Fields = fields;
+	else
+		changedQuery.Fields = nullptr;
+
+	return true;
+}
+
+/**
+ * The number of status columns which haven't been written because they were unchanged.
+ */
+uint_fast64_t DbConnection::GetSuppressedStatusColumns() const
+{
+	return m_SuppressedStatusColumns.load();
+}
+
+/**
+ * The config fields of an object including their hash.
+ */
+static Dictionary::Ptr GetHashedConfigFields(const DbObject::Ptr& dbobj)
+{
+	Dictionary::Ptr configFields = dbobj->GetConfigFields();
+	String configHash = dbobj->CalculateConfigHash(configFields);
+	ASSERT(configHash.GetLength() <= 64);
+	configFields->Set("config_hash", configHash);
+
+	return configFields;
+}
+
+/**
+ * Writes an object's config if it differs from the database.
+ *
+ * @param object The object
+ * @param configHash The hash of the object's config if it has been calculated already
+ * @param configFields The hashed config fields, may be null if the hash matched the database's one
+ */
+void DbConnection::UpdateObject(const ConfigObject::Ptr& object, const String& configHash, Dictionary::Ptr configFields)
 {
 	bool isShuttingDown = Application::IsShuttingDown();
 	bool isRestarting = Application::IsRestarting();
@@ -451,14 +739,19 @@ void DbConnection::UpdateObject(const ConfigObject::Ptr& object)
 			if (!dbActive)
 				ActivateObject(dbobj);
 
-			Dictionary::Ptr configFields = dbobj->GetConfigFields();
-			String configHash = dbobj->CalculateConfigHash(configFields);
-			ASSERT(configHash.GetLength() <= 64);
-			configFields->Set("config_hash", configHash);
+			String newHash = configHash;
+
+			if (newHash.IsEmpty()) {
+				configFields = GetHashedConfigFields(dbobj);
+				newHash = configFields->Get("config_hash");
+			}
 
 			String cachedHash = GetConfigHash(dbobj);
 
-			if (cachedHash != configHash) {
+			if (cachedHash != newHash) {
+				if (!configFields)
+					configFields = GetHashedConfigFields(dbobj);
+
 				dbobj->SendConfigUpdateHeavy(configFields);
 				dbobj->SendStatusUpdate();
 			} else {
@@ -478,6 +771,21 @@ void DbConnection::UpdateObject(const ConfigObject::Ptr& object)
 
 void DbConnection::UpdateAllObjects()
 {
+	struct ObjectDump
+	{
+		ConfigObject::Ptr Object;
+		DbObject::Ptr DbObj;
+		String ConfigHash;
+		Dictionary::Ptr ConfigFields;
+	};
+
+	/* The tables may have been changed while we were disconnected, so the
+	 * vars and group memberships of each object are written in full again.
+	 */
+	DbWrittenRows::InvalidateAll();
+
+	std::vector<ObjectDump> dumps;
+
 	for (const Type::Ptr& type : Type::GetAllTypes()) {
 		auto *dtype = dynamic_cast<ConfigType *>(type.get());
 
@@ -485,9 +793,88 @@ void DbConnection::UpdateAllObjects()
 			continue;
 
 		for (const ConfigObject::Ptr& object : dtype->GetObjects()) {
-			m_QueryQueue.Enqueue([this, object](){ UpdateObject(object); }, PriorityHigh);
+			DbObject::Ptr dbobj = DbObject::GetOrCreateByObject(object);
+
+			if (!dbobj)
+				continue;
+
+			dumps.push_back({ object, std::move(dbobj), String(), nullptr });
 		}
 	}
+
+	/* Hashing the config is the expensive part for objects which haven't changed,
+	 * so that's done in parallel before the queries are sent by the workers.
+	 */
+	std::vector<std::pair<size_t, size_t> > ranges;
+	size_t chunkSize = 500;
+
+	for (size_t begin = 0; begin < dumps.size(); begin += chunkSize)
+		ranges.emplace_back(begin, std::min(begin + chunkSize, dumps.size()));
+
+	WorkQueue upq(25000, Configuration::Concurrency);
+	upq.SetName("DbConnection, " + GetName() + ", config hashes");
+
+	upq.ParallelFor(ranges, [this, &dumps](const std::pair<size_t, size_t>& range) {
+		for (size_t i = range.first; i < range.second; i++) {
+			ObjectDump& dump = dumps[i];
+
+			if (!dump.Object->IsActive())
+				continue;
+
+			Dictionary::Ptr configFields = GetHashedConfigFields(dump.DbObj);
+			String configHash = configFields->Get("config_hash");
+
+			/* Only keep the fields of the objects which have to be written. */
+			if (configHash != GetConfigHash(dump.DbObj))
+				dump.ConfigFields = std::move(configFields);
+
+			dump.ConfigHash = std::move(configHash);
+		}
+	});
+
+	upq.Join();
+
+	/* Objects whose hash couldn't be calculated are hashed again by UpdateObject(). */
+	if (upq.HasExceptions())
+		upq.ReportExceptions("DbConnection");
+
+	for (ObjectDump& dump : dumps) {
+		ConfigObject::Ptr object = std::move(dump.Object);
+		String configHash = std::move(dump.ConfigHash);
+		Dictionary::Ptr configFields = std::move(dump.ConfigFields);
+
+		GetObjectQueue(dump.DbObj).Enqueue([this, object, configHash, configFields]() {
+			UpdateObject(object, configHash, configFields);
+		}, PriorityHigh);
+	}
+}
+
+/**
+ * The work queue which executes the queries of an object. Connections
+ * with several workers spread the objects across them.
+ *
+ * @param dbobj The object
+ * @return The work queue
+ */
+WorkQueue& DbConnection::GetObjectQueue(const DbObject::Ptr&)
+{
+	return m_QueryQueue;
+}
+
+/**
+ * Maps an object to one of a number of partitions, the same one each time.
+ *
+ * @param dbobj The object, may be null
+ * @param partitions The number of partitions
+ * @return The partition
+ */
+size_t DbConnection::GetObjectPartition(const DbObject::Ptr& dbobj, size_t partitions)
+{
+	if (!dbobj || partitions < 2u)
+		return 0;
+
+	/* The lower bits of the address are the same for all objects due to their alignment. */
+	return (reinterpret_cast<uintptr_t>(dbobj.get()) >> 4u) % partitions;
 }
 
 void DbConnection::PrepareDatabase()
@@ -518,6 +905,30 @@ void DbConnection::ValidateCategories(const Lazy<Array::Ptr>& lvalue, const Vali
 		BOOST_THROW_EXCEPTION(ValidationError(this, { "categories" }, "categories filter is invalid."));
 }
 
+void DbConnection::ValidateBatchSize(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<DbConnection>::ValidateBatchSize(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "batch_size" }, "Value must not be negative."));
+}
+
+void DbConnection::ValidateWorkers(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<DbConnection>::ValidateWorkers(lvalue, utils);
+
+	if (lvalue() < 1)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "workers" }, "Value must be greater than 0."));
+}
+
+void DbConnection::ValidateCleanupBatchSize(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<DbConnection>::ValidateCleanupBatchSize(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "cleanup_batch_size" }, "Value must not be negative."));
+}
+
 void DbConnection::IncreaseQueryCount()
 {
 	double now = Utility::GetTime();
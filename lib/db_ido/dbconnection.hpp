@@ -10,7 +10,12 @@
 #include "base/timer.hpp"
 #include "base/ringbuffer.hpp"
 #include <boost/thread/once.hpp>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
 #include <mutex>
+#include <unordered_map>
 
 #define IDO_CURRENT_SCHEMA_VERSION "1.14.3"
 #define IDO_COMPAT_SCHEMA_VERSION "1.14.3"
@@ -54,11 +59,17 @@ public:
 	void SetStatusUpdate(const DbObject::Ptr& dbobj, bool hasupdate);
 	bool GetStatusUpdate(const DbObject::Ptr& dbobj) const;
 
+	uint_fast64_t GetSuppressedStatusColumns() const;
+	void AddCleanUpStats(const Dictionary::Ptr& status, const String& prefix, const Array::Ptr& perfdata);
+
 	int GetQueryCount(RingBuffer::SizeType span);
 	virtual int GetPendingQueryCount() const = 0;
 
 	void ValidateFailoverTimeout(const Lazy<double>& lvalue, const ValidationUtils& utils) final;
 	void ValidateCategories(const Lazy<Array::Ptr>& lvalue, const ValidationUtils& utils) final;
+	void ValidateBatchSize(const Lazy<int>& lvalue, const ValidationUtils& utils) final;
+	void ValidateWorkers(const Lazy<int>& lvalue, const ValidationUtils& utils) final;
+	void ValidateCleanupBatchSize(const Lazy<int>& lvalue, const ValidationUtils& utils) final;
 
 protected:
 	void OnConfigLoaded() override;
@@ -76,7 +87,9 @@ protected:
 	virtual void FillIDCache(const DbType::Ptr& type) = 0;
 	virtual void NewTransaction() = 0;
 
-	void UpdateObject(const ConfigObject::Ptr& object);
+	virtual WorkQueue& GetObjectQueue(const DbObject::Ptr& dbobj);
+
+	void UpdateObject(const ConfigObject::Ptr& object, const String& configHash = String(), Dictionary::Ptr configFields = nullptr);
 	void UpdateAllObjects();
 
 	void PrepareDatabase();
@@ -92,24 +105,89 @@ protected:
 
 	static int GetSessionToken();
 
+	static size_t GetObjectPartition(const DbObject::Ptr& dbobj, size_t partitions);
+
 	void IncreasePendingQueries(int count);
 	void DecreasePendingQueries(int count);
 
+	bool FilterStatusUpdate(const DbQuery& query, DbQuery& changedQuery);
+
+	void FinishCleanUp(const String& table, uint_fast64_t rows, bool done);
+	void ResetCleanUps();
+
 	WorkQueue m_QueryQueue{10000000, 1, LogNotice};
 
 private:
-	bool m_IDCacheValid{false};
-	std::map<std::pair<DbType::Ptr, DbReference>, String> m_ConfigHashes;
-	std::map<DbObject::Ptr, DbReference> m_ObjectIDs;
-	std::map<std::pair<DbType::Ptr, DbReference>, DbReference> m_InsertIDs;
-	std::set<DbObject::Ptr> m_ActiveObjects;
-	std::set<DbObject::Ptr> m_ConfigUpdates;
-	std::set<DbObject::Ptr> m_StatusUpdates;
+	/* What the database knows about an object, so that a query needs a single lookup. */
+	struct ObjectCacheEntry
+	{
+		DbReference ObjectID;
+		bool Active{false};
+		bool ConfigUpdate{false};
+		bool StatusUpdate{false};
+
+		/* The status columns as they have been written last. */
+		Dictionary::Ptr StatusFields;
+
+		bool IsEmpty() const
+		{
+			return !ObjectID.IsValid() && !Active && !ConfigUpdate && !StatusUpdate && !StatusFields;
+		}
+	};
+
+	/* The rows of an object in its type's table, by object ID. Types are never freed. */
+	struct RowCacheEntry
+	{
+		DbReference InsertID;
+		String ConfigHash;
+	};
+
+	struct ObjectHash
+	{
+		size_t operator()(const DbObject::Ptr& dbobj) const
+		{
+			return std::hash<DbObject *>()(dbobj.get());
+		}
+	};
+
+	/* The rows which have been removed from a history table and how long that took. */
+	struct CleanUpStats
+	{
+		uint_fast64_t Rows{0};
+		double Duration{0};
+
+		/* The current cleanup, which may take several chunks. */
+		bool Running{false};
+		double StartTime{0};
+		uint_fast64_t RunRows{0};
+	};
+
+	struct RowHash
+	{
+		size_t operator()(const std::pair<DbType *, long>& key) const
+		{
+			return std::hash<DbType *>()(key.first) ^ (std::hash<long>()(key.second) * 31u);
+		}
+	};
+
+	/* Protects the ID cache. Several worker threads may use it. */
+	mutable std::mutex m_CacheMutex;
+	std::atomic<bool> m_IDCacheValid{false};
+	std::unordered_map<DbObject::Ptr, ObjectCacheEntry, ObjectHash> m_ObjectCache;
+	std::unordered_map<std::pair<DbType *, long>, RowCacheEntry, RowHash> m_RowCache;
+	std::atomic<uint_fast64_t> m_SuppressedStatusColumns{0};
 	Timer::Ptr m_CleanUpTimer;
 	Timer::Ptr m_LogStatsTimer;
 
 	double m_LogStatsTimeout;
 
+	void SetObjectCacheFlag(const DbObject::Ptr& dbobj, bool ObjectCacheEntry::*flag, bool value);
+	bool GetObjectCacheFlag(const DbObject::Ptr& dbobj, bool ObjectCacheEntry::*flag) const;
+
+	std::mutex m_CleanUpMutex;
+	std::map<String, CleanUpStats> m_CleanUpStats;
+
+	bool StartCleanUp(const String& table);
 	void CleanUpHandler();
 	void LogStatsHandler();
 
@@ -26,6 +26,8 @@ using namespace icinga;
 boost::signals2::signal<void (const DbQuery&)> DbObject::OnQuery;
 boost::signals2::signal<void (const std::vector<DbQuery>&)> DbObject::OnMultipleQueries;
 
+std::atomic<uint_fast64_t> DbWrittenRows::m_CurrentGeneration (1);
+
 INITIALIZE_ONCE(&DbObject::StaticInitialize);
 
 DbObject::DbObject(intrusive_ptr<DbType> type, String name1, String name2)
@@ -193,26 +195,8 @@ void DbObject::SendVarsConfigUpdateHeavy()
 	if (!custom_var_object)
 		return;
 
-	std::vector<DbQuery> queries;
-
-	DbQuery query1;
-	query1.Table = "customvariables";
-	query1.Type = DbQueryDelete;
-	query1.Category = DbCatConfig;
-	query1.WhereCriteria = new Dictionary({
-		{ "object_id", obj }
-	});
-	queries.emplace_back(std::move(query1));
-
-	DbQuery query2;
-	query2.Table = "customvariablestatus";
-	query2.Type = DbQueryDelete;
-	query2.Category = DbCatConfig;
-	query2.WhereCriteria = new Dictionary({
-		{ "object_id", obj }
-	});
-	queries.emplace_back(std::move(query2));
-
+	std::map<String, std::pair<String, int> > values;
+	DbWrittenRows::RowMap rows;
 	Dictionary::Ptr vars = custom_var_object->GetVars();
 
 	if (vars) {
@@ -231,39 +215,195 @@ void DbObject::SendVarsConfigUpdateHeavy()
 			} else
 				value = kv.second;
 
+			rows[kv.first] = std::hash<String>()(value) * 2u + is_json;
+			values[kv.first] = std::make_pair(std::move(value), is_json);
+		}
+	}
+
+	std::vector<DbQuery> queries;
+	std::vector<String> added, changed, removed;
+
+	std::unique_lock<std::mutex> lock (m_WrittenRowsMutex);
+
+	if (!m_WrittenVars.Update(std::move(rows), added, changed, removed)) {
+		DbQuery query1;
+		query1.Table = "customvariables";
+		query1.Type = DbQueryDelete;
+		query1.Category = DbCatConfig;
+		query1.WhereCriteria = new Dictionary({
+			{ "object_id", obj }
+		});
+		queries.emplace_back(std::move(query1));
+
+		DbQuery query2;
+		query2.Table = "customvariablestatus";
+		query2.Type = DbQueryDelete;
+		query2.Category = DbCatConfig;
+		query2.WhereCriteria = new Dictionary({
+			{ "object_id", obj }
+		});
+		queries.emplace_back(std::move(query2));
+	}
+
+	for (const String& name : removed) {
+		for (const char *table : { "customvariables", "customvariablestatus" }) {
+			DbQuery query;
+			query.Table = table;
+			query.Type = DbQueryDelete;
+			query.Category = DbCatConfig;
+			query.WhereCriteria = new Dictionary({
+				{ "object_id", obj },
+				{ "varname", name }
+			});
+			queries.emplace_back(std::move(query));
+		}
+	}
+
+	/* Changed vars are updated in place, new ones are inserted. */
+	for (auto *names : { &changed, &added }) {
+		int type = names == &changed ? DbQueryInsert | DbQueryUpdate : DbQueryInsert;
+
+		for (const String& name : *names) {
+			const auto& value (values[name]);
+
 			DbQuery query3;
 			query3.Table = "customvariables";
-			query3.Type = DbQueryInsert;
+			query3.Type = type;
 			query3.Category = DbCatConfig;
 			query3.Fields = new Dictionary({
-				{ "varname", kv.first },
-				{ "varvalue", value },
-				{ "is_json", is_json },
+				{ "varname", name },
+				{ "varvalue", value.first },
+				{ "is_json", value.second },
 				{ "config_type", 1 },
 				{ "object_id", obj },
 				{ "instance_id", 0 } /* DbConnection class fills in real ID */
 			});
+
+			if (names == &changed) {
+				query3.WhereCriteria = new Dictionary({
+					{ "object_id", obj },
+					{ "varname", name }
+				});
+			}
+
 			queries.emplace_back(std::move(query3));
 
 			DbQuery query4;
 			query4.Table = "customvariablestatus";
-			query4.Type = DbQueryInsert;
+			query4.Type = type;
 			query4.Category = DbCatState;
 
 			query4.Fields = new Dictionary({
-				{ "varname", kv.first },
-				{ "varvalue", value },
-				{ "is_json", is_json },
+				{ "varname", name },
+				{ "varvalue", value.first },
+				{ "is_json", value.second },
 				{ "status_update_time", DbValue::FromTimestamp(Utility::GetTime()) },
 				{ "object_id", obj },
 				{ "instance_id", 0 } /* DbConnection class fills in real ID */
 			});
 
+			if (names == &changed) {
+				query4.WhereCriteria = new Dictionary({
+					{ "object_id", obj },
+					{ "varname", name }
+				});
+			}
+
 			queries.emplace_back(std::move(query4));
 		}
 	}
 
-	OnMultipleQueries(queries);
+	if (!queries.empty())
+		OnMultipleQueries(queries);
+}
+
+/**
+ * Writes the groups an object is a member of, i.e. the rows of a
+ * *group_members table which refer to it.
+ *
+ * @param groupType The group's type, e.g. "HostGroup"
+ * @param groupColumn The column which refers to the group
+ * @param objectColumn The column which refers to the object
+ * @param groups The names of the groups
+ * @param insertType The type of the queries which add a membership
+ */
+void DbObject::SendGroupMembersUpdate(const String& groupType, const String& groupColumn, const String& objectColumn,
+	const Array::Ptr& groups, int insertType)
+{
+	ConfigObject::Ptr object = GetObject();
+	String table = DbType::GetByName(groupType)->GetTable() + "_members";
+	DbWrittenRows::RowMap rows;
+	std::vector<String> groupNames;
+
+	if (groups) {
+		ObjectLock olock(groups);
+
+		for (const String& groupName : groups) {
+			if (rows.emplace(groupName, 0).second)
+				groupNames.push_back(groupName);
+		}
+	}
+
+	std::vector<DbQuery> queries;
+	std::vector<String> added, changed, removed;
+
+	std::unique_lock<std::mutex> lock (m_WrittenRowsMutex);
+	bool full = !m_WrittenGroups.Update(std::move(rows), added, changed, removed);
+
+	for (const String& groupName : removed) {
+		/* The group's ID can only be determined as long as it exists. */
+		if (!ConfigObject::GetObject(groupType, groupName)) {
+			full = true;
+			added = std::move(groupNames);
+			break;
+		}
+	}
+
+	if (full) {
+		DbQuery query1;
+		query1.Table = table;
+		query1.Type = DbQueryDelete;
+		query1.Category = DbCatConfig;
+		query1.WhereCriteria = new Dictionary({
+			{ objectColumn, object }
+		});
+		queries.emplace_back(std::move(query1));
+	} else {
+		for (const String& groupName : removed) {
+			DbQuery query1;
+			query1.Table = table;
+			query1.Type = DbQueryDelete;
+			query1.Category = DbCatConfig;
+			query1.WhereCriteria = new Dictionary({
+				{ groupColumn, DbValue::FromObjectInsertID(ConfigObject::GetObject(groupType, groupName)) },
+				{ objectColumn, object }
+			});
+			queries.emplace_back(std::move(query1));
+		}
+	}
+
+	for (const String& groupName : added) {
+		ConfigObject::Ptr group = ConfigObject::GetObject(groupType, groupName);
+
+		DbQuery query2;
+		query2.Table = table;
+		query2.Type = insertType;
+		query2.Category = DbCatConfig;
+		query2.Fields = new Dictionary({
+			{ "instance_id", 0 }, /* DbConnection class fills in real ID */
+			{ groupColumn, DbValue::FromObjectInsertID(group) },
+			{ objectColumn, object }
+		});
+		query2.WhereCriteria = new Dictionary({
+			{ "instance_id", 0 }, /* DbConnection class fills in real ID */
+			{ groupColumn, DbValue::FromObjectInsertID(group) },
+			{ objectColumn, object }
+		});
+		queries.emplace_back(std::move(query2));
+	}
+
+	if (!queries.empty())
+		OnMultipleQueries(queries);
 }
 
 void DbObject::SendVarsStatusUpdate()
@@ -300,7 +440,7 @@ void DbObject::SendVarsStatusUpdate()
 			query.Category = DbCatState;
 
 			query.Fields = new Dictionary({
-				{ "varname", kv.first },
+				{ "varname", kv.first.GetString() },
 				{ "varvalue", value },
 				{ "is_json", is_json },
 				{ "status_update_time", DbValue::FromTimestamp(Utility::GetTime()) },
@@ -310,7 +450,7 @@ void DbObject::SendVarsStatusUpdate()
 
 			query.WhereCriteria = new Dictionary({
 				{ "object_id", obj },
-				{ "varname", kv.first }
+				{ "varname", kv.first.GetString() }
 			});
 
 			queries.emplace_back(std::move(query));
@@ -427,3 +567,52 @@ std::mutex& DbObject::GetStaticMutex()
 	static std::mutex mutex;
 	return mutex;
 }
+
+/**
+ * Replaces the rows which have been written last.
+ *
+ * @param rows The rows which have to be in the table now
+ * @param added Set to the keys of the rows which have to be inserted
+ * @param changed Set to the keys of the rows which have to be updated
+ * @param removed Set to the keys of the rows which have to be deleted
+ * @return false if it isn't known what's in the table, i.e. all rows of
+ *         the object have to be deleted and all in added inserted
+ */
+bool DbWrittenRows::Update(RowMap rows, std::vector<String>& added, std::vector<String>& changed, std::vector<String>& removed)
+{
+	uint_fast64_t generation = m_CurrentGeneration.load();
+	bool known = m_Generation == generation;
+
+	if (known) {
+		for (const auto& kv : m_Rows) {
+			auto it (rows.find(kv.first));
+
+			if (it == rows.end())
+				removed.push_back(kv.first);
+			else if (it->second != kv.second)
+				changed.push_back(kv.first);
+		}
+
+		for (const auto& kv : rows) {
+			if (m_Rows.find(kv.first) == m_Rows.end())
+				added.push_back(kv.first);
+		}
+	} else {
+		for (const auto& kv : rows)
+			added.push_back(kv.first);
+	}
+
+	m_Rows = std::move(rows);
+	m_Generation = generation;
+
+	return known;
+}
+
+/**
+ * Forgets what has been written for all objects, e.g. because a connection
+ * which may have missed some queries has been established again.
+ */
+void DbWrittenRows::InvalidateAll()
+{
+	m_CurrentGeneration.fetch_add(1);
+}
@@ -9,6 +9,11 @@
 #include "db_ido/dbtype.hpp"
 #include "icinga/customvarobject.hpp"
 #include "base/configobject.hpp"
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
 
 namespace icinga
 {
@@ -37,6 +42,30 @@ enum DbObjectType
 	DbObjectTypeZone = 14,
 };
 
+/**
+ * The rows of a table which belong to one object, e.g. its custom variables,
+ * as they have been written last. Each row is represented by its key and a
+ * hash of its other columns, so only the rows which have changed have to be
+ * written again.
+ *
+ * @ingroup ido
+ */
+class DbWrittenRows
+{
+public:
+	typedef std::map<String, size_t> RowMap;
+
+	bool Update(RowMap rows, std::vector<String>& added, std::vector<String>& changed, std::vector<String>& removed);
+
+	static void InvalidateAll();
+
+private:
+	RowMap m_Rows;
+	uint_fast64_t m_Generation{0};
+
+	static std::atomic<uint_fast64_t> m_CurrentGeneration;
+};
+
 /**
  * A database object.
  *
@@ -84,6 +113,9 @@ protected:
 
 	static String HashValue(const Value& value);
 
+	void SendGroupMembersUpdate(const String& groupType, const String& groupColumn, const String& objectColumn,
+		const Array::Ptr& groups, int insertType);
+
 private:
 	String m_Name1;
 	String m_Name2;
@@ -92,6 +124,10 @@ private:
 	double m_LastConfigUpdate;
 	double m_LastStatusUpdate;
 
+	std::mutex m_WrittenRowsMutex;
+	DbWrittenRows m_WrittenVars;
+	DbWrittenRows m_WrittenGroups;
+
 	static void StateChangedHandler(const ConfigObject::Ptr& object);
 	static void VarsChangedHandler(const CustomVarObject::Ptr& object);
 	static void VersionChangedHandler(const ConfigObject::Ptr& object);
@@ -0,0 +1,247 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "db_ido/dbupsertbatch.hpp"
+#include "db_ido/dbtype.hpp"
+#include "base/defer.hpp"
+#include "base/perfdatavalue.hpp"
+#include <utility>
+
+using namespace icinga;
+
+/* Both schemas have a unique key on the object column of these tables. */
+static const char * const l_BatchTables[] = { "hoststatus", "servicestatus", "contactstatus" };
+
+/**
+ * Tells which column identifies the rows of a query which can be batched.
+ *
+ * @param query The query
+ * @return The key column or an empty string if the query can't be batched
+ */
+String DbUpsertBatcher::GetKeyColumn(const DbQuery& query)
+{
+	/* Updates of changed columns contain the key column too, see DbConnection::FilterStatusUpdate(). */
+	if (!query.StatusUpdate || !query.Object || !(query.Type & DbQueryUpdate) || (query.Type & DbQueryDelete) || !query.Fields)
+		return String();
+
+	for (auto table : l_BatchTables) {
+		if (query.Table == table) {
+			String keyColumn = query.Object->GetType()->GetIDColumn();
+
+			if (query.Fields->Contains(keyColumn))
+				return keyColumn;
+
+			break;
+		}
+	}
+
+	return String();
+}
+
+/**
+ * @param rows Maximum number of rows per statement
+ * @param bytes Maximum size of the values per statement
+ */
+void DbUpsertBatcher::SetLimits(size_t rows, size_t bytes)
+{
+	m_MaxRows = rows;
+	m_MaxBytes = bytes;
+}
+
+/**
+ * Adds a row. A pending row of the same object is replaced, as the same key
+ * must not appear twice in one statement.
+ *
+ * @param query The query
+ * @param columns The query's column names
+ * @param values The query's escaped values
+ * @param flush Executes a full batch
+ * @return The number of rows which have been replaced
+ */
+size_t DbUpsertBatcher::Add(const DbQuery& query, std::vector<String>&& columns, std::vector<String>&& values, const FlushCallback& flush)
+{
+	TableBatches& tbs = m_Batches[query.Table];
+
+	String row = "(";
+	bool first = true;
+
+	for (auto& value : values) {
+		if (!first)
+			row += ", ";
+
+		row += value;
+		first = false;
+	}
+
+	row += ")";
+
+	auto it = tbs.ObjectRows.find(query.Object.get());
+
+	if (it != tbs.ObjectRows.end()) {
+		DbUpsertBatch& pending = *it->second.first;
+
+		if (pending.Columns == columns) {
+			String& oldRow = pending.Rows[it->second.second];
+
+			pending.Size = pending.Size - oldRow.GetLength() + row.GetLength();
+			oldRow = std::move(row);
+
+			if (pending.Size >= m_MaxBytes)
+				Flush(tbs, pending, flush);
+
+			return 1;
+		}
+
+		/* The new row may not replace all columns of the pending one, so that one goes first. */
+		Flush(tbs, pending, flush);
+	}
+
+	DbUpsertBatch& batch = tbs.Batches[columns];
+
+	if (batch.Rows.empty()) {
+		batch.Table = query.Table;
+		batch.KeyColumn = GetKeyColumn(query);
+		batch.Columns = std::move(columns);
+	}
+
+	tbs.ObjectRows[query.Object.get()] = std::make_pair(&batch, batch.Rows.size());
+	batch.Size += row.GetLength();
+	batch.Rows.emplace_back(std::move(row));
+	batch.Objects.push_back(query.Object);
+	m_Length++;
+
+	if (batch.Rows.size() >= m_MaxRows || batch.Size >= m_MaxBytes)
+		Flush(tbs, batch, flush);
+
+	return 0;
+}
+
+void DbUpsertBatcher::Flush(TableBatches& tbs, DbUpsertBatch& batch, const FlushCallback& flush)
+{
+	if (batch.Rows.empty())
+		return;
+
+	size_t rows = batch.Rows.size();
+
+	Defer reset ([this, &tbs, &batch, rows]() {
+		for (auto& object : batch.Objects)
+			tbs.ObjectRows.erase(object.get());
+
+		m_Length -= rows;
+		batch.Rows.clear();
+		batch.Objects.clear();
+		batch.Size = 0;
+	});
+
+	{
+		std::unique_lock<std::mutex> lock (m_StatsMutex);
+		DbUpsertBatchStats& stats = m_Stats[batch.Table];
+		stats.Rows += rows;
+		stats.Statements++;
+	}
+
+	flush(batch);
+}
+
+void DbUpsertBatcher::Flush(TableBatches& tbs, const FlushCallback& flush)
+{
+	/* Drop the batches of column sets which may not come again. */
+	Defer cleanup ([&tbs]() {
+		for (auto it = tbs.Batches.begin(); it != tbs.Batches.end();) {
+			if (it->second.Rows.empty())
+				it = tbs.Batches.erase(it);
+			else
+				it++;
+		}
+	});
+
+	for (auto& kv : tbs.Batches)
+		Flush(tbs, kv.second, flush);
+}
+
+/**
+ * Executes all pending rows.
+ *
+ * @param flush Executes a batch
+ */
+void DbUpsertBatcher::Flush(const FlushCallback& flush)
+{
+	for (auto& kv : m_Batches)
+		Flush(kv.second, flush);
+}
+
+/**
+ * Executes the pending rows of a table, so that other queries for
+ * the table don't overtake them.
+ *
+ * @param table The table
+ * @param flush Executes a batch
+ */
+void DbUpsertBatcher::Flush(const String& table, const FlushCallback& flush)
+{
+	auto it = m_Batches.find(table);
+
+	if (it != m_Batches.end())
+		Flush(it->second, flush);
+}
+
+/**
+ * Drops all pending rows, e.g. because their object IDs are no longer valid.
+ *
+ * @return The number of rows which have been dropped
+ */
+size_t DbUpsertBatcher::Clear()
+{
+	size_t length = m_Length;
+
+	m_Batches.clear();
+	m_Length = 0;
+
+	return length;
+}
+
+size_t DbUpsertBatcher::GetLength() const
+{
+	return m_Length;
+}
+
+/**
+ * Adds the number of rows and statements per table to the given totals.
+ *
+ * @param stats The totals of a connection's workers
+ */
+void DbUpsertBatcher::CollectStats(std::map<String, DbUpsertBatchStats>& stats)
+{
+	std::unique_lock<std::mutex> lock (m_StatsMutex);
+
+	for (auto& kv : m_Stats) {
+		DbUpsertBatchStats& total = stats[kv.first];
+		total.Rows += kv.second.Rows;
+		total.Statements += kv.second.Statements;
+	}
+}
+
+/**
+ * Adds the number of batched rows and statements per table to a connection's stats.
+ *
+ * @param stats The totals from CollectStats()
+ * @param status The connection's stats
+ * @param prefix The connection's perfdata label prefix
+ * @param perfdata Array of PerfdataValue objects
+ */
+void DbUpsertBatcher::AddStats(const std::map<String, DbUpsertBatchStats>& stats, const Dictionary::Ptr& status,
+	const String& prefix, const Array::Ptr& perfdata)
+{
+	Dictionary::Ptr tables = new Dictionary();
+
+	for (auto& kv : stats) {
+		tables->Set(kv.first, new Dictionary({
+			{ "rows", kv.second.Rows },
+			{ "statements", kv.second.Statements }
+		}));
+
+		perfdata->Add(new PerfdataValue(prefix + "_batch_" + kv.first + "_rows", kv.second.Rows, true));
+		perfdata->Add(new PerfdataValue(prefix + "_batch_" + kv.first + "_statements", kv.second.Statements, true));
+	}
+
+	status->Set("batches", tables);
+}
@@ -0,0 +1,100 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef DBUPSERTBATCH_H
+#define DBUPSERTBATCH_H
+
+#include "db_ido/i2-db_ido.hpp"
+#include "db_ido/dbobject.hpp"
+#include "db_ido/dbquery.hpp"
+#include "base/array.hpp"
+#include "base/dictionary.hpp"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * Status rows of one table which share their columns and are written
+ * with a single multi-row statement.
+ *
+ * @ingroup db_ido
+ */
+struct DbUpsertBatch
+{
+	String Table;
+	String KeyColumn;
+	std::vector<String> Columns;
+	std::vector<String> Rows;
+	std::vector<DbObject::Ptr> Objects;
+	size_t Size{0};
+};
+
+/**
+ * The number of rows and statements which have been written for a table.
+ *
+ * @ingroup db_ido
+ */
+struct DbUpsertBatchStats
+{
+	uint_fast64_t Rows{0};
+	uint_fast64_t Statements{0};
+};
+
+/**
+ * Collects the status updates of tables with a unique key on their object
+ * column into multi-row upserts, one per table and set of columns. Only used
+ * from a connection's work queue, except for the statistics.
+ *
+ * @ingroup db_ido
+ */
+class DbUpsertBatcher final
+{
+public:
+	typedef std::function<void (const DbUpsertBatch&)> FlushCallback;
+
+	static String GetKeyColumn(const DbQuery& query);
+
+	void SetLimits(size_t rows, size_t bytes);
+
+	size_t Add(const DbQuery& query, std::vector<String>&& columns, std::vector<String>&& values, const FlushCallback& flush);
+	void Flush(const FlushCallback& flush);
+	void Flush(const String& table, const FlushCallback& flush);
+	size_t Clear();
+
+	size_t GetLength() const;
+
+	void CollectStats(std::map<String, DbUpsertBatchStats>& stats);
+
+	static void AddStats(const std::map<String, DbUpsertBatchStats>& stats, const Dictionary::Ptr& status,
+		const String& prefix, const Array::Ptr& perfdata);
+
+private:
+	struct TableBatches
+	{
+		/* Status updates may only contain the changed columns, so there's one batch per set of columns. */
+		std::map<std::vector<String>, DbUpsertBatch> Batches;
+
+		/* The batch and row of each object's pending row. */
+		std::unordered_map<DbObject *, std::pair<DbUpsertBatch *, size_t> > ObjectRows;
+	};
+
+	size_t m_MaxRows{0};
+	size_t m_MaxBytes{0};
+	size_t m_Length{0};
+	std::map<String, TableBatches> m_Batches;
+
+	std::mutex m_StatsMutex;
+	std::map<String, DbUpsertBatchStats> m_Stats;
+
+	void Flush(TableBatches& tbs, DbUpsertBatch& batch, const FlushCallback& flush);
+	void Flush(TableBatches& tbs, const FlushCallback& flush);
+};
+
+}
+
+#endif /* DBUPSERTBATCH_H */
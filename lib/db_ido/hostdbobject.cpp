@@ -147,45 +147,10 @@ void HostDbObject::OnConfigUpdateHeavy()
 	Host::Ptr host = static_pointer_cast<Host>(GetObject());
 
 	/* groups */
-	Array::Ptr groups = host->GetGroups();
+	SendGroupMembersUpdate("HostGroup", "hostgroup_id", "host_object_id", host->GetGroups(), DbQueryInsert);
 
 	std::vector<DbQuery> queries;
 
-	DbQuery query1;
-	query1.Table = DbType::GetByName("HostGroup")->GetTable() + "_members";
-	query1.Type = DbQueryDelete;
-	query1.Category = DbCatConfig;
-	query1.WhereCriteria = new Dictionary();
-	query1.WhereCriteria->Set("host_object_id", host);
-	queries.emplace_back(std::move(query1));
-
-	if (groups) {
-		ObjectLock olock(groups);
-		for (const String& groupName : groups) {
-			HostGroup::Ptr group = HostGroup::GetByName(groupName);
-
-			DbQuery query2;
-			query2.Table = DbType::GetByName("HostGroup")->GetTable() + "_members";
-			query2.Type = DbQueryInsert;
-			query2.Category = DbCatConfig;
-			query2.Fields = new Dictionary({
-				{ "instance_id", 0 }, /* DbConnection class fills in real ID */
-				{ "hostgroup_id", DbValue::FromObjectInsertID(group) },
-				{ "host_object_id", host }
-			});
-			query2.WhereCriteria = new Dictionary({
-				{ "instance_id", 0 }, /* DbConnection class fills in real ID */
-				{ "hostgroup_id", DbValue::FromObjectInsertID(group) },
-				{ "host_object_id", host }
-			});
-			queries.emplace_back(std::move(query2));
-		}
-	}
-
-	DbObject::OnMultipleQueries(queries);
-
-	queries.clear();
-
 	DbQuery query2;
 	query2.Table = GetType()->GetTable() + "_parenthosts";
 	query2.Type = DbQueryDelete;
@@ -144,47 +144,11 @@ void ServiceDbObject::OnConfigUpdateHeavy()
 	Service::Ptr service = static_pointer_cast<Service>(GetObject());
 
 	/* groups */
-	Array::Ptr groups = service->GetGroups();
+	SendGroupMembersUpdate("ServiceGroup", "servicegroup_id", "service_object_id", service->GetGroups(), DbQueryInsert);
 
 	std::vector<DbQuery> queries;
 
-	DbQuery query1;
-	query1.Table = DbType::GetByName("ServiceGroup")->GetTable() + "_members";
-	query1.Type = DbQueryDelete;
-	query1.Category = DbCatConfig;
-	query1.WhereCriteria = new Dictionary({
-		{ "service_object_id", service }
-	});
-	queries.emplace_back(std::move(query1));
-
-	if (groups) {
-		ObjectLock olock(groups);
-		for (const String& groupName : groups) {
-			ServiceGroup::Ptr group = ServiceGroup::GetByName(groupName);
-
-			DbQuery query2;
-			query2.Table = DbType::GetByName("ServiceGroup")->GetTable() + "_members";
-			query2.Type = DbQueryInsert;
-			query2.Category = DbCatConfig;
-			query2.Fields = new Dictionary({
-				{ "instance_id", 0 }, /* DbConnection class fills in real ID */
-				{ "servicegroup_id", DbValue::FromObjectInsertID(group) },
-				{ "service_object_id", service }
-			});
-			query2.WhereCriteria = new Dictionary({
-				{ "instance_id", 0 }, /* DbConnection class fills in real ID */
-				{ "servicegroup_id", DbValue::FromObjectInsertID(group) },
-				{ "service_object_id", service }
-			});
-			queries.emplace_back(std::move(query2));
-		}
-	}
-
-	DbObject::OnMultipleQueries(queries);
-
 	/* service dependencies */
-	queries.clear();
-
 	DbQuery query2;
 	query2.Table = GetType()->GetTable() + "dependencies";
 	query2.Type = DbQueryDelete;
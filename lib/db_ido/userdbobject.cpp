@@ -64,46 +64,10 @@ void UserDbObject::OnConfigUpdateHeavy()
 	User::Ptr user = static_pointer_cast<User>(GetObject());
 
 	/* groups */
-	Array::Ptr groups = user->GetGroups();
+	SendGroupMembersUpdate("UserGroup", "contactgroup_id", "contact_object_id", user->GetGroups(), DbQueryInsert | DbQueryUpdate);
 
 	std::vector<DbQuery> queries;
 
-	DbQuery query1;
-	query1.Table = DbType::GetByName("UserGroup")->GetTable() + "_members";
-	query1.Type = DbQueryDelete;
-	query1.Category = DbCatConfig;
-	query1.WhereCriteria = new Dictionary({
-		{ "contact_object_id", user }
-	});
-	queries.emplace_back(std::move(query1));
-
-	if (groups) {
-		ObjectLock olock(groups);
-		for (const String& groupName : groups) {
-			UserGroup::Ptr group = UserGroup::GetByName(groupName);
-
-			DbQuery query2;
-			query2.Table = DbType::GetByName("UserGroup")->GetTable() + "_members";
-			query2.Type = DbQueryInsert | DbQueryUpdate;
-			query2.Category = DbCatConfig;
-			query2.Fields = new Dictionary({
-				{ "instance_id", 0 }, /* DbConnection class fills in real ID */
-				{ "contactgroup_id", DbValue::FromObjectInsertID(group) },
-				{ "contact_object_id", user }
-			});
-			query2.WhereCriteria = new Dictionary({
-				{ "instance_id", 0 }, /* DbConnection class fills in real ID */
-				{ "contactgroup_id", DbValue::FromObjectInsertID(group) },
-				{ "contact_object_id", user }
-			});
-			queries.emplace_back(std::move(query2));
-		}
-	}
-
-	DbObject::OnMultipleQueries(queries);
-
-	queries.clear();
-
 	DbQuery query2;
 	query2.Table = "contact_addresses";
 	query2.Type = DbQueryDelete;
@@ -14,6 +14,8 @@
 #include "base/exception.hpp"
 #include "base/statsfunction.hpp"
 #include "base/defer.hpp"
+#include "base/metrics.hpp"
+#include <algorithm>
 #include <utility>
 
 using namespace icinga;
@@ -21,12 +23,30 @@ using namespace icinga;
 REGISTER_TYPE(IdoMysqlConnection);
 REGISTER_STATSFUNCTION(IdoMysqlConnection, &IdoMysqlConnection::StatsFunc);
 
+static Histogram l_QueryTime ("icinga_ido_mysql_query_seconds", "Execution time of IDO MySQL queries and query batches");
+
 void IdoMysqlConnection::OnConfigLoaded()
 {
 	ObjectImpl<IdoMysqlConnection>::OnConfigLoaded();
 
 	m_QueryQueue.SetName("IdoMysqlConnection, " + GetName());
 
+	m_Workers.clear();
+
+	for (int i = 0; i < GetWorkers(); i++) {
+		std::unique_ptr<IdoMysqlWorker> worker (new IdoMysqlWorker());
+
+		if (i == 0) {
+			worker->Queue = &m_QueryQueue;
+		} else {
+			worker->OwnQueue.reset(new WorkQueue(10000000, 1, LogNotice));
+			worker->OwnQueue->SetName("IdoMysqlConnection, " + GetName() + ", worker " + Convert::ToString(i));
+			worker->Queue = worker->OwnQueue.get();
+		}
+
+		m_Workers.emplace_back(std::move(worker));
+	}
+
 	Library shimLibrary{"mysql_shim"};
 
 	auto create_mysql_shim = shimLibrary.GetSymbolAddress<create_mysql_shim_ptr>("create_mysql_shim");
@@ -41,16 +61,25 @@ void IdoMysqlConnection::StatsFunc(const Dictionary::Ptr& status, const Array::P
 	DictionaryData nodes;
 
 	for (const IdoMysqlConnection::Ptr& idomysqlconnection : ConfigType::GetObjectsByType<IdoMysqlConnection>()) {
-		size_t queryQueueItems = idomysqlconnection->m_QueryQueue.GetLength();
-		double queryQueueItemRate = idomysqlconnection->m_QueryQueue.GetTaskCount(60) / 60.0;
+		size_t queryQueueItems = 0;
+		double queryQueueItemRate = 0;
+		std::map<String, DbUpsertBatchStats> batchStats;
+
+		for (auto& worker : idomysqlconnection->m_Workers) {
+			queryQueueItems += worker->Queue->GetLength();
+			queryQueueItemRate += worker->Queue->GetTaskCount(60) / 60.0;
+			worker->UpsertBatcher.CollectStats(batchStats);
+		}
 
-		nodes.emplace_back(idomysqlconnection->GetName(), new Dictionary({
+		Dictionary::Ptr node = new Dictionary({
 			{ "version", idomysqlconnection->GetSchemaVersion() },
 			{ "instance_name", idomysqlconnection->GetInstanceName() },
 			{ "connected", idomysqlconnection->GetConnected() },
+			{ "workers", idomysqlconnection->m_Workers.size() },
+			{ "status_columns_suppressed", idomysqlconnection->GetSuppressedStatusColumns() },
 			{ "query_queue_items", queryQueueItems },
 			{ "query_queue_item_rate", queryQueueItemRate }
-		}));
+		});
 
 		perfdata->Add(new PerfdataValue("idomysqlconnection_" + idomysqlconnection->GetName() + "_queries_rate", idomysqlconnection->GetQueryCount(60) / 60.0));
 		perfdata->Add(new PerfdataValue("idomysqlconnection_" + idomysqlconnection->GetName() + "_queries_1min", idomysqlconnection->GetQueryCount(60)));
@@ -58,6 +87,13 @@ void IdoMysqlConnection::StatsFunc(const Dictionary::Ptr& status, const Array::P
 		perfdata->Add(new PerfdataValue("idomysqlconnection_" + idomysqlconnection->GetName() + "_queries_15mins", idomysqlconnection->GetQueryCount(15 * 60)));
 		perfdata->Add(new PerfdataValue("idomysqlconnection_" + idomysqlconnection->GetName() + "_query_queue_items", queryQueueItems));
 		perfdata->Add(new PerfdataValue("idomysqlconnection_" + idomysqlconnection->GetName() + "_query_queue_item_rate", queryQueueItemRate));
+
+		perfdata->Add(new PerfdataValue("idomysqlconnection_" + idomysqlconnection->GetName() + "_status_columns_suppressed", idomysqlconnection->GetSuppressedStatusColumns(), true));
+
+		DbUpsertBatcher::AddStats(batchStats, node, "idomysqlconnection_" + idomysqlconnection->GetName(), perfdata);
+		idomysqlconnection->AddCleanUpStats(node, "idomysqlconnection_" + idomysqlconnection->GetName(), perfdata);
+
+		nodes.emplace_back(idomysqlconnection->GetName(), node);
 	}
 
 	status->Set("idomysqlconnection", new Dictionary(std::move(nodes)));
@@ -70,7 +106,10 @@ void IdoMysqlConnection::Resume()
 
 	SetConnected(false);
 
-	m_QueryQueue.SetExceptionCallback([this](boost::exception_ptr exp) { ExceptionHandler(std::move(exp)); });
+	for (auto& worker : m_Workers) {
+		IdoMysqlWorker *pworker = worker.get();
+		worker->Queue->SetExceptionCallback([this, pworker](boost::exception_ptr exp) { ExceptionHandler(*pworker, std::move(exp)); });
+	}
 
 	/* Immediately try to connect on Resume() without timer. */
 	m_QueryQueue.Enqueue([this]() { Reconnect(); }, PriorityImmediate);
@@ -105,44 +144,112 @@ void IdoMysqlConnection::Pause()
 		<< "Rescheduling disconnect task.";
 #endif /* I2_DEBUG */
 
-	m_QueryQueue.Enqueue([this]() { Disconnect(); }, PriorityLow);
+	/* The other workers stop executing queries once the first one has disconnected. */
+	for (auto it = m_Workers.rbegin(); it != m_Workers.rend(); it++) {
+		(*it)->Queue->Enqueue([this]() { Disconnect(); }, PriorityLow);
 
-	/* Work on remaining tasks but never delete the threads, for HA resuming later. */
-	m_QueryQueue.Join();
+		/* Work on remaining tasks but never delete the threads, for HA resuming later. */
+		(*it)->Queue->Join();
+	}
 
 	Log(LogInformation, "IdoMysqlConnection")
 		<< "'" << GetName() << "' paused.";
 
 }
 
-void IdoMysqlConnection::ExceptionHandler(boost::exception_ptr exp)
+void IdoMysqlConnection::ExceptionHandler(IdoMysqlWorker& worker, boost::exception_ptr exp)
 {
 	Log(LogCritical, "IdoMysqlConnection", "Exception during database operation: Verify that your database is operational!");
 
 	Log(LogDebug, "IdoMysqlConnection")
 		<< "Exception during database operation: " << DiagnosticInformation(std::move(exp));
 
-	if (GetConnected()) {
-		m_Mysql->close(&m_Connection);
+	if (&worker == m_Workers[0].get()) {
+		if (GetConnected()) {
+			m_Mysql->close(&worker.Connection);
 
-		SetConnected(false);
+			SetConnected(false);
+		}
+	} else {
+		if (worker.Connected) {
+			m_Mysql->close(&worker.Connection);
+
+			worker.Connected = false;
+		}
+
+		/* The worker's uncommitted queries are lost, so all objects have to be written again. */
+		m_QueryQueue.Enqueue([this]() {
+			if (GetConnected()) {
+				m_Mysql->close(&m_Workers[0]->Connection);
+
+				SetConnected(false);
+			}
+		}, PriorityImmediate);
 	}
 }
 
+/**
+ * The worker of the current work queue thread.
+ */
+IdoMysqlWorker& IdoMysqlConnection::GetWorker()
+{
+	for (auto& worker : m_Workers) {
+		if (worker->Queue->IsWorkerThread())
+			return *worker;
+	}
+
+	BOOST_THROW_EXCEPTION(std::runtime_error("Not running on a work queue thread of '" + GetName() + "'."));
+}
+
+/**
+ * The worker which executes the queries of an object, so that they're executed in order.
+ *
+ * @param dbobj The object, may be null
+ */
+IdoMysqlWorker& IdoMysqlConnection::GetObjectWorker(const DbObject::Ptr& dbobj)
+{
+	return *m_Workers[GetObjectPartition(dbobj, m_Workers.size())];
+}
+
+WorkQueue& IdoMysqlConnection::GetObjectQueue(const DbObject::Ptr& dbobj)
+{
+	return *GetObjectWorker(dbobj).Queue;
+}
+
+/**
+ * Tells whether a worker may execute queries. The other workers
+ * depend on the first one, which sets up the database.
+ */
+bool IdoMysqlConnection::IsWorkerConnected(const IdoMysqlWorker& worker) const
+{
+	return GetConnected() && (&worker == m_Workers[0].get() || worker.Connected);
+}
+
 void IdoMysqlConnection::AssertOnWorkQueue()
 {
-	ASSERT(m_QueryQueue.IsWorkerThread());
+	ASSERT(std::any_of(m_Workers.begin(), m_Workers.end(), [](const std::unique_ptr<IdoMysqlWorker>& worker) {
+		return worker->Queue->IsWorkerThread();
+	}));
 }
 
 void IdoMysqlConnection::Disconnect()
 {
-	AssertOnWorkQueue();
+	IdoMysqlWorker& worker = GetWorker();
+	bool primary = &worker == m_Workers[0].get();
 
-	if (!GetConnected())
+	if (primary ? !GetConnected() : !worker.Connected)
 		return;
 
+	FlushUpsertBatches();
+	FinishAsyncQueries();
+
 	Query("COMMIT");
-	m_Mysql->close(&m_Connection);
+	m_Mysql->close(&worker.Connection);
+
+	if (!primary) {
+		worker.Connected = false;
+		return;
+	}
 
 	SetConnected(false);
 
@@ -160,17 +267,21 @@ void IdoMysqlConnection::NewTransaction()
 		<< "Scheduling new transaction and finishing async queries.";
 #endif /* I2_DEBUG */
 
-	m_QueryQueue.Enqueue([this]() { InternalNewTransaction(); }, PriorityNormal);
-	m_QueryQueue.Enqueue([this]() { FinishAsyncQueries(); }, PriorityNormal);
+	for (auto& worker : m_Workers) {
+		worker->Queue->Enqueue([this]() { InternalNewTransaction(); }, PriorityNormal);
+		worker->Queue->Enqueue([this]() { FinishAsyncQueries(); }, PriorityNormal);
+	}
 }
 
 void IdoMysqlConnection::InternalNewTransaction()
 {
 	AssertOnWorkQueue();
 
-	if (!GetConnected())
+	if (!IsWorkerConnected(GetWorker()))
 		return;
 
+	FlushUpsertBatches();
+
 	IncreasePendingQueries(2);
 
 	AsyncQuery("COMMIT");
@@ -197,6 +308,8 @@ void IdoMysqlConnection::Reconnect()
 
 	CONTEXT("Reconnecting to MySQL IDO database '" + GetName() + "'");
 
+	IdoMysqlWorker& worker = *m_Workers[0];
+
 	double startTime = Utility::GetTime();
 
 	SetShouldConnect(true);
@@ -206,10 +319,10 @@ void IdoMysqlConnection::Reconnect()
 	/* Ensure to close old connections first. */
 	if (GetConnected()) {
 		/* Check if we're really still connected */
-		if (m_Mysql->ping(&m_Connection) == 0)
+		if (m_Mysql->ping(&worker.Connection) == 0)
 			return;
 
-		m_Mysql->close(&m_Connection);
+		m_Mysql->close(&worker.Connection);
 		SetConnected(false);
 		reconnect = true;
 	}
@@ -218,58 +331,12 @@ void IdoMysqlConnection::Reconnect()
 		<< "Reconnect: Clearing ID cache.";
 
 	ClearIDCache();
+	ResetCleanUps();
 
-	String ihost, isocket_path, iuser, ipasswd, idb;
-	String isslKey, isslCert, isslCa, isslCaPath, isslCipher;
-	const char *host, *socket_path, *user , *passwd, *db;
-	const char *sslKey, *sslCert, *sslCa, *sslCaPath, *sslCipher;
-	bool enableSsl;
-	long port;
+	/* The pending rows refer to the old object IDs. */
+	DecreasePendingQueries(worker.UpsertBatcher.Clear());
 
-	ihost = GetHost();
-	isocket_path = GetSocketPath();
-	iuser = GetUser();
-	ipasswd = GetPassword();
-	idb = GetDatabase();
-
-	enableSsl = GetEnableSsl();
-	isslKey = GetSslKey();
-	isslCert = GetSslCert();
-	isslCa = GetSslCa();
-	isslCaPath = GetSslCapath();
-	isslCipher = GetSslCipher();
-
-	host = (!ihost.IsEmpty()) ? ihost.CStr() : nullptr;
-	port = GetPort();
-	socket_path = (!isocket_path.IsEmpty()) ? isocket_path.CStr() : nullptr;
-	user = (!iuser.IsEmpty()) ? iuser.CStr() : nullptr;
-	passwd = (!ipasswd.IsEmpty()) ? ipasswd.CStr() : nullptr;
-	db = (!idb.IsEmpty()) ? idb.CStr() : nullptr;
-
-	sslKey = (!isslKey.IsEmpty()) ? isslKey.CStr() : nullptr;
-	sslCert = (!isslCert.IsEmpty()) ? isslCert.CStr() : nullptr;
-	sslCa = (!isslCa.IsEmpty()) ? isslCa.CStr() : nullptr;
-	sslCaPath = (!isslCaPath.IsEmpty()) ? isslCaPath.CStr() : nullptr;
-	sslCipher = (!isslCipher.IsEmpty()) ? isslCipher.CStr() : nullptr;
-
-	/* connection */
-	if (!m_Mysql->init(&m_Connection)) {
-		Log(LogCritical, "IdoMysqlConnection")
-			<< "mysql_init() failed: out of memory";
-
-		BOOST_THROW_EXCEPTION(std::bad_alloc());
-	}
-
-	if (enableSsl)
-		m_Mysql->ssl_set(&m_Connection, sslKey, sslCert, sslCa, sslCaPath, sslCipher);
-
-	if (!m_Mysql->real_connect(&m_Connection, host, user, passwd, db, port, socket_path, CLIENT_FOUND_ROWS | CLIENT_MULTI_STATEMENTS)) {
-		Log(LogCritical, "IdoMysqlConnection")
-			<< "Connection to database '" << db << "' with user '" << user << "' on '" << host << ":" << port
-			<< "' " << (enableSsl ? "(SSL enabled) " : "") << "failed: \"" << m_Mysql->error(&m_Connection) << "\"";
-
-		BOOST_THROW_EXCEPTION(std::runtime_error(m_Mysql->error(&m_Connection)));
-	}
+	Connect(worker);
 
 	Log(LogNotice, "IdoMysqlConnection")
 		<< "Reconnect: '" << GetName() << "' is now connected to database '" << GetDatabase() << "'.";
@@ -281,19 +348,22 @@ void IdoMysqlConnection::Reconnect()
 	Dictionary::Ptr row = FetchRow(result);
 
 	if (row)
-		m_MaxPacketSize = row->Get("max_allowed_packet");
+		worker.MaxPacketSize = row->Get("max_allowed_packet");
 	else
-		m_MaxPacketSize = 64 * 1024;
+		worker.MaxPacketSize = 64 * 1024;
 
 	DiscardRows(result);
 
+	/* Leave room for the statement around the values. */
+	worker.UpsertBatcher.SetLimits(GetBatchSize(), worker.MaxPacketSize / 2);
+
 	String dbVersionName = "idoutils";
 	result = Query("SELECT version FROM " + GetTablePrefix() + "dbversion WHERE name='" + Escape(dbVersionName) + "'");
 
 	row = FetchRow(result);
 
 	if (!row) {
-		m_Mysql->close(&m_Connection);
+		m_Mysql->close(&worker.Connection);
 		SetConnected(false);
 
 		Log(LogCritical, "IdoMysqlConnection", "Schema does not provide any valid version! Verify your schema installation.");
@@ -308,7 +378,7 @@ void IdoMysqlConnection::Reconnect()
 	SetSchemaVersion(version);
 
 	if (Utility::CompareVersion(IDO_COMPAT_SCHEMA_VERSION, version) < 0) {
-		m_Mysql->close(&m_Connection);
+		m_Mysql->close(&worker.Connection);
 		SetConnected(false);
 
 		Log(LogCritical, "IdoMysqlConnection")
@@ -369,7 +439,7 @@ void IdoMysqlConnection::Reconnect()
 					<< "Last update by endpoint '" << endpoint_name << "' was "
 					<< status_update_age << "s ago (< failover timeout of " << failoverTimeout << "s). Retrying.";
 
-				m_Mysql->close(&m_Connection);
+				m_Mysql->close(&worker.Connection);
 				SetConnected(false);
 				SetShouldConnect(false);
 
@@ -381,7 +451,7 @@ void IdoMysqlConnection::Reconnect()
 				Log(LogNotice, "IdoMysqlConnection")
 					<< "Local endpoint '" << my_endpoint->GetName() << "' is not authoritative, bailing out.";
 
-				m_Mysql->close(&m_Connection);
+				m_Mysql->close(&worker.Connection);
 				SetConnected(false);
 
 				return;
@@ -444,6 +514,10 @@ void IdoMysqlConnection::Reconnect()
 
 	EnableActiveChangedHandler();
 
+	/* Connect the other workers before any of their objects' queries. */
+	for (size_t i = 1; i < m_Workers.size(); i++)
+		m_Workers[i]->Queue->Enqueue([this]() { ReconnectWorker(); }, PriorityImmediate);
+
 	for (const DbObject::Ptr& dbobj : activeDbObjs) {
 		if (dbobj->GetObject())
 			continue;
@@ -466,6 +540,99 @@ void IdoMysqlConnection::Reconnect()
 	m_QueryQueue.Enqueue([this, startTime]() { FinishConnect(startTime); }, PriorityNormal);
 }
 
+/**
+ * Opens the database connection of a worker.
+ *
+ * @param worker The worker
+ */
+void IdoMysqlConnection::Connect(IdoMysqlWorker& worker)
+{
+	String ihost, isocket_path, iuser, ipasswd, idb;
+	String isslKey, isslCert, isslCa, isslCaPath, isslCipher;
+	const char *host, *socket_path, *user , *passwd, *db;
+	const char *sslKey, *sslCert, *sslCa, *sslCaPath, *sslCipher;
+	bool enableSsl;
+	long port;
+
+	ihost = GetHost();
+	isocket_path = GetSocketPath();
+	iuser = GetUser();
+	ipasswd = GetPassword();
+	idb = GetDatabase();
+
+	enableSsl = GetEnableSsl();
+	isslKey = GetSslKey();
+	isslCert = GetSslCert();
+	isslCa = GetSslCa();
+	isslCaPath = GetSslCapath();
+	isslCipher = GetSslCipher();
+
+	host = (!ihost.IsEmpty()) ? ihost.CStr() : nullptr;
+	port = GetPort();
+	socket_path = (!isocket_path.IsEmpty()) ? isocket_path.CStr() : nullptr;
+	user = (!iuser.IsEmpty()) ? iuser.CStr() : nullptr;
+	passwd = (!ipasswd.IsEmpty()) ? ipasswd.CStr() : nullptr;
+	db = (!idb.IsEmpty()) ? idb.CStr() : nullptr;
+
+	sslKey = (!isslKey.IsEmpty()) ? isslKey.CStr() : nullptr;
+	sslCert = (!isslCert.IsEmpty()) ? isslCert.CStr() : nullptr;
+	sslCa = (!isslCa.IsEmpty()) ? isslCa.CStr() : nullptr;
+	sslCaPath = (!isslCaPath.IsEmpty()) ? isslCaPath.CStr() : nullptr;
+	sslCipher = (!isslCipher.IsEmpty()) ? isslCipher.CStr() : nullptr;
+
+	/* connection */
+	if (!m_Mysql->init(&worker.Connection)) {
+		Log(LogCritical, "IdoMysqlConnection")
+			<< "mysql_init() failed: out of memory";
+
+		BOOST_THROW_EXCEPTION(std::bad_alloc());
+	}
+
+	if (enableSsl)
+		m_Mysql->ssl_set(&worker.Connection, sslKey, sslCert, sslCa, sslCaPath, sslCipher);
+
+	if (!m_Mysql->real_connect(&worker.Connection, host, user, passwd, db, port, socket_path, CLIENT_FOUND_ROWS | CLIENT_MULTI_STATEMENTS)) {
+		Log(LogCritical, "IdoMysqlConnection")
+			<< "Connection to database '" << db << "' with user '" << user << "' on '" << host << ":" << port
+			<< "' " << (enableSsl ? "(SSL enabled) " : "") << "failed: \"" << m_Mysql->error(&worker.Connection) << "\"";
+
+		BOOST_THROW_EXCEPTION(std::runtime_error(m_Mysql->error(&worker.Connection)));
+	}
+}
+
+/**
+ * Connects one of the other workers, once the first one has set up the database.
+ */
+void IdoMysqlConnection::ReconnectWorker()
+{
+	IdoMysqlWorker& worker = GetWorker();
+
+	if (!GetConnected())
+		return;
+
+	/* The pending rows refer to the old object IDs, even if this worker's own connection is still alive. */
+	DecreasePendingQueries(worker.UpsertBatcher.Clear());
+
+	worker.MaxPacketSize = m_Workers[0]->MaxPacketSize;
+	worker.UpsertBatcher.SetLimits(GetBatchSize(), worker.MaxPacketSize / 2);
+
+	if (worker.Connected) {
+		if (m_Mysql->ping(&worker.Connection) == 0)
+			return;
+
+		m_Mysql->close(&worker.Connection);
+		worker.Connected = false;
+	}
+
+	Connect(worker);
+
+	worker.Connected = true;
+
+	Query("SET SESSION TIME_ZONE='+00:00'");
+	Query("SET SESSION SQL_MODE='NO_AUTO_VALUE_ON_ZERO'");
+	Query("BEGIN");
+}
+
 void IdoMysqlConnection::FinishConnect(double startTime)
 {
 	AssertOnWorkQueue();
@@ -507,13 +674,15 @@ void IdoMysqlConnection::AsyncQuery(const String& query, const std::function<voi
 	 * See https://github.com/Icinga/icinga2/issues/4603 for details.
 	 */
 	aq.Callback = callback;
-	m_AsyncQueries.emplace_back(std::move(aq));
+	GetWorker().AsyncQueries.emplace_back(std::move(aq));
 }
 
 void IdoMysqlConnection::FinishAsyncQueries()
 {
+	IdoMysqlWorker& worker = GetWorker();
+
 	std::vector<IdoAsyncQuery> queries;
-	m_AsyncQueries.swap(queries);
+	worker.AsyncQueries.swap(queries);
 
 	std::vector<IdoAsyncQuery>::size_type offset = 0;
 
@@ -534,10 +703,10 @@ void IdoMysqlConnection::FinishAsyncQueries()
 		std::vector<IdoAsyncQuery>::size_type count = 0;
 		size_t num_bytes = 0;
 
-		Defer decreaseQueries ([this, &offset, &count]() {
+		Defer decreaseQueries ([this, &worker, &offset, &count]() {
 			offset += count;
 			DecreasePendingQueries(count);
-			m_UncommittedAsyncQueries += count;
+			worker.UncommittedAsyncQueries += count;
 		});
 
 		for (std::vector<IdoAsyncQuery>::size_type i = offset; i < queries.size(); i++) {
@@ -546,7 +715,7 @@ void IdoMysqlConnection::FinishAsyncQueries()
 			size_t size_query = aq.Query.GetLength() + 1;
 
 			if (count > 0) {
-				if (num_bytes + size_query > m_MaxPacketSize - 512)
+				if (num_bytes + size_query > worker.MaxPacketSize - 512)
 					break;
 
 				querybuf << ";";
@@ -564,38 +733,42 @@ void IdoMysqlConnection::FinishAsyncQueries()
 
 		String query = querybuf.str();
 
-		if (m_Mysql->query(&m_Connection, query.CStr()) != 0) {
+		auto start (Histogram::Clock::now());
+
+		if (m_Mysql->query(&worker.Connection, query.CStr()) != 0) {
 			std::ostringstream msgbuf;
-			String message = m_Mysql->error(&m_Connection);
+			String message = m_Mysql->error(&worker.Connection);
 			msgbuf << "Error \"" << message << "\" when executing query \"" << query << "\"";
 			Log(LogCritical, "IdoMysqlConnection", msgbuf.str());
 
 			BOOST_THROW_EXCEPTION(
 				database_error()
-				<< errinfo_message(m_Mysql->error(&m_Connection))
+				<< errinfo_message(m_Mysql->error(&worker.Connection))
 				<< errinfo_database_query(query)
 			);
 		}
 
+		l_QueryTime.ObserveSince(start);
+
 		for (std::vector<IdoAsyncQuery>::size_type i = offset; i < offset + count; i++) {
 			const IdoAsyncQuery& aq = queries[i];
 
-			MYSQL_RES *result = m_Mysql->store_result(&m_Connection);
+			MYSQL_RES *result = m_Mysql->store_result(&worker.Connection);
 
-			m_AffectedRows = m_Mysql->affected_rows(&m_Connection);
+			worker.AffectedRows = m_Mysql->affected_rows(&worker.Connection);
 
 			IdoMysqlResult iresult;
 
 			if (!result) {
-				if (m_Mysql->field_count(&m_Connection) > 0) {
+				if (m_Mysql->field_count(&worker.Connection) > 0) {
 					std::ostringstream msgbuf;
-					String message = m_Mysql->error(&m_Connection);
+					String message = m_Mysql->error(&worker.Connection);
 					msgbuf << "Error \"" << message << "\" when executing query \"" << aq.Query << "\"";
 					Log(LogCritical, "IdoMysqlConnection", msgbuf.str());
 
 					BOOST_THROW_EXCEPTION(
 						database_error()
-						<< errinfo_message(m_Mysql->error(&m_Connection))
+						<< errinfo_message(m_Mysql->error(&worker.Connection))
 						<< errinfo_database_query(query)
 					);
 				}
@@ -605,33 +778,127 @@ void IdoMysqlConnection::FinishAsyncQueries()
 			if (aq.Callback)
 				aq.Callback(iresult);
 
-			if (m_Mysql->next_result(&m_Connection) > 0) {
+			if (m_Mysql->next_result(&worker.Connection) > 0) {
 				std::ostringstream msgbuf;
-				String message = m_Mysql->error(&m_Connection);
+				String message = m_Mysql->error(&worker.Connection);
 				msgbuf << "Error \"" << message << "\" when executing query \"" << query << "\"";
 				Log(LogCritical, "IdoMysqlConnection", msgbuf.str());
 
 				BOOST_THROW_EXCEPTION(
 					database_error()
-					<< errinfo_message(m_Mysql->error(&m_Connection))
+					<< errinfo_message(m_Mysql->error(&worker.Connection))
 					<< errinfo_database_query(query)
 				);
 			}
 		}
 	}
 
-	if (m_UncommittedAsyncQueries > 25000) {
-		m_UncommittedAsyncQueries = 0;
+	if (worker.UncommittedAsyncQueries > 25000) {
+		worker.UncommittedAsyncQueries = 0;
 
 		Query("COMMIT");
 		Query("BEGIN");
 	}
 }
 
-IdoMysqlResult IdoMysqlConnection::Query(const String& query)
+/**
+ * Adds a status update to the multi-row upsert of its table.
+ *
+ * @param query The query
+ * @return Whether the query has been batched
+ */
+bool IdoMysqlConnection::BatchUpsertQuery(const DbQuery& query)
+{
+	if (DbUpsertBatcher::GetKeyColumn(query).IsEmpty())
+		return false;
+
+	std::vector<String> columns, values;
+
+	{
+		ObjectLock olock(query.Fields);
+
+		for (const Dictionary::Pair& kv : query.Fields) {
+			Value value;
+
+			if (kv.second.IsEmpty() && !kv.second.IsString())
+				continue;
+
+			if (!FieldToEscapedString(kv.first, kv.second, &value))
+				return false;
+
+			columns.push_back(kv.first);
+			values.emplace_back(value);
+		}
+	}
+
+	DecreasePendingQueries(GetWorker().UpsertBatcher.Add(query, std::move(columns), std::move(values),
+		[this](const DbUpsertBatch& batch) { ExecuteUpsertBatch(batch); }));
+
+	return true;
+}
+
+void IdoMysqlConnection::FlushUpsertBatches()
 {
 	AssertOnWorkQueue();
 
+	GetWorker().UpsertBatcher.Flush([this](const DbUpsertBatch& batch) { ExecuteUpsertBatch(batch); });
+}
+
+void IdoMysqlConnection::ExecuteUpsertBatch(const DbUpsertBatch& batch)
+{
+	std::ostringstream qbuf;
+	bool first = true;
+
+	qbuf << "INSERT INTO " << GetTablePrefix() << batch.Table << " (";
+
+	for (auto& column : batch.Columns) {
+		if (!first)
+			qbuf << ", ";
+
+		qbuf << column;
+		first = false;
+	}
+
+	qbuf << ") VALUES ";
+	first = true;
+
+	for (auto& row : batch.Rows) {
+		if (!first)
+			qbuf << ", ";
+
+		qbuf << row;
+		first = false;
+	}
+
+	qbuf << " ON DUPLICATE KEY UPDATE ";
+	first = true;
+
+	for (auto& column : batch.Columns) {
+		if (column == batch.KeyColumn)
+			continue;
+
+		if (!first)
+			qbuf << ", ";
+
+		qbuf << column << " = VALUES(" << column << ")";
+		first = false;
+	}
+
+	/* The rows have been pending queries on their own, now they're one. */
+	DecreasePendingQueries(batch.Rows.size() - 1u);
+
+	std::vector<DbObject::Ptr> objects (batch.Objects);
+
+	AsyncQuery(qbuf.str(), [this, objects](const IdoMysqlResult&) {
+		for (auto& object : objects)
+			SetStatusUpdate(object, true);
+	});
+}
+
+IdoMysqlResult IdoMysqlConnection::Query(const String& query)
+{
+	IdoMysqlWorker& worker = GetWorker();
+
 	IncreasePendingQueries(1);
 	Defer decreaseQueries ([this]() { DecreasePendingQueries(1); });
 
@@ -643,33 +910,37 @@ IdoMysqlResult IdoMysqlConnection::Query(const String& query)
 
 	IncreaseQueryCount();
 
-	if (m_Mysql->query(&m_Connection, query.CStr()) != 0) {
+	auto start (Histogram::Clock::now());
+
+	if (m_Mysql->query(&worker.Connection, query.CStr()) != 0) {
 		std::ostringstream msgbuf;
-		String message = m_Mysql->error(&m_Connection);
+		String message = m_Mysql->error(&worker.Connection);
 		msgbuf << "Error \"" << message << "\" when executing query \"" << query << "\"";
 		Log(LogCritical, "IdoMysqlConnection", msgbuf.str());
 
 		BOOST_THROW_EXCEPTION(
 			database_error()
-			<< errinfo_message(m_Mysql->error(&m_Connection))
+			<< errinfo_message(m_Mysql->error(&worker.Connection))
 			<< errinfo_database_query(query)
 		);
 	}
 
-	MYSQL_RES *result = m_Mysql->store_result(&m_Connection);
+	MYSQL_RES *result = m_Mysql->store_result(&worker.Connection);
 
-	m_AffectedRows = m_Mysql->affected_rows(&m_Connection);
+	l_QueryTime.ObserveSince(start);
+
+	worker.AffectedRows = m_Mysql->affected_rows(&worker.Connection);
 
 	if (!result) {
-		if (m_Mysql->field_count(&m_Connection) > 0) {
+		if (m_Mysql->field_count(&worker.Connection) > 0) {
 			std::ostringstream msgbuf;
-			String message = m_Mysql->error(&m_Connection);
+			String message = m_Mysql->error(&worker.Connection);
 			msgbuf << "Error \"" << message << "\" when executing query \"" << query << "\"";
 			Log(LogCritical, "IdoMysqlConnection", msgbuf.str());
 
 			BOOST_THROW_EXCEPTION(
 				database_error()
-				<< errinfo_message(m_Mysql->error(&m_Connection))
+				<< errinfo_message(m_Mysql->error(&worker.Connection))
 				<< errinfo_database_query(query)
 			);
 		}
@@ -682,16 +953,12 @@ IdoMysqlResult IdoMysqlConnection::Query(const String& query)
 
 DbReference IdoMysqlConnection::GetLastInsertID()
 {
-	AssertOnWorkQueue();
-
-	return {static_cast<long>(m_Mysql->insert_id(&m_Connection))};
+	return {static_cast<long>(m_Mysql->insert_id(&GetWorker().Connection))};
 }
 
 int IdoMysqlConnection::GetAffectedRows()
 {
-	AssertOnWorkQueue();
-
-	return m_AffectedRows;
+	return GetWorker().AffectedRows;
 }
 
 String IdoMysqlConnection::Escape(const String& s)
@@ -703,7 +970,7 @@ String IdoMysqlConnection::Escape(const String& s)
 	size_t length = utf8s.GetLength();
 	auto *to = new char[utf8s.GetLength() * 2 + 1];
 
-	m_Mysql->real_escape_string(&m_Connection, to, utf8s.CStr(), length);
+	m_Mysql->real_escape_string(&GetWorker().Connection, to, utf8s.CStr(), length);
 
 	String result = String(to);
 
@@ -757,7 +1024,7 @@ void IdoMysqlConnection::ActivateObject(const DbObject::Ptr& dbobj)
 		<< "Scheduling object activation task for '" << dbobj->GetName1() << "!" << dbobj->GetName2() << "'.";
 #endif /* I2_DEBUG */
 
-	m_QueryQueue.Enqueue([this, dbobj]() { InternalActivateObject(dbobj); }, PriorityNormal);
+	GetObjectWorker(dbobj).Queue->Enqueue([this, dbobj]() { InternalActivateObject(dbobj); }, PriorityNormal);
 }
 
 void IdoMysqlConnection::InternalActivateObject(const DbObject::Ptr& dbobj)
@@ -767,7 +1034,7 @@ void IdoMysqlConnection::InternalActivateObject(const DbObject::Ptr& dbobj)
 	if (IsPaused())
 		return;
 
-	if (!GetConnected())
+	if (!IsWorkerConnected(GetWorker()))
 		return;
 
 	DbReference dbref = GetObjectID(dbobj);
@@ -803,7 +1070,7 @@ void IdoMysqlConnection::DeactivateObject(const DbObject::Ptr& dbobj)
 		<< "Scheduling object deactivation task for '" << dbobj->GetName1() << "!" << dbobj->GetName2() << "'.";
 #endif /* I2_DEBUG */
 
-	m_QueryQueue.Enqueue([this, dbobj]() { InternalDeactivateObject(dbobj); }, PriorityNormal);
+	GetObjectWorker(dbobj).Queue->Enqueue([this, dbobj]() { InternalDeactivateObject(dbobj); }, PriorityNormal);
 }
 
 void IdoMysqlConnection::InternalDeactivateObject(const DbObject::Ptr& dbobj)
@@ -813,7 +1080,7 @@ void IdoMysqlConnection::InternalDeactivateObject(const DbObject::Ptr& dbobj)
 	if (IsPaused())
 		return;
 
-	if (!GetConnected())
+	if (!IsWorkerConnected(GetWorker()))
 		return;
 
 	DbReference dbref = GetObjectID(dbobj);
@@ -864,6 +1131,10 @@ bool IdoMysqlConnection::FieldToEscapedString(const String& key, const Value& va
 			dbrefcol = GetObjectID(dbobjcol);
 
 			if (!dbrefcol.IsValid()) {
+				/* Only the object's own worker inserts it, the others wait for it. */
+				if (&GetObjectWorker(dbobjcol) != &GetWorker())
+					return false;
+
 				InternalActivateObject(dbobjcol);
 
 				dbrefcol = GetObjectID(dbobjcol);
@@ -914,7 +1185,7 @@ void IdoMysqlConnection::ExecuteQuery(const DbQuery& query)
 #endif /* I2_DEBUG */
 
 	IncreasePendingQueries(1);
-	m_QueryQueue.Enqueue([this, query]() { InternalExecuteQuery(query, -1); }, query.Priority, true);
+	GetObjectWorker(query.Object).Queue->Enqueue([this, query]() { InternalExecuteQuery(query, -1); }, query.Priority, true);
 }
 
 void IdoMysqlConnection::ExecuteMultipleQueries(const std::vector<DbQuery>& queries)
@@ -931,7 +1202,7 @@ void IdoMysqlConnection::ExecuteMultipleQueries(const std::vector<DbQuery>& quer
 #endif /* I2_DEBUG */
 
 	IncreasePendingQueries(queries.size());
-	m_QueryQueue.Enqueue([this, queries]() { InternalExecuteMultipleQueries(queries); }, queries[0].Priority, true);
+	GetObjectWorker(queries[0].Object).Queue->Enqueue([this, queries]() { InternalExecuteMultipleQueries(queries); }, queries[0].Priority, true);
 }
 
 bool IdoMysqlConnection::CanExecuteQuery(const DbQuery& query)
@@ -968,14 +1239,14 @@ bool IdoMysqlConnection::CanExecuteQuery(const DbQuery& query)
 
 void IdoMysqlConnection::InternalExecuteMultipleQueries(const std::vector<DbQuery>& queries)
 {
-	AssertOnWorkQueue();
+	IdoMysqlWorker& worker = GetWorker();
 
 	if (IsPaused()) {
 		DecreasePendingQueries(queries.size());
 		return;
 	}
 
-	if (!GetConnected()) {
+	if (!IsWorkerConnected(worker)) {
 		DecreasePendingQueries(queries.size());
 		return;
 	}
@@ -992,7 +1263,7 @@ void IdoMysqlConnection::InternalExecuteMultipleQueries(const std::vector<DbQuer
 				<< query.Type << "', table '" << query.Table << "', queue size: '" << GetPendingQueryCount() << "'.";
 #endif /* I2_DEBUG */
 
-			m_QueryQueue.Enqueue([this, queries]() { InternalExecuteMultipleQueries(queries); }, query.Priority);
+			worker.Queue->Enqueue([this, queries]() { InternalExecuteMultipleQueries(queries); }, query.Priority);
 			return;
 		}
 	}
@@ -1004,14 +1275,14 @@ void IdoMysqlConnection::InternalExecuteMultipleQueries(const std::vector<DbQuer
 
 void IdoMysqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOverride)
 {
-	AssertOnWorkQueue();
+	IdoMysqlWorker& worker = GetWorker();
 
 	if (IsPaused()) {
 		DecreasePendingQueries(1);
 		return;
 	}
 
-	if (!GetConnected()) {
+	if (!IsWorkerConnected(worker)) {
 		DecreasePendingQueries(1);
 		return;
 	}
@@ -1042,10 +1313,28 @@ void IdoMysqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 			<< typeOverride << "', table '" << query.Table << "', queue size: '" << GetPendingQueryCount() << "'.";
 #endif /* I2_DEBUG */
 
-		m_QueryQueue.Enqueue([this, query, typeOverride]() { InternalExecuteQuery(query, typeOverride); }, query.Priority);
+		worker.Queue->Enqueue([this, query, typeOverride]() { InternalExecuteQuery(query, typeOverride); }, query.Priority);
 		return;
 	}
 
+	if (typeOverride == -1) {
+		DbQuery changedQuery;
+
+		if (FilterStatusUpdate(query, changedQuery)) {
+			if (changedQuery.Fields)
+				InternalExecuteQuery(changedQuery, -1);
+			else
+				DecreasePendingQueries(1);
+
+			return;
+		}
+	}
+
+	if (typeOverride == -1 && GetBatchSize() > 0 && BatchUpsertQuery(query))
+		return;
+
+	worker.UpsertBatcher.Flush(query.Table, [this](const DbUpsertBatch& batch) { ExecuteUpsertBatch(batch); });
+
 	std::ostringstream qbuf, where;
 	int type;
 
@@ -1065,7 +1354,7 @@ void IdoMysqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 					<< typeOverride << "', table '" << query.Table << "', queue size: '" << GetPendingQueryCount() << "'.";
 #endif /* I2_DEBUG */
 
-				m_QueryQueue.Enqueue([this, query]() { InternalExecuteQuery(query, -1); }, query.Priority);
+				worker.Queue->Enqueue([this, query]() { InternalExecuteQuery(query, -1); }, query.Priority);
 				return;
 			}
 
@@ -1145,7 +1434,7 @@ void IdoMysqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 					<< kv.first << "', val '" << kv.second << "', type " << typeOverride << ", table '" << query.Table << "'.";
 #endif /* I2_DEBUG */
 
-				m_QueryQueue.Enqueue([this, query]() { InternalExecuteQuery(query, -1); }, query.Priority);
+				worker.Queue->Enqueue([this, query]() { InternalExecuteQuery(query, -1); }, query.Priority);
 				return;
 			}
 
@@ -1188,11 +1477,15 @@ void IdoMysqlConnection::FinishExecuteQuery(const DbQuery& query, int type, bool
 #endif /* I2_DEBUG */
 
 		IncreasePendingQueries(1);
-		m_QueryQueue.Enqueue([this, query]() { InternalExecuteQuery(query, DbQueryDelete | DbQueryInsert); }, query.Priority);
+		GetWorker().Queue->Enqueue([this, query]() { InternalExecuteQuery(query, DbQueryDelete | DbQueryInsert); }, query.Priority);
 
 		return;
 	}
 
+	/* The UPDATE has found the status row, so later status updates may only contain the changed columns. */
+	if (upsert && query.StatusUpdate && query.Object)
+		SetStatusUpdate(query.Object, true);
+
 	if (type == DbQueryInsert && query.Object) {
 		if (query.ConfigUpdate) {
 			SetInsertID(query.Object, GetLastInsertID());
@@ -1207,8 +1500,10 @@ void IdoMysqlConnection::FinishExecuteQuery(const DbQuery& query, int type, bool
 
 void IdoMysqlConnection::CleanUpExecuteQuery(const String& table, const String& time_column, double max_age)
 {
-	if (IsPaused())
+	if (IsPaused()) {
+		FinishCleanUp(table, 0, true);
 		return;
+	}
 
 #ifdef I2_DEBUG /* I2_DEBUG */
 		Log(LogDebug, "IdoMysqlConnection")
@@ -1224,19 +1519,33 @@ void IdoMysqlConnection::InternalCleanUpExecuteQuery(const String& table, const
 {
 	AssertOnWorkQueue();
 
-	if (IsPaused()) {
-		DecreasePendingQueries(1);
-		return;
-	}
-
-	if (!GetConnected()) {
+	if (IsPaused() || !GetConnected()) {
 		DecreasePendingQueries(1);
+		FinishCleanUp(table, 0, true);
 		return;
 	}
 
-	AsyncQuery("DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " +
+	int batchSize = GetCleanupBatchSize();
+	String query = "DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " +
 		Convert::ToString(static_cast<long>(m_InstanceID)) + " AND " + time_column +
-		" < FROM_UNIXTIME(" + Convert::ToString(static_cast<long>(max_age)) + ")");
+		" < FROM_UNIXTIME(" + Convert::ToString(static_cast<long>(max_age)) + ")";
+
+	if (batchSize > 0)
+		query += " LIMIT " + Convert::ToString(batchSize);
+
+	AsyncQuery(query, [this, table, time_column, max_age, batchSize](const IdoMysqlResult&) {
+		int rows = GetAffectedRows();
+		bool done = batchSize <= 0 || rows < batchSize;
+
+		FinishCleanUp(table, rows, done);
+
+		if (done)
+			return;
+
+		/* The next chunk goes into the next transaction, after the queries which have been queued in the meantime. */
+		IncreasePendingQueries(1);
+		m_QueryQueue.Enqueue([this, table, time_column, max_age]() { InternalCleanUpExecuteQuery(table, time_column, max_age); }, PriorityLow);
+	});
 }
 
 void IdoMysqlConnection::FillIDCache(const DbType::Ptr& type)
@@ -1255,5 +1564,10 @@ void IdoMysqlConnection::FillIDCache(const DbType::Ptr& type)
 
 int IdoMysqlConnection::GetPendingQueryCount() const
 {
-	return m_QueryQueue.GetLength();
+	size_t length = 0;
+
+	for (auto& worker : m_Workers)
+		length += worker->Queue->GetLength();
+
+	return length;
 }
@@ -5,6 +5,7 @@
 
 #include "db_ido_mysql/idomysqlconnection-ti.hpp"
 #include "mysql_shim/mysqlinterface.hpp"
+#include "db_ido/dbupsertbatch.hpp"
 #include "base/array.hpp"
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
@@ -24,6 +25,27 @@ struct IdoAsyncQuery
 	IdoAsyncCallback Callback;
 };
 
+/**
+ * A database connection and the work queue thread which uses it.
+ *
+ * @ingroup ido
+ */
+struct IdoMysqlWorker
+{
+	WorkQueue *Queue;
+	std::unique_ptr<WorkQueue> OwnQueue;
+
+	MYSQL Connection;
+	bool Connected{false};
+	int AffectedRows{0};
+	unsigned int MaxPacketSize{64 * 1024};
+
+	std::vector<IdoAsyncQuery> AsyncQueries;
+	uint_fast32_t UncommittedAsyncQueries{0};
+
+	DbUpsertBatcher UpsertBatcher;
+};
+
 /**
  * An IDO MySQL database connection.
  *
@@ -52,18 +74,16 @@ protected:
 	void FillIDCache(const DbType::Ptr& type) override;
 	void NewTransaction() override;
 
+	WorkQueue& GetObjectQueue(const DbObject::Ptr& dbobj) override;
+
 private:
 	DbReference m_InstanceID;
 
 	Library m_Library;
 	std::unique_ptr<MysqlInterface, MysqlInterfaceDeleter> m_Mysql;
 
-	MYSQL m_Connection;
-	int m_AffectedRows;
-	unsigned int m_MaxPacketSize;
-
-	std::vector<IdoAsyncQuery> m_AsyncQueries;
-	uint_fast32_t m_UncommittedAsyncQueries = 0;
+	/* The first worker uses m_QueryQueue and handles everything which isn't tied to an object. */
+	std::vector<std::unique_ptr<IdoMysqlWorker> > m_Workers;
 
 	Timer::Ptr m_ReconnectTimer;
 	Timer::Ptr m_TxTimer;
@@ -78,12 +98,22 @@ private:
 	void AsyncQuery(const String& query, const IdoAsyncCallback& callback = IdoAsyncCallback());
 	void FinishAsyncQueries();
 
+	bool BatchUpsertQuery(const DbQuery& query);
+	void FlushUpsertBatches();
+	void ExecuteUpsertBatch(const DbUpsertBatch& batch);
+
 	bool FieldToEscapedString(const String& key, const Value& value, Value *result);
 	void InternalActivateObject(const DbObject::Ptr& dbobj);
 	void InternalDeactivateObject(const DbObject::Ptr& dbobj);
 
+	IdoMysqlWorker& GetWorker();
+	IdoMysqlWorker& GetObjectWorker(const DbObject::Ptr& dbobj);
+	bool IsWorkerConnected(const IdoMysqlWorker& worker) const;
+
 	void Disconnect();
+	void Connect(IdoMysqlWorker& worker);
 	void Reconnect();
+	void ReconnectWorker();
 
 	void AssertOnWorkQueue();
 
@@ -101,7 +131,7 @@ private:
 	void ClearTableBySession(const String& table);
 	void ClearTablesBySession();
 
-	void ExceptionHandler(boost::exception_ptr exp);
+	void ExceptionHandler(IdoMysqlWorker& worker, boost::exception_ptr exp);
 
 	void FinishConnect(double startTime);
 };
@@ -15,6 +15,9 @@
 #include "base/context.hpp"
 #include "base/statsfunction.hpp"
 #include "base/defer.hpp"
+#include "base/metrics.hpp"
+#include <algorithm>
+#include <iterator>
 #include <utility>
 
 using namespace icinga;
@@ -23,6 +26,17 @@ REGISTER_TYPE(IdoPgsqlConnection);
 
 REGISTER_STATSFUNCTION(IdoPgsqlConnection, &IdoPgsqlConnection::StatsFunc);
 
+/* The tables with the most writes, see IsPreparedTable(). */
+static const char * const l_PreparedTables[] = { "hoststatus", "servicestatus", "statehistory", "comments", "scheduleddowntime" };
+
+/* Upper limit for the prepared statements of a connection. */
+static const size_t l_MaxPreparedStatements = 256;
+
+/* Upper limit for the statements in flight, their results have to fit into the socket buffers. */
+static const size_t l_MaxPipelinedQueries = 500;
+
+static Histogram l_QueryTime ("icinga_ido_pgsql_query_seconds", "Execution time of IDO PostgreSQL queries");
+
 IdoPgsqlConnection::IdoPgsqlConnection()
 {
 	m_QueryQueue.SetName("IdoPgsqlConnection, " + GetName());
@@ -34,6 +48,22 @@ void IdoPgsqlConnection::OnConfigLoaded()
 
 	m_QueryQueue.SetName("IdoPgsqlConnection, " + GetName());
 
+	m_Workers.clear();
+
+	for (int i = 0; i < GetWorkers(); i++) {
+		std::unique_ptr<IdoPgsqlWorker> worker (new IdoPgsqlWorker());
+
+		if (i == 0) {
+			worker->Queue = &m_QueryQueue;
+		} else {
+			worker->OwnQueue.reset(new WorkQueue(10000000, 1, LogNotice));
+			worker->OwnQueue->SetName("IdoPgsqlConnection, " + GetName() + ", worker " + Convert::ToString(i));
+			worker->Queue = worker->OwnQueue.get();
+		}
+
+		m_Workers.emplace_back(std::move(worker));
+	}
+
 	Library shimLibrary{"pgsql_shim"};
 
 	auto create_pgsql_shim = shimLibrary.GetSymbolAddress<create_pgsql_shim_ptr>("create_pgsql_shim");
@@ -48,16 +78,25 @@ void IdoPgsqlConnection::StatsFunc(const Dictionary::Ptr& status, const Array::P
 	DictionaryData nodes;
 
 	for (const IdoPgsqlConnection::Ptr& idopgsqlconnection : ConfigType::GetObjectsByType<IdoPgsqlConnection>()) {
-		size_t queryQueueItems = idopgsqlconnection->m_QueryQueue.GetLength();
-		double queryQueueItemRate = idopgsqlconnection->m_QueryQueue.GetTaskCount(60) / 60.0;
+		size_t queryQueueItems = 0;
+		double queryQueueItemRate = 0;
+		std::map<String, DbUpsertBatchStats> batchStats;
+
+		for (auto& worker : idopgsqlconnection->m_Workers) {
+			queryQueueItems += worker->Queue->GetLength();
+			queryQueueItemRate += worker->Queue->GetTaskCount(60) / 60.0;
+			worker->UpsertBatcher.CollectStats(batchStats);
+		}
 
-		nodes.emplace_back(idopgsqlconnection->GetName(), new Dictionary({
+		Dictionary::Ptr node = new Dictionary({
 			{ "version", idopgsqlconnection->GetSchemaVersion() },
 			{ "instance_name", idopgsqlconnection->GetInstanceName() },
 			{ "connected", idopgsqlconnection->GetConnected() },
+			{ "workers", idopgsqlconnection->m_Workers.size() },
+			{ "status_columns_suppressed", idopgsqlconnection->GetSuppressedStatusColumns() },
 			{ "query_queue_items", queryQueueItems },
 			{ "query_queue_item_rate", queryQueueItemRate }
-		}));
+		});
 
 		perfdata->Add(new PerfdataValue("idopgsqlconnection_" + idopgsqlconnection->GetName() + "_queries_rate", idopgsqlconnection->GetQueryCount(60) / 60.0));
 		perfdata->Add(new PerfdataValue("idopgsqlconnection_" + idopgsqlconnection->GetName() + "_queries_1min", idopgsqlconnection->GetQueryCount(60)));
@@ -65,6 +104,13 @@ void IdoPgsqlConnection::StatsFunc(const Dictionary::Ptr& status, const Array::P
 		perfdata->Add(new PerfdataValue("idopgsqlconnection_" + idopgsqlconnection->GetName() + "_queries_15mins", idopgsqlconnection->GetQueryCount(15 * 60)));
 		perfdata->Add(new PerfdataValue("idopgsqlconnection_" + idopgsqlconnection->GetName() + "_query_queue_items", queryQueueItems));
 		perfdata->Add(new PerfdataValue("idopgsqlconnection_" + idopgsqlconnection->GetName() + "_query_queue_item_rate", queryQueueItemRate));
+
+		perfdata->Add(new PerfdataValue("idopgsqlconnection_" + idopgsqlconnection->GetName() + "_status_columns_suppressed", idopgsqlconnection->GetSuppressedStatusColumns(), true));
+
+		DbUpsertBatcher::AddStats(batchStats, node, "idopgsqlconnection_" + idopgsqlconnection->GetName(), perfdata);
+		idopgsqlconnection->AddCleanUpStats(node, "idopgsqlconnection_" + idopgsqlconnection->GetName(), perfdata);
+
+		nodes.emplace_back(idopgsqlconnection->GetName(), node);
 	}
 
 	status->Set("idopgsqlconnection", new Dictionary(std::move(nodes)));
@@ -77,7 +123,10 @@ void IdoPgsqlConnection::Resume()
 
 	SetConnected(false);
 
-	m_QueryQueue.SetExceptionCallback([this](boost::exception_ptr exp) { ExceptionHandler(std::move(exp)); });
+	for (auto& worker : m_Workers) {
+		IdoPgsqlWorker *pworker = worker.get();
+		worker->Queue->SetExceptionCallback([this, pworker](boost::exception_ptr exp) { ExceptionHandler(*pworker, std::move(exp)); });
+	}
 
 	/* Immediately try to connect on Resume() without timer. */
 	m_QueryQueue.Enqueue([this]() { Reconnect(); }, PriorityImmediate);
@@ -104,44 +153,112 @@ void IdoPgsqlConnection::Pause()
 
 	m_ReconnectTimer.reset();
 
-	m_QueryQueue.Enqueue([this]() { Disconnect(); }, PriorityLow);
+	/* The other workers stop executing queries once the first one has disconnected. */
+	for (auto it = m_Workers.rbegin(); it != m_Workers.rend(); it++) {
+		(*it)->Queue->Enqueue([this]() { Disconnect(); }, PriorityLow);
 
-	/* Work on remaining tasks but never delete the threads, for HA resuming later. */
-	m_QueryQueue.Join();
+		/* Work on remaining tasks but never delete the threads, for HA resuming later. */
+		(*it)->Queue->Join();
+	}
 
 	Log(LogInformation, "IdoPgsqlConnection")
 		<< "'" << GetName() << "' paused.";
 }
 
-void IdoPgsqlConnection::ExceptionHandler(boost::exception_ptr exp)
+void IdoPgsqlConnection::ExceptionHandler(IdoPgsqlWorker& worker, boost::exception_ptr exp)
 {
 	Log(LogWarning, "IdoPgsqlConnection", "Exception during database operation: Verify that your database is operational!");
 
 	Log(LogDebug, "IdoPgsqlConnection")
 		<< "Exception during database operation: " << DiagnosticInformation(std::move(exp));
 
-	if (GetConnected()) {
-		m_Pgsql->finish(m_Connection);
-		SetConnected(false);
+	if (&worker == m_Workers[0].get()) {
+		if (GetConnected()) {
+			m_Pgsql->finish(worker.Connection);
+			SetConnected(false);
+		}
+	} else {
+		if (worker.Connected) {
+			m_Pgsql->finish(worker.Connection);
+			worker.Connected = false;
+		}
+
+		/* The worker's uncommitted queries are lost, so all objects have to be written again. */
+		m_QueryQueue.Enqueue([this]() {
+			if (GetConnected()) {
+				m_Pgsql->finish(m_Workers[0]->Connection);
+				SetConnected(false);
+			}
+		}, PriorityImmediate);
+	}
+}
+
+/**
+ * The worker of the current work queue thread.
+ */
+IdoPgsqlWorker& IdoPgsqlConnection::GetWorker()
+{
+	for (auto& worker : m_Workers) {
+		if (worker->Queue->IsWorkerThread())
+			return *worker;
 	}
+
+	BOOST_THROW_EXCEPTION(std::runtime_error("Not running on a work queue thread of '" + GetName() + "'."));
+}
+
+/**
+ * The worker which executes the queries of an object, so that they're executed in order.
+ *
+ * @param dbobj The object, may be null
+ */
+IdoPgsqlWorker& IdoPgsqlConnection::GetObjectWorker(const DbObject::Ptr& dbobj)
+{
+	return *m_Workers[GetObjectPartition(dbobj, m_Workers.size())];
+}
+
+WorkQueue& IdoPgsqlConnection::GetObjectQueue(const DbObject::Ptr& dbobj)
+{
+	return *GetObjectWorker(dbobj).Queue;
+}
+
+/**
+ * Tells whether a worker may execute queries. The other workers
+ * depend on the first one, which sets up the database.
+ */
+bool IdoPgsqlConnection::IsWorkerConnected(const IdoPgsqlWorker& worker) const
+{
+	return GetConnected() && (&worker == m_Workers[0].get() || worker.Connected);
 }
 
 void IdoPgsqlConnection::AssertOnWorkQueue()
 {
-	ASSERT(m_QueryQueue.IsWorkerThread());
+	ASSERT(std::any_of(m_Workers.begin(), m_Workers.end(), [](const std::unique_ptr<IdoPgsqlWorker>& worker) {
+		return worker->Queue->IsWorkerThread();
+	}));
 }
 
 void IdoPgsqlConnection::Disconnect()
 {
 	AssertOnWorkQueue();
 
-	if (!GetConnected())
+	IdoPgsqlWorker& worker = GetWorker();
+	bool primary = &worker == m_Workers[0].get();
+
+	if (primary ? !GetConnected() : !worker.Connected)
 		return;
 
+	FlushUpsertBatches();
+
 	IncreasePendingQueries(1);
 	Query("COMMIT");
 
-	m_Pgsql->finish(m_Connection);
+	m_Pgsql->finish(worker.Connection);
+
+	if (!primary) {
+		worker.Connected = false;
+		return;
+	}
+
 	SetConnected(false);
 
 	Log(LogInformation, "IdoPgsqlConnection")
@@ -153,16 +270,19 @@ void IdoPgsqlConnection::NewTransaction()
 	if (IsPaused())
 		return;
 
-	m_QueryQueue.Enqueue([this]() { InternalNewTransaction(); }, PriorityNormal, true);
+	for (auto& worker : m_Workers)
+		worker->Queue->Enqueue([this]() { InternalNewTransaction(); }, PriorityNormal, true);
 }
 
 void IdoPgsqlConnection::InternalNewTransaction()
 {
 	AssertOnWorkQueue();
 
-	if (!GetConnected())
+	if (!IsWorkerConnected(GetWorker()))
 		return;
 
+	FlushUpsertBatches();
+
 	IncreasePendingQueries(2);
 	Query("COMMIT");
 	Query("BEGIN");
@@ -180,6 +300,8 @@ void IdoPgsqlConnection::Reconnect()
 
 	CONTEXT("Reconnecting to PostgreSQL IDO database '" + GetName() + "'");
 
+	IdoPgsqlWorker& worker = *m_Workers[0];
+
 	double startTime = Utility::GetTime();
 
 	SetShouldConnect(true);
@@ -193,67 +315,27 @@ void IdoPgsqlConnection::Reconnect()
 			Query("SELECT 1");
 			return;
 		} catch (const std::exception&) {
-			m_Pgsql->finish(m_Connection);
+			m_Pgsql->finish(worker.Connection);
 			SetConnected(false);
 			reconnect = true;
 		}
 	}
 
 	ClearIDCache();
+	ResetCleanUps();
 
-	String host = GetHost();
-	String port = GetPort();
-	String user = GetUser();
-	String password = GetPassword();
-	String database = GetDatabase();
-
-	String sslMode = GetSslMode();
-	String sslKey = GetSslKey();
-	String sslCert = GetSslCert();
-	String sslCa = GetSslCa();
-
-	String conninfo;
+	/* The pending rows refer to the old object IDs. */
+	DecreasePendingQueries(worker.UpsertBatcher.Clear());
 
-	if (!host.IsEmpty())
-		conninfo += " host=" + host;
-	if (!port.IsEmpty())
-		conninfo += " port=" + port;
-	if (!user.IsEmpty())
-		conninfo += " user=" + user;
-	if (!password.IsEmpty())
-		conninfo += " password=" + password;
-	if (!database.IsEmpty())
-		conninfo += " dbname=" + database;
-
-	if (!sslMode.IsEmpty())
-		conninfo += " sslmode=" + sslMode;
-	if (!sslKey.IsEmpty())
-		conninfo += " sslkey=" + sslKey;
-	if (!sslCert.IsEmpty())
-		conninfo += " sslcert=" + sslCert;
-	if (!sslCa.IsEmpty())
-		conninfo += " sslrootcert=" + sslCa;
-
-	/* connection */
-	m_Connection = m_Pgsql->connectdb(conninfo.CStr());
-
-	if (!m_Connection)
+	if (!Connect(worker))
 		return;
 
-	if (m_Pgsql->status(m_Connection) != CONNECTION_OK) {
-		String message = m_Pgsql->errorMessage(m_Connection);
-		m_Pgsql->finish(m_Connection);
-		SetConnected(false);
-
-		Log(LogCritical, "IdoPgsqlConnection")
-			<< "Connection to database '" << database << "' with user '" << user << "' on '" << host << ":" << port
-			<< "' failed: \"" << message << "\"";
-
-		BOOST_THROW_EXCEPTION(std::runtime_error(message));
-	}
-
 	SetConnected(true);
 
+	/* INSERT ... ON CONFLICT requires PostgreSQL 9.5. */
+	m_SupportsUpsert = m_Pgsql->serverVersion(worker.Connection) >= 90500;
+	worker.UpsertBatcher.SetLimits(GetBatchSize(), 4 * 1024 * 1024);
+
 	IdoPgsqlResult result;
 
 	String dbVersionName = "idoutils";
@@ -263,7 +345,7 @@ void IdoPgsqlConnection::Reconnect()
 	Dictionary::Ptr row = FetchRow(result, 0);
 
 	if (!row) {
-		m_Pgsql->finish(m_Connection);
+		m_Pgsql->finish(worker.Connection);
 		SetConnected(false);
 
 		Log(LogCritical, "IdoPgsqlConnection", "Schema does not provide any valid version! Verify your schema installation.");
@@ -276,7 +358,7 @@ void IdoPgsqlConnection::Reconnect()
 	SetSchemaVersion(version);
 
 	if (Utility::CompareVersion(IDO_COMPAT_SCHEMA_VERSION, version) < 0) {
-		m_Pgsql->finish(m_Connection);
+		m_Pgsql->finish(worker.Connection);
 		SetConnected(false);
 
 		Log(LogCritical, "IdoPgsqlConnection")
@@ -337,7 +419,7 @@ void IdoPgsqlConnection::Reconnect()
 					<< "Last update by endpoint '" << endpoint_name << "' was "
 					<< status_update_age << "s ago (< failover timeout of " << failoverTimeout << "s). Retrying.";
 
-				m_Pgsql->finish(m_Connection);
+				m_Pgsql->finish(worker.Connection);
 				SetConnected(false);
 				SetShouldConnect(false);
 
@@ -349,7 +431,7 @@ void IdoPgsqlConnection::Reconnect()
 				Log(LogNotice, "IdoPgsqlConnection")
 					<< "Local endpoint '" << my_endpoint->GetName() << "' is not authoritative, bailing out.";
 
-				m_Pgsql->finish(m_Connection);
+				m_Pgsql->finish(worker.Connection);
 				SetConnected(false);
 
 				return;
@@ -367,7 +449,7 @@ void IdoPgsqlConnection::Reconnect()
 
 	Log(LogInformation, "IdoPgsqlConnection")
 		<< "PGSQL IDO instance id: " << static_cast<long>(m_InstanceID) << " (schema version: '" + version + "')"
-		<< (!sslMode.IsEmpty() ? ", sslmode='" + sslMode + "'" : "");
+		<< (!GetSslMode().IsEmpty() ? ", sslmode='" + GetSslMode() + "'" : "");
 
 	IncreasePendingQueries(1);
 	Query("BEGIN");
@@ -414,6 +496,10 @@ void IdoPgsqlConnection::Reconnect()
 
 	EnableActiveChangedHandler();
 
+	/* Connect the other workers before any of their objects' queries. */
+	for (size_t i = 1; i < m_Workers.size(); i++)
+		m_Workers[i]->Queue->Enqueue([this]() { ReconnectWorker(); }, PriorityImmediate);
+
 	for (const DbObject::Ptr& dbobj : activeDbObjs) {
 		if (dbobj->GetObject())
 			continue;
@@ -431,6 +517,110 @@ void IdoPgsqlConnection::Reconnect()
 	m_QueryQueue.Enqueue([this, startTime]() { FinishConnect(startTime); }, PriorityNormal);
 }
 
+/**
+ * Opens the database connection of a worker.
+ *
+ * @param worker The worker
+ * @return Whether a connection could be allocated
+ */
+bool IdoPgsqlConnection::Connect(IdoPgsqlWorker& worker)
+{
+	String host = GetHost();
+	String port = GetPort();
+	String user = GetUser();
+	String password = GetPassword();
+	String database = GetDatabase();
+
+	String sslMode = GetSslMode();
+	String sslKey = GetSslKey();
+	String sslCert = GetSslCert();
+	String sslCa = GetSslCa();
+
+	String conninfo;
+
+	if (!host.IsEmpty())
+		conninfo += " host=" + host;
+	if (!port.IsEmpty())
+		conninfo += " port=" + port;
+	if (!user.IsEmpty())
+		conninfo += " user=" + user;
+	if (!password.IsEmpty())
+		conninfo += " password=" + password;
+	if (!database.IsEmpty())
+		conninfo += " dbname=" + database;
+
+	if (!sslMode.IsEmpty())
+		conninfo += " sslmode=" + sslMode;
+	if (!sslKey.IsEmpty())
+		conninfo += " sslkey=" + sslKey;
+	if (!sslCert.IsEmpty())
+		conninfo += " sslcert=" + sslCert;
+	if (!sslCa.IsEmpty())
+		conninfo += " sslrootcert=" + sslCa;
+
+	/* connection */
+	/* Prepared statements belong to the old connection. */
+	worker.PreparedStatements.clear();
+	worker.PipelinedQueries.clear();
+	worker.Pipeline = false;
+
+	worker.Connection = m_Pgsql->connectdb(conninfo.CStr());
+
+	if (!worker.Connection)
+		return false;
+
+	if (m_Pgsql->status(worker.Connection) != CONNECTION_OK) {
+		String message = m_Pgsql->errorMessage(worker.Connection);
+		m_Pgsql->finish(worker.Connection);
+
+		Log(LogCritical, "IdoPgsqlConnection")
+			<< "Connection to database '" << database << "' with user '" << user << "' on '" << host << ":" << port
+			<< "' failed: \"" << message << "\"";
+
+		BOOST_THROW_EXCEPTION(std::runtime_error(message));
+	}
+
+	/* Pipeline mode is used with PostgreSQL 14 and newer only, older libpq versions don't support it at all. */
+	if (GetEnablePipelining() && m_Pgsql->serverVersion(worker.Connection) >= 140000)
+		worker.Pipeline = m_Pgsql->enterPipelineMode(worker.Connection);
+
+	return true;
+}
+
+/**
+ * Connects one of the other workers, once the first one has set up the database.
+ */
+void IdoPgsqlConnection::ReconnectWorker()
+{
+	IdoPgsqlWorker& worker = GetWorker();
+
+	if (!GetConnected())
+		return;
+
+	if (worker.Connected) {
+		try {
+			IncreasePendingQueries(1);
+			Query("SELECT 1");
+			return;
+		} catch (const std::exception&) {
+			m_Pgsql->finish(worker.Connection);
+			worker.Connected = false;
+		}
+	}
+
+	/* The pending rows refer to the old object IDs. */
+	DecreasePendingQueries(worker.UpsertBatcher.Clear());
+
+	if (!Connect(worker))
+		return;
+
+	worker.Connected = true;
+	worker.UpsertBatcher.SetLimits(GetBatchSize(), 4 * 1024 * 1024);
+
+	IncreasePendingQueries(1);
+	Query("BEGIN");
+}
+
 void IdoPgsqlConnection::FinishConnect(double startTime)
 {
 	AssertOnWorkQueue();
@@ -457,7 +647,7 @@ void IdoPgsqlConnection::ClearTablesBySession()
 void IdoPgsqlConnection::ClearTableBySession(const String& table)
 {
 	IncreasePendingQueries(1);
-	Query("DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " +
+	PipelineQuery("DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " +
 		Convert::ToString(static_cast<long>(m_InstanceID)) + " AND session_token <> " +
 		Convert::ToString(GetSessionToken()));
 }
@@ -468,15 +658,251 @@ IdoPgsqlResult IdoPgsqlConnection::Query(const String& query)
 
 	Defer decreaseQueries ([this]() { DecreasePendingQueries(1); });
 
+	auto start (Histogram::Clock::now());
+	Defer observeQueryTime ([start]() { l_QueryTime.ObserveSince(start); });
+
 	Log(LogDebug, "IdoPgsqlConnection")
 		<< "Query: " << query;
 
 	IncreaseQueryCount();
 
-	PGresult *result = m_Pgsql->exec(m_Connection, query.CStr());
+	IdoPgsqlWorker& worker = GetWorker();
+
+	if (worker.Pipeline) {
+		SendQuery(worker, query);
+		return FinishPipeline(worker);
+	}
+
+	return ProcessResult(worker, query, m_Pgsql->exec(worker.Connection, query.CStr()));
+}
+
+/**
+ * Executes a statement with parameters. The statement is prepared once per
+ * connection, so that the server doesn't have to parse it again.
+ *
+ * @param query The statement with $1, $2, ... placeholders
+ * @param params The parameters' values in text format
+ * @return The result, if any
+ */
+IdoPgsqlResult IdoPgsqlConnection::PreparedQuery(const String& query, const std::vector<String>& params)
+{
+	AssertOnWorkQueue();
+
+	Defer decreaseQueries ([this]() { DecreasePendingQueries(1); });
+
+	auto start (Histogram::Clock::now());
+	Defer observeQueryTime ([start]() { l_QueryTime.ObserveSince(start); });
+
+	Log(LogDebug, "IdoPgsqlConnection")
+		<< "Prepared query: " << query;
+
+	IncreaseQueryCount();
+
+	IdoPgsqlWorker& worker = GetWorker();
+
+	if (worker.Pipeline) {
+		SendPreparedQuery(worker, query, params);
+		return FinishPipeline(worker);
+	}
+
+	std::vector<const char *> values;
+	values.reserve(params.size());
+
+	for (auto& param : params)
+		values.push_back(param.CStr());
+
+	auto it = worker.PreparedStatements.find(query);
+
+	if (it == worker.PreparedStatements.end()) {
+		/* Don't let unexpected statement shapes fill the server's memory. */
+		if (worker.PreparedStatements.size() >= l_MaxPreparedStatements) {
+			return ProcessResult(worker, query, m_Pgsql->execParams(worker.Connection, query.CStr(),
+				values.size(), nullptr, values.data(), nullptr, nullptr, 0));
+		}
+
+		String name = "icinga_stmt_" + Convert::ToString(worker.PreparedStatements.size());
+
+		ProcessResult(worker, query, m_Pgsql->prepare(worker.Connection, name.CStr(), query.CStr(), values.size(), nullptr));
+
+		it = worker.PreparedStatements.emplace(query, std::move(name)).first;
+	}
+
+	return ProcessResult(worker, query, m_Pgsql->execPrepared(worker.Connection, it->second.CStr(),
+		values.size(), values.data(), nullptr, nullptr, 0));
+}
+
+/**
+ * Executes a statement whose result isn't needed. In pipeline mode it's
+ * only sent, its result is checked along with the next statement's which
+ * has to be waited for.
+ *
+ * @param query The statement
+ */
+void IdoPgsqlConnection::PipelineQuery(const String& query)
+{
+	AssertOnWorkQueue();
+
+	IdoPgsqlWorker& worker = GetWorker();
+
+	if (!worker.Pipeline) {
+		Query(query);
+		return;
+	}
+
+	Defer decreaseQueries ([this]() { DecreasePendingQueries(1); });
+
+	Log(LogDebug, "IdoPgsqlConnection")
+		<< "Pipelined query: " << query;
+
+	IncreaseQueryCount();
+
+	SendQuery(worker, query);
+
+	if (worker.PipelinedQueries.size() >= l_MaxPipelinedQueries)
+		FinishPipeline(worker);
+}
+
+/**
+ * Executes a statement with parameters whose result isn't needed,
+ * see PipelineQuery().
+ */
+void IdoPgsqlConnection::PipelinePreparedQuery(const String& query, const std::vector<String>& params)
+{
+	AssertOnWorkQueue();
+
+	IdoPgsqlWorker& worker = GetWorker();
+
+	if (!worker.Pipeline) {
+		PreparedQuery(query, params);
+		return;
+	}
+
+	Defer decreaseQueries ([this]() { DecreasePendingQueries(1); });
+
+	Log(LogDebug, "IdoPgsqlConnection")
+		<< "Pipelined prepared query: " << query;
+
+	IncreaseQueryCount();
+
+	SendPreparedQuery(worker, query, params);
+
+	if (worker.PipelinedQueries.size() >= l_MaxPipelinedQueries)
+		FinishPipeline(worker);
+}
+
+void IdoPgsqlConnection::SendQuery(IdoPgsqlWorker& worker, const String& query)
+{
+	/* PQsendQuery() isn't allowed in pipeline mode. */
+	if (!m_Pgsql->sendQueryParams(worker.Connection, query.CStr(), 0, nullptr, nullptr, nullptr, nullptr, 0))
+		ProcessResult(worker, query, nullptr);
+
+	worker.PipelinedQueries.push_back(query);
+}
+
+void IdoPgsqlConnection::SendPreparedQuery(IdoPgsqlWorker& worker, const String& query, const std::vector<String>& params)
+{
+	std::vector<const char *> values;
+	values.reserve(params.size());
+
+	for (auto& param : params)
+		values.push_back(param.CStr());
+
+	auto it = worker.PreparedStatements.find(query);
+
+	if (it == worker.PreparedStatements.end()) {
+		if (worker.PreparedStatements.size() >= l_MaxPreparedStatements) {
+			if (!m_Pgsql->sendQueryParams(worker.Connection, query.CStr(), values.size(), nullptr, values.data(), nullptr, nullptr, 0))
+				ProcessResult(worker, query, nullptr);
+
+			worker.PipelinedQueries.push_back(query);
+			return;
+		}
+
+		String name = "icinga_stmt_" + Convert::ToString(worker.PreparedStatements.size());
+
+		if (!m_Pgsql->sendPrepare(worker.Connection, name.CStr(), query.CStr(), values.size(), nullptr))
+			ProcessResult(worker, query, nullptr);
+
+		worker.PipelinedQueries.push_back(query);
+
+		it = worker.PreparedStatements.emplace(query, std::move(name)).first;
+	}
+
+	if (!m_Pgsql->sendQueryPrepared(worker.Connection, it->second.CStr(), values.size(), values.data(), nullptr, nullptr, 0))
+		ProcessResult(worker, query, nullptr);
+
+	worker.PipelinedQueries.push_back(query);
+}
+
+/**
+ * Waits for the results of the statements which have been sent in
+ * pipeline mode and checks them in order.
+ *
+ * @param worker The worker
+ * @return The result of the last statement, if it has returned rows
+ */
+IdoPgsqlResult IdoPgsqlConnection::FinishPipeline(IdoPgsqlWorker& worker)
+{
+	std::vector<String> queries;
+	std::swap(queries, worker.PipelinedQueries);
+
+	if (queries.empty())
+		return IdoPgsqlResult();
+
+	/* Also flushes the statements. As we're always in a transaction, this doesn't commit. */
+	if (!m_Pgsql->pipelineSync(worker.Connection))
+		ProcessResult(worker, queries.back(), nullptr);
+
+	IdoPgsqlResult result;
+	boost::exception_ptr error;
+
+	for (auto& query : queries) {
+		PGresult *pgresult = m_Pgsql->getResult(worker.Connection);
+
+		/* The connection is gone, the remaining results won't arrive. */
+		if (!pgresult)
+			ProcessResult(worker, query, nullptr);
+
+		/* Each statement's results are terminated by a null pointer. */
+		while (PGresult *extra = m_Pgsql->getResult(worker.Connection))
+			m_Pgsql->clear(extra);
+
+		/* The server skips the statements after a failed one. */
+		if (error) {
+			m_Pgsql->clear(pgresult);
+			continue;
+		}
+
+		try {
+			result = ProcessResult(worker, query, pgresult);
+		} catch (const std::exception&) {
+			error = boost::current_exception();
+			result.reset();
+		}
+	}
+
+	/* The synchronization point's own result. */
+	if (PGresult *sync = m_Pgsql->getResult(worker.Connection))
+		m_Pgsql->clear(sync);
+
+	if (error)
+		boost::rethrow_exception(error);
 
+	return result;
+}
+
+/**
+ * Checks the outcome of a statement.
+ *
+ * @param worker The worker which has executed the statement
+ * @param query The statement, for error messages
+ * @param result The result, may be null
+ * @return The result if the statement has returned rows
+ */
+IdoPgsqlResult IdoPgsqlConnection::ProcessResult(IdoPgsqlWorker& worker, const String& query, PGresult *result)
+{
 	if (!result) {
-		String message = m_Pgsql->errorMessage(m_Connection);
+		String message = m_Pgsql->errorMessage(worker.Connection);
 		Log(LogCritical, "IdoPgsqlConnection")
 			<< "Error \"" << message << "\" when executing query \"" << query << "\"";
 
@@ -488,7 +914,7 @@ IdoPgsqlResult IdoPgsqlConnection::Query(const String& query)
 	}
 
 	char *rowCount = m_Pgsql->cmdTuples(result);
-	m_AffectedRows = atoi(rowCount);
+	worker.AffectedRows = atoi(rowCount);
 
 	if (m_Pgsql->resultStatus(result) == PGRES_COMMAND_OK) {
 		m_Pgsql->clear(result);
@@ -512,6 +938,98 @@ IdoPgsqlResult IdoPgsqlConnection::Query(const String& query)
 	return IdoPgsqlResult(result, [this](PGresult* result) { m_Pgsql->clear(result); });
 }
 
+/**
+ * Adds a status update to the multi-row upsert of its table.
+ *
+ * @param query The query
+ * @return Whether the query has been batched
+ */
+bool IdoPgsqlConnection::BatchUpsertQuery(const DbQuery& query)
+{
+	if (!m_SupportsUpsert || DbUpsertBatcher::GetKeyColumn(query).IsEmpty())
+		return false;
+
+	std::vector<String> columns, values;
+
+	{
+		ObjectLock olock(query.Fields);
+
+		for (const Dictionary::Pair& kv : query.Fields) {
+			Value value;
+
+			if (kv.second.IsEmpty() && !kv.second.IsString())
+				continue;
+
+			if (!FieldToEscapedString(kv.first, kv.second, &value))
+				return false;
+
+			columns.push_back(kv.first);
+			values.emplace_back(value);
+		}
+	}
+
+	DecreasePendingQueries(GetWorker().UpsertBatcher.Add(query, std::move(columns), std::move(values),
+		[this](const DbUpsertBatch& batch) { ExecuteUpsertBatch(batch); }));
+
+	return true;
+}
+
+void IdoPgsqlConnection::FlushUpsertBatches()
+{
+	AssertOnWorkQueue();
+
+	GetWorker().UpsertBatcher.Flush([this](const DbUpsertBatch& batch) { ExecuteUpsertBatch(batch); });
+}
+
+void IdoPgsqlConnection::ExecuteUpsertBatch(const DbUpsertBatch& batch)
+{
+	std::ostringstream qbuf;
+	bool first = true;
+
+	qbuf << "INSERT INTO " << GetTablePrefix() << batch.Table << " (";
+
+	for (auto& column : batch.Columns) {
+		if (!first)
+			qbuf << ", ";
+
+		qbuf << column;
+		first = false;
+	}
+
+	qbuf << ") VALUES ";
+	first = true;
+
+	for (auto& row : batch.Rows) {
+		if (!first)
+			qbuf << ", ";
+
+		qbuf << row;
+		first = false;
+	}
+
+	qbuf << " ON CONFLICT (" << batch.KeyColumn << ") DO UPDATE SET ";
+	first = true;
+
+	for (auto& column : batch.Columns) {
+		if (column == batch.KeyColumn)
+			continue;
+
+		if (!first)
+			qbuf << ", ";
+
+		qbuf << column << " = EXCLUDED." << column;
+		first = false;
+	}
+
+	/* The rows have been pending queries on their own, now they're one. */
+	DecreasePendingQueries(batch.Rows.size() - 1u);
+
+	PipelineQuery(qbuf.str());
+
+	for (auto& object : batch.Objects)
+		SetStatusUpdate(object, true);
+}
+
 DbReference IdoPgsqlConnection::GetSequenceValue(const String& table, const String& column)
 {
 	AssertOnWorkQueue();
@@ -533,7 +1051,7 @@ int IdoPgsqlConnection::GetAffectedRows()
 {
 	AssertOnWorkQueue();
 
-	return m_AffectedRows;
+	return GetWorker().AffectedRows;
 }
 
 String IdoPgsqlConnection::Escape(const String& s)
@@ -545,7 +1063,7 @@ String IdoPgsqlConnection::Escape(const String& s)
 	size_t length = utf8s.GetLength();
 	auto *to = new char[utf8s.GetLength() * 2 + 1];
 
-	m_Pgsql->escapeStringConn(m_Connection, to, utf8s.CStr(), length, nullptr);
+	m_Pgsql->escapeStringConn(GetWorker().Connection, to, utf8s.CStr(), length, nullptr);
 
 	String result = String(to);
 
@@ -582,14 +1100,14 @@ void IdoPgsqlConnection::ActivateObject(const DbObject::Ptr& dbobj)
 	if (IsPaused())
 		return;
 
-	m_QueryQueue.Enqueue([this, dbobj]() { InternalActivateObject(dbobj); }, PriorityNormal);
+	GetObjectWorker(dbobj).Queue->Enqueue([this, dbobj]() { InternalActivateObject(dbobj); }, PriorityNormal);
 }
 
 void IdoPgsqlConnection::InternalActivateObject(const DbObject::Ptr& dbobj)
 {
 	AssertOnWorkQueue();
 
-	if (!GetConnected())
+	if (!IsWorkerConnected(GetWorker()))
 		return;
 
 	DbReference dbref = GetObjectID(dbobj);
@@ -607,12 +1125,12 @@ void IdoPgsqlConnection::InternalActivateObject(const DbObject::Ptr& dbobj)
 		}
 
 		IncreasePendingQueries(1);
-		Query(qbuf.str());
+		PipelineQuery(qbuf.str());
 		SetObjectID(dbobj, GetSequenceValue(GetTablePrefix() + "objects", "object_id"));
 	} else {
 		qbuf << "UPDATE " + GetTablePrefix() + "objects SET is_active = 1 WHERE object_id = " << static_cast<long>(dbref);
 		IncreasePendingQueries(1);
-		Query(qbuf.str());
+		PipelineQuery(qbuf.str());
 	}
 }
 
@@ -621,14 +1139,14 @@ void IdoPgsqlConnection::DeactivateObject(const DbObject::Ptr& dbobj)
 	if (IsPaused())
 		return;
 
-	m_QueryQueue.Enqueue([this, dbobj]() { InternalDeactivateObject(dbobj); }, PriorityNormal);
+	GetObjectWorker(dbobj).Queue->Enqueue([this, dbobj]() { InternalDeactivateObject(dbobj); }, PriorityNormal);
 }
 
 void IdoPgsqlConnection::InternalDeactivateObject(const DbObject::Ptr& dbobj)
 {
 	AssertOnWorkQueue();
 
-	if (!GetConnected())
+	if (!IsWorkerConnected(GetWorker()))
 		return;
 
 	DbReference dbref = GetObjectID(dbobj);
@@ -639,12 +1157,64 @@ void IdoPgsqlConnection::InternalDeactivateObject(const DbObject::Ptr& dbobj)
 	std::ostringstream qbuf;
 	qbuf << "UPDATE " + GetTablePrefix() + "objects SET is_active = 0 WHERE object_id = " << static_cast<long>(dbref);
 	IncreasePendingQueries(1);
-	Query(qbuf.str());
+	PipelineQuery(qbuf.str());
 
 	/* Note that we're _NOT_ clearing the db refs via SetReference/SetConfigUpdate/SetStatusUpdate
 	 * because the object is still in the database. */
 }
 
+/**
+ * Tells whether a table's statements are executed as prepared statements.
+ * These tables see most of the writes, with only a few statement shapes.
+ */
+bool IdoPgsqlConnection::IsPreparedTable(const String& table)
+{
+	for (auto preparedTable : l_PreparedTables) {
+		if (table == preparedTable)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Converts a field into a statement parameter.
+ *
+ * @param key The column
+ * @param value The value
+ * @param params The parameters of the current clause, the parameter is added to them
+ * @param offset The number of parameters before the current clause
+ * @param result The expression which refers to the parameter
+ * @return Whether all referenced objects have IDs
+ */
+bool IdoPgsqlConnection::FieldToParameter(const String& key, const Value& value, std::vector<String>& params, size_t offset, Value *result)
+{
+	Value rawvalue = DbValue::ExtractValue(value);
+	String param;
+
+	if (key == "instance_id" || key == "session_token" || rawvalue.IsObjectType<ConfigObject>() || DbValue::IsObjectInsertID(value)) {
+		Value id;
+
+		if (!FieldToEscapedString(key, value, &id))
+			return false;
+
+		param = Convert::ToString(id);
+	} else if (DbValue::IsTimestamp(value)) {
+		params.emplace_back(Convert::ToString(static_cast<long>(rawvalue)));
+		*result = "TO_TIMESTAMP($" + Convert::ToString(offset + params.size()) + ") AT TIME ZONE 'UTC'";
+		return true;
+	} else if (rawvalue.IsBoolean()) {
+		param = Convert::ToString(Convert::ToLong(rawvalue));
+	} else {
+		param = Utility::ValidateUTF8(rawvalue);
+	}
+
+	params.emplace_back(std::move(param));
+	*result = "$" + Convert::ToString(offset + params.size());
+
+	return true;
+}
+
 bool IdoPgsqlConnection::FieldToEscapedString(const String& key, const Value& value, Value *result)
 {
 	if (key == "instance_id") {
@@ -679,6 +1249,10 @@ bool IdoPgsqlConnection::FieldToEscapedString(const String& key, const Value& va
 			dbrefcol = GetObjectID(dbobjcol);
 
 			if (!dbrefcol.IsValid()) {
+				/* Only the object's own worker inserts it, the others wait for it. */
+				if (&GetObjectWorker(dbobjcol) != &GetWorker())
+					return false;
+
 				InternalActivateObject(dbobjcol);
 
 				dbrefcol = GetObjectID(dbobjcol);
@@ -724,7 +1298,7 @@ void IdoPgsqlConnection::ExecuteQuery(const DbQuery& query)
 	ASSERT(query.Category != DbCatInvalid);
 
 	IncreasePendingQueries(1);
-	m_QueryQueue.Enqueue([this, query]() { InternalExecuteQuery(query, -1); }, query.Priority, true);
+	GetObjectWorker(query.Object).Queue->Enqueue([this, query]() { InternalExecuteQuery(query, -1); }, query.Priority, true);
 }
 
 void IdoPgsqlConnection::ExecuteMultipleQueries(const std::vector<DbQuery>& queries)
@@ -736,7 +1310,7 @@ void IdoPgsqlConnection::ExecuteMultipleQueries(const std::vector<DbQuery>& quer
 		return;
 
 	IncreasePendingQueries(queries.size());
-	m_QueryQueue.Enqueue([this, queries]() { InternalExecuteMultipleQueries(queries); }, queries[0].Priority, true);
+	GetObjectWorker(queries[0].Object).Queue->Enqueue([this, queries]() { InternalExecuteMultipleQueries(queries); }, queries[0].Priority, true);
 }
 
 bool IdoPgsqlConnection::CanExecuteQuery(const DbQuery& query)
@@ -775,12 +1349,14 @@ void IdoPgsqlConnection::InternalExecuteMultipleQueries(const std::vector<DbQuer
 {
 	AssertOnWorkQueue();
 
+	IdoPgsqlWorker& worker = GetWorker();
+
 	if (IsPaused()) {
 		DecreasePendingQueries(queries.size());
 		return;
 	}
 
-	if (!GetConnected()) {
+	if (!IsWorkerConnected(worker)) {
 		DecreasePendingQueries(queries.size());
 		return;
 	}
@@ -789,7 +1365,7 @@ void IdoPgsqlConnection::InternalExecuteMultipleQueries(const std::vector<DbQuer
 		ASSERT(query.Type == DbQueryNewTransaction || query.Category != DbCatInvalid);
 
 		if (!CanExecuteQuery(query)) {
-			m_QueryQueue.Enqueue([this, queries]() { InternalExecuteMultipleQueries(queries); }, query.Priority);
+			worker.Queue->Enqueue([this, queries]() { InternalExecuteMultipleQueries(queries); }, query.Priority);
 			return;
 		}
 	}
@@ -803,12 +1379,14 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 {
 	AssertOnWorkQueue();
 
+	IdoPgsqlWorker& worker = GetWorker();
+
 	if (IsPaused()) {
 		DecreasePendingQueries(1);
 		return;
 	}
 
-	if (!GetConnected()) {
+	if (!IsWorkerConnected(worker)) {
 		DecreasePendingQueries(1);
 		return;
 	}
@@ -832,13 +1410,35 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 
 	/* check if there are missing object/insert ids and re-enqueue the query */
 	if (!CanExecuteQuery(query)) {
-		m_QueryQueue.Enqueue([this, query, typeOverride]() { InternalExecuteQuery(query, typeOverride); }, query.Priority);
+		worker.Queue->Enqueue([this, query, typeOverride]() { InternalExecuteQuery(query, typeOverride); }, query.Priority);
 		return;
 	}
 
+	if (typeOverride == -1) {
+		DbQuery changedQuery;
+
+		if (FilterStatusUpdate(query, changedQuery)) {
+			if (changedQuery.Fields)
+				InternalExecuteQuery(changedQuery, -1);
+			else
+				DecreasePendingQueries(1);
+
+			return;
+		}
+	}
+
+	if (typeOverride == -1 && GetBatchSize() > 0 && BatchUpsertQuery(query))
+		return;
+
+	worker.UpsertBatcher.Flush(query.Table, [this](const DbUpsertBatch& batch) { ExecuteUpsertBatch(batch); });
+
 	std::ostringstream qbuf, where;
 	int type;
 
+	/* Values of prepared statements are passed as parameters instead of being escaped. */
+	bool prepared = IsPreparedTable(query.Table);
+	std::vector<String> whereParams, fieldParams;
+
 	if (query.WhereCriteria) {
 		where << " WHERE ";
 
@@ -847,8 +1447,8 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 		bool first = true;
 
 		for (const Dictionary::Pair& kv : query.WhereCriteria) {
-			if (!FieldToEscapedString(kv.first, kv.second, &value)) {
-				m_QueryQueue.Enqueue([this, query]() { InternalExecuteQuery(query, -1); }, query.Priority);
+			if (prepared ? !FieldToParameter(kv.first, kv.second, whereParams, 0, &value) : !FieldToEscapedString(kv.first, kv.second, &value)) {
+				worker.Queue->Enqueue([this, query]() { InternalExecuteQuery(query, -1); }, query.Priority);
 				return;
 			}
 
@@ -886,7 +1486,11 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 		std::ostringstream qdel;
 		qdel << "DELETE FROM " << GetTablePrefix() << query.Table << where.str();
 		IncreasePendingQueries(1);
-		Query(qdel.str());
+
+		if (prepared)
+			PipelinePreparedQuery(qdel.str(), whereParams);
+		else
+			PipelineQuery(qdel.str());
 
 		type = DbQueryInsert;
 	}
@@ -913,14 +1517,17 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 
 		ObjectLock olock(query.Fields);
 
+		/* The WHERE clause's parameters come first if there is one. */
+		size_t offset = (type == DbQueryInsert) ? 0 : whereParams.size();
+
 		Value value;
 		bool first = true;
 		for (const Dictionary::Pair& kv : query.Fields) {
 			if (kv.second.IsEmpty() && !kv.second.IsString())
 				continue;
 
-			if (!FieldToEscapedString(kv.first, kv.second, &value)) {
-				m_QueryQueue.Enqueue([this, query]() { InternalExecuteQuery(query, -1); }, query.Priority);
+			if (prepared ? !FieldToParameter(kv.first, kv.second, fieldParams, offset, &value) : !FieldToEscapedString(kv.first, kv.second, &value)) {
+				worker.Queue->Enqueue([this, query]() { InternalExecuteQuery(query, -1); }, query.Priority);
 				return;
 			}
 
@@ -950,7 +1557,24 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 	if (type != DbQueryInsert)
 		qbuf << where.str();
 
-	Query(qbuf.str());
+	if (prepared) {
+		std::vector<String> params;
+
+		if (type != DbQueryInsert)
+			params = std::move(whereParams);
+
+		std::move(fieldParams.begin(), fieldParams.end(), std::back_inserter(params));
+
+		/* Only an upsert's UPDATE has to be waited for, its affected rows decide whether to INSERT. */
+		if (upsert)
+			PreparedQuery(qbuf.str(), params);
+		else
+			PipelinePreparedQuery(qbuf.str(), params);
+	} else if (upsert) {
+		Query(qbuf.str());
+	} else {
+		PipelineQuery(qbuf.str());
+	}
 
 	if (upsert && GetAffectedRows() == 0) {
 		IncreasePendingQueries(1);
@@ -959,6 +1583,10 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 		return;
 	}
 
+	/* The UPDATE has found the status row, so later status updates may only contain the changed columns. */
+	if (upsert && query.StatusUpdate && query.Object)
+		SetStatusUpdate(query.Object, true);
+
 	if (type == DbQueryInsert && query.Object) {
 		if (query.ConfigUpdate) {
 			String idField = query.IdColumn;
@@ -981,8 +1609,10 @@ void IdoPgsqlConnection::InternalExecuteQuery(const DbQuery& query, int typeOver
 
 void IdoPgsqlConnection::CleanUpExecuteQuery(const String& table, const String& time_column, double max_age)
 {
-	if (IsPaused())
+	if (IsPaused()) {
+		FinishCleanUp(table, 0, true);
 		return;
+	}
 
 	IncreasePendingQueries(1);
 	m_QueryQueue.Enqueue([this, table, time_column, max_age]() { InternalCleanUpExecuteQuery(table, time_column, max_age); }, PriorityLow, true);
@@ -994,12 +1624,37 @@ void IdoPgsqlConnection::InternalCleanUpExecuteQuery(const String& table, const
 
 	if (!GetConnected()) {
 		DecreasePendingQueries(1);
+		FinishCleanUp(table, 0, true);
+		return;
+	}
+
+	int batchSize = GetCleanupBatchSize();
+	String where = " WHERE instance_id = " + Convert::ToString(static_cast<long>(m_InstanceID)) + " AND " + time_column +
+		" < TO_TIMESTAMP(" + Convert::ToString(static_cast<long>(max_age)) + ") AT TIME ZONE 'UTC'";
+
+	if (batchSize <= 0) {
+		Query("DELETE FROM " + GetTablePrefix() + table + where);
+		FinishCleanUp(table, GetAffectedRows(), true);
 		return;
 	}
 
-	Query("DELETE FROM " + GetTablePrefix() + table + " WHERE instance_id = " +
-		Convert::ToString(static_cast<long>(m_InstanceID)) + " AND " + time_column +
-		" < TO_TIMESTAMP(" + Convert::ToString(static_cast<long>(max_age)) + ") AT TIME ZONE 'UTC'");
+	/* DELETE doesn't support LIMIT, so the chunk is selected by the rows' physical location. */
+	Query("DELETE FROM " + GetTablePrefix() + table + " WHERE ctid = ANY(ARRAY(SELECT ctid FROM " +
+		GetTablePrefix() + table + where + " LIMIT " + Convert::ToString(batchSize) + "))");
+
+	int rows = GetAffectedRows();
+	bool done = rows < batchSize;
+
+	FinishCleanUp(table, rows, done);
+
+	if (done)
+		return;
+
+	/* Commit the chunk, and let the queries which have been queued in the meantime go first. */
+	InternalNewTransaction();
+
+	IncreasePendingQueries(1);
+	m_QueryQueue.Enqueue([this, table, time_column, max_age]() { InternalCleanUpExecuteQuery(table, time_column, max_age); }, PriorityLow);
 }
 
 void IdoPgsqlConnection::FillIDCache(const DbType::Ptr& type)
@@ -1021,5 +1676,10 @@ void IdoPgsqlConnection::FillIDCache(const DbType::Ptr& type)
 
 int IdoPgsqlConnection::GetPendingQueryCount() const
 {
-	return m_QueryQueue.GetLength();
+	size_t length = 0;
+
+	for (auto& worker : m_Workers)
+		length += worker->Queue->GetLength();
+
+	return length;
 }
@@ -5,16 +5,43 @@
 
 #include "db_ido_pgsql/idopgsqlconnection-ti.hpp"
 #include "pgsql_shim/pgsqlinterface.hpp"
+#include "db_ido/dbupsertbatch.hpp"
 #include "base/array.hpp"
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
 #include "base/library.hpp"
+#include <map>
+#include <vector>
 
 namespace icinga
 {
 
 typedef std::shared_ptr<PGresult> IdoPgsqlResult;
 
+/**
+ * A database connection and the work queue thread which uses it.
+ *
+ * @ingroup ido
+ */
+struct IdoPgsqlWorker
+{
+	WorkQueue *Queue;
+	std::unique_ptr<WorkQueue> OwnQueue;
+
+	PGconn *Connection{nullptr};
+	bool Connected{false};
+	int AffectedRows{0};
+
+	/* Statement names by query text. */
+	std::map<String, String> PreparedStatements;
+
+	/* In pipeline mode, the statements whose results haven't been read yet. */
+	bool Pipeline{false};
+	std::vector<String> PipelinedQueries;
+
+	DbUpsertBatcher UpsertBatcher;
+};
+
 /**
  * An IDO pgSQL database connection.
  *
@@ -45,31 +72,55 @@ protected:
 	void FillIDCache(const DbType::Ptr& type) override;
 	void NewTransaction() override;
 
+	WorkQueue& GetObjectQueue(const DbObject::Ptr& dbobj) override;
+
 private:
 	DbReference m_InstanceID;
 
 	Library m_Library;
 	std::unique_ptr<PgsqlInterface, PgsqlInterfaceDeleter> m_Pgsql;
 
-	PGconn *m_Connection;
-	int m_AffectedRows;
+	/* The first worker uses m_QueryQueue and handles everything which isn't tied to an object. */
+	std::vector<std::unique_ptr<IdoPgsqlWorker> > m_Workers;
+
+	bool m_SupportsUpsert{false};
 
 	Timer::Ptr m_ReconnectTimer;
 	Timer::Ptr m_TxTimer;
 
 	IdoPgsqlResult Query(const String& query);
+	IdoPgsqlResult PreparedQuery(const String& query, const std::vector<String>& params);
+	IdoPgsqlResult ProcessResult(IdoPgsqlWorker& worker, const String& query, PGresult *result);
+	void PipelineQuery(const String& query);
+	void PipelinePreparedQuery(const String& query, const std::vector<String>& params);
+	void SendQuery(IdoPgsqlWorker& worker, const String& query);
+	void SendPreparedQuery(IdoPgsqlWorker& worker, const String& query, const std::vector<String>& params);
+	IdoPgsqlResult FinishPipeline(IdoPgsqlWorker& worker);
 	DbReference GetSequenceValue(const String& table, const String& column);
 	int GetAffectedRows();
 	String Escape(const String& s);
 	Dictionary::Ptr FetchRow(const IdoPgsqlResult& result, int row);
 
+	bool BatchUpsertQuery(const DbQuery& query);
+	void FlushUpsertBatches();
+	void ExecuteUpsertBatch(const DbUpsertBatch& batch);
+
+	static bool IsPreparedTable(const String& table);
+
+	bool FieldToParameter(const String& key, const Value& value, std::vector<String>& params, size_t offset, Value *result);
 	bool FieldToEscapedString(const String& key, const Value& value, Value *result);
 	void InternalActivateObject(const DbObject::Ptr& dbobj);
 	void InternalDeactivateObject(const DbObject::Ptr& dbobj);
 
+	IdoPgsqlWorker& GetWorker();
+	IdoPgsqlWorker& GetObjectWorker(const DbObject::Ptr& dbobj);
+	bool IsWorkerConnected(const IdoPgsqlWorker& worker) const;
+
 	void Disconnect();
 	void InternalNewTransaction();
+	bool Connect(IdoPgsqlWorker& worker);
 	void Reconnect();
+	void ReconnectWorker();
 
 	void AssertOnWorkQueue();
 
@@ -86,7 +137,7 @@ private:
 	void ClearTableBySession(const String& table);
 	void ClearTablesBySession();
 
-	void ExceptionHandler(boost::exception_ptr exp);
+	void ExceptionHandler(IdoPgsqlWorker& worker, boost::exception_ptr exp);
 
 	void FinishConnect(double startTime);
 };
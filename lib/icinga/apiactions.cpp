@@ -15,23 +15,26 @@
 #include "remote/filterutility.hpp"
 #include "remote/pkiutility.hpp"
 #include "remote/httputility.hpp"
+#include "base/configuration.hpp"
 #include "base/utility.hpp"
 #include "base/convert.hpp"
 #include "base/defer.hpp"
+#include "base/workqueue.hpp"
 #include "remote/actionshandler.hpp"
 #include <fstream>
 
 using namespace icinga;
 
 REGISTER_APIACTION(process_check_result, "Service;Host", &ApiActions::ProcessCheckResult);
+REGISTER_APIACTION(process_check_results, "", &ApiActions::ProcessCheckResults);
 REGISTER_APIACTION(reschedule_check, "Service;Host", &ApiActions::RescheduleCheck);
 REGISTER_APIACTION(send_custom_notification, "Service;Host", &ApiActions::SendCustomNotification);
 REGISTER_APIACTION(delay_notification, "Service;Host", &ApiActions::DelayNotification);
-REGISTER_APIACTION(acknowledge_problem, "Service;Host", &ApiActions::AcknowledgeProblem);
+REGISTER_BULK_APIACTION(acknowledge_problem, "Service;Host", &ApiActions::AcknowledgeProblem, &ApiActions::AcknowledgeProblems);
 REGISTER_APIACTION(remove_acknowledgement, "Service;Host", &ApiActions::RemoveAcknowledgement);
 REGISTER_APIACTION(add_comment, "Service;Host", &ApiActions::AddComment);
 REGISTER_APIACTION(remove_comment, "Service;Host;Comment", &ApiActions::RemoveComment);
-REGISTER_APIACTION(schedule_downtime, "Service;Host", &ApiActions::ScheduleDowntime);
+REGISTER_BULK_APIACTION(schedule_downtime, "Service;Host", &ApiActions::ScheduleDowntime, &ApiActions::ScheduleDowntimes);
 REGISTER_APIACTION(remove_downtime, "Service;Host;Downtime", &ApiActions::RemoveDowntime);
 REGISTER_APIACTION(shutdown_process, "", &ApiActions::ShutdownProcess);
 REGISTER_APIACTION(restart_process, "", &ApiActions::RestartProcess);
@@ -52,15 +55,13 @@ Dictionary::Ptr ApiActions::CreateResult(int code, const String& status,
 	return result;
 }
 
-Dictionary::Ptr ApiActions::ProcessCheckResult(const ConfigObject::Ptr& object,
-	const Dictionary::Ptr& params)
+/**
+ * Validates the parameters of a passive check result and creates it.
+ *
+ * @returns The result to respond with if the check result must not be processed, otherwise nullptr
+ */
+Dictionary::Ptr ApiActions::CreatePassiveCheckResult(const Checkable::Ptr& checkable, const Dictionary::Ptr& params, CheckResult::Ptr& cr)
 {
-	Checkable::Ptr checkable = static_pointer_cast<Checkable>(object);
-
-	if (!checkable)
-		return ApiActions::CreateResult(404,
-			"Cannot process passive check result for non-existent object.");
-
 	if (!checkable->GetEnablePassiveChecks())
 		return ApiActions::CreateResult(403, "Passive checks are disabled for object '" + checkable->GetName() + "'.");
 
@@ -93,7 +94,7 @@ Dictionary::Ptr ApiActions::ProcessCheckResult(const ConfigObject::Ptr& object,
 	if (!params->Contains("plugin_output"))
 		return ApiActions::CreateResult(400, "Parameter 'plugin_output' is required");
 
-	CheckResult::Ptr cr = new CheckResult();
+	cr = new CheckResult();
 	cr->SetOutput(HttpUtility::GetLastParameter(params, "plugin_output"));
 	cr->SetState(state);
 
@@ -122,11 +123,161 @@ Dictionary::Ptr ApiActions::ProcessCheckResult(const ConfigObject::Ptr& object,
 	if (params->Contains("ttl"))
 		cr->SetTtl(HttpUtility::GetLastParameter(params, "ttl"));
 
+	return nullptr;
+}
+
+Dictionary::Ptr ApiActions::ProcessCheckResult(const ConfigObject::Ptr& object,
+	const Dictionary::Ptr& params)
+{
+	Checkable::Ptr checkable = static_pointer_cast<Checkable>(object);
+
+	if (!checkable)
+		return ApiActions::CreateResult(404,
+			"Cannot process passive check result for non-existent object.");
+
+	CheckResult::Ptr cr;
+	Dictionary::Ptr error = CreatePassiveCheckResult(checkable, params, cr);
+
+	if (error)
+		return error;
+
 	checkable->ProcessCheckResult(cr);
 
 	return ApiActions::CreateResult(200, "Successfully processed check result for object '" + checkable->GetName() + "'.");
 }
 
+/**
+ * Processes many passive check results, each for the object named by its "target".
+ *
+ * The objects are looked up by name rather than by filters and the check results
+ * for different objects are processed concurrently. The result holds one status
+ * code per check result and the messages of the failed ones.
+ */
+Dictionary::Ptr ApiActions::ProcessCheckResults(const ConfigObject::Ptr&, const Dictionary::Ptr& params)
+{
+	Value checkResults = params ? params->Get("check_results") : Empty;
+
+	if (!checkResults.IsObjectType<Array>())
+		return ApiActions::CreateResult(400, "Parameter 'check_results' must be an array.");
+
+	Array::Ptr entries = checkResults;
+	ApiUser::Ptr user = ActionsHandler::AuthenticatedApiUser;
+
+	/* The user has the permission already, but it may be restricted to some objects. */
+	Expression *permissionFilter = nullptr;
+
+	if (user)
+		FilterUtility::CheckPermission(user, "actions/process-check-results", &permissionFilter);
+
+	std::unique_ptr<Expression> permissionFilterOwner (permissionFilter);
+	Namespace::Ptr permissionFrameNS = new Namespace();
+	ScriptFrame permissionFrame(false, permissionFrameNS);
+
+	struct PendingCheckResult
+	{
+		size_t Index;
+		Checkable::Ptr Object;
+		CheckResult::Ptr Result;
+	};
+
+	std::vector<Dictionary::Ptr> results (entries->GetLength());
+	std::vector<std::vector<PendingCheckResult>> lanes (std::max(Configuration::Concurrency, 1));
+	std::hash<Checkable*> hasher;
+
+	{
+		ObjectLock olock(entries);
+		size_t i = 0;
+
+		for (const Value& item : entries) {
+			size_t index = i++;
+
+			if (!item.IsObjectType<Dictionary>()) {
+				results[index] = ApiActions::CreateResult(400, "Check result must be an object.");
+				continue;
+			}
+
+			Dictionary::Ptr entry = item;
+			String target = entry->Get("target");
+			String type = entry->Get("type");
+
+			if (type.IsEmpty())
+				type = target.Contains("!") ? "Service" : "Host";
+
+			Checkable::Ptr checkable;
+
+			if (type == "Host")
+				checkable = Host::GetByName(target);
+			else if (type == "Service")
+				checkable = Service::GetByName(target);
+			else {
+				results[index] = ApiActions::CreateResult(400, "Invalid type '" + type + "'.");
+				continue;
+			}
+
+			if (!checkable || !FilterUtility::EvaluateFilter(permissionFrame, permissionFilter, checkable)) {
+				results[index] = ApiActions::CreateResult(404, "Object '" + target + "' of type '" + type + "' does not exist.");
+				continue;
+			}
+
+			CheckResult::Ptr cr;
+
+			try {
+				results[index] = CreatePassiveCheckResult(checkable, entry, cr);
+			} catch (const std::exception& ex) {
+				results[index] = ApiActions::CreateResult(400, DiagnosticInformation(ex, false));
+			}
+
+			/* Keep the check results for one object in order. */
+			if (cr)
+				lanes[hasher(checkable.get()) % lanes.size()].push_back({ index, checkable, cr });
+		}
+	}
+
+	WorkQueue queue;
+	queue.SetName("ApiActions::ProcessCheckResults");
+
+	queue.ParallelFor(lanes, [&results](const std::vector<PendingCheckResult>& lane) {
+		for (auto& pending : lane) {
+			try {
+				pending.Object->ProcessCheckResult(pending.Result);
+			} catch (const std::exception& ex) {
+				results[pending.Index] = ApiActions::CreateResult(500, DiagnosticInformation(ex, false));
+			}
+		}
+	});
+
+	queue.Join();
+
+	ArrayData codes, errors;
+	size_t processed = 0;
+
+	codes.reserve(results.size());
+
+	for (size_t i = 0; i < results.size(); i++) {
+		if (!results[i]) {
+			codes.emplace_back(200);
+			processed++;
+			continue;
+		}
+
+		int code = results[i]->Get("code");
+
+		codes.emplace_back(code);
+
+		errors.emplace_back(new Dictionary({
+			{ "index", i },
+			{ "code", code },
+			{ "status", results[i]->Get("status") }
+		}));
+	}
+
+	return ApiActions::CreateResult(200, "Processed " + Convert::ToString(processed) + " of "
+		+ Convert::ToString(results.size()) + " check results.", new Dictionary({
+			{ "codes", new Array(std::move(codes)) },
+			{ "errors", new Array(std::move(errors)) }
+		}));
+}
+
 Dictionary::Ptr ApiActions::RescheduleCheck(const ConfigObject::Ptr& object,
 	const Dictionary::Ptr& params)
 {
@@ -249,6 +400,91 @@ Dictionary::Ptr ApiActions::AcknowledgeProblem(const ConfigObject::Ptr& object,
 	return ApiActions::CreateResult(200, "Successfully acknowledged problem for object '" + checkable->GetName() + "'.");
 }
 
+/**
+ * Like AcknowledgeProblem(), but creates the comments of all acknowledgements as one batch.
+ */
+std::vector<Value> ApiActions::AcknowledgeProblems(const std::vector<ConfigObject::Ptr>& objects,
+	const Dictionary::Ptr& params)
+{
+	/* Let AcknowledgeProblem() reject invalid requests for each object as usual. */
+	if (!params->Contains("author") || !params->Contains("comment"))
+		return {};
+
+	AcknowledgementType sticky = AcknowledgementNormal;
+	bool notify = false;
+	bool persistent = false;
+	double timestamp = 0.0;
+
+	if (params->Contains("sticky") && HttpUtility::GetLastParameter(params, "sticky"))
+		sticky = AcknowledgementSticky;
+	if (params->Contains("notify"))
+		notify = HttpUtility::GetLastParameter(params, "notify");
+	if (params->Contains("persistent"))
+		persistent = HttpUtility::GetLastParameter(params, "persistent");
+	if (params->Contains("expiry")) {
+		timestamp = HttpUtility::GetLastParameter(params, "expiry");
+
+		if (timestamp <= Utility::GetTime())
+			return {};
+	}
+
+	String author = HttpUtility::GetLastParameter(params, "author");
+	String comment = HttpUtility::GetLastParameter(params, "comment");
+
+	std::vector<Value> results (objects.size());
+	std::vector<Checkable::Ptr> checkables;
+	std::vector<size_t> indexes;
+
+	for (size_t i = 0; i < objects.size(); i++) {
+		Checkable::Ptr checkable = dynamic_pointer_cast<Checkable>(objects[i]);
+
+		if (!checkable)
+			return {};
+
+		ObjectLock oLock (checkable);
+
+		Host::Ptr host;
+		Service::Ptr service;
+		tie(host, service) = GetHostService(checkable);
+
+		if (!service) {
+			if (host->GetState() == HostUp) {
+				results[i] = ApiActions::CreateResult(409, "Host " + checkable->GetName() + " is UP.");
+				continue;
+			}
+		} else {
+			if (service->GetState() == ServiceOK) {
+				results[i] = ApiActions::CreateResult(409, "Service " + checkable->GetName() + " is OK.");
+				continue;
+			}
+		}
+
+		if (checkable->IsAcknowledged()) {
+			results[i] = ApiActions::CreateResult(409, (service ? "Service " : "Host ") + checkable->GetName() + " is already acknowledged.");
+			continue;
+		}
+
+		checkables.emplace_back(checkable);
+		indexes.emplace_back(i);
+	}
+
+	if (!checkables.empty())
+		Comment::AddComments(checkables, CommentAcknowledgement, author, comment, persistent, timestamp);
+
+	for (size_t i = 0; i < checkables.size(); i++) {
+		auto& checkable (checkables[i]);
+
+		{
+			ObjectLock oLock (checkable);
+			checkable->AcknowledgeProblem(author, comment, sticky, notify, persistent, Utility::GetTime(), timestamp);
+		}
+
+		results[indexes[i]] = ApiActions::CreateResult(200, "Successfully acknowledged problem for object '" + checkable->GetName() + "'.");
+	}
+
+	return results;
+}
+
 Dictionary::Ptr ApiActions::RemoveAcknowledgement(const ConfigObject::Ptr& object,
 	const Dictionary::Ptr& params)
 {
@@ -484,6 +720,105 @@ Dictionary::Ptr ApiActions::ScheduleDowntime(const ConfigObject::Ptr& object,
 		downtimeName + "' for object '" + checkable->GetName() + "'.", additional);
 }
 
+/**
+ * Like ScheduleDowntime(), but creates all downtimes (including the ones
+ * of the services if all_services is set) as one batch.
+ *
+ * Child downtimes are left to ScheduleDowntime() as they depend on their parents.
+ */
+std::vector<Value> ApiActions::ScheduleDowntimes(const std::vector<ConfigObject::Ptr>& objects,
+	const Dictionary::Ptr& params)
+{
+	/* Let ScheduleDowntime() reject invalid requests for each object as usual. */
+	if (!params->Contains("start_time") || !params->Contains("end_time") ||
+		!params->Contains("author") || !params->Contains("comment") || params->Contains("child_options")) {
+		return {};
+	}
+
+	bool fixed = true;
+	if (params->Contains("fixed"))
+		fixed = HttpUtility::GetLastParameter(params, "fixed");
+
+	if (!fixed && !params->Contains("duration"))
+		return {};
+
+	double duration = 0.0;
+	if (params->Contains("duration"))
+		duration = HttpUtility::GetLastParameter(params, "duration");
+
+	String triggerName;
+	if (params->Contains("trigger_name"))
+		triggerName = HttpUtility::GetLastParameter(params, "trigger_name");
+
+	String author = HttpUtility::GetLastParameter(params, "author");
+	String comment = HttpUtility::GetLastParameter(params, "comment");
+	double startTime = HttpUtility::GetLastParameter(params, "start_time");
+	double endTime = HttpUtility::GetLastParameter(params, "end_time");
+
+	bool allServices = false;
+
+	if (params->Contains("all_services"))
+		allServices = HttpUtility::GetLastParameter(params, "all_services");
+
+	/* The checkables to schedule downtimes for and the objects they belong to. */
+	std::vector<Checkable::Ptr> checkables;
+	std::vector<size_t> owners;
+
+	for (size_t i = 0; i < objects.size(); i++) {
+		Checkable::Ptr checkable = dynamic_pointer_cast<Checkable>(objects[i]);
+
+		if (!checkable)
+			return {};
+
+		checkables.emplace_back(checkable);
+		owners.emplace_back(i);
+
+		Host::Ptr host = dynamic_pointer_cast<Host>(checkable);
+
+		if (allServices && host) {
+			for (const Service::Ptr& hostService : host->GetServices()) {
+				checkables.emplace_back(hostService);
+				owners.emplace_back(i);
+			}
+		}
+	}
+
+	std::vector<Downtime::Ptr> downtimes = Downtime::AddDowntimes(checkables, author, comment, startTime, endTime,
+		fixed, triggerName, duration);
+
+	std::vector<Dictionary::Ptr> additionals (objects.size());
+	std::vector<ArrayData> serviceDowntimes (objects.size());
+
+	for (size_t i = 0; i < downtimes.size(); i++) {
+		Dictionary::Ptr info = new Dictionary({
+			{ "name", downtimes[i]->GetName() },
+			{ "legacy_id", downtimes[i]->GetLegacyId() }
+		});
+
+		/* The first downtime of each object is its own one, the others are the ones of its services. */
+		if (additionals[owners[i]])
+			serviceDowntimes[owners[i]].push_back(std::move(info));
+		else
+			additionals[owners[i]] = std::move(info);
+	}
+
+	std::vector<Value> results;
+
+	results.reserve(objects.size());
+
+	for (size_t i = 0; i < objects.size(); i++) {
+		auto& additional (additionals[i]);
+
+		if (allServices && dynamic_pointer_cast<Host>(objects[i]))
+			additional->Set("service_downtimes", new Array(std::move(serviceDowntimes[i])));
+
+		results.emplace_back(ApiActions::CreateResult(200, "Successfully scheduled downtime '" +
+			additional->Get("name") + "' for object '" + objects[i]->GetName() + "'.", additional));
+	}
+
+	return results;
+}
+
 Dictionary::Ptr ApiActions::RemoveDowntime(const ConfigObject::Ptr& object,
 	const Dictionary::Ptr& params)
 {
@@ -4,9 +4,11 @@
 #define APIACTIONS_H
 
 #include "icinga/i2-icinga.hpp"
+#include "icinga/checkable.hpp"
 #include "base/configobject.hpp"
 #include "base/dictionary.hpp"
 #include "remote/apiuser.hpp"
+#include <vector>
 
 namespace icinga
 {
@@ -18,14 +20,17 @@ class ApiActions
 {
 public:
 	static Dictionary::Ptr ProcessCheckResult(const ConfigObject::Ptr& object, const Dictionary::Ptr& params);
+	static Dictionary::Ptr ProcessCheckResults(const ConfigObject::Ptr& object, const Dictionary::Ptr& params);
 	static Dictionary::Ptr RescheduleCheck(const ConfigObject::Ptr& object, const Dictionary::Ptr& params);
 	static Dictionary::Ptr SendCustomNotification(const ConfigObject::Ptr& object, const Dictionary::Ptr& params);
 	static Dictionary::Ptr DelayNotification(const ConfigObject::Ptr& object, const Dictionary::Ptr& params);
 	static Dictionary::Ptr AcknowledgeProblem(const ConfigObject::Ptr& object, const Dictionary::Ptr& params);
+	static std::vector<Value> AcknowledgeProblems(const std::vector<ConfigObject::Ptr>& objects, const Dictionary::Ptr& params);
 	static Dictionary::Ptr RemoveAcknowledgement(const ConfigObject::Ptr& object, const Dictionary::Ptr& params);
 	static Dictionary::Ptr AddComment(const ConfigObject::Ptr& object, const Dictionary::Ptr& params);
 	static Dictionary::Ptr RemoveComment(const ConfigObject::Ptr& object, const Dictionary::Ptr& params);
 	static Dictionary::Ptr ScheduleDowntime(const ConfigObject::Ptr& object, const Dictionary::Ptr& params);
+	static std::vector<Value> ScheduleDowntimes(const std::vector<ConfigObject::Ptr>& objects, const Dictionary::Ptr& params);
 	static Dictionary::Ptr RemoveDowntime(const ConfigObject::Ptr& object, const Dictionary::Ptr& params);
 	static Dictionary::Ptr ShutdownProcess(const ConfigObject::Ptr& object, const Dictionary::Ptr& params);
 	static Dictionary::Ptr RestartProcess(const ConfigObject::Ptr& object, const Dictionary::Ptr& params);
@@ -35,6 +40,7 @@ public:
 private:
 	static Dictionary::Ptr CreateResult(int code, const String& status, const Dictionary::Ptr& additional = nullptr);
 	static Value GetSingleObjectByNameUsingPermissions(const String& type, const String& value, const ApiUser::Ptr& user);
+	static Dictionary::Ptr CreatePassiveCheckResult(const Checkable::Ptr& checkable, const Dictionary::Ptr& params, CheckResult::Ptr& cr);
 };
 
 }
@@ -14,10 +14,16 @@
 #include "base/convert.hpp"
 #include "base/utility.hpp"
 #include "base/context.hpp"
+#include "base/defer.hpp"
+#include "base/metrics.hpp"
+#include "base/tracing.hpp"
+#include <deque>
+#include <unordered_map>
 
 using namespace icinga;
 
 boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, const MessageOrigin::Ptr&)> Checkable::OnNewCheckResult;
+boost::signals2::signal<void (const Checkable::CheckResultBatch&)> Checkable::OnNewCheckResults;
 boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, StateType, const MessageOrigin::Ptr&)> Checkable::OnStateChange;
 boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, std::set<Checkable::Ptr>, const MessageOrigin::Ptr&)> Checkable::OnReachabilityChanged;
 boost::signals2::signal<void (const Checkable::Ptr&, NotificationType, const CheckResult::Ptr&, const String&, const String&, const MessageOrigin::Ptr&)> Checkable::OnNotificationsRequested;
@@ -29,6 +35,48 @@ std::mutex Checkable::m_StatsMutex;
 int Checkable::m_PendingChecks = 0;
 std::condition_variable Checkable::m_PendingChecksCV;
 
+static std::mutex l_CheckResultBatchMutex;
+static Checkable::CheckResultBatch l_CheckResultBatch;
+
+/* Reachability changes are passed to at most this many children of a checkable at once. */
+static const size_t l_ReachabilityBatchSize = 1000;
+
+/**
+ * A reachability change which hasn't reached all children of a checkable yet.
+ */
+struct PendingReachabilityPropagation
+{
+	CheckResult::Ptr Result;
+	MessageOrigin::Ptr Origin;
+	bool Recovery;
+	uint_fast64_t Version;
+
+	/* The children to propagate to and how many of them are done, once started. */
+	std::shared_ptr<const std::vector<Checkable::Ptr> > Children;
+	size_t Offset;
+};
+
+static std::mutex l_ReachabilityMutex;
+static std::unordered_map<Checkable::Ptr, PendingReachabilityPropagation> l_PendingReachability;
+static std::deque<Checkable::Ptr> l_ReachabilityQueue;
+static bool l_ReachabilityPropagating = false;
+static uint_fast64_t l_ReachabilityDeduplicated = 0;
+
+static Histogram l_CheckExecutionTime ("icinga_check_execution_seconds", "Execution time of check results");
+static Histogram l_CheckResultProcessingTime ("icinga_check_result_processing_seconds", "Time spent processing check results");
+
+static Gauge l_ReachabilityPending ("icinga_reachability_propagations_pending",
+	"Checkables whose reachability changes haven't reached all children yet", "", []() {
+	std::unique_lock<std::mutex> lock (l_ReachabilityMutex);
+	return l_PendingReachability.size();
+});
+
+static Gauge l_ReachabilityDeduplicatedGauge ("icinga_reachability_propagations_deduplicated",
+	"Reachability changes merged into a pending one of the same checkable", "", []() {
+	std::unique_lock<std::mutex> lock (l_ReachabilityMutex);
+	return l_ReachabilityDeduplicated;
+});
+
 CheckCommand::Ptr Checkable::GetCheckCommand() const
 {
 	return dynamic_pointer_cast<CheckCommand>(NavigateCheckCommandRaw());
@@ -49,6 +97,38 @@ long Checkable::GetSchedulingOffset()
 	return m_SchedulingOffset;
 }
 
+/**
+ * Returns the execution time of the last active check spread over the check interval.
+ */
+double Checkable::GetAuthorityLoad() const
+{
+	if (!GetEnableActiveChecks())
+		return 0;
+
+	/* The command endpoint runs the check, not us. */
+	Endpoint::Ptr endpoint = GetCommandEndpoint();
+
+	if (endpoint && endpoint != Endpoint::GetLocalEndpoint())
+		return 0;
+
+	CheckResult::Ptr cr = GetLastCheckResult();
+
+	if (!cr || !cr->GetActive())
+		return 0;
+
+	double interval;
+
+	if (GetStateType() == StateTypeSoft)
+		interval = GetRetryInterval();
+	else
+		interval = GetCheckInterval();
+
+	if (interval <= 0)
+		return 0;
+
+	return cr->CalculateExecutionTime() / interval;
+}
+
 void Checkable::UpdateNextCheck(const MessageOrigin::Ptr& origin)
 {
 	double interval;
@@ -68,6 +148,21 @@ void Checkable::UpdateNextCheck(const MessageOrigin::Ptr& origin)
 		adj = std::min(0.5 + fmod(GetSchedulingOffset(), interval * 5) / 100.0, adj);
 
 	double nextCheck = now - adj + interval;
+	double phase = GetSchedulingPhase();
+
+	/* The checker assigns each checkable a phase within its check interval so
+	 * that the checks are spread evenly, snap to it (retries aren't smoothed).
+	 */
+	if (interval > 1 && interval == GetCheckInterval() && phase >= 0 && phase < interval) {
+		double next = now + interval;
+		double delta = fmod(phase - fmod(next, interval) + interval, interval);
+
+		if (delta > interval / 2)
+			delta -= interval;
+
+		nextCheck = next + delta;
+	}
+
 	double lastCheck = GetLastCheck();
 
 	Log(LogDebug, "Checkable")
@@ -94,6 +189,166 @@ double Checkable::GetLastCheck() const
 	return schedule_end;
 }
 
+/**
+ * Returns the last check_result_history check results, the oldest first.
+ */
+Array::Ptr Checkable::GetRecentCheckResults() const
+{
+	auto history (std::atomic_load(&m_CheckResultHistory));
+
+	if (!history)
+		return new Array();
+
+	return history->ToArray();
+}
+
+void Checkable::AddToCheckResultHistory(const CheckResult::Ptr& cr)
+{
+	int size = GetCheckResultHistory();
+	auto history (std::atomic_load(&m_CheckResultHistory));
+
+	if (size <= 0) {
+		if (history)
+			std::atomic_store(&m_CheckResultHistory, std::shared_ptr<CheckResultHistory>());
+
+		return;
+	}
+
+	if (!history) {
+		history = std::make_shared<CheckResultHistory>();
+		std::atomic_store(&m_CheckResultHistory, history);
+	}
+
+	int limit = IcingaApplication::GetInstance()->GetCheckResultHistoryLimit();
+
+	history->Add(cr, size, limit > 0 ? limit : 0);
+}
+
+/**
+ * Delivers all check results which have been processed since the last call
+ * to the OnNewCheckResults handlers.
+ */
+void Checkable::FlushCheckResultBatch(const Timer * const&)
+{
+	CheckResultBatch batch;
+
+	{
+		std::unique_lock<std::mutex> lock(l_CheckResultBatchMutex);
+		std::swap(batch, l_CheckResultBatch);
+	}
+
+	if (!batch.empty())
+		OnNewCheckResults(batch);
+}
+
+/**
+ * Passes a reachability change on to the checkable's children in the background,
+ * so that a checkable with lots of them doesn't stall the check result processing.
+ * A change for a checkable whose previous one hasn't reached all children yet
+ * replaces that one, e.g. during an outage the children only get the latest state.
+ */
+void Checkable::QueueReachabilityPropagation(const Checkable::Ptr& parent, const CheckResult::Ptr& cr,
+	const MessageOrigin::Ptr& origin, bool recovery)
+{
+	std::unique_lock<std::mutex> lock (l_ReachabilityMutex);
+
+	auto it (l_PendingReachability.find(parent));
+
+	if (it == l_PendingReachability.end()) {
+		l_PendingReachability.emplace(parent, PendingReachabilityPropagation{ cr, origin, recovery, 0, nullptr, 0 });
+		l_ReachabilityQueue.emplace_back(parent);
+	} else {
+		auto& pending (it->second);
+
+		/* The children which got the previous change need this one, too. */
+		pending.Result = cr;
+		pending.Origin = origin;
+		pending.Recovery = pending.Recovery || recovery;
+		pending.Version++;
+		pending.Children = nullptr;
+		pending.Offset = 0;
+
+		l_ReachabilityDeduplicated++;
+	}
+
+	if (!l_ReachabilityPropagating) {
+		l_ReachabilityPropagating = true;
+		Utility::QueueAsyncCallback(&Checkable::PropagateReachability);
+	}
+}
+
+/**
+ * Passes the oldest pending reachability change on to the next batch of children
+ * and queues itself again as long as there are any changes left. Checkables
+ * with pending changes take turns, one batch each.
+ */
+void Checkable::PropagateReachability()
+{
+	Checkable::Ptr parent;
+	PendingReachabilityPropagation pending;
+
+	{
+		std::unique_lock<std::mutex> lock (l_ReachabilityMutex);
+
+		if (l_ReachabilityQueue.empty()) {
+			l_ReachabilityPropagating = false;
+			return;
+		}
+
+		parent = std::move(l_ReachabilityQueue.front());
+		l_ReachabilityQueue.pop_front();
+		pending = l_PendingReachability.at(parent);
+	}
+
+	if (!pending.Children) {
+		std::set<Checkable::Ptr> children = parent->GetChildren();
+		pending.Children = std::make_shared<std::vector<Checkable::Ptr> >(children.begin(), children.end());
+	}
+
+	auto& children (*pending.Children);
+	size_t end = std::min(pending.Offset + l_ReachabilityBatchSize, children.size());
+	std::set<Checkable::Ptr> batch (children.begin() + pending.Offset, children.begin() + end);
+
+	if (!batch.empty())
+		OnReachabilityChanged(parent, pending.Result, batch, pending.Origin);
+
+	/* Check the children of a recovered checkable soon. */
+	if (pending.Recovery && parent->IsStateOK(pending.Result->GetState())) {
+		double now = Utility::GetTime();
+
+		for (auto& child : batch) {
+			if (child->GetProblem() && child->GetEnableActiveChecks()) {
+				auto nextCheck (now + Utility::Random() % 60);
+
+				ObjectLock oLock (child);
+
+				if (nextCheck < child->GetNextCheck()) {
+					child->SetNextCheck(nextCheck);
+				}
+			}
+		}
+	}
+
+	{
+		std::unique_lock<std::mutex> lock (l_ReachabilityMutex);
+
+		auto& current (l_PendingReachability.at(parent));
+
+		/* Otherwise a newer change has replaced this one and starts over. */
+		if (current.Version == pending.Version) {
+			current.Children = pending.Children;
+			current.Offset = end;
+		}
+
+		if (current.Children && current.Offset >= current.Children->size())
+			l_PendingReachability.erase(parent);
+		else
+			l_ReachabilityQueue.emplace_back(parent);
+	}
+
+	Utility::QueueAsyncCallback(&Checkable::PropagateReachability);
+}
+
 void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrigin::Ptr& origin)
 {
 	{
@@ -104,6 +359,21 @@ void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrig
 	if (!cr)
 		return;
 
+	auto processingStart (Histogram::Clock::now());
+
+	Defer observeProcessingTime ([processingStart]() {
+		l_CheckResultProcessingTime.ObserveSince(processingStart);
+	});
+
+	Span span ("Checkable::ProcessCheckResult", cr->GetTraceContext());
+
+	if (span.IsRecording()) {
+		span.SetAttribute("icinga.checkable", GetName());
+
+		/* Further spans, also on other nodes, are children of this one. */
+		cr->SetTraceContext(span.GetContext());
+	}
+
 	double now = Utility::GetTime();
 
 	if (cr->GetScheduleStart() == 0)
@@ -118,6 +388,8 @@ void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrig
 	if (cr->GetExecutionEnd() == 0)
 		cr->SetExecutionEnd(now);
 
+	l_CheckExecutionTime.Observe(cr->CalculateExecutionTime());
+
 	Endpoint::Ptr command_endpoint = GetCommandEndpoint();
 
 	if (cr->GetCheckSource().IsEmpty()) {
@@ -136,7 +408,7 @@ void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrig
 		if (listener) {
 			/* send message back to its origin */
 			Dictionary::Ptr message = ClusterEvents::MakeCheckResultMessage(this, cr);
-			listener->SyncSendMessage(command_endpoint, message);
+			listener->SendBatchedMessage(command_endpoint, message);
 		}
 
 		return;
@@ -202,7 +474,20 @@ void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrig
 
 	long attempt = 1;
 
-	std::set<Checkable::Ptr> children = GetChildren();
+	/* The vars of the previous result also describe this one if it doesn't change anything but the
+	 * timestamps, the output and the perfdata. Neither the reachability of the children nor
+	 * notifications, acknowledgements, event handlers or flapping have to be looked at then.
+	 */
+	Dictionary::Ptr unchangedVars;
+
+	if (old_cr && cr->GetState() == old_state && IsStateOK(old_state) && old_stateType == StateTypeHard
+		&& !GetVolatile() && !GetEnableFlapping()) {
+		Dictionary::Ptr vars = old_cr->GetVarsAfter();
+
+		if (vars && vars->Get("state") == old_state && vars->Get("state_type") == StateTypeHard
+			&& vars->Get("attempt") == 1 && vars->Get("reachable") == reachable && old_attempt == 1)
+			unchangedVars = vars;
+	}
 
 	if (IsStateOK(cr->GetState())) {
 		SetStateType(StateTypeHard); // NOT-OK -> HARD OK
@@ -212,10 +497,6 @@ void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrig
 
 		ResetNotificationNumbers();
 		SaveLastState(ServiceOK, cr->GetExecutionEnd());
-
-		/* update reachability for child objects in OK state */
-		if (!children.empty())
-			OnReachabilityChanged(this, cr, children, origin);
 	} else {
 		/* OK -> NOT-OK change, first SOFT state. Reset attempt counter. */
 		if (IsStateOK(old_state)) {
@@ -238,25 +519,11 @@ void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrig
 		if (!IsStateOK(cr->GetState())) {
 			SaveLastState(cr->GetState(), cr->GetExecutionEnd());
 		}
-
-		/* update reachability for child objects in NOT-OK state */
-		if (!children.empty())
-			OnReachabilityChanged(this, cr, children, origin);
 	}
 
-	if (recovery) {
-		for (auto& child : children) {
-			if (child->GetProblem() && child->GetEnableActiveChecks()) {
-				auto nextCheck (now + Utility::Random() % 60);
-
-				ObjectLock oLock (child);
-
-				if (nextCheck < child->GetNextCheck()) {
-					child->SetNextCheck(nextCheck);
-				}
-			}
-		}
-	}
+	/* update reachability for child objects */
+	if (!unchangedVars && HasChildren())
+		QueueReachabilityPropagation(this, cr, origin, recovery);
 
 	if (!reachable)
 		SetLastStateUnreachable(cr->GetExecutionEnd());
@@ -352,17 +619,24 @@ void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrig
 	if (remove_acknowledgement_comments)
 		RemoveCommentsByType(CommentAcknowledgement);
 
-	Dictionary::Ptr vars_after = new Dictionary({
-		{ "state", new_state },
-		{ "state_type", GetStateType() },
-		{ "attempt", GetCheckAttempt() },
-		{ "reachable", reachable }
-	});
+	if (unchangedVars) {
+		cr->SetVarsBefore(unchangedVars);
+		cr->SetVarsAfter(unchangedVars);
+	} else {
+		Dictionary::Ptr vars_after = new Dictionary({
+			{ "state", new_state },
+			{ "state_type", GetStateType() },
+			{ "attempt", GetCheckAttempt() },
+			{ "reachable", reachable }
+		});
 
-	if (old_cr)
-		cr->SetVarsBefore(old_cr->GetVarsAfter());
+		if (old_cr)
+			cr->SetVarsBefore(old_cr->GetVarsAfter());
+
+		cr->SetVarsAfter(vars_after);
+	}
 
-	cr->SetVarsAfter(vars_after);
+	AddToCheckResultHistory(cr);
 
 	olock.Lock();
 
@@ -406,6 +680,8 @@ void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrig
 		SetNextCheck(Utility::GetTime() + offset, false, origin);
 	}
 
+	PublishStateRecord();
+
 	olock.Unlock();
 
 #ifdef I2_DEBUG /* I2_DEBUG */
@@ -420,6 +696,12 @@ void Checkable::ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrig
 
 	OnNewCheckResult(this, cr, origin);
 
+	/* Features which opt in to batching get all check results of a tick at once. */
+	if (!OnNewCheckResults.empty()) {
+		std::unique_lock<std::mutex> lock(l_CheckResultBatchMutex);
+		l_CheckResultBatch.push_back({ this, cr, origin });
+	}
+
 	/* signal status updates to for example db_ido */
 	OnStateChanged(this);
 
@@ -529,6 +811,8 @@ void Checkable::ExecuteCheck()
 {
 	CONTEXT("Executing check for object '" + GetName() + "'");
 
+	Span span ("Checkable::ExecuteCheck");
+
 	/* keep track of scheduling info in case the check type doesn't provide its own information */
 	double scheduled_start = GetNextCheck();
 	double before_check = Utility::GetTime();
@@ -561,6 +845,7 @@ void Checkable::ExecuteCheck()
 
 	cr->SetScheduleStart(scheduled_start);
 	cr->SetExecutionStart(before_check);
+	cr->SetTraceContext(span.GetContext());
 
 	Endpoint::Ptr endpoint = GetCommandEndpoint();
 	bool local = !endpoint || endpoint == Endpoint::GetLocalEndpoint();
@@ -602,7 +887,7 @@ void Checkable::ExecuteCheck()
 			ApiListener::Ptr listener = ApiListener::GetInstance();
 
 			if (listener)
-				listener->SyncSendMessage(endpoint, message);
+				listener->SendBatchedMessage(endpoint, message);
 
 			/* Re-schedule the check so we don't run it again until after we've received
 			 * a check result from the remote instance. The check will be re-scheduled
@@ -38,18 +38,26 @@ void Checkable::RemoveCommentsByType(int type, const String& removedBy)
 
 std::set<Comment::Ptr> Checkable::GetComments() const
 {
-	std::unique_lock<std::mutex> lock(m_CommentMutex);
-	return m_Comments;
+	std::unique_lock<std::mutex> lock(m_RelationsMutex);
+
+	if (!m_Relations)
+		return std::set<Comment::Ptr>();
+
+	return std::set<Comment::Ptr>(m_Relations->Comments.begin(), m_Relations->Comments.end());
 }
 
 void Checkable::RegisterComment(const Comment::Ptr& comment)
 {
-	std::unique_lock<std::mutex> lock(m_CommentMutex);
-	m_Comments.insert(comment);
+	std::unique_lock<std::mutex> lock(m_RelationsMutex);
+	AddRelation(GetRelations().Comments, comment);
 }
 
 void Checkable::UnregisterComment(const Comment::Ptr& comment)
 {
-	std::unique_lock<std::mutex> lock(m_CommentMutex);
-	m_Comments.erase(comment);
+	std::unique_lock<std::mutex> lock(m_RelationsMutex);
+
+	if (m_Relations) {
+		RemoveRelation(m_Relations->Comments, comment);
+		ReleaseRelationsIfEmpty();
+	}
 }
@@ -1,48 +1,219 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "icinga/service.hpp"
+#include "icinga/cib.hpp"
 #include "icinga/dependency.hpp"
 #include "base/logger.hpp"
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace icinga;
 
+std::atomic<uint_fast64_t> Checkable::m_ReachabilityGeneration (0);
+
 void Checkable::AddDependency(const Dependency::Ptr& dep)
 {
-	std::unique_lock<std::mutex> lock(m_DependencyMutex);
-	m_Dependencies.insert(dep);
+	{
+		std::unique_lock<std::mutex> lock(m_RelationsMutex);
+		AddRelation(GetRelations().Dependencies, dep);
+	}
+
+	InvalidateReachability();
 }
 
 void Checkable::RemoveDependency(const Dependency::Ptr& dep)
 {
-	std::unique_lock<std::mutex> lock(m_DependencyMutex);
-	m_Dependencies.erase(dep);
+	{
+		std::unique_lock<std::mutex> lock(m_RelationsMutex);
+
+		if (m_Relations) {
+			RemoveRelation(m_Relations->Dependencies, dep);
+			ReleaseRelationsIfEmpty();
+		}
+	}
+
+	InvalidateReachability();
 }
 
 std::vector<Dependency::Ptr> Checkable::GetDependencies() const
 {
-	std::unique_lock<std::mutex> lock(m_DependencyMutex);
-	return std::vector<Dependency::Ptr>(m_Dependencies.begin(), m_Dependencies.end());
+	std::unique_lock<std::mutex> lock(m_RelationsMutex);
+
+	if (!m_Relations)
+		return std::vector<Dependency::Ptr>();
+
+	return m_Relations->Dependencies;
 }
 
 void Checkable::AddReverseDependency(const Dependency::Ptr& dep)
 {
-	std::unique_lock<std::mutex> lock(m_DependencyMutex);
-	m_ReverseDependencies.insert(dep);
+	{
+		std::unique_lock<std::mutex> lock(m_RelationsMutex);
+		AddRelation(GetRelations().ReverseDependencies, dep);
+	}
+
+	InvalidateAllChildren({ this });
 }
 
 void Checkable::RemoveReverseDependency(const Dependency::Ptr& dep)
 {
-	std::unique_lock<std::mutex> lock(m_DependencyMutex);
-	m_ReverseDependencies.erase(dep);
+	{
+		std::unique_lock<std::mutex> lock(m_RelationsMutex);
+
+		if (m_Relations) {
+			RemoveRelation(m_Relations->ReverseDependencies, dep);
+			ReleaseRelationsIfEmpty();
+		}
+	}
+
+	InvalidateAllChildren({ this });
 }
 
 std::vector<Dependency::Ptr> Checkable::GetReverseDependencies() const
 {
-	std::unique_lock<std::mutex> lock(m_DependencyMutex);
-	return std::vector<Dependency::Ptr>(m_ReverseDependencies.begin(), m_ReverseDependencies.end());
+	std::unique_lock<std::mutex> lock(m_RelationsMutex);
+
+	if (!m_Relations)
+		return std::vector<Dependency::Ptr>();
+
+	return m_Relations->ReverseDependencies;
+}
+
+bool Checkable::HasChildren() const
+{
+	std::unique_lock<std::mutex> lock(m_RelationsMutex);
+
+	return m_Relations && !m_Relations->ReverseDependencies.empty();
+}
+
+/**
+ * Adds the dependencies to their children and parents, like AddDependency()
+ * and AddReverseDependency() would one by one. Each checkable is locked and
+ * invalidated only once, and a parent with lots of children doesn't search
+ * its list of reverse dependencies for each of them.
+ *
+ * @param deps Dependencies whose child and parent have been resolved
+ */
+void Checkable::AddDependencies(const std::vector<Dependency::Ptr>& deps)
+{
+	std::unordered_map<Checkable *, std::vector<Dependency::Ptr> > byChild, byParent;
+
+	for (auto& dep : deps) {
+		byChild[dep->GetChild().get()].push_back(dep);
+		byParent[dep->GetParent().get()].push_back(dep);
+	}
+
+	auto addAll ([](std::vector<Dependency::Ptr>& relations, std::vector<Dependency::Ptr>& added) {
+		std::unordered_set<Dependency *> present;
+
+		for (auto& dep : relations)
+			present.insert(dep.get());
+
+		relations.reserve(relations.size() + added.size());
+
+		for (auto& dep : added) {
+			if (present.insert(dep.get()).second)
+				relations.emplace_back(std::move(dep));
+		}
+	});
+
+	std::vector<Checkable::Ptr> children, parents;
+
+	children.reserve(byChild.size());
+	parents.reserve(byParent.size());
+
+	for (auto& kv : byChild) {
+		{
+			std::unique_lock<std::mutex> lock(kv.first->m_RelationsMutex);
+			addAll(kv.first->GetRelations().Dependencies, kv.second);
+		}
+
+		children.emplace_back(kv.first);
+	}
+
+	for (auto& kv : byParent) {
+		{
+			std::unique_lock<std::mutex> lock(kv.first->m_RelationsMutex);
+			addAll(kv.first->GetRelations().ReverseDependencies, kv.second);
+		}
+
+		parents.emplace_back(kv.first);
+	}
+
+	InvalidateReachability(std::move(children));
+	InvalidateAllChildren(parents);
 }
 
+/**
+ * Checks whether the checkable's parents and dependencies allow it to be
+ * reached. The result is cached until InvalidateReachability() is called
+ * for the checkable or one of its parents, or a dependency's time period
+ * changes.
+ */
 bool Checkable::IsReachable(DependencyType dt, Dependency::Ptr *failedDependency, int rstack) const
+{
+	double validUntil = std::numeric_limits<double>::infinity();
+	bool cacheable = true;
+
+	return IsReachableInternal(dt, failedDependency, rstack, validUntil, cacheable);
+}
+
+bool Checkable::IsReachableInternal(DependencyType dt, Dependency::Ptr *failedDependency, int rstack,
+	double& validUntil, bool& cacheable) const
+{
+	double now = Utility::GetTime();
+	uint_fast64_t generation = m_ReachabilityGeneration.load();
+	uint_fast64_t version;
+
+	{
+		std::unique_lock<std::mutex> lock(m_ReachabilityMutex);
+		auto& entry (m_ReachabilityCache[dt]);
+
+		if (entry.Valid && entry.Generation == generation && now < entry.ValidUntil) {
+			if (failedDependency)
+				*failedDependency = entry.FailedDependency;
+
+			validUntil = std::min(validUntil, entry.ValidUntil);
+			return entry.Reachable;
+		}
+
+		version = m_ReachabilityVersion;
+	}
+
+	double localValidUntil = std::numeric_limits<double>::infinity();
+	bool localCacheable = true;
+	Dependency::Ptr failed;
+
+	bool reachable = CalculateReachability(dt, &failed, rstack, localValidUntil, localCacheable);
+
+	/* Don't cache results which a concurrent invalidation has already outdated. */
+	if (localCacheable && localValidUntil > now) {
+		std::unique_lock<std::mutex> lock(m_ReachabilityMutex);
+
+		if (m_ReachabilityVersion == version) {
+			auto& entry (m_ReachabilityCache[dt]);
+
+			entry.Valid = true;
+			entry.Reachable = reachable;
+			entry.FailedDependency = failed;
+			entry.ValidUntil = localValidUntil;
+			entry.Generation = generation;
+		}
+	}
+
+	if (failedDependency)
+		*failedDependency = failed;
+
+	validUntil = std::min(validUntil, localValidUntil);
+	cacheable = cacheable && localCacheable;
+
+	return reachable;
+}
+
+bool Checkable::CalculateReachability(DependencyType dt, Dependency::Ptr *failedDependency, int rstack,
+	double& validUntil, bool& cacheable) const
 {
 	/* Anything greater than 256 causes recursion bus errors. */
 	int limit = 256;
@@ -51,11 +222,13 @@ bool Checkable::IsReachable(DependencyType dt, Dependency::Ptr *failedDependency
 		Log(LogWarning, "Checkable")
 			<< "Too many nested dependencies (>" << limit << ") for checkable '" << GetName() << "': Dependency failed.";
 
+		/* Most likely a loop, don't cache anything along it. */
+		cacheable = false;
 		return false;
 	}
 
 	for (const Checkable::Ptr& checkable : GetParents()) {
-		if (!checkable->IsReachable(dt, failedDependency, rstack + 1))
+		if (!checkable->IsReachableInternal(dt, failedDependency, rstack + 1, validUntil, cacheable))
 			return false;
 	}
 
@@ -78,7 +251,7 @@ bool Checkable::IsReachable(DependencyType dt, Dependency::Ptr *failedDependency
 	int countFailed = 0;
 
 	for (const Dependency::Ptr& dep : deps) {
-		if (!dep->IsAvailable(dt)) {
+		if (!dep->IsAvailable(dt, &validUntil)) {
 			countFailed++;
 
 			if (failedDependency)
@@ -99,6 +272,84 @@ bool Checkable::IsReachable(DependencyType dt, Dependency::Ptr *failedDependency
 	return true;
 }
 
+/**
+ * Drops the cached reachability of the checkable and everything that depends
+ * on it: its children and, for hosts, their services. Must be called after
+ * anything IsReachable() looks at has changed.
+ */
+void Checkable::InvalidateReachability()
+{
+	InvalidateReachability(std::vector<Checkable::Ptr>{ this });
+}
+
+/**
+ * Like InvalidateReachability(), but visits the checkables they have in
+ * common only once.
+ */
+void Checkable::InvalidateReachability(std::vector<Checkable::Ptr> checkables)
+{
+	std::set<Checkable *> visited;
+	std::vector<Checkable::Ptr> pending (std::move(checkables));
+	std::vector<Checkable::Ptr> invalidated;
+
+	while (!pending.empty()) {
+		Checkable::Ptr checkable = std::move(pending.back());
+		pending.pop_back();
+
+		if (!visited.insert(checkable.get()).second)
+			continue;
+
+		invalidated.emplace_back(checkable);
+
+		{
+			std::unique_lock<std::mutex> lock(checkable->m_ReachabilityMutex);
+
+			checkable->m_ReachabilityVersion++;
+
+			for (auto& entry : checkable->m_ReachabilityCache)
+				entry.Valid = false;
+		}
+
+		for (const Checkable::Ptr& child : checkable->GetChildren())
+			pending.emplace_back(child);
+
+		Host::Ptr host = dynamic_pointer_cast<Host>(checkable);
+
+		if (host) {
+			for (const Service::Ptr& service : host->GetServices())
+				pending.emplace_back(service);
+		}
+	}
+
+	/* Their reachability counts towards the status statistics. */
+	for (auto& checkable : invalidated)
+		CIB::UpdateCheckableStatistics(checkable);
+}
+
+/**
+ * Invalidates the cached reachability of everything depending on us if any
+ * of our attributes which IsReachable() looks at has changed.
+ */
+void Checkable::UpdateReachabilityInputs()
+{
+	int state = GetStateRaw();
+	int stateType = GetStateType();
+	bool checked = GetLastCheckResult() != nullptr;
+
+	{
+		std::unique_lock<std::mutex> lock(m_ReachabilityMutex);
+
+		if (state == m_ReachabilityState && stateType == m_ReachabilityStateType && checked == m_ReachabilityChecked)
+			return;
+
+		m_ReachabilityState = state;
+		m_ReachabilityStateType = stateType;
+		m_ReachabilityChecked = checked;
+	}
+
+	InvalidateReachability();
+}
+
 std::set<Checkable::Ptr> Checkable::GetParents() const
 {
 	std::set<Checkable::Ptr> parents;
@@ -127,32 +378,74 @@ std::set<Checkable::Ptr> Checkable::GetChildren() const
 	return parents;
 }
 
-std::set<Checkable::Ptr> Checkable::GetAllChildren() const
+/**
+ * Returns the checkable's children, their children and so on, each of them
+ * once. The result is kept until a dependency below the checkable changes.
+ */
+std::vector<Checkable::Ptr> Checkable::GetAllChildren() const
 {
-	std::set<Checkable::Ptr> children = GetChildren();
+	uint_fast64_t version;
+
+	{
+		std::unique_lock<std::mutex> lock(m_RelationsMutex);
 
-	GetAllChildrenInternal(children, 0);
+		if (m_AllChildren)
+			return *m_AllChildren;
 
-	return children;
+		version = m_AllChildrenVersion;
+	}
+
+	auto children (std::make_shared<std::vector<Checkable::Ptr> >());
+	std::unordered_set<const Checkable *> visited { this };
+
+	for (size_t i = 0;; i++) {
+		const Checkable *checkable = i == 0 ? this : (*children)[i - 1u].get();
+
+		for (const Checkable::Ptr& child : checkable->GetChildren()) {
+			if (visited.insert(child.get()).second)
+				children->emplace_back(child);
+		}
+
+		if (i == children->size())
+			break;
+	}
+
+	/* Don't keep a result which a concurrent invalidation has already outdated. */
+	{
+		std::unique_lock<std::mutex> lock(m_RelationsMutex);
+
+		if (m_AllChildrenVersion == version)
+			m_AllChildren = children;
+	}
+
+	return *children;
 }
 
-void Checkable::GetAllChildrenInternal(std::set<Checkable::Ptr>& children, int level) const
+/**
+ * Drops what GetAllChildren() has kept for the checkables and all of their
+ * parents, their parents and so on. Must be called after a checkable's
+ * children have changed.
+ */
+void Checkable::InvalidateAllChildren(const std::vector<Checkable::Ptr>& checkables)
 {
-	if (level > 32)
-		return;
+	std::unordered_set<Checkable *> visited;
+	std::vector<Checkable::Ptr> pending (checkables);
+
+	while (!pending.empty()) {
+		Checkable::Ptr checkable = std::move(pending.back());
+		pending.pop_back();
 
-	std::set<Checkable::Ptr> localChildren;
+		if (!visited.insert(checkable.get()).second)
+			continue;
 
-	for (const Checkable::Ptr& checkable : children) {
-		std::set<Checkable::Ptr> cChildren = checkable->GetChildren();
+		{
+			std::unique_lock<std::mutex> lock(checkable->m_RelationsMutex);
 
-		if (!cChildren.empty()) {
-			GetAllChildrenInternal(cChildren, level + 1);
-			localChildren.insert(cChildren.begin(), cChildren.end());
+			checkable->m_AllChildrenVersion++;
+			checkable->m_AllChildren.reset();
 		}
 
-		localChildren.insert(checkable);
+		for (const Checkable::Ptr& parent : checkable->GetParents())
+			pending.emplace_back(parent);
 	}
-
-	children.insert(localChildren.begin(), localChildren.end());
 }
@@ -47,18 +47,26 @@ int Checkable::GetDowntimeDepth() const
 
 std::set<Downtime::Ptr> Checkable::GetDowntimes() const
 {
-	std::unique_lock<std::mutex> lock(m_DowntimeMutex);
-	return m_Downtimes;
+	std::unique_lock<std::mutex> lock(m_RelationsMutex);
+
+	if (!m_Relations)
+		return std::set<Downtime::Ptr>();
+
+	return std::set<Downtime::Ptr>(m_Relations->Downtimes.begin(), m_Relations->Downtimes.end());
 }
 
 void Checkable::RegisterDowntime(const Downtime::Ptr& downtime)
 {
-	std::unique_lock<std::mutex> lock(m_DowntimeMutex);
-	m_Downtimes.insert(downtime);
+	std::unique_lock<std::mutex> lock(m_RelationsMutex);
+	AddRelation(GetRelations().Downtimes, downtime);
 }
 
 void Checkable::UnregisterDowntime(const Downtime::Ptr& downtime)
 {
-	std::unique_lock<std::mutex> lock(m_DowntimeMutex);
-	m_Downtimes.erase(downtime);
+	std::unique_lock<std::mutex> lock(m_RelationsMutex);
+
+	if (m_Relations) {
+		RemoveRelation(m_Relations->Downtimes, downtime);
+		ReleaseRelationsIfEmpty();
+	}
 }
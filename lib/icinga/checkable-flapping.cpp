@@ -3,43 +3,42 @@
 #include "icinga/checkable.hpp"
 #include "icinga/icingaapplication.hpp"
 #include "base/utility.hpp"
+#include <bitset>
 
 using namespace icinga;
 
-template<typename T>
-struct Bitset
-{
-public:
-	Bitset(T value)
-		: m_Data(value)
-	{ }
-
-	void Modify(int index, bool bit)
-	{
-		if (bit)
-			m_Data |= 1 << index;
-		else
-			m_Data &= ~(1 << index);
-	}
-
-	bool Get(int index) const
-	{
-		return m_Data & (1 << index);
-	}
+/* The flapping buffer holds the last 20 state changes in its lower bits
+ * and the index of the oldest one above them.
+ */
+static const int l_FlappingWindow = 20;
+static const unsigned long l_FlappingWindowMask = (1ul << l_FlappingWindow) - 1;
 
-	T GetValue() const
-	{
-		return m_Data;
-	}
+/**
+ * Returns the sum of the positions (0 = oldest) of the set bits.
+ */
+static inline unsigned long GetFlappingPositionSum(unsigned long window)
+{
+	typedef std::bitset<l_FlappingWindow> Window;
 
-private:
-	T m_Data{0};
-};
+	return Window(window & 0xAAAAA).count() + 2 * Window(window & 0xCCCCC).count()
+		+ 4 * Window(window & 0xF0F0).count() + 8 * Window(window & 0xFF00).count()
+		+ 16 * Window(window & 0xF0000).count();
+}
 
 void Checkable::UpdateFlappingStatus(ServiceState newState)
 {
-	Bitset<unsigned long> stateChangeBuf = GetFlappingBuffer();
-	int oldestIndex = GetFlappingIndex();
+	if (!GetEnableFlapping() || !IcingaApplication::GetInstance()->GetEnableFlapping())
+		return;
+
+	unsigned long buffer = GetFlappingBuffer();
+	unsigned long stateChangeBuf = buffer & l_FlappingWindowMask;
+	int oldestIndex = buffer >> l_FlappingWindow;
+
+	/* The index used to be a separate attribute. */
+	if (GetFlappingIndex()) {
+		oldestIndex = GetFlappingIndex() % l_FlappingWindow;
+		SetFlappingIndex(0);
+	}
 
 	ServiceState lastState = GetFlappingLastState();
 	bool stateChange = false;
@@ -49,21 +48,23 @@ void Checkable::UpdateFlappingStatus(ServiceState newState)
 	/* Only count as state change if no state filter is set or the new state isn't filtered out */
 	if (stateFilter == -1 || !(ServiceStateToFlappingFilter(newState) & stateFilter)) {
 		stateChange = newState != lastState;
-		SetFlappingLastState(newState);
-	}
 
-	stateChangeBuf.Modify(oldestIndex, stateChange);
-	oldestIndex = (oldestIndex + 1) % 20;
+		if (stateChange)
+			SetFlappingLastState(newState);
+	}
 
-	double stateChanges = 0;
+	if (stateChange)
+		stateChangeBuf |= 1ul << oldestIndex;
+	else
+		stateChangeBuf &= ~(1ul << oldestIndex);
 
-	/* Iterate over our state array and compute a weighted total */
-	for (int i = 0; i < 20; i++) {
-		if (stateChangeBuf.Get((oldestIndex + i) % 20))
-			stateChanges += 0.8 + (0.02 * i);
-	}
+	oldestIndex = (oldestIndex + 1) % l_FlappingWindow;
 
-	double flappingValue = 100.0 * stateChanges / 20.0;
+	/* Rotate the oldest state change to bit 0. Each one weighs 0.8 + 0.02 * its position,
+	 * the flapping value is 100 * sum / 20, i.e. 4 per state change + 0.1 per position.
+	 */
+	unsigned long window = ((stateChangeBuf >> oldestIndex) | (stateChangeBuf << (l_FlappingWindow - oldestIndex))) & l_FlappingWindowMask;
+	double flappingValue = (40 * std::bitset<l_FlappingWindow>(window).count() + GetFlappingPositionSum(window)) / 10.0;
 
 	bool flapping;
 
@@ -72,18 +73,17 @@ void Checkable::UpdateFlappingStatus(ServiceState newState)
 	else
 		flapping = flappingValue > GetFlappingThresholdHigh();
 
-	SetFlappingBuffer(stateChangeBuf.GetValue());
-	SetFlappingIndex(oldestIndex);
-	SetFlappingCurrent(flappingValue);
+	SetFlappingBuffer(stateChangeBuf | static_cast<unsigned long>(oldestIndex) << l_FlappingWindow);
+
+	if (flappingValue != GetFlappingCurrent())
+		SetFlappingCurrent(flappingValue);
 
 	if (flapping != GetFlapping()) {
 		SetFlapping(flapping, true);
 
 		double ee = GetLastCheckResult()->GetExecutionEnd();
 
-		if (GetEnableFlapping() && IcingaApplication::GetInstance()->GetEnableFlapping()) {
-			OnFlappingChange(this, ee);
-		}
+		OnFlappingChange(this, ee);
 
 		SetFlappingLastChange(ee);
 	}
@@ -26,7 +26,10 @@ void Checkable::ResetNotificationNumbers()
 {
 	for (const Notification::Ptr& notification : GetNotifications()) {
 		ObjectLock olock(notification);
-		notification->ResetNotificationNumber();
+
+		/* Most check results are OK ones following OK ones, don't bother the IDO and the cluster with them. */
+		if (notification->GetNotificationNumber() != 0)
+			notification->ResetNotificationNumber();
 	}
 }
 
@@ -74,14 +77,7 @@ void Checkable::SendNotifications(NotificationType type, const CheckResult::Ptr&
 						Log(LogNotice, "Notification")
 							<< "Notification '" << notification->GetName() << "': there are some stashed notifications. Stashing notification to preserve order.";
 
-						stashedNotifications->Add(new Dictionary({
-							{"type", type},
-							{"cr", cr},
-							{"force", force},
-							{"reminder", false},
-							{"author", author},
-							{"text", text}
-						}));
+						notification->StashNotification(type, cr, force, false, author, text);
 					} else {
 						notification->BeginExecuteNotification(type, cr, force, false, author, text);
 					}
@@ -99,34 +95,35 @@ void Checkable::SendNotifications(NotificationType type, const CheckResult::Ptr&
 			Log(LogNotice, "Notification")
 				<< "Notification '" << notification->GetName() << "': object authority hasn't been updated, yet. Stashing notification.";
 
-			notification->GetStashedNotifications()->Add(new Dictionary({
-				{"type", type},
-				{"cr", cr},
-				{"force", force},
-				{"reminder", false},
-				{"author", author},
-				{"text", text}
-			}));
+			notification->StashNotification(type, cr, force, false, author, text);
 		}
 	}
 }
 
 std::set<Notification::Ptr> Checkable::GetNotifications() const
 {
-	std::unique_lock<std::mutex> lock(m_NotificationMutex);
-	return m_Notifications;
+	std::unique_lock<std::mutex> lock(m_RelationsMutex);
+
+	if (!m_Relations)
+		return std::set<Notification::Ptr>();
+
+	return std::set<Notification::Ptr>(m_Relations->Notifications.begin(), m_Relations->Notifications.end());
 }
 
 void Checkable::RegisterNotification(const Notification::Ptr& notification)
 {
-	std::unique_lock<std::mutex> lock(m_NotificationMutex);
-	m_Notifications.insert(notification);
+	std::unique_lock<std::mutex> lock(m_RelationsMutex);
+	AddRelation(GetRelations().Notifications, notification);
 }
 
 void Checkable::UnregisterNotification(const Notification::Ptr& notification)
 {
-	std::unique_lock<std::mutex> lock(m_NotificationMutex);
-	m_Notifications.erase(notification);
+	std::unique_lock<std::mutex> lock(m_RelationsMutex);
+
+	if (m_Relations) {
+		RemoveRelation(m_Relations->Notifications, notification);
+		ReleaseRelationsIfEmpty();
+	}
 }
 
 static void FireSuppressedNotifications(Checkable* checkable)
@@ -202,12 +199,12 @@ static void FireSuppressedNotifications(Checkable* checkable)
  */
 void Checkable::FireSuppressedNotifications(const Timer * const&)
 {
-	for (auto& host : ConfigType::GetObjectsByType<Host>()) {
-		::FireSuppressedNotifications(host.get());
+	for (Host *host : ConfigType::GetObjectsViewByType<Host>()) {
+		::FireSuppressedNotifications(host);
 	}
 
-	for (auto& service : ConfigType::GetObjectsByType<Service>()) {
-		::FireSuppressedNotifications(service.get());
+	for (Service *service : ConfigType::GetObjectsViewByType<Service>()) {
+		::FireSuppressedNotifications(service);
 	}
 }
 
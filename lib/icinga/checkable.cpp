@@ -4,6 +4,7 @@
 #include "icinga/checkable-ti.cpp"
 #include "icinga/host.hpp"
 #include "icinga/service.hpp"
+#include "icinga/cib.hpp"
 #include "base/objectlock.hpp"
 #include "base/utility.hpp"
 #include "base/exception.hpp"
@@ -30,6 +31,7 @@ boost::signals2::signal<void (const Checkable::Ptr&, double)> Checkable::OnFlapp
 
 static Timer::Ptr l_CheckablesFireSuppressedNotifications;
 static Timer::Ptr l_CleanDeadlinedExecutions;
+static Timer::Ptr l_CheckResultBatchTimer;
 
 thread_local std::function<void(const Value& commandLine, const ProcessResult&)> Checkable::ExecuteCommandProcessFinishedHandler;
 
@@ -41,6 +43,28 @@ void Checkable::StaticInitialize()
 	Downtime::OnDowntimeTriggered.connect([](const Downtime::Ptr& downtime) { Checkable::NotifyFlexibleDowntimeStart(downtime); });
 	/* fixed/flexible downtime end */
 	Downtime::OnDowntimeRemoved.connect([](const Downtime::Ptr& downtime) { Checkable::NotifyDowntimeEnd(downtime); });
+
+	/* cached reachability */
+	auto stateChanged ([](const Checkable::Ptr& checkable, const Value&) { checkable->UpdateReachabilityInputs(); });
+
+	Checkable::OnStateRawChanged.connect(stateChanged);
+	Checkable::OnStateTypeChanged.connect(stateChanged);
+	Checkable::OnLastCheckResultChanged.connect(stateChanged);
+
+	TimePeriod::OnSegmentsChanged.connect([](const TimePeriod::Ptr&, const Value&) { m_ReachabilityGeneration.fetch_add(1); });
+
+	auto invalidateChild ([](const Dependency::Ptr& dependency, const Value&) {
+		Checkable::Ptr child = dependency->GetChild();
+
+		if (child)
+			child->InvalidateReachability();
+	});
+
+	Dependency::OnStateFilterChanged.connect(invalidateChild);
+	Dependency::OnIgnoreSoftStatesChanged.connect(invalidateChild);
+	Dependency::OnDisableChecksChanged.connect(invalidateChild);
+	Dependency::OnDisableNotificationsChanged.connect(invalidateChild);
+	Dependency::OnPeriodRawChanged.connect(invalidateChild);
 }
 
 Checkable::Checkable()
@@ -48,6 +72,29 @@ Checkable::Checkable()
 	SetSchedulingOffset(Utility::Random());
 }
 
+/**
+ * Returns the checkable's relations, allocating them if necessary.
+ * The caller must hold m_RelationsMutex.
+ */
+Checkable::Relations& Checkable::GetRelations()
+{
+	if (!m_Relations)
+		m_Relations.reset(new Relations());
+
+	return *m_Relations;
+}
+
+/**
+ * Frees the checkable's relations once nothing is left in them.
+ * The caller must hold m_RelationsMutex.
+ */
+void Checkable::ReleaseRelationsIfEmpty()
+{
+	if (m_Relations && m_Relations->Downtimes.empty() && m_Relations->Comments.empty() && m_Relations->Notifications.empty()
+		&& m_Relations->Dependencies.empty() && m_Relations->ReverseDependencies.empty())
+		m_Relations.reset();
+}
+
 void Checkable::OnConfigLoaded()
 {
 	ObjectImpl<Checkable>::OnConfigLoaded();
@@ -98,6 +145,8 @@ void Checkable::Start(bool runtimeCreated)
 
 	ObjectImpl<Checkable>::Start(runtimeCreated);
 
+	CIB::AddCheckableStatistics(this);
+
 	static boost::once_flag once = BOOST_ONCE_INIT;
 
 	boost::call_once(once, []() {
@@ -109,10 +158,23 @@ void Checkable::Start(bool runtimeCreated)
 		l_CleanDeadlinedExecutions = new Timer();
 		l_CleanDeadlinedExecutions->SetInterval(300);
 		l_CleanDeadlinedExecutions->OnTimerExpired.connect(&Checkable::CleanDeadlinedExecutions);
+		l_CleanDeadlinedExecutions->SetSchedulerPolicy(BackgroundScheduler);
 		l_CleanDeadlinedExecutions->Start();
+
+		l_CheckResultBatchTimer = new Timer();
+		l_CheckResultBatchTimer->SetInterval(0.25);
+		l_CheckResultBatchTimer->OnTimerExpired.connect(&Checkable::FlushCheckResultBatch);
+		l_CheckResultBatchTimer->Start();
 	});
 }
 
+void Checkable::Stop(bool runtimeRemoved)
+{
+	CIB::RemoveCheckableStatistics(this);
+
+	ObjectImpl<Checkable>::Stop(runtimeRemoved);
+}
+
 void Checkable::AddGroup(const String& name)
 {
 	std::unique_lock<std::mutex> lock(m_CheckableMutex);
@@ -150,6 +212,57 @@ AcknowledgementType Checkable::GetAcknowledgement()
 	return avalue;
 }
 
+/**
+ * Like Checkable::GetAcknowledgement(), but doesn't clear an expired
+ * acknowledgement.
+ */
+AcknowledgementType CheckableStateRecord::GetAcknowledgement() const
+{
+	if (Acknowledgement != AcknowledgementNone && AcknowledgementExpiry != 0 && AcknowledgementExpiry < Utility::GetTime())
+		return AcknowledgementNone;
+
+	return Acknowledgement;
+}
+
+/**
+ * @return The most recently published state, doesn't lock the checkable once one was published
+ */
+CheckableStateRecord::ConstPtr Checkable::GetStateRecord() const
+{
+	auto record (std::atomic_load(&m_StateRecord));
+
+	if (record)
+		return record;
+
+	ObjectLock olock(this);
+	return const_cast<Checkable *>(this)->PublishStateRecord();
+}
+
+/**
+ * Publishes the current state for Checkable::GetStateRecord(). The caller must hold the object lock.
+ */
+CheckableStateRecord::ConstPtr Checkable::PublishStateRecord()
+{
+	auto record (std::make_shared<CheckableStateRecord>());
+
+	record->LastCheckResult = GetLastCheckResult();
+	record->State = GetStateRaw();
+	record->LastHardState = GetLastHardStateRaw();
+	record->CurrentStateType = GetStateType();
+	record->CheckAttempt = GetCheckAttempt();
+	record->LastStateChange = GetLastStateChange();
+	record->LastHardStateChange = GetLastHardStateChange();
+	record->Flapping = IsFlapping();
+	record->FlappingCurrent = GetFlappingCurrent();
+	record->Acknowledgement = static_cast<AcknowledgementType>(GetAcknowledgementRaw());
+	record->AcknowledgementExpiry = GetAcknowledgementExpiry();
+
+	CheckableStateRecord::ConstPtr result (std::move(record));
+	std::atomic_store(&m_StateRecord, result);
+
+	return result;
+}
+
 bool Checkable::IsAcknowledged() const
 {
 	return const_cast<Checkable *>(this)->GetAcknowledgement() != AcknowledgementNone;
@@ -157,8 +270,13 @@ bool Checkable::IsAcknowledged() const
 
 void Checkable::AcknowledgeProblem(const String& author, const String& comment, AcknowledgementType type, bool notify, bool persistent, double changeTime, double expiry, const MessageOrigin::Ptr& origin)
 {
-	SetAcknowledgementRaw(type);
-	SetAcknowledgementExpiry(expiry);
+	{
+		ObjectLock olock(this);
+
+		SetAcknowledgementRaw(type);
+		SetAcknowledgementExpiry(expiry);
+		PublishStateRecord();
+	}
 
 	if (notify && !IsPaused())
 		OnNotificationsRequested(this, NotificationAcknowledgement, GetLastCheckResult(), author, comment, nullptr);
@@ -179,6 +297,7 @@ void Checkable::ClearAcknowledgement(const String& removedBy, double changeTime,
 
 	SetAcknowledgementRaw(AcknowledgementNone);
 	SetAcknowledgementExpiry(0);
+	PublishStateRecord();
 
 	Log(LogInformation, "Checkable")
 		<< "Acknowledgement cleared for checkable '" << GetName() << "'.";
@@ -290,13 +409,21 @@ void Checkable::ValidateMaxCheckAttempts(const Lazy<int>& lvalue, const Validati
 		BOOST_THROW_EXCEPTION(ValidationError(this, { "max_check_attempts" }, "Value must be greater than 0."));
 }
 
+void Checkable::ValidateCheckResultHistory(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<Checkable>::ValidateCheckResultHistory(lvalue, utils);
+
+	if (lvalue() < 0 || lvalue() > 1000)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "check_result_history" }, "Value must be between 0 and 1000."));
+}
+
 void Checkable::CleanDeadlinedExecutions(const Timer * const&)
 {
 	double now = Utility::GetTime();
 	Dictionary::Ptr executions;
 	Dictionary::Ptr execution;
 
-	for (auto& host : ConfigType::GetObjectsByType<Host>()) {
+	for (Host *host : ConfigType::GetObjectsViewByType<Host>()) {
 		executions = host->GetExecutions();
 		if (executions) {
 			for (const String& key : executions->GetKeys()) {
@@ -308,7 +435,7 @@ void Checkable::CleanDeadlinedExecutions(const Timer * const&)
 		}
 	}
 
-	for (auto& service : ConfigType::GetObjectsByType<Service>()) {
+	for (Service *service : ConfigType::GetObjectsViewByType<Service>()) {
 		executions = service->GetExecutions();
 		if (executions) {
 			for (const String& key : executions->GetKeys()) {
@@ -12,11 +12,16 @@
 #include "icinga/notification.hpp"
 #include "icinga/comment.hpp"
 #include "icinga/downtime.hpp"
+#include "icinga/checkresulthistory.hpp"
 #include "remote/endpoint.hpp"
 #include "remote/messageorigin.hpp"
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
 #include <cstdint>
 #include <functional>
+#include <memory>
+#include <vector>
 
 namespace icinga
 {
@@ -57,6 +62,34 @@ class CheckCommand;
 class EventCommand;
 class Dependency;
 
+/**
+ * An immutable copy of a checkable's check state. Checkables publish a new
+ * one whenever a check result or an acknowledgement changes that state, so
+ * bulk readers get a consistent view without locking hot checkables.
+ *
+ * States are raw, i.e. hosts have to pass them through Host::CalculateState().
+ *
+ * @ingroup icinga
+ */
+struct CheckableStateRecord
+{
+	typedef std::shared_ptr<const CheckableStateRecord> ConstPtr;
+
+	CheckResult::Ptr LastCheckResult;
+	ServiceState State;
+	ServiceState LastHardState;
+	StateType CurrentStateType;
+	int CheckAttempt;
+	double LastStateChange;
+	double LastHardStateChange;
+	bool Flapping;
+	double FlappingCurrent;
+	AcknowledgementType Acknowledgement;
+	double AcknowledgementExpiry;
+
+	AcknowledgementType GetAcknowledgement() const;
+};
+
 /**
  * An Icinga service.
  *
@@ -75,14 +108,18 @@ public:
 
 	std::set<Checkable::Ptr> GetParents() const;
 	std::set<Checkable::Ptr> GetChildren() const;
-	std::set<Checkable::Ptr> GetAllChildren() const;
+	std::vector<Checkable::Ptr> GetAllChildren() const;
 
 	void AddGroup(const String& name);
 
 	bool IsReachable(DependencyType dt = DependencyState, intrusive_ptr<Dependency> *failedDependency = nullptr, int rstack = 0) const;
+	void InvalidateReachability();
+	static void InvalidateReachability(std::vector<Checkable::Ptr> checkables);
 
 	AcknowledgementType GetAcknowledgement();
 
+	CheckableStateRecord::ConstPtr GetStateRecord() const;
+
 	void AcknowledgeProblem(const String& author, const String& comment, AcknowledgementType type, bool notify = true, bool persistent = false, double changeTime = Utility::GetTime(), double expiry = 0, const MessageOrigin::Ptr& origin = nullptr);
 	void ClearAcknowledgement(const String& removedBy, double changeTime = Utility::GetTime(), const MessageOrigin::Ptr& origin = nullptr);
 
@@ -100,22 +137,40 @@ public:
 
 	void UpdateNextCheck(const MessageOrigin::Ptr& origin = nullptr);
 
+	double GetAuthorityLoad() const override;
+
 	bool HasBeenChecked() const;
 	virtual bool IsStateOK(ServiceState state) const = 0;
 
 	double GetLastCheck() const final;
+	Array::Ptr GetRecentCheckResults() const final;
 
 	virtual void SaveLastState(ServiceState state, double timestamp) = 0;
 
 	static void UpdateStatistics(const CheckResult::Ptr& cr, CheckableType type);
 
+	static void FlushCheckResultBatch(const Timer * const& = nullptr);
+
 	void ExecuteRemoteCheck(const Dictionary::Ptr& resolvedMacros = nullptr);
 	void ExecuteCheck();
 	void ProcessCheckResult(const CheckResult::Ptr& cr, const MessageOrigin::Ptr& origin = nullptr);
 
 	Endpoint::Ptr GetCommandEndpoint() const;
 
+	/**
+	 * A processed check result as delivered by OnNewCheckResults.
+	 */
+	struct CheckResultBatchEntry
+	{
+		Checkable::Ptr Object;
+		CheckResult::Ptr Result;
+		MessageOrigin::Ptr Origin;
+	};
+
+	typedef std::vector<CheckResultBatchEntry> CheckResultBatch;
+
 	static boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, const MessageOrigin::Ptr&)> OnNewCheckResult;
+	static boost::signals2::signal<void (const CheckResultBatch&)> OnNewCheckResults;
 	static boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, StateType, const MessageOrigin::Ptr&)> OnStateChange;
 	static boost::signals2::signal<void (const Checkable::Ptr&, const CheckResult::Ptr&, std::set<Checkable::Ptr>, const MessageOrigin::Ptr&)> OnReachabilityChanged;
 	static boost::signals2::signal<void (const Checkable::Ptr&, NotificationType, const CheckResult::Ptr&,
@@ -182,9 +237,12 @@ public:
 	void RemoveReverseDependency(const intrusive_ptr<Dependency>& dep);
 	std::vector<intrusive_ptr<Dependency> > GetReverseDependencies() const;
 
+	static void AddDependencies(const std::vector<intrusive_ptr<Dependency> >& deps);
+
 	void ValidateCheckInterval(const Lazy<double>& lvalue, const ValidationUtils& value) final;
 	void ValidateRetryInterval(const Lazy<double>& lvalue, const ValidationUtils& value) final;
 	void ValidateMaxCheckAttempts(const Lazy<int>& lvalue, const ValidationUtils& value) final;
+	void ValidateCheckResultHistory(const Lazy<int>& lvalue, const ValidationUtils& value) final;
 
 	bool NotificationReasonApplies(NotificationType type);
 	bool NotificationReasonSuppressed(NotificationType type);
@@ -199,6 +257,7 @@ public:
 
 protected:
 	void Start(bool runtimeCreated) override;
+	void Stop(bool runtimeRemoved) override;
 	void OnConfigLoaded() override;
 	void OnAllConfigLoaded() override;
 
@@ -206,14 +265,53 @@ private:
 	mutable std::mutex m_CheckableMutex;
 	bool m_CheckRunning{false};
 	long m_SchedulingOffset;
+	CheckableStateRecord::ConstPtr m_StateRecord;
+
+	CheckableStateRecord::ConstPtr PublishStateRecord();
+
+	/* Only allocated if check_result_history is set, see AddToCheckResultHistory(). */
+	std::shared_ptr<CheckResultHistory> m_CheckResultHistory;
+
+	void AddToCheckResultHistory(const CheckResult::Ptr& cr);
 
 	static std::mutex m_StatsMutex;
 	static int m_PendingChecks;
 	static std::condition_variable m_PendingChecksCV;
 
-	/* Downtimes */
-	std::set<Downtime::Ptr> m_Downtimes;
-	mutable std::mutex m_DowntimeMutex;
+	/* Downtimes, comments, notifications and dependencies. Most checkables have few or none
+	 * of them, so they share one mutex and are only allocated once there's anything to store. */
+	struct Relations
+	{
+		std::vector<Downtime::Ptr> Downtimes;
+		std::vector<Comment::Ptr> Comments;
+		std::vector<Notification::Ptr> Notifications;
+		std::vector<intrusive_ptr<Dependency> > Dependencies;
+		std::vector<intrusive_ptr<Dependency> > ReverseDependencies;
+	};
+
+	mutable std::mutex m_RelationsMutex;
+	std::unique_ptr<Relations> m_Relations;
+
+	Relations& GetRelations();
+	void ReleaseRelationsIfEmpty();
+
+	template<class T>
+	static void AddRelation(std::vector<T>& relations, const T& relation)
+	{
+		if (std::find(relations.begin(), relations.end(), relation) == relations.end())
+			relations.push_back(relation);
+	}
+
+	template<class T>
+	static void RemoveRelation(std::vector<T>& relations, const T& relation)
+	{
+		auto it (std::find(relations.begin(), relations.end(), relation));
+
+		if (it != relations.end()) {
+			*it = std::move(relations.back());
+			relations.pop_back();
+		}
+	}
 
 	static void NotifyFixedDowntimeStart(const Downtime::Ptr& downtime);
 	static void NotifyFlexibleDowntimeStart(const Downtime::Ptr& downtime);
@@ -224,20 +322,50 @@ private:
 	static void FireSuppressedNotifications(const Timer * const&);
 	static void CleanDeadlinedExecutions(const Timer * const&);
 
-	/* Comments */
-	std::set<Comment::Ptr> m_Comments;
-	mutable std::mutex m_CommentMutex;
+	struct ReachabilityCacheEntry
+	{
+		bool Valid{false};
+		bool Reachable{true};
+		intrusive_ptr<Dependency> FailedDependency;
+		double ValidUntil{0};
+		uint_fast64_t Generation{0};
+	};
 
-	/* Notifications */
-	std::set<Notification::Ptr> m_Notifications;
-	mutable std::mutex m_NotificationMutex;
+	mutable std::mutex m_ReachabilityMutex;
+	mutable ReachabilityCacheEntry m_ReachabilityCache[DependencyNotification + 1];
+	uint_fast64_t m_ReachabilityVersion{0};
 
-	/* Dependencies */
-	mutable std::mutex m_DependencyMutex;
-	std::set<intrusive_ptr<Dependency> > m_Dependencies;
-	std::set<intrusive_ptr<Dependency> > m_ReverseDependencies;
+	/* What our children's IsReachable() looked at, to skip invalidations for unchanged states. */
+	int m_ReachabilityState{-1};
+	int m_ReachabilityStateType{-1};
+	bool m_ReachabilityChecked{false};
+
+	void UpdateReachabilityInputs();
+
+	static std::atomic<uint_fast64_t> m_ReachabilityGeneration;
+
+	bool IsReachableInternal(DependencyType dt, intrusive_ptr<Dependency> *failedDependency, int rstack,
+		double& validUntil, bool& cacheable) const;
+	bool CalculateReachability(DependencyType dt, intrusive_ptr<Dependency> *failedDependency, int rstack,
+		double& validUntil, bool& cacheable) const;
+
+	/* The result of GetAllChildren(), dropped by InvalidateAllChildren() if anything below us changes. */
+	mutable std::shared_ptr<const std::vector<Checkable::Ptr> > m_AllChildren;
+	mutable uint_fast64_t m_AllChildrenVersion{0};
+
+	static void InvalidateAllChildren(const std::vector<Checkable::Ptr>& checkables);
+	bool HasChildren() const;
+
+	static void QueueReachabilityPropagation(const Checkable::Ptr& parent, const CheckResult::Ptr& cr,
+		const MessageOrigin::Ptr& origin, bool recovery);
+	static void PropagateReachability();
+
+	/* What CIB counts us as, see CIB::UpdateCheckableStatistics(). */
+	std::mutex m_StatisticsMutex;
+	bool m_StatisticsCounted{false};
+	uint_fast32_t m_StatisticsFlags{0};
 
-	void GetAllChildrenInternal(std::set<Checkable::Ptr>& children, int level = 0) const;
+	friend class CIB;
 
 	/* Flapping */
 	static const std::map<String, int> m_FlappingStateFilterMap;
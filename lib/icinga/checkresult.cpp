@@ -32,3 +32,23 @@ double CheckResult::CalculateLatency() const
 
 	return latency;
 }
+
+/**
+ * Returns the performance data parsed into its columnar form.
+ *
+ * The result is shared by all consumers of this check result and only
+ * computed again if the performance data is replaced.
+ */
+ParsedPerfdata::Ptr CheckResult::GetParsedPerformanceData() const
+{
+	Array::Ptr perfdata = GetPerformanceData();
+
+	std::unique_lock<std::mutex> lock (m_ParsedPerformanceDataMutex);
+
+	if (!m_ParsedPerformanceData || m_ParsedPerformanceDataSource != perfdata) {
+		m_ParsedPerformanceData = new ParsedPerfdata(perfdata);
+		m_ParsedPerformanceDataSource = perfdata;
+	}
+
+	return m_ParsedPerformanceData;
+}
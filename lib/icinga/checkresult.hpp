@@ -5,6 +5,9 @@
 
 #include "icinga/i2-icinga.hpp"
 #include "icinga/checkresult-ti.hpp"
+#include "base/parsedperfdata.hpp"
+#include "base/tracing.hpp"
+#include <mutex>
 
 namespace icinga
 {
@@ -21,6 +24,26 @@ public:
 
 	double CalculateExecutionTime() const;
 	double CalculateLatency() const;
+
+	ParsedPerfdata::Ptr GetParsedPerformanceData() const;
+
+	/* The span this check result was produced in, to continue its trace. */
+	TraceContext GetTraceContext() const
+	{
+		return m_TraceContext;
+	}
+
+	void SetTraceContext(const TraceContext& context)
+	{
+		m_TraceContext = context;
+	}
+
+private:
+	TraceContext m_TraceContext;
+
+	mutable std::mutex m_ParsedPerformanceDataMutex;
+	mutable Array::Ptr m_ParsedPerformanceDataSource;
+	mutable ParsedPerfdata::Ptr m_ParsedPerformanceData;
 };
 
 }
@@ -0,0 +1,208 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icinga/checkresulthistory.hpp"
+#include "base/dictionary.hpp"
+#include <algorithm>
+#include <deque>
+
+using namespace icinga;
+
+struct CheckResultHistoryAllocation
+{
+	std::weak_ptr<CheckResultHistory> Ring;
+	uint_fast64_t Generation;
+};
+
+static std::mutex l_AllocationsMutex;
+
+/* The rings in the order they got their storage, possibly with stale entries
+ * of rings which have been destroyed, evicted or resized since.
+ */
+static std::deque<CheckResultHistoryAllocation> l_Allocations;
+static size_t l_TotalEntries = 0;
+static uint_fast64_t l_Generation = 0;
+
+CheckResultHistory::~CheckResultHistory()
+{
+	std::unique_lock<std::mutex> lock (l_AllocationsMutex);
+
+	l_TotalEntries -= m_Reserved.load();
+}
+
+/**
+ * Adds a check result to the ring, overwriting the oldest one if full.
+ *
+ * @param cr The check result
+ * @param size How many check results to keep
+ * @param limit How many check results all rings may keep together
+ */
+void CheckResultHistory::Add(const CheckResult::Ptr& cr, size_t size, size_t limit)
+{
+	CheckResultHistoryEntry entry;
+	entry.ExecutionEnd = cr->GetExecutionEnd();
+	entry.ExecutionTime = cr->CalculateExecutionTime();
+	entry.Latency = cr->CalculateLatency();
+	entry.State = cr->GetState();
+	entry.PerfdataCount = 0;
+
+	auto perfdata (cr->GetParsedPerformanceData());
+
+	for (size_t i = 0; i < perfdata->GetLength() && entry.PerfdataCount < CheckResultHistoryEntry::MaxPerfdata; i++)
+		entry.Perfdata[entry.PerfdataCount++] = perfdata->GetValue(i);
+
+	if (m_Reserved.load() != size && !Reserve(size, limit))
+		return;
+
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	/* Evicted (or resized again) in the meantime. */
+	if (m_Reserved.load() != size)
+		return;
+
+	if (m_Entries.size() != size) {
+		std::vector<CheckResultHistoryEntry> entries;
+		entries.reserve(size);
+
+		for (auto& old : GetEntries(lock)) {
+			if (entries.size() == size)
+				entries.erase(entries.begin());
+
+			entries.push_back(old);
+		}
+
+		m_Count = entries.size();
+		m_Next = m_Count % size;
+		entries.resize(size);
+		m_Entries = std::move(entries);
+	}
+
+	m_Entries[m_Next] = entry;
+	m_Next = (m_Next + 1) % size;
+
+	if (m_Count < size)
+		m_Count++;
+}
+
+/**
+ * Accounts size entries for this ring, evicting the least recently allocated
+ * other rings if that would exceed the limit.
+ *
+ * @returns Whether the ring may allocate its storage
+ */
+bool CheckResultHistory::Reserve(size_t size, size_t limit)
+{
+	std::vector<CheckResultHistory::Ptr> victims, stale;
+
+	{
+		std::unique_lock<std::mutex> lock (l_AllocationsMutex);
+
+		l_TotalEntries -= m_Reserved.load();
+		m_Reserved.store(0);
+		m_Generation = ++l_Generation;
+
+		if (size > limit)
+			return false;
+
+		while (l_TotalEntries + size > limit && !l_Allocations.empty()) {
+			auto allocation (l_Allocations.front());
+			l_Allocations.pop_front();
+
+			auto ring (allocation.Ring.lock());
+
+			if (!ring)
+				continue;
+
+			if (ring->m_Generation != allocation.Generation) {
+				/* Don't let the destructor run while we hold its lock. */
+				stale.emplace_back(std::move(ring));
+				continue;
+			}
+
+			l_TotalEntries -= ring->m_Reserved.load();
+			ring->m_Reserved.store(0);
+			ring->m_Generation = ++l_Generation;
+			victims.emplace_back(std::move(ring));
+		}
+
+		l_TotalEntries += size;
+		m_Reserved.store(size);
+		l_Allocations.push_back({ shared_from_this(), m_Generation });
+	}
+
+	/* Outside of the global lock, the victims may be busy adding a check result. */
+	for (auto& victim : victims)
+		victim->Evict();
+
+	return true;
+}
+
+/**
+ * Frees the storage of an evicted ring unless it has been re-allocated already.
+ */
+void CheckResultHistory::Evict()
+{
+	std::vector<CheckResultHistoryEntry> entries;
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	if (m_Reserved.load())
+		return;
+
+	m_Entries.swap(entries);
+	m_Next = 0;
+	m_Count = 0;
+}
+
+std::vector<CheckResultHistoryEntry> CheckResultHistory::GetEntries(const std::unique_lock<std::mutex>&) const
+{
+	std::vector<CheckResultHistoryEntry> entries;
+	size_t size = m_Entries.size();
+
+	if (!size)
+		return entries;
+
+	entries.reserve(m_Count);
+
+	for (size_t i = 0; i < m_Count; i++)
+		entries.push_back(m_Entries[(m_Next + size - m_Count + i) % size]);
+
+	return entries;
+}
+
+/**
+ * Returns the check results in the ring, the oldest first.
+ */
+std::vector<CheckResultHistoryEntry> CheckResultHistory::GetEntries() const
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	return GetEntries(lock);
+}
+
+Array::Ptr CheckResultHistory::ToArray() const
+{
+	ArrayData result;
+
+	for (auto& entry : GetEntries()) {
+		ArrayData perfdata (entry.Perfdata, entry.Perfdata + entry.PerfdataCount);
+
+		result.emplace_back(new Dictionary({
+			{ "execution_end", entry.ExecutionEnd },
+			{ "state", entry.State },
+			{ "execution_time", entry.ExecutionTime },
+			{ "latency", entry.Latency },
+			{ "perfdata", new Array(std::move(perfdata)) }
+		}));
+	}
+
+	return new Array(std::move(result));
+}
+
+/**
+ * Returns how many check results all rings may currently keep together.
+ */
+size_t CheckResultHistory::GetTotalEntries()
+{
+	std::unique_lock<std::mutex> lock (l_AllocationsMutex);
+
+	return l_TotalEntries;
+}
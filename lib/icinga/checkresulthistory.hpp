@@ -0,0 +1,80 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef CHECKRESULTHISTORY_H
+#define CHECKRESULTHISTORY_H
+
+#include "icinga/i2-icinga.hpp"
+#include "icinga/checkresult.hpp"
+#include "base/array.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * One check result in a CheckResultHistory.
+ *
+ * @ingroup icinga
+ */
+struct CheckResultHistoryEntry
+{
+	static constexpr size_t MaxPerfdata = 4;
+
+	double ExecutionEnd;
+	float ExecutionTime;
+	float Latency;
+	float Perfdata[MaxPerfdata];
+	uint8_t State;
+	uint8_t PerfdataCount;
+};
+
+/**
+ * The last check results of a checkable in a fixed size ring.
+ *
+ * All rings together hold at most a given number of entries. If a ring needs
+ * room beyond that, the least recently allocated rings are evicted. They
+ * start over with their next check result.
+ *
+ * @ingroup icinga
+ */
+class CheckResultHistory final : public std::enable_shared_from_this<CheckResultHistory>
+{
+public:
+	typedef std::shared_ptr<CheckResultHistory> Ptr;
+
+	CheckResultHistory() = default;
+	CheckResultHistory(const CheckResultHistory&) = delete;
+	CheckResultHistory& operator=(const CheckResultHistory&) = delete;
+	~CheckResultHistory();
+
+	void Add(const CheckResult::Ptr& cr, size_t size, size_t limit);
+
+	std::vector<CheckResultHistoryEntry> GetEntries() const;
+	Array::Ptr ToArray() const;
+
+	static size_t GetTotalEntries();
+
+private:
+	mutable std::mutex m_Mutex;
+	std::vector<CheckResultHistoryEntry> m_Entries;
+	size_t m_Next{0};
+	size_t m_Count{0};
+
+	/* How many entries are accounted for this ring, 0 if it has been evicted. */
+	std::atomic<size_t> m_Reserved{0};
+
+	/* Guarded by the global allocation mutex, changes whenever m_Reserved does. */
+	uint_fast64_t m_Generation{0};
+
+	bool Reserve(size_t size, size_t limit);
+	void Evict();
+	std::vector<CheckResultHistoryEntry> GetEntries(const std::unique_lock<std::mutex>& lock) const;
+};
+
+}
+
+#endif /* CHECKRESULTHISTORY_H */
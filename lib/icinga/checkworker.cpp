@@ -0,0 +1,645 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef _WIN32
+
+#include "icinga/checkworker.hpp"
+#include "base/application.hpp"
+#include "base/convert.hpp"
+#include "base/exception.hpp"
+#include "base/logger.hpp"
+#include "base/objectlock.hpp"
+#include "base/utility.hpp"
+#include <boost/asio/deadline_timer.hpp>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace icinga;
+
+/* The capacity of each ring, the output of a plugin is cut to fit into half of it. */
+static const size_t l_RingCapacity = 4 * 1024 * 1024;
+
+/* How much of a worker's stderr is kept for the reason it exited, the rest is discarded. */
+static const size_t l_MaxWorkerOutput = 16 * 1024;
+
+/* How long to wait for the other side to make room in a full ring. */
+static const int l_FullRingRetryMilliseconds = 10;
+
+std::mutex CheckWorker::m_WorkersMutex;
+std::vector<CheckWorker::Ptr> CheckWorker::m_Workers;
+
+template<class T>
+static void AppendValue(std::string& buf, T value)
+{
+	buf.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void AppendString(std::string& buf, const String& value)
+{
+	AppendValue<uint32_t>(buf, value.GetLength());
+	buf.append(value.GetData());
+}
+
+/**
+ * Reads the fields of a message written by the Append*() functions.
+ */
+class MessageReader
+{
+public:
+	explicit MessageReader(const String& message)
+		: m_Message(message), m_Offset(0)
+	{ }
+
+	template<class T>
+	T ReadValue()
+	{
+		T value;
+
+		Check(sizeof(value));
+		memcpy(&value, m_Message.CStr() + m_Offset, sizeof(value));
+		m_Offset += sizeof(value);
+
+		return value;
+	}
+
+	String ReadString()
+	{
+		auto length (ReadValue<uint32_t>());
+
+		Check(length);
+
+		String value (m_Message.CStr() + m_Offset, m_Message.CStr() + m_Offset + length);
+		m_Offset += length;
+
+		return value;
+	}
+
+private:
+	const String& m_Message;
+	size_t m_Offset;
+
+	void Check(size_t length) const
+	{
+		if (m_Message.GetLength() - m_Offset < length)
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Check worker message is truncated"));
+	}
+};
+
+CheckWorker::CheckWorker(size_t index)
+	: m_Index(index), m_Strand(IoEngine::Get().GetIoContext()), m_Bell(IoEngine::Get().GetIoContext()),
+	m_BacklogQueued(IoEngine::Get().GetIoContext()), m_NextRequestId(0), m_Load(0), m_Stopped(false)
+{ }
+
+/**
+ * Starts the given number of workers, the checks are executed by them from
+ * now on.
+ */
+void CheckWorker::StartWorkers(int count)
+{
+	if (!SharedMemoryRing::IsSupported()) {
+		Log(LogWarning, "CheckWorker", "Check workers aren't supported on this platform, executing the checks ourselves.");
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock (m_WorkersMutex);
+
+	for (int i = 0; i < count; i++) {
+		CheckWorker::Ptr worker = new CheckWorker(i);
+
+		try {
+			worker->Start();
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "CheckWorker")
+				<< "Check worker " << i << " failed to start, starting it with the next check: " << DiagnosticInformation(ex, false);
+
+			worker->m_Stopped.store(true);
+		}
+
+		m_Workers.emplace_back(std::move(worker));
+	}
+}
+
+/**
+ * Stops all workers. Checks which are still running fail.
+ */
+void CheckWorker::StopWorkers()
+{
+	std::vector<CheckWorker::Ptr> workers;
+
+	{
+		std::unique_lock<std::mutex> lock (m_WorkersMutex);
+		workers.swap(m_Workers);
+	}
+
+	for (auto& worker : workers) {
+		CheckWorker::Ptr keepAlive (worker);
+		boost::asio::post(worker->m_Strand, [keepAlive]() { keepAlive->Stop("has been stopped"); });
+	}
+}
+
+bool CheckWorker::IsEnabled()
+{
+	std::unique_lock<std::mutex> lock (m_WorkersMutex);
+	return !m_Workers.empty();
+}
+
+/**
+ * Executes a command through the worker with the fewest running commands,
+ * restarting it if it has exited. The callback is called exactly once, like
+ * the one passed to Process::Run().
+ *
+ * @param arguments The command line
+ * @param extraEnvironment Environment variables for the command
+ * @param timeout The command's timeout in seconds
+ * @param maxOutputSize The maximum number of bytes of output to keep, 0 for no limit
+ * @param callback Receives the command's result
+ */
+void CheckWorker::Execute(const Process::Arguments& arguments, const Dictionary::Ptr& extraEnvironment,
+	double timeout, size_t maxOutputSize, const Callback& callback)
+{
+	std::string body;
+
+	AppendValue<double>(body, timeout);
+	AppendValue<uint64_t>(body, maxOutputSize);
+	AppendValue<uint32_t>(body, arguments.size());
+
+	for (const String& argument : arguments)
+		AppendString(body, argument);
+
+	if (extraEnvironment) {
+		ObjectLock olock (extraEnvironment);
+
+		AppendValue<uint32_t>(body, extraEnvironment->GetLength());
+
+		for (const Dictionary::Pair& kv : extraEnvironment) {
+			AppendString(body, kv.first);
+			AppendString(body, kv.second);
+		}
+	} else {
+		AppendValue<uint32_t>(body, 0);
+	}
+
+	CheckWorker::Ptr worker;
+
+	try {
+		std::unique_lock<std::mutex> lock (m_WorkersMutex);
+
+		if (m_Workers.empty())
+			BOOST_THROW_EXCEPTION(std::runtime_error("No check workers are running"));
+
+		auto best (m_Workers.begin());
+
+		for (auto it (m_Workers.begin()); it != m_Workers.end(); it++) {
+			if ((*it)->m_Load.load() < (*best)->m_Load.load())
+				best = it;
+		}
+
+		if ((*best)->m_Stopped.load()) {
+			CheckWorker::Ptr replacement = new CheckWorker((*best)->m_Index);
+			replacement->Start();
+			*best = std::move(replacement);
+		}
+
+		worker = *best;
+	} catch (const std::exception& ex) {
+		String message = "Check worker failed to start: " + DiagnosticInformation(ex, false);
+
+		Log(LogWarning, "CheckWorker", message);
+
+		ProcessResult pr;
+		pr.PID = -1;
+		pr.ExecutionStart = Utility::GetTime();
+		pr.ExecutionEnd = pr.ExecutionStart;
+		pr.ExitStatus = 3; /* Unknown */
+		pr.Output = message;
+
+		Utility::QueueAsyncCallback([callback, pr]() { callback(pr); });
+		return;
+	}
+
+	worker->m_Load.fetch_add(1);
+
+	String message (std::move(body));
+
+	boost::asio::post(worker->m_Strand, [worker, message, callback]() {
+		worker->Enqueue(message, callback);
+	});
+}
+
+/**
+ * The state of the workers, for statistics.
+ */
+Array::Ptr CheckWorker::GetStats()
+{
+	ArrayData stats;
+	std::unique_lock<std::mutex> lock (m_WorkersMutex);
+
+	for (auto& worker : m_Workers) {
+		bool stopped = worker->m_Stopped.load();
+
+		stats.emplace_back(new Dictionary({
+			{ "pid", stopped ? -1 : worker->m_Process->GetPID() },
+			{ "running", stopped ? 0 : worker->m_Load.load() },
+			{ "request_ring_bytes", stopped ? 0 : worker->m_Requests->GetLength() },
+			{ "result_ring_bytes", stopped ? 0 : worker->m_Results->GetLength() }
+		}));
+	}
+
+	return new Array(std::move(stats));
+}
+
+/**
+ * Spawns the worker with the shared memory as stdin and a socket as stdout.
+ * The beginning of the worker's stderr is logged once it has exited.
+ */
+void CheckWorker::Start()
+{
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("socketpair")
+			<< boost::errinfo_errno(errno));
+	}
+
+	Utility::SetCloExec(fds[0]);
+	Utility::SetCloExec(fds[1]);
+
+	try {
+		m_Memory.reset(new SharedMemory(2 * SharedMemoryRing::GetSize(l_RingCapacity)));
+	} catch (const std::exception&) {
+		(void)close(fds[0]);
+		(void)close(fds[1]);
+		throw;
+	}
+
+	char *memory = static_cast<char *>(m_Memory->GetAddress());
+
+	m_Requests.reset(new SharedMemoryRing(memory, l_RingCapacity));
+	m_Results.reset(new SharedMemoryRing(memory + SharedMemoryRing::GetSize(l_RingCapacity), l_RingCapacity));
+
+	m_Process = new Process({ Application::GetExePath(Application::GetArgV()[0]), "internal", "check-worker" });
+	m_Process->SetStdio(m_Memory->GetFD(), fds[1]);
+	m_Process->SetTimeout(0);
+	m_Process->SetMaxOutputSize(l_MaxWorkerOutput);
+
+	CheckWorker::Ptr keepAlive (this);
+
+	m_Process->Run([this, keepAlive](const ProcessResult& pr) {
+		String reason = "exited with status " + Convert::ToString(pr.ExitStatus);
+
+		if (!pr.Output.IsEmpty())
+			reason += ": " + pr.Output.Trim();
+
+		boost::asio::post(m_Strand, [this, keepAlive, reason]() { Stop(reason); });
+	});
+
+	(void)close(fds[1]);
+
+	Utility::SetNonBlocking(fds[0]);
+	m_Bell.assign(fds[0]);
+
+	Log(LogInformation, "CheckWorker")
+		<< "Started check worker " << m_Index << " (PID " << m_Process->GetPID() << ").";
+
+	IoEngine::SpawnCoroutine(m_Strand, [this, keepAlive](boost::asio::yield_context yc) { ReadResults(yc); });
+	IoEngine::SpawnCoroutine(m_Strand, [this, keepAlive](boost::asio::yield_context yc) { WriteBacklog(yc); }, CoroutineStackSmall);
+}
+
+/**
+ * Fails all running checks and closes the socket, which tells the worker to
+ * exit. Must be called on the strand.
+ *
+ * @param reason Why the worker is stopped, ends up in the checks' output
+ */
+void CheckWorker::Stop(const String& reason)
+{
+	if (m_Stopped.exchange(true))
+		return;
+
+	Log(LogWarning, "CheckWorker")
+		<< "Check worker " << m_Index << " " << reason;
+
+	boost::system::error_code ec;
+	m_Bell.close(ec);
+
+	m_Backlog.clear();
+	m_BacklogQueued.Set();
+
+	auto requests (std::move(m_InFlight));
+	m_InFlight.clear();
+
+	double now = Utility::GetTime();
+
+	for (auto& request : requests) {
+		ProcessResult pr;
+		pr.PID = m_Process ? m_Process->GetPID() : -1;
+		pr.ExecutionStart = request.second.ExecutionStart;
+		pr.ExecutionEnd = now;
+		pr.ExitStatus = 3; /* Unknown */
+		pr.Output = "<Check worker " + reason + ">";
+
+		auto callback (std::move(request.second.OnFinished));
+		Utility::QueueAsyncCallback([callback, pr]() { callback(pr); });
+	}
+
+	m_Load.fetch_sub(requests.size());
+}
+
+/**
+ * Passes a command to the worker. Must be called on the strand.
+ */
+void CheckWorker::Enqueue(const String& body, const Callback& callback)
+{
+	if (m_Stopped.load() || body.GetLength() + sizeof(uint64_t) + sizeof(uint32_t) > m_Requests->GetCapacity()) {
+		ProcessResult pr;
+		pr.PID = -1;
+		pr.ExecutionStart = Utility::GetTime();
+		pr.ExecutionEnd = pr.ExecutionStart;
+		pr.ExitStatus = 3; /* Unknown */
+		pr.Output = m_Stopped.load() ? "<Check worker is not running>" : "<Command line is too long for a check worker>";
+
+		m_Load.fetch_sub(1);
+
+		Utility::QueueAsyncCallback([callback, pr]() { callback(pr); });
+		return;
+	}
+
+	uint64_t id = m_NextRequestId++;
+
+	auto& request (m_InFlight[id]);
+	request.OnFinished = callback;
+	request.ExecutionStart = Utility::GetTime();
+
+	std::string message;
+	AppendValue<uint64_t>(message, id);
+	message.append(body.GetData());
+
+	if (m_Backlog.empty() && m_Requests->TryWrite(message)) {
+		if (m_Requests->Notify())
+			Wake();
+
+		return;
+	}
+
+	m_Backlog.emplace_back(std::move(message));
+	m_BacklogQueued.Set();
+}
+
+/**
+ * Completes a check with a result read from the worker. Must be called on
+ * the strand.
+ */
+void CheckWorker::Finish(const String& message)
+{
+	MessageReader reader (message);
+	auto id (reader.ReadValue<uint64_t>());
+
+	ProcessResult pr;
+	pr.PID = reader.ReadValue<int64_t>();
+	pr.ExitStatus = reader.ReadValue<int64_t>();
+	pr.ExecutionStart = reader.ReadValue<double>();
+	pr.ExecutionEnd = reader.ReadValue<double>();
+	pr.Output = reader.ReadString();
+
+	auto it (m_InFlight.find(id));
+
+	if (it == m_InFlight.end())
+		return;
+
+	auto callback (std::move(it->second.OnFinished));
+	m_InFlight.erase(it);
+	m_Load.fetch_sub(1);
+
+	/* Processing the result takes longer than reading it, don't hold up the strand. */
+	Utility::QueueAsyncCallback([callback, pr]() { callback(pr); });
+}
+
+/**
+ * Wakes up the worker waiting for messages.
+ */
+void CheckWorker::Wake()
+{
+	char bell = 0;
+
+	/* If the socket is full, the worker hasn't read the previous wakeups yet anyway. */
+	(void)write(m_Bell.native_handle(), &bell, sizeof(bell));
+}
+
+void CheckWorker::ReadResults(boost::asio::yield_context yc)
+{
+	char buf[512];
+
+	try {
+		while (!m_Stopped.load()) {
+			String message;
+
+			while (m_Results->TryRead(message))
+				Finish(message);
+
+			if (m_Results->PrepareWait()) {
+				/* Throws once the worker has closed its end. */
+				m_Bell.async_read_some(boost::asio::buffer(buf), yc);
+			}
+		}
+	} catch (const boost::coroutines::detail::forced_unwind&) {
+		throw;
+	} catch (const std::exception& ex) {
+		Stop("failed to return results: " + DiagnosticInformation(ex, false));
+	}
+}
+
+/**
+ * Writes the commands which haven't fit into the full request ring as soon
+ * as the worker has made room.
+ */
+void CheckWorker::WriteBacklog(boost::asio::yield_context yc)
+{
+	boost::asio::deadline_timer timer (m_Strand.context());
+
+	try {
+		while (!m_Stopped.load()) {
+			m_BacklogQueued.Wait(yc);
+			m_BacklogQueued.Clear();
+
+			while (!m_Backlog.empty() && !m_Stopped.load()) {
+				bool written = false;
+
+				while (!m_Backlog.empty() && m_Requests->TryWrite(m_Backlog.front())) {
+					m_Backlog.pop_front();
+					written = true;
+				}
+
+				if (written && m_Requests->Notify())
+					Wake();
+
+				if (!m_Backlog.empty()) {
+					timer.expires_from_now(boost::posix_time::milliseconds(l_FullRingRetryMilliseconds));
+					timer.async_wait(yc);
+				}
+			}
+		}
+	} catch (const boost::coroutines::detail::forced_unwind&) {
+		throw;
+	} catch (const std::exception& ex) {
+		Stop("stopped accepting checks: " + DiagnosticInformation(ex, false));
+	}
+}
+
+/**
+ * The state of the worker process shared with the callbacks of its processes.
+ */
+struct CheckWorkerState
+{
+	std::unique_ptr<SharedMemory> Memory;
+	std::unique_ptr<SharedMemoryRing> Requests;
+	std::unique_ptr<SharedMemoryRing> Results;
+	int Bell;
+
+	std::mutex ResultsMutex;
+	std::deque<String> Backlog;
+
+	/* Must be called with ResultsMutex held. */
+	void WriteResults()
+	{
+		bool written = false;
+
+		while (!Backlog.empty() && Results->TryWrite(Backlog.front())) {
+			Backlog.pop_front();
+			written = true;
+		}
+
+		if (written && Results->Notify()) {
+			char bell = 0;
+			(void)write(Bell, &bell, sizeof(bell));
+		}
+	}
+};
+
+/**
+ * The worker process' main loop: spawns the commands read from the shared
+ * memory and writes their results back to it until the socket is closed.
+ *
+ * @returns An exit status.
+ */
+int CheckWorker::RunWorker()
+{
+	auto state (std::make_shared<CheckWorkerState>());
+
+	try {
+		/* Keep the socket and the shared memory, but let stray output, e.g. of the logger, go to stderr. */
+		state->Bell = dup(STDOUT_FILENO);
+		int memory = dup(STDIN_FILENO);
+		int devNull = open("/dev/null", O_RDONLY);
+
+		if (state->Bell < 0 || memory < 0 || devNull < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0 || dup2(devNull, STDIN_FILENO) < 0) {
+			BOOST_THROW_EXCEPTION(posix_error()
+				<< boost::errinfo_api_function("dup")
+				<< boost::errinfo_errno(errno));
+		}
+
+		(void)close(devNull);
+
+		Utility::SetCloExec(state->Bell);
+		Utility::SetCloExec(memory);
+
+		state->Memory.reset(new SharedMemory(memory));
+
+		char *address = static_cast<char *>(state->Memory->GetAddress());
+
+		state->Requests.reset(new SharedMemoryRing(address));
+		state->Results.reset(new SharedMemoryRing(address + SharedMemoryRing::GetSize(state->Requests->GetCapacity())));
+	} catch (const std::exception& ex) {
+		Log(LogCritical, "CheckWorker")
+			<< "Failed to attach to the shared memory: " << DiagnosticInformation(ex, false);
+
+		return EXIT_FAILURE;
+	}
+
+	/* Leaves room for the other fields and another result. */
+	size_t maxResultOutput = state->Results->GetCapacity() / 2;
+
+	for (;;) {
+		String message;
+
+		try {
+			while (state->Requests->TryRead(message)) {
+				MessageReader reader (message);
+				auto id (reader.ReadValue<uint64_t>());
+				auto timeout (reader.ReadValue<double>());
+				auto maxOutputSize (reader.ReadValue<uint64_t>());
+
+				Process::Arguments arguments (reader.ReadValue<uint32_t>());
+
+				for (auto& argument : arguments)
+					argument = reader.ReadString();
+
+				Dictionary::Ptr extraEnvironment = new Dictionary();
+
+				for (auto i (reader.ReadValue<uint32_t>()); i; i--) {
+					String key = reader.ReadString();
+					extraEnvironment->Set(key, reader.ReadString());
+				}
+
+				Process::Ptr process = new Process(arguments, extraEnvironment);
+
+				process->SetTimeout(timeout);
+				process->SetAdjustPriority(true);
+				process->SetMaxOutputSize(maxOutputSize && maxOutputSize < maxResultOutput ? maxOutputSize : maxResultOutput);
+
+				process->Run([state, id](const ProcessResult& pr) {
+					std::string result;
+
+					AppendValue<uint64_t>(result, id);
+					AppendValue<int64_t>(result, pr.PID);
+					AppendValue<int64_t>(result, pr.ExitStatus);
+					AppendValue<double>(result, pr.ExecutionStart);
+					AppendValue<double>(result, pr.ExecutionEnd);
+					AppendString(result, pr.Output);
+
+					std::unique_lock<std::mutex> lock (state->ResultsMutex);
+
+					state->Backlog.emplace_back(std::move(result));
+					state->WriteResults();
+				});
+			}
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "CheckWorker")
+				<< "Failed to read a check: " << DiagnosticInformation(ex, false);
+
+			return EXIT_FAILURE;
+		}
+
+		bool backlogged;
+
+		{
+			std::unique_lock<std::mutex> lock (state->ResultsMutex);
+
+			state->WriteResults();
+			backlogged = !state->Backlog.empty();
+		}
+
+		if (!state->Requests->PrepareWait())
+			continue;
+
+		pollfd pfd;
+		pfd.fd = state->Bell;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		/* Retry writing the results while the main process hasn't made room yet. */
+		if (poll(&pfd, 1, backlogged ? l_FullRingRetryMilliseconds : -1) <= 0)
+			continue;
+
+		char buf[512];
+		ssize_t rc = read(state->Bell, buf, sizeof(buf));
+
+		/* The main process has closed its end. */
+		if (rc == 0 || (rc < 0 && errno != EINTR && errno != EAGAIN))
+			return EXIT_SUCCESS;
+	}
+}
+
+#endif /* _WIN32 */
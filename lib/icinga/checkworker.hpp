@@ -0,0 +1,104 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef CHECKWORKER_H
+#define CHECKWORKER_H
+
+#include "icinga/i2-icinga.hpp"
+#include "base/io-engine.hpp"
+#include "base/process.hpp"
+#include "base/shared-object.hpp"
+#include "base/shmring.hpp"
+#include <atomic>
+#include <boost/asio/io_context_strand.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/spawn.hpp>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace icinga
+{
+
+#ifndef _WIN32
+
+/**
+ * A process which spawns check plugins on our behalf, so that spawning them
+ * and capturing their output scales across processes.
+ *
+ * The macros are still resolved by us. The worker gets the resulting command
+ * lines through a ring buffer in memory shared with it and returns the
+ * results through a second one. Each side wakes up the other one through a
+ * socket only if it's waiting for messages.
+ *
+ * The worker is "icinga2 internal check-worker", the shared memory is its
+ * stdin and the socket its stdout.
+ *
+ * @ingroup icinga
+ */
+class CheckWorker final : public SharedObject
+{
+public:
+	DECLARE_PTR_TYPEDEFS(CheckWorker);
+
+	typedef std::function<void(const ProcessResult&)> Callback;
+
+	static void StartWorkers(int count);
+	static void StopWorkers();
+	static bool IsEnabled();
+
+	static void Execute(const Process::Arguments& arguments, const Dictionary::Ptr& extraEnvironment,
+		double timeout, size_t maxOutputSize, const Callback& callback);
+
+	static Array::Ptr GetStats();
+
+	static int RunWorker();
+
+private:
+	struct Request
+	{
+		Callback OnFinished;
+		double ExecutionStart;
+	};
+
+	CheckWorker(size_t index);
+
+	void Start();
+	void Stop(const String& reason);
+	void Enqueue(const String& message, const Callback& callback);
+	void Finish(const String& message);
+	void Wake();
+
+	void ReadResults(boost::asio::yield_context yc);
+	void WriteBacklog(boost::asio::yield_context yc);
+
+	size_t m_Index;
+	Process::Ptr m_Process;
+
+	std::unique_ptr<SharedMemory> m_Memory;
+	std::unique_ptr<SharedMemoryRing> m_Requests;
+	std::unique_ptr<SharedMemoryRing> m_Results;
+
+	boost::asio::io_context::strand m_Strand;
+	boost::asio::posix::stream_descriptor m_Bell;
+
+	std::deque<String> m_Backlog;
+	AsioConditionVariable m_BacklogQueued;
+
+	std::unordered_map<uint64_t, Request> m_InFlight;
+	uint64_t m_NextRequestId;
+	std::atomic<size_t> m_Load;
+	std::atomic<bool> m_Stopped;
+
+	static std::mutex m_WorkersMutex;
+	static std::vector<CheckWorker::Ptr> m_Workers;
+};
+
+#endif /* _WIN32 */
+
+}
+
+#endif /* CHECKWORKER_H */
@@ -10,13 +10,107 @@
 #include "base/perfdatavalue.hpp"
 #include "base/configtype.hpp"
 #include "base/statsfunction.hpp"
+#include "base/initialize.hpp"
+#include "base/timer.hpp"
+#include <boost/thread/once.hpp>
+#include <atomic>
 
 using namespace icinga;
 
-RingBuffer CIB::m_ActiveHostChecksStatistics(15 * 60);
-RingBuffer CIB::m_ActiveServiceChecksStatistics(15 * 60);
-RingBuffer CIB::m_PassiveHostChecksStatistics(15 * 60);
-RingBuffer CIB::m_PassiveServiceChecksStatistics(15 * 60);
+INITIALIZE_ONCE(&CIB::StaticInitialize);
+
+/* Enough shards for the thread pool and the I/O threads not to collide too often. */
+static const size_t l_StatisticsShards = 8;
+static std::atomic<size_t> l_NextStatisticsShard (0);
+static thread_local size_t l_StatisticsShard = l_NextStatisticsShard.fetch_add(1) % l_StatisticsShards;
+
+CIB::ShardedRingBuffer CIB::m_ActiveHostChecksStatistics(15 * 60);
+CIB::ShardedRingBuffer CIB::m_ActiveServiceChecksStatistics(15 * 60);
+CIB::ShardedRingBuffer CIB::m_PassiveHostChecksStatistics(15 * 60);
+CIB::ShardedRingBuffer CIB::m_PassiveServiceChecksStatistics(15 * 60);
+
+std::mutex CIB::m_CheckStatsMutex;
+double CIB::m_CheckStatsUpdated = 0;
+CheckableCheckStatistics CIB::m_HostCheckStats;
+CheckableCheckStatistics CIB::m_ServiceCheckStats;
+
+/**
+ * What a checkable contributes to HostStatistics/ServiceStatistics. Hosts
+ * use StatisticOK and StatisticCritical for up and down.
+ */
+enum CheckableStatistic
+{
+	StatisticOK,
+	StatisticWarning,
+	StatisticCritical,
+	StatisticUnknown,
+	StatisticPending,
+	StatisticUnreachable,
+	StatisticFlapping,
+	StatisticInDowntime,
+	StatisticAcknowledged,
+	StatisticHandled,
+	StatisticProblem,
+	StatisticCount
+};
+
+static std::atomic<int> l_HostStatistics[StatisticCount];
+static std::atomic<int> l_ServiceStatistics[StatisticCount];
+
+/* How often the per-state counters are verified and the check statistics are refreshed. */
+static const double l_ReconcileInterval = 60;
+static Timer::Ptr l_ReconcileTimer;
+
+CIB::ShardedRingBuffer::ShardedRingBuffer(RingBuffer::SizeType slots)
+{
+	for (size_t i = 0; i < l_StatisticsShards; i++)
+		m_Shards.emplace_back(new RingBuffer(slots));
+}
+
+void CIB::ShardedRingBuffer::InsertValue(RingBuffer::SizeType tv, int num)
+{
+	m_Shards[l_StatisticsShard]->InsertValue(tv, num);
+}
+
+int CIB::ShardedRingBuffer::UpdateAndGetValues(RingBuffer::SizeType tv, RingBuffer::SizeType span)
+{
+	int sum = 0;
+
+	for (auto& shard : m_Shards)
+		sum += shard->UpdateAndGetValues(tv, span);
+
+	return sum;
+}
+
+void CIB::StaticInitialize()
+{
+	ConfigObject::OnStateChanged.connect([](const ConfigObject::Ptr& object) {
+		Checkable::Ptr checkable = dynamic_pointer_cast<Checkable>(object);
+
+		if (checkable)
+			UpdateCheckableStatistics(checkable);
+	});
+
+	Checkable::OnAcknowledgementSet.connect([](const Checkable::Ptr& checkable, const String&, const String&,
+		AcknowledgementType, bool, bool, double, double, const MessageOrigin::Ptr&) {
+		UpdateCheckableStatistics(checkable);
+	});
+
+	Checkable::OnAcknowledgementCleared.connect([](const Checkable::Ptr& checkable, const String&, double, const MessageOrigin::Ptr&) {
+		UpdateCheckableStatistics(checkable);
+	});
+
+	auto downtimeChanged ([](const Downtime::Ptr& downtime) {
+		Checkable::Ptr checkable = downtime->GetCheckable();
+
+		if (checkable)
+			UpdateCheckableStatistics(checkable);
+	});
+
+	Downtime::OnDowntimeStarted.connect(downtimeChanged);
+	Downtime::OnDowntimeTriggered.connect(downtimeChanged);
+	Downtime::OnDowntimeRemoved.connect(downtimeChanged);
+}
 
 void CIB::UpdateActiveHostChecksStatistics(long tv, int num)
 {
@@ -40,7 +134,7 @@ int CIB::GetActiveServiceChecksStatistics(long timespan)
 
 void CIB::UpdatePassiveHostChecksStatistics(long tv, int num)
 {
-	m_PassiveServiceChecksStatistics.InsertValue(tv, num);
+	m_PassiveHostChecksStatistics.InsertValue(tv, num);
 }
 
 void CIB::UpdatePassiveServiceChecksStatistics(long tv, int num)
@@ -58,7 +152,8 @@ int CIB::GetPassiveServiceChecksStatistics(long timespan)
 	return m_PassiveServiceChecksStatistics.UpdateAndGetValues(Utility::GetTime(), timespan);
 }
 
-CheckableCheckStatistics CIB::CalculateHostCheckStats()
+template<typename T>
+static CheckableCheckStatistics CalculateCheckStats()
 {
 	double min_latency = -1, max_latency = 0, sum_latency = 0;
 	int count_latency = 0;
@@ -66,10 +161,8 @@ CheckableCheckStatistics CIB::CalculateHostCheckStats()
 	int count_execution_time = 0;
 	bool checkresult = false;
 
-	for (const Host::Ptr& host : ConfigType::GetObjectsByType<Host>()) {
-		ObjectLock olock(host);
-
-		CheckResult::Ptr cr = host->GetLastCheckResult();
+	for (T *checkable : ConfigType::GetObjectsViewByType<T>()) {
+		CheckResult::Ptr cr = checkable->GetLastCheckResult();
 
 		if (!cr)
 			continue;
@@ -119,139 +212,218 @@ CheckableCheckStatistics CIB::CalculateHostCheckStats()
 	return ccs;
 }
 
-CheckableCheckStatistics CIB::CalculateServiceCheckStats()
+/**
+ * Returns the latency and execution time statistics of all hosts as of the
+ * last reconciliation, i.e. at most a minute old.
+ */
+CheckableCheckStatistics CIB::CalculateHostCheckStats()
 {
-	double min_latency = -1, max_latency = 0, sum_latency = 0;
-	int count_latency = 0;
-	double min_execution_time = -1, max_execution_time = 0, sum_execution_time = 0;
-	int count_execution_time = 0;
-	bool checkresult = false;
+	std::unique_lock<std::mutex> lock (m_CheckStatsMutex);
 
-	for (const Service::Ptr& service : ConfigType::GetObjectsByType<Service>()) {
-		ObjectLock olock(service);
+	/* Without the reconciliation timer, e.g. before any checkable started. */
+	if (Utility::GetTime() - m_CheckStatsUpdated > l_ReconcileInterval * 2) {
+		lock.unlock();
+		ReconcileStatistics();
+		lock.lock();
+	}
 
-		CheckResult::Ptr cr = service->GetLastCheckResult();
+	return m_HostCheckStats;
+}
 
-		if (!cr)
-			continue;
+/**
+ * Returns the latency and execution time statistics of all services as of
+ * the last reconciliation, i.e. at most a minute old.
+ */
+CheckableCheckStatistics CIB::CalculateServiceCheckStats()
+{
+	std::unique_lock<std::mutex> lock (m_CheckStatsMutex);
 
-		/* set to true, we have a checkresult */
-		checkresult = true;
+	if (Utility::GetTime() - m_CheckStatsUpdated > l_ReconcileInterval * 2) {
+		lock.unlock();
+		ReconcileStatistics();
+		lock.lock();
+	}
 
-		/* latency */
-		double latency = cr->CalculateLatency();
+	return m_ServiceCheckStats;
+}
 
-		if (min_latency == -1 || latency < min_latency)
-			min_latency = latency;
+ServiceStatistics CIB::CalculateServiceStats()
+{
+	ServiceStatistics ss = {};
 
-		if (latency > max_latency)
-			max_latency = latency;
+	ss.services_ok = l_ServiceStatistics[StatisticOK].load();
+	ss.services_warning = l_ServiceStatistics[StatisticWarning].load();
+	ss.services_critical = l_ServiceStatistics[StatisticCritical].load();
+	ss.services_unknown = l_ServiceStatistics[StatisticUnknown].load();
+	ss.services_pending = l_ServiceStatistics[StatisticPending].load();
+	ss.services_unreachable = l_ServiceStatistics[StatisticUnreachable].load();
+	ss.services_flapping = l_ServiceStatistics[StatisticFlapping].load();
+	ss.services_in_downtime = l_ServiceStatistics[StatisticInDowntime].load();
+	ss.services_acknowledged = l_ServiceStatistics[StatisticAcknowledged].load();
+	ss.services_handled = l_ServiceStatistics[StatisticHandled].load();
+	ss.services_problem = l_ServiceStatistics[StatisticProblem].load();
 
-		sum_latency += latency;
-		count_latency++;
+	return ss;
+}
 
-		/* execution_time */
-		double execution_time = cr->CalculateExecutionTime();
+HostStatistics CIB::CalculateHostStats()
+{
+	HostStatistics hs = {};
 
-		if (min_execution_time == -1 || execution_time < min_execution_time)
-			min_execution_time = execution_time;
+	hs.hosts_up = l_HostStatistics[StatisticOK].load();
+	hs.hosts_down = l_HostStatistics[StatisticCritical].load();
+	hs.hosts_unreachable = l_HostStatistics[StatisticUnreachable].load();
+	hs.hosts_pending = l_HostStatistics[StatisticPending].load();
+	hs.hosts_flapping = l_HostStatistics[StatisticFlapping].load();
+	hs.hosts_in_downtime = l_HostStatistics[StatisticInDowntime].load();
+	hs.hosts_acknowledged = l_HostStatistics[StatisticAcknowledged].load();
+	hs.hosts_handled = l_HostStatistics[StatisticHandled].load();
+	hs.hosts_problem = l_HostStatistics[StatisticProblem].load();
 
-		if (execution_time > max_execution_time)
-			max_execution_time = execution_time;
+	return hs;
+}
 
-		sum_execution_time += execution_time;
-		count_execution_time++;
-	}
+uint_fast32_t CIB::GetCheckableStatisticsFlags(const Checkable::Ptr& checkable)
+{
+	uint_fast32_t flags = 0;
+	auto set ([&flags](CheckableStatistic statistic) { flags |= 1u << statistic; });
+
+	Host::Ptr host;
+	Service::Ptr service;
+	tie(host, service) = GetHostService(checkable);
+
+	if (service) {
+		switch (service->GetState()) {
+			case ServiceOK:
+				set(StatisticOK);
+				break;
+			case ServiceWarning:
+				set(StatisticWarning);
+				break;
+			case ServiceCritical:
+				set(StatisticCritical);
+				break;
+			case ServiceUnknown:
+				set(StatisticUnknown);
+				break;
+		}
 
-	if (!checkresult) {
-		min_latency = 0;
-		min_execution_time = 0;
+		if (!service->IsReachable())
+			set(StatisticUnreachable);
+	} else {
+		if (host->IsReachable()) {
+			if (host->GetState() == HostUp)
+				set(StatisticOK);
+			if (host->GetState() == HostDown)
+				set(StatisticCritical);
+		} else
+			set(StatisticUnreachable);
 	}
 
-	CheckableCheckStatistics ccs;
+	if (!checkable->GetLastCheckResult())
+		set(StatisticPending);
 
-	ccs.min_latency = min_latency;
-	ccs.max_latency = max_latency;
-	ccs.avg_latency = sum_latency / count_latency;
-	ccs.min_execution_time = min_execution_time;
-	ccs.max_execution_time = max_execution_time;
-	ccs.avg_execution_time = sum_execution_time / count_execution_time;
+	if (checkable->IsFlapping())
+		set(StatisticFlapping);
+	if (checkable->IsInDowntime())
+		set(StatisticInDowntime);
+	if (checkable->IsAcknowledged())
+		set(StatisticAcknowledged);
 
-	return ccs;
+	if (checkable->GetHandled())
+		set(StatisticHandled);
+	if (checkable->GetProblem())
+		set(StatisticProblem);
+
+	return flags;
 }
 
-ServiceStatistics CIB::CalculateServiceStats()
+/**
+ * Replaces what a checkable contributes to the per-state counters.
+ *
+ * @param checkable The checkable
+ * @param count Start counting the checkable if it isn't yet
+ * @param uncount Stop counting the checkable
+ */
+void CIB::SetCheckableStatisticsFlags(const Checkable::Ptr& checkable, bool count, bool uncount)
 {
-	ServiceStatistics ss = {};
+	auto& counters (dynamic_pointer_cast<Host>(checkable) ? l_HostStatistics : l_ServiceStatistics);
 
-	for (const Service::Ptr& service : ConfigType::GetObjectsByType<Service>()) {
-		ObjectLock olock(service);
+	std::unique_lock<std::mutex> lock (checkable->m_StatisticsMutex);
 
-		if (service->GetState() == ServiceOK)
-			ss.services_ok++;
-		if (service->GetState() == ServiceWarning)
-			ss.services_warning++;
-		if (service->GetState() == ServiceCritical)
-			ss.services_critical++;
-		if (service->GetState() == ServiceUnknown)
-			ss.services_unknown++;
+	if (!checkable->m_StatisticsCounted && !count)
+		return;
 
-		CheckResult::Ptr cr = service->GetLastCheckResult();
+	uint_fast32_t oldFlags = checkable->m_StatisticsCounted ? checkable->m_StatisticsFlags : 0;
+	uint_fast32_t newFlags = uncount ? 0 : GetCheckableStatisticsFlags(checkable);
 
-		if (!cr)
-			ss.services_pending++;
+	for (int statistic = 0; statistic < StatisticCount; statistic++) {
+		bool before = oldFlags & (1u << statistic);
+		bool after = newFlags & (1u << statistic);
 
-		if (!service->IsReachable())
-			ss.services_unreachable++;
-
-		if (service->IsFlapping())
-			ss.services_flapping++;
-		if (service->IsInDowntime())
-			ss.services_in_downtime++;
-		if (service->IsAcknowledged())
-			ss.services_acknowledged++;
-
-		if (service->GetHandled())
-			ss.services_handled++;
-		if (service->GetProblem())
-			ss.services_problem++;
+		if (before != after)
+			counters[statistic].fetch_add(after ? 1 : -1);
 	}
 
-	return ss;
+	checkable->m_StatisticsFlags = newFlags;
+	checkable->m_StatisticsCounted = !uncount;
 }
 
-HostStatistics CIB::CalculateHostStats()
+/**
+ * Starts counting a checkable in the per-state statistics.
+ */
+void CIB::AddCheckableStatistics(const Checkable::Ptr& checkable)
 {
-	HostStatistics hs = {};
+	SetCheckableStatisticsFlags(checkable, true, false);
 
-	for (const Host::Ptr& host : ConfigType::GetObjectsByType<Host>()) {
-		ObjectLock olock(host);
+	static boost::once_flag once = BOOST_ONCE_INIT;
 
-		if (host->IsReachable()) {
-			if (host->GetState() == HostUp)
-				hs.hosts_up++;
-			if (host->GetState() == HostDown)
-				hs.hosts_down++;
-		} else
-			hs.hosts_unreachable++;
-
-		if (!host->GetLastCheckResult())
-			hs.hosts_pending++;
-
-		if (host->IsFlapping())
-			hs.hosts_flapping++;
-		if (host->IsInDowntime())
-			hs.hosts_in_downtime++;
-		if (host->IsAcknowledged())
-			hs.hosts_acknowledged++;
-
-		if (host->GetHandled())
-			hs.hosts_handled++;
-		if (host->GetProblem())
-			hs.hosts_problem++;
-	}
+	boost::call_once(once, []() {
+		l_ReconcileTimer = new Timer();
+		l_ReconcileTimer->SetInterval(l_ReconcileInterval);
+		l_ReconcileTimer->OnTimerExpired.connect([](const Timer * const&) { ReconcileStatistics(); });
+		l_ReconcileTimer->Start();
+	});
+}
 
-	return hs;
+/**
+ * Re-evaluates what a checkable contributes to the per-state statistics
+ * after something they look at may have changed.
+ */
+void CIB::UpdateCheckableStatistics(const Checkable::Ptr& checkable)
+{
+	SetCheckableStatisticsFlags(checkable, false, false);
+}
+
+/**
+ * Stops counting a checkable in the per-state statistics.
+ */
+void CIB::RemoveCheckableStatistics(const Checkable::Ptr& checkable)
+{
+	SetCheckableStatisticsFlags(checkable, false, true);
+}
+
+/**
+ * Re-evaluates all checkables. Catches changes nothing signals, e.g.
+ * downtimes and dependency periods which begin or end over time, and
+ * refreshes the check statistics.
+ */
+void CIB::ReconcileStatistics()
+{
+	for (Host *host : ConfigType::GetObjectsViewByType<Host>())
+		UpdateCheckableStatistics(host);
+
+	for (Service *service : ConfigType::GetObjectsViewByType<Service>())
+		UpdateCheckableStatistics(service);
+
+	CheckableCheckStatistics hostCheckStats = CalculateCheckStats<Host>();
+	CheckableCheckStatistics serviceCheckStats = CalculateCheckStats<Service>();
+
+	std::unique_lock<std::mutex> lock (m_CheckStatsMutex);
+
+	m_HostCheckStats = hostCheckStats;
+	m_ServiceCheckStats = serviceCheckStats;
+	m_CheckStatsUpdated = Utility::GetTime();
 }
 
 /*
@@ -263,19 +435,15 @@ std::pair<Dictionary::Ptr, Array::Ptr> CIB::GetFeatureStats()
 	Dictionary::Ptr status = new Dictionary();
 	Array::Ptr perfdata = new Array();
 
-	Namespace::Ptr statsFunctions = ScriptGlobal::Get("StatsFunctions", &Empty);
-
-	if (statsFunctions) {
-		ObjectLock olock(statsFunctions);
-
-		for (const Namespace::Pair& kv : statsFunctions)
-			static_cast<Function::Ptr>(kv.second->Get())->Invoke({ status, perfdata });
-	}
+	StatsFunctionCache::ForEach([&status, &perfdata](const String&, const StatsFunctionResult& result) {
+		result.Status->CopyTo(status);
+		result.Perfdata->CopyTo(perfdata);
+	});
 
 	return std::make_pair(status, perfdata);
 }
 
-REGISTER_STATSFUNCTION(CIB, &CIB::StatsFunc);
+REGISTER_STATSFUNCTION_TTL(CIB, &CIB::StatsFunc, 5);
 
 void CIB::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata) {
 	double interval = Utility::GetTime() - Application::GetStartTime();
@@ -7,10 +7,15 @@
 #include "base/ringbuffer.hpp"
 #include "base/dictionary.hpp"
 #include "base/array.hpp"
+#include <cstdint>
+#include <memory>
+#include <vector>
 
 namespace icinga
 {
 
+class Checkable;
+
 struct CheckableCheckStatistics {
 	double min_latency;
 	double max_latency;
@@ -76,14 +81,45 @@ public:
 
 	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 
+	static void AddCheckableStatistics(const intrusive_ptr<Checkable>& checkable);
+	static void UpdateCheckableStatistics(const intrusive_ptr<Checkable>& checkable);
+	static void RemoveCheckableStatistics(const intrusive_ptr<Checkable>& checkable);
+
+	static void StaticInitialize();
+
 private:
+	/**
+	 * A RingBuffer per shard, threads insert into their own shard so
+	 * concurrent check results don't contend for one mutex. Readers sum up
+	 * all shards.
+	 */
+	class ShardedRingBuffer
+	{
+	public:
+		ShardedRingBuffer(RingBuffer::SizeType slots);
+
+		void InsertValue(RingBuffer::SizeType tv, int num);
+		int UpdateAndGetValues(RingBuffer::SizeType tv, RingBuffer::SizeType span);
+
+	private:
+		std::vector<std::unique_ptr<RingBuffer>> m_Shards;
+	};
+
 	CIB();
 
-	static std::mutex m_Mutex;
-	static RingBuffer m_ActiveHostChecksStatistics;
-	static RingBuffer m_PassiveHostChecksStatistics;
-	static RingBuffer m_ActiveServiceChecksStatistics;
-	static RingBuffer m_PassiveServiceChecksStatistics;
+	static ShardedRingBuffer m_ActiveHostChecksStatistics;
+	static ShardedRingBuffer m_PassiveHostChecksStatistics;
+	static ShardedRingBuffer m_ActiveServiceChecksStatistics;
+	static ShardedRingBuffer m_PassiveServiceChecksStatistics;
+
+	static std::mutex m_CheckStatsMutex;
+	static double m_CheckStatsUpdated;
+	static CheckableCheckStatistics m_HostCheckStats;
+	static CheckableCheckStatistics m_ServiceCheckStats;
+
+	static uint_fast32_t GetCheckableStatisticsFlags(const intrusive_ptr<Checkable>& checkable);
+	static void SetCheckableStatisticsFlags(const intrusive_ptr<Checkable>& checkable, bool count, bool uncount);
+	static void ReconcileStatistics();
 };
 
 }
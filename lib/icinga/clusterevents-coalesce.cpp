@@ -0,0 +1,136 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icinga/clusterevents.hpp"
+#include "icinga/service.hpp"
+#include "remote/apilistener.hpp"
+#include "base/statsfunction.hpp"
+#include <boost/thread/once.hpp>
+#include <vector>
+
+using namespace icinga;
+
+REGISTER_STATSFUNCTION(ClusterEvents, &ClusterEvents::StatsFunc);
+
+std::mutex ClusterEvents::m_CoalescedEventsMutex;
+std::map<std::pair<Checkable::Ptr, ClusterEvents::CoalescedEvent>, MessageOrigin::Ptr> ClusterEvents::m_CoalescedEvents;
+std::atomic<uint_fast64_t> ClusterEvents::m_SuppressedEvents[CoalescedEventCount];
+Timer::Ptr ClusterEvents::m_CoalesceTimer;
+
+/* How long to collect changes of the same attribute before relaying only the latest one. */
+static const double l_CoalesceInterval = 0.25;
+
+static const struct {
+	const char *Method;
+	const char *Param;
+	const char *PerfdataName;
+} l_CoalescedEventTypes[] = {
+	{ "event::SetNextCheck", "next_check", "next_check" },
+	{ "event::SetLastCheckStarted", "last_check_started", "last_check_started" },
+	{ "event::SetSuppressedNotifications", "suppressed_notifications", "suppressed_notifications" },
+	{ "event::SetForceNextCheck", "forced", "force_next_check" }
+};
+
+/**
+ * Relay a changed attribute of a checkable within the next l_CoalesceInterval.
+ *
+ * If the attribute changes again meanwhile, only its latest value is relayed, e.g.
+ * next_check is often updated several times in a row while processing a check result.
+ *
+ * @param checkable The changed checkable
+ * @param event Which attribute has changed
+ * @param origin Where the change came from, the latest one wins
+ */
+void ClusterEvents::CoalesceEvent(const Checkable::Ptr& checkable, CoalescedEvent event, const MessageOrigin::Ptr& origin)
+{
+	if (!ApiListener::GetInstance())
+		return;
+
+	static boost::once_flag once = BOOST_ONCE_INIT;
+
+	boost::call_once(once, []() {
+		m_CoalesceTimer = new Timer();
+		m_CoalesceTimer->SetInterval(l_CoalesceInterval);
+		m_CoalesceTimer->OnTimerExpired.connect([](const Timer * const&) { FlushCoalescedEvents(); });
+		m_CoalesceTimer->Start();
+	});
+
+	std::unique_lock<std::mutex> lock (m_CoalescedEventsMutex);
+	auto result (m_CoalescedEvents.emplace(std::make_pair(checkable, event), origin));
+
+	if (!result.second) {
+		result.first->second = origin;
+		m_SuppressedEvents[event].fetch_add(1);
+	}
+}
+
+void ClusterEvents::FlushCoalescedEvents()
+{
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	decltype(m_CoalescedEvents) events;
+
+	{
+		std::unique_lock<std::mutex> lock (m_CoalescedEventsMutex);
+		std::swap(events, m_CoalescedEvents);
+	}
+
+	if (!listener)
+		return;
+
+	for (auto& kv : events) {
+		const Checkable::Ptr& checkable (kv.first.first);
+		CoalescedEvent event (kv.first.second);
+		auto& type (l_CoalescedEventTypes[event]);
+
+		Host::Ptr host;
+		Service::Ptr service;
+		tie(host, service) = GetHostService(checkable);
+
+		Dictionary::Ptr params = new Dictionary();
+		params->Set("host", host->GetName());
+		if (service)
+			params->Set("service", service->GetShortName());
+
+		switch (event) {
+			case CoalescedNextCheck:
+				params->Set(type.Param, checkable->GetNextCheck());
+				break;
+			case CoalescedLastCheckStarted:
+				params->Set(type.Param, checkable->GetLastCheckStarted());
+				break;
+			case CoalescedSuppressedNotifications:
+				params->Set(type.Param, checkable->GetSuppressedNotifications());
+				break;
+			case CoalescedForceNextCheck:
+				params->Set(type.Param, checkable->GetForceNextCheck());
+				break;
+			default:
+				VERIFY(!"Invalid coalesced event.");
+		}
+
+		Dictionary::Ptr message = new Dictionary();
+		message->Set("jsonrpc", "2.0");
+		message->Set("method", type.Method);
+		message->Set("params", params);
+
+		/* Suppressed notifications have always been relayed without the checkable as security object. */
+		listener->RelayMessage(kv.second, event == CoalescedSuppressedNotifications ? nullptr : checkable, message, true);
+	}
+}
+
+void ClusterEvents::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
+{
+	Dictionary::Ptr suppressed = new Dictionary();
+
+	for (int event = 0; event < CoalescedEventCount; event++) {
+		auto& type (l_CoalescedEventTypes[event]);
+		double count = m_SuppressedEvents[event].load();
+
+		suppressed->Set(type.Method, count);
+		perfdata->Add(new PerfdataValue("clusterevents_suppressed_" + String(type.PerfdataName), count));
+	}
+
+	status->Set("clusterevents", new Dictionary({
+		{ "suppressed", suppressed }
+	}));
+}
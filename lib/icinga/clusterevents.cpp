@@ -55,9 +55,171 @@ void ClusterEvents::StaticInitialize()
 
 	Checkable::OnAcknowledgementSet.connect(&ClusterEvents::AcknowledgementSetHandler);
 	Checkable::OnAcknowledgementCleared.connect(&ClusterEvents::AcknowledgementClearedHandler);
+
+	RegisterReplayLogCompaction();
+	RegisterReplayLogSnapshot();
+}
+
+/**
+ * Adds the state of hosts and services to the snapshots a reconnecting endpoint
+ * gets instead of a long replay log: the last check result, the next check and
+ * the acknowledgement.
+ */
+void ClusterEvents::RegisterReplayLogSnapshot()
+{
+	ReplayLogSnapshot::Register([](const Zone::Ptr& zone, double since, const ReplayLogSnapshot::EmitFunc& emit) {
+		auto addCheckable ([&zone, since, &emit](const Checkable::Ptr& checkable) {
+			if (!zone->CanAccessObject(checkable))
+				return;
+
+			Host::Ptr host;
+			Service::Ptr service;
+			tie(host, service) = GetHostService(checkable);
+
+			auto makeMessage ([&host, &service](const String& method, const Dictionary::Ptr& params) {
+				params->Set("host", host->GetName());
+
+				if (service)
+					params->Set("service", service->GetShortName());
+
+				return new Dictionary({
+					{ "jsonrpc", "2.0" },
+					{ "method", method },
+					{ "params", params }
+				});
+			});
+
+			CheckResult::Ptr cr = checkable->GetLastCheckResult();
+
+			if (cr && cr->GetExecutionEnd() > since) {
+				Dictionary::Ptr message = MakeCheckResultMessage(checkable, cr);
+				Dictionary::Ptr(message->Get("params"))->Set("snapshot", true);
+				emit(message);
+			}
+
+			emit(makeMessage("event::SetNextCheck", new Dictionary({
+				{ "next_check", checkable->GetNextCheck() }
+			})));
+
+			if (checkable->IsAcknowledged()) {
+				String author, text;
+
+				for (const Comment::Ptr& comment : checkable->GetComments()) {
+					if (comment->GetEntryType() == CommentAcknowledgement) {
+						author = comment->GetAuthor();
+						text = comment->GetText();
+						break;
+					}
+				}
+
+				/* The acknowledgement comment itself is synced as a runtime object. */
+				emit(makeMessage("event::SetAcknowledgement", new Dictionary({
+					{ "author", author },
+					{ "comment", text },
+					{ "acktype", checkable->GetAcknowledgementRaw() },
+					{ "notify", false },
+					{ "persistent", false },
+					{ "expiry", checkable->GetAcknowledgementExpiry() },
+					{ "change_time", checkable->GetAcknowledgementLastChange() }
+				})));
+			} else if (checkable->GetAcknowledgementLastChange() > since) {
+				emit(makeMessage("event::ClearAcknowledgement", new Dictionary({
+					{ "author", "" },
+					{ "change_time", checkable->GetAcknowledgementLastChange() }
+				})));
+			}
+		});
+
+		for (const Host::Ptr& host : ConfigType::GetObjectsByType<Host>())
+			addCheckable(host);
+
+		for (const Service::Ptr& service : ConfigType::GetObjectsByType<Service>())
+			addCheckable(service);
+	});
+}
+
+/**
+ * Tells the replay log which messages only set state a later message of the same kind overwrites.
+ * Anything else (notifications, acknowledgements, ...) is always replayed.
+ */
+void ClusterEvents::RegisterReplayLogCompaction()
+{
+	auto checkableKey ([](const String& method) {
+		return [method](const Dictionary::Ptr& params) -> String {
+			return method + "!" + params->Get("host") + "!" + params->Get("service");
+		};
+	});
+
+	auto notificationKey ([](const String& method) {
+		return [method](const Dictionary::Ptr& params) -> String {
+			return method + "!" + params->Get("notification");
+		};
+	});
+
+	for (const char *method : {
+		"event::SetNextCheck", "event::SetLastCheckStarted", "event::SetForceNextCheck",
+		"event::SetForceNextNotification", "event::SetSuppressedNotifications"
+	}) {
+		ReplayLogCompaction::Register(method, { checkableKey(method), nullptr });
+	}
+
+	for (const char *method : { "event::SetNextNotification", "event::SetSuppressedNotificationTypes" }) {
+		ReplayLogCompaction::Register(method, { notificationKey(method), nullptr });
+	}
+
+	/* The receiver needs every state change and enough results after it to reach the hard state. */
+	ReplayLogCompaction::Register("event::CheckResult", { checkableKey("event::CheckResult"),
+		[](const Dictionary::Ptr& params, Value& state) {
+			Dictionary::Ptr cr = params->Get("cr");
+
+			if (!cr)
+				return true;
+
+			Host::Ptr host = Host::GetByName(params->Get("host"));
+
+			if (!host)
+				return true;
+
+			Checkable::Ptr checkable;
+
+			if (params->Contains("service"))
+				checkable = host->GetServiceByShortName(params->Get("service"));
+			else
+				checkable = host;
+
+			if (!checkable)
+				return true;
+
+			Dictionary::Ptr previous = state;
+			double newState = cr->Get("state");
+
+			if (!previous || previous->Get("state") != newState) {
+				state = new Dictionary({
+					{ "state", newState },
+					{ "attempts", 1 }
+				});
+
+				return true;
+			}
+
+			double attempts = previous->Get("attempts");
+			previous->Set("attempts", attempts + 1);
+
+			return attempts < checkable->GetMaxCheckAttempts();
+		}
+	});
 }
 
-Dictionary::Ptr ClusterEvents::MakeCheckResultMessage(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr)
+/**
+ * Serializes a check result for event::CheckResult.
+ *
+ * The compact variant is for endpoints with ApiCapabilities::CompactCheckResults.
+ * It omits what the receiver can tell by itself: vars_before and vars_after
+ * (see Checkable::ProcessCheckResult()), the command line (the receiver uses the
+ * name of the check command), the check source if it's the sender and default values.
+ * Parsed performance data is sent as strings.
+ */
+Dictionary::Ptr ClusterEvents::MakeCheckResultMessage(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr, bool compact)
 {
 	Dictionary::Ptr message = new Dictionary();
 	message->Set("jsonrpc", "2.0");
@@ -77,7 +239,51 @@ Dictionary::Ptr ClusterEvents::MakeCheckResultMessage(const Checkable::Ptr& chec
 		if (!agent_service_name.IsEmpty())
 			params->Set("service", agent_service_name);
 	}
-	params->Set("cr", Serialize(cr));
+
+	if (compact) {
+		Dictionary::Ptr vcr = Serialize(cr);
+
+		vcr->Remove("vars_before");
+		vcr->Remove("vars_after");
+		vcr->Remove("command");
+
+		if (cr->GetActive())
+			vcr->Remove("active");
+
+		if (cr->GetTtl() == 0)
+			vcr->Remove("ttl");
+
+		Endpoint::Ptr localEndpoint = Endpoint::GetLocalEndpoint();
+
+		if (localEndpoint && cr->GetCheckSource() == localEndpoint->GetName())
+			vcr->Remove("check_source");
+
+		Array::Ptr perfdata = cr->GetPerformanceData();
+		ArrayData vperf;
+
+		if (perfdata) {
+			ObjectLock olock(perfdata);
+
+			for (const Value& pdv : perfdata) {
+				if (pdv.IsObjectType<PerfdataValue>())
+					vperf.emplace_back(static_cast<PerfdataValue::Ptr>(pdv)->Format());
+				else
+					vperf.emplace_back(pdv);
+			}
+		}
+
+		vcr->Set("performance_data", new Array(std::move(vperf)));
+
+		params->Set("cr", vcr);
+		params->Set("compact", true);
+	} else {
+		params->Set("cr", Serialize(cr));
+	}
+
+	TraceContext trace = cr->GetTraceContext();
+
+	if (trace.IsSampled())
+		params->Set("trace", trace.ToString());
 
 	message->Set("params", params);
 
@@ -92,7 +298,12 @@ void ClusterEvents::CheckResultHandler(const Checkable::Ptr& checkable, const Ch
 		return;
 
 	Dictionary::Ptr message = MakeCheckResultMessage(checkable, cr);
-	listener->RelayMessage(origin, checkable, message, true);
+	Dictionary::Ptr compactMessage;
+
+	if (listener->GetCompactCheckResults())
+		compactMessage = MakeCheckResultMessage(checkable, cr, true);
+
+	listener->RelayMessage(origin, checkable, message, true, compactMessage);
 }
 
 Value ClusterEvents::CheckResultAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
@@ -143,6 +354,9 @@ Value ClusterEvents::CheckResultAPIHandler(const MessageOrigin::Ptr& origin, con
 
 	cr->SetPerformanceData(new Array(std::move(rperf)));
 
+	if (params->Contains("trace"))
+		cr->SetTraceContext(TraceContext::Parse(params->Get("trace")));
+
 	Host::Ptr host = Host::GetByName(params->Get("host"));
 
 	if (!host)
@@ -158,6 +372,27 @@ Value ClusterEvents::CheckResultAPIHandler(const MessageOrigin::Ptr& origin, con
 	if (!checkable)
 		return Empty;
 
+	/* A snapshot may be older than what the log has replayed in the meantime. */
+	if (params->Get("snapshot").ToBool()) {
+		CheckResult::Ptr lastCr = checkable->GetLastCheckResult();
+
+		if (lastCr && lastCr->GetExecutionEnd() >= cr->GetExecutionEnd())
+			return Empty;
+	}
+
+	/* Restore what MakeCheckResultMessage() left out. */
+	if (params->Get("compact").ToBool()) {
+		Dictionary::Ptr vcr = params->Get("cr");
+
+		if (!vcr->Contains("check_source"))
+			cr->SetCheckSource(endpoint->GetName());
+
+		CheckCommand::Ptr command = checkable->GetCheckCommand();
+
+		if (command)
+			cr->SetCommand(command->GetName());
+	}
+
 	if (origin->FromZone && !origin->FromZone->CanAccessObject(checkable) && endpoint != checkable->GetCommandEndpoint()) {
 		Log(LogNotice, "ClusterEvents")
 			<< "Discarding 'check result' message for checkable '" << checkable->GetName()
@@ -175,27 +410,7 @@ Value ClusterEvents::CheckResultAPIHandler(const MessageOrigin::Ptr& origin, con
 
 void ClusterEvents::NextCheckChangedHandler(const Checkable::Ptr& checkable, const MessageOrigin::Ptr& origin)
 {
-	ApiListener::Ptr listener = ApiListener::GetInstance();
-
-	if (!listener)
-		return;
-
-	Host::Ptr host;
-	Service::Ptr service;
-	tie(host, service) = GetHostService(checkable);
-
-	Dictionary::Ptr params = new Dictionary();
-	params->Set("host", host->GetName());
-	if (service)
-		params->Set("service", service->GetShortName());
-	params->Set("next_check", checkable->GetNextCheck());
-
-	Dictionary::Ptr message = new Dictionary();
-	message->Set("jsonrpc", "2.0");
-	message->Set("method", "event::SetNextCheck");
-	message->Set("params", params);
-
-	listener->RelayMessage(origin, checkable, message, true);
+	CoalesceEvent(checkable, CoalescedNextCheck, origin);
 }
 
 Value ClusterEvents::NextCheckChangedAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
@@ -242,27 +457,7 @@ Value ClusterEvents::NextCheckChangedAPIHandler(const MessageOrigin::Ptr& origin
 
 void ClusterEvents::LastCheckStartedChangedHandler(const Checkable::Ptr& checkable, const MessageOrigin::Ptr& origin)
 {
-	ApiListener::Ptr listener = ApiListener::GetInstance();
-
-	if (!listener)
-		return;
-
-	Host::Ptr host;
-	Service::Ptr service;
-	tie(host, service) = GetHostService(checkable);
-
-	Dictionary::Ptr params = new Dictionary();
-	params->Set("host", host->GetName());
-	if (service)
-		params->Set("service", service->GetShortName());
-	params->Set("last_check_started", checkable->GetLastCheckStarted());
-
-	Dictionary::Ptr message = new Dictionary();
-	message->Set("jsonrpc", "2.0");
-	message->Set("method", "event::SetLastCheckStarted");
-	message->Set("params", params);
-
-	listener->RelayMessage(origin, checkable, message, true);
+	CoalesceEvent(checkable, CoalescedLastCheckStarted, origin);
 }
 
 Value ClusterEvents::LastCheckStartedChangedAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
@@ -304,27 +499,7 @@ Value ClusterEvents::LastCheckStartedChangedAPIHandler(const MessageOrigin::Ptr&
 
 void ClusterEvents::SuppressedNotificationsChangedHandler(const Checkable::Ptr& checkable, const MessageOrigin::Ptr& origin)
 {
-	ApiListener::Ptr listener = ApiListener::GetInstance();
-
-	if (!listener)
-		return;
-
-	Host::Ptr host;
-	Service::Ptr service;
-	tie(host, service) = GetHostService(checkable);
-
-	Dictionary::Ptr params = new Dictionary();
-	params->Set("host", host->GetName());
-	if (service)
-		params->Set("service", service->GetShortName());
-	params->Set("suppressed_notifications", checkable->GetSuppressedNotifications());
-
-	Dictionary::Ptr message = new Dictionary();
-	message->Set("jsonrpc", "2.0");
-	message->Set("method", "event::SetSuppressedNotifications");
-	message->Set("params", params);
-
-	listener->RelayMessage(origin, nullptr, message, true);
+	CoalesceEvent(checkable, CoalescedSuppressedNotifications, origin);
 }
 
 Value ClusterEvents::SuppressedNotificationsChangedAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
@@ -463,27 +638,7 @@ Value ClusterEvents::NextNotificationChangedAPIHandler(const MessageOrigin::Ptr&
 
 void ClusterEvents::ForceNextCheckChangedHandler(const Checkable::Ptr& checkable, const MessageOrigin::Ptr& origin)
 {
-	ApiListener::Ptr listener = ApiListener::GetInstance();
-
-	if (!listener)
-		return;
-
-	Host::Ptr host;
-	Service::Ptr service;
-	tie(host, service) = GetHostService(checkable);
-
-	Dictionary::Ptr params = new Dictionary();
-	params->Set("host", host->GetName());
-	if (service)
-		params->Set("service", service->GetShortName());
-	params->Set("forced", checkable->GetForceNextCheck());
-
-	Dictionary::Ptr message = new Dictionary();
-	message->Set("jsonrpc", "2.0");
-	message->Set("method", "event::SetForceNextCheck");
-	message->Set("params", params);
-
-	listener->RelayMessage(origin, checkable, message, true);
+	CoalesceEvent(checkable, CoalescedForceNextCheck, origin);
 }
 
 Value ClusterEvents::ForceNextCheckChangedAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
@@ -8,6 +8,10 @@
 #include "icinga/checkcommand.hpp"
 #include "icinga/eventcommand.hpp"
 #include "icinga/notificationcommand.hpp"
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <utility>
 
 namespace icinga
 {
@@ -53,7 +57,7 @@ public:
 
 	static Value ExecuteCommandAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 
-	static Dictionary::Ptr MakeCheckResultMessage(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
+	static Dictionary::Ptr MakeCheckResultMessage(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr, bool compact = false);
 
 	static void SendNotificationsHandler(const Checkable::Ptr& checkable, NotificationType type,
 		const CheckResult::Ptr& cr, const String& author, const String& text, const MessageOrigin::Ptr& origin);
@@ -72,7 +76,21 @@ public:
 	static int GetCheckRequestQueueSize();
 	static void LogRemoteCheckQueueInformation();
 
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+
 private:
+	static void RegisterReplayLogCompaction();
+	static void RegisterReplayLogSnapshot();
+
+	enum CoalescedEvent
+	{
+		CoalescedNextCheck,
+		CoalescedLastCheckStarted,
+		CoalescedSuppressedNotifications,
+		CoalescedForceNextCheck,
+		CoalescedEventCount
+	};
+
 	static std::mutex m_Mutex;
 	static std::deque<std::function<void ()>> m_CheckRequestQueue;
 	static bool m_CheckSchedulerRunning;
@@ -83,6 +101,14 @@ private:
 	static void RemoteCheckThreadProc();
 	static void EnqueueCheck(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 	static void ExecuteCheckFromQueue(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
+
+	static std::mutex m_CoalescedEventsMutex;
+	static std::map<std::pair<Checkable::Ptr, CoalescedEvent>, MessageOrigin::Ptr> m_CoalescedEvents;
+	static std::atomic<uint_fast64_t> m_SuppressedEvents[CoalescedEventCount];
+	static Timer::Ptr m_CoalesceTimer;
+
+	static void CoalesceEvent(const Checkable::Ptr& checkable, CoalescedEvent event, const MessageOrigin::Ptr& origin);
+	static void FlushCoalescedEvents();
 };
 
 }
@@ -66,3 +66,41 @@ void Command::Validate(int types, const ValidationUtils& utils)
 		}
 	}
 }
+
+void Command::ValidateMaxOutputSize(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<Command>::ValidateMaxOutputSize(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "max_output_size" }, "Value must not be negative."));
+}
+
+static bool IsSameValue(const Value& lhs, const Value& rhs)
+{
+	if (lhs.IsObject() || rhs.IsObject())
+		return lhs.IsObject() && rhs.IsObject() && lhs.Get<Object::Ptr>() == rhs.Get<Object::Ptr>();
+
+	return lhs == rhs;
+}
+
+/**
+ * Returns the command line, arguments and environment compiled for
+ * MacroProcessor. They're compiled again once any of them is replaced.
+ *
+ * @returns The compiled command
+ */
+std::shared_ptr<CompiledCommand> Command::GetCompiledCommand()
+{
+	Value commandLine = GetCommandLine();
+	Dictionary::Ptr arguments = GetArguments();
+	Dictionary::Ptr env = GetEnv();
+
+	auto compiled (std::atomic_load(&m_CompiledCommand));
+
+	if (!compiled || !IsSameValue(compiled->CommandLine, commandLine) || compiled->Arguments != arguments || compiled->Env != env) {
+		compiled = MacroProcessor::CompileCommand(commandLine, arguments, env);
+		std::atomic_store(&m_CompiledCommand, compiled);
+	}
+
+	return compiled;
+}
@@ -6,10 +6,13 @@
 #include "icinga/i2-icinga.hpp"
 #include "icinga/command-ti.hpp"
 #include "remote/messageorigin.hpp"
+#include <memory>
 
 namespace icinga
 {
 
+struct CompiledCommand;
+
 /**
  * A command.
  *
@@ -23,6 +26,12 @@ public:
 	//virtual Dictionary::Ptr Execute(const Object::Ptr& context) = 0;
 
 	void Validate(int types, const ValidationUtils& utils) override;
+	void ValidateMaxOutputSize(const Lazy<int>& lvalue, const ValidationUtils& utils) final;
+
+	std::shared_ptr<CompiledCommand> GetCompiledCommand();
+
+private:
+	std::shared_ptr<CompiledCommand> m_CompiledCommand;
 };
 
 }
@@ -82,6 +82,7 @@ void Comment::Start(bool runtimeCreated)
 	boost::call_once(once, [this]() {
 		l_CommentsExpireTimer = new Timer();
 		l_CommentsExpireTimer->SetInterval(60);
+		l_CommentsExpireTimer->SetSlack(10);
 		l_CommentsExpireTimer->OnTimerExpired.connect([](const Timer * const&) { CommentsExpireTimerHandler(); });
 		l_CommentsExpireTimer->Start();
 	});
@@ -129,16 +130,9 @@ int Comment::GetNextCommentID()
 	return l_NextCommentID;
 }
 
-String Comment::AddComment(const Checkable::Ptr& checkable, CommentType entryType, const String& author,
-	const String& text, bool persistent, double expireTime, const String& id, const MessageOrigin::Ptr& origin)
+static Dictionary::Ptr GetCommentAttrs(const Checkable::Ptr& checkable, const String& fullName, CommentType entryType,
+	const String& author, const String& text, bool persistent, double expireTime)
 {
-	String fullName;
-
-	if (id.IsEmpty())
-		fullName = checkable->GetName() + "!" + Utility::NewUniqueID();
-	else
-		fullName = id;
-
 	Dictionary::Ptr attrs = new Dictionary();
 
 	attrs->Set("author", author);
@@ -161,11 +155,24 @@ String Comment::AddComment(const Checkable::Ptr& checkable, CommentType entryTyp
 	if (!zone.IsEmpty())
 		attrs->Set("zone", zone);
 
-	String config = ConfigObjectUtility::CreateObjectConfig(Comment::TypeInstance, fullName, true, nullptr, attrs);
+	return ConfigObjectUtility::CreateObjectAttrs(Comment::TypeInstance, fullName, attrs);
+}
+
+String Comment::AddComment(const Checkable::Ptr& checkable, CommentType entryType, const String& author,
+	const String& text, bool persistent, double expireTime, const String& id, const MessageOrigin::Ptr& origin)
+{
+	String fullName;
+
+	if (id.IsEmpty())
+		fullName = checkable->GetName() + "!" + Utility::NewUniqueID();
+	else
+		fullName = id;
+
+	Dictionary::Ptr attrs = GetCommentAttrs(checkable, fullName, entryType, author, text, persistent, expireTime);
 
 	Array::Ptr errors = new Array();
 
-	if (!ConfigObjectUtility::CreateObject(Comment::TypeInstance, fullName, config, errors, nullptr)) {
+	if (!ConfigObjectUtility::CreateJournaledObjects(Comment::TypeInstance, { { fullName, attrs } }, true, errors, nullptr)) {
 		ObjectLock olock(errors);
 		for (const String& error : errors) {
 			Log(LogCritical, "Comment", error);
@@ -185,6 +192,55 @@ String Comment::AddComment(const Checkable::Ptr& checkable, CommentType entryTyp
 	return fullName;
 }
 
+/**
+ * Like AddComment(), but for many checkables at once.
+ *
+ * The comments are created as one batch which is way cheaper than
+ * creating them one by one, e.g. for an API action applied to a filter.
+ *
+ * @return The names of the comments in the order of the checkables
+ */
+std::vector<String> Comment::AddComments(const std::vector<intrusive_ptr<Checkable>>& checkables, CommentType entryType,
+	const String& author, const String& text, bool persistent, double expireTime)
+{
+	std::vector<std::pair<String, Dictionary::Ptr>> objects;
+
+	objects.reserve(checkables.size());
+
+	for (auto& checkable : checkables) {
+		String fullName = checkable->GetName() + "!" + Utility::NewUniqueID();
+
+		objects.emplace_back(fullName, GetCommentAttrs(checkable, fullName, entryType, author, text, persistent, expireTime));
+	}
+
+	Array::Ptr errors = new Array();
+
+	if (!ConfigObjectUtility::CreateJournaledObjects(Comment::TypeInstance, objects, true, errors, nullptr)) {
+		ObjectLock olock(errors);
+		for (const String& error : errors) {
+			Log(LogCritical, "Comment", error);
+		}
+
+		BOOST_THROW_EXCEPTION(std::runtime_error("Could not create comments."));
+	}
+
+	std::vector<String> names;
+
+	names.reserve(objects.size());
+
+	for (auto& object : objects) {
+		if (!Comment::GetByName(object.first))
+			BOOST_THROW_EXCEPTION(std::runtime_error("Could not create comment."));
+
+		names.emplace_back(object.first);
+	}
+
+	Log(LogNotice, "Comment")
+		<< "Added " << names.size() << " comments.";
+
+	return names;
+}
+
 void Comment::RemoveComment(const String& id, const MessageOrigin::Ptr& origin)
 {
 	Comment::Ptr comment = Comment::GetByName(id);
@@ -221,13 +277,8 @@ String Comment::GetCommentIDFromLegacyID(int id)
 
 void Comment::CommentsExpireTimerHandler()
 {
-	std::vector<Comment::Ptr> comments;
-
-	for (const Comment::Ptr& comment : ConfigType::GetObjectsByType<Comment>()) {
-		comments.push_back(comment);
-	}
-
-	for (const Comment::Ptr& comment : comments) {
+	/* The snapshot doesn't change while we remove comments. */
+	for (Comment *comment : ConfigType::GetObjectsViewByType<Comment>()) {
 		/* Only remove comments which are activated after daemon start. */
 		if (comment->IsActive() && comment->IsExpired()) {
 			/* Do not remove persistent comments from an acknowledgement */
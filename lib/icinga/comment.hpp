@@ -35,6 +35,9 @@ public:
 		const String& author, const String& text, bool persistent, double expireTime,
 		const String& id = String(), const MessageOrigin::Ptr& origin = nullptr);
 
+	static std::vector<String> AddComments(const std::vector<intrusive_ptr<Checkable>>& checkables, CommentType entryType,
+		const String& author, const String& text, bool persistent, double expireTime);
+
 	static void RemoveComment(const String& id, const MessageOrigin::Ptr& origin = nullptr);
 
 	static String GetCommentIDFromLegacyID(int id);
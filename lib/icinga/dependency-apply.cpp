@@ -136,12 +136,9 @@ void Dependency::EvaluateApplyRules(const Host::Ptr& host)
 {
 	CONTEXT("Evaluating 'apply' rules for host '" + host->GetName() + "'");
 
-	for (ApplyRule& rule : ApplyRule::GetRules("Dependency")) {
-		if (rule.GetTargetType() != "Host")
-			continue;
-
-		if (EvaluateApplyRule(host, rule))
-			rule.AddMatch();
+	for (ApplyRule *rule : ApplyRule::GetCandidateRules("Dependency", "Host", new Dictionary({ { "host", host } }))) {
+		if (EvaluateApplyRule(host, *rule))
+			rule->AddMatch();
 	}
 }
 
@@ -149,11 +146,8 @@ void Dependency::EvaluateApplyRules(const Service::Ptr& service)
 {
 	CONTEXT("Evaluating 'apply' rules for service '" + service->GetName() + "'");
 
-	for (ApplyRule& rule : ApplyRule::GetRules("Dependency")) {
-		if (rule.GetTargetType() != "Service")
-			continue;
-
-		if (EvaluateApplyRule(service, rule))
-			rule.AddMatch();
+	for (ApplyRule *rule : ApplyRule::GetCandidateRules("Dependency", "Service", new Dictionary({ { "host", service->GetHost() }, { "service", service } }))) {
+		if (EvaluateApplyRule(service, *rule))
+			rule->AddMatch();
 	}
 }
@@ -3,13 +3,20 @@
 #include "icinga/dependency.hpp"
 #include "icinga/dependency-ti.cpp"
 #include "icinga/service.hpp"
+#include "config/configitem.hpp"
+#include "base/initialize.hpp"
 #include "base/logger.hpp"
 #include "base/exception.hpp"
+#include <algorithm>
 
 using namespace icinga;
 
 REGISTER_TYPE(Dependency);
 
+INITIALIZE_ONCE([]() {
+	ConfigItem::OnObjectsLoaded.connect(&Dependency::LinkLoadedDependencies);
+});
+
 String DependencyNameComposer::MakeName(const String& shortName, const Object::Ptr& context) const
 {
 	Dependency::Ptr dependency = dynamic_pointer_cast<Dependency>(context);
@@ -87,8 +94,31 @@ void Dependency::OnAllConfigLoaded()
 	if (!m_Parent)
 		BOOST_THROW_EXCEPTION(ScriptError("Dependency '" + GetName() + "' references a parent host/service which doesn't exist.", GetDebugInfo()));
 
-	m_Child->AddDependency(this);
-	m_Parent->AddReverseDependency(this);
+	/* The child and the parent learn about us in LinkLoadedDependencies(). */
+}
+
+/**
+ * Adds all dependencies which have just been loaded to their children and
+ * parents at once, rather than each of them locking and searching the
+ * relations of a parent which may have hundreds of thousands of children.
+ */
+void Dependency::LinkLoadedDependencies(const Type::Ptr& type, const std::vector<ConfigObject::Ptr>& objects)
+{
+	if (type != Dependency::TypeInstance)
+		return;
+
+	std::vector<Dependency::Ptr> deps;
+
+	deps.reserve(objects.size());
+
+	for (auto& object : objects) {
+		auto dep (static_pointer_cast<Dependency>(object));
+
+		if (dep->m_Child && dep->m_Parent)
+			deps.emplace_back(std::move(dep));
+	}
+
+	Checkable::AddDependencies(deps);
 }
 
 void Dependency::Stop(bool runtimeRemoved)
@@ -99,7 +129,16 @@ void Dependency::Stop(bool runtimeRemoved)
 	GetParent()->RemoveReverseDependency(this);
 }
 
-bool Dependency::IsAvailable(DependencyType dt) const
+/**
+ * Checks whether the dependency's parent is in a state which allows its child
+ * to be reached.
+ *
+ * @param dt The dependency type to check
+ * @param validUntil If the result depends on the time period, it's lowered to
+ *                   the time at which the result may change
+ * @returns Whether the dependency is available
+ */
+bool Dependency::IsAvailable(DependencyType dt, double *validUntil) const
 {
 	Checkable::Ptr parent = GetParent();
 
@@ -149,7 +188,27 @@ bool Dependency::IsAvailable(DependencyType dt) const
 
 	/* ignore if not in time period */
 	TimePeriod::Ptr tp = GetPeriod();
-	if (tp && !tp->IsInside(Utility::GetTime())) {
+	double now = Utility::GetTime();
+
+	if (tp && validUntil) {
+		Value validBegin = tp->GetValidBegin();
+		Value validEnd = tp->GetValidEnd();
+
+		/* Outside of the valid region the result can't be predicted. */
+		double until = validEnd.IsEmpty() ? now : static_cast<double>(validEnd);
+
+		if (!validBegin.IsEmpty() && now < validBegin)
+			until = std::min(until, static_cast<double>(validBegin));
+
+		double transition = tp->FindNextTransition(now);
+
+		if (transition > now)
+			until = std::min(until, transition);
+
+		*validUntil = std::min(*validUntil, until);
+	}
+
+	if (tp && !tp->IsInside(now)) {
 		Log(LogNotice, "Dependency")
 			<< "Dependency '" << GetName() << "' passed: Outside time period.";
 		return true;
@@ -30,13 +30,15 @@ public:
 
 	TimePeriod::Ptr GetPeriod() const;
 
-	bool IsAvailable(DependencyType dt) const;
+	bool IsAvailable(DependencyType dt, double *validUntil = nullptr) const;
 
 	void ValidateStates(const Lazy<Array::Ptr>& lvalue, const ValidationUtils& utils) override;
 
 	static void EvaluateApplyRules(const intrusive_ptr<Host>& host);
 	static void EvaluateApplyRules(const intrusive_ptr<Service>& service);
 
+	static void LinkLoadedDependencies(const Type::Ptr& type, const std::vector<ConfigObject::Ptr>& objects);
+
 	/* Note: Only use them for unit test mocks. Prefer OnConfigLoaded(). */
 	void SetParent(intrusive_ptr<Checkable> parent);
 	void SetChild(intrusive_ptr<Checkable> child);
@@ -8,16 +8,45 @@
 #include "base/configtype.hpp"
 #include "base/utility.hpp"
 #include "base/timer.hpp"
+#include <atomic>
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/key_extractors.hpp>
 #include <boost/thread/once.hpp>
 
 using namespace icinga;
 
+struct DowntimeScheduleInfo
+{
+	Downtime::Ptr Object;
+	double Due;
+};
+
+typedef boost::multi_index_container<
+	DowntimeScheduleInfo,
+	boost::multi_index::indexed_by<
+		boost::multi_index::ordered_unique<boost::multi_index::member<DowntimeScheduleInfo, Downtime::Ptr, &DowntimeScheduleInfo::Object> >,
+		boost::multi_index::ordered_non_unique<boost::multi_index::member<DowntimeScheduleInfo, double, &DowntimeScheduleInfo::Due> >
+	>
+> DowntimeScheduleSet;
+
 static int l_NextDowntimeID = 1;
 static std::mutex l_DowntimeMutex;
 static std::map<int, String> l_LegacyDowntimesCache;
 static Timer::Ptr l_DowntimesExpireTimer;
 static Timer::Ptr l_DowntimesStartTimer;
 
+static std::mutex l_DowntimeScheduleMutex;
+
+/* Fixed downtimes by their start time, see DowntimesStartTimerHandler(). */
+static DowntimeScheduleSet l_StartingDowntimes;
+
+/* All downtimes by when they're going to expire, see DowntimesExpireTimerHandler(). */
+static DowntimeScheduleSet l_ExpiringDowntimes;
+
+/* Whether downtimes may have lost their ScheduledDowntime, see HasValidConfigOwner(). */
+static std::atomic<bool> l_DowntimeConfigOwnersChanged (true);
+
 boost::signals2::signal<void (const Downtime::Ptr&)> Downtime::OnDowntimeAdded;
 boost::signals2::signal<void (const Downtime::Ptr&)> Downtime::OnDowntimeRemoved;
 boost::signals2::signal<void (const Downtime::Ptr&)> Downtime::OnDowntimeStarted;
@@ -32,6 +61,19 @@ void Downtime::StaticInitialize()
 	ScriptGlobal::Set("Icinga.DowntimeNoChildren", "DowntimeNoChildren", true);
 	ScriptGlobal::Set("Icinga.DowntimeTriggeredChildren", "DowntimeTriggeredChildren", true);
 	ScriptGlobal::Set("Icinga.DowntimeNonTriggeredChildren", "DowntimeNonTriggeredChildren", true);
+
+	auto updateSchedule ([](const Downtime::Ptr& downtime, const Value&) { downtime->UpdateSchedule(); });
+
+	Downtime::OnStartTimeChanged.connect(updateSchedule);
+	Downtime::OnEndTimeChanged.connect(updateSchedule);
+	Downtime::OnTriggerTimeChanged.connect(updateSchedule);
+	Downtime::OnFixedChanged.connect(updateSchedule);
+	Downtime::OnDurationChanged.connect(updateSchedule);
+
+	ConfigObject::OnActiveChanged.connect([](const ConfigObject::Ptr& object, const Value&) {
+		if (!object->IsActive() && dynamic_pointer_cast<ScheduledDowntime>(object))
+			l_DowntimeConfigOwnersChanged.store(true);
+	});
 }
 
 String DowntimeNameComposer::MakeName(const String& shortName, const Object::Ptr& context) const
@@ -93,11 +135,13 @@ void Downtime::Start(bool runtimeCreated)
 	boost::call_once(once, [this]() {
 		l_DowntimesStartTimer = new Timer();
 		l_DowntimesStartTimer->SetInterval(5);
+		l_DowntimesStartTimer->SetSlack(1);
 		l_DowntimesStartTimer->OnTimerExpired.connect([](const Timer * const&){ DowntimesStartTimerHandler(); });
 		l_DowntimesStartTimer->Start();
 
 		l_DowntimesExpireTimer = new Timer();
 		l_DowntimesExpireTimer->SetInterval(60);
+		l_DowntimesExpireTimer->SetSlack(10);
 		l_DowntimesExpireTimer->OnTimerExpired.connect([](const Timer * const&) { DowntimesExpireTimerHandler(); });
 		l_DowntimesExpireTimer->Start();
 	});
@@ -114,6 +158,8 @@ void Downtime::Start(bool runtimeCreated)
 
 	checkable->RegisterDowntime(this);
 
+	UpdateSchedule();
+
 	if (runtimeCreated)
 		OnDowntimeAdded(this);
 
@@ -137,6 +183,64 @@ void Downtime::Stop(bool runtimeRemoved)
 		OnDowntimeRemoved(this);
 
 	ObjectImpl<Downtime>::Stop(runtimeRemoved);
+
+	std::unique_lock<std::mutex> lock (l_DowntimeScheduleMutex);
+
+	l_StartingDowntimes.erase(this);
+	l_ExpiringDowntimes.erase(this);
+}
+
+/**
+ * Puts the downtime into the schedules of the timer handlers by when it's due
+ * to be started and to expire. Must be called whenever one of these changes.
+ */
+void Downtime::UpdateSchedule()
+{
+	double expireTime;
+
+	if (GetFixed()) {
+		expireTime = GetEndTime();
+	} else if (GetTriggerTime() > 0) {
+		expireTime = GetTriggerTime() + GetDuration();
+	} else {
+		expireTime = GetEndTime();
+	}
+
+	std::unique_lock<std::mutex> lock (l_DowntimeScheduleMutex);
+
+	l_StartingDowntimes.erase(this);
+	l_ExpiringDowntimes.erase(this);
+
+	if (!GetStartCalled() || GetStopCalled())
+		return;
+
+	/* Flexible downtimes will be triggered on-demand. */
+	if (GetFixed())
+		l_StartingDowntimes.insert(DowntimeScheduleInfo{ this, GetStartTime() });
+
+	l_ExpiringDowntimes.insert(DowntimeScheduleInfo{ this, expireTime });
+}
+
+/**
+ * Takes the downtimes which are due out of a schedule.
+ *
+ * @param schedule l_StartingDowntimes or l_ExpiringDowntimes
+ * @param now The current time
+ */
+static std::vector<Downtime::Ptr> TakeDueDowntimes(DowntimeScheduleSet& schedule, double now)
+{
+	std::vector<Downtime::Ptr> downtimes;
+	std::unique_lock<std::mutex> lock (l_DowntimeScheduleMutex);
+
+	auto& idx (schedule.get<1>());
+	auto end (idx.upper_bound(now));
+
+	for (auto it (idx.begin()); it != end; ++it)
+		downtimes.emplace_back(it->Object);
+
+	idx.erase(idx.begin(), end);
+
+	return downtimes;
 }
 
 Checkable::Ptr Downtime::GetCheckable() const
@@ -206,19 +310,11 @@ int Downtime::GetNextDowntimeID()
 	return l_NextDowntimeID;
 }
 
-Downtime::Ptr Downtime::AddDowntime(const Checkable::Ptr& checkable, const String& author,
+static Dictionary::Ptr GetDowntimeAttrs(const Checkable::Ptr& checkable, const String& fullName, const String& author,
 	const String& comment, double startTime, double endTime, bool fixed,
 	const String& triggeredBy, double duration,
-	const String& scheduledDowntime, const String& scheduledBy,
-	const String& id, const MessageOrigin::Ptr& origin)
+	const String& scheduledDowntime, const String& scheduledBy)
 {
-	String fullName;
-
-	if (id.IsEmpty())
-		fullName = checkable->GetName() + "!" + Utility::NewUniqueID();
-	else
-		fullName = id;
-
 	Dictionary::Ptr attrs = new Dictionary();
 
 	attrs->Set("author", author);
@@ -269,11 +365,28 @@ Downtime::Ptr Downtime::AddDowntime(const Checkable::Ptr& checkable, const Strin
 	if (!zone.IsEmpty())
 		attrs->Set("zone", zone);
 
-	String config = ConfigObjectUtility::CreateObjectConfig(Downtime::TypeInstance, fullName, true, nullptr, attrs);
+	return ConfigObjectUtility::CreateObjectAttrs(Downtime::TypeInstance, fullName, attrs);
+}
+
+Downtime::Ptr Downtime::AddDowntime(const Checkable::Ptr& checkable, const String& author,
+	const String& comment, double startTime, double endTime, bool fixed,
+	const String& triggeredBy, double duration,
+	const String& scheduledDowntime, const String& scheduledBy,
+	const String& id, const MessageOrigin::Ptr& origin)
+{
+	String fullName;
+
+	if (id.IsEmpty())
+		fullName = checkable->GetName() + "!" + Utility::NewUniqueID();
+	else
+		fullName = id;
+
+	Dictionary::Ptr attrs = GetDowntimeAttrs(checkable, fullName, author, comment, startTime, endTime,
+		fixed, triggeredBy, duration, scheduledDowntime, scheduledBy);
 
 	Array::Ptr errors = new Array();
 
-	if (!ConfigObjectUtility::CreateObject(Downtime::TypeInstance, fullName, config, errors, nullptr)) {
+	if (!ConfigObjectUtility::CreateJournaledObjects(Downtime::TypeInstance, { { fullName, attrs } }, true, errors, nullptr)) {
 		ObjectLock olock(errors);
 		for (const String& error : errors) {
 			Log(LogCritical, "Downtime", error);
@@ -305,6 +418,73 @@ Downtime::Ptr Downtime::AddDowntime(const Checkable::Ptr& checkable, const Strin
 	return downtime;
 }
 
+/**
+ * Like AddDowntime(), but for many checkables at once.
+ *
+ * The downtimes are created as one batch which is way cheaper than
+ * creating them one by one, e.g. for an API action applied to a filter.
+ *
+ * @return The downtimes in the order of the checkables
+ */
+std::vector<Downtime::Ptr> Downtime::AddDowntimes(const std::vector<intrusive_ptr<Checkable>>& checkables,
+	const String& author, const String& comment, double startTime, double endTime, bool fixed,
+	const String& triggeredBy, double duration)
+{
+	std::vector<std::pair<String, Dictionary::Ptr>> objects;
+
+	objects.reserve(checkables.size());
+
+	for (auto& checkable : checkables) {
+		String fullName = checkable->GetName() + "!" + Utility::NewUniqueID();
+
+		objects.emplace_back(fullName, GetDowntimeAttrs(checkable, fullName, author, comment,
+			startTime, endTime, fixed, triggeredBy, duration, String(), String()));
+	}
+
+	Array::Ptr errors = new Array();
+
+	if (!ConfigObjectUtility::CreateJournaledObjects(Downtime::TypeInstance, objects, true, errors, nullptr)) {
+		ObjectLock olock(errors);
+		for (const String& error : errors) {
+			Log(LogCritical, "Downtime", error);
+		}
+
+		BOOST_THROW_EXCEPTION(std::runtime_error("Could not create downtimes."));
+	}
+
+	Array::Ptr triggers;
+
+	if (!triggeredBy.IsEmpty())
+		triggers = Downtime::GetByName(triggeredBy)->GetTriggers();
+
+	std::vector<Downtime::Ptr> downtimes;
+
+	downtimes.reserve(objects.size());
+
+	for (auto& object : objects) {
+		Downtime::Ptr downtime = Downtime::GetByName(object.first);
+
+		if (!downtime)
+			BOOST_THROW_EXCEPTION(std::runtime_error("Could not create downtime object."));
+
+		if (triggers) {
+			ObjectLock olock(triggers);
+			if (!triggers->Contains(object.first))
+				triggers->Add(object.first);
+		}
+
+		downtimes.emplace_back(std::move(downtime));
+	}
+
+	Log(LogInformation, "Downtime")
+		<< "Added " << downtimes.size() << " downtimes"
+		<< " between '" << Utility::FormatDateTime("%Y-%m-%d %H:%M:%S", startTime)
+		<< "' and '" << Utility::FormatDateTime("%Y-%m-%d %H:%M:%S", endTime) << "', author: '"
+		<< author << "', " << (fixed ? "fixed" : "flexible with " + Convert::ToString(duration) + "s duration");
+
+	return downtimes;
+}
+
 void Downtime::RemoveDowntime(const String& id, bool cancelled, bool expired, const MessageOrigin::Ptr& origin)
 {
 	Downtime::Ptr downtime = Downtime::GetByName(id);
@@ -415,13 +595,19 @@ String Downtime::GetDowntimeIDFromLegacyID(int id)
 	return it->second;
 }
 
+/**
+ * Starts the fixed downtimes whose start time has come.
+ */
 void Downtime::DowntimesStartTimerHandler()
 {
-	/* Start fixed downtimes. Flexible downtimes will be triggered on-demand. */
-	for (const Downtime::Ptr& downtime : ConfigType::GetObjectsByType<Downtime>()) {
-		if (downtime->IsActive() &&
-			downtime->CanBeTriggered() &&
-			downtime->GetFixed()) {
+	for (const Downtime::Ptr& downtime : TakeDueDowntimes(l_StartingDowntimes, Utility::GetTime())) {
+		/* Not yet activated, try again next time. */
+		if (!downtime->IsActive()) {
+			downtime->UpdateSchedule();
+			continue;
+		}
+
+		if (downtime->CanBeTriggered() && downtime->GetFixed()) {
 			/* Send notifications. */
 			OnDowntimeStarted(downtime);
 
@@ -431,18 +617,34 @@ void Downtime::DowntimesStartTimerHandler()
 	}
 }
 
+/**
+ * Removes the downtimes whose end has come. All downtimes owned by a
+ * ScheduledDowntime are only visited after one has been removed.
+ */
 void Downtime::DowntimesExpireTimerHandler()
 {
-	std::vector<Downtime::Ptr> downtimes;
+	std::vector<Downtime::Ptr> downtimes = TakeDueDowntimes(l_ExpiringDowntimes, Utility::GetTime());
 
-	for (const Downtime::Ptr& downtime : ConfigType::GetObjectsByType<Downtime>()) {
-		downtimes.push_back(downtime);
+	if (l_DowntimeConfigOwnersChanged.exchange(false)) {
+		/* Before all config is loaded, HasValidConfigOwner() considers any config owner valid. */
+		if (!ScheduledDowntime::AllConfigIsLoaded())
+			l_DowntimeConfigOwnersChanged.store(true);
+
+		for (Downtime *downtime : ConfigType::GetObjectsViewByType<Downtime>()) {
+			/* Only remove downtimes which are activated after daemon start. */
+			if (downtime->IsActive() && !downtime->GetConfigOwner().IsEmpty() && !downtime->HasValidConfigOwner())
+				RemoveDowntime(downtime->GetName(), false, true);
+		}
 	}
 
 	for (const Downtime::Ptr& downtime : downtimes) {
 		/* Only remove downtimes which are activated after daemon start. */
-		if (downtime->IsActive() && (downtime->IsExpired() || !downtime->HasValidConfigOwner()))
+		if (downtime->IsActive() && downtime->IsExpired()) {
 			RemoveDowntime(downtime->GetName(), false, true);
+		} else {
+			/* Not yet activated or the end has moved meanwhile, try again. */
+			downtime->UpdateSchedule();
+		}
 	}
 }
 
@@ -51,9 +51,14 @@ public:
 		const String& scheduledBy = String(), const String& id = String(),
 		const MessageOrigin::Ptr& origin = nullptr);
 
+	static std::vector<Ptr> AddDowntimes(const std::vector<intrusive_ptr<Checkable>>& checkables, const String& author,
+		const String& comment, double startTime, double endTime, bool fixed,
+		const String& triggeredBy, double duration);
+
 	static void RemoveDowntime(const String& id, bool cancelled, bool expired = false, const MessageOrigin::Ptr& origin = nullptr);
 
 	void TriggerDowntime();
+	void UpdateSchedule();
 
 	static String GetDowntimeIDFromLegacyID(int id);
 
@@ -18,3 +18,19 @@ void EventCommand::Execute(const Checkable::Ptr& checkable,
 		useResolvedMacros
 	});
 }
+
+/**
+ * Returns the queue limiting the executions of this command to max_concurrent_executions.
+ */
+ExecutionQueue& EventCommand::GetExecutionQueue()
+{
+	return m_ExecutionQueue;
+}
+
+void EventCommand::ValidateMaxConcurrentExecutions(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<EventCommand>::ValidateMaxConcurrentExecutions(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "max_concurrent_executions" }, "Value must not be negative."));
+}
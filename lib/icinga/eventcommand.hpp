@@ -5,6 +5,7 @@
 
 #include "icinga/eventcommand-ti.hpp"
 #include "icinga/checkable.hpp"
+#include "icinga/executionqueue.hpp"
 
 namespace icinga
 {
@@ -25,6 +26,13 @@ public:
 	virtual void Execute(const Checkable::Ptr& checkable,
 		const Dictionary::Ptr& resolvedMacros = nullptr,
 		bool useResolvedMacros = false);
+
+	ExecutionQueue& GetExecutionQueue();
+
+	void ValidateMaxConcurrentExecutions(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+
+private:
+	ExecutionQueue m_ExecutionQueue;
 };
 
 }
@@ -0,0 +1,180 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icinga/executionqueue.hpp"
+#include "icinga/eventcommand.hpp"
+#include "icinga/notificationcommand.hpp"
+#include "base/configtype.hpp"
+#include "base/metrics.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/statsfunction.hpp"
+
+using namespace icinga;
+
+ExecutionQueue ExecutionQueue::EventHandlers;
+ExecutionQueue ExecutionQueue::Notifications;
+
+REGISTER_STATSFUNCTION(ExecutionQueue, &ExecutionQueue::StatsFunc);
+
+static Gauge l_EventHandlersRunning ("icinga_event_handlers_running", "Event handlers being executed", "", []() {
+	return ExecutionQueue::EventHandlers.GetRunning();
+});
+
+static Gauge l_EventHandlersPending ("icinga_event_handlers_pending", "Event handlers waiting for a free slot", "", []() {
+	return ExecutionQueue::EventHandlers.GetPending();
+});
+
+static Gauge l_NotificationsRunning ("icinga_notifications_running", "Notifications being executed", "", []() {
+	return ExecutionQueue::Notifications.GetRunning();
+});
+
+static Gauge l_NotificationsPending ("icinga_notifications_pending", "Notifications waiting for a free slot", "", []() {
+	return ExecutionQueue::Notifications.GetPending();
+});
+
+/**
+ * Runs a task once fewer than limit tasks are running. The task must call
+ * Release() once its execution has finished.
+ *
+ * @param limit The number of tasks allowed to run at the same time, 0 for no limit
+ * @param key Identifies the execution, an empty one is never deduplicated
+ * @param task The task
+ * @return false if the task has been dropped as a duplicate of a pending one
+ */
+bool ExecutionQueue::Enqueue(int limit, const String& key, std::function<void()> task)
+{
+	{
+		std::unique_lock<std::mutex> lock (m_Mutex);
+
+		m_Limit = limit;
+
+		if (limit > 0 && m_Running >= static_cast<size_t>(limit)) {
+			if (!key.IsEmpty() && !m_PendingKeys.insert(key).second) {
+				m_Deduplicated++;
+				return false;
+			}
+
+			m_Pending.push_back({ key, std::move(task) });
+			return true;
+		}
+
+		m_Running++;
+	}
+
+	task();
+	return true;
+}
+
+/**
+ * Passes the slot of a finished execution to the next pending task.
+ */
+void ExecutionQueue::Release()
+{
+	std::function<void()> next;
+
+	{
+		std::unique_lock<std::mutex> lock (m_Mutex);
+
+		/* The limit may have been lowered in the meantime. */
+		if (m_Pending.empty() || (m_Limit > 0 && m_Running > static_cast<size_t>(m_Limit))) {
+			m_Running--;
+			return;
+		}
+
+		PendingExecution& pending = m_Pending.front();
+
+		if (!pending.Key.IsEmpty())
+			m_PendingKeys.erase(pending.Key);
+
+		next = std::move(pending.Task);
+		m_Pending.pop_front();
+	}
+
+	next();
+}
+
+size_t ExecutionQueue::GetRunning() const
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+	return m_Running;
+}
+
+size_t ExecutionQueue::GetPending() const
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+	return m_Pending.size();
+}
+
+uint_fast64_t ExecutionQueue::GetDeduplicated() const
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+	return m_Deduplicated;
+}
+
+Dictionary::Ptr ExecutionQueue::GetStats() const
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	return new Dictionary({
+		{ "limit", m_Limit },
+		{ "running", m_Running },
+		{ "pending", m_Pending.size() },
+		{ "deduplicated", m_Deduplicated }
+	});
+}
+
+/**
+ * Runs a task once both a command's queue and the global one admit it.
+ * The task calls done once its execution has finished.
+ */
+void ExecutionQueue::Run(ExecutionQueue& local, int localLimit, ExecutionQueue& global, int globalLimit,
+	const String& key, const Task& task)
+{
+	ExecutionQueue *localp = &local;
+	ExecutionQueue *globalp = &global;
+
+	/* The command's slot is held while waiting for a global one, so that its executions keep their order. */
+	local.Enqueue(localLimit, key, [localp, globalp, globalLimit, key, task]() {
+		bool queued = globalp->Enqueue(globalLimit, key, [localp, globalp, task]() {
+			task([localp, globalp]() {
+				globalp->Release();
+				localp->Release();
+			});
+		});
+
+		if (!queued)
+			localp->Release();
+	});
+}
+
+void ExecutionQueue::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
+{
+	Dictionary::Ptr eventCommands = new Dictionary();
+
+	for (const EventCommand::Ptr& command : ConfigType::GetObjectsByType<EventCommand>()) {
+		const ExecutionQueue& queue = command->GetExecutionQueue();
+
+		if (command->GetMaxConcurrentExecutions() > 0 || queue.GetRunning() > 0)
+			eventCommands->Set(command->GetName(), queue.GetStats());
+	}
+
+	Dictionary::Ptr notificationCommands = new Dictionary();
+
+	for (const NotificationCommand::Ptr& command : ConfigType::GetObjectsByType<NotificationCommand>()) {
+		const ExecutionQueue& queue = command->GetExecutionQueue();
+
+		if (command->GetMaxConcurrentExecutions() > 0 || queue.GetRunning() > 0)
+			notificationCommands->Set(command->GetName(), queue.GetStats());
+	}
+
+	status->Set("executionqueue", new Dictionary({
+		{ "event_handlers", EventHandlers.GetStats() },
+		{ "notifications", Notifications.GetStats() },
+		{ "event_commands", eventCommands },
+		{ "notification_commands", notificationCommands }
+	}));
+
+	perfdata->Add(new PerfdataValue("event_handlers_running", EventHandlers.GetRunning()));
+	perfdata->Add(new PerfdataValue("event_handlers_pending", EventHandlers.GetPending()));
+	perfdata->Add(new PerfdataValue("notifications_running", Notifications.GetRunning()));
+	perfdata->Add(new PerfdataValue("notifications_pending", Notifications.GetPending()));
+}
@@ -0,0 +1,71 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef EXECUTIONQUEUE_H
+#define EXECUTIONQUEUE_H
+
+#include "icinga/i2-icinga.hpp"
+#include "base/dictionary.hpp"
+#include "base/array.hpp"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+
+namespace icinga
+{
+
+/**
+ * Limits how many executions of e.g. a command run at the same time. The
+ * executions above the limit wait in order of their arrival. An execution
+ * which is identical to one still waiting, i.e. has the same key, is dropped.
+ *
+ * Event handlers and notifications are limited per command and by the global
+ * MaxConcurrentEventHandlers and MaxConcurrentNotifications constants.
+ *
+ * @ingroup icinga
+ */
+class ExecutionQueue
+{
+public:
+	typedef std::function<void(const std::function<void()>& done)> Task;
+
+	static ExecutionQueue EventHandlers;
+	static ExecutionQueue Notifications;
+
+	ExecutionQueue() = default;
+	ExecutionQueue(const ExecutionQueue&) = delete;
+	ExecutionQueue& operator=(const ExecutionQueue&) = delete;
+
+	bool Enqueue(int limit, const String& key, std::function<void()> task);
+	void Release();
+
+	size_t GetRunning() const;
+	size_t GetPending() const;
+	uint_fast64_t GetDeduplicated() const;
+
+	Dictionary::Ptr GetStats() const;
+
+	static void Run(ExecutionQueue& local, int localLimit, ExecutionQueue& global, int globalLimit,
+		const String& key, const Task& task);
+
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+
+private:
+	struct PendingExecution
+	{
+		String Key;
+		std::function<void()> Task;
+	};
+
+	mutable std::mutex m_Mutex;
+	int m_Limit{0};
+	size_t m_Running{0};
+	std::deque<PendingExecution> m_Pending;
+	std::set<String> m_PendingKeys;
+	uint_fast64_t m_Deduplicated{0};
+};
+
+}
+
+#endif /* EXECUTIONQUEUE_H */
@@ -18,6 +18,7 @@
 #include "base/logger.hpp"
 #include "base/objectlock.hpp"
 #include "base/application.hpp"
+#include "base/configuration.hpp"
 #include "base/utility.hpp"
 #include "base/exception.hpp"
 #include <fstream>
@@ -27,34 +28,129 @@ using namespace icinga;
 
 boost::signals2::signal<void(double, const String&, const std::vector<String>&)> ExternalCommandProcessor::OnNewExternalCommand;
 
+struct ParsedExternalCommand
+{
+	double Time;
+	String Command;
+	std::vector<String> Arguments;
+};
+
 void ExternalCommandProcessor::Execute(const String& line)
 {
 	if (line.IsEmpty())
 		return;
 
-	if (line[0] != '[')
-		BOOST_THROW_EXCEPTION(std::invalid_argument("Missing timestamp in command: " + line));
+	double ts;
+	String command;
+	std::vector<String> arguments;
+
+	ParseCommandLine(line, ts, command, arguments);
+	Execute(ts, command, arguments);
+}
+
+/**
+ * Splits a "[timestamp] COMMAND;arg1;arg2" line without copying anything
+ * but the command name and its arguments.
+ */
+void ExternalCommandProcessor::ParseCommandLine(const boost::string_view& line, double& time, String& command, std::vector<String>& arguments)
+{
+	if (line.empty() || line[0] != '[')
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Missing timestamp in command: " + String(line.begin(), line.end())));
+
+	size_t pos = line.find(']');
+
+	if (pos == boost::string_view::npos)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Missing timestamp in command: " + String(line.begin(), line.end())));
+
+	time = Convert::ToDouble(String(line.begin() + 1, line.begin() + pos));
+
+	if (time == 0)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid timestamp in command: " + String(line.begin(), line.end())));
+
+	/* Skip the blank between the timestamp and the command. */
+	boost::string_view args = line.substr(std::min(pos + 2, line.size()));
+	size_t sep = args.find(';');
+
+	command = String(args.begin(), sep == boost::string_view::npos ? args.end() : args.begin() + sep);
+	arguments.clear();
+
+	while (sep != boost::string_view::npos) {
+		args.remove_prefix(sep + 1);
+		sep = args.find(';');
+		arguments.emplace_back(args.begin(), sep == boost::string_view::npos ? args.end() : args.begin() + sep);
+	}
+}
+
+/**
+ * Executes a batch of command lines. Passive check results are spread across
+ * the queue's threads by their host name, so the results for one host are
+ * still processed in order. Any other command waits for them and runs on the
+ * calling thread, keeping its position relative to the surrounding lines.
+ *
+ * @param lines The command lines, which need to stay valid until this returns
+ * @param queue The work queue which processes the check results
+ */
+void ExternalCommandProcessor::ExecuteBatch(const std::vector<boost::string_view>& lines, WorkQueue& queue)
+{
+	std::vector<std::vector<ParsedExternalCommand>> lanes (Configuration::Concurrency);
+	size_t pending = 0;
+	std::hash<String> hasher;
+
+	auto executeLogged ([](const ParsedExternalCommand& pc) {
+		try {
+			Execute(pc.Time, pc.Command, pc.Arguments);
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "ExternalCommandProcessor")
+				<< "External command failed: " << DiagnosticInformation(ex, false);
+			Log(LogNotice, "ExternalCommandProcessor")
+				<< "External command failed: " << DiagnosticInformation(ex, true);
+		}
+	});
+
+	auto flush ([&lanes, &pending, &queue, &executeLogged]() {
+		if (!pending)
+			return;
 
-	size_t pos = line.FindFirstOf("]");
+		queue.ParallelFor(lanes, [&executeLogged](const std::vector<ParsedExternalCommand>& lane) {
+			for (auto& pc : lane)
+				executeLogged(pc);
+		});
 
-	if (pos == String::NPos)
-		BOOST_THROW_EXCEPTION(std::invalid_argument("Missing timestamp in command: " + line));
+		queue.Join();
 
-	String timestamp = line.SubStr(1, pos - 1);
-	String args = line.SubStr(pos + 2, String::NPos);
+		for (auto& lane : lanes)
+			lane.clear();
 
-	double ts = Convert::ToDouble(timestamp);
+		pending = 0;
+	});
 
-	if (ts == 0)
-		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid timestamp in command: " + line));
+	for (auto& line : lines) {
+		if (line.empty())
+			continue;
 
-	std::vector<String> argv = args.Split(";");
+		Log(LogNotice, "ExternalCommandProcessor")
+			<< "Executing external command: " << line;
 
-	if (argv.empty())
-		BOOST_THROW_EXCEPTION(std::invalid_argument("Missing arguments in command: " + line));
+		ParsedExternalCommand pc;
 
-	std::vector<String> argvExtra(argv.begin() + 1, argv.end());
-	Execute(ts, argv[0], argvExtra);
+		try {
+			ParseCommandLine(line, pc.Time, pc.Command, pc.Arguments);
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "ExternalCommandProcessor")
+				<< "External command failed: " << DiagnosticInformation(ex, false);
+			continue;
+		}
+
+		if (!pc.Arguments.empty() && (pc.Command == "PROCESS_SERVICE_CHECK_RESULT" || pc.Command == "PROCESS_HOST_CHECK_RESULT")) {
+			lanes[hasher(pc.Arguments[0]) % lanes.size()].emplace_back(std::move(pc));
+			pending++;
+		} else {
+			flush();
+			executeLogged(pc);
+		}
+	}
+
+	flush();
 }
 
 void ExternalCommandProcessor::Execute(double time, const String& command, const std::vector<String>& arguments)
@@ -67,16 +163,13 @@ void ExternalCommandProcessor::Execute(double time, const String& command, const
 		RegisterCommands();
 	});
 
-	{
-		std::unique_lock<std::mutex> lock(GetMutex());
+	/* Commands are only registered once, above, so they can be looked up without locking. */
+	auto it = GetCommands().find(command);
 
-		auto it = GetCommands().find(command);
+	if (it == GetCommands().end())
+		BOOST_THROW_EXCEPTION(std::invalid_argument("The external command '" + command + "' does not exist."));
 
-		if (it == GetCommands().end())
-			BOOST_THROW_EXCEPTION(std::invalid_argument("The external command '" + command + "' does not exist."));
-
-		eci = it->second;
-	}
+	eci = it->second;
 
 	if (arguments.size() < eci.MinArgs)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Expected " + Convert::ToString(eci.MinArgs) + " arguments"));
@@ -242,35 +335,21 @@ void ExternalCommandProcessor::ExecuteFromFile(const String& line, std::deque< s
 	if (line.IsEmpty())
 		return;
 
-	if (line[0] != '[')
-		BOOST_THROW_EXCEPTION(std::invalid_argument("Missing timestamp in command: " + line));
-
-	size_t pos = line.FindFirstOf("]");
-
-	if (pos == String::NPos)
-		BOOST_THROW_EXCEPTION(std::invalid_argument("Missing timestamp in command: " + line));
-
-	String timestamp = line.SubStr(1, pos - 1);
-	String args = line.SubStr(pos + 2, String::NPos);
-
-	double ts = Convert::ToDouble(timestamp);
-
-	if (ts == 0)
-		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid timestamp in command: " + line));
-
-	std::vector<String> argv = args.Split(";");
+	double ts;
+	String command;
+	std::vector<String> arguments;
 
-	if (argv.empty())
-		BOOST_THROW_EXCEPTION(std::invalid_argument("Missing arguments in command: " + line));
+	ParseCommandLine(line, ts, command, arguments);
 
-	std::vector<String> argvExtra(argv.begin() + 1, argv.end());
+	if (command == "PROCESS_FILE") {
+		if (arguments.empty())
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Missing arguments in command: " + line));
 
-	if (argv[0] == "PROCESS_FILE") {
 		Log(LogDebug, "ExternalCommandProcessor")
-			<< "Enqueing external command file " << argvExtra[0];
-		file_queue.push_back(argvExtra);
+			<< "Enqueing external command file " << arguments[0];
+		file_queue.push_back(arguments);
 	} else {
-		Execute(ts, argv[0], argvExtra);
+		Execute(ts, command, arguments);
 	}
 }
 
@@ -2273,9 +2352,9 @@ std::mutex& ExternalCommandProcessor::GetMutex()
 	return mtx;
 }
 
-std::map<String, ExternalCommandInfo>& ExternalCommandProcessor::GetCommands()
+std::unordered_map<String, ExternalCommandInfo>& ExternalCommandProcessor::GetCommands()
 {
-	static std::map<String, ExternalCommandInfo> commands;
+	static std::unordered_map<String, ExternalCommandInfo> commands;
 	return commands;
 }
 
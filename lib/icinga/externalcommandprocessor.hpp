@@ -6,7 +6,10 @@
 #include "icinga/i2-icinga.hpp"
 #include "icinga/command.hpp"
 #include "base/string.hpp"
+#include "base/workqueue.hpp"
 #include <boost/signals2.hpp>
+#include <boost/utility/string_view.hpp>
+#include <unordered_map>
 #include <vector>
 
 namespace icinga
@@ -25,12 +28,14 @@ class ExternalCommandProcessor {
 public:
 	static void Execute(const String& line);
 	static void Execute(double time, const String& command, const std::vector<String>& arguments);
+	static void ExecuteBatch(const std::vector<boost::string_view>& lines, WorkQueue& queue);
 
 	static boost::signals2::signal<void(double, const String&, const std::vector<String>&)> OnNewExternalCommand;
 
 private:
 	ExternalCommandProcessor();
 
+	static void ParseCommandLine(const boost::string_view& line, double& time, String& command, std::vector<String>& arguments);
 	static void ExecuteFromFile(const String& line, std::deque< std::vector<String> >& file_queue);
 
 	static void ProcessHostCheckResult(double time, const std::vector<String>& arguments);
@@ -160,7 +165,7 @@ private:
 	static void RegisterCommands();
 
 	static std::mutex& GetMutex();
-	static std::map<String, ExternalCommandInfo>& GetCommands();
+	static std::unordered_map<String, ExternalCommandInfo>& GetCommands();
 
 };
 
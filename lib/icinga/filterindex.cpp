@@ -0,0 +1,117 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icinga/filterindex.hpp"
+#include "icinga/hostgroup.hpp"
+#include "icinga/service.hpp"
+#include "icinga/servicegroup.hpp"
+#include "base/configtype.hpp"
+#include "base/initialize.hpp"
+#include "base/utility.hpp"
+
+using namespace icinga;
+
+INITIALIZE_ONCE(&FilterIndex::StaticInitialize);
+
+void FilterIndex::StaticInitialize()
+{
+	FilterUtility::RegisterTargetIndex(&FilterIndex::FindCandidates);
+}
+
+bool FilterIndex::FindCandidates(const Type::Ptr& type, const FilterPredicate& predicate,
+	const std::function<void (const ConfigObject::Ptr&)>& addCandidate)
+{
+	if (type == Host::TypeInstance) {
+		if (predicate.Variable != "host")
+			return false;
+
+		return FindHosts(predicate, [&addCandidate](const Host::Ptr& host) { addCandidate(host); });
+	}
+
+	if (type != Service::TypeInstance)
+		return false;
+
+	auto addServices ([&addCandidate](const Host::Ptr& host) {
+		for (const Service::Ptr& service : host->GetServices())
+			addCandidate(service);
+	});
+
+	if (predicate.Variable == "host")
+		return FindHosts(predicate, addServices);
+
+	if (predicate.Variable != "service")
+		return false;
+
+	if (predicate.Field == "host_name") {
+		FilterPredicate hostPredicate (predicate);
+		hostPredicate.Variable = "host";
+		hostPredicate.Field = "name";
+
+		return FindHosts(hostPredicate, addServices);
+	}
+
+	if (predicate.Field == "groups" && predicate.Type == FilterPredicate::PredicateElement) {
+		ServiceGroup::Ptr group = ServiceGroup::GetByName(predicate.Value);
+
+		if (group) {
+			for (const Service::Ptr& service : group->GetMembers())
+				addCandidate(service);
+		}
+
+		return true;
+	}
+
+	/* The short name, so it's not the key of a lookup, but comparing it is cheaper than the filter. */
+	if (predicate.Field == "name") {
+		if (predicate.Type == FilterPredicate::PredicateElement)
+			return false;
+
+		for (const Service::Ptr& service : ConfigType::GetObjectsByType<Service>()) {
+			String name = service->GetShortName();
+
+			if (predicate.Type == FilterPredicate::PredicateEqual ? name == predicate.Value : Utility::Match(predicate.Value, name))
+				addCandidate(service);
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+bool FilterIndex::FindHosts(const FilterPredicate& predicate, const std::function<void (const Host::Ptr&)>& addHost)
+{
+	if (predicate.Field == "name") {
+		switch (predicate.Type) {
+			case FilterPredicate::PredicateEqual: {
+				Host::Ptr host = Host::GetByName(predicate.Value);
+
+				if (host)
+					addHost(host);
+
+				return true;
+			}
+			case FilterPredicate::PredicateMatch:
+				for (const Host::Ptr& host : ConfigType::GetObjectsByType<Host>()) {
+					if (Utility::Match(predicate.Value, host->GetName()))
+						addHost(host);
+				}
+
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	if (predicate.Field == "groups" && predicate.Type == FilterPredicate::PredicateElement) {
+		HostGroup::Ptr group = HostGroup::GetByName(predicate.Value);
+
+		if (group) {
+			for (const Host::Ptr& host : group->GetMembers())
+				addHost(host);
+		}
+
+		return true;
+	}
+
+	return false;
+}
@@ -0,0 +1,35 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef FILTERINDEX_H
+#define FILTERINDEX_H
+
+#include "icinga/i2-icinga.hpp"
+#include "icinga/host.hpp"
+#include "remote/filterutility.hpp"
+
+namespace icinga
+{
+
+/**
+ * Looks up the hosts and services API filters ask for by name or group,
+ * so they don't have to be evaluated for every object.
+ *
+ * @ingroup icinga
+ */
+class FilterIndex
+{
+public:
+	static void StaticInitialize();
+
+	static bool FindCandidates(const Type::Ptr& type, const FilterPredicate& predicate,
+		const std::function<void (const ConfigObject::Ptr&)>& addCandidate);
+
+private:
+	FilterIndex();
+
+	static bool FindHosts(const FilterPredicate& predicate, const std::function<void (const Host::Ptr&)>& addHost);
+};
+
+}
+
+#endif /* FILTERINDEX_H */
@@ -47,6 +47,8 @@ void IcingaApplication::StaticInitialize()
 
 	ScriptGlobal::Set("ReloadTimeout", 300);
 	ScriptGlobal::Set("MaxConcurrentChecks", 512);
+	ScriptGlobal::Set("MaxConcurrentEventHandlers", 256);
+	ScriptGlobal::Set("MaxConcurrentNotifications", 256);
 
 	Namespace::Ptr systemNS = ScriptGlobal::Get("System");
 	/* Ensure that the System namespace is already initialized. Otherwise this is a programming error. */
@@ -101,7 +103,9 @@ int IcingaApplication::Main()
 	/* periodically dump the program state */
 	l_RetentionTimer = new Timer();
 	l_RetentionTimer->SetInterval(300);
+	l_RetentionTimer->SetSlack(60);
 	l_RetentionTimer->OnTimerExpired.connect([this](const Timer * const&) { DumpProgramState(); });
+	l_RetentionTimer->SetSchedulerPolicy(BackgroundScheduler);
 	l_RetentionTimer->Start();
 
 	RunEventLoop();
@@ -311,6 +315,16 @@ int IcingaApplication::GetMaxConcurrentChecks() const
 	return ScriptGlobal::Get("MaxConcurrentChecks");
 }
 
+int IcingaApplication::GetMaxConcurrentEventHandlers() const
+{
+	return ScriptGlobal::Get("MaxConcurrentEventHandlers");
+}
+
+int IcingaApplication::GetMaxConcurrentNotifications() const
+{
+	return ScriptGlobal::Get("MaxConcurrentNotifications");
+}
+
 String IcingaApplication::GetEnvironment() const
 {
 	return Application::GetAppEnvironment();
@@ -34,6 +34,8 @@ public:
 	String GetNodeName() const;
 
 	int GetMaxConcurrentChecks() const;
+	int GetMaxConcurrentEventHandlers() const;
+	int GetMaxConcurrentNotifications() const;
 
 	String GetEnvironment() const override;
 	void SetEnvironment(const String& value, bool suppress_events = false, const Value& cookie = Empty) override;
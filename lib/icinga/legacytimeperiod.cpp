@@ -120,27 +120,81 @@ boost::gregorian::date LegacyTimePeriod::GetEndOfMonthDay(int year, int month)
 	return d.end_of_month();
 }
 
-void LegacyTimePeriod::ParseTimeSpec(const String& timespec, tm *begin, tm *end, tm *reference)
+/**
+ * Parses a time specification. Only depends on the string, evaluate the
+ * result with EvaluateTimeSpec().
+ */
+LegacyTimeSpec LegacyTimePeriod::CompileTimeSpec(const String& timespec)
 {
-	/* Let mktime() figure out whether we're in DST or not. */
-	reference->tm_isdst = -1;
+	LegacyTimeSpec spec;
 
 	/* YYYY-MM-DD */
 	if (timespec.GetLength() == 10 && timespec[4] == '-' && timespec[7] == '-') {
-		int year = Convert::ToLong(timespec.SubStr(0, 4));
-		int month = Convert::ToLong(timespec.SubStr(5, 2));
-		int day = Convert::ToLong(timespec.SubStr(8, 2));
+		spec.Type = LegacyTimeSpec::Date;
+		spec.Year = Convert::ToLong(timespec.SubStr(0, 4));
+		spec.Month = Convert::ToLong(timespec.SubStr(5, 2)) - 1;
+		spec.Day = Convert::ToLong(timespec.SubStr(8, 2));
 
-		if (month < 1 || month > 12)
+		if (spec.Month < 0 || spec.Month > 11)
 			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid month in time specification: " + timespec));
-		if (day < 1 || day > 31)
+		if (spec.Day < 1 || spec.Day > 31)
 			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid day in time specification: " + timespec));
 
+		return spec;
+	}
+
+	std::vector<String> tokens = timespec.Split(" ");
+
+	int mon = -1;
+
+	if (tokens.size() > 1 && (tokens[0] == "day" || (mon = MonthFromString(tokens[0])) != -1)) {
+		spec.Type = LegacyTimeSpec::MonthDay;
+		spec.Month = mon;
+		spec.Day = Convert::ToLong(tokens[1]);
+
+		return spec;
+	}
+
+	int wday;
+
+	if (tokens.size() >= 1 && (wday = WeekdayFromString(tokens[0])) != -1) {
+		spec.Type = LegacyTimeSpec::WeekDay;
+		spec.Weekday = wday;
+
+		if (tokens.size() > 2) {
+			spec.Month = MonthFromString(tokens[2]);
+
+			if (spec.Month == -1)
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid month in time specification: " + timespec));
+		}
+
+		if (tokens.size() > 1) {
+			spec.HasNth = true;
+			spec.Day = Convert::ToLong(tokens[1]);
+		}
+
+		return spec;
+	}
+
+	BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid time specification: " + timespec));
+}
+
+void LegacyTimePeriod::ParseTimeSpec(const String& timespec, tm *begin, tm *end, tm *reference)
+{
+	EvaluateTimeSpec(CompileTimeSpec(timespec), begin, end, reference);
+}
+
+void LegacyTimePeriod::EvaluateTimeSpec(const LegacyTimeSpec& spec, tm *begin, tm *end, tm *reference)
+{
+	/* Let mktime() figure out whether we're in DST or not. */
+	reference->tm_isdst = -1;
+
+	if (spec.Type == LegacyTimeSpec::Date) {
 		if (begin) {
 			*begin = *reference;
-			begin->tm_year = year - 1900;
-			begin->tm_mon = month - 1;
-			begin->tm_mday = day;
+			begin->tm_year = spec.Year - 1900;
+			begin->tm_mon = spec.Month;
+			begin->tm_mday = spec.Day;
 			begin->tm_hour = 0;
 			begin->tm_min = 0;
 			begin->tm_sec = 0;
@@ -148,9 +202,9 @@ void LegacyTimePeriod::ParseTimeSpec(const String& timespec, tm *begin, tm *end,
 
 		if (end) {
 			*end = *reference;
-			end->tm_year = year - 1900;
-			end->tm_mon = month - 1;
-			end->tm_mday = day;
+			end->tm_year = spec.Year - 1900;
+			end->tm_mon = spec.Month;
+			end->tm_mday = spec.Day;
 			end->tm_hour = 24;
 			end->tm_min = 0;
 			end->tm_sec = 0;
@@ -159,15 +213,13 @@ void LegacyTimePeriod::ParseTimeSpec(const String& timespec, tm *begin, tm *end,
 		return;
 	}
 
-	std::vector<String> tokens = timespec.Split(" ");
-
-	int mon = -1;
+	if (spec.Type == LegacyTimeSpec::MonthDay) {
+		int mon = spec.Month;
 
-	if (tokens.size() > 1 && (tokens[0] == "day" || (mon = MonthFromString(tokens[0])) != -1)) {
 		if (mon == -1)
 			mon = reference->tm_mon;
 
-		int mday = Convert::ToLong(tokens[1]);
+		int mday = spec.Day;
 
 		if (begin) {
 			*begin = *reference;
@@ -219,73 +271,59 @@ void LegacyTimePeriod::ParseTimeSpec(const String& timespec, tm *begin, tm *end,
 		return;
 	}
 
-	int wday;
-
-	if (tokens.size() >= 1 && (wday = WeekdayFromString(tokens[0])) != -1) {
-		tm myref = *reference;
-
-		if (tokens.size() > 2) {
-			mon = MonthFromString(tokens[2]);
-
-			if (mon == -1)
-				BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid month in time specification: " + timespec));
-
-			myref.tm_mon = mon;
-		}
-
-		int n = 0;
-
-		if (tokens.size() > 1)
-			n = Convert::ToLong(tokens[1]);
+	tm myref = *reference;
 
-		if (begin) {
-			*begin = myref;
+	if (spec.Month != -1)
+		myref.tm_mon = spec.Month;
 
-			if (tokens.size() > 1)
-				FindNthWeekday(wday, n, begin);
-			else
-				begin->tm_mday += (7 - begin->tm_wday + wday) % 7;
+	if (begin) {
+		*begin = myref;
 
-			begin->tm_hour = 0;
-			begin->tm_min = 0;
-			begin->tm_sec = 0;
-		}
+		if (spec.HasNth)
+			FindNthWeekday(spec.Weekday, spec.Day, begin);
+		else
+			begin->tm_mday += (7 - begin->tm_wday + spec.Weekday) % 7;
 
-		if (end) {
-			*end = myref;
+		begin->tm_hour = 0;
+		begin->tm_min = 0;
+		begin->tm_sec = 0;
+	}
 
-			if (tokens.size() > 1)
-				FindNthWeekday(wday, n, end);
-			else
-				end->tm_mday += (7 - end->tm_wday + wday) % 7;
+	if (end) {
+		*end = myref;
 
-			end->tm_hour = 0;
-			end->tm_min = 0;
-			end->tm_sec = 0;
-			end->tm_mday++;
-		}
+		if (spec.HasNth)
+			FindNthWeekday(spec.Weekday, spec.Day, end);
+		else
+			end->tm_mday += (7 - end->tm_wday + spec.Weekday) % 7;
 
-		return;
+		end->tm_hour = 0;
+		end->tm_min = 0;
+		end->tm_sec = 0;
+		end->tm_mday++;
 	}
-
-	BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid time specification: " + timespec));
 }
 
-void LegacyTimePeriod::ParseTimeRange(const String& timerange, tm *begin, tm *end, int *stride, tm *reference)
+/**
+ * Parses a day definition, i.e. one or two time specifications and an
+ * optional stride.
+ */
+LegacyDayDefinition LegacyTimePeriod::CompileDayDefinition(const String& daydef)
 {
-	String def = timerange;
+	LegacyDayDefinition result;
+	String def = daydef;
 
 	/* Figure out the stride. */
 	size_t pos = def.FindFirstOf('/');
 
 	if (pos != String::NPos) {
 		String strStride = def.SubStr(pos + 1).Trim();
-		*stride = Convert::ToLong(strStride);
+		result.Stride = Convert::ToLong(strStride);
 
 		/* Remove the stride parameter from the definition. */
 		def = def.SubStr(0, pos);
 	} else {
-		*stride = 1; /* User didn't specify anything, assume default. */
+		result.Stride = 1; /* User didn't specify anything, assume default. */
 	}
 
 	/* Figure out whether the user has specified two dates. */
@@ -296,7 +334,7 @@ void LegacyTimePeriod::ParseTimeRange(const String& timerange, tm *begin, tm *en
 
 		String second = def.SubStr(pos + 1).Trim();
 
-		ParseTimeSpec(first, begin, nullptr, reference);
+		result.Begin = CompileTimeSpec(first);
 
 		/* If the second definition starts with a number we need
 		 * to add the first word from the first definition, e.g.:
@@ -317,10 +355,28 @@ void LegacyTimePeriod::ParseTimeRange(const String& timerange, tm *begin, tm *en
 			second = first.SubStr(0, xpos + 1) + second;
 		}
 
-		ParseTimeSpec(second, nullptr, end, reference);
+		result.End = CompileTimeSpec(second);
 	} else {
-		ParseTimeSpec(def, begin, end, reference);
+		result.Begin = CompileTimeSpec(def);
+		result.End = result.Begin;
 	}
+
+	return result;
+}
+
+void LegacyTimePeriod::ParseTimeRange(const String& timerange, tm *begin, tm *end, int *stride, tm *reference)
+{
+	LegacyDayDefinition daydef = CompileDayDefinition(timerange);
+
+	*stride = daydef.Stride;
+
+	EvaluateDayDefinition(daydef, begin, end, reference);
+}
+
+void LegacyTimePeriod::EvaluateDayDefinition(const LegacyDayDefinition& daydef, tm *begin, tm *end, tm *reference)
+{
+	EvaluateTimeSpec(daydef.Begin, begin, nullptr, reference);
+	EvaluateTimeSpec(daydef.End, nullptr, end, reference);
 }
 
 bool LegacyTimePeriod::IsInDayDefinition(const String& daydef, tm *reference)
@@ -338,40 +394,73 @@ bool LegacyTimePeriod::IsInDayDefinition(const String& daydef, tm *reference)
 }
 
 static inline
-void ProcessTimeRaw(const String& in, tm *reference, tm *out)
+void CompileTimeRaw(const String& in, int *hour, int *minute, int *second)
 {
-	*out = *reference;
-
 	auto hd (in.Split(":"));
 
 	switch (hd.size()) {
 		case 2:
-			out->tm_sec = 0;
+			*second = 0;
 			break;
 		case 3:
-			out->tm_sec = Convert::ToLong(hd[2]);
+			*second = Convert::ToLong(hd[2]);
 			break;
 		default:
 			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid time specification: " + in));
 	}
 
-	out->tm_hour = Convert::ToLong(hd[0]);
-	out->tm_min = Convert::ToLong(hd[1]);
+	*hour = Convert::ToLong(hd[0]);
+	*minute = Convert::ToLong(hd[1]);
 }
 
-void LegacyTimePeriod::ProcessTimeRangeRaw(const String& timerange, tm *reference, tm *begin, tm *end)
+/**
+ * Parses a time range like "09:00-17:00".
+ */
+LegacyTimeRange LegacyTimePeriod::CompileTimeRange(const String& timerange)
 {
 	std::vector<String> times = timerange.Split("-");
 
 	if (times.size() != 2)
 		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid timerange: " + timerange));
 
-	ProcessTimeRaw(times[0], reference, begin);
-	ProcessTimeRaw(times[1], reference, end);
+	LegacyTimeRange result;
+
+	CompileTimeRaw(times[0], &result.BeginHour, &result.BeginMinute, &result.BeginSecond);
+	CompileTimeRaw(times[1], &result.EndHour, &result.EndMinute, &result.EndSecond);
+
+	if (result.BeginHour * 3600 + result.BeginMinute * 60 + result.BeginSecond >=
+		result.EndHour * 3600 + result.EndMinute * 60 + result.EndSecond)
+		result.EndHour += 24;
 
-	if (begin->tm_hour * 3600 + begin->tm_min * 60 + begin->tm_sec >=
-		end->tm_hour * 3600 + end->tm_min * 60 + end->tm_sec)
-		end->tm_hour += 24;
+	return result;
+}
+
+std::vector<LegacyTimeRange> LegacyTimePeriod::CompileTimeRanges(const String& timeranges)
+{
+	std::vector<LegacyTimeRange> result;
+
+	for (const String& range : timeranges.Split(","))
+		result.emplace_back(CompileTimeRange(range));
+
+	return result;
+}
+
+void LegacyTimePeriod::ProcessTimeRangeRaw(const String& timerange, tm *reference, tm *begin, tm *end)
+{
+	EvaluateTimeRange(CompileTimeRange(timerange), reference, begin, end);
+}
+
+void LegacyTimePeriod::EvaluateTimeRange(const LegacyTimeRange& timerange, tm *reference, tm *begin, tm *end)
+{
+	*begin = *reference;
+	begin->tm_hour = timerange.BeginHour;
+	begin->tm_min = timerange.BeginMinute;
+	begin->tm_sec = timerange.BeginSecond;
+
+	*end = *reference;
+	end->tm_hour = timerange.EndHour;
+	end->tm_min = timerange.EndMinute;
+	end->tm_sec = timerange.EndSecond;
 }
 
 Dictionary::Ptr LegacyTimePeriod::ProcessTimeRange(const String& timestamp, tm *reference)
@@ -508,40 +597,108 @@ Dictionary::Ptr LegacyTimePeriod::FindNextSegment(const String& daydef, const St
 	return nullptr;
 }
 
+/**
+ * Parses all day definitions and time ranges of TimePeriod#ranges.
+ */
+std::shared_ptr<CompiledTimeRanges> LegacyTimePeriod::CompileRanges(const Dictionary::Ptr& ranges)
+{
+	auto result (std::make_shared<CompiledTimeRanges>());
+
+	result->Source = ranges;
+
+	if (ranges) {
+		ObjectLock olock(ranges);
+		for (const Dictionary::Pair& kv : ranges)
+			result->Ranges.emplace_back(CompileDayDefinition(kv.first), CompileTimeRanges(kv.second));
+	}
+
+	return result;
+}
+
+/**
+ * Computes the segments of the day of the given reference time.
+ */
+std::vector<std::pair<double, double>> LegacyTimePeriod::EvaluateDay(const CompiledTimeRanges& ranges, tm *reference)
+{
+	std::vector<std::pair<double, double>> segments;
+
+	for (auto& range : ranges.Ranges) {
+		tm begin, end;
+
+		EvaluateDayDefinition(range.first, &begin, &end, reference);
+
+		if (!IsInTimeRange(&begin, &end, range.first.Stride, reference))
+			continue;
+
+		for (auto& timerange : range.second) {
+			tm rangeBegin, rangeEnd;
+
+			EvaluateTimeRange(timerange, reference, &rangeBegin, &rangeEnd);
+
+			long tsBegin = mktime(&rangeBegin);
+			long tsEnd = mktime(&rangeEnd);
+
+			if (tsBegin >= tsEnd)
+				continue;
+
+			segments.emplace_back(tsBegin, tsEnd);
+		}
+	}
+
+	return segments;
+}
+
+/**
+ * Computes the segments of all days between begin and end. Each day is
+ * only computed once, following updates only compute newly entering days.
+ */
 Array::Ptr LegacyTimePeriod::ScriptFunc(const TimePeriod::Ptr& tp, double begin, double end)
 {
 	Array::Ptr segments = new Array();
 
-	Dictionary::Ptr ranges = tp->GetRanges();
+	auto ranges (tp->GetCompiledRanges());
+
+	if (ranges && ranges->Source) {
+		std::unique_lock<std::mutex> lock (ranges->DaysMutex);
+		int firstDay = -1;
 
-	if (ranges) {
 		for (int i = 0; i <= (end - begin) / (24 * 60 * 60); i++) {
 			time_t refts = begin + i * 24 * 60 * 60;
 			tm reference = Utility::LocalTime(refts);
+			int day = (reference.tm_year + 1900) * 10000 + (reference.tm_mon + 1) * 100 + reference.tm_mday;
 
-#ifdef I2_DEBUG
-			Log(LogDebug, "LegacyTimePeriod")
-				<< "Checking reference time " << refts;
-#endif /* I2_DEBUG */
+			if (firstDay == -1)
+				firstDay = day;
 
-			ObjectLock olock(ranges);
-			for (const Dictionary::Pair& kv : ranges) {
-				if (!IsInDayDefinition(kv.first, &reference)) {
-#ifdef I2_DEBUG
-					Log(LogDebug, "LegacyTimePeriod")
-						<< "Not in day definition '" << kv.first << "'.";
-#endif /* I2_DEBUG */
-					continue;
-				}
+			auto it (ranges->Days.find(day));
 
+			if (it == ranges->Days.end()) {
 #ifdef I2_DEBUG
 				Log(LogDebug, "LegacyTimePeriod")
-					<< "In day definition '" << kv.first << "'.";
+					<< "Computing segments for reference time " << refts;
 #endif /* I2_DEBUG */
 
-				ProcessTimeRanges(kv.second, &reference, segments);
+				/* Whatever time of the day we've been asked for, the day's segments must not depend on it. */
+				reference.tm_hour = 12;
+				reference.tm_min = 0;
+				reference.tm_sec = 0;
+				reference.tm_isdst = -1;
+				mktime(&reference);
+
+				it = ranges->Days.emplace(day, EvaluateDay(*ranges, &reference)).first;
+			}
+
+			for (auto& segment : it->second) {
+				segments->Add(new Dictionary({
+					{ "begin", segment.first },
+					{ "end", segment.second }
+				}));
 			}
 		}
+
+		/* Days before the requested range won't be asked for again. */
+		if (firstDay != -1)
+			ranges->Days.erase(ranges->Days.begin(), ranges->Days.lower_bound(firstDay));
 	}
 
 	Log(LogDebug, "LegacyTimePeriod")
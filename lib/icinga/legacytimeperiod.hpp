@@ -7,10 +7,76 @@
 #include "icinga/timeperiod.hpp"
 #include "base/dictionary.hpp"
 #include <boost/date_time/gregorian/gregorian.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 namespace icinga
 {
 
+/**
+ * A parsed time specification, e.g. "2019-05-06", "day 1", "monday -1 may".
+ *
+ * @ingroup icinga
+ */
+struct LegacyTimeSpec
+{
+	enum SpecType
+	{
+		Date,
+		MonthDay,
+		WeekDay
+	};
+
+	SpecType Type;
+	int Year{0};
+	int Month{-1}; /* 0-11, -1 for the reference's month */
+	int Day{0}; /* The day of the month or, for weekdays, the n-th occurrence */
+	int Weekday{-1};
+	bool HasNth{false};
+};
+
+/**
+ * A parsed day definition, i.e. a key of TimePeriod#ranges.
+ *
+ * @ingroup icinga
+ */
+struct LegacyDayDefinition
+{
+	LegacyTimeSpec Begin;
+	LegacyTimeSpec End;
+	int Stride;
+};
+
+/**
+ * A parsed time range, e.g. "09:00-17:00". End is past 24:00 for ranges
+ * which overflow into the next day.
+ *
+ * @ingroup icinga
+ */
+struct LegacyTimeRange
+{
+	int BeginHour, BeginMinute, BeginSecond;
+	int EndHour, EndMinute, EndSecond;
+};
+
+/**
+ * TimePeriod#ranges parsed once, plus the segments already computed from
+ * them for individual days.
+ *
+ * @ingroup icinga
+ */
+struct CompiledTimeRanges
+{
+	Dictionary::Ptr Source;
+	std::vector<std::pair<LegacyDayDefinition, std::vector<LegacyTimeRange>>> Ranges;
+
+	std::mutex DaysMutex;
+	std::map<int, std::vector<std::pair<double, double>>> Days; /* By YYYYMMDD */
+};
+
 /**
  * Implements Icinga 1.x time periods.
  *
@@ -34,9 +100,20 @@ public:
 	static Dictionary::Ptr FindNextSegment(const String& daydef, const String& timeranges, tm *reference);
 	static Dictionary::Ptr FindRunningSegment(const String& daydef, const String& timeranges, tm *reference);
 
+	static LegacyTimeSpec CompileTimeSpec(const String& timespec);
+	static LegacyDayDefinition CompileDayDefinition(const String& daydef);
+	static LegacyTimeRange CompileTimeRange(const String& timerange);
+	static std::vector<LegacyTimeRange> CompileTimeRanges(const String& timeranges);
+	static std::shared_ptr<CompiledTimeRanges> CompileRanges(const Dictionary::Ptr& ranges);
+
 private:
 	LegacyTimePeriod();
 
+	static void EvaluateTimeSpec(const LegacyTimeSpec& spec, tm *begin, tm *end, tm *reference);
+	static void EvaluateDayDefinition(const LegacyDayDefinition& daydef, tm *begin, tm *end, tm *reference);
+	static void EvaluateTimeRange(const LegacyTimeRange& timerange, tm *reference, tm *begin, tm *end);
+	static std::vector<std::pair<double, double>> EvaluateDay(const CompiledTimeRanges& ranges, tm *reference);
+
 	static boost::gregorian::date GetEndOfMonthDay(int year, int month);
 };
 
@@ -11,7 +11,10 @@
 #include "base/scriptframe.hpp"
 #include "base/convert.hpp"
 #include "base/exception.hpp"
+#include "icinga/service.hpp"
 #include <boost/algorithm/string/join.hpp>
+#include <algorithm>
+#include <set>
 
 using namespace icinga;
 
@@ -73,21 +76,49 @@ Value MacroProcessor::ResolveMacros(const Value& str, const ResolverList& resolv
 	return result;
 }
 
-bool MacroProcessor::ResolveMacro(const String& macro, const ResolverList& resolvers,
-	const CheckResult::Ptr& cr, Value *result, bool *recursive_macro)
+Value MacroProcessor::ResolveMacros(const CompiledMacroValue& value, const ResolverList& resolvers,
+	const CheckResult::Ptr& cr, String *missingMacro,
+	const MacroProcessor::EscapeCallback& escapeFn, const Dictionary::Ptr& resolvedMacros,
+	bool useResolvedMacros, int recursionLevel)
 {
-	CONTEXT("Resolving macro '" + macro + "'");
+	if (!value.IsArray && value.Formats.empty())
+		return ResolveMacros(value.Source, resolvers, cr, missingMacro, escapeFn, resolvedMacros, useResolvedMacros, recursionLevel);
 
-	*recursive_macro = false;
+	if (useResolvedMacros)
+		REQUIRE_NOT_NULL(resolvedMacros);
+
+	if (!value.IsArray) {
+		return InternalResolveMacros(value.Formats[0], resolvers, cr, missingMacro, escapeFn,
+			resolvedMacros, useResolvedMacros, recursionLevel + 1);
+	}
+
+	ArrayData resultArr;
+	resultArr.reserve(value.Formats.size());
 
-	std::vector<String> tokens = macro.Split(".");
+	for (const MacroFormat& format : value.Formats) {
+		/* Note: don't escape macros here. */
+		Value resolved = InternalResolveMacros(format, resolvers, cr, missingMacro,
+			EscapeCallback(), resolvedMacros, useResolvedMacros, recursionLevel + 1);
 
-	String objName;
-	if (tokens.size() > 1) {
-		objName = tokens[0];
-		tokens.erase(tokens.begin());
+		if (resolved.IsObjectType<Array>())
+			resultArr.push_back(Utility::Join(resolved, ';'));
+		else
+			resultArr.push_back(std::move(resolved));
 	}
 
+	return new Array(std::move(resultArr));
+}
+
+bool MacroProcessor::ResolveMacro(const MacroFormat::Segment& macro, const ResolverList& resolvers,
+	const CheckResult::Ptr& cr, Value *result, bool *recursive_macro)
+{
+	CONTEXT("Resolving macro '" + macro.Text + "'");
+
+	*recursive_macro = false;
+
+	const std::vector<String>& tokens = macro.Tokens;
+	const String& objName = macro.ObjName;
+
 	for (const ResolverSpec& resolver : resolvers) {
 		if (!objName.IsEmpty() && objName != resolver.first)
 			continue;
@@ -98,8 +129,8 @@ bool MacroProcessor::ResolveMacro(const String& macro, const ResolverList& resol
 			if (dobj) {
 				Dictionary::Ptr vars = dobj->GetVars();
 
-				if (vars && vars->Contains(macro)) {
-					*result = vars->Get(macro);
+				if (vars && vars->Contains(macro.Text)) {
+					*result = vars->Get(macro.Text);
 					*recursive_macro = true;
 					return true;
 				}
@@ -108,7 +139,7 @@ bool MacroProcessor::ResolveMacro(const String& macro, const ResolverList& resol
 
 		auto *mresolver = dynamic_cast<MacroResolver *>(resolver.second.get());
 
-		if (mresolver && mresolver->ResolveMacro(boost::algorithm::join(tokens, "."), cr, result))
+		if (mresolver && mresolver->ResolveMacro(macro.Path, cr, result))
 			return true;
 
 		Value ref = resolver.second;
@@ -205,43 +236,48 @@ Value MacroProcessor::InternalResolveMacros(const String& str, const ResolverLis
 	const MacroProcessor::EscapeCallback& escapeFn, const Dictionary::Ptr& resolvedMacros,
 	bool useResolvedMacros, int recursionLevel)
 {
-	CONTEXT("Resolving macros for string '" + str + "'");
+	return InternalResolveMacros(ParseFormat(str), resolvers, cr, missingMacro, escapeFn,
+		resolvedMacros, useResolvedMacros, recursionLevel);
+}
+
+Value MacroProcessor::InternalResolveMacros(const MacroFormat& format, const ResolverList& resolvers,
+	const CheckResult::Ptr& cr, String *missingMacro,
+	const MacroProcessor::EscapeCallback& escapeFn, const Dictionary::Ptr& resolvedMacros,
+	bool useResolvedMacros, int recursionLevel)
+{
+	CONTEXT("Resolving macros for string '" + format.Source + "'");
 
 	if (recursionLevel > 15)
 		BOOST_THROW_EXCEPTION(std::runtime_error("Infinite recursion detected while resolving macros"));
 
-	size_t offset, pos_first, pos_second;
-	offset = 0;
-
-	Dictionary::Ptr resolvers_this;
+	/* we're done if this is the only macro and there are no other non-macro parts in the string */
+	bool onlyMacro = format.Segments.size() == 1 && format.Segments[0].IsMacro && !format.Unterminated;
 
-	String result = str;
-	while ((pos_first = result.FindFirstOf("$", offset)) != String::NPos) {
-		pos_second = result.FindFirstOf("$", pos_first + 1);
+	String result;
 
-		if (pos_second == String::NPos)
-			BOOST_THROW_EXCEPTION(std::runtime_error("Closing $ not found in macro format string."));
+	for (const MacroFormat::Segment& segment : format.Segments) {
+		if (!segment.IsMacro) {
+			result += segment.Text;
+			continue;
+		}
 
-		String name = result.SubStr(pos_first + 1, pos_second - pos_first - 1);
+		const String& name = segment.Text;
 
 		Value resolved_macro;
-		bool recursive_macro;
+		bool recursive_macro = false;
 		bool found;
 
-		if (useResolvedMacros) {
-			recursive_macro = false;
+		/* $$ is an escape sequence for $. */
+		if (name.IsEmpty()) {
+			resolved_macro = "$";
+			found = true;
+		} else if (useResolvedMacros) {
 			found = resolvedMacros->Contains(name);
 
 			if (found)
 				resolved_macro = resolvedMacros->Get(name);
 		} else
-			found = ResolveMacro(name, resolvers, cr, &resolved_macro, &recursive_macro);
-
-		/* $$ is an escape sequence for $. */
-		if (name.IsEmpty()) {
-			resolved_macro = "$";
-			found = true;
-		}
+			found = ResolveMacro(segment, resolvers, cr, &resolved_macro, &recursive_macro);
 
 		if (resolved_macro.IsObjectType<Function>()) {
 			resolved_macro = EvaluateFunction(resolved_macro, resolvers, cr, escapeFn,
@@ -286,29 +322,189 @@ Value MacroProcessor::InternalResolveMacros(const String& str, const ResolverLis
 		if (escapeFn)
 			resolved_macro = escapeFn(resolved_macro);
 
-		/* we're done if this is the only macro and there are no other non-macro parts in the string */
-		if (pos_first == 0 && pos_second == str.GetLength() - 1)
+		if (onlyMacro)
 			return resolved_macro;
-		else if (resolved_macro.IsObjectType<Array>())
-				BOOST_THROW_EXCEPTION(std::invalid_argument("Mixing both strings and non-strings in macros is not allowed."));
 
-		if (resolved_macro.IsObjectType<Array>()) {
-			/* don't allow mixing strings and arrays in macro strings */
-			if (pos_first != 0 || pos_second != str.GetLength() - 1)
-				BOOST_THROW_EXCEPTION(std::invalid_argument("Mixing both strings and non-strings in macros is not allowed."));
+		/* don't allow mixing strings and arrays in macro strings */
+		if (resolved_macro.IsObjectType<Array>())
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Mixing both strings and non-strings in macros is not allowed."));
 
-			return resolved_macro;
+		result += static_cast<String>(resolved_macro);
+	}
+
+	if (format.Unterminated)
+		BOOST_THROW_EXCEPTION(std::runtime_error("Closing $ not found in macro format string."));
+
+	return result;
+}
+
+/**
+ * Splits a format string into literal text and macros, so it doesn't have
+ * to be scanned again for each resolution.
+ *
+ * @param str The format string
+ * @returns The parsed format string
+ */
+MacroFormat MacroProcessor::ParseFormat(const String& str)
+{
+	MacroFormat format;
+	format.Source = str;
+
+	size_t offset = 0, pos_first, pos_second;
+
+	while ((pos_first = str.FindFirstOf("$", offset)) != String::NPos) {
+		pos_second = str.FindFirstOf("$", pos_first + 1);
+
+		if (pos_second == String::NPos) {
+			format.Unterminated = true;
+			break;
+		}
+
+		if (pos_first > offset)
+			format.Segments.push_back({ false, str.SubStr(offset, pos_first - offset), String(), {}, String() });
+
+		MacroFormat::Segment macro { true, str.SubStr(pos_first + 1, pos_second - pos_first - 1), String(), {}, String() };
+
+		macro.Tokens = macro.Text.Split(".");
+
+		if (macro.Tokens.size() > 1) {
+			macro.ObjName = macro.Tokens[0];
+			macro.Tokens.erase(macro.Tokens.begin());
+		}
+
+		macro.Path = boost::algorithm::join(macro.Tokens, ".");
+
+		format.Segments.emplace_back(std::move(macro));
+
+		offset = pos_second + 1;
+	}
+
+	if (!format.Unterminated && offset < str.GetLength())
+		format.Segments.push_back({ false, str.SubStr(offset), String(), {}, String() });
+
+	return format;
+}
+
+/**
+ * Whether a macro only depends on the configuration of a host or service,
+ * i.e. doesn't change with the check results.
+ */
+bool MacroProcessor::IsStaticMacro(const MacroFormat::Segment& macro)
+{
+	static const std::set<String> attributes {
+		"name", "display_name", "host_name", "address", "address6", "check_command", "zone",
+		"notes", "notes_url", "action_url", "icon_image", "icon_image_alt"
+	};
+
+	if ((macro.ObjName != "host" && macro.ObjName != "service") || macro.Tokens.empty())
+		return false;
+
+	if (macro.Tokens[0] == "vars")
+		return macro.Tokens.size() > 1;
+
+	return macro.Tokens.size() == 1 && attributes.find(macro.Tokens[0]) != attributes.end();
+}
+
+/**
+ * Resolves the static macros (see IsStaticMacro()) of a compiled value in advance,
+ * so that only the others have to be resolved for each check result.
+ *
+ * Macros are left alone if they aren't defined or resolve to anything but
+ * a string or a number, or to a string with further macros.
+ *
+ * @param value The compiled value
+ * @param resolvers The host and service (if any) whose configuration to use
+ * @param escapeFn The escape function ResolveMacros() is going to be called with
+ * @returns The specialized value, to be resolved with the same escape function
+ */
+CompiledMacroValue MacroProcessor::SpecializeValue(const CompiledMacroValue& value, const ResolverList& resolvers,
+	const EscapeCallback& escapeFn)
+{
+	if (value.IsArray || value.Formats.size() != 1)
+		return value;
+
+	const MacroFormat& format = value.Formats[0];
+	bool onlyMacro = format.Segments.size() == 1 && format.Segments[0].IsMacro && !format.Unterminated;
+
+	MacroFormat specialized;
+	specialized.Source = format.Source;
+	specialized.Unterminated = format.Unterminated;
+
+	for (const MacroFormat::Segment& segment : format.Segments) {
+		Value resolved;
+		bool recursive = false;
+		bool literal = !segment.IsMacro;
+
+		if (segment.IsMacro && IsStaticMacro(segment) && ResolveMacro(segment, resolvers, nullptr, &resolved, &recursive)) {
+			if (resolved.IsString() && recursive && resolved.Get<String>().FindFirstOf("$") != String::NPos)
+				literal = false;
+			else if (resolved.IsString() || resolved.IsNumber())
+				literal = true;
+
+			if (literal && escapeFn)
+				resolved = escapeFn(resolved);
+
+			/* A single macro keeps the type of its value, so only fold strings. */
+			if (literal && !(resolved.IsString() || (resolved.IsNumber() && !onlyMacro)))
+				literal = false;
 		}
 
-		String resolved_macro_str = resolved_macro;
+		if (!literal) {
+			specialized.Segments.push_back(segment);
+			continue;
+		}
+
+		String text = segment.IsMacro ? static_cast<String>(resolved) : segment.Text;
 
-		result.Replace(pos_first, pos_second - pos_first + 1, resolved_macro_str);
-		offset = pos_first + resolved_macro_str.GetLength();
+		if (!specialized.Segments.empty() && !specialized.Segments.back().IsMacro)
+			specialized.Segments.back().Text += text;
+		else
+			specialized.Segments.push_back({ false, std::move(text), String(), {}, String() });
 	}
 
+	CompiledMacroValue result;
+	result.Source = value.Source;
+	result.Formats.emplace_back(std::move(specialized));
+
 	return result;
 }
 
+/**
+ * Parses the format strings of a value which is going to be resolved
+ * repeatedly with ResolveMacros().
+ *
+ * @param value A string, number, array, dictionary or function
+ * @returns The compiled value
+ */
+CompiledMacroValue MacroProcessor::CompileValue(const Value& value)
+{
+	CompiledMacroValue result;
+	result.Source = value;
+
+	if (value.IsEmpty())
+		return result;
+
+	if (value.IsScalar()) {
+		result.Formats.emplace_back(ParseFormat(value));
+	} else if (value.IsObjectType<Array>()) {
+		Array::Ptr arr = value;
+		std::vector<MacroFormat> formats;
+
+		ObjectLock olock(arr);
+		for (const Value& arg : arr) {
+			/* Leave the rare non-scalar elements to ResolveMacros(). */
+			if (!arg.IsScalar())
+				return result;
+
+			formats.emplace_back(ParseFormat(arg));
+		}
+
+		result.Formats = std::move(formats);
+		result.IsArray = true;
+	}
+
+	return result;
+}
 
 bool MacroProcessor::ValidateMacroString(const String& macro)
 {
@@ -405,47 +601,36 @@ Value MacroProcessor::EscapeMacroShellArg(const Value& value)
 	return result;
 }
 
-struct CommandArgument
+/**
+ * Compiles a command line and its arguments so they can be resolved for
+ * many checks without parsing the format strings and sorting the arguments
+ * again for each one.
+ *
+ * @param command The command line
+ * @param arguments The command's arguments, if any
+ * @param env The command's environment variables, if any
+ * @returns The compiled command
+ */
+std::shared_ptr<CompiledCommand> MacroProcessor::CompileCommand(const Value& command,
+	const Dictionary::Ptr& arguments, const Dictionary::Ptr& env)
 {
-	int Order{0};
-	bool SkipKey{false};
-	bool RepeatKey{true};
-	bool SkipValue{false};
-	String Key;
-	Value AValue;
-
-	bool operator<(const CommandArgument& rhs) const
-	{
-		return Order < rhs.Order;
-	}
-};
+	auto compiled (std::make_shared<CompiledCommand>());
 
-Value MacroProcessor::ResolveArguments(const Value& command, const Dictionary::Ptr& arguments,
-	const MacroProcessor::ResolverList& resolvers, const CheckResult::Ptr& cr,
-	const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int recursionLevel)
-{
-	if (useResolvedMacros)
-		REQUIRE_NOT_NULL(resolvedMacros);
+	compiled->CommandLine = command;
+	compiled->Arguments = arguments;
+	compiled->Env = env;
 
-	Value resolvedCommand;
 	if (!arguments || command.IsObjectType<Array>() || command.IsObjectType<Function>())
-		resolvedCommand = MacroProcessor::ResolveMacros(command, resolvers, cr, nullptr,
-			EscapeMacroShellArg, resolvedMacros, useResolvedMacros, recursionLevel + 1);
-	else {
-		resolvedCommand = new Array({ command });
-	}
+		compiled->CompiledCommandLine = CompileValue(command);
 
 	if (arguments) {
-		std::vector<CommandArgument> args;
-
 		ObjectLock olock(arguments);
 		for (const Dictionary::Pair& kv : arguments) {
 			const Value& arginfo = kv.second;
 
-			CommandArgument arg;
+			CompiledCommandArgument arg;
 			arg.Key = kv.first;
 
-			bool required = false;
 			Value argval;
 
 			if (arginfo.IsObjectType<Dictionary>()) {
@@ -454,7 +639,7 @@ Value MacroProcessor::ResolveArguments(const Value& command, const Dictionary::P
 					arg.Key = argdict->Get("key");
 				argval = argdict->Get("value");
 				if (argdict->Contains("required"))
-					required = argdict->Get("required");
+					arg.Required = argdict->Get("required");
 				arg.SkipKey = argdict->Get("skip_key");
 				if (argdict->Contains("repeat_key"))
 					arg.RepeatKey = argdict->Get("repeat_key");
@@ -463,34 +648,8 @@ Value MacroProcessor::ResolveArguments(const Value& command, const Dictionary::P
 				Value set_if = argdict->Get("set_if");
 
 				if (!set_if.IsEmpty()) {
-					String missingMacro;
-					Value set_if_resolved = MacroProcessor::ResolveMacros(set_if, resolvers,
-						cr, &missingMacro, MacroProcessor::EscapeCallback(), resolvedMacros,
-						useResolvedMacros, recursionLevel + 1);
-
-					if (!missingMacro.IsEmpty())
-						continue;
-
-					int value;
-
-					if (set_if_resolved == "true")
-						value = 1;
-					else if (set_if_resolved == "false")
-						value = 0;
-					else {
-						try {
-							value = Convert::ToLong(set_if_resolved);
-						} catch (const std::exception& ex) {
-							/* tried to convert a string */
-							Log(LogWarning, "PluginUtility")
-								<< "Error evaluating set_if value '" << set_if_resolved
-								<< "' used in argument '" << arg.Key << "': " << ex.what();
-							continue;
-						}
-					}
-
-					if (!value)
-						continue;
+					arg.HasSetIf = true;
+					arg.SetIf = CompileValue(set_if);
 				}
 			}
 			else
@@ -499,13 +658,99 @@ Value MacroProcessor::ResolveArguments(const Value& command, const Dictionary::P
 			if (argval.IsEmpty())
 				arg.SkipValue = true;
 
+			arg.ArgValue = CompileValue(argval);
+
+			compiled->CompiledArguments.emplace_back(std::move(arg));
+		}
+
+		auto& order (compiled->ArgumentOrder);
+
+		for (size_t i = 0; i < compiled->CompiledArguments.size(); i++)
+			order.push_back(i);
+
+		std::stable_sort(order.begin(), order.end(), [&compiled](size_t lhs, size_t rhs) {
+			return compiled->CompiledArguments[lhs].Order < compiled->CompiledArguments[rhs].Order;
+		});
+	}
+
+	if (env) {
+		ObjectLock olock(env);
+		for (const Dictionary::Pair& kv : env)
+			compiled->CompiledEnv.emplace_back(kv.first, CompileValue(String(kv.second)));
+	}
+
+	return compiled;
+}
+
+Value MacroProcessor::ResolveArguments(const Value& command, const Dictionary::Ptr& arguments,
+	const MacroProcessor::ResolverList& resolvers, const CheckResult::Ptr& cr,
+	const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int recursionLevel)
+{
+	return ResolveArguments(*CompileCommand(command, arguments), resolvers, cr,
+		resolvedMacros, useResolvedMacros, recursionLevel);
+}
+
+Value MacroProcessor::ResolveArguments(const CompiledCommand& command,
+	const MacroProcessor::ResolverList& resolvers, const CheckResult::Ptr& cr,
+	const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int recursionLevel)
+{
+	if (useResolvedMacros)
+		REQUIRE_NOT_NULL(resolvedMacros);
+
+	Value resolvedCommand;
+	if (!command.Arguments || command.CommandLine.IsObjectType<Array>() || command.CommandLine.IsObjectType<Function>())
+		resolvedCommand = MacroProcessor::ResolveMacros(command.CompiledCommandLine, resolvers, cr, nullptr,
+			EscapeMacroShellArg, resolvedMacros, useResolvedMacros, recursionLevel + 1);
+	else {
+		resolvedCommand = new Array({ command.CommandLine });
+	}
+
+	if (command.Arguments) {
+		const auto& compiledArgs (command.CompiledArguments);
+		std::vector<Value> values (compiledArgs.size());
+		std::vector<bool> enabled (compiledArgs.size(), false);
+
+		for (size_t i = 0; i < compiledArgs.size(); i++) {
+			const CompiledCommandArgument& arg = compiledArgs[i];
+
+			if (arg.HasSetIf) {
+				String missingMacro;
+				Value set_if_resolved = MacroProcessor::ResolveMacros(arg.SetIf, resolvers,
+					cr, &missingMacro, MacroProcessor::EscapeCallback(), resolvedMacros,
+					useResolvedMacros, recursionLevel + 1);
+
+				if (!missingMacro.IsEmpty())
+					continue;
+
+				int value;
+
+				if (set_if_resolved == "true")
+					value = 1;
+				else if (set_if_resolved == "false")
+					value = 0;
+				else {
+					try {
+						value = Convert::ToLong(set_if_resolved);
+					} catch (const std::exception& ex) {
+						/* tried to convert a string */
+						Log(LogWarning, "PluginUtility")
+							<< "Error evaluating set_if value '" << set_if_resolved
+							<< "' used in argument '" << arg.Key << "': " << ex.what();
+						continue;
+					}
+				}
+
+				if (!value)
+					continue;
+			}
+
 			String missingMacro;
-			arg.AValue = MacroProcessor::ResolveMacros(argval, resolvers,
+			values[i] = MacroProcessor::ResolveMacros(arg.ArgValue, resolvers,
 				cr, &missingMacro, MacroProcessor::EscapeCallback(), resolvedMacros,
 				useResolvedMacros, recursionLevel + 1);
 
 			if (!missingMacro.IsEmpty()) {
-				if (required) {
+				if (arg.Required) {
 					BOOST_THROW_EXCEPTION(ScriptError("Non-optional macro '" + missingMacro + "' used in argument '" +
 						arg.Key + "' is missing."));
 				}
@@ -513,21 +758,24 @@ Value MacroProcessor::ResolveArguments(const Value& command, const Dictionary::P
 				continue;
 			}
 
-			args.emplace_back(std::move(arg));
+			enabled[i] = true;
 		}
 
-		std::sort(args.begin(), args.end());
-
 		Array::Ptr command_arr = resolvedCommand;
-		for (const CommandArgument& arg : args) {
+		for (size_t i : command.ArgumentOrder) {
+			if (!enabled[i])
+				continue;
+
+			const CompiledCommandArgument& arg = compiledArgs[i];
+			const Value& avalue = values[i];
 
-			if (arg.AValue.IsObjectType<Dictionary>()) {
+			if (avalue.IsObjectType<Dictionary>()) {
 				Log(LogWarning, "PluginUtility")
 					<< "Tried to use dictionary in argument '" << arg.Key << "'.";
 				continue;
-			} else if (arg.AValue.IsObjectType<Array>()) {
+			} else if (avalue.IsObjectType<Array>()) {
 				bool first = true;
-				Array::Ptr arr = static_cast<Array::Ptr>(arg.AValue);
+				Array::Ptr arr = static_cast<Array::Ptr>(avalue);
 
 				ObjectLock olock(arr);
 				for (const Value& value : arr) {
@@ -542,9 +790,75 @@ Value MacroProcessor::ResolveArguments(const Value& command, const Dictionary::P
 					AddArgumentHelper(command_arr, arg.Key, value, add_key, !arg.SkipValue);
 				}
 			} else
-				AddArgumentHelper(command_arr, arg.Key, arg.AValue, !arg.SkipKey, !arg.SkipValue);
+				AddArgumentHelper(command_arr, arg.Key, avalue, !arg.SkipKey, !arg.SkipValue);
 		}
 	}
 
 	return resolvedCommand;
 }
+
+MacroSpecializationCache::MacroSpecializationCache(MacroProcessor::EscapeCallback escapeFn)
+	: m_EscapeFn(std::move(escapeFn))
+{
+}
+
+/**
+ * Returns the values specialized for the given checkable.
+ *
+ * @param checkable The host or service
+ * @param values The compiled values
+ * @param resolvers The resolvers of the checkable
+ * @returns The specialized values, in the same order
+ */
+MacroSpecializationCache::Values MacroSpecializationCache::Get(const Checkable::Ptr& checkable, const Values& values,
+	const MacroProcessor::ResolverList& resolvers)
+{
+	Host::Ptr host;
+	Service::Ptr service;
+	tie(host, service) = GetHostService(checkable);
+
+	double version = checkable->GetVersion();
+	uint_fast64_t generation = checkable->GetModifiedAttributesGeneration();
+	double hostVersion = service ? host->GetVersion() : 0;
+	uint_fast64_t hostGeneration = service ? host->GetModifiedAttributesGeneration() : 0;
+
+	{
+		std::unique_lock<std::mutex> lock (m_Mutex);
+		auto entry (m_Entries.find(checkable));
+
+		if (entry != m_Entries.end() && entry->second.Source == values && entry->second.Version == version
+			&& entry->second.Generation == generation && entry->second.HostVersion == hostVersion
+			&& entry->second.HostGeneration == hostGeneration) {
+			return entry->second.Specialized;
+		}
+	}
+
+	auto specialized (std::make_shared<std::vector<CompiledMacroValue>>());
+	specialized->reserve(values->size());
+
+	for (auto& value : *values)
+		specialized->emplace_back(MacroProcessor::SpecializeValue(value, resolvers, m_EscapeFn));
+
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	m_Entries[checkable] = Entry{values, specialized, version, generation, hostVersion, hostGeneration};
+
+	return specialized;
+}
+
+/**
+ * Drops the entry of a checkable, e.g. once it has been deleted.
+ */
+void MacroSpecializationCache::Erase(const Checkable::Ptr& checkable)
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	m_Entries.erase(checkable);
+}
+
+void MacroSpecializationCache::Clear()
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	m_Entries.clear();
+}
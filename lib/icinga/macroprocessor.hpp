@@ -6,11 +6,86 @@
 #include "icinga/i2-icinga.hpp"
 #include "icinga/checkable.hpp"
 #include "base/value.hpp"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
 #include <vector>
 
 namespace icinga
 {
 
+/**
+ * A macro format string split into literal text and macros.
+ *
+ * @ingroup icinga
+ */
+struct MacroFormat
+{
+	struct Segment
+	{
+		bool IsMacro;
+		String Text;
+		String ObjName;
+		std::vector<String> Tokens;
+		String Path;
+	};
+
+	String Source;
+	std::vector<Segment> Segments;
+	bool Unterminated{false};
+};
+
+/**
+ * A value whose format strings have been parsed in advance. Values which
+ * can't be compiled (functions, dictionaries) are resolved from Source.
+ *
+ * @ingroup icinga
+ */
+struct CompiledMacroValue
+{
+	Value Source;
+	std::vector<MacroFormat> Formats;
+	bool IsArray{false};
+};
+
+/**
+ * A command argument as configured in a command's arguments dictionary.
+ *
+ * @ingroup icinga
+ */
+struct CompiledCommandArgument
+{
+	String Key;
+	int Order{0};
+	bool Required{false};
+	bool SkipKey{false};
+	bool RepeatKey{true};
+	bool SkipValue{false};
+	bool HasSetIf{false};
+	CompiledMacroValue SetIf;
+	CompiledMacroValue ArgValue;
+};
+
+/**
+ * A command's command line, arguments and environment, compiled once and
+ * reused for each execution until the command's attributes are replaced.
+ *
+ * @ingroup icinga
+ */
+struct CompiledCommand
+{
+	Value CommandLine;
+	Dictionary::Ptr Arguments;
+	Dictionary::Ptr Env;
+
+	CompiledMacroValue CompiledCommandLine;
+	std::vector<CompiledCommandArgument> CompiledArguments;
+	std::vector<size_t> ArgumentOrder;
+	std::vector<std::pair<String, CompiledMacroValue>> CompiledEnv;
+};
+
 /**
  * Resolves macros.
  *
@@ -33,19 +108,42 @@ public:
 		const MacroProcessor::ResolverList& resolvers, const CheckResult::Ptr& cr,
 		const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int recursionLevel = 0);
 
+	static Value ResolveMacros(const CompiledMacroValue& value, const ResolverList& resolvers,
+		const CheckResult::Ptr& cr = nullptr, String *missingMacro = nullptr,
+		const EscapeCallback& escapeFn = EscapeCallback(),
+		const Dictionary::Ptr& resolvedMacros = nullptr,
+		bool useResolvedMacros = false, int recursionLevel = 0);
+
+	static Value ResolveArguments(const CompiledCommand& command,
+		const MacroProcessor::ResolverList& resolvers, const CheckResult::Ptr& cr,
+		const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int recursionLevel = 0);
+
+	static std::shared_ptr<CompiledCommand> CompileCommand(const Value& command,
+		const Dictionary::Ptr& arguments, const Dictionary::Ptr& env = nullptr);
+	static CompiledMacroValue CompileValue(const Value& value);
+	static MacroFormat ParseFormat(const String& str);
+	static CompiledMacroValue SpecializeValue(const CompiledMacroValue& value, const ResolverList& resolvers,
+		const EscapeCallback& escapeFn = EscapeCallback());
+
 	static bool ValidateMacroString(const String& macro);
 	static void ValidateCustomVars(const ConfigObject::Ptr& object, const Dictionary::Ptr& value);
 
 private:
 	MacroProcessor();
 
-	static bool ResolveMacro(const String& macro, const ResolverList& resolvers,
+	static bool ResolveMacro(const MacroFormat::Segment& macro, const ResolverList& resolvers,
 		const CheckResult::Ptr& cr, Value *result, bool *recursive_macro);
+	static bool IsStaticMacro(const MacroFormat::Segment& macro);
 	static Value InternalResolveMacros(const String& str,
 		const ResolverList& resolvers, const CheckResult::Ptr& cr,
 		String *missingMacro, const EscapeCallback& escapeFn,
 		const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros,
 		int recursionLevel = 0);
+	static Value InternalResolveMacros(const MacroFormat& format,
+		const ResolverList& resolvers, const CheckResult::Ptr& cr,
+		String *missingMacro, const EscapeCallback& escapeFn,
+		const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros,
+		int recursionLevel = 0);
 	static Value EvaluateFunction(const Function::Ptr& func, const ResolverList& resolvers,
 		const CheckResult::Ptr& cr, const MacroProcessor::EscapeCallback& escapeFn,
 		const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int recursionLevel);
@@ -56,6 +154,43 @@ private:
 
 };
 
+/**
+ * Compiled macro values specialized for each checkable, see MacroProcessor::SpecializeValue().
+ *
+ * The macros which only depend on the configuration of a checkable and its host
+ * (names, custom variables etc.) are resolved once per checkable. An entry is
+ * specialized again as soon as the version or the modified attributes of the
+ * checkable or its host change, or the values it has been specialized from.
+ *
+ * @ingroup icinga
+ */
+class MacroSpecializationCache
+{
+public:
+	typedef std::shared_ptr<const std::vector<CompiledMacroValue>> Values;
+
+	explicit MacroSpecializationCache(MacroProcessor::EscapeCallback escapeFn = MacroProcessor::EscapeCallback());
+
+	Values Get(const Checkable::Ptr& checkable, const Values& values, const MacroProcessor::ResolverList& resolvers);
+	void Erase(const Checkable::Ptr& checkable);
+	void Clear();
+
+private:
+	struct Entry
+	{
+		Values Source;
+		Values Specialized;
+		double Version;
+		uint_fast64_t Generation;
+		double HostVersion;
+		uint_fast64_t HostGeneration;
+	};
+
+	MacroProcessor::EscapeCallback m_EscapeFn;
+	std::mutex m_Mutex;
+	std::map<Checkable::Ptr, Entry> m_Entries;
+};
+
 }
 
 #endif /* MACROPROCESSOR_H */
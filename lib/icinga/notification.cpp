@@ -23,6 +23,7 @@ std::map<String, int> Notification::m_StateFilterMap;
 std::map<String, int> Notification::m_TypeFilterMap;
 
 boost::signals2::signal<void (const Notification::Ptr&, const MessageOrigin::Ptr&)> Notification::OnNextNotificationChanged;
+boost::signals2::signal<void (const Notification::Ptr&)> Notification::OnNotificationStashed;
 
 String NotificationNameComposer::MakeName(const String& shortName, const Object::Ptr& context) const
 {
@@ -397,6 +398,9 @@ void Notification::BeginExecuteNotification(NotificationType type, const CheckRe
 	std::set<User::Ptr> allNotifiedUsers;
 	Array::Ptr notifiedProblemUsers = GetNotifiedProblemUsers();
 
+	/* The checkable's state and the current time are the same for all users. */
+	UserFilterContext filterContext = GetUserFilterContext(type);
+
 	for (const User::Ptr& user : allUsers) {
 		String userName = user->GetName();
 
@@ -407,7 +411,7 @@ void Notification::BeginExecuteNotification(NotificationType type, const CheckRe
 			continue;
 		}
 
-		if (!CheckNotificationUserFilters(type, user, force, reminder)) {
+		if (!CheckNotificationUserFilters(type, user, force, reminder, filterContext)) {
 			Log(LogNotice, "Notification")
 				<< "Notification object '" << notificationName << "': Filters for user '" << userName << "' not matched. Not sending notification.";
 			continue;
@@ -459,7 +463,55 @@ void Notification::BeginExecuteNotification(NotificationType type, const CheckRe
 	Service::OnNotificationSentToAllUsers(this, checkable, allNotifiedUsers, type, cr, author, text, nullptr);
 }
 
-bool Notification::CheckNotificationUserFilters(NotificationType type, const User::Ptr& user, bool force, bool reminder)
+/**
+ * Stashes a notification to be sent once the checkable is reachable and
+ * this endpoint has the authority for it.
+ */
+void Notification::StashNotification(NotificationType type, const CheckResult::Ptr& cr, bool force,
+	bool reminder, const String& author, const String& text)
+{
+	GetStashedNotifications()->Add(new Dictionary({
+		{"type", type},
+		{"cr", cr},
+		{"force", force},
+		{"reminder", reminder},
+		{"author", author},
+		{"text", text}
+	}));
+
+	OnNotificationStashed(this);
+}
+
+Notification::UserFilterContext Notification::GetUserFilterContext(NotificationType type)
+{
+	UserFilterContext context;
+
+	context.Now = Utility::GetTime();
+	context.FState = 0;
+
+	if (type != NotificationRecovery) {
+		Host::Ptr host;
+		Service::Ptr service;
+		tie(host, service) = GetHostService(GetCheckable());
+
+		if (service) {
+			context.FState = ServiceStateToFilter(service->GetState());
+			context.StateStr = NotificationServiceStateToString(service->GetState());
+		} else {
+			context.FState = HostStateToFilter(host->GetState());
+			context.StateStr = NotificationHostStateToString(host->GetState());
+		}
+	}
+
+	return context;
+}
+
+/**
+ * Checks a user's filters. Users usually share few time periods, so
+ * whether we're inside them is only computed once per context.
+ */
+bool Notification::CheckNotificationUserFilters(NotificationType type, const User::Ptr& user, bool force, bool reminder,
+	UserFilterContext& context)
 {
 	String notificationName = GetName();
 	String userName = user->GetName();
@@ -467,12 +519,19 @@ bool Notification::CheckNotificationUserFilters(NotificationType type, const Use
 	if (!force) {
 		TimePeriod::Ptr tp = user->GetPeriod();
 
-		if (tp && !tp->IsInside(Utility::GetTime())) {
-			Log(LogNotice, "Notification")
-				<< "Not sending " << (reminder ? "reminder " : "") << "notifications for notification object '"
-				<< notificationName << " and user '" << userName
-				<< "': user period not in timeperiod '" << tp->GetName() << "'";
-			return false;
+		if (tp) {
+			auto inside (context.PeriodsInside.find(tp.get()));
+
+			if (inside == context.PeriodsInside.end())
+				inside = context.PeriodsInside.emplace(tp.get(), tp->IsInside(context.Now)).first;
+
+			if (!inside->second) {
+				Log(LogNotice, "Notification")
+					<< "Not sending " << (reminder ? "reminder " : "") << "notifications for notification object '"
+					<< notificationName << " and user '" << userName
+					<< "': user period not in timeperiod '" << tp->GetName() << "'";
+				return false;
+			}
 		}
 
 		unsigned long ftype = type;
@@ -495,32 +554,16 @@ bool Notification::CheckNotificationUserFilters(NotificationType type, const Use
 
 		/* check state filters it this is not a recovery notification */
 		if (type != NotificationRecovery) {
-			Checkable::Ptr checkable = GetCheckable();
-			Host::Ptr host;
-			Service::Ptr service;
-			tie(host, service) = GetHostService(checkable);
-
-			unsigned long fstate;
-			String stateStr;
-
-			if (service) {
-				fstate = ServiceStateToFilter(service->GetState());
-				stateStr = NotificationServiceStateToString(service->GetState());
-			} else {
-				fstate = HostStateToFilter(host->GetState());
-				stateStr = NotificationHostStateToString(host->GetState());
-			}
-
 			Log(LogDebug, "Notification")
 				<< "User '" << userName << "' notification '" << notificationName
-				<< "', State '" << stateStr << "', StateFilter: "
+				<< "', State '" << context.StateStr << "', StateFilter: "
 				<< NotificationFilterToString(user->GetStateFilter(), GetStateFilterMap())
-				<< " (FState=" << fstate << ", StateFilter=" << user->GetStateFilter() << ")";
+				<< " (FState=" << context.FState << ", StateFilter=" << user->GetStateFilter() << ")";
 
-			if (!(fstate & user->GetStateFilter())) {
+			if (!(context.FState & user->GetStateFilter())) {
 				Log(LogNotice, "Notification")
 					<< "Not " << (reminder ? "reminder " : "") << "sending notifications for notification object '"
-					<< notificationName << " and user '" << userName << "': state '" << stateStr
+					<< notificationName << " and user '" << userName << "': state '" << context.StateStr
 					<< "' does not match state filter: " << NotificationFilterToString(user->GetStateFilter(), GetStateFilterMap()) << ".";
 				return false;
 			}
@@ -550,6 +593,14 @@ void Notification::ExecuteNotificationHelper(NotificationType type, const User::
 
 	String commandName = command->GetName();
 
+	/* Executed later as part of a digest, unless this is the digest's execution. */
+	if (!NotificationCommand::DigestMacros && command->AddToDigest(this, user, type, cr, author, text)) {
+		Log(LogNotice, "Notification")
+			<< "Added '" << NotificationTypeToString(type) << "' notification '" << notificationName
+			<< "' for user '" << userName << "' to the digest of command '" << commandName << "'.";
+		return;
+	}
+
 	try {
 		command->Execute(this, user, cr, type, author, text);
 
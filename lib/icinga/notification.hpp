@@ -79,6 +79,9 @@ public:
 
 	void BeginExecuteNotification(NotificationType type, const CheckResult::Ptr& cr, bool force,
 		bool reminder = false, const String& author = "", const String& text = "");
+	void StashNotification(NotificationType type, const CheckResult::Ptr& cr, bool force,
+		bool reminder, const String& author, const String& text);
+	void ExecuteNotificationHelper(NotificationType type, const User::Ptr& user, const CheckResult::Ptr& cr, bool force, const String& author = "", const String& text = "");
 
 	Endpoint::Ptr GetCommandEndpoint() const;
 
@@ -92,6 +95,7 @@ public:
 	static String NotificationHostStateToString(HostState state);
 
 	static boost::signals2::signal<void (const Notification::Ptr&, const MessageOrigin::Ptr&)> OnNextNotificationChanged;
+	static boost::signals2::signal<void (const Notification::Ptr&)> OnNotificationStashed;
 
 	void Validate(int types, const ValidationUtils& utils) override;
 
@@ -114,9 +118,20 @@ protected:
 private:
 	ObjectImpl<Checkable>::Ptr m_Checkable;
 
-	bool CheckNotificationUserFilters(NotificationType type, const User::Ptr& user, bool force, bool reminder);
-
-	void ExecuteNotificationHelper(NotificationType type, const User::Ptr& user, const CheckResult::Ptr& cr, bool force, const String& author = "", const String& text = "");
+	/**
+	 * What CheckNotificationUserFilters() looks at which is the same for all users.
+	 */
+	struct UserFilterContext
+	{
+		double Now;
+		unsigned long FState;
+		String StateStr;
+		std::map<TimePeriod *, bool> PeriodsInside;
+	};
+
+	UserFilterContext GetUserFilterContext(NotificationType type);
+	bool CheckNotificationUserFilters(NotificationType type, const User::Ptr& user, bool force, bool reminder,
+		UserFilterContext& context);
 
 	static bool EvaluateApplyRuleInstance(const intrusive_ptr<Checkable>& checkable, const String& name, ScriptFrame& frame, const ApplyRule& rule);
 	static bool EvaluateApplyRule(const intrusive_ptr<Checkable>& checkable, const ApplyRule& rule);
@@ -2,12 +2,21 @@
 
 #include "icinga/notificationcommand.hpp"
 #include "icinga/notificationcommand-ti.cpp"
+#include "icinga/compatutility.hpp"
+#include "icinga/service.hpp"
+#include "base/defer.hpp"
+#include "base/logger.hpp"
+#include "base/utility.hpp"
+#include <boost/algorithm/string/join.hpp>
+#include <algorithm>
+#include <utility>
 
 using namespace icinga;
 
 REGISTER_TYPE(NotificationCommand);
 
 thread_local NotificationCommand::Ptr NotificationCommand::ExecuteOverride;
+thread_local Dictionary::Ptr NotificationCommand::DigestMacros;
 
 Dictionary::Ptr NotificationCommand::Execute(const Notification::Ptr& notification,
 	const User::Ptr& user, const CheckResult::Ptr& cr, const NotificationType& type,
@@ -25,3 +34,180 @@ Dictionary::Ptr NotificationCommand::Execute(const Notification::Ptr& notificati
 		useResolvedMacros,
 	});
 }
+
+void NotificationCommand::Start(bool runtimeCreated)
+{
+	ObjectImpl<NotificationCommand>::Start(runtimeCreated);
+
+	if (GetDigestWindow() > 0) {
+		m_DigestTimer = new Timer();
+		m_DigestTimer->SetInterval(std::min(GetDigestWindow(), 1.0));
+		m_DigestTimer->OnTimerExpired.connect([this](const Timer * const&) { FlushDigests(false); });
+		m_DigestTimer->Start();
+	}
+}
+
+void NotificationCommand::Stop(bool runtimeRemoved)
+{
+	if (m_DigestTimer) {
+		m_DigestTimer->Stop(true);
+		m_DigestTimer.reset();
+	}
+
+	/* Don't lose the notifications collected so far. */
+	FlushDigests(true);
+
+	ObjectImpl<NotificationCommand>::Stop(runtimeRemoved);
+}
+
+/**
+ * Collects a notification for a user which is sent together with the other
+ * ones for the same user once the digest window has passed.
+ *
+ * @return false if digests are disabled for this command
+ */
+bool NotificationCommand::AddToDigest(const Notification::Ptr& notification, const User::Ptr& user,
+	NotificationType type, const CheckResult::Ptr& cr, const String& author, const String& text)
+{
+	double window = GetDigestWindow();
+
+	if (window <= 0 || !IsActive())
+		return false;
+
+	std::unique_lock<std::mutex> lock (m_DigestsMutex);
+
+	auto it (m_Digests.find(user));
+
+	if (it == m_Digests.end())
+		it = m_Digests.emplace(user, Digest{Utility::GetTime() + window, {}}).first;
+
+	it->second.Entries.emplace_back(DigestEntry{notification, type, cr, author, text});
+
+	return true;
+}
+
+/**
+ * Executes the digests whose window has passed.
+ *
+ * @param all Whether to execute all digests regardless of their window
+ */
+void NotificationCommand::FlushDigests(bool all)
+{
+	std::vector<std::pair<User::Ptr, std::vector<DigestEntry>>> due;
+	double now = Utility::GetTime();
+
+	{
+		std::unique_lock<std::mutex> lock (m_DigestsMutex);
+
+		for (auto it (m_Digests.begin()); it != m_Digests.end();) {
+			if (all || it->second.Deadline <= now) {
+				due.emplace_back(it->first, std::move(it->second.Entries));
+				it = m_Digests.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	for (auto& digest : due) {
+		auto user (digest.first);
+		auto entries (std::make_shared<std::vector<DigestEntry>>(std::move(digest.second)));
+
+		Utility::QueueAsyncCallback([user, entries]() { ExecuteDigest(user, *entries); });
+	}
+}
+
+/**
+ * Executes the command once for all notifications of a digest. The digest_*
+ * macros describe all of them, the other macros the latest one.
+ */
+void NotificationCommand::ExecuteDigest(const User::Ptr& user, const std::vector<DigestEntry>& entries)
+{
+	if (entries.empty())
+		return;
+
+	std::vector<String> objects;
+	std::vector<String> lines;
+
+	for (auto& entry : entries) {
+		Checkable::Ptr checkable = entry.NotificationObject->GetCheckable();
+
+		objects.emplace_back(checkable->GetName());
+		lines.emplace_back(FormatDigestLine(checkable, entry.Type, entry.CR));
+	}
+
+	DigestMacros = new Dictionary({
+		{ "digest_count", entries.size() },
+		{ "digest_objects", boost::algorithm::join(objects, ", ") },
+		{ "digest_summary", boost::algorithm::join(lines, "\n") }
+	});
+
+	Defer resetDigestMacros ([]() { DigestMacros = nullptr; });
+
+	auto& latest (entries.back());
+
+	Log(LogInformation, "NotificationCommand")
+		<< "Sending digest of " << entries.size() << " notification(s) to user '" << user->GetName() << "'.";
+
+	latest.NotificationObject->ExecuteNotificationHelper(latest.Type, user, latest.CR, false, latest.Author, latest.Text);
+
+	/* Required by the compat logger and the notification history, as if they had been sent one by one. */
+	for (size_t i = 0; i + 1u < entries.size(); i++) {
+		auto& entry (entries[i]);
+		auto notification (entry.NotificationObject);
+
+		Checkable::OnNotificationSentToUser(notification, notification->GetCheckable(), user, entry.Type, entry.CR,
+			entry.Author, entry.Text, notification->GetCommand()->GetName(), nullptr);
+	}
+}
+
+/**
+ * Returns the digest_* macros of a notification which isn't part of a digest.
+ */
+Dictionary::Ptr NotificationCommand::GetDigestMacros(const Checkable::Ptr& checkable, NotificationType type, const CheckResult::Ptr& cr)
+{
+	return new Dictionary({
+		{ "digest_count", 1 },
+		{ "digest_objects", checkable->GetName() },
+		{ "digest_summary", FormatDigestLine(checkable, type, cr) }
+	});
+}
+
+String NotificationCommand::FormatDigestLine(const Checkable::Ptr& checkable, NotificationType type, const CheckResult::Ptr& cr)
+{
+	Host::Ptr host;
+	Service::Ptr service;
+	tie(host, service) = GetHostService(checkable);
+
+	String line = Notification::NotificationTypeToStringCompat(type) + " " + checkable->GetName() + " is "
+		+ (service ? Service::StateToString(service->GetState()) : Host::StateToString(host->GetState()));
+
+	if (cr)
+		line += ": " + CompatUtility::GetCheckResultOutput(cr);
+
+	return line;
+}
+
+/**
+ * Returns the queue limiting the executions of this command to max_concurrent_executions.
+ */
+ExecutionQueue& NotificationCommand::GetExecutionQueue()
+{
+	return m_ExecutionQueue;
+}
+
+void NotificationCommand::ValidateDigestWindow(const Lazy<double>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<NotificationCommand>::ValidateDigestWindow(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "digest_window" }, "Value must not be negative."));
+}
+
+void NotificationCommand::ValidateMaxConcurrentExecutions(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<NotificationCommand>::ValidateMaxConcurrentExecutions(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "max_concurrent_executions" }, "Value must not be negative."));
+}
@@ -5,6 +5,11 @@
 
 #include "icinga/notificationcommand-ti.hpp"
 #include "icinga/notification.hpp"
+#include "icinga/executionqueue.hpp"
+#include "base/timer.hpp"
+#include <map>
+#include <mutex>
+#include <vector>
 
 namespace icinga
 {
@@ -24,11 +29,54 @@ public:
 
 	static thread_local NotificationCommand::Ptr ExecuteOverride;
 
+	/* The digest_* notification macros of the execution in progress. */
+	static thread_local Dictionary::Ptr DigestMacros;
+
 	virtual Dictionary::Ptr Execute(const intrusive_ptr<Notification>& notification,
 		const User::Ptr& user, const CheckResult::Ptr& cr, const NotificationType& type,
 		const String& author, const String& comment,
 		const Dictionary::Ptr& resolvedMacros = nullptr,
 		bool useResolvedMacros = false);
+
+	bool AddToDigest(const intrusive_ptr<Notification>& notification, const User::Ptr& user,
+		NotificationType type, const CheckResult::Ptr& cr, const String& author, const String& text);
+	void FlushDigests(bool all);
+
+	static Dictionary::Ptr GetDigestMacros(const intrusive_ptr<Checkable>& checkable, NotificationType type, const CheckResult::Ptr& cr);
+
+	ExecutionQueue& GetExecutionQueue();
+
+	void ValidateDigestWindow(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
+	void ValidateMaxConcurrentExecutions(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+
+protected:
+	void Start(bool runtimeCreated) override;
+	void Stop(bool runtimeRemoved) override;
+
+private:
+	struct DigestEntry
+	{
+		intrusive_ptr<Notification> NotificationObject;
+		NotificationType Type;
+		CheckResult::Ptr CR;
+		String Author;
+		String Text;
+	};
+
+	struct Digest
+	{
+		double Deadline;
+		std::vector<DigestEntry> Entries;
+	};
+
+	std::mutex m_DigestsMutex;
+	std::map<User::Ptr, Digest> m_Digests;
+	Timer::Ptr m_DigestTimer;
+
+	ExecutionQueue m_ExecutionQueue;
+
+	static String FormatDigestLine(const intrusive_ptr<Checkable>& checkable, NotificationType type, const CheckResult::Ptr& cr);
+	static void ExecuteDigest(const User::Ptr& user, const std::vector<DigestEntry>& entries);
 };
 
 }
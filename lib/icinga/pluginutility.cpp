@@ -1,7 +1,10 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "icinga/pluginutility.hpp"
+#include "icinga/checkcommand.hpp"
+#include "icinga/checkworker.hpp"
 #include "icinga/macroprocessor.hpp"
+#include "icinga/pluginworker.hpp"
 #include "base/logger.hpp"
 #include "base/utility.hpp"
 #include "base/perfdatavalue.hpp"
@@ -10,21 +13,23 @@
 #include "base/objectlock.hpp"
 #include "base/exception.hpp"
 #include <boost/algorithm/string/trim.hpp>
+#include <boost/utility/string_view.hpp>
+#include <cstring>
+#include <string>
 
 using namespace icinga;
 
 void PluginUtility::ExecuteCommand(const Command::Ptr& commandObj, const Checkable::Ptr& checkable,
 	const CheckResult::Ptr& cr, const MacroProcessor::ResolverList& macroResolvers,
 	const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros, int timeout,
-	const std::function<void(const Value& commandLine, const ProcessResult&)>& callback)
+	const std::function<void(const Value& commandLine, const ProcessResult&)>& callback, const Value& worker)
 {
-	Value raw_command = commandObj->GetCommandLine();
-	Dictionary::Ptr raw_arguments = commandObj->GetArguments();
+	auto compiled (commandObj->GetCompiledCommand());
 
 	Value command;
 
 	try {
-		command = MacroProcessor::ResolveArguments(raw_command, raw_arguments,
+		command = MacroProcessor::ResolveArguments(*compiled,
 			macroResolvers, cr, resolvedMacros, useResolvedMacros);
 	} catch (const std::exception& ex) {
 		String message = DiagnosticInformation(ex);
@@ -46,38 +51,49 @@ void PluginUtility::ExecuteCommand(const Command::Ptr& commandObj, const Checkab
 
 	Dictionary::Ptr envMacros = new Dictionary();
 
-	Dictionary::Ptr env = commandObj->GetEnv();
+	for (const auto& kv : compiled->CompiledEnv) {
+		String name = kv.second.Source;
 
-	if (env) {
-		ObjectLock olock(env);
-		for (const Dictionary::Pair& kv : env) {
-			String name = kv.second;
-
-			String missingMacro;
-			Value value = MacroProcessor::ResolveMacros(name, macroResolvers, cr,
-				&missingMacro, MacroProcessor::EscapeCallback(), resolvedMacros,
-				useResolvedMacros);
+		String missingMacro;
+		Value value = MacroProcessor::ResolveMacros(kv.second, macroResolvers, cr,
+			&missingMacro, MacroProcessor::EscapeCallback(), resolvedMacros,
+			useResolvedMacros);
 
 #ifdef I2_DEBUG
-			if (!missingMacro.IsEmpty())
-				Log(LogDebug, "PluginUtility")
-					<< "Macro '" << name << "' is not defined.";
+		if (!missingMacro.IsEmpty())
+			Log(LogDebug, "PluginUtility")
+				<< "Macro '" << name << "' is not defined.";
 #endif /* I2_DEBUG */
 
-			if (value.IsObjectType<Array>())
-				value = Utility::Join(value, ';');
+		if (value.IsObjectType<Array>())
+			value = Utility::Join(value, ';');
 
-			envMacros->Set(kv.first, value);
-		}
+		envMacros->Set(kv.first, value);
 	}
 
 	if (resolvedMacros && !useResolvedMacros)
 		return;
 
+#ifndef _WIN32
+	if (!worker.IsEmpty()) {
+		PluginWorker::Execute(Process::PrepareCommand(worker), command, envMacros, timeout,
+			[callback, command](const ProcessResult& pr) { callback(command, pr); });
+		return;
+	}
+
+	/* Checks are spawned by the check worker processes if the CheckerComponent has started any. */
+	if (dynamic_pointer_cast<CheckCommand>(commandObj) && CheckWorker::IsEnabled()) {
+		CheckWorker::Execute(Process::PrepareCommand(command), envMacros, timeout, commandObj->GetMaxOutputSize(),
+			[callback, command](const ProcessResult& pr) { callback(command, pr); });
+		return;
+	}
+#endif /* _WIN32 */
+
 	Process::Ptr process = new Process(Process::PrepareCommand(command), envMacros);
 
 	process->SetTimeout(timeout);
 	process->SetAdjustPriority(true);
+	process->SetMaxOutputSize(commandObj->GetMaxOutputSize());
 
 	process->Run([callback, command](const ProcessResult& pr) { callback(command, pr); });
 }
@@ -130,45 +146,55 @@ Array::Ptr PluginUtility::SplitPerfdata(const String& perfdata)
 {
 	ArrayData result;
 
-	size_t begin = 0;
-	String multi_prefix;
+	const char *begin = perfdata.CStr();
+	const char *end = begin + perfdata.GetLength();
+	std::string multiPrefix;
 
-	for (;;) {
-		size_t eqp = perfdata.FindFirstOf('=', begin);
+	while (begin < end) {
+		auto eqp ((const char*)memchr(begin, '=', end - begin));
 
-		if (eqp == String::NPos)
+		if (!eqp)
 			break;
 
-		String label = perfdata.SubStr(begin, eqp - begin);
+		boost::string_view label (begin, eqp - begin);
 
-		if (label.GetLength() > 2 && label[0] == '\'' && label[label.GetLength() - 1] == '\'')
-			label = label.SubStr(1, label.GetLength() - 2);
+		if (label.size() > 2 && label.front() == '\'' && label.back() == '\'')
+			label = label.substr(1, label.size() - 2);
 
-		size_t multi_index = label.RFind("::");
+		auto multiIndex (label.rfind("::"));
 
-		if (multi_index != String::NPos)
-			multi_prefix = "";
+		if (multiIndex != boost::string_view::npos)
+			multiPrefix.clear();
 
-		size_t spq = perfdata.FindFirstOf(' ', eqp);
+		auto spq ((const char*)memchr(eqp, ' ', end - eqp));
 
-		if (spq == String::NPos)
-			spq = perfdata.GetLength();
+		if (!spq)
+			spq = end;
 
-		String value = perfdata.SubStr(eqp + 1, spq - eqp - 1);
+		bool quote = label.find(' ') != boost::string_view::npos || multiPrefix.find(' ') != std::string::npos;
+		std::string pdv;
 
-		if (!multi_prefix.IsEmpty())
-			label = multi_prefix + "::" + label;
+		pdv.reserve(multiPrefix.size() + label.size() + (spq - eqp) + 4u);
 
-		String pdv;
-		if (label.FindFirstOf(" ") != String::NPos)
-			pdv = "'" + label + "'=" + value;
-		else
-			pdv = label + "=" + value;
+		if (quote)
+			pdv += '\'';
+
+		if (!multiPrefix.empty()) {
+			pdv += multiPrefix;
+			pdv += "::";
+		}
+
+		pdv.append(label.data(), label.size());
+
+		if (quote)
+			pdv += '\'';
+
+		pdv.append(eqp, spq);
 
-		result.emplace_back(std::move(pdv));
+		result.emplace_back(String(std::move(pdv)));
 
-		if (multi_index != String::NPos)
-			multi_prefix = label.SubStr(0, multi_index);
+		if (multiIndex != boost::string_view::npos)
+			multiPrefix.assign(label.data(), multiIndex);
 
 		begin = spq + 1;
 	}
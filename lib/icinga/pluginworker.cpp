@@ -0,0 +1,328 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef _WIN32
+
+#include "icinga/pluginworker.hpp"
+#include "base/convert.hpp"
+#include "base/exception.hpp"
+#include "base/json.hpp"
+#include "base/logger.hpp"
+#include "base/netstring.hpp"
+#include "base/utility.hpp"
+#include <boost/asio/buffers_iterator.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/lexical_cast.hpp>
+#include <unistd.h>
+
+using namespace icinga;
+
+/* Responses are plugin output, anything larger than this is garbage. */
+static const size_t l_MaxResponseLength = 16 * 1024 * 1024;
+
+std::mutex PluginWorker::m_WorkersMutex;
+std::map<String, PluginWorker::Ptr> PluginWorker::m_Workers;
+
+PluginWorker::PluginWorker(const Process::Arguments& arguments)
+	: m_Arguments(arguments), m_Strand(IoEngine::Get().GetIoContext()), m_Stdin(IoEngine::Get().GetIoContext()),
+	m_Stdout(IoEngine::Get().GetIoContext()), m_RequestsQueued(IoEngine::Get().GetIoContext()), m_NextRequestId(0),
+	m_Stopped(false)
+{ }
+
+/**
+ * Executes a command through a worker, starting the worker if it isn't
+ * running yet. The callback is called exactly once, like the one passed to
+ * Process::Run().
+ *
+ * @param worker The worker's command line
+ * @param command The command the worker shall execute
+ * @param extraEnvironment Environment variables for the command
+ * @param timeout The command's timeout in seconds
+ * @param callback Receives the command's result
+ */
+void PluginWorker::Execute(const Process::Arguments& worker, const Value& command,
+	const Dictionary::Ptr& extraEnvironment, double timeout, const Callback& callback)
+{
+	String key = Process::PrettyPrintArguments(worker);
+	PluginWorker::Ptr instance;
+
+	try {
+		std::unique_lock<std::mutex> lock (m_WorkersMutex);
+		auto& current (m_Workers[key]);
+
+		if (!current || current->m_Stopped.load()) {
+			current = new PluginWorker(worker);
+			current->Start();
+		}
+
+		instance = current;
+	} catch (const std::exception& ex) {
+		String message = "Plugin worker " + key + " failed to start: " + DiagnosticInformation(ex, false);
+
+		Log(LogWarning, "PluginWorker", message);
+
+		ProcessResult pr;
+		pr.PID = -1;
+		pr.ExecutionStart = Utility::GetTime();
+		pr.ExecutionEnd = pr.ExecutionStart;
+		pr.ExitStatus = 3; /* Unknown */
+		pr.Output = message;
+
+		Utility::QueueAsyncCallback([callback, pr]() { callback(pr); });
+		return;
+	}
+
+	boost::asio::post(instance->m_Strand, [instance, command, extraEnvironment, timeout, callback]() {
+		instance->Enqueue(command, extraEnvironment, timeout, callback);
+	});
+}
+
+/**
+ * Spawns the worker with pipes as stdin and stdout. The worker's stderr is
+ * logged once it has exited.
+ */
+void PluginWorker::Start()
+{
+	int requestFDs[2], responseFDs[2];
+
+	if (pipe(requestFDs) < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("pipe")
+			<< boost::errinfo_errno(errno));
+	}
+
+	if (pipe(responseFDs) < 0) {
+		int error = errno;
+
+		(void)close(requestFDs[0]);
+		(void)close(requestFDs[1]);
+
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("pipe")
+			<< boost::errinfo_errno(error));
+	}
+
+	for (int fd : { requestFDs[0], requestFDs[1], responseFDs[0], responseFDs[1] })
+		Utility::SetCloExec(fd);
+
+	m_Process = new Process(m_Arguments);
+	m_Process->SetStdio(requestFDs[0], responseFDs[1]);
+	m_Process->SetTimeout(0);
+
+	PluginWorker::Ptr keepAlive (this);
+
+	m_Process->Run([this, keepAlive](const ProcessResult& pr) {
+		String reason = "exited with status " + Convert::ToString(pr.ExitStatus);
+
+		if (!pr.Output.IsEmpty())
+			reason += ": " + pr.Output.Trim();
+
+		boost::asio::post(m_Strand, [this, keepAlive, reason]() { Stop(reason); });
+	});
+
+	(void)close(requestFDs[0]);
+	(void)close(responseFDs[1]);
+
+	m_Stdin.assign(requestFDs[1]);
+	m_Stdout.assign(responseFDs[0]);
+
+	Log(LogInformation, "PluginWorker")
+		<< "Started plugin worker " << Process::PrettyPrintArguments(m_Arguments) << " (PID " << m_Process->GetPID() << ").";
+
+	IoEngine::SpawnCoroutine(m_Strand, [this, keepAlive](boost::asio::yield_context yc) { ReadResponses(yc); });
+	IoEngine::SpawnCoroutine(m_Strand, [this, keepAlive](boost::asio::yield_context yc) { WriteRequests(yc); }, CoroutineStackSmall);
+}
+
+/**
+ * Fails all pending requests and closes the pipes, which tells the worker to
+ * exit. Must be called on the strand.
+ *
+ * @param reason Why the worker is stopped, ends up in the requests' output
+ */
+void PluginWorker::Stop(const String& reason)
+{
+	if (m_Stopped.exchange(true))
+		return;
+
+	Log(LogWarning, "PluginWorker")
+		<< "Plugin worker " << Process::PrettyPrintArguments(m_Arguments) << " " << reason;
+
+	boost::system::error_code ec;
+	m_Stdin.close(ec);
+	m_Stdout.close(ec);
+
+	m_RequestsQueued.Set();
+
+	auto requests (std::move(m_Requests));
+	m_Requests.clear();
+
+	double now = Utility::GetTime();
+
+	for (auto& request : requests) {
+		if (request.second.RequestTimeout)
+			request.second.RequestTimeout->Cancel();
+
+		ProcessResult pr;
+		pr.PID = m_Process->GetPID();
+		pr.ExecutionStart = request.second.ExecutionStart;
+		pr.ExecutionEnd = now;
+		pr.ExitStatus = 3; /* Unknown */
+		pr.Output = "<Plugin worker " + reason + ">";
+
+		auto callback (std::move(request.second.OnFinished));
+		Utility::QueueAsyncCallback([callback, pr]() { callback(pr); });
+	}
+}
+
+/**
+ * Registers a request and queues it for the writer. Must be called on the
+ * strand.
+ */
+void PluginWorker::Enqueue(const Value& command, const Dictionary::Ptr& extraEnvironment, double timeout, const Callback& callback)
+{
+	if (m_Stopped.load()) {
+		ProcessResult pr;
+		pr.PID = -1;
+		pr.ExecutionStart = Utility::GetTime();
+		pr.ExecutionEnd = pr.ExecutionStart;
+		pr.ExitStatus = 3; /* Unknown */
+		pr.Output = "<Plugin worker is not running>";
+
+		Utility::QueueAsyncCallback([callback, pr]() { callback(pr); });
+		return;
+	}
+
+	uint64_t id = m_NextRequestId++;
+
+	auto& request (m_Requests[id]);
+	request.OnFinished = callback;
+	request.ExecutionStart = Utility::GetTime();
+
+	PluginWorker::Ptr keepAlive (this);
+
+	/* Like Process, a timeout of 0 means none. */
+	if (timeout != 0) {
+		request.RequestTimeout = new Timeout(m_Strand.context(), m_Strand, boost::posix_time::microseconds(intmax_t(timeout * 1000000)),
+			[this, keepAlive, id](boost::asio::yield_context) { Finish(id, 128, "<Timeout exceeded.>"); });
+	}
+
+	Dictionary::Ptr message = new Dictionary({
+		{ "id", static_cast<double>(id) },
+		{ "command", command },
+		{ "env", extraEnvironment },
+		{ "timeout", timeout }
+	});
+
+	std::string buf;
+	NetString::AppendStringToBuffer(buf, JsonEncode(message));
+
+	m_Queue.emplace_back(std::move(buf));
+	m_RequestsQueued.Set();
+}
+
+/**
+ * Completes a request unless it has already been completed. Must be called
+ * on the strand.
+ */
+void PluginWorker::Finish(uint64_t id, long exitStatus, const String& output)
+{
+	auto it (m_Requests.find(id));
+
+	/* Late responses for timed out requests are dropped. */
+	if (it == m_Requests.end())
+		return;
+
+	if (it->second.RequestTimeout)
+		it->second.RequestTimeout->Cancel();
+
+	ProcessResult pr;
+	pr.PID = m_Process->GetPID();
+	pr.ExecutionStart = it->second.ExecutionStart;
+	pr.ExecutionEnd = Utility::GetTime();
+	pr.ExitStatus = exitStatus;
+	pr.Output = output;
+
+	auto callback (std::move(it->second.OnFinished));
+	m_Requests.erase(it);
+
+	Utility::QueueAsyncCallback([callback, pr]() { callback(pr); });
+}
+
+void PluginWorker::ReadResponses(boost::asio::yield_context yc)
+{
+	boost::asio::streambuf buf;
+
+	try {
+		while (!m_Stopped.load()) {
+			Dictionary::Ptr response = JsonDecode(ReadMessage(buf, yc));
+
+			if (!response)
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Response is not an object"));
+
+			Finish(static_cast<uint64_t>(static_cast<double>(response->Get("id"))), response->Get("exit_status"), response->Get("output"));
+		}
+	} catch (const boost::coroutines::detail::forced_unwind&) {
+		throw;
+	} catch (const std::exception& ex) {
+		Stop("failed to respond: " + DiagnosticInformation(ex, false));
+	}
+}
+
+void PluginWorker::WriteRequests(boost::asio::yield_context yc)
+{
+	try {
+		while (!m_Stopped.load()) {
+			m_RequestsQueued.Wait(yc);
+
+			auto queue (std::move(m_Queue));
+
+			m_Queue.clear();
+			m_RequestsQueued.Clear();
+
+			for (auto& message : queue) {
+				if (m_Stopped.load())
+					return;
+
+				boost::asio::async_write(m_Stdin, boost::asio::buffer(message.GetData()), yc);
+			}
+		}
+	} catch (const boost::coroutines::detail::forced_unwind&) {
+		throw;
+	} catch (const std::exception& ex) {
+		Stop("stopped accepting requests: " + DiagnosticInformation(ex, false));
+	}
+}
+
+/**
+ * Reads one netstring from the worker's stdout.
+ */
+String PluginWorker::ReadMessage(boost::asio::streambuf& buf, boost::asio::yield_context yc)
+{
+	namespace asio = boost::asio;
+
+	size_t headerLength = asio::async_read_until(m_Stdout, buf, ':', yc);
+
+	std::string header (asio::buffers_begin(buf.data()), asio::buffers_begin(buf.data()) + headerLength - 1);
+	buf.consume(headerLength);
+
+	size_t length = boost::lexical_cast<size_t>(header);
+
+	if (length > l_MaxResponseLength)
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Response is too large"));
+
+	if (buf.size() < length + 1)
+		asio::async_read(m_Stdout, buf, asio::transfer_exactly(length + 1 - buf.size()), yc);
+
+	auto begin (asio::buffers_begin(buf.data()));
+	String message (begin, begin + length);
+
+	if (*(begin + length) != ',')
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Response is not terminated by ','"));
+
+	buf.consume(length + 1);
+
+	return message;
+}
+
+#endif /* _WIN32 */
@@ -0,0 +1,88 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef PLUGINWORKER_H
+#define PLUGINWORKER_H
+
+#include "icinga/i2-icinga.hpp"
+#include "base/io-engine.hpp"
+#include "base/process.hpp"
+#include "base/shared-object.hpp"
+#include <atomic>
+#include <boost/asio/io_context_strand.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/spawn.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace icinga
+{
+
+#ifndef _WIN32
+
+/**
+ * A long-lived process which executes check commands on our behalf, so
+ * interpreted plugins don't pay their interpreter's startup for every check.
+ *
+ * Requests and responses are JSON objects wrapped into netstrings, written
+ * to the worker's stdin and read from its stdout respectively. Any number of
+ * requests may be in flight, the worker may answer them in any order.
+ *
+ * @ingroup icinga
+ */
+class PluginWorker final : public SharedObject
+{
+public:
+	DECLARE_PTR_TYPEDEFS(PluginWorker);
+
+	typedef std::function<void(const ProcessResult&)> Callback;
+
+	static void Execute(const Process::Arguments& worker, const Value& command,
+		const Dictionary::Ptr& extraEnvironment, double timeout, const Callback& callback);
+
+private:
+	struct Request
+	{
+		Callback OnFinished;
+		double ExecutionStart;
+		Timeout::Ptr RequestTimeout;
+	};
+
+	PluginWorker(const Process::Arguments& arguments);
+
+	void Start();
+	void Stop(const String& reason);
+	void Enqueue(const Value& command, const Dictionary::Ptr& extraEnvironment, double timeout, const Callback& callback);
+	void Finish(uint64_t id, long exitStatus, const String& output);
+
+	void ReadResponses(boost::asio::yield_context yc);
+	void WriteRequests(boost::asio::yield_context yc);
+	String ReadMessage(boost::asio::streambuf& buf, boost::asio::yield_context yc);
+
+	Process::Arguments m_Arguments;
+	Process::Ptr m_Process;
+
+	boost::asio::io_context::strand m_Strand;
+	boost::asio::posix::stream_descriptor m_Stdin;
+	boost::asio::posix::stream_descriptor m_Stdout;
+
+	std::vector<String> m_Queue;
+	AsioConditionVariable m_RequestsQueued;
+
+	std::unordered_map<uint64_t, Request> m_Requests;
+	uint64_t m_NextRequestId;
+	std::atomic<bool> m_Stopped;
+
+	static std::mutex m_WorkersMutex;
+	static std::map<String, PluginWorker::Ptr> m_Workers;
+};
+
+#endif /* _WIN32 */
+
+}
+
+#endif /* PLUGINWORKER_H */
@@ -12,14 +12,36 @@
 #include "base/convert.hpp"
 #include "base/logger.hpp"
 #include "base/exception.hpp"
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/key_extractors.hpp>
 #include <boost/thread/once.hpp>
+#include <mutex>
 
 using namespace icinga;
 
 REGISTER_TYPE(ScheduledDowntime);
 
+struct NextSegmentInfo
+{
+	ScheduledDowntime::Ptr Object;
+	double Due;
+};
+
+typedef boost::multi_index_container<
+	NextSegmentInfo,
+	boost::multi_index::indexed_by<
+		boost::multi_index::ordered_unique<boost::multi_index::member<NextSegmentInfo, ScheduledDowntime::Ptr, &NextSegmentInfo::Object> >,
+		boost::multi_index::ordered_non_unique<boost::multi_index::member<NextSegmentInfo, double, &NextSegmentInfo::Due> >
+	>
+> NextSegmentSet;
+
 static Timer::Ptr l_Timer;
 
+/* When to call CreateNextDowntime() next, see TimerProc(). */
+static std::mutex l_NextSegmentsMutex;
+static NextSegmentSet l_NextSegments;
+
 String ScheduledDowntimeNameComposer::MakeName(const String& shortName, const Object::Ptr& context) const
 {
 	ScheduledDowntime::Ptr downtime = dynamic_pointer_cast<ScheduledDowntime>(context);
@@ -76,22 +98,78 @@ void ScheduledDowntime::Start(bool runtimeCreated)
 	boost::call_once(once, [this]() {
 		l_Timer = new Timer();
 		l_Timer->SetInterval(60);
+		l_Timer->SetSlack(10);
 		l_Timer->OnTimerExpired.connect([](const Timer * const&) { TimerProc(); });
 		l_Timer->Start();
+
+		OnRangesChanged.connect([](const ScheduledDowntime::Ptr& sd, const Value&) {
+			sd->ScheduleNextDowntime(Utility::GetTime());
+		});
+
+		/* Paused ones aren't scheduled, see CreateNextDowntime(). */
+		ConfigObject::OnPausedChanged.connect([](const ConfigObject::Ptr& object, const Value&) {
+			ScheduledDowntime::Ptr sd = dynamic_pointer_cast<ScheduledDowntime>(object);
+
+			if (sd && sd->IsActive() && !sd->IsPaused())
+				sd->ScheduleNextDowntime(Utility::GetTime());
+		});
 	});
 
 	if (!IsPaused())
 		Utility::QueueAsyncCallback([this]() { CreateNextDowntime(); });
 }
 
+void ScheduledDowntime::Stop(bool runtimeRemoved)
+{
+	ObjectImpl<ScheduledDowntime>::Stop(runtimeRemoved);
+
+	std::unique_lock<std::mutex> lock (l_NextSegmentsMutex);
+
+	l_NextSegments.erase(this);
+}
+
+/**
+ * Creates the next downtimes of the scheduled downtimes which are due for it.
+ */
 void ScheduledDowntime::TimerProc()
 {
-	for (const ScheduledDowntime::Ptr& sd : ConfigType::GetObjectsByType<ScheduledDowntime>()) {
+	std::vector<ScheduledDowntime::Ptr> sds;
+
+	{
+		std::unique_lock<std::mutex> lock (l_NextSegmentsMutex);
+
+		auto& idx (l_NextSegments.get<1>());
+		auto end (idx.upper_bound(Utility::GetTime()));
+
+		for (auto it (idx.begin()); it != end; ++it)
+			sds.emplace_back(it->Object);
+
+		idx.erase(idx.begin(), end);
+	}
+
+	for (const ScheduledDowntime::Ptr& sd : sds) {
 		if (sd->IsActive() && !sd->IsPaused())
 			sd->CreateNextDowntime();
+		else if (!sd->IsActive())
+			sd->ScheduleNextDowntime(Utility::GetTime());
 	}
 }
 
+/**
+ * Lets TimerProc() call CreateNextDowntime() at the given time.
+ *
+ * @param due When to call it, e.g. when the next downtime starts
+ */
+void ScheduledDowntime::ScheduleNextDowntime(double due)
+{
+	std::unique_lock<std::mutex> lock (l_NextSegmentsMutex);
+
+	l_NextSegments.erase(this);
+
+	if (!GetStopCalled())
+		l_NextSegments.insert(NextSegmentInfo{ this, due });
+}
+
 Checkable::Ptr ScheduledDowntime::GetCheckable() const
 {
 	Host::Ptr host = Host::GetByName(GetHostName());
@@ -228,6 +306,9 @@ void ScheduledDowntime::CreateNextDowntime()
 		return;
 	}
 
+	/* Retry later if there's nothing to create now or creating fails. */
+	ScheduleNextDowntime(Utility::GetTime() + 60);
+
 	double minEnd = 0;
 
 	for (const Downtime::Ptr& downtime : GetCheckable()->GetDowntimes()) {
@@ -240,6 +321,7 @@ void ScheduledDowntime::CreateNextDowntime()
 			continue;
 
 		/* We've found a downtime that is owned by us and that hasn't started yet - we're done. */
+		ScheduleNextDowntime(downtime->GetStartTime());
 		return;
 	}
 
@@ -258,6 +340,9 @@ void ScheduledDowntime::CreateNextDowntime()
 		GetFixed(), String(), GetDuration(), GetName(), GetName());
 	String downtimeName = downtime->GetName();
 
+	/* Once it has started, the next one can be created. */
+	ScheduleNextDowntime(segment.first);
+
 	int childOptions = Downtime::ChildOptionsFromValue(GetChildOptions());
 	if (childOptions > 0) {
 		/* 'DowntimeTriggeredChildren' schedules child downtimes triggered by the parent downtime.
@@ -0,0 +1,269 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icinga/statemap.hpp"
+#include "base/convert.hpp"
+#include "base/exception.hpp"
+#include "base/utility.hpp"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#ifndef _WIN32
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif /* _WIN32 */
+
+using namespace icinga;
+
+#ifndef _WIN32
+
+static_assert(sizeof(StateMap::Header) == 64, "The state map header must keep its layout");
+static_assert(sizeof(StateMap::Record) == 64, "The state map records must keep their layout");
+
+/**
+ * Creates a new state map file next to the given path. All records are zeroed,
+ * i.e. pending, until updated. See Publish().
+ *
+ * @param path The file to replace once published
+ * @param objects The type and name of each record
+ * @param outputSize The number of bytes reserved for the plugin output of each record
+ */
+StateMap::StateMap(const String& path, const std::vector<std::pair<RecordType, String>>& objects, size_t outputSize)
+	: m_Path(path)
+{
+	size_t namesSize = 0;
+
+	for (auto& object : objects)
+		namesSize += object.second.GetLength() + 1u;
+
+	size_t recordsOffset = sizeof(Header);
+	size_t namesOffset = recordsOffset + objects.size() * sizeof(Record);
+	size_t outputOffset = namesOffset + namesSize;
+	size_t size = outputOffset + objects.size() * outputSize;
+
+	String tempPath = path + ".tmp";
+	int fd = open(tempPath.CStr(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if (fd < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("open")
+			<< boost::errinfo_errno(errno)
+			<< boost::errinfo_file_name(tempPath));
+	}
+
+	if (ftruncate(fd, size) < 0) {
+		int error = errno;
+
+		(void)close(fd);
+
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("ftruncate")
+			<< boost::errinfo_errno(error)
+			<< boost::errinfo_file_name(tempPath));
+	}
+
+	m_Memory.reset(new SharedMemory(fd));
+	m_Base = static_cast<char *>(m_Memory->GetAddress());
+
+	m_Header = new (m_Base) Header();
+	m_Header->Magic = Magic;
+	m_Header->Version = Version;
+	m_Header->RecordSize = sizeof(Record);
+	m_Header->RecordCount = objects.size();
+	m_Header->RecordsOffset = recordsOffset;
+	m_Header->OutputSize = outputSize;
+	m_Header->CreatedAt = Utility::GetTime();
+	m_Header->Retired.store(0);
+
+	m_Records = reinterpret_cast<Record *>(m_Base + recordsOffset);
+
+	for (size_t i = 0; i < objects.size(); i++) {
+		Record *record = new (&m_Records[i]) Record();
+		const String& name = objects[i].second;
+
+		record->Sequence.store(0);
+		record->Type = objects[i].first;
+		record->NameOffset = namesOffset;
+		record->NameLength = name.GetLength();
+		record->OutputOffset = outputOffset + i * outputSize;
+
+		memcpy(m_Base + namesOffset, name.CStr(), name.GetLength() + 1u);
+		namesOffset += name.GetLength() + 1u;
+	}
+}
+
+/**
+ * Attaches to a state map file created by another instance.
+ *
+ * @param path The file
+ */
+StateMap::StateMap(const String& path)
+	: m_Path(path)
+{
+	int fd = open(path.CStr(), O_RDWR | O_CLOEXEC);
+
+	if (fd < 0) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("open")
+			<< boost::errinfo_errno(errno)
+			<< boost::errinfo_file_name(path));
+	}
+
+	m_Memory.reset(new SharedMemory(fd));
+	m_Base = static_cast<char *>(m_Memory->GetAddress());
+	m_Header = reinterpret_cast<Header *>(m_Base);
+
+	if (m_Memory->GetSize() < sizeof(Header) || m_Header->Magic != Magic || m_Header->Version != Version
+		|| m_Header->RecordSize != sizeof(Record)
+		|| m_Header->RecordsOffset + m_Header->RecordCount * sizeof(Record) > m_Memory->GetSize()) {
+		BOOST_THROW_EXCEPTION(std::invalid_argument("File '" + path + "' isn't a state map of version "
+			+ Convert::ToString(static_cast<uint32_t>(Version))));
+	}
+
+	m_Records = reinterpret_cast<Record *>(m_Base + m_Header->RecordsOffset);
+}
+
+/**
+ * Replaces the file at the path given on creation, which is retired if it's a
+ * state map as well.
+ */
+void StateMap::Publish()
+{
+	std::unique_ptr<StateMap> previous;
+
+	try {
+		previous.reset(new StateMap(m_Path));
+	} catch (const std::exception&) {
+		/* Nothing to retire. */
+	}
+
+	Utility::RenameFile(m_Path + ".tmp", m_Path);
+
+	if (previous)
+		previous->Retire();
+}
+
+/**
+ * Overwrites a record. Concurrent updates of the same record are serialized.
+ *
+ * @param index The record's index
+ * @param entry The new contents, the output is truncated to the reserved size
+ */
+void StateMap::Update(size_t index, const Entry& entry)
+{
+	VERIFY(index < m_Header->RecordCount);
+
+	Record& record = m_Records[index];
+	uint32_t sequence = record.Sequence.load(std::memory_order_relaxed);
+
+	/* An odd sequence tells readers to retry and other writers to wait. */
+	for (;;) {
+		if (sequence & 1u) {
+			std::this_thread::yield();
+			sequence = record.Sequence.load(std::memory_order_relaxed);
+		} else if (record.Sequence.compare_exchange_weak(sequence, sequence + 1u,
+			std::memory_order_acquire, std::memory_order_relaxed)) {
+			break;
+		}
+	}
+
+	std::atomic_thread_fence(std::memory_order_release);
+
+	size_t outputLength = std::min<size_t>(entry.Output.GetLength(), m_Header->OutputSize);
+
+	/* Don't cut a UTF-8 sequence in half. */
+	if (outputLength < entry.Output.GetLength()) {
+		while (outputLength > 0 && (entry.Output[outputLength] & 0xC0) == 0x80)
+			outputLength--;
+	}
+
+	record.State = entry.State;
+	record.StateType = entry.StateType;
+	record.Flags = entry.Flags;
+	record.CheckAttempt = entry.CheckAttempt;
+	record.LastCheck = entry.LastCheck;
+	record.LastStateChange = entry.LastStateChange;
+	record.OutputLength = outputLength;
+	memcpy(m_Base + record.OutputOffset, entry.Output.CStr(), outputLength);
+
+	record.Sequence.store(sequence + 2u, std::memory_order_release);
+}
+
+/**
+ * Reads a consistent copy of a record the way external readers should.
+ *
+ * @param index The record's index
+ * @param entry Receives the contents
+ * @return false if there's no such record
+ */
+bool StateMap::Read(size_t index, Entry& entry) const
+{
+	if (index >= m_Header->RecordCount)
+		return false;
+
+	const Record& record = m_Records[index];
+	std::string output;
+
+	for (;;) {
+		uint32_t sequence = record.Sequence.load(std::memory_order_acquire);
+
+		if (sequence & 1u) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		entry.Type = static_cast<RecordType>(record.Type);
+		entry.State = record.State;
+		entry.StateType = record.StateType;
+		entry.Flags = record.Flags;
+		entry.CheckAttempt = record.CheckAttempt;
+		entry.LastCheck = record.LastCheck;
+		entry.LastStateChange = record.LastStateChange;
+
+		/* The length may be torn, but mustn't make us read beyond the record's output. */
+		output.assign(m_Base + record.OutputOffset, std::min<uint64_t>(record.OutputLength, m_Header->OutputSize));
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if (record.Sequence.load(std::memory_order_relaxed) == sequence)
+			break;
+	}
+
+	entry.Output = String(std::move(output));
+	return true;
+}
+
+String StateMap::GetName(size_t index) const
+{
+	VERIFY(index < m_Header->RecordCount);
+
+	const Record& record = m_Records[index];
+
+	return String(m_Base + record.NameOffset, m_Base + record.NameOffset + record.NameLength);
+}
+
+/**
+ * Tells readers which still have this file mapped that it has been replaced.
+ */
+void StateMap::Retire()
+{
+	m_Header->Retired.store(1, std::memory_order_release);
+}
+
+bool StateMap::IsRetired() const
+{
+	return m_Header->Retired.load(std::memory_order_acquire);
+}
+
+size_t StateMap::GetCount() const
+{
+	return m_Header->RecordCount;
+}
+
+size_t StateMap::GetSize() const
+{
+	return m_Memory->GetSize();
+}
+
+#endif /* _WIN32 */
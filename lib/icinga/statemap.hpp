@@ -0,0 +1,130 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef STATEMAP_H
+#define STATEMAP_H
+
+#include "icinga/i2-icinga.hpp"
+#include "base/shmring.hpp"
+#include "base/string.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace icinga
+{
+
+#ifndef _WIN32
+
+/**
+ * A file with one fixed-size record per host and service, meant to be mapped
+ * into memory by local consumers which want to scan the state of all objects
+ * without parsing anything.
+ *
+ * The records are updated in place. Each one is guarded by a sequence counter
+ * which is odd while the record is being written, so readers copy a record
+ * and retry if the counter was odd or changed meanwhile. The set of records
+ * is fixed, a file with a different set replaces the old one atomically once
+ * it's published and the old one is marked as retired for readers which still
+ * have it mapped.
+ *
+ * All numbers are in the host's byte order, all offsets are relative to the
+ * start of the file.
+ *
+ * @ingroup icinga
+ */
+class StateMap final
+{
+public:
+	static const uint64_t Magic = 0x4932535441544531; /* "I2STATE1" */
+	static const uint32_t Version = 1;
+
+	enum RecordType : uint8_t
+	{
+		RecordHost = 0,
+		RecordService = 1
+	};
+
+	enum RecordFlags : uint8_t
+	{
+		FlagAcknowledged = 1,
+		FlagInDowntime = 2,
+		FlagFlapping = 4,
+		FlagUnreachable = 8
+	};
+
+	struct alignas(64) Header
+	{
+		uint64_t Magic;
+		uint32_t Version;
+		uint32_t RecordSize;
+		uint64_t RecordCount;
+		uint64_t RecordsOffset;
+		uint64_t OutputSize;
+		double CreatedAt;
+		std::atomic<uint32_t> Retired;
+	};
+
+	struct alignas(64) Record
+	{
+		std::atomic<uint32_t> Sequence;
+		uint8_t Type;
+		uint8_t State;
+		uint8_t StateType;
+		uint8_t Flags;
+		uint32_t CheckAttempt;
+		uint32_t OutputLength;
+		double LastCheck;
+		double LastStateChange;
+		uint64_t NameOffset;
+		uint32_t NameLength;
+		uint32_t Reserved;
+		uint64_t OutputOffset;
+	};
+
+	/**
+	 * The contents of a record as written by Update() and returned by Read().
+	 */
+	struct Entry
+	{
+		RecordType Type{RecordHost};
+		uint8_t State{0};
+		uint8_t StateType{0};
+		uint8_t Flags{0};
+		uint32_t CheckAttempt{0};
+		double LastCheck{0};
+		double LastStateChange{0};
+		String Output;
+	};
+
+	StateMap(const String& path, const std::vector<std::pair<RecordType, String>>& objects, size_t outputSize);
+	explicit StateMap(const String& path);
+
+	StateMap(const StateMap&) = delete;
+	StateMap& operator=(const StateMap&) = delete;
+
+	void Publish();
+
+	void Update(size_t index, const Entry& entry);
+	bool Read(size_t index, Entry& entry) const;
+	String GetName(size_t index) const;
+
+	void Retire();
+	bool IsRetired() const;
+
+	size_t GetCount() const;
+	size_t GetSize() const;
+
+private:
+	String m_Path;
+	std::unique_ptr<SharedMemory> m_Memory;
+	Header *m_Header;
+	Record *m_Records;
+	char *m_Base;
+};
+
+#endif /* _WIN32 */
+
+}
+
+#endif /* STATEMAP_H */
@@ -10,6 +10,7 @@
 #include "base/timer.hpp"
 #include "base/utility.hpp"
 #include <boost/thread/once.hpp>
+#include <algorithm>
 
 using namespace icinga;
 
@@ -26,6 +27,7 @@ void TimePeriod::Start(bool runtimeCreated)
 	boost::call_once(once, [this]() {
 		l_UpdateTimer = new Timer();
 		l_UpdateTimer->SetInterval(300);
+		l_UpdateTimer->SetSlack(60);
 		l_UpdateTimer->OnTimerExpired.connect([](const Timer * const&) { UpdateTimerHandler(); });
 		l_UpdateTimer->Start();
 	});
@@ -42,6 +44,9 @@ void TimePeriod::AddSegment(double begin, double end)
 {
 	ASSERT(OwnsLock());
 
+	/* Existing segments may be extended in place. */
+	m_SortedSegmentsDirty = true;
+
 	Log(LogDebug, "TimePeriod")
 		<< "Adding segment '" << Utility::FormatDateTime("%c", begin) << "' <-> '"
 		<< Utility::FormatDateTime("%c", end) << "' to TimePeriod '" << GetName() << "'";
@@ -279,6 +284,46 @@ bool TimePeriod::GetIsInside() const
 	return IsInside(Utility::GetTime());
 }
 
+/**
+ * Rebuilds m_SortedSegments if the segments have been replaced or changed
+ * since the last call. The caller must hold the object lock.
+ */
+void TimePeriod::UpdateSortedSegments() const
+{
+	Array::Ptr segments = GetSegments();
+
+	if (!m_SortedSegmentsDirty && m_SortedSegmentsSource == segments)
+		return;
+
+	m_SortedSegments.clear();
+
+	if (segments) {
+		ObjectLock dlock(segments);
+		for (const Dictionary::Ptr& segment : segments)
+			m_SortedSegments.emplace_back(segment->Get("begin"), segment->Get("end"));
+	}
+
+	std::sort(m_SortedSegments.begin(), m_SortedSegments.end());
+
+	/* Merge overlapping segments. Adjacent ones are kept apart as their common boundary isn't inside. */
+	size_t merged = 0;
+
+	for (size_t i = 1; i < m_SortedSegments.size(); i++) {
+		auto& last (m_SortedSegments[merged]);
+
+		if (m_SortedSegments[i].first < last.second)
+			last.second = std::max(last.second, m_SortedSegments[i].second);
+		else
+			m_SortedSegments[++merged] = m_SortedSegments[i];
+	}
+
+	if (!m_SortedSegments.empty())
+		m_SortedSegments.resize(merged + 1);
+
+	m_SortedSegmentsSource = segments;
+	m_SortedSegmentsDirty = false;
+}
+
 bool TimePeriod::IsInside(double ts) const
 {
 	ObjectLock olock(this);
@@ -286,17 +331,18 @@ bool TimePeriod::IsInside(double ts) const
 	if (GetValidBegin().IsEmpty() || ts < GetValidBegin() || GetValidEnd().IsEmpty() || ts > GetValidEnd())
 		return true; /* Assume that all invalid regions are "inside". */
 
-	Array::Ptr segments = GetSegments();
+	UpdateSortedSegments();
 
-	if (segments) {
-		ObjectLock dlock(segments);
-		for (const Dictionary::Ptr& segment : segments) {
-			if (ts > segment->Get("begin") && ts < segment->Get("end"))
-				return true;
-		}
-	}
+	/* The last segment beginning before ts is the only one which may contain it. */
+	auto it (std::lower_bound(m_SortedSegments.begin(), m_SortedSegments.end(), ts,
+		[](const std::pair<double, double>& segment, double ts) { return segment.first < ts; }));
+
+	if (it == m_SortedSegments.begin())
+		return false;
 
-	return false;
+	--it;
+
+	return ts < it->second;
 }
 
 double TimePeriod::FindNextTransition(double begin)
@@ -321,11 +367,31 @@ double TimePeriod::FindNextTransition(double begin)
 	return closestTransition;
 }
 
+/**
+ * Returns TimePeriod#ranges parsed for LegacyTimePeriod. They're parsed
+ * again once the ranges are replaced.
+ *
+ * @returns The parsed ranges
+ */
+std::shared_ptr<CompiledTimeRanges> TimePeriod::GetCompiledRanges()
+{
+	Dictionary::Ptr ranges = GetRanges();
+
+	auto compiled (std::atomic_load(&m_CompiledRanges));
+
+	if (!compiled || compiled->Source != ranges) {
+		compiled = LegacyTimePeriod::CompileRanges(ranges);
+		std::atomic_store(&m_CompiledRanges, compiled);
+	}
+
+	return compiled;
+}
+
 void TimePeriod::UpdateTimerHandler()
 {
 	double now = Utility::GetTime();
 
-	for (const TimePeriod::Ptr& tp : ConfigType::GetObjectsByType<TimePeriod>()) {
+	for (TimePeriod *tp : ConfigType::GetObjectsViewByType<TimePeriod>()) {
 		if (!tp->IsActive())
 			continue;
 
@@ -5,10 +5,15 @@
 
 #include "icinga/i2-icinga.hpp"
 #include "icinga/timeperiod-ti.hpp"
+#include <memory>
+#include <utility>
+#include <vector>
 
 namespace icinga
 {
 
+struct CompiledTimeRanges;
+
 /**
  * A time period.
  *
@@ -29,9 +34,20 @@ public:
 	bool IsInside(double ts) const;
 	double FindNextTransition(double begin);
 
+	std::shared_ptr<CompiledTimeRanges> GetCompiledRanges();
+
 	void ValidateRanges(const Lazy<Dictionary::Ptr>& lvalue, const ValidationUtils& utils) override;
 
 private:
+	std::shared_ptr<CompiledTimeRanges> m_CompiledRanges;
+
+	/* The segments sorted by begin and merged where they overlap, see IsInside(). */
+	mutable Array::Ptr m_SortedSegmentsSource;
+	mutable bool m_SortedSegmentsDirty{true};
+	mutable std::vector<std::pair<double, double>> m_SortedSegments;
+
+	void UpdateSortedSegments() const;
+
 	void AddSegment(double s, double end);
 	void AddSegment(const Dictionary::Ptr& segment);
 	void RemoveSegment(double begin, double end);
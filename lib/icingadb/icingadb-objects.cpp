@@ -29,6 +29,9 @@
 #include "icinga/timeperiod.hpp"
 #include "icinga/pluginutility.hpp"
 #include "remote/zone.hpp"
+#include <atomic>
+#include <chrono>
+#include <future>
 #include <iterator>
 #include <map>
 #include <memory>
@@ -179,12 +182,48 @@ void IcingaDB::UpdateAllConfigObjects()
 		m_DumpedGlobals.IconImage.Reset();
 	});
 
-	upq.ParallelFor(types, [this](const TypePair& type) {
+	// The objects' transactions are spread across these connections, all other queries go through m_Rcon
+	std::vector<RedisConnection::Ptr> dumpConns ({m_Rcon});
+
+	for (auto i (GetDumpConnections()); i > 1; --i) {
+		auto conn (OpenDumpConnection());
+
+		if (conn) {
+			dumpConns.emplace_back(std::move(conn));
+		}
+	}
+
+	Defer stopDumpConns ([&dumpConns]() {
+		for (auto i (dumpConns.size()); i > 1u; --i) {
+			dumpConns[i - 1u]->Stop();
+		}
+	});
+
+	std::atomic<size_t> nextDumpConn (0);
+
+	auto getDumpConn ([&dumpConns, &nextDumpConn]() -> const RedisConnection::Ptr& {
+		return dumpConns[nextDumpConn.fetch_add(1) % dumpConns.size()];
+	});
+
+	// Wait until Redis has executed everything sent so far via any of the connections
+	auto awaitDumpConns ([&dumpConns]() {
+		for (auto& conn : dumpConns) {
+			conn->GetResultOfQuery({"PING"}, Prio::Config);
+		}
+	});
+
+	upq.ParallelFor(types, [this, &dumpConns, &getDumpConn, &awaitDumpConns](const TypePair& type) {
 		String lcType = type.second;
+		double typeStartTime = Utility::GetTime();
 
 		std::vector<String> keys = GetTypeOverwriteKeys(lcType);
 		DeleteKeys(keys, Prio::Config);
 
+		if (dumpConns.size() > 1u) {
+			// The other connections must not overtake the above deletions
+			m_Rcon->GetResultOfQuery({"PING"}, Prio::Config);
+		}
+
 		WorkQueue upqObjectType(25000, Configuration::Concurrency);
 		upqObjectType.SetName("IcingaDB:ConfigDump:" + lcType);
 
@@ -223,6 +262,10 @@ void IcingaDB::UpdateAllConfigObjects()
 		std::map<String, std::vector<std::vector<String>>> ourContentRaw {{configCheckSum, {}}, {configObject, {}}};
 		std::mutex ourContentMutex;
 
+		// CPU time spent by all chunks, protected by ourContentMutex
+		double serializeDuration = 0, hashDuration = 0;
+		size_t objectsDumped = 0;
+
 		upqObjectType.ParallelFor(objectChunks, [&](decltype(objectChunks)::const_reference chunk) {
 			std::map<String, std::vector<String>> hMSets, publishes;
 			std::vector<String> states 							= {"HMSET", m_PrefixStateObject + lcType};
@@ -245,10 +288,26 @@ void IcingaDB::UpdateAllConfigObjects()
 			bool dumpState = (lcType == "host" || lcType == "service");
 
 			size_t bulkCounter = 0;
+			double chunkSerializeDuration = 0, chunkHashDuration = 0;
+
+			m_HashDuration = &chunkHashDuration;
+
+			Defer accountDurations ([&]() {
+				m_HashDuration = nullptr;
+
+				std::lock_guard<std::mutex> l (ourContentMutex);
+
+				serializeDuration += chunkSerializeDuration - chunkHashDuration;
+				hashDuration += chunkHashDuration;
+				objectsDumped += bulkCounter;
+			});
+
 			for (const ConfigObject::Ptr& object : chunk) {
 				if (lcType != GetLowerCaseTypeNameDB(object))
 					continue;
 
+				double serializeStartTime = Utility::GetTime();
+
 				CreateConfigUpdate(object, lcType, hMSets, publishes, false);
 
 				// Write out inital state for checkables
@@ -257,6 +316,8 @@ void IcingaDB::UpdateAllConfigObjects()
 					states.emplace_back(JsonEncode(SerializeState(dynamic_pointer_cast<Checkable>(object))));
 				}
 
+				chunkSerializeDuration += Utility::GetTime() - serializeStartTime;
+
 				bulkCounter++;
 				if (!(bulkCounter % 100)) {
 					skimObjects();
@@ -291,7 +352,7 @@ void IcingaDB::UpdateAllConfigObjects()
 
 					if (transaction.size() > 1) {
 						transaction.push_back({"EXEC"});
-						m_Rcon->FireAndForgetQueries(std::move(transaction), Prio::Config);
+						getDumpConn()->FireAndForgetQueries(std::move(transaction), Prio::Config);
 						transaction = {{"MULTI"}};
 					}
 				}
@@ -341,7 +402,7 @@ void IcingaDB::UpdateAllConfigObjects()
 
 			if (transaction.size() > 1) {
 				transaction.push_back({"EXEC"});
-				m_Rcon->FireAndForgetQueries(std::move(transaction), Prio::Config);
+				getDumpConn()->FireAndForgetQueries(std::move(transaction), Prio::Config);
 			}
 
 			for (auto zAdds : {&hostZAdds, &serviceZAdds}) {
@@ -356,6 +417,8 @@ void IcingaDB::UpdateAllConfigObjects()
 
 		upqObjectType.Join();
 
+		double serializedTime = Utility::GetTime();
+
 		if (upqObjectType.HasExceptions()) {
 			for (boost::exception_ptr exc : upqObjectType.GetExceptions()) {
 				if (exc) {
@@ -485,6 +548,16 @@ void IcingaDB::UpdateAllConfigObjects()
 			flushSets();
 		}
 
+		// Announce the type as done only after all of its objects have actually arrived
+		awaitDumpConns();
+
+		double doneTime = Utility::GetTime();
+
+		Log(LogInformation, "IcingaDB")
+			<< "Dumped " << objectsDumped << " objects of type '" << lcType << "' in " << doneTime - typeStartTime
+			<< " seconds (CPU time: serialize " << serializeDuration << "s, hash " << hashDuration
+			<< "s; waiting for Redis: " << doneTime - serializedTime << "s)";
+
 		m_Rcon->FireAndForgetQuery({"XADD", "icinga:dump", "*", "type", lcType, "state", "done"}, Prio::Config);
 	});
 
@@ -511,7 +584,52 @@ void IcingaDB::UpdateAllConfigObjects()
 	p.get_future().wait();
 
 	Log(LogInformation, "IcingaDB")
-			<< "Initial config/status dump finished in " << Utility::GetTime() - startTime << " seconds.";
+			<< "Initial config/status dump finished in " << Utility::GetTime() - startTime << " seconds"
+			<< " using " << dumpConns.size() << " Redis connection(s).";
+}
+
+/**
+ * Open an additional connection to Redis for the initial dump
+ *
+ * @return The connection or nullptr if it couldn't be established in time
+ */
+RedisConnection::Ptr IcingaDB::OpenDumpConnection()
+{
+	auto connected (std::make_shared<std::promise<void>>());
+	auto once (std::make_shared<std::atomic<bool>>(false));
+	auto future (connected->get_future());
+
+	RedisConnection::Ptr conn = new RedisConnection(GetHost(), GetPort(), GetPath(), GetPassword(), GetDbIndex());
+
+	if (GetRedisCluster()) {
+		conn->EnableClusterMode();
+	}
+
+	conn->SetConnectedCallback([connected, once](boost::asio::yield_context&) {
+		if (!once->exchange(true)) {
+			connected->set_value();
+		}
+	});
+
+	conn->Start();
+
+	if (future.wait_for(std::chrono::seconds(10)) != std::future_status::ready) {
+		Log(LogWarning, "IcingaDB", "Couldn't open an additional Redis connection for the initial dump in time, continuing without it");
+
+		conn->Stop();
+		return nullptr;
+	}
+
+	if (GetRedisCluster()) {
+		try {
+			conn->UpdateClusterSlots();
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "IcingaDB")
+				<< "Cannot fetch the Redis Cluster slots for an additional connection: " << ex.what();
+		}
+	}
+
+	return conn;
 }
 
 std::vector<std::vector<intrusive_ptr<ConfigObject>>> IcingaDB::ChunkObjects(std::vector<intrusive_ptr<ConfigObject>> objects, size_t chunkSize) {
@@ -586,7 +704,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 	auto env (GetEnvironment());
 
 	if (customVarObject) {
-		auto vars(SerializeVars(customVarObject));
+		auto vars(SerializeVarsCached(customVarObject));
 		if (vars) {
 			auto& typeCvs (hMSets[m_PrefixConfigObject + typeName + ":customvar"]);
 			auto& allCvs (hMSets[m_PrefixConfigObject + "customvar"]);
@@ -608,7 +726,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 
 				String id = HashValue(new Array(Prepend(env, Prepend(kv.first, GetObjectIdentifiersWithoutEnv(object)))));
 				typeCvs.emplace_back(id);
-				typeCvs.emplace_back(JsonEncode(new Dictionary({{"object_id", objectKey}, {"environment_id", m_EnvironmentId}, {"customvar_id", kv.first}})));
+				typeCvs.emplace_back(JsonEncode(new Dictionary({{"object_id", objectKey}, {"environment_id", m_EnvironmentId}, {"customvar_id", kv.first.GetString()}})));
 
 				if (runtimeUpdate) {
 					publishes["icinga:config:update:" + typeName + ":customvar"].emplace_back(id);
@@ -719,12 +837,12 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 			rangeIds->Reserve(ranges->GetLength());
 
 			for (auto& kv : ranges) {
-				String rangeId = HashValue(new Array({env, kv.first, kv.second}));
+				String rangeId = HashValue(new Array({env, kv.first.GetString(), kv.second}));
 				rangeIds->Add(rangeId);
 
 				String id = HashValue(new Array(Prepend(env, Prepend(kv.first, Prepend(kv.second, GetObjectIdentifiersWithoutEnv(object))))));
 				typeRanges.emplace_back(id);
-				typeRanges.emplace_back(JsonEncode(new Dictionary({{"environment_id", m_EnvironmentId}, {"timeperiod_id", objectKey}, {"range_key", kv.first}, {"range_value", kv.second}})));
+				typeRanges.emplace_back(JsonEncode(new Dictionary({{"environment_id", m_EnvironmentId}, {"timeperiod_id", objectKey}, {"range_key", kv.first.GetString()}, {"range_value", kv.second}})));
 
 				if (runtimeUpdate) {
 					publishes["icinga:config:update:" + typeName + ":range"].emplace_back(id);
@@ -951,7 +1069,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 				}
 
 				values->Set("command_id", objectKey);
-				values->Set("argument_key", kv.first);
+				values->Set("argument_key", kv.first.GetString());
 				values->Set("environment_id", m_EnvironmentId);
 
 				String id = HashValue(new Array(Prepend(env, Prepend(kv.first, GetObjectIdentifiersWithoutEnv(object)))));
@@ -998,7 +1116,7 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 				}
 
 				values->Set("command_id", objectKey);
-				values->Set("envvar_key", kv.first);
+				values->Set("envvar_key", kv.first.GetString());
 				values->Set("environment_id", m_EnvironmentId);
 
 				String id = HashValue(new Array(Prepend(env, Prepend(kv.first, GetObjectIdentifiersWithoutEnv(object)))));
@@ -1019,14 +1137,87 @@ void IcingaDB::InsertObjectDependencies(const ConfigObject::Ptr& object, const S
 	}
 }
 
+/**
+ * Queues the state of a checkable to be written by the next FlushStates().
+ *
+ * Multiple updates of the same checkable within state_flush_interval, e.g. for
+ * a new check result and the next check being rescheduled, end up in one write.
+ */
 void IcingaDB::UpdateState(const Checkable::Ptr& checkable)
 {
 	if (!m_Rcon || !m_Rcon->IsConnected())
 		return;
 
-	Dictionary::Ptr stateAttrs = SerializeState(checkable);
+	std::unique_lock<std::mutex> lock (m_PendingStatesMutex);
 
-	m_Rcon->FireAndForgetQuery({"HSET", m_PrefixStateObject + GetLowerCaseTypeNameDB(checkable), GetObjectIdentifier(checkable), JsonEncode(stateAttrs)}, Prio::State);
+	if (!m_PendingStates.insert(checkable).second)
+		m_StateUpdatesCoalesced.fetch_add(1);
+}
+
+/**
+ * Writes the states queued by UpdateState() which differ from the ones written last.
+ */
+void IcingaDB::FlushStates()
+{
+	std::set<Checkable::Ptr> pending;
+
+	{
+		std::unique_lock<std::mutex> lock (m_PendingStatesMutex);
+		pending.swap(m_PendingStates);
+	}
+
+	if (pending.empty() || !m_Rcon || !m_Rcon->IsConnected())
+		return;
+
+	std::map<String, std::vector<String>> hSets;
+
+	for (auto& checkable : pending) {
+		String state = JsonEncode(SerializeState(checkable));
+		size_t hash = std::hash<String>()(state);
+
+		{
+			std::unique_lock<std::mutex> lock (m_StateHashesMutex);
+			auto& lastHash (m_StateHashes[checkable]);
+
+			if (lastHash == hash) {
+				m_StateUpdatesUnchanged.fetch_add(1);
+				continue;
+			}
+
+			lastHash = hash;
+		}
+
+		auto& hSet (hSets[m_PrefixStateObject + GetLowerCaseTypeNameDB(checkable)]);
+
+		hSet.emplace_back(GetObjectIdentifier(checkable));
+		hSet.emplace_back(std::move(state));
+
+		m_StateUpdatesWritten.fetch_add(1);
+	}
+
+	RedisConnection::Queries queries;
+
+	for (auto& kv : hSets) {
+		kv.second.insert(kv.second.begin(), {"HSET", kv.first});
+		queries.emplace_back(std::move(kv.second));
+	}
+
+	if (!queries.empty())
+		m_Rcon->FireAndForgetQueries(std::move(queries), Prio::State);
+}
+
+/**
+ * Makes FlushStates() forget a checkable, e.g. because it's gone or its state has been written otherwise.
+ */
+void IcingaDB::ForgetState(const Checkable::Ptr& checkable)
+{
+	{
+		std::unique_lock<std::mutex> lock (m_PendingStatesMutex);
+		m_PendingStates.erase(checkable);
+	}
+
+	std::unique_lock<std::mutex> lock (m_StateHashesMutex);
+	m_StateHashes.erase(checkable);
 }
 
 // Used to update a single object, used for runtime updates
@@ -1044,6 +1235,7 @@ void IcingaDB::SendConfigUpdate(const ConfigObject::Ptr& object, bool runtimeUpd
 	Checkable::Ptr checkable = dynamic_pointer_cast<Checkable>(object);
 	if (checkable) {
 		String objectKey = GetObjectIdentifier(object);
+		ForgetState(checkable);
 		m_Rcon->FireAndForgetQuery({"HSET", m_PrefixStateObject + typeName, objectKey, JsonEncode(SerializeState(checkable))}, Prio::State);
 		publishes["icinga:config:update:state:" + typeName].emplace_back(objectKey);
 	}
@@ -1341,6 +1533,99 @@ bool IcingaDB::PrepareObject(const ConfigObject::Ptr& object, Dictionary::Ptr& a
 	return false;
 }
 
+/**
+ * Like PrepareObject() and HashValue() on the attributes, but reuses the results of the last call for the same object
+ * as long as neither its version nor its modified attributes generation have changed since then.
+ *
+ * @param object Config object
+ * @param attributes Set to the (shared, don't modify!) attributes
+ * @param checkSum Set to the attributes' checksum
+ *
+ * @return Whether the object is to be written to Redis, see PrepareObject()
+ */
+bool IcingaDB::PrepareObjectCached(const ConfigObject::Ptr& object, Dictionary::Ptr& attributes, String& checkSum)
+{
+	Type::Ptr type = object->GetReflectionType();
+
+	// Their attributes also depend on the time and their state
+	bool cacheable = type != Comment::TypeInstance && type != Downtime::TypeInstance;
+
+	auto version (object->GetVersion());
+	auto generation (object->GetModifiedAttributesGeneration());
+
+	if (cacheable) {
+		std::unique_lock<std::mutex> lock (m_ConfigObjectCacheMutex);
+		auto cached (m_ConfigObjectCache.find(object));
+
+		if (cached != m_ConfigObjectCache.end() && cached->second.Attributes
+			&& cached->second.Version == version && cached->second.Generation == generation) {
+			attributes = cached->second.Attributes;
+			checkSum = cached->second.CheckSum;
+			return true;
+		}
+	}
+
+	Dictionary::Ptr checkSums = new Dictionary();
+	attributes = new Dictionary();
+
+	if (!PrepareObject(object, attributes, checkSums))
+		return false;
+
+	checkSum = HashValue(attributes);
+
+	if (cacheable) {
+		std::unique_lock<std::mutex> lock (m_ConfigObjectCacheMutex);
+		auto& cached (m_ConfigObjectCache[object]);
+
+		if (cached.Version != version || cached.Generation != generation) {
+			cached = CachedConfigObject{version, generation, nullptr, "", false, nullptr};
+		}
+
+		cached.Attributes = attributes;
+		cached.CheckSum = checkSum;
+	}
+
+	return true;
+}
+
+/**
+ * Like SerializeVars(), but reuses the result of the last call for the same object
+ * as long as neither its version nor its modified attributes generation have changed since then.
+ *
+ * @param object Config object with custom vars
+ *
+ * @return The (shared, don't modify!) result of SerializeVars()
+ */
+Dictionary::Ptr IcingaDB::SerializeVarsCached(const CustomVarObject::Ptr& object)
+{
+	auto version (object->GetVersion());
+	auto generation (object->GetModifiedAttributesGeneration());
+
+	{
+		std::unique_lock<std::mutex> lock (m_ConfigObjectCacheMutex);
+		auto cached (m_ConfigObjectCache.find(object));
+
+		if (cached != m_ConfigObjectCache.end() && cached->second.HasVars
+			&& cached->second.Version == version && cached->second.Generation == generation) {
+			return cached->second.Vars;
+		}
+	}
+
+	auto vars (SerializeVars(object));
+
+	std::unique_lock<std::mutex> lock (m_ConfigObjectCacheMutex);
+	auto& cached (m_ConfigObjectCache[object]);
+
+	if (cached.Version != version || cached.Generation != generation) {
+		cached = CachedConfigObject{version, generation, nullptr, "", false, nullptr};
+	}
+
+	cached.HasVars = true;
+	cached.Vars = vars;
+
+	return std::move(vars);
+}
+
 /* Creates a config update with computed checksums etc.
  * Writes attributes, customVars and checksums into the respective supplied vectors. Adds two values to each vector
  * (if applicable), first the key then the value. To use in a Redis command the command (e.g. HSET) and the key (e.g.
@@ -1358,10 +1643,10 @@ IcingaDB::CreateConfigUpdate(const ConfigObject::Ptr& object, const String typeN
 	if (m_Rcon == nullptr)
 		return;
 
-	Dictionary::Ptr attr = new Dictionary;
-	Dictionary::Ptr chksm = new Dictionary;
+	Dictionary::Ptr attr;
+	String chksm;
 
-	if (!PrepareObject(object, attr, chksm))
+	if (!PrepareObjectCached(object, attr, chksm))
 		return;
 
 	InsertObjectDependencies(object, typeName, hMSets, publishes, runtimeUpdate);
@@ -1374,7 +1659,7 @@ IcingaDB::CreateConfigUpdate(const ConfigObject::Ptr& object, const String typeN
 	attrs.emplace_back(JsonEncode(attr));
 
 	chksms.emplace_back(objectKey);
-	chksms.emplace_back(JsonEncode(new Dictionary({{"checksum", HashValue(attr)}})));
+	chksms.emplace_back(JsonEncode(new Dictionary({{"checksum", chksm}})));
 
 	/* Send an update event to subscribers. */
 	if (runtimeUpdate) {
@@ -1387,6 +1672,16 @@ void IcingaDB::SendConfigDelete(const ConfigObject::Ptr& object)
 	String typeName = object->GetReflectionType()->GetName().ToLower();
 	String objectKey = GetObjectIdentifier(object);
 
+	{
+		std::unique_lock<std::mutex> lock (m_ConfigObjectCacheMutex);
+		m_ConfigObjectCache.erase(object);
+	}
+
+	auto deletedCheckable (dynamic_pointer_cast<Checkable>(object));
+
+	if (deletedCheckable)
+		ForgetState(deletedCheckable);
+
 	m_Rcon->FireAndForgetQueries({
 								   {"HDEL",    m_PrefixConfigObject + typeName, objectKey},
 								   {"DEL",     m_PrefixStateObject + typeName + ":" + objectKey},
@@ -1448,7 +1743,7 @@ void IcingaDB::SendStatusUpdate(const ConfigObject::Ptr& object, const CheckResu
 		streamadd.emplace_back(Utility::ValidateUTF8(kv.second));
 	}
 
-	m_Rcon->FireAndForgetQuery(std::move(streamadd), Prio::State);
+	AddToStream(std::move(streamadd), Prio::State);
 
 	int hard_state;
 	if (!cr) {
@@ -1509,7 +1804,7 @@ void IcingaDB::SendStatusUpdate(const ConfigObject::Ptr& object, const CheckResu
 		xAdd.emplace_back(GetObjectIdentifier(endpoint));
 	}
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	AddToStream(std::move(xAdd), Prio::History);
 }
 
 void IcingaDB::SendSentNotification(
@@ -1566,7 +1861,7 @@ void IcingaDB::SendSentNotification(
 		xAdd.emplace_back(GetObjectIdentifier(endpoint));
 	}
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	AddToStream(std::move(xAdd), Prio::History);
 
 	for (const User::Ptr& user : users) {
 		auto userId = GetObjectIdentifier(user);
@@ -1578,7 +1873,7 @@ void IcingaDB::SendSentNotification(
 			"user_id", GetObjectIdentifier(user),
 		});
 
-		m_Rcon->FireAndForgetQuery(std::move(xAddUser), Prio::History);
+		AddToStream(std::move(xAddUser), Prio::History);
 	}
 }
 
@@ -1648,7 +1943,7 @@ void IcingaDB::SendStartedDowntime(const Downtime::Ptr& downtime)
 		xAdd.emplace_back(GetObjectIdentifier(endpoint));
 	}
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	AddToStream(std::move(xAdd), Prio::History);
 }
 
 void IcingaDB::SendRemovedDowntime(const Downtime::Ptr& downtime)
@@ -1721,7 +2016,7 @@ void IcingaDB::SendRemovedDowntime(const Downtime::Ptr& downtime)
 		xAdd.emplace_back(GetObjectIdentifier(endpoint));
 	}
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	AddToStream(std::move(xAdd), Prio::History);
 }
 
 void IcingaDB::SendAddedComment(const Comment::Ptr& comment)
@@ -1776,7 +2071,7 @@ void IcingaDB::SendAddedComment(const Comment::Ptr& comment)
 		}
 	}
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	AddToStream(std::move(xAdd), Prio::History);
 }
 
 void IcingaDB::SendRemovedComment(const Comment::Ptr& comment)
@@ -1843,7 +2138,7 @@ void IcingaDB::SendRemovedComment(const Comment::Ptr& comment)
 		}
 	}
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	AddToStream(std::move(xAdd), Prio::History);
 }
 
 void IcingaDB::SendFlappingChange(const Checkable::Ptr& checkable, double changeTime, double flappingLastChange)
@@ -1906,7 +2201,7 @@ void IcingaDB::SendFlappingChange(const Checkable::Ptr& checkable, double change
 	xAdd.emplace_back("id");
 	xAdd.emplace_back(HashValue(new Array({GetEnvironment(), checkable->GetReflectionType()->GetName(), checkable->GetName(), startTime})));
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	AddToStream(std::move(xAdd), Prio::History);
 }
 
 void IcingaDB::SendNextUpdate(const Checkable::Ptr& checkable)
@@ -1975,7 +2270,7 @@ void IcingaDB::SendAcknowledgementSet(const Checkable::Ptr& checkable, const Str
 	xAdd.emplace_back("id");
 	xAdd.emplace_back(HashValue(new Array({GetEnvironment(), checkable->GetReflectionType()->GetName(), checkable->GetName(), setTime})));
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	AddToStream(std::move(xAdd), Prio::History);
 }
 
 void IcingaDB::SendAcknowledgementCleared(const Checkable::Ptr& checkable, const String& removedBy, double changeTime, double ackLastChange)
@@ -2025,7 +2320,7 @@ void IcingaDB::SendAcknowledgementCleared(const Checkable::Ptr& checkable, const
 		xAdd.emplace_back(removedBy);
 	}
 
-	m_Rcon->FireAndForgetQuery(std::move(xAdd), Prio::History);
+	AddToStream(std::move(xAdd), Prio::History);
 }
 
 Dictionary::Ptr IcingaDB::SerializeState(const Checkable::Ptr& checkable)
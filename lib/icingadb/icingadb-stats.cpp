@@ -3,7 +3,6 @@
 #include "icingadb/icingadb.hpp"
 #include "base/json.hpp"
 #include "base/logger.hpp"
-#include "base/serializer.hpp"
 #include "base/statsfunction.hpp"
 #include "base/convert.hpp"
 
@@ -14,37 +13,31 @@ Dictionary::Ptr IcingaDB::GetStats()
 	Dictionary::Ptr stats = new Dictionary();
 
 	//TODO: Figure out if more stats can be useful here.
-	Namespace::Ptr statsFunctions = ScriptGlobal::Get("StatsFunctions", &Empty);
-
-	if (!statsFunctions)
-		Dictionary::Ptr();
-
-	ObjectLock olock(statsFunctions);
-
-	for (auto& kv : statsFunctions)
-	{
-		Function::Ptr func = kv.second->Get();
-
-		if (!func)
-			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid status function name."));
-
-		Dictionary::Ptr status = new Dictionary();
-		Array::Ptr perfdata = new Array();
-		func->Invoke({ status, perfdata });
-
-		stats->Set(kv.first, new Dictionary({
-			{ "status", status },
-			{ "perfdata", Serialize(perfdata, FAState) }
+	StatsFunctionCache::ForEach([&stats](const String& name, const StatsFunctionResult& result) {
+		stats->Set(name, new Dictionary({
+			{ "status", result.Status },
+			{ "perfdata", result.SerializedPerfdata }
 		}));
-	}
+	});
 
 	auto localEndpoint (Endpoint::GetLocalEndpoint());
 
 	if (localEndpoint) {
-		typedef Dictionary::Ptr DP;
+		/* Don't modify the cached results, they are shared with /v1/status. */
+		Dictionary::Ptr component = stats->Get("IcingaApplication");
+		component = component->ShallowClone();
+		stats->Set("IcingaApplication", component);
+
+		Dictionary::Ptr status = Dictionary::Ptr(component->Get("status"))->ShallowClone();
+		component->Set("status", status);
+
+		Dictionary::Ptr icingaapplication = Dictionary::Ptr(status->Get("icingaapplication"))->ShallowClone();
+		status->Set("icingaapplication", icingaapplication);
+
+		Dictionary::Ptr app = Dictionary::Ptr(icingaapplication->Get("app"))->ShallowClone();
+		icingaapplication->Set("app", app);
 
-		DP(DP(DP(DP(stats->Get("IcingaApplication"))->Get("status"))->Get("icingaapplication"))->Get("app"))
-			->Set("endpoint_id", GetObjectIdentifier(localEndpoint));
+		app->Set("endpoint_id", GetObjectIdentifier(localEndpoint));
 	}
 
 	return stats;
@@ -2,6 +2,8 @@
 
 #include "icingadb/icingadb.hpp"
 #include "base/configtype.hpp"
+#include "base/defer.hpp"
+#include "base/hex.hpp"
 #include "base/object-packer.hpp"
 #include "base/logger.hpp"
 #include "base/serializer.hpp"
@@ -12,6 +14,7 @@
 #include "base/scriptglobal.hpp"
 #include "base/convert.hpp"
 #include "base/json.hpp"
+#include "base/utility.hpp"
 #include "icinga/customvarobject.hpp"
 #include "icinga/checkcommand.hpp"
 #include "icinga/notificationcommand.hpp"
@@ -26,11 +29,7 @@ using namespace icinga;
 
 String IcingaDB::FormatCheckSumBinary(const String& str)
 {
-	char output[20*2+1];
-	for (int i = 0; i < 20; i++)
-		sprintf(output + 2 * i, "%02x", str[i]);
-
-	return output;
+	return Hex::Encode(str);
 }
 
 String IcingaDB::FormatCommandLine(const Value& commandLine)
@@ -75,9 +74,25 @@ ArrayData IcingaDB::GetObjectIdentifiersWithoutEnv(const ConfigObject::Ptr& obje
 		return {object->GetName()};
 }
 
+/**
+ * Get the ID of object in Icinga DB, i.e. the hash of the environment and its name (and type if ambiguous)
+ *
+ * None of these can change at runtime, so the ID is computed once per object and kept as its extension.
+ *
+ * @param object Config object
+ *
+ * @return The ID
+ */
 String IcingaDB::GetObjectIdentifier(const ConfigObject::Ptr& object)
 {
-	return HashValue(new Array(Prepend(GetEnvironment(), GetObjectIdentifiersWithoutEnv(object))));
+	Value id = object->GetExtension("IcingaDBObjectIdentifier");
+
+	if (id.IsEmpty()) {
+		id = HashValue(new Array(Prepend(GetEnvironment(), GetObjectIdentifiersWithoutEnv(object))));
+		object->SetExtension("IcingaDBObjectIdentifier", id);
+	}
+
+	return id;
 }
 
 static const std::set<String> metadataWhitelist ({"package", "source_location", "templates"});
@@ -130,17 +145,16 @@ Dictionary::Ptr IcingaDB::SerializeVars(const CustomVarObject::Ptr& object)
 
 	Dictionary::Ptr res = new Dictionary();
 	auto env (GetEnvironment());
-	auto envChecksum (SHA1(env));
 
 	ObjectLock olock(vars);
 
 	for (auto& kv : vars) {
 		res->Set(
-			SHA1(PackObject((Array::Ptr)new Array({env, kv.first, kv.second}))),
+			PackObjectSHA1((Array::Ptr)new Array({env, kv.first.GetString(), kv.second})),
 			(Dictionary::Ptr)new Dictionary({
-				{"environment_id", envChecksum},
+				{"environment_id", m_EnvironmentId},
 				{"name_checksum", SHA1(kv.first)},
-				{"name", kv.first},
+				{"name", kv.first.GetString()},
 				{"value", JsonEncode(kv.second)},
 			})
 		);
@@ -151,6 +165,8 @@ Dictionary::Ptr IcingaDB::SerializeVars(const CustomVarObject::Ptr& object)
 
 static const std::set<String> propertiesBlacklistEmpty;
 
+thread_local double *IcingaDB::m_HashDuration = nullptr;
+
 String IcingaDB::HashValue(const Value& value)
 {
 	return HashValue(value, propertiesBlacklistEmpty);
@@ -158,6 +174,15 @@ String IcingaDB::HashValue(const Value& value)
 
 String IcingaDB::HashValue(const Value& value, const std::set<String>& propertiesBlacklist, bool propertiesWhitelist)
 {
+	auto hashDuration (m_HashDuration);
+	double start = hashDuration ? Utility::GetTime() : 0;
+
+	Defer addDuration ([hashDuration, start]() {
+		if (hashDuration) {
+			*hashDuration += Utility::GetTime() - start;
+		}
+	});
+
 	Value temp;
 	bool mutabl;
 
@@ -186,7 +211,7 @@ String IcingaDB::HashValue(const Value& value, const std::set<String>& propertie
 
 				while (current != dict->End()) {
 					if (propertiesBlacklist.find(current->first) == propertiesBlacklistEnd) {
-						dict->Remove(current++);
+						current = dict->Remove(current);
 					} else {
 						++current;
 					}
@@ -201,7 +226,7 @@ String IcingaDB::HashValue(const Value& value, const std::set<String>& propertie
 		}
 	}
 
-	return SHA1(PackObject(temp));
+	return PackObjectSHA1(temp);
 }
 
 String IcingaDB::GetLowerCaseTypeNameDB(const ConfigObject::Ptr& obj)
@@ -4,7 +4,12 @@
 #include "icingadb/icingadb-ti.cpp"
 #include "icingadb/redisconnection.hpp"
 #include "remote/eventqueue.hpp"
+#include "base/convert.hpp"
 #include "base/json.hpp"
+#include "base/configtype.hpp"
+#include "base/memoryusage.hpp"
+#include "base/statsfunction.hpp"
+#include "base/perfdatavalue.hpp"
 #include "icinga/checkable.hpp"
 #include "icinga/host.hpp"
 #include <boost/algorithm/string.hpp>
@@ -41,6 +46,12 @@ boost::once_flag IcingaDB::m_EnvironmentIdOnce = BOOST_ONCE_INIT;
 
 REGISTER_TYPE(IcingaDB);
 
+REGISTER_STATSFUNCTION(IcingaDB, &IcingaDB::StatsFunc);
+
+INITIALIZE_ONCE([]() {
+	MemoryUsage::Register("redis_connections", &IcingaDB::MemoryUsageFunc);
+});
+
 IcingaDB::IcingaDB()
 	: m_Rcon(nullptr)
 {
@@ -73,6 +84,11 @@ void IcingaDB::Start(bool runtimeCreated)
 	m_WorkQueue.SetExceptionCallback([this](boost::exception_ptr exp) { ExceptionHandler(std::move(exp)); });
 
 	m_Rcon = new RedisConnection(GetHost(), GetPort(), GetPath(), GetPassword(), GetDbIndex());
+
+	if (GetRedisCluster()) {
+		m_Rcon->EnableClusterMode();
+	}
+
 	m_Rcon->SetConnectedCallback([this](boost::asio::yield_context& yc) {
 		m_WorkQueue.Enqueue([this]() { OnConnectedHandler(); });
 	});
@@ -80,15 +96,107 @@ void IcingaDB::Start(bool runtimeCreated)
 
 	m_StatsTimer = new Timer();
 	m_StatsTimer->SetInterval(1);
+	m_StatsTimer->SetSlack(0.5);
 	m_StatsTimer->OnTimerExpired.connect([this](const Timer * const&) { PublishStatsTimerHandler(); });
 	m_StatsTimer->Start();
 
+	m_StreamFlushTimer = new Timer();
+	m_StreamFlushTimer->SetInterval(GetStreamFlushInterval());
+	m_StreamFlushTimer->OnTimerExpired.connect([this](const Timer * const&) { FlushStreams(); });
+	m_StreamFlushTimer->Start();
+
+	m_StateFlushTimer = new Timer();
+	m_StateFlushTimer->SetInterval(GetStateFlushInterval());
+	m_StateFlushTimer->OnTimerExpired.connect([this](const Timer * const&) { FlushStates(); });
+	m_StateFlushTimer->Start();
+
 	m_WorkQueue.SetName("IcingaDB");
 
 	m_Rcon->SuppressQueryKind(Prio::CheckResult);
 	m_Rcon->SuppressQueryKind(Prio::State);
 }
 
+void IcingaDB::ValidateDumpConnections(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<IcingaDB>::ValidateDumpConnections(lvalue, utils);
+
+	if (lvalue() < 1)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "dump_connections" }, "Value must be greater than 0."));
+}
+
+void IcingaDB::ValidateStreamBatchSize(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<IcingaDB>::ValidateStreamBatchSize(lvalue, utils);
+
+	if (lvalue() < 1)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "stream_batch_size" }, "Value must be greater than 0."));
+}
+
+void IcingaDB::ValidateStreamFlushInterval(const Lazy<double>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<IcingaDB>::ValidateStreamFlushInterval(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "stream_flush_interval" }, "Value must be greater than 0."));
+}
+
+void IcingaDB::ValidateStreamMaxlen(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<IcingaDB>::ValidateStreamMaxlen(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "stream_maxlen" }, "Value must not be negative."));
+}
+
+void IcingaDB::ValidateStateFlushInterval(const Lazy<double>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<IcingaDB>::ValidateStateFlushInterval(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "state_flush_interval" }, "Value must be greater than 0."));
+}
+
+/**
+ * The queries waiting to be written to Redis by IcingaDB object name, see MemoryUsage.
+ */
+Value IcingaDB::MemoryUsageFunc()
+{
+	Dictionary::Ptr connections = new Dictionary();
+
+	for (const IcingaDB::Ptr& icingadb : ConfigType::GetObjectsByType<IcingaDB>()) {
+		RedisConnection::Ptr rcon = icingadb->m_Rcon;
+
+		if (rcon)
+			connections->Set(icingadb->GetName(), rcon->GetWriteQueueLength());
+	}
+
+	return connections;
+}
+
+void IcingaDB::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
+{
+	DictionaryData nodes;
+
+	for (const IcingaDB::Ptr& icingadb : ConfigType::GetObjectsByType<IcingaDB>()) {
+		String prefix = "icingadb_" + icingadb->GetName();
+		uint_fast64_t written = icingadb->m_StateUpdatesWritten.load();
+		uint_fast64_t coalesced = icingadb->m_StateUpdatesCoalesced.load();
+		uint_fast64_t unchanged = icingadb->m_StateUpdatesUnchanged.load();
+
+		nodes.emplace_back(icingadb->GetName(), new Dictionary({
+			{ "state_updates_written", written },
+			{ "state_updates_coalesced", coalesced },
+			{ "state_updates_unchanged", unchanged }
+		}));
+
+		perfdata->Add(new PerfdataValue(prefix + "_state_updates_written", written));
+		perfdata->Add(new PerfdataValue(prefix + "_state_updates_coalesced", coalesced));
+		perfdata->Add(new PerfdataValue(prefix + "_state_updates_unchanged", unchanged));
+	}
+
+	status->Set("icingadb", new Dictionary(std::move(nodes)));
+}
+
 void IcingaDB::ExceptionHandler(boost::exception_ptr exp)
 {
 	Log(LogCritical, "IcingaDB", "Exception during redis query. Verify that Redis is operational.");
@@ -101,6 +209,21 @@ void IcingaDB::OnConnectedHandler()
 {
 	AssertOnWorkQueue();
 
+	/* Redis may have lost what we've written before. */
+	{
+		std::unique_lock<std::mutex> lock (m_StateHashesMutex);
+		m_StateHashes.clear();
+	}
+
+	if (GetRedisCluster()) {
+		try {
+			m_Rcon->UpdateClusterSlots();
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "IcingaDB")
+				<< "Cannot fetch the Redis Cluster slots, sending everything to '" << GetHost() << ":" << GetPort() << "' for now: " << ex.what();
+		}
+	}
+
 	if (m_ConfigDumpInProgress || m_ConfigDumpDone)
 		return;
 
@@ -127,6 +250,7 @@ void IcingaDB::PublishStats()
 
 	Dictionary::Ptr status = GetStats();
 	status->Set("config_dump_in_progress", m_ConfigDumpInProgress);
+	status->Set("redis_connection", m_Rcon->GetStats());
 	status->Set("timestamp", TimestampToMilliseconds(Utility::GetTime()));
 
 	std::vector<String> eval ({"EVAL", l_LuaPublishStats, "1", "icinga:stats"});
@@ -142,11 +266,77 @@ void IcingaDB::PublishStats()
 	m_Rcon->FireAndForgetQuery(std::move(eval), Prio::Heartbeat);
 }
 
+/**
+ * Queues an XADD to one of the streams Icinga DB consumes, e.g. a history event.
+ *
+ * The XADDs are sent as one pipelined batch per priority as soon as stream_batch_size
+ * of them are queued, at the latest after stream_flush_interval seconds.
+ */
+void IcingaDB::AddToStream(RedisConnection::Query xAdd, RedisConnection::QueryPriority priority)
+{
+	auto maxLen (GetStreamMaxlen());
+
+	if (maxLen > 0) {
+		/* XADD key MAXLEN ~ n * field value ... */
+		xAdd.insert(xAdd.begin() + 2, { "MAXLEN", "~", Convert::ToString(maxLen) });
+	}
+
+	RedisConnection::Queries batch;
+
+	{
+		std::unique_lock<std::mutex> lock (m_StreamBatchesMutex);
+		auto& queries (m_StreamBatches[priority]);
+
+		queries.emplace_back(std::move(xAdd));
+
+		if (queries.size() < (size_t)GetStreamBatchSize())
+			return;
+
+		batch.swap(queries);
+	}
+
+	m_Rcon->FireAndForgetQueries(std::move(batch), priority);
+}
+
+/**
+ * Sends all XADDs queued by AddToStream().
+ */
+void IcingaDB::FlushStreams()
+{
+	std::map<RedisConnection::QueryPriority, RedisConnection::Queries> batches;
+
+	{
+		std::unique_lock<std::mutex> lock (m_StreamBatchesMutex);
+		batches.swap(m_StreamBatches);
+	}
+
+	for (auto& batch : batches) {
+		if (!batch.second.empty()) {
+			m_Rcon->FireAndForgetQueries(std::move(batch.second), batch.first);
+		}
+	}
+}
+
 void IcingaDB::Stop(bool runtimeRemoved)
 {
 	Log(LogInformation, "IcingaDB")
 		<< "'" << GetName() << "' stopped.";
 
+	if (m_StateFlushTimer) {
+		m_StateFlushTimer->Stop(true);
+		FlushStates();
+	}
+
+	if (m_StreamFlushTimer) {
+		m_StreamFlushTimer->Stop(true);
+		FlushStreams();
+	}
+
+	{
+		std::unique_lock<std::mutex> lock (m_ConfigObjectCacheMutex);
+		m_ConfigObjectCache.clear();
+	}
+
 	ObjectImpl<IcingaDB>::Stop(runtimeRemoved);
 }
 
@@ -13,9 +13,13 @@
 #include "icinga/downtime.hpp"
 #include "remote/messageorigin.hpp"
 #include <boost/thread/once.hpp>
+#include <atomic>
+#include <cstdint>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <set>
+#include <unordered_map>
 #include <utility>
 
 namespace icinga
@@ -37,6 +41,15 @@ public:
 	virtual void Start(bool runtimeCreated) override;
 	virtual void Stop(bool runtimeRemoved) override;
 
+	void ValidateDumpConnections(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateStreamBatchSize(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateStreamFlushInterval(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
+	void ValidateStreamMaxlen(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateStateFlushInterval(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
+
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+	static Value MemoryUsageFunc();
+
 private:
 	class DumpedGlobals
 	{
@@ -54,14 +67,20 @@ private:
 	void PublishStatsTimerHandler();
 	void PublishStats();
 
+	void AddToStream(RedisConnection::Query xAdd, RedisConnection::QueryPriority priority);
+	void FlushStreams();
+
 	/* config & status dump */
 	void UpdateAllConfigObjects();
+	RedisConnection::Ptr OpenDumpConnection();
 	std::vector<std::vector<intrusive_ptr<ConfigObject>>> ChunkObjects(std::vector<intrusive_ptr<ConfigObject>> objects, size_t chunkSize);
 	void DeleteKeys(const std::vector<String>& keys, RedisConnection::QueryPriority priority);
 	std::vector<String> GetTypeOverwriteKeys(const String& type);
 	void InsertObjectDependencies(const ConfigObject::Ptr& object, const String typeName, std::map<String, std::vector<String>>& hMSets,
 			std::map<String, std::vector<String>>& publishes, bool runtimeUpdate);
 	void UpdateState(const Checkable::Ptr& checkable);
+	void FlushStates();
+	void ForgetState(const Checkable::Ptr& checkable);
 	void SendConfigUpdate(const ConfigObject::Ptr& object, bool runtimeUpdate);
 	void CreateConfigUpdate(const ConfigObject::Ptr& object, const String type, std::map<String, std::vector<String>>& hMSets,
 			std::map<String, std::vector<String>>& publishes, bool runtimeUpdate);
@@ -103,6 +122,8 @@ private:
 
 	static String GetLowerCaseTypeNameDB(const ConfigObject::Ptr& obj);
 	static bool PrepareObject(const ConfigObject::Ptr& object, Dictionary::Ptr& attributes, Dictionary::Ptr& checkSums);
+	bool PrepareObjectCached(const ConfigObject::Ptr& object, Dictionary::Ptr& attributes, String& checkSum);
+	Dictionary::Ptr SerializeVarsCached(const CustomVarObject::Ptr& object);
 
 	static void StateChangeHandler(const ConfigObject::Ptr& object);
 	static void StateChangeHandler(const ConfigObject::Ptr& object, const CheckResult::Ptr& cr, StateType type);
@@ -147,8 +168,26 @@ private:
 	}
 
 	Timer::Ptr m_StatsTimer;
+	Timer::Ptr m_StreamFlushTimer;
+	Timer::Ptr m_StateFlushTimer;
 	WorkQueue m_WorkQueue;
 
+	/* XADDs not sent yet, per priority */
+	std::map<RedisConnection::QueryPriority, RedisConnection::Queries> m_StreamBatches;
+	std::mutex m_StreamBatchesMutex;
+
+	/* Checkables UpdateState() has been called for since the last FlushStates() */
+	std::set<Checkable::Ptr> m_PendingStates;
+	std::mutex m_PendingStatesMutex;
+
+	/* Hashes of the states FlushStates() has written last */
+	std::unordered_map<Checkable::Ptr, size_t> m_StateHashes;
+	std::mutex m_StateHashesMutex;
+
+	std::atomic<uint_fast64_t> m_StateUpdatesWritten {0};
+	std::atomic<uint_fast64_t> m_StateUpdatesCoalesced {0};
+	std::atomic<uint_fast64_t> m_StateUpdatesUnchanged {0};
+
 	String m_PrefixConfigObject;
 	String m_PrefixConfigCheckSum;
 	String m_PrefixStateObject;
@@ -162,8 +201,28 @@ private:
 		DumpedGlobals CustomVar, ActionUrl, NotesUrl, IconImage;
 	} m_DumpedGlobals;
 
+	/**
+	 * What PrepareObjectCached() and SerializeVarsCached() computed for an object
+	 * while it had the given version and modified attributes generation.
+	 */
+	struct CachedConfigObject
+	{
+		double Version;
+		uint_fast64_t Generation;
+		Dictionary::Ptr Attributes;
+		String CheckSum;
+		bool HasVars;
+		Dictionary::Ptr Vars;
+	};
+
+	std::map<ConfigObject::Ptr, CachedConfigObject> m_ConfigObjectCache;
+	std::mutex m_ConfigObjectCacheMutex;
+
 	static String m_EnvironmentId;
 	static boost::once_flag m_EnvironmentIdOnce;
+
+	// If set, HashValue() adds the time it took to *m_HashDuration
+	static thread_local double *m_HashDuration;
 };
 }
 
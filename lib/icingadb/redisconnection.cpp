@@ -6,23 +6,48 @@
 #include "base/defer.hpp"
 #include "base/io-engine.hpp"
 #include "base/logger.hpp"
+#include "base/metrics.hpp"
 #include "base/objectlock.hpp"
 #include "base/string.hpp"
 #include "base/tcpsocket.hpp"
+#include "base/utility.hpp"
 #include <boost/asio.hpp>
 #include <boost/coroutine/exceptions.hpp>
 #include <boost/date_time/posix_time/posix_time_duration.hpp>
 #include <boost/utility/string_view.hpp>
 #include <boost/variant/get.hpp>
+#include <algorithm>
 #include <exception>
 #include <future>
 #include <iterator>
 #include <memory>
+#include <set>
+#include <stdexcept>
 #include <utility>
 
 using namespace icinga;
 namespace asio = boost::asio;
 
+/* Initial size of RedisConnection#m_ReadBuffer and how much RedisConnection#m_WriteBuffer may collect before sending it */
+static const size_t l_ReadBufferSize = 64 * 1024;
+static const size_t l_WriteBufferSize = 256 * 1024;
+
+/* Limits of RedisConnection#m_BatchSize */
+static const size_t l_MinBatchSize = 64;
+static const size_t l_MaxBatchSize = 16384;
+static const size_t l_InitialBatchSize = 512;
+
+/* Upper bounds (in seconds) of the round trip histogram's buckets, the last bucket takes everything above */
+static const struct {
+	double UpperBound;
+	const char *Name;
+} l_RoundTripBuckets[] = {
+	{ 0.001, "0.001" }, { 0.002, "0.002" }, { 0.005, "0.005" }, { 0.01, "0.01" }, { 0.025, "0.025" },
+	{ 0.05, "0.05" }, { 0.1, "0.1" }, { 0.25, "0.25" }, { 0.5, "0.5" }, { 1, "1" }
+};
+
+static Histogram l_RedisRoundTrip ("icinga_redis_query_seconds", "Round trip time of Redis query batches of all connections");
+
 RedisConnection::RedisConnection(const String& host, const int port, const String& path, const String& password, const int db) :
 	RedisConnection(IoEngine::Get().GetIoContext(), host, port, path, password, db)
 {
@@ -30,8 +55,12 @@ RedisConnection::RedisConnection(const String& host, const int port, const Strin
 
 RedisConnection::RedisConnection(boost::asio::io_context& io, String host, int port, String path, String password, int db)
 	: m_Host(std::move(host)), m_Port(port), m_Path(std::move(path)), m_Password(std::move(password)), m_DbIndex(db),
-	  m_Connecting(false), m_Connected(false), m_Started(false), m_Strand(io), m_QueuedWrites(io), m_QueuedReads(io)
+	  m_Connecting(false), m_Connected(false), m_Started(false), m_Stopped(false), m_Strand(io),
+	  m_ReadBuffer{std::vector<char>(l_ReadBufferSize), 0, 0}, m_QueuedWrites(io), m_QueuedReads(io),
+	  m_WriteQueueLength(0), m_UnflushedQueries(0), m_BatchSize(l_InitialBatchSize), m_QueriesWritten(0), m_ResponsesRead(0), m_MaxInFlight(0),
+	  m_MinRoundTrip(0), m_RoundTrips{}, m_ClusterMode(false), m_ClusterStopped(false), m_ClusterSlotsUpdating(false)
 {
+	m_WriteBuffer.reserve(l_WriteBufferSize);
 }
 
 void RedisConnection::Start()
@@ -50,10 +79,117 @@ void RedisConnection::Start()
 	}
 }
 
+/**
+ * Close the connection and stop (re-)connecting
+ *
+ * Queries not sent yet are discarded, so the caller should make sure all of its queries have been answered.
+ */
+void RedisConnection::Stop()
+{
+	Ptr keepAlive (this);
+
+	asio::post(m_Strand, [this, keepAlive]() {
+		boost::system::error_code ec;
+
+		m_Stopped = true;
+		m_Connected.store(false);
+
+		if (m_TcpConn) {
+			m_TcpConn->close(ec);
+			m_TcpConn = nullptr;
+		}
+
+		if (m_UnixConn) {
+			m_UnixConn->close(ec);
+			m_UnixConn = nullptr;
+		}
+
+		m_QueuedWrites.Set();
+		m_QueuedReads.Set();
+	});
+
+	if (m_ClusterMode) {
+		std::shared_ptr<const ClusterNodes> cluster;
+
+		{
+			std::unique_lock<std::mutex> lock (m_ClusterMutex);
+			m_ClusterStopped = true;
+			cluster = std::atomic_load(&m_ClusterNodes);
+			std::atomic_store(&m_ClusterNodes, std::shared_ptr<const ClusterNodes>());
+		}
+
+		if (cluster) {
+			for (auto& node : cluster->Nodes) {
+				node.second->Stop();
+			}
+		}
+	}
+}
+
 bool RedisConnection::IsConnected() {
 	return m_Connected.load();
 }
 
+/**
+ * Get the pipelining statistics of this connection
+ *
+ * @return Queries in flight, batch size and round trip histogram
+ */
+/**
+ * Get the amount of queries (and batches of them) waiting to be written to Redis,
+ * including those of the cluster nodes.
+ */
+size_t RedisConnection::GetWriteQueueLength()
+{
+	size_t length = m_WriteQueueLength.load();
+
+	if (m_ClusterMode) {
+		auto cluster (std::atomic_load(&m_ClusterNodes));
+
+		if (cluster) {
+			for (auto& node : cluster->Nodes) {
+				length += node.second->GetWriteQueueLength();
+			}
+		}
+	}
+
+	return length;
+}
+
+Dictionary::Ptr RedisConnection::GetStats()
+{
+	Dictionary::Ptr roundTrips = new Dictionary();
+
+	for (size_t i = 0; i < RoundTripBuckets; ++i) {
+		roundTrips->Set(i < RoundTripBuckets - 1u ? l_RoundTripBuckets[i].Name : "+Inf", (double)m_RoundTrips[i].load());
+	}
+
+	auto written (m_QueriesWritten.load());
+	auto read (m_ResponsesRead.load());
+
+	Dictionary::Ptr stats = new Dictionary({
+		{ "queries_in_flight", written > read ? (double)(written - read) : 0.0 },
+		{ "queries_in_flight_max", (double)m_MaxInFlight.load() },
+		{ "batch_size", (double)m_BatchSize.load() },
+		{ "round_trip_histogram", roundTrips }
+	});
+
+	if (m_ClusterMode) {
+		auto cluster (std::atomic_load(&m_ClusterNodes));
+		Dictionary::Ptr nodes = new Dictionary();
+
+		if (cluster) {
+			for (auto& node : cluster->Nodes) {
+				nodes->Set(node.first, node.second->GetStats());
+			}
+		}
+
+		stats->Set("cluster_nodes", nodes);
+	}
+
+	return stats;
+}
+
 /**
  * Append a Redis query to a log message
  *
@@ -87,6 +223,11 @@ void LogQuery(RedisConnection::Query& query, Log& msg)
  */
 void RedisConnection::FireAndForgetQuery(RedisConnection::Query query, RedisConnection::QueryPriority priority)
 {
+	if (m_ClusterMode) {
+		FireAndForgetQueries({std::move(query)}, priority);
+		return;
+	}
+
 	{
 		Log msg (LogNotice, "IcingaDB", "Firing and forgetting query:");
 		LogQuery(query, msg);
@@ -96,6 +237,7 @@ void RedisConnection::FireAndForgetQuery(RedisConnection::Query query, RedisConn
 
 	asio::post(m_Strand, [this, item, priority]() {
 		m_Queues.Writes[priority].emplace(WriteQueueItem{item, nullptr, nullptr, nullptr});
+		m_WriteQueueLength.fetch_add(1);
 		m_QueuedWrites.Set();
 	});
 }
@@ -108,6 +250,43 @@ void RedisConnection::FireAndForgetQuery(RedisConnection::Query query, RedisConn
  */
 void RedisConnection::FireAndForgetQueries(RedisConnection::Queries queries, RedisConnection::QueryPriority priority)
 {
+	if (m_ClusterMode) {
+		std::map<RedisConnection::Ptr, Queries> batches;
+		Queries own;
+
+		auto route ([this, &batches, &own](Query query) {
+			auto node (GetClusterNode(query));
+
+			(node ? batches[node] : own).emplace_back(std::move(query));
+		});
+
+		for (auto& query : queries) {
+			if (query.empty() || query[0] == "MULTI" || query[0] == "EXEC") {
+				// A transaction can't span multiple nodes
+				continue;
+			}
+
+			if ((query[0] == "DEL" || query[0] == "UNLINK") && query.size() > 2u) {
+				// The keys may belong to different nodes
+				for (auto key (query.begin() + 1); key != query.end(); ++key) {
+					route({query[0], std::move(*key)});
+				}
+			} else {
+				route(std::move(query));
+			}
+		}
+
+		for (auto& batch : batches) {
+			batch.first->FireAndForgetQueries(std::move(batch.second), priority);
+		}
+
+		if (own.empty()) {
+			return;
+		}
+
+		queries = std::move(own);
+	}
+
 	for (auto& query : queries) {
 		Log msg (LogNotice, "IcingaDB", "Firing and forgetting query:");
 		LogQuery(query, msg);
@@ -117,6 +296,7 @@ void RedisConnection::FireAndForgetQueries(RedisConnection::Queries queries, Red
 
 	asio::post(m_Strand, [this, item, priority]() {
 		m_Queues.Writes[priority].emplace(WriteQueueItem{nullptr, item, nullptr, nullptr});
+		m_WriteQueueLength.fetch_add(1);
 		m_QueuedWrites.Set();
 	});
 }
@@ -131,6 +311,41 @@ void RedisConnection::FireAndForgetQueries(RedisConnection::Queries queries, Red
  */
 RedisConnection::Reply RedisConnection::GetResultOfQuery(RedisConnection::Query query, RedisConnection::QueryPriority priority)
 {
+	if (m_ClusterMode) {
+		if (query.size() == 1u && query[0] == "PING") {
+			// Wait until all nodes have executed everything sent so far, not just the seed
+			for (auto& node : GetClusterNodes()) {
+				node->GetResultOfQuery(query, priority);
+			}
+		} else {
+			auto node (GetClusterNode(query));
+
+			if (node) {
+				auto reply (node->GetResultOfQuery(query, priority));
+				bool ask;
+				String address;
+
+				if (!ParseRedirect(reply, ask, address)) {
+					return reply;
+				}
+
+				node = GetClusterNode(address);
+
+				if (!node) {
+					throw RedisDisconnected();
+				}
+
+				if (ask) {
+					return node->GetResultsOfQueries({{"ASKING"}, std::move(query)}, priority).at(1);
+				}
+
+				UpdateClusterSlotsAsync();
+
+				return node->GetResultOfQuery(std::move(query), priority);
+			}
+		}
+	}
+
 	{
 		Log msg (LogNotice, "IcingaDB", "Executing query:");
 		LogQuery(query, msg);
@@ -142,6 +357,7 @@ RedisConnection::Reply RedisConnection::GetResultOfQuery(RedisConnection::Query
 
 	asio::post(m_Strand, [this, item, priority]() {
 		m_Queues.Writes[priority].emplace(WriteQueueItem{nullptr, nullptr, item, nullptr});
+		m_WriteQueueLength.fetch_add(1);
 		m_QueuedWrites.Set();
 	});
 
@@ -160,6 +376,21 @@ RedisConnection::Reply RedisConnection::GetResultOfQuery(RedisConnection::Query
  */
 RedisConnection::Replies RedisConnection::GetResultsOfQueries(RedisConnection::Queries queries, RedisConnection::QueryPriority priority)
 {
+	if (m_ClusterMode) {
+		// The queries are expected to share one hash slot, e.g. via a {hash tag}
+		for (auto& query : queries) {
+			if (GetQueryKey(query)) {
+				auto node (GetClusterNode(query));
+
+				if (node) {
+					return node->GetResultsOfQueries(std::move(queries), priority);
+				}
+
+				break;
+			}
+		}
+	}
+
 	for (auto& query : queries) {
 		Log msg (LogNotice, "IcingaDB", "Executing query:");
 		LogQuery(query, msg);
@@ -171,6 +402,7 @@ RedisConnection::Replies RedisConnection::GetResultsOfQueries(RedisConnection::Q
 
 	asio::post(m_Strand, [this, item, priority]() {
 		m_Queues.Writes[priority].emplace(WriteQueueItem{nullptr, nullptr, nullptr, item});
+		m_WriteQueueLength.fetch_add(1);
 		m_QueuedWrites.Set();
 	});
 
@@ -179,10 +411,45 @@ RedisConnection::Replies RedisConnection::GetResultsOfQueries(RedisConnection::Q
 	return future.get();
 }
 
+/**
+ * Queue a callback to be run once all queries queued before have been sent
+ *
+ * In cluster mode the callback runs once that's the case on all nodes, from the coroutine of the last one.
+ *
+ * @param callback Callback to run
+ * @param priority The callback's priority
+ */
 void RedisConnection::EnqueueCallback(const std::function<void(boost::asio::yield_context&)>& callback, RedisConnection::QueryPriority priority)
 {
+	if (m_ClusterMode) {
+		auto nodes (GetClusterNodes());
+
+		if (!nodes.empty()) {
+			auto pending (std::make_shared<std::atomic<size_t>>(nodes.size() + 1u));
+
+			std::function<void(boost::asio::yield_context&)> countDown ([callback, pending](boost::asio::yield_context& yc) {
+				if (pending->fetch_sub(1) == 1u) {
+					callback(yc);
+				}
+			});
+
+			for (auto& node : nodes) {
+				node->EnqueueCallback(countDown, priority);
+			}
+
+			asio::post(m_Strand, [this, countDown, priority]() {
+				m_Queues.Writes[priority].emplace(WriteQueueItem{nullptr, nullptr, nullptr, nullptr, countDown});
+				m_WriteQueueLength.fetch_add(1);
+				m_QueuedWrites.Set();
+			});
+
+			return;
+		}
+	}
+
 	asio::post(m_Strand, [this, callback, priority]() {
 		m_Queues.Writes[priority].emplace(WriteQueueItem{nullptr, nullptr, nullptr, nullptr, callback});
+		m_WriteQueueLength.fetch_add(1);
 		m_QueuedWrites.Set();
 	});
 }
@@ -195,6 +462,19 @@ void RedisConnection::EnqueueCallback(const std::function<void(boost::asio::yiel
 void RedisConnection::SuppressQueryKind(RedisConnection::QueryPriority kind)
 {
 	asio::post(m_Strand, [this, kind]() { m_SuppressedQueryKinds.emplace(kind); });
+
+	if (m_ClusterMode) {
+		std::unique_lock<std::mutex> lock (m_ClusterMutex);
+		auto cluster (std::atomic_load(&m_ClusterNodes));
+
+		m_ClusterSuppressedKinds.emplace(kind);
+
+		if (cluster) {
+			for (auto& node : cluster->Nodes) {
+				node.second->SuppressQueryKind(kind);
+			}
+		}
+	}
 }
 
 /**
@@ -208,6 +488,19 @@ void RedisConnection::UnsuppressQueryKind(RedisConnection::QueryPriority kind)
 		m_SuppressedQueryKinds.erase(kind);
 		m_QueuedWrites.Set();
 	});
+
+	if (m_ClusterMode) {
+		std::unique_lock<std::mutex> lock (m_ClusterMutex);
+		auto cluster (std::atomic_load(&m_ClusterNodes));
+
+		m_ClusterSuppressedKinds.erase(kind);
+
+		if (cluster) {
+			for (auto& node : cluster->Nodes) {
+				node.second->UnsuppressQueryKind(kind);
+			}
+		}
+	}
 }
 
 /**
@@ -220,23 +513,36 @@ void RedisConnection::Connect(asio::yield_context& yc)
 	boost::asio::deadline_timer timer (m_Strand.context());
 
 	for (;;) {
+		if (m_Stopped) {
+			return;
+		}
+
 		try {
 			if (m_Path.IsEmpty()) {
 				Log(LogInformation, "IcingaDB")
 					<< "Trying to connect to Redis server (async) on host '" << m_Host << ":" << m_Port << "'";
 
 				auto conn (Shared<TcpConn>::Make(m_Strand.context()));
-				icinga::Connect(conn->next_layer(), m_Host, Convert::ToString(m_Port), yc);
+				icinga::Connect(*conn, m_Host, Convert::ToString(m_Port), yc);
 				m_TcpConn = std::move(conn);
 			} else {
 				Log(LogInformation, "IcingaDB")
 					<< "Trying to connect to Redis server (async) on unix socket path '" << m_Path << "'";
 
 				auto conn (Shared<UnixConn>::Make(m_Strand.context()));
-				conn->next_layer().async_connect(Unix::endpoint(m_Path.CStr()), yc);
+				conn->async_connect(Unix::endpoint(m_Path.CStr()), yc);
 				m_UnixConn = std::move(conn);
 			}
 
+			// Whatever was in flight on the previous connection won't be answered anymore
+			m_ResponsesRead.store(m_QueriesWritten.load());
+			m_UnflushedQueries = 0;
+			m_ReadBuffer.Begin = 0;
+			m_ReadBuffer.End = 0;
+			m_WriteBuffer.clear();
+			m_PendingRoundTrips = decltype(m_PendingRoundTrips)();
+			m_MinRoundTrip = 0;
+
 			m_Connected.store(true);
 
 			Log(LogInformation, "IcingaDB", "Connected to Redis server");
@@ -267,28 +573,52 @@ void RedisConnection::ReadLoop(asio::yield_context& yc)
 	for (;;) {
 		m_QueuedReads.Wait(yc);
 
+		if (m_Stopped) {
+			return;
+		}
+
 		while (!m_Queues.FutureResponseActions.empty()) {
 			auto item (std::move(m_Queues.FutureResponseActions.front()));
 			m_Queues.FutureResponseActions.pop();
 
 			switch (item.Action) {
 				case ResponseAction::Ignore:
-					try {
-						for (auto i (item.Amount); i; --i) {
-							ReadOne(yc);
+					{
+						auto i (item.Amount);
+
+						try {
+							for (; i; --i) {
+								auto reply (ReadOne(yc));
+
+								if (m_RedirectCallback) {
+									auto sent (std::move(m_Queues.SentQueries.front()));
+									m_Queues.SentQueries.pop();
+
+									bool ask;
+									String address;
+
+									if (ParseRedirect(reply, ask, address)) {
+										m_RedirectCallback(sent.Single ? *sent.Single : (*sent.Batch)[sent.Index],
+											sent.Priority, RedisError::Ptr(reply)->GetMessage());
+									}
+								}
+							}
+						} catch (const boost::coroutines::detail::forced_unwind&) {
+							throw;
+						} catch (const std::exception& ex) {
+							Log(LogCritical, "IcingaDB")
+								<< "Error during receiving the response to a query which has been fired and forgotten: " << ex.what();
+						} catch (...) {
+							Log(LogCritical, "IcingaDB")
+								<< "Error during receiving the response to a query which has been fired and forgotten";
+						}
+
+						if (m_RedirectCallback) {
+							// These won't be answered anymore
+							for (; i; --i) {
+								m_Queues.SentQueries.pop();
+							}
 						}
-					} catch (const boost::coroutines::detail::forced_unwind&) {
-						throw;
-					} catch (const std::exception& ex) {
-						Log(LogCritical, "IcingaDB")
-							<< "Error during receiving the response to a query which has been fired and forgotten: " << ex.what();
-
-						continue;
-					} catch (...) {
-						Log(LogCritical, "IcingaDB")
-							<< "Error during receiving the response to a query which has been fired and forgotten";
-
-						continue;
 					}
 
 					break;
@@ -350,6 +680,10 @@ void RedisConnection::WriteLoop(asio::yield_context& yc)
 	for (;;) {
 		m_QueuedWrites.Wait(yc);
 
+		if (m_Stopped) {
+			return;
+		}
+
 	WriteFirstOfHighestPrio:
 		for (auto& queue : m_Queues.Writes) {
 			if (m_SuppressedQueryKinds.find(queue.first) != m_SuppressedQueryKinds.end() || queue.second.empty()) {
@@ -358,12 +692,20 @@ void RedisConnection::WriteLoop(asio::yield_context& yc)
 
 			auto next (std::move(queue.second.front()));
 			queue.second.pop();
+			m_WriteQueueLength.fetch_sub(1);
 
-			WriteItem(yc, std::move(next));
+			WriteItem(yc, std::move(next), queue.first);
+
+			if (m_UnflushedQueries >= m_BatchSize.load()) {
+				Flush(yc);
+			}
 
 			goto WriteFirstOfHighestPrio;
 		}
 
+		// Nothing more to batch right now
+		Flush(yc);
+
 		m_QueuedWrites.Clear();
 	}
 }
@@ -372,8 +714,9 @@ void RedisConnection::WriteLoop(asio::yield_context& yc)
  * Send next and schedule receiving the response
  *
  * @param next Redis queries
+ * @param priority The queries' priority
  */
-void RedisConnection::WriteItem(boost::asio::yield_context& yc, RedisConnection::WriteQueueItem next)
+void RedisConnection::WriteItem(boost::asio::yield_context& yc, RedisConnection::WriteQueueItem next, RedisConnection::QueryPriority priority)
 {
 	if (next.FireAndForgetQuery) {
 		auto& item (*next.FireAndForgetQuery);
@@ -402,6 +745,10 @@ void RedisConnection::WriteItem(boost::asio::yield_context& yc, RedisConnection:
 			++m_Queues.FutureResponseActions.back().Amount;
 		}
 
+		if (m_RedirectCallback) {
+			m_Queues.SentQueries.emplace(SentQuery{next.FireAndForgetQuery, nullptr, 0, priority});
+		}
+
 		m_QueuedReads.Set();
 	}
 
@@ -436,6 +783,12 @@ void RedisConnection::WriteItem(boost::asio::yield_context& yc, RedisConnection:
 			m_Queues.FutureResponseActions.back().Amount += item.size();
 		}
 
+		if (m_RedirectCallback) {
+			for (size_t i = 0; i < item.size(); ++i) {
+				m_Queues.SentQueries.emplace(SentQuery{nullptr, next.FireAndForgetQueries, i, priority});
+			}
+		}
+
 		m_QueuedReads.Set();
 	}
 
@@ -485,6 +838,9 @@ void RedisConnection::WriteItem(boost::asio::yield_context& yc, RedisConnection:
 	}
 
 	if (next.Callback) {
+		// The callback may wait for the responses to the queries written so far
+		Flush(yc);
+
 		next.Callback(yc);
 	}
 }
@@ -496,25 +852,231 @@ void RedisConnection::WriteItem(boost::asio::yield_context& yc, RedisConnection:
  */
 RedisConnection::Reply RedisConnection::ReadOne(boost::asio::yield_context& yc)
 {
+	Reply reply;
+
 	if (m_Path.IsEmpty()) {
-		return ReadOne(m_TcpConn, yc);
+		reply = ReadOne(m_TcpConn, yc);
 	} else {
-		return ReadOne(m_UnixConn, yc);
+		reply = ReadOne(m_UnixConn, yc);
 	}
+
+	auto read (m_ResponsesRead.fetch_add(1) + 1u);
+
+	if (!m_PendingRoundTrips.empty() && m_PendingRoundTrips.front().first <= read) {
+		auto now (Utility::GetTime());
+
+		do {
+			RecordRoundTrip(now - m_PendingRoundTrips.front().second);
+			m_PendingRoundTrips.pop();
+		} while (!m_PendingRoundTrips.empty() && m_PendingRoundTrips.front().first <= read);
+	}
+
+	return reply;
 }
 
 /**
- * Send query
+ * Write query to m_WriteBuffer, send the latter once it's full
  *
  * @param query Redis query
  */
 void RedisConnection::WriteOne(RedisConnection::Query& query, asio::yield_context& yc)
 {
-	if (m_Path.IsEmpty()) {
-		WriteOne(m_TcpConn, query, yc);
+	if (m_Path.IsEmpty() ? !m_TcpConn : !m_UnixConn) {
+		throw RedisDisconnected();
+	}
+
+	WriteRESP(m_WriteBuffer, query);
+
+	++m_UnflushedQueries;
+	m_QueriesWritten.fetch_add(1);
+
+	if (m_WriteBuffer.size() >= l_WriteBufferSize) {
+		Flush(yc);
+	}
+}
+
+/**
+ * Actually send the queries written by WriteOne() so far
+ *
+ * Errors are logged, not thrown - the queries' requestors are notified by ReadLoop().
+ */
+void RedisConnection::Flush(asio::yield_context& yc)
+{
+	if (!m_UnflushedQueries) {
+		return;
+	}
+
+	m_UnflushedQueries = 0;
+
+	Defer clear ([this]() {
+		if (m_WriteBuffer.capacity() > l_WriteBufferSize * 4u) {
+			// Don't keep the memory of a single huge query forever
+			m_WriteBuffer = std::vector<char>();
+			m_WriteBuffer.reserve(l_WriteBufferSize);
+		} else {
+			m_WriteBuffer.clear();
+		}
+	});
+
+	try {
+		if (m_Path.IsEmpty()) {
+			Flush(m_TcpConn, yc);
+		} else {
+			Flush(m_UnixConn, yc);
+		}
+	} catch (const boost::coroutines::detail::forced_unwind&) {
+		throw;
+	} catch (const std::exception& ex) {
+		Log(LogCritical, "IcingaDB")
+			<< "Error during sending queries: " << ex.what();
+
+		return;
+	} catch (...) {
+		Log(LogCritical, "IcingaDB", "Error during sending queries");
+
+		return;
+	}
+
+	auto written (m_QueriesWritten.load());
+	auto read (m_ResponsesRead.load());
+	auto inFlight (written > read ? written - read : 0u);
+
+	if (inFlight > m_MaxInFlight.load()) {
+		m_MaxInFlight.store(inFlight);
+	}
+
+	m_PendingRoundTrips.emplace(written, Utility::GetTime());
+}
+
+/**
+ * Append the decimal length of a Redis protocol value with its type (e.g. "$42\r\n") to out
+ *
+ * @return The end of what has been appended
+ */
+static inline
+char *WriteRESPLength(char *out, char type, size_t length)
+{
+	size_t digits = 1;
+
+	for (auto i (length); i >= 10u; i /= 10u) {
+		++digits;
+	}
+
+	*out++ = type;
+
+	for (auto pos (out + digits); pos != out; length /= 10u) {
+		*--pos = '0' + length % 10u;
+	}
+
+	out += digits;
+	*out++ = '\r';
+	*out++ = '\n';
+
+	return out;
+}
+
+/**
+ * Append a Redis query in the Redis protocol to buffer
+ *
+ * An upper bound of the length is computed first, so buffer grows at most once.
+ *
+ * @param buffer Write buffer
+ * @param query Redis query
+ */
+void RedisConnection::WriteRESP(std::vector<char>& buffer, const Query& query)
+{
+	// "*" length "\r\n", per argument "$" length "\r\n" argument "\r\n", 20 digits max.
+	size_t length = 1u + 20u + 2u;
+
+	for (auto& arg : query) {
+		length += 1u + 20u + 2u + arg.GetLength() + 2u;
+	}
+
+	auto offset (buffer.size());
+
+	if (buffer.capacity() < offset + length) {
+		buffer.reserve(std::max(offset + length, buffer.capacity() * 2u));
+	}
+
+	buffer.resize(offset + length);
+
+	auto out (WriteRESPLength(buffer.data() + offset, '*', query.size()));
+
+	for (auto& arg : query) {
+		out = WriteRESPLength(out, '$', arg.GetLength());
+		memcpy(out, arg.CStr(), arg.GetLength());
+		out += arg.GetLength();
+		*out++ = '\r';
+		*out++ = '\n';
+	}
+
+	buffer.resize(out - buffer.data());
+}
+
+/**
+ * Parse the decimal integer of a Redis protocol value
+ *
+ * @param str The integer ex. type and \r\n
+ *
+ * @return The integer
+ */
+intmax_t RedisConnection::ParseRESPInt(boost::string_view str)
+{
+	auto pos (str.begin());
+	bool negative = pos != str.end() && *pos == '-';
+
+	if (negative) {
+		++pos;
+	}
+
+	if (pos == str.end() || str.end() - pos > 18) {
+		throw BadRedisInt(std::vector<char>(str.begin(), str.end()));
+	}
+
+	intmax_t i = 0;
+
+	for (; pos != str.end(); ++pos) {
+		if (*pos < '0' || *pos > '9') {
+			throw BadRedisInt(std::vector<char>(str.begin(), str.end()));
+		}
+
+		i = i * 10 + (*pos - '0');
+	}
+
+	return negative ? -i : i;
+}
+
+/**
+ * Account a round trip (from a flush to the response to its last query) and resize the batches accordingly
+ *
+ * As long as the round trip stays close to the lowest one seen, Redis keeps up and the batches grow.
+ * Otherwise they shrink, so that high priority queries don't wait behind too many others.
+ *
+ * @param roundTrip Seconds
+ */
+void RedisConnection::RecordRoundTrip(double roundTrip)
+{
+	size_t bucket = 0;
+
+	while (bucket < RoundTripBuckets - 1u && roundTrip > l_RoundTripBuckets[bucket].UpperBound) {
+		++bucket;
+	}
+
+	m_RoundTrips[bucket].fetch_add(1);
+	l_RedisRoundTrip.Observe(roundTrip);
+
+	// Let the minimum rise slowly, so that a permanently slower network doesn't shrink the batches forever
+	m_MinRoundTrip = m_MinRoundTrip > 0 ? std::min(roundTrip, m_MinRoundTrip * 1.01) : roundTrip;
+
+	auto batchSize (m_BatchSize.load());
+
+	if (roundTrip <= m_MinRoundTrip * 2) {
+		batchSize = std::min(batchSize * 2u, l_MaxBatchSize);
 	} else {
-		WriteOne(m_UnixConn, query, yc);
+		batchSize = std::max(batchSize / 2u, l_MinBatchSize);
 	}
+
+	m_BatchSize.store(batchSize);
 }
 
 /**
@@ -527,3 +1089,384 @@ void RedisConnection::WriteOne(RedisConnection::Query& query, asio::yield_contex
 void RedisConnection::SetConnectedCallback(std::function<void(asio::yield_context& yc)> callback) {
 	m_ConnectedCallback = std::move(callback);
 }
+
+
+/**
+ * Treat the connection as a seed of a Redis Cluster and route the queries to the master node serving their keys
+ *
+ * Must be called before Start(). The nodes are connected to once known, see UpdateClusterSlots().
+ * Queries without keys (e.g. PING) stay on the seed connection. Transactions (MULTI/EXEC) are dropped
+ * and DEL/UNLINK of multiple keys is split up, as their keys may be served by different nodes.
+ */
+void RedisConnection::EnableClusterMode()
+{
+	m_ClusterMode = true;
+
+	m_RedirectCallback = [this](const Query& query, QueryPriority priority, const String& error) {
+		Redirect(query, priority, error);
+	};
+}
+
+/**
+ * Fetch which master node serves which hash slot and connect to the new ones
+ *
+ * Blocks until Redis has answered, so don't call it from within a Boost.Asio coroutine.
+ */
+void RedisConnection::UpdateClusterSlots()
+{
+	Value reply = GetResultOfQuery({"CLUSTER", "SLOTS"}, QueryPriority::Heartbeat);
+
+	if (reply.IsObjectType<RedisError>()) {
+		BOOST_THROW_EXCEPTION(std::runtime_error("CLUSTER SLOTS failed: " + RedisError::Ptr(reply)->GetMessage()));
+	}
+
+	if (!reply.IsObjectType<Array>()) {
+		BOOST_THROW_EXCEPTION(std::runtime_error("CLUSTER SLOTS returned a malformed response"));
+	}
+
+	Array::Ptr ranges = reply;
+	std::vector<RedisConnection::Ptr> obsolete;
+
+	{
+		std::unique_lock<std::mutex> lock (m_ClusterMutex);
+
+		if (m_ClusterStopped) {
+			return;
+		}
+
+		auto old (std::atomic_load(&m_ClusterNodes));
+		auto cluster (std::make_shared<ClusterNodes>());
+
+		cluster->Slots.resize(ClusterSlotCount);
+
+		ObjectLock olock (ranges);
+
+		for (const Value& vrange : ranges) {
+			if (!vrange.IsObjectType<Array>()) {
+				continue;
+			}
+
+			// [first slot, last slot, [master host, master port, ...], replicas...]
+			Array::Ptr range = vrange;
+
+			if (range->GetLength() < 3u || !range->Get(2).IsObjectType<Array>()) {
+				continue;
+			}
+
+			Array::Ptr master = range->Get(2);
+
+			if (master->GetLength() < 2u) {
+				continue;
+			}
+
+			String host = master->Get(0);
+			String address = (host.IsEmpty() ? m_Host : host) + ":" + Convert::ToString(master->Get(1));
+			auto& node (cluster->Nodes[address]);
+
+			if (!node) {
+				if (old) {
+					auto pos (old->Nodes.find(address));
+
+					if (pos != old->Nodes.end()) {
+						node = pos->second;
+					}
+				}
+
+				if (!node) {
+					node = MakeClusterNode(address);
+				}
+			}
+
+			auto first (std::max<long>(Convert::ToLong(range->Get(0)), 0));
+			auto last (std::min<long>(Convert::ToLong(range->Get(1)), ClusterSlotCount - 1u));
+
+			for (auto slot (first); slot <= last; ++slot) {
+				cluster->Slots[slot] = node;
+			}
+		}
+
+		if (old) {
+			for (auto& node : old->Nodes) {
+				if (cluster->Nodes.find(node.first) == cluster->Nodes.end()) {
+					obsolete.emplace_back(node.second);
+				}
+			}
+		}
+
+		Log(LogInformation, "IcingaDB")
+			<< "Redis Cluster has " << cluster->Nodes.size() << " master node(s)";
+
+		std::atomic_store(&m_ClusterNodes, std::shared_ptr<const ClusterNodes>(std::move(cluster)));
+	}
+
+	for (auto& node : obsolete) {
+		node->Stop();
+	}
+}
+
+/**
+ * Let UpdateClusterSlots() run in the background unless it's already running
+ */
+void RedisConnection::UpdateClusterSlotsAsync()
+{
+	if (m_ClusterSlotsUpdating.exchange(true)) {
+		return;
+	}
+
+	Ptr keepAlive (this);
+
+	Utility::QueueAsyncCallback([this, keepAlive]() {
+		Defer notUpdating ([this]() { m_ClusterSlotsUpdating.store(false); });
+
+		try {
+			UpdateClusterSlots();
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "IcingaDB")
+				<< "Cannot update the Redis Cluster slots: " << ex.what();
+		}
+	});
+}
+
+/**
+ * Re-send a query fired and forgotten which a node answered with MOVED or ASK
+ *
+ * Runs on the node's strand, so it must not block.
+ *
+ * @param query Redis query
+ * @param priority The query's priority
+ * @param error The node's response, e.g. "MOVED 3999 127.0.0.1:6381"
+ */
+void RedisConnection::Redirect(const Query& query, QueryPriority priority, const String& error)
+{
+	auto pos (error.RFind(" "));
+	auto node (pos == String::NPos ? nullptr : GetClusterNode(error.SubStr(pos + 1u)));
+
+	if (!node) {
+		Log msg (LogWarning, "IcingaDB", "Dropping query");
+		LogQuery(const_cast<Query&>(query), msg);
+		msg << " redirected by Redis Cluster: " << error;
+
+		return;
+	}
+
+	if (error.Find("ASK ") == 0) {
+		node->FireAndForgetQueries({{"ASKING"}, query}, priority);
+	} else {
+		node->FireAndForgetQuery(query, priority);
+
+		UpdateClusterSlotsAsync();
+	}
+}
+
+/**
+ * Compute a key's Redis Cluster hash slot, i.e. the CRC16 (XMODEM) of it (or of its {hash tag}) modulo 16384
+ *
+ * @param key Redis key
+ *
+ * @return Hash slot
+ */
+size_t RedisConnection::GetKeySlot(const String& key)
+{
+	static const auto table ([]() {
+		std::vector<uint_fast16_t> table (256);
+
+		for (unsigned i = 0; i < 256u; ++i) {
+			uint_fast16_t crc = i << 8u;
+
+			for (int bit = 0; bit < 8; ++bit) {
+				crc = (crc & 0x8000u ? crc << 1u ^ 0x1021u : crc << 1u) & 0xffffu;
+			}
+
+			table[i] = crc;
+		}
+
+		return table;
+	}());
+
+	auto begin (key.Begin());
+	auto end (key.End());
+	auto open (std::find(begin, end, '{'));
+
+	if (open != end) {
+		auto close (std::find(open + 1, end, '}'));
+
+		// Only a non-empty hash tag counts
+		if (close != end && close != open + 1) {
+			begin = open + 1;
+			end = close;
+		}
+	}
+
+	uint_fast16_t crc = 0;
+
+	for (auto pos (begin); pos != end; ++pos) {
+		crc = (crc << 8u ^ table[(crc >> 8u ^ (unsigned char)*pos) & 0xffu]) & 0xffffu;
+	}
+
+	return crc % ClusterSlotCount;
+}
+
+/**
+ * Get the key a Redis Cluster routes a query by
+ *
+ * @param query Redis query
+ *
+ * @return The key or nullptr if the query has none
+ */
+const String *RedisConnection::GetQueryKey(const Query& query)
+{
+	static const std::set<String> keyless ({"ASKING", "CLUSTER", "DISCARD", "EXEC", "INFO", "MULTI", "PING", "SCRIPT", "TIME"});
+
+	if (query.size() < 2u || keyless.find(query[0]) != keyless.end()) {
+		return nullptr;
+	}
+
+	if (query[0] == "EVAL" || query[0] == "EVALSHA") {
+		return query.size() > 3u && query[2] != "0" ? &query[3] : nullptr;
+	}
+
+	return &query[1];
+}
+
+/**
+ * Check whether reply is a Redis Cluster redirection
+ *
+ * @param reply Redis response
+ * @param ask Set to whether it's an ASK (one-time) redirection rather than a MOVED one
+ * @param address Set to the "host:port" to ask instead
+ *
+ * @return Whether reply is a redirection
+ */
+bool RedisConnection::ParseRedirect(const Reply& reply, bool& ask, String& address)
+{
+	if (!reply.IsObjectType<RedisError>()) {
+		return false;
+	}
+
+	auto& error (RedisError::Ptr(reply)->GetMessage());
+
+	if (error.Find("MOVED ") == 0) {
+		ask = false;
+	} else if (error.Find("ASK ") == 0) {
+		ask = true;
+	} else {
+		return false;
+	}
+
+	address = error.SubStr(error.RFind(" ") + 1u);
+	return true;
+}
+
+/**
+ * Get the connection to the master node serving query's key
+ *
+ * @param query Redis query
+ *
+ * @return The connection or nullptr if the seed connection shall handle query
+ */
+RedisConnection::Ptr RedisConnection::GetClusterNode(const Query& query)
+{
+	auto key (GetQueryKey(query));
+
+	if (!key) {
+		return nullptr;
+	}
+
+	auto cluster (std::atomic_load(&m_ClusterNodes));
+
+	if (!cluster || cluster->Slots.empty()) {
+		return nullptr;
+	}
+
+	return cluster->Slots[GetKeySlot(*key)];
+}
+
+/**
+ * Get the connection to a node by address, connect to it if not known yet
+ *
+ * @param address "host:port"
+ *
+ * @return The connection or nullptr if this connection has been stopped
+ */
+RedisConnection::Ptr RedisConnection::GetClusterNode(const String& address)
+{
+	{
+		auto cluster (std::atomic_load(&m_ClusterNodes));
+
+		if (cluster) {
+			auto pos (cluster->Nodes.find(address));
+
+			if (pos != cluster->Nodes.end()) {
+				return pos->second;
+			}
+		}
+	}
+
+	std::unique_lock<std::mutex> lock (m_ClusterMutex);
+
+	if (m_ClusterStopped) {
+		return nullptr;
+	}
+
+	auto old (std::atomic_load(&m_ClusterNodes));
+	auto cluster (old ? std::make_shared<ClusterNodes>(*old) : std::make_shared<ClusterNodes>());
+	auto& node (cluster->Nodes[address]);
+
+	if (!node) {
+		node = MakeClusterNode(address);
+
+		std::atomic_store(&m_ClusterNodes, std::shared_ptr<const ClusterNodes>(cluster));
+	}
+
+	return node;
+}
+
+/**
+ * Get the connections to all nodes known so far
+ *
+ * @return Connections
+ */
+std::vector<RedisConnection::Ptr> RedisConnection::GetClusterNodes()
+{
+	std::vector<RedisConnection::Ptr> nodes;
+	auto cluster (std::atomic_load(&m_ClusterNodes));
+
+	if (cluster) {
+		nodes.reserve(cluster->Nodes.size());
+
+		for (auto& node : cluster->Nodes) {
+			nodes.emplace_back(node.second);
+		}
+	}
+
+	return nodes;
+}
+
+/**
+ * Connect to a node, m_ClusterMutex must be locked
+ *
+ * @param address "host:port"
+ *
+ * @return The connection
+ */
+RedisConnection::Ptr RedisConnection::MakeClusterNode(const String& address)
+{
+	auto pos (address.RFind(":"));
+	String host = pos == String::NPos ? address : address.SubStr(0, pos);
+	int port = pos == String::NPos ? m_Port : Convert::ToLong(address.SubStr(pos + 1u));
+
+	Ptr node = new RedisConnection(host.IsEmpty() ? m_Host : host, port, "", m_Password, m_DbIndex);
+	Ptr seed (this);
+
+	node->m_RedirectCallback = [seed](const Query& query, QueryPriority priority, const String& error) {
+		seed->Redirect(query, priority, error);
+	};
+
+	for (auto kind : m_ClusterSuppressedKinds) {
+		node->SuppressQueryKind(kind);
+	}
+
+	node->Start();
+
+	return node;
+}
@@ -5,13 +5,13 @@
 
 #include "base/array.hpp"
 #include "base/atomic.hpp"
+#include "base/dictionary.hpp"
 #include "base/io-engine.hpp"
 #include "base/object.hpp"
 #include "base/shared.hpp"
 #include "base/string.hpp"
 #include "base/value.hpp"
 #include <boost/asio/buffer.hpp>
-#include <boost/asio/buffered_stream.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/io_context_strand.hpp>
 #include <boost/asio/ip/tcp.hpp>
@@ -22,13 +22,17 @@
 #include <boost/asio/write.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/utility/string_view.hpp>
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <functional>
 #include <future>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <queue>
 #include <set>
 #include <stdexcept>
@@ -70,9 +74,13 @@ namespace icinga
 			const String& password = "", const int db = 0);
 
 		void Start();
+		void Stop();
 
 		bool IsConnected();
 
+		Dictionary::Ptr GetStats();
+		size_t GetWriteQueueLength();
+
 		void FireAndForgetQuery(Query query, QueryPriority priority);
 		void FireAndForgetQueries(Queries queries, QueryPriority priority);
 
@@ -86,6 +94,14 @@ namespace icinga
 
 		void SetConnectedCallback(std::function<void(boost::asio::yield_context& yc)> callback);
 
+		void EnableClusterMode();
+		void UpdateClusterSlots();
+
+		static size_t GetKeySlot(const String& key);
+
+		// Number of hash slots a Redis Cluster distributes the keys over
+		static constexpr size_t ClusterSlotCount = 16384;
+
 	private:
 		/**
 		 * What to do with the responses to Redis queries.
@@ -124,35 +140,92 @@ namespace icinga
 			std::function<void(boost::asio::yield_context&)> Callback;
 		};
 
+		/**
+		 * A query fired and forgotten on a Redis Cluster node, kept in case the node redirects it.
+		 *
+		 * @ingroup icingadb
+		 */
+		struct SentQuery
+		{
+			Shared<Query>::Ptr Single;
+			Shared<Queries>::Ptr Batch;
+			size_t Index;
+			QueryPriority Priority;
+		};
+
+		/**
+		 * The master nodes of a Redis Cluster.
+		 *
+		 * @ingroup icingadb
+		 */
+		struct ClusterNodes
+		{
+			// Connections by "host:port"
+			std::map<String, RedisConnection::Ptr> Nodes;
+			// Connection of each hash slot's master, empty until CLUSTER SLOTS has been answered
+			std::vector<RedisConnection::Ptr> Slots;
+		};
+
+		typedef std::function<void(const Query&, QueryPriority, const String&)> RedirectCallback;
+
 		typedef boost::asio::ip::tcp Tcp;
 		typedef boost::asio::local::stream_protocol Unix;
 
-		typedef boost::asio::buffered_stream<Tcp::socket> TcpConn;
-		typedef boost::asio::buffered_stream<Unix::socket> UnixConn;
+		typedef Tcp::socket TcpConn;
+		typedef Unix::socket UnixConn;
+
+		/**
+		 * Data received from Redis, but not parsed yet.
+		 *
+		 * @ingroup icingadb
+		 */
+		struct ReadBuffer
+		{
+			std::vector<char> Data;
+			// Range of Data not parsed yet
+			size_t Begin, End;
+		};
 
 		template<class AsyncReadStream>
-		static Value ReadRESP(AsyncReadStream& stream, boost::asio::yield_context& yc);
+		static Value ReadRESP(AsyncReadStream& stream, ReadBuffer& buffer, boost::asio::yield_context& yc);
 
 		template<class AsyncReadStream>
-		static std::vector<char> ReadLine(AsyncReadStream& stream, boost::asio::yield_context& yc, size_t hint = 0);
+		static boost::string_view ReadLine(AsyncReadStream& stream, ReadBuffer& buffer, boost::asio::yield_context& yc);
 
-		template<class AsyncWriteStream>
-		static void WriteRESP(AsyncWriteStream& stream, const Query& query, boost::asio::yield_context& yc);
+		template<class AsyncReadStream>
+		static void FillReadBuffer(AsyncReadStream& stream, ReadBuffer& buffer, size_t least, boost::asio::yield_context& yc);
+
+		static intmax_t ParseRESPInt(boost::string_view str);
+		static void WriteRESP(std::vector<char>& buffer, const Query& query);
 
 		RedisConnection(boost::asio::io_context& io, String host, int port, String path, String password, int db);
 
 		void Connect(boost::asio::yield_context& yc);
 		void ReadLoop(boost::asio::yield_context& yc);
 		void WriteLoop(boost::asio::yield_context& yc);
-		void WriteItem(boost::asio::yield_context& yc, WriteQueueItem item);
+		void WriteItem(boost::asio::yield_context& yc, WriteQueueItem item, QueryPriority priority);
 		Reply ReadOne(boost::asio::yield_context& yc);
 		void WriteOne(Query& query, boost::asio::yield_context& yc);
+		void Flush(boost::asio::yield_context& yc);
+		void RecordRoundTrip(double roundTrip);
+
+		static const String *GetQueryKey(const Query& query);
+		static bool ParseRedirect(const Reply& reply, bool& ask, String& address);
+
+		RedisConnection::Ptr GetClusterNode(const Query& query);
+		RedisConnection::Ptr GetClusterNode(const String& address);
+		std::vector<RedisConnection::Ptr> GetClusterNodes();
+		RedisConnection::Ptr MakeClusterNode(const String& address);
+		void Redirect(const Query& query, QueryPriority priority, const String& error);
+		void UpdateClusterSlotsAsync();
 
 		template<class StreamPtr>
 		Reply ReadOne(StreamPtr& stream, boost::asio::yield_context& yc);
 
 		template<class StreamPtr>
-		void WriteOne(StreamPtr& stream, Query& query, boost::asio::yield_context& yc);
+		void Flush(StreamPtr& stream, boost::asio::yield_context& yc);
+
+		static constexpr size_t RoundTripBuckets = 11;
 
 		String m_Path;
 		String m_Host;
@@ -163,7 +236,13 @@ namespace icinga
 		boost::asio::io_context::strand m_Strand;
 		Shared<TcpConn>::Ptr m_TcpConn;
 		Shared<UnixConn>::Ptr m_UnixConn;
+		// Responses received, but not parsed yet
+		ReadBuffer m_ReadBuffer;
+		// Queries written, but not sent yet
+		std::vector<char> m_WriteBuffer;
 		Atomic<bool> m_Connecting, m_Connected, m_Started;
+		// Set (on m_Strand) by Stop()
+		bool m_Stopped;
 
 		struct {
 			// Items to be send to Redis
@@ -174,6 +253,8 @@ namespace icinga
 			std::queue<std::promise<Replies>> RepliesPromises;
 			// Metadata about all of the above
 			std::queue<FutureResponseAction> FutureResponseActions;
+			// Queries fired and forgotten, but not answered yet (only if m_RedirectCallback is set)
+			std::queue<SentQuery> SentQueries;
 		} m_Queues;
 
 		// Kinds of queries not to actually send yet
@@ -182,7 +263,37 @@ namespace icinga
 		// Indicate that there's something to send/receive
 		AsioConditionVariable m_QueuedWrites, m_QueuedReads;
 
+		// Items in m_Queues.Writes, readable from any thread
+		Atomic<size_t> m_WriteQueueLength;
+
 		std::function<void(boost::asio::yield_context& yc)> m_ConnectedCallback;
+
+		// Queries written, but not flushed yet
+		size_t m_UnflushedQueries;
+		// How many queries to write before flushing them even if there are more queued
+		Atomic<size_t> m_BatchSize;
+		// Totals of queries written and responses read, the difference is in flight
+		Atomic<uint_fast64_t> m_QueriesWritten, m_ResponsesRead, m_MaxInFlight;
+		// Flushes waiting for their last response: queries written so far and time of the flush
+		std::queue<std::pair<uint_fast64_t, double>> m_PendingRoundTrips;
+		// Lowest round trip time seen (slowly decaying), the reference for sizing m_BatchSize
+		double m_MinRoundTrip;
+		// Histogram of round trip times from flush to last response, see l_RoundTripBuckets
+		std::atomic<uint_fast64_t> m_RoundTrips[RoundTripBuckets];
+
+		// Whether this is the seed connection of a Redis Cluster routing the queries to m_ClusterNodes
+		bool m_ClusterMode;
+		// Replaced as a whole (std::atomic_store()) on topology changes
+		std::shared_ptr<const ClusterNodes> m_ClusterNodes;
+		// Serializes replacing m_ClusterNodes and protects the two members below
+		std::mutex m_ClusterMutex;
+		// Set by Stop()
+		bool m_ClusterStopped;
+		// What SuppressQueryKind() has been told, to be applied to new nodes
+		std::set<QueryPriority> m_ClusterSuppressedKinds;
+		Atomic<bool> m_ClusterSlotsUpdating;
+		// Set on cluster nodes (and the seed connection) to re-send fire-and-forget queries answered with MOVED/ASK
+		RedirectCallback m_RedirectCallback;
 	};
 
 /**
@@ -296,7 +407,7 @@ RedisConnection::Reply RedisConnection::ReadOne(StreamPtr& stream, boost::asio::
 	auto strm (stream);
 
 	try {
-		return ReadRESP(*strm, yc);
+		return ReadRESP(*strm, m_ReadBuffer, yc);
 	} catch (const boost::coroutines::detail::forced_unwind&) {
 		throw;
 	} catch (...) {
@@ -316,13 +427,12 @@ RedisConnection::Reply RedisConnection::ReadOne(StreamPtr& stream, boost::asio::
 }
 
 /**
- * Write a Redis query to stream
+ * Send all queries written to m_WriteBuffer so far to stream
  *
  * @param stream Redis server connection
- * @param query Redis query
  */
 template<class StreamPtr>
-void RedisConnection::WriteOne(StreamPtr& stream, RedisConnection::Query& query, boost::asio::yield_context& yc)
+void RedisConnection::Flush(StreamPtr& stream, boost::asio::yield_context& yc)
 {
 	namespace asio = boost::asio;
 
@@ -333,8 +443,7 @@ void RedisConnection::WriteOne(StreamPtr& stream, RedisConnection::Query& query,
 	auto strm (stream);
 
 	try {
-		WriteRESP(*strm, query, yc);
-		strm->async_flush(yc);
+		asio::async_write(*strm, asio::buffer(m_WriteBuffer), yc);
 	} catch (const boost::coroutines::detail::forced_unwind&) {
 		throw;
 	} catch (...) {
@@ -357,78 +466,49 @@ void RedisConnection::WriteOne(StreamPtr& stream, RedisConnection::Query& query,
  * Read a Redis protocol value from stream
  *
  * @param stream Redis server connection
+ * @param buffer What has been received from stream, but not parsed yet
  *
  * @return The value
  */
 template<class AsyncReadStream>
-Value RedisConnection::ReadRESP(AsyncReadStream& stream, boost::asio::yield_context& yc)
+Value RedisConnection::ReadRESP(AsyncReadStream& stream, ReadBuffer& buffer, boost::asio::yield_context& yc)
 {
-	namespace asio = boost::asio;
+	FillReadBuffer(stream, buffer, 1, yc);
 
-	char type = 0;
-	asio::async_read(stream, asio::mutable_buffer(&type, 1), yc);
+	char type = buffer.Data[buffer.Begin++];
 
 	switch (type) {
 		case '+':
 			{
-				auto buf (ReadLine(stream, yc));
-				return String(buf.begin(), buf.end());
+				auto line (ReadLine(stream, buffer, yc));
+				return String(line.begin(), line.end());
 			}
 		case '-':
 			{
-				auto buf (ReadLine(stream, yc));
-				return new RedisError(String(buf.begin(), buf.end()));
+				auto line (ReadLine(stream, buffer, yc));
+				return new RedisError(String(line.begin(), line.end()));
 			}
 		case ':':
-			{
-				auto buf (ReadLine(stream, yc, 21));
-				intmax_t i = 0;
-
-				try {
-					i = boost::lexical_cast<intmax_t>(boost::string_view(buf.data(), buf.size()));
-				} catch (...) {
-					throw BadRedisInt(std::move(buf));
-				}
-
-				return (double)i;
-			}
+			return (double)ParseRESPInt(ReadLine(stream, buffer, yc));
 		case '$':
 			{
-				auto buf (ReadLine(stream, yc, 21));
-				intmax_t i = 0;
-
-				try {
-					i = boost::lexical_cast<intmax_t>(boost::string_view(buf.data(), buf.size()));
-				} catch (...) {
-					throw BadRedisInt(std::move(buf));
-				}
+				auto i (ParseRESPInt(ReadLine(stream, buffer, yc)));
 
 				if (i < 0) {
 					return Value();
 				}
 
-				buf.clear();
-				buf.insert(buf.end(), i, 0);
-				asio::async_read(stream, asio::mutable_buffer(buf.data(), buf.size()), yc);
+				// Including \r\n
+				FillReadBuffer(stream, buffer, i + 2u, yc);
 
-				{
-					char crlf[2];
-					asio::async_read(stream, asio::mutable_buffer(crlf, 2), yc);
-				}
+				auto begin (buffer.Data.data() + buffer.Begin);
+				buffer.Begin += i + 2u;
 
-				return String(buf.begin(), buf.end());
+				return String(begin, begin + i);
 			}
 		case '*':
 			{
-				auto buf (ReadLine(stream, yc, 21));
-				intmax_t i = 0;
-
-				try {
-					i = boost::lexical_cast<intmax_t>(boost::string_view(buf.data(), buf.size()));
-				} catch (...) {
-					throw BadRedisInt(std::move(buf));
-				}
-
+				auto i (ParseRESPInt(ReadLine(stream, buffer, yc)));
 				Array::Ptr arr = new Array();
 
 				if (i < 0) {
@@ -438,7 +518,7 @@ Value RedisConnection::ReadRESP(AsyncReadStream& stream, boost::asio::yield_cont
 				arr->Reserve(i);
 
 				for (; i; --i) {
-					arr->Add(ReadRESP(stream, yc));
+					arr->Add(ReadRESP(stream, buffer, yc));
 				}
 
 				return arr;
@@ -449,57 +529,59 @@ Value RedisConnection::ReadRESP(AsyncReadStream& stream, boost::asio::yield_cont
 }
 
 /**
- * Read from stream until \r\n
+ * Read from buffer (and, if necessary, stream) until \r\n
  *
  * @param stream Redis server connection
- * @param hint Expected amount of data
+ * @param buffer What has been received from stream, but not parsed yet
  *
- * @return Read data ex. \r\n
+ * @return Read data ex. \r\n, valid until buffer is filled again
  */
 template<class AsyncReadStream>
-std::vector<char> RedisConnection::ReadLine(AsyncReadStream& stream, boost::asio::yield_context& yc, size_t hint)
+boost::string_view RedisConnection::ReadLine(AsyncReadStream& stream, ReadBuffer& buffer, boost::asio::yield_context& yc)
 {
-	namespace asio = boost::asio;
-
-	std::vector<char> line;
-	line.reserve(hint);
-
-	char next = 0;
-	asio::mutable_buffer buf (&next, 1);
+	size_t searched = 0;
 
 	for (;;) {
-		asio::async_read(stream, buf, yc);
+		auto begin (buffer.Data.data() + buffer.Begin);
+		auto end (buffer.Data.data() + buffer.End);
+		auto lf (std::find(begin + searched, end, '\n'));
+
+		if (lf != end) {
+			buffer.Begin = lf + 1 - buffer.Data.data();
 
-		if (next == '\r') {
-			asio::async_read(stream, buf, yc);
-			return std::move(line);
+			return boost::string_view(begin, (lf != begin && lf[-1] == '\r' ? lf - 1 : lf) - begin);
 		}
 
-		line.emplace_back(next);
+		searched = end - begin;
+		FillReadBuffer(stream, buffer, searched + 1u, yc);
 	}
 }
 
 /**
- * Write a Redis protocol value to stream
+ * Read from stream until buffer has at least the given amount of unparsed data
  *
  * @param stream Redis server connection
- * @param query Redis protocol value
+ * @param buffer What has been received from stream, but not parsed yet
+ * @param least Amount of data
  */
-template<class AsyncWriteStream>
-void RedisConnection::WriteRESP(AsyncWriteStream& stream, const Query& query, boost::asio::yield_context& yc)
+template<class AsyncReadStream>
+void RedisConnection::FillReadBuffer(AsyncReadStream& stream, ReadBuffer& buffer, size_t least, boost::asio::yield_context& yc)
 {
 	namespace asio = boost::asio;
 
-	asio::streambuf writeBuffer;
-	std::ostream msg(&writeBuffer);
+	while (buffer.End - buffer.Begin < least) {
+		if (buffer.Begin) {
+			std::memmove(buffer.Data.data(), buffer.Data.data() + buffer.Begin, buffer.End - buffer.Begin);
+			buffer.End -= buffer.Begin;
+			buffer.Begin = 0;
+		}
 
-	msg << "*" << query.size() << "\r\n";
+		if (buffer.Data.size() < least) {
+			buffer.Data.resize(least);
+		}
 
-	for (auto& arg : query) {
-		msg << "$" << arg.GetLength() << "\r\n" << arg << "\r\n";
+		buffer.End += stream.async_read_some(asio::mutable_buffer(buffer.Data.data() + buffer.End, buffer.Data.size() - buffer.End), yc);
 	}
-
-	asio::async_write(stream, writeBuffer, yc);
 }
 
 }
@@ -28,6 +28,21 @@ public:
 
 	virtual void Apply(const Table::Ptr& table, const Value& row, AggregatorState **state) = 0;
 	virtual double GetResultAndFreeState(AggregatorState *state) const = 0;
+
+	/**
+	 * Adds rows counted by the stats index.
+	 *
+	 * @param table The table
+	 * @param cls The values of the counted columns
+	 * @param count The number of rows
+	 * @param state The state of the aggregator
+	 * @return false if the aggregator needs the rows themselves
+	 */
+	virtual bool ApplyStatsClass(const Table::Ptr&, const LivestatusStatsClass&, size_t, AggregatorState **)
+	{
+		return false;
+	}
+
 	void SetFilter(const Filter::Ptr& filter);
 
 protected:
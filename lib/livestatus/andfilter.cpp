@@ -1,6 +1,7 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "livestatus/andfilter.hpp"
+#include "livestatus/statsindex.hpp"
 
 using namespace icinga;
 
@@ -13,3 +14,26 @@ bool AndFilter::Apply(const Table::Ptr& table, const Value& row)
 
 	return true;
 }
+
+void AndFilter::GetIndexLookups(std::vector<LivestatusIndexLookup>& lookups) const
+{
+	for (const Filter::Ptr& filter : m_Filters) {
+		filter->GetIndexLookups(lookups);
+	}
+}
+
+bool AndFilter::ApplyStatsClass(const Table::Ptr& table, const LivestatusStatsClass& cls, bool *result) const
+{
+	*result = true;
+
+	for (const Filter::Ptr& filter : m_Filters) {
+		bool match;
+
+		if (!filter->ApplyStatsClass(table, cls, &match))
+			return false;
+
+		*result = *result && match;
+	}
+
+	return true;
+}
@@ -19,6 +19,8 @@ public:
 	DECLARE_PTR_TYPEDEFS(AndFilter);
 
 	bool Apply(const Table::Ptr& table, const Value& row) override;
+	void GetIndexLookups(std::vector<LivestatusIndexLookup>& lookups) const override;
+	bool ApplyStatsClass(const Table::Ptr& table, const LivestatusStatsClass& cls, bool *result) const override;
 };
 
 }
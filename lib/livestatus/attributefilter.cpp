@@ -1,24 +1,88 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "livestatus/attributefilter.hpp"
+#include "livestatus/statsindex.hpp"
 #include "base/convert.hpp"
 #include "base/array.hpp"
 #include "base/objectlock.hpp"
 #include "base/logger.hpp"
-#include <boost/regex.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <algorithm>
 
 using namespace icinga;
 
 AttributeFilter::AttributeFilter(String column, String op, String operand)
 	: m_Column(std::move(column)), m_Operator(std::move(op)), m_Operand(std::move(operand))
-{ }
+{
+	if (m_Operator == "~" || m_Operator == "~~") {
+		try {
+			m_Regex.assign(m_Operand.GetData(), m_Operator == "~~" ? boost::regex::icase : boost::regex::normal);
+			m_HasRegex = true;
+		} catch (boost::exception&) {
+			/* Apply() logs the error for each row. */
+		}
+	}
+
+	try {
+		m_NumericOperand = Convert::ToDouble(m_Operand);
+		m_HasNumericOperand = true;
+	} catch (const std::exception&) {
+		/* Only an error if the column turns out to be a number. */
+	}
+}
+
+void AttributeFilter::Prepare(const Table::Ptr& table)
+{
+	try {
+		m_ResolvedColumn = table->GetColumn(m_Column);
+		m_ColumnTable = table.get();
+	} catch (const std::exception&) {
+		/* Apply() reports unknown columns, as there may not be any rows. */
+		m_ColumnTable = nullptr;
+	}
+
+	m_CompareNumbers = m_ColumnTable && m_ResolvedColumn.HasNumberAccessor() && m_HasNumericOperand
+		&& (m_Operator == "=" || m_Operator == "<" || m_Operator == ">" || m_Operator == "<=" || m_Operator == ">=");
+}
+
+double AttributeFilter::GetNumericOperand() const
+{
+	if (!m_HasNumericOperand)
+		return Convert::ToDouble(m_Operand);
+
+	return m_NumericOperand;
+}
+
+bool AttributeFilter::CompareNumber(double value) const
+{
+	if (m_Operator == "=")
+		return value == m_NumericOperand;
+	else if (m_Operator == "<")
+		return value < m_NumericOperand;
+	else if (m_Operator == ">")
+		return value > m_NumericOperand;
+	else if (m_Operator == "<=")
+		return value <= m_NumericOperand;
+	else
+		return value >= m_NumericOperand;
+}
 
 bool AttributeFilter::Apply(const Table::Ptr& table, const Value& row)
 {
-	Column column = table->GetColumn(m_Column);
+	if (m_CompareNumbers && m_ColumnTable == table.get()) {
+		double number;
+
+		/* Otherwise the value is compared like any other, e.g. if there's no object. */
+		if (m_ResolvedColumn.ExtractNumber(row, &number))
+			return CompareNumber(number);
+	}
 
-	Value value = column.ExtractValue(row);
+	Value value;
+
+	if (m_ColumnTable == table.get())
+		value = m_ResolvedColumn.ExtractValue(row);
+	else
+		value = table->GetColumn(m_Column).ExtractValue(row);
 
 	if (value.IsObjectType<Array>()) {
 		Array::Ptr array = value;
@@ -41,16 +105,21 @@ bool AttributeFilter::Apply(const Table::Ptr& table, const Value& row)
 	} else {
 		if (m_Operator == "=") {
 			if (value.GetType() == ValueNumber || value.GetType() == ValueBoolean)
-				return (static_cast<double>(value) == Convert::ToDouble(m_Operand));
+				return (static_cast<double>(value) == GetNumericOperand());
 			else
 				return (static_cast<String>(value) == m_Operand);
 		} else if (m_Operator == "~") {
+			if (!m_HasRegex) {
+				Log(LogWarning, "AttributeFilter")
+					<< "Regex '" << m_Operand << " " << m_Operator << " " << value << "' error.";
+				return false;
+			}
+
 			bool ret;
 			try {
-				boost::regex expr(m_Operand.GetData());
 				String operand = value;
 				boost::smatch what;
-				ret = boost::regex_search(operand.GetData(), what, expr);
+				ret = boost::regex_search(operand.GetData(), what, m_Regex);
 			} catch (boost::exception&) {
 				Log(LogWarning, "AttributeFilter")
 					<< "Regex '" << m_Operand << " " << m_Operator << " " << value << "' error.";
@@ -75,12 +144,17 @@ bool AttributeFilter::Apply(const Table::Ptr& table, const Value& row)
 
 			return ret;
 		} else if (m_Operator == "~~") {
+			if (!m_HasRegex) {
+				Log(LogWarning, "AttributeFilter")
+					<< "Regex '" << m_Operand << " " << m_Operator << " " << value << "' error.";
+				return false;
+			}
+
 			bool ret;
 			try {
-				boost::regex expr(m_Operand.GetData(), boost::regex::icase);
 				String operand = value;
 				boost::smatch what;
-				ret = boost::regex_search(operand.GetData(), what, expr);
+				ret = boost::regex_search(operand.GetData(), what, m_Regex);
 			} catch (boost::exception&) {
 				Log(LogWarning, "AttributeFilter")
 					<< "Regex '" << m_Operand << " " << m_Operator << " " << value << "' error.";
@@ -94,22 +168,22 @@ bool AttributeFilter::Apply(const Table::Ptr& table, const Value& row)
 			return ret;
 		} else if (m_Operator == "<") {
 			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) < Convert::ToDouble(m_Operand));
+				return (static_cast<double>(value) < GetNumericOperand());
 			else
 				return (static_cast<String>(value) < m_Operand);
 		} else if (m_Operator == ">") {
 			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) > Convert::ToDouble(m_Operand));
+				return (static_cast<double>(value) > GetNumericOperand());
 			else
 				return (static_cast<String>(value) > m_Operand);
 		} else if (m_Operator == "<=") {
 			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) <= Convert::ToDouble(m_Operand));
+				return (static_cast<double>(value) <= GetNumericOperand());
 			else
 				return (static_cast<String>(value) <= m_Operand);
 		} else if (m_Operator == ">=") {
 			if (value.GetType() == ValueNumber)
-				return (static_cast<double>(value) >= Convert::ToDouble(m_Operand));
+				return (static_cast<double>(value) >= GetNumericOperand());
 			else
 				return (static_cast<String>(value) >= m_Operand);
 		} else {
@@ -119,3 +193,47 @@ bool AttributeFilter::Apply(const Table::Ptr& table, const Value& row)
 
 	return false;
 }
+
+void AttributeFilter::GetIndexLookups(std::vector<LivestatusIndexLookup>& lookups) const
+{
+	lookups.push_back({ m_Column, m_Operator, m_Operand });
+}
+
+bool AttributeFilter::ApplyStatsClass(const Table::Ptr& table, const LivestatusStatsClass& cls, bool *result) const
+{
+	String column = table->GetColumnKey(m_Column);
+
+	/* See Apply() for arrays. */
+	if (column == "groups") {
+		if (m_Operator == ">=" || m_Operator == "<") {
+			bool found = std::binary_search(cls.Groups.begin(), cls.Groups.end(), m_Operand);
+			*result = (found == (m_Operator == ">="));
+		} else if (m_Operator == "=")
+			*result = cls.Groups.empty();
+		else
+			return false;
+
+		return true;
+	}
+
+	double value;
+
+	if (column == "state")
+		value = cls.State;
+	else if (column == "state_type")
+		value = cls.StateType;
+	else if (column == "has_been_checked")
+		value = cls.HasBeenChecked;
+	else if (column == "scheduled_downtime_depth")
+		value = cls.DowntimeDepth;
+	else if (column == "acknowledged" && m_Operator == "=") /* A boolean, Apply() compares it as a string otherwise. */
+		value = cls.Acknowledged;
+	else
+		return false;
+
+	if (!m_HasNumericOperand || (m_Operator != "=" && m_Operator != "<" && m_Operator != ">" && m_Operator != "<=" && m_Operator != ">="))
+		return false;
+
+	*result = CompareNumber(value);
+	return true;
+}
@@ -4,6 +4,7 @@
 #define ATTRIBUTEFILTER_H
 
 #include "livestatus/filter.hpp"
+#include <boost/regex.hpp>
 
 using namespace icinga;
 
@@ -21,11 +22,31 @@ public:
 	AttributeFilter(String column, String op, String operand);
 
 	bool Apply(const Table::Ptr& table, const Value& row) override;
+	void GetIndexLookups(std::vector<LivestatusIndexLookup>& lookups) const override;
+	void Prepare(const Table::Ptr& table) override;
+	bool ApplyStatsClass(const Table::Ptr& table, const LivestatusStatsClass& cls, bool *result) const override;
 
 protected:
 	String m_Column;
 	String m_Operator;
 	String m_Operand;
+
+private:
+	/* Resolved by Prepare() rather than for each row. */
+	const Table *m_ColumnTable{nullptr};
+	Column m_ResolvedColumn{nullptr, nullptr};
+
+	bool m_HasNumericOperand{false};
+	double m_NumericOperand{0};
+
+	/* Whether numbers are compared without converting them into a Value. */
+	bool m_CompareNumbers{false};
+
+	bool m_HasRegex{false};
+	boost::regex m_Regex;
+
+	double GetNumericOperand() const;
+	bool CompareNumber(double value) const;
 };
 
 }
@@ -1,11 +1,14 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "livestatus/column.hpp"
+#include "livestatus/typedcolumn.hpp"
 
 using namespace icinga;
 
-Column::Column(ValueAccessor valueAccessor, ObjectAccessor objectAccessor)
-	: m_ValueAccessor(std::move(valueAccessor)), m_ObjectAccessor(std::move(objectAccessor))
+std::atomic<uint_fast64_t> LivestatusRowCache::m_Generation (1);
+
+Column::Column(ValueAccessor valueAccessor, ObjectAccessor objectAccessor, NumberAccessor numberAccessor)
+	: m_ValueAccessor(std::move(valueAccessor)), m_ObjectAccessor(std::move(objectAccessor)), m_NumberAccessor(numberAccessor)
 { }
 
 Value Column::ExtractValue(const Value& urow, LivestatusGroupByType groupByType, const Object::Ptr& groupByObject) const
@@ -19,3 +22,30 @@ Value Column::ExtractValue(const Value& urow, LivestatusGroupByType groupByType,
 
 	return m_ValueAccessor(row);
 }
+
+/**
+ * Whether the column's values are numbers which can be extracted
+ * without converting them into a Value.
+ */
+bool Column::HasNumberAccessor() const
+{
+	return m_NumberAccessor != nullptr;
+}
+
+/**
+ * Extracts the value of a column which has a number accessor.
+ *
+ * @param urow The row
+ * @param value Set to the value
+ * @return false if the value isn't a number, ExtractValue() tells what it is
+ */
+bool Column::ExtractNumber(const Value& urow, double *value) const
+{
+	if (!m_NumberAccessor)
+		return false;
+
+	if (m_ObjectAccessor)
+		return m_NumberAccessor(m_ObjectAccessor(urow, LivestatusGroupByNone, Empty), value);
+
+	return m_NumberAccessor(urow, value);
+}
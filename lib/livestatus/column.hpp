@@ -23,13 +23,20 @@ public:
 	typedef std::function<Value (const Value&)> ValueAccessor;
 	typedef std::function<Value (const Value&, LivestatusGroupByType, const Object::Ptr&)> ObjectAccessor;
 
-	Column(ValueAccessor valueAccessor, ObjectAccessor objectAccessor);
+	/* Returns false if the value isn't a number for the row. */
+	typedef bool (*NumberAccessor)(const Value&, double *);
+
+	Column(ValueAccessor valueAccessor, ObjectAccessor objectAccessor, NumberAccessor numberAccessor = nullptr);
 
 	Value ExtractValue(const Value& urow, LivestatusGroupByType groupByType = LivestatusGroupByNone, const Object::Ptr& groupByObject = Empty) const;
 
+	bool HasNumberAccessor() const;
+	bool ExtractNumber(const Value& urow, double *value) const;
+
 private:
 	ValueAccessor m_ValueAccessor;
 	ObjectAccessor m_ObjectAccessor;
+	NumberAccessor m_NumberAccessor;
 };
 
 }
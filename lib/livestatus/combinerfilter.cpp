@@ -8,3 +8,10 @@ void CombinerFilter::AddSubFilter(const Filter::Ptr& filter)
 {
 	m_Filters.push_back(filter);
 }
+
+void CombinerFilter::Prepare(const Table::Ptr& table)
+{
+	for (const Filter::Ptr& filter : m_Filters) {
+		filter->Prepare(table);
+	}
+}
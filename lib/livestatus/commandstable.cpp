@@ -89,7 +89,7 @@ Value CommandsTable::CustomVariableNamesAccessor(const Value& row)
 	if (vars) {
 		ObjectLock xlock(vars);
 		for (const auto& kv : vars) {
-			keys.push_back(kv.first);
+			keys.push_back(kv.first.GetString());
 		}
 	}
 
@@ -132,7 +132,7 @@ Value CommandsTable::CustomVariablesAccessor(const Value& row)
 		ObjectLock xlock(vars);
 		for (const auto& kv : vars) {
 			result.push_back(new Array({
-				kv.first,
+				kv.first.GetString(),
 				kv.second
 			}));
 		}
@@ -192,7 +192,7 @@ Value ContactsTable::CustomVariableNamesAccessor(const Value& row)
 	if (vars) {
 		ObjectLock olock(vars);
 		for (const Dictionary::Pair& kv : vars) {
-			result.push_back(kv.first);
+			result.push_back(kv.first.GetString());
 		}
 	}
 
@@ -245,7 +245,7 @@ Value ContactsTable::CustomVariablesAccessor(const Value& row)
 				val = kv.second;
 
 			result.push_back(new Array({
-				kv.first,
+				kv.first.GetString(),
 				val
 			}));
 		}
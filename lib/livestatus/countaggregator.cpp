@@ -1,6 +1,7 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "livestatus/countaggregator.hpp"
+#include "livestatus/statsindex.hpp"
 
 using namespace icinga;
 
@@ -20,6 +21,21 @@ void CountAggregator::Apply(const Table::Ptr& table, const Value& row, Aggregato
 		pstate->Count++;
 }
 
+bool CountAggregator::ApplyStatsClass(const Table::Ptr& table, const LivestatusStatsClass& cls, size_t count, AggregatorState **state)
+{
+	bool match;
+
+	if (!GetFilter()->ApplyStatsClass(table, cls, &match))
+		return false;
+
+	CountAggregatorState *pstate = EnsureState(state);
+
+	if (match)
+		pstate->Count += count;
+
+	return true;
+}
+
 double CountAggregator::GetResultAndFreeState(AggregatorState *state) const
 {
 	CountAggregatorState *pstate = EnsureState(&state);
@@ -26,6 +26,7 @@ public:
 	DECLARE_PTR_TYPEDEFS(CountAggregator);
 
 	void Apply(const Table::Ptr& table, const Value& row, AggregatorState **) override;
+	bool ApplyStatsClass(const Table::Ptr& table, const LivestatusStatsClass& cls, size_t count, AggregatorState **state) override;
 	double GetResultAndFreeState(AggregatorState *state) const override;
 
 private:
@@ -9,6 +9,8 @@
 namespace icinga
 {
 
+struct LivestatusStatsClass;
+
 /**
  * @ingroup livestatus
  */
@@ -19,6 +21,36 @@ public:
 
 	virtual bool Apply(const Table::Ptr& table, const Value& row) = 0;
 
+	/**
+	 * Adds the conditions which every row matching the filter fulfills.
+	 *
+	 * @param lookups Receives the conditions
+	 */
+	virtual void GetIndexLookups(std::vector<LivestatusIndexLookup>&) const
+	{ }
+
+	/**
+	 * Resolves what doesn't depend on the rows, so that Apply() may be called
+	 * by several threads afterwards.
+	 *
+	 * @param table The table the filter is applied to
+	 */
+	virtual void Prepare(const Table::Ptr&)
+	{ }
+
+	/**
+	 * Evaluates the filter for the rows the stats index counts together.
+	 *
+	 * @param table The table the filter is applied to
+	 * @param cls The values of the counted columns
+	 * @param result Set to whether the rows match
+	 * @return false if the filter refers to anything else
+	 */
+	virtual bool ApplyStatsClass(const Table::Ptr&, const LivestatusStatsClass&, bool *) const
+	{
+		return false;
+	}
+
 protected:
 	Filter() = default;
 };
@@ -144,6 +144,7 @@ void HostsTable::AddColumns(Table *table, const String& prefix,
 	table->AddColumn(prefix + "services_with_state", Column(&HostsTable::ServicesWithStateAccessor, objectAccessor));
 	table->AddColumn(prefix + "services_with_info", Column(&HostsTable::ServicesWithInfoAccessor, objectAccessor));
 	table->AddColumn(prefix + "check_source", Column(&HostsTable::CheckSourceAccessor, objectAccessor));
+	table->AddColumn(prefix + "recent_check_results", Column(&HostsTable::RecentCheckResultsAccessor, objectAccessor));
 	table->AddColumn(prefix + "is_reachable", Column(&HostsTable::IsReachableAccessor, objectAccessor));
 	table->AddColumn(prefix + "cv_is_json", Column(&HostsTable::CVIsJsonAccessor, objectAccessor));
 	table->AddColumn(prefix + "original_attributes", Column(&HostsTable::OriginalAttributesAccessor, objectAccessor));
@@ -180,13 +181,49 @@ void HostsTable::FetchRows(const AddRowFunction& addRowFn)
 			}
 		}
 	} else {
-		for (const Host::Ptr& host : ConfigType::GetObjectsByType<Host>()) {
+		for (Host *host : ConfigType::GetObjectsViewByType<Host>()) {
 			if (!addRowFn(host, LivestatusGroupByNone, Empty))
 				return;
 		}
 	}
 }
 
+/**
+ * Looks up a host or the members of a group instead of scanning all hosts.
+ */
+bool HostsTable::FetchIndexedRows(const std::vector<LivestatusIndexLookup>& lookups, const AddRowFunction& addRowFn)
+{
+	/* The grouped table returns a host once per group. */
+	if (GetGroupByType() != LivestatusGroupByNone)
+		return false;
+
+	for (const LivestatusIndexLookup& lookup : lookups) {
+		String column = GetColumnKey(lookup.Column);
+
+		if (column == "name" && lookup.Operator == "=") {
+			Host::Ptr host = Host::GetByName(lookup.Operand);
+
+			if (host)
+				addRowFn(host, LivestatusGroupByNone, Empty);
+
+			return true;
+		} else if (column == "groups" && lookup.Operator == ">=") {
+			HostGroup::Ptr hg = HostGroup::GetByName(lookup.Operand);
+
+			if (hg) {
+				for (const Host::Ptr& host : hg->GetMembers()) {
+					if (!addRowFn(host, LivestatusGroupByNone, Empty))
+						break;
+				}
+			}
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
 Object::Ptr HostsTable::HostGroupAccessor(const Value& row, LivestatusGroupByType groupByType, const Object::Ptr& groupByObject)
 {
 	/* return the current group by value set from within FetchRows()
@@ -501,8 +538,7 @@ Value HostsTable::AcknowledgementTypeAccessor(const Value& row)
 	if (!host)
 		return Empty;
 
-	ObjectLock olock(host);
-	return host->GetAcknowledgement();
+	return host->GetStateRecord()->GetAcknowledgement();
 }
 
 Value HostsTable::CheckTypeAccessor(const Value& row)
@@ -652,8 +688,7 @@ Value HostsTable::AcknowledgedAccessor(const Value& row)
 	if (!host)
 		return Empty;
 
-	ObjectLock olock(host);
-	return host->IsAcknowledged();
+	return host->GetStateRecord()->GetAcknowledgement() != AcknowledgementNone;
 }
 
 Value HostsTable::StateAccessor(const Value& row)
@@ -1028,7 +1063,7 @@ Value HostsTable::CustomVariableNamesAccessor(const Value& row)
 	if (vars) {
 		ObjectLock olock(vars);
 		for (const Dictionary::Pair& kv : vars) {
-			result.push_back(kv.first);
+			result.push_back(kv.first.GetString());
 		}
 	}
 
@@ -1081,7 +1116,7 @@ Value HostsTable::CustomVariablesAccessor(const Value& row)
 				val = kv.second;
 
 			result.push_back(new Array({
-				kv.first,
+				kv.first.GetString(),
 				val
 			}));
 		}
@@ -1501,6 +1536,29 @@ Value HostsTable::CheckSourceAccessor(const Value& row)
 	return Empty;
 }
 
+Value HostsTable::RecentCheckResultsAccessor(const Value& row)
+{
+	Host::Ptr host = static_cast<Host::Ptr>(row);
+
+	if (!host)
+		return Empty;
+
+	Array::Ptr history = host->GetRecentCheckResults();
+	ArrayData result;
+
+	ObjectLock olock(history);
+	for (Dictionary::Ptr entry : history) {
+		result.push_back(new Array({
+			entry->Get("execution_end"),
+			entry->Get("state"),
+			entry->Get("execution_time"),
+			entry->Get("latency")
+		}));
+	}
+
+	return new Array(std::move(result));
+}
+
 Value HostsTable::IsReachableAccessor(const Value& row)
 {
 	Host::Ptr host = static_cast<Host::Ptr>(row);
@@ -28,6 +28,7 @@ public:
 
 protected:
 	void FetchRows(const AddRowFunction& addRowFn) override;
+	bool FetchIndexedRows(const std::vector<LivestatusIndexLookup>& lookups, const AddRowFunction& addRowFn) override;
 
 	static Object::Ptr HostGroupAccessor(const Value& row, LivestatusGroupByType groupByType, const Object::Ptr& groupByObject);
 
@@ -123,6 +124,7 @@ protected:
 	static Value ServicesWithStateAccessor(const Value& row);
 	static Value ServicesWithInfoAccessor(const Value& row);
 	static Value CheckSourceAccessor(const Value& row);
+	static Value RecentCheckResultsAccessor(const Value& row);
 	static Value IsReachableAccessor(const Value& row);
 	static Value CVIsJsonAccessor(const Value& row);
 	static Value OriginalAttributesAccessor(const Value& row);
@@ -8,13 +8,20 @@
 #include "base/configtype.hpp"
 #include "base/logger.hpp"
 #include "base/exception.hpp"
-#include "base/tcpsocket.hpp"
-#include "base/unixsocket.hpp"
-#include "base/networkstream.hpp"
 #include "base/application.hpp"
+#include "base/defer.hpp"
+#include "base/fifo.hpp"
 #include "base/function.hpp"
+#include "base/io-engine.hpp"
 #include "base/statsfunction.hpp"
 #include "base/convert.hpp"
+#include <boost/asio/post.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/streambuf.hpp>
+#include <boost/asio/write.hpp>
+#include <istream>
+#include <string>
+#include <sys/stat.h>
 
 using namespace icinga;
 
@@ -46,36 +53,74 @@ void LivestatusListener::StatsFunc(const Dictionary::Ptr& status, const Array::P
  */
 void LivestatusListener::Start(bool runtimeCreated)
 {
+	namespace asio = boost::asio;
+
 	ObjectImpl<LivestatusListener>::Start(runtimeCreated);
 
 	Log(LogInformation, "LivestatusListener")
 		<< "'" << GetName() << "' started.";
 
+	auto& io (IoEngine::Get().GetIoContext());
+
 	if (GetSocketType() == "tcp") {
-		TcpSocket::Ptr socket = new TcpSocket();
+		using asio::ip::tcp;
+
+		auto acceptor (Shared<tcp::acceptor>::Make(io));
 
 		try {
-			socket->Bind(GetBindHost(), GetBindPort(), AF_UNSPEC);
-		} catch (std::exception&) {
+			tcp::resolver resolver (io);
+			tcp::resolver::query query (GetBindHost(), GetBindPort(), tcp::resolver::query::passive);
+
+			auto result (resolver.resolve(query));
+			auto current (result.begin());
+
+			for (;;) {
+				try {
+					acceptor->open(current->endpoint().protocol());
+					acceptor->set_option(tcp::acceptor::reuse_address(true));
+					acceptor->bind(current->endpoint());
+
+					break;
+				} catch (const std::exception&) {
+					if (++current == result.end()) {
+						throw;
+					}
+
+					if (acceptor->is_open()) {
+						acceptor->close();
+					}
+				}
+			}
+
+			acceptor->listen(SOMAXCONN);
+		} catch (const std::exception&) {
 			Log(LogCritical, "LivestatusListener")
 				<< "Cannot bind TCP socket on host '" << GetBindHost() << "' port '" << GetBindPort() << "'.";
 			return;
 		}
 
-		m_Listener = socket;
+		m_TcpAcceptor = acceptor;
 
-		m_Thread = std::thread([this]() { ServerThreadProc(); });
+		IoEngine::SpawnCoroutine(io, [this, acceptor](asio::yield_context yc) {
+			ListenerCoroutineProc<tcp::acceptor>(yc, acceptor);
+		});
 
 		Log(LogInformation, "LivestatusListener")
 			<< "Created TCP socket listening on host '" << GetBindHost() << "' port '" << GetBindPort() << "'.";
 	}
 	else if (GetSocketType() == "unix") {
 #ifndef _WIN32
-		UnixSocket::Ptr socket = new UnixSocket();
+		using asio::local::stream_protocol;
+
+		auto acceptor (Shared<stream_protocol::acceptor>::Make(io));
 
 		try {
-			socket->Bind(GetSocketPath());
-		} catch (std::exception&) {
+			unlink(GetSocketPath().CStr());
+
+			acceptor->open();
+			acceptor->bind(stream_protocol::endpoint(GetSocketPath().CStr()));
+			acceptor->listen(SOMAXCONN);
+		} catch (const std::exception&) {
 			Log(LogCritical, "LivestatusListener")
 				<< "Cannot bind UNIX socket to '" << GetSocketPath() << "'.";
 			return;
@@ -90,9 +135,11 @@ void LivestatusListener::Start(bool runtimeCreated)
 			return;
 		}
 
-		m_Listener = socket;
+		m_UnixAcceptor = acceptor;
 
-		m_Thread = std::thread([this]() { ServerThreadProc(); });
+		IoEngine::SpawnCoroutine(io, [this, acceptor](asio::yield_context yc) {
+			ListenerCoroutineProc<stream_protocol::acceptor>(yc, acceptor);
+		});
 
 		Log(LogInformation, "LivestatusListener")
 			<< "Created UNIX socket in '" << GetSocketPath() << "'.";
@@ -111,10 +158,27 @@ void LivestatusListener::Stop(bool runtimeRemoved)
 	Log(LogInformation, "LivestatusListener")
 		<< "'" << GetName() << "' stopped.";
 
-	m_Listener->Close();
+	/* The acceptors are only used by their coroutines, so close them there, too. */
+	auto& io (IoEngine::Get().GetIoContext());
+	auto tcpAcceptor (std::move(m_TcpAcceptor));
+
+	if (tcpAcceptor) {
+		boost::asio::post(io, [tcpAcceptor]() {
+			boost::system::error_code ec;
+			tcpAcceptor->close(ec);
+		});
+	}
+
+#ifndef _WIN32
+	auto unixAcceptor (std::move(m_UnixAcceptor));
 
-	if (m_Thread.joinable())
-		m_Thread.join();
+	if (unixAcceptor) {
+		boost::asio::post(io, [unixAcceptor]() {
+			boost::system::error_code ec;
+			unixAcceptor->close(ec);
+		});
+	}
+#endif /* _WIN32 */
 }
 
 int LivestatusListener::GetClientsConnected()
@@ -131,77 +195,122 @@ int LivestatusListener::GetConnections()
 	return l_Connections;
 }
 
-void LivestatusListener::ServerThreadProc()
+template<class Acceptor>
+void LivestatusListener::ListenerCoroutineProc(boost::asio::yield_context yc, const typename Shared<Acceptor>::Ptr& acceptor)
 {
-	m_Listener->Listen();
+	namespace asio = boost::asio;
 
-	try {
-		for (;;) {
-			timeval tv = { 0, 500000 };
+	typedef typename Acceptor::protocol_type::socket Socket;
 
-			if (m_Listener->Poll(true, false, &tv)) {
-				Socket::Ptr client = m_Listener->Accept();
-				Log(LogNotice, "LivestatusListener", "Client connected");
-				Utility::QueueAsyncCallback([this, client]() { ClientHandler(client); }, LowLatencyScheduler);
-			}
+	for (;;) {
+		/* With NUMA-aware I/O each client stays on one node. */
+		auto& io (IoEngine::Get().GetNextIoContext());
+		boost::system::error_code ec;
+		auto client (Shared<Socket>::Make(io));
+
+		acceptor->async_accept(*client, yc[ec]);
 
-			if (!IsActive())
+		if (ec) {
+			if (ec == asio::error::operation_aborted || !acceptor->is_open())
 				break;
+
+			Log(LogCritical, "LivestatusListener")
+				<< "Cannot accept new connection: " << ec.message();
+			continue;
 		}
-	} catch (std::exception&) {
-		Log(LogCritical, "LivestatusListener", "Cannot accept new connection.");
-	}
 
-	m_Listener->Close();
+		Log(LogNotice, "LivestatusListener", "Client connected");
+
+		/* Clients wait for their next query while being connected, which mustn't block any thread. */
+		auto strand (Shared<asio::io_context::strand>::Make(io));
+		LivestatusListener::Ptr keepAlive (this);
+
+		IoEngine::SpawnCoroutine(*strand, [keepAlive, strand, client](asio::yield_context yc) {
+			keepAlive->ClientHandler<Socket>(yc, client);
+		});
+	}
 }
 
-void LivestatusListener::ClientHandler(const Socket::Ptr& client)
+template<class Socket>
+void LivestatusListener::ClientHandler(boost::asio::yield_context yc, const typename Shared<Socket>::Ptr& client)
 {
+	namespace asio = boost::asio;
+
 	{
 		std::unique_lock<std::mutex> lock(l_ComponentMutex);
 		l_ClientsConnected++;
 		l_Connections++;
 	}
 
-	Stream::Ptr stream = new NetworkStream(client);
+	Defer disconnected ([client]() {
+		boost::system::error_code ec;
+		client->close(ec);
 
-	StreamReadContext context;
-
-	for (;;) {
-		String line;
+		std::unique_lock<std::mutex> lock(l_ComponentMutex);
+		l_ClientsConnected--;
+	});
 
-		std::vector<String> lines;
+	asio::streambuf buf;
 
+	try {
 		for (;;) {
-			StreamReadStatus srs = stream->ReadLine(&line, context);
+			std::vector<String> lines;
+			bool eof = false;
 
-			if (srs == StatusEof)
-				break;
+			for (;;) {
+				boost::system::error_code ec;
+				asio::async_read_until(*client, buf, '\n', yc[ec]);
 
-			if (srs != StatusNewItem)
-				continue;
+				std::istream is (&buf);
+				std::string line;
 
-			if (line.GetLength() > 0)
-				lines.push_back(line);
-			else
+				/* Handles a final line without trailing newline, too. */
+				if (!std::getline(is, line)) {
+					eof = true;
+					break;
+				}
+
+				if (line.empty())
+					break;
+
+				lines.emplace_back(std::move(line));
+
+				if (ec) {
+					eof = true;
+					break;
+				}
+			}
+
+			if (lines.empty())
 				break;
-		}
 
-		if (lines.empty())
-			break;
+			/* The response has to be complete before we may write it (fixed16 headers state its length). */
+			FIFO::Ptr response = new FIFO();
+			bool keepAlive;
 
-		LivestatusQuery::Ptr query = new LivestatusQuery(lines, GetCompatLogPath());
-		if (!query->Execute(stream))
-			break;
-	}
+			{
+				CpuBoundWork handlingQuery (yc, CpuBoundWorkApiRead);
 
-	{
-		std::unique_lock<std::mutex> lock(l_ComponentMutex);
-		l_ClientsConnected--;
+				LivestatusQuery::Ptr query = new LivestatusQuery(lines, GetCompatLogPath());
+				keepAlive = query->Execute(response);
+			}
+
+			std::string data (response->GetAvailableBytes(), '\0');
+
+			if (!data.empty()) {
+				response->Read(&data[0], data.size(), true);
+				asio::async_write(*client, asio::buffer(data), yc);
+			}
+
+			if (!keepAlive || eof)
+				break;
+		}
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "LivestatusListener")
+			<< "Error while handling client: " << DiagnosticInformation(ex, false);
 	}
 }
 
-
 void LivestatusListener::ValidateSocketType(const Lazy<String>& lvalue, const ValidationUtils& utils)
 {
 	ObjectImpl<LivestatusListener>::ValidateSocketType(lvalue, utils);
@@ -0,0 +1,234 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "livestatus/livestatuslogindex.hpp"
+#include "livestatus/livestatuslogutility.hpp"
+#include "base/logger.hpp"
+#include <boost/crc.hpp>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+
+using namespace icinga;
+
+static const char l_IndexMagic[8] = { 'I', '2', 'L', 'S', 'I', 'D', 'X', '1' };
+
+/* The magic, the first bytes of the log file, the indexed size, the number of records and the next line number. */
+static const size_t l_HeaderSize = 40;
+static const size_t l_LogStartSize = 12;
+static const size_t l_RecordSize = 32;
+
+/* Serializes the updates of the index files. */
+static std::mutex l_IndexMutex;
+
+static void EncodeUInt32(char *buf, uint_least32_t value)
+{
+	for (int i = 0; i < 4; i++) {
+		buf[i] = static_cast<char>((value >> (i * 8)) & 0xffu);
+	}
+}
+
+static uint_least32_t DecodeUInt32(const char *buf)
+{
+	uint_least32_t value = 0;
+
+	for (int i = 0; i < 4; i++) {
+		value |= static_cast<uint_least32_t>(static_cast<unsigned char>(buf[i])) << (i * 8);
+	}
+
+	return value;
+}
+
+static void EncodeUInt64(char *buf, uint_fast64_t value)
+{
+	EncodeUInt32(buf, value & 0xffffffffu);
+	EncodeUInt32(buf + 4, value >> 32u);
+}
+
+static uint_fast64_t DecodeUInt64(const char *buf)
+{
+	return DecodeUInt32(buf) | (static_cast<uint_fast64_t>(DecodeUInt32(buf + 4)) << 32u);
+}
+
+bool LivestatusLogFilter::IsEmpty() const
+{
+	return HostName.IsEmpty() && ServiceDescription.IsEmpty() && Class == -1 &&
+		From == 0 && Until == std::numeric_limits<time_t>::max();
+}
+
+/**
+ * Tells whether a line may match. Different names can have the same hash,
+ * so the line still has to be checked.
+ *
+ * @param record The line's index record
+ */
+bool LivestatusLogFilter::Matches(const LivestatusLogRecord& record) const
+{
+	if (record.Time < From || record.Time > Until)
+		return false;
+
+	if (Class != -1 && record.Class != Class)
+		return false;
+
+	if (!HostName.IsEmpty() && record.HostHash != LivestatusLogIndex::HashName(HostName))
+		return false;
+
+	if (!ServiceDescription.IsEmpty() && record.ServiceHash != LivestatusLogIndex::HashName(ServiceDescription))
+		return false;
+
+	return true;
+}
+
+uint_least32_t LivestatusLogIndex::HashName(const String& name)
+{
+	boost::crc_32_type crc;
+	crc.process_bytes(name.CStr(), name.GetLength());
+	return crc.checksum();
+}
+
+/**
+ * Returns the index records of a log file, indexing the lines which
+ * haven't been indexed yet.
+ *
+ * @param path The log file
+ * @return The records in the order of the lines
+ */
+std::vector<LivestatusLogRecord> LivestatusLogIndex::GetRecords(const String& path)
+{
+	std::unique_lock<std::mutex> lock (l_IndexMutex);
+
+	std::vector<LivestatusLogRecord> records;
+
+	std::ifstream fp (path.CStr(), std::ifstream::binary | std::ifstream::ate);
+
+	if (!fp)
+		return records;
+
+	uint_fast64_t size = fp.tellg();
+	char logStart[l_LogStartSize] = {};
+
+	fp.seekg(0);
+	fp.read(logStart, sizeof(logStart));
+	fp.clear();
+
+	String indexPath = path + ".idx";
+	uint_fast64_t indexedSize = 0;
+	uint_least32_t lineno = 0;
+	size_t oldCount = 0;
+
+	{
+		std::ifstream ifp (indexPath.CStr(), std::ifstream::binary);
+		char header[l_HeaderSize];
+
+		/* The log file has been rotated and replaced if it starts with different content or has shrunk. */
+		if (ifp.read(header, sizeof(header)) && memcmp(header, l_IndexMagic, sizeof(l_IndexMagic)) == 0 &&
+			memcmp(header + 8, logStart, sizeof(logStart)) == 0 && DecodeUInt64(header + 20) <= size) {
+			size_t count = DecodeUInt32(header + 28);
+			std::vector<char> data (count * l_RecordSize);
+
+			if (ifp.read(data.data(), data.size())) {
+				records.reserve(count);
+
+				for (size_t i = 0; i < count; i++) {
+					const char *buf = &data[i * l_RecordSize];
+
+					records.push_back({
+						static_cast<time_t>(DecodeUInt64(buf)),
+						DecodeUInt64(buf + 8),
+						DecodeUInt32(buf + 16),
+						DecodeUInt32(buf + 20),
+						DecodeUInt32(buf + 24),
+						static_cast<unsigned char>(buf[28])
+					});
+				}
+
+				indexedSize = DecodeUInt64(header + 20);
+				lineno = DecodeUInt32(header + 32);
+				oldCount = count;
+			}
+		}
+	}
+
+	if (indexedSize >= size)
+		return records;
+
+	fp.seekg(indexedSize);
+
+	for (;;) {
+		uint_fast64_t offset = fp.tellg();
+		std::string line;
+
+		/* A line without a newline is still being written. */
+		if (!std::getline(fp, line) || fp.eof())
+			break;
+
+		indexedSize = fp.tellg();
+
+		if (line.empty())
+			continue; /* Ignore empty lines */
+
+		Dictionary::Ptr attrs = LivestatusLogUtility::GetAttributes(line);
+
+		records.push_back({
+			static_cast<time_t>(static_cast<unsigned long>(attrs->Get("time"))),
+			offset,
+			lineno,
+			HashName(attrs->Get("host_name")),
+			HashName(attrs->Get("service_description")),
+			static_cast<int>(attrs->Get("class"))
+		});
+
+		lineno++;
+	}
+
+	if (records.size() == oldCount)
+		return records;
+
+	char header[l_HeaderSize];
+
+	memcpy(header, l_IndexMagic, sizeof(l_IndexMagic));
+	memcpy(header + 8, logStart, sizeof(logStart));
+	EncodeUInt64(header + 20, indexedSize);
+	EncodeUInt32(header + 28, records.size());
+	EncodeUInt32(header + 32, lineno);
+	EncodeUInt32(header + 36, 0);
+
+	/* Only the new records are appended. They don't count before the header has been updated. */
+	std::fstream ofp;
+
+	if (oldCount > 0u)
+		ofp.open(indexPath.CStr(), std::fstream::in | std::fstream::out | std::fstream::binary);
+
+	if (!ofp.is_open()) {
+		oldCount = 0;
+		ofp.open(indexPath.CStr(), std::fstream::in | std::fstream::out | std::fstream::binary | std::fstream::trunc);
+		ofp.write(header, sizeof(header));
+	}
+
+	ofp.seekp(l_HeaderSize + oldCount * l_RecordSize);
+
+	for (size_t i = oldCount; i < records.size(); i++) {
+		const LivestatusLogRecord& record = records[i];
+		char buf[l_RecordSize] = {};
+
+		EncodeUInt64(buf, record.Time);
+		EncodeUInt64(buf + 8, record.Offset);
+		EncodeUInt32(buf + 16, record.Lineno);
+		EncodeUInt32(buf + 20, record.HostHash);
+		EncodeUInt32(buf + 24, record.ServiceHash);
+		buf[28] = static_cast<char>(record.Class);
+
+		ofp.write(buf, sizeof(buf));
+	}
+
+	ofp.flush();
+	ofp.seekp(0);
+	ofp.write(header, sizeof(header));
+	ofp.flush();
+
+	if (!ofp) {
+		Log(LogNotice, "LivestatusLogIndex")
+			<< "Can't write index file '" << indexPath << "', the log file will be indexed again.";
+	}
+
+	return records;
+}
@@ -0,0 +1,68 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef LIVESTATUSLOGINDEX_H
+#define LIVESTATUSLOGINDEX_H
+
+#include "livestatus/i2-livestatus.hpp"
+#include "base/string.hpp"
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * The position and the keys of a line in a compat log file.
+ *
+ * @ingroup livestatus
+ */
+struct LivestatusLogRecord
+{
+	time_t Time;
+	uint_fast64_t Offset;
+	uint_least32_t Lineno;
+	uint_least32_t HostHash;
+	uint_least32_t ServiceHash;
+	int Class;
+};
+
+/**
+ * The keys of the log lines a query is interested in. Lines which don't
+ * match them can't be part of the result and aren't read at all.
+ *
+ * @ingroup livestatus
+ */
+struct LivestatusLogFilter
+{
+	String HostName;
+	String ServiceDescription;
+	int Class{-1};
+	time_t From{0};
+	time_t Until{std::numeric_limits<time_t>::max()};
+
+	bool IsEmpty() const;
+	bool Matches(const LivestatusLogRecord& record) const;
+};
+
+/**
+ * Keeps an index of each compat log file in a file next to it. The index is
+ * extended by the lines which have been appended since it was written,
+ * and rebuilt if the log file has been replaced.
+ *
+ * @ingroup livestatus
+ */
+class LivestatusLogIndex
+{
+public:
+	static std::vector<LivestatusLogRecord> GetRecords(const String& path);
+	static uint_least32_t HashName(const String& name);
+
+private:
+	LivestatusLogIndex();
+};
+
+}
+
+#endif /* LIVESTATUSLOGINDEX_H */
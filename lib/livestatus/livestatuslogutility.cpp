@@ -53,8 +53,18 @@ void LivestatusLogUtility::CreateLogIndexFileHandler(const String& path, std::ma
 	index[ts_start] = path;
 }
 
+/**
+ * Passes the lines of the log files in a time range to a table.
+ *
+ * @param index The log files by the timestamps of their first lines
+ * @param table The table
+ * @param from The start of the time range
+ * @param until The end of the time range
+ * @param addRowFn Passed to the table for each line
+ * @param filter Only the lines which match it are read, using the index of each log file
+ */
 void LivestatusLogUtility::CreateLogCache(std::map<time_t, String> index, HistoryTable *table,
-	time_t from, time_t until, const AddRowFunction& addRowFn)
+	time_t from, time_t until, const AddRowFunction& addRowFn, const LivestatusLogFilter& filter)
 {
 	ASSERT(table);
 
@@ -74,6 +84,26 @@ void LivestatusLogUtility::CreateLogCache(std::map<time_t, String> index, Histor
 		fp.exceptions(std::ifstream::badbit);
 		fp.open(log_file.CStr(), std::ifstream::in);
 
+		if (!filter.IsEmpty()) {
+			for (const LivestatusLogRecord& record : LivestatusLogIndex::GetRecords(log_file)) {
+				if (!filter.Matches(record))
+					continue;
+
+				std::string line;
+
+				fp.clear();
+				fp.seekg(record.Offset);
+				std::getline(fp, line);
+
+				table->UpdateLogEntries(LivestatusLogUtility::GetAttributes(line), line_count, record.Lineno, addRowFn);
+
+				line_count++;
+			}
+
+			fp.close();
+			continue;
+		}
+
 		while (fp.good()) {
 			std::string line;
 			std::getline(fp, line);
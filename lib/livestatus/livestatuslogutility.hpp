@@ -4,6 +4,7 @@
 #define LIVESTATUSLOGUTILITY_H
 
 #include "livestatus/historytable.hpp"
+#include "livestatus/livestatuslogindex.hpp"
 
 using namespace icinga;
 
@@ -48,7 +49,8 @@ class LivestatusLogUtility
 public:
 	static void CreateLogIndex(const String& path, std::map<time_t, String>& index);
 	static void CreateLogIndexFileHandler(const String& path, std::map<time_t, String>& index);
-	static void CreateLogCache(std::map<time_t, String> index, HistoryTable *table, time_t from, time_t until, const AddRowFunction& addRowFn);
+	static void CreateLogCache(std::map<time_t, String> index, HistoryTable *table, time_t from, time_t until, const AddRowFunction& addRowFn,
+		const LivestatusLogFilter& filter = LivestatusLogFilter());
 	static Dictionary::Ptr GetAttributes(const String& text);
 
 private:
@@ -13,6 +13,7 @@
 #include "livestatus/negatefilter.hpp"
 #include "livestatus/orfilter.hpp"
 #include "livestatus/andfilter.hpp"
+#include "livestatus/statsindex.hpp"
 #include "icinga/externalcommandprocessor.hpp"
 #include "base/debug.hpp"
 #include "base/convert.hpp"
@@ -26,6 +27,11 @@
 #include "base/initialize.hpp"
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/join.hpp>
+#include <cstring>
+
+#ifdef HAVE_ZLIB
+#	include <zlib.h>
+#endif /* HAVE_ZLIB */
 
 using namespace icinga;
 
@@ -101,6 +107,20 @@ LivestatusQuery::LivestatusQuery(const std::vector<String>& lines, const String&
 			m_OutputFormat = params;
 		else if (header == "KeepAlive")
 			m_KeepAlive = (params == "on");
+		else if (header == "OutputCompression") {
+#ifdef HAVE_ZLIB
+			if (params != "gzip") {
+#endif /* HAVE_ZLIB */
+				m_Verb = "ERROR";
+				m_ErrorCode = LivestatusErrorQuery;
+				m_ErrorMessage = "Unsupported output compression: " + params;
+				return;
+#ifdef HAVE_ZLIB
+			}
+
+			m_OutputCompression = params;
+#endif /* HAVE_ZLIB */
+		}
 		else if (header == "Columns") {
 			m_ColumnHeaders = false; // Might be explicitly re-enabled later on
 			m_Columns = params.Split(" ");
@@ -352,12 +372,11 @@ void LivestatusQuery::EndResultSet(std::ostream& fp) const
 		fp << "]";
 }
 
-void LivestatusQuery::AppendResultRow(std::ostream& fp, const Array::Ptr& row, bool& first_row) const
+void LivestatusQuery::AppendResultRow(std::ostream& fp, const std::vector<Value>& row, bool& first_row) const
 {
 	if (m_OutputFormat == "csv") {
 		bool first = true;
 
-		ObjectLock rlock(row);
 		for (const Value& value : row) {
 			if (first)
 				first = false;
@@ -375,7 +394,17 @@ void LivestatusQuery::AppendResultRow(std::ostream& fp, const Array::Ptr& row, b
 		if (!first_row)
 			fp << ", ";
 
-		fp << JsonEncode(row);
+		JsonStreamEncoder encoder;
+
+		encoder.StartArray();
+
+		for (const Value& value : row) {
+			encoder.Encode(value);
+		}
+
+		encoder.EndArray();
+
+		fp << encoder.TakeResult();
 	} else if (m_OutputFormat == "python") {
 		if (!first_row)
 			fp << ", ";
@@ -406,7 +435,8 @@ void LivestatusQuery::PrintCsvArray(std::ostream& fp, const Array::Ptr& array, i
 	}
 }
 
-void LivestatusQuery::PrintPythonArray(std::ostream& fp, const Array::Ptr& rs) const
+template<class Container>
+void LivestatusQuery::PrintPythonArray(std::ostream& fp, const Container& rs) const
 {
 	fp << "[ ";
 
@@ -419,7 +449,7 @@ void LivestatusQuery::PrintPythonArray(std::ostream& fp, const Array::Ptr& rs) c
 			fp << ", ";
 
 		if (value.IsObjectType<Array>())
-			PrintPythonArray(fp, value);
+			PrintPythonArray(fp, Array::Ptr(value));
 		else if (value.IsNumber())
 			fp << value;
 		else
@@ -448,7 +478,16 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 		return;
 	}
 
-	std::vector<LivestatusRowValue> objects = table->FilterRows(m_Filter, m_Limit);
+	/* Counting rows doesn't need the rows if the stats index has counted them already. */
+	std::vector<AggregatorState *> indexedStats;
+	bool indexed = !m_Aggregators.empty() && m_Columns.empty() && m_Limit == -1
+		&& LivestatusStatsIndex::Aggregate(table, m_Filter, m_Aggregators, indexedStats);
+
+	std::vector<LivestatusRowValue> objects;
+
+	if (!indexed)
+		objects = table->FilterRows(m_Filter, m_Limit);
+
 	std::vector<String> columns;
 
 	if (m_Columns.size() > 0)
@@ -458,6 +497,20 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 
 	std::ostringstream result;
 	bool first_row = true;
+
+	/* Without a length header nor compression the rows can be sent as they are produced. */
+	bool streaming = m_ResponseHeader != "fixed16" && m_OutputCompression.IsEmpty();
+
+	auto appendRow ([this, &stream, &result, &first_row, streaming](const std::vector<Value>& row) {
+		AppendResultRow(result, row, first_row);
+
+		if (streaming && result.tellp() >= 64 * 1024) {
+			std::string chunk = result.str();
+			stream->Write(chunk.c_str(), chunk.size());
+			result.str(std::string());
+		}
+	});
+
 	BeginResultSet(result);
 
 	if (m_Aggregators.empty()) {
@@ -469,30 +522,33 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 		for (const String& columnName : columns)
 			column_objs.emplace_back(columnName, table->GetColumn(columnName));
 
-		ArrayData header;
+		/* One row buffer for all rows, the values go straight into the output. */
+		std::vector<Value> row;
 
-		for (const LivestatusRowValue& object : objects) {
-			ArrayData row;
-
-			row.reserve(column_objs.size());
-
-			for (const ColumnPair& cv : column_objs) {
-				if (m_ColumnHeaders)
-					header.push_back(cv.first);
-
-				row.push_back(cv.second.ExtractValue(object.Row, object.GroupByType, object.GroupByObject));
-			}
+		row.reserve(column_objs.size());
 
+		for (const LivestatusRowValue& object : objects) {
 			if (m_ColumnHeaders) {
-				AppendResultRow(result, new Array(std::move(header)), first_row);
+				for (const ColumnPair& cv : column_objs)
+					row.emplace_back(cv.first);
+
+				appendRow(row);
+				row.clear();
 				m_ColumnHeaders = false;
 			}
 
-			AppendResultRow(result, new Array(std::move(row)), first_row);
+			for (const ColumnPair& cv : column_objs)
+				row.emplace_back(cv.second.ExtractValue(object.Row, object.GroupByType, object.GroupByObject));
+
+			appendRow(row);
+			row.clear();
 		}
 	} else {
 		std::map<std::vector<Value>, std::vector<AggregatorState *> > allStats;
 
+		if (!indexedStats.empty())
+			allStats.emplace(std::vector<Value>(), std::move(indexedStats));
+
 		/* add aggregated stats */
 		for (const LivestatusRowValue& object : objects) {
 			std::vector<Value> statsKey;
@@ -521,7 +577,7 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 
 		/* add column headers both for raw and aggregated data */
 		if (m_ColumnHeaders) {
-			ArrayData header;
+			std::vector<Value> header;
 
 			for (const String& columnName : m_Columns) {
 				header.push_back(columnName);
@@ -531,13 +587,14 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 				header.push_back("stats_" + Convert::ToString(i));
 			}
 
-			AppendResultRow(result, new Array(std::move(header)), first_row);
+			appendRow(header);
 		}
 
-		for (const auto& kv : allStats) {
-			ArrayData row;
+		std::vector<Value> row;
 
-			row.reserve(m_Columns.size() + m_Aggregators.size());
+		row.reserve(m_Columns.size() + m_Aggregators.size());
+
+		for (const auto& kv : allStats) {
 
 			for (const Value& keyPart : kv.first) {
 				row.push_back(keyPart);
@@ -548,20 +605,17 @@ void LivestatusQuery::ExecuteGetHelper(const Stream::Ptr& stream)
 			for (size_t i = 0; i < m_Aggregators.size(); i++)
 				row.push_back(m_Aggregators[i]->GetResultAndFreeState(stats[i]));
 
-			AppendResultRow(result, new Array(std::move(row)), first_row);
+			appendRow(row);
+			row.clear();
 		}
 
 		/* add a bogus zero value if aggregated is empty*/
 		if (allStats.empty()) {
-			ArrayData row;
-
-			row.reserve(m_Aggregators.size());
-
 			for (size_t i = 1; i <= m_Aggregators.size(); i++) {
 				row.push_back(0);
 			}
 
-			AppendResultRow(result, new Array(std::move(row)), first_row);
+			appendRow(row);
 		}
 	}
 
@@ -591,8 +645,59 @@ void LivestatusQuery::ExecuteErrorHelper(const Stream::Ptr& stream)
 	SendResponse(stream, m_ErrorCode, m_ErrorMessage);
 }
 
+#ifdef HAVE_ZLIB
+/**
+ * Compresses a response body for "OutputCompression: gzip".
+ */
+static String GzipCompress(const String& data)
+{
+	z_stream zs;
+
+	memset(&zs, 0, sizeof(zs));
+
+	/* 15 window bits plus 16 for a gzip header and trailer */
+	if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		BOOST_THROW_EXCEPTION(std::runtime_error("deflateInit2() failed."));
+
+	std::string compressed (deflateBound(&zs, data.GetLength()), '\0');
+
+	zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.CStr()));
+	zs.avail_in = data.GetLength();
+	zs.next_out = reinterpret_cast<Bytef*>(&compressed[0]);
+	zs.avail_out = compressed.size();
+
+	int rc = deflate(&zs, Z_FINISH);
+
+	compressed.resize(zs.total_out);
+	deflateEnd(&zs);
+
+	if (rc != Z_STREAM_END)
+		BOOST_THROW_EXCEPTION(std::runtime_error("deflate() failed."));
+
+	return std::move(compressed);
+}
+#endif /* HAVE_ZLIB */
+
 void LivestatusQuery::SendResponse(const Stream::Ptr& stream, int code, const String& data)
 {
+#ifdef HAVE_ZLIB
+	/* Errors stay readable, only results are compressed. */
+	if (m_OutputCompression == "gzip" && code == LivestatusErrorOK) {
+		String compressed = GzipCompress(data);
+
+		if (m_ResponseHeader == "fixed16")
+			PrintFixed16(stream, code, compressed);
+
+		try {
+			stream->Write(compressed.CStr(), compressed.GetLength());
+		} catch (const std::exception&) {
+			Log(LogCritical, "LivestatusQuery", "Cannot write query response to socket.");
+		}
+
+		return;
+	}
+#endif /* HAVE_ZLIB */
+
 	if (m_ResponseHeader == "fixed16")
 		PrintFixed16(stream, code, data);
 
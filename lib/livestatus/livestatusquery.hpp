@@ -55,6 +55,7 @@ private:
 	int m_Limit;
 
 	String m_ResponseHeader;
+	String m_OutputCompression;
 
 	/* Parameters for COMMAND/SCRIPT queries. */
 	String m_Command;
@@ -70,9 +71,12 @@ private:
 
 	void BeginResultSet(std::ostream& fp) const;
 	void EndResultSet(std::ostream& fp) const;
-	void AppendResultRow(std::ostream& fp, const Array::Ptr& row, bool& first_row) const;
+	void AppendResultRow(std::ostream& fp, const std::vector<Value>& row, bool& first_row) const;
 	void PrintCsvArray(std::ostream& fp, const Array::Ptr& array, int level) const;
-	void PrintPythonArray(std::ostream& fp, const Array::Ptr& array) const;
+
+	template<class Container>
+	void PrintPythonArray(std::ostream& fp, const Container& array) const;
+
 	static String QuoteStringPython(const String& str);
 
 	void ExecuteGetHelper(const Stream::Ptr& stream);
@@ -22,6 +22,8 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <algorithm>
+#include <cmath>
 #include <fstream>
 
 using namespace icinga;
@@ -91,6 +93,50 @@ void LogTable::FetchRows(const AddRowFunction& addRowFn)
 	LivestatusLogUtility::CreateLogCache(m_LogFileIndex, this, m_TimeFrom, m_TimeUntil, addRowFn);
 }
 
+/**
+ * Reads only the log lines of a host, service, class or time range.
+ */
+bool LogTable::FetchIndexedRows(const std::vector<LivestatusIndexLookup>& lookups, const AddRowFunction& addRowFn)
+{
+	LivestatusLogFilter filter;
+
+	for (const LivestatusIndexLookup& lookup : lookups) {
+		String column = GetColumnKey(lookup.Column);
+
+		try {
+			if (column == "host_name" && lookup.Operator == "=")
+				filter.HostName = lookup.Operand;
+			else if (column == "service_description" && lookup.Operator == "=")
+				filter.ServiceDescription = lookup.Operand;
+			else if (column == "class" && lookup.Operator == "=")
+				filter.Class = Convert::ToLong(Convert::ToDouble(lookup.Operand));
+			else if (column == "time") {
+				double operand = Convert::ToDouble(lookup.Operand);
+
+				if (lookup.Operator == ">=" || lookup.Operator == "=")
+					filter.From = std::max(filter.From, static_cast<time_t>(std::ceil(operand)));
+				else if (lookup.Operator == ">")
+					filter.From = std::max(filter.From, static_cast<time_t>(std::floor(operand)) + 1);
+
+				if (lookup.Operator == "<=" || lookup.Operator == "=")
+					filter.Until = std::min(filter.Until, static_cast<time_t>(std::floor(operand)));
+				else if (lookup.Operator == "<")
+					filter.Until = std::min(filter.Until, static_cast<time_t>(std::ceil(operand)) - 1);
+			}
+		} catch (const std::exception&) {
+			/* The filter reports invalid operands. */
+		}
+	}
+
+	if (filter.IsEmpty())
+		return false;
+
+	LivestatusLogUtility::CreateLogIndex(m_CompatLogPath, m_LogFileIndex);
+	LivestatusLogUtility::CreateLogCache(m_LogFileIndex, this, m_TimeFrom, m_TimeUntil, addRowFn, filter);
+
+	return true;
+}
+
 /* gets called in LivestatusLogUtility::CreateLogCache */
 void LogTable::UpdateLogEntries(const Dictionary::Ptr& log_entry_attrs, int line_count, int lineno, const AddRowFunction& addRowFn)
 {
@@ -1,6 +1,7 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "livestatus/negatefilter.hpp"
+#include "livestatus/statsindex.hpp"
 
 using namespace icinga;
 
@@ -12,3 +13,17 @@ bool NegateFilter::Apply(const Table::Ptr& table, const Value& row)
 {
 	return !m_Inner->Apply(table, row);
 }
+
+void NegateFilter::Prepare(const Table::Ptr& table)
+{
+	m_Inner->Prepare(table);
+}
+
+bool NegateFilter::ApplyStatsClass(const Table::Ptr& table, const LivestatusStatsClass& cls, bool *result) const
+{
+	if (!m_Inner->ApplyStatsClass(table, cls, result))
+		return false;
+
+	*result = !*result;
+	return true;
+}
@@ -21,6 +21,8 @@ public:
 	NegateFilter(Filter::Ptr inner);
 
 	bool Apply(const Table::Ptr& table, const Value& row) override;
+	void Prepare(const Table::Ptr& table) override;
+	bool ApplyStatsClass(const Table::Ptr& table, const LivestatusStatsClass& cls, bool *result) const override;
 
 private:
 	Filter::Ptr m_Inner;
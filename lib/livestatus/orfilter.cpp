@@ -1,6 +1,7 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "livestatus/orfilter.hpp"
+#include "livestatus/statsindex.hpp"
 
 using namespace icinga;
 
@@ -16,3 +17,19 @@ bool OrFilter::Apply(const Table::Ptr& table, const Value& row)
 
 	return false;
 }
+
+bool OrFilter::ApplyStatsClass(const Table::Ptr& table, const LivestatusStatsClass& cls, bool *result) const
+{
+	*result = m_Filters.empty();
+
+	for (const Filter::Ptr& filter : m_Filters) {
+		bool match;
+
+		if (!filter->ApplyStatsClass(table, cls, &match))
+			return false;
+
+		*result = *result || match;
+	}
+
+	return true;
+}
@@ -19,6 +19,7 @@ public:
 	DECLARE_PTR_TYPEDEFS(OrFilter);
 
 	bool Apply(const Table::Ptr& table, const Value& row) override;
+	bool ApplyStatsClass(const Table::Ptr& table, const LivestatusStatsClass& cls, bool *result) const override;
 };
 
 }
@@ -24,6 +24,15 @@
 
 using namespace icinga;
 
+ServiceRow::ServiceRow(const Value& row)
+	: ServiceObject(static_cast<Service::Ptr>(row))
+{
+	if (ServiceObject) {
+		HostObject = ServiceObject->GetHost();
+		LastCheckResult = ServiceObject->GetLastCheckResult();
+	}
+}
+
 ServicesTable::ServicesTable(LivestatusGroupByType type)
 	: Table(type)
 {
@@ -40,69 +49,69 @@ void ServicesTable::AddColumns(Table *table, const String& prefix,
 	table->AddColumn(prefix + "check_command", Column(&ServicesTable::CheckCommandAccessor, objectAccessor));
 	table->AddColumn(prefix + "check_command_expanded", Column(&ServicesTable::CheckCommandExpandedAccessor, objectAccessor));
 	table->AddColumn(prefix + "event_handler", Column(&ServicesTable::EventHandlerAccessor, objectAccessor));
-	table->AddColumn(prefix + "plugin_output", Column(&ServicesTable::PluginOutputAccessor, objectAccessor));
-	table->AddColumn(prefix + "long_plugin_output", Column(&ServicesTable::LongPluginOutputAccessor, objectAccessor));
-	table->AddColumn(prefix + "perf_data", Column(&ServicesTable::PerfDataAccessor, objectAccessor));
+	table->AddColumn(prefix + "plugin_output", TypedColumn<ServiceRow>::Make<String, &ServicesTable::PluginOutputAccessor>(objectAccessor));
+	table->AddColumn(prefix + "long_plugin_output", TypedColumn<ServiceRow>::Make<String, &ServicesTable::LongPluginOutputAccessor>(objectAccessor));
+	table->AddColumn(prefix + "perf_data", TypedColumn<ServiceRow>::Make<Value, &ServicesTable::PerfDataAccessor>(objectAccessor));
 	table->AddColumn(prefix + "notification_period", Column(&Table::EmptyStringAccessor, objectAccessor));
 	table->AddColumn(prefix + "check_period", Column(&ServicesTable::CheckPeriodAccessor, objectAccessor));
 	table->AddColumn(prefix + "notes", Column(&ServicesTable::NotesAccessor, objectAccessor));
-	table->AddColumn(prefix + "notes_expanded", Column(&ServicesTable::NotesExpandedAccessor, objectAccessor));
+	table->AddColumn(prefix + "notes_expanded", TypedColumn<ServiceRow>::Make<Value, &ServicesTable::NotesExpandedAccessor>(objectAccessor));
 	table->AddColumn(prefix + "notes_url", Column(&ServicesTable::NotesUrlAccessor, objectAccessor));
-	table->AddColumn(prefix + "notes_url_expanded", Column(&ServicesTable::NotesUrlExpandedAccessor, objectAccessor));
+	table->AddColumn(prefix + "notes_url_expanded", TypedColumn<ServiceRow>::Make<Value, &ServicesTable::NotesUrlExpandedAccessor>(objectAccessor));
 	table->AddColumn(prefix + "action_url", Column(&ServicesTable::ActionUrlAccessor, objectAccessor));
-	table->AddColumn(prefix + "action_url_expanded", Column(&ServicesTable::ActionUrlExpandedAccessor, objectAccessor));
+	table->AddColumn(prefix + "action_url_expanded", TypedColumn<ServiceRow>::Make<Value, &ServicesTable::ActionUrlExpandedAccessor>(objectAccessor));
 	table->AddColumn(prefix + "icon_image", Column(&ServicesTable::IconImageAccessor, objectAccessor));
-	table->AddColumn(prefix + "icon_image_expanded", Column(&ServicesTable::IconImageExpandedAccessor, objectAccessor));
+	table->AddColumn(prefix + "icon_image_expanded", TypedColumn<ServiceRow>::Make<Value, &ServicesTable::IconImageExpandedAccessor>(objectAccessor));
 	table->AddColumn(prefix + "icon_image_alt", Column(&ServicesTable::IconImageAltAccessor, objectAccessor));
 	table->AddColumn(prefix + "initial_state", Column(&Table::EmptyStringAccessor, objectAccessor));
-	table->AddColumn(prefix + "max_check_attempts", Column(&ServicesTable::MaxCheckAttemptsAccessor, objectAccessor));
-	table->AddColumn(prefix + "current_attempt", Column(&ServicesTable::CurrentAttemptAccessor, objectAccessor));
-	table->AddColumn(prefix + "state", Column(&ServicesTable::StateAccessor, objectAccessor));
-	table->AddColumn(prefix + "has_been_checked", Column(&ServicesTable::HasBeenCheckedAccessor, objectAccessor));
-	table->AddColumn(prefix + "last_state", Column(&ServicesTable::LastStateAccessor, objectAccessor));
-	table->AddColumn(prefix + "last_hard_state", Column(&ServicesTable::LastHardStateAccessor, objectAccessor));
-	table->AddColumn(prefix + "state_type", Column(&ServicesTable::StateTypeAccessor, objectAccessor));
-	table->AddColumn(prefix + "check_type", Column(&ServicesTable::CheckTypeAccessor, objectAccessor));
-	table->AddColumn(prefix + "acknowledged", Column(&ServicesTable::AcknowledgedAccessor, objectAccessor));
-	table->AddColumn(prefix + "acknowledgement_type", Column(&ServicesTable::AcknowledgementTypeAccessor, objectAccessor));
+	table->AddColumn(prefix + "max_check_attempts", TypedColumn<ServiceRow>::Make<int, &ServicesTable::MaxCheckAttemptsAccessor>(objectAccessor));
+	table->AddColumn(prefix + "current_attempt", TypedColumn<ServiceRow>::Make<int, &ServicesTable::CurrentAttemptAccessor>(objectAccessor));
+	table->AddColumn(prefix + "state", TypedColumn<ServiceRow>::Make<int, &ServicesTable::StateAccessor>(objectAccessor));
+	table->AddColumn(prefix + "has_been_checked", TypedColumn<ServiceRow>::Make<long, &ServicesTable::HasBeenCheckedAccessor>(objectAccessor));
+	table->AddColumn(prefix + "last_state", TypedColumn<ServiceRow>::Make<int, &ServicesTable::LastStateAccessor>(objectAccessor));
+	table->AddColumn(prefix + "last_hard_state", TypedColumn<ServiceRow>::Make<int, &ServicesTable::LastHardStateAccessor>(objectAccessor));
+	table->AddColumn(prefix + "state_type", TypedColumn<ServiceRow>::Make<int, &ServicesTable::StateTypeAccessor>(objectAccessor));
+	table->AddColumn(prefix + "check_type", TypedColumn<ServiceRow>::Make<int, &ServicesTable::CheckTypeAccessor>(objectAccessor));
+	table->AddColumn(prefix + "acknowledged", TypedColumn<ServiceRow>::Make<bool, &ServicesTable::AcknowledgedAccessor>(objectAccessor));
+	table->AddColumn(prefix + "acknowledgement_type", TypedColumn<ServiceRow>::Make<int, &ServicesTable::AcknowledgementTypeAccessor>(objectAccessor));
 	table->AddColumn(prefix + "no_more_notifications", Column(&ServicesTable::NoMoreNotificationsAccessor, objectAccessor));
-	table->AddColumn(prefix + "last_time_ok", Column(&ServicesTable::LastTimeOkAccessor, objectAccessor));
-	table->AddColumn(prefix + "last_time_warning", Column(&ServicesTable::LastTimeWarningAccessor, objectAccessor));
-	table->AddColumn(prefix + "last_time_critical", Column(&ServicesTable::LastTimeCriticalAccessor, objectAccessor));
-	table->AddColumn(prefix + "last_time_unknown", Column(&ServicesTable::LastTimeUnknownAccessor, objectAccessor));
-	table->AddColumn(prefix + "last_check", Column(&ServicesTable::LastCheckAccessor, objectAccessor));
-	table->AddColumn(prefix + "next_check", Column(&ServicesTable::NextCheckAccessor, objectAccessor));
+	table->AddColumn(prefix + "last_time_ok", TypedColumn<ServiceRow>::Make<int, &ServicesTable::LastTimeOkAccessor>(objectAccessor));
+	table->AddColumn(prefix + "last_time_warning", TypedColumn<ServiceRow>::Make<int, &ServicesTable::LastTimeWarningAccessor>(objectAccessor));
+	table->AddColumn(prefix + "last_time_critical", TypedColumn<ServiceRow>::Make<int, &ServicesTable::LastTimeCriticalAccessor>(objectAccessor));
+	table->AddColumn(prefix + "last_time_unknown", TypedColumn<ServiceRow>::Make<int, &ServicesTable::LastTimeUnknownAccessor>(objectAccessor));
+	table->AddColumn(prefix + "last_check", TypedColumn<ServiceRow>::Make<int, &ServicesTable::LastCheckAccessor>(objectAccessor));
+	table->AddColumn(prefix + "next_check", TypedColumn<ServiceRow>::Make<int, &ServicesTable::NextCheckAccessor>(objectAccessor));
 	table->AddColumn(prefix + "last_notification", Column(&ServicesTable::LastNotificationAccessor, objectAccessor));
 	table->AddColumn(prefix + "next_notification", Column(&ServicesTable::NextNotificationAccessor, objectAccessor));
 	table->AddColumn(prefix + "current_notification_number", Column(&ServicesTable::CurrentNotificationNumberAccessor, objectAccessor));
-	table->AddColumn(prefix + "last_state_change", Column(&ServicesTable::LastStateChangeAccessor, objectAccessor));
-	table->AddColumn(prefix + "last_hard_state_change", Column(&ServicesTable::LastHardStateChangeAccessor, objectAccessor));
-	table->AddColumn(prefix + "scheduled_downtime_depth", Column(&ServicesTable::ScheduledDowntimeDepthAccessor, objectAccessor));
-	table->AddColumn(prefix + "is_flapping", Column(&ServicesTable::IsFlappingAccessor, objectAccessor));
-	table->AddColumn(prefix + "checks_enabled", Column(&ServicesTable::ChecksEnabledAccessor, objectAccessor));
-	table->AddColumn(prefix + "accept_passive_checks", Column(&ServicesTable::AcceptPassiveChecksAccessor, objectAccessor));
-	table->AddColumn(prefix + "event_handler_enabled", Column(&ServicesTable::EventHandlerEnabledAccessor, objectAccessor));
-	table->AddColumn(prefix + "notifications_enabled", Column(&ServicesTable::NotificationsEnabledAccessor, objectAccessor));
-	table->AddColumn(prefix + "process_performance_data", Column(&ServicesTable::ProcessPerformanceDataAccessor, objectAccessor));
+	table->AddColumn(prefix + "last_state_change", TypedColumn<ServiceRow>::Make<int, &ServicesTable::LastStateChangeAccessor>(objectAccessor));
+	table->AddColumn(prefix + "last_hard_state_change", TypedColumn<ServiceRow>::Make<int, &ServicesTable::LastHardStateChangeAccessor>(objectAccessor));
+	table->AddColumn(prefix + "scheduled_downtime_depth", TypedColumn<ServiceRow>::Make<int, &ServicesTable::ScheduledDowntimeDepthAccessor>(objectAccessor));
+	table->AddColumn(prefix + "is_flapping", TypedColumn<ServiceRow>::Make<bool, &ServicesTable::IsFlappingAccessor>(objectAccessor));
+	table->AddColumn(prefix + "checks_enabled", TypedColumn<ServiceRow>::Make<long, &ServicesTable::ChecksEnabledAccessor>(objectAccessor));
+	table->AddColumn(prefix + "accept_passive_checks", TypedColumn<ServiceRow>::Make<long, &ServicesTable::AcceptPassiveChecksAccessor>(objectAccessor));
+	table->AddColumn(prefix + "event_handler_enabled", TypedColumn<ServiceRow>::Make<long, &ServicesTable::EventHandlerEnabledAccessor>(objectAccessor));
+	table->AddColumn(prefix + "notifications_enabled", TypedColumn<ServiceRow>::Make<long, &ServicesTable::NotificationsEnabledAccessor>(objectAccessor));
+	table->AddColumn(prefix + "process_performance_data", TypedColumn<ServiceRow>::Make<long, &ServicesTable::ProcessPerformanceDataAccessor>(objectAccessor));
 	table->AddColumn(prefix + "is_executing", Column(&Table::ZeroAccessor, objectAccessor));
-	table->AddColumn(prefix + "active_checks_enabled", Column(&ServicesTable::ActiveChecksEnabledAccessor, objectAccessor));
+	table->AddColumn(prefix + "active_checks_enabled", TypedColumn<ServiceRow>::Make<long, &ServicesTable::ActiveChecksEnabledAccessor>(objectAccessor));
 	table->AddColumn(prefix + "check_options", Column(&Table::EmptyStringAccessor, objectAccessor));
-	table->AddColumn(prefix + "flap_detection_enabled", Column(&ServicesTable::FlapDetectionEnabledAccessor, objectAccessor));
+	table->AddColumn(prefix + "flap_detection_enabled", TypedColumn<ServiceRow>::Make<long, &ServicesTable::FlapDetectionEnabledAccessor>(objectAccessor));
 	table->AddColumn(prefix + "check_freshness", Column(&Table::OneAccessor, objectAccessor));
 	table->AddColumn(prefix + "obsess_over_service", Column(&Table::ZeroAccessor, objectAccessor));
 	table->AddColumn(prefix + "modified_attributes", Column(&Table::ZeroAccessor, objectAccessor));
 	table->AddColumn(prefix + "modified_attributes_list", Column(&Table::ZeroAccessor, objectAccessor));
 	table->AddColumn(prefix + "pnpgraph_present", Column(&Table::ZeroAccessor, objectAccessor));
-	table->AddColumn(prefix + "staleness", Column(&ServicesTable::StalenessAccessor, objectAccessor));
-	table->AddColumn(prefix + "check_interval", Column(&ServicesTable::CheckIntervalAccessor, objectAccessor));
-	table->AddColumn(prefix + "retry_interval", Column(&ServicesTable::RetryIntervalAccessor, objectAccessor));
+	table->AddColumn(prefix + "staleness", TypedColumn<ServiceRow>::Make<double, &ServicesTable::StalenessAccessor>(objectAccessor));
+	table->AddColumn(prefix + "check_interval", TypedColumn<ServiceRow>::Make<double, &ServicesTable::CheckIntervalAccessor>(objectAccessor));
+	table->AddColumn(prefix + "retry_interval", TypedColumn<ServiceRow>::Make<double, &ServicesTable::RetryIntervalAccessor>(objectAccessor));
 	table->AddColumn(prefix + "notification_interval", Column(&ServicesTable::NotificationIntervalAccessor, objectAccessor));
 	table->AddColumn(prefix + "first_notification_delay", Column(&Table::EmptyStringAccessor, objectAccessor));
-	table->AddColumn(prefix + "low_flap_threshold", Column(&ServicesTable::LowFlapThresholdAccessor, objectAccessor));
-	table->AddColumn(prefix + "high_flap_threshold", Column(&ServicesTable::HighFlapThresholdAccessor, objectAccessor));
-	table->AddColumn(prefix + "latency", Column(&ServicesTable::LatencyAccessor, objectAccessor));
-	table->AddColumn(prefix + "execution_time", Column(&ServicesTable::ExecutionTimeAccessor, objectAccessor));
-	table->AddColumn(prefix + "percent_state_change", Column(&ServicesTable::PercentStateChangeAccessor, objectAccessor));
+	table->AddColumn(prefix + "low_flap_threshold", TypedColumn<ServiceRow>::Make<double, &ServicesTable::LowFlapThresholdAccessor>(objectAccessor));
+	table->AddColumn(prefix + "high_flap_threshold", TypedColumn<ServiceRow>::Make<double, &ServicesTable::HighFlapThresholdAccessor>(objectAccessor));
+	table->AddColumn(prefix + "latency", TypedColumn<ServiceRow>::Make<Value, &ServicesTable::LatencyAccessor>(objectAccessor));
+	table->AddColumn(prefix + "execution_time", TypedColumn<ServiceRow>::Make<Value, &ServicesTable::ExecutionTimeAccessor>(objectAccessor));
+	table->AddColumn(prefix + "percent_state_change", TypedColumn<ServiceRow>::Make<double, &ServicesTable::PercentStateChangeAccessor>(objectAccessor));
 	table->AddColumn(prefix + "in_check_period", Column(&ServicesTable::InCheckPeriodAccessor, objectAccessor));
 	table->AddColumn(prefix + "in_notification_period", Column(&ServicesTable::InNotificationPeriodAccessor, objectAccessor));
 	table->AddColumn(prefix + "contacts", Column(&ServicesTable::ContactsAccessor, objectAccessor));
@@ -116,7 +125,8 @@ void ServicesTable::AddColumns(Table *table, const String& prefix,
 	table->AddColumn(prefix + "custom_variables", Column(&ServicesTable::CustomVariablesAccessor, objectAccessor));
 	table->AddColumn(prefix + "groups", Column(&ServicesTable::GroupsAccessor, objectAccessor));
 	table->AddColumn(prefix + "contact_groups", Column(&ServicesTable::ContactGroupsAccessor, objectAccessor));
-	table->AddColumn(prefix + "check_source", Column(&ServicesTable::CheckSourceAccessor, objectAccessor));
+	table->AddColumn(prefix + "check_source", TypedColumn<ServiceRow>::Make<Value, &ServicesTable::CheckSourceAccessor>(objectAccessor));
+	table->AddColumn(prefix + "recent_check_results", Column(&ServicesTable::RecentCheckResultsAccessor, objectAccessor));
 	table->AddColumn(prefix + "is_reachable", Column(&ServicesTable::IsReachableAccessor, objectAccessor));
 	table->AddColumn(prefix + "cv_is_json", Column(&ServicesTable::CVIsJsonAccessor, objectAccessor));
 	table->AddColumn(prefix + "original_attributes", Column(&ServicesTable::OriginalAttributesAccessor, objectAccessor));
@@ -176,13 +186,66 @@ void ServicesTable::FetchRows(const AddRowFunction& addRowFn)
 			}
 		}
 	} else {
-		for (const Service::Ptr& service : ConfigType::GetObjectsByType<Service>()) {
+		for (Service *service : ConfigType::GetObjectsViewByType<Service>()) {
 			if (!addRowFn(service, LivestatusGroupByNone, Empty))
 				return;
 		}
 	}
 }
 
+/**
+ * Looks up the services of a host or group instead of scanning all services.
+ */
+bool ServicesTable::FetchIndexedRows(const std::vector<LivestatusIndexLookup>& lookups, const AddRowFunction& addRowFn)
+{
+	/* The grouped tables return a service once per group. */
+	if (GetGroupByType() != LivestatusGroupByNone)
+		return false;
+
+	for (const LivestatusIndexLookup& lookup : lookups) {
+		String column = GetColumnKey(lookup.Column);
+
+		if (column == "host_name" && lookup.Operator == "=") {
+			Host::Ptr host = Host::GetByName(lookup.Operand);
+
+			if (host) {
+				for (const Service::Ptr& service : host->GetServices()) {
+					if (!addRowFn(service, LivestatusGroupByNone, Empty))
+						break;
+				}
+			}
+
+			return true;
+		} else if (column == "groups" && lookup.Operator == ">=") {
+			ServiceGroup::Ptr sg = ServiceGroup::GetByName(lookup.Operand);
+
+			if (sg) {
+				for (const Service::Ptr& service : sg->GetMembers()) {
+					if (!addRowFn(service, LivestatusGroupByNone, Empty))
+						break;
+				}
+			}
+
+			return true;
+		} else if (column == "host_groups" && lookup.Operator == ">=") {
+			HostGroup::Ptr hg = HostGroup::GetByName(lookup.Operand);
+
+			if (hg) {
+				for (const Host::Ptr& host : hg->GetMembers()) {
+					for (const Service::Ptr& service : host->GetServices()) {
+						if (!addRowFn(service, LivestatusGroupByNone, Empty))
+							return true;
+					}
+				}
+			}
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
 Object::Ptr ServicesTable::HostAccessor(const Value& row, const Column::ObjectAccessor& parentObjectAccessor)
 {
 	Value service;
@@ -289,52 +352,28 @@ Value ServicesTable::EventHandlerAccessor(const Value& row)
 	return Empty;
 }
 
-Value ServicesTable::PluginOutputAccessor(const Value& row)
+String ServicesTable::PluginOutputAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	String output;
-	CheckResult::Ptr cr = service->GetLastCheckResult();
+	if (!row.LastCheckResult)
+		return String();
 
-	if (cr)
-		output = CompatUtility::GetCheckResultOutput(cr);
-
-	return output;
+	return CompatUtility::GetCheckResultOutput(row.LastCheckResult);
 }
 
-Value ServicesTable::LongPluginOutputAccessor(const Value& row)
+String ServicesTable::LongPluginOutputAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
+	if (!row.LastCheckResult)
+		return String();
 
-	if (!service)
-		return Empty;
-
-	String long_output;
-	CheckResult::Ptr cr = service->GetLastCheckResult();
-
-	if (cr)
-		long_output = CompatUtility::GetCheckResultLongOutput(cr);
-
-	return long_output;
+	return CompatUtility::GetCheckResultLongOutput(row.LastCheckResult);
 }
 
-Value ServicesTable::PerfDataAccessor(const Value& row)
+Value ServicesTable::PerfDataAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
+	if (!row.LastCheckResult)
 		return Empty;
 
-	String perfdata;
-	CheckResult::Ptr cr = service->GetLastCheckResult();
-
-	if (!cr)
-		return Empty;
-
-	return PluginUtility::FormatPerfdata(cr->GetPerformanceData());
+	return PluginUtility::FormatPerfdata(row.LastCheckResult->GetPerformanceData());
 }
 
 Value ServicesTable::CheckPeriodAccessor(const Value& row)
@@ -362,20 +401,15 @@ Value ServicesTable::NotesAccessor(const Value& row)
 	return service->GetNotes();
 }
 
-Value ServicesTable::NotesExpandedAccessor(const Value& row)
+Value ServicesTable::NotesExpandedAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
 	MacroProcessor::ResolverList resolvers {
-		{ "service", service },
-		{ "host", service->GetHost() },
+		{ "service", row.ServiceObject },
+		{ "host", row.HostObject },
 		{ "icinga", IcingaApplication::GetInstance() }
 	};
 
-	return MacroProcessor::ResolveMacros(service->GetNotes(), resolvers);
+	return MacroProcessor::ResolveMacros(row.ServiceObject->GetNotes(), resolvers);
 }
 
 Value ServicesTable::NotesUrlAccessor(const Value& row)
@@ -388,20 +422,15 @@ Value ServicesTable::NotesUrlAccessor(const Value& row)
 	return service->GetNotesUrl();
 }
 
-Value ServicesTable::NotesUrlExpandedAccessor(const Value& row)
+Value ServicesTable::NotesUrlExpandedAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
 	MacroProcessor::ResolverList resolvers {
-		{ "service", service },
-		{ "host", service->GetHost() },
+		{ "service", row.ServiceObject },
+		{ "host", row.HostObject },
 		{ "icinga", IcingaApplication::GetInstance() }
 	};
 
-	return MacroProcessor::ResolveMacros(service->GetNotesUrl(), resolvers);
+	return MacroProcessor::ResolveMacros(row.ServiceObject->GetNotesUrl(), resolvers);
 }
 
 Value ServicesTable::ActionUrlAccessor(const Value& row)
@@ -414,20 +443,15 @@ Value ServicesTable::ActionUrlAccessor(const Value& row)
 	return service->GetActionUrl();
 }
 
-Value ServicesTable::ActionUrlExpandedAccessor(const Value& row)
+Value ServicesTable::ActionUrlExpandedAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
 	MacroProcessor::ResolverList resolvers {
-		{ "service", service },
-		{ "host", service->GetHost() },
+		{ "service", row.ServiceObject },
+		{ "host", row.HostObject },
 		{ "icinga", IcingaApplication::GetInstance() }
 	};
 
-	return MacroProcessor::ResolveMacros(service->GetActionUrl(), resolvers);
+	return MacroProcessor::ResolveMacros(row.ServiceObject->GetActionUrl(), resolvers);
 }
 
 Value ServicesTable::IconImageAccessor(const Value& row)
@@ -440,20 +464,15 @@ Value ServicesTable::IconImageAccessor(const Value& row)
 	return service->GetIconImage();
 }
 
-Value ServicesTable::IconImageExpandedAccessor(const Value& row)
+Value ServicesTable::IconImageExpandedAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
 	MacroProcessor::ResolverList resolvers {
-		{ "service", service },
-		{ "host", service->GetHost() },
+		{ "service", row.ServiceObject },
+		{ "host", row.HostObject },
 		{ "icinga", IcingaApplication::GetInstance() }
 	};
 
-	return MacroProcessor::ResolveMacros(service->GetIconImage(), resolvers);
+	return MacroProcessor::ResolveMacros(row.ServiceObject->GetIconImage(), resolvers);
 }
 
 Value ServicesTable::IconImageAltAccessor(const Value& row)
@@ -466,106 +485,54 @@ Value ServicesTable::IconImageAltAccessor(const Value& row)
 	return service->GetIconImageAlt();
 }
 
-Value ServicesTable::MaxCheckAttemptsAccessor(const Value& row)
+int ServicesTable::MaxCheckAttemptsAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return service->GetMaxCheckAttempts();
+	return row.ServiceObject->GetMaxCheckAttempts();
 }
 
-Value ServicesTable::CurrentAttemptAccessor(const Value& row)
+int ServicesTable::CurrentAttemptAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return service->GetCheckAttempt();
+	return row.ServiceObject->GetCheckAttempt();
 }
 
-Value ServicesTable::StateAccessor(const Value& row)
+int ServicesTable::StateAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return service->GetState();
+	return row.ServiceObject->GetState();
 }
 
-Value ServicesTable::HasBeenCheckedAccessor(const Value& row)
+long ServicesTable::HasBeenCheckedAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return Convert::ToLong(service->HasBeenChecked());
+	return Convert::ToLong(row.ServiceObject->HasBeenChecked());
 }
 
-Value ServicesTable::LastStateAccessor(const Value& row)
+int ServicesTable::LastStateAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return service->GetLastState();
+	return row.ServiceObject->GetLastState();
 }
 
-Value ServicesTable::LastHardStateAccessor(const Value& row)
+int ServicesTable::LastHardStateAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return service->GetLastHardState();
+	return row.ServiceObject->GetLastHardState();
 }
 
-Value ServicesTable::StateTypeAccessor(const Value& row)
+int ServicesTable::StateTypeAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return service->GetStateType();
+	return row.ServiceObject->GetStateType();
 }
 
-Value ServicesTable::CheckTypeAccessor(const Value& row)
+int ServicesTable::CheckTypeAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return (service->GetEnableActiveChecks() ? 0 : 1); /* 0 .. active, 1 .. passive */
+	return (row.ServiceObject->GetEnableActiveChecks() ? 0 : 1); /* 0 .. active, 1 .. passive */
 }
 
-Value ServicesTable::AcknowledgedAccessor(const Value& row)
+bool ServicesTable::AcknowledgedAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	ObjectLock olock(service);
-	return service->IsAcknowledged();
+	return row.ServiceObject->GetStateRecord()->GetAcknowledgement() != AcknowledgementNone;
 }
 
-Value ServicesTable::AcknowledgementTypeAccessor(const Value& row)
+int ServicesTable::AcknowledgementTypeAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	ObjectLock olock(service);
-	return service->GetAcknowledgement();
+	return row.ServiceObject->GetStateRecord()->GetAcknowledgement();
 }
 
 Value ServicesTable::NoMoreNotificationsAccessor(const Value& row)
@@ -578,64 +545,34 @@ Value ServicesTable::NoMoreNotificationsAccessor(const Value& row)
 	return (CompatUtility::GetCheckableNotificationNotificationInterval(service) == 0 && !service->GetVolatile()) ? 1 : 0;
 }
 
-Value ServicesTable::LastTimeOkAccessor(const Value& row)
+int ServicesTable::LastTimeOkAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return static_cast<int>(service->GetLastStateOK());
+	return static_cast<int>(row.ServiceObject->GetLastStateOK());
 }
 
-Value ServicesTable::LastTimeWarningAccessor(const Value& row)
+int ServicesTable::LastTimeWarningAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return static_cast<int>(service->GetLastStateWarning());
+	return static_cast<int>(row.ServiceObject->GetLastStateWarning());
 }
 
-Value ServicesTable::LastTimeCriticalAccessor(const Value& row)
+int ServicesTable::LastTimeCriticalAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return static_cast<int>(service->GetLastStateCritical());
+	return static_cast<int>(row.ServiceObject->GetLastStateCritical());
 }
 
-Value ServicesTable::LastTimeUnknownAccessor(const Value& row)
+int ServicesTable::LastTimeUnknownAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return static_cast<int>(service->GetLastStateUnknown());
+	return static_cast<int>(row.ServiceObject->GetLastStateUnknown());
 }
 
-Value ServicesTable::LastCheckAccessor(const Value& row)
+int ServicesTable::LastCheckAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return static_cast<int>(service->GetLastCheck());
+	return static_cast<int>(row.ServiceObject->GetLastCheck());
 }
 
-Value ServicesTable::NextCheckAccessor(const Value& row)
+int ServicesTable::NextCheckAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return static_cast<int>(service->GetNextCheck());
+	return static_cast<int>(row.ServiceObject->GetNextCheck());
 }
 
 Value ServicesTable::LastNotificationAccessor(const Value& row)
@@ -668,122 +605,64 @@ Value ServicesTable::CurrentNotificationNumberAccessor(const Value& row)
 	return CompatUtility::GetCheckableNotificationNotificationNumber(service);
 }
 
-Value ServicesTable::LastStateChangeAccessor(const Value& row)
+int ServicesTable::LastStateChangeAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return static_cast<int>(service->GetLastStateChange());
+	return static_cast<int>(row.ServiceObject->GetLastStateChange());
 }
 
-Value ServicesTable::LastHardStateChangeAccessor(const Value& row)
+int ServicesTable::LastHardStateChangeAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return static_cast<int>(service->GetLastHardStateChange());
+	return static_cast<int>(row.ServiceObject->GetLastHardStateChange());
 }
 
-Value ServicesTable::ScheduledDowntimeDepthAccessor(const Value& row)
+int ServicesTable::ScheduledDowntimeDepthAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return service->GetDowntimeDepth();
+	return row.ServiceObject->GetDowntimeDepth();
 }
 
-Value ServicesTable::IsFlappingAccessor(const Value& row)
+bool ServicesTable::IsFlappingAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return service->IsFlapping();
+	return row.ServiceObject->IsFlapping();
 }
 
-Value ServicesTable::ChecksEnabledAccessor(const Value& row)
+long ServicesTable::ChecksEnabledAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return Convert::ToLong(service->GetEnableActiveChecks());
+	return Convert::ToLong(row.ServiceObject->GetEnableActiveChecks());
 }
 
-Value ServicesTable::AcceptPassiveChecksAccessor(const Value& row)
+long ServicesTable::AcceptPassiveChecksAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return Convert::ToLong(service->GetEnablePassiveChecks());
+	return Convert::ToLong(row.ServiceObject->GetEnablePassiveChecks());
 }
 
-Value ServicesTable::EventHandlerEnabledAccessor(const Value& row)
+long ServicesTable::EventHandlerEnabledAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return Convert::ToLong(service->GetEnableEventHandler());
+	return Convert::ToLong(row.ServiceObject->GetEnableEventHandler());
 }
 
-Value ServicesTable::NotificationsEnabledAccessor(const Value& row)
+long ServicesTable::NotificationsEnabledAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return Convert::ToLong(service->GetEnableNotifications());
+	return Convert::ToLong(row.ServiceObject->GetEnableNotifications());
 }
 
-Value ServicesTable::ProcessPerformanceDataAccessor(const Value& row)
+long ServicesTable::ProcessPerformanceDataAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return Convert::ToLong(service->GetEnablePerfdata());
+	return Convert::ToLong(row.ServiceObject->GetEnablePerfdata());
 }
 
-Value ServicesTable::ActiveChecksEnabledAccessor(const Value& row)
+long ServicesTable::ActiveChecksEnabledAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return Convert::ToLong(service->GetEnableActiveChecks());
+	return Convert::ToLong(row.ServiceObject->GetEnableActiveChecks());
 }
 
-Value ServicesTable::FlapDetectionEnabledAccessor(const Value& row)
+long ServicesTable::FlapDetectionEnabledAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return Convert::ToLong(service->GetEnableFlapping());
+	return Convert::ToLong(row.ServiceObject->GetEnableFlapping());
 }
 
-Value ServicesTable::StalenessAccessor(const Value& row)
+double ServicesTable::StalenessAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
+	const Service::Ptr& service = row.ServiceObject;
 
 	if (service->HasBeenChecked() && service->GetLastCheck() > 0)
 		return (Utility::GetTime() - service->GetLastCheck()) / (service->GetCheckInterval() * 3600);
@@ -791,24 +670,14 @@ Value ServicesTable::StalenessAccessor(const Value& row)
 	return 0.0;
 }
 
-Value ServicesTable::CheckIntervalAccessor(const Value& row)
+double ServicesTable::CheckIntervalAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return service->GetCheckInterval() / LIVESTATUS_INTERVAL_LENGTH;
+	return row.ServiceObject->GetCheckInterval() / LIVESTATUS_INTERVAL_LENGTH;
 }
 
-Value ServicesTable::RetryIntervalAccessor(const Value& row)
+double ServicesTable::RetryIntervalAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return service->GetRetryInterval() / LIVESTATUS_INTERVAL_LENGTH;
+	return row.ServiceObject->GetRetryInterval() / LIVESTATUS_INTERVAL_LENGTH;
 }
 
 Value ServicesTable::NotificationIntervalAccessor(const Value& row)
@@ -821,64 +690,35 @@ Value ServicesTable::NotificationIntervalAccessor(const Value& row)
 	return CompatUtility::GetCheckableNotificationNotificationInterval(service);
 }
 
-Value ServicesTable::LowFlapThresholdAccessor(const Value& row)
+double ServicesTable::LowFlapThresholdAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return service->GetFlappingThresholdLow();
+	return row.ServiceObject->GetFlappingThresholdLow();
 }
 
-Value ServicesTable::HighFlapThresholdAccessor(const Value& row)
+double ServicesTable::HighFlapThresholdAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return service->GetFlappingThresholdHigh();
+	return row.ServiceObject->GetFlappingThresholdHigh();
 }
 
-Value ServicesTable::LatencyAccessor(const Value& row)
+Value ServicesTable::LatencyAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	CheckResult::Ptr cr = service->GetLastCheckResult();
-
-	if (!cr)
+	if (!row.LastCheckResult)
 		return Empty;
 
-	return cr->CalculateLatency();
+	return row.LastCheckResult->CalculateLatency();
 }
 
-Value ServicesTable::ExecutionTimeAccessor(const Value& row)
+Value ServicesTable::ExecutionTimeAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
+	if (!row.LastCheckResult)
 		return Empty;
 
-	CheckResult::Ptr cr = service->GetLastCheckResult();
-
-	if (!cr)
-		return Empty;
-
-	return cr->CalculateExecutionTime();
+	return row.LastCheckResult->CalculateExecutionTime();
 }
 
-Value ServicesTable::PercentStateChangeAccessor(const Value& row)
+double ServicesTable::PercentStateChangeAccessor(const ServiceRow& row)
 {
-	Service::Ptr service = static_cast<Service::Ptr>(row);
-
-	if (!service)
-		return Empty;
-
-	return service->GetFlappingCurrent();
+	return row.ServiceObject->GetFlappingCurrent();
 }
 
 Value ServicesTable::InCheckPeriodAccessor(const Value& row)
@@ -1053,7 +893,7 @@ Value ServicesTable::CustomVariableNamesAccessor(const Value& row)
 	if (vars) {
 		ObjectLock olock(vars);
 		for (const Dictionary::Pair& kv : vars) {
-			result.push_back(kv.first);
+			result.push_back(kv.first.GetString());
 		}
 	}
 
@@ -1106,7 +946,7 @@ Value ServicesTable::CustomVariablesAccessor(const Value& row)
 				val = kv.second;
 
 			result.push_back(new Array({
-				kv.first,
+				kv.first.GetString(),
 				val
 			}));
 		}
@@ -1169,19 +1009,35 @@ Value ServicesTable::ContactGroupsAccessor(const Value& row)
 	return new Array(std::move(result));
 }
 
-Value ServicesTable::CheckSourceAccessor(const Value& row)
+Value ServicesTable::CheckSourceAccessor(const ServiceRow& row)
+{
+	if (!row.LastCheckResult)
+		return Empty;
+
+	return row.LastCheckResult->GetCheckSource();
+}
+
+Value ServicesTable::RecentCheckResultsAccessor(const Value& row)
 {
 	Service::Ptr service = static_cast<Service::Ptr>(row);
 
 	if (!service)
 		return Empty;
 
-	CheckResult::Ptr cr = service->GetLastCheckResult();
+	Array::Ptr history = service->GetRecentCheckResults();
+	ArrayData result;
 
-	if (cr)
-		return cr->GetCheckSource();
+	ObjectLock olock(history);
+	for (Dictionary::Ptr entry : history) {
+		result.push_back(new Array({
+			entry->Get("execution_end"),
+			entry->Get("state"),
+			entry->Get("execution_time"),
+			entry->Get("latency")
+		}));
+	}
 
-	return Empty;
+	return new Array(std::move(result));
 }
 
 Value ServicesTable::IsReachableAccessor(const Value& row)
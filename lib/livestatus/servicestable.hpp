@@ -4,12 +4,34 @@
 #define SERVICESTABLE_H
 
 #include "livestatus/table.hpp"
+#include "livestatus/typedcolumn.hpp"
+#include "icinga/service.hpp"
 
 using namespace icinga;
 
 namespace icinga
 {
 
+/**
+ * The objects most columns of a service row are computed from.
+ *
+ * @ingroup livestatus
+ */
+struct ServiceRow
+{
+	Service::Ptr ServiceObject;
+	Host::Ptr HostObject;
+	CheckResult::Ptr LastCheckResult;
+
+	ServiceRow() = default;
+	explicit ServiceRow(const Value& row);
+
+	explicit operator bool() const
+	{
+		return ServiceObject != nullptr;
+	}
+};
+
 /**
  * @ingroup livestatus
  */
@@ -28,6 +50,7 @@ public:
 
 protected:
 	void FetchRows(const AddRowFunction& addRowFn) override;
+	bool FetchIndexedRows(const std::vector<LivestatusIndexLookup>& lookups, const AddRowFunction& addRowFn) override;
 
 	static Object::Ptr HostAccessor(const Value& row, const Column::ObjectAccessor& parentObjectAccessor);
 	static Object::Ptr ServiceGroupAccessor(const Value& row, LivestatusGroupByType groupByType, const Object::Ptr& groupByObject);
@@ -38,59 +61,59 @@ protected:
 	static Value CheckCommandAccessor(const Value& row);
 	static Value CheckCommandExpandedAccessor(const Value& row);
 	static Value EventHandlerAccessor(const Value& row);
-	static Value PluginOutputAccessor(const Value& row);
-	static Value LongPluginOutputAccessor(const Value& row);
-	static Value PerfDataAccessor(const Value& row);
+	static String PluginOutputAccessor(const ServiceRow& row);
+	static String LongPluginOutputAccessor(const ServiceRow& row);
+	static Value PerfDataAccessor(const ServiceRow& row);
 	static Value CheckPeriodAccessor(const Value& row);
 	static Value NotesAccessor(const Value& row);
-	static Value NotesExpandedAccessor(const Value& row);
+	static Value NotesExpandedAccessor(const ServiceRow& row);
 	static Value NotesUrlAccessor(const Value& row);
-	static Value NotesUrlExpandedAccessor(const Value& row);
+	static Value NotesUrlExpandedAccessor(const ServiceRow& row);
 	static Value ActionUrlAccessor(const Value& row);
-	static Value ActionUrlExpandedAccessor(const Value& row);
+	static Value ActionUrlExpandedAccessor(const ServiceRow& row);
 	static Value IconImageAccessor(const Value& row);
-	static Value IconImageExpandedAccessor(const Value& row);
+	static Value IconImageExpandedAccessor(const ServiceRow& row);
 	static Value IconImageAltAccessor(const Value& row);
-	static Value MaxCheckAttemptsAccessor(const Value& row);
-	static Value CurrentAttemptAccessor(const Value& row);
-	static Value StateAccessor(const Value& row);
-	static Value HasBeenCheckedAccessor(const Value& row);
-	static Value LastStateAccessor(const Value& row);
-	static Value LastHardStateAccessor(const Value& row);
-	static Value StateTypeAccessor(const Value& row);
-	static Value CheckTypeAccessor(const Value& row);
-	static Value AcknowledgedAccessor(const Value& row);
-	static Value AcknowledgementTypeAccessor(const Value& row);
+	static int MaxCheckAttemptsAccessor(const ServiceRow& row);
+	static int CurrentAttemptAccessor(const ServiceRow& row);
+	static int StateAccessor(const ServiceRow& row);
+	static long HasBeenCheckedAccessor(const ServiceRow& row);
+	static int LastStateAccessor(const ServiceRow& row);
+	static int LastHardStateAccessor(const ServiceRow& row);
+	static int StateTypeAccessor(const ServiceRow& row);
+	static int CheckTypeAccessor(const ServiceRow& row);
+	static bool AcknowledgedAccessor(const ServiceRow& row);
+	static int AcknowledgementTypeAccessor(const ServiceRow& row);
 	static Value NoMoreNotificationsAccessor(const Value& row);
-	static Value LastTimeOkAccessor(const Value& row);
-	static Value LastTimeWarningAccessor(const Value& row);
-	static Value LastTimeCriticalAccessor(const Value& row);
-	static Value LastTimeUnknownAccessor(const Value& row);
-	static Value LastCheckAccessor(const Value& row);
-	static Value NextCheckAccessor(const Value& row);
+	static int LastTimeOkAccessor(const ServiceRow& row);
+	static int LastTimeWarningAccessor(const ServiceRow& row);
+	static int LastTimeCriticalAccessor(const ServiceRow& row);
+	static int LastTimeUnknownAccessor(const ServiceRow& row);
+	static int LastCheckAccessor(const ServiceRow& row);
+	static int NextCheckAccessor(const ServiceRow& row);
 	static Value LastNotificationAccessor(const Value& row);
 	static Value NextNotificationAccessor(const Value& row);
 	static Value CurrentNotificationNumberAccessor(const Value& row);
-	static Value LastStateChangeAccessor(const Value& row);
-	static Value LastHardStateChangeAccessor(const Value& row);
-	static Value ScheduledDowntimeDepthAccessor(const Value& row);
-	static Value IsFlappingAccessor(const Value& row);
-	static Value ChecksEnabledAccessor(const Value& row);
-	static Value AcceptPassiveChecksAccessor(const Value& row);
-	static Value EventHandlerEnabledAccessor(const Value& row);
-	static Value NotificationsEnabledAccessor(const Value& row);
-	static Value ProcessPerformanceDataAccessor(const Value& row);
-	static Value ActiveChecksEnabledAccessor(const Value& row);
-	static Value FlapDetectionEnabledAccessor(const Value& row);
-	static Value StalenessAccessor(const Value& row);
-	static Value CheckIntervalAccessor(const Value& row);
-	static Value RetryIntervalAccessor(const Value& row);
+	static int LastStateChangeAccessor(const ServiceRow& row);
+	static int LastHardStateChangeAccessor(const ServiceRow& row);
+	static int ScheduledDowntimeDepthAccessor(const ServiceRow& row);
+	static bool IsFlappingAccessor(const ServiceRow& row);
+	static long ChecksEnabledAccessor(const ServiceRow& row);
+	static long AcceptPassiveChecksAccessor(const ServiceRow& row);
+	static long EventHandlerEnabledAccessor(const ServiceRow& row);
+	static long NotificationsEnabledAccessor(const ServiceRow& row);
+	static long ProcessPerformanceDataAccessor(const ServiceRow& row);
+	static long ActiveChecksEnabledAccessor(const ServiceRow& row);
+	static long FlapDetectionEnabledAccessor(const ServiceRow& row);
+	static double StalenessAccessor(const ServiceRow& row);
+	static double CheckIntervalAccessor(const ServiceRow& row);
+	static double RetryIntervalAccessor(const ServiceRow& row);
 	static Value NotificationIntervalAccessor(const Value& row);
-	static Value LowFlapThresholdAccessor(const Value& row);
-	static Value HighFlapThresholdAccessor(const Value& row);
-	static Value LatencyAccessor(const Value& row);
-	static Value ExecutionTimeAccessor(const Value& row);
-	static Value PercentStateChangeAccessor(const Value& row);
+	static double LowFlapThresholdAccessor(const ServiceRow& row);
+	static double HighFlapThresholdAccessor(const ServiceRow& row);
+	static Value LatencyAccessor(const ServiceRow& row);
+	static Value ExecutionTimeAccessor(const ServiceRow& row);
+	static double PercentStateChangeAccessor(const ServiceRow& row);
 	static Value InCheckPeriodAccessor(const Value& row);
 	static Value InNotificationPeriodAccessor(const Value& row);
 	static Value ContactsAccessor(const Value& row);
@@ -104,7 +127,8 @@ protected:
 	static Value CustomVariablesAccessor(const Value& row);
 	static Value GroupsAccessor(const Value& row);
 	static Value ContactGroupsAccessor(const Value& row);
-	static Value CheckSourceAccessor(const Value& row);
+	static Value CheckSourceAccessor(const ServiceRow& row);
+	static Value RecentCheckResultsAccessor(const Value& row);
 	static Value IsReachableAccessor(const Value& row);
 	static Value CVIsJsonAccessor(const Value& row);
 	static Value OriginalAttributesAccessor(const Value& row);
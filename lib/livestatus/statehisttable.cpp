@@ -239,6 +239,36 @@ String StateHistTable::GetPrefix() const
 }
 
 void StateHistTable::FetchRows(const AddRowFunction& addRowFn)
+{
+	FetchStateHistory(LivestatusLogFilter(), addRowFn);
+}
+
+/**
+ * Reads only the log lines of a host or service. The state history of an
+ * object doesn't depend on the lines of other objects.
+ */
+bool StateHistTable::FetchIndexedRows(const std::vector<LivestatusIndexLookup>& lookups, const AddRowFunction& addRowFn)
+{
+	LivestatusLogFilter filter;
+
+	for (const LivestatusIndexLookup& lookup : lookups) {
+		String column = GetColumnKey(lookup.Column);
+
+		if (column == "host_name" && lookup.Operator == "=")
+			filter.HostName = lookup.Operand;
+		else if (column == "service_description" && lookup.Operator == "=")
+			filter.ServiceDescription = lookup.Operand;
+	}
+
+	if (filter.IsEmpty())
+		return false;
+
+	FetchStateHistory(filter, addRowFn);
+
+	return true;
+}
+
+void StateHistTable::FetchStateHistory(const LivestatusLogFilter& filter, const AddRowFunction& addRowFn)
 {
 	Log(LogDebug, "StateHistTable")
 		<< "Pre-selecting log file from " << m_TimeFrom << " until " << m_TimeUntil;
@@ -247,7 +277,7 @@ void StateHistTable::FetchRows(const AddRowFunction& addRowFn)
 	LivestatusLogUtility::CreateLogIndex(m_CompatLogPath, m_LogFileIndex);
 
 	/* generate log cache */
-	LivestatusLogUtility::CreateLogCache(m_LogFileIndex, this, m_TimeFrom, m_TimeUntil, addRowFn);
+	LivestatusLogUtility::CreateLogCache(m_LogFileIndex, this, m_TimeFrom, m_TimeUntil, addRowFn, filter);
 
 	Checkable::Ptr checkable;
 
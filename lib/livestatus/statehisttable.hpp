@@ -5,6 +5,7 @@
 
 #include "icinga/service.hpp"
 #include "livestatus/historytable.hpp"
+#include "livestatus/livestatuslogindex.hpp"
 
 using namespace icinga;
 
@@ -31,6 +32,7 @@ public:
 
 protected:
 	void FetchRows(const AddRowFunction& addRowFn) override;
+	bool FetchIndexedRows(const std::vector<LivestatusIndexLookup>& lookups, const AddRowFunction& addRowFn) override;
 
 	static Object::Ptr HostAccessor(const Value& row, const Column::ObjectAccessor& parentObjectAccessor);
 	static Object::Ptr ServiceAccessor(const Value& row, const Column::ObjectAccessor& parentObjectAccessor);
@@ -68,6 +70,8 @@ private:
 	time_t m_TimeFrom;
 	time_t m_TimeUntil;
 	String m_CompatLogPath;
+
+	void FetchStateHistory(const LivestatusLogFilter& filter, const AddRowFunction& addRowFn);
 };
 
 }
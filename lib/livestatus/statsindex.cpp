@@ -0,0 +1,329 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "livestatus/statsindex.hpp"
+#include "icinga/host.hpp"
+#include "icinga/service.hpp"
+#include "icinga/dependency.hpp"
+#include "icinga/downtime.hpp"
+#include "base/configtype.hpp"
+#include "base/initialize.hpp"
+#include "base/objectlock.hpp"
+#include "base/utility.hpp"
+#include <algorithm>
+#include <limits>
+#include <tuple>
+
+using namespace icinga;
+
+INITIALIZE_ONCE(&LivestatusStatsIndex::StaticInitialize);
+
+bool LivestatusStatsClass::operator<(const LivestatusStatsClass& other) const
+{
+	return std::tie(State, StateType, HasBeenChecked, Acknowledged, DowntimeDepth, Groups)
+		< std::tie(other.State, other.StateType, other.HasBeenChecked, other.Acknowledged, other.DowntimeDepth, other.Groups);
+}
+
+LivestatusStatsIndex::LivestatusStatsIndex(bool services)
+	: m_Services(services), m_NextExpiry(std::numeric_limits<double>::infinity())
+{ }
+
+void LivestatusStatsIndex::StaticInitialize()
+{
+	Checkable::OnNewCheckResult.connect([](const Checkable::Ptr& checkable, const CheckResult::Ptr&, const MessageOrigin::Ptr&) {
+		MarkDirty(checkable);
+	});
+
+	Checkable::OnStateChange.connect([](const Checkable::Ptr& checkable, const CheckResult::Ptr&, StateType, const MessageOrigin::Ptr&) {
+		MarkDirty(checkable);
+	});
+
+	Checkable::OnAcknowledgementSet.connect([](const Checkable::Ptr& checkable, const String&, const String&, AcknowledgementType,
+		bool, bool, double, double, const MessageOrigin::Ptr&) {
+		MarkDirty(checkable);
+	});
+
+	Checkable::OnAcknowledgementCleared.connect([](const Checkable::Ptr& checkable, const String&, double, const MessageOrigin::Ptr&) {
+		MarkDirty(checkable);
+	});
+
+	auto downtimeHandler ([](const Downtime::Ptr& downtime) { MarkDirty(downtime->GetCheckable()); });
+
+	Downtime::OnDowntimeAdded.connect(downtimeHandler);
+	Downtime::OnDowntimeRemoved.connect(downtimeHandler);
+	Downtime::OnDowntimeStarted.connect(downtimeHandler);
+	Downtime::OnDowntimeTriggered.connect(downtimeHandler);
+
+	ConfigObject::OnActiveChanged.connect([](const ConfigObject::Ptr& object, const Value&) {
+		Checkable::Ptr checkable = dynamic_pointer_cast<Checkable>(object);
+
+		if (checkable) {
+			MarkDirty(checkable);
+			return;
+		}
+
+		/* A host's state depends on its reachability. */
+		Dependency::Ptr dependency = dynamic_pointer_cast<Dependency>(object);
+
+		if (dependency)
+			MarkDirty(dependency->GetChild());
+	});
+}
+
+LivestatusStatsIndex *LivestatusStatsIndex::GetIndex(bool services)
+{
+	static LivestatusStatsIndex hostsIndex (false), servicesIndex (true);
+
+	return services ? &servicesIndex : &hostsIndex;
+}
+
+void LivestatusStatsIndex::MarkDirty(const Checkable::Ptr& checkable)
+{
+	if (!checkable)
+		return;
+
+	LivestatusStatsIndex *index = GetIndex(static_cast<bool>(dynamic_pointer_cast<Service>(checkable)));
+
+	std::unique_lock<std::mutex> lock(index->m_Mutex);
+	index->m_Dirty.insert(checkable);
+}
+
+/**
+ * Counts the rows of a table matching a filter by the classes of checkables
+ * rather than by filtering the rows.
+ *
+ * @param table The table
+ * @param filter The filter all rows have to match
+ * @param aggregators The stats to compute
+ * @param stats Receives the states of the aggregators unless no row matches
+ * @return false if the table or any of the filters isn't supported
+ */
+bool LivestatusStatsIndex::Aggregate(const Table::Ptr& table, const Filter::Ptr& filter,
+	const std::deque<Aggregator::Ptr>& aggregators, std::vector<AggregatorState *>& stats)
+{
+	if (table->GetGroupByType() != LivestatusGroupByNone)
+		return false;
+
+	LivestatusStatsIndex *index;
+
+	if (table->GetName() == "hosts")
+		index = GetIndex(false);
+	else if (table->GetName() == "services")
+		index = GetIndex(true);
+	else
+		return false;
+
+	std::vector<AggregatorState *> result (aggregators.size(), nullptr);
+	bool matched = false;
+	bool supported = true;
+
+	{
+		std::unique_lock<std::mutex> lock(index->m_RefreshMutex);
+
+		index->Refresh();
+
+		for (const auto& kv : index->m_Counters) {
+			bool match = true;
+
+			if (filter && !filter->ApplyStatsClass(table, kv.first, &match)) {
+				supported = false;
+				break;
+			}
+
+			if (!match)
+				continue;
+
+			matched = true;
+
+			for (size_t i = 0; i < aggregators.size() && supported; i++)
+				supported = aggregators[i]->ApplyStatsClass(table, kv.first, kv.second, &result[i]);
+
+			if (!supported)
+				break;
+		}
+	}
+
+	if (!supported) {
+		for (size_t i = 0; i < aggregators.size(); i++) {
+			if (result[i])
+				aggregators[i]->GetResultAndFreeState(result[i]);
+		}
+
+		return false;
+	}
+
+	if (matched)
+		stats.swap(result);
+
+	return true;
+}
+
+/**
+ * Re-classifies the checkables which have changed since the last query.
+ * The caller must hold m_RefreshMutex.
+ */
+void LivestatusStatsIndex::Refresh()
+{
+	std::set<Checkable::Ptr> dirty;
+
+	/* The checkables activated before the signal handlers were connected. */
+	if (!m_Loaded) {
+		m_Loaded = true;
+
+		if (m_Services) {
+			for (const Service::Ptr& service : ConfigType::GetObjectsByType<Service>())
+				dirty.insert(service);
+		} else {
+			for (const Host::Ptr& host : ConfigType::GetObjectsByType<Host>())
+				dirty.insert(host);
+		}
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+
+		if (dirty.empty())
+			dirty.swap(m_Dirty);
+		else {
+			dirty.insert(m_Dirty.begin(), m_Dirty.end());
+			m_Dirty.clear();
+		}
+	}
+
+	double now = Utility::GetTime();
+	bool expired = now >= m_NextExpiry;
+
+	dirty.insert(m_Volatile.begin(), m_Volatile.end());
+
+	if (expired) {
+		for (const auto& kv : m_Records) {
+			if (kv.second.ValidUntil <= now)
+				dirty.insert(kv.first);
+		}
+	}
+
+	for (const Checkable::Ptr& checkable : dirty) {
+		auto it (m_Records.find(checkable));
+
+		if (it != m_Records.end())
+			AddCount(it->second.Class, false);
+
+		Record record;
+		bool isVolatile = false;
+
+		if (!Classify(checkable, now, record, &isVolatile)) {
+			if (it != m_Records.end())
+				m_Records.erase(it);
+
+			m_Volatile.erase(checkable);
+			continue;
+		}
+
+		AddCount(record.Class, true);
+		m_NextExpiry = std::min(m_NextExpiry, record.ValidUntil);
+
+		if (isVolatile)
+			m_Volatile.insert(checkable);
+		else
+			m_Volatile.erase(checkable);
+
+		if (it != m_Records.end())
+			it->second = std::move(record);
+		else
+			m_Records.emplace(checkable, std::move(record));
+	}
+
+	if (expired) {
+		m_NextExpiry = std::numeric_limits<double>::infinity();
+
+		for (const auto& kv : m_Records)
+			m_NextExpiry = std::min(m_NextExpiry, kv.second.ValidUntil);
+	}
+}
+
+void LivestatusStatsIndex::AddCount(const LivestatusStatsClass& cls, bool add)
+{
+	if (add) {
+		m_Counters[cls]++;
+		return;
+	}
+
+	auto it (m_Counters.find(cls));
+
+	if (it != m_Counters.end() && --it->second == 0)
+		m_Counters.erase(it);
+}
+
+/**
+ * Determines the values of the counted columns like the hosts and services
+ * tables do.
+ *
+ * @param checkable The host or service
+ * @param now The current time
+ * @param record Receives the class and until when it's valid
+ * @param isVolatile Set if the class has to be determined for each query
+ * @return false if the checkable isn't active
+ */
+bool LivestatusStatsIndex::Classify(const Checkable::Ptr& checkable, double now, Record& record, bool *isVolatile)
+{
+	if (!checkable->IsActive())
+		return false;
+
+	Host::Ptr host;
+	Service::Ptr service;
+	tie(host, service) = GetHostService(checkable);
+
+	LivestatusStatsClass& cls = record.Class;
+
+	if (service)
+		cls.State = service->GetState();
+	else {
+		cls.State = host->IsReachable() ? host->GetState() : 2;
+
+		/* The reachability changes with the states of the parents. */
+		*isVolatile = !host->GetDependencies().empty();
+	}
+
+	cls.StateType = checkable->GetStateType();
+	cls.HasBeenChecked = checkable->HasBeenChecked();
+	cls.Acknowledged = checkable->GetStateRecord()->GetAcknowledgement() != AcknowledgementNone;
+
+	record.ValidUntil = std::numeric_limits<double>::infinity();
+
+	/* See Downtime::IsInEffect(). */
+	for (const Downtime::Ptr& downtime : checkable->GetDowntimes()) {
+		double start, end;
+
+		if (downtime->GetFixed()) {
+			start = downtime->GetStartTime();
+			end = downtime->GetEndTime();
+		} else {
+			start = downtime->GetTriggerTime();
+
+			/* Flexible downtimes are re-classified once they're triggered. */
+			if (start == 0)
+				continue;
+
+			end = start + downtime->GetDuration();
+		}
+
+		if (now < start)
+			record.ValidUntil = std::min(record.ValidUntil, start);
+		else if (now < end) {
+			cls.DowntimeDepth++;
+			record.ValidUntil = std::min(record.ValidUntil, end);
+		}
+	}
+
+	Array::Ptr groups = service ? service->GetGroups() : host->GetGroups();
+
+	if (groups) {
+		ObjectLock olock(groups);
+
+		for (const String& group : groups)
+			cls.Groups.push_back(group);
+	}
+
+	std::sort(cls.Groups.begin(), cls.Groups.end());
+
+	return true;
+}
@@ -0,0 +1,90 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef STATSINDEX_H
+#define STATSINDEX_H
+
+#include "livestatus/i2-livestatus.hpp"
+#include "livestatus/aggregator.hpp"
+#include "icinga/checkable.hpp"
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * The values of the columns the stats index counts the rows by.
+ *
+ * @ingroup livestatus
+ */
+struct LivestatusStatsClass
+{
+	int State{0};
+	int StateType{0};
+	bool HasBeenChecked{false};
+	bool Acknowledged{false};
+	int DowntimeDepth{0};
+
+	/* Sorted, the rows are counted per combination of groups. */
+	std::vector<String> Groups;
+
+	bool operator<(const LivestatusStatsClass& other) const;
+};
+
+/**
+ * Counts the hosts and services by their state, acknowledgement, downtime
+ * depth and groups, so that the typical tactical overview queries, e.g.
+ * "Stats: state = 2" and "Stats: acknowledged = 0" combined with
+ * "StatsAnd: 2", can be answered without filtering each row.
+ *
+ * The checkables are re-classified when their check results, acknowledgements
+ * or downtimes change, and when a downtime starts or ends. Only count stats
+ * whose filters refer to the counted columns use the index, everything else
+ * falls back to filtering the rows.
+ *
+ * @ingroup livestatus
+ */
+class LivestatusStatsIndex
+{
+public:
+	static void StaticInitialize();
+
+	static bool Aggregate(const Table::Ptr& table, const Filter::Ptr& filter,
+		const std::deque<Aggregator::Ptr>& aggregators, std::vector<AggregatorState *>& stats);
+
+private:
+	struct Record
+	{
+		LivestatusStatsClass Class;
+		double ValidUntil;
+	};
+
+	bool m_Services;
+
+	std::mutex m_Mutex;
+	std::set<Checkable::Ptr> m_Dirty;
+
+	/* Protects the rest. Serializes the refreshes, so that a class can't be overwritten by an older one. */
+	std::mutex m_RefreshMutex;
+	bool m_Loaded{false};
+	std::map<Checkable::Ptr, Record> m_Records;
+	std::set<Checkable::Ptr> m_Volatile;
+	std::map<LivestatusStatsClass, size_t> m_Counters;
+	double m_NextExpiry;
+
+	explicit LivestatusStatsIndex(bool services);
+
+	static LivestatusStatsIndex *GetIndex(bool services);
+	static void MarkDirty(const Checkable::Ptr& checkable);
+
+	void Refresh();
+	void AddCount(const LivestatusStatsClass& cls, bool add);
+	static bool Classify(const Checkable::Ptr& checkable, double now, Record& record, bool *isVolatile);
+};
+
+}
+
+#endif /* STATSINDEX_H */
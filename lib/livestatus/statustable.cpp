@@ -226,7 +226,7 @@ Value StatusTable::CustomVariableNamesAccessor(const Value&)
 	if (vars) {
 		ObjectLock olock(vars);
 		for (const auto& kv : vars) {
-			result.push_back(kv.first);
+			result.push_back(kv.first.GetString());
 		}
 	}
 
@@ -259,7 +259,7 @@ Value StatusTable::CustomVariablesAccessor(const Value&)
 		ObjectLock olock(vars);
 		for (const auto& kv : vars) {
 			result.push_back(new Array({
-				kv.first,
+				kv.first.GetString(),
 				kv.second
 			}));
 		}
@@ -17,12 +17,19 @@
 #include "livestatus/logtable.hpp"
 #include "livestatus/statehisttable.hpp"
 #include "livestatus/filter.hpp"
+#include "livestatus/typedcolumn.hpp"
 #include "base/array.hpp"
+#include "base/configuration.hpp"
 #include "base/dictionary.hpp"
+#include "base/workqueue.hpp"
 #include <boost/algorithm/string/case_conv.hpp>
+#include <algorithm>
 
 using namespace icinga;
 
+/* Filtering fewer rows isn't worth starting threads for. */
+static const size_t l_ParallelFilterRows = 10000;
+
 Table::Table(LivestatusGroupByType type)
 	: m_GroupByType(type), m_GroupByObject(Empty)
 { }
@@ -79,13 +86,25 @@ void Table::AddColumn(const String& name, const Column& column)
 		ret.first->second = column;
 }
 
-Column Table::GetColumn(const String& name) const
+/**
+ * Strips the table's prefix from a column name.
+ *
+ * @param name The column name as used in queries
+ * @return The name the column has been added with
+ */
+String Table::GetColumnKey(const String& name) const
 {
-	String dname = name;
 	String prefix = GetPrefix() + "_";
 
-	if (dname.Find(prefix) == 0)
-		dname = dname.SubStr(prefix.GetLength());
+	if (name.Find(prefix) == 0)
+		return name.SubStr(prefix.GetLength());
+
+	return name;
+}
+
+Column Table::GetColumn(const String& name) const
+{
+	String dname = GetColumnKey(name);
 
 	auto it = m_Columns.find(dname);
 
@@ -110,13 +129,103 @@ std::vector<LivestatusRowValue> Table::FilterRows(const Filter::Ptr& filter, int
 {
 	std::vector<LivestatusRowValue> rs;
 
-	FetchRows([this, filter, limit, &rs](const Value& row, LivestatusGroupByType groupByType, const Object::Ptr& groupByObject) {
-		return FilteredAddRow(rs, filter, limit, row, groupByType, groupByObject);
+	/* The rows' objects may have changed since the last query. */
+	LivestatusRowCache::Invalidate();
+
+	if (!filter) {
+		FetchCandidateRows(filter, [this, limit, &rs](const Value& row, LivestatusGroupByType groupByType, const Object::Ptr& groupByObject) {
+			return FilteredAddRow(rs, nullptr, limit, row, groupByType, groupByObject);
+		});
+
+		return rs;
+	}
+
+	filter->Prepare(this);
+
+	/* The rows up to the limit have to be filtered in order. */
+	if (limit != -1) {
+		FetchCandidateRows(filter, [this, filter, limit, &rs](const Value& row, LivestatusGroupByType groupByType, const Object::Ptr& groupByObject) {
+			return FilteredAddRow(rs, filter, limit, row, groupByType, groupByObject);
+		});
+
+		return rs;
+	}
+
+	std::vector<LivestatusRowValue> candidates;
+
+	FetchCandidateRows(filter, [this, &candidates](const Value& row, LivestatusGroupByType groupByType, const Object::Ptr& groupByObject) {
+		return FilteredAddRow(candidates, nullptr, -1, row, groupByType, groupByObject);
 	});
 
+	std::vector<char> matches (candidates.size(), false);
+
+	if (candidates.size() < l_ParallelFilterRows) {
+		for (size_t i = 0; i < candidates.size(); i++)
+			matches[i] = filter->Apply(this, candidates[i].Row);
+	} else {
+		std::vector<std::pair<size_t, size_t> > ranges;
+		size_t chunkSize = 1000;
+
+		for (size_t begin = 0; begin < candidates.size(); begin += chunkSize)
+			ranges.emplace_back(begin, std::min(begin + chunkSize, candidates.size()));
+
+		WorkQueue upq(25000, Configuration::Concurrency);
+		upq.SetName("Livestatus, " + GetName() + ", filter");
+
+		Table::Ptr self = this;
+
+		upq.ParallelFor(ranges, [self, &filter, &candidates, &matches](const std::pair<size_t, size_t>& range) {
+			for (size_t i = range.first; i < range.second; i++)
+				matches[i] = filter->Apply(self, candidates[i].Row);
+		});
+
+		upq.Join();
+
+		/* Report the filter's error to the client just like for a smaller table. */
+		if (upq.HasExceptions())
+			boost::rethrow_exception(upq.GetExceptions().front());
+	}
+
+	for (size_t i = 0; i < candidates.size(); i++) {
+		if (matches[i])
+			rs.emplace_back(std::move(candidates[i]));
+	}
+
 	return rs;
 }
 
+/**
+ * Fetches the rows which may match a filter, from an index if possible.
+ *
+ * @param filter The filter, may be null
+ * @param addRowFn Called for each candidate row
+ */
+void Table::FetchCandidateRows(const Filter::Ptr& filter, const AddRowFunction& addRowFn)
+{
+	if (filter) {
+		std::vector<LivestatusIndexLookup> lookups;
+		filter->GetIndexLookups(lookups);
+
+		/* The filter is still applied to each candidate row. */
+		if (!lookups.empty() && FetchIndexedRows(lookups, addRowFn))
+			return;
+	}
+
+	FetchRows(addRowFn);
+}
+
+/**
+ * Fetches the rows which may fulfill the conditions, if the table has an index for one of them.
+ *
+ * @param lookups The conditions
+ * @param addRowFn Called for each candidate row
+ * @return Whether the rows have been fetched
+ */
+bool Table::FetchIndexedRows(const std::vector<LivestatusIndexLookup>&, const AddRowFunction&)
+{
+	return false;
+}
+
 bool Table::FilteredAddRow(std::vector<LivestatusRowValue>& rs, const Filter::Ptr& filter, int limit, const Value& row, LivestatusGroupByType groupByType, const Object::Ptr& groupByObject)
 {
 	if (limit != -1 && static_cast<int>(rs.size()) == limit)
@@ -23,6 +23,16 @@ struct LivestatusRowValue {
 
 typedef std::function<bool (const Value&, LivestatusGroupByType, const Object::Ptr&)> AddRowFunction;
 
+/**
+ * A condition which all rows matching a filter fulfill, so that a table
+ * can fetch the candidate rows from an index instead of scanning all rows.
+ */
+struct LivestatusIndexLookup {
+	String Column;
+	String Operator;
+	String Operand;
+};
+
 class Filter;
 
 /**
@@ -46,10 +56,13 @@ public:
 
 	LivestatusGroupByType GetGroupByType() const;
 
+	String GetColumnKey(const String& name) const;
+
 protected:
 	Table(LivestatusGroupByType type = LivestatusGroupByNone);
 
 	virtual void FetchRows(const AddRowFunction& addRowFn) = 0;
+	virtual bool FetchIndexedRows(const std::vector<LivestatusIndexLookup>& lookups, const AddRowFunction& addRowFn);
 
 	static Value ZeroAccessor(const Value&);
 	static Value OneAccessor(const Value&);
@@ -63,6 +76,7 @@ protected:
 private:
 	std::map<String, Column> m_Columns;
 
+	void FetchCandidateRows(const intrusive_ptr<Filter>& filter, const AddRowFunction& addRowFn);
 	bool FilteredAddRow(std::vector<LivestatusRowValue>& rs, const intrusive_ptr<Filter>& filter, int limit, const Value& row, LivestatusGroupByType groupByType, const Object::Ptr& groupByObject);
 };
 
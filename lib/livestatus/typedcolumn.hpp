@@ -0,0 +1,122 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef TYPEDCOLUMN_H
+#define TYPEDCOLUMN_H
+
+#include "livestatus/column.hpp"
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+namespace icinga
+{
+
+/**
+ * Tells whether the row contexts computed by TypedColumn may still be used.
+ * They're valid until the next query starts filtering its rows.
+ *
+ * @ingroup livestatus
+ */
+class LivestatusRowCache
+{
+public:
+	static uint_fast64_t GetGeneration()
+	{
+		return m_Generation.load(std::memory_order_relaxed);
+	}
+
+	static void Invalidate()
+	{
+		m_Generation.fetch_add(1);
+	}
+
+private:
+	static std::atomic<uint_fast64_t> m_Generation;
+};
+
+/**
+ * Creates columns whose accessors take a context of type TRow rather than
+ * the row itself, e.g. a service along with its host and last check result.
+ *
+ * TRow needs a default constructor, a constructor which takes the row and
+ * an explicit operator bool() which tells whether it's a valid row. The
+ * context is computed once per row and thread and then shared by all of
+ * TRow's columns. Accessors which return numbers also get a number
+ * accessor, so that filters can compare them without creating a Value.
+ *
+ * @ingroup livestatus
+ */
+template<typename TRow>
+class TypedColumn
+{
+public:
+	template<typename T, T (*Accessor)(const TRow&)>
+	static Column Make(const Column::ObjectAccessor& objectAccessor)
+	{
+		return Column(&ExtractValue<T, Accessor>, objectAccessor,
+			GetNumberAccessor<T, Accessor>(std::integral_constant<bool, std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>()));
+	}
+
+	static const TRow& GetRow(const Value& row)
+	{
+		struct Entry
+		{
+			const Object *Key{nullptr};
+			uint_fast64_t Generation{0};
+			TRow Row;
+		};
+
+		static thread_local Entry entry;
+
+		const Object *key = row.IsObject() ? row.Get<Object::Ptr>().get() : nullptr;
+		uint_fast64_t generation = LivestatusRowCache::GetGeneration();
+
+		if (!key || key != entry.Key || generation != entry.Generation) {
+			entry.Row = TRow(row);
+			entry.Key = key;
+			entry.Generation = generation;
+		}
+
+		return entry.Row;
+	}
+
+private:
+	template<typename T, T (*Accessor)(const TRow&)>
+	static Value ExtractValue(const Value& row)
+	{
+		const TRow& context = GetRow(row);
+
+		if (!context)
+			return Empty;
+
+		return Accessor(context);
+	}
+
+	template<typename T, T (*Accessor)(const TRow&)>
+	static bool ExtractNumber(const Value& row, double *value)
+	{
+		const TRow& context = GetRow(row);
+
+		if (!context)
+			return false;
+
+		*value = Accessor(context);
+		return true;
+	}
+
+	template<typename T, T (*Accessor)(const TRow&)>
+	static Column::NumberAccessor GetNumberAccessor(std::true_type)
+	{
+		return &ExtractNumber<T, Accessor>;
+	}
+
+	template<typename T, T (*Accessor)(const TRow&)>
+	static Column::NumberAccessor GetNumberAccessor(std::false_type)
+	{
+		return nullptr;
+	}
+};
+
+}
+
+#endif /* TYPEDCOLUMN_H */
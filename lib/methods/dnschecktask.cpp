@@ -0,0 +1,116 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "methods/dnschecktask.hpp"
+#include "methods/nativechecktask.hpp"
+#include "icinga/checkcommand.hpp"
+#include "icinga/macroprocessor.hpp"
+#include "base/convert.hpp"
+#include "base/defer.hpp"
+#include "base/function.hpp"
+#include "base/objectlock.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/utility.hpp"
+#include <boost/algorithm/string/join.hpp>
+#include <algorithm>
+#include <set>
+
+using namespace icinga;
+
+REGISTER_FUNCTION_NONCONST(Internal, DnsCheck, &DnsCheckTask::ScriptFunc, "checkable:cr:resolvedMacros:useResolvedMacros");
+
+void DnsCheckTask::ScriptFunc(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr,
+	const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros)
+{
+	namespace asio = boost::asio;
+
+	REQUIRE_NOT_NULL(checkable);
+	REQUIRE_NOT_NULL(cr);
+
+	CheckCommand::Ptr commandObj = CheckCommand::ExecuteOverride ? CheckCommand::ExecuteOverride : checkable->GetCheckCommand();
+	MacroProcessor::ResolverList resolvers = NativeCheckTask::GetResolvers(checkable, commandObj);
+
+	auto resolve ([&checkable, &resolvers, &resolvedMacros, useResolvedMacros](const String& macro) {
+		return MacroProcessor::ResolveMacros(macro, resolvers, checkable->GetLastCheckResult(),
+			nullptr, MacroProcessor::EscapeCallback(), resolvedMacros, useResolvedMacros);
+	});
+
+	String lookup = resolve("$dns_lookup$");
+	Value expectedAnswers = resolve("$dns_expected_answers$");
+	Value wtime = resolve("$dns_wtime$");
+	Value ctime = resolve("$dns_ctime$");
+
+	if (resolvedMacros && !useResolvedMacros)
+		return;
+
+	std::set<String> expected;
+
+	if (expectedAnswers.IsObjectType<Array>()) {
+		Array::Ptr answers = expectedAnswers;
+
+		ObjectLock olock(answers);
+		for (const Value& answer : answers)
+			expected.insert(answer);
+	} else if (!expectedAnswers.IsEmpty()) {
+		for (const String& answer : String(expectedAnswers).Split(","))
+			expected.insert(answer.Trim());
+	}
+
+	double timeout = NativeCheckTask::GetTimeout(checkable, commandObj);
+
+	NativeCheckTask::Run(checkable, cr, commandObj, [lookup, expected, wtime, ctime, timeout](asio::yield_context yc,
+		const NativeCheckTask::Strand& strand, NativeCheckResult& result) {
+		if (lookup.IsEmpty()) {
+			result.Output = "UNKNOWN - dns_lookup must be set.";
+			return;
+		}
+
+		asio::ip::tcp::resolver resolver (strand->context());
+		bool expired = false;
+
+		Timeout::Ptr lookupTimeout = NativeCheckTask::StartTimeout(strand, timeout, [&resolver, &expired]() {
+			expired = true;
+			resolver.cancel();
+		});
+
+		Defer cancelTimeout ([&lookupTimeout]() { lookupTimeout->Cancel(); });
+
+		double start = Utility::GetTime();
+
+		boost::system::error_code ec;
+		auto entries (resolver.async_resolve(asio::ip::tcp::resolver::query(lookup, ""), yc[ec]));
+
+		double elapsed = Utility::GetTime() - start;
+
+		if (expired) {
+			result.State = ServiceCritical;
+			result.Output = "DNS CRITICAL - query timed out after " + Convert::ToString(timeout) + " seconds";
+			return;
+		}
+
+		if (ec) {
+			result.State = ServiceCritical;
+			result.Output = "DNS CRITICAL - '" + lookup + "' could not be resolved: " + ec.message();
+			return;
+		}
+
+		std::set<String> addresses;
+
+		for (auto& entry : entries)
+			addresses.insert(entry.endpoint().address().to_string());
+
+		String answers = boost::algorithm::join(addresses, ",");
+
+		if (!expected.empty() && addresses != expected) {
+			result.State = ServiceCritical;
+			result.Output = "DNS CRITICAL - expected '" + boost::algorithm::join(expected, ",") + "' but got '" + answers + "'";
+		} else {
+			result.State = NativeCheckTask::CheckThresholds(elapsed, wtime, ctime);
+			result.Output = "DNS " + NativeCheckTask::GetStateText(result.State) + ": " + NativeCheckTask::FormatNumber(elapsed, 3)
+				+ " seconds response time. " + lookup + " returns " + answers;
+		}
+
+		result.PerformanceData = new Array({
+			new PerfdataValue("time", elapsed, false, "s", wtime, ctime, 0)
+		});
+	});
+}
@@ -0,0 +1,30 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef DNSCHECKTASK_H
+#define DNSCHECKTASK_H
+
+#include "methods/i2-methods.hpp"
+#include "icinga/service.hpp"
+#include "base/dictionary.hpp"
+
+namespace icinga
+{
+
+/**
+ * Implements the native "dns" check type, like check_dns using the system's resolver.
+ *
+ * @ingroup methods
+ */
+class DnsCheckTask
+{
+public:
+	static void ScriptFunc(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr,
+		const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros);
+
+private:
+	DnsCheckTask();
+};
+
+}
+
+#endif /* DNSCHECKTASK_H */
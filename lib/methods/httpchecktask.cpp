@@ -0,0 +1,164 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "methods/httpchecktask.hpp"
+#include "methods/nativechecktask.hpp"
+#include "icinga/checkcommand.hpp"
+#include "icinga/macroprocessor.hpp"
+#include "base/application.hpp"
+#include "base/convert.hpp"
+#include "base/defer.hpp"
+#include "base/function.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/tlsstream.hpp"
+#include "base/tlsutility.hpp"
+#include "base/utility.hpp"
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+using namespace icinga;
+
+REGISTER_FUNCTION_NONCONST(Internal, HttpCheck, &HttpCheckTask::ScriptFunc, "checkable:cr:resolvedMacros:useResolvedMacros");
+
+template<class Stream>
+static void SendHttpRequest(Stream& stream, boost::beast::http::request<boost::beast::http::empty_body>& request,
+	boost::beast::http::response_parser<boost::beast::http::string_body>& parser, boost::asio::yield_context yc)
+{
+	namespace beast = boost::beast;
+	namespace http = beast::http;
+
+	http::async_write(stream, request, yc);
+	stream.async_flush(yc);
+
+	beast::flat_buffer buf;
+	http::async_read(stream, buf, parser, yc);
+}
+
+void HttpCheckTask::ScriptFunc(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr,
+	const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros)
+{
+	namespace asio = boost::asio;
+	namespace http = boost::beast::http;
+
+	REQUIRE_NOT_NULL(checkable);
+	REQUIRE_NOT_NULL(cr);
+
+	CheckCommand::Ptr commandObj = CheckCommand::ExecuteOverride ? CheckCommand::ExecuteOverride : checkable->GetCheckCommand();
+	MacroProcessor::ResolverList resolvers = NativeCheckTask::GetResolvers(checkable, commandObj);
+
+	auto resolve ([&checkable, &resolvers, &resolvedMacros, useResolvedMacros](const String& macro) {
+		return MacroProcessor::ResolveMacros(macro, resolvers, checkable->GetLastCheckResult(),
+			nullptr, MacroProcessor::EscapeCallback(), resolvedMacros, useResolvedMacros);
+	});
+
+	String address = resolve("$http_address$");
+	String vhost = resolve("$http_vhost$");
+	String port = resolve("$http_port$");
+	String uri = resolve("$http_uri$");
+	bool ssl = resolve("$http_ssl$").ToBool();
+	Value wtime = resolve("$http_warn_time$");
+	Value ctime = resolve("$http_critical_time$");
+
+	if (resolvedMacros && !useResolvedMacros)
+		return;
+
+	if (vhost.IsEmpty())
+		vhost = address;
+
+	if (port.IsEmpty())
+		port = ssl ? "443" : "80";
+
+	if (uri.IsEmpty())
+		uri = "/";
+
+	double timeout = NativeCheckTask::GetTimeout(checkable, commandObj);
+
+	NativeCheckTask::Run(checkable, cr, commandObj, [address, vhost, port, uri, ssl, wtime, ctime, timeout](asio::yield_context yc,
+		const NativeCheckTask::Strand& strand, NativeCheckResult& result) {
+		if (address.IsEmpty()) {
+			result.Output = "UNKNOWN - http_address must be set.";
+			return;
+		}
+
+		/* Like check_http, the certificate isn't verified, so one context without any certificates suffices. */
+		static Shared<asio::ssl::context>::Ptr sslContext = MakeAsioSslContext();
+
+		OptionalTlsStream stream;
+
+		if (ssl)
+			stream.first = Shared<AsioTlsStream>::Make(strand->context(), *sslContext, vhost);
+		else
+			stream.second = Shared<AsioTcpStream>::Make(strand->context());
+
+		auto& socket (ssl ? stream.first->lowest_layer() : stream.second->lowest_layer());
+		asio::ip::tcp::resolver resolver (strand->context());
+		bool expired = false;
+
+		Timeout::Ptr requestTimeout = NativeCheckTask::StartTimeout(strand, timeout, [&socket, &resolver, &expired]() {
+			expired = true;
+
+			boost::system::error_code ec;
+			resolver.cancel();
+			socket.cancel(ec);
+		});
+
+		Defer cancelTimeout ([&requestTimeout]() { requestTimeout->Cancel(); });
+
+		double start = Utility::GetTime();
+
+		http::request<http::empty_body> request (http::verb::get, std::string(uri), 11);
+		request.set(http::field::host, std::string(vhost));
+		request.set(http::field::user_agent, "Icinga/" + Application::GetAppVersion());
+		request.set(http::field::connection, "close");
+
+		http::response_parser<http::string_body> parser;
+
+		try {
+			NativeCheckTask::Connect(socket, resolver, address, port, expired, yc);
+
+			if (ssl) {
+				stream.first->next_layer().async_handshake(stream.first->next_layer().client, yc);
+				SendHttpRequest(*stream.first, request, parser, yc);
+			} else {
+				SendHttpRequest(*stream.second, request, parser, yc);
+			}
+		} catch (const boost::system::system_error& ex) {
+			result.State = ServiceCritical;
+
+			if (expired)
+				result.Output = "CRITICAL - Socket timeout after " + Convert::ToString(timeout) + " seconds";
+			else
+				result.Output = "HTTP CRITICAL - Unable to open TCP socket or read the response: " + ex.code().message();
+
+			return;
+		}
+
+		double elapsed = Utility::GetTime() - start;
+
+		auto& response (parser.get());
+		unsigned int status = response.result_int();
+		size_t size = response.body().size();
+
+		/* Like check_http without -e, redirects are OK. */
+		if (status >= 500)
+			result.State = ServiceCritical;
+		else if (status >= 400)
+			result.State = ServiceWarning;
+		else
+			result.State = ServiceOK;
+
+		auto timeState (NativeCheckTask::CheckThresholds(elapsed, wtime, ctime));
+
+		if (timeState > result.State)
+			result.State = timeState;
+
+		result.Output = "HTTP " + NativeCheckTask::GetStateText(result.State) + ": HTTP/"
+			+ Convert::ToString(response.version() / 10) + "." + Convert::ToString(response.version() % 10) + " "
+			+ Convert::ToString(status) + " " + String(response.reason().begin(), response.reason().end())
+			+ " - " + Convert::ToString(size) + " bytes in " + NativeCheckTask::FormatNumber(elapsed, 3) + " second response time";
+
+		result.PerformanceData = new Array({
+			new PerfdataValue("time", elapsed, false, "s", wtime, ctime, 0),
+			new PerfdataValue("size", size, false, "B", Empty, Empty, 0)
+		});
+	});
+}
@@ -0,0 +1,261 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "methods/icmpchecktask.hpp"
+#include "methods/nativechecktask.hpp"
+#include "icinga/checkcommand.hpp"
+#include "icinga/macroprocessor.hpp"
+#include "base/convert.hpp"
+#include "base/defer.hpp"
+#include "base/function.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/utility.hpp"
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/asio/generic/datagram_protocol.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+using namespace icinga;
+
+REGISTER_FUNCTION_NONCONST(Internal, IcmpCheck, &IcmpCheckTask::ScriptFunc, "checkable:cr:resolvedMacros:useResolvedMacros");
+
+/* The interval between two echo requests, the minimum unprivileged users may use with ping(8). */
+static const double l_IcmpInterval = 0.2;
+
+struct IcmpEchoHeader
+{
+	uint8_t Type;
+	uint8_t Code;
+	uint16_t Checksum;
+	uint16_t Identifier;
+	uint16_t Sequence;
+};
+
+static uint16_t IcmpChecksum(const unsigned char *data, size_t length)
+{
+	uint32_t sum = 0;
+
+	for (size_t i = 0; i + 1 < length; i += 2)
+		sum += (data[i] << 8) | data[i + 1];
+
+	if (length % 2)
+		sum += data[length - 1] << 8;
+
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return htons(~sum & 0xffff);
+}
+
+void IcmpCheckTask::ScriptFunc(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr,
+	const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros)
+{
+	namespace asio = boost::asio;
+
+	REQUIRE_NOT_NULL(checkable);
+	REQUIRE_NOT_NULL(cr);
+
+	CheckCommand::Ptr commandObj = CheckCommand::ExecuteOverride ? CheckCommand::ExecuteOverride : checkable->GetCheckCommand();
+	MacroProcessor::ResolverList resolvers = NativeCheckTask::GetResolvers(checkable, commandObj);
+
+	auto resolve ([&checkable, &resolvers, &resolvedMacros, useResolvedMacros](const String& macro) {
+		return MacroProcessor::ResolveMacros(macro, resolvers, checkable->GetLastCheckResult(),
+			nullptr, MacroProcessor::EscapeCallback(), resolvedMacros, useResolvedMacros);
+	});
+
+	String address = resolve("$ping_address$");
+	double wrta = resolve("$ping_wrta$");
+	double wpl = resolve("$ping_wpl$");
+	double crta = resolve("$ping_crta$");
+	double cpl = resolve("$ping_cpl$");
+	Value packetsValue = resolve("$ping_packets$");
+	Value timeoutValue = resolve("$ping_timeout$");
+
+	if (resolvedMacros && !useResolvedMacros)
+		return;
+
+	int packets = packetsValue.IsEmpty() ? 5 : static_cast<int>(packetsValue);
+	double timeout = NativeCheckTask::GetTimeout(checkable, commandObj);
+
+	/* Like check_ping, don't wait for lost packets longer than 10 seconds by default. */
+	double pingTimeout = timeoutValue.IsEmpty() ? 10 : static_cast<double>(timeoutValue);
+
+	if (pingTimeout < timeout)
+		timeout = pingTimeout;
+
+	NativeCheckTask::Run(checkable, cr, commandObj, [address, wrta, wpl, crta, cpl, packets, timeout](asio::yield_context yc,
+		const NativeCheckTask::Strand& strand, NativeCheckResult& result) {
+#ifdef _WIN32
+		result.Output = "PING UNKNOWN - Native ICMP checks are not supported on Windows.";
+#else /* _WIN32 */
+		if (address.IsEmpty() || packets < 1) {
+			result.Output = "PING UNKNOWN - ping_address must be set and ping_packets must be positive.";
+			return;
+		}
+
+		double start = Utility::GetTime();
+		double deadline = start + timeout;
+
+		boost::system::error_code ec;
+		asio::ip::udp::resolver resolver (strand->context());
+		bool expired = false;
+
+		asio::ip::udp::endpoint endpoint;
+
+		{
+			Timeout::Ptr lookupTimeout = NativeCheckTask::StartTimeout(strand, timeout, [&resolver, &expired]() {
+				expired = true;
+				resolver.cancel();
+			});
+
+			Defer cancelTimeout ([&lookupTimeout]() { lookupTimeout->Cancel(); });
+
+			auto entries (resolver.async_resolve(asio::ip::udp::resolver::query(address, ""), yc[ec]));
+
+			if (ec || entries.begin() == entries.end()) {
+				result.State = ServiceCritical;
+				result.Output = "PING CRITICAL - Cannot resolve '" + address + "'" + (expired ? String() : ": " + String(ec.message()));
+				return;
+			}
+
+			endpoint = entries.begin()->endpoint();
+		}
+
+		bool v6 = endpoint.address().is_v6();
+
+		/* Unprivileged ICMP sockets (net.ipv4.ping_group_range on Linux), the kernel fills in the identifier. */
+		int family = v6 ? AF_INET6 : AF_INET;
+		int icmpProtocol = v6 ? static_cast<int>(IPPROTO_ICMPV6) : static_cast<int>(IPPROTO_ICMP);
+		asio::generic::datagram_protocol protocol (family, icmpProtocol);
+		asio::generic::datagram_protocol::socket socket (strand->context());
+
+		socket.open(protocol, ec);
+
+		if (ec) {
+			result.Output = "PING UNKNOWN - Cannot open ICMP socket: " + ec.message();
+			return;
+		}
+
+		asio::generic::datagram_protocol::endpoint target (endpoint.data(), endpoint.size(), protocol.protocol());
+
+		std::vector<double> sentAt (packets, 0);
+		std::vector<bool> answered (packets, false);
+		int sent = 0;
+		int received = 0;
+		double rttSum = 0;
+
+		auto receiveUntil ([&](double until) {
+			unsigned char reply[1500];
+
+			while (received < sent) {
+				double wait = until - Utility::GetTime();
+
+				if (wait <= 0)
+					return;
+
+				Timeout::Ptr receiveTimeout = NativeCheckTask::StartTimeout(strand, wait, [&socket]() {
+					boost::system::error_code ec;
+					socket.cancel(ec);
+				});
+
+				Defer cancelTimeout ([&receiveTimeout]() { receiveTimeout->Cancel(); });
+
+				boost::system::error_code ec;
+				size_t length = socket.async_receive(asio::buffer(reply), yc[ec]);
+				double now = Utility::GetTime();
+
+				if (ec)
+					return;
+
+				size_t offset = 0;
+
+				/* Some platforms include the IPv4 header. */
+				if (!v6 && length > 0 && (reply[0] >> 4) == 4)
+					offset = (reply[0] & 0x0f) * 4;
+
+				if (length < offset + sizeof(IcmpEchoHeader))
+					continue;
+
+				IcmpEchoHeader header;
+				memcpy(&header, reply + offset, sizeof(header));
+
+				if (header.Type != (v6 ? 129 : 0))
+					continue;
+
+				int seq = ntohs(header.Sequence);
+
+				if (seq >= sent || answered[seq])
+					continue;
+
+				answered[seq] = true;
+				received++;
+				rttSum += now - sentAt[seq];
+			}
+		});
+
+		for (int seq = 0; seq < packets; seq++) {
+			unsigned char request[sizeof(IcmpEchoHeader) + 56] = {};
+
+			IcmpEchoHeader header;
+			header.Type = v6 ? 128 : 8;
+			header.Code = 0;
+			header.Checksum = 0;
+			header.Identifier = 0;
+			header.Sequence = htons(seq);
+
+			memcpy(request, &header, sizeof(header));
+
+			if (!v6) {
+				header.Checksum = IcmpChecksum(request, sizeof(request));
+				memcpy(request, &header, sizeof(header));
+			}
+
+			sentAt[seq] = Utility::GetTime();
+			sent++;
+
+			socket.async_send_to(asio::buffer(request), target, yc[ec]);
+
+			if (seq + 1 == packets) {
+				receiveUntil(deadline);
+				break;
+			}
+
+			double next = std::min(sentAt[seq] + l_IcmpInterval, deadline);
+
+			receiveUntil(next);
+
+			double wait = next - Utility::GetTime();
+
+			if (wait > 0) {
+				asio::deadline_timer timer (strand->context());
+				timer.expires_from_now(boost::posix_time::microseconds(intmax_t(wait * 1000000)));
+				timer.async_wait(yc[ec]);
+			}
+
+			if (Utility::GetTime() >= deadline)
+				break;
+		}
+
+		double pl = 100.0 * (packets - received) / packets;
+		double rta = received ? rttSum / received * 1000 : 0;
+
+		if (pl >= cpl || (received && rta >= crta))
+			result.State = ServiceCritical;
+		else if (pl >= wpl || (received && rta >= wrta))
+			result.State = ServiceWarning;
+		else
+			result.State = ServiceOK;
+
+		result.Output = "PING " + NativeCheckTask::GetStateText(result.State) + " - Packet loss = " + Convert::ToString(static_cast<int>(pl)) + "%";
+		result.PerformanceData = new Array();
+
+		if (received) {
+			result.Output += ", RTA = " + NativeCheckTask::FormatNumber(rta, 2) + " ms";
+			result.PerformanceData->Add(new PerfdataValue("rta", rta, false, "ms", wrta, crta, 0));
+		}
+
+		result.PerformanceData->Add(new PerfdataValue("pl", pl, false, "%", wpl, cpl, 0));
+#endif /* _WIN32 */
+	});
+}
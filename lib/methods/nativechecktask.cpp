@@ -0,0 +1,202 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "methods/nativechecktask.hpp"
+#include "icinga/icingaapplication.hpp"
+#include "icinga/pluginutility.hpp"
+#include "base/process.hpp"
+#include "base/utility.hpp"
+#include <iomanip>
+#include <sstream>
+
+using namespace icinga;
+
+MacroProcessor::ResolverList NativeCheckTask::GetResolvers(const Checkable::Ptr& checkable, const CheckCommand::Ptr& commandObj)
+{
+	Host::Ptr host;
+	Service::Ptr service;
+	tie(host, service) = GetHostService(checkable);
+
+	MacroProcessor::ResolverList resolvers;
+
+	if (MacroResolver::OverrideMacros)
+		resolvers.emplace_back("override", MacroResolver::OverrideMacros);
+
+	if (service)
+		resolvers.emplace_back("service", service);
+	resolvers.emplace_back("host", host);
+	resolvers.emplace_back("command", commandObj);
+	resolvers.emplace_back("icinga", IcingaApplication::GetInstance());
+
+	return resolvers;
+}
+
+double NativeCheckTask::GetTimeout(const Checkable::Ptr& checkable, const CheckCommand::Ptr& commandObj)
+{
+	double timeout = commandObj->GetTimeout();
+
+	if (!checkable->GetCheckTimeout().IsEmpty())
+		timeout = checkable->GetCheckTimeout();
+
+	return timeout;
+}
+
+/**
+ * Runs the check as a coroutine on the I/O engine and processes its result
+ * once it has finished. Unlike plugins, the check doesn't block a thread while
+ * it waits for the network.
+ *
+ * @param checkable The object being checked
+ * @param cr The check result to fill in
+ * @param commandObj The check command
+ * @param check Performs the actual check, exceptions result in an UNKNOWN state
+ */
+void NativeCheckTask::Run(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr, const CheckCommand::Ptr& commandObj,
+	const CheckFunction& check)
+{
+	/* The handler is thread-local, but the result is processed in an I/O thread. */
+	auto callback (Checkable::ExecuteCommandProcessFinishedHandler);
+	String commandName = commandObj->GetName();
+	auto strand (Shared<boost::asio::io_context::strand>::Make(IoEngine::Get().GetIoContext()));
+
+	Checkable::CurrentConcurrentChecks.fetch_add(1);
+	Checkable::IncreasePendingChecks();
+
+	IoEngine::SpawnCoroutine(*strand, [checkable, cr, commandName, strand, check, callback](boost::asio::yield_context yc) {
+		NativeCheckResult result;
+		double start = Utility::GetTime();
+
+		try {
+			check(yc, strand, result);
+		} catch (const boost::coroutines::detail::forced_unwind&) {
+			throw;
+		} catch (const std::exception& ex) {
+			result.State = ServiceUnknown;
+			result.Output = "UNKNOWN - " + String(ex.what());
+			result.PerformanceData = nullptr;
+		}
+
+		double end = Utility::GetTime();
+
+		CpuBoundWork processResult (yc, CpuBoundWorkCheckResult);
+
+		Checkable::CurrentConcurrentChecks.fetch_sub(1);
+		Checkable::DecreasePendingChecks();
+
+		if (callback) {
+			ProcessResult pr;
+			pr.PID = -1;
+			pr.Output = result.Output;
+			pr.ExecutionStart = start;
+			pr.ExecutionEnd = end;
+			pr.ExitStatus = result.State;
+
+			if (result.PerformanceData)
+				pr.Output += " |" + PluginUtility::FormatPerfdata(result.PerformanceData);
+
+			callback(commandName, pr);
+		} else {
+			cr->SetCommand(commandName);
+			cr->SetOutput(result.Output);
+			cr->SetPerformanceData(result.PerformanceData);
+			cr->SetState(result.State);
+			cr->SetExitStatus(result.State);
+			cr->SetExecutionStart(start);
+			cr->SetExecutionEnd(end);
+
+			checkable->ProcessCheckResult(cr);
+		}
+	});
+}
+
+/**
+ * Calls onTimeout on the check's strand once the check's timeout has expired.
+ * The caller must cancel the returned timeout before the objects used by
+ * onTimeout go out of scope.
+ */
+Timeout::Ptr NativeCheckTask::StartTimeout(const Strand& strand, double seconds, const std::function<void()>& onTimeout)
+{
+	return new Timeout(strand->context(), *strand, boost::posix_time::microseconds(intmax_t(seconds * 1000000)),
+		[onTimeout](boost::asio::yield_context) { onTimeout(); });
+}
+
+/**
+ * Connects to the first reachable address of host, like icinga::Connect(),
+ * but gives up once the check's timeout has expired.
+ *
+ * @param socket The socket to connect
+ * @param resolver The resolver to use, so the caller can cancel it
+ * @param host The host name or address
+ * @param port The port or service name
+ * @param expired Set by the caller's timeout handler, which should also cancel the socket and resolver
+ * @param yc The coroutine's yield context
+ */
+void NativeCheckTask::Connect(boost::asio::ip::tcp::socket::lowest_layer_type& socket, boost::asio::ip::tcp::resolver& resolver,
+	const String& host, const String& port, const bool& expired, boost::asio::yield_context yc)
+{
+	using boost::asio::ip::tcp;
+
+	boost::system::error_code ec;
+	auto result (resolver.async_resolve(tcp::resolver::query(host, port), yc[ec]));
+
+	if (expired)
+		BOOST_THROW_EXCEPTION(boost::system::system_error(boost::asio::error::timed_out));
+
+	if (ec)
+		BOOST_THROW_EXCEPTION(boost::system::system_error(ec));
+
+	for (auto current (result.begin()); current != result.end(); ++current) {
+		socket.open(current->endpoint().protocol());
+		socket.async_connect(current->endpoint(), yc[ec]);
+
+		if (!ec)
+			return;
+
+		socket.close();
+
+		if (expired)
+			BOOST_THROW_EXCEPTION(boost::system::system_error(boost::asio::error::timed_out));
+	}
+
+	BOOST_THROW_EXCEPTION(boost::system::system_error(ec ? ec : boost::asio::error::host_not_found));
+}
+
+/**
+ * Compares a value against simple upper thresholds, like the plugins'
+ * -w/-c options for response times.
+ *
+ * @param value The measured value
+ * @param warn The warning threshold, if any
+ * @param crit The critical threshold, if any
+ * @returns The resulting state
+ */
+ServiceState NativeCheckTask::CheckThresholds(double value, const Value& warn, const Value& crit)
+{
+	if (!crit.IsEmpty() && value > static_cast<double>(crit))
+		return ServiceCritical;
+
+	if (!warn.IsEmpty() && value > static_cast<double>(warn))
+		return ServiceWarning;
+
+	return ServiceOK;
+}
+
+String NativeCheckTask::FormatNumber(double value, int precision)
+{
+	std::ostringstream msgbuf;
+	msgbuf << std::fixed << std::setprecision(precision) << value;
+	return msgbuf.str();
+}
+
+String NativeCheckTask::GetStateText(ServiceState state)
+{
+	switch (state) {
+		case ServiceOK:
+			return "OK";
+		case ServiceWarning:
+			return "WARNING";
+		case ServiceCritical:
+			return "CRITICAL";
+		default:
+			return "UNKNOWN";
+	}
+}
@@ -0,0 +1,67 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef NATIVECHECKTASK_H
+#define NATIVECHECKTASK_H
+
+#include "methods/i2-methods.hpp"
+#include "icinga/service.hpp"
+#include "icinga/checkcommand.hpp"
+#include "icinga/macroprocessor.hpp"
+#include "base/array.hpp"
+#include "base/dictionary.hpp"
+#include "base/io-engine.hpp"
+#include "base/shared.hpp"
+#include <boost/asio/io_context_strand.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/spawn.hpp>
+#include <functional>
+
+namespace icinga
+{
+
+/**
+ * The outcome of a check which is executed in-process.
+ *
+ * @ingroup methods
+ */
+struct NativeCheckResult
+{
+	ServiceState State{ServiceUnknown};
+	String Output;
+	Array::Ptr PerformanceData;
+};
+
+/**
+ * Runs checks inside the Icinga process as coroutines on the I/O engine
+ * instead of forking a plugin, for checks which only need a bit of network
+ * I/O (e.g. TCP connects or HTTP requests).
+ *
+ * @ingroup methods
+ */
+class NativeCheckTask
+{
+public:
+	typedef Shared<boost::asio::io_context::strand>::Ptr Strand;
+	typedef std::function<void(boost::asio::yield_context, const Strand&, NativeCheckResult&)> CheckFunction;
+
+	static MacroProcessor::ResolverList GetResolvers(const Checkable::Ptr& checkable, const CheckCommand::Ptr& commandObj);
+	static double GetTimeout(const Checkable::Ptr& checkable, const CheckCommand::Ptr& commandObj);
+
+	static void Run(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr, const CheckCommand::Ptr& commandObj,
+		const CheckFunction& check);
+
+	static Timeout::Ptr StartTimeout(const Strand& strand, double seconds, const std::function<void()>& onTimeout);
+	static void Connect(boost::asio::ip::tcp::socket::lowest_layer_type& socket, boost::asio::ip::tcp::resolver& resolver,
+		const String& host, const String& port, const bool& expired, boost::asio::yield_context yc);
+
+	static ServiceState CheckThresholds(double value, const Value& warn, const Value& crit);
+	static String FormatNumber(double value, int precision);
+	static String GetStateText(ServiceState state);
+
+private:
+	NativeCheckTask();
+};
+
+}
+
+#endif /* NATIVECHECKTASK_H */
@@ -44,6 +44,10 @@ void PluginCheckTask::ScriptFunc(const Checkable::Ptr& checkable, const CheckRes
 	if (!checkable->GetCheckTimeout().IsEmpty())
 		timeout = checkable->GetCheckTimeout();
 
+	/* Optional, executes the command through a long-lived worker instead of spawning it. */
+	Value worker = MacroProcessor::ResolveMacros("$plugin_worker$", resolvers, checkable->GetLastCheckResult(),
+		nullptr, MacroProcessor::EscapeCallback(), resolvedMacros, useResolvedMacros);
+
 	std::function<void(const Value& commandLine, const ProcessResult&)> callback;
 
 	if (Checkable::ExecuteCommandProcessFinishedHandler) {
@@ -55,7 +59,7 @@ void PluginCheckTask::ScriptFunc(const Checkable::Ptr& checkable, const CheckRes
 	}
 
 	PluginUtility::ExecuteCommand(commandObj, checkable, checkable->GetLastCheckResult(),
-		resolvers, resolvedMacros, useResolvedMacros, timeout, callback);
+		resolvers, resolvedMacros, useResolvedMacros, timeout, callback, worker);
 
 	if (!resolvedMacros || useResolvedMacros) {
 		Checkable::CurrentConcurrentChecks.fetch_add(1);
@@ -6,6 +6,7 @@
 #include "icinga/pluginutility.hpp"
 #include "icinga/icingaapplication.hpp"
 #include "base/configtype.hpp"
+#include "base/defer.hpp"
 #include "base/logger.hpp"
 #include "base/function.hpp"
 #include "base/utility.hpp"
@@ -47,8 +48,27 @@ void PluginEventTask::ScriptFunc(const Checkable::Ptr& checkable,
 		callback = [checkable](const Value& commandLine, const ProcessResult& pr) { ProcessFinishedHandler(checkable, commandLine, pr); };
 	}
 
-	PluginUtility::ExecuteCommand(commandObj, checkable, checkable->GetLastCheckResult(),
-		resolvers, resolvedMacros, useResolvedMacros, timeout, callback);
+	/* Neither macro resolution only nor the API's synchronous executions are limited. */
+	if (resolvedMacros || Checkable::ExecuteCommandProcessFinishedHandler) {
+		PluginUtility::ExecuteCommand(commandObj, checkable, checkable->GetLastCheckResult(),
+			resolvers, resolvedMacros, useResolvedMacros, timeout, callback);
+		return;
+	}
+
+	/* The macros are resolved once the event handler runs, so one waiting per checkable is enough. */
+	String key = commandObj->GetName() + "!" + checkable->GetName();
+
+	ExecutionQueue::Run(commandObj->GetExecutionQueue(), commandObj->GetMaxConcurrentExecutions(),
+		ExecutionQueue::EventHandlers, IcingaApplication::GetInstance()->GetMaxConcurrentEventHandlers(), key,
+		[commandObj, checkable, resolvers, timeout, callback](const std::function<void()>& done) {
+			PluginUtility::ExecuteCommand(commandObj, checkable, checkable->GetLastCheckResult(),
+				resolvers, nullptr, false, timeout,
+				[callback, done](const Value& commandLine, const ProcessResult& pr) {
+					Defer release (done);
+
+					callback(commandLine, pr);
+				});
+		});
 }
 
 void PluginEventTask::ProcessFinishedHandler(const Checkable::Ptr& checkable, const Value& commandLine, const ProcessResult& pr)
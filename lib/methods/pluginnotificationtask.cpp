@@ -8,7 +8,9 @@
 #include "icinga/macroprocessor.hpp"
 #include "icinga/icingaapplication.hpp"
 #include "base/function.hpp"
+#include "base/defer.hpp"
 #include "base/logger.hpp"
+#include "base/objectlock.hpp"
 #include "base/utility.hpp"
 #include "base/process.hpp"
 #include "base/convert.hpp"
@@ -37,6 +39,19 @@ void PluginNotificationTask::ScriptFunc(const Notification::Ptr& notification,
 		{ "comment", comment }
 	});
 
+	{
+		Dictionary::Ptr digestMacros = NotificationCommand::DigestMacros;
+
+		if (!digestMacros)
+			digestMacros = NotificationCommand::GetDigestMacros(checkable, type, cr);
+
+		ObjectLock olock(digestMacros);
+
+		for (const Dictionary::Pair& kv : digestMacros) {
+			notificationExtra->Set(kv.first, kv.second);
+		}
+	}
+
 	Host::Ptr host;
 	Service::Ptr service;
 	tie(host, service) = GetHostService(checkable);
@@ -64,8 +79,27 @@ void PluginNotificationTask::ScriptFunc(const Notification::Ptr& notification,
 		callback = [checkable](const Value& commandline, const ProcessResult& pr) { ProcessFinishedHandler(checkable, commandline, pr); };
 	}
 
-	PluginUtility::ExecuteCommand(commandObj, checkable, cr, resolvers,
-		resolvedMacros, useResolvedMacros, timeout, callback);
+	/* Neither macro resolution only nor the API's synchronous executions are limited. */
+	if (resolvedMacros || Checkable::ExecuteCommandProcessFinishedHandler) {
+		PluginUtility::ExecuteCommand(commandObj, checkable, cr, resolvers,
+			resolvedMacros, useResolvedMacros, timeout, callback);
+		return;
+	}
+
+	/* The same notification to the same user of the same type is sent only once while it's waiting. */
+	String key = commandObj->GetName() + "!" + notification->GetName() + "!" + user->GetName()
+		+ "!" + Notification::NotificationTypeToStringCompat(type);
+
+	ExecutionQueue::Run(commandObj->GetExecutionQueue(), commandObj->GetMaxConcurrentExecutions(),
+		ExecutionQueue::Notifications, IcingaApplication::GetInstance()->GetMaxConcurrentNotifications(), key,
+		[commandObj, checkable, cr, resolvers, timeout, callback](const std::function<void()>& done) {
+			PluginUtility::ExecuteCommand(commandObj, checkable, cr, resolvers, nullptr, false, timeout,
+				[callback, done](const Value& commandLine, const ProcessResult& pr) {
+					Defer release (done);
+
+					callback(commandLine, pr);
+				});
+		});
 }
 
 void PluginNotificationTask::ProcessFinishedHandler(const Checkable::Ptr& checkable, const Value& commandLine, const ProcessResult& pr)
@@ -0,0 +1,91 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "methods/tcpchecktask.hpp"
+#include "methods/nativechecktask.hpp"
+#include "icinga/checkcommand.hpp"
+#include "icinga/macroprocessor.hpp"
+#include "base/convert.hpp"
+#include "base/defer.hpp"
+#include "base/function.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/utility.hpp"
+
+using namespace icinga;
+
+REGISTER_FUNCTION_NONCONST(Internal, TcpCheck, &TcpCheckTask::ScriptFunc, "checkable:cr:resolvedMacros:useResolvedMacros");
+
+void TcpCheckTask::ScriptFunc(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr,
+	const Dictionary::Ptr& resolvedMacros, bool useResolvedMacros)
+{
+	namespace asio = boost::asio;
+
+	REQUIRE_NOT_NULL(checkable);
+	REQUIRE_NOT_NULL(cr);
+
+	CheckCommand::Ptr commandObj = CheckCommand::ExecuteOverride ? CheckCommand::ExecuteOverride : checkable->GetCheckCommand();
+	MacroProcessor::ResolverList resolvers = NativeCheckTask::GetResolvers(checkable, commandObj);
+
+	auto resolve ([&checkable, &resolvers, &resolvedMacros, useResolvedMacros](const String& macro) {
+		return MacroProcessor::ResolveMacros(macro, resolvers, checkable->GetLastCheckResult(),
+			nullptr, MacroProcessor::EscapeCallback(), resolvedMacros, useResolvedMacros);
+	});
+
+	String address = resolve("$tcp_address$");
+	String port = resolve("$tcp_port$");
+	Value wtime = resolve("$tcp_wtime$");
+	Value ctime = resolve("$tcp_ctime$");
+
+	if (resolvedMacros && !useResolvedMacros)
+		return;
+
+	double timeout = NativeCheckTask::GetTimeout(checkable, commandObj);
+
+	NativeCheckTask::Run(checkable, cr, commandObj, [address, port, wtime, ctime, timeout](asio::yield_context yc,
+		const NativeCheckTask::Strand& strand, NativeCheckResult& result) {
+		if (address.IsEmpty() || port.IsEmpty()) {
+			result.Output = "UNKNOWN - Both tcp_address and tcp_port must be set.";
+			return;
+		}
+
+		asio::ip::tcp::socket socket (strand->context());
+		asio::ip::tcp::resolver resolver (strand->context());
+		bool expired = false;
+
+		Timeout::Ptr connectTimeout = NativeCheckTask::StartTimeout(strand, timeout, [&socket, &resolver, &expired]() {
+			expired = true;
+
+			boost::system::error_code ec;
+			resolver.cancel();
+			socket.cancel(ec);
+		});
+
+		Defer cancelTimeout ([&connectTimeout]() { connectTimeout->Cancel(); });
+
+		double start = Utility::GetTime();
+
+		try {
+			NativeCheckTask::Connect(socket, resolver, address, port, expired, yc);
+		} catch (const boost::system::system_error& ex) {
+			result.State = ServiceCritical;
+
+			if (expired)
+				result.Output = "CRITICAL - Socket timeout after " + Convert::ToString(timeout) + " seconds";
+			else
+				result.Output = "connect to address " + address + " and port " + port + ": " + ex.code().message();
+
+			return;
+		}
+
+		double elapsed = Utility::GetTime() - start;
+
+		boost::system::error_code ec;
+		socket.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+
+		result.State = NativeCheckTask::CheckThresholds(elapsed, wtime, ctime);
+		result.Output = "TCP " + NativeCheckTask::GetStateText(result.State) + " - " + NativeCheckTask::FormatNumber(elapsed, 3)
+			+ " second response time on " + address + " port " + port;
+		result.PerformanceData = new Array({
+			new PerfdataValue("time", elapsed, false, "s", wtime, ctime, 0, timeout)
+		});
+	});
+}
@@ -10,7 +10,10 @@
 #include "base/utility.hpp"
 #include "base/exception.hpp"
 #include "base/statsfunction.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/convert.hpp"
 #include "remote/apilistener.hpp"
+#include <algorithm>
 
 using namespace icinga;
 
@@ -18,12 +21,38 @@ REGISTER_TYPE(NotificationComponent);
 
 REGISTER_STATSFUNCTION(NotificationComponent, &NotificationComponent::StatsFunc);
 
-void NotificationComponent::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+void NotificationComponent::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
 	DictionaryData nodes;
 
 	for (const NotificationComponent::Ptr& notification_component : ConfigType::GetObjectsByType<NotificationComponent>()) {
-		nodes.emplace_back(notification_component->GetName(), 1); //add more stats
+		size_t reminders, pending, dispatched;
+		double latencyAvg, latencyMax;
+
+		{
+			std::unique_lock<std::mutex> lock (notification_component->m_Mutex);
+
+			reminders = notification_component->m_ReminderNotifications.size();
+			pending = notification_component->m_PendingNotifications.size();
+			dispatched = notification_component->m_LastDispatched;
+			latencyAvg = notification_component->m_DispatchLatencyAvg;
+			latencyMax = notification_component->m_DispatchLatencyMax;
+		}
+
+		String perfdata_prefix = "notificationcomponent_" + notification_component->GetName() + "_";
+
+		nodes.emplace_back(notification_component->GetName(), new Dictionary({
+			{ "reminders", reminders },
+			{ "pending", pending },
+			{ "dispatched", dispatched },
+			{ "avg_dispatch_latency", latencyAvg },
+			{ "max_dispatch_latency", latencyMax }
+		}));
+
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "reminders", Convert::ToDouble(reminders)));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "pending", Convert::ToDouble(pending)));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "avg_dispatch_latency", latencyAvg));
+		perfdata->Add(new PerfdataValue(perfdata_prefix + "max_dispatch_latency", latencyMax));
 	}
 
 	status->Set("notificationcomponent", new Dictionary(std::move(nodes)));
@@ -44,6 +73,26 @@ void NotificationComponent::Start(bool runtimeCreated)
 		SendNotificationsHandler(checkable, type, cr, author, text);
 	});
 
+	ConfigObject::OnActiveChanged.connect([this](const ConfigObject::Ptr& object, const Value&) {
+		Notification::Ptr notification = dynamic_pointer_cast<Notification>(object);
+
+		if (notification)
+			ObjectHandler(notification);
+	});
+
+	auto fieldChanged ([this](const Notification::Ptr& notification, const Value&) { ObjectHandler(notification); });
+
+	ObjectImpl<Notification>::OnNextNotificationChanged.connect(fieldChanged);
+	ObjectImpl<Notification>::OnIntervalChanged.connect(fieldChanged);
+	ObjectImpl<Notification>::OnNoMoreNotificationsChanged.connect(fieldChanged);
+	ObjectImpl<Notification>::OnSuppressedNotificationsChanged.connect(fieldChanged);
+
+	Notification::OnNotificationStashed.connect([this](const Notification::Ptr& notification) { ObjectHandler(notification); });
+
+	/* Notifications which have been activated before us, e.g. with state from the last run. */
+	for (const Notification::Ptr& notification : ConfigType::GetObjectsByType<Notification>())
+		ObjectHandler(notification);
+
 	m_NotificationTimer = new Timer();
 	m_NotificationTimer->SetInterval(5);
 	m_NotificationTimer->OnTimerExpired.connect([this](const Timer * const&) { NotificationTimerHandler(); });
@@ -122,7 +171,31 @@ void FireSuppressedNotifications(const Notification::Ptr& notification)
 }
 
 /**
- * Periodically sends notifications.
+ * Files a notification into the reminder queue and the pending set
+ * according to its current attributes.
+ */
+void NotificationComponent::ObjectHandler(const Notification::Ptr& notification)
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	m_ReminderNotifications.erase(notification);
+
+	if (!notification->IsActive()) {
+		m_PendingNotifications.erase(notification);
+		return;
+	}
+
+	/* Sent out once and interval=0 disables reminder notifications, see ProcessNotification(). */
+	if (notification->GetInterval() > 0 || !notification->GetNoMoreNotifications())
+		m_ReminderNotifications.insert(NotificationScheduleInfo{ notification, notification->GetNextNotification() });
+
+	if (notification->GetSuppressedNotifications() || notification->GetStashedNotifications()->GetLength())
+		m_PendingNotifications.insert(notification);
+}
+
+/**
+ * Periodically sends notifications. Only visits notifications which are
+ * due for a reminder or have stashed or suppressed notifications.
  *
  * @param - Event arguments for the timer.
  */
@@ -133,126 +206,177 @@ void NotificationComponent::NotificationTimerHandler()
 	/* Function already checks whether 'api' feature is enabled. */
 	Endpoint::Ptr myEndpoint = Endpoint::GetLocalEndpoint();
 
-	for (const Notification::Ptr& notification : ConfigType::GetObjectsByType<Notification>()) {
-		if (!notification->IsActive())
-			continue;
+	std::vector<Notification::Ptr> notifications;
 
-		String notificationName = notification->GetName();
-		bool updatedObjectAuthority = ApiListener::UpdatedObjectAuthority();
+	{
+		std::unique_lock<std::mutex> lock (m_Mutex);
 
-		/* Skip notification if paused, in a cluster setup & HA feature is enabled. */
-		if (notification->IsPaused()) {
-			if (updatedObjectAuthority) {
-				auto stashedNotifications (notification->GetStashedNotifications());
-				ObjectLock olock(stashedNotifications);
+		notifications.assign(m_PendingNotifications.begin(), m_PendingNotifications.end());
 
-				if (stashedNotifications->GetLength()) {
-					Log(LogNotice, "NotificationComponent")
-						<< "Notification '" << notificationName << "': HA cluster active, this endpoint does not have the authority. Dropping all stashed notifications.";
+		auto& idx (m_ReminderNotifications.get<1>());
 
-					stashedNotifications->Clear();
-				}
-			}
+		for (auto it (idx.begin()); it != idx.end() && it->NextNotification <= now; ++it)
+			notifications.emplace_back(it->Object);
+	}
+
+	std::sort(notifications.begin(), notifications.end());
+	notifications.erase(std::unique(notifications.begin(), notifications.end()), notifications.end());
+
+	std::vector<double> latencies;
+
+	for (const Notification::Ptr& notification : notifications) {
+		ProcessNotification(notification, now, myEndpoint, latencies);
+
+		std::unique_lock<std::mutex> lock (m_Mutex);
+
+		if (!notification->GetSuppressedNotifications() && !notification->GetStashedNotifications()->GetLength())
+			m_PendingNotifications.erase(notification);
+	}
+
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	m_LastDispatched = latencies.size();
+	m_DispatchLatencyAvg = 0;
+	m_DispatchLatencyMax = 0;
+
+	for (double latency : latencies) {
+		m_DispatchLatencyAvg += latency / latencies.size();
+		m_DispatchLatencyMax = std::max(m_DispatchLatencyMax, latency);
+	}
+}
+
+/**
+ * Sends a notification's stashed, suppressed and reminder notifications.
+ *
+ * @param latencies Receives how late reminder notifications have been sent
+ */
+void NotificationComponent::ProcessNotification(const Notification::Ptr& notification, double now,
+	const Endpoint::Ptr& myEndpoint, std::vector<double>& latencies)
+{
+	if (!notification->IsActive())
+		return;
+
+	String notificationName = notification->GetName();
+	bool updatedObjectAuthority = ApiListener::UpdatedObjectAuthority();
 
-			if (myEndpoint && GetEnableHA()) {
+	/* Skip notification if paused, in a cluster setup & HA feature is enabled. */
+	if (notification->IsPaused()) {
+		if (updatedObjectAuthority) {
+			auto stashedNotifications (notification->GetStashedNotifications());
+			ObjectLock olock(stashedNotifications);
+
+			if (stashedNotifications->GetLength()) {
 				Log(LogNotice, "NotificationComponent")
-					<< "Reminder notification '" << notificationName << "': HA cluster active, this endpoint does not have the authority (paused=true). Skipping.";
-				continue;
+					<< "Notification '" << notificationName << "': HA cluster active, this endpoint does not have the authority. Dropping all stashed notifications.";
+
+				stashedNotifications->Clear();
 			}
 		}
 
-		Checkable::Ptr checkable = notification->GetCheckable();
+		if (myEndpoint && GetEnableHA()) {
+			Log(LogNotice, "NotificationComponent")
+				<< "Reminder notification '" << notificationName << "': HA cluster active, this endpoint does not have the authority (paused=true). Skipping.";
+			return;
+		}
+	}
+
+	Checkable::Ptr checkable = notification->GetCheckable();
+
+	if (!IcingaApplication::GetInstance()->GetEnableNotifications() || !checkable->GetEnableNotifications())
+		return;
 
-		if (!IcingaApplication::GetInstance()->GetEnableNotifications() || !checkable->GetEnableNotifications())
-			continue;
+	bool reachable = checkable->IsReachable(DependencyNotification);
 
-		bool reachable = checkable->IsReachable(DependencyNotification);
+	if (reachable) {
+		{
+			Array::Ptr unstashedNotifications = new Array();
 
-		if (reachable) {
 			{
-				Array::Ptr unstashedNotifications = new Array();
+				auto stashedNotifications (notification->GetStashedNotifications());
+				ObjectLock olock(stashedNotifications);
 
-				{
-					auto stashedNotifications (notification->GetStashedNotifications());
-					ObjectLock olock(stashedNotifications);
+				stashedNotifications->CopyTo(unstashedNotifications);
+				stashedNotifications->Clear();
+			}
 
-					stashedNotifications->CopyTo(unstashedNotifications);
-					stashedNotifications->Clear();
-				}
+			ObjectLock olock(unstashedNotifications);
 
-				ObjectLock olock(unstashedNotifications);
-
-				for (Dictionary::Ptr unstashedNotification : unstashedNotifications) {
-					try {
-						Log(LogNotice, "NotificationComponent")
-							<< "Attempting to send stashed notification '" << notificationName << "'.";
-
-						notification->BeginExecuteNotification(
-							(NotificationType)(int)unstashedNotification->Get("type"),
-							(CheckResult::Ptr)unstashedNotification->Get("cr"),
-							(bool)unstashedNotification->Get("force"),
-							(bool)unstashedNotification->Get("reminder"),
-							(String)unstashedNotification->Get("author"),
-							(String)unstashedNotification->Get("text")
-						);
-					} catch (const std::exception& ex) {
-						Log(LogWarning, "NotificationComponent")
-							<< "Exception occurred during notification for object '"
-							<< notificationName << "': " << DiagnosticInformation(ex, false);
-					}
+			for (Dictionary::Ptr unstashedNotification : unstashedNotifications) {
+				try {
+					Log(LogNotice, "NotificationComponent")
+						<< "Attempting to send stashed notification '" << notificationName << "'.";
+
+					notification->BeginExecuteNotification(
+						(NotificationType)(int)unstashedNotification->Get("type"),
+						(CheckResult::Ptr)unstashedNotification->Get("cr"),
+						(bool)unstashedNotification->Get("force"),
+						(bool)unstashedNotification->Get("reminder"),
+						(String)unstashedNotification->Get("author"),
+						(String)unstashedNotification->Get("text")
+					);
+				} catch (const std::exception& ex) {
+					Log(LogWarning, "NotificationComponent")
+						<< "Exception occurred during notification for object '"
+						<< notificationName << "': " << DiagnosticInformation(ex, false);
 				}
 			}
-
-			FireSuppressedNotifications(notification);
 		}
 
-		if (notification->GetInterval() <= 0 && notification->GetNoMoreNotifications()) {
-			Log(LogNotice, "NotificationComponent")
-				<< "Reminder notification '" << notificationName << "': Notification was sent out once and interval=0 disables reminder notifications.";
-			continue;
-		}
+		FireSuppressedNotifications(notification);
+	}
 
-		if (notification->GetNextNotification() > now)
-			continue;
+	if (notification->GetInterval() <= 0 && notification->GetNoMoreNotifications()) {
+		Log(LogNotice, "NotificationComponent")
+			<< "Reminder notification '" << notificationName << "': Notification was sent out once and interval=0 disables reminder notifications.";
+		return;
+	}
 
-		{
-			ObjectLock olock(notification);
-			notification->SetNextNotification(Utility::GetTime() + notification->GetInterval());
-		}
+	double nextNotification = notification->GetNextNotification();
 
-		{
-			Host::Ptr host;
-			Service::Ptr service;
-			tie(host, service) = GetHostService(checkable);
+	if (nextNotification > now)
+		return;
 
-			ObjectLock olock(checkable);
+	{
+		ObjectLock olock(notification);
+		notification->SetNextNotification(Utility::GetTime() + notification->GetInterval());
+	}
 
-			if (checkable->GetStateType() == StateTypeSoft)
-				continue;
+	{
+		Host::Ptr host;
+		Service::Ptr service;
+		tie(host, service) = GetHostService(checkable);
 
-			/* Don't send reminder notifications for OK/Up states. */
-			if ((service && service->GetState() == ServiceOK) || (!service && host->GetState() == HostUp))
-				continue;
+		ObjectLock olock(checkable);
 
-			/* Don't send reminder notifications before initial ones. */
-			if (checkable->GetSuppressedNotifications() & NotificationProblem)
-				continue;
+		if (checkable->GetStateType() == StateTypeSoft)
+			return;
 
-			/* Skip in runtime filters. */
-			if (!reachable || checkable->IsInDowntime() || checkable->IsAcknowledged() || checkable->IsFlapping())
-				continue;
-		}
+		/* Don't send reminder notifications for OK/Up states. */
+		if ((service && service->GetState() == ServiceOK) || (!service && host->GetState() == HostUp))
+			return;
 
-		try {
-			Log(LogNotice, "NotificationComponent")
-				<< "Attempting to send reminder notification '" << notificationName << "'.";
+		/* Don't send reminder notifications before initial ones. */
+		if (checkable->GetSuppressedNotifications() & NotificationProblem)
+			return;
 
-			notification->BeginExecuteNotification(NotificationProblem, checkable->GetLastCheckResult(), false, true);
-		} catch (const std::exception& ex) {
-			Log(LogWarning, "NotificationComponent")
-				<< "Exception occurred during notification for object '"
-				<< notificationName << "': " << DiagnosticInformation(ex, false);
-		}
+		/* Skip in runtime filters. */
+		if (!reachable || checkable->IsInDowntime() || checkable->IsAcknowledged() || checkable->IsFlapping())
+			return;
+	}
+
+	try {
+		Log(LogNotice, "NotificationComponent")
+			<< "Attempting to send reminder notification '" << notificationName << "'.";
+
+		notification->BeginExecuteNotification(NotificationProblem, checkable->GetLastCheckResult(), false, true);
+
+		/* The very first reminder of a notification has never been scheduled. */
+		if (nextNotification > 0)
+			latencies.push_back(Utility::GetTime() - nextNotification);
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "NotificationComponent")
+			<< "Exception occurred during notification for object '"
+			<< notificationName << "': " << DiagnosticInformation(ex, false);
 	}
 }
 
@@ -7,10 +7,25 @@
 #include "icinga/service.hpp"
 #include "base/configobject.hpp"
 #include "base/timer.hpp"
+#include <boost/multi_index_container.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index/key_extractors.hpp>
+#include <mutex>
+#include <set>
+#include <vector>
 
 namespace icinga
 {
 
+/**
+ * @ingroup notification
+ */
+struct NotificationScheduleInfo
+{
+	Notification::Ptr Object;
+	double NextNotification;
+};
+
 /**
  * @ingroup notification
  */
@@ -20,6 +35,14 @@ public:
 	DECLARE_OBJECT(NotificationComponent);
 	DECLARE_OBJECTNAME(NotificationComponent);
 
+	typedef boost::multi_index_container<
+		NotificationScheduleInfo,
+		boost::multi_index::indexed_by<
+			boost::multi_index::ordered_unique<boost::multi_index::member<NotificationScheduleInfo, Notification::Ptr, &NotificationScheduleInfo::Object> >,
+			boost::multi_index::ordered_non_unique<boost::multi_index::member<NotificationScheduleInfo, double, &NotificationScheduleInfo::NextNotification> >
+		>
+	> NotificationSet;
+
 	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 
 	void Start(bool runtimeCreated) override;
@@ -28,7 +51,22 @@ public:
 private:
 	Timer::Ptr m_NotificationTimer;
 
+	std::mutex m_Mutex;
+
+	/* Notifications which may send reminders, by when they're due. */
+	NotificationSet m_ReminderNotifications;
+
+	/* Notifications with stashed or suppressed notifications, visited on every run. */
+	std::set<Notification::Ptr> m_PendingNotifications;
+
+	double m_DispatchLatencyAvg{0};
+	double m_DispatchLatencyMax{0};
+	size_t m_LastDispatched{0};
+
+	void ObjectHandler(const Notification::Ptr& notification);
 	void NotificationTimerHandler();
+	void ProcessNotification(const Notification::Ptr& notification, double now,
+		const Endpoint::Ptr& myEndpoint, std::vector<double>& latencies);
 	void SendNotificationsHandler(const Checkable::Ptr& checkable, NotificationType type,
 		const CheckResult::Ptr& cr, const String& author, const String& text);
 };
@@ -7,17 +7,20 @@
 #include "icinga/service.hpp"
 #include "icinga/checkcommand.hpp"
 #include "base/application.hpp"
-#include "base/defer.hpp"
 #include "base/io-engine.hpp"
 #include "base/tcpsocket.hpp"
 #include "base/stream.hpp"
 #include "base/base64.hpp"
+#include "base/defer.hpp"
 #include "base/json.hpp"
 #include "base/utility.hpp"
 #include "base/networkstream.hpp"
+#include "base/objectlock.hpp"
+#include "base/convert.hpp"
 #include "base/perfdatavalue.hpp"
 #include "base/exception.hpp"
 #include "base/statsfunction.hpp"
+#include "base/configuration.hpp"
 #include <boost/algorithm/string.hpp>
 #include <boost/asio/ssl/context.hpp>
 #include <boost/beast/core/flat_buffer.hpp>
@@ -30,12 +33,22 @@
 #include <boost/beast/http/verb.hpp>
 #include <boost/beast/http/write.hpp>
 #include <boost/scoped_array.hpp>
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <utility>
 
 using namespace icinga;
 
+/* Maximum number of events handled per WQ task, so that other tasks aren't starved. */
+static const size_t l_EventBatchSize = 4096;
+
+/* How often bulk items which Elasticsearch rejected temporarily are sent again. */
+static const int l_BulkRetries = 3;
+
+/* Delay in seconds before the first retry, doubled for each retry. */
+static const double l_BulkRetryDelay = 0.5;
+
 REGISTER_TYPE(ElasticsearchWriter);
 
 REGISTER_STATSFUNCTION(ElasticsearchWriter, &ElasticsearchWriter::StatsFunc);
@@ -44,8 +57,6 @@ void ElasticsearchWriter::OnConfigLoaded()
 {
 	ObjectImpl<ElasticsearchWriter>::OnConfigLoaded();
 
-	m_WorkQueue.SetName("ElasticsearchWriter, " + GetName());
-
 	if (!GetEnableHa()) {
 		Log(LogDebug, "ElasticsearchWriter")
 			<< "HA functionality disabled. Won't pause connection: " << GetName();
@@ -61,16 +72,26 @@ void ElasticsearchWriter::StatsFunc(const Dictionary::Ptr& status, const Array::
 	DictionaryData nodes;
 
 	for (const ElasticsearchWriter::Ptr& elasticsearchwriter : ConfigType::GetObjectsByType<ElasticsearchWriter>()) {
-		size_t workQueueItems = elasticsearchwriter->m_WorkQueue.GetLength();
-		double workQueueItemRate = elasticsearchwriter->m_WorkQueue.GetTaskCount(60) / 60.0;
+		String prefix = "elasticsearchwriter_" + elasticsearchwriter->GetName();
+		Dictionary::Ptr stats = elasticsearchwriter->GetExportStats();
+
+		uint_fast64_t retriedItems = elasticsearchwriter->m_RetriedItems.load();
+		uint_fast64_t rejectedItems = elasticsearchwriter->m_RejectedItems.load();
+
+		stats->Set("event_ring_items", elasticsearchwriter->m_Events.GetLength());
+		stats->Set("retried_items", retriedItems);
+		stats->Set("rejected_items", rejectedItems);
+
+		elasticsearchwriter->AddExportPerfdata(prefix, perfdata);
+		perfdata->Add(new PerfdataValue(prefix + "_retried_items", retriedItems, true));
+		perfdata->Add(new PerfdataValue(prefix + "_rejected_items", rejectedItems, true));
+
+		PerfdataSpool::Ptr spool = elasticsearchwriter->m_Spool;
 
-		nodes.emplace_back(elasticsearchwriter->GetName(), new Dictionary({
-			{ "work_queue_items", workQueueItems },
-			{ "work_queue_item_rate", workQueueItemRate }
-		}));
+		if (spool)
+			spool->AddStats(stats, prefix, perfdata);
 
-		perfdata->Add(new PerfdataValue("elasticsearchwriter_" + elasticsearchwriter->GetName() + "_work_queue_items", workQueueItems));
-		perfdata->Add(new PerfdataValue("elasticsearchwriter_" + elasticsearchwriter->GetName() + "_work_queue_item_rate", workQueueItemRate));
+		nodes.emplace_back(elasticsearchwriter->GetName(), stats);
 	}
 
 	status->Set("elasticsearchwriter", new Dictionary(std::move(nodes)));
@@ -87,9 +108,20 @@ void ElasticsearchWriter::Resume()
 
 	m_WorkQueue.SetExceptionCallback([this](boost::exception_ptr exp) { ExceptionHandler(std::move(exp)); });
 
+	/* Flushes block once all requests are in flight and one more batch is waiting. */
+	m_SendQueue.reset(new WorkQueue(GetMaxConcurrentRequests(), GetMaxConcurrentRequests()));
+	m_SendQueue->SetName("ElasticsearchWriter, " + GetName() + ", bulk");
+	m_SendQueue->SetExceptionCallback([this](boost::exception_ptr exp) { ExceptionHandler(std::move(exp)); });
+
+	if (GetEnableSpool()) {
+		m_Spool = new PerfdataSpool(Configuration::DataDir + "/spool/elasticsearchwriter/" + GetName(),
+			static_cast<uint_fast64_t>(GetSpoolSizeLimit()) * 1024u * 1024u);
+	}
+
 	/* Setup timer for periodically flushing m_DataBuffer */
 	m_FlushTimer = new Timer();
 	m_FlushTimer->SetInterval(GetFlushInterval());
+	m_FlushTimer->SetSlack(1);
 	m_FlushTimer->OnTimerExpired.connect([this](const Timer * const&) { FlushTimeout(); });
 	m_FlushTimer->Start();
 	m_FlushTimer->Reschedule(0);
@@ -112,9 +144,19 @@ void ElasticsearchWriter::Resume()
 /* Pause is equivalent to Stop, but with HA capabilities to resume at runtime. */
 void ElasticsearchWriter::Pause()
 {
-	Flush();
+	{
+		std::unique_lock<std::mutex> lock(m_DataBufferMutex);
+		Flush();
+	}
+
 	m_WorkQueue.Join();
-	Flush();
+
+	{
+		std::unique_lock<std::mutex> lock(m_DataBufferMutex);
+		Flush();
+	}
+
+	m_SendQueue->Join();
 
 	Log(LogInformation, "ElasticsearchWriter")
 		<< "'" << GetName() << "' paused.";
@@ -146,51 +188,39 @@ void ElasticsearchWriter::AddCheckResult(const Dictionary::Ptr& fields, const Ch
 	if (!GetEnableSendPerfdata())
 		return;
 
-	Array::Ptr perfdata = cr->GetPerformanceData();
+	ParsedPerfdata::Ptr perfdata = cr->GetParsedPerformanceData();
 
 	CheckCommand::Ptr checkCommand = checkable->GetCheckCommand();
 
-	if (perfdata) {
-		ObjectLock olock(perfdata);
-		for (const Value& val : perfdata) {
-			PerfdataValue::Ptr pdv;
-
-			if (val.IsObjectType<PerfdataValue>())
-				pdv = val;
-			else {
-				try {
-					pdv = PerfdataValue::Parse(val);
-				} catch (const std::exception&) {
-					Log(LogWarning, "ElasticsearchWriter")
-						<< "Ignoring invalid perfdata for checkable '"
-						<< checkable->GetName() << "' and command '"
-						<< checkCommand->GetName() << "' with value: " << val;
-					continue;
-				}
-			}
+	for (const Value& val : perfdata->GetInvalid()) {
+		Log(LogWarning, "ElasticsearchWriter")
+			<< "Ignoring invalid perfdata for checkable '"
+			<< checkable->GetName() << "' and command '"
+			<< checkCommand->GetName() << "' with value: " << val;
+	}
 
-			String escapedKey = pdv->GetLabel();
-			boost::replace_all(escapedKey, " ", "_");
-			boost::replace_all(escapedKey, ".", "_");
-			boost::replace_all(escapedKey, "\\", "_");
-			boost::algorithm::replace_all(escapedKey, "::", ".");
+	for (size_t i = 0, length = perfdata->GetLength(); i < length; i++) {
+		String escapedKey = perfdata->GetLabel(i);
+		boost::replace_all(escapedKey, " ", "_");
+		boost::replace_all(escapedKey, ".", "_");
+		boost::replace_all(escapedKey, "\\", "_");
+		boost::algorithm::replace_all(escapedKey, "::", ".");
 
-			String perfdataPrefix = prefix + "perfdata." + escapedKey;
+		String perfdataPrefix = prefix + "perfdata." + escapedKey;
 
-			fields->Set(perfdataPrefix + ".value", pdv->GetValue());
+		fields->Set(perfdataPrefix + ".value", perfdata->GetValue(i));
 
-			if (!pdv->GetMin().IsEmpty())
-				fields->Set(perfdataPrefix + ".min", pdv->GetMin());
-			if (!pdv->GetMax().IsEmpty())
-				fields->Set(perfdataPrefix + ".max", pdv->GetMax());
-			if (!pdv->GetWarn().IsEmpty())
-				fields->Set(perfdataPrefix + ".warn", pdv->GetWarn());
-			if (!pdv->GetCrit().IsEmpty())
-				fields->Set(perfdataPrefix + ".crit", pdv->GetCrit());
+		if (perfdata->HasMin(i))
+			fields->Set(perfdataPrefix + ".min", perfdata->GetMin(i));
+		if (perfdata->HasMax(i))
+			fields->Set(perfdataPrefix + ".max", perfdata->GetMax(i));
+		if (perfdata->HasWarn(i))
+			fields->Set(perfdataPrefix + ".warn", perfdata->GetWarn(i));
+		if (perfdata->HasCrit(i))
+			fields->Set(perfdataPrefix + ".crit", perfdata->GetCrit(i));
 
-			if (!pdv->GetUnit().IsEmpty())
-				fields->Set(perfdataPrefix + ".unit", pdv->GetUnit());
-		}
+		if (!perfdata->GetUnit(i).IsEmpty())
+			fields->Set(perfdataPrefix + ".unit", perfdata->GetUnit(i));
 	}
 }
 
@@ -199,7 +229,52 @@ void ElasticsearchWriter::CheckResultHandler(const Checkable::Ptr& checkable, co
 	if (IsPaused())
 		return;
 
-	m_WorkQueue.Enqueue([this, checkable, cr]() { InternalCheckResultHandler(checkable, cr); });
+	PushEvent({ checkable, cr, StateTypeHard, false });
+}
+
+/**
+ * Hands an event over to the WQ, which drains the ring in batches.
+ *
+ * Only the first event after the ring has been drained enqueues a task.
+ *
+ * @param event The event
+ */
+void ElasticsearchWriter::PushEvent(ExportEvent&& event)
+{
+	if (!m_Events.TryPush(std::move(event))) {
+		/* Fall back to a closure while the ring is full, so queue_limit still applies. */
+		EnqueueExport([this, event]() { HandleEvent(event); });
+		return;
+	}
+
+	if (!m_EventsScheduled.exchange(true))
+		m_WorkQueue.Enqueue([this]() { DrainEvents(); });
+}
+
+/**
+ * Drains a batch of events and schedules another batch if there are more.
+ *
+ * Called inside the WQ.
+ */
+void ElasticsearchWriter::DrainEvents()
+{
+	AssertOnWorkQueue();
+
+	/* Reset first, so that events pushed while draining schedule another run. */
+	m_EventsScheduled = false;
+
+	m_Events.Drain(l_EventBatchSize, [this](const ExportEvent& event) { HandleEvent(event); });
+
+	if (!m_Events.IsEmpty() && !m_EventsScheduled.exchange(true))
+		m_WorkQueue.Enqueue([this]() { DrainEvents(); });
+}
+
+void ElasticsearchWriter::HandleEvent(const ExportEvent& event)
+{
+	if (event.StateChange)
+		StateChangeHandlerInternal(event.Object, event.Result, event.Type);
+	else
+		InternalCheckResultHandler(event.Object, event.Result);
 }
 
 void ElasticsearchWriter::InternalCheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr)
@@ -256,7 +331,7 @@ void ElasticsearchWriter::StateChangeHandler(const Checkable::Ptr& checkable, co
 	if (IsPaused())
 		return;
 
-	m_WorkQueue.Enqueue([this, checkable, cr, type]() { StateChangeHandlerInternal(checkable, cr, type); });
+	PushEvent({ checkable, cr, type, true });
 }
 
 void ElasticsearchWriter::StateChangeHandlerInternal(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr, StateType type)
@@ -308,7 +383,7 @@ void ElasticsearchWriter::NotificationSentToAllUsersHandler(const Notification::
 	if (IsPaused())
 		return;
 
-	m_WorkQueue.Enqueue([this, notification, checkable, users, type, cr, author, text]() {
+	EnqueueExport([this, notification, checkable, users, type, cr, author, text]() {
 		NotificationSentToAllUsersHandlerInternal(notification, checkable, users, type, cr, author, text);
 	});
 }
@@ -394,9 +469,10 @@ void ElasticsearchWriter::Enqueue(const Checkable::Ptr& checkable, const String&
 		<< "Checkable '" << checkable->GetName() << "' adds to metric list: '" << fieldsBody << "'.";
 
 	m_DataBuffer.emplace_back(indexBody + fieldsBody);
+	m_DataBufferSize += m_DataBuffer.back().GetLength() + 1u;
 
 	/* Flush if we've buffered too much to prevent excessive memory use. */
-	if (static_cast<int>(m_DataBuffer.size()) >= GetFlushThreshold()) {
+	if (static_cast<int>(m_DataBuffer.size()) >= GetFlushThreshold() || m_DataBufferSize >= static_cast<size_t>(GetFlushSizeThreshold())) {
 		Log(LogDebug, "ElasticsearchWriter")
 			<< "Data buffer overflow writing " << m_DataBuffer.size() << " data points";
 		Flush();
@@ -414,10 +490,24 @@ void ElasticsearchWriter::FlushTimeout()
 	if (m_DataBuffer.size() > 0) {
 		Log(LogDebug, "ElasticsearchWriter")
 			<< "Timer expired writing " << m_DataBuffer.size() << " data points";
+
 		Flush();
 	}
+
+	if (m_Reachable && m_Spool && !m_Draining.exchange(true)) {
+		m_SendQueue->Enqueue([this]() {
+			DrainSpool();
+			m_Draining = false;
+		}, PriorityLow);
+	}
 }
 
+/**
+ * Hands the buffered data points over to the bulk request queue,
+ * or spools them if the queue is full.
+ *
+ * Called with m_DataBufferMutex held.
+ */
 void ElasticsearchWriter::Flush()
 {
 	/* Flush can be called from 1) Timeout 2) Threshold 3) on shutdown/reload. */
@@ -427,18 +517,125 @@ void ElasticsearchWriter::Flush()
 	/* Ensure you hold a lock against m_DataBuffer so that things
 	 * don't go missing after creating the body and clearing the buffer.
 	 */
-	String body = boost::algorithm::join(m_DataBuffer, "\n");
-	m_DataBuffer.clear();
+	auto points (std::make_shared<std::vector<String>>());
+	points->swap(m_DataBuffer);
+	m_DataBufferSize = 0;
 
-	/* Elasticsearch 6.x requires a new line. This is compatible to 5.x.
-	 * Tested with 6.0.0 and 5.6.4.
-	 */
-	body += "\n";
+	/* Don't wait for a free request slot while more and more data points pile up in memory. */
+	if (m_Spool && m_SendQueue->GetLength() >= static_cast<size_t>(GetMaxConcurrentRequests())) {
+		Log(LogWarning, "ElasticsearchWriter")
+			<< "All requests to Elasticsearch are busy, spooling " << points->size() << " data points to disk.";
+
+		m_Spool->Append(*points);
+		return;
+	}
+
+	m_SendQueue->Enqueue([this, points]() { SendBulk(*points); });
+}
+
+/**
+ * Sends a bulk request and retries the items which Elasticsearch rejected
+ * temporarily. Spools the data points if Elasticsearch isn't reachable.
+ *
+ * @param points The data points, consumed
+ */
+void ElasticsearchWriter::SendBulk(std::vector<String>& points)
+{
+	for (int attempt = 0;; attempt++) {
+		std::vector<String> retry;
+		bool sent;
+
+		try {
+			sent = SendRequest(points, retry);
+		} catch (const std::exception&) {
+			m_Reachable = false;
+
+			if (!m_Spool)
+				throw;
+
+			sent = false;
+		}
+
+		m_Reachable = sent;
+
+		if (!sent) {
+			if (m_Spool) {
+				Log(LogWarning, "ElasticsearchWriter")
+					<< "Spooling " << points.size() << " data points to disk.";
+
+				m_Spool->Append(points);
+			}
+
+			return;
+		}
+
+		if (retry.empty())
+			return;
+
+		if (attempt >= l_BulkRetries) {
+			if (m_Spool) {
+				Log(LogWarning, "ElasticsearchWriter")
+					<< "Elasticsearch still rejects " << retry.size() << " data points, spooling them to disk.";
+
+				m_Spool->Append(retry);
+			} else {
+				Log(LogWarning, "ElasticsearchWriter")
+					<< "Elasticsearch still rejects " << retry.size() << " data points, dropping them.";
+
+				m_RejectedItems += retry.size();
+			}
 
-	SendRequest(body);
+			return;
+		}
+
+		Log(LogNotice, "ElasticsearchWriter")
+			<< "Retrying " << retry.size() << " of " << points.size() << " data points rejected by Elasticsearch.";
+
+		m_RetriedItems += retry.size();
+
+		Utility::Sleep(l_BulkRetryDelay * (1 << attempt));
+
+		points.swap(retry);
+	}
+}
+
+/**
+ * Re-sends spooled data points, at most spool_drain_rate per second.
+ */
+void ElasticsearchWriter::DrainSpool()
+{
+	if (!m_Spool || m_Spool->IsEmpty())
+		return;
+
+	size_t limit = static_cast<size_t>(GetSpoolDrainRate()) * std::max(GetFlushInterval(), 1);
+
+	try {
+		size_t drained = m_Spool->Drain(limit, std::max(GetFlushThreshold(), 1), [this](const std::vector<String>& points) {
+			std::vector<String> retry;
+
+			if (!SendRequest(points, retry))
+				BOOST_THROW_EXCEPTION(std::runtime_error("Cannot connect to Elasticsearch."));
+
+			/* Try the rejected ones again on the next drain. */
+			if (!retry.empty())
+				m_Spool->Append(retry);
+		});
+
+		Log(LogNotice, "ElasticsearchWriter")
+			<< "Sent " << drained << " spooled data points.";
+	} catch (const std::exception&) {
+		/* Already logged, try again on the next flush. */
+	}
 }
 
-void ElasticsearchWriter::SendRequest(const String& body)
+/**
+ * Sends a bulk request.
+ *
+ * @param points The bulk actions, one per data point
+ * @param retry Receives the data points which have been rejected temporarily
+ * @return Whether the connection could be established
+ */
+bool ElasticsearchWriter::SendRequest(const std::vector<String>& points, std::vector<String>& retry)
 {
 	namespace beast = boost::beast;
 	namespace http = beast::http;
@@ -473,7 +670,7 @@ void ElasticsearchWriter::SendRequest(const String& body)
 	} catch (const std::exception& ex) {
 		Log(LogWarning, "ElasticsearchWriter")
 			<< "Flush failed, cannot connect to Elasticsearch: " << DiagnosticInformation(ex, false);
-		return;
+		return false;
 	}
 
 	Defer s ([&stream]() {
@@ -503,7 +700,10 @@ void ElasticsearchWriter::SendRequest(const String& body)
 	if (!username.IsEmpty() && !password.IsEmpty())
 		request.set(http::field::authorization, "Basic " + Base64::Encode(username + ":" + password));
 
-	request.body() = body;
+	/* Elasticsearch 6.x requires a new line. This is compatible to 5.x.
+	 * Tested with 6.0.0 and 5.6.4.
+	 */
+	request.body() = boost::algorithm::join(points, "\n") + "\n";
 	request.content_length(request.body().size());
 
 	/* Don't log the request body to debug log, this is already done above. */
@@ -542,6 +742,15 @@ void ElasticsearchWriter::SendRequest(const String& body)
 
 	auto& response (parser.get());
 
+	/* The whole request has been rejected due to overload. */
+	if (response.result() == http::status::too_many_requests || response.result() == http::status::service_unavailable) {
+		Log(LogWarning, "ElasticsearchWriter")
+			<< "Elasticsearch rejected the bulk request with response code " << response.result_int() << ".";
+
+		retry = points;
+		return true;
+	}
+
 	if (response.result_int() > 299) {
 		if (response.result() == http::status::unauthorized) {
 			/* More verbose error logging with Elasticsearch is hidden behind a proxy. */
@@ -554,7 +763,7 @@ void ElasticsearchWriter::SendRequest(const String& body)
 					<< "401 Unauthorized. The HTTP API requires authentication but no username/password has been configured.";
 			}
 
-			return;
+			return true;
 		}
 
 		std::ostringstream msgbuf;
@@ -579,14 +788,85 @@ void ElasticsearchWriter::SendRequest(const String& body)
 		} catch (...) {
 			Log(LogWarning, "ElasticsearchWriter")
 				<< "Unable to parse JSON response:\n" << body;
-			return;
+			return true;
 		}
 
 		String error = jsonResponse->Get("error");
 
 		Log(LogCritical, "ElasticsearchWriter")
 			<< "Error: '" << error << "'. " << msgbuf.str();
+
+		return true;
+	}
+
+	auto& body (response.body());
+	Dictionary::Ptr jsonResponse;
+
+	try {
+		jsonResponse = JsonDecode(body);
+	} catch (...) {
+		Log(LogWarning, "ElasticsearchWriter")
+			<< "Unable to parse JSON response:\n" << body;
+		return true;
+	}
+
+	/* Set if any item failed, only then the items have to be checked. */
+	Value errors;
+
+	if (jsonResponse->Get("errors", &errors) && !errors.ToBool())
+		return true;
+
+	Array::Ptr items = jsonResponse->Get("items");
+
+	if (!items)
+		return true;
+
+	ObjectLock olock(items);
+	size_t index = 0;
+	size_t rejected = 0;
+	String firstError;
+
+	for (const Value& item : items) {
+		if (index >= points.size())
+			break;
+
+		/* Each item has the action type as its only key. */
+		Dictionary::Ptr result;
+
+		if (item.IsObjectType<Dictionary>()) {
+			Dictionary::Ptr action = item;
+			ObjectLock actionLock(action);
+
+			for (const Dictionary::Pair& kv : action) {
+				if (kv.second.IsObjectType<Dictionary>())
+					result = kv.second;
+
+				break;
+			}
+		}
+
+		long status = result ? Convert::ToLong(result->Get("status")) : 0;
+
+		if (status == 429 || status >= 500) {
+			retry.push_back(points[index]);
+		} else if (status > 299) {
+			if (firstError.IsEmpty())
+				firstError = JsonEncode(result->Get("error"));
+
+			rejected++;
+		}
+
+		index++;
 	}
+
+	if (rejected > 0u) {
+		m_RejectedItems += rejected;
+
+		Log(LogWarning, "ElasticsearchWriter")
+			<< "Elasticsearch rejected " << rejected << " of " << points.size() << " data points, e.g.: " << firstError;
+	}
+
+	return true;
 }
 
 OptionalTlsStream ElasticsearchWriter::Connect()
@@ -667,3 +947,35 @@ String ElasticsearchWriter::FormatTimestamp(double ts)
 
 	return Utility::FormatDateTime("%Y-%m-%dT%H:%M:%S", ts) + "." + Convert::ToString(milliSeconds) + Utility::FormatDateTime("%z", ts);
 }
+
+void ElasticsearchWriter::ValidateSpoolSizeLimit(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ElasticsearchWriter>::ValidateSpoolSizeLimit(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "spool_size_limit" }, "Value must be greater than 0."));
+}
+
+void ElasticsearchWriter::ValidateSpoolDrainRate(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ElasticsearchWriter>::ValidateSpoolDrainRate(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "spool_drain_rate" }, "Value must be greater than 0."));
+}
+
+void ElasticsearchWriter::ValidateFlushSizeThreshold(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ElasticsearchWriter>::ValidateFlushSizeThreshold(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "flush_size_threshold" }, "Value must be greater than 0."));
+}
+
+void ElasticsearchWriter::ValidateMaxConcurrentRequests(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ElasticsearchWriter>::ValidateMaxConcurrentRequests(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "max_concurrent_requests" }, "Value must be greater than 0."));
+}
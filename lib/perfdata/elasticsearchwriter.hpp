@@ -6,9 +6,15 @@
 #include "perfdata/elasticsearchwriter-ti.hpp"
 #include "icinga/service.hpp"
 #include "base/configobject.hpp"
+#include "base/eventring.hpp"
 #include "base/workqueue.hpp"
 #include "base/timer.hpp"
 #include "base/tlsstream.hpp"
+#include "perfdata/perfdataspool.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
 namespace icinga
 {
@@ -23,17 +29,44 @@ public:
 
 	static String FormatTimestamp(double ts);
 
+	void ValidateFlushSizeThreshold(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateMaxConcurrentRequests(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateSpoolSizeLimit(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateSpoolDrainRate(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+
 protected:
 	void OnConfigLoaded() override;
 	void Resume() override;
 	void Pause() override;
 
 private:
+	/* A check result, or a state change if StateChange is set. */
+	struct ExportEvent
+	{
+		Checkable::Ptr Object;
+		CheckResult::Ptr Result;
+		StateType Type;
+		bool StateChange;
+	};
+
+	/* Passes check results and state changes to the WQ without a closure per event. */
+	EventRing<ExportEvent> m_Events{65536};
+	std::atomic<bool> m_EventsScheduled{false};
+
 	String m_EventPrefix;
-	WorkQueue m_WorkQueue{10000000, 1};
 	Timer::Ptr m_FlushTimer;
 	std::vector<String> m_DataBuffer;
+	size_t m_DataBufferSize{0};
 	std::mutex m_DataBufferMutex;
+	PerfdataSpool::Ptr m_Spool;
+
+	/* Runs up to max_concurrent_requests bulk requests. */
+	std::unique_ptr<WorkQueue> m_SendQueue;
+	std::atomic<bool> m_Reachable{true};
+	std::atomic<bool> m_Draining{false};
+
+	std::atomic<uint_fast64_t> m_RetriedItems{0};
+	std::atomic<uint_fast64_t> m_RejectedItems{0};
 
 	void AddCheckResult(const Dictionary::Ptr& fields, const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
 
@@ -48,6 +81,10 @@ private:
 		const Checkable::Ptr& checkable, const std::set<User::Ptr>& users, NotificationType type,
 		const CheckResult::Ptr& cr, const String& author, const String& text);
 
+	void PushEvent(ExportEvent&& event);
+	void DrainEvents();
+	void HandleEvent(const ExportEvent& event);
+
 	void Enqueue(const Checkable::Ptr& checkable, const String& type,
 		const Dictionary::Ptr& fields, double ts);
 
@@ -56,7 +93,9 @@ private:
 	void ExceptionHandler(boost::exception_ptr exp);
 	void FlushTimeout();
 	void Flush();
-	void SendRequest(const String& body);
+	void DrainSpool();
+	void SendBulk(std::vector<String>& points);
+	bool SendRequest(const std::vector<String>& points, std::vector<String>& retry);
 };
 
 }
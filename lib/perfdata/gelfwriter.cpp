@@ -27,9 +27,20 @@
 #include <boost/asio/buffer.hpp>
 #include <boost/system/error_code.hpp>
 #include <boost/asio/error.hpp>
+#include <boost/beast/zlib/deflate_stream.hpp>
+#include <boost/crc.hpp>
 
 using namespace icinga;
 
+/* The batch of messages is written once it exceeds this size. */
+static const size_t l_MaxBatchSize = 64 * 1024;
+
+/* Magic bytes, message ID, sequence number and count of a chunk. */
+static const size_t l_ChunkHeaderSize = 12;
+
+/* Receivers discard messages split into more chunks. */
+static const size_t l_MaxChunks = 128;
+
 REGISTER_TYPE(GelfWriter);
 
 REGISTER_STATSFUNCTION(GelfWriter, &GelfWriter::StatsFunc);
@@ -38,8 +49,6 @@ void GelfWriter::OnConfigLoaded()
 {
 	ObjectImpl<GelfWriter>::OnConfigLoaded();
 
-	m_WorkQueue.SetName("GelfWriter, " + GetName());
-
 	if (!GetEnableHa()) {
 		Log(LogDebug, "GelfWriter")
 			<< "HA functionality disabled. Won't pause connection: " << GetName();
@@ -55,18 +64,14 @@ void GelfWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perf
 	DictionaryData nodes;
 
 	for (const GelfWriter::Ptr& gelfwriter : ConfigType::GetObjectsByType<GelfWriter>()) {
-		size_t workQueueItems = gelfwriter->m_WorkQueue.GetLength();
-		double workQueueItemRate = gelfwriter->m_WorkQueue.GetTaskCount(60) / 60.0;
-
-		nodes.emplace_back(gelfwriter->GetName(), new Dictionary({
-			{ "work_queue_items", workQueueItems },
-			{ "work_queue_item_rate", workQueueItemRate },
-			{ "connected", gelfwriter->GetConnected() },
-			{ "source", gelfwriter->GetSource() }
-		}));
-
-		perfdata->Add(new PerfdataValue("gelfwriter_" + gelfwriter->GetName() + "_work_queue_items", workQueueItems));
-		perfdata->Add(new PerfdataValue("gelfwriter_" + gelfwriter->GetName() + "_work_queue_item_rate", workQueueItemRate));
+		Dictionary::Ptr stats = gelfwriter->GetExportStats();
+		stats->Set("connected", gelfwriter->GetConnected());
+		stats->Set("source", gelfwriter->GetSource());
+		stats->Set("protocol", gelfwriter->GetProtocol());
+
+		nodes.emplace_back(gelfwriter->GetName(), stats);
+
+		gelfwriter->AddExportPerfdata("gelfwriter_" + gelfwriter->GetName(), perfdata);
 	}
 
 	status->Set("gelfwriter", new Dictionary(std::move(nodes)));
@@ -82,9 +87,21 @@ void GelfWriter::Resume()
 	/* Register exception handler for WQ tasks. */
 	m_WorkQueue.SetExceptionCallback([this](boost::exception_ptr exp) { ExceptionHandler(std::move(exp)); });
 
+	m_Udp = GetProtocol() == "udp";
+	m_Compression = GetCompression();
+	m_MessageIds.seed(std::random_device()());
+
+	/* Timer for writing partially filled batches */
+	m_BatchTimer = new Timer();
+	m_BatchTimer->SetInterval(GetBatchWindow());
+	m_BatchTimer->OnTimerExpired.connect([this](const Timer * const&) {
+		m_WorkQueue.Enqueue([this]() { FlushBatch(); });
+	});
+	m_BatchTimer->Start();
+
 	/* Timer for reconnecting */
 	m_ReconnectTimer = new Timer();
-	m_ReconnectTimer->SetInterval(10);
+	m_ReconnectTimer->SetInterval(ReconnectInterval);
 	m_ReconnectTimer->OnTimerExpired.connect([this](const Timer * const&) { ReconnectTimerHandler(); });
 	m_ReconnectTimer->Start();
 	m_ReconnectTimer->Reschedule(0);
@@ -108,6 +125,7 @@ void GelfWriter::Resume()
 void GelfWriter::Pause()
 {
 	m_ReconnectTimer.reset();
+	m_BatchTimer.reset();
 
 	try {
 		ReconnectInternal();
@@ -120,6 +138,7 @@ void GelfWriter::Pause()
 	}
 
 	m_WorkQueue.Join();
+	FlushBatch();
 	DisconnectInternal();
 
 	Log(LogInformation, "GelfWriter")
@@ -152,7 +171,14 @@ void GelfWriter::Reconnect()
 		return;
 	}
 
-	ReconnectInternal();
+	try {
+		ReconnectInternal();
+	} catch (const std::exception&) {
+		ReconnectFailed();
+		throw;
+	}
+
+	ReconnectSucceeded();
 }
 
 void GelfWriter::ReconnectInternal()
@@ -169,6 +195,26 @@ void GelfWriter::ReconnectInternal()
 	Log(LogNotice, "GelfWriter")
 		<< "Reconnecting to Graylog Gelf on host '" << GetHost() << "' port '" << GetPort() << "'.";
 
+	if (m_Udp) {
+		try {
+			boost::asio::ip::udp::resolver resolver (IoEngine::Get().GetIoContext());
+			boost::asio::ip::udp::resolver::query query (GetHost(), GetPort());
+
+			m_UdpSocket = Shared<UdpSocket>::Make(IoEngine::Get().GetIoContext());
+			m_UdpSocket->connect(resolver.resolve(query).begin()->endpoint());
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "GelfWriter")
+				<< "Can't connect to Graylog Gelf on host '" << GetHost() << "' port '" << GetPort() << ".'";
+			throw;
+		}
+
+		SetConnected(true);
+
+		Log(LogInformation, "GelfWriter")
+			<< "Finished reconnecting to Graylog Gelf in " << std::setw(2) << Utility::GetTime() - startTime << " second(s).";
+		return;
+	}
+
 	bool ssl = GetEnableTls();
 
 	if (ssl) {
@@ -216,6 +262,9 @@ void GelfWriter::ReconnectInternal()
 
 void GelfWriter::ReconnectTimerHandler()
 {
+	if (!ShouldReconnect())
+		return;
+
 	m_WorkQueue.Enqueue([this]() { Reconnect(); }, PriorityNormal);
 }
 
@@ -231,7 +280,15 @@ void GelfWriter::DisconnectInternal()
 	if (!GetConnected())
 		return;
 
-	if (m_Stream.first) {
+	/* Messages are only batched while connected. */
+	m_Batch.clear();
+	m_BatchMessages = 0;
+
+	if (m_UdpSocket) {
+		boost::system::error_code ec;
+		m_UdpSocket->close(ec);
+		m_UdpSocket.reset();
+	} else if (m_Stream.first) {
 		boost::system::error_code ec;
 		m_Stream.first->next_layer().shutdown(ec);
 
@@ -254,7 +311,7 @@ void GelfWriter::CheckResultHandler(const Checkable::Ptr& checkable, const Check
 	if (IsPaused())
 		return;
 
-	m_WorkQueue.Enqueue([this, checkable, cr]() { CheckResultHandlerInternal(checkable, cr); });
+	EnqueueExport([this, checkable, cr]() { CheckResultHandlerInternal(checkable, cr); });
 }
 
 void GelfWriter::CheckResultHandlerInternal(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr)
@@ -308,47 +365,35 @@ void GelfWriter::CheckResultHandlerInternal(const Checkable::Ptr& checkable, con
 	}
 
 	if (cr && GetEnableSendPerfdata()) {
-		Array::Ptr perfdata = cr->GetPerformanceData();
-
-		if (perfdata) {
-			ObjectLock olock(perfdata);
-			for (const Value& val : perfdata) {
-				PerfdataValue::Ptr pdv;
-
-				if (val.IsObjectType<PerfdataValue>())
-					pdv = val;
-				else {
-					try {
-						pdv = PerfdataValue::Parse(val);
-					} catch (const std::exception&) {
-						Log(LogWarning, "GelfWriter")
-							<< "Ignoring invalid perfdata for checkable '"
-							<< checkable->GetName() << "' and command '"
-							<< checkCommand->GetName() << "' with value: " << val;
-						continue;
-					}
-				}
-
-				String escaped_key = pdv->GetLabel();
-				boost::replace_all(escaped_key, " ", "_");
-				boost::replace_all(escaped_key, ".", "_");
-				boost::replace_all(escaped_key, "\\", "_");
-				boost::algorithm::replace_all(escaped_key, "::", ".");
-
-				fields->Set("_" + escaped_key, pdv->GetValue());
-
-				if (!pdv->GetMin().IsEmpty())
-					fields->Set("_" + escaped_key + "_min", pdv->GetMin());
-				if (!pdv->GetMax().IsEmpty())
-					fields->Set("_" + escaped_key + "_max", pdv->GetMax());
-				if (!pdv->GetWarn().IsEmpty())
-					fields->Set("_" + escaped_key + "_warn", pdv->GetWarn());
-				if (!pdv->GetCrit().IsEmpty())
-					fields->Set("_" + escaped_key + "_crit", pdv->GetCrit());
-
-				if (!pdv->GetUnit().IsEmpty())
-					fields->Set("_" + escaped_key + "_unit", pdv->GetUnit());
-			}
+		ParsedPerfdata::Ptr perfdata = cr->GetParsedPerformanceData();
+
+		for (const Value& val : perfdata->GetInvalid()) {
+			Log(LogWarning, "GelfWriter")
+				<< "Ignoring invalid perfdata for checkable '"
+				<< checkable->GetName() << "' and command '"
+				<< checkCommand->GetName() << "' with value: " << val;
+		}
+
+		for (size_t i = 0, length = perfdata->GetLength(); i < length; i++) {
+			String escaped_key = perfdata->GetLabel(i);
+			boost::replace_all(escaped_key, " ", "_");
+			boost::replace_all(escaped_key, ".", "_");
+			boost::replace_all(escaped_key, "\\", "_");
+			boost::algorithm::replace_all(escaped_key, "::", ".");
+
+			fields->Set("_" + escaped_key, perfdata->GetValue(i));
+
+			if (perfdata->HasMin(i))
+				fields->Set("_" + escaped_key + "_min", perfdata->GetMin(i));
+			if (perfdata->HasMax(i))
+				fields->Set("_" + escaped_key + "_max", perfdata->GetMax(i));
+			if (perfdata->HasWarn(i))
+				fields->Set("_" + escaped_key + "_warn", perfdata->GetWarn(i));
+			if (perfdata->HasCrit(i))
+				fields->Set("_" + escaped_key + "_crit", perfdata->GetCrit(i));
+
+			if (!perfdata->GetUnit(i).IsEmpty())
+				fields->Set("_" + escaped_key + "_unit", perfdata->GetUnit(i));
 		}
 	}
 
@@ -362,7 +407,7 @@ void GelfWriter::NotificationToUserHandler(const Notification::Ptr& notification
 	if (IsPaused())
 		return;
 
-	m_WorkQueue.Enqueue([this, notification, checkable, user, notificationType, cr, author, commentText, commandName]() {
+	EnqueueExport([this, notification, checkable, user, notificationType, cr, author, commentText, commandName]() {
 		NotificationToUserHandlerInternal(notification, checkable, user, notificationType, cr, author, commentText, commandName);
 	});
 }
@@ -430,7 +475,7 @@ void GelfWriter::StateChangeHandler(const Checkable::Ptr& checkable, const Check
 	if (IsPaused())
 		return;
 
-	m_WorkQueue.Enqueue([this, checkable, cr, type]() { StateChangeHandlerInternal(checkable, cr, type); });
+	EnqueueExport([this, checkable, cr, type]() { StateChangeHandlerInternal(checkable, cr, type); });
 }
 
 void GelfWriter::StateChangeHandlerInternal(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr, StateType type)
@@ -490,34 +535,289 @@ String GelfWriter::ComposeGelfMessage(const Dictionary::Ptr& fields, const Strin
 	return JsonEncode(fields);
 }
 
+/**
+ * Compresses a message for the UDP transport. Receivers detect the format
+ * by the magic bytes.
+ *
+ * @param message The GELF message
+ * @param gzip Whether to create a gzip member rather than a zlib stream
+ * @return The compressed message
+ */
+std::string GelfWriter::CompressGelfMessage(const String& message, bool gzip)
+{
+	namespace zlib = boost::beast::zlib;
+
+	static const unsigned char gzipHeader[] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+	static const unsigned char zlibHeader[] = { 0x78, 0x9c };
+
+	const unsigned char *header = gzip ? gzipHeader : zlibHeader;
+	size_t headerSize = gzip ? sizeof(gzipHeader) : sizeof(zlibHeader);
+	size_t trailerSize = gzip ? 8 : 4;
+
+	zlib::deflate_stream deflate;
+	std::string out (headerSize + deflate.upper_bound(message.GetLength()) + trailerSize, '\0');
+
+	std::copy(header, header + headerSize, out.begin());
+
+	zlib::z_params params;
+	params.next_in = message.CStr();
+	params.avail_in = message.GetLength();
+	params.next_out = &out[headerSize];
+	params.avail_out = out.size() - headerSize - trailerSize;
+
+	boost::system::error_code ec;
+	deflate.write(params, zlib::Flush::finish, ec);
+
+	/* end_of_stream signals that all input has been compressed. */
+	if (ec && ec != zlib::error::end_of_stream)
+		BOOST_THROW_EXCEPTION(boost::system::system_error(ec));
+
+	size_t pos = headerSize + params.total_out;
+
+	if (gzip) {
+		boost::crc_32_type crc;
+		crc.process_bytes(message.CStr(), message.GetLength());
+
+		uint_least32_t trailer[] = { crc.checksum(), static_cast<uint_least32_t>(message.GetLength()) };
+
+		/* Little endian */
+		for (auto value : trailer) {
+			for (int i = 0; i < 4; i++) {
+				out[pos++] = static_cast<char>((value >> (i * 8)) & 0xffu);
+			}
+		}
+	} else {
+		uint_least32_t a = 1, b = 0;
+
+		for (unsigned char c : message.GetData()) {
+			a = (a + c) % 65521u;
+			b = (b + a) % 65521u;
+		}
+
+		uint_least32_t adler = (b << 16) | a;
+
+		/* Big endian */
+		for (int i = 3; i >= 0; i--) {
+			out[pos++] = static_cast<char>((adler >> (i * 8)) & 0xffu);
+		}
+	}
+
+	out.resize(pos);
+
+	return std::move(out);
+}
+
+/**
+ * Splits a message into GELF chunks unless it fits into one datagram.
+ *
+ * @param message The (compressed) GELF message
+ * @param chunkSize The maximum size of a datagram
+ * @param messageId Identifies the chunks of this message
+ * @return The datagrams, none if the message needs too many chunks
+ */
+std::vector<std::string> GelfWriter::ChunkGelfMessage(const std::string& message, size_t chunkSize, uint_fast64_t messageId)
+{
+	std::vector<std::string> chunks;
+
+	if (message.size() <= chunkSize) {
+		chunks.emplace_back(message);
+		return chunks;
+	}
+
+	size_t payloadSize = chunkSize - l_ChunkHeaderSize;
+	size_t count = (message.size() + payloadSize - 1u) / payloadSize;
+
+	if (count > l_MaxChunks)
+		return chunks;
+
+	chunks.reserve(count);
+
+	for (size_t i = 0; i < count; i++) {
+		std::string chunk;
+		chunk.reserve(chunkSize);
+
+		chunk += '\x1e';
+		chunk += '\x0f';
+
+		for (int j = 7; j >= 0; j--) {
+			chunk += static_cast<char>((messageId >> (j * 8)) & 0xffu);
+		}
+
+		chunk += static_cast<char>(i);
+		chunk += static_cast<char>(count);
+		chunk.append(message, i * payloadSize, payloadSize);
+
+		chunks.emplace_back(std::move(chunk));
+	}
+
+	return chunks;
+}
+
+/**
+ * Hands a message over to the transport. Messages sent via TCP are
+ * collected and written together once the batch is full or the batch
+ * window has passed.
+ *
+ * Called inside the WQ.
+ */
 void GelfWriter::SendLogMessage(const Checkable::Ptr& checkable, const String& gelfMessage)
 {
-	std::ostringstream msgbuf;
-	msgbuf << gelfMessage;
-	msgbuf << '\0';
+	if (!GetConnected())
+		return;
+
+	Log(LogDebug, "GelfWriter")
+		<< "Checkable '" << checkable->GetName() << "' sending message '" << gelfMessage << "'.";
+
+	if (m_Udp) {
+		SendDatagrams(gelfMessage);
+		return;
+	}
+
+	m_Batch.append(gelfMessage.GetData());
+	m_Batch += '\0';
+	m_BatchMessages++;
+
+	if (m_Batch.size() >= l_MaxBatchSize)
+		FlushBatch();
+}
+
+/**
+ * Sends a message via UDP, compressed and split into chunks if necessary.
+ */
+void GelfWriter::SendDatagrams(const String& gelfMessage)
+{
+	std::vector<std::string> datagrams;
+
+	if (m_Compression == "none")
+		datagrams = ChunkGelfMessage(gelfMessage.GetData(), GetChunkSize(), m_MessageIds());
+	else
+		datagrams = ChunkGelfMessage(CompressGelfMessage(gelfMessage, m_Compression == "gzip"), GetChunkSize(), m_MessageIds());
+
+	if (datagrams.empty()) {
+		Log(LogWarning, "GelfWriter")
+			<< "Dropping message of " << gelfMessage.GetLength() << " bytes which doesn't fit into "
+			<< l_MaxChunks << " chunks of " << GetChunkSize() << " bytes.";
+		return;
+	}
+
+	ObjectLock olock(this);
+
+	try {
+		for (auto& datagram : datagrams) {
+			m_UdpSocket->send(boost::asio::buffer(datagram));
+		}
+	} catch (const std::exception& ex) {
+		Log(LogCritical, "GelfWriter")
+			<< "Cannot write to UDP socket on host '" << GetHost() << "' port '" << GetPort() << "'.";
+
+		throw;
+	}
+}
+
+/**
+ * Writes the batched messages to the TCP stream.
+ */
+void GelfWriter::FlushBatch()
+{
+	if (m_Batch.empty())
+		return;
 
-	String log = msgbuf.str();
+	std::string batch;
+	batch.swap(m_Batch);
+
+	size_t messages = m_BatchMessages;
+	m_BatchMessages = 0;
 
 	ObjectLock olock(this);
 
 	if (!GetConnected())
 		return;
 
-	try {
-		Log(LogDebug, "GelfWriter")
-			<< "Checkable '" << checkable->GetName() << "' sending message '" << log << "'.";
+	Log(LogDebug, "GelfWriter")
+		<< "Writing " << messages << " message(s) with " << batch.size() << " bytes.";
 
+	try {
 		if (m_Stream.first) {
-			boost::asio::write(*m_Stream.first, boost::asio::buffer(msgbuf.str()));
+			boost::asio::write(*m_Stream.first, boost::asio::buffer(batch));
 			m_Stream.first->flush();
 		} else {
-			boost::asio::write(*m_Stream.second, boost::asio::buffer(msgbuf.str()));
+			boost::asio::write(*m_Stream.second, boost::asio::buffer(batch));
 			m_Stream.second->flush();
 		}
 	} catch (const std::exception& ex) {
 		Log(LogCritical, "GelfWriter")
 			<< "Cannot write to TCP socket on host '" << GetHost() << "' port '" << GetPort() << "'.";
 
-		throw ex;
+		throw;
 	}
 }
+
+void GelfWriter::Validate(int types, const ValidationUtils& utils)
+{
+	ObjectImpl<GelfWriter>::Validate(types, utils);
+
+	if (!(types & FAConfig))
+		return;
+
+	if (GetProtocol() == "udp" && GetEnableTls())
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "enable_tls" }, "TLS isn't supported with protocol 'udp'."));
+
+	if (GetProtocol() != "udp" && GetCompression() != "none")
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "compression" }, "Compression requires protocol 'udp'."));
+}
+
+/**
+ * Validate the configuration setting 'protocol'
+ *
+ * @param lvalue "tcp" or "udp"
+ * @param utils Helper, unused
+ */
+void GelfWriter::ValidateProtocol(const Lazy<String>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<GelfWriter>::ValidateProtocol(lvalue, utils);
+
+	if (lvalue() != "tcp" && lvalue() != "udp")
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "protocol" }, "Value must be one of 'tcp' or 'udp'."));
+}
+
+/**
+ * Validate the configuration setting 'compression'
+ *
+ * @param lvalue "none", "gzip" or "zlib"
+ * @param utils Helper, unused
+ */
+void GelfWriter::ValidateCompression(const Lazy<String>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<GelfWriter>::ValidateCompression(lvalue, utils);
+
+	if (lvalue() != "none" && lvalue() != "gzip" && lvalue() != "zlib")
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "compression" }, "Value must be one of 'none', 'gzip' or 'zlib'."));
+}
+
+/**
+ * Validate the configuration setting 'chunk_size'
+ *
+ * @param lvalue Maximum size of a datagram
+ * @param utils Helper, unused
+ */
+void GelfWriter::ValidateChunkSize(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<GelfWriter>::ValidateChunkSize(lvalue, utils);
+
+	if (lvalue() < 128 || lvalue() > 65507)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "chunk_size" }, "Value must be between 128 and 65507."));
+}
+
+/**
+ * Validate the configuration setting 'batch_window'
+ *
+ * @param lvalue Seconds to collect messages for
+ * @param utils Helper, unused
+ */
+void GelfWriter::ValidateBatchWindow(const Lazy<double>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<GelfWriter>::ValidateBatchWindow(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "batch_window" }, "Value must be greater than 0."));
+}
@@ -9,7 +9,11 @@
 #include "base/tcpsocket.hpp"
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
+#include <boost/asio/ip/udp.hpp>
+#include <cstdint>
 #include <fstream>
+#include <random>
+#include <vector>
 
 namespace icinga
 {
@@ -27,16 +31,36 @@ public:
 
 	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 
+	static std::string CompressGelfMessage(const String& message, bool gzip);
+	static std::vector<std::string> ChunkGelfMessage(const std::string& message, size_t chunkSize, uint_fast64_t messageId);
+
+	void Validate(int types, const ValidationUtils& utils) override;
+	void ValidateProtocol(const Lazy<String>& lvalue, const ValidationUtils& utils) override;
+	void ValidateCompression(const Lazy<String>& lvalue, const ValidationUtils& utils) override;
+	void ValidateChunkSize(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateBatchWindow(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
+
 protected:
 	void OnConfigLoaded() override;
 	void Resume() override;
 	void Pause() override;
 
 private:
+	typedef boost::asio::ip::udp::socket UdpSocket;
+
 	OptionalTlsStream m_Stream;
-	WorkQueue m_WorkQueue{10000000, 1};
+	Shared<UdpSocket>::Ptr m_UdpSocket;
 
 	Timer::Ptr m_ReconnectTimer;
+	Timer::Ptr m_BatchTimer;
+
+	/* The NUL terminated messages not yet written to the TCP stream, only accessed inside the WQ. */
+	std::string m_Batch;
+	size_t m_BatchMessages{0};
+
+	bool m_Udp{false};
+	String m_Compression;
+	std::mt19937_64 m_MessageIds;
 
 	void CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
 	void CheckResultHandlerInternal(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
@@ -51,6 +75,8 @@ private:
 
 	String ComposeGelfMessage(const Dictionary::Ptr& fields, const String& source, double ts);
 	void SendLogMessage(const Checkable::Ptr& checkable, const String& gelfMessage);
+	void SendDatagrams(const String& gelfMessage);
+	void FlushBatch();
 
 	void ReconnectTimerHandler();
 
@@ -14,20 +14,55 @@
 #include "base/utility.hpp"
 #include "base/perfdatavalue.hpp"
 #include "base/application.hpp"
+#include "base/defer.hpp"
 #include "base/stream.hpp"
 #include "base/networkstream.hpp"
 #include "base/exception.hpp"
 #include "base/statsfunction.hpp"
 #include <boost/algorithm/string.hpp>
-#include <boost/algorithm/string/replace.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/write.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
 #include <utility>
 
 using namespace icinga;
 
+/* Frames are handed over to the writer once they exceed this size. */
+static const size_t l_MaxFrameSize = 64 * 1024;
+
+/* Frames sent via UDP have to fit into a single unfragmented datagram. */
+static const size_t l_MaxDatagramSize = 1400;
+
+/* The oldest frames are dropped if the writer falls behind this far. */
+static const size_t l_MaxQueuedFramesSize = 64 * 1024 * 1024;
+
+/**
+ * Appends a pickle BINFLOAT, i.e. a big-endian IEEE 754 double.
+ */
+static void AppendPickledFloat(std::string& out, double value)
+{
+	uint_least64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	out += 'G';
+
+	for (int i = 7; i >= 0; i--) {
+		out += static_cast<char>((bits >> (i * 8)) & 0xffu);
+	}
+}
+
 REGISTER_TYPE(GraphiteWriter);
 
 REGISTER_STATSFUNCTION(GraphiteWriter, &GraphiteWriter::StatsFunc);
 
+GraphiteWriter::GraphiteWriter()
+	: m_IoStrand(IoEngine::Get().GetIoContext()), m_FramesQueued(IoEngine::Get().GetIoContext())
+{ }
+
 /*
  * Enable HA capabilities once the config object is loaded.
  */
@@ -35,8 +70,6 @@ void GraphiteWriter::OnConfigLoaded()
 {
 	ObjectImpl<GraphiteWriter>::OnConfigLoaded();
 
-	m_WorkQueue.SetName("GraphiteWriter, " + GetName());
-
 	if (!GetEnableHa()) {
 		Log(LogDebug, "GraphiteWriter")
 			<< "HA functionality disabled. Won't pause connection: " << GetName();
@@ -58,17 +91,12 @@ void GraphiteWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&
 	DictionaryData nodes;
 
 	for (const GraphiteWriter::Ptr& graphitewriter : ConfigType::GetObjectsByType<GraphiteWriter>()) {
-		size_t workQueueItems = graphitewriter->m_WorkQueue.GetLength();
-		double workQueueItemRate = graphitewriter->m_WorkQueue.GetTaskCount(60) / 60.0;
+		Dictionary::Ptr stats = graphitewriter->GetExportStats();
+		stats->Set("connected", graphitewriter->GetConnected());
 
-		nodes.emplace_back(graphitewriter->GetName(), new Dictionary({
-			{ "work_queue_items", workQueueItems },
-			{ "work_queue_item_rate", workQueueItemRate },
-			{ "connected", graphitewriter->GetConnected() }
-		}));
+		nodes.emplace_back(graphitewriter->GetName(), stats);
 
-		perfdata->Add(new PerfdataValue("graphitewriter_" + graphitewriter->GetName() + "_work_queue_items", workQueueItems));
-		perfdata->Add(new PerfdataValue("graphitewriter_" + graphitewriter->GetName() + "_work_queue_item_rate", workQueueItemRate));
+		graphitewriter->AddExportPerfdata("graphitewriter_" + graphitewriter->GetName(), perfdata);
 	}
 
 	status->Set("graphitewriter", new Dictionary(std::move(nodes)));
@@ -87,16 +115,27 @@ void GraphiteWriter::Resume()
 	/* Register exception handler for WQ tasks. */
 	m_WorkQueue.SetExceptionCallback([this](boost::exception_ptr exp) { ExceptionHandler(std::move(exp)); });
 
+	m_Pickle = GetProtocol() == "pickle";
+	m_Udp = GetProtocol() == "udp";
+
+	/* Timer for sending partially filled frames */
+	m_BatchTimer = new Timer();
+	m_BatchTimer->SetInterval(GetBatchWindow());
+	m_BatchTimer->OnTimerExpired.connect([this](const Timer * const&) {
+		m_WorkQueue.Enqueue([this]() { FlushFrame(); });
+	});
+	m_BatchTimer->Start();
+
 	/* Timer for reconnecting */
 	m_ReconnectTimer = new Timer();
-	m_ReconnectTimer->SetInterval(10);
+	m_ReconnectTimer->SetInterval(ReconnectInterval);
 	m_ReconnectTimer->OnTimerExpired.connect([this](const Timer * const&) { ReconnectTimerHandler(); });
 	m_ReconnectTimer->Start();
 	m_ReconnectTimer->Reschedule(0);
 
 	/* Register event handlers. */
-	Checkable::OnNewCheckResult.connect([this](const Checkable::Ptr& checkable, const CheckResult::Ptr& cr, const MessageOrigin::Ptr&) {
-		CheckResultHandler(checkable, cr);
+	Checkable::OnNewCheckResults.connect([this](const Checkable::CheckResultBatch& batch) {
+		CheckResultHandler(batch);
 	});
 }
 
@@ -106,6 +145,7 @@ void GraphiteWriter::Resume()
 void GraphiteWriter::Pause()
 {
 	m_ReconnectTimer.reset();
+	m_BatchTimer.reset();
 
 	try {
 		ReconnectInternal();
@@ -118,6 +158,7 @@ void GraphiteWriter::Pause()
 	}
 
 	m_WorkQueue.Join();
+	FlushFrame();
 	DisconnectInternal();
 
 	Log(LogInformation, "GraphiteWriter")
@@ -148,11 +189,7 @@ void GraphiteWriter::ExceptionHandler(boost::exception_ptr exp)
 	Log(LogDebug, "GraphiteWriter")
 		<< "Exception during Graphite operation: " << DiagnosticInformation(std::move(exp));
 
-	if (GetConnected()) {
-		m_Stream->close();
-
-		SetConnected(false);
-	}
+	DisconnectInternal();
 }
 
 /**
@@ -169,7 +206,14 @@ void GraphiteWriter::Reconnect()
 		return;
 	}
 
-	ReconnectInternal();
+	try {
+		ReconnectInternal();
+	} catch (const std::exception&) {
+		ReconnectFailed();
+		throw;
+	}
+
+	ReconnectSucceeded();
 }
 
 /**
@@ -189,10 +233,20 @@ void GraphiteWriter::ReconnectInternal()
 	Log(LogNotice, "GraphiteWriter")
 		<< "Reconnecting to Graphite on host '" << GetHost() << "' port '" << GetPort() << "'.";
 
-	m_Stream = Shared<AsioTcpStream>::Make(IoEngine::Get().GetIoContext());
+	Shared<AsioTcpStream>::Ptr tcp;
+	Shared<UdpSocket>::Ptr udp;
 
 	try {
-		icinga::Connect(m_Stream->lowest_layer(), GetHost(), GetPort());
+		if (m_Udp) {
+			boost::asio::ip::udp::resolver resolver (IoEngine::Get().GetIoContext());
+			boost::asio::ip::udp::resolver::query query (GetHost(), GetPort());
+
+			udp = Shared<UdpSocket>::Make(IoEngine::Get().GetIoContext());
+			udp->connect(resolver.resolve(query).begin()->endpoint());
+		} else {
+			tcp = Shared<AsioTcpStream>::Make(IoEngine::Get().GetIoContext());
+			icinga::Connect(tcp->lowest_layer(), GetHost(), GetPort());
+		}
 	} catch (const std::exception& ex) {
 		Log(LogWarning, "GraphiteWriter")
 			<< "Can't connect to Graphite on host '" << GetHost() << "' port '" << GetPort() << ".'";
@@ -202,6 +256,21 @@ void GraphiteWriter::ReconnectInternal()
 		throw;
 	}
 
+	auto writerDone (std::make_shared<std::promise<void>>());
+	m_WriterDone = writerDone->get_future();
+
+	GraphiteWriter::Ptr keepAlive (this);
+
+	boost::asio::post(m_IoStrand, [this, keepAlive, tcp, udp, writerDone]() {
+		uint_fast64_t generation = ++m_Generation;
+
+		IoEngine::SpawnCoroutine(m_IoStrand, [this, keepAlive, tcp, udp, writerDone, generation](boost::asio::yield_context yc) {
+			Defer signalWriterDone ([&writerDone]() { writerDone->set_value(); });
+
+			WriteFrames(tcp, udp, generation, yc);
+		});
+	});
+
 	SetConnected(true);
 
 	Log(LogInformation, "GraphiteWriter")
@@ -211,11 +280,11 @@ void GraphiteWriter::ReconnectInternal()
 /**
  * Reconnect handler called by the timer.
  *
- * Enqueues a reconnect task into the WQ.
+ * Enqueues a reconnect task into the WQ unless backing off after failed attempts.
  */
 void GraphiteWriter::ReconnectTimerHandler()
 {
-	if (IsPaused())
+	if (IsPaused() || !ShouldReconnect())
 		return;
 
 	m_WorkQueue.Enqueue([this]() { Reconnect(); }, PriorityHigh);
@@ -234,7 +303,7 @@ void GraphiteWriter::Disconnect()
 }
 
 /**
- * Disconnect the stream.
+ * Disconnect the stream after the writer has sent the queued frames.
  *
  * Called outside the WQ.
  */
@@ -243,23 +312,149 @@ void GraphiteWriter::DisconnectInternal()
 	if (!GetConnected())
 		return;
 
-	m_Stream->close();
+	GraphiteWriter::Ptr keepAlive (this);
+
+	/* Frames posted before are queued already, so the writer sends them before it stops. */
+	boost::asio::post(m_IoStrand, [this, keepAlive]() {
+		m_Generation++;
+		m_FramesQueued.Set();
+	});
+
+	if (m_WriterDone.valid())
+		m_WriterDone.wait_for(std::chrono::seconds(10));
 
 	SetConnected(false);
 }
 
+/**
+ * Hands the current frame over to the writer.
+ *
+ * Called inside the WQ.
+ */
+void GraphiteWriter::FlushFrame()
+{
+	if (m_Frame.empty())
+		return;
+
+	auto frame (std::make_shared<std::string>());
+	size_t metrics = m_FrameMetrics;
+
+	if (m_Pickle) {
+		/* The frame contains the pickled (path, (timestamp, value)) tuples only:
+		 * add PROTO 2, EMPTY_LIST and MARK in front of them, APPENDS and STOP after them
+		 * and prefix the whole pickle with its big-endian length.
+		 */
+		static const char head[] = { '\x80', 2, ']', '(' };
+		static const char tail[] = { 'e', '.' };
+
+		uint_least32_t length = sizeof(head) + m_Frame.size() + sizeof(tail);
+
+		frame->reserve(4 + length);
+
+		for (int i = 3; i >= 0; i--) {
+			frame->push_back(static_cast<char>((length >> (i * 8)) & 0xffu));
+		}
+
+		frame->append(head, sizeof(head));
+		frame->append(m_Frame);
+		frame->append(tail, sizeof(tail));
+	} else {
+		frame->swap(m_Frame);
+	}
+
+	m_Frame.clear();
+	m_FrameMetrics = 0;
+
+	if (!GetConnected())
+		return;
+
+	Log(LogDebug, "GraphiteWriter")
+		<< "Sending " << metrics << " metrics in " << frame->size() << " bytes.";
+
+	GraphiteWriter::Ptr keepAlive (this);
+
+	boost::asio::post(m_IoStrand, [this, keepAlive, frame]() {
+		while (!m_Frames.empty() && m_FramesSize + frame->size() > l_MaxQueuedFramesSize) {
+			Log(LogWarning, "GraphiteWriter")
+				<< "Can't send metrics to Graphite fast enough, dropping " << m_Frames.front().size() << " bytes.";
+
+			m_FramesSize -= m_Frames.front().size();
+			m_Frames.pop_front();
+		}
+
+		m_FramesSize += frame->size();
+		m_Frames.emplace_back(std::move(*frame));
+		m_FramesQueued.Set();
+	});
+}
+
+/**
+ * Writes the queued frames until the connection fails or is replaced.
+ *
+ * Called inside m_IoStrand.
+ */
+void GraphiteWriter::WriteFrames(const Shared<AsioTcpStream>::Ptr& tcp, const Shared<UdpSocket>::Ptr& udp,
+	uint_fast64_t generation, boost::asio::yield_context yc)
+{
+	namespace asio = boost::asio;
+
+	for (;;) {
+		m_FramesQueued.Wait(yc);
+
+		auto frames (std::move(m_Frames));
+
+		m_Frames.clear();
+		m_FramesSize = 0;
+		m_FramesQueued.Clear();
+
+		try {
+			for (auto& frame : frames) {
+				if (udp) {
+					udp->async_send(asio::buffer(frame), yc);
+				} else {
+					asio::async_write(*tcp, asio::buffer(frame), yc);
+				}
+			}
+
+			if (tcp && !frames.empty())
+				tcp->async_flush(yc);
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "GraphiteWriter")
+				<< "Cannot write to " << (udp ? "UDP" : "TCP") << " socket on host '" << GetHost() << "' port '" << GetPort() << "'.";
+
+			if (generation == m_Generation)
+				SetConnected(false);
+
+			break;
+		}
+
+		if (generation != m_Generation)
+			break;
+	}
+
+	boost::system::error_code ec;
+
+	if (tcp)
+		tcp->lowest_layer().close(ec);
+
+	if (udp)
+		udp->close(ec);
+}
+
 /**
  * Check result event handler, checks whether feature is not paused in HA setups.
  *
- * @param checkable Host/Service object
- * @param cr Check result including performance data
+ * @param batch Host/Service objects and their check results including performance data
  */
-void GraphiteWriter::CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr)
+void GraphiteWriter::CheckResultHandler(const Checkable::CheckResultBatch& batch)
 {
 	if (IsPaused())
 		return;
 
-	m_WorkQueue.Enqueue([this, checkable, cr]() { CheckResultHandlerInternal(checkable, cr); });
+	EnqueueExport([this, batch]() {
+		for (auto& entry : batch)
+			CheckResultHandlerInternal(entry.Object, entry.Result);
+	});
 }
 
 /**
@@ -276,9 +471,9 @@ void GraphiteWriter::CheckResultHandlerInternal(const Checkable::Ptr& checkable,
 
 	CONTEXT("Processing check result for '" + checkable->GetName() + "'");
 
-	/* TODO: Deal with missing connection here. Needs refactoring
-	 * into parsing the actual performance data and then putting it
-	 * into a queue for re-inserting. */
+	/* Frames are dropped while disconnected, so don't even format them. */
+	if (!GetConnected())
+		return;
 
 	if (!IcingaApplication::GetInstance()->GetEnablePerfdata() || !checkable->GetEnablePerfdata())
 		return;
@@ -312,19 +507,19 @@ void GraphiteWriter::CheckResultHandlerInternal(const Checkable::Ptr& checkable,
 
 	if (GetEnableSendMetadata()) {
 		if (service) {
-			SendMetric(checkable, prefixMetadata, "state", service->GetState(), ts);
+			SendMetric(prefixMetadata, "state", nullptr, service->GetState(), ts);
 		} else {
-			SendMetric(checkable, prefixMetadata, "state", host->GetState(), ts);
+			SendMetric(prefixMetadata, "state", nullptr, host->GetState(), ts);
 		}
 
-		SendMetric(checkable, prefixMetadata, "current_attempt", checkable->GetCheckAttempt(), ts);
-		SendMetric(checkable, prefixMetadata, "max_check_attempts", checkable->GetMaxCheckAttempts(), ts);
-		SendMetric(checkable, prefixMetadata, "state_type", checkable->GetStateType(), ts);
-		SendMetric(checkable, prefixMetadata, "reachable", checkable->IsReachable(), ts);
-		SendMetric(checkable, prefixMetadata, "downtime_depth", checkable->GetDowntimeDepth(), ts);
-		SendMetric(checkable, prefixMetadata, "acknowledgement", checkable->GetAcknowledgement(), ts);
-		SendMetric(checkable, prefixMetadata, "latency", cr->CalculateLatency(), ts);
-		SendMetric(checkable, prefixMetadata, "execution_time", cr->CalculateExecutionTime(), ts);
+		SendMetric(prefixMetadata, "current_attempt", nullptr, checkable->GetCheckAttempt(), ts);
+		SendMetric(prefixMetadata, "max_check_attempts", nullptr, checkable->GetMaxCheckAttempts(), ts);
+		SendMetric(prefixMetadata, "state_type", nullptr, checkable->GetStateType(), ts);
+		SendMetric(prefixMetadata, "reachable", nullptr, checkable->IsReachable(), ts);
+		SendMetric(prefixMetadata, "downtime_depth", nullptr, checkable->GetDowntimeDepth(), ts);
+		SendMetric(prefixMetadata, "acknowledgement", nullptr, checkable->GetAcknowledgement(), ts);
+		SendMetric(prefixMetadata, "latency", nullptr, cr->CalculateLatency(), ts);
+		SendMetric(prefixMetadata, "execution_time", nullptr, cr->CalculateExecutionTime(), ts);
 	}
 
 	SendPerfdata(checkable, prefixPerfdata, cr, ts);
@@ -340,83 +535,125 @@ void GraphiteWriter::CheckResultHandlerInternal(const Checkable::Ptr& checkable,
  */
 void GraphiteWriter::SendPerfdata(const Checkable::Ptr& checkable, const String& prefix, const CheckResult::Ptr& cr, double ts)
 {
-	Array::Ptr perfdata = cr->GetPerformanceData();
-
-	if (!perfdata)
-		return;
+	ParsedPerfdata::Ptr perfdata = cr->GetParsedPerformanceData();
 
 	CheckCommand::Ptr checkCommand = checkable->GetCheckCommand();
 
-	ObjectLock olock(perfdata);
-	for (const Value& val : perfdata) {
-		PerfdataValue::Ptr pdv;
-
-		if (val.IsObjectType<PerfdataValue>())
-			pdv = val;
-		else {
-			try {
-				pdv = PerfdataValue::Parse(val);
-			} catch (const std::exception&) {
-				Log(LogWarning, "GraphiteWriter")
-					<< "Ignoring invalid perfdata for checkable '"
-					<< checkable->GetName() << "' and command '"
-					<< checkCommand->GetName() << "' with value: " << val;
-				continue;
-			}
-		}
+	for (const Value& val : perfdata->GetInvalid()) {
+		Log(LogWarning, "GraphiteWriter")
+			<< "Ignoring invalid perfdata for checkable '"
+			<< checkable->GetName() << "' and command '"
+			<< checkCommand->GetName() << "' with value: " << val;
+	}
 
-		String escapedKey = EscapeMetricLabel(pdv->GetLabel());
+	for (size_t i = 0, length = perfdata->GetLength(); i < length; i++) {
+		const String& label = perfdata->GetLabel(i);
 
-		SendMetric(checkable, prefix, escapedKey + ".value", pdv->GetValue(), ts);
+		SendMetric(prefix, label, "value", perfdata->GetValue(i), ts);
 
 		if (GetEnableSendThresholds()) {
-			if (!pdv->GetCrit().IsEmpty())
-				SendMetric(checkable, prefix, escapedKey + ".crit", pdv->GetCrit(), ts);
-			if (!pdv->GetWarn().IsEmpty())
-				SendMetric(checkable, prefix, escapedKey + ".warn", pdv->GetWarn(), ts);
-			if (!pdv->GetMin().IsEmpty())
-				SendMetric(checkable, prefix, escapedKey + ".min", pdv->GetMin(), ts);
-			if (!pdv->GetMax().IsEmpty())
-				SendMetric(checkable, prefix, escapedKey + ".max", pdv->GetMax(), ts);
+			if (perfdata->HasCrit(i))
+				SendMetric(prefix, label, "crit", perfdata->GetCrit(i), ts);
+			if (perfdata->HasWarn(i))
+				SendMetric(prefix, label, "warn", perfdata->GetWarn(i), ts);
+			if (perfdata->HasMin(i))
+				SendMetric(prefix, label, "min", perfdata->GetMin(i), ts);
+			if (perfdata->HasMax(i))
+				SendMetric(prefix, label, "max", perfdata->GetMax(i), ts);
 		}
 	}
 }
 
 /**
- * Computes metric data and sends to Graphite
+ * Appends a metric to the current frame, in plaintext or pickle format
+ *
+ * Called inside the WQ.
  *
- * @param checkable Host/service object
  * @param prefix Computed metric prefix string
- * @param name Metric name
+ * @param label Metric label, escaped here
+ * @param suffix Appended to the label if not null
  * @param value Metric value
  * @param ts Timestamp when the check result was created
  */
-void GraphiteWriter::SendMetric(const Checkable::Ptr& checkable, const String& prefix, const String& name, double value, double ts)
+void GraphiteWriter::SendMetric(const String& prefix, const String& label, const char *suffix, double value, double ts)
 {
-	namespace asio = boost::asio;
+	size_t offset = m_Frame.size();
 
-	std::ostringstream msgbuf;
-	msgbuf << prefix << "." << name << " " << Convert::ToString(value) << " " << static_cast<long>(ts);
+	if (m_Pickle) {
+		/* BINUNICODE with a length which is filled in below. */
+		m_Frame.append("X\0\0\0\0", 5);
+	}
 
-	Log(LogDebug, "GraphiteWriter")
-		<< "Checkable '" << checkable->GetName() << "' adds to metric list: '" << msgbuf.str() << "'.";
+	size_t pathOffset = m_Frame.size();
 
-	// do not send \n to debug log
-	msgbuf << "\n";
+	m_Frame.append(prefix.GetData());
+	m_Frame += '.';
+	AppendEscapedMetricLabel(m_Frame, label);
 
-	std::unique_lock<std::mutex> lock(m_StreamMutex);
+	if (suffix) {
+		m_Frame += '.';
+		m_Frame.append(suffix);
+	}
 
-	if (!GetConnected())
-		return;
+	if (m_Pickle) {
+		uint_least32_t pathLength = m_Frame.size() - pathOffset;
 
-	try {
-		asio::write(*m_Stream, asio::buffer(msgbuf.str()));
-		m_Stream->flush();
-	} catch (const std::exception& ex) {
-		Log(LogCritical, "GraphiteWriter")
-			<< "Cannot write to TCP socket on host '" << GetHost() << "' port '" << GetPort() << "'.";
+		for (int i = 0; i < 4; i++) {
+			m_Frame[pathOffset - 4 + i] = static_cast<char>((pathLength >> (i * 8)) & 0xffu);
+		}
+
+		char buf[5];
+
+		/* BININT for the timestamp until it doesn't fit into 32 bits anymore, BINFLOAT otherwise. */
+		if (ts < 2147483648.0) {
+			auto timestamp (static_cast<uint_least32_t>(static_cast<long>(ts)));
+
+			buf[0] = 'J';
 
-		throw ex;
+			for (int i = 0; i < 4; i++) {
+				buf[1 + i] = static_cast<char>((timestamp >> (i * 8)) & 0xffu);
+			}
+
+			m_Frame.append(buf, sizeof(buf));
+		} else {
+			AppendPickledFloat(m_Frame, ts);
+		}
+
+		AppendPickledFloat(m_Frame, value);
+
+		/* TUPLE2 (timestamp, value), TUPLE2 (path, (timestamp, value)) */
+		m_Frame.append("\x86\x86", 2);
+	} else {
+		char buf[64];
+
+		/* Same format as Convert::ToString(double) without the temporary strings. */
+		double integral;
+		int length;
+
+		if (std::modf(value, &integral) == 0)
+			length = snprintf(buf, sizeof(buf), " %lld %ld\n", static_cast<long long>(value), static_cast<long>(ts));
+		else
+			length = snprintf(buf, sizeof(buf), " %f %ld\n", value, static_cast<long>(ts));
+
+		if (length > 0)
+			m_Frame.append(buf, std::min(static_cast<size_t>(length), sizeof(buf) - 1u));
+	}
+
+	m_FrameMetrics++;
+
+	if (m_Udp && m_Frame.size() > l_MaxDatagramSize && offset > 0u) {
+		/* Start a new datagram with the metric which doesn't fit into the current one anymore. */
+		std::string metric (m_Frame, offset);
+
+		m_Frame.resize(offset);
+		m_FrameMetrics--;
+
+		FlushFrame();
+
+		m_Frame = std::move(metric);
+		m_FrameMetrics = 1;
+	} else if (m_Frame.size() >= (m_Udp ? l_MaxDatagramSize : l_MaxFrameSize)) {
+		FlushFrame();
 	}
 }
 
@@ -433,10 +670,10 @@ String GraphiteWriter::EscapeMetric(const String& str)
 	String result = str;
 
 	//don't allow '.' in metric prefixes
-	boost::replace_all(result, " ", "_");
-	boost::replace_all(result, ".", "_");
-	boost::replace_all(result, "\\", "_");
-	boost::replace_all(result, "/", "_");
+	for (char& c : result.GetData()) {
+		if (c == ' ' || c == '.' || c == '\\' || c == '/')
+			c = '_';
+	}
 
 	return result;
 }
@@ -446,20 +683,26 @@ String GraphiteWriter::EscapeMetric(const String& str)
  *
  * Dots are allowed - users can create trees from perfdata labels
  *
+ * @param out Receives the escaped label
  * @param str Metric label name
- * @return Escaped string
  */
-String GraphiteWriter::EscapeMetricLabel(const String& str)
+void GraphiteWriter::AppendEscapedMetricLabel(std::string& out, const String& str)
 {
-	String result = str;
+	const std::string& label = str.GetData();
 
 	//allow to pass '.' in perfdata labels
-	boost::replace_all(result, " ", "_");
-	boost::replace_all(result, "\\", "_");
-	boost::replace_all(result, "/", "_");
-	boost::replace_all(result, "::", ".");
-
-	return result;
+	for (size_t i = 0; i < label.size(); i++) {
+		char c = label[i];
+
+		if (c == ' ' || c == '\\' || c == '/') {
+			out += '_';
+		} else if (c == ':' && i + 1u < label.size() && label[i + 1u] == ':') {
+			out += '.';
+			i++;
+		} else {
+			out += c;
+		}
+	}
 }
 
 /**
@@ -511,3 +754,31 @@ void GraphiteWriter::ValidateServiceNameTemplate(const Lazy<String>& lvalue, con
 	if (!MacroProcessor::ValidateMacroString(lvalue()))
 		BOOST_THROW_EXCEPTION(ValidationError(this, { "service_name_template" }, "Closing $ not found in macro format string '" + lvalue() + "'."));
 }
+
+/**
+ * Validate the configuration setting 'protocol'
+ *
+ * @param lvalue "plaintext", "pickle" or "udp"
+ * @param utils Helper, unused
+ */
+void GraphiteWriter::ValidateProtocol(const Lazy<String>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<GraphiteWriter>::ValidateProtocol(lvalue, utils);
+
+	if (lvalue() != "plaintext" && lvalue() != "pickle" && lvalue() != "udp")
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "protocol" }, "Value must be one of 'plaintext', 'pickle' or 'udp'."));
+}
+
+/**
+ * Validate the configuration setting 'batch_window'
+ *
+ * @param lvalue Seconds to collect metrics for
+ * @param utils Helper, unused
+ */
+void GraphiteWriter::ValidateBatchWindow(const Lazy<double>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<GraphiteWriter>::ValidateBatchWindow(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "batch_window" }, "Value must be greater than 0."));
+}
@@ -9,8 +9,14 @@
 #include "base/tcpsocket.hpp"
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
+#include "base/io-engine.hpp"
+#include <boost/asio/io_context_strand.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/asio/spawn.hpp>
+#include <cstdint>
+#include <deque>
 #include <fstream>
-#include <mutex>
+#include <future>
 
 namespace icinga
 {
@@ -26,8 +32,12 @@ public:
 	DECLARE_OBJECT(GraphiteWriter);
 	DECLARE_OBJECTNAME(GraphiteWriter);
 
+	GraphiteWriter();
+
 	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 
+	void ValidateProtocol(const Lazy<String>& lvalue, const ValidationUtils& utils) override;
+	void ValidateBatchWindow(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
 	void ValidateHostNameTemplate(const Lazy<String>& lvalue, const ValidationUtils& utils) override;
 	void ValidateServiceNameTemplate(const Lazy<String>& lvalue, const ValidationUtils& utils) override;
 
@@ -37,20 +47,38 @@ protected:
 	void Pause() override;
 
 private:
-	Shared<AsioTcpStream>::Ptr m_Stream;
-	std::mutex m_StreamMutex;
-	WorkQueue m_WorkQueue{10000000, 1};
+	typedef boost::asio::ip::udp::socket UdpSocket;
 
 	Timer::Ptr m_ReconnectTimer;
+	Timer::Ptr m_BatchTimer;
+
+	/* The frame being filled, only accessed inside the WQ. */
+	std::string m_Frame;
+	size_t m_FrameMetrics{0};
+	bool m_Pickle{false};
+	bool m_Udp{false};
+
+	/* The writer coroutine's state, only accessed inside m_IoStrand. */
+	boost::asio::io_context::strand m_IoStrand;
+	std::deque<std::string> m_Frames;
+	size_t m_FramesSize{0};
+	AsioConditionVariable m_FramesQueued;
+	uint_fast64_t m_Generation{0};
 
-	void CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
+	std::future<void> m_WriterDone;
+
+	void CheckResultHandler(const Checkable::CheckResultBatch& batch);
 	void CheckResultHandlerInternal(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
-	void SendMetric(const Checkable::Ptr& checkable, const String& prefix, const String& name, double value, double ts);
+	void SendMetric(const String& prefix, const String& label, const char *suffix, double value, double ts);
 	void SendPerfdata(const Checkable::Ptr& checkable, const String& prefix, const CheckResult::Ptr& cr, double ts);
 	static String EscapeMetric(const String& str);
-	static String EscapeMetricLabel(const String& str);
+	static void AppendEscapedMetricLabel(std::string& out, const String& str);
 	static Value EscapeMacroMetric(const Value& value);
 
+	void FlushFrame();
+	void WriteFrames(const Shared<AsioTcpStream>::Ptr& tcp, const Shared<UdpSocket>::Ptr& udp,
+		uint_fast64_t generation, boost::asio::yield_context yc);
+
 	void ReconnectTimerHandler();
 
 	void Disconnect();
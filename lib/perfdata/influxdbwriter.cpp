@@ -8,7 +8,6 @@
 #include "icinga/icingaapplication.hpp"
 #include "icinga/checkcommand.hpp"
 #include "base/application.hpp"
-#include "base/defer.hpp"
 #include "base/io-engine.hpp"
 #include "base/tcpsocket.hpp"
 #include "base/configtype.hpp"
@@ -23,6 +22,7 @@
 #include "base/networkstream.hpp"
 #include "base/exception.hpp"
 #include "base/statsfunction.hpp"
+#include "base/configuration.hpp"
 #include "base/tlsutility.hpp"
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/replace.hpp>
@@ -39,6 +39,7 @@
 #include <boost/math/special_functions/fpclassify.hpp>
 #include <boost/regex.hpp>
 #include <boost/scoped_array.hpp>
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <utility>
@@ -63,6 +64,12 @@ private:
 	int m_Value;
 };
 
+/* Upper bounds of the write request latency histogram buckets in seconds,
+ * the last bucket counts everything slower. */
+static const double l_LatencyBuckets[] = { 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 };
+
+static const size_t l_LatencyBucketCount = sizeof(l_LatencyBuckets) / sizeof(l_LatencyBuckets[0]) + 1u;
+
 REGISTER_TYPE(InfluxdbWriter);
 
 REGISTER_STATSFUNCTION(InfluxdbWriter, &InfluxdbWriter::StatsFunc);
@@ -71,8 +78,6 @@ void InfluxdbWriter::OnConfigLoaded()
 {
 	ObjectImpl<InfluxdbWriter>::OnConfigLoaded();
 
-	m_WorkQueue.SetName("InfluxdbWriter, " + GetName());
-
 	if (!GetEnableHa()) {
 		Log(LogDebug, "InfluxdbWriter")
 			<< "HA functionality disabled. Won't pause connection: " << GetName();
@@ -88,19 +93,23 @@ void InfluxdbWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&
 	DictionaryData nodes;
 
 	for (const InfluxdbWriter::Ptr& influxdbwriter : ConfigType::GetObjectsByType<InfluxdbWriter>()) {
-		size_t workQueueItems = influxdbwriter->m_WorkQueue.GetLength();
-		double workQueueItemRate = influxdbwriter->m_WorkQueue.GetTaskCount(60) / 60.0;
+		String prefix = "influxdbwriter_" + influxdbwriter->GetName();
 		size_t dataBufferItems = influxdbwriter->m_DataBuffer.size();
 
-		nodes.emplace_back(influxdbwriter->GetName(), new Dictionary({
-			{ "work_queue_items", workQueueItems },
-			{ "work_queue_item_rate", workQueueItemRate },
-			{ "data_buffer_items", dataBufferItems }
-		}));
+		Dictionary::Ptr stats = influxdbwriter->GetExportStats();
+		stats->Set("data_buffer_items", dataBufferItems);
+
+		influxdbwriter->AddExportPerfdata(prefix, perfdata);
+		perfdata->Add(new PerfdataValue(prefix + "_data_queue_items", dataBufferItems));
+
+		influxdbwriter->AddLatencyStats(stats, prefix, perfdata);
+
+		PerfdataSpool::Ptr spool = influxdbwriter->m_Spool;
 
-		perfdata->Add(new PerfdataValue("influxdbwriter_" + influxdbwriter->GetName() + "_work_queue_items", workQueueItems));
-		perfdata->Add(new PerfdataValue("influxdbwriter_" + influxdbwriter->GetName() + "_work_queue_item_rate", workQueueItemRate));
-		perfdata->Add(new PerfdataValue("influxdbwriter_" + influxdbwriter->GetName() + "_data_queue_items", dataBufferItems));
+		if (spool)
+			spool->AddStats(stats, prefix, perfdata);
+
+		nodes.emplace_back(influxdbwriter->GetName(), stats);
 	}
 
 	status->Set("influxdbwriter", new Dictionary(std::move(nodes)));
@@ -116,16 +125,37 @@ void InfluxdbWriter::Resume()
 	/* Register exception handler for WQ tasks. */
 	m_WorkQueue.SetExceptionCallback([this](boost::exception_ptr exp) { ExceptionHandler(std::move(exp)); });
 
+	/* Flushes block once all connections are busy and one more batch is waiting. */
+	m_SendQueue.reset(new WorkQueue(GetMaxConnections(), GetMaxConnections()));
+	m_SendQueue->SetName("InfluxdbWriter, " + GetName() + ", send");
+	m_SendQueue->SetExceptionCallback([this](boost::exception_ptr exp) { ExceptionHandler(std::move(exp)); });
+
+	if (GetEnableSpool()) {
+		m_Spool = new PerfdataSpool(Configuration::DataDir + "/spool/influxdbwriter/" + GetName(),
+			static_cast<uint_fast64_t>(GetSpoolSizeLimit()) * 1024u * 1024u);
+	}
+
 	/* Setup timer for periodically flushing m_DataBuffer */
 	m_FlushTimer = new Timer();
 	m_FlushTimer->SetInterval(GetFlushInterval());
+	m_FlushTimer->SetSlack(1);
 	m_FlushTimer->OnTimerExpired.connect([this](const Timer * const&) { FlushTimeout(); });
 	m_FlushTimer->Start();
 	m_FlushTimer->Reschedule(0);
 
 	/* Register for new metrics. */
-	Checkable::OnNewCheckResult.connect([this](const Checkable::Ptr& checkable, const CheckResult::Ptr& cr, const MessageOrigin::Ptr&) {
-		CheckResultHandler(checkable, cr);
+	Checkable::OnNewCheckResults.connect([this](const Checkable::CheckResultBatch& batch) {
+		CheckResultHandler(batch);
+	});
+
+	/* Don't keep the specialized templates of deleted objects. */
+	ConfigObject::OnActiveChanged.connect([this](const ConfigObject::Ptr& object, const Value&) {
+		auto checkable (dynamic_pointer_cast<Checkable>(object));
+
+		if (checkable && !checkable->IsActive()) {
+			m_HostTemplate.Cache.Erase(checkable);
+			m_ServiceTemplate.Cache.Erase(checkable);
+		}
 	});
 }
 
@@ -150,6 +180,13 @@ void InfluxdbWriter::Pause()
 
 	Flush();
 
+	Log(LogDebug, "InfluxdbWriter")
+		<< "Waiting for pending write requests.";
+
+	m_SendQueue->Join();
+
+	CloseIdleConnections();
+
 	Log(LogInformation, "InfluxdbWriter")
 		<< "'" << GetName() << "' paused.";
 
@@ -168,7 +205,7 @@ void InfluxdbWriter::ExceptionHandler(boost::exception_ptr exp)
 	Log(LogDebug, "InfluxdbWriter")
 		<< "Exception during InfluxDB operation: " << DiagnosticInformation(std::move(exp));
 
-	//TODO: Close the connection, if we keep it open.
+	CloseIdleConnections();
 }
 
 OptionalTlsStream InfluxdbWriter::Connect()
@@ -219,12 +256,135 @@ OptionalTlsStream InfluxdbWriter::Connect()
 	return std::move(stream);
 }
 
-void InfluxdbWriter::CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr)
+/**
+ * Takes an idle kept alive connection from the pool or establishes a new one.
+ *
+ * @param reused Receives whether the connection comes from the pool
+ * @return The connection
+ */
+OptionalTlsStream InfluxdbWriter::AcquireConnection(bool& reused)
+{
+	{
+		std::unique_lock<std::mutex> lock (m_ConnectionsMutex);
+
+		if (!m_IdleConnections.empty()) {
+			OptionalTlsStream stream (std::move(m_IdleConnections.back()));
+			m_IdleConnections.pop_back();
+
+			reused = true;
+			return std::move(stream);
+		}
+	}
+
+	reused = false;
+	return Connect();
+}
+
+/**
+ * Puts a connection which InfluxDB keeps alive back into the pool.
+ */
+void InfluxdbWriter::ReleaseConnection(OptionalTlsStream&& stream)
+{
+	{
+		std::unique_lock<std::mutex> lock (m_ConnectionsMutex);
+
+		if (m_IdleConnections.size() < static_cast<size_t>(GetMaxConnections())) {
+			m_IdleConnections.emplace_back(std::move(stream));
+			return;
+		}
+	}
+
+	CloseConnection(stream);
+}
+
+void InfluxdbWriter::CloseConnection(OptionalTlsStream& stream)
+{
+	if (stream.first) {
+		boost::system::error_code ec;
+		stream.first->next_layer().shutdown(ec);
+	}
+}
+
+void InfluxdbWriter::CloseIdleConnections()
+{
+	std::vector<OptionalTlsStream> connections;
+
+	{
+		std::unique_lock<std::mutex> lock (m_ConnectionsMutex);
+		connections.swap(m_IdleConnections);
+	}
+
+	for (auto& stream : connections) {
+		CloseConnection(stream);
+	}
+}
+
+void InfluxdbWriter::RecordLatency(double latency)
+{
+	size_t bucket = std::lower_bound(std::begin(l_LatencyBuckets), std::end(l_LatencyBuckets), latency) - std::begin(l_LatencyBuckets);
+
+	std::unique_lock<std::mutex> lock (m_LatencyMutex);
+
+	if (m_LatencyHistogram.empty())
+		m_LatencyHistogram.resize(l_LatencyBucketCount);
+
+	m_LatencyHistogram[bucket]++;
+	m_LatencySum += latency;
+	m_Requests++;
+}
+
+/**
+ * Adds the write request latency histogram to the stats, with cumulative bucket counters.
+ *
+ * @param stats The writer's stats
+ * @param prefix The writer's perfdata label prefix
+ * @param perfdata Array of PerfdataValue objects
+ */
+void InfluxdbWriter::AddLatencyStats(const Dictionary::Ptr& stats, const String& prefix, const Array::Ptr& perfdata)
+{
+	std::vector<uint_fast64_t> histogram;
+	double sum;
+	uint_fast64_t requests;
+
+	{
+		std::unique_lock<std::mutex> lock (m_LatencyMutex);
+
+		histogram = m_LatencyHistogram;
+		sum = m_LatencySum;
+		requests = m_Requests;
+	}
+
+	histogram.resize(l_LatencyBucketCount);
+
+	DictionaryData buckets;
+	uint_fast64_t count = 0;
+
+	for (size_t i = 0; i < l_LatencyBucketCount; i++) {
+		String bound = i + 1u < l_LatencyBucketCount ? Convert::ToString(l_LatencyBuckets[i]) : "inf";
+
+		count += histogram[i];
+
+		buckets.emplace_back(bound, count);
+		perfdata->Add(new PerfdataValue(prefix + "_request_latency_le_" + bound, count, true));
+	}
+
+	stats->Set("request_latency_buckets", new Dictionary(std::move(buckets)));
+	stats->Set("request_latency_sum", sum);
+	stats->Set("requests", requests);
+
+	perfdata->Add(new PerfdataValue(prefix + "_request_latency_sum", sum, true, "seconds"));
+	perfdata->Add(new PerfdataValue(prefix + "_requests", requests, true));
+}
+
+void InfluxdbWriter::CheckResultHandler(const Checkable::CheckResultBatch& batch)
 {
 	if (IsPaused())
 		return;
 
-	m_WorkQueue.Enqueue([this, checkable, cr]() { CheckResultHandlerWQ(checkable, cr); }, PriorityLow);
+	EnqueueExport([this, batch]() {
+		for (auto& entry : batch)
+			CheckResultHandlerWQ(entry.Object, entry.Result);
+	}, PriorityLow);
 }
 
 void InfluxdbWriter::CheckResultHandlerWQ(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr)
@@ -250,24 +410,29 @@ void InfluxdbWriter::CheckResultHandlerWQ(const Checkable::Ptr& checkable, const
 
 	double ts = cr->GetExecutionEnd();
 
-	// Clone the template and perform an in-place macro expansion of measurement and tag values
-	Dictionary::Ptr tmpl_clean = service ? GetServiceTemplate() : GetHostTemplate();
-	Dictionary::Ptr tmpl = static_pointer_cast<Dictionary>(tmpl_clean->ShallowClone());
-	tmpl->Set("measurement", MacroProcessor::ResolveMacros(tmpl->Get("measurement"), resolvers, cr));
+	/* Only the macros which depend on the check result are left to resolve,
+	 * the others have been resolved once for this checkable.
+	 */
+	CompiledTemplate& compiled = service ? m_ServiceTemplate : m_HostTemplate;
+	Dictionary::Ptr source = service ? GetServiceTemplate() : GetHostTemplate();
+
+	if (compiled.Source != source)
+		CompileTemplate(compiled, source);
+
+	auto values (compiled.Cache.Get(checkable, compiled.Values, resolvers));
 
-	Dictionary::Ptr tagsClean = tmpl->Get("tags");
-	if (tagsClean) {
+	Dictionary::Ptr tmpl = new Dictionary();
+	tmpl->Set("measurement", MacroProcessor::ResolveMacros((*values)[0], resolvers, cr));
+
+	if (compiled.HasTags) {
 		Dictionary::Ptr tags = new Dictionary();
 
-		{
-			ObjectLock olock(tagsClean);
-			for (const Dictionary::Pair& pair : tagsClean) {
-				String missing_macro;
-				Value value = MacroProcessor::ResolveMacros(pair.second, resolvers, cr, &missing_macro);
+		for (size_t i = 0; i < compiled.Tags.size(); i++) {
+			String missing_macro;
+			Value value = MacroProcessor::ResolveMacros((*values)[i + 1], resolvers, cr, &missing_macro);
 
-				if (missing_macro.IsEmpty()) {
-					tags->Set(pair.first, value);
-				}
+			if (missing_macro.IsEmpty()) {
+				tags->Set(compiled.Tags[i], value);
 			}
 		}
 
@@ -276,46 +441,34 @@ void InfluxdbWriter::CheckResultHandlerWQ(const Checkable::Ptr& checkable, const
 
 	CheckCommand::Ptr checkCommand = checkable->GetCheckCommand();
 
-	Array::Ptr perfdata = cr->GetPerformanceData();
-
-	if (perfdata) {
-		ObjectLock olock(perfdata);
-		for (const Value& val : perfdata) {
-			PerfdataValue::Ptr pdv;
-
-			if (val.IsObjectType<PerfdataValue>())
-				pdv = val;
-			else {
-				try {
-					pdv = PerfdataValue::Parse(val);
-				} catch (const std::exception&) {
-					Log(LogWarning, "InfluxdbWriter")
-						<< "Ignoring invalid perfdata for checkable '"
-						<< checkable->GetName() << "' and command '"
-						<< checkCommand->GetName() << "' with value: " << val;
-					continue;
-				}
-			}
+	ParsedPerfdata::Ptr perfdata = cr->GetParsedPerformanceData();
 
-			Dictionary::Ptr fields = new Dictionary();
-			fields->Set("value", pdv->GetValue());
-
-			if (GetEnableSendThresholds()) {
-				if (!pdv->GetCrit().IsEmpty())
-					fields->Set("crit", pdv->GetCrit());
-				if (!pdv->GetWarn().IsEmpty())
-					fields->Set("warn", pdv->GetWarn());
-				if (!pdv->GetMin().IsEmpty())
-					fields->Set("min", pdv->GetMin());
-				if (!pdv->GetMax().IsEmpty())
-					fields->Set("max", pdv->GetMax());
-			}
-			if (!pdv->GetUnit().IsEmpty()) {
-				fields->Set("unit", pdv->GetUnit());
-			}
+	for (const Value& val : perfdata->GetInvalid()) {
+		Log(LogWarning, "InfluxdbWriter")
+			<< "Ignoring invalid perfdata for checkable '"
+			<< checkable->GetName() << "' and command '"
+			<< checkCommand->GetName() << "' with value: " << val;
+	}
 
-			SendMetric(checkable, tmpl, pdv->GetLabel(), fields, ts);
+	for (size_t i = 0, length = perfdata->GetLength(); i < length; i++) {
+		Dictionary::Ptr fields = new Dictionary();
+		fields->Set("value", perfdata->GetValue(i));
+
+		if (GetEnableSendThresholds()) {
+			if (perfdata->HasCrit(i))
+				fields->Set("crit", perfdata->GetCrit(i));
+			if (perfdata->HasWarn(i))
+				fields->Set("warn", perfdata->GetWarn(i));
+			if (perfdata->HasMin(i))
+				fields->Set("min", perfdata->GetMin(i));
+			if (perfdata->HasMax(i))
+				fields->Set("max", perfdata->GetMax(i));
 		}
+		if (!perfdata->GetUnit(i).IsEmpty()) {
+			fields->Set("unit", perfdata->GetUnit(i));
+		}
+
+		SendMetric(checkable, tmpl, perfdata->GetLabel(i), fields, ts);
 	}
 
 	if (GetEnableSendMetadata()) {
@@ -382,6 +535,33 @@ String InfluxdbWriter::EscapeValue(const Value& value)
 	return value;
 }
 
+/**
+ * Compiles the measurement and the tag values of a template, see MacroProcessor::CompileValue().
+ */
+void InfluxdbWriter::CompileTemplate(CompiledTemplate& tmpl, const Dictionary::Ptr& source)
+{
+	auto values (std::make_shared<std::vector<CompiledMacroValue>>());
+
+	tmpl.Tags.clear();
+	values->emplace_back(MacroProcessor::CompileValue(source->Get("measurement")));
+
+	Dictionary::Ptr tags = source->Get("tags");
+	tmpl.HasTags = static_cast<bool>(tags);
+
+	if (tags) {
+		ObjectLock olock(tags);
+
+		for (const Dictionary::Pair& pair : tags) {
+			tmpl.Tags.emplace_back(pair.first);
+			values->emplace_back(MacroProcessor::CompileValue(pair.second));
+		}
+	}
+
+	tmpl.Source = source;
+	tmpl.Values = std::move(values);
+	tmpl.Cache.Clear();
+}
+
 void InfluxdbWriter::SendMetric(const Checkable::Ptr& checkable, const Dictionary::Ptr& tmpl,
 	const String& label, const Dictionary::Ptr& fields, double ts)
 {
@@ -453,13 +633,17 @@ void InfluxdbWriter::FlushTimeoutWQ()
 		<< "Timer expired writing " << m_DataBuffer.size() << " data points";
 
 	Flush();
+
+	if (m_Reachable)
+		DrainSpool();
 }
 
+/**
+ * Hands the buffered data points over to the send queue which spools them
+ * if InfluxDB isn't reachable. Spools them right away if the queue is full.
+ */
 void InfluxdbWriter::Flush()
 {
-	namespace beast = boost::beast;
-	namespace http = beast::http;
-
 	/* Flush can be called from 1) Timeout 2) Threshold 3) on shutdown/reload. */
 	if (m_DataBuffer.empty())
 		return;
@@ -467,24 +651,75 @@ void InfluxdbWriter::Flush()
 	Log(LogDebug, "InfluxdbWriter")
 		<< "Flushing data buffer to InfluxDB.";
 
-	String body = boost::algorithm::join(m_DataBuffer, "\n");
-	m_DataBuffer.clear();
+	auto points (std::make_shared<std::vector<String>>());
+	points->swap(m_DataBuffer);
 
-	OptionalTlsStream stream;
+	/* Don't wait for a connection while more and more data points pile up in memory. */
+	if (m_Spool && m_SendQueue->GetLength() >= static_cast<size_t>(GetMaxConnections())) {
+		Log(LogWarning, "InfluxdbWriter")
+			<< "All connections to InfluxDB are busy, spooling " << points->size() << " data points to disk.";
 
-	try {
-		stream = Connect();
-	} catch (const std::exception& ex) {
-		Log(LogWarning, "InfluxDbWriter")
-			<< "Flush failed, cannot connect to InfluxDB: " << DiagnosticInformation(ex, false);
+		m_Spool->Append(*points);
 		return;
 	}
 
-	Defer s ([&stream]() {
-		if (stream.first) {
-			stream.first->next_layer().shutdown();
+	m_SendQueue->Enqueue([this, points]() {
+		bool sent;
+
+		try {
+			sent = Send(boost::algorithm::join(*points, "\n"));
+		} catch (const std::exception&) {
+			m_Reachable = false;
+
+			if (!m_Spool)
+				throw;
+
+			sent = false;
+		}
+
+		m_Reachable = sent;
+
+		if (!sent && m_Spool) {
+			Log(LogWarning, "InfluxdbWriter")
+				<< "Spooling " << points->size() << " data points to disk.";
+
+			m_Spool->Append(*points);
 		}
 	});
+}
+
+/**
+ * Re-sends spooled data points, at most spool_drain_rate per second.
+ */
+void InfluxdbWriter::DrainSpool()
+{
+	if (!m_Spool || m_Spool->IsEmpty())
+		return;
+
+	size_t limit = static_cast<size_t>(GetSpoolDrainRate()) * std::max(GetFlushInterval(), 1);
+
+	try {
+		size_t drained = m_Spool->Drain(limit, std::max(GetFlushThreshold(), 1), [this](const std::vector<String>& points) {
+			if (!Send(boost::algorithm::join(points, "\n")))
+				BOOST_THROW_EXCEPTION(std::runtime_error("Cannot connect to InfluxDB."));
+		});
+
+		Log(LogNotice, "InfluxdbWriter")
+			<< "Sent " << drained << " spooled data points.";
+	} catch (const std::exception&) {
+		/* Already logged, try again on the next flush. */
+	}
+}
+
+/**
+ * Sends data points in line protocol over a pooled connection.
+ *
+ * @param body The data points
+ * @return Whether the connection could be established
+ */
+bool InfluxdbWriter::Send(const String& body)
+{
+	namespace http = boost::beast::http;
 
 	Url::Ptr url = new Url();
 	url->SetScheme(GetSslEnable() ? "https" : "http");
@@ -502,10 +737,11 @@ void InfluxdbWriter::Flush()
 	if (!GetPassword().IsEmpty())
 		url->AddQueryElement("p", GetPassword());
 
-	http::request<http::string_body> request (http::verb::post, std::string(url->Format(true)), 10);
+	http::request<http::string_body> request (http::verb::post, std::string(url->Format(true)), 11);
 
 	request.set(http::field::user_agent, "Icinga/" + Application::GetAppVersion());
 	request.set(http::field::host, url->GetHost() + ":" + url->GetPort());
+	request.keep_alive(true);
 
 	{
 		Dictionary::Ptr basicAuth = GetBasicAuth();
@@ -518,9 +754,67 @@ void InfluxdbWriter::Flush()
 		}
 	}
 
-	request.body() = body;
+	if (GetEnableGzip()) {
+		request.set(http::field::content_encoding, "gzip");
+		request.body() = GzipCompress(body);
+	} else {
+		request.body() = body;
+	}
+
 	request.content_length(request.body().size());
 
+	for (;;) {
+		bool reused;
+		OptionalTlsStream stream;
+
+		try {
+			stream = AcquireConnection(reused);
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "InfluxDbWriter")
+				<< "Flush failed, cannot connect to InfluxDB: " << DiagnosticInformation(ex, false);
+			return false;
+		}
+
+		bool keepAlive;
+
+		try {
+			keepAlive = SendRequest(stream, request);
+		} catch (const std::exception& ex) {
+			CloseConnection(stream);
+
+			/* InfluxDB may have closed the idle connection meanwhile. */
+			if (reused) {
+				Log(LogDebug, "InfluxdbWriter")
+					<< "Kept alive connection to InfluxDB failed, retrying on a new one: " << DiagnosticInformation(ex, false);
+				continue;
+			}
+
+			throw;
+		}
+
+		if (keepAlive)
+			ReleaseConnection(std::move(stream));
+		else
+			CloseConnection(stream);
+
+		return true;
+	}
+}
+
+/**
+ * Writes one request and handles its response.
+ *
+ * @param stream The connection
+ * @param request The request
+ * @return Whether InfluxDB keeps the connection alive
+ */
+bool InfluxdbWriter::SendRequest(OptionalTlsStream& stream, const boost::beast::http::request<boost::beast::http::string_body>& request)
+{
+	namespace beast = boost::beast;
+	namespace http = beast::http;
+
+	double start = Utility::GetTime();
+
 	try {
 		if (stream.first) {
 			http::write(*stream.first, request);
@@ -550,6 +844,8 @@ void InfluxdbWriter::Flush()
 		throw;
 	}
 
+	RecordLatency(Utility::GetTime() - start);
+
 	auto& response (parser.get());
 
 	if (response.result() != http::status::no_content) {
@@ -560,7 +856,7 @@ void InfluxdbWriter::Flush()
 		if (contentType != "application/json") {
 			Log(LogWarning, "InfluxdbWriter")
 				<< "Unexpected Content-Type: " << contentType;
-			return;
+			return response.keep_alive();
 		}
 
 		Dictionary::Ptr jsonResponse;
@@ -571,7 +867,7 @@ void InfluxdbWriter::Flush()
 		} catch (...) {
 			Log(LogWarning, "InfluxdbWriter")
 				<< "Unable to parse JSON response:\n" << body;
-			return;
+			return response.keep_alive();
 		}
 
 		String error = jsonResponse->Get("error");
@@ -579,6 +875,8 @@ void InfluxdbWriter::Flush()
 		Log(LogCritical, "InfluxdbWriter")
 			<< "InfluxDB error message:\n" << error;
 	}
+
+	return response.keep_alive();
 }
 
 void InfluxdbWriter::ValidateHostTemplate(const Lazy<Dictionary::Ptr>& lvalue, const ValidationUtils& utils)
@@ -617,3 +915,27 @@ void InfluxdbWriter::ValidateServiceTemplate(const Lazy<Dictionary::Ptr>& lvalue
 	}
 }
 
+
+void InfluxdbWriter::ValidateSpoolSizeLimit(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<InfluxdbWriter>::ValidateSpoolSizeLimit(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "spool_size_limit" }, "Value must be greater than 0."));
+}
+
+void InfluxdbWriter::ValidateSpoolDrainRate(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<InfluxdbWriter>::ValidateSpoolDrainRate(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "spool_drain_rate" }, "Value must be greater than 0."));
+}
+
+void InfluxdbWriter::ValidateMaxConnections(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<InfluxdbWriter>::ValidateMaxConnections(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "max_connections" }, "Value must be greater than 0."));
+}
@@ -5,12 +5,21 @@
 
 #include "perfdata/influxdbwriter-ti.hpp"
 #include "icinga/service.hpp"
+#include "icinga/macroprocessor.hpp"
 #include "base/configobject.hpp"
 #include "base/tcpsocket.hpp"
 #include "base/timer.hpp"
 #include "base/tlsstream.hpp"
 #include "base/workqueue.hpp"
+#include "perfdata/perfdataspool.hpp"
+#include <boost/beast/http/message.hpp>
+#include <boost/beast/http/string_body.hpp>
+#include <atomic>
+#include <cstdint>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace icinga
 {
@@ -30,6 +39,9 @@ public:
 
 	void ValidateHostTemplate(const Lazy<Dictionary::Ptr>& lvalue, const ValidationUtils& utils) override;
 	void ValidateServiceTemplate(const Lazy<Dictionary::Ptr>& lvalue, const ValidationUtils& utils) override;
+	void ValidateMaxConnections(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateSpoolSizeLimit(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateSpoolDrainRate(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
 
 protected:
 	void OnConfigLoaded() override;
@@ -37,22 +49,58 @@ protected:
 	void Pause() override;
 
 private:
-	WorkQueue m_WorkQueue{10000000, 1};
 	Timer::Ptr m_FlushTimer;
 	std::vector<String> m_DataBuffer;
+	PerfdataSpool::Ptr m_Spool;
 
-	void CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
+	/* Runs up to max_connections concurrent write requests. */
+	std::unique_ptr<WorkQueue> m_SendQueue;
+	std::atomic<bool> m_Reachable{true};
+
+	std::mutex m_ConnectionsMutex;
+	std::vector<OptionalTlsStream> m_IdleConnections;
+
+	std::mutex m_LatencyMutex;
+	std::vector<uint_fast64_t> m_LatencyHistogram;
+	double m_LatencySum{0};
+	uint_fast64_t m_Requests{0};
+
+	/* The measurement and the tag values of a template, only used on the work queue. */
+	struct CompiledTemplate
+	{
+		Dictionary::Ptr Source;
+		bool HasTags;
+		std::vector<String> Tags;
+		MacroSpecializationCache::Values Values;
+		MacroSpecializationCache Cache;
+	};
+
+	CompiledTemplate m_HostTemplate;
+	CompiledTemplate m_ServiceTemplate;
+
+	void CheckResultHandler(const Checkable::CheckResultBatch& batch);
 	void CheckResultHandlerWQ(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
+	static void CompileTemplate(CompiledTemplate& tmpl, const Dictionary::Ptr& source);
 	void SendMetric(const Checkable::Ptr& checkable, const Dictionary::Ptr& tmpl,
 		const String& label, const Dictionary::Ptr& fields, double ts);
 	void FlushTimeout();
 	void FlushTimeoutWQ();
 	void Flush();
+	void DrainSpool();
+	bool Send(const String& body);
+	bool SendRequest(OptionalTlsStream& stream, const boost::beast::http::request<boost::beast::http::string_body>& request);
 
 	static String EscapeKeyOrTagValue(const String& str);
 	static String EscapeValue(const Value& value);
 
 	OptionalTlsStream Connect();
+	OptionalTlsStream AcquireConnection(bool& reused);
+	void ReleaseConnection(OptionalTlsStream&& stream);
+	static void CloseConnection(OptionalTlsStream& stream);
+	void CloseIdleConnections();
+
+	void RecordLatency(double latency);
+	void AddLatencyStats(const Dictionary::Ptr& stats, const String& prefix, const Array::Ptr& perfdata);
 
 	void AssertOnWorkQueue();
 
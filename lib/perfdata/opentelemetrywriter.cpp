@@ -0,0 +1,343 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "perfdata/opentelemetrywriter.hpp"
+#include "perfdata/opentelemetrywriter-ti.cpp"
+#include "icinga/icingaapplication.hpp"
+#include "base/application.hpp"
+#include "base/configtype.hpp"
+#include "base/convert.hpp"
+#include "base/exception.hpp"
+#include "base/io-engine.hpp"
+#include "base/json.hpp"
+#include "base/logger.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/statsfunction.hpp"
+#include "base/tcpsocket.hpp"
+#include "base/tlsutility.hpp"
+#include <boost/asio/ssl/context.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/http/field.hpp>
+#include <boost/beast/http/message.hpp>
+#include <boost/beast/http/parser.hpp>
+#include <boost/beast/http/read.hpp>
+#include <boost/beast/http/status.hpp>
+#include <boost/beast/http/string_body.hpp>
+#include <boost/beast/http/verb.hpp>
+#include <boost/beast/http/write.hpp>
+#include <cinttypes>
+#include <cstdio>
+#include <utility>
+
+using namespace icinga;
+
+REGISTER_TYPE(OpenTelemetryWriter);
+
+REGISTER_STATSFUNCTION(OpenTelemetryWriter, &OpenTelemetryWriter::StatsFunc);
+
+void OpenTelemetryWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
+{
+	DictionaryData nodes;
+
+	for (const OpenTelemetryWriter::Ptr& writer : ConfigType::GetObjectsByType<OpenTelemetryWriter>()) {
+		String prefix = "opentelemetrywriter_" + writer->GetName();
+		size_t spanBufferItems;
+
+		{
+			std::unique_lock<std::mutex> lock (writer->m_SpansMutex);
+			spanBufferItems = writer->m_Spans.size();
+		}
+
+		double exportedSpans = writer->m_ExportedSpans.load();
+
+		Dictionary::Ptr stats = writer->GetExportStats();
+		stats->Set("span_buffer_items", spanBufferItems);
+		stats->Set("exported_spans", exportedSpans);
+
+		writer->AddExportPerfdata(prefix, perfdata);
+		perfdata->Add(new PerfdataValue(prefix + "_span_buffer_items", spanBufferItems));
+		perfdata->Add(new PerfdataValue(prefix + "_exported_spans", exportedSpans, true));
+
+		nodes.emplace_back(writer->GetName(), stats);
+	}
+
+	status->Set("opentelemetrywriter", new Dictionary(std::move(nodes)));
+}
+
+void OpenTelemetryWriter::ValidateSampleRate(const Lazy<double>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<OpenTelemetryWriter>::ValidateSampleRate(lvalue, utils);
+
+	if (lvalue() < 0 || lvalue() > 1)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "sample_rate" }, "Value must be between 0 and 1."));
+}
+
+void OpenTelemetryWriter::Resume()
+{
+	ObjectImpl<OpenTelemetryWriter>::Resume();
+
+	Log(LogInformation, "OpenTelemetryWriter")
+		<< "'" << GetName() << "' resumed.";
+
+	m_WorkQueue.SetExceptionCallback([this](boost::exception_ptr exp) {
+		Log(LogCritical, "OpenTelemetryWriter")
+			<< "Exception during OTLP export: " << DiagnosticInformation(std::move(exp));
+	});
+
+	m_FlushTimer = new Timer();
+	m_FlushTimer->SetInterval(GetFlushInterval());
+	m_FlushTimer->SetSlack(1);
+	m_FlushTimer->OnTimerExpired.connect([this](const Timer * const&) { Flush(); });
+	m_FlushTimer->Start();
+
+	/* Only one writer can receive the spans, the last one resumed wins. */
+	OpenTelemetryWriter::Ptr self (this);
+
+	Span::SetExporter([self](const SpanData& span) { self->AddSpan(span); }, GetSampleRate());
+}
+
+void OpenTelemetryWriter::Pause()
+{
+	Span::SetExporter(nullptr, 0);
+
+	m_FlushTimer->Stop(true);
+
+	Flush();
+
+	m_WorkQueue.Join();
+
+	Log(LogInformation, "OpenTelemetryWriter")
+		<< "'" << GetName() << "' paused.";
+
+	ObjectImpl<OpenTelemetryWriter>::Pause();
+}
+
+/**
+ * Buffers a finished span. Called on the thread which has finished it.
+ *
+ * @param span The span
+ */
+void OpenTelemetryWriter::AddSpan(const SpanData& span)
+{
+	std::unique_lock<std::mutex> lock (m_SpansMutex);
+
+	m_Spans.push_back(span);
+
+	if (m_Spans.size() >= static_cast<size_t>(GetFlushThreshold())) {
+		lock.unlock();
+		Flush();
+	}
+}
+
+/**
+ * Hands the buffered spans over to the work queue.
+ */
+void OpenTelemetryWriter::Flush()
+{
+	auto spans (std::make_shared<std::vector<SpanData>>());
+
+	{
+		std::unique_lock<std::mutex> lock (m_SpansMutex);
+		spans->swap(m_Spans);
+	}
+
+	if (spans->empty())
+		return;
+
+	EnqueueExport([this, spans]() { Send(*spans); });
+}
+
+static String FormatId(uint64_t high, uint64_t low)
+{
+	char buf[33];
+
+	snprintf(buf, sizeof(buf), "%016" PRIx64 "%016" PRIx64, high, low);
+
+	return buf;
+}
+
+static String FormatId(uint64_t id)
+{
+	char buf[17];
+
+	snprintf(buf, sizeof(buf), "%016" PRIx64, id);
+
+	return buf;
+}
+
+static Dictionary::Ptr FormatAttribute(const String& key, const Value& value)
+{
+	Dictionary::Ptr anyValue;
+
+	if (value.IsNumber())
+		anyValue = new Dictionary({ { "doubleValue", value } });
+	else if (value.IsBoolean())
+		anyValue = new Dictionary({ { "boolValue", value } });
+	else
+		anyValue = new Dictionary({ { "stringValue", Convert::ToString(value) } });
+
+	return new Dictionary({
+		{ "key", key },
+		{ "value", anyValue }
+	});
+}
+
+/**
+ * Builds an OTLP/JSON ExportTraceServiceRequest.
+ *
+ * @param spans The finished spans
+ * @param serviceName The service.name resource attribute
+ * @return The request body
+ */
+String OpenTelemetryWriter::FormatSpans(const std::vector<SpanData>& spans, const String& serviceName)
+{
+	ArrayData otlpSpans;
+	otlpSpans.reserve(spans.size());
+
+	for (auto& span : spans) {
+		ArrayData attributes;
+
+		if (span.Attributes) {
+			ObjectLock olock (span.Attributes);
+
+			for (auto& kv : span.Attributes)
+				attributes.emplace_back(FormatAttribute(kv.first, kv.second));
+		}
+
+		Dictionary::Ptr otlpSpan = new Dictionary({
+			{ "traceId", FormatId(span.Context.TraceIdHigh, span.Context.TraceIdLow) },
+			{ "spanId", FormatId(span.Context.SpanId) },
+			{ "name", span.Name },
+			/* SPAN_KIND_INTERNAL */
+			{ "kind", 1 },
+			/* 64-bit integers are strings in OTLP/JSON. */
+			{ "startTimeUnixNano", Convert::ToString(span.StartTime) },
+			{ "endTimeUnixNano", Convert::ToString(span.EndTime) },
+			{ "attributes", new Array(std::move(attributes)) }
+		});
+
+		if (span.ParentSpanId)
+			otlpSpan->Set("parentSpanId", FormatId(span.ParentSpanId));
+
+		otlpSpans.emplace_back(std::move(otlpSpan));
+	}
+
+	ArrayData resourceAttributes ({
+		FormatAttribute("service.name", serviceName),
+		FormatAttribute("service.version", Application::GetAppVersion())
+	});
+
+	IcingaApplication::Ptr app = IcingaApplication::GetInstance();
+
+	if (app)
+		resourceAttributes.emplace_back(FormatAttribute("service.instance.id", app->GetNodeName()));
+
+	Dictionary::Ptr request = new Dictionary({
+		{ "resourceSpans", new Array({
+			new Dictionary({
+				{ "resource", new Dictionary({
+					{ "attributes", new Array(std::move(resourceAttributes)) }
+				}) },
+				{ "scopeSpans", new Array({
+					new Dictionary({
+						{ "scope", new Dictionary({ { "name", "icinga2" } }) },
+						{ "spans", new Array(std::move(otlpSpans)) }
+					})
+				}) }
+			})
+		}) }
+	});
+
+	return JsonEncode(request);
+}
+
+/**
+ * Posts spans to the OTLP endpoint. Runs on the work queue.
+ *
+ * Traces are best effort, so spans are dropped if the collector isn't reachable.
+ *
+ * @param spans The finished spans
+ */
+void OpenTelemetryWriter::Send(const std::vector<SpanData>& spans)
+{
+	namespace beast = boost::beast;
+	namespace http = beast::http;
+
+	if (!ShouldReconnect()) {
+		Log(LogDebug, "OpenTelemetryWriter")
+			<< "Dropping " << spans.size() << " spans, the OTLP collector has been unreachable.";
+		return;
+	}
+
+	http::request<http::string_body> request (http::verb::post, std::string(GetPath()), 11);
+
+	request.set(http::field::user_agent, "Icinga/" + Application::GetAppVersion());
+	request.set(http::field::host, GetHost() + ":" + GetPort());
+	request.set(http::field::content_type, "application/json");
+	request.body() = FormatSpans(spans, GetServiceName());
+	request.content_length(request.body().size());
+
+	OptionalTlsStream stream;
+
+	try {
+		stream = Connect();
+	} catch (const std::exception& ex) {
+		ReconnectFailed();
+
+		Log(LogWarning, "OpenTelemetryWriter")
+			<< "Dropping " << spans.size() << " spans, cannot connect to the OTLP collector on host '"
+			<< GetHost() << "' port '" << GetPort() << "': " << DiagnosticInformation(ex, false);
+		return;
+	}
+
+	ReconnectSucceeded();
+
+	http::parser<false, http::string_body> parser;
+	beast::flat_buffer buf;
+
+	if (stream.first) {
+		http::write(*stream.first, request);
+		stream.first->flush();
+		http::read(*stream.first, buf, parser);
+
+		boost::system::error_code ec;
+		stream.first->next_layer().shutdown(ec);
+	} else {
+		http::write(*stream.second, request);
+		stream.second->flush();
+		http::read(*stream.second, buf, parser);
+	}
+
+	auto& response (parser.get());
+
+	if (http::to_status_class(response.result()) != http::status_class::successful) {
+		Log(LogWarning, "OpenTelemetryWriter")
+			<< "Unexpected response code " << response.result_int() << " from the OTLP collector: " << response.body();
+		return;
+	}
+
+	m_ExportedSpans.fetch_add(spans.size());
+}
+
+OptionalTlsStream OpenTelemetryWriter::Connect()
+{
+	OptionalTlsStream stream;
+	bool tls = GetEnableTls();
+
+	if (tls) {
+		Shared<boost::asio::ssl::context>::Ptr sslContext = MakeAsioSslContext(GetCertPath(), GetKeyPath(), GetCaPath());
+
+		stream.first = Shared<AsioTlsStream>::Make(IoEngine::Get().GetIoContext(), *sslContext, GetHost());
+	} else {
+		stream.second = Shared<AsioTcpStream>::Make(IoEngine::Get().GetIoContext());
+	}
+
+	icinga::Connect(tls ? stream.first->lowest_layer() : stream.second->lowest_layer(), GetHost(), GetPort());
+
+	if (tls) {
+		auto& tlsStream (stream.first->next_layer());
+
+		tlsStream.handshake(tlsStream.client);
+	}
+
+	return std::move(stream);
+}
@@ -0,0 +1,56 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef OPENTELEMETRYWRITER_H
+#define OPENTELEMETRYWRITER_H
+
+#include "perfdata/opentelemetrywriter-ti.hpp"
+#include "base/configobject.hpp"
+#include "base/timer.hpp"
+#include "base/tlsstream.hpp"
+#include "base/tracing.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * Exports the spans of sampled check traces via OTLP/HTTP.
+ *
+ * @ingroup perfdata
+ */
+class OpenTelemetryWriter final : public ObjectImpl<OpenTelemetryWriter>
+{
+public:
+	DECLARE_OBJECT(OpenTelemetryWriter);
+	DECLARE_OBJECTNAME(OpenTelemetryWriter);
+
+	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
+
+	static String FormatSpans(const std::vector<SpanData>& spans, const String& serviceName);
+
+	void ValidateSampleRate(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
+
+protected:
+	void Resume() override;
+	void Pause() override;
+
+private:
+	Timer::Ptr m_FlushTimer;
+	std::vector<SpanData> m_Spans;
+	std::mutex m_SpansMutex;
+
+	std::atomic<uint_fast64_t> m_ExportedSpans{0};
+
+	void AddSpan(const SpanData& span);
+	void Flush();
+	void Send(const std::vector<SpanData>& spans);
+	OptionalTlsStream Connect();
+};
+
+}
+
+#endif /* OPENTELEMETRYWRITER_H */
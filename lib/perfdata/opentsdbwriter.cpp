@@ -18,9 +18,18 @@
 #include "base/stream.hpp"
 #include "base/networkstream.hpp"
 #include "base/exception.hpp"
+#include "base/json.hpp"
 #include "base/statsfunction.hpp"
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/beast/core/flat_buffer.hpp>
+#include <boost/beast/http/field.hpp>
+#include <boost/beast/http/parser.hpp>
+#include <boost/beast/http/read.hpp>
+#include <boost/beast/http/status.hpp>
+#include <boost/beast/http/verb.hpp>
+#include <boost/beast/http/write.hpp>
+#include <utility>
 
 using namespace icinga;
 
@@ -49,15 +58,27 @@ void OpenTsdbWriter::OnConfigLoaded()
  * Feature stats interface
  *
  * @param status Key value pairs for feature stats
+ * @param perfdata Array of PerfdataValue objects
  */
-void OpenTsdbWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+void OpenTsdbWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
 	DictionaryData nodes;
 
 	for (const OpenTsdbWriter::Ptr& opentsdbwriter : ConfigType::GetObjectsByType<OpenTsdbWriter>()) {
-		nodes.emplace_back(opentsdbwriter->GetName(), new Dictionary({
-			{ "connected", opentsdbwriter->GetConnected() }
-		}));
+		String prefix = "opentsdbwriter_" + opentsdbwriter->GetName();
+		double pointsSent = opentsdbwriter->m_PointsSent.load();
+		double pointsFailed = opentsdbwriter->m_PointsFailed.load();
+
+		Dictionary::Ptr stats = opentsdbwriter->GetExportStats();
+		stats->Set("connected", opentsdbwriter->GetConnected());
+		stats->Set("points_sent", pointsSent);
+		stats->Set("points_failed", pointsFailed);
+
+		nodes.emplace_back(opentsdbwriter->GetName(), stats);
+
+		opentsdbwriter->AddExportPerfdata(prefix, perfdata);
+		perfdata->Add(new PerfdataValue(prefix + "_points_sent", pointsSent, true));
+		perfdata->Add(new PerfdataValue(prefix + "_points_failed", pointsFailed, true));
 	}
 
 	status->Set("opentsdbwriter", new Dictionary(std::move(nodes)));
@@ -75,14 +96,32 @@ void OpenTsdbWriter::Resume()
 
 	ReadConfigTemplate(m_ServiceConfigTemplate, m_HostConfigTemplate);
 
-	m_ReconnectTimer = new Timer();
-	m_ReconnectTimer->SetInterval(10);
-	m_ReconnectTimer->OnTimerExpired.connect([this](const Timer * const&) { ReconnectTimerHandler(); });
-	m_ReconnectTimer->Start();
-	m_ReconnectTimer->Reschedule(0);
+	m_WorkQueue.SetExceptionCallback([this](boost::exception_ptr exp) { ExceptionHandler(std::move(exp)); });
+
+	m_Http = GetProtocol() == "http";
+
+	if (m_Http) {
+		/* Flushes block once all connections are busy and one more batch is waiting. */
+		m_SendQueue.reset(new WorkQueue(GetMaxConnections(), GetMaxConnections()));
+		m_SendQueue->SetName("OpenTsdbWriter, " + GetName() + ", send");
+		m_SendQueue->SetExceptionCallback([this](boost::exception_ptr exp) { ExceptionHandler(std::move(exp)); });
+
+		/* Setup timer for periodically flushing m_DataBuffer */
+		m_FlushTimer = new Timer();
+		m_FlushTimer->SetInterval(GetFlushInterval());
+		m_FlushTimer->SetSlack(1);
+		m_FlushTimer->OnTimerExpired.connect([this](const Timer * const&) { FlushTimeout(); });
+		m_FlushTimer->Start();
+	} else {
+		m_ReconnectTimer = new Timer();
+		m_ReconnectTimer->SetInterval(ReconnectInterval);
+		m_ReconnectTimer->OnTimerExpired.connect([this](const Timer * const&) { ReconnectTimerHandler(); });
+		m_ReconnectTimer->Start();
+		m_ReconnectTimer->Reschedule(0);
+	}
 
-	Service::OnNewCheckResult.connect([this](const Checkable::Ptr& checkable, const CheckResult::Ptr& cr, const MessageOrigin::Ptr&) {
-		CheckResultHandler(checkable, cr);
+	Checkable::OnNewCheckResults.connect([this](const Checkable::CheckResultBatch& batch) {
+		CheckResultHandler(batch);
 	});
 }
 
@@ -92,23 +131,75 @@ void OpenTsdbWriter::Resume()
 void OpenTsdbWriter::Pause()
 {
 	m_ReconnectTimer.reset();
+	m_FlushTimer.reset();
+
+	m_WorkQueue.Join();
+
+	if (m_Http) {
+		/* Send the data points buffered by the WQ tasks. */
+		Flush();
+
+		m_SendQueue->Join();
+
+		CloseIdleConnections();
+	}
 
 	Log(LogInformation, "OpentsdbWriter")
 		<< "'" << GetName() << "' paused.";
 
-	m_Stream->close();
+	if (m_Stream)
+		m_Stream->close();
 
 	SetConnected(false);
 
 	ObjectImpl<OpenTsdbWriter>::Pause();
 }
 
+/**
+ * Exception handler for the WQ.
+ *
+ * Closes the connection if connected.
+ *
+ * @param exp Exception pointer
+ */
+void OpenTsdbWriter::ExceptionHandler(boost::exception_ptr exp)
+{
+	Log(LogCritical, "OpenTsdbWriter", "Exception during OpenTSDB operation: Verify that your backend is operational!");
+
+	Log(LogDebug, "OpenTsdbWriter")
+		<< "Exception during OpenTSDB operation: " << DiagnosticInformation(std::move(exp));
+
+	if (m_Http) {
+		CloseIdleConnections();
+	} else if (GetConnected()) {
+		m_Stream->close();
+	}
+
+	SetConnected(false);
+}
+
 /**
  * Reconnect handler called by the timer.
- * Handles TLS
+ *
+ * Enqueues a reconnect task into the WQ unless backing off after failed attempts.
  */
 void OpenTsdbWriter::ReconnectTimerHandler()
 {
+	if (IsPaused() || !ShouldReconnect())
+		return;
+
+	m_WorkQueue.Enqueue([this]() { Reconnect(); }, PriorityHigh);
+}
+
+/**
+ * Reconnect method, connects to a TCP stream.
+ *
+ * Called inside the WQ.
+ */
+void OpenTsdbWriter::Reconnect()
+{
+	ASSERT(m_WorkQueue.IsWorkerThread());
+
 	if (IsPaused())
 		return;
 
@@ -135,27 +226,46 @@ void OpenTsdbWriter::ReconnectTimerHandler()
 			<< "Can't connect to OpenTSDB on host '" << GetHost() << "' port '" << GetPort() << ".'";
 
 		SetConnected(false);
+		ReconnectFailed();
 
 		return;
 	}
 
 	SetConnected(true);
+	ReconnectSucceeded();
 
 	Log(LogInformation, "OpenTsdbWriter")
 		<< "Finished reconnecting to OpenTSDB in " << std::setw(2) << Utility::GetTime() - startTime << " second(s).";
 }
 
+/**
+ * Check result event handler, checks whether feature is not paused in HA setups.
+ *
+ * @param batch Host/Service objects and their check results
+ */
+void OpenTsdbWriter::CheckResultHandler(const Checkable::CheckResultBatch& batch)
+{
+	if (IsPaused())
+		return;
+
+	EnqueueExport([this, batch]() {
+		for (auto& entry : batch)
+			CheckResultHandlerInternal(entry.Object, entry.Result);
+	});
+}
+
 /**
  * Registered check result handler processing data.
  * Calculates tags from the config.
  *
+ * Called inside the WQ.
+ *
  * @param checkable Host/service object
  * @param cr Check result
  */
-void OpenTsdbWriter::CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr)
+void OpenTsdbWriter::CheckResultHandlerInternal(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr)
 {
-	if (IsPaused())
-		return;
+	ASSERT(m_WorkQueue.IsWorkerThread());
 
 	CONTEXT("Processing check result for '" + checkable->GetName() + "'");
 
@@ -301,56 +411,43 @@ void OpenTsdbWriter::CheckResultHandler(const Checkable::Ptr& checkable, const C
 void OpenTsdbWriter::SendPerfdata(const Checkable::Ptr& checkable, const String& metric,
 	const std::map<String, String>& tags, const CheckResult::Ptr& cr, double ts)
 {
-	Array::Ptr perfdata = cr->GetPerformanceData();
-
-	if (!perfdata)
-		return;
+	ParsedPerfdata::Ptr perfdata = cr->GetParsedPerformanceData();
 
 	CheckCommand::Ptr checkCommand = checkable->GetCheckCommand();
 
-	ObjectLock olock(perfdata);
-	for (const Value& val : perfdata) {
-		PerfdataValue::Ptr pdv;
-
-		if (val.IsObjectType<PerfdataValue>())
-			pdv = val;
-		else {
-			try {
-				pdv = PerfdataValue::Parse(val);
-			} catch (const std::exception&) {
-				Log(LogWarning, "OpenTsdbWriter")
-					<< "Ignoring invalid perfdata for checkable '"
-					<< checkable->GetName() << "' and command '"
-					<< checkCommand->GetName() << "' with value: " << val;
-				continue;
-			}
-		}
-		
+	for (const Value& val : perfdata->GetInvalid()) {
+		Log(LogWarning, "OpenTsdbWriter")
+			<< "Ignoring invalid perfdata for checkable '"
+			<< checkable->GetName() << "' and command '"
+			<< checkCommand->GetName() << "' with value: " << val;
+	}
+
+	for (size_t i = 0, length = perfdata->GetLength(); i < length; i++) {
 		String metric_name;
 		std::map<String, String> tags_new = tags;
 
 		// Do not break original functionality where perfdata labels form
 		// part of the metric name
 		if (!GetEnableGenericMetrics()) {
-			String escaped_key = EscapeMetric(pdv->GetLabel());
+			String escaped_key = EscapeMetric(perfdata->GetLabel(i));
 			boost::algorithm::replace_all(escaped_key, "::", ".");
 			metric_name = metric + "." + escaped_key;
 		} else {
-			String escaped_key = EscapeTag(pdv->GetLabel());
+			String escaped_key = EscapeTag(perfdata->GetLabel(i));
 			metric_name = metric;
 			tags_new["label"] = escaped_key;
 		}
 
-		SendMetric(checkable, metric_name, tags_new, pdv->GetValue(), ts);
+		SendMetric(checkable, metric_name, tags_new, perfdata->GetValue(i), ts);
 
-		if (!pdv->GetCrit().IsEmpty())
-			SendMetric(checkable, metric_name + "_crit", tags_new, pdv->GetCrit(), ts);
-		if (!pdv->GetWarn().IsEmpty())
-			SendMetric(checkable, metric_name + "_warn", tags_new, pdv->GetWarn(), ts);
-		if (!pdv->GetMin().IsEmpty())
-			SendMetric(checkable, metric_name + "_min", tags_new, pdv->GetMin(), ts);
-		if (!pdv->GetMax().IsEmpty())
-			SendMetric(checkable, metric_name + "_max", tags_new, pdv->GetMax(), ts);
+		if (perfdata->HasCrit(i))
+			SendMetric(checkable, metric_name + "_crit", tags_new, perfdata->GetCrit(i), ts);
+		if (perfdata->HasWarn(i))
+			SendMetric(checkable, metric_name + "_warn", tags_new, perfdata->GetWarn(i), ts);
+		if (perfdata->HasMin(i))
+			SendMetric(checkable, metric_name + "_min", tags_new, perfdata->GetMin(i), ts);
+		if (perfdata->HasMax(i))
+			SendMetric(checkable, metric_name + "_max", tags_new, perfdata->GetMax(i), ts);
 	}
 }
 
@@ -366,6 +463,36 @@ void OpenTsdbWriter::SendPerfdata(const Checkable::Ptr& checkable, const String&
 void OpenTsdbWriter::SendMetric(const Checkable::Ptr& checkable, const String& metric,
 	const std::map<String, String>& tags, double value, double ts)
 {
+	if (m_Http) {
+		/* http://opentsdb.net/docs/build/html/api_http/put.html */
+		std::ostringstream msgbuf;
+		msgbuf << "{\"metric\":" << JsonEncode(metric) << ",\"timestamp\":" << static_cast<long>(ts)
+			<< ",\"value\":" << JsonEncode(value) << ",\"tags\":{";
+
+		bool first = true;
+
+		for (auto& tag : tags) {
+			if (!first)
+				msgbuf << ",";
+
+			msgbuf << JsonEncode(tag.first) << ":" << JsonEncode(tag.second);
+			first = false;
+		}
+
+		msgbuf << "}}";
+
+		Log(LogDebug, "OpenTsdbWriter")
+			<< "Checkable '" << checkable->GetName() << "' adds to data points: '" << msgbuf.str() << "'.";
+
+		m_DataBuffer.emplace_back(msgbuf.str());
+
+		/* Flush if we've buffered too much to prevent excessive memory use */
+		if (static_cast<int>(m_DataBuffer.size()) >= GetFlushThreshold())
+			Flush();
+
+		return;
+	}
+
 	String tags_string = "";
 
 	for (const Dictionary::Pair& tag : tags) {
@@ -404,6 +531,260 @@ void OpenTsdbWriter::SendMetric(const Checkable::Ptr& checkable, const String& m
 	}
 }
 
+void OpenTsdbWriter::FlushTimeout()
+{
+	m_WorkQueue.Enqueue([this]() { Flush(); }, PriorityHigh);
+}
+
+/**
+ * Hands the buffered data points over to the send queue.
+ *
+ * Called inside the WQ or once it has been joined.
+ */
+void OpenTsdbWriter::Flush()
+{
+	if (m_DataBuffer.empty())
+		return;
+
+	auto points (std::make_shared<std::vector<String>>());
+	points->swap(m_DataBuffer);
+
+	m_SendQueue->Enqueue([this, points]() { Send(points); });
+}
+
+/**
+ * Sends data points as one JSON array to the /api/put endpoint over a pooled connection.
+ *
+ * @param points The JSON encoded data points
+ */
+void OpenTsdbWriter::Send(const std::shared_ptr<std::vector<String>>& points)
+{
+	namespace http = boost::beast::http;
+
+	String body = "[" + boost::algorithm::join(*points, ",") + "]";
+
+	http::request<http::string_body> request (http::verb::post, GetEnableDetails() ? "/api/put?details" : "/api/put", 11);
+
+	request.set(http::field::user_agent, "Icinga/" + Application::GetAppVersion());
+	request.set(http::field::host, GetHost() + ":" + GetPort());
+	request.set(http::field::content_type, "application/json");
+	request.keep_alive(true);
+
+	if (GetEnableGzip()) {
+		request.set(http::field::content_encoding, "gzip");
+		request.body() = GzipCompress(body);
+	} else {
+		request.body() = std::move(body.GetData());
+	}
+
+	request.content_length(request.body().size());
+
+	for (;;) {
+		bool reused;
+		Shared<AsioTcpStream>::Ptr stream;
+
+		try {
+			stream = AcquireConnection(reused);
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "OpenTsdbWriter")
+				<< "Dropping " << points->size() << " data points, cannot connect to OpenTSDB: " << DiagnosticInformation(ex, false);
+
+			m_PointsFailed += points->size();
+			SetConnected(false);
+			return;
+		}
+
+		bool keepAlive;
+
+		try {
+			keepAlive = SendRequest(stream, request, points->size());
+		} catch (const std::exception& ex) {
+			boost::system::error_code ec;
+			stream->lowest_layer().close(ec);
+
+			/* The TSD may have closed the idle connection meanwhile. */
+			if (reused) {
+				Log(LogDebug, "OpenTsdbWriter")
+					<< "Kept alive connection to OpenTSDB failed, retrying on a new one: " << DiagnosticInformation(ex, false);
+				continue;
+			}
+
+			m_PointsFailed += points->size();
+			throw;
+		}
+
+		SetConnected(true);
+
+		if (keepAlive)
+			ReleaseConnection(std::move(stream));
+		else
+			stream->close();
+
+		return;
+	}
+}
+
+/**
+ * Writes one /api/put request and accounts the stored and failed data points of its response.
+ *
+ * @param stream The connection
+ * @param request The request
+ * @param points The number of data points in the request
+ * @return Whether the TSD keeps the connection alive
+ */
+bool OpenTsdbWriter::SendRequest(const Shared<AsioTcpStream>::Ptr& stream,
+	const boost::beast::http::request<boost::beast::http::string_body>& request, size_t points)
+{
+	namespace beast = boost::beast;
+	namespace http = beast::http;
+
+	try {
+		http::write(*stream, request);
+		stream->flush();
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "OpenTsdbWriter")
+			<< "Cannot write to TCP socket on host '" << GetHost() << "' port '" << GetPort() << "'.";
+		throw;
+	}
+
+	http::parser<false, http::string_body> parser;
+	beast::flat_buffer buf;
+
+	try {
+		http::read(*stream, buf, parser);
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "OpenTsdbWriter")
+			<< "Failed to parse HTTP response from host '" << GetHost() << "' port '" << GetPort() << "': " << DiagnosticInformation(ex);
+		throw;
+	}
+
+	auto& response (parser.get());
+
+	/* Without details the TSD only tells whether all data points have been stored. */
+	if (response.result() == http::status::no_content) {
+		m_PointsSent += points;
+		return response.keep_alive();
+	}
+
+	Dictionary::Ptr jsonResponse;
+
+	try {
+		jsonResponse = JsonDecode(response.body());
+	} catch (...) {
+	}
+
+	if (!jsonResponse) {
+		Log(LogWarning, "OpenTsdbWriter")
+			<< "Unexpected response code " << response.result() << " for " << points << " data points.";
+
+		m_PointsFailed += points;
+		return response.keep_alive();
+	}
+
+	if (jsonResponse->Contains("success")) {
+		double success = jsonResponse->Get("success");
+		double failed = jsonResponse->Get("failed");
+
+		m_PointsSent += success;
+		m_PointsFailed += failed;
+
+		if (failed > 0) {
+			Array::Ptr errors = jsonResponse->Get("errors");
+			String error;
+
+			if (errors && errors->GetLength() > 0) {
+				Dictionary::Ptr firstError = errors->Get(0);
+
+				if (firstError)
+					error = firstError->Get("error");
+			}
+
+			Log(LogWarning, "OpenTsdbWriter")
+				<< "OpenTSDB rejected " << failed << " of " << points << " data points, e.g.: " << error;
+		}
+
+		return response.keep_alive();
+	}
+
+	Dictionary::Ptr error = jsonResponse->Get("error");
+	String message;
+
+	if (error)
+		message = error->Get("message");
+
+	Log(LogWarning, "OpenTsdbWriter")
+		<< "OpenTSDB rejected " << points << " data points with response code " << response.result() << ": " << message;
+
+	m_PointsFailed += points;
+	return response.keep_alive();
+}
+
+/**
+ * Takes an idle kept alive connection from the pool or establishes a new one.
+ *
+ * @param reused Receives whether the connection comes from the pool
+ * @return The connection
+ */
+Shared<AsioTcpStream>::Ptr OpenTsdbWriter::AcquireConnection(bool& reused)
+{
+	{
+		std::unique_lock<std::mutex> lock (m_ConnectionsMutex);
+
+		if (!m_IdleConnections.empty()) {
+			auto stream (std::move(m_IdleConnections.back()));
+			m_IdleConnections.pop_back();
+
+			reused = true;
+			return stream;
+		}
+	}
+
+	reused = false;
+
+	auto stream (Shared<AsioTcpStream>::Make(IoEngine::Get().GetIoContext()));
+
+	try {
+		icinga::Connect(stream->lowest_layer(), GetHost(), GetPort());
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "OpenTsdbWriter")
+			<< "Can't connect to OpenTSDB on host '" << GetHost() << "' port '" << GetPort() << "'.";
+		throw;
+	}
+
+	return stream;
+}
+
+/**
+ * Puts a connection which the TSD keeps alive back into the pool.
+ */
+void OpenTsdbWriter::ReleaseConnection(Shared<AsioTcpStream>::Ptr&& stream)
+{
+	{
+		std::unique_lock<std::mutex> lock (m_ConnectionsMutex);
+
+		if (m_IdleConnections.size() < static_cast<size_t>(GetMaxConnections())) {
+			m_IdleConnections.emplace_back(std::move(stream));
+			return;
+		}
+	}
+
+	stream->close();
+}
+
+void OpenTsdbWriter::CloseIdleConnections()
+{
+	std::vector<Shared<AsioTcpStream>::Ptr> connections;
+
+	{
+		std::unique_lock<std::mutex> lock (m_ConnectionsMutex);
+		connections.swap(m_IdleConnections);
+	}
+
+	for (auto& stream : connections) {
+		stream->close();
+	}
+}
+
 /**
  * Escape tags for OpenTSDB
  * http://opentsdb.net/docs/build/html/user_guide/query/timeseries.html#precisions-on-metrics-and-tags
@@ -523,3 +904,41 @@ void OpenTsdbWriter::ValidateServiceTemplate(const Lazy<Dictionary::Ptr>& lvalue
 		}
 	}
 }
+
+/**
+ * Validate the configuration setting 'protocol'
+ *
+ * @param lvalue "telnet" or "http"
+ * @param utils Helper, unused
+ */
+void OpenTsdbWriter::ValidateProtocol(const Lazy<String>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<OpenTsdbWriter>::ValidateProtocol(lvalue, utils);
+
+	if (lvalue() != "telnet" && lvalue() != "http")
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "protocol" }, "Value must be one of 'telnet' or 'http'."));
+}
+
+void OpenTsdbWriter::ValidateFlushInterval(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<OpenTsdbWriter>::ValidateFlushInterval(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "flush_interval" }, "Value must be greater than 0."));
+}
+
+void OpenTsdbWriter::ValidateFlushThreshold(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<OpenTsdbWriter>::ValidateFlushThreshold(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "flush_threshold" }, "Value must be greater than 0."));
+}
+
+void OpenTsdbWriter::ValidateMaxConnections(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<OpenTsdbWriter>::ValidateMaxConnections(lvalue, utils);
+
+	if (lvalue() <= 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "max_connections" }, "Value must be greater than 0."));
+}
@@ -8,7 +8,15 @@
 #include "base/configobject.hpp"
 #include "base/tcpsocket.hpp"
 #include "base/timer.hpp"
+#include "base/workqueue.hpp"
+#include <boost/beast/http/message.hpp>
+#include <boost/beast/http/string_body.hpp>
+#include <atomic>
+#include <cstdint>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace icinga
 {
@@ -28,6 +36,10 @@ public:
 
 	void ValidateHostTemplate(const Lazy<Dictionary::Ptr>& lvalue, const ValidationUtils& utils) override;
 	void ValidateServiceTemplate(const Lazy<Dictionary::Ptr>& lvalue, const ValidationUtils& utils) override;
+	void ValidateProtocol(const Lazy<String>& lvalue, const ValidationUtils& utils) override;
+	void ValidateFlushInterval(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateFlushThreshold(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateMaxConnections(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
 
 protected:
 	void OnConfigLoaded() override;
@@ -39,10 +51,25 @@ private:
 
 	Timer::Ptr m_ReconnectTimer;
 
+	/* The data points for the HTTP API, only accessed inside the WQ. */
+	bool m_Http{false};
+	Timer::Ptr m_FlushTimer;
+	std::vector<String> m_DataBuffer;
+
+	/* Runs up to max_connections concurrent /api/put requests. */
+	std::unique_ptr<WorkQueue> m_SendQueue;
+
+	std::mutex m_ConnectionsMutex;
+	std::vector<Shared<AsioTcpStream>::Ptr> m_IdleConnections;
+
+	std::atomic<uint_fast64_t> m_PointsSent{0};
+	std::atomic<uint_fast64_t> m_PointsFailed{0};
+
 	Dictionary::Ptr m_ServiceConfigTemplate;
 	Dictionary::Ptr m_HostConfigTemplate;
 
-	void CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
+	void CheckResultHandler(const Checkable::CheckResultBatch& batch);
+	void CheckResultHandlerInternal(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
 	void SendMetric(const Checkable::Ptr& checkable, const String& metric,
 		const std::map<String, String>& tags, double value, double ts);
 	void SendPerfdata(const Checkable::Ptr& checkable, const String& metric,
@@ -50,7 +77,20 @@ private:
 	static String EscapeTag(const String& str);
 	static String EscapeMetric(const String& str);
 
+	void FlushTimeout();
+	void Flush();
+	void Send(const std::shared_ptr<std::vector<String>>& points);
+	bool SendRequest(const Shared<AsioTcpStream>::Ptr& stream,
+		const boost::beast::http::request<boost::beast::http::string_body>& request, size_t points);
+
+	Shared<AsioTcpStream>::Ptr AcquireConnection(bool& reused);
+	void ReleaseConnection(Shared<AsioTcpStream>::Ptr&& stream);
+	void CloseIdleConnections();
+
 	void ReconnectTimerHandler();
+	void Reconnect();
+
+	void ExceptionHandler(boost::exception_ptr exp);
 
 	void ReadConfigTemplate(const Dictionary::Ptr& stemplate, 
 		const Dictionary::Ptr& htemplate);
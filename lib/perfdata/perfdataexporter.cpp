@@ -0,0 +1,176 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "perfdata/perfdataexporter.hpp"
+#include "perfdata/perfdataexporter-ti.cpp"
+#include "base/perfdatavalue.hpp"
+#include "base/logger.hpp"
+#include "base/utility.hpp"
+#include <boost/beast/zlib/deflate_stream.hpp>
+#include <boost/crc.hpp>
+#include <algorithm>
+
+using namespace icinga;
+
+REGISTER_TYPE(PerfdataExporter);
+
+/* Reconnect attempts back off up to this multiple of the reconnect interval. */
+static const unsigned int l_MaxReconnectTicks = 30;
+
+void PerfdataExporter::OnConfigLoaded()
+{
+	ObjectImpl<PerfdataExporter>::OnConfigLoaded();
+
+	m_WorkQueue.SetName(GetReflectionType()->GetName() + ", " + GetName());
+}
+
+void PerfdataExporter::ValidateQueueLimit(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<PerfdataExporter>::ValidateQueueLimit(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "queue_limit" }, "Value must not be negative."));
+}
+
+/**
+ * Enqueues an export task unless the work queue already holds queue_limit tasks.
+ *
+ * Dropping keeps the memory bounded if the backend can't keep up
+ * instead of blocking the check result processing.
+ *
+ * @param task The task
+ * @param priority The task priority
+ * @return Whether the task has been enqueued
+ */
+bool PerfdataExporter::EnqueueExport(std::function<void ()>&& task, WorkQueuePriority priority)
+{
+	int limit = GetQueueLimit();
+
+	if (limit > 0 && m_WorkQueue.GetLength() >= static_cast<size_t>(limit)) {
+		uint_fast64_t dropped = ++m_DroppedItems;
+		double now = Utility::GetTime();
+
+		if (now - m_LastDropWarning.load() >= 60) {
+			m_LastDropWarning.store(now);
+
+			Log(LogWarning, GetReflectionType()->GetName())
+				<< "Work queue of '" << GetName() << "' reached its limit of " << limit
+				<< " items, dropping data (" << dropped << " items dropped so far). Verify that your backend is operational!";
+		}
+
+		return false;
+	}
+
+	m_WorkQueue.Enqueue(std::move(task), priority);
+	return true;
+}
+
+/**
+ * Called on each reconnect timer tick, tells whether to try reconnecting
+ * or to keep backing off after failed attempts.
+ */
+bool PerfdataExporter::ShouldReconnect()
+{
+	std::unique_lock<std::mutex> lock (m_ReconnectMutex);
+
+	if (m_ReconnectTicksToSkip > 0) {
+		m_ReconnectTicksToSkip--;
+		return false;
+	}
+
+	return true;
+}
+
+void PerfdataExporter::ReconnectSucceeded()
+{
+	std::unique_lock<std::mutex> lock (m_ReconnectMutex);
+
+	m_ReconnectBackoff = 0;
+	m_ReconnectTicksToSkip = 0;
+}
+
+/**
+ * Doubles the time until the next reconnect attempt, up to l_MaxReconnectTicks intervals.
+ */
+void PerfdataExporter::ReconnectFailed()
+{
+	std::unique_lock<std::mutex> lock (m_ReconnectMutex);
+
+	m_ReconnectBackoff = m_ReconnectBackoff ? std::min(m_ReconnectBackoff * 2u, l_MaxReconnectTicks) : 1u;
+	m_ReconnectTicksToSkip = m_ReconnectBackoff - 1u;
+}
+
+/**
+ * Returns the statistics all writers share, to be extended by the writer.
+ */
+Dictionary::Ptr PerfdataExporter::GetExportStats()
+{
+	unsigned int backoff;
+
+	{
+		std::unique_lock<std::mutex> lock (m_ReconnectMutex);
+		backoff = m_ReconnectBackoff;
+	}
+
+	return new Dictionary({
+		{ "work_queue_items", m_WorkQueue.GetLength() },
+		{ "work_queue_item_rate", m_WorkQueue.GetTaskCount(60) / 60.0 },
+		{ "work_queue_limit", GetQueueLimit() },
+		{ "dropped_items", static_cast<double>(m_DroppedItems.load()) },
+		{ "reconnect_interval", backoff * ReconnectInterval }
+	});
+}
+
+void PerfdataExporter::AddExportPerfdata(const String& prefix, const Array::Ptr& perfdata)
+{
+	perfdata->Add(new PerfdataValue(prefix + "_work_queue_items", m_WorkQueue.GetLength()));
+	perfdata->Add(new PerfdataValue(prefix + "_work_queue_item_rate", m_WorkQueue.GetTaskCount(60) / 60.0));
+	perfdata->Add(new PerfdataValue(prefix + "_dropped_items", static_cast<double>(m_DroppedItems.load()), true));
+}
+
+/**
+ * Compresses an HTTP body for "Content-Encoding: gzip".
+ *
+ * @param data The uncompressed body
+ * @return The gzip member
+ */
+String PerfdataExporter::GzipCompress(const String& data)
+{
+	namespace zlib = boost::beast::zlib;
+
+	static const unsigned char header[] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+	static const size_t trailerSize = 8;
+
+	zlib::deflate_stream deflate;
+	std::string out (sizeof(header) + deflate.upper_bound(data.GetLength()) + trailerSize, '\0');
+
+	std::copy(header, header + sizeof(header), out.begin());
+
+	zlib::z_params params;
+	params.next_in = data.CStr();
+	params.avail_in = data.GetLength();
+	params.next_out = &out[sizeof(header)];
+	params.avail_out = out.size() - sizeof(header) - trailerSize;
+
+	boost::system::error_code ec;
+	deflate.write(params, zlib::Flush::finish, ec);
+
+	/* end_of_stream signals that all input has been compressed. */
+	if (ec && ec != zlib::error::end_of_stream)
+		BOOST_THROW_EXCEPTION(boost::system::system_error(ec));
+
+	boost::crc_32_type crc;
+	crc.process_bytes(data.CStr(), data.GetLength());
+
+	size_t pos = sizeof(header) + params.total_out;
+	uint_least32_t trailer[] = { crc.checksum(), static_cast<uint_least32_t>(data.GetLength()) };
+
+	for (auto value : trailer) {
+		for (int i = 0; i < 4; i++) {
+			out[pos++] = static_cast<char>((value >> (i * 8)) & 0xffu);
+		}
+	}
+
+	out.resize(pos);
+
+	return std::move(out);
+}
@@ -0,0 +1,59 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef PERFDATAEXPORTER_H
+#define PERFDATAEXPORTER_H
+
+#include "perfdata/perfdataexporter-ti.hpp"
+#include "base/configobject.hpp"
+#include "base/workqueue.hpp"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+namespace icinga
+{
+
+/**
+ * The common part of the perfdata writers: a bounded export queue,
+ * reconnect backoff and the statistics about both.
+ *
+ * @ingroup perfdata
+ */
+class PerfdataExporter : public ObjectImpl<PerfdataExporter>
+{
+public:
+	DECLARE_OBJECT(PerfdataExporter);
+
+	void ValidateQueueLimit(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+
+protected:
+	/* Interval of the writers' reconnect timers. */
+	static constexpr double ReconnectInterval = 10;
+
+	WorkQueue m_WorkQueue{10000000, 1};
+
+	void OnConfigLoaded() override;
+
+	bool EnqueueExport(std::function<void ()>&& task, WorkQueuePriority priority = PriorityNormal);
+
+	bool ShouldReconnect();
+	void ReconnectSucceeded();
+	void ReconnectFailed();
+
+	Dictionary::Ptr GetExportStats();
+	void AddExportPerfdata(const String& prefix, const Array::Ptr& perfdata);
+
+	static String GzipCompress(const String& data);
+
+private:
+	std::atomic<uint_fast64_t> m_DroppedItems{0};
+	std::atomic<double> m_LastDropWarning{0};
+
+	std::mutex m_ReconnectMutex;
+	unsigned int m_ReconnectBackoff{0};
+	unsigned int m_ReconnectTicksToSkip{0};
+};
+
+}
+
+#endif /* PERFDATAEXPORTER_H */
@@ -0,0 +1,344 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "perfdata/perfdataspool.hpp"
+#include "base/exception.hpp"
+#include "base/logger.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/utility.hpp"
+#include <boost/crc.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace icinga;
+
+/* New records go into a new segment once the current one exceeds this size. */
+static const uint_fast64_t l_SegmentSize = 16 * 1024 * 1024;
+
+/* Larger lengths can only be the result of corruption. */
+static const uint_least32_t l_MaxRecordSize = 64 * 1024 * 1024;
+
+static const size_t l_RecordHeaderSize = 8;
+
+static uint_least32_t CalculateChecksum(const char *data, size_t length)
+{
+	boost::crc_32_type crc;
+	crc.process_bytes(data, length);
+	return crc.checksum();
+}
+
+static void EncodeUInt32(char *buf, uint_least32_t value)
+{
+	for (int i = 0; i < 4; i++) {
+		buf[i] = static_cast<char>((value >> (i * 8)) & 0xffu);
+	}
+}
+
+static uint_least32_t DecodeUInt32(const char *buf)
+{
+	uint_least32_t value = 0;
+
+	for (int i = 0; i < 4; i++) {
+		value |= static_cast<uint_least32_t>(static_cast<unsigned char>(buf[i])) << (i * 8);
+	}
+
+	return value;
+}
+
+/**
+ * Opens the spool in the given directory, picking up the segments left by a previous run.
+ *
+ * @param path The directory, created if necessary
+ * @param sizeLimit The size in bytes beyond which the oldest segments are dropped
+ */
+PerfdataSpool::PerfdataSpool(const String& path, uint_fast64_t sizeLimit)
+	: m_Path(path), m_SizeLimit(sizeLimit)
+{
+	Utility::MkDirP(m_Path, 0750);
+
+	Utility::Glob(m_Path + "/*.spool", [this](const String& file) {
+		String name = Utility::BaseName(file);
+		char *end = nullptr;
+		uint_fast64_t id = strtoull(name.CStr(), &end, 10);
+
+		if (end == name.CStr() || String(end) != ".spool")
+			return;
+
+		std::ifstream fp (file.CStr(), std::ifstream::binary | std::ifstream::ate);
+
+		if (!fp)
+			return;
+
+		uint_fast64_t size = fp.tellg();
+
+		m_Segments.push_back({ id, size });
+		m_Size += size;
+	}, GlobFile);
+
+	std::sort(m_Segments.begin(), m_Segments.end(), [](const Segment& a, const Segment& b) { return a.Id < b.Id; });
+
+	if (!m_Segments.empty()) {
+		Log(LogInformation, "PerfdataSpool")
+			<< "Found " << m_Size << " bytes in " << m_Segments.size() << " spool segment(s) in '" << m_Path << "'.";
+	}
+}
+
+String PerfdataSpool::GetSegmentPath(uint_fast64_t id) const
+{
+	char name[32];
+	sprintf(name, "%020llu.spool", static_cast<unsigned long long>(id));
+	return m_Path + "/" + name;
+}
+
+/**
+ * Deletes the oldest segment.
+ *
+ * Called with m_Mutex held.
+ */
+void PerfdataSpool::RemoveHeadSegment()
+{
+	if (m_Writing && m_Segments.size() == 1u) {
+		m_Writer.close();
+		m_Writing = false;
+	}
+
+	String path = GetSegmentPath(m_Segments.front().Id);
+
+	if (std::remove(path.CStr()) < 0 && errno != ENOENT) {
+		Log(LogWarning, "PerfdataSpool")
+			<< "Can't remove spool segment '" << path << "': " << Utility::FormatErrorNumber(errno);
+	}
+
+	m_Size -= m_Segments.front().Size;
+	m_Segments.pop_front();
+	m_ReadOffset = 0;
+}
+
+/**
+ * Starts a new segment for appending.
+ *
+ * Called with m_Mutex held.
+ */
+void PerfdataSpool::OpenWriter()
+{
+	uint_fast64_t id = m_Segments.empty() ? 1u : m_Segments.back().Id + 1u;
+	String path = GetSegmentPath(id);
+
+	m_Writer.open(path.CStr(), std::ofstream::binary | std::ofstream::app);
+
+	if (!m_Writer) {
+		BOOST_THROW_EXCEPTION(posix_error()
+			<< boost::errinfo_api_function("open")
+			<< boost::errinfo_errno(errno)
+			<< boost::errinfo_file_name(path));
+	}
+
+	m_Segments.push_back({ id, 0 });
+	m_Writing = true;
+}
+
+/**
+ * Appends records to the newest segment.
+ *
+ * @param records The records
+ */
+void PerfdataSpool::Append(const std::vector<String>& records)
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	for (auto& record : records) {
+		if (!m_Writing || m_Segments.back().Size >= l_SegmentSize) {
+			if (m_Writing)
+				m_Writer.close();
+
+			OpenWriter();
+		}
+
+		char header[l_RecordHeaderSize];
+		EncodeUInt32(header, record.GetLength());
+		EncodeUInt32(header + 4, CalculateChecksum(record.CStr(), record.GetLength()));
+
+		m_Writer.write(header, sizeof(header));
+		m_Writer.write(record.CStr(), record.GetLength());
+
+		uint_fast64_t size = sizeof(header) + record.GetLength();
+
+		m_Segments.back().Size += size;
+		m_Size += size;
+	}
+
+	m_Writer.flush();
+
+	while (m_Size > m_SizeLimit && m_Segments.size() > 1u) {
+		Log(LogWarning, "PerfdataSpool")
+			<< "Spool '" << m_Path << "' exceeds its size limit of " << m_SizeLimit
+			<< " bytes, dropping its oldest " << m_Segments.front().Size << " bytes.";
+
+		RemoveHeadSegment();
+	}
+}
+
+/**
+ * Reads up to count records from the head of the spool without consuming them.
+ *
+ * Called with m_Mutex held.
+ *
+ * @param count Maximum number of records
+ * @param records Receives the records
+ * @param segments Receives the number of segments which have been read completely
+ * @param offset Receives the read offset in the first segment which has not been read completely
+ */
+void PerfdataSpool::Read(size_t count, std::vector<String>& records, size_t& segments, uint_fast64_t& offset)
+{
+	segments = 0;
+	offset = m_ReadOffset;
+
+	while (records.size() < count && segments < m_Segments.size()) {
+		bool writing = m_Writing && segments + 1u == m_Segments.size();
+		String path = GetSegmentPath(m_Segments[segments].Id);
+		std::ifstream fp (path.CStr(), std::ifstream::binary);
+
+		fp.seekg(offset);
+
+		while (records.size() < count) {
+			char header[l_RecordHeaderSize];
+
+			if (!fp.read(header, sizeof(header)))
+				break;
+
+			uint_least32_t length = DecodeUInt32(header);
+
+			if (length > l_MaxRecordSize) {
+				Log(LogWarning, "PerfdataSpool")
+					<< "Skipping the remainder of corrupted spool segment '" << path << "'.";
+				break;
+			}
+
+			std::string data (length, '\0');
+
+			if (!fp.read(&data[0], length))
+				break;
+
+			if (CalculateChecksum(data.c_str(), data.size()) != DecodeUInt32(header + 4)) {
+				Log(LogWarning, "PerfdataSpool")
+					<< "Skipping the remainder of corrupted spool segment '" << path << "'.";
+				break;
+			}
+
+			records.emplace_back(std::move(data));
+			offset += sizeof(header) + length;
+		}
+
+		if (records.size() >= count)
+			break;
+
+		/* The end of the segment which is being appended to isn't its final end. */
+		if (writing) {
+			if (offset >= m_Segments[segments].Size)
+				break;
+
+			m_Writer.close();
+			m_Writing = false;
+		}
+
+		segments++;
+		offset = 0;
+	}
+}
+
+/**
+ * Sends up to limit records from the head of the spool and consumes them once sent.
+ *
+ * @param limit Maximum number of records
+ * @param chunkSize Maximum number of records per send() call
+ * @param send Sends records, throws on failure
+ * @return Number of records which have been sent
+ */
+size_t PerfdataSpool::Drain(size_t limit, size_t chunkSize, const std::function<void (const std::vector<String>&)>& send)
+{
+	size_t drained = 0;
+
+	while (drained < limit) {
+		std::vector<String> records;
+		size_t segments;
+		uint_fast64_t offset, headId;
+
+		{
+			std::unique_lock<std::mutex> lock (m_Mutex);
+
+			Read(std::min(limit - drained, chunkSize), records, segments, offset);
+
+			headId = m_Segments.empty() ? 0 : m_Segments.front().Id;
+
+			/* Corrupted or empty segments have to go even if nothing could be read. */
+			if (records.empty()) {
+				if (segments == 0u)
+					break;
+
+				for (; segments > 0u; segments--)
+					RemoveHeadSegment();
+
+				continue;
+			}
+		}
+
+		send(records);
+
+		std::unique_lock<std::mutex> lock (m_Mutex);
+
+		/* The segments have been dropped in the meantime due to the size limit. */
+		if (m_Segments.empty() || m_Segments.front().Id != headId)
+			break;
+
+		for (; segments > 0u; segments--)
+			RemoveHeadSegment();
+
+		m_ReadOffset = offset;
+
+		/* Nothing left to read, so don't keep appending to what has been consumed. */
+		if (m_Writing && m_Segments.size() == 1u && m_ReadOffset >= m_Segments.front().Size)
+			RemoveHeadSegment();
+
+		m_DrainStats.InsertValue(Utility::GetTime(), records.size());
+		drained += records.size();
+	}
+
+	return drained;
+}
+
+bool PerfdataSpool::IsEmpty()
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	return m_Segments.empty();
+}
+
+/**
+ * Adds the spool depth and the drain rate per second over the last minute to a writer's stats.
+ *
+ * @param stats The writer's stats
+ * @param prefix The writer's perfdata label prefix
+ * @param perfdata Array of PerfdataValue objects
+ */
+void PerfdataSpool::AddStats(const Dictionary::Ptr& stats, const String& prefix, const Array::Ptr& perfdata)
+{
+	uint_fast64_t size;
+	size_t segments;
+
+	{
+		std::unique_lock<std::mutex> lock (m_Mutex);
+
+		size = m_Size - std::min(m_Size, m_ReadOffset);
+		segments = m_Segments.size();
+	}
+
+	double drainRate = m_DrainStats.UpdateAndGetValues(Utility::GetTime(), 60) / 60.0;
+
+	stats->Set("spool_bytes", static_cast<double>(size));
+	stats->Set("spool_segments", segments);
+	stats->Set("spool_drain_rate", drainRate);
+
+	perfdata->Add(new PerfdataValue(prefix + "_spool_bytes", static_cast<double>(size), false, "bytes"));
+	perfdata->Add(new PerfdataValue(prefix + "_spool_drain_rate", drainRate));
+}
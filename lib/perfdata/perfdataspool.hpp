@@ -0,0 +1,72 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef PERFDATASPOOL_H
+#define PERFDATASPOOL_H
+
+#include "base/i2-base.hpp"
+#include "base/array.hpp"
+#include "base/dictionary.hpp"
+#include "base/ringbuffer.hpp"
+#include "base/shared-object.hpp"
+#include "base/string.hpp"
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * An append-only on-disk queue of data points which couldn't be sent.
+ *
+ * The spool consists of numbered segment files. Each record is stored
+ * with its length and CRC32, corrupted records end their segment.
+ * Consumed segments are deleted, and if the spool grows beyond its size
+ * limit the oldest segments are dropped.
+ *
+ * @ingroup perfdata
+ */
+class PerfdataSpool final : public SharedObject
+{
+public:
+	DECLARE_PTR_TYPEDEFS(PerfdataSpool);
+
+	PerfdataSpool(const String& path, uint_fast64_t sizeLimit);
+
+	void Append(const std::vector<String>& records);
+	size_t Drain(size_t limit, size_t chunkSize, const std::function<void (const std::vector<String>&)>& send);
+
+	bool IsEmpty();
+	void AddStats(const Dictionary::Ptr& stats, const String& prefix, const Array::Ptr& perfdata);
+
+private:
+	struct Segment
+	{
+		uint_fast64_t Id;
+		uint_fast64_t Size;
+	};
+
+	std::mutex m_Mutex;
+	String m_Path;
+	uint_fast64_t m_SizeLimit;
+	uint_fast64_t m_Size{0};
+	std::deque<Segment> m_Segments;
+	uint_fast64_t m_ReadOffset{0};
+
+	std::ofstream m_Writer;
+	bool m_Writing{false};
+
+	RingBuffer m_DrainStats{15 * 60};
+
+	String GetSegmentPath(uint_fast64_t id) const;
+	void RemoveHeadSegment();
+	void OpenWriter();
+	void Read(size_t count, std::vector<String>& records, size_t& segments, uint_fast64_t& offset);
+};
+
+}
+
+#endif /* PERFDATASPOOL_H */
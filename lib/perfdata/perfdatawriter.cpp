@@ -13,10 +13,17 @@
 #include "base/context.hpp"
 #include "base/exception.hpp"
 #include "base/application.hpp"
+#include "base/perfdatavalue.hpp"
 #include "base/statsfunction.hpp"
 
 using namespace icinga;
 
+/* The buffered lines are handed over to the WQ once they exceed this size. */
+static const size_t l_FlushSize = 256 * 1024;
+
+/* Further lines are dropped while the WQ can't write the buffered ones fast enough. */
+static const size_t l_MaxBufferSize = 64 * 1024 * 1024;
+
 REGISTER_TYPE(PerfdataWriter);
 
 REGISTER_STATSFUNCTION(PerfdataWriter, &PerfdataWriter::StatsFunc);
@@ -33,14 +40,32 @@ void PerfdataWriter::OnConfigLoaded()
 	} else {
 		SetHAMode(HARunOnce);
 	}
+
+	m_WorkQueue.SetName("PerfdataWriter, " + GetName());
 }
 
-void PerfdataWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr&)
+void PerfdataWriter::StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata)
 {
 	DictionaryData nodes;
 
 	for (const PerfdataWriter::Ptr& perfdatawriter : ConfigType::GetObjectsByType<PerfdataWriter>()) {
-		nodes.emplace_back(perfdatawriter->GetName(), 1); //add more stats
+		String prefix = "perfdatawriter_" + perfdatawriter->GetName();
+		size_t bufferedBytes;
+
+		{
+			std::unique_lock<std::mutex> lock (perfdatawriter->m_BufferMutex);
+			bufferedBytes = perfdatawriter->m_ServiceBuffer.size() + perfdatawriter->m_HostBuffer.size();
+		}
+
+		double droppedLines = perfdatawriter->m_DroppedLines.load();
+
+		nodes.emplace_back(perfdatawriter->GetName(), new Dictionary({
+			{ "buffered_bytes", bufferedBytes },
+			{ "dropped_lines", droppedLines }
+		}));
+
+		perfdata->Add(new PerfdataValue(prefix + "_buffered_bytes", bufferedBytes));
+		perfdata->Add(new PerfdataValue(prefix + "_dropped_lines", droppedLines, true));
 	}
 
 	status->Set("perfdatawriter", new Dictionary(std::move(nodes)));
@@ -57,13 +82,23 @@ void PerfdataWriter::Resume()
 		CheckResultHandler(checkable, cr);
 	});
 
+	/* Don't keep the specialized templates of deleted objects. */
+	ConfigObject::OnActiveChanged.connect([this](const ConfigObject::Ptr& object, const Value&) {
+		auto checkable (dynamic_pointer_cast<Checkable>(object));
+
+		if (checkable && !checkable->IsActive()) {
+			m_HostTemplateCache.Erase(checkable);
+			m_ServiceTemplateCache.Erase(checkable);
+		}
+	});
+
 	m_RotationTimer = new Timer();
 	m_RotationTimer->OnTimerExpired.connect([this](const Timer * const&) { RotationTimerHandler(); });
 	m_RotationTimer->SetInterval(GetRotationInterval());
+	m_RotationTimer->SetSchedulerPolicy(BackgroundScheduler);
 	m_RotationTimer->Start();
 
-	RotateFile(m_ServiceOutputFile, GetServiceTempPath(), GetServicePerfdataPath());
-	RotateFile(m_HostOutputFile, GetHostTempPath(), GetHostPerfdataPath());
+	m_WorkQueue.Enqueue([this]() { RotateAllFiles(); });
 }
 
 void PerfdataWriter::Pause()
@@ -76,7 +111,8 @@ void PerfdataWriter::Pause()
 #endif /* I2_DEBUG */
 
 	/* Force a rotation closing the file stream. */
-	RotateAllFiles();
+	m_WorkQueue.Enqueue([this]() { RotateAllFiles(); });
+	m_WorkQueue.Join();
 
 	Log(LogInformation, "PerfdataWriter")
 		<< "'" << GetName() << "' paused.";
@@ -92,6 +128,25 @@ Value PerfdataWriter::EscapeMacroMetric(const Value& value)
 		return value;
 }
 
+/**
+ * Returns the host or service format template compiled with MacroProcessor::CompileValue().
+ */
+MacroSpecializationCache::Values PerfdataWriter::GetCompiledTemplate(bool service)
+{
+	String source = service ? GetServiceFormatTemplate() : GetHostFormatTemplate();
+	String& compiledSource = service ? m_ServiceTemplateSource : m_HostTemplateSource;
+	MacroSpecializationCache::Values& compiled = service ? m_ServiceTemplate : m_HostTemplate;
+
+	std::unique_lock<std::mutex> lock (m_TemplatesMutex);
+
+	if (!compiled || compiledSource != source) {
+		compiled = std::make_shared<std::vector<CompiledMacroValue>>(1, MacroProcessor::CompileValue(source));
+		compiledSource = source;
+	}
+
+	return compiled;
+}
+
 void PerfdataWriter::CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr)
 {
 	if (IsPaused())
@@ -116,38 +171,98 @@ void PerfdataWriter::CheckResultHandler(const Checkable::Ptr& checkable, const C
 	resolvers.emplace_back("host", host);
 	resolvers.emplace_back("icinga", IcingaApplication::GetInstance());
 
-	if (service) {
-		String line = MacroProcessor::ResolveMacros(GetServiceFormatTemplate(), resolvers, cr, nullptr, &PerfdataWriter::EscapeMacroMetric);
+	/* Only the macros which depend on the check result are left to resolve,
+	 * the others have been resolved once for this checkable.
+	 */
+	auto tmpl ((service ? m_ServiceTemplateCache : m_HostTemplateCache).Get(checkable, GetCompiledTemplate(static_cast<bool>(service)), resolvers));
 
-		{
-			std::unique_lock<std::mutex> lock(m_StreamMutex);
+	String line = MacroProcessor::ResolveMacros(tmpl->at(0), resolvers, cr, nullptr, &PerfdataWriter::EscapeMacroMetric);
 
-			if (!m_ServiceOutputFile.good())
-				return;
+	AppendLine(static_cast<bool>(service), line);
+}
+
+/**
+ * Buffers a line for the WQ, which writes it to the host or service file.
+ */
+void PerfdataWriter::AppendLine(bool service, const String& line)
+{
+	bool flush = false;
+
+	{
+		std::unique_lock<std::mutex> lock (m_BufferMutex);
+
+		if (m_ServiceBuffer.size() + m_HostBuffer.size() >= l_MaxBufferSize) {
+			lock.unlock();
+
+			m_DroppedLines++;
 
-			m_ServiceOutputFile << line << "\n";
+			double now = Utility::GetTime();
+			double lastWarning = m_LastDropWarning.load();
+
+			if (now - lastWarning >= 60 && m_LastDropWarning.compare_exchange_strong(lastWarning, now)) {
+				Log(LogWarning, "PerfdataWriter")
+					<< "'" << GetName() << "' can't write perfdata fast enough, dropped " << m_DroppedLines.load() << " lines so far.";
+			}
+
+			return;
 		}
-	} else {
-		String line = MacroProcessor::ResolveMacros(GetHostFormatTemplate(), resolvers, cr, nullptr, &PerfdataWriter::EscapeMacroMetric);
 
-		{
-			std::unique_lock<std::mutex> lock(m_StreamMutex);
+		std::string& buffer (service ? m_ServiceBuffer : m_HostBuffer);
 
-			if (!m_HostOutputFile.good())
-				return;
+		buffer.append(line.GetData());
+		buffer += '\n';
 
-			m_HostOutputFile << line << "\n";
+		if (!m_FlushPending && buffer.size() >= l_FlushSize) {
+			m_FlushPending = true;
+			flush = true;
 		}
 	}
+
+	if (flush)
+		m_WorkQueue.Enqueue([this]() { FlushBuffers(); });
 }
 
+/**
+ * Writes the buffered lines to the files. The buffers are swapped under the
+ * lock, so producers never wait for the disk.
+ *
+ * Called inside the WQ.
+ */
+void PerfdataWriter::FlushBuffers()
+{
+	ASSERT(m_WorkQueue.IsWorkerThread());
+
+	{
+		std::unique_lock<std::mutex> lock (m_BufferMutex);
+
+		m_ServiceBuffer.swap(m_ServiceSpareBuffer);
+		m_HostBuffer.swap(m_HostSpareBuffer);
+		m_FlushPending = false;
+	}
+
+	/* Lines are lost while a file can't be opened, as before. */
+	if (!m_ServiceSpareBuffer.empty() && m_ServiceOutputFile.good())
+		m_ServiceOutputFile.write(m_ServiceSpareBuffer.c_str(), m_ServiceSpareBuffer.size());
+
+	if (!m_HostSpareBuffer.empty() && m_HostOutputFile.good())
+		m_HostOutputFile.write(m_HostSpareBuffer.c_str(), m_HostSpareBuffer.size());
+
+	m_ServiceSpareBuffer.clear();
+	m_HostSpareBuffer.clear();
+}
+
+/**
+ * Closes a file, atomically renames it for the consumer and opens a new one.
+ *
+ * Called inside the WQ.
+ */
 void PerfdataWriter::RotateFile(std::ofstream& output, const String& temp_path, const String& perfdata_path)
 {
+	ASSERT(m_WorkQueue.IsWorkerThread());
+
 	Log(LogDebug, "PerfdataWriter")
 		<< "Rotating perfdata files.";
 
-	std::unique_lock<std::mutex> lock(m_StreamMutex);
-
 	if (output.good()) {
 		output.close();
 
@@ -174,11 +289,16 @@ void PerfdataWriter::RotationTimerHandler()
 	if (IsPaused())
 		return;
 
-	RotateAllFiles();
+	m_WorkQueue.Enqueue([this]() { RotateAllFiles(); });
 }
 
+/**
+ * Called inside the WQ.
+ */
 void PerfdataWriter::RotateAllFiles()
 {
+	FlushBuffers();
+
 	RotateFile(m_ServiceOutputFile, GetServiceTempPath(), GetServicePerfdataPath());
 	RotateFile(m_HostOutputFile, GetHostTempPath(), GetHostPerfdataPath());
 }
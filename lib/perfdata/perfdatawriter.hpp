@@ -5,9 +5,15 @@
 
 #include "perfdata/perfdatawriter-ti.hpp"
 #include "icinga/service.hpp"
+#include "icinga/macroprocessor.hpp"
 #include "base/configobject.hpp"
 #include "base/timer.hpp"
+#include "base/workqueue.hpp"
+#include <atomic>
+#include <cstdint>
 #include <fstream>
+#include <mutex>
+#include <string>
 
 namespace icinga
 {
@@ -35,13 +41,41 @@ protected:
 
 private:
 	Timer::Ptr m_RotationTimer;
+
+	/* Writes and rotates the files, which are only accessed by it. */
+	WorkQueue m_WorkQueue;
 	std::ofstream m_ServiceOutputFile;
 	std::ofstream m_HostOutputFile;
-	std::mutex m_StreamMutex;
+
+	/* The lines not yet handed over to the WQ. */
+	std::mutex m_BufferMutex;
+	std::string m_ServiceBuffer;
+	std::string m_HostBuffer;
+	bool m_FlushPending{false};
+
+	/* Swapped with the buffers above to keep their capacity, only accessed inside the WQ. */
+	std::string m_ServiceSpareBuffer;
+	std::string m_HostSpareBuffer;
+
+	std::atomic<uint_fast64_t> m_DroppedLines{0};
+	std::atomic<double> m_LastDropWarning{0};
+
+	/* The format templates, compiled again if they change at runtime. */
+	std::mutex m_TemplatesMutex;
+	String m_HostTemplateSource;
+	String m_ServiceTemplateSource;
+	MacroSpecializationCache::Values m_HostTemplate;
+	MacroSpecializationCache::Values m_ServiceTemplate;
+	MacroSpecializationCache m_HostTemplateCache{&PerfdataWriter::EscapeMacroMetric};
+	MacroSpecializationCache m_ServiceTemplateCache{&PerfdataWriter::EscapeMacroMetric};
 
 	void CheckResultHandler(const Checkable::Ptr& checkable, const CheckResult::Ptr& cr);
+	MacroSpecializationCache::Values GetCompiledTemplate(bool service);
 	static Value EscapeMacroMetric(const Value& value);
 
+	void AppendLine(bool service, const String& line);
+	void FlushBuffers();
+
 	void RotationTimerHandler();
 	void RotateAllFiles();
 	void RotateFile(std::ofstream& output, const String& temp_path, const String& perfdata_path);
@@ -36,6 +36,16 @@ struct PgsqlInterfaceImpl final : public PgsqlInterface
 		return PQexec(conn, query);
 	}
 
+	PGresult *execParams(PGconn *conn, const char *command, int nParams, const Oid *paramTypes, const char * const *paramValues, const int *paramLengths, const int *paramFormats, int resultFormat) const override
+	{
+		return PQexecParams(conn, command, nParams, paramTypes, paramValues, paramLengths, paramFormats, resultFormat);
+	}
+
+	PGresult *execPrepared(PGconn *conn, const char *stmtName, int nParams, const char * const *paramValues, const int *paramLengths, const int *paramFormats, int resultFormat) const override
+	{
+		return PQexecPrepared(conn, stmtName, nParams, paramValues, paramLengths, paramFormats, resultFormat);
+	}
+
 	void finish(PGconn *conn) const override
 	{
 		PQfinish(conn);
@@ -81,6 +91,11 @@ struct PgsqlInterfaceImpl final : public PgsqlInterface
 		return PQresultStatus(res);
 	}
 
+	PGresult *prepare(PGconn *conn, const char *stmtName, const char *query, int nParams, const Oid *paramTypes) const override
+	{
+		return PQprepare(conn, stmtName, query, nParams, paramTypes);
+	}
+
 	int serverVersion(const PGconn *conn) const override
 	{
 		return PQserverVersion(conn);
@@ -100,6 +115,46 @@ struct PgsqlInterfaceImpl final : public PgsqlInterface
 	{
 		return PQstatus(conn);
 	}
+
+	int enterPipelineMode(PGconn *conn) const override
+	{
+#ifdef LIBPQ_HAS_PIPELINING
+		return PQenterPipelineMode(conn);
+#else /* LIBPQ_HAS_PIPELINING */
+		(void)conn;
+		return 0;
+#endif /* LIBPQ_HAS_PIPELINING */
+	}
+
+	PGresult *getResult(PGconn *conn) const override
+	{
+		return PQgetResult(conn);
+	}
+
+	int pipelineSync(PGconn *conn) const override
+	{
+#ifdef LIBPQ_HAS_PIPELINING
+		return PQpipelineSync(conn);
+#else /* LIBPQ_HAS_PIPELINING */
+		(void)conn;
+		return 0;
+#endif /* LIBPQ_HAS_PIPELINING */
+	}
+
+	int sendPrepare(PGconn *conn, const char *stmtName, const char *query, int nParams, const Oid *paramTypes) const override
+	{
+		return PQsendPrepare(conn, stmtName, query, nParams, paramTypes);
+	}
+
+	int sendQueryParams(PGconn *conn, const char *command, int nParams, const Oid *paramTypes, const char * const *paramValues, const int *paramLengths, const int *paramFormats, int resultFormat) const override
+	{
+		return PQsendQueryParams(conn, command, nParams, paramTypes, paramValues, paramLengths, paramFormats, resultFormat);
+	}
+
+	int sendQueryPrepared(PGconn *conn, const char *stmtName, int nParams, const char * const *paramValues, const int *paramLengths, const int *paramFormats, int resultFormat) const override
+	{
+		return PQsendQueryPrepared(conn, stmtName, nParams, paramValues, paramLengths, paramFormats, resultFormat);
+	}
 };
 
 PgsqlInterface *create_pgsql_shim()
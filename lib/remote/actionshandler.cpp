@@ -82,20 +82,44 @@ bool ActionsHandler::HandleRequest(
 	if (params)
 		verbose = HttpUtility::GetLastParameter(params, "verbose");
 
-	for (const ConfigObject::Ptr& obj : objs) {
+	auto makeFail ([verbose](const std::exception& ex) -> Dictionary::Ptr {
+		Dictionary::Ptr fail = new Dictionary({
+			{ "code", 500 },
+			{ "status", "Action execution failed: '" + DiagnosticInformation(ex, false) + "'." }
+		});
+
+		/* Exception for actions. Normally we would handle this inside SendJsonError(). */
+		if (verbose)
+			fail->Set("diagnostic_information", DiagnosticInformation(ex));
+
+		return fail;
+	});
+
+	/* Actions applied to many objects via filters may create e.g. all downtimes at once. */
+	if (objs.size() > 1u && action->CanInvokeBulk()) {
+		std::vector<ConfigObject::Ptr> targets (objs.begin(), objs.end());
+
 		try {
-			results.emplace_back(action->Invoke(obj, params));
+			std::vector<Value> bulkResults = action->InvokeBulk(targets, params);
+
+			if (!bulkResults.empty()) {
+				results.insert(results.end(), bulkResults.begin(), bulkResults.end());
+				objs.clear();
+			}
 		} catch (const std::exception& ex) {
-			Dictionary::Ptr fail = new Dictionary({
-				{ "code", 500 },
-				{ "status", "Action execution failed: '" + DiagnosticInformation(ex, false) + "'." }
-			});
+			for (size_t i = 0; i < objs.size(); i++) {
+				results.emplace_back(makeFail(ex));
+			}
 
-			/* Exception for actions. Normally we would handle this inside SendJsonError(). */
-			if (verbose)
-				fail->Set("diagnostic_information", DiagnosticInformation(ex));
+			objs.clear();
+		}
+	}
 
-			results.emplace_back(std::move(fail));
+	for (const ConfigObject::Ptr& obj : objs) {
+		try {
+			results.emplace_back(action->Invoke(obj, params));
+		} catch (const std::exception& ex) {
+			results.emplace_back(makeFail(ex));
 		}
 	}
 
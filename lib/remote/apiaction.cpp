@@ -5,8 +5,8 @@
 
 using namespace icinga;
 
-ApiAction::ApiAction(std::vector<String> types, Callback action)
-	: m_Types(std::move(types)), m_Callback(std::move(action))
+ApiAction::ApiAction(std::vector<String> types, Callback action, BulkCallback bulkAction)
+	: m_Types(std::move(types)), m_Callback(std::move(action)), m_BulkCallback(std::move(bulkAction))
 { }
 
 Value ApiAction::Invoke(const ConfigObject::Ptr& target, const Dictionary::Ptr& params)
@@ -14,6 +14,16 @@ Value ApiAction::Invoke(const ConfigObject::Ptr& target, const Dictionary::Ptr&
 	return m_Callback(target, params);
 }
 
+bool ApiAction::CanInvokeBulk() const
+{
+	return (bool)m_BulkCallback;
+}
+
+std::vector<Value> ApiAction::InvokeBulk(const std::vector<ConfigObject::Ptr>& targets, const Dictionary::Ptr& params)
+{
+	return m_BulkCallback(targets, params);
+}
+
 const std::vector<String>& ApiAction::GetTypes() const
 {
 	return m_Types;
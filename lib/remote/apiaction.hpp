@@ -26,10 +26,19 @@ public:
 
 	typedef std::function<Value(const ConfigObject::Ptr& target, const Dictionary::Ptr& params)> Callback;
 
-	ApiAction(std::vector<String> registerTypes, Callback function);
+	/**
+	 * Runs the action for many targets at once. Returns one result per target
+	 * or nothing if the targets have to be processed one by one after all.
+	 */
+	typedef std::function<std::vector<Value>(const std::vector<ConfigObject::Ptr>& targets, const Dictionary::Ptr& params)> BulkCallback;
+
+	ApiAction(std::vector<String> registerTypes, Callback function, BulkCallback bulkFunction = BulkCallback());
 
 	Value Invoke(const ConfigObject::Ptr& target, const Dictionary::Ptr& params);
 
+	bool CanInvokeBulk() const;
+	std::vector<Value> InvokeBulk(const std::vector<ConfigObject::Ptr>& targets, const Dictionary::Ptr& params);
+
 	const std::vector<String>& GetTypes() const;
 
 	static ApiAction::Ptr GetByName(const String& name);
@@ -39,6 +48,7 @@ public:
 private:
 	std::vector<String> m_Types;
 	Callback m_Callback;
+	BulkCallback m_BulkCallback;
 };
 
 /**
@@ -53,6 +63,9 @@ public:
 };
 
 #define REGISTER_APIACTION(name, types, callback) \
+	REGISTER_BULK_APIACTION(name, types, callback, ApiAction::BulkCallback())
+
+#define REGISTER_BULK_APIACTION(name, types, callback, bulkCallback) \
 	INITIALIZE_ONCE([]() { \
 		String registerName = #name; \
 		boost::algorithm::replace_all(registerName, "_", "-"); \
@@ -60,7 +73,7 @@ public:
 		String typeNames = types; \
 		if (!typeNames.IsEmpty()) \
 			registerTypes = typeNames.Split(";"); \
-		ApiAction::Ptr action = new ApiAction(registerTypes, callback); \
+		ApiAction::Ptr action = new ApiAction(registerTypes, callback, bulkCallback); \
 		ApiActionRegistry::GetInstance()->Register(registerName, action); \
 	})
 
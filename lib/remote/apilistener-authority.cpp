@@ -2,55 +2,246 @@
 
 #include "remote/zone.hpp"
 #include "remote/apilistener.hpp"
+#include "remote/apifunction.hpp"
+#include "remote/jsonrpcconnection.hpp"
 #include "base/configtype.hpp"
+#include "base/initialize.hpp"
 #include "base/utility.hpp"
 #include "base/convert.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 
 using namespace icinga;
 
+REGISTER_APIFUNCTION(SetAuthorityLoad, event, &ApiListener::AuthorityLoadAPIHandler);
+
 std::atomic<bool> ApiListener::m_UpdatedObjectAuthority (false);
 
-void ApiListener::UpdateObjectAuthority()
+/**
+ * The connected endpoints of the local zone the HARunOnce objects are distributed among.
+ */
+struct ObjectAuthorityAssignment
 {
-	/* Always run this, even if there is no 'api' feature enabled. */
-	if (auto listener = ApiListener::GetInstance()) {
-		Log(LogNotice, "ApiListener")
-			<< "Updating object authority for objects at endpoint '" << listener->GetIdentity() << "'.";
-	} else {
-		Log(LogNotice, "ApiListener")
-			<< "Updating object authority for local objects.";
+	/* No local zone, so all objects run here. */
+	bool Standalone;
+
+	/* Whether all endpoints assign objects by rendezvous hashing, see UpdateObjectAuthority(). */
+	bool Rendezvous;
+
+	/* Sorted by name. */
+	std::vector<Endpoint::Ptr> Endpoints;
+	std::vector<uint64_t> EndpointHashes;
+	std::vector<double> EndpointWeights;
+	Endpoint::Ptr LocalEndpoint;
+
+	bool operator==(const ObjectAuthorityAssignment& other) const
+	{
+		return Standalone == other.Standalone && Rendezvous == other.Rendezvous
+			&& Endpoints == other.Endpoints && EndpointWeights == other.EndpointWeights;
+	}
+
+	bool IsAuthority(const ConfigObject::Ptr& object) const;
+};
+
+static std::mutex l_AuthorityMutex;
+static std::shared_ptr<const ObjectAuthorityAssignment> l_Authority;
+
+/**
+ * FNV-1a, so all endpoints compute the same hashes regardless of platform.
+ */
+static uint64_t HashName(const String& name)
+{
+	uint64_t hash = 14695981039346656037u;
+
+	for (char ch : name) {
+		hash ^= static_cast<unsigned char>(ch);
+		hash *= 1099511628211u;
+	}
+
+	return hash;
+}
+
+/**
+ * The SplitMix64 finalizer, spreads the combined hashes over all bits.
+ */
+static uint64_t MixHash(uint64_t hash)
+{
+	hash = (hash ^ (hash >> 30u)) * 0xbf58476d1ce4e5b9u;
+	hash = (hash ^ (hash >> 27u)) * 0x94d049bb133111ebu;
+
+	return hash ^ (hash >> 31u);
+}
+
+bool ObjectAuthorityAssignment::IsAuthority(const ConfigObject::Ptr& object) const
+{
+	if (Standalone)
+		return true;
+
+	if (!Rendezvous)
+		return Endpoints[Utility::SDBM(object->GetName()) % Endpoints.size()] == LocalEndpoint;
+
+	/* Each object goes to the endpoint it scores highest with. If an endpoint leaves,
+	 * only its objects move to their respective runner-up, all others stay.
+	 *
+	 * The weights scale each endpoint's share of the objects (weighted rendezvous hashing).
+	 * With equal weights the score is monotonic in the hash, so the assignment doesn't
+	 * differ from an unweighted one.
+	 */
+	uint64_t objectHash = HashName(object->GetName());
+	size_t best = 0;
+	double bestScore = 0;
+
+	for (size_t i = 0; i < Endpoints.size(); i++) {
+		/* In (0, 1), from the upper 53 bits. */
+		double hash = ((MixHash(objectHash ^ EndpointHashes[i]) >> 11u) + 0.5) / 9007199254740992.0;
+		double score = -EndpointWeights[i] / std::log(hash);
+
+		if (score > bestScore || !i) {
+			best = i;
+			bestScore = score;
+		}
 	}
 
+	return Endpoints[best] == LocalEndpoint;
+}
+
+/**
+ * Sets the authority for a HARunOnce object activated after the initial assignment,
+ * e.g. created via the API or the cluster.
+ */
+static void ObjectActiveChangedHandler(const ConfigObject::Ptr& object, const Value&)
+{
+	if (!object->IsActive() || object->GetHAMode() != HARunOnce)
+		return;
+
+	std::shared_ptr<const ObjectAuthorityAssignment> authority;
+
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock (l_AuthorityMutex);
+
+			/* UpdateObjectAuthority() hasn't run yet. */
+			if (!l_Authority || l_Authority == authority)
+				return;
+
+			authority = l_Authority;
+		}
+
+		/* Repeated if the assignment has changed meanwhile and UpdateObjectAuthority() has already passed this object. */
+		object->SetAuthority(authority->IsAuthority(object));
+	}
+}
+
+static std::atomic<double> l_LastAuthorityWeightChange (0);
+
+/**
+ * Resets the weights of all endpoints of the local zone, including our own, once
+ * one of them (dis)connects. All endpoints of the zone do the same, so they agree
+ * on the authority until UpdateAuthorityLoad() has adjusted and exchanged the
+ * weights again. Otherwise each one would keep its own weight, but reset the
+ * others', and both could run some HARunOnce objects or none of them would.
+ */
+static void ZoneEndpointConnectionHandler(const Endpoint::Ptr& endpoint, const JsonRpcConnection::Ptr&)
+{
 	Zone::Ptr my_zone = Zone::GetLocalZone();
 
-	std::vector<Endpoint::Ptr> endpoints;
-	Endpoint::Ptr my_endpoint;
+	if (!my_zone || endpoint->GetZone() != my_zone || endpoint == Endpoint::GetLocalEndpoint())
+		return;
+
+	/* Forget what a disconnected endpoint told us in UpdateAuthorityLoad(). */
+	if (!endpoint->GetConnected())
+		endpoint->SetAuthorityLoad(-1);
+
+	for (const Endpoint::Ptr& zoneEndpoint : my_zone->GetEndpoints())
+		zoneEndpoint->SetAuthorityWeight(1);
+
+	/* Give the re-assigned objects time to be checked before measuring their load. */
+	l_LastAuthorityWeightChange.store(Utility::GetTime());
+}
+
+INITIALIZE_ONCE([]() {
+	ConfigObject::OnActiveChanged.connect(&ObjectActiveChangedHandler);
+	Endpoint::OnConnected.connect(&ZoneEndpointConnectionHandler);
+	Endpoint::OnDisconnected.connect(&ZoneEndpointConnectionHandler);
+});
+
+/**
+ * Distributes the HARunOnce objects among the connected endpoints of the local zone.
+ *
+ * Objects are only re-assigned if the set of connected endpoints has changed,
+ * objects activated later are assigned on activation. If all endpoints support
+ * it, objects are assigned by rendezvous hashing, so an endpoint (dis)connecting
+ * only moves the objects it takes over (or gives up). Otherwise, e.g. while
+ * an HA zone is being upgraded, the name hash modulo the number of endpoints
+ * decides, like older versions do.
+ */
+void ApiListener::UpdateObjectAuthority()
+{
+	auto authority (std::make_shared<ObjectAuthorityAssignment>());
+
+	authority->Standalone = true;
+	authority->Rendezvous = true;
+
+	Zone::Ptr my_zone = Zone::GetLocalZone();
 
 	if (my_zone) {
-		my_endpoint = Endpoint::GetLocalEndpoint();
+		authority->Standalone = false;
+		authority->LocalEndpoint = Endpoint::GetLocalEndpoint();
 
 		int num_total = 0;
 
 		for (const Endpoint::Ptr& endpoint : my_zone->GetEndpoints()) {
 			num_total++;
 
-			if (endpoint != my_endpoint && !endpoint->GetConnected())
-				continue;
+			if (endpoint != authority->LocalEndpoint) {
+				if (!endpoint->GetConnected())
+					continue;
+
+				if (!(endpoint->GetCapabilities() & (uint_fast64_t)ApiCapabilities::RendezvousAuthority))
+					authority->Rendezvous = false;
+			}
 
-			endpoints.push_back(endpoint);
+			authority->Endpoints.push_back(endpoint);
 		}
 
 		double startTime = Application::GetStartTime();
 
 		/* 30 seconds cold startup, don't update any authority to give the secondary endpoint time to reconnect. */
-		if (num_total > 1 && endpoints.size() <= 1 && (startTime == 0 || Utility::GetTime() - startTime < 30))
+		if (num_total > 1 && authority->Endpoints.size() <= 1 && (startTime == 0 || Utility::GetTime() - startTime < 30))
 			return;
 
-		std::sort(endpoints.begin(), endpoints.end(),
+		std::sort(authority->Endpoints.begin(), authority->Endpoints.end(),
 			[](const ConfigObject::Ptr& a, const ConfigObject::Ptr& b) {
 				return a->GetName() < b->GetName();
 			}
 		);
+
+		for (const Endpoint::Ptr& endpoint : authority->Endpoints) {
+			authority->EndpointHashes.push_back(HashName(endpoint->GetName()));
+			authority->EndpointWeights.push_back(authority->Rendezvous ? endpoint->GetAuthorityWeight() : 1);
+		}
+	}
+
+	{
+		std::unique_lock<std::mutex> lock (l_AuthorityMutex);
+
+		/* Objects activated since the last run have been assigned on activation. */
+		if (l_Authority && *l_Authority == *authority)
+			return;
+
+		l_Authority = authority;
+	}
+
+	if (auto listener = ApiListener::GetInstance()) {
+		Log(LogNotice, "ApiListener")
+			<< "Updating object authority for objects at endpoint '" << listener->GetIdentity() << "'.";
+	} else {
+		Log(LogNotice, "ApiListener")
+			<< "Updating object authority for local objects.";
 	}
 
 	for (const Type::Ptr& type : Type::GetAllTypes()) {
@@ -59,26 +250,147 @@ void ApiListener::UpdateObjectAuthority()
 		if (!dtype)
 			continue;
 
-		for (const ConfigObject::Ptr& object : dtype->GetObjects()) {
+		auto snapshot (dtype->GetSnapshot());
+
+		for (const ConfigObject::Ptr& object : snapshot->Objects) {
 			if (!object->IsActive() || object->GetHAMode() != HARunOnce)
 				continue;
 
-			bool authority;
-
-			if (!my_zone)
-				authority = true;
-			else
-				authority = endpoints[Utility::SDBM(object->GetName()) % endpoints.size()] == my_endpoint;
+			bool isAuthority = authority->IsAuthority(object);
 
 #ifdef I2_DEBUG
 // 			//Enable on demand, causes heavy logging on each run.
 //			Log(LogDebug, "ApiListener")
-//				<< "Setting authority '" << Convert::ToString(authority) << "' for object '" << object->GetName() << "' of type '" << object->GetReflectionType()->GetName() << "'.";
+//				<< "Setting authority '" << Convert::ToString(isAuthority) << "' for object '" << object->GetName() << "' of type '" << object->GetReflectionType()->GetName() << "'.";
 #endif /* I2_DEBUG */
 
-			object->SetAuthority(authority);
+			object->SetAuthority(isAuthority);
 		}
 	}
 
 	m_UpdatedObjectAuthority.store(true);
 }
+
+/**
+ * Balances the expected load of the HARunOnce objects among the endpoints of the local zone.
+ *
+ * Each endpoint sums up ConfigObject::GetAuthorityLoad() of the objects it has
+ * the authority for and tells the other endpoints of its zone. If its load
+ * differs from the zone's average by more than a quarter, it adjusts its weight
+ * for UpdateObjectAuthority() accordingly and tells the others its new one.
+ * Only halfway though (in log scale), as the others adjust theirs in the
+ * opposite direction meanwhile, and not more often than every five minutes,
+ * so the moved objects have been checked by their new endpoints.
+ */
+void ApiListener::UpdateAuthorityLoad()
+{
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+	Zone::Ptr my_zone = Zone::GetLocalZone();
+
+	if (!listener || !my_zone)
+		return;
+
+	Endpoint::Ptr my_endpoint = listener->GetLocalEndpoint();
+
+	if (!my_endpoint)
+		return;
+
+	double load = 0;
+
+	for (const Type::Ptr& type : Type::GetAllTypes()) {
+		auto *dtype = dynamic_cast<ConfigType *>(type.get());
+
+		if (!dtype)
+			continue;
+
+		auto snapshot (dtype->GetSnapshot());
+
+		for (const ConfigObject::Ptr& object : snapshot->Objects) {
+			if (object->IsActive() && !object->IsPaused() && object->GetHAMode() == HARunOnce)
+				load += object->GetAuthorityLoad();
+		}
+	}
+
+	my_endpoint->SetAuthorityLoad(load);
+
+	std::vector<Endpoint::Ptr> peers;
+	double totalLoad = load;
+	bool complete = true;
+
+	for (const Endpoint::Ptr& endpoint : my_zone->GetEndpoints()) {
+		if (endpoint == my_endpoint || !endpoint->GetConnected())
+			continue;
+
+		/* Weights are only used with rendezvous hashing, see UpdateObjectAuthority(). */
+		if (!(endpoint->GetCapabilities() & (uint_fast64_t)ApiCapabilities::RendezvousAuthority))
+			return;
+
+		peers.push_back(endpoint);
+
+		double peerLoad = endpoint->GetAuthorityLoad();
+
+		if (peerLoad < 0)
+			complete = false;
+		else
+			totalLoad += peerLoad;
+	}
+
+	if (peers.empty())
+		return;
+
+	double now = Utility::GetTime();
+	double average = totalLoad / (peers.size() + 1);
+	double weight = my_endpoint->GetAuthorityWeight();
+
+	/* Below 5% of a CPU per endpoint there's nothing worth moving around. */
+	if (complete && average >= 0.05 && std::fabs(load - average) > average / 4 && now - l_LastAuthorityWeightChange.load() >= 300) {
+		double newWeight = weight * (load > 0 ? std::sqrt(average / load) : 2);
+
+		newWeight = std::min(std::max(newWeight, 0.1), 10.0);
+
+		if (newWeight != weight) {
+			Log(LogInformation, "ApiListener")
+				<< "Expected load of objects at endpoint '" << my_endpoint->GetName() << "' is " << load
+				<< " CPU seconds per second, zone '" << my_zone->GetName() << "' average is " << average
+				<< ". Changing authority weight from " << weight << " to " << newWeight << ".";
+
+			weight = newWeight;
+			my_endpoint->SetAuthorityWeight(weight);
+			l_LastAuthorityWeightChange.store(now);
+		}
+	}
+
+	JsonRpcSharedMessage::Ptr message = new JsonRpcSharedMessage(new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", "event::SetAuthorityLoad" },
+		{ "params", new Dictionary({
+			{ "load", load },
+			{ "weight", weight }
+		}) }
+	}));
+
+	for (const Endpoint::Ptr& endpoint : peers)
+		listener->SyncSendMessage(endpoint, message);
+}
+
+Value ApiListener::AuthorityLoadAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
+{
+	Endpoint::Ptr endpoint = origin->FromClient->GetEndpoint();
+
+	if (!endpoint || endpoint->GetZone() != Zone::GetLocalZone() || endpoint == Endpoint::GetLocalEndpoint())
+		return Empty;
+
+	double load = params->Get("load");
+	double weight = params->Get("weight");
+
+	if (!std::isfinite(load) || !std::isfinite(weight) || weight <= 0) {
+		Log(LogWarning, "ApiListener")
+			<< "Ignoring invalid authority load from endpoint '" << endpoint->GetName() << "'.";
+		return Empty;
+	}
+
+	endpoint->SetAuthorityLoad(std::max(load, 0.0));
+	endpoint->SetAuthorityWeight(weight);
+
+	return Empty;
+}
@@ -0,0 +1,145 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/apilistener.hpp"
+#include "remote/apifunction.hpp"
+#include "remote/jsonrpcconnection.hpp"
+#include "base/logger.hpp"
+#include "base/objectlock.hpp"
+#include <set>
+
+using namespace icinga;
+
+REGISTER_APIFUNCTION(MessageBatch, event, &ApiListener::MessageBatchAPIHandler);
+
+/* Flush a batch right away once it has that many messages. */
+static const size_t l_MaxMessageBatchSize = 1000;
+
+/* Only these may be batched, see MessageBatchAPIHandler(). config::UpdateObject
+ * is only batched by StreamRuntimeConfigObjects(), for peers with the RuntimeObjectBatches capability.
+ */
+static const std::set<String> l_BatchableMethods {
+	"event::ExecuteCommand",
+	"event::CheckResult",
+	"config::UpdateObject"
+};
+
+/**
+ * Sends a message to an endpoint together with other messages queued for it
+ * within ApiListener#command_batch_interval, as one event::MessageBatch.
+ *
+ * Falls back to SyncSendMessage() if batching is disabled, the endpoint
+ * doesn't support it or the method can't be batched.
+ *
+ * @param endpoint The endpoint
+ * @param message The message
+ */
+void ApiListener::SendBatchedMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message)
+{
+	if (GetCommandBatchInterval() <= 0 || !(endpoint->GetCapabilities() & (uint_fast64_t)ApiCapabilities::MessageBatches)
+		|| !l_BatchableMethods.count(message->Get("method"))) {
+		SyncSendMessage(endpoint, message);
+		return;
+	}
+
+	ArrayData full;
+
+	{
+		std::unique_lock<std::mutex> lock (m_MessageBatchesMutex);
+		auto& batch (m_MessageBatches[endpoint]);
+
+		batch.emplace_back(new Dictionary({
+			{ "method", message->Get("method") },
+			{ "params", message->Get("params") }
+		}));
+
+		if (batch.size() < l_MaxMessageBatchSize)
+			return;
+
+		full.swap(batch);
+		m_MessageBatches.erase(endpoint);
+	}
+
+	SendMessageBatch(endpoint, std::move(full));
+}
+
+/**
+ * Sends all pending message batches.
+ */
+void ApiListener::FlushMessageBatches()
+{
+	std::map<Endpoint::Ptr, ArrayData> batches;
+
+	{
+		std::unique_lock<std::mutex> lock (m_MessageBatchesMutex);
+		batches.swap(m_MessageBatches);
+	}
+
+	for (auto& batch : batches)
+		SendMessageBatch(batch.first, std::move(batch.second));
+}
+
+void ApiListener::SendMessageBatch(const Endpoint::Ptr& endpoint, ArrayData messages)
+{
+	size_t count = messages.size();
+
+	/* Not worth the additional nesting. */
+	if (count == 1u) {
+		Dictionary::Ptr message = messages[0];
+		message->Set("jsonrpc", "2.0");
+		SyncSendMessage(endpoint, message);
+		return;
+	}
+
+	Dictionary::Ptr batch = new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", "event::MessageBatch" },
+		{ "params", new Dictionary({
+			{ "messages", new Array(std::move(messages)) }
+		}) }
+	});
+
+	Log(LogDebug, "ApiListener")
+		<< "Sending batch of " << count << " messages to '" << endpoint->GetName() << "'.";
+
+	SyncSendMessage(endpoint, batch);
+}
+
+/**
+ * Runs the messages of an event::MessageBatch in order, as if they had been
+ * received one by one from the same origin.
+ */
+Value ApiListener::MessageBatchAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
+{
+	Array::Ptr messages = params->Get("messages");
+
+	if (!messages)
+		return Empty;
+
+	ObjectLock olock(messages);
+
+	for (const Dictionary::Ptr& message : messages) {
+		String method = message->Get("method");
+
+		if (!l_BatchableMethods.count(method)) {
+			Log(LogNotice, "ApiListener")
+				<< "Ignoring message '" << method << "' in batch from '"
+				<< (origin->FromClient ? origin->FromClient->GetIdentity() : "") << "': Method can't be batched.";
+			continue;
+		}
+
+		ApiFunction::Ptr afunc = ApiFunction::GetByName(method);
+		Dictionary::Ptr mparams = message->Get("params");
+
+		if (!afunc || !mparams)
+			continue;
+
+		try {
+			afunc->Invoke(origin, mparams);
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "ApiListener")
+				<< "Error while processing message '" << method << "' in batch: " << DiagnosticInformation(ex, false);
+		}
+	}
+
+	return Empty;
+}
@@ -2,18 +2,45 @@
 
 #include "remote/apilistener.hpp"
 #include "remote/apifunction.hpp"
+#include "remote/configobjectjournal.hpp"
 #include "remote/configobjectutility.hpp"
 #include "remote/jsonrpc.hpp"
 #include "base/configtype.hpp"
 #include "base/json.hpp"
 #include "base/convert.hpp"
+#include "base/utility.hpp"
 #include "config/vmops.hpp"
+#include <chrono>
+#include <exception>
 #include <fstream>
+#include <future>
+#include <memory>
 
 using namespace icinga;
 
 REGISTER_APIFUNCTION(UpdateObject, config, &ApiListener::ConfigUpdateObjectAPIHandler);
 REGISTER_APIFUNCTION(DeleteObject, config, &ApiListener::ConfigDeleteObjectAPIHandler);
+REGISTER_APIFUNCTION(RuntimeObjectVersions, config, &ApiListener::ConfigRuntimeObjectVersionsAPIHandler);
+
+/* Runtime objects are sent to peers in batches of this many config::UpdateObject messages. */
+static const size_t l_RuntimeObjectBatchSize = 500;
+
+/* A config::RuntimeObjectVersions message has at most this many objects, further ones follow in more messages. */
+static const size_t l_RuntimeObjectVersionsChunkSize = 10000;
+
+/* Don't encode more batches while that many bytes still wait to be written to the peer. */
+static const size_t l_RuntimeObjectSyncMaxQueuedBytes = 16u * 1024u * 1024u;
+
+/* Sync all objects one by one if the peer doesn't tell us which ones it has within that many seconds. */
+static const double l_RuntimeObjectVersionsTimeout = 30;
+
+/**
+ * Whether an object is synced to other endpoints, i.e. created or modified at runtime.
+ */
+static bool IsRuntimeObject(const ConfigObject::Ptr& object)
+{
+	return object->GetPackage() == "_api" || object->GetVersion() != 0;
+}
 
 INITIALIZE_ONCE([]() {
 	ConfigObject::OnActiveChanged.connect(&ApiListener::ConfigUpdateObjectHandler);
@@ -187,7 +214,7 @@ Value ApiListener::ConfigUpdateObjectAPIHandler(const MessageOrigin::Ptr& origin
 			ObjectLock xlock(objOriginalAttributes);
 			for (const Dictionary::Pair& kv : objOriginalAttributes) {
 				/* original attribute was removed, restore it */
-				if (!newOriginalAttributes->Contains(kv.first))
+				if (!newOriginalAttributes->Contains(kv.first.GetString()))
 					restoreAttrs.push_back(kv.first);
 			}
 		}
@@ -311,10 +338,13 @@ void ApiListener::UpdateConfigObject(const ConfigObject::Ptr& object, const Mess
 		}
 	}
 
-	if (object->GetPackage() != "_api" && object->GetVersion() == 0)
+	if (!IsRuntimeObject(object))
 		return;
 
-	Dictionary::Ptr params = new Dictionary();
+	Dictionary::Ptr params = GetConfigObjectParams(object);
+
+	if (!params)
+		return;
 
 	Dictionary::Ptr message = new Dictionary({
 		{ "jsonrpc", "2.0" },
@@ -322,6 +352,33 @@ void ApiListener::UpdateConfigObject(const ConfigObject::Ptr& object, const Mess
 		{ "params", params }
 	});
 
+#ifdef I2_DEBUG
+	Log(LogDebug, "ApiListener")
+		<< "Sent update for object '" << object->GetName() << "': " << JsonEncode(params);
+#endif /* I2_DEBUG */
+
+	if (client)
+		client->SendMessage(message);
+	else {
+		Zone::Ptr target = static_pointer_cast<Zone>(object->GetZone());
+
+		if (!target)
+			target = Zone::GetLocalZone();
+
+		RelayMessage(origin, target, message, false);
+	}
+}
+
+/**
+ * Builds the params of a config::UpdateObject message.
+ *
+ * @param object The object
+ * @returns The params or nullptr if the object's config can't be read
+ */
+Dictionary::Ptr ApiListener::GetConfigObjectParams(const ConfigObject::Ptr& object)
+{
+	Dictionary::Ptr params = new Dictionary();
+
 	params->Set("name", object->GetName());
 	params->Set("type", object->GetReflectionType()->GetName());
 	params->Set("version", object->GetVersion());
@@ -332,21 +389,26 @@ void ApiListener::UpdateConfigObject(const ConfigObject::Ptr& object, const Mess
 		params->Set("zone", zoneName);
 
 	if (object->GetPackage() == "_api") {
-		String file;
+		String content = ConfigObjectJournal::GetInstance()->GetConfig(object->GetReflectionType(), object->GetName());
 
-		try {
-			file = ConfigObjectUtility::GetObjectConfigPath(object->GetReflectionType(), object->GetName());
-		} catch (const std::exception& ex) {
-			Log(LogNotice, "ApiListener")
-				<< "Cannot sync object '" << object->GetName() << "': " << ex.what();
-			return;
-		}
+		if (content.IsEmpty()) {
+			String file;
 
-		std::ifstream fp(file.CStr(), std::ifstream::binary);
-		if (!fp)
-			return;
+			try {
+				file = ConfigObjectUtility::GetObjectConfigPath(object->GetReflectionType(), object->GetName());
+			} catch (const std::exception& ex) {
+				Log(LogNotice, "ApiListener")
+					<< "Cannot sync object '" << object->GetName() << "': " << ex.what();
+				return nullptr;
+			}
+
+			std::ifstream fp(file.CStr(), std::ifstream::binary);
+			if (!fp)
+				return nullptr;
+
+			content = String((std::istreambuf_iterator<char>(fp)), std::istreambuf_iterator<char>());
+		}
 
-		String content((std::istreambuf_iterator<char>(fp)), std::istreambuf_iterator<char>());
 		params->Set("config", content);
 	}
 
@@ -366,7 +428,7 @@ void ApiListener::UpdateConfigObject(const ConfigObject::Ptr& object, const Mess
 
 			modified_attributes->Set(kv.first, value);
 
-			newOriginalAttributes.push_back(kv.first);
+			newOriginalAttributes.push_back(kv.first.GetString());
 		}
 	}
 
@@ -375,21 +437,7 @@ void ApiListener::UpdateConfigObject(const ConfigObject::Ptr& object, const Mess
 	/* only send the original attribute keys */
 	params->Set("original_attributes", new Array(std::move(newOriginalAttributes)));
 
-#ifdef I2_DEBUG
-	Log(LogDebug, "ApiListener")
-		<< "Sent update for object '" << object->GetName() << "': " << JsonEncode(params);
-#endif /* I2_DEBUG */
-
-	if (client)
-		client->SendMessage(message);
-	else {
-		Zone::Ptr target = static_pointer_cast<Zone>(object->GetZone());
-
-		if (!target)
-			target = Zone::GetLocalZone();
-
-		RelayMessage(origin, target, message, false);
-	}
+	return params;
 }
 
 
@@ -450,9 +498,89 @@ void ApiListener::SendRuntimeConfigObjects(const JsonRpcConnection::Ptr& aclient
 
 	Zone::Ptr azone = endpoint->GetZone();
 
+	RuntimeObjectSync progress;
+	progress.StartTime = Utility::GetTime();
+
+	/* Peers which accept config from us tell us what they already have, see SyncClient(). */
+	if ((endpoint->GetCapabilities() & (uint_fast64_t)ApiCapabilities::RuntimeObjectBatches) && azone->IsChildOf(Zone::GetLocalZone())) {
+		PeerRuntimeObjects peer;
+		bool received;
+
+		progress.State = "waiting";
+		UpdateRuntimeObjectSync(endpoint, progress);
+
+		{
+			std::unique_lock<std::mutex> lock (m_RuntimeObjectSyncMutex);
+
+			received = m_RuntimeObjectVersionsReceived.wait_for(lock, std::chrono::duration<double>(l_RuntimeObjectVersionsTimeout), [this, &aclient]() {
+				auto it (m_PeerRuntimeObjects.find(aclient));
+
+				return it != m_PeerRuntimeObjects.end() && it->second.Complete;
+			});
+
+			auto it (m_PeerRuntimeObjects.find(aclient));
+
+			if (it != m_PeerRuntimeObjects.end()) {
+				peer = std::move(it->second);
+				m_PeerRuntimeObjects.erase(it);
+			}
+		}
+
+		if (received && !peer.AcceptConfig) {
+			Log(LogInformation, "ApiListener")
+				<< "Not syncing runtime objects to endpoint '" << endpoint->GetName() << "': It doesn't accept config.";
+
+			progress.State = "done";
+			progress.EndTime = Utility::GetTime();
+			UpdateRuntimeObjectSync(endpoint, progress);
+			return;
+		}
+
+		if (received) {
+			auto promise (std::make_shared<std::promise<RuntimeObjectSync>>());
+			auto future (promise->get_future());
+			Dictionary::Ptr versions = peer.Versions;
+
+			progress.State = "queued";
+			UpdateRuntimeObjectSync(endpoint, progress);
+
+			/* Encoding the objects is what's expensive, do it for one endpoint after another. */
+			m_RuntimeObjectSyncQueue.Enqueue([this, aclient, versions, progress, promise]() {
+				try {
+					auto result (progress);
+
+					StreamRuntimeConfigObjects(aclient, versions, result);
+					promise->set_value(result);
+				} catch (...) {
+					promise->set_exception(std::current_exception());
+				}
+			});
+
+			try {
+				progress = future.get();
+			} catch (const std::exception&) {
+				progress.State = "failed";
+				progress.EndTime = Utility::GetTime();
+				UpdateRuntimeObjectSync(endpoint, progress);
+				throw;
+			}
+
+			progress.EndTime = Utility::GetTime();
+			UpdateRuntimeObjectSync(endpoint, progress);
+			return;
+		}
+
+		Log(LogWarning, "ApiListener")
+			<< "Endpoint '" << endpoint->GetName() << "' didn't tell which runtime objects it has within "
+			<< l_RuntimeObjectVersionsTimeout << " seconds, syncing all of them one by one.";
+	}
+
 	Log(LogInformation, "ApiListener")
 		<< "Syncing runtime objects to endpoint '" << endpoint->GetName() << "'.";
 
+	progress.State = "sending";
+	UpdateRuntimeObjectSync(endpoint, progress);
+
 	for (const Type::Ptr& type : Type::GetAllTypes()) {
 		auto *dtype = dynamic_cast<ConfigType *>(type.get());
 
@@ -464,11 +592,257 @@ void ApiListener::SendRuntimeConfigObjects(const JsonRpcConnection::Ptr& aclient
 			if (!azone->CanAccessObject(object))
 				continue;
 
+			if (IsRuntimeObject(object)) {
+				progress.Total++;
+				progress.Sent++;
+			}
+
 			/* send the config object to the connected client */
 			UpdateConfigObject(object, nullptr, aclient);
 		}
 	}
 
+	progress.State = "done";
+	progress.EndTime = Utility::GetTime();
+	UpdateRuntimeObjectSync(endpoint, progress);
+
 	Log(LogInformation, "ApiListener")
 		<< "Finished syncing runtime objects to endpoint '" << endpoint->GetName() << "'.";
 }
+
+/**
+ * Sends the runtime objects a peer doesn't have yet in batches, i.e. event::MessageBatch
+ * messages of config::UpdateObject. Objects whose version the peer already has are left
+ * out, the peer would discard them anyway. Waits for the peer to read the previous
+ * batches before encoding more of them.
+ *
+ * @param aclient Connected JSON-RPC client of an endpoint with the RuntimeObjectBatches capability.
+ * @param peerVersions The peer's object versions by type and name, see config::RuntimeObjectVersions.
+ * @param progress Updated as the objects are sent.
+ */
+void ApiListener::StreamRuntimeConfigObjects(const JsonRpcConnection::Ptr& aclient, const Dictionary::Ptr& peerVersions,
+	RuntimeObjectSync& progress)
+{
+	Endpoint::Ptr endpoint = aclient->GetEndpoint();
+	Zone::Ptr azone = endpoint->GetZone();
+	std::vector<ConfigObject::Ptr> objects;
+
+	for (const Type::Ptr& type : Type::GetAllTypes()) {
+		auto *dtype = dynamic_cast<ConfigType *>(type.get());
+
+		if (!dtype)
+			continue;
+
+		for (const ConfigObject::Ptr& object : dtype->GetObjects()) {
+			/* don't sync objects for non-matching parent-child zones */
+			if (azone->CanAccessObject(object) && IsRuntimeObject(object))
+				objects.emplace_back(object);
+		}
+	}
+
+	progress.State = "sending";
+	progress.Total = objects.size();
+	UpdateRuntimeObjectSync(endpoint, progress);
+
+	Log(LogInformation, "ApiListener")
+		<< "Syncing " << objects.size() << " runtime objects to endpoint '" << endpoint->GetName() << "' in batches.";
+
+	ArrayData batch;
+
+	auto sendBatch ([&aclient, &batch, &progress]() {
+		size_t count = batch.size();
+
+		Dictionary::Ptr message = new Dictionary({
+			{ "jsonrpc", "2.0" },
+			{ "method", "event::MessageBatch" },
+			{ "params", new Dictionary({
+				{ "messages", new Array(std::move(batch)) }
+			}) }
+		});
+
+		batch.clear();
+
+		/* Encode here rather than on the connection's I/O strand. */
+		aclient->SendRawMessage(JsonEncode(message));
+		progress.Sent += count;
+	});
+
+	for (const ConfigObject::Ptr& object : objects) {
+		Dictionary::Ptr typeVersions = peerVersions->Get(object->GetReflectionType()->GetName());
+		Value peerVersion;
+
+		if (typeVersions && typeVersions->Get(object->GetName(), &peerVersion) && object->GetVersion() <= static_cast<double>(peerVersion)) {
+			progress.Skipped++;
+			continue;
+		}
+
+		Dictionary::Ptr params = GetConfigObjectParams(object);
+
+		if (!params)
+			continue;
+
+		batch.emplace_back(new Dictionary({
+			{ "method", "config::UpdateObject" },
+			{ "params", params }
+		}));
+
+		if (batch.size() < l_RuntimeObjectBatchSize)
+			continue;
+
+		sendBatch();
+		UpdateRuntimeObjectSync(endpoint, progress);
+
+		while (aclient->GetQueuedBytes() > l_RuntimeObjectSyncMaxQueuedBytes) {
+			if (!endpoint->GetClients().count(aclient)) {
+				Log(LogInformation, "ApiListener")
+					<< "Stopped syncing runtime objects to endpoint '" << endpoint->GetName() << "': Disconnected.";
+
+				progress.State = "aborted";
+				return;
+			}
+
+			Utility::Sleep(0.05);
+		}
+	}
+
+	if (!batch.empty())
+		sendBatch();
+
+	progress.State = "done";
+
+	Log(LogInformation, "ApiListener")
+		<< "Finished syncing runtime objects to endpoint '" << endpoint->GetName() << "': Sent "
+		<< progress.Sent << ", skipped " << progress.Skipped << " unchanged ones.";
+}
+
+/**
+ * Tells a parent endpoint or one in our zone which runtime objects we already have,
+ * so it doesn't send them again. See StreamRuntimeConfigObjects().
+ *
+ * @param aclient Connected JSON-RPC client of an endpoint with the RuntimeObjectBatches capability.
+ */
+void ApiListener::SendRuntimeObjectVersions(const JsonRpcConnection::Ptr& aclient)
+{
+	bool acceptConfig = GetAcceptConfig();
+	Dictionary::Ptr versions = new Dictionary();
+	size_t count = 0;
+
+	auto sendVersions ([&aclient, &versions, &count, acceptConfig](bool complete) {
+		Dictionary::Ptr message = new Dictionary({
+			{ "jsonrpc", "2.0" },
+			{ "method", "config::RuntimeObjectVersions" },
+			{ "params", new Dictionary({
+				{ "versions", versions },
+				{ "accept_config", acceptConfig },
+				{ "complete", complete }
+			}) }
+		});
+
+		aclient->SendMessage(message);
+
+		versions = new Dictionary();
+		count = 0;
+	});
+
+	/* The sender needs nothing else if we'd ignore its objects anyway. */
+	if (acceptConfig) {
+		for (const Type::Ptr& type : Type::GetAllTypes()) {
+			auto *dtype = dynamic_cast<ConfigType *>(type.get());
+
+			if (!dtype)
+				continue;
+
+			String typeName = type->GetName();
+
+			for (const ConfigObject::Ptr& object : dtype->GetObjects()) {
+				if (!IsRuntimeObject(object))
+					continue;
+
+				Dictionary::Ptr typeVersions = versions->Get(typeName);
+
+				if (!typeVersions) {
+					typeVersions = new Dictionary();
+					versions->Set(typeName, typeVersions);
+				}
+
+				typeVersions->Set(object->GetName(), object->GetVersion());
+
+				if (++count >= l_RuntimeObjectVersionsChunkSize)
+					sendVersions(false);
+			}
+		}
+	}
+
+	sendVersions(true);
+}
+
+/**
+ * Registered handler when a new config::RuntimeObjectVersions message is received.
+ *
+ * A peer which accepts config from us tells us which runtime objects it has,
+ * SendRuntimeConfigObjects() waits for this.
+ *
+ * @param origin Where this message came from.
+ * @param params Message parameters including the object versions by type and name.
+ * @returns Empty, required by the interface.
+ */
+Value ApiListener::ConfigRuntimeObjectVersionsAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
+{
+	auto client (origin->FromClient);
+
+	if (!client || !client->GetEndpoint())
+		return Empty;
+
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	if (!listener)
+		return Empty;
+
+	Dictionary::Ptr versions = params->Get("versions");
+
+	{
+		std::unique_lock<std::mutex> lock (listener->m_RuntimeObjectSyncMutex);
+		auto& peers (listener->m_PeerRuntimeObjects);
+
+		/* Nobody waits for the versions of connections which are gone meanwhile. */
+		if (!peers.count(client)) {
+			for (auto it (peers.begin()); it != peers.end();) {
+				if (it->first->GetEndpoint()->GetClients().count(it->first))
+					++it;
+				else
+					it = peers.erase(it);
+			}
+		}
+
+		auto& peer (peers[client]);
+
+		if (versions) {
+			ObjectLock olock(versions);
+
+			for (const Dictionary::Pair& kv : versions) {
+				if (!kv.second.IsObjectType<Dictionary>())
+					continue;
+
+				Dictionary::Ptr typeVersions = peer.Versions->Get(kv.first);
+
+				if (typeVersions)
+					static_cast<Dictionary::Ptr>(kv.second)->CopyTo(typeVersions);
+				else
+					peer.Versions->Set(kv.first, kv.second);
+			}
+		}
+
+		peer.AcceptConfig = params->Get("accept_config").ToBool();
+		peer.Complete = params->Get("complete").ToBool();
+	}
+
+	listener->m_RuntimeObjectVersionsReceived.notify_all();
+
+	return Empty;
+}
+
+void ApiListener::UpdateRuntimeObjectSync(const Endpoint::Ptr& endpoint, const RuntimeObjectSync& progress)
+{
+	std::unique_lock<std::mutex> lock (m_RuntimeObjectSyncMutex);
+	m_RuntimeObjectSyncs[endpoint->GetName()] = progress;
+}
@@ -9,25 +9,44 @@
 #include "base/logger.hpp"
 #include "base/convert.hpp"
 #include "base/application.hpp"
+#include "base/configuration.hpp"
 #include "base/exception.hpp"
 #include "base/shared.hpp"
 #include "base/utility.hpp"
+#include "base/workqueue.hpp"
 #include <fstream>
 #include <iomanip>
+#include <map>
 #include <thread>
 
 using namespace icinga;
 
 REGISTER_APIFUNCTION(Update, config, &ApiListener::ConfigUpdateHandler);
+REGISTER_APIFUNCTION(Checksums, config, &ApiListener::ConfigChecksumsHandler);
 
 std::mutex ApiListener::m_ConfigSyncStageLock;
 
+/**
+ * A file's checksum, valid as long as the file's size and modification time don't change.
+ */
+struct ConfigChecksumCacheEntry
+{
+	off_t Size;
+	time_t Mtime;
+	String Checksum;
+};
+
+static std::mutex l_ConfigChecksumCacheMutex;
+static std::map<String, ConfigChecksumCacheEntry> l_ConfigChecksumCache;
+
 /**
  * Entrypoint for updating all authoritative configs from /etc/zones.d, packages, etc.
  * into var/lib/icinga2/api/zones
  */
 void ApiListener::SyncLocalZoneDirs() const
 {
+	double start = Utility::GetTime();
+
 	for (const Zone::Ptr& zone : ConfigType::GetObjectsByType<Zone>()) {
 		try {
 			SyncLocalZoneDir(zone);
@@ -35,6 +54,10 @@ void ApiListener::SyncLocalZoneDirs() const
 			continue;
 		}
 	}
+
+	Log(LogInformation, "ApiListener")
+		<< "Synced local zone directories in " << std::fixed << std::setprecision(3)
+		<< Utility::GetTime() - start << " seconds.";
 }
 
 /**
@@ -71,7 +94,7 @@ void ApiListener::SyncLocalZoneDir(const Zone::Ptr& zone) const
 				String path = "/" + zf.Tag + kv.first;
 
 				newConfigInfo.UpdateV1->Set(path, kv.second);
-				newConfigInfo.Checksums->Set(path, GetChecksum(kv.second));
+				newConfigInfo.Checksums->Set(path, newConfigPart.Checksums->Get(kv.first));
 			}
 		}
 
@@ -82,7 +105,7 @@ void ApiListener::SyncLocalZoneDir(const Zone::Ptr& zone) const
 				String path = "/" + zf.Tag + kv.first;
 
 				newConfigInfo.UpdateV2->Set(path, kv.second);
-				newConfigInfo.Checksums->Set(path, GetChecksum(kv.second));
+				newConfigInfo.Checksums->Set(path, newConfigPart.Checksums->Get(kv.first));
 			}
 		}
 	}
@@ -175,9 +198,14 @@ void ApiListener::SyncLocalZoneDir(const Zone::Ptr& zone) const
  * Loads the zone config files where this client belongs to
  * and sends the 'config::Update' JSON-RPC message.
  *
+ * If the client told us which files it already has, only changed and new files are sent.
+ * The checksums are always sent in full, the client takes unchanged files from its
+ * production directory and deletes the ones missing in the checksums.
+ *
  * @param aclient Connected JSON-RPC client.
+ * @param peerChecksums Checksums of the client's current zone files by zone name, see 'config::Checksums'.
  */
-void ApiListener::SendConfigUpdate(const JsonRpcConnection::Ptr& aclient)
+void ApiListener::SendConfigUpdate(const JsonRpcConnection::Ptr& aclient, const Dictionary::Ptr& peerChecksums)
 {
 	Endpoint::Ptr endpoint = aclient->GetEndpoint();
 	ASSERT(endpoint);
@@ -194,6 +222,8 @@ void ApiListener::SendConfigUpdate(const JsonRpcConnection::Ptr& aclient)
 	Dictionary::Ptr configUpdateChecksums = new Dictionary(); // new since 2.11
 
 	String zonesDir = GetApiZonesDir();
+	size_t numFiles = 0, numSkipped = 0;
+	double start = Utility::GetTime();
 
 	for (const Zone::Ptr& zone : ConfigType::GetObjectsByType<Zone>()) {
 		String zoneName = zone->GetName();
@@ -213,24 +243,186 @@ void ApiListener::SendConfigUpdate(const JsonRpcConnection::Ptr& aclient)
 
 		ConfigDirInformation config = LoadConfigDir(zoneDir);
 
+		if (peerChecksums) {
+			Dictionary::Ptr zoneChecksums = peerChecksums->Get(zoneName);
+
+			if (zoneChecksums) {
+				for (auto& update : { config.UpdateV1, config.UpdateV2 }) {
+					std::vector<String> unchanged;
+
+					{
+						ObjectLock olock(update);
+
+						for (const Dictionary::Pair& kv : update) {
+							numFiles++;
+
+							// Internal files like .timestamp are tiny and always sent.
+							if (Utility::Match("/.*", kv.first))
+								continue;
+
+							Value checksum;
+
+							if (zoneChecksums->Get(kv.first, &checksum) && checksum == config.Checksums->Get(kv.first))
+								unchanged.push_back(kv.first);
+						}
+					}
+
+					for (const String& path : unchanged)
+						update->Remove(path);
+
+					numSkipped += unchanged.size();
+				}
+			}
+		}
+
 		configUpdateV1->Set(zoneName, config.UpdateV1);
 		configUpdateV2->Set(zoneName, config.UpdateV2);
 		configUpdateChecksums->Set(zoneName, config.Checksums); // new since 2.11
 	}
 
+	Dictionary::Ptr params = new Dictionary({
+		{ "update", configUpdateV1 },
+		{ "update_v2", configUpdateV2 },	// Since 2.4.2.
+		{ "checksums", configUpdateChecksums } 	// Since 2.11.0.
+	});
+
+	if (peerChecksums) {
+		params->Set("delta", true);
+
+		Log(LogInformation, "ApiListener")
+			<< "Skipping " << numSkipped << " of " << numFiles << " configuration files which endpoint '"
+			<< endpoint->GetName() << "' already has.";
+	}
+
+	Log(LogInformation, "ApiListener")
+		<< "Loaded configuration files for endpoint '" << endpoint->GetName() << "' in "
+		<< std::fixed << std::setprecision(3) << Utility::GetTime() - start << " seconds.";
+
 	Dictionary::Ptr message = new Dictionary({
 		{ "jsonrpc", "2.0" },
 		{ "method", "config::Update" },
+		{ "params", params }
+	});
+
+	aclient->SendMessage(message);
+}
+
+/**
+ * Sends the checksums of our synced zone files to our parent, which answers with a
+ * delta 'config::Update'.
+ *
+ * @param aclient Connected JSON-RPC client of a parent endpoint.
+ * @param requestFullUpdate Send no checksums at all, so the parent sends all files.
+ */
+void ApiListener::SendConfigChecksums(const JsonRpcConnection::Ptr& aclient, bool requestFullUpdate)
+{
+	Dictionary::Ptr checksums = new Dictionary();
+
+	if (!requestFullUpdate) {
+		String zonesDir = GetApiZonesDir();
+
+		for (const Zone::Ptr& zone : ConfigType::GetObjectsByType<Zone>()) {
+			String zoneName = zone->GetName();
+			String zoneDir = zonesDir + zoneName;
+
+			// Our own authoritative zone config isn't synced from the parent.
+			if (ConfigCompiler::HasZoneConfigAuthority(zoneName) || !Utility::PathExists(zoneDir))
+				continue;
+
+			checksums->Set(zoneName, LoadConfigDir(zoneDir).Checksums);
+		}
+	}
+
+	Dictionary::Ptr message = new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", "config::Checksums" },
 		{ "params", new Dictionary({
-			{ "update", configUpdateV1 },
-			{ "update_v2", configUpdateV2 },	// Since 2.4.2.
-			{ "checksums", configUpdateChecksums } 	// Since 2.11.0.
+			{ "checksums", checksums }
 		}) }
 	});
 
 	aclient->SendMessage(message);
 }
 
+/**
+ * Registered handler when a new config::Checksums message is received.
+ *
+ * A child endpoint tells us which zone files it has, we answer with a delta config::Update.
+ *
+ * @param origin Where this message came from.
+ * @param params Message parameters including the checksums by zone name.
+ * @returns Empty, required by the interface.
+ */
+Value ApiListener::ConfigChecksumsHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
+{
+	auto client (origin->FromClient);
+
+	// Only child endpoints are synced, SendConfigUpdate() verifies the zone relation.
+	if (!client || !client->GetEndpoint())
+		return Empty;
+
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	if (!listener) {
+		Log(LogCritical, "ApiListener", "No instance available.");
+		return Empty;
+	}
+
+	Dictionary::Ptr checksums = params->Get("checksums");
+
+	if (!checksums)
+		return Empty;
+
+	// Loading the zone directories is expensive, don't block the connection.
+	Utility::QueueAsyncCallback([listener, client, checksums]() {
+		listener->SendConfigUpdate(client, checksums);
+	});
+
+	return Empty;
+}
+
+/**
+ * Adds the files a delta config::Update left out to it, taking them from production.
+ *
+ * @param productionConfig The current production config of the zone.
+ * @param newConfig The received config of the zone, completed in place.
+ * @returns Whether all left out files were found in production with the expected checksum.
+ */
+bool ApiListener::CompleteConfigDelta(const ConfigDirInformation& productionConfig, ConfigDirInformation& newConfig)
+{
+	newConfig.UpdateV1 = newConfig.UpdateV1 ? newConfig.UpdateV1->ShallowClone() : new Dictionary();
+	newConfig.UpdateV2 = newConfig.UpdateV2 ? newConfig.UpdateV2->ShallowClone() : new Dictionary();
+
+	if (!newConfig.Checksums)
+		return false;
+
+	ObjectLock olock(newConfig.Checksums);
+
+	for (const Dictionary::Pair& kv : newConfig.Checksums) {
+		const String& path = kv.first;
+
+		if (newConfig.UpdateV1->Contains(path) || newConfig.UpdateV2->Contains(path))
+			continue;
+
+		if (productionConfig.Checksums->Get(path) != kv.second) {
+			Log(LogWarning, "ApiListener")
+				<< "File '" << path << "' of a delta config update doesn't match our production copy.";
+			return false;
+		}
+
+		Value content;
+
+		if (productionConfig.UpdateV1->Get(path, &content))
+			newConfig.UpdateV1->Set(path, content);
+		else if (productionConfig.UpdateV2->Get(path, &content))
+			newConfig.UpdateV2->Set(path, content);
+		else
+			return false;
+	}
+
+	return true;
+}
+
 static bool CompareTimestampsConfigChange(const Dictionary::Ptr& productionConfig, const Dictionary::Ptr& receivedConfig,
 	const String& stageConfigZoneDir)
 {
@@ -351,6 +543,9 @@ void ApiListener::HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dic
 	if (params->Contains("checksums"))
 		checksums = params->Get("checksums");
 
+	// Unchanged files have been left out, see SendConfigUpdate().
+	bool delta = params->Get("delta").ToBool();
+
 	bool configChange = false;
 
 	// Keep track of the relative config paths for later validation and copying. TODO: Find a better algorithm.
@@ -369,6 +564,7 @@ void ApiListener::HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dic
 
 	// Analyse and process the update.
 	size_t count = 0;
+	double start = Utility::GetTime();
 
 	ObjectLock olock(updateV1);
 
@@ -417,6 +613,15 @@ void ApiListener::HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dic
 		// Load the current production config details.
 		ConfigDirInformation productionConfigInfo = LoadConfigDir(productionConfigZoneDir);
 
+		if (delta && !CompleteConfigDelta(productionConfigInfo, newConfigInfo)) {
+			Log(LogWarning, "ApiListener")
+				<< "Can't complete delta config update for zone '" << zoneName << "' from endpoint '"
+				<< fromEndpointName << "', requesting all files.";
+
+			SendConfigChecksums(origin->FromClient, true);
+			return;
+		}
+
 		// Merge updateV1 and updateV2
 		Dictionary::Ptr productionConfig = MergeConfigUpdate(productionConfigInfo);
 		Dictionary::Ptr newConfig = MergeConfigUpdate(newConfigInfo);
@@ -531,6 +736,10 @@ void ApiListener::HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dic
 		count++;
 	}
 
+	Log(LogInformation, "ApiListener")
+		<< "Staged configuration updates (" << count << ") from endpoint '" << fromEndpointName << "' in "
+		<< std::fixed << std::setprecision(3) << Utility::GetTime() - start << " seconds.";
+
 	/*
 	 * We have processed all configuration files and stored them in the staging directory.
 	 *
@@ -782,6 +991,7 @@ bool ApiListener::CheckConfigChange(const ConfigDirInformation& oldConfig, const
 
 /**
  * Load the given config dir and read their file content into the config structure.
+ * The files are read and checksummed in parallel.
  *
  * @param dir Path to the config directory.
  * @returns ConfigDirInformation structure.
@@ -793,10 +1003,53 @@ ConfigDirInformation ApiListener::LoadConfigDir(const String& dir)
 	config.UpdateV2 = new Dictionary();
 	config.Checksums = new Dictionary();
 
-	Utility::GlobRecursive(dir, "*", [&config, dir](const String& file) { ConfigGlobHandler(config, dir, file); }, GlobFile);
+	std::vector<String> files;
+	Utility::GlobRecursive(dir, "*", [&files](const String& file) { files.push_back(file); }, GlobFile);
+
+	WorkQueue upq(25000, Configuration::Concurrency);
+	upq.SetName("ApiListener::LoadConfigDir");
+
+	upq.ParallelFor(files, [&config, &dir](const String& file) { ConfigGlobHandler(config, dir, file); });
+	upq.Join();
+
+	if (upq.HasExceptions())
+		boost::rethrow_exception(upq.GetExceptions().front());
+
 	return config;
 }
 
+/**
+ * Generate a config file checksum, cached by the file's size and modification time.
+ *
+ * @param file Full file name.
+ * @param st The file's status, taken before its content was read.
+ * @param content The file's content.
+ * @returns The checksum as string.
+ */
+String ApiListener::GetFileChecksum(const String& file, const struct stat& st, const String& content)
+{
+	{
+		std::unique_lock<std::mutex> lock (l_ConfigChecksumCacheMutex);
+		auto it (l_ConfigChecksumCache.find(file));
+
+		if (it != l_ConfigChecksumCache.end() && it->second.Size == st.st_size && it->second.Mtime == st.st_mtime
+			&& static_cast<off_t>(content.GetLength()) == st.st_size)
+			return it->second.Checksum;
+	}
+
+	String checksum = GetChecksum(content);
+
+	/* The modification time has a resolution of one second. Files modified in the current
+	 * second may be modified again without a visible change, so don't cache them yet.
+	 */
+	if (static_cast<off_t>(content.GetLength()) == st.st_size && st.st_mtime < time(nullptr) - 1) {
+		std::unique_lock<std::mutex> lock (l_ConfigChecksumCacheMutex);
+		l_ConfigChecksumCache[file] = ConfigChecksumCacheEntry{st.st_size, st.st_mtime, checksum};
+	}
+
+	return checksum;
+}
+
 /**
  * Read the given file and store it in the config information structure.
  * Callback function for Glob().
@@ -816,6 +1069,12 @@ void ApiListener::ConfigGlobHandler(ConfigDirInformation& config, const String&
 	Log(LogNotice, "ApiListener")
 		<< "Creating config update for file '" << file << "'.";
 
+	// Taken before reading, so a concurrent modification never ends up in the checksum cache.
+	struct stat st;
+
+	if (stat(file.CStr(), &st) < 0)
+		return;
+
 	std::ifstream fp(file.CStr(), std::ifstream::binary);
 	if (!fp)
 		return;
@@ -858,7 +1117,7 @@ void ApiListener::ConfigGlobHandler(ConfigDirInformation& config, const String&
 	 *
 	 * IMPORTANT: Ignore the .authoritative file above, this must not be synced.
 	 * */
-	config.Checksums->Set(relativePath, GetChecksum(content));
+	config.Checksums->Set(relativePath, GetFileChecksum(file, st, content));
 }
 
 /**
@@ -5,21 +5,28 @@
 #include "remote/jsonrpcconnection.hpp"
 #include "remote/endpoint.hpp"
 #include "remote/jsonrpc.hpp"
+#include "remote/jsonrpccompression.hpp"
 #include "remote/apifunction.hpp"
 #include "remote/configpackageutility.hpp"
 #include "remote/configobjectutility.hpp"
+#include "remote/eventqueue.hpp"
 #include "base/convert.hpp"
 #include "base/defer.hpp"
 #include "base/io-engine.hpp"
 #include "base/netstring.hpp"
+#include "base/processhandoff.hpp"
 #include "base/json.hpp"
 #include "base/configtype.hpp"
 #include "base/logger.hpp"
+#include "base/metrics.hpp"
+#include "base/tracing.hpp"
 #include "base/objectlock.hpp"
 #include "base/stdiostream.hpp"
 #include "base/perfdatavalue.hpp"
 #include "base/application.hpp"
 #include "base/context.hpp"
+#include "base/configuration.hpp"
+#include "base/initialize.hpp"
 #include "base/statsfunction.hpp"
 #include "base/exception.hpp"
 #include "base/tcpsocket.hpp"
@@ -32,10 +39,13 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/regex.hpp>
 #include <boost/system/error_code.hpp>
+#include <algorithm>
 #include <climits>
 #include <cstdint>
 #include <fstream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <openssl/ssl.h>
 #include <openssl/tls1.h>
 #include <openssl/x509.h>
@@ -49,14 +59,54 @@ REGISTER_TYPE(ApiListener);
 boost::signals2::signal<void(bool)> ApiListener::OnMasterChanged;
 ApiListener::Ptr ApiListener::m_Instance;
 
-REGISTER_STATSFUNCTION(ApiListener, &ApiListener::StatsFunc);
+REGISTER_STATSFUNCTION_TTL(ApiListener, &ApiListener::StatsFunc, 5);
 
 REGISTER_APIFUNCTION(Hello, icinga, &ApiListener::HelloAPIHandler);
 
+static Histogram l_RelayTime ("icinga_cluster_relay_seconds", "Time from queueing a cluster message for relaying until it was relayed");
+
+/**
+ * A zone RelayMessageOne() relays to and its endpoints, except the local one.
+ */
+struct RelayRoute
+{
+	Zone::Ptr TargetZone;
+	std::vector<Endpoint::Ptr> Endpoints;
+};
+
+typedef std::shared_ptr<const std::vector<RelayRoute>> RelayRoutes;
+
+/* By target zone, rebuilt on demand after any zone or endpoint changes. */
+static std::mutex l_RelayRoutesMutex;
+static std::map<Zone::Ptr, RelayRoutes> l_RelayRoutes;
+
+static void InvalidateRelayRoutes()
+{
+	std::unique_lock<std::mutex> lock (l_RelayRoutesMutex);
+	l_RelayRoutes.clear();
+}
+
+INITIALIZE_ONCE([]() {
+	ConfigObject::OnActiveChanged.connect([](const ConfigObject::Ptr& object, const Value&) {
+		if (dynamic_cast<Zone*>(object.get()) || dynamic_cast<Endpoint*>(object.get()))
+			InvalidateRelayRoutes();
+	});
+
+	Zone::OnParentRawChanged.connect([](const Zone::Ptr&, const Value&) { InvalidateRelayRoutes(); });
+	Zone::OnEndpointsRawChanged.connect([](const Zone::Ptr&, const Value&) { InvalidateRelayRoutes(); });
+	Zone::OnGlobalChanged.connect([](const Zone::Ptr&, const Value&) { InvalidateRelayRoutes(); });
+});
+
 ApiListener::ApiListener()
 {
 	m_RelayQueue.SetName("ApiListener, RelayQueue");
 	m_SyncQueue.SetName("ApiListener, SyncQueue");
+	m_RuntimeObjectSyncQueue.SetName("ApiListener, RuntimeObjectSyncQueue");
+
+	for (int i = 0; i < std::max(Configuration::Concurrency, 1); i++) {
+		m_MessageLanes.emplace_back(new WorkQueue(0, 1, LogNotice));
+		m_MessageLanes.back()->SetName("ApiListener, MessageLane #" + Convert::ToString(i));
+	}
 }
 
 String ApiListener::GetApiDir()
@@ -218,6 +268,17 @@ void ApiListener::UpdateSSLContext()
 		}
 	}
 
+	try {
+		/* Lets clients resume their sessions after a restart. The keys are renewed daily and whenever
+		 * the certificates or the CRL change, so such changes are never bypassed by a resumed session.
+		 */
+		SetTlsSessionTicketKeysToSSLContext(context, GetCertsDir() + "/session-tickets.key", 24 * 60 * 60,
+			{ GetDefaultCertPath(), GetDefaultCaPath(), GetCrlPath() });
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "ApiListener")
+			<< "Cannot persist TLS session ticket keys, sessions won't survive a restart: " << DiagnosticInformation(ex, false);
+	}
+
 	m_SSLContext = context;
 
 	for (const Endpoint::Ptr& endpoint : ConfigType::GetObjectsByType<Endpoint>()) {
@@ -266,12 +327,14 @@ void ApiListener::Start(bool runtimeCreated)
 	m_Timer = new Timer();
 	m_Timer->OnTimerExpired.connect([this](const Timer * const&) { ApiTimerHandler(); });
 	m_Timer->SetInterval(5);
+	m_Timer->SetSlack(1);
 	m_Timer->Start();
 	m_Timer->Reschedule(0);
 
 	m_ReconnectTimer = new Timer();
 	m_ReconnectTimer->OnTimerExpired.connect([this](const Timer * const&) { ApiReconnectTimerHandler(); });
 	m_ReconnectTimer->SetInterval(10);
+	m_ReconnectTimer->SetSlack(1);
 	m_ReconnectTimer->Start();
 	m_ReconnectTimer->Reschedule(0);
 
@@ -282,17 +345,35 @@ void ApiListener::Start(bool runtimeCreated)
 	m_AuthorityTimer = new Timer();
 	m_AuthorityTimer->OnTimerExpired.connect([](const Timer * const&) { UpdateObjectAuthority(); });
 	m_AuthorityTimer->SetInterval(10);
+	m_AuthorityTimer->SetSlack(1);
 	m_AuthorityTimer->Start();
 
+	m_AuthorityLoadTimer = new Timer();
+	m_AuthorityLoadTimer->OnTimerExpired.connect([](const Timer * const&) { UpdateAuthorityLoad(); });
+	m_AuthorityLoadTimer->SetInterval(60);
+	m_AuthorityLoadTimer->SetSlack(10);
+	m_AuthorityLoadTimer->Start();
+
+	if (GetCommandBatchInterval() > 0) {
+		m_MessageBatchTimer = new Timer();
+		m_MessageBatchTimer->OnTimerExpired.connect([this](const Timer * const&) { FlushMessageBatches(); });
+		m_MessageBatchTimer->SetInterval(GetCommandBatchInterval());
+		m_MessageBatchTimer->Start();
+	}
+
 	m_CleanupCertificateRequestsTimer = new Timer();
 	m_CleanupCertificateRequestsTimer->OnTimerExpired.connect([this](const Timer * const&) { CleanupCertificateRequestsTimerHandler(); });
 	m_CleanupCertificateRequestsTimer->SetInterval(3600);
+	m_CleanupCertificateRequestsTimer->SetSlack(60);
+	m_CleanupCertificateRequestsTimer->SetSchedulerPolicy(BackgroundScheduler);
 	m_CleanupCertificateRequestsTimer->Start();
 	m_CleanupCertificateRequestsTimer->Reschedule(0);
 
 	m_ApiPackageIntegrityTimer = new Timer();
 	m_ApiPackageIntegrityTimer->OnTimerExpired.connect([this](const Timer * const&) { CheckApiPackageIntegrity(); });
 	m_ApiPackageIntegrityTimer->SetInterval(300);
+	m_ApiPackageIntegrityTimer->SetSlack(60);
+	m_ApiPackageIntegrityTimer->SetSchedulerPolicy(BackgroundScheduler);
 	m_ApiPackageIntegrityTimer->Start();
 
 	OnMasterChanged(true);
@@ -368,48 +449,72 @@ bool ApiListener::AddListener(const String& node, const String& service)
 
 	auto& io (IoEngine::Get().GetIoContext());
 	auto acceptor (Shared<tcp::acceptor>::Make(io));
+	String handoffKey = node + ":" + service;
 
-	try {
-		tcp::resolver resolver (io);
-		tcp::resolver::query query (node, service, tcp::resolver::query::passive);
+#ifndef _WIN32
+	/* Take over the socket of the previous worker process on reload, it may already have queued connections. */
+	int handoffFd = ProcessHandoff::TakeListener(handoffKey);
 
-		auto result (resolver.resolve(query));
-		auto current (result.begin());
+	if (handoffFd != -1) {
+		sockaddr_storage addr;
+		socklen_t addrLength = sizeof(addr);
+		boost::system::error_code ec;
 
-		for (;;) {
-			try {
-				acceptor->open(current->endpoint().protocol());
+		if (getsockname(handoffFd, reinterpret_cast<sockaddr *>(&addr), &addrLength) == 0)
+			acceptor->assign(addr.ss_family == AF_INET6 ? tcp::v6() : tcp::v4(), handoffFd, ec);
+
+		if (!acceptor->is_open()) {
+			Log(LogWarning, "ApiListener")
+				<< "Cannot take over the listener for host '" << node << "' on port '" << service << "' from the previous process.";
+
+			(void)close(handoffFd);
+		}
+	}
+#endif /* _WIN32 */
 
-				{
-					auto fd (acceptor->native_handle());
+	if (!acceptor->is_open()) {
+		try {
+			tcp::resolver resolver (io);
+			tcp::resolver::query query (node, service, tcp::resolver::query::passive);
+
+			auto result (resolver.resolve(query));
+			auto current (result.begin());
+
+			for (;;) {
+				try {
+					acceptor->open(current->endpoint().protocol());
+
+					{
+						auto fd (acceptor->native_handle());
 
-					const int optFalse = 0;
-					setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast<const char *>(&optFalse), sizeof(optFalse));
+						const int optFalse = 0;
+						setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast<const char *>(&optFalse), sizeof(optFalse));
 
-					const int optTrue = 1;
-					setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&optTrue), sizeof(optTrue));
+						const int optTrue = 1;
+						setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&optTrue), sizeof(optTrue));
 #ifdef SO_REUSEPORT
-					setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char *>(&optTrue), sizeof(optTrue));
+						setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char *>(&optTrue), sizeof(optTrue));
 #endif /* SO_REUSEPORT */
-				}
+					}
 
-				acceptor->bind(current->endpoint());
+					acceptor->bind(current->endpoint());
 
-				break;
-			} catch (const std::exception&) {
-				if (++current == result.end()) {
-					throw;
-				}
+					break;
+				} catch (const std::exception&) {
+					if (++current == result.end()) {
+						throw;
+					}
 
-				if (acceptor->is_open()) {
-					acceptor->close();
+					if (acceptor->is_open()) {
+						acceptor->close();
+					}
 				}
 			}
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "ApiListener")
+				<< "Cannot bind TCP socket for host '" << node << "' on port '" << service << "': " << ex.what();
+			return false;
 		}
-	} catch (const std::exception& ex) {
-		Log(LogCritical, "ApiListener")
-			<< "Cannot bind TCP socket for host '" << node << "' on port '" << service << "': " << ex.what();
-		return false;
 	}
 
 	acceptor->listen(INT_MAX);
@@ -419,7 +524,16 @@ bool ApiListener::AddListener(const String& node, const String& service)
 	Log(LogInformation, "ApiListener")
 		<< "Started new listener on '[" << localEndpoint.address() << "]:" << localEndpoint.port() << "'";
 
-	IoEngine::SpawnCoroutine(io, [this, acceptor](asio::yield_context yc) { ListenerCoroutineProc(yc, acceptor, m_SSLContext); });
+	auto strand (Shared<asio::io_context::strand>::Make(io));
+
+	IoEngine::SpawnCoroutine(*strand, [this, acceptor](asio::yield_context yc) { ListenerCoroutineProc(yc, acceptor, m_SSLContext); });
+
+	ProcessHandoff::AddListener(handoffKey, acceptor->native_handle(), [strand, acceptor]() {
+		asio::post(*strand, [acceptor]() {
+			boost::system::error_code ec;
+			acceptor->close(ec);
+		});
+	});
 
 	UpdateStatusFile(localEndpoint);
 
@@ -430,8 +544,6 @@ void ApiListener::ListenerCoroutineProc(boost::asio::yield_context yc, const Sha
 {
 	namespace asio = boost::asio;
 
-	auto& io (IoEngine::Get().GetIoContext());
-
 	time_t lastModified = -1;
 	const String crlPath = GetCrlPath();
 
@@ -441,6 +553,8 @@ void ApiListener::ListenerCoroutineProc(boost::asio::yield_context yc, const Sha
 
 	for (;;) {
 		try {
+			/* With NUMA-aware I/O each connection stays on one node. */
+			auto& io (IoEngine::Get().GetNextIoContext());
 			asio::ip::tcp::socket socket (io);
 
 			server->async_accept(socket.lowest_layer(), yc);
@@ -462,12 +576,58 @@ void ApiListener::ListenerCoroutineProc(boost::asio::yield_context yc, const Sha
 
 			IoEngine::SpawnCoroutine(*strand, [this, strand, sslConn](asio::yield_context yc) { NewClientHandler(yc, strand, sslConn, String(), RoleServer); });
 		} catch (const std::exception& ex) {
+			/* The socket has been passed to the next worker process. */
+			if (!server->is_open())
+				break;
+
 			Log(LogCritical, "ApiListener")
 				<< "Cannot accept new connection: " << ex.what();
 		}
 	}
 }
 
+/**
+ * Waits until less than max_concurrent_tls_handshakes incoming handshakes
+ * are in progress, so a reconnect storm doesn't starve the I/O threads.
+ */
+void ApiListener::AcquireTlsHandshakeSlot(boost::asio::yield_context yc, const Shared<boost::asio::io_context::strand>::Ptr& strand)
+{
+	AsioConditionVariable admitted (strand->context());
+
+	{
+		std::unique_lock<std::mutex> lock (m_TlsHandshakeSlotsMutex);
+		int limit = GetMaxConcurrentTlsHandshakes();
+
+		if (limit == 0 || m_TlsHandshakesInProgress < limit) {
+			m_TlsHandshakesInProgress++;
+			return;
+		}
+
+		m_TlsHandshakeWaiters.emplace_back(strand, &admitted);
+	}
+
+	/* ReleaseTlsHandshakeSlot() hands its slot over to us. */
+	admitted.Wait(yc);
+}
+
+void ApiListener::ReleaseTlsHandshakeSlot()
+{
+	std::unique_lock<std::mutex> lock (m_TlsHandshakeSlotsMutex);
+
+	if (m_TlsHandshakeWaiters.empty()) {
+		m_TlsHandshakesInProgress--;
+		return;
+	}
+
+	auto waiter (m_TlsHandshakeWaiters.front());
+	m_TlsHandshakeWaiters.pop_front();
+
+	lock.unlock();
+
+	AsioConditionVariable *admitted = waiter.second;
+	boost::asio::post(*waiter.first, [admitted]() { admitted->Set(); });
+}
+
 /**
  * Creates a new JSON-RPC client and connects to the specified endpoint.
  *
@@ -483,7 +643,7 @@ void ApiListener::AddConnection(const Endpoint::Ptr& endpoint)
 		return;
 	}
 
-	auto& io (IoEngine::Get().GetIoContext());
+	auto& io (IoEngine::Get().GetNextIoContext());
 	auto strand (Shared<asio::io_context::strand>::Make(io));
 
 	IoEngine::SpawnCoroutine(*strand, [this, strand, endpoint, &io](asio::yield_context yc) {
@@ -542,7 +702,34 @@ static const auto l_AppVersionInt (([]() -> unsigned long {
 		+ boost::lexical_cast<unsigned long>(match[3].str());
 })());
 
-static const auto l_MyCapabilities (ApiCapabilities::ExecuteArbitraryCommand);
+/* Replay log segments are rotated after reaching this size. */
+static const uint_fast64_t l_MaxLogFileSize = 64u * 1024u * 1024u;
+
+static const auto l_MyCapabilities (
+	(uint_fast64_t)ApiCapabilities::ExecuteArbitraryCommand | (uint_fast64_t)ApiCapabilities::BinaryMessages
+		| (uint_fast64_t)ApiCapabilities::ConfigDeltaSync | (uint_fast64_t)ApiCapabilities::RendezvousAuthority
+		| (uint_fast64_t)ApiCapabilities::MessageBatches | (uint_fast64_t)ApiCapabilities::RuntimeObjectBatches
+);
+
+/**
+ * Capabilities to advertise in icinga::Hello.
+ *
+ * @return Bitmask of ApiCapabilities
+ */
+uint_fast64_t ApiListener::GetMyCapabilities()
+{
+	auto capabilities (l_MyCapabilities);
+
+	if (GetCompression()) {
+		capabilities |= (uint_fast64_t)ApiCapabilities::Compression;
+	}
+
+	if (GetCompactCheckResults()) {
+		capabilities |= (uint_fast64_t)ApiCapabilities::CompactCheckResults;
+	}
+
+	return capabilities;
+}
 
 /**
  * Processes a new client connection.
@@ -579,7 +766,17 @@ void ApiListener::NewClientHandlerInternal(
 
 	boost::system::error_code ec;
 
+	if (role == RoleServer)
+		AcquireTlsHandshakeSlot(yc, strand);
+
 	{
+		Defer releaseHandshakeSlot ([this, role]() {
+			if (role == RoleServer)
+				ReleaseTlsHandshakeSlot();
+		});
+
+		double handshakeStart = Utility::GetTime();
+
 		Timeout::Ptr handshakeTimeout (new Timeout(
 			strand->context(),
 			*strand,
@@ -593,6 +790,16 @@ void ApiListener::NewClientHandlerInternal(
 		sslConn.async_handshake(role == RoleClient ? sslConn.client : sslConn.server, yc[ec]);
 
 		handshakeTimeout->Cancel();
+
+		if (!ec) {
+			double now = Utility::GetTime();
+
+			m_TlsHandshakes.InsertValue(now, 1);
+			m_TlsHandshakeMilliseconds.InsertValue(now, static_cast<int>((now - handshakeStart) * 1000));
+
+			if (sslConn.IsSessionReused())
+				m_TlsResumedHandshakes.InsertValue(now, 1);
+		}
 	}
 
 	if (ec) {
@@ -677,13 +884,16 @@ void ApiListener::NewClientHandlerInternal(
 			{ "method", "icinga::Hello" },
 			{ "params", new Dictionary({
 				{ "version", (double)l_AppVersionInt },
-				{ "capabilities", (double)l_MyCapabilities }
+				{ "capabilities", (double)GetMyCapabilities() }
 			}) }
 		}), yc);
 
 		client->async_flush(yc);
 
 		ctype = ClientJsonRpc;
+	} else if (sslConn.GetAlpnProtocol() == "http/1.1") {
+		/* JSON-RPC peers don't use ALPN, so there's no need to wait for the first byte. */
+		ctype = ClientHttp;
 	} else {
 		{
 			boost::system::error_code ec;
@@ -716,7 +926,7 @@ void ApiListener::NewClientHandlerInternal(
 				{ "method", "icinga::Hello" },
 				{ "params", new Dictionary({
 					{ "version", (double)l_AppVersionInt },
-					{ "capabilities", (double)l_MyCapabilities }
+					{ "capabilities", (double)GetMyCapabilities() }
 				}) }
 			}), yc);
 
@@ -738,7 +948,7 @@ void ApiListener::NewClientHandlerInternal(
 			return;
 		}
 
-		JsonRpcConnection::Ptr aclient = new JsonRpcConnection(identity, verify_ok, client, role);
+		JsonRpcConnection::Ptr aclient = new JsonRpcConnection(identity, verify_ok, client, role, strand->context());
 
 		if (endpoint) {
 			endpoint->AddClient(aclient);
@@ -762,7 +972,7 @@ void ApiListener::NewClientHandlerInternal(
 	} else {
 		Log(LogNotice, "ApiListener", "New HTTP client");
 
-		HttpServerConnection::Ptr aclient = new HttpServerConnection(identity, verify_ok, client);
+		HttpServerConnection::Ptr aclient = new HttpServerConnection(identity, verify_ok, client, strand->context());
 		AddHttpClient(aclient);
 		aclient->Start();
 
@@ -794,8 +1004,16 @@ void ApiListener::SyncClient(const JsonRpcConnection::Ptr& aclient, const Endpoi
 					JsonRpcConnection::SendCertificateRequest(aclient, nullptr, newPath);
 				}, GlobFile);
 			}
+
+			/* Tell the parent which zone files we already have, it answers with a delta. */
+			if (GetAcceptConfig())
+				SendConfigChecksums(aclient);
 		}
 
+		/* Tell parents and endpoints in our zone which runtime objects they don't have to send us. */
+		if (myZone->IsChildOf(eZone) && (endpoint->GetCapabilities() & (uint_fast64_t)ApiCapabilities::RuntimeObjectBatches))
+			SendRuntimeObjectVersions(aclient);
+
 		/* Make sure that the config updates are synced
 		 * before the logs are replayed.
 		 */
@@ -803,8 +1021,9 @@ void ApiListener::SyncClient(const JsonRpcConnection::Ptr& aclient, const Endpoi
 		Log(LogInformation, "ApiListener")
 			<< "Sending config updates for endpoint '" << endpoint->GetName() << "' in zone '" << eZone->GetName() << "'.";
 
-		/* sync zone file config */
-		SendConfigUpdate(aclient);
+		/* sync zone file config, peers capable of delta syncs request it themselves */
+		if (!(endpoint->GetCapabilities() & (uint_fast64_t)ApiCapabilities::ConfigDeltaSync))
+			SendConfigUpdate(aclient);
 
 		Log(LogInformation, "ApiListener")
 			<< "Finished sending config file updates for endpoint '" << endpoint->GetName() << "' in zone '" << eZone->GetName() << "'.";
@@ -859,6 +1078,10 @@ void ApiListener::ApiTimerHandler()
 	for (int ts : files) {
 		bool need = false;
 		auto localZone (GetLocalEndpoint()->GetZone());
+		String path = GetApiDir() + "log/" + Convert::ToString(ts);
+
+		ReplayLogIndex index;
+		index.Load(path + ".idx");
 
 		for (const Endpoint::Ptr& endpoint : ConfigType::GetObjectsByType<Endpoint>()) {
 			if (endpoint == GetLocalEndpoint())
@@ -874,17 +1097,17 @@ void ApiListener::ApiTimerHandler()
 			if (endpoint->GetLogDuration() >= 0 && ts < now - endpoint->GetLogDuration())
 				continue;
 
-			if (ts > endpoint->GetLocalLogPosition()) {
+			if (ts > endpoint->GetLocalLogPosition() && index.MayConcern(zone)) {
 				need = true;
 				break;
 			}
 		}
 
 		if (!need) {
-			String path = GetApiDir() + "log/" + Convert::ToString(ts);
 			Log(LogNotice, "ApiListener")
 				<< "Removing old log file: " << path;
 			(void)unlink(path.CStr());
+			(void)unlink((path + ".idx").CStr());
 		}
 	}
 
@@ -1026,25 +1249,41 @@ void ApiListener::CleanupCertificateRequestsTimerHandler()
 	}
 }
 
+/**
+ * Relays a message to all endpoints which are allowed to see secobj.
+ *
+ * @param compactMessage An optional variant of the message for endpoints
+ *	which advertised ApiCapabilities::CompactCheckResults
+ */
 void ApiListener::RelayMessage(const MessageOrigin::Ptr& origin,
-	const ConfigObject::Ptr& secobj, const Dictionary::Ptr& message, bool log)
+	const ConfigObject::Ptr& secobj, const Dictionary::Ptr& message, bool log, const Dictionary::Ptr& compactMessage)
 {
 	if (!IsActive())
 		return;
 
-	m_RelayQueue.Enqueue([this, origin, secobj, message, log]() { SyncRelayMessage(origin, secobj, message, log); }, PriorityNormal, true);
+	auto queued (Histogram::Clock::now());
+	auto trace (Span::GetCurrentContext());
+
+	m_RelayQueue.Enqueue([this, origin, secobj, message, log, compactMessage, queued, trace]() {
+		Span span ("ApiListener::RelayMessage", trace);
+
+		SyncRelayMessage(origin, secobj, message, log, compactMessage);
+		l_RelayTime.ObserveSince(queued);
+	}, PriorityNormal, true);
 }
 
-void ApiListener::PersistMessage(const Dictionary::Ptr& message, const ConfigObject::Ptr& secobj)
+void ApiListener::PersistMessage(const JsonRpcSharedMessage::Ptr& message, const ConfigObject::Ptr& secobj)
 {
-	double ts = message->Get("ts");
+	double ts = message->GetMessage()->Get("ts");
 
 	ASSERT(ts != 0);
 
 	Dictionary::Ptr pmessage = new Dictionary();
 	pmessage->Set("timestamp", ts);
 
-	pmessage->Set("message", JsonEncode(message));
+	/* Lets ReplayLog() decide whether to skip it without decoding the message. */
+	pmessage->Set("method", message->GetMessage()->Get("method"));
+	pmessage->Set("message", *message->GetEncoded(false));
 
 	if (secobj) {
 		Dictionary::Ptr secname = new Dictionary();
@@ -1053,13 +1292,27 @@ void ApiListener::PersistMessage(const Dictionary::Ptr& message, const ConfigObj
 		pmessage->Set("secobj", secname);
 	}
 
+	/* Same as Zone#CanAccessObject() */
+	String zone;
+
+	if (secobj) {
+		if (secobj->GetReflectionType() == Zone::TypeInstance)
+			zone = secobj->GetName();
+		else
+			zone = secobj->GetZoneName();
+
+		if (zone.IsEmpty())
+			zone = Zone::GetLocalZone()->GetName();
+	}
+
 	std::unique_lock<std::mutex> lock(m_LogLock);
 	if (m_LogFile) {
-		NetString::WriteStringToStream(m_LogFile, JsonEncode(pmessage));
+		m_LogIndex.AddMessage(m_LogFileSize, ts, zone, !secobj);
+		m_LogFileSize += NetString::WriteStringToStream(m_LogFile, JsonEncode(pmessage));
 		m_LogMessageCount++;
 		SetLogMessageTimestamp(ts);
 
-		if (m_LogMessageCount > 50000) {
+		if (m_LogMessageCount > 50000 || m_LogFileSize > l_MaxLogFileSize) {
 			CloseLogFile();
 			RotateLogFile();
 			OpenLogFile();
@@ -1067,13 +1320,32 @@ void ApiListener::PersistMessage(const Dictionary::Ptr& message, const ConfigObj
 	}
 }
 
-void ApiListener::SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message)
+/**
+ * Sends a message to the most recently connected client of an endpoint.
+ *
+ * @param endpoint The endpoint
+ * @param message The message
+ *
+ * @return false if the message was dropped because the endpoint doesn't keep up
+ */
+bool ApiListener::SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message)
+{
+	return SyncSendMessage(endpoint, new JsonRpcSharedMessage(message));
+}
+
+/**
+ * Like SyncSendMessage(const Endpoint::Ptr&, const Dictionary::Ptr&), but doesn't encode
+ * the message again if it has been sent to another endpoint already.
+ */
+bool ApiListener::SyncSendMessage(const Endpoint::Ptr& endpoint, const JsonRpcSharedMessage::Ptr& message)
 {
 	ObjectLock olock(endpoint);
 
+	bool sent = true;
+
 	if (!endpoint->GetSyncing()) {
 		Log(LogNotice, "ApiListener")
-			<< "Sending message '" << message->Get("method") << "' to '" << endpoint->GetName() << "'";
+			<< "Sending message '" << message->GetMessage()->Get("method") << "' to '" << endpoint->GetName() << "'";
 
 		double maxTs = 0;
 
@@ -1082,13 +1354,87 @@ void ApiListener::SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionar
 				maxTs = client->GetTimestamp();
 		}
 
+		size_t highWaterMark = GetMaxQueuedMessages();
+
 		for (const JsonRpcConnection::Ptr& client : endpoint->GetClients()) {
 			if (client->GetTimestamp() != maxTs)
 				continue;
 
+			if (client->ExceedsHighWaterMark(highWaterMark)) {
+				sent = false;
+				continue;
+			}
+
 			client->SendMessage(message);
 		}
 	}
+
+	return sent;
+}
+
+/**
+ * Process a received message in one of the message lanes, one thread each.
+ * Messages with the same key are processed in the order they were dispatched.
+ *
+ * @param key Usually the host the message concerns
+ * @param handler Processes the message
+ */
+void ApiListener::DispatchMessage(const String& key, std::function<void ()> handler)
+{
+	auto& lane (m_MessageLanes[Utility::SDBM(key) % m_MessageLanes.size()]);
+
+	lane->Enqueue(std::move(handler));
+}
+
+/**
+ * Determine the zones (and their endpoints) RelayMessageOne() relays a message for the target zone to.
+ *
+ * Only relay the message to a) the same local zone, b) the parent zone and c) direct child zones.
+ * Exception is a global zone which the message has to be relayed to our local zone and direct children for.
+ *
+ * @param targetZone The zone to relay to
+ * @param localZone The local zone
+ * @param localEndpoint The local endpoint
+ * @return The zones to relay to, empty if none
+ */
+static RelayRoutes GetRelayRoutes(const Zone::Ptr& targetZone, const Zone::Ptr& localZone, const Endpoint::Ptr& localEndpoint)
+{
+	std::unique_lock<std::mutex> lock (l_RelayRoutesMutex);
+	auto& routes (l_RelayRoutes[targetZone]);
+
+	if (routes)
+		return routes;
+
+	std::vector<RelayRoute> newRoutes;
+
+	auto addRoute ([&newRoutes, &localEndpoint](const Zone::Ptr& zone) {
+		RelayRoute route;
+		route.TargetZone = zone;
+
+		for (const Endpoint::Ptr& endpoint : zone->GetEndpoints()) {
+			/* Don't relay messages to ourselves. */
+			if (endpoint != localEndpoint)
+				route.Endpoints.push_back(endpoint);
+		}
+
+		newRoutes.emplace_back(std::move(route));
+	});
+
+	if (targetZone->GetGlobal()) {
+		addRoute(localZone);
+
+		for (const Zone::Ptr& zone : ConfigType::GetObjectsByType<Zone>()) {
+			if (zone->GetParent() == localZone) {
+				addRoute(zone);
+			}
+		}
+	} else if (targetZone == localZone || targetZone == localZone->GetParent() || targetZone->GetParent() == localZone) {
+		addRoute(targetZone);
+	}
+
+	routes = std::make_shared<const std::vector<RelayRoute>>(std::move(newRoutes));
+
+	return routes;
 }
 
 /**
@@ -1102,48 +1448,26 @@ void ApiListener::SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionar
  * @return true if the message has been relayed to all relevant endpoints,
  *         false if it hasn't and must be persisted in the replay log
  */
-bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrigin::Ptr& origin, const Dictionary::Ptr& message, const Endpoint::Ptr& currentZoneMaster)
+bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrigin::Ptr& origin, const JsonRpcSharedMessage::Ptr& message, const Endpoint::Ptr& currentZoneMaster)
 {
 	ASSERT(targetZone);
 
 	Zone::Ptr localZone = Zone::GetLocalZone();
+	Endpoint::Ptr localEndpoint = GetLocalEndpoint();
+	RelayRoutes routes = GetRelayRoutes(targetZone, localZone, localEndpoint);
 
-	/* only relay the message to a) the same local zone, b) the parent zone and c) direct child zones. Exception is a global zone. */
-	if (!targetZone->GetGlobal() &&
-		targetZone != localZone &&
-		targetZone != localZone->GetParent() &&
-		targetZone->GetParent() != localZone) {
+	if (routes->empty())
 		return true;
-	}
-
-	Endpoint::Ptr localEndpoint = GetLocalEndpoint();
 
 	std::vector<Endpoint::Ptr> skippedEndpoints;
 
-	std::set<Zone::Ptr> allTargetZones;
-	if (targetZone->GetGlobal()) {
-		/* if the zone is global, the message has to be relayed to our local zone and direct children */
-		allTargetZones.insert(localZone);
-		for (const Zone::Ptr& zone : ConfigType::GetObjectsByType<Zone>()) {
-			if (zone->GetParent() == localZone) {
-				allTargetZones.insert(zone);
-			}
-		}
-	} else {
-		/* whereas if it's not global, the message is just relayed to the zone itself */
-		allTargetZones.insert(targetZone);
-	}
-
 	bool needsReplay = false;
 
-	for (const Zone::Ptr& currentTargetZone : allTargetZones) {
+	for (const RelayRoute& route : *routes) {
+		const Zone::Ptr& currentTargetZone (route.TargetZone);
 		bool relayed = false, log_needed = false, log_done = false;
 
-		for (const Endpoint::Ptr& targetEndpoint : currentTargetZone->GetEndpoints()) {
-			/* Don't relay messages to ourselves. */
-			if (targetEndpoint == localEndpoint)
-				continue;
-
+		for (const Endpoint::Ptr& targetEndpoint : route.Endpoints) {
 			log_needed = true;
 
 			/* Don't relay messages to disconnected endpoints. */
@@ -1196,7 +1520,10 @@ bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrig
 
 			relayed = true;
 
-			SyncSendMessage(targetEndpoint, message);
+			/* The endpoint is too slow and gets disconnected, replay the message after it reconnected. */
+			if (!SyncSendMessage(targetEndpoint, message)) {
+				needsReplay = true;
+			}
 		}
 
 		if (log_needed && !log_done) {
@@ -1205,7 +1532,7 @@ bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrig
 	}
 
 	if (!skippedEndpoints.empty()) {
-		double ts = message->Get("ts");
+		double ts = message->GetMessage()->Get("ts");
 
 		for (const Endpoint::Ptr& skippedEndpoint : skippedEndpoints)
 			skippedEndpoint->SetLocalLogPosition(ts);
@@ -1215,7 +1542,7 @@ bool ApiListener::RelayMessageOne(const Zone::Ptr& targetZone, const MessageOrig
 }
 
 void ApiListener::SyncRelayMessage(const MessageOrigin::Ptr& origin,
-	const ConfigObject::Ptr& secobj, const Dictionary::Ptr& message, bool log)
+	const ConfigObject::Ptr& secobj, const Dictionary::Ptr& message, bool log, const Dictionary::Ptr& compactMessage)
 {
 	double ts = Utility::GetTime();
 	message->Set("ts", ts);
@@ -1226,6 +1553,13 @@ void ApiListener::SyncRelayMessage(const MessageOrigin::Ptr& origin,
 	if (origin && origin->FromZone)
 		message->Set("originZone", origin->FromZone->GetName());
 
+	if (compactMessage) {
+		compactMessage->Set("ts", ts);
+
+		if (origin && origin->FromZone)
+			compactMessage->Set("originZone", origin->FromZone->GetName());
+	}
+
 	Zone::Ptr target_zone;
 
 	if (secobj) {
@@ -1240,15 +1574,22 @@ void ApiListener::SyncRelayMessage(const MessageOrigin::Ptr& origin,
 
 	Endpoint::Ptr master = GetMaster();
 
-	bool need_log = !RelayMessageOne(target_zone, origin, message, master);
+	/* Encoded at most once per format, no matter to how many endpoints it's relayed. */
+	JsonRpcSharedMessage::Ptr sharedMessage = new JsonRpcSharedMessage(message, compactMessage);
+
+	bool need_log = !RelayMessageOne(target_zone, origin, sharedMessage, master);
 
 	for (const Zone::Ptr& zone : target_zone->GetAllParentsRaw()) {
-		if (!RelayMessageOne(zone, origin, message, master))
+		if (!RelayMessageOne(zone, origin, sharedMessage, master))
 			need_log = true;
 	}
 
-	if (log && need_log)
-		PersistMessage(message, secobj);
+	/* A connection which exceeds max_queued_messages is disconnected together with all messages
+	 * still queued for it, even the ones relayed successfully. So all of them have to be in the
+	 * replay log, unless the limit is disabled.
+	 */
+	if (log && (need_log || GetMaxQueuedMessages() > 0))
+		PersistMessage(sharedMessage, secobj);
 }
 
 /* must hold m_LogLock */
@@ -1266,8 +1607,14 @@ void ApiListener::OpenLogFile()
 		return;
 	}
 
+	fp->seekp(0, std::ios_base::end);
+
+	std::streamoff size = fp->tellp();
+
 	m_LogFile = new StdioStream(fp, true);
 	m_LogMessageCount = 0;
+	m_LogFileSize = size > 0 ? size : 0;
+	m_LogIndex.Open(path + ".idx", m_LogFileSize);
 	SetLogMessageTimestamp(Utility::GetTime());
 }
 
@@ -1279,6 +1626,7 @@ void ApiListener::CloseLogFile()
 
 	m_LogFile->Close();
 	m_LogFile.reset();
+	m_LogIndex.Close();
 }
 
 /* must hold m_LogLock */
@@ -1301,6 +1649,21 @@ void ApiListener::RotateLogFile()
 			Log(LogCritical, "ApiListener")
 				<< "Cannot rotate replay log file from '" << oldpath << "' to '"
 				<< newpath << "': " << ex.what();
+
+			return;
+		}
+
+		/* An index not matching its segment is worse than none. */
+		if (Utility::PathExists(oldpath + ".idx")) {
+			try {
+				Utility::RenameFile(oldpath + ".idx", newpath + ".idx");
+			} catch (const std::exception& ex) {
+				Log(LogWarning, "ApiListener")
+					<< "Cannot rotate replay log index from '" << oldpath << ".idx' to '"
+					<< newpath << ".idx': " << ex.what();
+
+				(void)unlink((oldpath + ".idx").CStr());
+			}
 		}
 	}
 }
@@ -1351,6 +1714,40 @@ void ApiListener::ReplayLog(const JsonRpcConnection::Ptr& client)
 		return;
 	}
 
+	double snapshotAfter = GetReplayLogSnapshotAfter();
+
+	/* The log only grows with the outage, the snapshot only with the objects. */
+	if (snapshotAfter > 0 && Utility::GetTime() - peer_ts > snapshotAfter) {
+		double snapshotTs = Utility::GetTime();
+		size_t snapshotCount = 0;
+
+		try {
+			snapshotCount = ReplayLogSnapshot::Create(target_zone, peer_ts, [&client](const Dictionary::Ptr& message) {
+				client->SendMessage(message);
+			});
+		} catch (const std::exception& ex) {
+			Log(LogWarning, "ApiListener")
+				<< "Error while sending state snapshot to endpoint '" << endpoint->GetName() << "': " << DiagnosticInformation(ex, false);
+
+			return;
+		}
+
+		peer_ts = snapshotTs;
+		logpos_ts = snapshotTs;
+
+		client->SendMessage(new Dictionary({
+			{ "jsonrpc", "2.0" },
+			{ "method", "log::SetLogPosition" },
+			{ "params", new Dictionary({
+				{ "log_position", logpos_ts }
+			}) }
+		}));
+
+		Log(LogInformation, "ApiListener")
+			<< "Sent state snapshot of " << snapshotCount << " messages to endpoint '" << endpoint->GetName()
+			<< "', replaying the log from " << Utility::FormatDateTime("%Y-%m-%d %H:%M:%S %z", snapshotTs) << ".";
+	}
+
 	for (;;) {
 		std::unique_lock<std::mutex> lock(m_LogLock);
 
@@ -1379,82 +1776,138 @@ void ApiListener::ReplayLog(const JsonRpcConnection::Ptr& client)
 
 		allFiles.emplace_back(Utility::GetTime() + 1, GetApiDir() + "log/current");
 
-		for (auto& file : allFiles) {
-			Log(LogNotice, "ApiListener")
-				<< "Replaying log: " << file.second;
+		/* Calls the callback for each message to be replayed with its position (segment and offset). */
+		auto forEachMessage ([&allFiles, &peer_ts, &target_zone](bool logProgress,
+			const std::function<bool (const Dictionary::Ptr&, uint_fast64_t, const std::pair<int, String>&)>& callback) {
+			for (size_t i = 0; i < allFiles.size(); i++) {
+				auto& file (allFiles[i]);
+				ReplayLogIndex index;
+				index.Load(file.second + ".idx");
+
+				if (!index.MayConcern(target_zone)) {
+					if (logProgress) {
+						Log(LogNotice, "ApiListener")
+							<< "Skipping log not relevant for zone '" << target_zone->GetName() << "': " << file.second;
+					}
 
-			auto *fp = new std::fstream(file.second.CStr(), std::fstream::in | std::fstream::binary);
-			StdioStream::Ptr logStream = new StdioStream(fp, true);
+					continue;
+				}
 
-			String message;
-			StreamReadContext src;
-			while (true) {
-				Dictionary::Ptr pmessage;
+				ReplayLogSegment segment (file.second);
+				uint_fast64_t offset = index.Seek(peer_ts);
 
-				try {
-					StreamReadStatus srs = NetString::ReadStringFromStream(logStream, &message, src);
+				if (logProgress) {
+					Log(LogNotice, "ApiListener")
+						<< "Replaying log: " << file.second << " from offset " << offset << " of " << segment.GetSize();
+				}
 
-					if (srs == StatusEof)
+				String message;
+				while (true) {
+					Dictionary::Ptr pmessage;
+					uint_fast64_t position = static_cast<uint_fast64_t>(i) << 40u | offset;
+
+					try {
+						if (!segment.ReadMessage(offset, message))
+							break;
+
+						pmessage = JsonDecode(message);
+					} catch (const std::exception&) {
+						if (logProgress) {
+							Log(LogWarning, "ApiListener")
+								<< "Unexpected end-of-file for cluster log: " << file.second;
+						}
+
+						/* Log files may be incomplete or corrupted. This is perfectly OK. */
 						break;
+					}
 
-					if (srs != StatusNewItem)
+					if (pmessage->Get("timestamp") <= peer_ts)
 						continue;
 
-					pmessage = JsonDecode(message);
-				} catch (const std::exception&) {
-					Log(LogWarning, "ApiListener")
-						<< "Unexpected end-of-file for cluster log: " << file.second;
+					Dictionary::Ptr secname = pmessage->Get("secobj");
 
-					/* Log files may be incomplete or corrupted. This is perfectly OK. */
-					break;
+					if (secname) {
+						ConfigObject::Ptr secobj = ConfigObject::GetObject(secname->Get("type"), secname->Get("name"));
+
+						if (!secobj)
+							continue;
+
+						if (!target_zone->CanAccessObject(secobj))
+							continue;
+					}
+
+					if (!callback(pmessage, position, file))
+						break;
 				}
+			}
+		});
 
-				if (pmessage->Get("timestamp") <= peer_ts)
-					continue;
+		/* Segments written by older versions don't have the method next to the message. */
+		auto getMethod ([](const Dictionary::Ptr& pmessage) -> String {
+			Value method;
 
-				Dictionary::Ptr secname = pmessage->Get("secobj");
+			if (pmessage->Get("method", &method))
+				return method;
 
-				if (secname) {
-					ConfigObject::Ptr secobj = ConfigObject::GetObject(secname->Get("type"), secname->Get("name"));
 
-					if (!secobj)
-						continue;
+			Dictionary::Ptr message = JsonDecode(pmessage->Get("message"));
+			return message->Get("method");
+		});
 
-					if (!target_zone->CanAccessObject(secobj))
-						continue;
-				}
+		std::unique_ptr<ReplayLogCompaction> compaction;
 
-				try  {
-					client->SendRawMessage(pmessage->Get("message"));
-					count++;
-				} catch (const std::exception& ex) {
-					Log(LogWarning, "ApiListener")
-						<< "Error while replaying log for endpoint '" << endpoint->GetName() << "': " << DiagnosticInformation(ex, false);
+		if (GetReplayLogCompaction()) {
+			compaction.reset(new ReplayLogCompaction());
 
-					Log(LogDebug, "ApiListener")
-						<< "Error while replaying log for endpoint '" << endpoint->GetName() << "': " << DiagnosticInformation(ex);
+			forEachMessage(false, [&compaction, &getMethod](const Dictionary::Ptr& pmessage, uint_fast64_t position, const std::pair<int, String>&) {
+				if (ReplayLogCompaction::IsCompactable(getMethod(pmessage)))
+					compaction->Add(JsonDecode(pmessage->Get("message")), position);
 
-					break;
-				}
+				return true;
+			});
+		}
 
+		forEachMessage(true, [&](const Dictionary::Ptr& pmessage, uint_fast64_t position, const std::pair<int, String>& file) {
+			if (compaction && !compaction->ShouldReplay(getMethod(pmessage), position)) {
 				peer_ts = pmessage->Get("timestamp");
+				return true;
+			}
 
-				if (file.first > logpos_ts + 10) {
-					logpos_ts = file.first;
+			try  {
+				client->SendRawMessage(pmessage->Get("message"));
+				count++;
+			} catch (const std::exception& ex) {
+				Log(LogWarning, "ApiListener")
+					<< "Error while replaying log for endpoint '" << endpoint->GetName() << "': " << DiagnosticInformation(ex, false);
 
-					Dictionary::Ptr lmessage = new Dictionary({
-						{ "jsonrpc", "2.0" },
-						{ "method", "log::SetLogPosition" },
-						{ "params", new Dictionary({
-							{ "log_position", logpos_ts }
-						}) }
-					});
+				Log(LogDebug, "ApiListener")
+					<< "Error while replaying log for endpoint '" << endpoint->GetName() << "': " << DiagnosticInformation(ex);
 
-					client->SendMessage(lmessage);
-				}
+				return false;
+			}
+
+			peer_ts = pmessage->Get("timestamp");
+
+			if (file.first > logpos_ts + 10) {
+				logpos_ts = file.first;
+
+				Dictionary::Ptr lmessage = new Dictionary({
+					{ "jsonrpc", "2.0" },
+					{ "method", "log::SetLogPosition" },
+					{ "params", new Dictionary({
+						{ "log_position", logpos_ts }
+					}) }
+				});
+
+				client->SendMessage(lmessage);
 			}
 
-			logStream->Close();
+			return true;
+		});
+
+		if (compaction && compaction->GetSuperseded() > 0) {
+			Log(LogInformation, "ApiListener")
+				<< "Skipped " << compaction->GetSuperseded() << " superseded messages while replaying the log.";
 		}
 
 		if (count > 0) {
@@ -1571,9 +2024,74 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus()
 	size_t httpClients = GetHttpClients().size();
 	size_t syncQueueItems = m_SyncQueue.GetLength();
 	size_t relayQueueItems = m_RelayQueue.GetLength();
+	size_t messageLaneItems = 0;
+	ArrayData messageLanes;
+
+	for (auto& lane : m_MessageLanes) {
+		size_t items = lane->GetLength();
+
+		messageLaneItems += items;
+		messageLanes.emplace_back(items);
+	}
+
 	double workQueueItemRate = JsonRpcConnection::GetWorkQueueRate();
 	double syncQueueItemRate = m_SyncQueue.GetTaskCount(60) / 60.0;
 	double relayQueueItemRate = m_RelayQueue.GetTaskCount(60) / 60.0;
+	double compressionRatio = JsonRpcCompression::GetRatio();
+	double compressionCpuTime = JsonRpcCompression::GetCpuTime();
+	double droppedEvents = EventsInbox::GetDroppedEvents();
+	double overflowedEventStreams = EventsInbox::GetOverflowedInboxes();
+
+	double now = Utility::GetTime();
+	int tlsHandshakes = m_TlsHandshakes.UpdateAndGetValues(now, 60);
+	double tlsHandshakeRate = tlsHandshakes / 60.0;
+	double tlsResumedHandshakeRate = m_TlsResumedHandshakes.UpdateAndGetValues(now, 60) / 60.0;
+	double tlsHandshakeLatency = tlsHandshakes ? m_TlsHandshakeMilliseconds.UpdateAndGetValues(now, 60) / 1000.0 / tlsHandshakes : 0;
+	size_t tlsHandshakesWaiting;
+
+	Dictionary::Ptr cpuBoundWork = new Dictionary();
+	auto& ioEngine (IoEngine::Get());
+
+	for (auto& priority : std::vector<std::pair<CpuBoundWorkPriority, String>>{
+		{ CpuBoundWorkCluster, "cluster" }, { CpuBoundWorkCheckResult, "check_result" },
+		{ CpuBoundWorkApiRead, "api_read" }, { CpuBoundWorkApiWrite, "api_write" }
+	}) {
+		CpuBoundWorkStats stats = ioEngine.GetCpuBoundWorkStats(priority.first);
+
+		cpuBoundWork->Set(priority.second, new Dictionary({
+			{ "acquired", static_cast<double>(stats.Acquired) },
+			{ "wait_time", stats.WaitTime }
+		}));
+
+		perfdata->Set("cpu_bound_work_" + priority.second + "_acquired", static_cast<double>(stats.Acquired));
+		perfdata->Set("cpu_bound_work_" + priority.second + "_wait_time", stats.WaitTime);
+	}
+
+	{
+		std::unique_lock<std::mutex> lock (m_TlsHandshakeSlotsMutex);
+		tlsHandshakesWaiting = m_TlsHandshakeWaiters.size();
+	}
+
+	Dictionary::Ptr runtimeObjectSyncs = new Dictionary();
+	size_t runtimeObjectSyncsRunning = 0;
+
+	{
+		std::unique_lock<std::mutex> lock (m_RuntimeObjectSyncMutex);
+
+		for (auto& sync : m_RuntimeObjectSyncs) {
+			if (sync.second.EndTime == 0)
+				runtimeObjectSyncsRunning++;
+
+			runtimeObjectSyncs->Set(sync.first, new Dictionary({
+				{ "state", sync.second.State },
+				{ "start_time", sync.second.StartTime },
+				{ "end_time", sync.second.EndTime },
+				{ "total", sync.second.Total },
+				{ "sent", sync.second.Sent },
+				{ "skipped", sync.second.Skipped }
+			}));
+		}
+	}
 
 	Dictionary::Ptr status = new Dictionary({
 		{ "identity", GetIdentity() },
@@ -1589,13 +2107,33 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus()
 			{ "anonymous_clients", jsonRpcAnonymousClients },
 			{ "sync_queue_items", syncQueueItems },
 			{ "relay_queue_items", relayQueueItems },
+			{ "message_lane_items", new Array(std::move(messageLanes)) },
 			{ "work_queue_item_rate", workQueueItemRate },
 			{ "sync_queue_item_rate", syncQueueItemRate },
-			{ "relay_queue_item_rate", relayQueueItemRate }
+			{ "relay_queue_item_rate", relayQueueItemRate },
+			{ "compression_ratio", compressionRatio },
+			{ "compression_cpu_time", compressionCpuTime }
 		}) },
 
 		{ "http", new Dictionary({
-			{ "clients", httpClients }
+			{ "clients", httpClients },
+			{ "dropped_events", droppedEvents },
+			{ "overflowed_event_streams", overflowedEventStreams }
+		}) },
+
+		{ "cpu_bound_work", cpuBoundWork },
+
+		{ "runtime_object_sync", new Dictionary({
+			{ "running", runtimeObjectSyncsRunning },
+			{ "queue_items", m_RuntimeObjectSyncQueue.GetLength() },
+			{ "endpoints", runtimeObjectSyncs }
+		}) },
+
+		{ "tls", new Dictionary({
+			{ "handshake_rate", tlsHandshakeRate },
+			{ "resumed_handshake_rate", tlsResumedHandshakeRate },
+			{ "handshake_latency", tlsHandshakeLatency },
+			{ "handshakes_waiting", tlsHandshakesWaiting }
 		}) }
 	});
 
@@ -1606,13 +2144,25 @@ std::pair<Dictionary::Ptr, Dictionary::Ptr> ApiListener::GetStatus()
 
 	perfdata->Set("num_json_rpc_anonymous_clients", jsonRpcAnonymousClients);
 	perfdata->Set("num_http_clients", httpClients);
+	perfdata->Set("num_http_dropped_events", droppedEvents);
+	perfdata->Set("num_http_overflowed_event_streams", overflowedEventStreams);
 	perfdata->Set("num_json_rpc_sync_queue_items", syncQueueItems);
 	perfdata->Set("num_json_rpc_relay_queue_items", relayQueueItems);
+	perfdata->Set("num_json_rpc_message_lane_items", messageLaneItems);
+	perfdata->Set("num_runtime_object_syncs_running", runtimeObjectSyncsRunning);
 
 	perfdata->Set("num_json_rpc_work_queue_item_rate", workQueueItemRate);
 	perfdata->Set("num_json_rpc_sync_queue_item_rate", syncQueueItemRate);
 	perfdata->Set("num_json_rpc_relay_queue_item_rate", relayQueueItemRate);
 
+	perfdata->Set("json_rpc_compression_ratio", compressionRatio);
+	perfdata->Set("json_rpc_compression_cpu_time", compressionCpuTime);
+
+	perfdata->Set("tls_handshake_rate", tlsHandshakeRate);
+	perfdata->Set("tls_resumed_handshake_rate", tlsResumedHandshakeRate);
+	perfdata->Set("tls_handshake_latency", tlsHandshakeLatency);
+	perfdata->Set("num_tls_handshakes_waiting", tlsHandshakesWaiting);
+
 	return std::make_pair(status, perfdata);
 }
 
@@ -1679,13 +2229,65 @@ Value ApiListener::HelloAPIHandler(const MessageOrigin::Ptr& origin, const Dicti
 		auto client (origin->FromClient);
 
 		if (client) {
+			auto capabilities ((uint_fast64_t)(double)params->Get("capabilities"));
+
+			/* Peers which don't know about the binary format keep getting JSON. */
+			client->SetBinaryMessages(capabilities & (uint_fast64_t)ApiCapabilities::BinaryMessages);
+
+			/* Both sides have to opt in, see GetMyCapabilities(). */
+			if (capabilities & (uint_fast64_t)ApiCapabilities::CompactCheckResults) {
+				ApiListener::Ptr listener = ApiListener::GetInstance();
+
+				if (listener && listener->GetCompactCheckResults()) {
+					client->SetCompactMessages(true);
+				}
+			}
+
+			/* Both sides have to opt in, see GetMyCapabilities(). */
+			if (capabilities & (uint_fast64_t)ApiCapabilities::Compression) {
+				ApiListener::Ptr listener = ApiListener::GetInstance();
+
+				if (listener && listener->GetCompression()) {
+					client->EnableCompression();
+				}
+			}
+
 			auto endpoint (client->GetEndpoint());
 
 			if (endpoint) {
 				unsigned long nodeVersion = params->Get("version");
 
+				/* SyncClient() relied on the capabilities of the previous connection. If the
+				 * peer was downgraded meanwhile, it won't request a delta config sync.
+				 */
+				auto deltaSync ((uint_fast64_t)ApiCapabilities::ConfigDeltaSync);
+
+				if ((endpoint->GetCapabilities() & deltaSync) && !(capabilities & deltaSync)) {
+					ApiListener::Ptr listener = ApiListener::GetInstance();
+
+					if (listener) {
+						Utility::QueueAsyncCallback([listener, client]() {
+							listener->SendConfigUpdate(client);
+						});
+					}
+				}
+
+				/* Likewise, if the peer was upgraded meanwhile, it waits for our runtime object versions. */
+				auto runtimeObjectBatches ((uint_fast64_t)ApiCapabilities::RuntimeObjectBatches);
+
+				if (!(endpoint->GetCapabilities() & runtimeObjectBatches) && (capabilities & runtimeObjectBatches)
+					&& Zone::GetLocalZone()->IsChildOf(endpoint->GetZone())) {
+					ApiListener::Ptr listener = ApiListener::GetInstance();
+
+					if (listener) {
+						Utility::QueueAsyncCallback([listener, client]() {
+							listener->SendRuntimeObjectVersions(client);
+						});
+					}
+				}
+
 				endpoint->SetIcingaVersion(nodeVersion);
-				endpoint->SetCapabilities((double)params->Get("capabilities"));
+				endpoint->SetCapabilities(capabilities);
 
 				if (nodeVersion == 0u) {
 					nodeVersion = 21200;
@@ -1817,6 +2419,46 @@ void ApiListener::ValidateTlsHandshakeTimeout(const Lazy<double>& lvalue, const
 		BOOST_THROW_EXCEPTION(ValidationError(this, { "tls_handshake_timeout" }, "Value must be greater than 0."));
 }
 
+void ApiListener::ValidateCompression(const Lazy<bool>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ApiListener>::ValidateCompression(lvalue, utils);
+
+	if (lvalue() && !JsonRpcCompression::IsSupported())
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "compression" }, "Icinga 2 was built without zlib support."));
+}
+
+void ApiListener::ValidateMaxQueuedMessages(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ApiListener>::ValidateMaxQueuedMessages(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "max_queued_messages" }, "Value must not be negative."));
+}
+
+void ApiListener::ValidateMaxConcurrentTlsHandshakes(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ApiListener>::ValidateMaxConcurrentTlsHandshakes(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "max_concurrent_tls_handshakes" }, "Value must not be negative."));
+}
+
+void ApiListener::ValidateMaxQueuedEvents(const Lazy<int>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ApiListener>::ValidateMaxQueuedEvents(lvalue, utils);
+
+	if (lvalue() < 0)
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "max_queued_events" }, "Value must not be negative."));
+}
+
+void ApiListener::ValidateQueuedEventsOverflow(const Lazy<String>& lvalue, const ValidationUtils& utils)
+{
+	ObjectImpl<ApiListener>::ValidateQueuedEventsOverflow(lvalue, utils);
+
+	if (lvalue() != "drop" && lvalue() != "disconnect")
+		BOOST_THROW_EXCEPTION(ValidationError(this, { "queued_events_overflow" }, "Value must be 'drop' or 'disconnect'."));
+}
+
 bool ApiListener::IsHACluster()
 {
 	Zone::Ptr zone = Zone::GetLocalZone();
@@ -7,9 +7,11 @@
 #include "remote/jsonrpcconnection.hpp"
 #include "remote/httpserverconnection.hpp"
 #include "remote/endpoint.hpp"
+#include "remote/replaylog.hpp"
 #include "remote/messageorigin.hpp"
 #include "base/configobject.hpp"
 #include "base/process.hpp"
+#include "base/ringbuffer.hpp"
 #include "base/shared.hpp"
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
@@ -21,9 +23,16 @@
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/spawn.hpp>
 #include <boost/asio/ssl/context.hpp>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <set>
+#include <vector>
+#include <sys/stat.h>
 
 namespace icinga
 {
@@ -66,7 +75,14 @@ struct ConfigDirInformation
  */
 enum class ApiCapabilities : uint_fast64_t
 {
-	ExecuteArbitraryCommand = 1u
+	ExecuteArbitraryCommand = 1u,
+	BinaryMessages = 1u << 1u,
+	Compression = 1u << 2u,
+	ConfigDeltaSync = 1u << 3u,
+	RendezvousAuthority = 1u << 4u,
+	CompactCheckResults = 1u << 5u,
+	MessageBatches = 1u << 6u,
+	RuntimeObjectBatches = 1u << 7u
 };
 
 /**
@@ -98,8 +114,12 @@ public:
 
 	Endpoint::Ptr GetLocalEndpoint() const;
 
-	void SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message);
-	void RelayMessage(const MessageOrigin::Ptr& origin, const ConfigObject::Ptr& secobj, const Dictionary::Ptr& message, bool log);
+	bool SyncSendMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message);
+	bool SyncSendMessage(const Endpoint::Ptr& endpoint, const JsonRpcSharedMessage::Ptr& message);
+	void SendBatchedMessage(const Endpoint::Ptr& endpoint, const Dictionary::Ptr& message);
+	void DispatchMessage(const String& key, std::function<void ()> handler);
+	void RelayMessage(const MessageOrigin::Ptr& origin, const ConfigObject::Ptr& secobj, const Dictionary::Ptr& message, bool log,
+		const Dictionary::Ptr& compactMessage = nullptr);
 
 	static void StatsFunc(const Dictionary::Ptr& status, const Array::Ptr& perfdata);
 	std::pair<Dictionary::Ptr, Dictionary::Ptr> GetStatus();
@@ -117,6 +137,7 @@ public:
 	/* filesync */
 	static Value ConfigUpdateHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 	void HandleConfigUpdate(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
+	static Value ConfigChecksumsHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 
 	/* configsync */
 	static void ConfigUpdateObjectHandler(const ConfigObject::Ptr& object, const Value& cookie);
@@ -131,6 +152,10 @@ public:
 	static Value HelloAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 
 	static void UpdateObjectAuthority();
+	static void UpdateAuthorityLoad();
+	static Value AuthorityLoadAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
+	static Value MessageBatchAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
+	static Value ConfigRuntimeObjectVersionsAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 
 	static bool IsHACluster();
 	static String GetFromZoneName(const Zone::Ptr& fromZone);
@@ -156,10 +181,17 @@ protected:
 
 	void ValidateTlsProtocolmin(const Lazy<String>& lvalue, const ValidationUtils& utils) override;
 	void ValidateTlsHandshakeTimeout(const Lazy<double>& lvalue, const ValidationUtils& utils) override;
+	void ValidateMaxConcurrentTlsHandshakes(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateCompression(const Lazy<bool>& lvalue, const ValidationUtils& utils) override;
+	void ValidateMaxQueuedMessages(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateMaxQueuedEvents(const Lazy<int>& lvalue, const ValidationUtils& utils) override;
+	void ValidateQueuedEventsOverflow(const Lazy<String>& lvalue, const ValidationUtils& utils) override;
 
 private:
 	Shared<boost::asio::ssl::context>::Ptr m_SSLContext;
 
+	uint_fast64_t GetMyCapabilities();
+
 	mutable std::mutex m_AnonymousClientsLock;
 	mutable std::mutex m_HttpClientsLock;
 	std::set<JsonRpcConnection::Ptr> m_AnonymousClients;
@@ -168,6 +200,8 @@ private:
 	Timer::Ptr m_Timer;
 	Timer::Ptr m_ReconnectTimer;
 	Timer::Ptr m_AuthorityTimer;
+	Timer::Ptr m_AuthorityLoadTimer;
+	Timer::Ptr m_MessageBatchTimer;
 	Timer::Ptr m_CleanupCertificateRequestsTimer;
 	Timer::Ptr m_ApiPackageIntegrityTimer;
 
@@ -194,16 +228,39 @@ private:
 	);
 	void ListenerCoroutineProc(boost::asio::yield_context yc, const Shared<boost::asio::ip::tcp::acceptor>::Ptr& server, const Shared<boost::asio::ssl::context>::Ptr& sslContext);
 
+	void AcquireTlsHandshakeSlot(boost::asio::yield_context yc, const Shared<boost::asio::io_context::strand>::Ptr& strand);
+	void ReleaseTlsHandshakeSlot();
+
+	/* Incoming handshakes beyond max_concurrent_tls_handshakes wait here for a slot. */
+	std::mutex m_TlsHandshakeSlotsMutex;
+	int m_TlsHandshakesInProgress{0};
+	std::deque<std::pair<Shared<boost::asio::io_context::strand>::Ptr, AsioConditionVariable*>> m_TlsHandshakeWaiters;
+
+	RingBuffer m_TlsHandshakes{15 * 60};
+	RingBuffer m_TlsResumedHandshakes{15 * 60};
+	RingBuffer m_TlsHandshakeMilliseconds{15 * 60};
+
 	WorkQueue m_RelayQueue;
 	WorkQueue m_SyncQueue{0, 4};
+	std::vector<std::unique_ptr<WorkQueue>> m_MessageLanes;
+
+	/* Messages waiting for the next FlushMessageBatches(), see SendBatchedMessage(). */
+	std::mutex m_MessageBatchesMutex;
+	std::map<Endpoint::Ptr, ArrayData> m_MessageBatches;
 
 	std::mutex m_LogLock;
 	Stream::Ptr m_LogFile;
 	size_t m_LogMessageCount{0};
+	uint_fast64_t m_LogFileSize{0};
+	ReplayLogIndexWriter m_LogIndex;
+
+	bool RelayMessageOne(const Zone::Ptr& zone, const MessageOrigin::Ptr& origin, const JsonRpcSharedMessage::Ptr& message, const Endpoint::Ptr& currentZoneMaster);
+	void SyncRelayMessage(const MessageOrigin::Ptr& origin, const ConfigObject::Ptr& secobj, const Dictionary::Ptr& message, bool log,
+		const Dictionary::Ptr& compactMessage = nullptr);
+	void PersistMessage(const JsonRpcSharedMessage::Ptr& message, const ConfigObject::Ptr& secobj);
 
-	bool RelayMessageOne(const Zone::Ptr& zone, const MessageOrigin::Ptr& origin, const Dictionary::Ptr& message, const Endpoint::Ptr& currentZoneMaster);
-	void SyncRelayMessage(const MessageOrigin::Ptr& origin, const ConfigObject::Ptr& secobj, const Dictionary::Ptr& message, bool log);
-	void PersistMessage(const Dictionary::Ptr& message, const ConfigObject::Ptr& secobj);
+	void FlushMessageBatches();
+	void SendMessageBatch(const Endpoint::Ptr& endpoint, ArrayData messages);
 
 	void OpenLogFile();
 	void RotateLogFile();
@@ -222,7 +279,9 @@ private:
 	void SyncLocalZoneDirs() const;
 	void SyncLocalZoneDir(const Zone::Ptr& zone) const;
 
-	void SendConfigUpdate(const JsonRpcConnection::Ptr& aclient);
+	void SendConfigUpdate(const JsonRpcConnection::Ptr& aclient, const Dictionary::Ptr& peerChecksums = nullptr);
+	void SendConfigChecksums(const JsonRpcConnection::Ptr& aclient, bool requestFullUpdate = false);
+	static bool CompleteConfigDelta(const ConfigDirInformation& productionConfig, ConfigDirInformation& newConfig);
 
 	static Dictionary::Ptr MergeConfigUpdate(const ConfigDirInformation& config);
 
@@ -232,6 +291,7 @@ private:
 	static void TryActivateZonesStage(const std::vector<String>& relativePaths);
 
 	static String GetChecksum(const String& content);
+	static String GetFileChecksum(const String& file, const struct stat& st, const String& content);
 	static bool CheckConfigChange(const ConfigDirInformation& oldConfig, const ConfigDirInformation& newConfig);
 
 	void UpdateLastFailedZonesStageValidation(const String& log);
@@ -243,6 +303,41 @@ private:
 	void DeleteConfigObject(const ConfigObject::Ptr& object, const MessageOrigin::Ptr& origin,
 		const JsonRpcConnection::Ptr& client = nullptr);
 	void SendRuntimeConfigObjects(const JsonRpcConnection::Ptr& aclient);
+	void SendRuntimeObjectVersions(const JsonRpcConnection::Ptr& aclient);
+
+	static Dictionary::Ptr GetConfigObjectParams(const ConfigObject::Ptr& object);
+
+	/* What a peer told us about the runtime objects it already has, see config::RuntimeObjectVersions. */
+	struct PeerRuntimeObjects
+	{
+		Dictionary::Ptr Versions{new Dictionary()};
+		bool AcceptConfig{true};
+		bool Complete{false};
+	};
+
+	/* Progress of a runtime object sync, see GetStatus(). */
+	struct RuntimeObjectSync
+	{
+		String State;
+		double StartTime{0};
+		double EndTime{0};
+		size_t Total{0};
+		size_t Sent{0};
+		size_t Skipped{0};
+	};
+
+	void StreamRuntimeConfigObjects(const JsonRpcConnection::Ptr& aclient, const Dictionary::Ptr& peerVersions, RuntimeObjectSync& progress);
+	void UpdateRuntimeObjectSync(const Endpoint::Ptr& endpoint, const RuntimeObjectSync& progress);
+
+	std::mutex m_RuntimeObjectSyncMutex;
+	std::condition_variable m_RuntimeObjectVersionsReceived;
+	std::map<JsonRpcConnection::Ptr, PeerRuntimeObjects> m_PeerRuntimeObjects;
+
+	/* The last sync to each endpoint by its name. */
+	std::map<String, RuntimeObjectSync> m_RuntimeObjectSyncs;
+
+	/* Streams runtime objects to peers one at a time, so reconnecting endpoints don't all do so at once. */
+	WorkQueue m_RuntimeObjectSyncQueue{0, 1, LogNotice};
 
 	void SyncClient(const JsonRpcConnection::Ptr& aclient, const Endpoint::Ptr& endpoint, bool needSync);
 
@@ -28,7 +28,13 @@ ApiUser::Ptr ApiUser::GetByAuthHeader(const String& auth_header)
 
 	if (pos != String::NPos && auth_header.SubStr(0, pos) == "Basic") {
 		String credentials_base64 = auth_header.SubStr(pos + 1);
-		String credentials = Base64::Decode(credentials_base64);
+		String credentials;
+
+		try {
+			credentials = Base64::Decode(credentials_base64);
+		} catch (const std::invalid_argument&) {
+			/* Deny authentication below. */
+		}
 
 		String::SizeType cpos = credentials.FindFirstOf(":");
 
@@ -0,0 +1,421 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/configobjectjournal.hpp"
+#include "config/configitembuilder.hpp"
+#include "config/expression.hpp"
+#include "base/configuration.hpp"
+#include "base/configwriter.hpp"
+#include "base/convert.hpp"
+#include "base/exception.hpp"
+#include "base/json.hpp"
+#include "base/logger.hpp"
+#include "base/objectlock.hpp"
+#include "base/singleton.hpp"
+#include "base/utility.hpp"
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <sstream>
+#include <vector>
+
+using namespace icinga;
+
+ConfigObjectJournal *ConfigObjectJournal::GetInstance()
+{
+	return Singleton<ConfigObjectJournal>::GetInstance();
+}
+
+String ConfigObjectJournal::GetPath()
+{
+	return Configuration::DataDir + "/api/runtime-objects.journal";
+}
+
+/**
+ * Registers the config items of all objects in the journal.
+ *
+ * @returns false if any of them couldn't be compiled
+ */
+bool ConfigObjectJournal::Load()
+{
+	String path = GetPath();
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	m_Objects.clear();
+	m_Records = 0;
+	m_Size = 0;
+	m_Loaded = true;
+
+	std::ifstream fp (path.CStr(), std::ifstream::binary);
+
+	if (!fp)
+		return true;
+
+	std::unordered_map<String, std::pair<std::streamoff, Dictionary::Ptr>> objects;
+	String data;
+
+	for (;;) {
+		std::streamoff offset = fp.tellg();
+		Dictionary::Ptr record;
+
+		if (!ReadRecord(fp, data))
+			break;
+
+		try {
+			record = JsonDecode(data);
+		} catch (const std::exception&) {
+			break;
+		}
+
+		m_Records++;
+		m_Size = fp.tellg();
+
+		String key = GetKey(record->Get("type"), record->Get("name"));
+
+		if (record->Get("deleted").ToBool())
+			objects.erase(key);
+		else
+			objects[key] = std::make_pair(offset, record);
+	}
+
+	fp.clear();
+	fp.seekg(0, std::ios_base::end);
+
+	/* Most likely we've been killed while writing to it, Append() cuts it off. */
+	if (fp.tellg() != m_Size) {
+		Log(LogWarning, "ConfigObjectJournal")
+			<< "Ignoring incomplete record at offset " << m_Size << " of '" << path << "'.";
+	}
+
+	bool success = true;
+
+	for (auto& object : objects) {
+		auto& record (object.second.second);
+		String typeName = record->Get("type");
+		String name = record->Get("name");
+
+		try {
+			Type::Ptr type = Type::GetByName(typeName);
+
+			if (!type)
+				BOOST_THROW_EXCEPTION(ScriptError("Unknown type '" + typeName + "'."));
+
+			CompileItem(type, name, record->Get("ignore_on_error").ToBool(), record->Get("attrs"))->Register();
+
+			m_Objects.emplace(object.first, object.second.first);
+		} catch (const std::exception& ex) {
+			Log(LogCritical, "ConfigObjectJournal")
+				<< "Cannot load object '" << name << "' of type '" << typeName << "' from '" << path << "': "
+				<< DiagnosticInformation(ex, false);
+
+			success = false;
+		}
+	}
+
+	Log(LogInformation, "ConfigObjectJournal")
+		<< "Loaded " << m_Objects.size() << " runtime objects from '" << path << "'.";
+
+	return success;
+}
+
+/**
+ * Records a new object, its config item has to be compiled with CompileItem().
+ *
+ * @param type The type of the object
+ * @param fullName The full name of the object
+ * @param ignoreOnError Whether to ignore the object if its attributes are invalid
+ * @param attrs The attributes as returned by ConfigObjectUtility::CreateObjectAttrs()
+ */
+void ConfigObjectJournal::Add(const Type::Ptr& type, const String& fullName, bool ignoreOnError, const Dictionary::Ptr& attrs)
+{
+	Dictionary::Ptr record = new Dictionary({
+		{ "type", type->GetName() },
+		{ "name", fullName },
+		{ "ignore_on_error", ignoreOnError },
+		{ "attrs", attrs }
+	});
+
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	std::streamoff offset = m_Size;
+
+	Append(record);
+
+	m_Objects[GetKey(type->GetName(), fullName)] = offset;
+
+	if (!m_CompactTimer) {
+		m_CompactTimer = new Timer();
+		m_CompactTimer->OnTimerExpired.connect([this](const Timer * const&) { Compact(); });
+		m_CompactTimer->SetInterval(300);
+		m_CompactTimer->SetSchedulerPolicy(BackgroundScheduler);
+		m_CompactTimer->Start();
+	}
+}
+
+/**
+ * Records that an object has been deleted.
+ *
+ * @returns false if the object isn't in the journal
+ */
+bool ConfigObjectJournal::Remove(const Type::Ptr& type, const String& fullName)
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	auto it (m_Objects.find(GetKey(type->GetName(), fullName)));
+
+	if (it == m_Objects.end())
+		return false;
+
+	Append(new Dictionary({
+		{ "type", type->GetName() },
+		{ "name", fullName },
+		{ "deleted", true }
+	}));
+
+	m_Objects.erase(it);
+
+	return true;
+}
+
+/**
+ * Renders the config of an object in the journal for cluster config sync,
+ * i.e. the same config ConfigObjectUtility::CreateObjectConfig() would have returned.
+ *
+ * @returns An empty string if the object isn't in the journal
+ */
+String ConfigObjectJournal::GetConfig(const Type::Ptr& type, const String& fullName)
+{
+	String data;
+
+	{
+		std::unique_lock<std::mutex> lock (m_Mutex);
+
+		auto it (m_Objects.find(GetKey(type->GetName(), fullName)));
+
+		if (it == m_Objects.end())
+			return String();
+
+		if (m_File.is_open())
+			m_File.flush();
+
+		std::ifstream fp (GetPath().CStr(), std::ifstream::binary);
+		fp.seekg(it->second);
+
+		if (!ReadRecord(fp, data))
+			return String();
+	}
+
+	Dictionary::Ptr record = JsonDecode(data);
+	String name = fullName;
+	auto *nc = dynamic_cast<NameComposer *>(type.get());
+
+	if (nc)
+		name = nc->ParseName(fullName)->Get("name");
+
+	std::ostringstream config;
+	ConfigWriter::EmitConfigItem(config, type->GetName(), name, false, record->Get("ignore_on_error").ToBool(), nullptr, record->Get("attrs"));
+	ConfigWriter::EmitRaw(config, "\n");
+
+	return config.str();
+}
+
+/**
+ * Rewrites the journal with only the records of objects which still exist.
+ *
+ * @param force Whether to compact it even if there are only a few deleted objects
+ */
+void ConfigObjectJournal::Compact(bool force)
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	size_t garbage = m_Records - m_Objects.size();
+
+	if (!force && (garbage < 1000 || garbage < m_Objects.size()))
+		return;
+
+	String path = GetPath();
+	std::vector<std::pair<std::streamoff, String>> objects;
+
+	objects.reserve(m_Objects.size());
+
+	for (auto& object : m_Objects)
+		objects.emplace_back(object.second, object.first);
+
+	/* Read the old file sequentially. */
+	std::sort(objects.begin(), objects.end());
+
+	m_File.close();
+	m_File.clear();
+
+	String tempPath;
+
+	try {
+		std::ifstream ifp (path.CStr(), std::ifstream::binary);
+		std::fstream ofp;
+		tempPath = Utility::CreateTempFile(path + ".XXXXXX", 0600, ofp);
+
+		ofp.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+
+		std::vector<std::streamoff> offsets;
+		std::streamoff size = 0;
+		String data;
+
+		offsets.reserve(objects.size());
+
+		for (auto& object : objects) {
+			ifp.seekg(object.first);
+
+			if (!ReadRecord(ifp, data))
+				BOOST_THROW_EXCEPTION(std::runtime_error("Cannot read record at offset " + Convert::ToString(object.first)));
+
+			offsets.push_back(size);
+			size += WriteRecord(ofp, data);
+		}
+
+		ofp.close();
+
+		Utility::RenameFile(tempPath, path);
+
+		for (size_t i = 0; i < objects.size(); i++)
+			m_Objects[objects[i].second] = offsets[i];
+
+		m_Records = objects.size();
+		m_Size = size;
+		m_Loaded = true;
+	} catch (const std::exception& ex) {
+		Log(LogWarning, "ConfigObjectJournal")
+			<< "Cannot compact '" << path << "': " << DiagnosticInformation(ex, false);
+
+		if (!tempPath.IsEmpty())
+			Utility::Remove(tempPath);
+
+		return;
+	}
+
+	Log(LogInformation, "ConfigObjectJournal")
+		<< "Compacted '" << path << "', dropped " << garbage << " records of deleted objects.";
+}
+
+/**
+ * Builds the config item of an object from its attributes, without rendering
+ * and compiling config in between.
+ */
+ConfigItem::Ptr ConfigObjectJournal::CompileItem(const Type::Ptr& type, const String& fullName,
+	bool ignoreOnError, const Dictionary::Ptr& attrs)
+{
+	DebugInfo di;
+	di.Path = GetPath();
+
+	String name = fullName;
+	auto *nc = dynamic_cast<NameComposer *>(type.get());
+
+	if (nc)
+		name = nc->ParseName(fullName)->Get("name");
+
+	ConfigItemBuilder builder{di};
+	builder.SetType(type);
+	builder.SetName(name);
+	builder.SetPackage("_api");
+	builder.SetIgnoreOnError(ignoreOnError);
+	builder.AddExpression(new ImportDefaultTemplatesExpression());
+
+	if (attrs) {
+		ObjectLock olock(attrs);
+
+		for (const Dictionary::Pair& kv : attrs) {
+			builder.AddExpression(new SetExpression(MakeIndexer(ScopeThis, kv.first), OpSetLiteral,
+				MakeLiteral(kv.second.Clone()), di));
+		}
+	}
+
+	return builder.Compile();
+}
+
+/**
+ * Writes a record to the end of the journal, m_Mutex must be held.
+ */
+void ConfigObjectJournal::Append(const Dictionary::Ptr& record)
+{
+	String path = GetPath();
+
+	if (!m_File.is_open()) {
+		namespace fs = boost::filesystem;
+
+		Utility::MkDirP(Utility::DirName(path), 0750);
+
+		fs::path fsPath (path.Begin(), path.End());
+
+		if (m_Loaded) {
+			/* Cut off an incomplete record Load() has ignored. */
+			if (fs::exists(fsPath) && fs::file_size(fsPath) != static_cast<uintmax_t>(m_Size))
+				fs::resize_file(fsPath, m_Size);
+		} else {
+			m_Size = fs::exists(fsPath) ? fs::file_size(fsPath) : 0;
+			m_Loaded = true;
+		}
+
+		m_File.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+		m_File.open(path.CStr(), std::ofstream::binary | std::ofstream::app);
+	}
+
+	try {
+		std::streamoff written = WriteRecord(m_File, JsonEncode(record));
+		m_File.flush();
+
+		m_Size += written;
+		m_Records++;
+	} catch (const std::exception&) {
+		/* Let the next call cut off what we've written so far. */
+		m_File.close();
+		m_File.clear();
+		throw;
+	}
+}
+
+String ConfigObjectJournal::GetKey(const String& type, const String& fullName)
+{
+	return type + "\n" + fullName;
+}
+
+/**
+ * Reads one netstring.
+ *
+ * @returns false at the end of the file or if the record is incomplete
+ */
+bool ConfigObjectJournal::ReadRecord(std::istream& fp, String& record)
+{
+	size_t length = 0;
+	bool digits = false;
+	int ch;
+
+	while ((ch = fp.get()) >= '0' && ch <= '9') {
+		length = length * 10 + (ch - '0');
+		digits = true;
+
+		if (length > 512 * 1024 * 1024)
+			return false;
+	}
+
+	if (!digits || ch != ':')
+		return false;
+
+	std::string data (length, '\0');
+
+	if (!fp.read(&data[0], length) || fp.get() != ',')
+		return false;
+
+	record = String(std::move(data));
+	return true;
+}
+
+/**
+ * Writes one netstring.
+ *
+ * @returns The number of bytes written
+ */
+std::streamoff ConfigObjectJournal::WriteRecord(std::ostream& fp, const String& record)
+{
+	String length = Convert::ToString(record.GetLength());
+
+	fp << length << ':' << record << ',';
+
+	return length.GetLength() + record.GetLength() + 2;
+}
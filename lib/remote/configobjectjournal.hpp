@@ -0,0 +1,67 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef CONFIGOBJECTJOURNAL_H
+#define CONFIGOBJECTJOURNAL_H
+
+#include "remote/i2-remote.hpp"
+#include "config/configitem.hpp"
+#include "base/dictionary.hpp"
+#include "base/timer.hpp"
+#include "base/type.hpp"
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+namespace icinga
+{
+
+/**
+ * An append-only journal of runtime created objects, e.g. comments and downtimes.
+ *
+ * Unlike objects in the _api package, they don't need a config file each
+ * which has to be rendered, written and compiled again on every start.
+ * Each netstring in the journal is a JSON object which either creates an object
+ * from its attributes or deletes it. Deleted objects are dropped from the
+ * journal by compacting it periodically.
+ *
+ * @ingroup remote
+ */
+class ConfigObjectJournal
+{
+public:
+	static ConfigObjectJournal *GetInstance();
+	static String GetPath();
+
+	bool Load();
+
+	void Add(const Type::Ptr& type, const String& fullName, bool ignoreOnError, const Dictionary::Ptr& attrs);
+	bool Remove(const Type::Ptr& type, const String& fullName);
+	String GetConfig(const Type::Ptr& type, const String& fullName);
+
+	void Compact(bool force = false);
+
+	static ConfigItem::Ptr CompileItem(const Type::Ptr& type, const String& fullName,
+		bool ignoreOnError, const Dictionary::Ptr& attrs);
+
+private:
+	std::mutex m_Mutex;
+
+	/* The offset of the record which created each object, by type and full name. */
+	std::unordered_map<String, std::streamoff> m_Objects;
+
+	size_t m_Records{0};
+	std::streamoff m_Size{0};
+	bool m_Loaded{false};
+	std::ofstream m_File;
+	Timer::Ptr m_CompactTimer;
+
+	void Append(const Dictionary::Ptr& record);
+
+	static String GetKey(const String& type, const String& fullName);
+	static bool ReadRecord(std::istream& fp, String& record);
+	static std::streamoff WriteRecord(std::ostream& fp, const String& record);
+};
+
+}
+
+#endif /* CONFIGOBJECTJOURNAL_H */
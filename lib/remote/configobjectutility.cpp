@@ -1,6 +1,7 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "remote/configobjectutility.hpp"
+#include "remote/configobjectjournal.hpp"
 #include "remote/configpackageutility.hpp"
 #include "remote/apilistener.hpp"
 #include "config/configcompiler.hpp"
@@ -107,18 +108,18 @@ String ConfigObjectUtility::EscapeName(const String& name)
 	return Utility::EscapeString(name, "<>:\"/\\|?*", true);
 }
 
-String ConfigObjectUtility::CreateObjectConfig(const Type::Ptr& type, const String& fullName,
-	bool ignoreOnError, const Array::Ptr& templates, const Dictionary::Ptr& attrs)
+/**
+ * Validates the attributes of a new object and completes them with the parts of its name.
+ *
+ * @returns The attributes to create the object with
+ */
+Dictionary::Ptr ConfigObjectUtility::CreateObjectAttrs(const Type::Ptr& type, const String& fullName, const Dictionary::Ptr& attrs)
 {
 	auto *nc = dynamic_cast<NameComposer *>(type.get());
 	Dictionary::Ptr nameParts;
-	String name;
 
-	if (nc) {
+	if (nc)
 		nameParts = nc->ParseName(fullName);
-		name = nameParts->Get("name");
-	} else
-		name = fullName;
 
 	Dictionary::Ptr allAttrs = new Dictionary();
 
@@ -147,6 +148,22 @@ String ConfigObjectUtility::CreateObjectConfig(const Type::Ptr& type, const Stri
 	/* update the version for config sync */
 	allAttrs->Set("version", Utility::GetTime());
 
+	return allAttrs;
+}
+
+String ConfigObjectUtility::CreateObjectConfig(const Type::Ptr& type, const String& fullName,
+	bool ignoreOnError, const Array::Ptr& templates, const Dictionary::Ptr& attrs)
+{
+	auto *nc = dynamic_cast<NameComposer *>(type.get());
+	String name;
+
+	if (nc)
+		name = nc->ParseName(fullName)->Get("name");
+	else
+		name = fullName;
+
+	Dictionary::Ptr allAttrs = CreateObjectAttrs(type, fullName, attrs);
+
 	std::ostringstream config;
 	ConfigWriter::EmitConfigItem(config, type->GetName(), name, false, ignoreOnError, templates, allAttrs);
 	ConfigWriter::EmitRaw(config, "\n");
@@ -276,6 +293,217 @@ bool ConfigObjectUtility::CreateObject(const Type::Ptr& type, const String& full
 	return true;
 }
 
+/**
+ * Creates many objects of the same type at once, e.g. the downtimes of a bulk API action.
+ *
+ * Unlike calling CreateObject() for each one, all of them are evaluated, committed
+ * and activated together, i.e. with one work queue and one activation run.
+ * Objects which are ignored due to errors (ignore_on_error) are just missing afterwards.
+ *
+ * @param type The type of all objects
+ * @param objects Pairs of full names and configs as returned by CreateObjectConfig()
+ * @param errors Where to add errors to
+ * @param diagnosticInformation Where to add diagnostic information to
+ * @param cookie The origin to forward to the activation
+ * @return Whether the batch has been committed and activated
+ */
+bool ConfigObjectUtility::CreateObjects(const Type::Ptr& type, const std::vector<std::pair<String, String>>& objects,
+	const Array::Ptr& errors, const Array::Ptr& diagnosticInformation, const Value& cookie)
+{
+	CreateStorage();
+
+	auto configType (dynamic_cast<ConfigType*>(type.get()));
+	std::vector<String> paths;
+	std::vector<std::unique_ptr<Expression>> exprs;
+
+	paths.reserve(objects.size());
+	exprs.reserve(objects.size());
+
+	auto removePaths ([&paths]() {
+		for (auto& path : paths) {
+			Utility::Remove(path);
+		}
+	});
+
+	try {
+		for (auto& object : objects) {
+			if (configType && configType->GetObject(object.first)) {
+				removePaths();
+				errors->Add("Object '" + object.first + "' already exists.");
+				return false;
+			}
+
+			String path = GetObjectConfigPath(type, object.first);
+
+			Utility::MkDirP(Utility::DirName(path), 0700);
+
+			std::ofstream fp(path.CStr(), std::ofstream::out | std::ostream::trunc);
+			fp << object.second;
+			fp.close();
+
+			paths.emplace_back(path);
+			exprs.emplace_back(ConfigCompiler::CompileFile(path, String(), "_api"));
+		}
+
+		ActivationScope ascope;
+
+		for (auto& expr : exprs) {
+			ScriptFrame frame(true);
+			expr->Evaluate(frame);
+			expr.reset();
+		}
+
+		WorkQueue upq;
+		upq.SetName("ConfigObjectUtility::CreateObjects");
+
+		std::vector<ConfigItem::Ptr> newItems;
+
+		/* Same as in CreateObject(), but for all objects at once. */
+		if (!ConfigItem::CommitItems(ascope.GetContext(), upq, newItems, true)
+			|| !ConfigItem::ActivateItems(newItems, true, true, false, cookie)) {
+			Log(LogNotice, "ConfigObjectUtility")
+				<< "Failed to create " << objects.size() << " objects of type '" << type->GetName() << "'. Aborting and removing their config paths.";
+
+			removePaths();
+
+			for (const boost::exception_ptr& ex : upq.GetExceptions()) {
+				errors->Add(DiagnosticInformation(ex, false));
+
+				if (diagnosticInformation)
+					diagnosticInformation->Add(DiagnosticInformation(ex));
+			}
+
+			return false;
+		}
+	} catch (const std::exception& ex) {
+		removePaths();
+
+		errors->Add(DiagnosticInformation(ex, false));
+
+		if (diagnosticInformation)
+			diagnosticInformation->Add(DiagnosticInformation(ex));
+
+		return false;
+	}
+
+	if (type->GetName() != "Comment" && type->GetName() != "Downtime")
+		ApiListener::UpdateObjectAuthority();
+
+	size_t created = 0;
+
+	for (auto& object : objects) {
+		if (configType && configType->GetObject(object.first)) {
+			++created;
+		} else {
+			Log(LogNotice, "ConfigObjectUtility")
+				<< "Object '" << object.first << "' was not created but ignored due to errors.";
+		}
+	}
+
+	Log(LogInformation, "ConfigObjectUtility")
+		<< "Created and activated " << created << " objects of type '" << type->GetName() << "'.";
+
+	return true;
+}
+
+/**
+ * Creates a batch of objects like CreateObjects(), but records them in the
+ * ConfigObjectJournal instead of writing and compiling a config file for each.
+ *
+ * @param type The type of the objects
+ * @param objects Pairs of full names and attributes as returned by CreateObjectAttrs()
+ * @param ignoreOnError Whether to ignore invalid objects instead of failing the batch
+ * @param errors Where to add errors to
+ * @param diagnosticInformation Where to add diagnostic information to
+ * @param cookie The origin to forward to the activation
+ * @return Whether the batch has been committed and activated
+ */
+bool ConfigObjectUtility::CreateJournaledObjects(const Type::Ptr& type, const std::vector<std::pair<String, Dictionary::Ptr>>& objects,
+	bool ignoreOnError, const Array::Ptr& errors, const Array::Ptr& diagnosticInformation, const Value& cookie)
+{
+	auto journal (ConfigObjectJournal::GetInstance());
+	auto configType (dynamic_cast<ConfigType*>(type.get()));
+	std::vector<String> added;
+
+	added.reserve(objects.size());
+
+	auto removeAdded ([&journal, &type, &added]() {
+		for (auto& name : added) {
+			journal->Remove(type, name);
+		}
+	});
+
+	try {
+		ActivationScope ascope;
+
+		for (auto& object : objects) {
+			if (configType && configType->GetObject(object.first)) {
+				removeAdded();
+				errors->Add("Object '" + object.first + "' already exists.");
+				return false;
+			}
+
+			journal->Add(type, object.first, ignoreOnError, object.second);
+			added.emplace_back(object.first);
+
+			ConfigObjectJournal::CompileItem(type, object.first, ignoreOnError, object.second)->Register();
+		}
+
+		WorkQueue upq;
+		upq.SetName("ConfigObjectUtility::CreateJournaledObjects");
+
+		std::vector<ConfigItem::Ptr> newItems;
+
+		if (!ConfigItem::CommitItems(ascope.GetContext(), upq, newItems, true)
+			|| !ConfigItem::ActivateItems(newItems, true, true, false, cookie)) {
+			Log(LogNotice, "ConfigObjectUtility")
+				<< "Failed to create " << objects.size() << " objects of type '" << type->GetName() << "'. Aborting and removing them from the journal.";
+
+			removeAdded();
+
+			for (const boost::exception_ptr& ex : upq.GetExceptions()) {
+				errors->Add(DiagnosticInformation(ex, false));
+
+				if (diagnosticInformation)
+					diagnosticInformation->Add(DiagnosticInformation(ex));
+			}
+
+			return false;
+		}
+	} catch (const std::exception& ex) {
+		removeAdded();
+
+		errors->Add(DiagnosticInformation(ex, false));
+
+		if (diagnosticInformation)
+			diagnosticInformation->Add(DiagnosticInformation(ex));
+
+		return false;
+	}
+
+	if (type->GetName() != "Comment" && type->GetName() != "Downtime")
+		ApiListener::UpdateObjectAuthority();
+
+	size_t created = 0;
+
+	for (auto& object : objects) {
+		if (configType && configType->GetObject(object.first)) {
+			++created;
+		} else {
+			/* Unlike a config file, there's no point in keeping it around. */
+			journal->Remove(type, object.first);
+
+			Log(LogNotice, "ConfigObjectUtility")
+				<< "Object '" << object.first << "' was not created but ignored due to errors.";
+		}
+	}
+
+	Log(LogInformation, "ConfigObjectUtility")
+		<< "Created and activated " << created << " journaled objects of type '" << type->GetName() << "'.";
+
+	return true;
+}
+
 bool ConfigObjectUtility::DeleteObjectHelper(const ConfigObject::Ptr& object, bool cascade,
 	const Array::Ptr& errors, const Array::Ptr& diagnosticInformation, const Value& cookie)
 {
@@ -332,16 +560,18 @@ bool ConfigObjectUtility::DeleteObjectHelper(const ConfigObject::Ptr& object, bo
 		return false;
 	}
 
-	String path;
+	if (!ConfigObjectJournal::GetInstance()->Remove(type, name)) {
+		String path;
 
-	try {
-		path = GetObjectConfigPath(object->GetReflectionType(), name);
-	} catch (const std::exception& ex) {
-		errors->Add("Config package broken: " + DiagnosticInformation(ex, false));
-		return false;
-	}
+		try {
+			path = GetObjectConfigPath(object->GetReflectionType(), name);
+		} catch (const std::exception& ex) {
+			errors->Add("Config package broken: " + DiagnosticInformation(ex, false));
+			return false;
+		}
 
-	Utility::Remove(path);
+		Utility::Remove(path);
+	}
 
 	Log(LogInformation, "ConfigObjectUtility")
 		<< "Deleted object '" << name << "' of type '" << type->GetName() << "'.";
@@ -8,6 +8,8 @@
 #include "base/configobject.hpp"
 #include "base/dictionary.hpp"
 #include "base/type.hpp"
+#include <utility>
+#include <vector>
 
 namespace icinga
 {
@@ -26,12 +28,20 @@ public:
 	static void RepairPackage(const String& package);
 	static void CreateStorage();
 
+	static Dictionary::Ptr CreateObjectAttrs(const Type::Ptr& type, const String& fullName, const Dictionary::Ptr& attrs);
+
 	static String CreateObjectConfig(const Type::Ptr& type, const String& fullName,
 		bool ignoreOnError, const Array::Ptr& templates, const Dictionary::Ptr& attrs);
 
 	static bool CreateObject(const Type::Ptr& type, const String& fullName,
 		const String& config, const Array::Ptr& errors, const Array::Ptr& diagnosticInformation, const Value& cookie = Empty);
 
+	static bool CreateObjects(const Type::Ptr& type, const std::vector<std::pair<String, String>>& objects,
+		const Array::Ptr& errors, const Array::Ptr& diagnosticInformation, const Value& cookie = Empty);
+
+	static bool CreateJournaledObjects(const Type::Ptr& type, const std::vector<std::pair<String, Dictionary::Ptr>>& objects,
+		bool ignoreOnError, const Array::Ptr& errors, const Array::Ptr& diagnosticInformation, const Value& cookie = Empty);
+
 	static bool DeleteObject(const ConfigObject::Ptr& object, bool cascade, const Array::Ptr& errors,
 		const Array::Ptr& diagnosticInformation, const Value& cookie = Empty);
 
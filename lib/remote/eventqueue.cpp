@@ -1,12 +1,16 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "config/configcompiler.hpp"
+#include "config/bytecode.hpp"
+#include "remote/apilistener.hpp"
 #include "remote/eventqueue.hpp"
 #include "remote/filterutility.hpp"
 #include "base/io-engine.hpp"
+#include "base/json.hpp"
 #include "base/singleton.hpp"
 #include "base/logger.hpp"
 #include "base/utility.hpp"
+#include <boost/algorithm/string/replace.hpp>
 #include <boost/asio/spawn.hpp>
 #include <boost/date_time/posix_time/posix_time_duration.hpp>
 #include <boost/date_time/posix_time/ptime.hpp>
@@ -148,11 +152,21 @@ EventQueueRegistry *EventQueueRegistry::GetInstance()
 std::mutex EventsInbox::m_FiltersMutex;
 std::map<String, EventsInbox::Filter> EventsInbox::m_Filters ({{"", EventsInbox::Filter{1, Expression::Ptr()}}});
 
+std::atomic<uint_fast64_t> EventsInbox::m_DroppedEvents (0);
+std::atomic<uint_fast64_t> EventsInbox::m_OverflowedInboxes (0);
+
 EventsRouter EventsRouter::m_Instance;
 
 EventsInbox::EventsInbox(String filter, const String& filterSource)
-	: m_Timer(IoEngine::Get().GetIoContext())
+	: m_Timer(IoEngine::Get().GetIoContext()), m_MaxQueued(0), m_DisconnectOnOverflow(false), m_Overflowed(false)
 {
+	ApiListener::Ptr listener = ApiListener::GetInstance();
+
+	if (listener) {
+		m_MaxQueued = listener->GetMaxQueuedEvents();
+		m_DisconnectOnOverflow = listener->GetQueuedEventsOverflow() == "disconnect";
+	}
+
 	std::unique_lock<std::mutex> lock (m_FiltersMutex);
 	m_Filter = m_Filters.find(filter);
 
@@ -166,7 +180,7 @@ EventsInbox::EventsInbox(String filter, const String& filterSource)
 		m_Filter = m_Filters.find(filter);
 
 		if (m_Filter == m_Filters.end()) {
-			m_Filter = m_Filters.emplace(std::move(filter), Filter{1, Expression::Ptr(expr.release())}).first;
+			m_Filter = m_Filters.emplace(std::move(filter), Filter{1, new CompiledExpression(expr.release())}).first;
 		} else {
 			++m_Filter->second.Refs;
 		}
@@ -189,15 +203,46 @@ const Expression::Ptr& EventsInbox::GetFilter()
 	return m_Filter->second.Expr;
 }
 
-void EventsInbox::Push(Dictionary::Ptr event)
+/**
+ * Queues an event unless the inbox is full. Full inboxes either drop events
+ * or are marked as overflowed, so their subscriber gets disconnected.
+ */
+void EventsInbox::Push(const EncodedEvent& event)
 {
 	std::unique_lock<std::mutex> lock (m_Mutex);
 
-	m_Queue.emplace(std::move(event));
+	if (m_Overflowed) {
+		m_DroppedEvents.fetch_add(1);
+		return;
+	}
+
+	if (m_MaxQueued && m_Queue.size() >= m_MaxQueued) {
+		m_DroppedEvents.fetch_add(1);
+
+		if (m_DisconnectOnOverflow) {
+			m_Overflowed = true;
+			m_OverflowedInboxes.fetch_add(1);
+
+			m_DroppedEvents.fetch_add(m_Queue.size());
+			m_Queue.clear();
+
+			m_Timer.expires_at(boost::posix_time::neg_infin);
+		}
+
+		return;
+	}
+
+	m_Queue.emplace_back(event);
 	m_Timer.expires_at(boost::posix_time::neg_infin);
 }
 
-Dictionary::Ptr EventsInbox::Shift(boost::asio::yield_context yc, double timeout)
+/**
+ * Waits for events and takes all of them at once, so they can be written
+ * together.
+ *
+ * @return The events, none after the timeout or if the inbox has overflowed
+ */
+std::vector<EventsInbox::EncodedEvent> EventsInbox::Shift(boost::asio::yield_context yc, double timeout)
 {
 	std::unique_lock<std::mutex> lock (m_Mutex, std::defer_lock);
 
@@ -211,7 +256,7 @@ Dictionary::Ptr EventsInbox::Shift(boost::asio::yield_context yc, double timeout
 		}
 	}
 
-	if (m_Queue.empty()) {
+	if (m_Queue.empty() && !m_Overflowed) {
 		m_Timer.expires_from_now(boost::posix_time::milliseconds((unsigned long)(timeout * 1000.0)));
 		lock.unlock();
 
@@ -223,15 +268,38 @@ Dictionary::Ptr EventsInbox::Shift(boost::asio::yield_context yc, double timeout
 				m_Timer.async_wait(yc[ec]);
 			}
 		}
-
-		if (m_Queue.empty()) {
-			return nullptr;
-		}
 	}
 
-	auto event (std::move(m_Queue.front()));
-	m_Queue.pop();
-	return std::move(event);
+	std::vector<EncodedEvent> events;
+	events.swap(m_Queue);
+
+	return events;
+}
+
+bool EventsInbox::HasOverflowed()
+{
+	std::unique_lock<std::mutex> lock (m_Mutex);
+
+	return m_Overflowed;
+}
+
+EventsInbox::EncodedEvent EventsInbox::Encode(const Dictionary::Ptr& event)
+{
+	String body = JsonEncode(event);
+
+	boost::algorithm::replace_all(body, "\n", "");
+
+	return std::make_shared<String>(body + "\n");
+}
+
+uint_fast64_t EventsInbox::GetDroppedEvents()
+{
+	return m_DroppedEvents.load();
+}
+
+uint_fast64_t EventsInbox::GetOverflowedInboxes()
+{
+	return m_OverflowedInboxes.load();
 }
 
 EventsSubscriber::EventsSubscriber(std::set<EventType> types, String filter, const String& filterSource)
@@ -262,6 +330,9 @@ EventsFilter::operator bool()
 
 void EventsFilter::Push(Dictionary::Ptr event)
 {
+	/* Encoded once for all subscribers and only if there's one at all. */
+	EventsInbox::EncodedEvent encoded;
+
 	for (auto& perFilter : m_Inboxes) {
 		if (perFilter.first) {
 			ScriptFrame frame(true, new Namespace());
@@ -278,8 +349,12 @@ void EventsFilter::Push(Dictionary::Ptr event)
 			}
 		}
 
+		if (!encoded) {
+			encoded = EventsInbox::Encode(event);
+		}
+
 		for (auto& inbox : perFilter.second) {
-			inbox->Push(event);
+			inbox->Push(encoded);
 		}
 	}
 }
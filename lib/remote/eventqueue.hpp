@@ -8,14 +8,16 @@
 #include "config/expression.hpp"
 #include <boost/asio/deadline_timer.hpp>
 #include <boost/asio/spawn.hpp>
+#include <atomic>
 #include <condition_variable>
 #include <cstddef>
 #include <cstdint>
 #include <mutex>
 #include <set>
 #include <map>
+#include <memory>
 #include <deque>
-#include <queue>
+#include <vector>
 
 namespace icinga
 {
@@ -91,6 +93,9 @@ class EventsInbox : public Object
 public:
 	DECLARE_PTR_TYPEDEFS(EventsInbox);
 
+	/* An event encoded as a line of JSON, shared by all inboxes it's pushed to. */
+	typedef std::shared_ptr<const String> EncodedEvent;
+
 	EventsInbox(String filter, const String& filterSource);
 	EventsInbox(const EventsInbox&) = delete;
 	EventsInbox(EventsInbox&&) = delete;
@@ -100,8 +105,14 @@ public:
 
 	const Expression::Ptr& GetFilter();
 
-	void Push(Dictionary::Ptr event);
-	Dictionary::Ptr Shift(boost::asio::yield_context yc, double timeout = 5);
+	void Push(const EncodedEvent& event);
+	std::vector<EncodedEvent> Shift(boost::asio::yield_context yc, double timeout = 5);
+	bool HasOverflowed();
+
+	static EncodedEvent Encode(const Dictionary::Ptr& event);
+
+	static uint_fast64_t GetDroppedEvents();
+	static uint_fast64_t GetOverflowedInboxes();
 
 private:
 	struct Filter
@@ -113,10 +124,17 @@ private:
 	static std::mutex m_FiltersMutex;
 	static std::map<String, Filter> m_Filters;
 
+	static std::atomic<uint_fast64_t> m_DroppedEvents;
+	static std::atomic<uint_fast64_t> m_OverflowedInboxes;
+
 	std::mutex m_Mutex;
 	decltype(m_Filters.begin()) m_Filter;
-	std::queue<Dictionary::Ptr> m_Queue;
+	std::vector<EncodedEvent> m_Queue;
 	boost::asio::deadline_timer m_Timer;
+
+	std::size_t m_MaxQueued;
+	bool m_DisconnectOnOverflow;
+	bool m_Overflowed;
 };
 
 class EventsSubscriber
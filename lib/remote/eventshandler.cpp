@@ -7,13 +7,13 @@
 #include "config/expression.hpp"
 #include "base/defer.hpp"
 #include "base/io-engine.hpp"
+#include "base/logger.hpp"
 #include "base/objectlock.hpp"
-#include "base/json.hpp"
 #include <boost/asio/buffer.hpp>
 #include <boost/asio/write.hpp>
-#include <boost/algorithm/string/replace.hpp>
 #include <map>
 #include <set>
+#include <vector>
 
 using namespace icinga;
 
@@ -105,33 +105,34 @@ bool EventsHandler::HandleRequest(
 	response.result(http::status::ok);
 	response.set(http::field::content_type, "application/json");
 
-	IoBoundWorkSlot dontLockTheIoThread (yc);
+	IoBoundWorkSlot dontLockTheIoThread (yc, CpuBoundWorkApiRead);
 
 	http::async_write(stream, response, yc);
 	stream.async_flush(yc);
 
-	asio::const_buffer newLine ("\n", 1);
+	std::vector<asio::const_buffer> buffers;
 
 	for (;;) {
-		auto event (subscriber.GetInbox()->Shift(yc));
+		auto events (subscriber.GetInbox()->Shift(yc));
 
-		if (event) {
-			CpuBoundWork buildingResponse (yc);
+		if (!events.empty()) {
+			/* Everything which has been queued meanwhile is written at once. */
+			buffers.clear();
 
-			String body = JsonEncode(event);
-
-			boost::algorithm::replace_all(body, "\n", "");
-
-			asio::const_buffer payload (body.CStr(), body.GetLength());
-
-			buildingResponse.Done();
+			for (auto& event : events) {
+				buffers.emplace_back(event->CStr(), event->GetLength());
+			}
 
-			asio::async_write(stream, payload, yc);
-			asio::async_write(stream, newLine, yc);
+			asio::async_write(stream, buffers, yc);
 			stream.async_flush(yc);
+		} else if (subscriber.GetInbox()->HasOverflowed()) {
+			Log(LogWarning, "EventsHandler")
+				<< "Disconnecting event stream of API user '" << user->GetName() << "' for queue '"
+				<< queueName << "' because it can't keep up with the events.";
+
+			return true;
 		} else if (server.Disconnected()) {
 			return true;
 		}
 	}
 }
-
@@ -4,15 +4,29 @@
 #include "remote/httputility.hpp"
 #include "config/configcompiler.hpp"
 #include "config/expression.hpp"
+#include "config/bytecode.hpp"
 #include "base/namespace.hpp"
 #include "base/json.hpp"
 #include "base/configtype.hpp"
 #include "base/logger.hpp"
 #include "base/utility.hpp"
 #include <boost/algorithm/string/case_conv.hpp>
+#include <algorithm>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
 
 using namespace icinga;
 
+/* Dashboards send the same few filters over and over again. */
+static const size_t l_FilterCacheSize = 256;
+
+static std::mutex l_FilterCacheMutex;
+static std::list<std::pair<String, Expression::Ptr>> l_FilterCache;
+static std::map<String, std::list<std::pair<String, Expression::Ptr>>::iterator> l_FilterCacheIndex;
+
 Type::Ptr FilterUtility::TypeFromPluralName(const String& pluralName)
 {
 	String uname = pluralName;
@@ -29,13 +43,39 @@ Type::Ptr FilterUtility::TypeFromPluralName(const String& pluralName)
 	return nullptr;
 }
 
+String TargetProvider::GetTargetName(const Value& target) const
+{
+	if (target.IsObjectType<Dictionary>())
+		return static_cast<Dictionary::Ptr>(target)->Get("name");
+
+	ConfigObject::Ptr object = dynamic_pointer_cast<ConfigObject>(static_cast<Object::Ptr>(target));
+
+	if (object)
+		return object->GetName();
+
+	return String();
+}
+
+bool TargetProvider::FindIndexedTargets(const String&, const Expression *, const Namespace::Ptr&,
+	const std::function<void (const Value&)>&) const
+{
+	return false;
+}
+
+bool QueryPage::IsPaginated() const
+{
+	return Limit || !Cursor.IsEmpty();
+}
+
 void ConfigObjectTargetProvider::FindTargets(const String& type, const std::function<void (const Value&)>& addTarget) const
 {
 	Type::Ptr ptype = Type::GetByName(type);
 	auto *ctype = dynamic_cast<ConfigType *>(ptype.get());
 
 	if (ctype) {
-		for (const ConfigObject::Ptr& object : ctype->GetObjects()) {
+		auto snapshot (ctype->GetSnapshot());
+
+		for (const ConfigObject::Ptr& object : snapshot->Objects) {
 			addTarget(object);
 		}
 	}
@@ -66,6 +106,12 @@ String ConfigObjectTargetProvider::GetPluralName(const String& type) const
 	return Type::GetByName(type)->GetPluralName();
 }
 
+bool ConfigObjectTargetProvider::FindIndexedTargets(const String& type, const Expression *filter, const Namespace::Ptr& filterVars,
+	const std::function<void (const Value&)>& addTarget) const
+{
+	return FilterUtility::FindIndexedTargets(Type::GetByName(type), filter, filterVars, addTarget);
+}
+
 bool FilterUtility::EvaluateFilter(ScriptFrame& frame, Expression *filter,
 	const Object::Ptr& target, const String& variableName)
 {
@@ -114,9 +160,276 @@ bool FilterUtility::EvaluateFilter(ScriptFrame& frame, Expression *filter,
 	return Convert::ToBool(filter->Evaluate(frame));
 }
 
+std::vector<FilterTargetIndex> FilterUtility::m_TargetIndexes;
+
+/**
+ * Registers a lookup for filter predicates. Must be called during
+ * initialization.
+ */
+void FilterUtility::RegisterTargetIndex(const FilterTargetIndex& index)
+{
+	m_TargetIndexes.push_back(index);
+}
+
+/**
+ * Finds the objects which may match a filter with the registered indexes,
+ * without evaluating the filter. The filter has to be evaluated for each of
+ * them nevertheless.
+ *
+ * Like ApplyRuleIndex, this only considers predicates which must be true for
+ * the filter to be true, i.e. ones which are combined with && and || only.
+ *
+ * @return Whether the candidates have been found, nothing has been added otherwise
+ */
+bool FilterUtility::FindIndexedTargets(const Type::Ptr& type, const Expression *filter, const Namespace::Ptr& filterVars,
+	const std::function<void (const Value&)>& addTarget)
+{
+	if (!type || !filter || m_TargetIndexes.empty())
+		return false;
+
+	PredicateContext context;
+	context.TargetType = type;
+	context.Variable = type->GetName().ToLower();
+	context.FilterVars = filterVars;
+
+	/* The variables EvaluateFilter() sets for each object. */
+	for (int fid = 0; fid < type->GetFieldCount(); fid++) {
+		Field field = type->GetFieldInfo(fid);
+
+		if ((field.Attributes & FANavigation) == 0)
+			continue;
+
+		/* Navigation fields such as Service#host are of the type they refer to, name references aren't. */
+		context.Objects[field.NavigationName ? field.NavigationName : field.Name] = Type::GetByName(field.RefTypeName ? field.RefTypeName : field.TypeName);
+	}
+
+	context.Objects["obj"] = type;
+	context.Objects[context.Variable] = type;
+
+	if (auto compiled = dynamic_cast<const CompiledExpression *>(filter))
+		filter = compiled->GetExpression().get();
+
+	/* Filters are compiled into a block. */
+	if (auto block = dynamic_cast<const DictExpression *>(filter)) {
+		if (block->m_Expressions.size() != 1)
+			return false;
+
+		filter = block->m_Expressions[0].get();
+	}
+
+	std::vector<FilterPredicate> predicates;
+
+	if (!ExtractPredicates(filter, context, predicates))
+		return false;
+
+	std::set<ConfigObject::Ptr> candidates;
+
+	for (const FilterPredicate& predicate : predicates) {
+		bool found = false;
+
+		for (const FilterTargetIndex& index : m_TargetIndexes) {
+			if (index(type, predicate, [&candidates](const ConfigObject::Ptr& candidate) { candidates.insert(candidate); })) {
+				found = true;
+				break;
+			}
+		}
+
+		if (!found)
+			return false;
+	}
+
+	for (const ConfigObject::Ptr& candidate : candidates)
+		addTarget(candidate);
+
+	return true;
+}
+
+/**
+ * Collects the predicates at least one of which is true if the expression is
+ * true or can fail.
+ *
+ * @return Whether the expression has such predicates
+ */
+bool FilterUtility::ExtractPredicates(const Expression *expr, const PredicateContext& context, std::vector<FilterPredicate>& predicates)
+{
+	if (dynamic_cast<const LogicalAndExpression *>(expr)) {
+		auto binary = static_cast<const BinaryExpression *>(expr);
+		std::vector<FilterPredicate> subPredicates;
+
+		/* The right side is only used if the left side can't fail for objects which aren't candidates. */
+		if (ExtractPredicates(binary->m_Operand1.get(), context, subPredicates) ||
+			(IsPurePredicate(binary->m_Operand1.get(), context) && ExtractPredicates(binary->m_Operand2.get(), context, subPredicates))) {
+			predicates.insert(predicates.end(), subPredicates.begin(), subPredicates.end());
+			return true;
+		}
+
+		return false;
+	}
+
+	if (dynamic_cast<const LogicalOrExpression *>(expr)) {
+		auto binary = static_cast<const BinaryExpression *>(expr);
+
+		return ExtractPredicates(binary->m_Operand1.get(), context, predicates) &&
+			ExtractPredicates(binary->m_Operand2.get(), context, predicates);
+	}
+
+	FilterPredicate predicate;
+
+	if (dynamic_cast<const EqualExpression *>(expr)) {
+		auto binary = static_cast<const BinaryExpression *>(expr);
+
+		if ((GetPredicatePath(binary->m_Operand1.get(), context, &predicate.Variable, &predicate.Field) &&
+			GetPredicateValue(binary->m_Operand2.get(), context, &predicate.Value)) ||
+			(GetPredicatePath(binary->m_Operand2.get(), context, &predicate.Variable, &predicate.Field) &&
+			GetPredicateValue(binary->m_Operand1.get(), context, &predicate.Value))) {
+			predicate.Type = FilterPredicate::PredicateEqual;
+			predicates.emplace_back(std::move(predicate));
+			return true;
+		}
+
+		return false;
+	}
+
+	if (dynamic_cast<const InExpression *>(expr)) {
+		auto binary = static_cast<const BinaryExpression *>(expr);
+
+		if (GetPredicateValue(binary->m_Operand1.get(), context, &predicate.Value) &&
+			GetPredicatePath(binary->m_Operand2.get(), context, &predicate.Variable, &predicate.Field)) {
+			predicate.Type = FilterPredicate::PredicateElement;
+			predicates.emplace_back(std::move(predicate));
+			return true;
+		}
+
+		return false;
+	}
+
+	if (auto call = dynamic_cast<const FunctionCallExpression *>(expr)) {
+		/* The mode argument can make match() true if any element of an array matches. */
+		if (call->m_Args.size() != 2)
+			return false;
+
+		auto fname = dynamic_cast<const VariableExpression *>(call->m_FName.get());
+
+		if (!fname || fname->GetVariable() != "match" || context.Objects.find("match") != context.Objects.end() ||
+			(context.FilterVars && context.FilterVars->Contains("match")))
+			return false;
+
+		if (GetPredicateValue(call->m_Args[0].get(), context, &predicate.Value) &&
+			GetPredicatePath(call->m_Args[1].get(), context, &predicate.Variable, &predicate.Field)) {
+			predicate.Type = FilterPredicate::PredicateMatch;
+			predicates.emplace_back(std::move(predicate));
+			return true;
+		}
+
+		return false;
+	}
+
+	return false;
+}
+
+/**
+ * Tells whether an expression reads a field of the object or one of the
+ * objects it refers to, e.g. host.name.
+ */
+bool FilterUtility::GetPredicatePath(const Expression *expr, const PredicateContext& context, String *variable, String *field)
+{
+	if (!dynamic_cast<const IndexerExpression *>(expr))
+		return false;
+
+	auto binary = static_cast<const BinaryExpression *>(expr);
+	auto object = dynamic_cast<const VariableExpression *>(binary->m_Operand1.get());
+	auto index = dynamic_cast<const LiteralExpression *>(binary->m_Operand2.get());
+
+	if (!object || !index || !index->GetValue().IsString())
+		return false;
+
+	auto it (context.Objects.find(object->GetVariable()));
+
+	if (it == context.Objects.end() || !it->second || it->second->GetFieldId(index->GetValue()) < 0)
+		return false;
+
+	*variable = it->second == context.TargetType && object->GetVariable() == "obj" ? context.Variable : object->GetVariable();
+	*field = index->GetValue();
+
+	return true;
+}
+
+/**
+ * Tells whether an expression is a string which is the same for all objects.
+ */
+bool FilterUtility::GetPredicateValue(const Expression *expr, const PredicateContext& context, String *value)
+{
+	Value result;
+
+	if (auto literal = dynamic_cast<const LiteralExpression *>(expr)) {
+		result = literal->GetValue();
+	} else if (auto variable = dynamic_cast<const VariableExpression *>(expr)) {
+		String name = variable->GetVariable();
+
+		/* The objects' variables override the filter variables. */
+		if (context.Objects.find(name) != context.Objects.end() || !context.FilterVars || !context.FilterVars->Contains(name))
+			return false;
+
+		result = context.FilterVars->Get(name);
+	} else {
+		return false;
+	}
+
+	/* Empty strings are equal to null. */
+	if (!result.IsString() || result.IsEmpty())
+		return false;
+
+	*value = result;
+	return true;
+}
+
+/**
+ * Tells whether an expression can be evaluated without side effects and
+ * without errors.
+ */
+bool FilterUtility::IsPurePredicate(const Expression *expr, const PredicateContext& context)
+{
+	String variable, field;
+
+	if (dynamic_cast<const LiteralExpression *>(expr))
+		return true;
+
+	/* Scalar filter variables, unless the objects' variables override them. */
+	if (auto var = dynamic_cast<const VariableExpression *>(expr)) {
+		String name = var->GetVariable();
+
+		return context.Objects.find(name) == context.Objects.end() && context.FilterVars &&
+			context.FilterVars->Contains(name) && !context.FilterVars->Get(name).IsObject();
+	}
+
+	/* Fields of the object itself, the objects it refers to may be null. */
+	if (GetPredicatePath(expr, context, &variable, &field))
+		return variable == context.Variable;
+
+	if (dynamic_cast<const LogicalNegateExpression *>(expr))
+		return IsPurePredicate(static_cast<const UnaryExpression *>(expr)->m_Operand.get(), context);
+
+	if (dynamic_cast<const LogicalAndExpression *>(expr) || dynamic_cast<const LogicalOrExpression *>(expr) ||
+		dynamic_cast<const EqualExpression *>(expr) || dynamic_cast<const NotEqualExpression *>(expr)) {
+		auto binary = static_cast<const BinaryExpression *>(expr);
+
+		return IsPurePredicate(binary->m_Operand1.get(), context) && IsPurePredicate(binary->m_Operand2.get(), context);
+	}
+
+	return false;
+}
+
 static void FilteredAddTarget(ScriptFrame& permissionFrame, Expression *permissionFilter,
-	ScriptFrame& frame, Expression *ufilter, std::vector<Value>& result, const String& variableName, const Object::Ptr& target)
+	ScriptFrame& frame, Expression *ufilter, std::vector<Value>& result, const String& variableName, uint_fast64_t changedSince,
+	const Object::Ptr& target)
 {
+	if (changedSince) {
+		auto object (dynamic_cast<ConfigObject *>(target.get()));
+
+		if (object && object->GetRevision() <= changedSince)
+			return;
+	}
+
 	if (FilterUtility::EvaluateFilter(permissionFrame, permissionFilter, target, variableName)) {
 		if (FilterUtility::EvaluateFilter(frame, ufilter, target, variableName)) {
 			result.emplace_back(std::move(target));
@@ -124,6 +437,137 @@ static void FilteredAddTarget(ScriptFrame& permissionFrame, Expression *permissi
 	}
 }
 
+/**
+ * Visits the targets in name order, starting after the page's cursor, and
+ * stops evaluating filters as soon as the page is full.
+ */
+static void FilteredAddTargetsPage(const TargetProvider::Ptr& provider, const String& type, const Namespace::Ptr& filterVars,
+	ScriptFrame& permissionFrame, Expression *permissionFilter, ScriptFrame& frame, Expression *ufilter,
+	std::vector<Value>& result, const String& variableName, uint_fast64_t changedSince, QueryPage& page)
+{
+	std::vector<std::pair<String, Value>> targets;
+
+	std::function<void (const Value&)> addTarget ([&provider, &targets](const Value& target) {
+		targets.emplace_back(provider->GetTargetName(target), target);
+	});
+
+	if (!ufilter || !provider->FindIndexedTargets(type, ufilter, filterVars, addTarget))
+		provider->FindTargets(type, addTarget);
+
+	std::sort(targets.begin(), targets.end(), [](const std::pair<String, Value>& a, const std::pair<String, Value>& b) {
+		return a.first < b.first;
+	});
+
+	auto it (targets.begin());
+
+	if (!page.Cursor.IsEmpty()) {
+		it = std::upper_bound(targets.begin(), targets.end(), page.Cursor, [](const String& cursor, const std::pair<String, Value>& target) {
+			return cursor < target.first;
+		});
+	}
+
+	String lastName;
+
+	for (; it != targets.end(); ++it) {
+		if (page.Limit && result.size() >= page.Limit) {
+			page.NextCursor = lastName;
+			break;
+		}
+
+		auto size (result.size());
+
+		FilteredAddTarget(permissionFrame, permissionFilter, frame, ufilter, result, variableName, changedSince, it->second);
+
+		if (result.size() != size)
+			lastName = it->first;
+	}
+}
+
+/**
+ * Compiles a filter, or returns the compiled filter from the last requests
+ * with the same text. Compiled expressions are immutable and may be
+ * evaluated by multiple requests at once.
+ */
+Expression::Ptr FilterUtility::CompileFilter(const String& filter)
+{
+	{
+		std::unique_lock<std::mutex> lock (l_FilterCacheMutex);
+		auto it (l_FilterCacheIndex.find(filter));
+
+		if (it != l_FilterCacheIndex.end()) {
+			l_FilterCache.splice(l_FilterCache.begin(), l_FilterCache, it->second);
+			return it->second->second;
+		}
+	}
+
+	/* Not under the lock. */
+	std::unique_ptr<Expression> compiled = ConfigCompiler::CompileText("<API query>", filter);
+
+	/* Syntax errors are thrown once the filter is evaluated, don't let invalid filters take cache slots. */
+	bool invalid = dynamic_cast<ThrowExpression *>(compiled.get());
+
+	Expression::Ptr expr = new CompiledExpression(compiled.release());
+
+	if (invalid)
+		return expr;
+
+	std::unique_lock<std::mutex> lock (l_FilterCacheMutex);
+	auto it (l_FilterCacheIndex.find(filter));
+
+	if (it != l_FilterCacheIndex.end())
+		return it->second->second;
+
+	l_FilterCache.emplace_front(filter, expr);
+	l_FilterCacheIndex.emplace(filter, l_FilterCache.begin());
+
+	if (l_FilterCache.size() > l_FilterCacheSize) {
+		l_FilterCacheIndex.erase(l_FilterCache.back().first);
+		l_FilterCache.pop_back();
+	}
+
+	return expr;
+}
+
+QueryPage FilterUtility::GetQueryPage(const Dictionary::Ptr& query)
+{
+	QueryPage page;
+
+	if (!query)
+		return page;
+
+	Value limit = HttpUtility::GetLastParameter(query, "limit");
+
+	if (!limit.IsEmpty()) {
+		double value = Convert::ToDouble(limit);
+
+		if (value < 0 || value != static_cast<double>(static_cast<size_t>(value)))
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid limit specified: must be a non-negative integer."));
+
+		page.Limit = value;
+	}
+
+	page.Cursor = HttpUtility::GetLastParameter(query, "cursor");
+
+	return page;
+}
+
+/**
+ * Tells whether a query returns all objects of its type which it may return
+ * at all, i.e. neither a filter of the query nor one of the user's
+ * permission restricts them. Its result then only changes with the objects.
+ *
+ * Throws like GetFilterTargets() if the user lacks the permission.
+ */
+bool FilterUtility::IsUnfilteredQuery(const QueryDescription& qd, const Dictionary::Ptr& query, const ApiUser::Ptr& user)
+{
+	Expression *permissionFilter;
+	CheckPermission(user, qd.Permission, &permissionFilter);
+
+	std::unique_ptr<Expression> permissionFilterOwner (permissionFilter);
+
+	return !permissionFilter && !(query && query->Contains("filter"));
+}
+
 void FilterUtility::CheckPermission(const ApiUser::Ptr& user, const String& permission, Expression **permissionFilter)
 {
 	if (permissionFilter)
@@ -177,7 +621,8 @@ void FilterUtility::CheckPermission(const ApiUser::Ptr& user, const String& perm
 	}
 }
 
-std::vector<Value> FilterUtility::GetFilterTargets(const QueryDescription& qd, const Dictionary::Ptr& query, const ApiUser::Ptr& user, const String& variableName)
+std::vector<Value> FilterUtility::GetFilterTargets(const QueryDescription& qd, const Dictionary::Ptr& query,
+	const ApiUser::Ptr& user, const String& variableName, QueryPage *page)
 {
 	std::vector<Value> result;
 
@@ -191,6 +636,8 @@ std::vector<Value> FilterUtility::GetFilterTargets(const QueryDescription& qd, c
 	Expression *permissionFilter;
 	CheckPermission(user, qd.Permission, &permissionFilter);
 
+	std::unique_ptr<Expression> permissionFilterOwner (permissionFilter);
+
 	Namespace::Ptr permissionFrameNS = new Namespace();
 	ScriptFrame permissionFrame(false, permissionFrameNS);
 
@@ -247,8 +694,7 @@ std::vector<Value> FilterUtility::GetFilterTargets(const QueryDescription& qd, c
 		frame.Sandboxed = true;
 
 		if (query->Contains("filter")) {
-			String filter = HttpUtility::GetLastParameter(query, "filter");
-			std::unique_ptr<Expression> ufilter = ConfigCompiler::CompileText("<API query>", filter);
+			Expression::Ptr ufilter = CompileFilter(HttpUtility::GetLastParameter(query, "filter"));
 
 			Dictionary::Ptr filter_vars = query->Get("filter_vars");
 			if (filter_vars) {
@@ -258,15 +704,24 @@ std::vector<Value> FilterUtility::GetFilterTargets(const QueryDescription& qd, c
 				}
 			}
 
-			provider->FindTargets(type, [&permissionFrame, permissionFilter, &frame, &ufilter, &result, variableName](const Object::Ptr& target) {
-				FilteredAddTarget(permissionFrame, permissionFilter, frame, &*ufilter, result, variableName, target);
-			});
+			if (page && page->IsPaginated()) {
+				FilteredAddTargetsPage(provider, type, frameNS, permissionFrame, permissionFilter, frame, &*ufilter, result, variableName, qd.ChangedSince, *page);
+			} else {
+				std::function<void (const Value&)> addTarget ([&permissionFrame, permissionFilter, &frame, &ufilter, &result, variableName, &qd](const Object::Ptr& target) {
+					FilteredAddTarget(permissionFrame, permissionFilter, frame, &*ufilter, result, variableName, qd.ChangedSince, target);
+				});
+
+				if (!provider->FindIndexedTargets(type, &*ufilter, frameNS, addTarget))
+					provider->FindTargets(type, addTarget);
+			}
+		} else if (page && page->IsPaginated()) {
+			FilteredAddTargetsPage(provider, type, frameNS, permissionFrame, permissionFilter, frame, nullptr, result, variableName, qd.ChangedSince, *page);
 		} else {
 			/* Ensure to pass a nullptr as filter expression.
 			 * GCC 8.1.1 on F28 causes problems, see GH #6533.
 			 */
-			provider->FindTargets(type, [&permissionFrame, permissionFilter, &frame, &result, variableName](const Object::Ptr& target) {
-				FilteredAddTarget(permissionFrame, permissionFilter, frame, nullptr, result, variableName, target);
+			provider->FindTargets(type, [&permissionFrame, permissionFilter, &frame, &result, variableName, &qd](const Object::Ptr& target) {
+				FilteredAddTarget(permissionFrame, permissionFilter, frame, nullptr, result, variableName, qd.ChangedSince, target);
 			});
 		}
 	}
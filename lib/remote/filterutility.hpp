@@ -8,7 +8,11 @@
 #include "config/expression.hpp"
 #include "base/dictionary.hpp"
 #include "base/configobject.hpp"
+#include "base/namespace.hpp"
+#include <functional>
+#include <map>
 #include <set>
+#include <vector>
 
 namespace icinga
 {
@@ -22,6 +26,9 @@ public:
 	virtual Value GetTargetByName(const String& type, const String& name) const = 0;
 	virtual bool IsValidType(const String& type) const = 0;
 	virtual String GetPluralName(const String& type) const = 0;
+	virtual String GetTargetName(const Value& target) const;
+	virtual bool FindIndexedTargets(const String& type, const Expression *filter, const Namespace::Ptr& filterVars,
+		const std::function<void (const Value&)>& addTarget) const;
 };
 
 class ConfigObjectTargetProvider final : public TargetProvider
@@ -33,13 +40,59 @@ public:
 	Value GetTargetByName(const String& type, const String& name) const override;
 	bool IsValidType(const String& type) const override;
 	String GetPluralName(const String& type) const override;
+	bool FindIndexedTargets(const String& type, const Expression *filter, const Namespace::Ptr& filterVars,
+		const std::function<void (const Value&)>& addTarget) const override;
 };
 
+/**
+ * A predicate which must be true for an object to match an API filter, e.g.
+ * host.name == "web1", "linux-servers" in host.groups or match("web*", host.name).
+ */
+struct FilterPredicate
+{
+	enum PredicateType
+	{
+		PredicateEqual,
+		PredicateElement,
+		PredicateMatch
+	};
+
+	PredicateType Type;
+	String Variable;
+	String Field;
+	String Value;
+};
+
+/**
+ * Looks up the objects of a type which may satisfy a predicate, e.g. the
+ * members of a group. Returns false if it doesn't know the predicate.
+ */
+typedef std::function<bool (const Type::Ptr& type, const FilterPredicate& predicate,
+	const std::function<void (const ConfigObject::Ptr&)>& addCandidate)> FilterTargetIndex;
+
 struct QueryDescription
 {
 	std::set<String> Types;
 	TargetProvider::Ptr Provider;
 	String Permission;
+
+	/* Only objects with a greater revision are searched for, see ConfigObject::GetRevision(). */
+	uint_fast64_t ChangedSince{0};
+};
+
+/**
+ * A page of query results. Targets are ordered by their name within their
+ * type, the cursor is the name of the last target of the previous page.
+ */
+struct QueryPage
+{
+	size_t Limit{0};
+	String Cursor;
+
+	/* Set if the page is full and further targets may follow. */
+	String NextCursor;
+
+	bool IsPaginated() const;
 };
 
 /**
@@ -52,10 +105,33 @@ class FilterUtility
 public:
 	static Type::Ptr TypeFromPluralName(const String& pluralName);
 	static void CheckPermission(const ApiUser::Ptr& user, const String& permission, Expression **filter = nullptr);
+	static Expression::Ptr CompileFilter(const String& filter);
+	static QueryPage GetQueryPage(const Dictionary::Ptr& query);
+	static bool IsUnfilteredQuery(const QueryDescription& qd, const Dictionary::Ptr& query, const ApiUser::Ptr& user);
 	static std::vector<Value> GetFilterTargets(const QueryDescription& qd, const Dictionary::Ptr& query,
-		const ApiUser::Ptr& user, const String& variableName = String());
+		const ApiUser::Ptr& user, const String& variableName = String(), QueryPage *page = nullptr);
 	static bool EvaluateFilter(ScriptFrame& frame, Expression *filter,
 		const Object::Ptr& target, const String& variableName = String());
+
+	static void RegisterTargetIndex(const FilterTargetIndex& index);
+	static bool FindIndexedTargets(const Type::Ptr& type, const Expression *filter, const Namespace::Ptr& filterVars,
+		const std::function<void (const Value&)>& addTarget);
+
+private:
+	struct PredicateContext
+	{
+		Type::Ptr TargetType;
+		String Variable;
+		std::map<String, Type::Ptr> Objects;
+		Namespace::Ptr FilterVars;
+	};
+
+	static std::vector<FilterTargetIndex> m_TargetIndexes;
+
+	static bool ExtractPredicates(const Expression *expr, const PredicateContext& context, std::vector<FilterPredicate>& predicates);
+	static bool GetPredicatePath(const Expression *expr, const PredicateContext& context, String *variable, String *field);
+	static bool GetPredicateValue(const Expression *expr, const PredicateContext& context, String *value);
+	static bool IsPurePredicate(const Expression *expr, const PredicateContext& context);
 };
 
 }
@@ -98,6 +98,9 @@ void HttpHandler::ProcessRequest(
 		return;
 	}
 
+	/* The handlers only look at the decoded parameters, don't keep e.g. an uploaded config package twice. */
+	std::string().swap(request.body());
+
 	bool processed = false;
 
 	/*
@@ -14,10 +14,12 @@
 #include "base/exception.hpp"
 #include "base/io-engine.hpp"
 #include "base/logger.hpp"
+#include "base/metrics.hpp"
 #include "base/objectlock.hpp"
 #include "base/timer.hpp"
 #include "base/tlsstream.hpp"
 #include "base/utility.hpp"
+#include <atomic>
 #include <limits>
 #include <memory>
 #include <stdexcept>
@@ -34,6 +36,13 @@ using namespace icinga;
 
 auto const l_ServerHeader ("Icinga/" + Application::GetAppVersion());
 
+static Histogram l_BodyReadTime ("icinga_api_request_body_read_seconds", "Time spent receiving HTTP API request bodies");
+static std::atomic<uint_fast64_t> l_BodyBytes (0);
+
+static Gauge l_BodyBytesGauge ("icinga_api_request_body_received_bytes", "Bytes of HTTP API request bodies received", "bytes", []() {
+	return l_BodyBytes.load(std::memory_order_relaxed);
+});
+
 HttpServerConnection::HttpServerConnection(const String& identity, bool authenticated, const Shared<AsioTlsStream>::Ptr& stream)
 	: HttpServerConnection(identity, authenticated, stream, IoEngine::Get().GetIoContext())
 {
@@ -64,7 +73,7 @@ void HttpServerConnection::Start()
 	HttpServerConnection::Ptr keepAlive (this);
 
 	IoEngine::SpawnCoroutine(m_IoStrand, [this, keepAlive](asio::yield_context yc) { ProcessMessages(yc); });
-	IoEngine::SpawnCoroutine(m_IoStrand, [this, keepAlive](asio::yield_context yc) { CheckLiveness(yc); });
+	IoEngine::SpawnCoroutine(m_IoStrand, [this, keepAlive](asio::yield_context yc) { CheckLiveness(yc); }, CoroutineStackSmall);
 }
 
 void HttpServerConnection::Disconnect()
@@ -101,7 +110,7 @@ void HttpServerConnection::Disconnect()
 			auto listener (ApiListener::GetInstance());
 
 			if (listener) {
-				CpuBoundWork removeHttpClient (yc);
+				CpuBoundWork removeHttpClient (yc, CpuBoundWorkApiRead);
 
 				listener->RemoveHttpClient(this);
 			}
@@ -239,7 +248,7 @@ bool HandleAccessControl(
 		auto headerAllowOrigin (listener->GetAccessControlAllowOrigin());
 
 		if (headerAllowOrigin) {
-			CpuBoundWork allowOriginHeader (yc);
+			CpuBoundWork allowOriginHeader (yc, CpuBoundWorkApiRead);
 
 			auto allowedOrigins (headerAllowOrigin->ToSet<String>());
 
@@ -353,6 +362,7 @@ bool EnsureValidBody(
 	ApiUser::Ptr& authenticatedUser,
 	boost::beast::http::response<boost::beast::http::string_body>& response,
 	bool& shuttingDown,
+	double& seen,
 	boost::asio::yield_context& yc
 )
 {
@@ -363,7 +373,7 @@ bool EnsureValidBody(
 		Array::Ptr permissions = authenticatedUser->GetPermissions();
 
 		if (permissions) {
-			CpuBoundWork evalPermissions (yc);
+			CpuBoundWork evalPermissions (yc, CpuBoundWorkApiRead);
 
 			ObjectLock olock(permissions);
 
@@ -400,7 +410,26 @@ bool EnsureValidBody(
 
 	boost::system::error_code ec;
 
-	http::async_read(stream, buf, parser, yc[ec]);
+	{
+		auto start (Histogram::Clock::now());
+
+		/* Large uploads, e.g. config packages, may take longer than the liveness timeout. */
+		while (!parser.is_done()) {
+			http::async_read_some(stream, buf, parser, yc[ec]);
+
+			if (ec)
+				break;
+
+			seen = Utility::GetTime();
+		}
+
+		size_t received = parser.get().body().size();
+
+		if (received) {
+			l_BodyReadTime.ObserveSince(start);
+			l_BodyBytes.fetch_add(received, std::memory_order_relaxed);
+		}
+	}
 
 	if (ec) {
 		if (ec == boost::asio::error::operation_aborted)
@@ -450,12 +479,15 @@ bool ProcessRequest(
 {
 	namespace http = boost::beast::http;
 
+	/* Queries are often POSTed with "X-HTTP-Method-Override: GET" because of their request body. */
+	bool isRead = request.method() == http::verb::get || request["X-HTTP-Method-Override"] == "GET";
+
 	try {
-		CpuBoundWork handlingRequest (yc);
+		CpuBoundWork handlingRequest (yc, isRead ? CpuBoundWorkApiRead : CpuBoundWorkApiWrite);
 
 		HttpHandler::ProcessRequest(stream, authenticatedUser, request, response, yc, server);
 	} catch (const std::exception& ex) {
-		if (hasStartedStreaming) {
+		if (hasStartedStreaming || response.chunked()) {
 			return false;
 		}
 
@@ -481,6 +513,11 @@ bool ProcessRequest(
 		return false;
 	}
 
+	/* Chunked responses have already been written by the handler. */
+	if (response.chunked()) {
+		return true;
+	}
+
 	boost::system::error_code ec;
 
 	http::async_write(stream, response, yc[ec]);
@@ -534,7 +571,7 @@ void HttpServerConnection::ProcessMessages(boost::asio::yield_context yc)
 			auto authenticatedUser (m_ApiUser);
 
 			if (!authenticatedUser) {
-				CpuBoundWork fetchingAuthenticatedUser (yc);
+				CpuBoundWork fetchingAuthenticatedUser (yc, CpuBoundWorkApiRead);
 
 				authenticatedUser = ApiUser::GetByAuthHeader(request[http::field::authorization].to_string());
 			}
@@ -562,7 +599,7 @@ void HttpServerConnection::ProcessMessages(boost::asio::yield_context yc)
 				break;
 			}
 
-			if (!EnsureValidBody(*m_Stream, buf, parser, authenticatedUser, response, m_ShuttingDown, yc)) {
+			if (!EnsureValidBody(*m_Stream, buf, parser, authenticatedUser, response, m_ShuttingDown, m_Seen, yc)) {
 				break;
 			}
 
@@ -2,11 +2,15 @@
 
 #include "remote/httputility.hpp"
 #include "remote/url.hpp"
+#include "base/io-engine.hpp"
 #include "base/json.hpp"
 #include "base/logger.hpp"
+#include <functional>
 #include <map>
+#include <sstream>
 #include <string>
 #include <vector>
+#include <boost/asio/write.hpp>
 #include <boost/beast/http.hpp>
 
 using namespace icinga;
@@ -19,7 +23,8 @@ Dictionary::Ptr HttpUtility::FetchRequestParameters(const Url::Ptr& url, const s
 		Log(LogDebug, "HttpUtility")
 			<< "Request body: '" << body << '\'';
 
-		result = JsonDecode(body);
+		/* Not converted to a String first, bodies may be as large as config packages. */
+		result = JsonDecodeRange(body.data(), body.data() + body.size());
 	}
 
 	if (!result)
@@ -75,6 +80,119 @@ void HttpUtility::SendJsonError(boost::beast::http::response<boost::beast::http:
 	}
 
 	response.result(code);
+	response.erase(boost::beast::http::field::etag);
 
 	HttpUtility::SendJsonBody(response, params, result);
 }
+
+/**
+ * Sets the entity tag of a query's result and answers with 304 Not Modified
+ * if the client already has that result (If-None-Match). The tag consists of
+ * the revision and a hash of the parameters and the user, as the parameters
+ * may also be passed in the request body and the permissions differ.
+ *
+ * @param revision Changes whenever the result of the query may change
+ * @return true if the response has been turned into 304 Not Modified
+ */
+bool HttpUtility::SendNotModified(const boost::beast::http::request<boost::beast::http::string_body>& request,
+	boost::beast::http::response<boost::beast::http::string_body>& response, const Dictionary::Ptr& params,
+	const ApiUser::Ptr& user, const String& revision)
+{
+	namespace http = boost::beast::http;
+
+	std::ostringstream msgbuf;
+	msgbuf << '"' << revision << '-' << std::hex
+		<< std::hash<std::string>()(JsonEncode(params) + "\n" + (user ? user->GetName() : String()).GetData()) << '"';
+
+	String etag = msgbuf.str();
+
+	response.set(http::field::etag, etag);
+
+	auto ifNoneMatch (request[http::field::if_none_match]);
+
+	if (ifNoneMatch.empty())
+		return false;
+
+	for (String tag : String(ifNoneMatch.data(), ifNoneMatch.data() + ifNoneMatch.size()).Split(",")) {
+		tag = tag.Trim();
+
+		/* Weak comparison, see RFC 7232 3.2. */
+		if (tag.SubStr(0, 2) == "W/")
+			tag = tag.SubStr(2);
+
+		if (tag == etag || tag == "*") {
+			response.result(http::status::not_modified);
+			response.body().clear();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Encoded JSON is sent in chunks of about this size. */
+static const size_t l_JsonChunkSize = 64 * 1024;
+
+ChunkedJsonResponse::ChunkedJsonResponse(AsioTlsStream& stream, boost::beast::http::response<boost::beast::http::string_body>& response,
+	const Dictionary::Ptr& params, boost::asio::yield_context& yc)
+	: m_Stream(stream), m_Response(response), m_Yc(yc), m_PrettyPrint(params && HttpUtility::GetLastParameter(params, "pretty")),
+	m_HeaderSent(false), m_Encoder(m_PrettyPrint)
+{ }
+
+JsonStreamEncoder& ChunkedJsonResponse::GetEncoder()
+{
+	return m_Encoder;
+}
+
+/**
+ * Sends what has been encoded so far, starting with the header. Unless
+ * forced, waits until a chunk is worth sending.
+ */
+void ChunkedJsonResponse::Flush(bool force)
+{
+	namespace asio = boost::asio;
+	namespace http = boost::beast::http;
+
+	if (!force && m_Encoder.GetLength() < l_JsonChunkSize)
+		return;
+
+	String chunk = m_Encoder.TakeResult();
+
+	IoBoundWorkSlot dontLockTheIoThread (m_Yc, CpuBoundWorkApiRead);
+
+	if (!m_HeaderSent) {
+		m_Response.result(http::status::ok);
+		m_Response.set(http::field::content_type, "application/json");
+		m_Response.chunked(true);
+
+		http::response_serializer<http::string_body> serializer (m_Response);
+		http::async_write_header(m_Stream, serializer, m_Yc);
+
+		m_HeaderSent = true;
+	}
+
+	if (!chunk.IsEmpty())
+		asio::async_write(m_Stream, http::make_chunk(asio::const_buffer(chunk.CStr(), chunk.GetLength())), m_Yc);
+
+	m_Stream.async_flush(m_Yc);
+}
+
+/**
+ * Sends the rest of the document and terminates the response.
+ */
+void ChunkedJsonResponse::Finish()
+{
+	namespace asio = boost::asio;
+	namespace http = boost::beast::http;
+
+	Flush(true);
+
+	IoBoundWorkSlot dontLockTheIoThread (m_Yc, CpuBoundWorkApiRead);
+
+	/* Like HttpUtility::SendJsonBody(). */
+	if (m_PrettyPrint)
+		asio::async_write(m_Stream, http::make_chunk(asio::buffer("\n", 1)), m_Yc);
+
+	asio::async_write(m_Stream, http::make_chunk_last(), m_Yc);
+	m_Stream.async_flush(m_Yc);
+}
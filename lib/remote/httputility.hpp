@@ -3,8 +3,12 @@
 #ifndef HTTPUTILITY_H
 #define HTTPUTILITY_H
 
+#include "remote/apiuser.hpp"
 #include "remote/url.hpp"
 #include "base/dictionary.hpp"
+#include "base/json.hpp"
+#include "base/tlsstream.hpp"
+#include <boost/asio/spawn.hpp>
 #include <boost/beast/http.hpp>
 #include <string>
 
@@ -26,6 +30,36 @@ public:
 	static void SendJsonBody(boost::beast::http::response<boost::beast::http::string_body>& response, const Dictionary::Ptr& params, const Value& val);
 	static void SendJsonError(boost::beast::http::response<boost::beast::http::string_body>& response, const Dictionary::Ptr& params, const int code,
 		const String& verbose = String(), const String& diagnosticInformation = String());
+	static bool SendNotModified(const boost::beast::http::request<boost::beast::http::string_body>& request,
+		boost::beast::http::response<boost::beast::http::string_body>& response, const Dictionary::Ptr& params,
+		const ApiUser::Ptr& user, const String& revision);
+};
+
+/**
+ * Sends a JSON document with chunked transfer encoding while it's being
+ * encoded. Nothing is sent before the first Flush(), so the response may
+ * still be turned into an error until then.
+ *
+ * @ingroup remote
+ */
+class ChunkedJsonResponse
+{
+public:
+	ChunkedJsonResponse(AsioTlsStream& stream, boost::beast::http::response<boost::beast::http::string_body>& response,
+		const Dictionary::Ptr& params, boost::asio::yield_context& yc);
+
+	JsonStreamEncoder& GetEncoder();
+
+	void Flush(bool force = false);
+	void Finish();
+
+private:
+	AsioTlsStream& m_Stream;
+	boost::beast::http::response<boost::beast::http::string_body>& m_Response;
+	boost::asio::yield_context& m_Yc;
+	bool m_PrettyPrint;
+	bool m_HeaderSent;
+	JsonStreamEncoder m_Encoder;
 };
 
 }
@@ -1,8 +1,10 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "remote/jsonrpc.hpp"
+#include "remote/jsonrpccompression.hpp"
 #include "base/netstring.hpp"
 #include "base/json.hpp"
+#include "base/object-packer.hpp"
 #include "base/console.hpp"
 #include "base/scriptglobal.hpp"
 #include "base/convert.hpp"
@@ -43,6 +45,24 @@ static bool GetDebugJsonRpcCached()
 
 	return debugJsonRpc;
 }
+
+/**
+ * Render a (possibly binary) message readable for debugging.
+ *
+ * @param message The raw message
+ *
+ * @return JSON string
+ */
+static String GetDebugMessage(const String& message)
+{
+	if (JsonRpcCompression::IsCompressedMessage(message))
+		return "(" + Convert::ToString(message.GetLength()) + " bytes compressed)";
+
+	if (JsonRpc::IsBinaryMessage(message))
+		return JsonEncode(UnpackObject(message));
+
+	return message;
+}
 #endif /* I2_DEBUG */
 
 /**
@@ -58,7 +78,7 @@ size_t JsonRpc::SendMessage(const Shared<AsioTlsStream>::Ptr& stream, const Dict
 
 #ifdef I2_DEBUG
 	if (GetDebugJsonRpcCached())
-		std::cerr << ConsoleColorTag(Console_ForegroundBlue) << ">> " << json << ConsoleColorTag(Console_Normal) << "\n";
+		std::cerr << ConsoleColorTag(Console_ForegroundBlue) << ">> " << GetDebugMessage(json) << ConsoleColorTag(Console_Normal) << "\n";
 #endif /* I2_DEBUG */
 
 	return NetString::WriteStringToStream(stream, json);
@@ -89,12 +109,30 @@ size_t JsonRpc::SendRawMessage(const Shared<AsioTlsStream>::Ptr& stream, const S
 {
 #ifdef I2_DEBUG
 	if (GetDebugJsonRpcCached())
-		std::cerr << ConsoleColorTag(Console_ForegroundBlue) << ">> " << json << ConsoleColorTag(Console_Normal) << "\n";
+		std::cerr << ConsoleColorTag(Console_ForegroundBlue) << ">> " << GetDebugMessage(json) << ConsoleColorTag(Console_Normal) << "\n";
 #endif /* I2_DEBUG */
 
 	return NetString::WriteStringToStream(stream, json, yc);
 }
 
+/**
+ * Appends a raw message to a buffer to be sent later together with other messages.
+ *
+ * @param buffer Buffer of messages in netstring format
+ * @param json message
+ *
+ * @return bytes appended
+ */
+size_t JsonRpc::AppendRawMessage(std::string& buffer, const String& json)
+{
+#ifdef I2_DEBUG
+	if (GetDebugJsonRpcCached())
+		std::cerr << ConsoleColorTag(Console_ForegroundBlue) << ">> " << GetDebugMessage(json) << ConsoleColorTag(Console_Normal) << "\n";
+#endif /* I2_DEBUG */
+
+	return NetString::AppendStringToBuffer(buffer, json);
+}
+
 /**
  * Reads a message from the connected peer.
  *
@@ -110,7 +148,7 @@ String JsonRpc::ReadMessage(const Shared<AsioTlsStream>::Ptr& stream, ssize_t ma
 
 #ifdef I2_DEBUG
 	if (GetDebugJsonRpcCached())
-		std::cerr << ConsoleColorTag(Console_ForegroundBlue) << "<< " << jsonString << ConsoleColorTag(Console_Normal) << "\n";
+		std::cerr << ConsoleColorTag(Console_ForegroundBlue) << "<< " << GetDebugMessage(jsonString) << ConsoleColorTag(Console_Normal) << "\n";
 #endif /* I2_DEBUG */
 
 	return std::move(jsonString);
@@ -120,33 +158,63 @@ String JsonRpc::ReadMessage(const Shared<AsioTlsStream>::Ptr& stream, ssize_t ma
  * Reads a message from the connected peer.
  *
  * @param stream ASIO TLS Stream
+ * @param reader The connection's reader
  * @param yc Yield Context for ASIO
  * @param maxMessageLength maximum size of bytes read.
  *
- * @return A JSON string
+ * @return The raw message, valid until the next message is read
  */
-String JsonRpc::ReadMessage(const Shared<AsioTlsStream>::Ptr& stream, boost::asio::yield_context yc, ssize_t maxMessageLength)
+boost::string_view JsonRpc::ReadMessage(const Shared<AsioTlsStream>::Ptr& stream, NetStringReader& reader,
+	boost::asio::yield_context yc, ssize_t maxMessageLength)
 {
-	String jsonString = NetString::ReadStringFromStream(stream, yc, maxMessageLength);
+	boost::string_view message = reader.ReadString(stream, yc, maxMessageLength);
 
 #ifdef I2_DEBUG
 	if (GetDebugJsonRpcCached())
-		std::cerr << ConsoleColorTag(Console_ForegroundBlue) << "<< " << jsonString << ConsoleColorTag(Console_Normal) << "\n";
+		std::cerr << ConsoleColorTag(Console_ForegroundBlue) << "<< " << GetDebugMessage(String(message.begin(), message.end())) << ConsoleColorTag(Console_Normal) << "\n";
 #endif /* I2_DEBUG */
 
-	return std::move(jsonString);
+	return message;
+}
+
+/**
+ * Encode a message in the binary format (see PackObject()).
+ *
+ * Only peers which advertised ApiCapabilities::BinaryMessages understand it.
+ *
+ * @param message Dictionary ptr
+ *
+ * @return Binary string
+ */
+String JsonRpc::EncodeBinaryMessage(const Dictionary::Ptr& message)
+{
+	return PackObject(message);
+}
+
+/**
+ * Determine whether a raw message is in the binary format.
+ *
+ * JSON messages start with '{', packed dictionaries with their type byte.
+ *
+ * @param message Raw message
+ *
+ * @return Whether it's binary
+ */
+bool JsonRpc::IsBinaryMessage(boost::string_view message)
+{
+	return !message.empty() && message[0] == '\6';
 }
 
 /**
  * Decode message, enforce a Dictionary
  *
- * @param message JSON string
+ * @param message JSON or binary string
  *
  * @return Dictionary ptr
  */
-Dictionary::Ptr JsonRpc::DecodeMessage(const String& message)
+Dictionary::Ptr JsonRpc::DecodeMessage(boost::string_view message)
 {
-	Value value = JsonDecode(message);
+	Value value = IsBinaryMessage(message) ? UnpackObject(message) : JsonDecodeRange(message.begin(), message.end());
 
 	if (!value.IsObjectType<Dictionary>()) {
 		BOOST_THROW_EXCEPTION(std::invalid_argument("JSON-RPC"
@@ -155,3 +223,42 @@ Dictionary::Ptr JsonRpc::DecodeMessage(const String& message)
 
 	return value;
 }
+
+JsonRpcSharedMessage::JsonRpcSharedMessage(Dictionary::Ptr message, Dictionary::Ptr compactMessage)
+	: m_Message(std::move(message)), m_CompactMessage(std::move(compactMessage))
+{
+}
+
+const Dictionary::Ptr& JsonRpcSharedMessage::GetMessage() const
+{
+	return m_Message;
+}
+
+/**
+ * Encode the message, unless already done. Thread-safe.
+ *
+ * @param binary Whether to encode it in the binary format instead of JSON
+ * @param compact Whether to encode the compact variant of the message if there is one
+ *
+ * @return The encoded message, must not be modified
+ */
+const Shared<String>::Ptr& JsonRpcSharedMessage::GetEncoded(bool binary, bool compact)
+{
+	if (compact && m_CompactMessage) {
+		if (binary) {
+			std::call_once(m_CompactBinaryOnce, [this]() { m_CompactBinary = Shared<String>::Make(JsonRpc::EncodeBinaryMessage(m_CompactMessage)); });
+			return m_CompactBinary;
+		}
+
+		std::call_once(m_CompactJsonOnce, [this]() { m_CompactJson = Shared<String>::Make(JsonEncode(m_CompactMessage)); });
+		return m_CompactJson;
+	}
+
+	if (binary) {
+		std::call_once(m_BinaryOnce, [this]() { m_Binary = Shared<String>::Make(JsonRpc::EncodeBinaryMessage(m_Message)); });
+		return m_Binary;
+	}
+
+	std::call_once(m_JsonOnce, [this]() { m_Json = Shared<String>::Make(JsonEncode(m_Message)); });
+	return m_Json;
+}
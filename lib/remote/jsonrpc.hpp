@@ -5,10 +5,16 @@
 
 #include "base/stream.hpp"
 #include "base/dictionary.hpp"
+#include "base/netstring.hpp"
+#include "base/shared.hpp"
+#include "base/shared-object.hpp"
 #include "base/tlsstream.hpp"
 #include "remote/i2-remote.hpp"
 #include <memory>
+#include <mutex>
+#include <string>
 #include <boost/asio/spawn.hpp>
+#include <boost/utility/string_view.hpp>
 
 namespace icinga
 {
@@ -24,16 +30,46 @@ public:
 	static size_t SendMessage(const Shared<AsioTlsStream>::Ptr& stream, const Dictionary::Ptr& message);
 	static size_t SendMessage(const Shared<AsioTlsStream>::Ptr& stream, const Dictionary::Ptr& message, boost::asio::yield_context yc);
 	static size_t SendRawMessage(const Shared<AsioTlsStream>::Ptr& stream, const String& json, boost::asio::yield_context yc);
+	static size_t AppendRawMessage(std::string& buffer, const String& json);
 
 	static String ReadMessage(const Shared<AsioTlsStream>::Ptr& stream, ssize_t maxMessageLength = -1);
-	static String ReadMessage(const Shared<AsioTlsStream>::Ptr& stream, boost::asio::yield_context yc, ssize_t maxMessageLength = -1);
+	static boost::string_view ReadMessage(const Shared<AsioTlsStream>::Ptr& stream, NetStringReader& reader,
+		boost::asio::yield_context yc, ssize_t maxMessageLength = -1);
 
-	static Dictionary::Ptr DecodeMessage(const String& message);
+	static String EncodeBinaryMessage(const Dictionary::Ptr& message);
+	static bool IsBinaryMessage(boost::string_view message);
+	static Dictionary::Ptr DecodeMessage(boost::string_view message);
 
 private:
 	JsonRpc();
 };
 
+/**
+ * A message sent to several connections. Each format is encoded only once,
+ * by whichever connection needs it first, and the encoded buffer is shared.
+ *
+ * @ingroup remote
+ */
+class JsonRpcSharedMessage final : public SharedObject
+{
+public:
+	typedef boost::intrusive_ptr<JsonRpcSharedMessage> Ptr;
+
+	explicit JsonRpcSharedMessage(Dictionary::Ptr message, Dictionary::Ptr compactMessage = nullptr);
+
+	const Dictionary::Ptr& GetMessage() const;
+	const Shared<String>::Ptr& GetEncoded(bool binary, bool compact = false);
+
+private:
+	Dictionary::Ptr m_Message;
+	std::once_flag m_JsonOnce, m_BinaryOnce;
+	Shared<String>::Ptr m_Json, m_Binary;
+
+	Dictionary::Ptr m_CompactMessage;
+	std::once_flag m_CompactJsonOnce, m_CompactBinaryOnce;
+	Shared<String>::Ptr m_CompactJson, m_CompactBinary;
+};
+
 }
 
 #endif /* JSONRPC_H */
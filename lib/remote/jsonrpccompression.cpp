@@ -0,0 +1,218 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/jsonrpccompression.hpp"
+#include "base/exception.hpp"
+#include <chrono>
+#include <stdexcept>
+#include <string>
+
+using namespace icinga;
+
+JsonRpcCompressionStats JsonRpcCompression::Stats;
+
+/**
+ * The first byte of a compressed message.
+ * Differs from both JSON ('{') and the binary message format (0x06).
+ */
+static const char l_CompressedMessageMarker = '\x1f';
+
+#ifdef HAVE_ZLIB
+
+/**
+ * Adds the time elapsed since start to the compression statistics.
+ */
+static inline void AddDuration(std::chrono::steady_clock::time_point start)
+{
+	JsonRpcCompression::Stats.Duration.fetch_add(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()
+	);
+}
+
+JsonRpcCompressor::JsonRpcCompressor()
+{
+	m_Stream.zalloc = Z_NULL;
+	m_Stream.zfree = Z_NULL;
+	m_Stream.opaque = Z_NULL;
+
+	/* Raw deflate (negative window bits), we have our own framing. */
+	if (deflateInit2(&m_Stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		BOOST_THROW_EXCEPTION(std::runtime_error("deflateInit2() failed."));
+	}
+}
+
+JsonRpcCompressor::~JsonRpcCompressor()
+{
+	deflateEnd(&m_Stream);
+}
+
+/**
+ * Compresses a message.
+ *
+ * @param message The raw (JSON or binary) message
+ *
+ * @return The compressed message including the marker byte
+ */
+String JsonRpcCompressor::Compress(const String& message)
+{
+	auto start (std::chrono::steady_clock::now());
+
+	std::string compressed (1, l_CompressedMessageMarker);
+	size_t offset = 1;
+
+	compressed.resize(offset + deflateBound(&m_Stream, message.GetLength()) + 16u);
+
+	m_Stream.next_in = (Bytef*)message.CStr();
+	m_Stream.avail_in = message.GetLength();
+
+	do {
+		if (offset == compressed.size()) {
+			compressed.resize(compressed.size() * 2u);
+		}
+
+		m_Stream.next_out = (Bytef*)&compressed[offset];
+		m_Stream.avail_out = compressed.size() - offset;
+
+		if (deflate(&m_Stream, Z_SYNC_FLUSH) == Z_STREAM_ERROR) {
+			BOOST_THROW_EXCEPTION(std::runtime_error("deflate() failed."));
+		}
+
+		offset = compressed.size() - m_Stream.avail_out;
+	} while (m_Stream.avail_out == 0u);
+
+	compressed.resize(offset);
+
+	JsonRpcCompression::Stats.Uncompressed.fetch_add(message.GetLength());
+	JsonRpcCompression::Stats.Compressed.fetch_add(compressed.size());
+	AddDuration(start);
+
+	return std::move(compressed);
+}
+
+JsonRpcDecompressor::JsonRpcDecompressor()
+{
+	m_Stream.zalloc = Z_NULL;
+	m_Stream.zfree = Z_NULL;
+	m_Stream.opaque = Z_NULL;
+	m_Stream.next_in = Z_NULL;
+	m_Stream.avail_in = 0;
+
+	if (inflateInit2(&m_Stream, -15) != Z_OK) {
+		BOOST_THROW_EXCEPTION(std::runtime_error("inflateInit2() failed."));
+	}
+}
+
+JsonRpcDecompressor::~JsonRpcDecompressor()
+{
+	inflateEnd(&m_Stream);
+}
+
+/**
+ * Decompresses a message.
+ *
+ * @param message The compressed message including the marker byte
+ * @param maxMessageLength maximum size of the decompressed message in bytes
+ *
+ * @return The raw (JSON or binary) message
+ */
+String JsonRpcDecompressor::Decompress(boost::string_view message, ssize_t maxMessageLength)
+{
+	auto start (std::chrono::steady_clock::now());
+
+	std::string decompressed;
+	size_t offset = 0;
+
+	decompressed.resize(message.size() * 4u + 64u);
+
+	m_Stream.next_in = (Bytef*)message.data() + 1;
+	m_Stream.avail_in = message.size() - 1u;
+
+	do {
+		if (offset == decompressed.size()) {
+			if (maxMessageLength >= 0 && decompressed.size() >= (size_t)maxMessageLength) {
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Decompressed message must not exceed "
+					+ std::to_string(maxMessageLength) + " bytes."));
+			}
+
+			decompressed.resize(decompressed.size() * 2u);
+		}
+
+		m_Stream.next_out = (Bytef*)&decompressed[offset];
+		m_Stream.avail_out = decompressed.size() - offset;
+
+		switch (inflate(&m_Stream, Z_SYNC_FLUSH)) {
+			case Z_OK:
+			case Z_BUF_ERROR:
+				break;
+			default:
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid compressed message."));
+		}
+
+		offset = decompressed.size() - m_Stream.avail_out;
+	} while (m_Stream.avail_in > 0u || m_Stream.avail_out == 0u);
+
+	decompressed.resize(offset);
+
+	if (maxMessageLength >= 0 && decompressed.size() > (size_t)maxMessageLength) {
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Decompressed message must not exceed "
+			+ std::to_string(maxMessageLength) + " bytes."));
+	}
+
+	JsonRpcCompression::Stats.Uncompressed.fetch_add(decompressed.size());
+	JsonRpcCompression::Stats.Compressed.fetch_add(message.size());
+	AddDuration(start);
+
+	return std::move(decompressed);
+}
+
+#endif /* HAVE_ZLIB */
+
+/**
+ * Whether this build is able to (de)compress messages.
+ *
+ * @return true if built with zlib
+ */
+bool JsonRpcCompression::IsSupported()
+{
+#ifdef HAVE_ZLIB
+	return true;
+#else /* HAVE_ZLIB */
+	return false;
+#endif /* HAVE_ZLIB */
+}
+
+/**
+ * Determine whether a raw message is compressed.
+ *
+ * @param message Raw message
+ *
+ * @return Whether it's compressed
+ */
+bool JsonRpcCompression::IsCompressedMessage(boost::string_view message)
+{
+	return !message.empty() && message[0] == l_CompressedMessageMarker;
+}
+
+/**
+ * Uncompressed bytes per compressed byte sent and received so far.
+ *
+ * @return The ratio, 0 if nothing was compressed yet
+ */
+double JsonRpcCompression::GetRatio()
+{
+	double compressed = Stats.Compressed.load();
+
+	if (compressed == 0)
+		return 0;
+
+	return Stats.Uncompressed.load() / compressed;
+}
+
+/**
+ * CPU time spent in (de)compression so far.
+ *
+ * @return Seconds
+ */
+double JsonRpcCompression::GetCpuTime()
+{
+	return Stats.Duration.load() / 1e9;
+}
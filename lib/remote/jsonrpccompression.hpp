@@ -0,0 +1,103 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef JSONRPCCOMPRESSION_H
+#define JSONRPCCOMPRESSION_H
+
+#include "remote/i2-remote.hpp"
+#include "base/string.hpp"
+#include <atomic>
+#include <cstdint>
+#include <sys/types.h>
+
+#ifdef HAVE_ZLIB
+#	include <zlib.h>
+#endif /* HAVE_ZLIB */
+
+namespace icinga
+{
+
+/**
+ * Compression statistics of all JSON-RPC connections.
+ *
+ * @ingroup remote
+ */
+struct JsonRpcCompressionStats
+{
+	/* Bytes before compression and after decompression */
+	std::atomic<uint_fast64_t> Uncompressed;
+	/* Bytes on the wire */
+	std::atomic<uint_fast64_t> Compressed;
+	/* Nanoseconds spent in (de)compression */
+	std::atomic<uint_fast64_t> Duration;
+};
+
+#ifdef HAVE_ZLIB
+
+/**
+ * Streaming deflate compression of outgoing JSON-RPC messages.
+ *
+ * All messages of a connection share one deflate stream (and so the history window).
+ * Every message gets flushed (Z_SYNC_FLUSH) so the peer can decode it immediately.
+ *
+ * @ingroup remote
+ */
+class JsonRpcCompressor
+{
+public:
+	JsonRpcCompressor();
+	~JsonRpcCompressor();
+
+	JsonRpcCompressor(const JsonRpcCompressor&) = delete;
+	JsonRpcCompressor& operator=(const JsonRpcCompressor&) = delete;
+
+	String Compress(const String& message);
+
+private:
+	z_stream m_Stream;
+};
+
+/**
+ * Streaming inflate decompression of incoming JSON-RPC messages.
+ *
+ * @ingroup remote
+ */
+class JsonRpcDecompressor
+{
+public:
+	JsonRpcDecompressor();
+	~JsonRpcDecompressor();
+
+	JsonRpcDecompressor(const JsonRpcDecompressor&) = delete;
+	JsonRpcDecompressor& operator=(const JsonRpcDecompressor&) = delete;
+
+	String Decompress(boost::string_view message, ssize_t maxMessageLength = -1);
+
+private:
+	z_stream m_Stream;
+};
+
+#endif /* HAVE_ZLIB */
+
+/**
+ * Helpers for compressed JSON-RPC messages.
+ *
+ * @ingroup remote
+ */
+class JsonRpcCompression
+{
+public:
+	static bool IsSupported();
+	static bool IsCompressedMessage(boost::string_view message);
+
+	static double GetRatio();
+	static double GetCpuTime();
+
+	static JsonRpcCompressionStats Stats;
+
+private:
+	JsonRpcCompression();
+};
+
+}
+
+#endif /* JSONRPCCOMPRESSION_H */
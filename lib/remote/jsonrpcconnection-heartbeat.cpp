@@ -7,42 +7,131 @@
 #include "base/configtype.hpp"
 #include "base/logger.hpp"
 #include "base/utility.hpp"
-#include <boost/asio/spawn.hpp>
-#include <boost/date_time/posix_time/posix_time_duration.hpp>
-#include <boost/system/system_error.hpp>
+#include <boost/thread/once.hpp>
 
 using namespace icinga;
 
 REGISTER_APIFUNCTION(Heartbeat, event, &JsonRpcConnection::HeartbeatAPIHandler);
 
+/* The wheel advances by one slot per second, so each connection is visited every that many seconds. */
+static const size_t l_LivenessSlots = 20;
+
+std::mutex JsonRpcConnection::m_LivenessMutex;
+std::vector<std::set<JsonRpcConnection::Ptr>> JsonRpcConnection::m_LivenessWheel (l_LivenessSlots);
+size_t JsonRpcConnection::m_LivenessCursor = 0;
+size_t JsonRpcConnection::m_LivenessNext = 0;
+Timer::Ptr JsonRpcConnection::m_LivenessTimer;
+
 /**
- * We still send a heartbeat without timeout here
- * to keep the m_Seen variable up to date. This is to keep the
- * cluster connection alive when there isn't much going on.
+ * Lets the timer wheel check this connection's liveness and send it heartbeats.
+ *
+ * Authenticated connections are spread evenly across the slots. Anonymous ones
+ * are put half a round ahead of the cursor to be closed after about 10 seconds.
  */
+void JsonRpcConnection::RegisterLiveness()
+{
+	static boost::once_flag once = BOOST_ONCE_INIT;
+
+	boost::call_once(once, []() {
+		m_LivenessTimer = new Timer();
+		m_LivenessTimer->SetInterval(1);
+		m_LivenessTimer->OnTimerExpired.connect([](const Timer * const&) { LivenessTimerHandler(); });
+		m_LivenessTimer->Start();
+	});
+
+	std::unique_lock<std::mutex> lock (m_LivenessMutex);
+
+	if (m_Authenticated) {
+		m_LivenessSlot = m_LivenessNext++ % l_LivenessSlots;
+	} else {
+		m_LivenessSlot = (m_LivenessCursor + l_LivenessSlots / 2u) % l_LivenessSlots;
+	}
+
+	m_LivenessWheel[m_LivenessSlot].emplace(this);
+}
+
+void JsonRpcConnection::UnregisterLiveness()
+{
+	std::unique_lock<std::mutex> lock (m_LivenessMutex);
+
+	m_LivenessWheel[m_LivenessSlot].erase(this);
+}
+
+/**
+ * Visits the connections of the current slot. All of them share one encoded heartbeat.
+ */
+void JsonRpcConnection::LivenessTimerHandler()
+{
+	std::vector<JsonRpcConnection::Ptr> clients;
+
+	{
+		std::unique_lock<std::mutex> lock (m_LivenessMutex);
+		auto& slot (m_LivenessWheel[m_LivenessCursor]);
+
+		clients.assign(slot.begin(), slot.end());
+		m_LivenessCursor = (m_LivenessCursor + 1u) % l_LivenessSlots;
+	}
+
+	if (clients.empty()) {
+		return;
+	}
+
+	JsonRpcSharedMessage::Ptr heartbeat = new JsonRpcSharedMessage(new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", "event::Heartbeat" },
+		{ "params", new Dictionary() }
+	}));
+
+	for (auto& client : clients) {
+		client->m_IoStrand.post([client, heartbeat]() { client->CheckLiveness(heartbeat); });
+	}
+}
 
-void JsonRpcConnection::HandleAndWriteHeartbeats(boost::asio::yield_context yc)
+/**
+ * Closes stale connections, otherwise sends them a heartbeat. Must be called in m_IoStrand.
+ *
+ * @param heartbeat The heartbeat message to send
+ */
+void JsonRpcConnection::CheckLiveness(const JsonRpcSharedMessage::Ptr& heartbeat)
 {
-	boost::system::error_code ec;
-
-	for (;;) {
-		m_HeartbeatTimer.expires_from_now(boost::posix_time::seconds(20));
-		m_HeartbeatTimer.async_wait(yc[ec]);
-
-		if (m_ShuttingDown) {
-			break;
-		}
-		
-		SendMessageInternal(new Dictionary({
-			{ "jsonrpc", "2.0" },
-			{ "method", "event::Heartbeat" },
-			{ "params", new Dictionary() }
-		}));
+	if (m_ShuttingDown) {
+		return;
 	}
+
+	if (!m_Authenticated) {
+		/* Anonymous connections are normally only used for requesting a certificate and are closed after this request
+		 * is received. However, the request is only sent if the child has successfully verified the certificate of its
+		 * parent so that it is an authenticated connection from its perspective. In case this verification fails, both
+		 * ends view it as an anonymous connection and never actually use it but attempt a reconnect after 10 seconds
+		 * leaking the connection. Therefore close it after a timeout.
+		 */
+
+		boost::system::error_code ec;
+		auto remote (m_Stream->lowest_layer().remote_endpoint(ec));
+
+		Log(LogInformation, "JsonRpcConnection")
+			<< "Closing anonymous connection [" << remote.address() << "]:" << remote.port() << " after 10 seconds.";
+
+		Disconnect();
+		return;
+	}
+
+	if (m_Seen < Utility::GetTime() - 60 && (!m_Endpoint || !m_Endpoint->GetSyncing())) {
+		Log(LogInformation, "JsonRpcConnection")
+			<<  "No messages for identity '" << m_Identity << "' have been received in the last 60 seconds.";
+
+		Disconnect();
+		return;
+	}
+
+	/* We still send a heartbeat without timeout here
+	 * to keep the m_Seen variable up to date. This is to keep the
+	 * cluster connection alive when there isn't much going on.
+	 */
+	EnqueueMessage(heartbeat->GetEncoded(m_BinaryMessages));
 }
 
 Value JsonRpcConnection::HeartbeatAPIHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
 {
 	return Empty;
 }
-
@@ -10,6 +10,8 @@
 #include "base/logger.hpp"
 #include "base/exception.hpp"
 #include "base/convert.hpp"
+#include "base/hex.hpp"
+#include "base/metrics.hpp"
 #include <boost/thread/once.hpp>
 #include <boost/regex.hpp>
 #include <fstream>
@@ -23,6 +25,9 @@ REGISTER_APIFUNCTION(RequestCertificate, pki, &RequestCertificateHandler);
 static Value UpdateCertificateHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params);
 REGISTER_APIFUNCTION(UpdateCertificate, pki, &UpdateCertificateHandler);
 
+static Histogram l_TicketVerificationTime ("icinga_pki_ticket_verification_seconds", "Time spent verifying the tickets of certificate requests");
+static Histogram l_SigningTime ("icinga_pki_signing_seconds", "Time spent signing certificate requests");
+
 Value RequestCertificateHandler(const MessageOrigin::Ptr& origin, const Dictionary::Ptr& params)
 {
 	String certText = params->Get("cert_request");
@@ -109,9 +114,7 @@ Value RequestCertificateHandler(const MessageOrigin::Ptr& origin, const Dictiona
 		return result;
 	}
 
-	char certFingerprint[EVP_MAX_MD_SIZE*2+1];
-	for (unsigned int i = 0; i < n; i++)
-		sprintf(certFingerprint + 2 * i, "%02x", digest[i]);
+	String certFingerprint = Hex::Encode(digest, n);
 
 	result->Set("fingerprint_request", certFingerprint);
 
@@ -190,7 +193,9 @@ Value RequestCertificateHandler(const MessageOrigin::Ptr& origin, const Dictiona
 			goto delayed_request;
 		}
 
+		auto verificationStart (Histogram::Clock::now());
 		String realTicket = PBKDF2_SHA1(cn, salt, 50000);
+		l_TicketVerificationTime.ObserveSince(verificationStart);
 
 		Log(LogDebug, "JsonRpcConnection")
 			<< "Certificate request for CN '" << cn << "': Comparing received ticket '"
@@ -209,7 +214,11 @@ Value RequestCertificateHandler(const MessageOrigin::Ptr& origin, const Dictiona
 	pubkey = std::shared_ptr<EVP_PKEY>(X509_get_pubkey(cert.get()), EVP_PKEY_free);
 	subject = X509_get_subject_name(cert.get());
 
-	newcert = CreateCertIcingaCA(pubkey.get(), subject);
+	{
+		auto signingStart (Histogram::Clock::now());
+		newcert = CreateCertIcingaCA(pubkey.get(), subject);
+		l_SigningTime.ObserveSince(signingStart);
+	}
 
 	/* verify that the new cert matches the CA we're using for the ApiListener;
 	 * this ensures that the CA we have in /var/lib/icinga2/ca matches the one
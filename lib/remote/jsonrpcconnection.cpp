@@ -6,9 +6,12 @@
 #include "remote/jsonrpc.hpp"
 #include "base/defer.hpp"
 #include "base/configtype.hpp"
+#include "base/initialize.hpp"
 #include "base/io-engine.hpp"
 #include "base/json.hpp"
+#include "base/memoryusage.hpp"
 #include "base/objectlock.hpp"
+#include "base/objectpool.hpp"
 #include "base/utility.hpp"
 #include "base/logger.hpp"
 #include "base/exception.hpp"
@@ -18,6 +21,7 @@
 #include <utility>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/spawn.hpp>
+#include <boost/asio/write.hpp>
 #include <boost/date_time/posix_time/posix_time_duration.hpp>
 #include <boost/system/system_error.hpp>
 #include <boost/thread/once.hpp>
@@ -29,6 +33,38 @@ REGISTER_APIFUNCTION(SetLogPosition, log, &SetLogPositionHandler);
 
 static RingBuffer l_TaskStats (15 * 60);
 
+/* Outgoing messages are coalesced into buffers of (at least) this size to get large TLS records. */
+static const size_t l_CoalescedWriteSize = 256u * 1024u;
+
+/* Stop reading from a peer while this many of its messages are waiting in ApiListener's message lanes. */
+static const size_t l_MaxDispatchedMessages = 1024;
+
+INITIALIZE_ONCE([]() {
+	MemoryUsage::Register("json_rpc_connections", []() -> Value {
+		Dictionary::Ptr connections = new Dictionary();
+		ApiListener::Ptr listener = ApiListener::GetInstance();
+
+		if (!listener)
+			return connections;
+
+		std::set<JsonRpcConnection::Ptr> clients = listener->GetAnonymousClients();
+
+		for (const Endpoint::Ptr& endpoint : ConfigType::GetObjectsByType<Endpoint>()) {
+			for (const JsonRpcConnection::Ptr& client : endpoint->GetClients())
+				clients.insert(client);
+		}
+
+		for (const JsonRpcConnection::Ptr& client : clients) {
+			connections->Set(client->GetIdentity(), new Dictionary({
+				{ "queued_messages", client->GetQueuedMessages() },
+				{ "queued_bytes", client->GetQueuedBytes() }
+			}));
+		}
+
+		return connections;
+	});
+});
+
 JsonRpcConnection::JsonRpcConnection(const String& identity, bool authenticated,
 	const Shared<AsioTlsStream>::Ptr& stream, ConnectionRole role)
 	: JsonRpcConnection(identity, authenticated, stream, role, IoEngine::Get().GetIoContext())
@@ -39,8 +75,10 @@ JsonRpcConnection::JsonRpcConnection(const String& identity, bool authenticated,
 	const Shared<AsioTlsStream>::Ptr& stream, ConnectionRole role, boost::asio::io_context& io)
 	: m_Identity(identity), m_Authenticated(authenticated), m_Stream(stream), m_Role(role),
 	m_Timestamp(Utility::GetTime()), m_Seen(Utility::GetTime()), m_NextHeartbeat(0), m_IoStrand(io),
-	m_OutgoingMessagesQueued(io), m_WriterDone(io), m_ShuttingDown(false),
-	m_CheckLivenessTimer(io), m_HeartbeatTimer(io)
+	m_QueuedMessages(0), m_QueuedBytes(0), m_Overloaded(false), m_OutgoingMessagesQueued(io), m_WriterDone(io),
+	m_DispatchedMessages(0), m_DispatchedMessagesAwaited(-1), m_DispatchedMessagesDone(io),
+	m_ShuttingDown(false), m_BinaryMessages(false), m_CompactMessages(false),
+	m_LivenessSlot(0)
 {
 	if (authenticated)
 		m_Endpoint = Endpoint::GetByName(identity);
@@ -53,9 +91,9 @@ void JsonRpcConnection::Start()
 	JsonRpcConnection::Ptr keepAlive (this);
 
 	IoEngine::SpawnCoroutine(m_IoStrand, [this, keepAlive](asio::yield_context yc) { HandleIncomingMessages(yc); });
-	IoEngine::SpawnCoroutine(m_IoStrand, [this, keepAlive](asio::yield_context yc) { WriteOutgoingMessages(yc); });
-	IoEngine::SpawnCoroutine(m_IoStrand, [this, keepAlive](asio::yield_context yc) { HandleAndWriteHeartbeats(yc); });
-	IoEngine::SpawnCoroutine(m_IoStrand, [this, keepAlive](asio::yield_context yc) { CheckLiveness(yc); });
+	IoEngine::SpawnCoroutine(m_IoStrand, [this, keepAlive](asio::yield_context yc) { WriteOutgoingMessages(yc); }, CoroutineStackSmall);
+
+	RegisterLiveness();
 }
 
 void JsonRpcConnection::HandleIncomingMessages(boost::asio::yield_context yc)
@@ -63,10 +101,25 @@ void JsonRpcConnection::HandleIncomingMessages(boost::asio::yield_context yc)
 	m_Stream->next_layer().SetSeen(&m_Seen);
 
 	for (;;) {
-		String message;
+		/* Points into m_Reader's buffer, so it must not be used after the next read. */
+		boost::string_view message;
+		String decompressed;
 
 		try {
-			message = JsonRpc::ReadMessage(m_Stream, yc, m_Endpoint ? -1 : 1024 * 1024);
+			message = JsonRpc::ReadMessage(m_Stream, m_Reader, yc, m_Endpoint ? -1 : 1024 * 1024);
+
+			if (JsonRpcCompression::IsCompressedMessage(message)) {
+#ifdef HAVE_ZLIB
+				if (!m_Decompressor) {
+					BOOST_THROW_EXCEPTION(std::invalid_argument("Received a compressed message, but compression wasn't negotiated."));
+				}
+
+				decompressed = m_Decompressor->Decompress(message, m_Endpoint ? -1 : 1024 * 1024);
+				message = decompressed;
+#else /* HAVE_ZLIB */
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Received a compressed message, but compression isn't supported."));
+#endif /* HAVE_ZLIB */
+			}
 		} catch (const std::exception& ex) {
 			Log(m_ShuttingDown ? LogDebug : LogNotice, "JsonRpcConnection")
 				<< "Error while reading JSON-RPC message for identity '" << m_Identity
@@ -78,9 +131,39 @@ void JsonRpcConnection::HandleIncomingMessages(boost::asio::yield_context yc)
 		m_Seen = Utility::GetTime();
 
 		try {
-			CpuBoundWork handleMessage (yc);
+			Dictionary::Ptr decoded;
+			String dispatchKey;
+			bool dispatch = false;
+
+			{
+				CpuBoundWork handleMessage (yc, CpuBoundWorkCluster);
 
-			MessageHandler(message);
+				decoded = DecodeIncomingMessage(message);
+
+				if (decoded) {
+					dispatch = GetDispatchKey(decoded, dispatchKey);
+
+					/* The common case, nothing to wait for. */
+					if (!dispatch && !m_DispatchedMessages.load()) {
+						MessageHandler(decoded);
+						decoded = nullptr;
+					}
+				}
+			}
+
+			if (decoded) {
+				if (dispatch) {
+					WaitForDispatchedMessages(l_MaxDispatchedMessages - 1u, yc);
+					DispatchMessage(decoded, dispatchKey);
+				} else {
+					/* Messages not concerning a particular host, e.g. config updates, are ordered relative to all others. */
+					WaitForDispatchedMessages(0, yc);
+
+					CpuBoundWork handleMessage (yc, CpuBoundWorkCluster);
+
+					MessageHandler(decoded);
+				}
+			}
 		} catch (const std::exception& ex) {
 			Log(m_ShuttingDown ? LogDebug : LogWarning, "JsonRpcConnection")
 				<< "Error while processing JSON-RPC message for identity '" << m_Identity
@@ -89,7 +172,7 @@ void JsonRpcConnection::HandleIncomingMessages(boost::asio::yield_context yc)
 			break;
 		}
 
-		CpuBoundWork taskStats (yc);
+		CpuBoundWork taskStats (yc, CpuBoundWorkCluster);
 
 		l_TaskStats.InsertValue(Utility::GetTime(), 1);
 	}
@@ -99,6 +182,8 @@ void JsonRpcConnection::HandleIncomingMessages(boost::asio::yield_context yc)
 
 void JsonRpcConnection::WriteOutgoingMessages(boost::asio::yield_context yc)
 {
+	namespace asio = boost::asio;
+
 	Defer signalWriterDone ([this]() { m_WriterDone.Set(); });
 
 	do {
@@ -111,15 +196,43 @@ void JsonRpcConnection::WriteOutgoingMessages(boost::asio::yield_context yc)
 
 		if (!queue.empty()) {
 			try {
+				/* Flush anything written through the buffered stream before, e.g. icinga::Hello. */
+				m_Stream->async_flush(yc);
+
+				std::string buffer;
+				size_t queuedBytes = 0;
+
 				for (auto& message : queue) {
-					size_t bytesSent = JsonRpc::SendRawMessage(m_Stream, message, yc);
+					size_t bytesSent;
+
+					queuedBytes += message->GetLength();
+
+#ifdef HAVE_ZLIB
+					/* The message may be shared with other connections, see JsonRpcSharedMessage. */
+					if (m_Compressor) {
+						bytesSent = JsonRpc::AppendRawMessage(buffer, m_Compressor->Compress(*message));
+					} else
+#endif /* HAVE_ZLIB */
+					{
+						bytesSent = JsonRpc::AppendRawMessage(buffer, *message);
+					}
 
 					if (m_Endpoint) {
 						m_Endpoint->AddMessageSent(bytesSent);
 					}
+
+					if (buffer.size() >= l_CoalescedWriteSize) {
+						asio::async_write(m_Stream->next_layer(), asio::buffer(buffer), yc);
+						buffer.clear();
+					}
 				}
 
-				m_Stream->async_flush(yc);
+				if (!buffer.empty()) {
+					asio::async_write(m_Stream->next_layer(), asio::buffer(buffer), yc);
+				}
+
+				m_QueuedMessages.fetch_sub(queue.size());
+				m_QueuedBytes.fetch_sub(queuedBytes);
 			} catch (const std::exception& ex) {
 				Log(m_ShuttingDown ? LogDebug : LogWarning, "JsonRpcConnection")
 					<< "Error while sending JSON-RPC message for identity '"
@@ -163,6 +276,45 @@ ConnectionRole JsonRpcConnection::GetRole() const
 	return m_Role;
 }
 
+/**
+ * Switch outgoing messages to the binary format once the peer told us (via icinga::Hello) it understands it.
+ * Must be called from within the I/O strand, e.g. by an API handler.
+ *
+ * @param binary Whether to use the binary format
+ */
+void JsonRpcConnection::SetBinaryMessages(bool binary)
+{
+	m_BinaryMessages = binary;
+}
+
+/**
+ * Send the compact variants of shared messages (see JsonRpcSharedMessage) once the peer told us (via icinga::Hello) it understands them.
+ * Must be called from within the I/O strand, e.g. by an API handler.
+ *
+ * @param compact Whether to prefer compact messages
+ */
+void JsonRpcConnection::SetCompactMessages(bool compact)
+{
+	m_CompactMessages = compact;
+}
+
+/**
+ * Start compressing outgoing and accept compressed incoming messages once both sides agreed to (via icinga::Hello).
+ * Must be called from within the I/O strand, e.g. by an API handler.
+ */
+void JsonRpcConnection::EnableCompression()
+{
+#ifdef HAVE_ZLIB
+	if (!m_Compressor) {
+		m_Compressor.reset(new JsonRpcCompressor());
+		m_Decompressor.reset(new JsonRpcDecompressor());
+
+		Log(LogInformation, "JsonRpcConnection")
+			<< "Enabled compression for identity '" << m_Identity << "'.";
+	}
+#endif /* HAVE_ZLIB */
+}
+
 void JsonRpcConnection::SendMessage(const Dictionary::Ptr& message)
 {
 	Ptr keepAlive (this);
@@ -170,19 +322,92 @@ void JsonRpcConnection::SendMessage(const Dictionary::Ptr& message)
 	m_IoStrand.post([this, keepAlive, message]() { SendMessageInternal(message); });
 }
 
+/**
+ * Like SendMessage(const Dictionary::Ptr&), but shares the encoded message
+ * with all other connections it's sent to.
+ */
+void JsonRpcConnection::SendMessage(const JsonRpcSharedMessage::Ptr& message)
+{
+	Ptr keepAlive (this);
+
+	m_IoStrand.post([this, keepAlive, message]() {
+		EnqueueMessage(message->GetEncoded(m_BinaryMessages, m_CompactMessages));
+	});
+}
+
 void JsonRpcConnection::SendRawMessage(const String& message)
 {
 	Ptr keepAlive (this);
 
 	m_IoStrand.post([this, keepAlive, message]() {
-		m_OutgoingMessagesQueue.emplace_back(message);
-		m_OutgoingMessagesQueued.Set();
+		EnqueueMessage(Shared<String>::Make(message));
 	});
 }
 
+/**
+ * Get the amount of messages waiting to be written to the peer.
+ *
+ * @return Messages queued
+ */
+size_t JsonRpcConnection::GetQueuedMessages() const
+{
+	return m_QueuedMessages.load();
+}
+
+/**
+ * Get the size of the messages waiting to be written to the peer,
+ * before compression. Messages shared with other connections count for each of them.
+ *
+ * @return Bytes queued
+ */
+size_t JsonRpcConnection::GetQueuedBytes() const
+{
+	return m_QueuedBytes.load();
+}
+
+/**
+ * Checks whether the peer doesn't keep up with reading our messages.
+ * If so, disconnects it. After reconnecting, it will catch up via the replay log,
+ * ApiListener::SyncRelayMessage() logs all messages while the limit is enabled.
+ *
+ * @param highWaterMark Maximum amount of queued messages, 0 for unlimited
+ *
+ * @return Whether more than highWaterMark messages are queued
+ */
+bool JsonRpcConnection::ExceedsHighWaterMark(size_t highWaterMark)
+{
+	if (m_Overloaded.load()) {
+		return true;
+	}
+
+	if (highWaterMark == 0u || m_QueuedMessages.load() < highWaterMark) {
+		return false;
+	}
+
+	if (!m_Overloaded.exchange(true)) {
+		Log(LogWarning, "JsonRpcConnection")
+			<< "More than " << highWaterMark << " messages are queued for identity '" << m_Identity
+			<< "', disconnecting. Messages will be replayed after reconnecting.";
+
+		Disconnect();
+	}
+
+	return true;
+}
+
 void JsonRpcConnection::SendMessageInternal(const Dictionary::Ptr& message)
 {
-	m_OutgoingMessagesQueue.emplace_back(JsonEncode(message));
+	EnqueueMessage(Shared<String>::Make(m_BinaryMessages ? JsonRpc::EncodeBinaryMessage(message) : JsonEncode(message)));
+}
+
+/**
+ * Queues an encoded message for WriteOutgoingMessages(), must be called on m_IoStrand.
+ */
+void JsonRpcConnection::EnqueueMessage(Shared<String>::Ptr message)
+{
+	m_QueuedBytes.fetch_add(message->GetLength());
+	m_OutgoingMessagesQueue.emplace_back(std::move(message));
+	m_QueuedMessages.fetch_add(1);
 	m_OutgoingMessagesQueued.Set();
 }
 
@@ -200,7 +425,7 @@ void JsonRpcConnection::Disconnect()
 				<< "API client disconnected for identity '" << m_Identity << "'";
 
 			{
-				CpuBoundWork removeClient (yc);
+				CpuBoundWork removeClient (yc, CpuBoundWorkCluster);
 
 				if (m_Endpoint) {
 					m_Endpoint->RemoveClient(this);
@@ -223,8 +448,7 @@ void JsonRpcConnection::Disconnect()
 			 */
 			boost::system::error_code ec;
 
-			m_CheckLivenessTimer.cancel();
-			m_HeartbeatTimer.cancel();
+			UnregisterLiveness();
 
 			m_Stream->lowest_layer().cancel(ec);
 
@@ -247,7 +471,14 @@ void JsonRpcConnection::Disconnect()
 	});
 }
 
-void JsonRpcConnection::MessageHandler(const String& jsonString)
+/**
+ * Decode a received message and track the replay log position.
+ *
+ * @param jsonString The raw message
+ *
+ * @return The message, nullptr if it has been received before
+ */
+Dictionary::Ptr JsonRpcConnection::DecodeIncomingMessage(boost::string_view jsonString)
 {
 	Dictionary::Ptr message = JsonRpc::DecodeMessage(jsonString);
 
@@ -256,11 +487,105 @@ void JsonRpcConnection::MessageHandler(const String& jsonString)
 
 		/* ignore old messages */
 		if (ts < m_Endpoint->GetRemoteLogPosition())
-			return;
+			return nullptr;
 
 		m_Endpoint->SetRemoteLogPosition(ts);
 	}
 
+	if (m_Endpoint)
+		m_Endpoint->AddMessageReceived(jsonString.size());
+
+	return message;
+}
+
+/**
+ * Determine whether a message may be processed by one of ApiListener's message lanes.
+ *
+ * That's the case for messages from endpoints concerning a host or its services.
+ * All messages concerning the same host go to the same lane, so they're processed in order.
+ *
+ * @param message The message
+ * @param key Set to the lane key
+ *
+ * @return Whether to dispatch the message
+ */
+bool JsonRpcConnection::GetDispatchKey(const Dictionary::Ptr& message, String& key) const
+{
+	if (!m_Endpoint)
+		return false;
+
+	Value vparams = message->Get("params");
+
+	if (!vparams.IsObjectType<Dictionary>())
+		return false;
+
+	Value vhost = Dictionary::Ptr(vparams)->Get("host");
+
+	if (!vhost.IsString() || vhost.IsEmpty())
+		return false;
+
+	key = vhost;
+	return true;
+}
+
+/**
+ * Process a message in one of ApiListener's message lanes, see GetDispatchKey().
+ */
+void JsonRpcConnection::DispatchMessage(const Dictionary::Ptr& message, const String& key)
+{
+	Ptr keepAlive (this);
+
+	m_DispatchedMessages.fetch_add(1);
+
+	ApiListener::GetInstance()->DispatchMessage(key, [this, keepAlive, message]() {
+		try {
+			MessageHandler(message, false);
+		} catch (const std::exception& ex) {
+			Log(m_ShuttingDown ? LogDebug : LogWarning, "JsonRpcConnection")
+				<< "Error while processing JSON-RPC message for identity '" << m_Identity
+				<< "': " << DiagnosticInformation(ex);
+
+			Disconnect();
+		}
+
+		auto left (m_DispatchedMessages.fetch_sub(1) - 1u);
+		auto awaited (m_DispatchedMessagesAwaited.load());
+
+		if (awaited >= 0 && left <= static_cast<size_t>(awaited)) {
+			m_IoStrand.post([this, keepAlive]() { m_DispatchedMessagesDone.Set(); });
+		}
+	});
+}
+
+/**
+ * Wait until at most the given amount of dispatched messages is still being processed.
+ * Must be called from within the I/O strand.
+ */
+void JsonRpcConnection::WaitForDispatchedMessages(size_t max, boost::asio::yield_context yc)
+{
+	while (m_DispatchedMessages.load() > max) {
+		m_DispatchedMessagesDone.Clear();
+		m_DispatchedMessagesAwaited.store(max);
+
+		/* A message may have been processed meanwhile without noticing us. */
+		if (m_DispatchedMessages.load() > max) {
+			m_DispatchedMessagesDone.Wait(yc);
+		}
+	}
+
+	m_DispatchedMessagesAwaited.store(-1);
+}
+
+/**
+ * Process a message from the peer.
+ *
+ * @param message The decoded message
+ * @param inStrand Whether this runs within the I/O strand or in one of ApiListener's message lanes
+ */
+void JsonRpcConnection::MessageHandler(const Dictionary::Ptr& message, bool inStrand)
+{
+	ObjectPoolStats::Scope allocations;
+
 	MessageOrigin::Ptr origin = new MessageOrigin();
 	origin->FromClient = this;
 
@@ -269,8 +594,6 @@ void JsonRpcConnection::MessageHandler(const String& jsonString)
 			origin->FromZone = m_Endpoint->GetZone();
 		else
 			origin->FromZone = Zone::GetByName(message->Get("originZone"));
-
-		m_Endpoint->AddMessageReceived(jsonString.GetLength());
 	}
 
 	Value vmethod;
@@ -315,11 +638,18 @@ void JsonRpcConnection::MessageHandler(const String& jsonString)
 			<< "Error while processing message for identity '" << m_Identity << "'\n" << diagInfo;
 	}
 
+	Log(LogDebug, "JsonRpcConnection")
+		<< "Processed '" << method << "' message from identity '" << m_Identity << "' with "
+		<< allocations.GetAllocations() << " dictionary, array and string allocations.";
+
 	if (message->Contains("id")) {
 		resultMessage->Set("jsonrpc", "2.0");
 		resultMessage->Set("id", message->Get("id"));
 
-		SendMessageInternal(resultMessage);
+		if (inStrand)
+			SendMessageInternal(resultMessage);
+		else
+			SendMessage(resultMessage);
 	}
 }
 
@@ -337,51 +667,6 @@ Value SetLogPositionHandler(const MessageOrigin::Ptr& origin, const Dictionary::
 	return Empty;
 }
 
-void JsonRpcConnection::CheckLiveness(boost::asio::yield_context yc)
-{
-	boost::system::error_code ec;
-
-	if (!m_Authenticated) {
-		/* Anonymous connections are normally only used for requesting a certificate and are closed after this request
-		 * is received. However, the request is only sent if the child has successfully verified the certificate of its
-		 * parent so that it is an authenticated connection from its perspective. In case this verification fails, both
-		 * ends view it as an anonymous connection and never actually use it but attempt a reconnect after 10 seconds
-		 * leaking the connection. Therefore close it after a timeout.
-		 */
-
-		m_CheckLivenessTimer.expires_from_now(boost::posix_time::seconds(10));
-		m_CheckLivenessTimer.async_wait(yc[ec]);
-
-		if (m_ShuttingDown) {
-			return;
-		}
-
-		auto remote (m_Stream->lowest_layer().remote_endpoint());
-
-		Log(LogInformation, "JsonRpcConnection")
-			<< "Closing anonymous connection [" << remote.address() << "]:" << remote.port() << " after 10 seconds.";
-
-		Disconnect();
-	} else {
-		for (;;) {
-			m_CheckLivenessTimer.expires_from_now(boost::posix_time::seconds(30));
-			m_CheckLivenessTimer.async_wait(yc[ec]);
-
-			if (m_ShuttingDown) {
-				break;
-			}
-
-			if (m_Seen < Utility::GetTime() - 60 && (!m_Endpoint || !m_Endpoint->GetSyncing())) {
-				Log(LogInformation, "JsonRpcConnection")
-					<<  "No messages for identity '" << m_Identity << "' have been received in the last 60 seconds.";
-
-				Disconnect();
-				break;
-			}
-		}
-	}
-}
-
 double JsonRpcConnection::GetWorkQueueRate()
 {
 	return l_TaskStats.UpdateAndGetValues(Utility::GetTime(), 60) / 60.0;
@@ -5,15 +5,22 @@
 
 #include "remote/i2-remote.hpp"
 #include "remote/endpoint.hpp"
+#include "remote/jsonrpc.hpp"
+#include "remote/jsonrpccompression.hpp"
 #include "base/io-engine.hpp"
+#include "base/netstring.hpp"
 #include "base/tlsstream.hpp"
 #include "base/timer.hpp"
 #include "base/workqueue.hpp"
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <vector>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/io_context_strand.hpp>
 #include <boost/asio/spawn.hpp>
+#include <boost/utility/string_view.hpp>
 
 namespace icinga
 {
@@ -43,6 +50,7 @@ public:
 	DECLARE_PTR_TYPEDEFS(JsonRpcConnection);
 
 	JsonRpcConnection(const String& identity, bool authenticated, const Shared<AsioTlsStream>::Ptr& stream, ConnectionRole role);
+	JsonRpcConnection(const String& identity, bool authenticated, const Shared<AsioTlsStream>::Ptr& stream, ConnectionRole role, boost::asio::io_context& io);
 
 	void Start();
 
@@ -55,9 +63,18 @@ public:
 
 	void Disconnect();
 
+	void SetBinaryMessages(bool binary);
+	void SetCompactMessages(bool compact);
+	void EnableCompression();
+
 	void SendMessage(const Dictionary::Ptr& request);
+	void SendMessage(const JsonRpcSharedMessage::Ptr& request);
 	void SendRawMessage(const String& request);
 
+	size_t GetQueuedMessages() const;
+	size_t GetQueuedBytes() const;
+	bool ExceedsHighWaterMark(size_t highWaterMark);
+
 	static Value HeartbeatAPIHandler(const intrusive_ptr<MessageOrigin>& origin, const Dictionary::Ptr& params);
 
 	static double GetWorkQueueRate();
@@ -69,30 +86,54 @@ private:
 	bool m_Authenticated;
 	Endpoint::Ptr m_Endpoint;
 	Shared<AsioTlsStream>::Ptr m_Stream;
+	NetStringReader m_Reader;
 	ConnectionRole m_Role;
 	double m_Timestamp;
 	double m_Seen;
 	double m_NextHeartbeat;
 	boost::asio::io_context::strand m_IoStrand;
-	std::vector<String> m_OutgoingMessagesQueue;
+	std::vector<Shared<String>::Ptr> m_OutgoingMessagesQueue;
+	std::atomic<size_t> m_QueuedMessages;
+	std::atomic<size_t> m_QueuedBytes;
+	std::atomic<bool> m_Overloaded;
 	AsioConditionVariable m_OutgoingMessagesQueued;
 	AsioConditionVariable m_WriterDone;
+	std::atomic<size_t> m_DispatchedMessages;
+	std::atomic<ssize_t> m_DispatchedMessagesAwaited;
+	AsioConditionVariable m_DispatchedMessagesDone;
 	bool m_ShuttingDown;
-	boost::asio::deadline_timer m_CheckLivenessTimer, m_HeartbeatTimer;
-
-	JsonRpcConnection(const String& identity, bool authenticated, const Shared<AsioTlsStream>::Ptr& stream, ConnectionRole role, boost::asio::io_context& io);
+	bool m_BinaryMessages;
+	bool m_CompactMessages;
+#ifdef HAVE_ZLIB
+	std::unique_ptr<JsonRpcCompressor> m_Compressor;
+	std::unique_ptr<JsonRpcDecompressor> m_Decompressor;
+#endif /* HAVE_ZLIB */
+	size_t m_LivenessSlot;
+
+	static std::mutex m_LivenessMutex;
+	static std::vector<std::set<JsonRpcConnection::Ptr>> m_LivenessWheel;
+	static size_t m_LivenessCursor;
+	static size_t m_LivenessNext;
+	static Timer::Ptr m_LivenessTimer;
 
 	void HandleIncomingMessages(boost::asio::yield_context yc);
 	void WriteOutgoingMessages(boost::asio::yield_context yc);
-	void HandleAndWriteHeartbeats(boost::asio::yield_context yc);
-	void CheckLiveness(boost::asio::yield_context yc);
+	void RegisterLiveness();
+	void UnregisterLiveness();
+	void CheckLiveness(const JsonRpcSharedMessage::Ptr& heartbeat);
+	static void LivenessTimerHandler();
 
 	bool ProcessMessage();
-	void MessageHandler(const String& jsonString);
+	Dictionary::Ptr DecodeIncomingMessage(boost::string_view jsonString);
+	bool GetDispatchKey(const Dictionary::Ptr& message, String& key) const;
+	void DispatchMessage(const Dictionary::Ptr& message, const String& key);
+	void WaitForDispatchedMessages(size_t max, boost::asio::yield_context yc);
+	void MessageHandler(const Dictionary::Ptr& message, bool inStrand = true);
 
 	void CertificateRequestResponseHandler(const Dictionary::Ptr& message);
 
 	void SendMessageInternal(const Dictionary::Ptr& request);
+	void EnqueueMessage(Shared<String>::Ptr message);
 };
 
 }
@@ -0,0 +1,44 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/metricshandler.hpp"
+#include "remote/filterutility.hpp"
+#include "base/metrics.hpp"
+#include <sstream>
+
+using namespace icinga;
+
+REGISTER_URLHANDLER("/v1/metrics", MetricsHandler);
+
+bool MetricsHandler::HandleRequest(
+	AsioTlsStream& stream,
+	const ApiUser::Ptr& user,
+	boost::beast::http::request<boost::beast::http::string_body>& request,
+	const Url::Ptr& url,
+	boost::beast::http::response<boost::beast::http::string_body>& response,
+	const Dictionary::Ptr& params,
+	boost::asio::yield_context& yc,
+	HttpServerConnection& server
+)
+{
+	namespace http = boost::beast::http;
+
+	if (url->GetPath().size() != 2)
+		return false;
+
+	if (request.method() != http::verb::get)
+		return false;
+
+	FilterUtility::CheckPermission(user, "status/query");
+
+	std::ostringstream body;
+	body.precision(10);
+
+	Histogram::WriteOpenMetrics(body);
+
+	response.result(http::status::ok);
+	response.set(http::field::content_type, "application/openmetrics-text; version=1.0.0; charset=utf-8");
+	response.body() = body.str();
+	response.content_length(response.body().size());
+
+	return true;
+}
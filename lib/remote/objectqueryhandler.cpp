@@ -3,45 +3,44 @@
 #include "remote/objectqueryhandler.hpp"
 #include "remote/httputility.hpp"
 #include "remote/filterutility.hpp"
+#include "base/convert.hpp"
+#include "base/json.hpp"
 #include "base/serializer.hpp"
 #include "base/dependencygraph.hpp"
 #include "base/configtype.hpp"
 #include <boost/algorithm/string/case_conv.hpp>
+#include <memory>
 #include <set>
 
 using namespace icinga;
 
 REGISTER_URLHANDLER("/v1/objects", ObjectQueryHandler);
 
-Dictionary::Ptr ObjectQueryHandler::SerializeObjectAttrs(const Object::Ptr& object,
-	const String& attrPrefix, const Array::Ptr& attrs, bool isJoin, bool allAttrs)
+/**
+ * @param attrPrefix The navigation name of a join
+ * @param attrs The requested attributes, prefixed with attrPrefix for joins
+ * @param isJoin Whether the projection is for a join
+ * @param allAttrs Whether all attributes are requested anyway
+ */
+ObjectQueryHandler::AttrsProjection::AttrsProjection(const String& attrPrefix, const Array::Ptr& attrs, bool isJoin, bool allAttrs)
+	: m_AllAttrs(allAttrs)
 {
-	Type::Ptr type = object->GetReflectionType();
-
-	std::vector<int> fids;
-
 	if (isJoin && attrs) {
 		ObjectLock olock(attrs);
 		for (const String& attr : attrs) {
 			if (attr == attrPrefix) {
-				allAttrs = true;
+				m_AllAttrs = true;
 				break;
 			}
 		}
 	}
 
 	if (!isJoin && (!attrs || attrs->GetLength() == 0))
-		allAttrs = true;
+		m_AllAttrs = true;
 
-	if (allAttrs) {
-		for (int fid = 0; fid < type->GetFieldCount(); fid++) {
-			fids.push_back(fid);
-		}
-	} else if (attrs) {
+	if (!m_AllAttrs && attrs) {
 		ObjectLock olock(attrs);
 		for (const String& attr : attrs) {
-			String userAttr;
-
 			if (isJoin) {
 				String::SizeType dpos = attr.FindFirstOf(".");
 				if (dpos == String::NPos)
@@ -51,10 +50,32 @@ Dictionary::Ptr ObjectQueryHandler::SerializeObjectAttrs(const Object::Ptr& obje
 				if (userJoinAttr != attrPrefix)
 					continue;
 
-				userAttr = attr.SubStr(dpos + 1);
+				m_Attrs.emplace_back(attr.SubStr(dpos + 1));
 			} else
-				userAttr = attr;
+				m_Attrs.emplace_back(attr);
+		}
+	}
+}
+
+/**
+ * Resolves the attributes to the fields of a type once, the projection is
+ * used for all objects of a request.
+ */
+const std::vector<Field>& ObjectQueryHandler::AttrsProjection::GetFields(const Type::Ptr& type)
+{
+	auto it (m_Fields.find(type.get()));
+
+	if (it != m_Fields.end())
+		return it->second;
+
+	std::vector<int> fids;
 
+	if (m_AllAttrs) {
+		for (int fid = 0; fid < type->GetFieldCount(); fid++) {
+			fids.push_back(fid);
+		}
+	} else {
+		for (const String& userAttr : m_Attrs) {
 			int fid = type->GetFieldId(userAttr);
 
 			if (fid < 0)
@@ -64,14 +85,12 @@ Dictionary::Ptr ObjectQueryHandler::SerializeObjectAttrs(const Object::Ptr& obje
 		}
 	}
 
-	DictionaryData resultAttrs;
-	resultAttrs.reserve(fids.size());
+	std::vector<Field> fields;
+	fields.reserve(fids.size());
 
 	for (int fid : fids) {
 		Field field = type->GetFieldInfo(fid);
 
-		Value val = object->GetField(fid);
-
 		/* hide attributes which shouldn't be user-visible */
 		if (field.Attributes & FANoUserView)
 			continue;
@@ -80,11 +99,64 @@ Dictionary::Ptr ObjectQueryHandler::SerializeObjectAttrs(const Object::Ptr& obje
 		if (field.Attributes & FANavigation && !(field.Attributes & (FAConfig | FAState)))
 			continue;
 
-		Value sval = Serialize(val, FAConfig | FAState);
-		resultAttrs.emplace_back(field.Name, sval);
+		fields.push_back(field);
 	}
 
-	return new Dictionary(std::move(resultAttrs));
+	return m_Fields.emplace(type.get(), std::move(fields)).first->second;
+}
+
+/**
+ * Encodes the fields returned by GetFields() as a JSON object.
+ */
+void ObjectQueryHandler::AttrsProjection::Encode(JsonStreamEncoder& encoder, const Object::Ptr& object, const std::vector<Field>& fields)
+{
+	/* Repeated queries share the serialized attributes which haven't changed in between. */
+	auto configObject (dynamic_cast<ConfigObject *>(object.get()));
+
+	encoder.StartObject();
+
+	for (const Field& field : fields) {
+		encoder.Key(field.Name);
+		encoder.Encode(configObject ? configObject->GetSerializedField(field.ID) : Serialize(object->GetField(field.ID), FAConfig | FAState));
+	}
+
+	encoder.EndObject();
+}
+
+/**
+ * Tells whether a query returns only config attributes, i.e. whether its
+ * result only changes with the revision of the queried type.
+ */
+bool ObjectQueryHandler::IsConfigQuery(const Type::Ptr& type, const Array::Ptr& attrs, const Array::Ptr& joins, bool allJoins, const Array::Ptr& metas)
+{
+	if (!attrs || attrs->GetLength() == 0 || (joins && joins->GetLength() > 0) || allJoins)
+		return false;
+
+	{
+		ObjectLock olock(attrs);
+		for (const String& attr : attrs) {
+			int fid = type->GetFieldId(attr);
+
+			if (fid < 0)
+				return false;
+
+			int attributes = type->GetFieldInfo(fid).Attributes;
+
+			if (!(attributes & FAConfig) || (attributes & FAState))
+				return false;
+		}
+	}
+
+	/* The objects using one change without a new revision of its type. */
+	if (metas) {
+		ObjectLock olock(metas);
+		for (const String& meta : metas) {
+			if (meta != "location" && meta != "revision")
+				return false;
+		}
+	}
+
+	return true;
 }
 
 bool ObjectQueryHandler::HandleRequest(
@@ -153,10 +225,38 @@ bool ObjectQueryHandler::HandleRequest(
 		params->Set(attr, url->GetPath()[3]);
 	}
 
+	QueryPage page;
+
+	try {
+		page = FilterUtility::GetQueryPage(params);
+
+		Value changedSince = HttpUtility::GetLastParameter(params, "changed_since");
+
+		if (!changedSince.IsEmpty()) {
+			double value = Convert::ToDouble(changedSince);
+
+			if (value < 0 || value != static_cast<double>(static_cast<uint_fast64_t>(value)))
+				BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid changed_since specified: must be a non-negative integer."));
+
+			qd.ChangedSince = value;
+		}
+	} catch (const std::exception& ex) {
+		HttpUtility::SendJsonError(response, params, 400, ex.what());
+		return true;
+	}
+
+	/* Read before the objects, so that changes while they're being serialized show up with the next revision. */
+	auto ctype (dynamic_cast<ConfigType *>(type.get()));
+	uint_fast64_t revision = ctype ? ctype->GetRevision() : 0;
+
 	std::vector<Value> objs;
 
 	try {
-		objs = FilterUtility::GetFilterTargets(qd, params, user);
+		if (ctype && IsConfigQuery(type, uattrs, ujoins, allJoins, umetas) && FilterUtility::IsUnfilteredQuery(qd, params, user)
+			&& HttpUtility::SendNotModified(request, response, params, user, Convert::ToString(revision)))
+			return true;
+
+		objs = FilterUtility::GetFilterTargets(qd, params, user, String(), &page);
 	} catch (const std::exception& ex) {
 		HttpUtility::SendJsonError(response, params, 404,
 			"No objects found.",
@@ -164,10 +264,23 @@ bool ObjectQueryHandler::HandleRequest(
 		return true;
 	}
 
-	ArrayData results;
-	results.reserve(objs.size());
+	bool pretty = HttpUtility::GetLastParameter(params, "pretty");
+
+	/* HTTP/1.1 clients receive the results while they're being serialized,
+	 * so large result sets don't have to be buffered as a whole.
+	 */
+	std::unique_ptr<ChunkedJsonResponse> chunked;
+	JsonStreamEncoder bufferedEncoder (pretty);
+
+	if (request.version() >= 11)
+		chunked.reset(new ChunkedJsonResponse(stream, response, params, yc));
+
+	JsonStreamEncoder& encoder (chunked ? chunked->GetEncoder() : bufferedEncoder);
+
+	encoder.StartObject();
+	encoder.Key("results");
+	encoder.StartArray();
 
-	std::set<String> joinAttrs;
 	std::set<String> userJoinAttrs;
 
 	if (ujoins) {
@@ -177,6 +290,16 @@ bool ObjectQueryHandler::HandleRequest(
 		}
 	}
 
+	struct JoinProjection
+	{
+		int FieldId;
+		String Prefix;
+		AttrsProjection Attrs;
+	};
+
+	/* The joins are fields of the queried type, so they're resolved once. */
+	std::vector<JoinProjection> joins;
+
 	for (int fid = 0; fid < type->GetFieldCount(); fid++) {
 		Field field = type->GetFieldInfo(fid);
 
@@ -186,15 +309,15 @@ bool ObjectQueryHandler::HandleRequest(
 		if (!allJoins && userJoinAttrs.find(field.NavigationName) == userJoinAttrs.end())
 			continue;
 
-		joinAttrs.insert(field.Name);
+		String prefix = field.NavigationName;
+
+		joins.push_back({ fid, prefix, AttrsProjection(prefix, ujoins, true, allJoins) });
 	}
 
-	for (const ConfigObject::Ptr& obj : objs) {
-		DictionaryData result1{
-			{ "name", obj->GetName() },
-			{ "type", obj->GetReflectionType()->GetName() }
-		};
+	AttrsProjection attrs (String(), uattrs, false, false);
 
+	for (const ConfigObject::Ptr& obj : objs) {
+		/* Everything which can fail is done before the object is encoded. */
 		DictionaryData metaAttrs;
 
 		if (umetas) {
@@ -218,6 +341,8 @@ bool ObjectQueryHandler::HandleRequest(
 					}
 				} else if (meta == "location") {
 					metaAttrs.emplace_back("location", obj->GetSourceLocation());
+				} else if (meta == "revision") {
+					metaAttrs.emplace_back("revision", static_cast<double>(obj->GetRevision()));
 				} else {
 					HttpUtility::SendJsonError(response, params, 400, "Invalid field specified for meta: " + meta);
 					return true;
@@ -225,59 +350,80 @@ bool ObjectQueryHandler::HandleRequest(
 			}
 		}
 
-		result1.emplace_back("meta", new Dictionary(std::move(metaAttrs)));
+		const std::vector<Field> *fields;
+		std::vector<std::pair<Object::Ptr, const std::vector<Field> *>> joinedObjs;
 
 		try {
-			result1.emplace_back("attrs", SerializeObjectAttrs(obj, String(), uattrs, false, false));
+			fields = &attrs.GetFields(obj->GetReflectionType());
+
+			for (JoinProjection& join : joins) {
+				Object::Ptr joinedObj = obj->NavigateField(join.FieldId);
+
+				if (joinedObj)
+					joinedObjs.emplace_back(joinedObj, &join.Attrs.GetFields(joinedObj->GetReflectionType()));
+				else
+					joinedObjs.emplace_back(nullptr, nullptr);
+			}
 		} catch (const ScriptError& ex) {
 			HttpUtility::SendJsonError(response, params, 400, ex.what());
 			return true;
 		}
 
-		DictionaryData joins;
-
-		for (const String& joinAttr : joinAttrs) {
-			Object::Ptr joinedObj;
-			int fid = type->GetFieldId(joinAttr);
+		encoder.StartObject();
+		encoder.Key("name");
+		encoder.Encode(obj->GetName());
+		encoder.Key("type");
+		encoder.Encode(obj->GetReflectionType()->GetName());
+		encoder.Key("meta");
+		encoder.Encode(new Dictionary(std::move(metaAttrs)));
+		encoder.Key("attrs");
+		attrs.Encode(encoder, obj, *fields);
+		encoder.Key("joins");
+		encoder.StartObject();
+
+		for (size_t i = 0; i < joins.size(); i++) {
+			if (!joinedObjs[i].first)
+				continue;
 
-			if (fid < 0) {
-				HttpUtility::SendJsonError(response, params, 400, "Invalid field specified for join: " + joinAttr);
-				return true;
-			}
+			encoder.Key(joins[i].Prefix);
+			joins[i].Attrs.Encode(encoder, joinedObjs[i].first, *joinedObjs[i].second);
+		}
 
-			Field field = type->GetFieldInfo(fid);
+		encoder.EndObject();
+		encoder.EndObject();
 
-			if (!(field.Attributes & FANavigation)) {
-				HttpUtility::SendJsonError(response, params, 400, "Not a joinable field: " + joinAttr);
-				return true;
-			}
+		/* Validation errors show up with the first object at the latest,
+		 * so nothing is sent before it has been serialized.
+		 */
+		if (chunked)
+			chunked->Flush();
+	}
 
-			joinedObj = obj->NavigateField(fid);
+	encoder.EndArray();
 
-			if (!joinedObj)
-				continue;
+	if (!page.NextCursor.IsEmpty()) {
+		encoder.Key("next_cursor");
+		encoder.Encode(page.NextCursor);
+	}
 
-			String prefix = field.NavigationName;
+	if (ctype) {
+		encoder.Key("revision");
+		encoder.Encode(static_cast<double>(revision));
+	}
 
-			try {
-				joins.emplace_back(prefix, SerializeObjectAttrs(joinedObj, prefix, ujoins, true, allJoins));
-			} catch (const ScriptError& ex) {
-				HttpUtility::SendJsonError(response, params, 400, ex.what());
-				return true;
-			}
-		}
+	encoder.EndObject();
 
-		result1.emplace_back("joins", new Dictionary(std::move(joins)));
+	response.result(http::status::ok);
 
-		results.push_back(new Dictionary(std::move(result1)));
+	if (chunked) {
+		chunked->Finish();
+		return true;
 	}
 
-	Dictionary::Ptr result = new Dictionary({
-		{ "results", new Array(std::move(results)) }
-	});
-
-	response.result(http::status::ok);
-	HttpUtility::SendJsonBody(response, params, result);
+	/* Like HttpUtility::SendJsonBody(). */
+	response.set(http::field::content_type, "application/json");
+	response.body() = encoder.TakeResult() + (pretty ? "\n" : "");
+	response.content_length(response.body().size());
 
 	return true;
 }
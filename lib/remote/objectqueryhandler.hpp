@@ -4,6 +4,10 @@
 #define OBJECTQUERYHANDLER_H
 
 #include "remote/httphandler.hpp"
+#include "base/json.hpp"
+#include "base/type.hpp"
+#include <map>
+#include <vector>
 
 namespace icinga
 {
@@ -25,8 +29,24 @@ public:
 	) override;
 
 private:
-	static Dictionary::Ptr SerializeObjectAttrs(const Object::Ptr& object, const String& attrPrefix,
-		const Array::Ptr& attrs, bool isJoin, bool allAttrs);
+	static bool IsConfigQuery(const Type::Ptr& type, const Array::Ptr& attrs, const Array::Ptr& joins, bool allJoins, const Array::Ptr& metas);
+
+	/**
+	 * The attributes a query returns for an object or a joined object.
+	 */
+	class AttrsProjection
+	{
+	public:
+		AttrsProjection(const String& attrPrefix, const Array::Ptr& attrs, bool isJoin, bool allAttrs);
+
+		const std::vector<Field>& GetFields(const Type::Ptr& type);
+		void Encode(JsonStreamEncoder& encoder, const Object::Ptr& object, const std::vector<Field>& fields);
+
+	private:
+		std::vector<String> m_Attrs;
+		bool m_AllAttrs;
+		std::map<const Type *, std::vector<Field>> m_Fields;
+	};
 };
 
 }
@@ -0,0 +1,127 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/profilehandler.hpp"
+#include "remote/httputility.hpp"
+#include "remote/filterutility.hpp"
+#include "base/configuration.hpp"
+#include "base/convert.hpp"
+#include "base/defer.hpp"
+#include "base/io-engine.hpp"
+#include "base/logger.hpp"
+#include "base/profiler.hpp"
+#include "base/utility.hpp"
+#include <boost/asio/deadline_timer.hpp>
+#include <algorithm>
+#include <fstream>
+
+using namespace icinga;
+
+REGISTER_URLHANDLER("/v1/debug/profile", ProfileHandler);
+
+bool ProfileHandler::HandleRequest(
+	AsioTlsStream& stream,
+	const ApiUser::Ptr& user,
+	boost::beast::http::request<boost::beast::http::string_body>& request,
+	const Url::Ptr& url,
+	boost::beast::http::response<boost::beast::http::string_body>& response,
+	const Dictionary::Ptr& params,
+	boost::asio::yield_context& yc,
+	HttpServerConnection& server
+)
+{
+	namespace http = boost::beast::http;
+
+	if (url->GetPath().size() != 3)
+		return false;
+
+	if (request.method() != http::verb::post)
+		return false;
+
+	FilterUtility::CheckPermission(user, "debug/profile");
+
+	if (!Profiler::IsSupported()) {
+		HttpUtility::SendJsonError(response, params, 501, "Profiling is not supported on this platform.");
+		return true;
+	}
+
+	Value vDuration = HttpUtility::GetLastParameter(params, "duration");
+	Value vFrequency = HttpUtility::GetLastParameter(params, "frequency");
+	double duration = vDuration.IsEmpty() ? 10 : Convert::ToDouble(vDuration);
+	int frequency = vFrequency.IsEmpty() ? 99 : Convert::ToLong(vFrequency);
+	bool locks = HttpUtility::GetLastParameter(params, "locks").ToBool();
+
+	if (duration <= 0 || duration > 300) {
+		HttpUtility::SendJsonError(response, params, 400, "Parameter 'duration' must be between 0 and 300 seconds.");
+		return true;
+	}
+
+	if (frequency < 1 || frequency > 1000) {
+		HttpUtility::SendJsonError(response, params, 400, "Parameter 'frequency' must be between 1 and 1000.");
+		return true;
+	}
+
+	if (!Profiler::Start(frequency, locks)) {
+		HttpUtility::SendJsonError(response, params, 409, "Another profile is already running.");
+		return true;
+	}
+
+	Log(LogInformation, "ProfileHandler")
+		<< "Profiling for " << duration << " seconds at " << frequency << " Hz"
+		<< (locks ? ", recording lock contention." : ".");
+
+	{
+		Defer stop ([]() { Profiler::Stop(); });
+
+		/* Don't occupy a CPU bound work slot while just waiting. */
+		IoBoundWorkSlot dontLockTheIoThread (yc, CpuBoundWorkApiWrite);
+
+		boost::asio::deadline_timer timer (IoEngine::Get().GetIoContext());
+		timer.expires_from_now(boost::posix_time::milliseconds(static_cast<long>(duration * 1000)));
+		timer.async_wait(yc);
+	}
+
+	String dir = Configuration::DataDir + "/profiles";
+	String path = dir + "/cpu-" + Utility::FormatDateTime("%Y%m%d-%H%M%S", Utility::GetTime()) + ".folded";
+
+	Utility::MkDirP(dir, 0750);
+
+	std::ofstream fp (path.CStr(), std::ofstream::out | std::ofstream::trunc);
+
+	if (!fp) {
+		HttpUtility::SendJsonError(response, params, 500, "Cannot open '" + path + "' for writing.");
+		return true;
+	}
+
+	size_t samples = Profiler::WriteFoldedStacks(fp);
+	fp.close();
+
+	ArrayData contention;
+
+	for (auto& site : Profiler::GetLockContention()) {
+		contention.emplace_back(new Dictionary({
+			{ "site", site.Site },
+			{ "waits", site.Waits },
+			{ "wait_time", site.WaitTime },
+			{ "max_wait_time", site.MaxWaitTime }
+		}));
+	}
+
+	Log(LogInformation, "ProfileHandler")
+		<< "Wrote " << samples << " stack samples to '" << path << "'.";
+
+	Dictionary::Ptr result = new Dictionary({
+		{ "results", new Array({
+			new Dictionary({
+				{ "path", path },
+				{ "samples", samples },
+				{ "dropped_samples", Profiler::GetDroppedSamples() },
+				{ "locks", new Array(std::move(contention)) }
+			})
+		}) }
+	});
+
+	response.result(http::status::ok);
+	HttpUtility::SendJsonBody(response, params, result);
+
+	return true;
+}
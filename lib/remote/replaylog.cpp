@@ -0,0 +1,404 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/replaylog.hpp"
+#include "base/exception.hpp"
+#include "base/utility.hpp"
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#ifndef _WIN32
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif /* _WIN32 */
+
+using namespace icinga;
+
+/**
+ * Loads the index of a segment.
+ *
+ * @param path Path of the index
+ *
+ * @return false if there's no index, e.g. for segments written by older versions
+ */
+bool ReplayLogIndex::Load(const String& path)
+{
+	std::ifstream fp (path.CStr());
+
+	if (!fp.good())
+		return false;
+
+	std::string line;
+
+	while (std::getline(fp, line)) {
+		if (line.empty())
+			continue;
+
+		switch (line[0]) {
+			case 'o': {
+				std::istringstream buf (line.substr(1));
+				uint_fast64_t offset;
+				double timestamp;
+
+				if (buf >> offset >> timestamp)
+					m_Offsets.emplace_back(offset, timestamp);
+
+				break;
+			}
+
+			case 'z':
+				if (line.size() > 2u)
+					m_Zones.emplace(line.substr(2));
+
+				break;
+
+			case 'a':
+				m_Unbound = true;
+				break;
+		}
+	}
+
+	m_Loaded = true;
+
+	return true;
+}
+
+bool ReplayLogIndex::IsLoaded() const
+{
+	return m_Loaded;
+}
+
+/**
+ * Finds the offset to start replaying at.
+ *
+ * @param timestamp The timestamp the peer has already received all messages up to
+ *
+ * @return An offset before which all messages are not newer than timestamp
+ */
+uint_fast64_t ReplayLogIndex::Seek(double timestamp) const
+{
+	uint_fast64_t offset = 0;
+
+	/* The maximum timestamps are monotonic by definition. */
+	for (auto& entry : m_Offsets) {
+		if (entry.second > timestamp)
+			break;
+
+		offset = entry.first;
+	}
+
+	return offset;
+}
+
+/**
+ * Whether the segment may contain messages the given zone has access to.
+ *
+ * @param zone The zone of the endpoint to replay the log to
+ *
+ * @return false if the segment surely contains no relevant messages
+ */
+bool ReplayLogIndex::MayConcern(const Zone::Ptr& zone) const
+{
+	if (!m_Loaded || m_Unbound)
+		return true;
+
+	for (auto& name : m_Zones) {
+		Zone::Ptr objectZone = Zone::GetByName(name);
+
+		/* Messages for objects of deleted zones are not replayed anyway. */
+		if (!objectZone)
+			continue;
+
+		if (objectZone->GetGlobal() || objectZone->IsChildOf(zone))
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * Opens the index of the segment which is going to be written.
+ *
+ * @param path Path of the index
+ * @param segmentSize Current size of the segment
+ */
+void ReplayLogIndexWriter::Open(const String& path, uint_fast64_t segmentSize)
+{
+	m_Messages = 0;
+	m_Unbound = false;
+	m_Zones.clear();
+
+	if (segmentSize == 0u) {
+		m_Stream.open(path.CStr(), std::ofstream::out | std::ofstream::trunc);
+		m_MaxTimestamp = 0;
+	} else {
+		bool indexed = Utility::PathExists(path);
+
+		/* We don't know the timestamps of messages written before (e.g. before a restart).
+		 * Assume they're not newer than now.
+		 */
+		m_Stream.open(path.CStr(), std::ofstream::out | std::ofstream::app);
+		m_MaxTimestamp = Utility::GetTime();
+
+		/* Nor their zones if they weren't indexed. */
+		if (!indexed) {
+			m_Unbound = true;
+			m_Stream << "a\n";
+		}
+	}
+
+	m_Stream.precision(std::numeric_limits<double>::max_digits10);
+}
+
+void ReplayLogIndexWriter::Close()
+{
+	if (m_Stream.is_open())
+		m_Stream.close();
+}
+
+/**
+ * Indexes a message which is going to be appended to the segment.
+ *
+ * @param offset The message's offset in the segment
+ * @param timestamp The message's timestamp
+ * @param zone The zone of the message's object
+ * @param unbound Whether the message isn't bound to any object/zone
+ */
+void ReplayLogIndexWriter::AddMessage(uint_fast64_t offset, double timestamp, const String& zone, bool unbound)
+{
+	if (!m_Stream.is_open())
+		return;
+
+	if (m_Messages % ReplayLogIndex::Interval == 0u)
+		m_Stream << "o " << offset << " " << m_MaxTimestamp << "\n";
+
+	m_Messages++;
+
+	if (timestamp > m_MaxTimestamp)
+		m_MaxTimestamp = timestamp;
+
+	if (unbound) {
+		if (!m_Unbound) {
+			m_Unbound = true;
+			m_Stream << "a\n";
+		}
+	} else if (m_Zones.emplace(zone).second) {
+		m_Stream << "z " << zone << "\n";
+	}
+}
+
+/**
+ * Maps a segment into memory.
+ *
+ * @param path Path of the segment
+ */
+ReplayLogSegment::ReplayLogSegment(const String& path)
+	: m_Data(nullptr), m_Size(0)
+{
+#ifndef _WIN32
+	int fd = open(path.CStr(), O_RDONLY);
+
+	if (fd < 0)
+		return;
+
+	struct stat statbuf;
+
+	if (fstat(fd, &statbuf) == 0 && statbuf.st_size > 0) {
+		void *data = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (data != MAP_FAILED) {
+			m_Data = static_cast<const char *>(data);
+			m_Size = statbuf.st_size;
+
+			(void)madvise(data, m_Size, MADV_SEQUENTIAL);
+		}
+	}
+
+	(void)close(fd);
+#else /* _WIN32 */
+	std::ifstream fp (path.CStr(), std::ifstream::in | std::ifstream::binary);
+
+	m_Buffer.assign(std::istreambuf_iterator<char>(fp), std::istreambuf_iterator<char>());
+	m_Data = m_Buffer.data();
+	m_Size = m_Buffer.size();
+#endif /* _WIN32 */
+}
+
+ReplayLogSegment::~ReplayLogSegment()
+{
+#ifndef _WIN32
+	if (m_Data)
+		(void)munmap(const_cast<char *>(m_Data), m_Size);
+#endif /* _WIN32 */
+}
+
+size_t ReplayLogSegment::GetSize() const
+{
+	return m_Size;
+}
+
+/**
+ * Reads a message in netstring format.
+ *
+ * @param offset Where to read, advanced behind the message
+ * @param message The message read
+ *
+ * @return false on the end of the segment
+ * @exception invalid_argument The segment is truncated or corrupted.
+ */
+bool ReplayLogSegment::ReadMessage(uint_fast64_t& offset, String& message) const
+{
+	if (offset >= m_Size)
+		return false;
+
+	uint_fast64_t length = 0;
+	uint_fast64_t pos = offset;
+
+	for (; pos < m_Size && m_Data[pos] != ':'; ++pos) {
+		char digit = m_Data[pos];
+
+		if (digit < '0' || digit > '9' || pos - offset >= 20u)
+			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (bad length)"));
+
+		length = length * 10u + (digit - '0');
+	}
+
+	++pos;
+
+	if (pos > m_Size || length >= m_Size - pos || m_Data[pos + length] != ',')
+		BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid NetString (truncated)"));
+
+	message = String(m_Data + pos, m_Data + pos + length);
+	offset = pos + length + 1u;
+
+	return true;
+}
+
+std::map<String, ReplayLogCompaction::Policy>& ReplayLogCompaction::GetPolicies()
+{
+	static std::map<String, Policy> policies;
+	return policies;
+}
+
+/**
+ * Lets messages of a type be skipped if superseded. Must be called during initialization.
+ *
+ * @param method The message type, e.g. "event::SetNextCheck"
+ * @param policy Which messages supersede each other
+ */
+void ReplayLogCompaction::Register(const String& method, Policy policy)
+{
+	GetPolicies()[method] = std::move(policy);
+}
+
+bool ReplayLogCompaction::IsCompactable(const String& method)
+{
+	return GetPolicies().find(method) != GetPolicies().end();
+}
+
+/**
+ * Considers a message to be replayed.
+ *
+ * @param message The message
+ * @param position Where it's in the log, must be larger than all previous ones
+ */
+void ReplayLogCompaction::Add(const Dictionary::Ptr& message, uint_fast64_t position)
+{
+	m_End = position + 1u;
+
+	auto& policies (GetPolicies());
+	auto policy (policies.find(message->Get("method")));
+
+	if (policy == policies.end())
+		return;
+
+	Dictionary::Ptr params = message->Get("params");
+
+	if (!params)
+		return;
+
+	String key = policy->second.GetKey(params);
+
+	if (key.IsEmpty()) {
+		m_Kept.insert(position);
+		return;
+	}
+
+	auto result (m_Keys.emplace(std::move(key), KeyInfo{position, Empty}));
+	auto& info (result.first->second);
+
+	if (!result.second) {
+		if (m_Kept.find(info.Latest) == m_Kept.end())
+			m_Superseded++;
+
+		m_Latest.erase(info.Latest);
+		info.Latest = position;
+	}
+
+	m_Latest.insert(position);
+
+	if (policy->second.MustKeep && policy->second.MustKeep(params, info.State))
+		m_Kept.insert(position);
+}
+
+/**
+ * Whether a message is still needed. Messages not added before always are.
+ *
+ * @param method The message type
+ * @param position Where it's in the log
+ */
+bool ReplayLogCompaction::ShouldReplay(const String& method, uint_fast64_t position) const
+{
+	if (position >= m_End || !IsCompactable(method))
+		return true;
+
+	return m_Kept.find(position) != m_Kept.end() || m_Latest.find(position) != m_Latest.end();
+}
+
+/**
+ * Returns how many of the added messages won't be replayed.
+ */
+size_t ReplayLogCompaction::GetSuperseded() const
+{
+	return m_Superseded;
+}
+
+std::vector<ReplayLogSnapshot::Provider>& ReplayLogSnapshot::GetProviders()
+{
+	static std::vector<Provider> providers;
+	return providers;
+}
+
+/**
+ * Adds state to snapshots. Must be called during initialization.
+ */
+void ReplayLogSnapshot::Register(Provider provider)
+{
+	GetProviders().emplace_back(std::move(provider));
+}
+
+/**
+ * Emits the messages of a snapshot for a zone.
+ *
+ * @param zone The zone of the endpoint to be synced
+ * @param since The log position of the endpoint
+ * @param emit Called for each message
+ *
+ * @return The number of messages
+ */
+size_t ReplayLogSnapshot::Create(const Zone::Ptr& zone, double since, const EmitFunc& emit)
+{
+	size_t count = 0;
+
+	for (auto& provider : GetProviders()) {
+		provider(zone, since, [&emit, &count](const Dictionary::Ptr& message) {
+			emit(message);
+			count++;
+		});
+	}
+
+	return count;
+}
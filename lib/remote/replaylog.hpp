@@ -0,0 +1,176 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef REPLAYLOG_H
+#define REPLAYLOG_H
+
+#include "remote/i2-remote.hpp"
+#include "remote/zone.hpp"
+#include "base/dictionary.hpp"
+#include "base/string.hpp"
+#include "base/value.hpp"
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * Sparse index of a replay log segment.
+ *
+ * Stored next to the segment (suffix ".idx") as text lines:
+ *
+ *   o <offset> <timestamp>  All messages before offset have at most this timestamp
+ *   z <zone>                The segment contains messages for this zone
+ *   a                       The segment contains messages not bound to any zone
+ *
+ * @ingroup remote
+ */
+class ReplayLogIndex
+{
+public:
+	/* Messages between two offset entries */
+	static const size_t Interval = 256;
+
+	bool Load(const String& path);
+
+	bool IsLoaded() const;
+	uint_fast64_t Seek(double timestamp) const;
+	bool MayConcern(const Zone::Ptr& zone) const;
+
+private:
+	bool m_Loaded{false};
+	bool m_Unbound{false};
+	std::vector<std::pair<uint_fast64_t, double>> m_Offsets;
+	std::set<String> m_Zones;
+};
+
+/**
+ * Appends to the index of the replay log segment being written.
+ *
+ * @ingroup remote
+ */
+class ReplayLogIndexWriter
+{
+public:
+	void Open(const String& path, uint_fast64_t segmentSize);
+	void Close();
+
+	void AddMessage(uint_fast64_t offset, double timestamp, const String& zone, bool unbound);
+
+private:
+	std::ofstream m_Stream;
+	size_t m_Messages{0};
+	double m_MaxTimestamp{0};
+	bool m_Unbound{false};
+	std::set<String> m_Zones;
+};
+
+/**
+ * Read-only view of a replay log segment, memory-mapped where available.
+ *
+ * @ingroup remote
+ */
+class ReplayLogSegment
+{
+public:
+	ReplayLogSegment(const String& path);
+	~ReplayLogSegment();
+
+	ReplayLogSegment(const ReplayLogSegment&) = delete;
+	ReplayLogSegment& operator=(const ReplayLogSegment&) = delete;
+
+	size_t GetSize() const;
+	bool ReadMessage(uint_fast64_t& offset, String& message) const;
+
+private:
+	const char *m_Data;
+	size_t m_Size;
+#ifdef _WIN32
+	std::vector<char> m_Buffer;
+#endif /* _WIN32 */
+};
+
+/**
+ * Skips replay log messages superseded by later ones, see ApiListener::ReplayLog().
+ *
+ * Message types which only set state opt in via Register(). Their key identifies
+ * the object and attribute a message sets, of all messages with the same key
+ * only the latest one is replayed. Except for the ones the policy must keep,
+ * e.g. check results changing the state.
+ *
+ * Messages are identified by their position, e.g. segment and offset. Add() all
+ * messages to be replayed first, then ask ShouldReplay() for each one.
+ *
+ * @ingroup remote
+ */
+class ReplayLogCompaction
+{
+public:
+	struct Policy
+	{
+		/* The object and attribute the message sets. Empty if it must be kept. */
+		std::function<String (const Dictionary::Ptr& params)> GetKey;
+
+		/* Optional. Whether to keep the message even if superseded. May track anything per key in the state. */
+		std::function<bool (const Dictionary::Ptr& params, Value& state)> MustKeep;
+	};
+
+	static void Register(const String& method, Policy policy);
+	static bool IsCompactable(const String& method);
+
+	void Add(const Dictionary::Ptr& message, uint_fast64_t position);
+	bool ShouldReplay(const String& method, uint_fast64_t position) const;
+
+	size_t GetSuperseded() const;
+
+private:
+	struct KeyInfo
+	{
+		uint_fast64_t Latest;
+		Value State;
+	};
+
+	std::unordered_map<String, KeyInfo> m_Keys;
+	std::unordered_set<uint_fast64_t> m_Kept;
+	std::unordered_set<uint_fast64_t> m_Latest;
+	uint_fast64_t m_End{0};
+	size_t m_Superseded{0};
+
+	static std::map<String, Policy>& GetPolicies();
+};
+
+/**
+ * The current state of the objects a zone can access as messages, which a
+ * reconnecting endpoint gets instead of the log up to now, see ApiListener::ReplayLog().
+ *
+ * Whatever has state to sync opts in via Register(). The log is replayed after
+ * the snapshot from the time it has been created, so messages on both sides of
+ * the snapshot must be safe to apply twice.
+ *
+ * @ingroup remote
+ */
+class ReplayLogSnapshot
+{
+public:
+	typedef std::function<void (const Dictionary::Ptr& message)> EmitFunc;
+
+	/* Emits the messages for the objects of the zone whose state may have changed after since. */
+	typedef std::function<void (const Zone::Ptr& zone, double since, const EmitFunc& emit)> Provider;
+
+	static void Register(Provider provider);
+	static size_t Create(const Zone::Ptr& zone, double since, const EmitFunc& emit);
+
+private:
+	static std::vector<Provider>& GetProviders();
+};
+
+}
+
+#endif /* REPLAYLOG_H */
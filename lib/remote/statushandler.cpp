@@ -3,7 +3,6 @@
 #include "remote/statushandler.hpp"
 #include "remote/httputility.hpp"
 #include "remote/filterutility.hpp"
-#include "base/serializer.hpp"
 #include "base/statsfunction.hpp"
 #include "base/namespace.hpp"
 
@@ -31,29 +30,12 @@ public:
 
 	Value GetTargetByName(const String& type, const String& name) const override
 	{
-		Namespace::Ptr statsFunctions = ScriptGlobal::Get("StatsFunctions", &Empty);
-
-		if (!statsFunctions)
-			BOOST_THROW_EXCEPTION(std::invalid_argument("No status functions are available."));
-
-		Value vfunc;
-
-		if (!statsFunctions->Get(name, &vfunc))
-			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid status function name."));
-
-		Function::Ptr func = vfunc;
-
-		if (!func)
-			BOOST_THROW_EXCEPTION(std::invalid_argument("Invalid status function name."));
-
-		Dictionary::Ptr status = new Dictionary();
-		Array::Ptr perfdata = new Array();
-		func->Invoke({ status, perfdata });
+		StatsFunctionResult result = StatsFunctionCache::Get(name);
 
 		return new Dictionary({
 			{ "name", name },
-			{ "status", status },
-			{ "perfdata", Serialize(perfdata, FAState) }
+			{ "status", result.Status },
+			{ "perfdata", result.SerializedPerfdata }
 		});
 	}
 
@@ -4,7 +4,9 @@
 #include "remote/httputility.hpp"
 #include "remote/filterutility.hpp"
 #include "config/configitem.hpp"
+#include "base/application.hpp"
 #include "base/configtype.hpp"
+#include "base/convert.hpp"
 #include "base/scriptglobal.hpp"
 #include "base/logger.hpp"
 #include <boost/algorithm/string/case_conv.hpp>
@@ -114,10 +116,24 @@ bool TemplateQueryHandler::HandleRequest(
 		params->Set(attr, url->GetPath()[3]);
 	}
 
+	QueryPage page;
+
+	try {
+		page = FilterUtility::GetQueryPage(params);
+	} catch (const std::exception& ex) {
+		HttpUtility::SendJsonError(response, params, 400, ex.what());
+		return true;
+	}
+
 	std::vector<Value> objs;
 
 	try {
-		objs = FilterUtility::GetFilterTargets(qd, params, user, "tmpl");
+		/* Templates are only loaded with the config, i.e. they don't change until the next reload. */
+		if (FilterUtility::IsUnfilteredQuery(qd, params, user)
+			&& HttpUtility::SendNotModified(request, response, params, user, Convert::ToString(Application::GetStartTime())))
+			return true;
+
+		objs = FilterUtility::GetFilterTargets(qd, params, user, "tmpl", &page);
 	} catch (const std::exception& ex) {
 		HttpUtility::SendJsonError(response, params, 404,
 			"No templates found.",
@@ -129,6 +145,9 @@ bool TemplateQueryHandler::HandleRequest(
 		{ "results", new Array(std::move(objs)) }
 	});
 
+	if (!page.NextCursor.IsEmpty())
+		result->Set("next_cursor", page.NextCursor);
+
 	response.result(http::status::ok);
 	HttpUtility::SendJsonBody(response, params, result);
 
@@ -3,7 +3,9 @@
 #include "remote/typequeryhandler.hpp"
 #include "remote/httputility.hpp"
 #include "remote/filterutility.hpp"
+#include "base/application.hpp"
 #include "base/configtype.hpp"
+#include "base/convert.hpp"
 #include "base/scriptglobal.hpp"
 #include "base/logger.hpp"
 #include <set>
@@ -81,6 +83,11 @@ bool TypeQueryHandler::HandleRequest(
 	std::vector<Value> objs;
 
 	try {
+		/* The types don't change until the next restart. */
+		if (FilterUtility::IsUnfilteredQuery(qd, params, user)
+			&& HttpUtility::SendNotModified(request, response, params, user, Convert::ToString(Application::GetStartTime())))
+			return true;
+
 		objs = FilterUtility::GetFilterTargets(qd, params, user);
 	} catch (const std::exception& ex) {
 		HttpUtility::SendJsonError(response, params, 404,
@@ -110,7 +117,7 @@ bool TypeQueryHandler::HandleRequest(
 		if (prototype) {
 			ObjectLock olock(prototype);
 			for (const Dictionary::Pair& kv : prototype) {
-				prototypeKeys->Add(kv.first);
+				prototypeKeys->Add(kv.first.GetString());
 			}
 		}
 
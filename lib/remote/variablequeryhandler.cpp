@@ -85,10 +85,19 @@ bool VariableQueryHandler::HandleRequest(
 	if (url->GetPath().size() >= 3)
 		params->Set("variable", url->GetPath()[2]);
 
+	QueryPage page;
+
+	try {
+		page = FilterUtility::GetQueryPage(params);
+	} catch (const std::exception& ex) {
+		HttpUtility::SendJsonError(response, params, 400, ex.what());
+		return true;
+	}
+
 	std::vector<Value> objs;
 
 	try {
-		objs = FilterUtility::GetFilterTargets(qd, params, user, "variable");
+		objs = FilterUtility::GetFilterTargets(qd, params, user, "variable", &page);
 	} catch (const std::exception& ex) {
 		HttpUtility::SendJsonError(response, params, 404,
 			"No variables found.",
@@ -110,6 +119,9 @@ bool VariableQueryHandler::HandleRequest(
 		{ "results", new Array(std::move(results)) }
 	});
 
+	if (!page.NextCursor.IsEmpty())
+		result->Set("next_cursor", page.NextCursor);
+
 	response.result(http::status::ok);
 	HttpUtility::SendJsonBody(response, params, result);
 
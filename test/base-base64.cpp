@@ -1,6 +1,8 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "base/base64.hpp"
+#include "base/hex.hpp"
+#include "base/tlsutility.hpp"
 #include <BoostTestTargetConfig.h>
 
 using namespace icinga;
@@ -42,4 +44,40 @@ BOOST_AUTO_TEST_CASE(base64)
 	}
 }
 
+BOOST_AUTO_TEST_CASE(vectors)
+{
+	/* RFC 4648, section 10 */
+	std::vector<std::pair<String, String>> vectors {
+		{ "", "" },
+		{ "f", "Zg==" },
+		{ "fo", "Zm8=" },
+		{ "foo", "Zm9v" },
+		{ "foob", "Zm9vYg==" },
+		{ "fooba", "Zm9vYmE=" },
+		{ "foobar", "Zm9vYmFy" }
+	};
+
+	for (auto& vector : vectors) {
+		BOOST_CHECK(Base64::Encode(vector.first) == vector.second);
+		BOOST_CHECK(Base64::Decode(vector.second) == vector.first);
+	}
+
+	BOOST_CHECK(Base64::Encode(String(std::string("\xfb\xff", 2))) == "+/8=");
+	BOOST_CHECK(Base64::Decode("+/8") == String(std::string("\xfb\xff", 2)));
+	BOOST_CHECK(Base64::Decode("Zm9vYg") == "foob");
+
+	BOOST_CHECK_THROW(Base64::Decode("Zm9v!"), std::invalid_argument);
+	BOOST_CHECK_THROW(Base64::Decode("Z"), std::invalid_argument);
+	BOOST_CHECK_THROW(Base64::Decode("Zm9=="), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(hex)
+{
+	BOOST_CHECK(Hex::Encode("") == "");
+	BOOST_CHECK(Hex::Encode(String(std::string("\x00\x01\x7f\x80\xab\xff", 6))) == "00017f80abff");
+	BOOST_CHECK(SHA1("abc") == "a9993e364706816aba3e25717850c26c9cd0d89d");
+	BOOST_CHECK(SHA1("abc", true).GetLength() == 20);
+	BOOST_CHECK(SHA256("abc") == "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
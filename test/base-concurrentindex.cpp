@@ -0,0 +1,107 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/concurrentindex.hpp"
+#include "base/convert.hpp"
+#include "base/string.hpp"
+#include <BoostTestTargetConfig.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_concurrentindex)
+
+BOOST_AUTO_TEST_CASE(insert_get)
+{
+	ConcurrentIndex<String, int> index;
+	int value = 0;
+
+	BOOST_CHECK(!index.Get("a", value));
+	BOOST_CHECK(index.Insert("a", 1));
+	BOOST_CHECK(!index.Insert("a", 2));
+	BOOST_CHECK(index.Get("a", value));
+	BOOST_CHECK(value == 1);
+	BOOST_CHECK(index.GetSize() == 1);
+}
+
+BOOST_AUTO_TEST_CASE(erase)
+{
+	ConcurrentIndex<String, int> index;
+	int value = 0;
+
+	index.Insert("a", 1);
+	index.Insert("b", 2);
+
+	BOOST_CHECK(index.Erase("a"));
+	BOOST_CHECK(!index.Erase("a"));
+	BOOST_CHECK(!index.Get("a", value));
+	BOOST_CHECK(index.Get("b", value));
+	BOOST_CHECK(value == 2);
+	BOOST_CHECK(index.GetSize() == 1);
+}
+
+BOOST_AUTO_TEST_CASE(grow)
+{
+	ConcurrentIndex<String, int> index;
+
+	for (int i = 0; i < 1000; i++)
+		BOOST_CHECK(index.Insert("key" + Convert::ToString(i), i));
+
+	BOOST_CHECK(index.GetSize() == 1000);
+
+	for (int i = 0; i < 1000; i++) {
+		int value = -1;
+
+		BOOST_CHECK(index.Get("key" + Convert::ToString(i), value));
+		BOOST_CHECK(value == i);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(readers)
+{
+	ConcurrentIndex<String, String> index;
+	std::vector<String> keys;
+
+	for (int i = 0; i < 2000; i++)
+		keys.emplace_back("key" + Convert::ToString(i));
+
+	/* The even keys are always there, the odd ones come and go. */
+	for (size_t i = 0; i < keys.size(); i += 2)
+		index.Insert(keys[i], keys[i]);
+
+	std::atomic<bool> stop (false);
+	std::atomic<size_t> errors (0);
+	std::vector<std::thread> readers;
+
+	for (int t = 0; t < 4; t++) {
+		readers.emplace_back([&index, &keys, &stop, &errors]() {
+			while (!stop) {
+				for (size_t i = 0; i < keys.size(); i++) {
+					String value;
+
+					if (index.Get(keys[i], value) ? value != keys[i] : i % 2 == 0)
+						errors++;
+				}
+			}
+		});
+	}
+
+	for (int round = 0; round < 5; round++) {
+		for (size_t i = 1; i < keys.size(); i += 2)
+			index.Insert(keys[i], keys[i]);
+
+		for (size_t i = 1; i < keys.size(); i += 2)
+			index.Erase(keys[i]);
+	}
+
+	stop = true;
+
+	for (auto& reader : readers)
+		reader.join();
+
+	BOOST_CHECK(errors == 0);
+	BOOST_CHECK(index.GetSize() == keys.size() / 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,7 +2,9 @@
 
 #include "base/dictionary.hpp"
 #include "base/objectlock.hpp"
+#include "base/objectpool.hpp"
 #include "base/json.hpp"
+#include "base/convert.hpp"
 #include <BoostTestTargetConfig.h>
 
 using namespace icinga;
@@ -183,4 +185,83 @@ BOOST_AUTO_TEST_CASE(json)
 	BOOST_CHECK(deserialized->Get("test2") == "hello world");
 }
 
+BOOST_AUTO_TEST_CASE(duplicates)
+{
+	DictionaryData dict;
+
+	dict.emplace_back("test1", 1);
+	dict.emplace_back("test2", 2);
+	dict.emplace_back("test1", 3);
+
+	Dictionary::Ptr dictionary = new Dictionary(std::move(dict));
+
+	BOOST_CHECK(dictionary->GetLength() == 2);
+	BOOST_CHECK(dictionary->Get("test1") == 1);
+}
+
+BOOST_AUTO_TEST_CASE(large)
+{
+	Dictionary::Ptr dictionary = new Dictionary();
+	int count = Dictionary::IndexThreshold * 4;
+
+	for (int i = count - 1; i >= 0; i--)
+		dictionary->Set("key" + Convert::ToString(i), i);
+
+	BOOST_CHECK(dictionary->GetLength() == static_cast<size_t>(count));
+
+	for (int i = 0; i < count; i++)
+		BOOST_CHECK(dictionary->Get("key" + Convert::ToString(i)) == i);
+
+	BOOST_CHECK(!dictionary->Contains("key"));
+
+	dictionary->Set("key0", "test");
+	BOOST_CHECK(dictionary->Get("key0") == "test");
+	BOOST_CHECK(dictionary->GetLength() == static_cast<size_t>(count));
+
+	dictionary->Remove("key1");
+	BOOST_CHECK(!dictionary->Contains("key1"));
+	BOOST_CHECK(dictionary->Get("key2") == 2);
+
+	{
+		ObjectLock olock(dictionary);
+
+		String previous;
+
+		for (const Dictionary::Pair& kv : dictionary) {
+			BOOST_CHECK(previous < kv.first);
+			previous = kv.first;
+		}
+
+		for (auto it = dictionary->Begin(); it != dictionary->End();) {
+			if (it->first.GetLength() == 4)
+				it = dictionary->Remove(it);
+			else
+				++it;
+		}
+	}
+
+	BOOST_CHECK(dictionary->GetLength() == static_cast<size_t>(count - 10));
+	BOOST_CHECK(!dictionary->Contains("key9"));
+	BOOST_CHECK(dictionary->Get("key10") == 10);
+}
+
+BOOST_AUTO_TEST_CASE(pool)
+{
+	ObjectPoolStats::Scope allocations;
+
+	Dictionary *address;
+
+	{
+		Dictionary::Ptr dictionary = new Dictionary({ { "key", "value" } });
+		address = dictionary.get();
+	}
+
+	/* The next dictionary reuses the freed one's memory. */
+	Dictionary::Ptr dictionary = new Dictionary();
+	BOOST_CHECK(dictionary.get() == address);
+
+	/* At least the two dictionaries, plus the string "value". */
+	BOOST_CHECK(allocations.GetAllocations() >= 3);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
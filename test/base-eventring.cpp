@@ -0,0 +1,85 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/eventring.hpp"
+#include <BoostTestTargetConfig.h>
+#include <thread>
+#include <vector>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_eventring)
+
+BOOST_AUTO_TEST_CASE(construct)
+{
+	EventRing<int> ring (100);
+
+	BOOST_CHECK(ring.GetCapacity() == 128);
+	BOOST_CHECK(ring.IsEmpty());
+	BOOST_CHECK(ring.GetLength() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(push_drain)
+{
+	EventRing<int> ring (4);
+
+	for (int i = 0; i < 4; i++)
+		BOOST_CHECK(ring.TryPush(int(i)));
+
+	BOOST_CHECK(!ring.TryPush(4));
+	BOOST_CHECK(ring.GetLength() == 4);
+
+	std::vector<int> events;
+
+	BOOST_CHECK(ring.Drain(3, [&events](int event) { events.push_back(event); }) == 3);
+	BOOST_CHECK(events == std::vector<int>({ 0, 1, 2 }));
+
+	/* Wraps around. */
+	BOOST_CHECK(ring.TryPush(4));
+	BOOST_CHECK(ring.TryPush(5));
+
+	BOOST_CHECK(ring.Drain(10, [&events](int event) { events.push_back(event); }) == 3);
+	BOOST_CHECK(events == std::vector<int>({ 0, 1, 2, 3, 4, 5 }));
+	BOOST_CHECK(ring.IsEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(producers)
+{
+	EventRing<int> ring (1024);
+	std::vector<std::thread> producers;
+	std::vector<int> counts (4, 0);
+
+	for (int p = 0; p < 4; p++) {
+		producers.emplace_back([&ring, p]() {
+			for (int i = 0; i < 10000; i++) {
+				while (!ring.TryPush(p * 10000 + i))
+					std::this_thread::yield();
+			}
+		});
+	}
+
+	int received = 0;
+	bool ordered = true;
+	std::vector<int> last (4, -1);
+
+	while (received < 40000) {
+		received += ring.Drain(256, [&](int event) {
+			int p = event / 10000;
+
+			/* Events of the same producer keep their order. */
+			if (event % 10000 <= last[p])
+				ordered = false;
+
+			last[p] = event % 10000;
+			counts[p]++;
+		});
+	}
+
+	for (auto& producer : producers)
+		producer.join();
+
+	BOOST_CHECK(ordered);
+	BOOST_CHECK(counts == std::vector<int>({ 10000, 10000, 10000, 10000 }));
+	BOOST_CHECK(ring.IsEmpty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
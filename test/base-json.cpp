@@ -47,6 +47,15 @@ BOOST_AUTO_TEST_CASE(encode)
 	BOOST_CHECK(JsonEncode(input, false) == output);
 }
 
+BOOST_AUTO_TEST_CASE(encode_escapes)
+{
+	BOOST_CHECK(JsonEncode("\"\\/\b\f\n\r\t\x01\x7f") == R"EOF("\"\\/\b\f\n\r\t\u0001\u007f")EOF");
+	BOOST_CHECK(JsonEncode("\xC3\xA4\xF0\x9F\x98\x80\xED\xA0\x80x") == R"EOF("\u00e4\ud83d\ude00\ufffdx")EOF");
+
+	BOOST_CHECK(JsonEncode(new Array({ 0.5, -0.0, 1e21, -9223372036854775808.0, 18446744073709549568.0, 1e100 }))
+		== "[0.5,0,1e+21,-9223372036854775808,18446744073709549568,1e+100]");
+}
+
 BOOST_AUTO_TEST_CASE(decode)
 {
 	String input (R"EOF({
@@ -103,4 +112,44 @@ BOOST_AUTO_TEST_CASE(invalid1)
 	BOOST_CHECK_THROW(JsonDecode("{\"test\": \"test\""), std::exception);
 }
 
+BOOST_AUTO_TEST_CASE(decode_escapes)
+{
+	auto output ((Array::Ptr)JsonDecode(R"EOF([ "\"\\\/\b\f\n\r\t", "\u00e4\ud83d\ude00", {"k\u00e4y": -0} ])EOF"));
+	BOOST_CHECK(output->GetLength() == 3u);
+
+	BOOST_CHECK(output->Get(0) == "\"\\/\b\f\n\r\t");
+	BOOST_CHECK(output->Get(1) == "\xC3\xA4\xF0\x9F\x98\x80");
+
+	auto object ((Dictionary::Ptr)output->Get(2));
+	BOOST_CHECK(object->GetKeys() == std::vector<String>({"k\xC3\xA4y"}));
+	BOOST_CHECK(object->Get("k\xC3\xA4y") == 0);
+
+	BOOST_CHECK(JsonEncode(JsonDecode("\xEF\xBB\xBF [1.5e3, 18446744073709551616]")) == JsonEncode(JsonDecode("[1500, 1.8446744073709552e19]")));
+	BOOST_CHECK(JsonEncode(JsonDecode("{\"k\xC3\": \"v\xED\xA0\x80\"}")) == "{\"k\\ufffd\":\"v\\ufffd\"}");
+}
+
+BOOST_AUTO_TEST_CASE(invalid2)
+{
+	for (auto input : {
+		"", " ", "01", "-", "1.", "1e", "1e400", "[1,]", "[1 2]", "{\"a\":1,}", "{\"a\" 1}", "[1] x",
+		"tru", "\"\\ud800\"", "\"\\udc00\"", "\"\\u00\"", "\"\\x\"", "\"\x01\""
+	}) {
+		BOOST_CHECK_THROW(JsonDecode(input), std::exception);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(decode_range)
+{
+	/* E.g. two netstrings in one network buffer, neither of them NUL-terminated. */
+	const char buffer[] = "13:{\"a\":[1,\"\xC3\"]},6:[true],";
+
+	Dictionary::Ptr first = JsonDecodeRange(buffer + 3, buffer + 16);
+	BOOST_CHECK(JsonEncode(first) == "{\"a\":[1,\"\\ufffd\"]}");
+
+	Array::Ptr second = JsonDecodeRange(buffer + 19, buffer + 25);
+	BOOST_CHECK(second->GetLength() == 1u && second->Get(0) == true);
+
+	BOOST_CHECK_THROW(JsonDecodeRange(buffer + 19, buffer + 24), std::exception);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
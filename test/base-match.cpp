@@ -24,4 +24,29 @@ BOOST_AUTO_TEST_CASE(tolong)
 	BOOST_CHECK(Utility::Match("he**o", "hello"));
 }
 
+BOOST_AUTO_TEST_CASE(literal_wildcards)
+{
+	BOOST_CHECK(Utility::Match("hello", "hello"));
+	BOOST_CHECK(Utility::Match("Hello", "hELLO"));
+	BOOST_CHECK(!Utility::Match("hello", "hell"));
+	BOOST_CHECK(!Utility::Match("hell", "hello"));
+	BOOST_CHECK(Utility::Match("", ""));
+	BOOST_CHECK(!Utility::Match("", "hello"));
+
+	BOOST_CHECK(Utility::Match("HE*", "hello"));
+	BOOST_CHECK(Utility::Match("hello*", "hello"));
+	BOOST_CHECK(!Utility::Match("hello*", "hell"));
+
+	BOOST_CHECK(Utility::Match("*LO", "hello"));
+	BOOST_CHECK(Utility::Match("*hello", "hello"));
+	BOOST_CHECK(!Utility::Match("*hello", "ello"));
+	BOOST_CHECK(!Utility::Match("*he", "hello"));
+
+	BOOST_CHECK(Utility::Match("*ELL*", "hello"));
+	BOOST_CHECK(Utility::Match("*hello*", "hello"));
+	BOOST_CHECK(!Utility::Match("*hola*", "hello"));
+	BOOST_CHECK(Utility::Match("**", ""));
+	BOOST_CHECK(Utility::Match("*", ""));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
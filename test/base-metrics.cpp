@@ -0,0 +1,91 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/metrics.hpp"
+#include <BoostTestTargetConfig.h>
+#include <sstream>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_metrics)
+
+BOOST_AUTO_TEST_CASE(histogram)
+{
+	static Histogram histogram ("test_histogram_seconds", "Durations of a test");
+
+	histogram.Observe(0.5e-6);
+	histogram.Observe(1.5e-6);
+	histogram.Observe(1.6e-6);
+	histogram.Observe(1e4);
+
+	std::ostringstream msgbuf;
+	Histogram::WriteOpenMetrics(msgbuf);
+	String output = msgbuf.str();
+
+	BOOST_CHECK(output.Find("# TYPE test_histogram_seconds histogram\n") != String::NPos);
+	BOOST_CHECK(output.Find("# HELP test_histogram_seconds Durations of a test\n") != String::NPos);
+	BOOST_CHECK(output.Find("# UNIT test_histogram_seconds seconds\n") != String::NPos);
+
+	/* Cumulative and without the empty buckets in between. */
+	BOOST_CHECK(output.Find("test_histogram_seconds_bucket{le=\"1e-06\"} 1\ntest_histogram_seconds_bucket{le=\"1.75e-06\"} 3\n"
+		"test_histogram_seconds_bucket{le=\"+Inf\"} 4\n") != String::NPos);
+	BOOST_CHECK(output.Find("test_histogram_seconds_count 4\n") != String::NPos);
+	BOOST_CHECK(output.Find("test_histogram_seconds_sum 10000\n") != String::NPos);
+
+	BOOST_CHECK(output.SubStr(output.GetLength() - 6) == "# EOF\n");
+}
+
+BOOST_AUTO_TEST_CASE(labels)
+{
+	Histogram first ("test_labelled_seconds", "Labelled durations", "queue");
+	Histogram second ("test_labelled_seconds", "Labelled durations", "queue");
+	Histogram third ("test_labelled_seconds", "Labelled durations", "queue");
+	Histogram unnamed ("test_labelled_seconds", "Labelled durations", "queue");
+
+	first.SetLabelValue("a \"b\"");
+	second.SetLabelValue("a \"b\"");
+	third.SetLabelValue("c");
+
+	first.Observe(1);
+	second.Observe(1);
+	third.Observe(2);
+	unnamed.Observe(3);
+
+	BOOST_CHECK(first.GetCount() == 1);
+	BOOST_CHECK(first.GetSum() == 1);
+
+	std::ostringstream msgbuf;
+	Histogram::WriteOpenMetrics(msgbuf);
+	String output = msgbuf.str();
+
+	/* One header per family, histograms with the same label value are merged. */
+	BOOST_CHECK(output.Find("# TYPE test_labelled_seconds histogram\n") == output.RFind("# TYPE test_labelled_seconds histogram\n"));
+	BOOST_CHECK(output.Find("test_labelled_seconds_count{queue=\"a \\\"b\\\"\"} 2\n") != String::NPos);
+	BOOST_CHECK(output.Find("test_labelled_seconds_count{queue=\"c\"} 1\n") != String::NPos);
+	BOOST_CHECK(output.Find("test_labelled_seconds_sum{queue=\"c\"} 2\n") != String::NPos);
+
+	/* Without a label value */
+	BOOST_CHECK(output.Find("_count{queue=\"\"}") == String::NPos);
+}
+
+BOOST_AUTO_TEST_CASE(gauge)
+{
+	double value = 42;
+	Gauge gauge ("test_gauge_bytes", "A test value", "bytes", [&value]() { return value; });
+
+	std::ostringstream msgbuf;
+	Histogram::WriteOpenMetrics(msgbuf);
+	String output = msgbuf.str();
+
+	BOOST_CHECK(output.Find("# TYPE test_gauge_bytes gauge\n# HELP test_gauge_bytes A test value\n"
+		"# UNIT test_gauge_bytes bytes\ntest_gauge_bytes 42\n") != String::NPos);
+	BOOST_CHECK(output.SubStr(output.GetLength() - 6) == "# EOF\n");
+
+	/* Sampled on every write. */
+	value = 23;
+	msgbuf.str("");
+	Histogram::WriteOpenMetrics(msgbuf);
+
+	BOOST_CHECK(String(msgbuf.str()).Find("test_gauge_bytes 23\n") != String::NPos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
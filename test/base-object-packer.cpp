@@ -5,11 +5,15 @@
 #include "base/string.hpp"
 #include "base/array.hpp"
 #include "base/dictionary.hpp"
+#include "base/convert.hpp"
+#include "base/json.hpp"
+#include "base/tlsutility.hpp"
 #include <BoostTestTargetConfig.h>
 #include <climits>
 #include <initializer_list>
 #include <iomanip>
 #include <sstream>
+#include <string>
 
 using namespace icinga;
 
@@ -261,4 +265,123 @@ BOOST_AUTO_TEST_CASE(pack_object)
 	));
 }
 
+BOOST_AUTO_TEST_CASE(unpack_roundtrip)
+{
+	Dictionary::Ptr in = new Dictionary({
+		{"null", Empty},
+		{"false", false},
+		{"true", true},
+		{"42.125", 42.125},
+		{"foobar", "foobar"},
+		{"[]", (Array::Ptr)new Array()},
+		{"{}", (Dictionary::Ptr)new Dictionary()},
+		{"nested", (Array::Ptr)new Array({
+			(Array::Ptr)new Array({1, 2, (Array::Ptr)new Array({3})}),
+			(Dictionary::Ptr)new Dictionary({{"key", "value"}}),
+			"áéíóú"
+		})}
+	});
+
+	Value out = UnpackObject(PackObject(in));
+
+	BOOST_CHECK(out.IsObjectType<Dictionary>());
+	BOOST_CHECK_EQUAL(JsonEncode(out), JsonEncode(in));
+
+	BOOST_CHECK(UnpackObject(PackObject(Empty)).IsEmpty());
+	BOOST_CHECK_EQUAL(UnpackObject(PackObject(42.125)), 42.125);
+	BOOST_CHECK_EQUAL(UnpackObject(PackObject("foobar")), "foobar");
+}
+
+BOOST_AUTO_TEST_CASE(unpack_invalid)
+{
+	String packed = PackObject((Dictionary::Ptr)new Dictionary({
+		{"foo", (Array::Ptr)new Array({"bar", 42})}
+	}));
+
+	for (size_t i = 0; i < packed.GetLength(); ++i) {
+		BOOST_CHECK_THROW(UnpackObject(packed.SubStr(0, i)), std::invalid_argument);
+	}
+
+	BOOST_CHECK_THROW(UnpackObject(packed + String(std::string("\0", 1))), std::invalid_argument);
+	BOOST_CHECK_THROW(UnpackObject("\7"), std::invalid_argument);
+
+	/* An array which claims to have more elements than bytes are available */
+	BOOST_CHECK_THROW(UnpackObject(String(std::string("\5\xff\xff\xff\xff\xff\xff\xff\xff", 9))), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(pack_sha1)
+{
+	Array::Ptr large = new Array();
+
+	for (int i = 0; i < 1000; ++i) {
+		large->Add(i);
+		large->Add(String(i % 100, 'x'));
+	}
+
+	for (const Value& value : std::initializer_list<Value>{
+		Empty, false, 42.125, "foobar", String(10000, 'x'), large,
+		(Dictionary::Ptr)new Dictionary({{"large", large}, {"bar", "baz"}})
+	}) {
+		BOOST_CHECK_EQUAL(PackObjectSHA1(value), SHA1(PackObject(value)));
+	}
+}
+
+class StringSink : public PackSink
+{
+public:
+	void Write(const char *data, size_t length) override
+	{
+		Buffer.append(data, length);
+		++Writes;
+	}
+
+	std::string Buffer;
+	size_t Writes = 0;
+};
+
+static Array::Ptr MakeBenchmarkValue()
+{
+	Array::Ptr objects = new Array();
+
+	for (int i = 0; i < 1000; ++i) {
+		objects->Add((Dictionary::Ptr)new Dictionary({
+			{"name", "host" + Convert::ToString(i)},
+			{"address", "192.0.2." + Convert::ToString(i % 256)},
+			{"check_interval", 60},
+			{"enable_active_checks", true},
+			{"vars", (Dictionary::Ptr)new Dictionary({
+				{"os", "Linux"},
+				{"disks", (Array::Ptr)new Array({"/", "/var", "/home"})},
+				{"notes", String(200, 'x')}
+			})}
+		}));
+	}
+
+	return objects;
+}
+
+BOOST_AUTO_TEST_CASE(pack_sink)
+{
+	Array::Ptr large = MakeBenchmarkValue();
+
+	for (const Value& value : std::initializer_list<Value>{
+		Empty, false, true, 42.125, "foobar", String(10000, 'x'), (Array::Ptr)new Array(), large,
+		(Dictionary::Ptr)new Dictionary({{"large", large}, {"bar", "baz"}, {"obj", (Object::Ptr)new Object()}})
+	}) {
+		String packed = PackObject(value);
+		StringSink sink;
+
+		PackObject(value, sink);
+
+		BOOST_CHECK(sink.Buffer == packed.GetData());
+		BOOST_CHECK_EQUAL(GetPackedSize(value), packed.GetLength());
+	}
+
+	/* The output is handed over in chunks, not byte by byte */
+	StringSink sink;
+	PackObject(large, sink);
+
+	BOOST_CHECK(sink.Writes < sink.Buffer.size() / 1000u);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,8 +1,11 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "base/object.hpp"
+#include "base/objectlock.hpp"
 #include "base/value.hpp"
 #include <BoostTestTargetConfig.h>
+#include <thread>
+#include <vector>
 
 using namespace icinga;
 
@@ -15,6 +18,8 @@ public:
 	{
 		return this;
 	}
+
+	int Counter = 0;
 };
 
 BOOST_AUTO_TEST_SUITE(base_object)
@@ -36,4 +41,77 @@ BOOST_AUTO_TEST_CASE(getself)
 	BOOST_CHECK(vobject.IsObjectType<TestObject>());
 }
 
+BOOST_AUTO_TEST_CASE(lock)
+{
+	TestObject::Ptr tobject = new TestObject();
+
+	BOOST_CHECK(!ObjectLock::IsOwner(tobject.get()));
+
+	{
+		ObjectLock olock(tobject);
+		BOOST_CHECK(ObjectLock::IsOwner(tobject.get()));
+
+		{
+			ObjectLock olock2(tobject);
+			BOOST_CHECK(ObjectLock::IsOwner(tobject.get()));
+		}
+
+		BOOST_CHECK(ObjectLock::IsOwner(tobject.get()));
+
+		olock.Unlock();
+		BOOST_CHECK(!ObjectLock::IsOwner(tobject.get()));
+	}
+
+	BOOST_CHECK(!ObjectLock::IsOwner(tobject.get()));
+
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < 4; i++) {
+		threads.emplace_back([tobject]() {
+			for (int j = 0; j < 10000; j++) {
+				ObjectLock olock(tobject);
+				ObjectLock olock2(tobject);
+				tobject->Counter++;
+			}
+		});
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+
+	BOOST_CHECK(tobject->Counter == 40000);
+	BOOST_CHECK(!ObjectLock::IsOwner(tobject.get()));
+}
+
+static ObjectTypeStatistics GetTestObjectStatistics()
+{
+	for (auto& type : GetObjectTypeStatistics()) {
+		if (*type.Type == typeid(TestObject))
+			return type;
+	}
+
+	return { &typeid(TestObject), 0, 0 };
+}
+
+BOOST_AUTO_TEST_CASE(type_statistics)
+{
+	auto before (GetTestObjectStatistics());
+
+	{
+		TestObject::Ptr first = new TestObject();
+		TestObject::Ptr second = new TestObject();
+		TestObject::Ptr again = first;
+
+		auto during (GetTestObjectStatistics());
+
+		BOOST_CHECK_EQUAL(during.Count, before.Count + 2);
+		BOOST_CHECK_EQUAL(during.Bytes, before.Bytes + 2 * first->GetObjectSize());
+	}
+
+	auto after (GetTestObjectStatistics());
+
+	BOOST_CHECK_EQUAL(after.Count, before.Count);
+	BOOST_CHECK_EQUAL(after.Bytes, before.Bytes);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
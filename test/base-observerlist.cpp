@@ -0,0 +1,38 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/observerlist.hpp"
+#include "base/value.hpp"
+#include <BoostTestTargetConfig.h>
+#include <vector>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_observerlist)
+
+BOOST_AUTO_TEST_CASE(construct)
+{
+	ObserverList<int> observers;
+
+	BOOST_CHECK(observers.empty());
+
+	/* No slots, nothing happens. */
+	observers(42);
+}
+
+BOOST_AUTO_TEST_CASE(order)
+{
+	ObserverList<int, const Value&> observers;
+	std::vector<int> calls;
+
+	observers.connect([&calls](int i, const Value&) { calls.push_back(i); });
+	observers.connect([&calls](int i, const Value& cookie) { calls.push_back(i * 10 + static_cast<int>(cookie)); });
+
+	BOOST_CHECK(!observers.empty());
+
+	observers(1, 2);
+	observers(3, 4);
+
+	BOOST_CHECK(calls == std::vector<int>({ 1, 12, 3, 34 }));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,52 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/profiler.hpp"
+#include <BoostTestTargetConfig.h>
+#include <chrono>
+#include <thread>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_profiler)
+
+static std::unique_lock<std::mutex> LockForTest(std::mutex& mutex)
+{
+	return PROFILED_LOCK(mutex);
+}
+
+BOOST_AUTO_TEST_CASE(lock_contention)
+{
+	std::mutex mutex;
+
+	BOOST_CHECK(Profiler::Start(0, true));
+
+	std::unique_lock<std::mutex> lock (LockForTest(mutex));
+
+	std::thread waiter ([&mutex]() { (void)LockForTest(mutex); });
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	lock.unlock();
+	waiter.join();
+
+	BOOST_CHECK(!Profiler::Start(0, true));
+	Profiler::Stop();
+
+	auto contention (Profiler::GetLockContention());
+
+	BOOST_REQUIRE(!contention.empty());
+	BOOST_CHECK(contention[0].Site.Contains("base-profiler.cpp:"));
+	BOOST_CHECK_EQUAL(contention[0].Waits, 1);
+	BOOST_CHECK(contention[0].WaitTime >= 0.04);
+	BOOST_CHECK(contention[0].MaxWaitTime == contention[0].WaitTime);
+
+	/* Not recorded anymore. */
+	lock.lock();
+	std::thread other ([&mutex]() { (void)LockForTest(mutex); });
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	lock.unlock();
+	other.join();
+
+	BOOST_CHECK_EQUAL(Profiler::GetLockContention()[0].Waits, 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 #include "base/serializer.hpp"
 #include "base/array.hpp"
 #include "base/dictionary.hpp"
+#include "remote/zone.hpp"
 #include <BoostTestTargetConfig.h>
 
 using namespace icinga;
@@ -65,4 +66,32 @@ BOOST_AUTO_TEST_CASE(object)
 	BOOST_CHECK(result->GetValue() == pdv->GetValue());
 }
 
+BOOST_AUTO_TEST_CASE(config_object)
+{
+	Zone::Ptr zone = new Zone();
+	zone->SetName("serialize", true);
+	zone->SetEndpointsRaw(new Array({ "endpoint1" }), true);
+
+	int fid = Zone::TypeInstance->GetFieldId("endpoints");
+
+	/* Inactive objects aren't tracked. */
+	Array::Ptr endpoints = zone->GetSerializedField(fid);
+	BOOST_CHECK(Array::Ptr(zone->GetSerializedField(fid)) != endpoints);
+
+	zone->PreActivate();
+
+	endpoints = zone->GetSerializedField(fid);
+	BOOST_CHECK(Array::Ptr(zone->GetSerializedField(fid)) == endpoints);
+	BOOST_CHECK(endpoints->Get(0) == "endpoint1");
+
+	Dictionary::Ptr result = Serialize(zone, FAConfig | FAState);
+	BOOST_CHECK(Array::Ptr(result->Get("endpoints")) == endpoints);
+
+	zone->SetEndpointsRaw(new Array({ "endpoint2" }));
+
+	Array::Ptr changed = zone->GetSerializedField(fid);
+	BOOST_CHECK(changed != endpoints);
+	BOOST_CHECK(changed->Get(0) == "endpoint2");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
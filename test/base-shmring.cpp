@@ -0,0 +1,144 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/shmring.hpp"
+#include "base/convert.hpp"
+#include <BoostTestTargetConfig.h>
+#include <cstring>
+#include <thread>
+
+#ifndef _WIN32
+#	include <unistd.h>
+#endif /* _WIN32 */
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_shmring)
+
+BOOST_AUTO_TEST_CASE(write_read)
+{
+	alignas(64) char memory[2048];
+	SharedMemoryRing ring (memory, 64);
+
+	BOOST_CHECK(ring.GetCapacity() == 64);
+	BOOST_CHECK(ring.GetLength() == 0);
+
+	String message;
+	BOOST_CHECK(!ring.TryRead(message));
+
+	/* Each message takes its length and four bytes. */
+	BOOST_CHECK(ring.TryWrite("0123456789"));
+	BOOST_CHECK(ring.TryWrite(""));
+	BOOST_CHECK(ring.TryWrite(String(40, 'x')));
+	BOOST_CHECK(!ring.TryWrite("too much"));
+	BOOST_CHECK(ring.GetLength() == 62);
+
+	BOOST_CHECK(ring.TryRead(message) && message == "0123456789");
+	BOOST_CHECK(ring.TryRead(message) && message == "");
+
+	/* Wraps around. */
+	BOOST_CHECK(ring.TryWrite("abcdefghij"));
+
+	BOOST_CHECK(ring.TryRead(message) && message == String(40, 'x'));
+	BOOST_CHECK(ring.TryRead(message) && message == "abcdefghij");
+	BOOST_CHECK(!ring.TryRead(message));
+
+	/* Never fits. */
+	BOOST_CHECK(!ring.TryWrite(String(61, 'x')));
+}
+
+BOOST_AUTO_TEST_CASE(wait_notify)
+{
+	alignas(64) char memory[2048];
+	SharedMemoryRing ring (memory, 64);
+
+	/* Nobody waits, nobody has to be woken up. */
+	BOOST_CHECK(ring.TryWrite("a"));
+	BOOST_CHECK(!ring.Notify());
+
+	/* There's a message, the consumer must not wait. */
+	BOOST_CHECK(!ring.PrepareWait());
+	BOOST_CHECK(!ring.Notify());
+
+	String message;
+	BOOST_CHECK(ring.TryRead(message));
+
+	BOOST_CHECK(ring.PrepareWait());
+	BOOST_CHECK(ring.TryWrite("b"));
+	BOOST_CHECK(ring.Notify());
+
+	/* Only once. */
+	BOOST_CHECK(ring.TryWrite("c"));
+	BOOST_CHECK(!ring.Notify());
+}
+
+BOOST_AUTO_TEST_CASE(corrupted)
+{
+	alignas(64) char memory[2048];
+	SharedMemoryRing ring (memory, 64);
+
+	BOOST_CHECK(ring.TryWrite("x"));
+
+	/* The length in front of the message, as if the other side had overwritten it. */
+	uint32_t length = 0x7fffffff;
+	memcpy(memory + SharedMemoryRing::GetSize(64) - 64, &length, sizeof(length));
+
+	String message;
+	BOOST_CHECK_THROW(ring.TryRead(message), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(threads)
+{
+	alignas(64) char memory[2048];
+	SharedMemoryRing ring (memory, 1024);
+
+	std::thread producer ([&ring]() {
+		for (int i = 0; i < 10000; i++) {
+			String message = String(i % 100, 'x') + Convert::ToString(i);
+
+			while (!ring.TryWrite(message))
+				std::this_thread::yield();
+		}
+	});
+
+	int received = 0;
+	bool ordered = true;
+
+	while (received < 10000) {
+		String message;
+
+		if (!ring.TryRead(message)) {
+			std::this_thread::yield();
+			continue;
+		}
+
+		ordered = ordered && message == String(received % 100, 'x') + Convert::ToString(received);
+		received++;
+	}
+
+	producer.join();
+
+	BOOST_CHECK(ordered);
+}
+
+#ifndef _WIN32
+BOOST_AUTO_TEST_CASE(shared)
+{
+	SharedMemory memory (SharedMemoryRing::GetSize(4096));
+	SharedMemoryRing ring (memory.GetAddress(), 4096);
+
+	/* Another process would map the memory through its FD like this. */
+	SharedMemory other (dup(memory.GetFD()));
+	SharedMemoryRing otherRing (other.GetAddress());
+
+	BOOST_CHECK(other.GetSize() == memory.GetSize());
+	BOOST_CHECK(otherRing.GetCapacity() == 4096);
+
+	BOOST_CHECK(ring.TryWrite("hello"));
+
+	String message;
+	BOOST_CHECK(otherRing.TryRead(message) && message == "hello");
+	BOOST_CHECK(ring.GetLength() == 0);
+}
+#endif /* _WIN32 */
+
+BOOST_AUTO_TEST_SUITE_END()
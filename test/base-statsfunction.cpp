@@ -0,0 +1,33 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/statsfunction.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_statsfunction)
+
+BOOST_AUTO_TEST_CASE(cached)
+{
+	StatsFunctionResult first = StatsFunctionCache::Get("WorkQueue");
+	StatsFunctionResult second = StatsFunctionCache::Get("WorkQueue");
+
+	BOOST_CHECK(first.Status);
+	BOOST_CHECK(first.Status == second.Status);
+	BOOST_CHECK(first.SerializedPerfdata == second.SerializedPerfdata);
+
+	StatsFunctionCache::SetTtl("WorkQueue", 0);
+
+	StatsFunctionResult third = StatsFunctionCache::Get("WorkQueue");
+
+	BOOST_CHECK(third.Status != first.Status);
+
+	StatsFunctionCache::SetTtl("WorkQueue", 1);
+}
+
+BOOST_AUTO_TEST_CASE(invalid_name)
+{
+	BOOST_CHECK_THROW(StatsFunctionCache::Get("NoSuchStatsFunction"), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,5 +1,6 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
+#include "base/internedstring.hpp"
 #include "base/string.hpp"
 #include <BoostTestTargetConfig.h>
 
@@ -101,4 +102,30 @@ BOOST_AUTO_TEST_CASE(find)
 	BOOST_CHECK(s.FindFirstOf("xl") == 2);
 }
 
+BOOST_AUTO_TEST_CASE(interned)
+{
+	size_t poolSize = InternedString::GetPoolSize();
+
+	{
+		InternedString s1 = "interned_test_key";
+		InternedString s2 = String("interned_test_") + "key";
+		InternedString s3 = "interned_test_value";
+
+		BOOST_CHECK(s1 == s2);
+		BOOST_CHECK(s1.CStr() == s2.CStr());
+		BOOST_CHECK(s1 != s3);
+		BOOST_CHECK(s1 < s3);
+		BOOST_CHECK(s1 == "interned_test_key");
+		BOOST_CHECK(s1.GetString() == "interned_test_key");
+
+		BOOST_CHECK(InternedString::GetPoolSize() == poolSize + 2);
+	}
+
+	BOOST_CHECK(InternedString::GetPoolSize() == poolSize);
+
+	InternedString empty;
+	BOOST_CHECK(empty.IsEmpty());
+	BOOST_CHECK(empty == InternedString(""));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
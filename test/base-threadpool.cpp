@@ -0,0 +1,64 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/threadpool.hpp"
+#include <BoostTestTargetConfig.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_threadpool)
+
+BOOST_AUTO_TEST_CASE(lanes)
+{
+	ThreadPool tp (2);
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	bool release = false;
+	std::atomic<int> blocked (0);
+
+	/* Occupy all threads of the default lane. */
+	for (int i = 0; i < 2; i++) {
+		BOOST_CHECK(tp.Post([&]() {
+			blocked++;
+
+			std::unique_lock<std::mutex> lock (mutex);
+			cv.wait(lock, [&]() { return release; });
+		}, DefaultScheduler));
+	}
+
+	while (blocked < 2)
+		std::this_thread::yield();
+
+	std::atomic<bool> lowLatency (false), background (false);
+
+	tp.Post([&]() { lowLatency = true; }, LowLatencyScheduler);
+	tp.Post([&]() { background = true; }, BackgroundScheduler);
+	tp.Post([]() { }, DefaultScheduler);
+
+	auto deadline (std::chrono::steady_clock::now() + std::chrono::seconds(10));
+
+	while (!(lowLatency && background) && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	BOOST_CHECK(lowLatency);
+	BOOST_CHECK(background);
+	BOOST_CHECK(tp.GetPending(DefaultScheduler) == 1);
+	BOOST_CHECK(tp.GetPending() == 1);
+
+	{
+		std::unique_lock<std::mutex> lock (mutex);
+		release = true;
+	}
+
+	cv.notify_all();
+	tp.Stop();
+
+	BOOST_CHECK(tp.GetPending() == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -22,6 +22,31 @@ BOOST_AUTO_TEST_CASE(interval)
 	BOOST_CHECK(timer->GetInterval() == 1.5);
 }
 
+BOOST_AUTO_TEST_CASE(slack)
+{
+	Timer::Ptr timer = new Timer();
+	timer->SetInterval(100);
+	timer->SetSlack(0.05);
+
+	/* Less than the finest granularity, nothing to round. */
+	timer->Reschedule(1000.123);
+	BOOST_CHECK(timer->GetNext() == 1000.123);
+
+	timer->SetSlack(7);
+	BOOST_CHECK(timer->GetSlack() == 7);
+
+	/* Rounded up to the next multiple of 5 seconds. */
+	timer->Reschedule(1001.5);
+	BOOST_CHECK(timer->GetNext() == 1005);
+
+	timer->Reschedule(1005);
+	BOOST_CHECK(timer->GetNext() == 1005);
+
+	timer->SetSlack(60);
+	timer->Reschedule(1001);
+	BOOST_CHECK(timer->GetNext() == 1020);
+}
+
 int counter = 0;
 
 static void Callback(const Timer * const&)
@@ -58,4 +83,40 @@ BOOST_AUTO_TEST_CASE(scope)
 	BOOST_CHECK(counter >= 4 && counter <= 6);
 }
 
+BOOST_AUTO_TEST_CASE(wheel_invoke)
+{
+	Timer::SetBackend(TimerBackendWheel);
+
+	Timer::Ptr timer = new Timer();
+	timer->OnTimerExpired.connect(&Callback);
+	timer->SetInterval(1);
+
+	counter = 0;
+	timer->Start();
+	Utility::Sleep(5.5);
+	timer->Stop();
+
+	Timer::SetBackend(TimerBackendOrdered);
+
+	BOOST_CHECK(counter >= 4 && counter <= 6);
+}
+
+BOOST_AUTO_TEST_CASE(switch_backend)
+{
+	Timer::Ptr timer = new Timer();
+	timer->OnTimerExpired.connect(&Callback);
+	timer->SetInterval(1);
+
+	counter = 0;
+	timer->Start();
+	Utility::Sleep(2.5);
+	Timer::SetBackend(TimerBackendWheel);
+	Utility::Sleep(3);
+	timer->Stop();
+
+	Timer::SetBackend(TimerBackendOrdered);
+
+	BOOST_CHECK(counter >= 4 && counter <= 6);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,74 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/tracing.hpp"
+#include <BoostTestTargetConfig.h>
+#include <vector>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_tracing)
+
+BOOST_AUTO_TEST_CASE(traceparent)
+{
+	TraceContext context = TraceContext::Parse("00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01");
+
+	BOOST_CHECK(context.IsSampled());
+	BOOST_CHECK(context.TraceIdHigh == 0x0af7651916cd43ddu);
+	BOOST_CHECK(context.TraceIdLow == 0x8448eb211c80319cu);
+	BOOST_CHECK(context.SpanId == 0xb7ad6b7169203331u);
+	BOOST_CHECK(context.ToString() == "00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01");
+
+	/* Not sampled */
+	BOOST_CHECK(!TraceContext::Parse("00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-00").IsSampled());
+
+	/* Malformed */
+	BOOST_CHECK(!TraceContext::Parse("").IsSampled());
+	BOOST_CHECK(!TraceContext::Parse("00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331").IsSampled());
+	BOOST_CHECK(!TraceContext::Parse("00-0AF7651916CD43DD8448EB211C80319C-b7ad6b7169203331-01").IsSampled());
+}
+
+BOOST_AUTO_TEST_CASE(spans)
+{
+	std::vector<SpanData> spans;
+
+	{
+		Span span ("unsampled", TraceContext::StartTrace());
+		BOOST_CHECK(!span.IsRecording());
+	}
+
+	Span::SetExporter([&spans](const SpanData& span) { spans.push_back(span); }, 1);
+
+	{
+		Span root ("root", TraceContext::StartTrace());
+		BOOST_CHECK(root.IsRecording());
+
+		{
+			Span child ("child");
+			BOOST_CHECK(child.IsRecording());
+			BOOST_CHECK(Span::GetCurrentContext().SpanId == child.GetContext().SpanId);
+		}
+
+		BOOST_CHECK(Span::GetCurrentContext().SpanId == root.GetContext().SpanId);
+	}
+
+	Span::SetExporter(nullptr, 0);
+
+	{
+		Span span ("disabled", TraceContext::Parse("00-0af7651916cd43dd8448eb211c80319c-b7ad6b7169203331-01"));
+		BOOST_CHECK(!span.IsRecording());
+	}
+
+	BOOST_CHECK(!Span::GetCurrentContext().IsSampled());
+
+	BOOST_REQUIRE(spans.size() == 2);
+	BOOST_CHECK(spans[0].Name == String("child"));
+	BOOST_CHECK(spans[1].Name == String("root"));
+	BOOST_CHECK(spans[1].ParentSpanId == 0);
+	BOOST_CHECK(spans[0].ParentSpanId == spans[1].Context.SpanId);
+	BOOST_CHECK(spans[0].Context.TraceIdHigh == spans[1].Context.TraceIdHigh);
+	BOOST_CHECK(spans[0].Context.TraceIdLow == spans[1].Context.TraceIdLow);
+	BOOST_CHECK(spans[0].StartTime >= spans[1].StartTime);
+	BOOST_CHECK(spans[0].EndTime <= spans[1].EndTime);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,7 @@
 #include "base/application.hpp"
 #include "base/type.hpp"
 #include <BoostTestTargetConfig.h>
+#include <cstring>
 
 using namespace icinga;
 
@@ -44,4 +45,23 @@ BOOST_AUTO_TEST_CASE(instantiate)
 	BOOST_CHECK(p);
 }
 
+BOOST_AUTO_TEST_CASE(field_ids)
+{
+	for (const Type::Ptr& type : Type::GetAllTypes()) {
+		for (int i = 0; i < type->GetFieldCount(); i++) {
+			int fid = type->GetFieldId(type->GetFieldInfo(i).Name);
+
+			/* Derived types may hide fields of their base types. */
+			BOOST_CHECK(fid >= i && strcmp(type->GetFieldInfo(fid).Name, type->GetFieldInfo(i).Name) == 0);
+		}
+
+		BOOST_CHECK(type->GetFieldId("no_such_field") == -1);
+		BOOST_CHECK(type->GetFieldId("") == -1);
+	}
+
+	Type::Ptr t = Type::GetByName("Application");
+
+	BOOST_CHECK(t->GetFieldId("name") == ConfigObject::TypeInstance->GetFieldId("name"));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
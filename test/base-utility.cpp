@@ -1,12 +1,16 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "base/utility.hpp"
+#include "base/exception.hpp"
 #include <chrono>
+#include <fstream>
 #include <BoostTestTargetConfig.h>
 
 #ifdef _WIN32
 # include <windows.h>
 # include <shellapi.h>
+#else /* _WIN32 */
+# include <unistd.h>
 #endif /* _WIN32 */
 
 using namespace icinga;
@@ -111,4 +115,41 @@ BOOST_AUTO_TEST_CASE(EscapeCreateProcessArg)
 #endif /* _WIN32 */
 }
 
+#ifndef _WIN32
+BOOST_AUTO_TEST_CASE(glob_recursive)
+{
+	char dir[] = "/tmp/globrecursive-XXXXXX";
+	BOOST_REQUIRE(mkdtemp(dir));
+
+	String root = dir;
+
+	Utility::MkDirP(root + "/d1/sub", 0700);
+	Utility::MkDirP(root + "/d2", 0700);
+
+	for (auto file : { "/b.conf", "/a.conf", "/x.txt", "/d2/c.conf", "/d1/g.conf", "/d1/e.conf", "/d1/sub/f.conf" })
+		std::ofstream(root + file).close();
+
+	/* Followed like a directory. */
+	BOOST_REQUIRE(symlink("d2", (root + "/link").CStr()) == 0);
+
+	std::vector<String> paths;
+
+	Utility::GlobRecursive(root, "*.conf", [&paths](const String& path) { paths.push_back(path); }, GlobFile);
+
+	/* Each directory's files, then its subdirectories, both sorted. */
+	BOOST_CHECK(paths == std::vector<String>({ root + "/a.conf", root + "/b.conf", root + "/d1/e.conf", root + "/d1/g.conf",
+		root + "/d1/sub/f.conf", root + "/d2/c.conf", root + "/link/c.conf" }));
+
+	paths.clear();
+
+	Utility::GlobRecursive(root, "*", [&paths](const String& path) { paths.push_back(path); }, GlobDirectory);
+
+	BOOST_CHECK(paths == std::vector<String>({ root + "/d1", root + "/d2", root + "/link", root + "/d1/sub" }));
+
+	Utility::RemoveDirRecursive(root);
+
+	BOOST_CHECK_THROW(Utility::GlobRecursive(root, "*", [](const String&) { }), posix_error);
+}
+#endif /* _WIN32 */
+
 BOOST_AUTO_TEST_SUITE_END()
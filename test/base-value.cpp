@@ -1,6 +1,7 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "base/value.hpp"
+#include "base/dictionary.hpp"
 #include <BoostTestTargetConfig.h>
 
 using namespace icinga;
@@ -49,4 +50,36 @@ BOOST_AUTO_TEST_CASE(format)
 	BOOST_CHECK(v != 3);
 }
 
+BOOST_AUTO_TEST_CASE(storage)
+{
+	BOOST_CHECK(sizeof(Value) <= 2 * sizeof(double));
+
+	Value s1 = "hello";
+	Value s2 (s1);
+
+	/* Copies share the string. */
+	BOOST_CHECK(&s1.Get<String>() == &s2.Get<String>());
+
+	s1 = s1;
+	BOOST_CHECK(s1 == "hello");
+
+	Value s3 (std::move(s2));
+	BOOST_CHECK(s3 == "hello");
+	BOOST_CHECK(s2.GetType() == ValueEmpty);
+
+	Value o = new Dictionary({ { "key", "value" } });
+
+	/* Replacing an object by one of its own values. */
+	o = static_cast<Dictionary::Ptr>(o)->Get("key");
+	BOOST_CHECK(o == "value");
+
+	Value n = 42;
+	n.Swap(s3);
+	BOOST_CHECK(n == "hello");
+	BOOST_CHECK(s3 == 42);
+
+	BOOST_CHECK_THROW(n.Get<double>(), boost::bad_get);
+	BOOST_CHECK_THROW(s3.Get<String>(), boost::bad_get);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,87 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "base/workqueue.hpp"
+#include <BoostTestTargetConfig.h>
+#include <atomic>
+#include <vector>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(base_workqueue)
+
+static void TestParallelFor(bool workStealing)
+{
+	WorkQueue upq(25000, 4);
+	upq.SetName("ParallelFor");
+	upq.SetWorkStealing(workStealing);
+
+	std::vector<int> items (10000);
+
+	for (size_t i = 0; i < items.size(); i++)
+		items[i] = i;
+
+	std::vector<std::atomic<int> > visited (items.size());
+
+	upq.ParallelFor(items, [&visited](int item) {
+		visited[item]++;
+	});
+
+	upq.Join();
+
+	for (auto& count : visited)
+		BOOST_CHECK(count == 1);
+
+	BOOST_CHECK(!upq.HasExceptions());
+}
+
+BOOST_AUTO_TEST_CASE(parallelfor)
+{
+	TestParallelFor(false);
+}
+
+BOOST_AUTO_TEST_CASE(parallelfor_workstealing)
+{
+	TestParallelFor(true);
+}
+
+BOOST_AUTO_TEST_CASE(workstealing)
+{
+	WorkQueue upq(100, 4);
+	upq.SetName("WorkStealing");
+	upq.SetWorkStealing(true);
+
+	std::atomic<int> counter (0);
+
+	for (int i = 0; i < 1000; i++) {
+		upq.Enqueue([&upq, &counter]() {
+			/* Spawn local tasks from within the worker threads. */
+			for (int j = 0; j < 10; j++) {
+				upq.Enqueue([&counter]() { counter++; }, PriorityHigh);
+			}
+
+			counter++;
+		}, i % 2 ? PriorityLow : PriorityNormal);
+	}
+
+	upq.Join();
+
+	BOOST_CHECK(counter == 11000);
+	BOOST_CHECK(upq.GetLength() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(workstealing_exceptions)
+{
+	WorkQueue upq(0, 2);
+	upq.SetName("WorkStealingExceptions");
+	upq.SetWorkStealing(true);
+
+	for (int i = 0; i < 10; i++) {
+		upq.Enqueue([]() { throw std::runtime_error("test"); });
+	}
+
+	upq.Join();
+
+	BOOST_CHECK(upq.GetExceptions().size() == 10);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
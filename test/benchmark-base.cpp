@@ -0,0 +1,422 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "benchmark.hpp"
+#include "base/array.hpp"
+#include "base/base64.hpp"
+#include "base/convert.hpp"
+#include "base/dictionary.hpp"
+#include "base/json.hpp"
+#include "base/object-packer.hpp"
+#include "base/objectlock.hpp"
+#include "base/observerlist.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/timer.hpp"
+#include "base/tlsutility.hpp"
+#include "base/utility.hpp"
+#include <boost/signals2.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+using namespace icinga;
+
+/* Keeps the compiler from optimizing the measured operations away. */
+static volatile size_t l_Sink;
+
+BENCHMARK(value)
+{
+	size_t count = 1000000 * bench.GetScale();
+	std::vector<Value> values;
+
+	values.reserve(count);
+
+	for (size_t i = 0; i < count; i++) {
+		if (i % 2)
+			values.emplace_back("service-" + Convert::ToString(i));
+		else
+			values.emplace_back(static_cast<double>(i));
+	}
+
+	bench.Measure("copy", count, [&values]() {
+		std::vector<Value> copy (values);
+		l_Sink = copy.size();
+	});
+
+	bench.Measure("add", count, [&values]() {
+		Value sum = 0;
+
+		for (const Value& value : values) {
+			if (value.IsNumber())
+				sum = sum + value;
+		}
+
+		l_Sink = static_cast<size_t>(sum.Get<double>());
+	});
+}
+
+BENCHMARK(dictionary)
+{
+	size_t keys = 10000 * bench.GetScale();
+	std::vector<String> names;
+
+	names.reserve(keys);
+
+	for (size_t i = 0; i < keys; i++)
+		names.emplace_back("key" + Convert::ToString(i));
+
+	Dictionary::Ptr dict = new Dictionary();
+
+	bench.Measure("set", keys, [&dict, &names]() {
+		for (auto& name : names)
+			dict->Set(name, 42);
+	});
+
+	bench.Measure("get", keys, [&dict, &names]() {
+		size_t found = 0;
+
+		for (auto& name : names) {
+			if (!dict->Get(name).IsEmpty())
+				found++;
+		}
+
+		l_Sink = found;
+	});
+
+	size_t small = 100000 * bench.GetScale();
+
+	bench.Measure("construct_small", small, [small]() {
+		for (size_t i = 0; i < small; i++) {
+			Dictionary::Ptr dict = new Dictionary({
+				{ "state", 0 },
+				{ "output", "OK" },
+				{ "execution_start", 1.5 },
+				{ "execution_end", 2.5 }
+			});
+
+			l_Sink = dict->GetLength();
+		}
+	});
+
+	/* Small dictionaries are scanned linearly, larger ones use an index. */
+	for (size_t size : std::vector<size_t>{ 4, 16, Dictionary::IndexThreshold + 1u, 1000 }) {
+		size_t rounds = 100000 * bench.GetScale() / size;
+		String suffix = "_" + Convert::ToString(size);
+
+		names.clear();
+
+		for (size_t i = 0; i < size; i++)
+			names.emplace_back("attribute_" + Convert::ToString(i * 7919 % size));
+
+		bench.Measure("set" + suffix, rounds * size, [rounds, &dict, &names]() {
+			for (size_t r = 0; r < rounds; r++) {
+				dict = new Dictionary();
+
+				for (auto& name : names)
+					dict->Set(name, static_cast<double>(r));
+			}
+		});
+
+		bench.Measure("contains" + suffix, rounds * size, [rounds, &dict, &names]() {
+			size_t found = 0;
+
+			for (size_t r = 0; r < rounds; r++) {
+				for (auto& name : names)
+					found += dict->Contains(name);
+			}
+
+			l_Sink = found;
+		});
+
+		bench.Measure("iterate" + suffix, rounds * size, [rounds, &dict]() {
+			size_t iterated = 0;
+
+			for (size_t r = 0; r < rounds; r++) {
+				ObjectLock olock(dict);
+
+				for (const Dictionary::Pair& kv : dict)
+					iterated += kv.second.IsEmpty() ? 0 : 1;
+			}
+
+			l_Sink = iterated;
+		});
+	}
+}
+
+static Dictionary::Ptr MakeJsonDocument(size_t entries)
+{
+	ArrayData items;
+
+	for (size_t i = 0; i < entries; i++) {
+		items.emplace_back(new Dictionary({
+			{ "name", "host-" + Convert::ToString(i) + "!service" },
+			{ "state", static_cast<double>(i % 4) },
+			{ "output", "OK - Everything is \"fine\"\n" },
+			{ "performance_data", new Array({ "time=0.1s;1;2;0", "size=42B" }) },
+			{ "active", true }
+		}));
+	}
+
+	return new Dictionary({ { "results", new Array(std::move(items)) } });
+}
+
+BENCHMARK(json)
+{
+	size_t documents = 100 * bench.GetScale();
+	Dictionary::Ptr document = MakeJsonDocument(100);
+	String json = JsonEncode(document);
+
+	bench.Measure("encode", documents, [documents, &document]() {
+		for (size_t i = 0; i < documents; i++)
+			l_Sink = JsonEncode(document).GetLength();
+	});
+
+	bench.Measure("decode", documents, [documents, &json]() {
+		for (size_t i = 0; i < documents; i++) {
+			Dictionary::Ptr result = JsonDecode(json);
+			l_Sink = result->GetLength();
+		}
+	});
+}
+
+BENCHMARK(json_decode_message)
+{
+	/* A typical event::CheckResult cluster message. */
+	String message (R"EOF({"jsonrpc":"2.0","method":"event::CheckResult","params":{"cr":{"active":true,"check_source":"satellite1.example.com",)EOF"
+		R"EOF("command":["/usr/lib/nagios/plugins/check_disk","-c","10%","-w","20%","-X","tmpfs","-p","/"],"execution_end":1598866546.563744,)EOF"
+		R"EOF("execution_start":1598866546.548432,"exit_status":0,"output":"DISK OK - free space: / 24753 MiB (65% inode=90%);",)EOF"
+		R"EOF("performance_data":["/=13044MB;30830;34684;0;38538"],"schedule_end":1598866546.563848,"schedule_start":1598866546.5474,)EOF"
+		R"EOF("scheduling_source":"satellite1.example.com","state":0.0,"ttl":0.0,"type":"CheckResult",)EOF"
+		R"EOF("vars_after":{"attempt":1.0,"reachable":true,"state":0.0,"state_type":1.0},)EOF"
+		R"EOF("vars_before":{"attempt":1.0,"reachable":true,"state":0.0,"state_type":1.0}},)EOF"
+		R"EOF("host":"web1.example.com","service":"disk \u00e4 /"},"ts":1598866546.564143})EOF");
+
+	size_t rounds = 20000 * bench.GetScale();
+
+	bench.Measure("check_result", rounds, [rounds, &message]() {
+		for (size_t i = 0; i < rounds; i++) {
+			Dictionary::Ptr decoded = JsonDecode(message);
+			l_Sink = decoded->GetLength();
+		}
+	});
+}
+
+BENCHMARK(json_encode_message)
+{
+	Dictionary::Ptr message = JsonDecode(R"EOF({"jsonrpc":"2.0","method":"event::CheckResult","params":{"cr":{"active":true,)EOF"
+		R"EOF("check_source":"satellite1.example.com","command":["/usr/lib/nagios/plugins/check_disk","-c","10%","-w","20%"],)EOF"
+		R"EOF("execution_end":1598866546.563744,"execution_start":1598866546.548432,"exit_status":0,)EOF"
+		R"EOF("output":"DISK OK - free space: / 24753 MiB (65% inode=90%);\nä","performance_data":["/=13044MB;30830;34684;0;38538"],)EOF"
+		R"EOF("state":0.0,"ttl":0.0,"type":"CheckResult","vars_after":{"attempt":1.0,"reachable":true,"state":0.0,"state_type":1.0}},)EOF"
+		R"EOF("host":"web1.example.com","service":"disk /"},"ts":1598866546.564143})EOF");
+
+	size_t rounds = 20000 * bench.GetScale();
+
+	bench.Measure("check_result", rounds, [rounds, &message]() {
+		for (size_t i = 0; i < rounds; i++)
+			l_Sink = JsonEncode(message).GetLength();
+	});
+}
+
+class NullSink : public PackSink
+{
+public:
+	void Write(const char *, size_t length) override
+	{
+		Length += length;
+	}
+
+	size_t Length = 0;
+};
+
+BENCHMARK(object_packer)
+{
+	Array::Ptr value = new Array();
+
+	for (int i = 0; i < 1000; i++) {
+		value->Add(new Dictionary({
+			{ "name", "host" + Convert::ToString(i) },
+			{ "address", "192.0.2." + Convert::ToString(i % 256) },
+			{ "check_interval", 60 },
+			{ "enable_active_checks", true },
+			{ "vars", new Dictionary({
+				{ "os", "Linux" },
+				{ "disks", new Array({ "/", "/var", "/home" }) },
+				{ "notes", String(200, 'x') }
+			}) }
+		}));
+	}
+
+	size_t rounds = 20 * bench.GetScale();
+
+	bench.Measure("pack", rounds, [rounds, &value]() {
+		for (size_t i = 0; i < rounds; i++)
+			l_Sink = PackObject(value).GetLength();
+	});
+
+	bench.Measure("pack_sink", rounds, [rounds, &value]() {
+		for (size_t i = 0; i < rounds; i++) {
+			NullSink sink;
+			PackObject(value, sink);
+			l_Sink = sink.Length;
+		}
+	});
+
+	bench.Measure("packed_size", rounds, [rounds, &value]() {
+		for (size_t i = 0; i < rounds; i++)
+			l_Sink = GetPackedSize(value);
+	});
+
+	bench.Measure("pack_sha1", rounds, [rounds, &value]() {
+		for (size_t i = 0; i < rounds; i++)
+			l_Sink = PackObjectSHA1(value).GetLength();
+	});
+}
+
+BENCHMARK(base64)
+{
+	size_t rounds = 20000 * bench.GetScale();
+	String data;
+
+	for (int i = 0; i < 1024; i++)
+		data += static_cast<char>(i * 7);
+
+	String encoded = Base64::Encode(data);
+
+	bench.Measure("encode", rounds, [rounds, &data]() {
+		for (size_t i = 0; i < rounds; i++)
+			l_Sink = Base64::Encode(data).GetLength();
+	});
+
+	bench.Measure("decode", rounds, [rounds, &encoded]() {
+		for (size_t i = 0; i < rounds; i++)
+			l_Sink = Base64::Decode(encoded).GetLength();
+	});
+
+	bench.Measure("sha1_hex", rounds, [rounds, &data]() {
+		for (size_t i = 0; i < rounds; i++)
+			l_Sink = SHA1(data).GetLength();
+	});
+}
+
+BENCHMARK(observers)
+{
+	size_t rounds = 10000000 * bench.GetScale();
+	size_t calls = 0;
+	Value cookie;
+
+	boost::signals2::signal<void (size_t, const Value&)> signal;
+	ObserverList<size_t, const Value&> observers;
+
+	bench.Measure("signals2_empty", rounds, [rounds, &signal, &cookie]() {
+		for (size_t i = 0; i < rounds; i++)
+			signal(i, cookie);
+	});
+
+	bench.Measure("observerlist_empty", rounds, [rounds, &observers, &cookie]() {
+		for (size_t i = 0; i < rounds; i++)
+			observers(i, cookie);
+	});
+
+	signal.connect([&calls](size_t, const Value&) { calls++; });
+	observers.connect([&calls](size_t, const Value&) { calls++; });
+
+	bench.Measure("signals2_one", rounds, [rounds, &signal, &cookie]() {
+		for (size_t i = 0; i < rounds; i++)
+			signal(i, cookie);
+	});
+
+	bench.Measure("observerlist_one", rounds, [rounds, &observers, &cookie]() {
+		for (size_t i = 0; i < rounds; i++)
+			observers(i, cookie);
+	});
+
+	l_Sink = calls;
+}
+
+static void MeasureTimers(Benchmark& bench, TimerBackend backend, size_t count)
+{
+	String suffix = String(backend == TimerBackendWheel ? "_wheel_" : "_ordered_") + Convert::ToString(count);
+
+	Timer::SetBackend(backend);
+
+	/* Background population which doesn't fire during the benchmark. */
+	std::vector<Timer::Ptr> timers;
+	timers.reserve(count);
+
+	for (size_t i = 0; i < count; i++) {
+		Timer::Ptr timer = new Timer();
+		timer->SetInterval(3600 + i % 3600);
+		timer->Start();
+		timers.emplace_back(std::move(timer));
+	}
+
+	double now = Utility::GetTime();
+
+	bench.Measure("reschedule" + suffix, count, [count, now, &timers]() {
+		for (size_t i = 0; i < count; i++)
+			timers[i]->Reschedule(now + 3600 + (i * 7919) % 3600);
+	});
+
+	/* A sample of one-shot timers which all expire within the next second. */
+	const size_t samples = 1000;
+	std::mutex mtx;
+	double maxJitter = 0, sumJitter = 0;
+	std::atomic<size_t> fired (0);
+	std::vector<Timer::Ptr> sampleTimers;
+
+	now = Utility::GetTime();
+
+	for (size_t i = 0; i < samples; i++) {
+		Timer::Ptr timer = new Timer();
+		timer->OnTimerExpired.connect([&mtx, &maxJitter, &sumJitter, &fired](const Timer * const& timer) {
+			double jitter = std::fabs(Utility::GetTime() - timer->GetNext());
+
+			std::unique_lock<std::mutex> lock(mtx);
+			maxJitter = std::max(maxJitter, jitter);
+			sumJitter += jitter;
+			fired++;
+		});
+		timer->Start();
+		timer->Reschedule(now + 0.5 + 0.5 * i / samples);
+		sampleTimers.emplace_back(std::move(timer));
+	}
+
+	Utility::Sleep(1.5);
+
+	for (auto& timer : sampleTimers)
+		timer->Stop(true);
+
+	for (auto& timer : timers)
+		timer->Stop();
+
+	Timer::SetBackend(TimerBackendOrdered);
+
+	if (fired != samples)
+		throw std::runtime_error("Only " + std::to_string(fired) + " of " + std::to_string(samples) + " timers fired.");
+
+	bench.Report("expiry_jitter" + suffix, "avg_seconds", sumJitter / samples);
+	bench.Report("expiry_jitter" + suffix, "max_seconds", maxJitter);
+}
+
+BENCHMARK(timers)
+{
+	for (size_t count : { 10000, 100000, 1000000 }) {
+		MeasureTimers(bench, TimerBackendOrdered, count * bench.GetScale());
+		MeasureTimers(bench, TimerBackendWheel, count * bench.GetScale());
+	}
+}
+
+BENCHMARK(perfdata)
+{
+	size_t values = 100000 * bench.GetScale();
+
+	bench.Measure("parse", values, [values]() {
+		for (size_t i = 0; i < values; i++) {
+			PerfdataValue::Ptr pv = PerfdataValue::Parse("'rta'=0.123456ms;100.000000;500.000000;0.000000");
+			l_Sink = pv->GetLabel().GetLength();
+		}
+	});
+}
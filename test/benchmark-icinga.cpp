@@ -0,0 +1,311 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "benchmark.hpp"
+#include "config/configcompiler.hpp"
+#include "config/configitem.hpp"
+#include "icinga/host.hpp"
+#include "icinga/icingaapplication.hpp"
+#include "icinga/macroprocessor.hpp"
+#include "icinga/service.hpp"
+#include "base/configtype.hpp"
+#include "base/convert.hpp"
+#include "base/function.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/scriptframe.hpp"
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace icinga;
+
+static volatile size_t l_Sink;
+
+/**
+ * Generates a config similar to a real-world one, but with checks which don't spawn processes.
+ *
+ * Every host depends on the first one, every service notifies one user.
+ * Half of the services return random states, so they change state and
+ * run through the soft/hard state and notification logic.
+ *
+ * @param hosts The number of hosts
+ * @param servicesPerHost The number of services on each host
+ * @return The config
+ */
+String icinga::GenerateBenchmarkConfig(size_t hosts, size_t servicesPerHost)
+{
+	std::ostringstream config;
+
+	config << R"CONFIG(
+object CheckCommand "bench-null" {
+  execute = Internal.NullCheck
+}
+
+object CheckCommand "bench-random" {
+  execute = Internal.RandomCheck
+}
+
+object NotificationCommand "bench-notification" {
+  command = [ "/bin/true" ]
+}
+
+object User "bench-user" {
+  email = "bench@example.com"
+}
+
+apply Dependency "bench-parent" to Host {
+  parent_host_name = "bench-host-0"
+  assign where host.vars.bench && host.name != "bench-host-0"
+}
+
+apply Notification "bench-notification" to Service {
+  command = "bench-notification"
+  users = [ "bench-user" ]
+  assign where host.vars.bench
+}
+)CONFIG";
+
+	for (size_t i = 0; i < hosts; i++) {
+		config << "\nobject Host \"bench-host-" << i << "\" {\n"
+			<< "  address = \"192.0.2." << i % 256 << "\"\n"
+			<< "  check_command = \"bench-null\"\n"
+			<< "  vars.bench = true\n"
+			<< "}\n";
+
+		for (size_t j = 0; j < servicesPerHost; j++) {
+			config << "\nobject Service \"bench-service-" << j << "\" {\n"
+				<< "  host_name = \"bench-host-" << i << "\"\n"
+				<< "  check_command = \"" << (j % 2 ? "bench-random" : "bench-null") << "\"\n"
+				<< "  max_check_attempts = 3\n"
+				<< "}\n";
+		}
+	}
+
+	return config.str();
+}
+
+static String l_BenchmarkConfig;
+
+static void CompileBenchmarkConfig()
+{
+	std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("<benchmark>", l_BenchmarkConfig);
+	expr->Evaluate(*ScriptFrame::GetCurrentFrame());
+}
+
+/**
+ * Loads the generated config, once per process.
+ *
+ * @return All hosts and services
+ */
+std::vector<Checkable::Ptr> icinga::LoadBenchmarkConfig(Benchmark& bench)
+{
+	static bool loaded = false;
+
+	if (!loaded) {
+		size_t hosts = 100 * bench.GetScale();
+
+		l_BenchmarkConfig = GenerateBenchmarkConfig(hosts, 10);
+
+		bench.Measure("load_config", hosts * 11, []() {
+			ConfigItem::RunWithActivationContext(new Function("CompileBenchmarkConfig", CompileBenchmarkConfig));
+		});
+
+		l_BenchmarkConfig = String();
+		loaded = true;
+	}
+
+	std::vector<Checkable::Ptr> checkables;
+
+	for (const Host::Ptr& host : ConfigType::GetObjectsByType<Host>())
+		checkables.emplace_back(host);
+
+	for (const Service::Ptr& service : ConfigType::GetObjectsByType<Service>())
+		checkables.emplace_back(service);
+
+	return checkables;
+}
+
+BENCHMARK(checks)
+{
+	std::vector<Checkable::Ptr> checkables = LoadBenchmarkConfig(bench);
+	size_t rounds = 10;
+
+	/* Like the checker's shards, each thread runs the checks of its share of the checkables. */
+	size_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+	bench.Measure("execute_check", checkables.size() * rounds, [&checkables, rounds, threads]() {
+		std::vector<std::thread> workers;
+
+		for (size_t i = 0; i < threads; i++) {
+			workers.emplace_back([&checkables, rounds, threads, i]() {
+				for (size_t round = 0; round < rounds; round++) {
+					for (size_t j = i; j < checkables.size(); j += threads)
+						checkables[j]->ExecuteCheck();
+				}
+			});
+		}
+
+		for (auto& worker : workers)
+			worker.join();
+	});
+
+	bench.Measure("process_check_result", checkables.size() * rounds, [&checkables, rounds]() {
+		for (size_t round = 0; round < rounds; round++) {
+			for (auto& checkable : checkables) {
+				CheckResult::Ptr cr = new CheckResult();
+
+				cr->SetState(round % 2 ? ServiceCritical : ServiceOK);
+				cr->SetOutput("Benchmark");
+				cr->SetPerformanceData(new Array({ new PerfdataValue("time", round) }));
+
+				checkable->ProcessCheckResult(cr);
+			}
+		}
+	});
+}
+
+BENCHMARK(macros)
+{
+	Host::Ptr host = new Host();
+	host->SetName("bench-macro-host", true);
+	host->SetAddress("192.0.2.1", true);
+	host->SetVars(new Dictionary({ { "port", 443 }, { "community", "public" } }), true);
+
+	MacroProcessor::ResolverList resolvers;
+	resolvers.emplace_back("host", host);
+	resolvers.emplace_back("icinga", IcingaApplication::GetInstance());
+
+	size_t strings = 100000 * bench.GetScale();
+
+	bench.Measure("resolve", strings, [&resolvers, strings]() {
+		for (size_t i = 0; i < strings; i++) {
+			String result = MacroProcessor::ResolveMacros("-H $host.address$ -p $host.vars.port$ -C $community$ -n $host.name$", resolvers);
+			l_Sink = result.GetLength();
+		}
+	});
+}
+
+/**
+ * Compares the sweeps over all services which copy the object list (one
+ * reference count increment and decrement per object and copy) with the
+ * ones which iterate a shared snapshot.
+ */
+BENCHMARK(sweep)
+{
+	std::vector<Checkable::Ptr> checkables = LoadBenchmarkConfig(bench);
+	size_t services = ConfigType::Get<Service>()->GetObjectCount();
+	size_t rounds = 100;
+
+	bench.Measure("copy", services * rounds, [rounds]() {
+		size_t active = 0;
+
+		for (size_t round = 0; round < rounds; round++) {
+			for (const Service::Ptr& service : ConfigType::GetObjectsByType<Service>()) {
+				if (service->IsActive())
+					active++;
+			}
+		}
+
+		l_Sink = active;
+	});
+
+	bench.Measure("view", services * rounds, [rounds]() {
+		size_t active = 0;
+
+		for (size_t round = 0; round < rounds; round++) {
+			for (Service *service : ConfigType::GetObjectsViewByType<Service>()) {
+				if (service->IsActive())
+					active++;
+			}
+		}
+
+		l_Sink = active;
+	});
+}
+
+/**
+ * Resolves the names of all fields of the Service type, most of which are
+ * inherited, and some unknown names, like the DSL, API attrs and filters do.
+ */
+BENCHMARK(field_ids)
+{
+	Type::Ptr type = Service::TypeInstance;
+	std::vector<String> names;
+
+	for (int i = 0; i < type->GetFieldCount(); i++)
+		names.emplace_back(type->GetFieldInfo(i).Name);
+
+	names.emplace_back("no_such_field");
+	names.emplace_back("vars.no_such_var");
+
+	size_t rounds = 100000 * bench.GetScale();
+
+	bench.Measure("get_field_id", names.size() * rounds, [&type, &names, rounds]() {
+		size_t found = 0;
+
+		for (size_t round = 0; round < rounds; round++) {
+			for (const String& name : names) {
+				if (type->GetFieldId(name) >= 0)
+					found++;
+			}
+		}
+
+		l_Sink = found;
+	});
+}
+
+/**
+ * Looks up all hosts and services by name from 32 threads at once, like
+ * concurrent API requests and cluster messages do.
+ */
+BENCHMARK(lookup)
+{
+	std::vector<Checkable::Ptr> checkables = LoadBenchmarkConfig(bench);
+	std::vector<std::pair<Type::Ptr, String> > names;
+
+	for (auto& checkable : checkables)
+		names.emplace_back(checkable->GetReflectionType(), checkable->GetName());
+
+	size_t threads = 32;
+	size_t rounds = 10;
+
+	auto run ([&names, threads, rounds](const std::function<bool (const Type::Ptr&, const String&)>& lookup) {
+		std::vector<std::thread> workers;
+		std::atomic<size_t> found (0);
+
+		for (size_t i = 0; i < threads; i++) {
+			workers.emplace_back([&names, &lookup, &found, rounds, i]() {
+				size_t count = 0;
+
+				for (size_t round = 0; round < rounds; round++) {
+					for (size_t j = 0; j < names.size(); j++) {
+						auto& name (names[(i * 7919u + j) % names.size()]);
+
+						if (lookup(name.first, name.second))
+							count++;
+					}
+				}
+
+				found += count;
+			});
+		}
+
+		for (auto& worker : workers)
+			worker.join();
+
+		l_Sink = found;
+	});
+
+	bench.Measure("get_object", names.size() * rounds * threads, [&run]() {
+		run([](const Type::Ptr& type, const String& name) {
+			return static_cast<bool>(dynamic_cast<ConfigType *>(type.get())->GetObject(name));
+		});
+	});
+
+	bench.Measure("get_item", names.size() * rounds * threads, [&run]() {
+		run([](const Type::Ptr& type, const String& name) {
+			return static_cast<bool>(ConfigItem::GetByTypeAndName(type, name));
+		});
+	});
+}
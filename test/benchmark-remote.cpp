@@ -0,0 +1,101 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "benchmark.hpp"
+#include "icinga/clusterevents.hpp"
+#include "icinga/host.hpp"
+#include "icinga/service.hpp"
+#include "base/fifo.hpp"
+#include "base/json.hpp"
+#include "base/netstring.hpp"
+#include "base/objectlock.hpp"
+#include "base/perfdatavalue.hpp"
+#include "base/serializer.hpp"
+#include <vector>
+
+using namespace icinga;
+
+/**
+ * Turns a relayed event::CheckResult message back into a check result, like ClusterEvents::CheckResultAPIHandler().
+ */
+static void ReceiveCheckResult(const Dictionary::Ptr& message)
+{
+	Dictionary::Ptr params = message->Get("params");
+	Dictionary::Ptr vcr = params->Get("cr");
+	Array::Ptr vperf = vcr->Get("performance_data");
+
+	vcr->Remove("performance_data");
+
+	CheckResult::Ptr cr = new CheckResult();
+	Deserialize(cr, vcr, true);
+
+	ArrayData rperf;
+
+	if (vperf) {
+		ObjectLock olock(vperf);
+
+		for (const Value& vp : vperf) {
+			if (vp.IsObjectType<Dictionary>()) {
+				PerfdataValue::Ptr val = new PerfdataValue();
+				Deserialize(val, vp, true);
+				rperf.push_back(val);
+			} else
+				rperf.push_back(vp);
+		}
+	}
+
+	cr->SetPerformanceData(new Array(std::move(rperf)));
+
+	Host::Ptr host = Host::GetByName(params->Get("host"));
+	Checkable::Ptr checkable;
+
+	if (params->Contains("service"))
+		checkable = host->GetServiceByShortName(params->Get("service"));
+	else
+		checkable = host;
+
+	checkable->ProcessCheckResult(cr);
+}
+
+BENCHMARK(relay)
+{
+	std::vector<Checkable::Ptr> checkables = LoadBenchmarkConfig(bench);
+	std::vector<Dictionary::Ptr> messages;
+
+	messages.reserve(checkables.size());
+
+	for (auto& checkable : checkables) {
+		CheckResult::Ptr cr = new CheckResult();
+
+		cr->SetState(ServiceWarning);
+		cr->SetOutput("Relayed");
+		cr->SetPerformanceData(new Array({ new PerfdataValue("time", 0.1), "size=42B" }));
+
+		messages.emplace_back(ClusterEvents::MakeCheckResultMessage(checkable, cr));
+	}
+
+	FIFO::Ptr fifo = new FIFO();
+
+	bench.Measure("encode", messages.size(), [&messages, &fifo]() {
+		for (auto& message : messages)
+			NetString::WriteStringToStream(fifo, JsonEncode(message));
+	});
+
+	std::vector<Dictionary::Ptr> received;
+
+	received.reserve(messages.size());
+
+	bench.Measure("decode", messages.size(), [&fifo, &received]() {
+		String json;
+		StreamReadContext src;
+
+		while (NetString::ReadStringFromStream(fifo, &json, src) == StatusNewItem)
+			received.emplace_back(JsonDecode(json));
+	});
+
+	bench.Measure("process", received.size(), [&received]() {
+		for (auto& message : received)
+			ReceiveCheckResult(message);
+	});
+
+	fifo->Close();
+}
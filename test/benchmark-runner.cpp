@@ -0,0 +1,150 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "benchmark.hpp"
+#include "icinga/icingaapplication.hpp"
+#include "base/application.hpp"
+#include "base/convert.hpp"
+#include "base/dictionary.hpp"
+#include "base/exception.hpp"
+#include "base/json.hpp"
+#include "base/logger.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+using namespace icinga;
+
+static std::map<String, Benchmark::Callback>& GetBenchmarks()
+{
+	static std::map<String, Benchmark::Callback> benchmarks;
+	return benchmarks;
+}
+
+Benchmark::Benchmark(String name, size_t scale, std::ostream& output)
+	: m_Name(std::move(name)), m_Scale(scale), m_Output(output)
+{ }
+
+/**
+ * Multiplies the number of objects and iterations each benchmark uses.
+ */
+size_t Benchmark::GetScale() const
+{
+	return m_Scale;
+}
+
+/**
+ * Runs func once and prints how long it took.
+ *
+ * @param step The step's name, appended to the benchmark's name
+ * @param ops How many operations func performs
+ * @param func The operations
+ */
+void Benchmark::Measure(const String& step, size_t ops, const std::function<void ()>& func)
+{
+	auto start (std::chrono::steady_clock::now());
+
+	func();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	Dictionary::Ptr result = new Dictionary({
+		{ "benchmark", m_Name + "/" + step },
+		{ "ops", ops },
+		{ "seconds", seconds },
+		{ "ns_per_op", ops ? seconds * 1e9 / ops : 0 },
+		{ "ops_per_second", seconds > 0 ? ops / seconds : 0 }
+	});
+
+	m_Output << JsonEncode(result) << std::endl;
+}
+
+/**
+ * Prints a metric which isn't a duration, e.g. a latency observed by the benchmark itself.
+ *
+ * @param step The step's name, appended to the benchmark's name
+ * @param metric The metric's name
+ * @param value The metric's value
+ */
+void Benchmark::Report(const String& step, const String& metric, double value)
+{
+	Dictionary::Ptr result = new Dictionary({
+		{ "benchmark", m_Name + "/" + step },
+		{ metric, value }
+	});
+
+	m_Output << JsonEncode(result) << std::endl;
+}
+
+void Benchmark::Register(const char *name, Callback callback)
+{
+	GetBenchmarks()[name] = std::move(callback);
+}
+
+/**
+ * Runs all benchmarks whose name contains filter.
+ *
+ * @return The number of failed benchmarks
+ */
+int Benchmark::RunAll(const String& filter, size_t scale, std::ostream& output)
+{
+	int failed = 0;
+
+	for (auto& kv : GetBenchmarks()) {
+		if (!filter.IsEmpty() && kv.first.Find(filter) == String::NPos)
+			continue;
+
+		Benchmark bench (kv.first, scale, output);
+
+		try {
+			kv.second(bench);
+		} catch (const std::exception& ex) {
+			std::cerr << "Benchmark '" << kv.first << "' failed: " << DiagnosticInformation(ex, false) << "\n";
+			failed++;
+		}
+	}
+
+	return failed;
+}
+
+static void PrintUsage(const char *argv0)
+{
+	std::cerr << "Usage: " << argv0 << " [--filter <name>] [--scale <n>] [--generate-config <hosts>]\n"
+		<< "\n"
+		<< "Prints one JSON object per measured step to stdout.\n"
+		<< "--generate-config prints the config the benchmarks load instead.\n";
+}
+
+int main(int argc, char **argv)
+{
+	String filter;
+	size_t scale = 1;
+
+	for (int i = 1; i < argc; i++) {
+		if (i + 1 < argc && !strcmp(argv[i], "--filter")) {
+			filter = argv[++i];
+		} else if (i + 1 < argc && !strcmp(argv[i], "--scale")) {
+			scale = Convert::ToLong(argv[++i]);
+		} else if (i + 1 < argc && !strcmp(argv[i], "--generate-config")) {
+			std::cout << GenerateBenchmarkConfig(Convert::ToLong(argv[++i]), 10);
+			return EXIT_SUCCESS;
+		} else {
+			PrintUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (scale < 1)
+		scale = 1;
+
+	Application::InitializeBase();
+	Logger::SetConsoleLogSeverity(LogCritical);
+
+	IcingaApplication::Ptr appInst = new IcingaApplication();
+	static_pointer_cast<ConfigObject>(appInst)->OnConfigLoaded();
+
+	int failed = Benchmark::RunAll(filter, scale, std::cout);
+
+	std::_Exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,61 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "icinga/checkable.hpp"
+#include "base/string.hpp"
+#include <functional>
+#include <ostream>
+#include <vector>
+
+namespace icinga
+{
+
+/**
+ * A tiny harness for the benchmarks in benchmark-*.cpp.
+ *
+ * Each benchmark measures one or more named steps. Every step is printed
+ * as one JSON object per line, so the results can be collected and
+ * compared across builds.
+ */
+class Benchmark final
+{
+public:
+	typedef std::function<void (Benchmark&)> Callback;
+
+	Benchmark(String name, size_t scale, std::ostream& output);
+
+	size_t GetScale() const;
+
+	void Measure(const String& step, size_t ops, const std::function<void ()>& func);
+	void Report(const String& step, const String& metric, double value);
+
+	static void Register(const char *name, Callback callback);
+	static int RunAll(const String& filter, size_t scale, std::ostream& output);
+
+private:
+	String m_Name;
+	size_t m_Scale;
+	std::ostream& m_Output;
+};
+
+struct BenchmarkRegistrar
+{
+	BenchmarkRegistrar(const char *name, Benchmark::Callback callback)
+	{
+		Benchmark::Register(name, std::move(callback));
+	}
+};
+
+String GenerateBenchmarkConfig(size_t hosts, size_t servicesPerHost);
+std::vector<Checkable::Ptr> LoadBenchmarkConfig(Benchmark& bench);
+
+}
+
+#define BENCHMARK(name)									\
+	static void Benchmark_ ## name(icinga::Benchmark& bench);			\
+	static icinga::BenchmarkRegistrar l_BenchmarkRegistrar_ ## name (#name, &Benchmark_ ## name); \
+	static void Benchmark_ ## name(icinga::Benchmark& bench)
+
+#endif /* BENCHMARK_H */
@@ -0,0 +1,119 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "config/applyrule.hpp"
+#include "config/configcompiler.hpp"
+#include <BoostTestTargetConfig.h>
+#include <algorithm>
+
+using namespace icinga;
+
+static std::vector<String> GetCandidateNames(const Dictionary::Ptr& host)
+{
+	std::vector<String> names;
+
+	for (ApplyRule *rule : ApplyRule::GetCandidateRules("ApplyIndexTest", "Host", new Dictionary({ { "host", host } })))
+		names.push_back(rule->GetName());
+
+	return names;
+}
+
+static std::vector<String> GetMatchingNames(const Dictionary::Ptr& host)
+{
+	std::vector<String> names;
+
+	for (const ApplyRule& rule : ApplyRule::GetRules("ApplyIndexTest")) {
+		ScriptFrame frame(true);
+		frame.Locals->Set("host", host);
+
+		try {
+			if (rule.EvaluateFilter(frame))
+				names.push_back(rule.GetName());
+		} catch (const std::exception&) {
+			names.push_back(rule.GetName());
+		}
+	}
+
+	return names;
+}
+
+BOOST_AUTO_TEST_SUITE(config_apply)
+
+BOOST_AUTO_TEST_CASE(candidates)
+{
+	ApplyRule::RegisterType("ApplyIndexTest", { "Host" });
+
+	ScriptFrame frame(true);
+	std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("<test>",
+		"apply ApplyIndexTest \"linux\" { vars.x = 1; assign where host.vars.os == \"Linux\" }\n"
+		"apply ApplyIndexTest \"web\" { vars.x = 1; assign where \"web\" in host.groups || match(\"WEB*\", host.name) }\n"
+		"apply ApplyIndexTest \"east\" { vars.x = 1; assign where host.address && host.vars.region == \"east\"; ignore where host.vars.test }\n"
+		"apply ApplyIndexTest \"any\" { vars.x = 1; assign where host.vars.os != \"Windows\" }\n");
+	expr->Evaluate(frame);
+
+	std::vector<Dictionary::Ptr> hosts {
+		new Dictionary({
+			{ "name", "web1" },
+			{ "vars", new Dictionary({ { "os", "Linux" }, { "region", "east" } }) },
+			{ "groups", new Array() }
+		}),
+		new Dictionary({
+			{ "name", "db1" },
+			{ "vars", new Dictionary({ { "os", "Windows" } }) },
+			{ "groups", new Array({ "db" }) }
+		}),
+		new Dictionary({
+			{ "name", "db2" },
+			{ "vars", new Dictionary({ { "os", "Linux" } }) },
+			{ "groups", new Array({ "web" }) }
+		}),
+		new Dictionary({
+			{ "name", "broken" },
+			{ "vars", "invalid" }
+		})
+	};
+
+	BOOST_CHECK(GetCandidateNames(hosts[0]) == std::vector<String>({ "linux", "web", "east", "any" }));
+	BOOST_CHECK(GetCandidateNames(hosts[1]) == std::vector<String>({ "any" }));
+	BOOST_CHECK(GetCandidateNames(hosts[2]) == std::vector<String>({ "linux", "web", "any" }));
+
+	/* The filters of the rules which read the invalid vars fail and have to be evaluated. */
+	BOOST_CHECK(GetCandidateNames(hosts[3]) == std::vector<String>({ "linux", "east", "any" }));
+
+	for (const Dictionary::Ptr& host : hosts) {
+		std::vector<String> candidates = GetCandidateNames(host);
+
+		for (const String& name : GetMatchingNames(host))
+			BOOST_CHECK(std::find(candidates.begin(), candidates.end(), name) != candidates.end());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(target_type)
+{
+	ApplyRule::RegisterType("ApplyTargetTest", { "Host" });
+	ApplyRule::RegisterType("ApplyTargetsTest", { "Host", "Service" });
+
+	ScriptFrame frame(true);
+	std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("<test>",
+		"apply ApplyTargetTest \"implicit\" { vars.x = 1; assign where true }\n"
+		"apply ApplyTargetTest \"explicit\" to Host { vars.x = 1; assign where true }\n"
+		"apply ApplyTargetsTest \"host\" to Host { vars.x = 1; assign where true }\n"
+		"apply ApplyTargetsTest \"service\" to Service { vars.x = 1; assign where true }\n");
+	expr->Evaluate(frame);
+
+	auto names ([](const String& type, const String& targetType) {
+		std::vector<String> result;
+
+		for (ApplyRule *rule : ApplyRule::GetCandidateRules(type, targetType, new Dictionary({ { "host", new Dictionary() } })))
+			result.push_back(rule->GetName());
+
+		return result;
+	});
+
+	/* Rules without a target type apply to the only one of their type. */
+	BOOST_CHECK(names("ApplyTargetTest", "Host") == std::vector<String>({ "implicit", "explicit" }));
+
+	BOOST_CHECK(names("ApplyTargetsTest", "Host") == std::vector<String>({ "host" }));
+	BOOST_CHECK(names("ApplyTargetsTest", "Service") == std::vector<String>({ "service" }));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,13 +1,28 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "config/configcompiler.hpp"
+#include "config/bytecode.hpp"
+#include "config/templateprogram.hpp"
+#include "icinga/host.hpp"
+#include "base/configuration.hpp"
 #include "base/exception.hpp"
+#include "base/scriptglobal.hpp"
 #include <BoostTestTargetConfig.h>
 
 using namespace icinga;
 
 BOOST_AUTO_TEST_SUITE(config_ops)
 
+static Value EvaluateCompiled(ScriptFrame& frame, const String& text, size_t *instructions = nullptr)
+{
+	CompiledExpression::Ptr expr = new CompiledExpression(ConfigCompiler::CompileText("<test>", text).release());
+
+	if (instructions)
+		*instructions = expr->GetProgram()->GetInstructionCount();
+
+	return expr->Evaluate(frame).GetValue();
+}
+
 BOOST_AUTO_TEST_CASE(simple)
 {
 	ScriptFrame frame(true);
@@ -243,4 +258,178 @@ BOOST_AUTO_TEST_CASE(advanced)
 	BOOST_CHECK(func->Invoke() == 3);
 }
 
+BOOST_AUTO_TEST_CASE(bytecode)
+{
+	ScriptFrame frame(true);
+	size_t instructions;
+
+	frame.Locals->Set("x", 5);
+
+	BOOST_CHECK(EvaluateCompiled(frame, "1 + 2 * 3", &instructions) == 7);
+	BOOST_CHECK(instructions == 0);
+
+	BOOST_CHECK(EvaluateCompiled(frame, "!(1 > 2) && \"a\"", &instructions) == "a");
+	BOOST_CHECK(instructions == 0);
+
+	BOOST_CHECK(EvaluateCompiled(frame, "x * 2 + x") == 15);
+	BOOST_CHECK(EvaluateCompiled(frame, "x > 3 && x < 10") == true);
+	BOOST_CHECK(EvaluateCompiled(frame, "x > 7 || \"b\"") == "b");
+	BOOST_CHECK(EvaluateCompiled(frame, "x in [ 1, 5 ]") == true);
+	BOOST_CHECK(EvaluateCompiled(frame, "x !in [ 1, 5 ]") == false);
+	BOOST_CHECK(EvaluateCompiled(frame, "x in null") == false);
+	BOOST_CHECK(EvaluateCompiled(frame, "x !in null") == true);
+	BOOST_CHECK_THROW(EvaluateCompiled(frame, "x in 7"), ScriptError);
+	BOOST_CHECK(EvaluateCompiled(frame, "if (x > 3) { \"big\" } else { \"small\" }") == "big");
+	BOOST_CHECK(EvaluateCompiled(frame, "\"abc\".len() + x") == 8);
+	BOOST_CHECK(EvaluateCompiled(frame, "Math.max(x, 7)") == 7);
+	BOOST_CHECK(EvaluateCompiled(frame, "match(\"a*\", \"abc\")") == true);
+	BOOST_CHECK(EvaluateCompiled(frame, "var a = 1; a += x; a") == 6);
+	BOOST_CHECK(EvaluateCompiled(frame, "function f(v) { return v * 2 }; f(x)") == 10);
+	BOOST_CHECK(EvaluateCompiled(frame, "globals.bytecode_y = 3; function g() { globals.bytecode_y = 1; return 2 }; bytecode_y + g() + bytecode_y") == 6);
+	BOOST_CHECK_THROW(EvaluateCompiled(frame, "x.y"), ScriptError);
+	BOOST_CHECK_THROW(EvaluateCompiled(frame, "undefined_variable"), ScriptError);
+
+	Host::Ptr host = new Host();
+	host->SetMaxCheckAttempts(3);
+	host->SetVars(new Dictionary({ { "os", "Linux" } }));
+	frame.Locals->Set("host", host);
+
+	BOOST_CHECK(EvaluateCompiled(frame, "host.max_check_attempts * x") == 15);
+	BOOST_CHECK(EvaluateCompiled(frame, "host.vars.os == \"Linux\" && host.vars.role == null") == true);
+}
+
+BOOST_AUTO_TEST_CASE(optimizer)
+{
+	ScriptFrame frame(true);
+
+	/* Folded while compiling, the results must be the same as without. */
+	BOOST_CHECK(ConfigCompiler::CompileText("<test>", "\"check_\" + \"load\"")->Evaluate(frame).GetValue() == "check_load");
+	BOOST_CHECK(ConfigCompiler::CompileText("<test>", "5 * 60 + -1")->Evaluate(frame).GetValue() == 299);
+	BOOST_CHECK(ConfigCompiler::CompileText("<test>", "if (\"a\" == \"a\") { 1 } else { 2 }")->Evaluate(frame).GetValue() == 1);
+	BOOST_CHECK(ConfigCompiler::CompileText("<test>", "if (1 > 2) { 1 } else if (!false) { 2 }")->Evaluate(frame).GetValue() == 2);
+	BOOST_CHECK(ConfigCompiler::CompileText("<test>", "if (0) { 1 }")->Evaluate(frame).GetValue().IsEmpty());
+	BOOST_CHECK(ConfigCompiler::CompileText("<test>", "false && undefined_variable")->Evaluate(frame).GetValue() == false);
+	BOOST_CHECK(ConfigCompiler::CompileText("<test>", "\"a\" || undefined_variable")->Evaluate(frame).GetValue() == "a");
+
+	/* Errors still happen when evaluating. */
+	std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("<test>", "1 / 0");
+	BOOST_CHECK_THROW(expr->Evaluate(frame), ScriptError);
+
+	/* Arrays are mutable and mustn't be shared. */
+	expr = ConfigCompiler::CompileText("<test>", "[ 1 + 1 ]");
+	Array::Ptr array1 = expr->Evaluate(frame).GetValue();
+	Array::Ptr array2 = expr->Evaluate(frame).GetValue();
+	BOOST_CHECK(array1 != array2 && array1->Get(0) == 2);
+}
+
+BOOST_AUTO_TEST_CASE(template_program)
+{
+	auto program (TemplateProgram::Compile(ConfigCompiler::CompileText("<test>",
+		"check_command = \"hostalive\"; vars.os = \"Linux\"; this.notes = \"a\"; max_check_attempts = 1 + 2; notes_url = notes + \"b\"").release()));
+
+	/* 1 + 2 is folded into a constant while compiling, only notes_url needs the tree walker. */
+	BOOST_CHECK(program->GetStatementCount() == 5);
+	BOOST_CHECK(program->GetAssignmentCount() == 4);
+
+	Host::Ptr host = new Host();
+	host->SetVars(new Dictionary({ { "role", "db" } }));
+
+	ScriptFrame frame(true, host);
+	DebugHint dhint;
+	program->Run(frame, &dhint);
+
+	BOOST_CHECK(host->GetCheckCommandRaw() == "hostalive");
+	BOOST_CHECK(host->GetVars()->Get("os") == "Linux");
+	BOOST_CHECK(host->GetVars()->Get("role") == "db");
+	BOOST_CHECK(host->GetNotes() == "a");
+	BOOST_CHECK(host->GetMaxCheckAttempts() == 3);
+	BOOST_CHECK(host->GetNotesUrl() == "ab");
+
+	Dictionary::Ptr properties = dhint.ToDictionary()->Get("properties");
+	BOOST_CHECK(properties->Contains("check_command"));
+	BOOST_CHECK(Dictionary::Ptr(Dictionary::Ptr(properties->Get("vars"))->Get("properties"))->Contains("os"));
+
+	/* Locals take precedence over the attributes, just like without the program. */
+	host = new Host();
+	ScriptFrame localFrame(true, host);
+	localFrame.Locals->Set("check_command", "local");
+	program->Run(localFrame, nullptr);
+
+	BOOST_CHECK(host->GetCheckCommandRaw().IsEmpty());
+	BOOST_CHECK(localFrame.Locals->Get("check_command") == "hostalive");
+}
+
+BOOST_AUTO_TEST_CASE(globals)
+{
+	ScriptFrame frame(true);
+	frame.Self = Empty;
+
+	std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("<test>", "globals_test_var");
+
+	ScriptGlobal::Set("globals_test_var", 1);
+	BOOST_CHECK(expr->Evaluate(frame).GetValue() == 1);
+
+	/* Changed values must not be served from the cached binding. */
+	ScriptGlobal::Set("globals_test_var", 2);
+	BOOST_CHECK(expr->Evaluate(frame).GetValue() == 2);
+
+	ScriptGlobal::SetConst("globals_test_var", 3);
+	BOOST_CHECK(expr->Evaluate(frame).GetValue() == 3);
+
+	ScriptGlobal::Set("globals_test_var", 4, true);
+	BOOST_CHECK(expr->Evaluate(frame).GetValue() == 4);
+
+	ScriptGlobal::GetGlobals()->Remove("globals_test_var", true);
+	BOOST_CHECK_THROW(expr->Evaluate(frame).GetValue(), std::exception);
+
+	/* Imports take precedence over the globals. */
+	expr = ConfigCompiler::CompileText("<test>", "Configuration");
+	BOOST_CHECK(expr->Evaluate(frame).GetValue().IsObjectType<Configuration>());
+
+	ScriptGlobal::Set("Configuration", 1);
+	BOOST_CHECK(expr->Evaluate(frame).GetValue().IsObjectType<Configuration>());
+	ScriptGlobal::GetGlobals()->Remove("Configuration", true);
+
+	expr = ConfigCompiler::CompileText("<test>", "Dictionary");
+	BOOST_CHECK(expr->Evaluate(frame).GetValue().IsObjectType<Type>());
+	BOOST_CHECK(expr->Evaluate(frame).GetValue().IsObjectType<Type>());
+}
+
+BOOST_AUTO_TEST_CASE(parallel)
+{
+	ScriptFrame frame(true);
+	std::unique_ptr<Expression> expr;
+	Array::Ptr result;
+
+	expr = ConfigCompiler::CompileText("<test>", "range(10000).parallel_map(x => x * 2)");
+	result = expr->Evaluate(frame).GetValue();
+	BOOST_CHECK(result->GetLength() == 10000);
+	BOOST_CHECK(result->Get(0) == 0);
+	BOOST_CHECK(result->Get(9999) == 19998);
+
+	expr = ConfigCompiler::CompileText("<test>", "range(10000).parallel_filter(x => x % 3 == 0)");
+	result = expr->Evaluate(frame).GetValue();
+	BOOST_CHECK(result->GetLength() == 3334);
+	BOOST_CHECK(result->Get(1) == 3);
+
+	expr = ConfigCompiler::CompileText("<test>", "range(10000).parallel_reduce((a, b) => a + b)");
+	BOOST_CHECK(expr->Evaluate(frame).GetValue() == 49995000);
+
+	expr = ConfigCompiler::CompileText("<test>", "[].parallel_reduce((a, b) => a + b)");
+	BOOST_CHECK(expr->Evaluate(frame).GetValue() == Empty);
+
+	expr = ConfigCompiler::CompileText("<test>", "range(10000).parallel_any(x => x == 9999)");
+	BOOST_CHECK(expr->Evaluate(frame).GetValue() == true);
+
+	expr = ConfigCompiler::CompileText("<test>", "range(10000).parallel_all(x => x < 9999)");
+	BOOST_CHECK(expr->Evaluate(frame).GetValue() == false);
+
+	expr = ConfigCompiler::CompileText("<test>", "range(10000).parallel_map(x => x.y)");
+	BOOST_CHECK_THROW(expr->Evaluate(frame).GetValue(), ScriptError);
+
+	frame.Sandboxed = true;
+	expr = ConfigCompiler::CompileText("<test>", "range(10000).parallel_map(x => x)");
+	BOOST_CHECK_THROW(expr->Evaluate(frame).GetValue(), ScriptError);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
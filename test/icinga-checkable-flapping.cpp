@@ -124,6 +124,37 @@ BOOST_AUTO_TEST_CASE(host_flapping)
 #endif /* I2_DEBUG */
 }
 
+BOOST_AUTO_TEST_CASE(host_flapping_disabled)
+{
+#ifndef I2_DEBUG
+	BOOST_WARN_MESSAGE(false, "This test can only be run in a debug build!");
+#else /* I2_DEBUG */
+	std::cout << "Running test with flapping detection disabled...\n";
+
+	Host::Ptr host = new Host();
+	host->SetName("test");
+	host->SetEnableFlapping(false);
+	host->SetMaxCheckAttempts(5);
+	host->SetActive(true);
+
+	Utility::SetTime(0);
+
+	int i = 0;
+	while (i++ < 25) {
+		if (i % 2)
+			host->ProcessCheckResult(MakeCheckResult(ServiceOK));
+		else
+			host->ProcessCheckResult(MakeCheckResult(ServiceWarning));
+
+		BOOST_CHECK(!host->IsFlapping());
+	}
+
+	/* Nothing is tracked meanwhile. */
+	BOOST_CHECK(host->GetFlappingCurrent() == 0);
+	BOOST_CHECK(host->GetFlappingBuffer() == 0);
+#endif /* I2_DEBUG */
+}
+
 BOOST_AUTO_TEST_CASE(host_flapping_recover)
 {
 #ifndef I2_DEBUG
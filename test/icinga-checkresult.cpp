@@ -1,6 +1,8 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "icinga/host.hpp"
+#include "icinga/checkresulthistory.hpp"
+#include "base/convert.hpp"
 #include <BoostTestTargetConfig.h>
 #include <iostream>
 
@@ -809,4 +811,115 @@ BOOST_AUTO_TEST_CASE(service_flapping_ok_over_bad_into_ok)
 
 #endif /* I2_DEBUG */
 }
+BOOST_AUTO_TEST_CASE(state_record)
+{
+	Host::Ptr host = new Host();
+	host->SetActive(true);
+	host->SetMaxCheckAttempts(2);
+	host->Activate();
+	host->SetAuthority(true);
+	host->SetStateRaw(ServiceOK);
+	host->SetStateType(StateTypeHard);
+
+	CheckableStateRecord::ConstPtr before = host->GetStateRecord();
+	BOOST_CHECK(before->State == ServiceOK);
+	BOOST_CHECK(before->CurrentStateType == StateTypeHard);
+
+	CheckResult::Ptr cr = MakeCheckResult(ServiceCritical);
+	host->ProcessCheckResult(cr);
+
+	CheckableStateRecord::ConstPtr after = host->GetStateRecord();
+	BOOST_CHECK(after->LastCheckResult == cr);
+	BOOST_CHECK(after->State == ServiceCritical);
+	BOOST_CHECK(after->CurrentStateType == StateTypeSoft);
+	BOOST_CHECK(after->CheckAttempt == 1);
+
+	/* Published records never change. */
+	BOOST_CHECK(before->State == ServiceOK);
+
+	host->AcknowledgeProblem("icingaadmin", "", AcknowledgementNormal, false);
+	BOOST_CHECK(host->GetStateRecord()->GetAcknowledgement() == AcknowledgementNormal);
+	BOOST_CHECK(after->GetAcknowledgement() == AcknowledgementNone);
+
+	host->ClearAcknowledgement("");
+	BOOST_CHECK(host->GetStateRecord()->GetAcknowledgement() == AcknowledgementNone);
+}
+
+BOOST_AUTO_TEST_CASE(unchanged)
+{
+	Host::Ptr host = new Host();
+	host->SetActive(true);
+	host->SetMaxCheckAttempts(2);
+	host->Activate();
+	host->SetAuthority(true);
+	host->SetStateRaw(ServiceOK);
+	host->SetStateType(StateTypeHard);
+
+	CheckResult::Ptr first = MakeCheckResult(ServiceOK);
+	host->ProcessCheckResult(first);
+	BOOST_REQUIRE(first->GetVarsAfter());
+
+	/* The vars are shared as long as nothing changes. */
+	CheckResult::Ptr second = MakeCheckResult(ServiceOK);
+	host->ProcessCheckResult(second);
+	BOOST_CHECK(second->GetVarsBefore() == first->GetVarsAfter());
+	BOOST_CHECK(second->GetVarsAfter() == first->GetVarsAfter());
+	BOOST_CHECK(host->GetLastCheckResult() == second);
+
+	CheckResult::Ptr third = MakeCheckResult(ServiceCritical);
+	host->ProcessCheckResult(third);
+	BOOST_CHECK(third->GetVarsBefore() == first->GetVarsAfter());
+	BOOST_CHECK(third->GetVarsAfter() != first->GetVarsAfter());
+	BOOST_CHECK(host->GetStateType() == StateTypeSoft);
+
+	CheckResult::Ptr fourth = MakeCheckResult(ServiceOK);
+	host->ProcessCheckResult(fourth);
+	BOOST_CHECK(fourth->GetVarsAfter() != third->GetVarsAfter());
+	BOOST_CHECK(fourth->GetVarsAfter()->Get("state") == ServiceOK);
+	BOOST_CHECK(host->GetStateType() == StateTypeHard);
+}
+
+BOOST_AUTO_TEST_CASE(history)
+{
+	auto first (std::make_shared<CheckResultHistory>());
+	auto second (std::make_shared<CheckResultHistory>());
+
+	for (int i = 0; i < 5; i++) {
+		CheckResult::Ptr cr = MakeCheckResult(i % 2 ? ServiceCritical : ServiceOK);
+		cr->SetExecutionEnd(i);
+		cr->SetPerformanceData(new Array({ "time=" + Convert::ToString(i) + "s" }));
+		first->Add(cr, 3, 5);
+	}
+
+	auto entries (first->GetEntries());
+	BOOST_REQUIRE(entries.size() == 3);
+
+	for (int i = 0; i < 3; i++) {
+		BOOST_CHECK(entries[i].ExecutionEnd == i + 2);
+		BOOST_CHECK(entries[i].State == (i % 2 ? ServiceCritical : ServiceOK));
+		BOOST_CHECK(entries[i].PerfdataCount == 1);
+		BOOST_CHECK(entries[i].Perfdata[0] == i + 2);
+	}
+
+	BOOST_CHECK(CheckResultHistory::GetTotalEntries() == 3);
+
+	/* Doesn't fit next to the first one, which gets evicted. */
+	second->Add(MakeCheckResult(ServiceOK), 4, 5);
+	BOOST_CHECK(first->GetEntries().empty());
+	BOOST_CHECK(second->GetEntries().size() == 1);
+	BOOST_CHECK(CheckResultHistory::GetTotalEntries() == 4);
+
+	/* Shrinking keeps the newest ones. */
+	first->Add(MakeCheckResult(ServiceOK), 1, 5);
+	second->Add(MakeCheckResult(ServiceWarning), 2, 5);
+	second->Add(MakeCheckResult(ServiceCritical), 1, 5);
+	BOOST_REQUIRE(second->GetEntries().size() == 1);
+	BOOST_CHECK(second->GetEntries()[0].State == ServiceCritical);
+	BOOST_CHECK(first->GetEntries().size() == 1);
+	BOOST_CHECK(CheckResultHistory::GetTotalEntries() == 2);
+
+	first.reset();
+	BOOST_CHECK(CheckResultHistory::GetTotalEntries() == 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -86,4 +86,163 @@ BOOST_AUTO_TEST_CASE(multi_parent)
 	BOOST_CHECK(childHost->IsReachable() == false);
 }
 
+BOOST_AUTO_TEST_CASE(cached_reachability)
+{
+	/* Grandparent -> parent -> child, the child's cached reachability must follow the grandparent. */
+	std::vector<Host::Ptr> hosts;
+
+	for (int i = 0; i < 3; i++) {
+		Host::Ptr host = new Host();
+		host->SetActive(true);
+		host->SetMaxCheckAttempts(1);
+		host->Activate();
+		host->SetAuthority(true);
+		host->SetStateRaw(ServiceOK);
+		host->SetStateType(StateTypeHard);
+		host->SetLastCheckResult(new CheckResult());
+
+		hosts.push_back(host);
+	}
+
+	std::vector<Dependency::Ptr> deps;
+
+	for (int i = 0; i < 2; i++) {
+		Dependency::Ptr dep = new Dependency();
+		dep->SetParent(hosts[i]);
+		dep->SetChild(hosts[i + 1]);
+		dep->SetStateFilter(StateFilterUp);
+
+		hosts[i + 1]->AddDependency(dep);
+		hosts[i]->AddReverseDependency(dep);
+
+		deps.push_back(dep);
+	}
+
+	BOOST_CHECK(hosts[2]->IsReachable() == true);
+
+	hosts[0]->SetStateRaw(ServiceCritical);
+
+	Dependency::Ptr failedDependency;
+	BOOST_CHECK(hosts[2]->IsReachable(DependencyState, &failedDependency) == false);
+	BOOST_CHECK(failedDependency == deps[0]);
+
+	/* Served from the cache, including the failed dependency. */
+	failedDependency = nullptr;
+	BOOST_CHECK(hosts[2]->IsReachable(DependencyState, &failedDependency) == false);
+	BOOST_CHECK(failedDependency == deps[0]);
+
+	hosts[0]->SetStateType(StateTypeSoft);
+	BOOST_CHECK(hosts[2]->IsReachable() == true);
+
+	hosts[0]->SetStateType(StateTypeHard);
+	BOOST_CHECK(hosts[2]->IsReachable() == false);
+
+	hosts[1]->RemoveDependency(deps[0]);
+	hosts[0]->RemoveReverseDependency(deps[0]);
+	BOOST_CHECK(hosts[2]->IsReachable() == true);
+}
+
+BOOST_AUTO_TEST_CASE(bulk_add)
+{
+	/* One parent with many children, added at once. */
+	std::vector<Host::Ptr> hosts;
+
+	for (int i = 0; i < 101; i++) {
+		Host::Ptr host = new Host();
+		host->SetActive(true);
+		host->SetMaxCheckAttempts(1);
+		host->Activate();
+		host->SetAuthority(true);
+		host->SetStateRaw(ServiceOK);
+		host->SetStateType(StateTypeHard);
+		host->SetLastCheckResult(new CheckResult());
+
+		hosts.push_back(host);
+	}
+
+	std::vector<Dependency::Ptr> deps;
+
+	for (int i = 1; i < 101; i++) {
+		Dependency::Ptr dep = new Dependency();
+		dep->SetParent(hosts[0]);
+		dep->SetChild(hosts[i]);
+		dep->SetStateFilter(StateFilterUp);
+
+		deps.push_back(dep);
+	}
+
+	/* Cached before the dependencies exist. */
+	BOOST_CHECK(hosts[1]->IsReachable() == true);
+
+	hosts[0]->SetStateRaw(ServiceCritical);
+	hosts[1]->AddDependency(deps[0]);
+	hosts[0]->AddReverseDependency(deps[0]);
+
+	Checkable::AddDependencies(deps);
+
+	BOOST_CHECK(hosts[0]->GetReverseDependencies().size() == 100);
+
+	for (int i = 1; i < 101; i++) {
+		BOOST_CHECK(hosts[i]->GetDependencies().size() == 1);
+		BOOST_CHECK(hosts[i]->IsReachable() == false);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(all_children)
+{
+	/* 0 -> 1 -> 3, 0 -> 2 -> 3, 3 -> 0 and later 3 -> 4. */
+	std::vector<Host::Ptr> hosts;
+
+	for (int i = 0; i < 5; i++) {
+		Host::Ptr host = new Host();
+		host->SetActive(true);
+		host->Activate();
+
+		hosts.push_back(host);
+	}
+
+	auto depend ([&hosts](int parent, int child) {
+		Dependency::Ptr dep = new Dependency();
+		dep->SetParent(hosts[parent]);
+		dep->SetChild(hosts[child]);
+
+		hosts[child]->AddDependency(dep);
+		hosts[parent]->AddReverseDependency(dep);
+
+		return dep;
+	});
+
+	auto allChildren ([&hosts](int parent) {
+		std::set<Checkable::Ptr> children;
+
+		for (auto& child : hosts[parent]->GetAllChildren())
+			BOOST_CHECK(children.insert(child).second);
+
+		return children;
+	});
+
+	depend(0, 1);
+	depend(0, 2);
+	depend(1, 3);
+	depend(2, 3);
+	depend(3, 0);
+
+	/* Each of them once, even the ones reachable on several ways, and never the checkable itself. */
+	BOOST_CHECK(allChildren(0) == std::set<Checkable::Ptr>({ hosts[1], hosts[2], hosts[3] }));
+	BOOST_CHECK(allChildren(1) == std::set<Checkable::Ptr>({ hosts[3], hosts[0], hosts[2] }));
+
+	/* The kept results of all ancestors follow changes below them. */
+	Dependency::Ptr dep = depend(3, 4);
+
+	BOOST_CHECK(allChildren(0).count(hosts[4]));
+	BOOST_CHECK(allChildren(1).count(hosts[4]));
+	BOOST_CHECK(allChildren(4).empty());
+
+	hosts[4]->RemoveDependency(dep);
+	hosts[3]->RemoveReverseDependency(dep);
+
+	BOOST_CHECK(!allChildren(0).count(hosts[4]));
+	BOOST_CHECK(!allChildren(2).count(hosts[4]));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
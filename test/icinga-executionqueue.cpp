@@ -0,0 +1,119 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icinga/executionqueue.hpp"
+#include <BoostTestTargetConfig.h>
+#include <deque>
+#include <vector>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(icinga_executionqueue)
+
+BOOST_AUTO_TEST_CASE(limit)
+{
+	ExecutionQueue queue;
+	std::vector<int> started;
+
+	for (int i = 0; i < 4; i++)
+		BOOST_CHECK(queue.Enqueue(2, "", [&started, i]() { started.push_back(i); }));
+
+	/* Only two executions run at the same time, the others wait in order. */
+	BOOST_CHECK(started == std::vector<int>({ 0, 1 }));
+	BOOST_CHECK_EQUAL(queue.GetRunning(), 2u);
+	BOOST_CHECK_EQUAL(queue.GetPending(), 2u);
+
+	queue.Release();
+	BOOST_CHECK(started == std::vector<int>({ 0, 1, 2 }));
+
+	queue.Release();
+	queue.Release();
+	BOOST_CHECK(started == std::vector<int>({ 0, 1, 2, 3 }));
+
+	/* All slots are free again. */
+	queue.Release();
+	BOOST_CHECK_EQUAL(queue.GetRunning(), 0u);
+
+	queue.Enqueue(2, "", [&started]() { started.push_back(4); });
+	queue.Enqueue(2, "", [&started]() { started.push_back(5); });
+	BOOST_CHECK(started.size() == 6u);
+
+	/* Without a limit nothing waits. */
+	for (int i = 0; i < 10; i++)
+		queue.Enqueue(0, "", [&started, i]() { started.push_back(6 + i); });
+
+	BOOST_CHECK(started.size() == 16u);
+	BOOST_CHECK_EQUAL(queue.GetPending(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(deduplication)
+{
+	ExecutionQueue queue;
+	std::vector<int> started;
+
+	BOOST_CHECK(queue.Enqueue(1, "a", [&started]() { started.push_back(0); }));
+	BOOST_CHECK(queue.Enqueue(1, "a", [&started]() { started.push_back(1); }));
+	BOOST_CHECK(!queue.Enqueue(1, "a", [&started]() { started.push_back(2); }));
+	BOOST_CHECK(queue.Enqueue(1, "b", [&started]() { started.push_back(3); }));
+
+	BOOST_CHECK_EQUAL(queue.GetPending(), 2u);
+	BOOST_CHECK_EQUAL(queue.GetDeduplicated(), 1u);
+
+	queue.Release();
+	BOOST_CHECK(started == std::vector<int>({ 0, 1 }));
+
+	/* Once the pending one has started, the same execution may wait again. */
+	BOOST_CHECK(queue.Enqueue(1, "a", [&started]() { started.push_back(4); }));
+
+	queue.Release();
+	queue.Release();
+	queue.Release();
+	BOOST_CHECK(started == std::vector<int>({ 0, 1, 3, 4 }));
+	BOOST_CHECK_EQUAL(queue.GetRunning(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(global)
+{
+	ExecutionQueue local1, local2, global;
+	std::deque<std::function<void()>> running;
+	std::vector<int> started;
+
+	auto run ([&](ExecutionQueue& local, int localLimit, const String& key, int id) {
+		ExecutionQueue::Run(local, localLimit, global, 3, key, [&running, &started, id](const std::function<void()>& done) {
+			started.push_back(id);
+			running.push_back(done);
+		});
+	});
+
+	run(local1, 2, "a", 0);
+	run(local1, 2, "b", 1);
+	run(local1, 2, "c", 2);
+	run(local2, 2, "d", 3);
+	run(local2, 2, "e", 4);
+
+	/* Each command runs at most two, all of them at most three. */
+	BOOST_CHECK(started == std::vector<int>({ 0, 1, 3 }));
+	BOOST_CHECK_EQUAL(local1.GetPending(), 1u);
+	BOOST_CHECK_EQUAL(global.GetPending(), 1u);
+
+	running[0]();
+	BOOST_CHECK(started == std::vector<int>({ 0, 1, 3, 4 }));
+
+	running[1]();
+	BOOST_CHECK(started == std::vector<int>({ 0, 1, 3, 4, 2 }));
+
+	/* Identical to the execution waiting for a global slot, its command's slot is freed again. */
+	run(local1, 0, "f", 5);
+	run(local1, 0, "f", 6);
+	BOOST_CHECK_EQUAL(global.GetDeduplicated(), 1u);
+	BOOST_CHECK_EQUAL(local1.GetRunning(), 2u);
+
+	for (size_t i = 2; i < running.size(); i++)
+		running[i]();
+
+	BOOST_CHECK(started == std::vector<int>({ 0, 1, 3, 4, 2, 5 }));
+	BOOST_CHECK_EQUAL(local1.GetRunning(), 0u);
+	BOOST_CHECK_EQUAL(local2.GetRunning(), 0u);
+	BOOST_CHECK_EQUAL(global.GetRunning(), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,42 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icinga/filterindex.hpp"
+#include "icinga/service.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+static bool IsIndexed(const Type::Ptr& type, const String& filter, const Namespace::Ptr& filterVars = nullptr)
+{
+	size_t candidates = 0;
+
+	return FilterUtility::FindIndexedTargets(type, FilterUtility::CompileFilter(filter).get(), filterVars,
+		[&candidates](const Value&) { candidates++; });
+}
+
+BOOST_AUTO_TEST_SUITE(icinga_filterindex)
+
+BOOST_AUTO_TEST_CASE(predicates)
+{
+	Namespace::Ptr filterVars = new Namespace();
+	filterVars->Set("hostname", "example.localdomain");
+	filterVars->Set("state", 2);
+
+	BOOST_CHECK(IsIndexed(Host::TypeInstance, "host.name == \"example.localdomain\""));
+	BOOST_CHECK(IsIndexed(Host::TypeInstance, "\"example.localdomain\" == obj.name"));
+	BOOST_CHECK(IsIndexed(Host::TypeInstance, "host.name == hostname", filterVars));
+	BOOST_CHECK(IsIndexed(Host::TypeInstance, "\"linux-servers\" in host.groups"));
+	BOOST_CHECK(IsIndexed(Host::TypeInstance, "match(\"web*\", host.name) || \"linux-servers\" in host.groups"));
+	BOOST_CHECK(IsIndexed(Service::TypeInstance, "service.state != 0 && \"linux-servers\" in host.groups"));
+	BOOST_CHECK(IsIndexed(Service::TypeInstance, "service.state == state && match(\"ping*\", service.name)", filterVars));
+	BOOST_CHECK(IsIndexed(Service::TypeInstance, "\"http\" in service.groups"));
+
+	BOOST_CHECK(!IsIndexed(Host::TypeInstance, "host.name == hostname"));
+	BOOST_CHECK(!IsIndexed(Host::TypeInstance, "host.vars.os == \"Linux\""));
+	BOOST_CHECK(!IsIndexed(Host::TypeInstance, "match(\"web*\", host.name) || host.vars.os == \"Linux\""));
+	BOOST_CHECK(!IsIndexed(Host::TypeInstance, "len(host.groups) > 0 && \"linux-servers\" in host.groups"));
+	BOOST_CHECK(!IsIndexed(Host::TypeInstance, "match(\"web*\", host.name, MatchAny)"));
+	BOOST_CHECK(!IsIndexed(Service::TypeInstance, "service.state != 0"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
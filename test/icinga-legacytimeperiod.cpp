@@ -265,4 +265,36 @@ BOOST_AUTO_TEST_CASE(advanced)
 	AdvancedHelper("09:00:03-30:00:04", {{2014, 9, 24}, {9, 0, 3}}, {{2014, 9, 25}, {6, 0, 4}});
 }
 
+BOOST_AUTO_TEST_CASE(compiled)
+{
+	LegacyDayDefinition daydef = LegacyTimePeriod::CompileDayDefinition("day 1 - 15 / 2");
+
+	BOOST_CHECK(daydef.Begin.Type == LegacyTimeSpec::MonthDay);
+	BOOST_CHECK_EQUAL(daydef.Begin.Month, -1);
+	BOOST_CHECK_EQUAL(daydef.Begin.Day, 1);
+	BOOST_CHECK(daydef.End.Type == LegacyTimeSpec::MonthDay);
+	BOOST_CHECK_EQUAL(daydef.End.Day, 15);
+	BOOST_CHECK_EQUAL(daydef.Stride, 2);
+
+	LegacyTimeSpec spec = LegacyTimePeriod::CompileTimeSpec("monday -1 may");
+
+	BOOST_CHECK(spec.Type == LegacyTimeSpec::WeekDay);
+	BOOST_CHECK_EQUAL(spec.Weekday, 1);
+	BOOST_CHECK(spec.HasNth);
+	BOOST_CHECK_EQUAL(spec.Day, -1);
+	BOOST_CHECK_EQUAL(spec.Month, 4);
+
+	std::vector<LegacyTimeRange> timeranges = LegacyTimePeriod::CompileTimeRanges("09:00-17:00,22:00:30-06:00");
+
+	BOOST_REQUIRE_EQUAL(timeranges.size(), 2);
+	BOOST_CHECK_EQUAL(timeranges[0].BeginHour, 9);
+	BOOST_CHECK_EQUAL(timeranges[0].EndHour, 17);
+	BOOST_CHECK_EQUAL(timeranges[1].BeginSecond, 30);
+	BOOST_CHECK_EQUAL(timeranges[1].EndHour, 30);
+
+	BOOST_CHECK_THROW(LegacyTimePeriod::CompileTimeSpec("2015-12-32"), std::invalid_argument);
+	BOOST_CHECK_THROW(LegacyTimePeriod::CompileTimeSpec("monday 1 smarch"), std::invalid_argument);
+	BOOST_CHECK_THROW(LegacyTimePeriod::CompileTimeRange("09:00"), std::invalid_argument);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
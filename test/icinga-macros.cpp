@@ -1,6 +1,7 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "icinga/macroprocessor.hpp"
+#include "icinga/host.hpp"
 #include <BoostTestTargetConfig.h>
 
 using namespace icinga;
@@ -47,4 +48,71 @@ BOOST_AUTO_TEST_CASE(simple)
 
 }
 
+BOOST_AUTO_TEST_CASE(compiled)
+{
+	Dictionary::Ptr macros = new Dictionary({
+		{ "address", "192.0.2.1" },
+		{ "port", 443 },
+		{ "ssl", true }
+	});
+
+	MacroProcessor::ResolverList resolvers;
+	resolvers.emplace_back("macros", macros);
+
+	Dictionary::Ptr arguments = new Dictionary({
+		{ "-H", "$address$" },
+		{ "-p", new Dictionary({ { "value", "$port$" }, { "order", -1 } }) },
+		{ "-S", new Dictionary({ { "set_if", "$ssl$" } }) },
+		{ "--sni", new Dictionary({ { "value", "$sni$" } }) }
+	});
+
+	auto compiled (MacroProcessor::CompileCommand(new Array({ "check_tcp" }), arguments));
+
+	/* --sni is skipped because $sni$ is missing, the compiled command must give the same result for each resolution. */
+	for (int i = 0; i < 2; i++) {
+		Array::Ptr result = MacroProcessor::ResolveArguments(*compiled, resolvers, nullptr, nullptr, false);
+
+		BOOST_REQUIRE(result->GetLength() == 6);
+		BOOST_CHECK(result->Get(0) == "check_tcp");
+		BOOST_CHECK(result->Get(1) == "-p");
+		BOOST_CHECK(result->Get(2) == "443");
+		BOOST_CHECK(result->Get(3) == "-H");
+		BOOST_CHECK(result->Get(4) == "192.0.2.1");
+		BOOST_CHECK(result->Get(5) == "-S");
+	}
+
+	MacroFormat format = MacroProcessor::ParseFormat("a $macros.address$ $$ b");
+
+	BOOST_REQUIRE(format.Segments.size() == 5);
+	BOOST_CHECK(format.Segments[1].IsMacro && format.Segments[1].ObjName == "macros" && format.Segments[1].Path == "address");
+	BOOST_CHECK(format.Segments[3].IsMacro && format.Segments[3].Text.IsEmpty());
+
+	BOOST_CHECK(MacroProcessor::ResolveMacros(MacroProcessor::CompileValue("a $macros.address$ $$ b"), resolvers) == "a 192.0.2.1 $ b");
+	BOOST_CHECK(MacroProcessor::ParseFormat("$address").Unterminated);
+}
+
+BOOST_AUTO_TEST_CASE(specialized)
+{
+	Host::Ptr host = new Host();
+	host->SetName("example.localdomain", true);
+	host->SetVars(new Dictionary({ { "os", "Linux" }, { "recursive", "$host.name$" } }), true);
+
+	MacroProcessor::ResolverList resolvers;
+	resolvers.emplace_back("host", host);
+
+	CompiledMacroValue value = MacroProcessor::SpecializeValue(
+		MacroProcessor::CompileValue("$host.name$.$host.vars.os$.$host.vars.recursive$.$host.vars.missing$.$$"), resolvers);
+
+	/* Only the macros with further macros or without a value are left. */
+	BOOST_REQUIRE(value.Formats.size() == 1);
+	BOOST_REQUIRE(value.Formats[0].Segments.size() == 6);
+	BOOST_CHECK(!value.Formats[0].Segments[0].IsMacro && value.Formats[0].Segments[0].Text == "example.localdomain.Linux.");
+	BOOST_CHECK(value.Formats[0].Segments[1].IsMacro && value.Formats[0].Segments[1].Path == "vars.recursive");
+	BOOST_CHECK(value.Formats[0].Segments[3].IsMacro && value.Formats[0].Segments[3].Path == "vars.missing");
+
+	String missingMacro;
+	BOOST_CHECK(MacroProcessor::ResolveMacros(value, resolvers, nullptr, &missingMacro) == "example.localdomain.Linux.example.localdomain..$");
+	BOOST_CHECK(missingMacro == "host.vars.missing");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
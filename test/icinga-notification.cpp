@@ -1,8 +1,17 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "icinga/notification.hpp"
+#include "icinga/host.hpp"
+#include "icinga/notificationcommand.hpp"
+#include "icinga/user.hpp"
+#include "config/configcompiler.hpp"
+#include "config/configitem.hpp"
 #include <BoostTestTargetConfig.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
 
 using namespace icinga;
 
@@ -102,4 +111,104 @@ BOOST_AUTO_TEST_CASE(type_filter)
 	std::cout << "#4 Notification type: " << ftype << " against " << notification->GetTypeFilter() << " must fail." << std::endl;
 	BOOST_CHECK(!(notification->GetTypeFilter() & ftype));
 }
+
+static void CreateDigestTestObjects()
+{
+	String config = R"CONFIG(
+object CheckCommand "digest-dummy" {
+  execute = function() { }
+}
+
+object NotificationCommand "digest" {
+  execute = function() { }
+  digest_window = 3600
+}
+
+object User "digest-user" { }
+
+object Host "digest-01" { check_command = "digest-dummy" }
+object Host "digest-02" { check_command = "digest-dummy" }
+object Host "digest-03" { check_command = "digest-dummy" }
+
+apply Notification "digest" to Host {
+  command = "digest"
+  users = [ "digest-user" ]
+  assign where match("digest-*", host.name)
+}
+)CONFIG";
+
+	std::unique_ptr<Expression> expr = ConfigCompiler::CompileText("<digest>", config);
+	expr->Evaluate(*ScriptFrame::GetCurrentFrame());
+}
+
+BOOST_AUTO_TEST_CASE(digest)
+{
+	BOOST_REQUIRE(ConfigItem::RunWithActivationContext(new Function("CreateDigestTestObjects", CreateDigestTestObjects)));
+
+	NotificationCommand::Ptr command = NotificationCommand::GetByName("digest");
+	User::Ptr user = User::GetByName("digest-user");
+	BOOST_REQUIRE(command && user);
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::vector<std::pair<Value, Dictionary::Ptr>> executions;
+	std::vector<String> sent;
+
+	command->SetExecute(new Function("DigestTestExecute", [&mutex, &cv, &executions](const std::vector<Value>& args) -> Value {
+		std::unique_lock<std::mutex> lock (mutex);
+		executions.emplace_back(args.at(0), NotificationCommand::DigestMacros);
+		cv.notify_all();
+		return Empty;
+	}));
+
+	boost::signals2::scoped_connection onSent (Checkable::OnNotificationSentToUser.connect([&mutex, &cv, &sent](
+		const Notification::Ptr& notification, const Checkable::Ptr&, const User::Ptr&, const NotificationType&,
+		const CheckResult::Ptr&, const String&, const String&, const String& commandName, const MessageOrigin::Ptr&) {
+		if (commandName == "digest") {
+			std::unique_lock<std::mutex> lock (mutex);
+			sent.emplace_back(notification->GetName());
+			cv.notify_all();
+		}
+	}));
+
+	std::vector<Notification::Ptr> notifications;
+
+	for (auto name : { "digest-01", "digest-02", "digest-03" })
+		notifications.emplace_back(Notification::GetByName(String(name) + "!digest"));
+
+	for (auto& notification : notifications) {
+		BOOST_REQUIRE(notification);
+		notification->ExecuteNotificationHelper(NotificationProblem, user, nullptr, false);
+	}
+
+	{
+		/* Nothing is sent within the digest window. */
+		std::unique_lock<std::mutex> lock (mutex);
+		BOOST_CHECK(executions.empty());
+		BOOST_CHECK(sent.empty());
+	}
+
+	command->FlushDigests(true);
+
+	std::unique_lock<std::mutex> lock (mutex);
+
+	BOOST_REQUIRE(cv.wait_for(lock, std::chrono::seconds(10), [&sent]() { return sent.size() >= 3u; }));
+
+	/* The command runs once, for the latest notification. */
+	BOOST_REQUIRE_EQUAL(executions.size(), 1u);
+	BOOST_CHECK(executions[0].first == notifications[2]);
+
+	Dictionary::Ptr macros = executions[0].second;
+	BOOST_REQUIRE(macros);
+	BOOST_CHECK_EQUAL(macros->Get("digest_count"), 3);
+	BOOST_CHECK_EQUAL(macros->Get("digest_objects"), "digest-01, digest-02, digest-03");
+	BOOST_CHECK_EQUAL(String(macros->Get("digest_summary")).Split("\n").size(), 3u);
+
+	/* Every notification is reported as sent, the latest by the command's execution, the others by the digest. */
+	BOOST_CHECK_EQUAL(sent.size(), 3u);
+	BOOST_CHECK(std::count(sent.begin(), sent.end(), notifications[0]->GetName()) == 1);
+	BOOST_CHECK(std::count(sent.begin(), sent.end(), notifications[1]->GetName()) == 1);
+	BOOST_CHECK(std::count(sent.begin(), sent.end(), notifications[2]->GetName()) == 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
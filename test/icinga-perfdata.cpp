@@ -1,5 +1,6 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
+#include "base/parsedperfdata.hpp"
 #include "base/perfdatavalue.hpp"
 #include "icinga/pluginutility.hpp"
 #include <BoostTestTargetConfig.h>
@@ -305,4 +306,72 @@ BOOST_AUTO_TEST_CASE(multi)
 	BOOST_CHECK(pd->Get(1) == "test::b=4");
 }
 
+BOOST_AUTO_TEST_CASE(numbers)
+{
+	BOOST_CHECK(PerfdataValue::Parse("test=1e3")->GetValue() == 1000);
+	BOOST_CHECK(PerfdataValue::Parse("test=+.5")->GetValue() == 0.5);
+	BOOST_CHECK(PerfdataValue::Parse("test=-5.")->GetValue() == -5);
+	BOOST_CHECK(PerfdataValue::Parse("test=0.1")->GetValue() == 0.1);
+	BOOST_CHECK(PerfdataValue::Parse("test=1.5e-3")->GetValue() == 1.5e-3);
+	BOOST_CHECK(PerfdataValue::Parse("test=12345678901234567890")->GetValue() == 12345678901234567890.0);
+	BOOST_CHECK(PerfdataValue::Parse("test=1e100")->GetValue() == 1e100);
+
+	BOOST_CHECK_THROW(PerfdataValue::Parse("test=1..2"), boost::exception);
+	BOOST_CHECK_THROW(PerfdataValue::Parse("test=5e"), boost::exception);
+	BOOST_CHECK_THROW(PerfdataValue::Parse("test=ms"), boost::exception);
+}
+
+BOOST_AUTO_TEST_CASE(fields)
+{
+	String perfdata = "'hello world'=1000ms;U;500;;2000";
+	size_t labelBegin, labelLength;
+	PerfdataFields fields;
+
+	PerfdataValue::ParseFields(perfdata, labelBegin, labelLength, fields);
+
+	BOOST_CHECK(perfdata.SubStr(labelBegin, labelLength) == "hello world");
+	BOOST_CHECK(fields.Value == 1);
+	BOOST_CHECK(String(fields.Unit) == "seconds");
+	BOOST_CHECK(fields.Flags == (PerfdataFields::HasCrit | PerfdataFields::HasMax));
+	BOOST_CHECK(fields.Crit == 0.5);
+	BOOST_CHECK(fields.Max == 2);
+}
+
+BOOST_AUTO_TEST_CASE(parsed)
+{
+	Array::Ptr pd = PluginUtility::SplitPerfdata("rta=0.5ms;100;500;0 pl=5%;;;0;100 invalid=x");
+	pd->Add(new PerfdataValue("bytes", 23, true, "", Empty, 42));
+
+	ParsedPerfdata::Ptr parsed = new ParsedPerfdata(pd);
+
+	BOOST_CHECK(parsed->GetLength() == 3);
+
+	BOOST_CHECK(parsed->GetLabel(0) == "rta");
+	BOOST_CHECK(parsed->GetValue(0) == 0.0005);
+	BOOST_CHECK(parsed->GetUnit(0) == "seconds");
+	BOOST_CHECK(parsed->HasWarn(0) && parsed->GetWarn(0) == 0.1);
+	BOOST_CHECK(parsed->HasCrit(0) && parsed->GetCrit(0) == 0.5);
+	BOOST_CHECK(parsed->HasMin(0) && parsed->GetMin(0) == 0);
+	BOOST_CHECK(!parsed->HasMax(0));
+	BOOST_CHECK(!parsed->IsCounter(0));
+
+	BOOST_CHECK(parsed->GetLabel(1) == "pl");
+	BOOST_CHECK(parsed->GetUnit(1) == "percent");
+	BOOST_CHECK(!parsed->HasWarn(1) && !parsed->HasCrit(1));
+	BOOST_CHECK(parsed->HasMax(1) && parsed->GetMax(1) == 100);
+
+	BOOST_CHECK(parsed->GetLabel(2) == "bytes");
+	BOOST_CHECK(parsed->IsCounter(2));
+	BOOST_CHECK(!parsed->HasWarn(2));
+	BOOST_CHECK(parsed->HasCrit(2) && parsed->GetCrit(2) == 42);
+	BOOST_CHECK(parsed->GetPerfdataValue(2)->GetCrit() == 42);
+
+	BOOST_CHECK(parsed->GetInvalid().size() == 1);
+	BOOST_CHECK(parsed->GetInvalid()[0] == "invalid=x");
+
+	/* Labels are shared between parses. */
+	ParsedPerfdata::Ptr again = new ParsedPerfdata(pd);
+	BOOST_CHECK(&again->GetLabel(0) == &parsed->GetLabel(0));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,126 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "icinga/statemap.hpp"
+#include "base/convert.hpp"
+#include "base/utility.hpp"
+#include <BoostTestTargetConfig.h>
+#include <atomic>
+#include <thread>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(icinga_statemap)
+
+#ifndef _WIN32
+BOOST_AUTO_TEST_CASE(update_read)
+{
+	char dir[] = "/tmp/statemap-XXXXXX";
+	BOOST_REQUIRE(mkdtemp(dir));
+
+	String path = String(dir) + "/icinga2.state";
+
+	{
+		StateMap map (path, { { StateMap::RecordHost, "h1" }, { StateMap::RecordService, "h1!s1" } }, 8);
+
+		/* Not there before it's published. */
+		BOOST_CHECK(!Utility::PathExists(path));
+
+		map.Publish();
+		BOOST_CHECK(Utility::PathExists(path));
+
+		StateMap::Entry entry;
+		entry.State = 2;
+		entry.StateType = 1;
+		entry.Flags = StateMap::FlagAcknowledged | StateMap::FlagInDowntime;
+		entry.CheckAttempt = 3;
+		entry.LastCheck = 1000;
+		entry.LastStateChange = 900;
+		entry.Output = "CRITICAL";
+		map.Update(1, entry);
+
+		/* Truncated, but not within a UTF-8 sequence. */
+		entry.Output = "1234567\xc3\xa4";
+		map.Update(0, entry);
+
+		/* Another process would attach to the file like this. */
+		StateMap reader (path);
+
+		BOOST_CHECK(reader.GetCount() == 2);
+		BOOST_CHECK(reader.GetName(0) == "h1");
+		BOOST_CHECK(reader.GetName(1) == "h1!s1");
+
+		StateMap::Entry read;
+		BOOST_CHECK(reader.Read(1, read));
+		BOOST_CHECK(read.Type == StateMap::RecordService);
+		BOOST_CHECK(read.State == 2);
+		BOOST_CHECK(read.StateType == 1);
+		BOOST_CHECK(read.Flags == (StateMap::FlagAcknowledged | StateMap::FlagInDowntime));
+		BOOST_CHECK(read.CheckAttempt == 3);
+		BOOST_CHECK(read.LastCheck == 1000);
+		BOOST_CHECK(read.LastStateChange == 900);
+		BOOST_CHECK(read.Output == "CRITICAL");
+
+		BOOST_CHECK(reader.Read(0, read));
+		BOOST_CHECK(read.Type == StateMap::RecordHost);
+		BOOST_CHECK(read.Output == "1234567");
+
+		BOOST_CHECK(!reader.Read(2, read));
+
+		/* A new file replaces the old one, which tells its readers. */
+		StateMap next (path, { { StateMap::RecordHost, "h2" } }, 8);
+		next.Publish();
+
+		BOOST_CHECK(reader.IsRetired());
+		BOOST_CHECK(!next.IsRetired());
+		BOOST_CHECK(StateMap(path).GetName(0) == "h2");
+	}
+
+	Utility::RemoveDirRecursive(dir);
+}
+
+BOOST_AUTO_TEST_CASE(consistency)
+{
+	char dir[] = "/tmp/statemap-XXXXXX";
+	BOOST_REQUIRE(mkdtemp(dir));
+
+	{
+		StateMap map (String(dir) + "/icinga2.state", { { StateMap::RecordService, "h1!s1" } }, 64);
+		std::atomic<bool> stop (false);
+
+		/* Each entry's fields are derived from the same number, so torn reads show up as mismatches. */
+		std::thread writer ([&map, &stop]() {
+			for (uint32_t i = 1; !stop.load(); i++) {
+				StateMap::Entry entry;
+				entry.CheckAttempt = i;
+				entry.LastCheck = i;
+				entry.Output = String(i % 64, 'x') + Convert::ToString(i);
+				map.Update(0, entry);
+			}
+		});
+
+		bool consistent = true;
+
+		for (int i = 0; i < 100000; i++) {
+			StateMap::Entry entry;
+			map.Read(0, entry);
+
+			if (entry.CheckAttempt == 0)
+				continue;
+
+			String expected = String(entry.CheckAttempt % 64, 'x') + Convert::ToString(entry.CheckAttempt);
+
+			consistent = consistent && entry.LastCheck == entry.CheckAttempt
+				&& entry.Output == expected.SubStr(0, 64);
+		}
+
+		stop.store(true);
+		writer.join();
+
+		BOOST_CHECK(consistent);
+	}
+
+	Utility::RemoveDirRecursive(dir);
+}
+#endif /* _WIN32 */
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,14 +1,27 @@
 /* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
 
 #include "livestatus/livestatusquery.hpp"
+#include "livestatus/livestatuslogindex.hpp"
+#include "livestatus/livestatuslogutility.hpp"
+#include "icinga/service.hpp"
+#include "icinga/checkresult.hpp"
 #include "base/application.hpp"
 #include "base/stdiostream.hpp"
 #include "base/json.hpp"
+#include "base/utility.hpp"
 #include <BoostTestTargetConfig.h>
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+
+#ifdef HAVE_ZLIB
+#	include <zlib.h>
+#endif /* HAVE_ZLIB */
 
 using namespace icinga;
 
-String LivestatusQueryHelper(const std::vector<String>& lines)
+static String ExecuteLivestatusQuery(const std::vector<String>& lines)
 {
 	LivestatusQuery::Ptr query = new LivestatusQuery(lines, "");
 
@@ -36,6 +49,13 @@ String LivestatusQueryHelper(const std::vector<String>& lines)
 			break;
 	}
 
+	return output;
+}
+
+String LivestatusQueryHelper(const std::vector<String>& lines)
+{
+	String output = ExecuteLivestatusQuery(lines);
+
 	BOOST_TEST_MESSAGE("Query Result: " + output);
 
 	return output;
@@ -102,6 +122,275 @@ BOOST_AUTO_TEST_CASE(services)
 
 	BOOST_TEST_MESSAGE("Done with testing livestatus services...");
 }
+
+BOOST_AUTO_TEST_CASE(services_by_host)
+{
+	BOOST_TEST_MESSAGE( "Querying Livestatus...");
+
+	std::vector<String> lines;
+	lines.emplace_back("GET services");
+	lines.emplace_back("Columns: host_name service_description");
+	lines.emplace_back("Filter: host_name = test-01");
+	lines.emplace_back("Filter: description = livestatus");
+	lines.emplace_back("OutputFormat: json");
+	lines.emplace_back("\n");
+
+	/* use our query helper */
+	String output = LivestatusQueryHelper(lines);
+
+	Array::Ptr query_result = JsonDecode(output);
+
+	/* the services are looked up by their host */
+	BOOST_CHECK(query_result->GetLength() == 1);
+
+	Array::Ptr res1 = query_result->Get(0);
+
+	BOOST_CHECK(res1->Get(0) == "test-01");
+	BOOST_CHECK(res1->Get(1) == "livestatus");
+
+	BOOST_TEST_MESSAGE("Done with testing livestatus services by host...");
+}
+
+BOOST_AUTO_TEST_CASE(services_numeric_filter)
+{
+	std::vector<String> lines;
+	lines.emplace_back("GET services");
+	lines.emplace_back("Columns: host_name state has_been_checked max_check_attempts is_flapping");
+	lines.emplace_back("Filter: state = 3");
+	lines.emplace_back("Filter: max_check_attempts >= 3");
+	lines.emplace_back("OutputFormat: json");
+	lines.emplace_back("\n");
+
+	/* Services which haven't been checked yet are UNKNOWN. */
+	Array::Ptr query_result = JsonDecode(LivestatusQueryHelper(lines));
+
+	BOOST_CHECK(query_result->GetLength() == 2);
+
+	for (size_t i = 0; i < query_result->GetLength(); i++) {
+		Array::Ptr row = query_result->Get(i);
+
+		BOOST_CHECK(row->Get(1) == 3);
+		BOOST_CHECK(row->Get(2) == 0);
+		BOOST_CHECK(row->Get(3) == 3);
+		BOOST_CHECK(row->Get(4) == false);
+	}
+
+	lines[2] = "Filter: state < 3";
+
+	query_result = JsonDecode(LivestatusQueryHelper(lines));
+
+	BOOST_CHECK(query_result->GetLength() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_queries)
+{
+	BOOST_TEST_MESSAGE( "Querying Livestatus from several threads...");
+
+	std::vector<String> lines;
+	lines.emplace_back("GET services");
+	lines.emplace_back("Columns: host_name service_description");
+	lines.emplace_back("Filter: host_name = test-01");
+	lines.emplace_back("OutputFormat: json");
+	lines.emplace_back("\n");
+
+	String expected = ExecuteLivestatusQuery(lines);
+
+	const int threadCount = 8;
+	const int queryCount = 500;
+
+	std::atomic<int> mismatches (0);
+	std::vector<std::thread> threads;
+
+	double start = Utility::GetTime();
+
+	for (int i = 0; i < threadCount; i++) {
+		threads.emplace_back([&lines, &expected, &mismatches, queryCount]() {
+			for (int j = 0; j < queryCount; j++) {
+				if (ExecuteLivestatusQuery(lines) != expected)
+					mismatches++;
+			}
+		});
+	}
+
+	for (auto& thread : threads)
+		thread.join();
+
+	double duration = Utility::GetTime() - start;
+
+	BOOST_CHECK(mismatches == 0);
+
+	BOOST_TEST_MESSAGE("Executed " << threadCount * queryCount << " queries in " << duration << " seconds ("
+		<< threadCount * queryCount / duration << " queries per second).");
+}
+BOOST_AUTO_TEST_CASE(log_index)
+{
+	std::fstream fp;
+	String path = Utility::CreateTempFile("livestatus-log-XXXXXX", 0600, fp);
+
+	fp << "[1600000000] SERVICE ALERT: test-01;livestatus;CRITICAL;HARD;1;down\n"
+		<< "\n"
+		<< "[1600000001] HOST ALERT: test-02;DOWN;HARD;1;down\n"
+		<< "[1600000002] SERVICE ALERT: test-02;livestatus;OK;HARD;1;up";
+	fp.flush();
+
+	/* The last line is still being written. */
+	std::vector<LivestatusLogRecord> records = LivestatusLogIndex::GetRecords(path);
+
+	BOOST_CHECK(records.size() == 2);
+	BOOST_CHECK(records[1].Time == 1600000001);
+	BOOST_CHECK(records[1].Lineno == 1);
+	BOOST_CHECK(records[1].HostHash == LivestatusLogIndex::HashName("test-02"));
+	BOOST_CHECK(records[1].Class == LogEntryClassAlert);
+
+	fp << "\n";
+	fp.close();
+
+	records = LivestatusLogIndex::GetRecords(path);
+
+	BOOST_CHECK(records.size() == 3);
+	BOOST_CHECK(records[2].Lineno == 2);
+	BOOST_CHECK(records[2].ServiceHash == LivestatusLogIndex::HashName("livestatus"));
+
+	LivestatusLogFilter filter;
+	filter.HostName = "test-02";
+
+	std::ifstream log (path.CStr());
+	std::string line;
+
+	log.seekg(records[2].Offset);
+	std::getline(log, line);
+
+	BOOST_CHECK(!filter.Matches(records[0]));
+	BOOST_CHECK(filter.Matches(records[2]));
+	BOOST_CHECK(line == "[1600000002] SERVICE ALERT: test-02;livestatus;OK;HARD;1;up");
+
+	(void)unlink(path.CStr());
+	(void)unlink((path + ".idx").CStr());
+}
+
+BOOST_AUTO_TEST_CASE(output_compression)
+{
+	std::vector<String> lines;
+	lines.emplace_back("GET hosts");
+	lines.emplace_back("Columns: host_name");
+	lines.emplace_back("OutputFormat: json");
+	lines.emplace_back("ResponseHeader: fixed16");
+	lines.emplace_back("OutputCompression: gzip");
+
+	LivestatusQuery::Ptr query = new LivestatusQuery(lines, "");
+
+	std::stringstream stream;
+	StdioStream::Ptr sstream = new StdioStream(&stream, false);
+
+	query->Execute(sstream);
+
+	std::string response = stream.str();
+
+	BOOST_REQUIRE(response.size() >= 16u);
+
+#ifdef HAVE_ZLIB
+	BOOST_CHECK(response.substr(0, 3) == "200");
+
+	size_t length = std::stoul(response.substr(3, 12));
+
+	BOOST_REQUIRE(response.size() == 16u + length);
+
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+
+	BOOST_REQUIRE(inflateInit2(&zs, 15 + 16) == Z_OK);
+
+	std::string json (64 * 1024, '\0');
+
+	zs.next_in = reinterpret_cast<Bytef*>(&response[16]);
+	zs.avail_in = length;
+	zs.next_out = reinterpret_cast<Bytef*>(&json[0]);
+	zs.avail_out = json.size();
+
+	BOOST_CHECK(inflate(&zs, Z_FINISH) == Z_STREAM_END);
+
+	json.resize(zs.total_out);
+	inflateEnd(&zs);
+
+	Array::Ptr rows = JsonDecode(json);
+
+	BOOST_CHECK(rows->GetLength() > 1);
+#else /* HAVE_ZLIB */
+	BOOST_CHECK(response.substr(0, 3) == "452");
+#endif /* HAVE_ZLIB */
+}
+
+static CheckResult::Ptr MakeCheckResult(ServiceState state)
+{
+	CheckResult::Ptr cr = new CheckResult();
+
+	cr->SetState(state);
+
+	double now = Utility::GetTime();
+	cr->SetScheduleStart(now);
+	cr->SetScheduleEnd(now);
+	cr->SetExecutionStart(now);
+	cr->SetExecutionEnd(now);
+
+	return cr;
+}
+
+BOOST_AUTO_TEST_CASE(stats_index)
+{
+	std::vector<String> lines;
+	lines.emplace_back("GET services");
+	lines.emplace_back("Stats: state = 0");
+	lines.emplace_back("Stats: state = 2");
+	lines.emplace_back("Stats: state = 2");
+	lines.emplace_back("Stats: acknowledged = 0");
+	lines.emplace_back("StatsAnd: 2");
+	lines.emplace_back("Stats: has_been_checked = 1");
+	lines.emplace_back("Stats: groups >= nonexistent");
+	lines.emplace_back("OutputFormat: json");
+	lines.emplace_back("\n");
+
+	/* The stats index doesn't count host names, so these stats are computed from the rows. */
+	std::vector<String> scanLines (lines);
+	scanLines.insert(scanLines.begin() + 1, "Filter: host_name ~ ^test-");
+
+	/* Services start out UNKNOWN until they've been checked. */
+	Service::Ptr service = Service::GetByNamePair("test-01", "livestatus");
+	BOOST_REQUIRE(service);
+
+	Service::Ptr other = Service::GetByNamePair("test-02", "livestatus");
+	BOOST_REQUIRE(other);
+
+	service->ProcessCheckResult(MakeCheckResult(ServiceOK));
+	other->ProcessCheckResult(MakeCheckResult(ServiceOK));
+
+	Array::Ptr row = Array::Ptr(JsonDecode(LivestatusQueryHelper(lines)))->Get(0);
+
+	BOOST_CHECK(row->Get(0) == 2);
+	BOOST_CHECK(row->Get(1) == 0);
+	BOOST_CHECK(row->Get(2) == 0);
+	BOOST_CHECK(row->Get(3) == 2);
+	BOOST_CHECK(row->Get(4) == 0);
+	BOOST_CHECK(ExecuteLivestatusQuery(lines) == ExecuteLivestatusQuery(scanLines));
+
+	service->ProcessCheckResult(MakeCheckResult(ServiceCritical));
+
+	row = Array::Ptr(JsonDecode(LivestatusQueryHelper(lines)))->Get(0);
+
+	BOOST_CHECK(row->Get(0) == 1);
+	BOOST_CHECK(row->Get(1) == 1);
+	BOOST_CHECK(row->Get(2) == 1);
+	BOOST_CHECK(row->Get(3) == 2);
+	BOOST_CHECK(ExecuteLivestatusQuery(lines) == ExecuteLivestatusQuery(scanLines));
+
+	service->ProcessCheckResult(MakeCheckResult(ServiceOK));
+
+	row = Array::Ptr(JsonDecode(LivestatusQueryHelper(lines)))->Get(0);
+
+	BOOST_CHECK(row->Get(0) == 2);
+	BOOST_CHECK(row->Get(1) == 0);
+	BOOST_CHECK(ExecuteLivestatusQuery(lines) == ExecuteLivestatusQuery(scanLines));
+}
+
 //____________________________________________________________________________//
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,157 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "perfdata/perfdataspool.hpp"
+#include "base/utility.hpp"
+#include <BoostTestTargetConfig.h>
+#include <fstream>
+#include <stdexcept>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(perfdata_perfdataspool)
+
+#ifndef _WIN32
+static std::vector<String> DrainAll(const PerfdataSpool::Ptr& spool, size_t chunkSize = 100)
+{
+	std::vector<String> drained;
+
+	spool->Drain(1000, chunkSize, [&drained](const std::vector<String>& records) {
+		drained.insert(drained.end(), records.begin(), records.end());
+	});
+
+	return drained;
+}
+
+BOOST_AUTO_TEST_CASE(append_drain)
+{
+	char dir[] = "/tmp/perfdataspool-XXXXXX";
+	BOOST_REQUIRE(mkdtemp(dir));
+
+	{
+		PerfdataSpool::Ptr spool = new PerfdataSpool(String(dir) + "/spool", 1024 * 1024);
+
+		BOOST_CHECK(spool->IsEmpty());
+
+		spool->Append({ "a", "bb", "" });
+		spool->Append({ "dddd" });
+
+		BOOST_CHECK(!spool->IsEmpty());
+
+		std::vector<size_t> chunks;
+
+		size_t drained = spool->Drain(1000, 3, [&chunks](const std::vector<String>& records) {
+			chunks.push_back(records.size());
+		});
+
+		BOOST_CHECK(drained == 4);
+		BOOST_CHECK(chunks == std::vector<size_t>({ 3, 1 }));
+		BOOST_CHECK(spool->IsEmpty());
+
+		/* Records which failed to be sent stay. */
+		spool->Append({ "e", "f" });
+
+		BOOST_CHECK_THROW(spool->Drain(1000, 100, [](const std::vector<String>&) {
+			throw std::runtime_error("unreachable");
+		}), std::runtime_error);
+
+		BOOST_CHECK(DrainAll(spool, 1) == std::vector<String>({ "e", "f" }));
+		BOOST_CHECK(spool->IsEmpty());
+
+		/* The limit is respected. */
+		spool->Append({ "g", "h", "i" });
+
+		BOOST_CHECK(spool->Drain(2, 100, [](const std::vector<String>&) { }) == 2);
+		BOOST_CHECK(DrainAll(spool) == std::vector<String>({ "i" }));
+	}
+
+	Utility::RemoveDirRecursive(dir);
+}
+
+BOOST_AUTO_TEST_CASE(restart)
+{
+	char dir[] = "/tmp/perfdataspool-XXXXXX";
+	BOOST_REQUIRE(mkdtemp(dir));
+
+	String path = String(dir) + "/spool";
+
+	{
+		PerfdataSpool::Ptr spool = new PerfdataSpool(path, 1024 * 1024);
+		spool->Append({ "a", "b" });
+	}
+
+	{
+		PerfdataSpool::Ptr spool = new PerfdataSpool(path, 1024 * 1024);
+
+		BOOST_CHECK(!spool->IsEmpty());
+
+		/* Appended to a new segment behind the old one. */
+		spool->Append({ "c" });
+
+		BOOST_CHECK(DrainAll(spool) == std::vector<String>({ "a", "b", "c" }));
+		BOOST_CHECK(spool->IsEmpty());
+	}
+
+	BOOST_CHECK(PerfdataSpool::Ptr(new PerfdataSpool(path, 1024 * 1024))->IsEmpty());
+
+	Utility::RemoveDirRecursive(dir);
+}
+
+BOOST_AUTO_TEST_CASE(corrupted)
+{
+	char dir[] = "/tmp/perfdataspool-XXXXXX";
+	BOOST_REQUIRE(mkdtemp(dir));
+
+	String path = String(dir) + "/spool";
+
+	{
+		PerfdataSpool::Ptr spool = new PerfdataSpool(path, 1024 * 1024);
+		spool->Append({ "first", "second", "third" });
+	}
+
+	{
+		/* Flip a byte of the second record, behind the 8 bytes of each record's length and checksum. */
+		std::fstream fp ((path + "/00000000000000000001.spool").CStr(), std::fstream::in | std::fstream::out | std::fstream::binary);
+		BOOST_REQUIRE(fp);
+
+		fp.seekp(8 + 5 + 8);
+		fp.put('S');
+	}
+
+	{
+		PerfdataSpool::Ptr spool = new PerfdataSpool(path, 1024 * 1024);
+		spool->Append({ "fourth" });
+
+		/* The remainder of the corrupted segment is skipped, the next one is read. */
+		BOOST_CHECK(DrainAll(spool) == std::vector<String>({ "first", "fourth" }));
+		BOOST_CHECK(spool->IsEmpty());
+	}
+
+	Utility::RemoveDirRecursive(dir);
+}
+
+BOOST_AUTO_TEST_CASE(size_limit)
+{
+	char dir[] = "/tmp/perfdataspool-XXXXXX";
+	BOOST_REQUIRE(mkdtemp(dir));
+
+	String path = String(dir) + "/spool";
+
+	{
+		PerfdataSpool::Ptr spool = new PerfdataSpool(path, 1024 * 1024);
+		spool->Append({ String(100, 'a') });
+	}
+
+	{
+		PerfdataSpool::Ptr spool = new PerfdataSpool(path, 150);
+		spool->Append({ String(100, 'b') });
+
+		/* The oldest segment has been dropped to get below the limit. */
+		BOOST_CHECK(DrainAll(spool) == std::vector<String>({ String(100, 'b') }));
+		BOOST_CHECK(spool->IsEmpty());
+	}
+
+	Utility::RemoveDirRecursive(dir);
+}
+#endif /* _WIN32 */
+
+BOOST_AUTO_TEST_SUITE_END()
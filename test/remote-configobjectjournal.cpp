@@ -0,0 +1,72 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/configobjectjournal.hpp"
+#include "base/configuration.hpp"
+#include "base/dictionary.hpp"
+#include "base/utility.hpp"
+#include <BoostTestTargetConfig.h>
+#include <fstream>
+#include <stdlib.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(remote_configobjectjournal)
+
+BOOST_AUTO_TEST_CASE(add_remove_compact)
+{
+	char dir[] = "/tmp/configobjectjournal-XXXXXX";
+	BOOST_REQUIRE(mkdtemp(dir));
+
+	String oldDataDir = Configuration::DataDir;
+	Configuration::DataDir = dir;
+
+	Type::Ptr type = Type::GetByName("Zone");
+	BOOST_REQUIRE(type);
+
+	auto journal (ConfigObjectJournal::GetInstance());
+
+	for (int i = 0; i < 10; i++)
+		journal->Add(type, "zone" + std::to_string(i), true, new Dictionary({ { "global", true }, { "version", i } }));
+
+	for (int i = 0; i < 10; i += 2)
+		BOOST_CHECK(journal->Remove(type, "zone" + std::to_string(i)));
+
+	BOOST_CHECK(!journal->Remove(type, "zone0"));
+	BOOST_CHECK(journal->GetConfig(type, "zone0").IsEmpty());
+
+	String config = journal->GetConfig(type, "zone3");
+	BOOST_CHECK(config.Find("object Zone \"zone3\"") != String::NPos);
+	BOOST_CHECK(config.Find("ignore_on_error") != String::NPos);
+	BOOST_CHECK(config.Find("version = 3") != String::NPos);
+
+	auto size ([]() {
+		std::ifstream fp (ConfigObjectJournal::GetPath().CStr(), std::ifstream::binary | std::ifstream::ate);
+		return static_cast<std::streamoff>(fp.tellg());
+	});
+
+	std::streamoff before = size();
+
+	journal->Compact(true);
+
+	BOOST_CHECK(size() < before);
+	BOOST_CHECK(journal->GetConfig(type, "zone0").IsEmpty());
+
+	for (int i = 1; i < 10; i += 2)
+		BOOST_CHECK(journal->GetConfig(type, "zone" + std::to_string(i)).Find("version = " + std::to_string(i)) != String::NPos);
+
+	/* Appending after the compaction has to keep the offsets right. */
+	journal->Add(type, "zone10", false, new Dictionary({ { "version", 10 } }));
+	BOOST_CHECK(journal->GetConfig(type, "zone10").Find("version = 10") != String::NPos);
+	BOOST_CHECK(journal->GetConfig(type, "zone9").Find("version = 9") != String::NPos);
+
+	for (int i = 1; i <= 10; i += 2)
+		journal->Remove(type, "zone" + std::to_string(i));
+
+	journal->Remove(type, "zone10");
+	journal->Compact(true);
+
+	Utility::RemoveDirRecursive(dir);
+	Configuration::DataDir = oldDataDir;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,107 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/filterutility.hpp"
+#include "remote/zone.hpp"
+#include "base/configtype.hpp"
+#include "base/convert.hpp"
+#include "base/dictionary.hpp"
+#include "base/scriptframe.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(remote_filterutility)
+
+BOOST_AUTO_TEST_CASE(compile_filter)
+{
+	Expression::Ptr expr = FilterUtility::CompileFilter("a == b");
+
+	BOOST_CHECK(expr);
+	BOOST_CHECK(FilterUtility::CompileFilter("a == b") == expr);
+	BOOST_CHECK(FilterUtility::CompileFilter("a != b") != expr);
+
+	/* Syntax errors are thrown when evaluating the filter, and invalid filters aren't cached. */
+	ScriptFrame frame (true);
+	Expression::Ptr invalid = FilterUtility::CompileFilter("a == ");
+
+	BOOST_CHECK_THROW(invalid->Evaluate(frame), std::exception);
+	BOOST_CHECK(FilterUtility::CompileFilter("a == ") != invalid);
+
+	for (int i = 0; i < 1000; i++)
+		FilterUtility::CompileFilter("a == " + Convert::ToString(i));
+
+	BOOST_CHECK(FilterUtility::CompileFilter("a == b") != expr);
+}
+
+BOOST_AUTO_TEST_CASE(query_page)
+{
+	QueryPage page = FilterUtility::GetQueryPage(new Dictionary());
+
+	BOOST_CHECK(!page.IsPaginated());
+
+	page = FilterUtility::GetQueryPage(new Dictionary({ { "limit", 10 }, { "cursor", "host1!ping" } }));
+
+	BOOST_CHECK(page.IsPaginated());
+	BOOST_CHECK(page.Limit == 10);
+	BOOST_CHECK(page.Cursor == "host1!ping");
+
+	BOOST_CHECK_THROW(FilterUtility::GetQueryPage(new Dictionary({ { "limit", -1 } })), std::invalid_argument);
+	BOOST_CHECK_THROW(FilterUtility::GetQueryPage(new Dictionary({ { "limit", 1.5 } })), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(changed_since)
+{
+	ApiUser::Ptr user = new ApiUser();
+	user->SetPermissions(new Array({ "*" }), true);
+
+	auto type (ConfigType::Get<Zone>());
+
+	Zone::Ptr zone1 = new Zone();
+	zone1->SetName("changed_since1", true);
+	zone1->Register();
+
+	uint_fast64_t revision = type->GetRevision();
+
+	BOOST_CHECK(zone1->GetRevision() == revision);
+
+	Zone::Ptr zone2 = new Zone();
+	zone2->SetName("changed_since2", true);
+	zone2->Register();
+
+	BOOST_CHECK(zone2->GetRevision() > revision);
+	BOOST_CHECK(type->GetRevision() == zone2->GetRevision());
+
+	QueryDescription qd;
+	qd.Types.insert("Zone");
+	qd.Permission = "objects/query/Zone";
+	qd.ChangedSince = revision;
+
+	Dictionary::Ptr query = new Dictionary({ { "type", "Zone" } });
+
+	BOOST_CHECK(FilterUtility::IsUnfilteredQuery(qd, query, user));
+
+	std::vector<Value> objs = FilterUtility::GetFilterTargets(qd, query, user);
+
+	BOOST_CHECK(objs.size() == 1 && objs[0] == zone2);
+
+	revision = type->GetRevision();
+	zone1->ModifyAttribute("global", true);
+
+	BOOST_CHECK(type->GetRevision() > revision);
+
+	qd.ChangedSince = revision;
+	objs = FilterUtility::GetFilterTargets(qd, query, user);
+
+	BOOST_CHECK(objs.size() == 1 && objs[0] == zone1);
+
+	revision = type->GetRevision();
+	zone1->Unregister();
+	zone2->Unregister();
+
+	BOOST_CHECK(type->GetRevision() > revision);
+
+	query->Set("filter", "zone.global");
+	BOOST_CHECK(!FilterUtility::IsUnfilteredQuery(qd, query, user));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
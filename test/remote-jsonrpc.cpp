@@ -0,0 +1,60 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/jsonrpc.hpp"
+#include "base/json.hpp"
+#include <BoostTestTargetConfig.h>
+
+using namespace icinga;
+
+BOOST_AUTO_TEST_SUITE(remote_jsonrpc)
+
+BOOST_AUTO_TEST_CASE(shared_message)
+{
+	Dictionary::Ptr message = new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", "event::Heartbeat" },
+		{ "params", new Dictionary({ { "timeout", 120 } }) }
+	});
+
+	JsonRpcSharedMessage::Ptr shared = new JsonRpcSharedMessage(message);
+
+	auto json (shared->GetEncoded(false));
+	auto binary (shared->GetEncoded(true));
+
+	BOOST_CHECK(shared->GetEncoded(false) == json);
+	BOOST_CHECK(shared->GetEncoded(true) == binary);
+
+	BOOST_CHECK(!JsonRpc::IsBinaryMessage(*json));
+	BOOST_CHECK(JsonRpc::IsBinaryMessage(*binary));
+
+	BOOST_CHECK(*json == JsonEncode(message));
+	BOOST_CHECK(JsonEncode(JsonRpc::DecodeMessage(*binary)) == *json);
+}
+
+BOOST_AUTO_TEST_CASE(shared_message_compact)
+{
+	Dictionary::Ptr message = new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", "event::CheckResult" },
+		{ "params", new Dictionary({ { "host", "example" }, { "cr", new Dictionary({ { "command", "/bin/true" } }) } }) }
+	});
+
+	Dictionary::Ptr compactMessage = new Dictionary({
+		{ "jsonrpc", "2.0" },
+		{ "method", "event::CheckResult" },
+		{ "params", new Dictionary({ { "host", "example" }, { "cr", new Dictionary() }, { "compact", true } }) }
+	});
+
+	JsonRpcSharedMessage::Ptr shared = new JsonRpcSharedMessage(message, compactMessage);
+
+	BOOST_CHECK(*shared->GetEncoded(false) == JsonEncode(message));
+	BOOST_CHECK(*shared->GetEncoded(false, true) == JsonEncode(compactMessage));
+	BOOST_CHECK(JsonEncode(JsonRpc::DecodeMessage(*shared->GetEncoded(true, true))) == JsonEncode(compactMessage));
+
+	/* Without a compact variant, all peers get the full message. */
+	JsonRpcSharedMessage::Ptr full = new JsonRpcSharedMessage(message);
+
+	BOOST_CHECK(full->GetEncoded(false, true) == full->GetEncoded(false));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
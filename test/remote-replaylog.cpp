@@ -0,0 +1,163 @@
+/* Icinga 2 | (c) 2012 Icinga GmbH | GPLv2+ */
+
+#include "remote/replaylog.hpp"
+#include "base/dictionary.hpp"
+#include "base/netstring.hpp"
+#include "base/utility.hpp"
+#include <BoostTestTargetConfig.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+using namespace icinga;
+
+/**
+ * Writes a segment with one message per second starting at 1000 and its index
+ */
+static String WriteSegment(size_t messages, std::vector<uint_fast64_t>& offsets)
+{
+	std::fstream fp;
+	String path = Utility::CreateTempFile("replaylog-XXXXXX", 0600, fp);
+
+	ReplayLogIndexWriter index;
+	index.Open(path + ".idx", 0);
+
+	std::string buffer;
+
+	for (size_t i = 0; i < messages; i++) {
+		offsets.push_back(buffer.size());
+		index.AddMessage(buffer.size(), 1000 + i, "zone", false);
+		NetString::AppendStringToBuffer(buffer, "message " + std::to_string(i));
+	}
+
+	fp << buffer;
+	fp.close();
+	index.Close();
+
+	return path;
+}
+
+static void RemoveSegment(const String& path)
+{
+	(void)unlink(path.CStr());
+	(void)unlink((path + ".idx").CStr());
+}
+
+BOOST_AUTO_TEST_SUITE(remote_replaylog)
+
+BOOST_AUTO_TEST_CASE(read)
+{
+	std::vector<uint_fast64_t> offsets;
+	String path = WriteSegment(1000, offsets);
+
+	ReplayLogSegment segment (path);
+	uint_fast64_t offset = 0;
+	String message;
+	size_t count = 0;
+
+	while (segment.ReadMessage(offset, message)) {
+		BOOST_CHECK_EQUAL(message, "message " + std::to_string(count));
+		count++;
+	}
+
+	BOOST_CHECK_EQUAL(count, 1000);
+	BOOST_CHECK_EQUAL(offset, segment.GetSize());
+
+	RemoveSegment(path);
+}
+
+BOOST_AUTO_TEST_CASE(seek)
+{
+	std::vector<uint_fast64_t> offsets;
+	String path = WriteSegment(1000, offsets);
+
+	ReplayLogIndex index;
+	BOOST_CHECK(index.Load(path + ".idx"));
+
+	BOOST_CHECK(index.IsLoaded());
+	BOOST_CHECK_EQUAL(index.Seek(999), 0);
+
+	for (double ts : { 1000.0, 1255.0, 1256.0, 1500.0, 1999.0, 5000.0 }) {
+		uint_fast64_t offset = index.Seek(ts);
+
+		/* Never skip a newer message... */
+		auto pos (std::find(offsets.begin(), offsets.end(), offset));
+		BOOST_REQUIRE(pos != offsets.end());
+		BOOST_CHECK(1000 + (pos - offsets.begin()) <= ts + 1);
+
+		/* ...but skip as much as the index allows. */
+		BOOST_CHECK(1000 + (pos - offsets.begin()) + ReplayLogIndex::Interval > std::min(ts, 1999.0));
+	}
+
+	RemoveSegment(path);
+
+	ReplayLogIndex missing;
+	BOOST_CHECK(!missing.Load(path + ".idx"));
+	BOOST_CHECK_EQUAL(missing.Seek(5000), 0);
+}
+
+BOOST_AUTO_TEST_CASE(truncated)
+{
+	std::vector<uint_fast64_t> offsets;
+	String path = WriteSegment(3, offsets);
+
+	(void)truncate(path.CStr(), offsets[2] + 3);
+
+	ReplayLogSegment segment (path);
+	uint_fast64_t offset = 0;
+	String message;
+
+	BOOST_CHECK(segment.ReadMessage(offset, message));
+	BOOST_CHECK(segment.ReadMessage(offset, message));
+	BOOST_CHECK_THROW(segment.ReadMessage(offset, message), std::invalid_argument);
+
+	RemoveSegment(path);
+}
+
+static Dictionary::Ptr MakeMessage(const String& method, const String& object, bool keep = false)
+{
+	return new Dictionary({
+		{ "method", method },
+		{ "params", new Dictionary({
+			{ "object", object },
+			{ "keep", keep }
+		}) }
+	});
+}
+
+BOOST_AUTO_TEST_CASE(compaction)
+{
+	ReplayLogCompaction::Register("test::SetState", {
+		[](const Dictionary::Ptr& params) -> String { return params->Get("object"); },
+		[](const Dictionary::Ptr& params, Value&) -> bool { return params->Get("keep").ToBool(); }
+	});
+
+	BOOST_CHECK(ReplayLogCompaction::IsCompactable("test::SetState"));
+	BOOST_CHECK(!ReplayLogCompaction::IsCompactable("test::Notify"));
+
+	ReplayLogCompaction compaction;
+
+	compaction.Add(MakeMessage("test::SetState", "a"), 1);
+	compaction.Add(MakeMessage("test::SetState", "b"), 2);
+	compaction.Add(MakeMessage("test::SetState", "a", true), 3);
+	compaction.Add(MakeMessage("test::Notify", "a"), 4);
+	compaction.Add(MakeMessage("test::SetState", "a"), 5);
+	compaction.Add(MakeMessage("test::SetState", "a"), (uint_fast64_t(1) << 40u) | 1u);
+
+	/* Superseded by a later message for the same object... */
+	BOOST_CHECK(!compaction.ShouldReplay("test::SetState", 1));
+	BOOST_CHECK(!compaction.ShouldReplay("test::SetState", 5));
+	BOOST_CHECK_EQUAL(compaction.GetSuperseded(), 2);
+
+	/* ...unless the policy wants to keep it. */
+	BOOST_CHECK(compaction.ShouldReplay("test::SetState", 3));
+	BOOST_CHECK(compaction.ShouldReplay("test::SetState", 2));
+	BOOST_CHECK(compaction.ShouldReplay("test::SetState", (uint_fast64_t(1) << 40u) | 1u));
+	BOOST_CHECK(compaction.ShouldReplay("test::Notify", 4));
+
+	/* Messages written after the first pass. */
+	BOOST_CHECK(compaction.ShouldReplay("test::SetState", (uint_fast64_t(1) << 40u) | 2u));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -95,23 +95,6 @@ void ClassCompiler::HandleLibrary(const std::string& library, const ClassDebugIn
 	m_Library = library;
 }
 
-unsigned long ClassCompiler::SDBM(const std::string& str, size_t len = std::string::npos)
-{
-	unsigned long hash = 0;
-	size_t current = 0;
-
-	for (const char& ch : str) {
-		if (current >= len)
-			break;
-
-		hash = ch + (hash << 6) + (hash << 16) - hash;
-
-		current++;
-	}
-
-	return hash;
-}
-
 static int TypePreference(const std::string& type)
 {
 	if (type == "Value")
@@ -247,67 +230,8 @@ void ClassCompiler::HandleClass(const Klass& klass, const ClassDebugInfo&)
 	m_Header << "\t" << "int GetFieldId(const String& name) const override;" << std::endl;
 
 	m_Impl << "int TypeImpl<" << klass.Name << ">::GetFieldId(const String& name) const" << std::endl
-		<< "{" << std::endl;
-
-	if (!klass.Fields.empty()) {
-		m_Impl << "\t" << "int offset = ";
-
-		if (!klass.Parent.empty())
-			m_Impl << klass.Parent << "::TypeInstance->GetFieldCount()";
-		else
-			m_Impl << "0";
-
-		m_Impl << ";" << std::endl << std::endl;
-	}
-
-	std::map<int, std::vector<std::pair<int, std::string> > > jumptable;
-
-	int hlen = 0, collisions = 0;
-
-	do {
-		int num = 0;
-
-		hlen++;
-		jumptable.clear();
-		collisions = 0;
-
-		for (const Field& field : klass.Fields) {
-			auto hash = static_cast<int>(SDBM(field.Name, hlen));
-			jumptable[hash].emplace_back(num, field.Name);
-			num++;
-
-			if (jumptable[hash].size() > 1)
-				collisions++;
-		}
-	} while (collisions >= 5 && hlen < 8);
-
-	if (!klass.Fields.empty()) {
-		m_Impl << "\tswitch (static_cast<int>(Utility::SDBM(name, " << hlen << "))) {" << std::endl;
-
-		for (const auto& itj : jumptable) {
-			m_Impl << "\t\tcase " << itj.first << ":" << std::endl;
-
-			for (const auto& itf : itj.second) {
-				m_Impl << "\t\t\t" << "if (name == \"" << itf.second << "\")" << std::endl
-					<< "\t\t\t\t" << "return offset + " << itf.first << ";" << std::endl;
-			}
-
-			m_Impl << std::endl
-					<< "\t\t\tbreak;" << std::endl;
-		}
-
-		m_Impl << "\t}" << std::endl;
-	}
-
-	m_Impl << std::endl
-		<< "\t" << "return ";
-
-	if (!klass.Parent.empty())
-		m_Impl << klass.Parent << "::TypeInstance->GetFieldId(name)";
-	else
-		m_Impl << "-1";
-
-	m_Impl << ";" << std::endl
+		<< "{" << std::endl
+		<< "\t" << "return LookupFieldId(name);" << std::endl
 		<< "}" << std::endl << std::endl;
 
 	/* GetFieldInfo */
@@ -378,6 +302,14 @@ void ClassCompiler::HandleClass(const Klass& klass, const ClassDebugInfo&)
 		<< "\t" << "return TypeHelper<" << klass.Name << ", " << ((klass.Attributes & TAVarArgConstructor) ? "true" : "false") << ">::GetFactory();" << std::endl
 		<< "}" << std::endl << std::endl;
 
+	/* GetInstanceSize */
+	m_Header << "\t" << "size_t GetInstanceSize() const override;" << std::endl;
+
+	m_Impl << "size_t TypeImpl<" << klass.Name << ">::GetInstanceSize() const" << std::endl
+		<< "{" << std::endl
+		<< "\t" << "return sizeof(" << klass.Name << ");" << std::endl
+		<< "}" << std::endl << std::endl;
+
 	/* GetLoadDependencies */
 	m_Header << "\t" << "std::vector<String> GetLoadDependencies() const override;" << std::endl;
 
@@ -1001,7 +933,9 @@ void ClassCompiler::HandleClass(const Klass& klass, const ClassDebugInfo&)
 					<< "\t" << "virtual void Notify" << field.GetFriendlyName() << "(const Value& cookie = Empty);" << std::endl;
 
 			m_Impl << "void ObjectImpl<" << klass.Name << ">::Notify" << field.GetFriendlyName() << "(const Value& cookie)" << std::endl
-				<< "{" << std::endl;
+				<< "{" << std::endl
+				<< "\t" << "if (On" << field.GetFriendlyName() << "Changed.empty())" << std::endl
+				<< "\t\t" << "return;" << std::endl << std::endl;
 
 			if (field.Name != "active") {
 				m_Impl << "\t" << "auto *dobj = dynamic_cast<ConfigObject *>(this);" << std::endl
@@ -1051,8 +985,8 @@ void ClassCompiler::HandleClass(const Klass& klass, const ClassDebugInfo&)
 		m_Header << "public:" << std::endl;
 		
 		for (const Field& field : klass.Fields) {
-			m_Header << "\t" << "static boost::signals2::signal<void (const intrusive_ptr<" << klass.Name << ">&, const Value&)> On" << field.GetFriendlyName() << "Changed;" << std::endl;
-			m_Impl << std::endl << "boost::signals2::signal<void (const intrusive_ptr<" << klass.Name << ">&, const Value&)> ObjectImpl<" << klass.Name << ">::On" << field.GetFriendlyName() << "Changed;" << std::endl << std::endl;
+			m_Header << "\t" << "static ObserverList<const intrusive_ptr<" << klass.Name << ">&, const Value&> On" << field.GetFriendlyName() << "Changed;" << std::endl;
+			m_Impl << std::endl << "ObserverList<const intrusive_ptr<" << klass.Name << ">&, const Value&> ObjectImpl<" << klass.Name << ">::On" << field.GetFriendlyName() << "Changed;" << std::endl << std::endl;
 		}
 	}
 
@@ -1433,6 +1367,7 @@ void ClassCompiler::CompileStream(const std::string& path, std::istream& input,
 		<< "#include \"base/array.hpp\"" << std::endl
 		<< "#include \"base/atomic.hpp\"" << std::endl
 		<< "#include \"base/dictionary.hpp\"" << std::endl
+		<< "#include \"base/observerlist.hpp\"" << std::endl
 		<< "#include <boost/signals2.hpp>" << std::endl << std::endl;
 
 	oimpl << "#include \"base/exception.hpp\"" << std::endl
@@ -233,7 +233,6 @@ private:
 
 	std::map<std::pair<std::string, std::string>, Field> m_MissingValidators;
 
-	static unsigned long SDBM(const std::string& str, size_t len);
 	static std::string BaseName(const std::string& path);
 	static std::string FileNameToGuardName(const std::string& path);
 };